@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <ESPAsyncWebServer.h>
+#include <array>
+#include <cstdint>
+#include <mutex>
+
+// Number of client addresses with their own budget. The least recently seen one is
+// replaced by a new client.
+#ifndef ADMISSION_MAX_CLIENTS
+#define ADMISSION_MAX_CLIENTS 8
+#endif
+
+// Rate (requests/s) and burst of each endpoint class, per client and for all clients.
+// The control class has its own total budget, so read traffic cannot use it up.
+#ifndef ADMISSION_CONTROL_RATE
+#define ADMISSION_CONTROL_RATE 10
+#endif
+#ifndef ADMISSION_CONTROL_BURST
+#define ADMISSION_CONTROL_BURST 20
+#endif
+#ifndef ADMISSION_CONTROL_TOTAL_RATE
+#define ADMISSION_CONTROL_TOTAL_RATE 20
+#endif
+#ifndef ADMISSION_CONTROL_TOTAL_BURST
+#define ADMISSION_CONTROL_TOTAL_BURST 40
+#endif
+
+#ifndef ADMISSION_READ_RATE
+#define ADMISSION_READ_RATE 5
+#endif
+#ifndef ADMISSION_READ_BURST
+#define ADMISSION_READ_BURST 15
+#endif
+#ifndef ADMISSION_READ_TOTAL_RATE
+#define ADMISSION_READ_TOTAL_RATE 12
+#endif
+#ifndef ADMISSION_READ_TOTAL_BURST
+#define ADMISSION_READ_TOTAL_BURST 30
+#endif
+
+#ifndef ADMISSION_WRITE_RATE
+#define ADMISSION_WRITE_RATE 2
+#endif
+#ifndef ADMISSION_WRITE_BURST
+#define ADMISSION_WRITE_BURST 6
+#endif
+#ifndef ADMISSION_WRITE_TOTAL_RATE
+#define ADMISSION_WRITE_TOTAL_RATE 4
+#endif
+#ifndef ADMISSION_WRITE_TOTAL_BURST
+#define ADMISSION_WRITE_TOTAL_BURST 10
+#endif
+
+enum class AdmissionClass_t : uint8_t {
+    Control, // /api/limit/*, /api/power/*
+    Read, // other GET requests of the web api
+    Write, // other requests of the web api
+    Count,
+};
+
+struct AdmissionClassStats_t {
+    uint32_t Admitted;
+    uint32_t Rejected;
+};
+
+struct AdmissionStats_t {
+    uint32_t Clients;
+    std::array<AdmissionClassStats_t, static_cast<size_t>(AdmissionClass_t::Count)> Classes;
+};
+
+// Token buckets per client address and endpoint class, checked by a middleware of the
+// web server before a handler allocates anything. The webapp files are not limited.
+class AdmissionControlClass {
+public:
+    AdmissionControlClass();
+
+    // Returns 0 if the request is admitted, otherwise the seconds until it would be
+    uint32_t check(AsyncWebServerRequest* request);
+
+    AdmissionStats_t getStats();
+
+    static const char* getClassName(const AdmissionClass_t cls);
+
+private:
+    static constexpr size_t ClassCount = static_cast<size_t>(AdmissionClass_t::Count);
+
+    // Tokens in 1/1000 requests
+    struct Bucket_t {
+        uint32_t Tokens;
+        uint32_t LastRefill; // millis()
+    };
+    using Buckets_t = std::array<Bucket_t, ClassCount>;
+
+    struct Limit_t {
+        uint16_t Rate;
+        uint16_t Burst;
+    };
+    static const Limit_t ClientLimits[ClassCount];
+    static const Limit_t TotalLimits[ClassCount];
+
+    struct Client_t {
+        uint32_t Address;
+        uint32_t LastSeen; // millis()
+        Buckets_t Buckets;
+    };
+
+    static bool classify(AsyncWebServerRequest* request, AdmissionClass_t& cls);
+    static void fill(Buckets_t& buckets, const Limit_t limits[], const uint32_t now);
+    static void refill(Bucket_t& bucket, const Limit_t& limit, const uint32_t now);
+    static uint32_t getRetryAfter(const Bucket_t& bucket, const Limit_t& limit);
+
+    Client_t& getClient(const uint32_t address, const uint32_t now);
+
+    std::mutex _mutex;
+    std::array<Client_t, ADMISSION_MAX_CLIENTS> _clients = {};
+    Buckets_t _total;
+    std::array<AdmissionClassStats_t, ClassCount> _stats = {};
+};
+
+extern AdmissionControlClass AdmissionControl;
@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+struct BootPhase_t {
+    const char* Name;
+    uint32_t Start; // ms since boot
+    uint32_t Duration; // ms
+};
+
+class BootTimingClass {
+public:
+    // Ends the running phase and starts a new one
+    void beginPhase(const char* name);
+    void endPhase();
+
+    std::vector<BootPhase_t> getPhases();
+
+private:
+    std::vector<BootPhase_t> _phases;
+    bool _running = false;
+    std::mutex _mutex;
+};
+
+extern BootTimingClass BootTiming;
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Arduino.h>
+#include <cstdint>
+#include <mutex>
+
+enum class Cert_t : uint8_t {
+    MqttRootCa,
+    MqttClientCert,
+    MqttClientKey,
+    FirmwareRootCa,
+    InfluxRootCa,
+    Count,
+};
+
+// Keeps the PEM certificates and keys of the TLS connections (MQTT, firmware pull,
+// Influx) in files of their own, they are only read while a client connects or the
+// web API shows them. CONFIG_T only holds a handle (crc32 of the content), which changes with
+// the file. Without a file the default of defaults.h is used.
+class CertStoreClass {
+public:
+    String read(const Cert_t cert);
+
+    // Replaces the content, the file is only written if it differs. Returns the new handle.
+    uint32_t write(const Cert_t cert, const char* pem);
+
+    uint32_t getHandle(const Cert_t cert);
+
+    static const char* getFilename(const Cert_t cert);
+
+private:
+    static uint32_t calcHandle(const char* pem, const size_t len);
+    static const char* getDefault(const Cert_t cert);
+    String readLocked(const Cert_t cert);
+
+    std::mutex _mutex;
+};
+
+extern CertStoreClass CertStore;
@@ -2,14 +2,46 @@
 #pragma once
 
 #include "PinMapping.h"
+#include <ArduinoJson.h>
+#include <Print.h>
+#include <ReaderPreferringMutex.h>
 #include <TaskSchedulerDeclarations.h>
+#include <array>
+#include <atomic>
 #include <condition_variable>
 #include <cstdint>
 #include <mutex>
+#include <shared_mutex>
+#include <vector>
 
+// The configuration is stored as binary image. A JSON file is only used for
+// backup and restore. An uploaded backup is applied by restoreJson(), the file
+// of an older version is imported (and removed) at the next boot.
 #define CONFIG_FILENAME "/config.json"
+#define CONFIG_IMAGE_FILENAME "/config.bin"
+#define CONFIG_RESTORE_FILENAME "/config.restore"
+#define CONFIG_IMAGE_MAGIC 0x4746434F // "OCFG"
+#define CONFIG_IMAGE_VERSION 1
 #define CONFIG_VERSION 0x00011d00 // 0.1.29 // make sure to clean all after change
 
+// A requested write is performed once no further request arrived for this time (ms)
+#ifndef CONFIG_WRITE_DELAY
+#define CONFIG_WRITE_DELAY 1000
+#endif
+
+// Upper limit (ms) a requested write is deferred by subsequent requests
+#ifndef CONFIG_WRITE_MAX_DELAY
+#define CONFIG_WRITE_MAX_DELAY 5000
+#endif
+
+// Largest backup accepted by a restore (bytes)
+#ifndef CONFIG_RESTORE_MAX_SIZE
+#define CONFIG_RESTORE_MAX_SIZE (64 * 1024)
+#endif
+
+// Deepest nesting of a backup, the inverter channels are the deepest level
+#define CONFIG_RESTORE_NESTING_LIMIT 5
+
 #define WIFI_MAX_SSID_STRLEN 32
 #define WIFI_MAX_PASSWORD_STRLEN 64
 #define WIFI_MAX_HOSTNAME_STRLEN 31
@@ -27,11 +59,33 @@
 #define MQTT_MAX_CERT_STRLEN 2560
 
 #define INV_MAX_NAME_STRLEN 31
+// Only the configured inverters are held in memory. This is just the upper limit.
+#ifndef INV_MAX_COUNT
+#ifdef BOARD_HAS_PSRAM
+#define INV_MAX_COUNT 30
+#else
 #define INV_MAX_COUNT 10
+#endif
+#endif
 #define INV_MAX_CHAN_COUNT 6
 
+// Inverters can be assigned to one of the groups 1 - INV_MAX_GROUP_COUNT, 0 is none
+#define INV_MAX_GROUP_COUNT 8
+
+// Number of slots of the serial lookup table, has to be a power of two larger than INV_MAX_COUNT
+#define INV_INDEX_SIZE 64
+
 #define CHAN_MAX_NAME_STRLEN 31
 
+#define POWERCTRL_MAX_TOPIC_STRLEN 128
+
+#define INFLUX_MAX_URL_STRLEN 128
+#define INFLUX_MAX_TOKEN_STRLEN 128
+
+#define RAWSTATS_MAX_HOST_STRLEN 128
+
+#define SYSLOG_MAX_HOST_STRLEN 128
+
 #define DEV_MAX_MAPPING_NAME_STRLEN 63
 #define LOCALE_STRLEN 2
 
@@ -54,6 +108,17 @@ struct INVERTER_CONFIG_T {
     bool ZeroYieldDayOnMidnight;
     bool ClearEventlogOnMidnight;
     bool YieldDayCorrection;
+    uint8_t Group; // 0 = none
+
+    // Intervals (s) of the requests, 0 means on every poll
+    struct {
+        uint16_t StatsInterval;
+        uint16_t AlarmInterval;
+        uint16_t LimitInterval;
+        bool AlarmOnDemand;
+        bool GridProfileOnDemand;
+    } PollPlan;
+
     CHANNEL_CONFIG_T channel[INV_MAX_CHAN_COUNT];
 };
 
@@ -100,6 +165,32 @@ struct CONFIG_T {
         bool Retain;
         uint32_t PublishInterval;
         bool CleanSession;
+        bool PublishOnChange;
+        bool JsonPayload;
+
+        struct {
+            bool Enabled;
+            uint16_t ReplayRate; // records per second
+        } Journal;
+
+        struct {
+            bool Enabled;
+            char Topic[MQTT_MAX_TOPIC_STRLEN + 1]; // shared by all DTUs of the cluster
+        } Cluster;
+
+        // Values published right after each response instead of with the publish interval
+        struct {
+            bool TotalAcPower; // ac/power
+            bool TotalDcPower; // dc/power
+            bool AcPower; // [serial]/0/power
+            bool DcPower; // [serial]/0/powerdc
+        } FastLane;
+
+        struct {
+            bool Publish; // totals of this DTU to [topic]dtu/[id]
+            bool Aggregate; // totals of all DTUs to [topic]total/...
+            char Topic[MQTT_MAX_TOPIC_STRLEN + 1]; // shared by all DTUs of the site
+        } Fleet;
 
         struct {
             char Topic[MQTT_MAX_TOPIC_STRLEN + 1];
@@ -114,20 +205,31 @@ struct CONFIG_T {
             char Topic[MQTT_MAX_TOPIC_STRLEN + 1];
             bool IndividualPanels;
             bool Expire;
+            bool DeviceDiscovery; // one config per device instead of one per entity
         } Hass;
 
         struct {
             bool Enabled;
-            char RootCaCert[MQTT_MAX_CERT_STRLEN + 1];
+            // Handles of the PEM files in CertStore, they change with the content
+            uint32_t RootCaCert;
             bool CertLogin;
-            char ClientCert[MQTT_MAX_CERT_STRLEN + 1];
-            char ClientKey[MQTT_MAX_CERT_STRLEN + 1];
+            uint32_t ClientCert;
+            uint32_t ClientKey;
         } Tls;
     } Mqtt;
 
     struct {
         uint64_t Serial;
         uint32_t PollInterval;
+        bool AdaptivePolling;
+        bool PollCalibration;
+        bool SnapshotPolling;
+        uint32_t FreshnessSloInterval; // s, 0 to disable
+        uint32_t FreshnessSloAge; // s, 0 to disable
+        uint32_t LimitMinInterval;
+        float LimitHysteresis;
+        bool NightStandby;
+        bool TxPowerControl;
         struct {
             uint8_t PaLevel;
         } Nrf;
@@ -159,18 +261,89 @@ struct CONFIG_T {
         uint8_t Brightness;
     } Led_Single[PINMAPPING_LED_COUNT];
 
-    INVERTER_CONFIG_T Inverter[INV_MAX_COUNT];
+    struct {
+        bool Enabled;
+        char MeterTopic[POWERCTRL_MAX_TOPIC_STRLEN + 1];
+        int32_t TargetPower;
+        float Kp;
+        float Ki;
+        uint32_t MeterTimeout;
+        uint8_t MinLimit;
+    } PowerControl;
+
+    struct {
+        bool Enabled;
+        char Url[INFLUX_MAX_URL_STRLEN + 1]; // udp://host:port or http(s)://host:port/write?...
+        char Token[INFLUX_MAX_TOKEN_STRLEN + 1];
+        uint32_t FlushInterval;
+        uint32_t RootCaCert; // handle of the PEM file in CertStore, checks https servers
+    } Influx;
+
+    struct {
+        bool Enabled;
+        uint16_t Port;
+        bool AllowWrite; // limit and power commands by the controls model
+    } Modbus;
+
+    struct {
+        bool Mqtt; // to [topic][serial]/raw
+        bool Udp;
+        char UdpHost[RAWSTATS_MAX_HOST_STRLEN + 1];
+        uint16_t UdpPort;
+        bool SkipFields; // no per field MQTT topics or json of the statistics
+    } RawStats;
+
+    struct {
+        bool Enabled;
+        char Host[SYSLOG_MAX_HOST_STRLEN + 1];
+        uint16_t Port;
+        uint8_t Format; // SyslogFormat_t
+        uint8_t Level; // highest MessageLevel_t which is sent
+    } Syslog;
+
+    struct {
+        uint32_t CacheTtl; // ms a rendered scrape is reused, 0 disables the cache
+    } Prometheus;
+
+    std::vector<INVERTER_CONFIG_T> Inverter;
     char Dev_PinMapping[DEV_MAX_MAPPING_NAME_STRLEN + 1];
 };
 
+enum class ConfigRestoreResult_t {
+    Applied, // active without a restart
+    RestartRequired, // settings which are only applied at boot changed or the file needs a migration
+    Invalid,
+};
+
 class ConfigurationClass {
 public:
     void init(Scheduler& scheduler);
     bool read();
     bool write();
     void migrate();
+
+    // Writes the configuration in the JSON format of CONFIG_FILENAME
+    bool exportJson(Print& output);
+
+    // Reads a backup in the format of CONFIG_FILENAME one top level member at a time
+    // into a staging configuration and validates it. Only a valid file replaces the
+    // configuration, which is written at once. The caller applies the changes to the
+    // running modules or restarts. error describes why a file is invalid.
+    ConfigRestoreResult_t restoreJson(const char* filename, String& error);
+
+    // Marks the configuration as changed. The file is written by the loop task
+    // after CONFIG_WRITE_DELAY so several changes in a row result in one write.
+    void requestWrite();
+    bool isWritePending();
+    // True if the last write of the file failed, until a write succeeds again
+    bool hasWriteFailed() const;
+    void flushPendingWrite();
+    void discardPendingWrite();
     CONFIG_T const& get();
 
+    // Incremented whenever a WriteGuard is released, before the change is written
+    uint32_t getChangeCount() const;
+
     class WriteGuard {
     public:
         WriteGuard();
@@ -179,18 +352,51 @@ public:
 
     private:
         std::unique_lock<std::mutex> _lock;
+        std::unique_lock<ReaderPreferringMutex> _inverterLock;
     };
 
     WriteGuard getWriteGuard();
 
+    // Readers of the inverter list outside of the loop task (web server, MQTT) hold it as
+    // long as they use an entry. Write guards wait for them before they add or remove one.
+    class ReadGuard {
+    public:
+        ReadGuard();
+
+    private:
+        std::shared_lock<ReaderPreferringMutex> _lock;
+    };
+
+    ReadGuard getReadGuard();
+
+    // Appends a new inverter with default settings. Returns nullptr if INV_MAX_COUNT is reached.
     INVERTER_CONFIG_T* getFreeInverterSlot();
     INVERTER_CONFIG_T* getInverterConfig(const uint64_t serial);
     void deleteInverterById(const uint8_t id);
 
 private:
     void loop();
+    void loadDefaults();
+    void serialize(std::vector<uint8_t>& image);
+    bool readImage();
+    bool importJson();
+    void fromJson(JsonDocument& doc);
+    void toJson(JsonDocument& doc);
+    void migrateJson(JsonDocument& doc);
+    static void initInverterConfig(INVERTER_CONFIG_T& inverter);
+    static uint8_t getInverterIndexSlot(const uint64_t serial);
+    void rebuildInverterIndex();
 
     Task _loopTask;
+
+    // Open addressing table of inverter positions + 1 (0 = empty slot) for getInverterConfig
+    std::array<uint8_t, INV_INDEX_SIZE> _inverterIndex = {};
+
+    std::mutex _writeRequestMutex;
+    bool _writePending = false;
+    uint32_t _writeFirstRequest = 0;
+    uint32_t _writeLastRequest = 0;
+    std::atomic<bool> _writeFailed { false };
 };
 
 extern ConfigurationClass Configuration;
@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <TaskSchedulerDeclarations.h>
+#include <array>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <mutex>
+#include <vector>
+
+// Interval (ms) over which the load is measured
+#ifndef CPU_LOAD_INTERVAL
+#define CPU_LOAD_INTERVAL 5000
+#endif
+
+// Number of tasks which are sampled per core if FreeRTOS keeps no run time stats
+#ifndef CPU_LOAD_MAX_TASKS
+#define CPU_LOAD_MAX_TASKS 32
+#endif
+
+struct CpuTaskLoad_t {
+    char Name[configMAX_TASK_NAME_LEN];
+    int8_t Core; // -1 if the task runs on both cores
+    uint8_t Priority;
+    float Load; // percent of one core
+    uint32_t StackHighWater; // bytes of the stack which were never used
+};
+
+struct CpuLoadStats_t {
+    bool Exact; // from the FreeRTOS run time stats instead of tick samples
+    std::array<float, portNUM_PROCESSORS> CoreLoad; // percent
+    std::vector<CpuTaskLoad_t> Tasks;
+};
+
+// Load of each core and task over the last interval. FreeRTOS run time stats are used
+// if they are compiled in. Otherwise the task which runs at each tick is counted, which
+// is exact enough for the capacity planning but misses tasks which run shorter than a tick.
+class CpuLoadClass {
+public:
+    CpuLoadClass();
+    void init(Scheduler& scheduler);
+
+    CpuLoadStats_t getStats();
+
+private:
+    struct Counter_t {
+        TaskHandle_t Task;
+        uint32_t Value;
+    };
+
+    void loop();
+    static uint32_t getCounter(const TaskStatus_t& status);
+
+    Task _loopTask;
+
+    std::vector<TaskStatus_t> _status;
+    std::vector<Counter_t> _lastCounters;
+    uint64_t _lastTime = 0;
+    std::array<uint32_t, portNUM_PROCESSORS> _lastTicks = {};
+
+    CpuLoadStats_t _stats = {};
+    std::mutex _mutex;
+};
+
+extern CpuLoadClass CpuLoad;
@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "EventBus.h"
+#include <Hoymiles.h>
+#include <TaskSchedulerDeclarations.h>
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Intervals between two statistics updates kept per inverter for the quantiles
+#ifndef DATA_FRESHNESS_WINDOW
+#define DATA_FRESHNESS_WINDOW 32
+#endif
+
+// Interval (s) in which the SLO violations are evaluated
+#ifndef DATA_FRESHNESS_CHECK_INTERVAL
+#define DATA_FRESHNESS_CHECK_INTERVAL 5
+#endif
+
+// Age of a data class which was not received since the boot
+#define DATA_FRESHNESS_NEVER UINT32_MAX
+
+struct DataFreshnessStats_t {
+    uint8_t Samples; // intervals in the window
+    uint32_t P50; // ms
+    uint32_t P95; // ms
+    uint32_t Max; // ms
+    uint32_t StatsAge; // ms since the last update of the class, DATA_FRESHNESS_NEVER if none
+    uint32_t DevInfoAge;
+    uint32_t LimitAge;
+    uint32_t AlarmAge;
+    bool Violated; // one of the SLOs (Dtu.FreshnessSloInterval, Dtu.FreshnessSloAge) is missed
+    uint32_t Violations; // checks with a missed SLO since the boot
+};
+
+// Tracks how fresh the data of each inverter is: The intervals between successful
+// statistics updates go into a rolling window from which p50, p95 and the maximum are
+// taken, and the age of the last devinfo, limit and alarm answer is reported next to
+// it. While an inverter is not polled (night, polling disabled) its reference is
+// dropped, so the gap until the next morning does not end up in the window.
+class DataFreshnessClass {
+public:
+    DataFreshnessClass();
+    void init(Scheduler& scheduler);
+
+    void getStats(InverterAbstract& inv, DataFreshnessStats_t& stats);
+
+    // Number of polled inverters which miss an SLO at the moment
+    uint8_t getViolatedCount();
+
+private:
+    void loop();
+    void onStatisticsUpdated(const EventData_t& event);
+
+    struct Inverter_t {
+        uint64_t Serial = 0;
+        uint32_t LastUpdate = 0;
+        std::array<uint32_t, DATA_FRESHNESS_WINDOW> Intervals = {};
+        uint8_t Count = 0;
+        uint8_t Next = 0;
+        bool Violated = false;
+        uint32_t Violations = 0;
+    };
+
+    Inverter_t* findInverter(const uint64_t serial);
+    void calculate(const Inverter_t& entry, DataFreshnessStats_t& stats) const;
+
+    Task _loopTask;
+
+    std::mutex _mutex;
+    std::vector<Inverter_t> _inverters;
+};
+
+extern DataFreshnessClass DataFreshness;
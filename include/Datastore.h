@@ -1,9 +1,138 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 #pragma once
 
+#include "Configuration.h"
+#include <Hoymiles.h>
 #include <TaskSchedulerDeclarations.h>
+#include <algorithm>
+#include <array>
 #include <mutex>
 
+struct DatastoreGroupTotals_t {
+    uint8_t MemberCount;
+    float AcYieldTotal;
+    float AcYieldDay;
+    float AcPower;
+    float DcPower;
+    double AcEnergy; // Wh
+    double DcEnergy; // Wh
+    uint8_t AcYieldTotalDigits;
+    uint8_t AcYieldDayDigits;
+    uint8_t AcPowerDigits;
+    uint8_t DcPowerDigits;
+    bool IsAllEnabledReachable;
+    uint32_t Skew; // ms between the oldest and the newest response of the reachable members
+};
+
+// Latest decoded values of all inverters, one array per field (structure of arrays). Row i
+// belongs to the inverter at position i, bit i of the masks tells the state of that row.
+// Aggregates are tight loops over one array, which the compiler can unroll and vectorize
+// instead of decoding every inverter through its statistics again.
+struct FleetTable_t {
+    using Mask_t = uint32_t;
+    static_assert(INV_MAX_COUNT <= sizeof(Mask_t) * 8, "Mask_t has to hold a bit per inverter");
+
+    uint8_t Count; // rows in use
+
+    std::array<uint64_t, INV_MAX_COUNT> Serial;
+    std::array<uint32_t, INV_MAX_COUNT> LastUpdate; // millis of the response
+    std::array<uint8_t, INV_MAX_COUNT> Group;
+    std::array<float, INV_MAX_COUNT> AcYieldTotal;
+    std::array<float, INV_MAX_COUNT> AcYieldDay;
+    std::array<float, INV_MAX_COUNT> AcPower;
+    std::array<float, INV_MAX_COUNT> DcPower;
+    std::array<float, INV_MAX_COUNT> DcPowerIrradiation;
+    std::array<float, INV_MAX_COUNT> DcIrradiationInstalled;
+    std::array<uint8_t, INV_MAX_COUNT> AcYieldTotalDigits;
+    std::array<uint8_t, INV_MAX_COUNT> AcYieldDayDigits;
+    std::array<uint8_t, INV_MAX_COUNT> AcPowerDigits;
+    std::array<uint8_t, INV_MAX_COUNT> DcPowerDigits;
+
+    Mask_t Valid; // row holds the values of a configured inverter
+    Mask_t Restored; // values are restored from the cache, not a response
+    Mask_t PollEnabled; // polled right now (not disabled at night)
+    Mask_t CfgPollEnabled; // polling enabled in the configuration
+    Mask_t Reachable;
+
+    static bool test(const Mask_t mask, const uint8_t i) { return (mask >> i) & 1; }
+    static void set(Mask_t& mask, const uint8_t i, const bool value)
+    {
+        mask = value ? mask | (1UL << i) : mask & ~(1UL << i);
+    }
+
+    // Rows which belong to group (1 - INV_MAX_GROUP_COUNT)
+    Mask_t groupMask(const uint8_t group) const
+    {
+        Mask_t mask = 0;
+        for (uint8_t i = 0; i < Count; i++) {
+            mask |= static_cast<Mask_t>(Group[i] == group) << i;
+        }
+        return mask;
+    }
+
+    // Rows whose value is above zero
+    template <typename T>
+    Mask_t positiveMask(const std::array<T, INV_MAX_COUNT>& values) const
+    {
+        Mask_t mask = 0;
+        for (uint8_t i = 0; i < Count; i++) {
+            mask |= static_cast<Mask_t>(values[i] > 0) << i;
+        }
+        return mask;
+    }
+
+    // The rows not in mask are multiplied by zero instead of being branched over
+    float sum(const std::array<float, INV_MAX_COUNT>& values, const Mask_t mask) const
+    {
+        float sum = 0;
+        for (uint8_t i = 0; i < Count; i++) {
+            sum += values[i] * static_cast<float>((mask >> i) & 1);
+        }
+        return sum;
+    }
+
+    uint8_t max(const std::array<uint8_t, INV_MAX_COUNT>& values, const Mask_t mask) const
+    {
+        uint8_t max = 0;
+        for (uint8_t i = 0; i < Count; i++) {
+            max = std::max<uint8_t>(max, values[i] * ((mask >> i) & 1));
+        }
+        return max;
+    }
+
+    // Time (ms) between the oldest and the newest response of the rows in mask
+    uint32_t span(const Mask_t mask) const
+    {
+        if (mask == 0) {
+            return 0;
+        }
+        // Relative to one of the rows, a millis() overflow in between does not matter
+        const uint32_t reference = LastUpdate[__builtin_ctz(mask)];
+        int32_t oldest = 0;
+        int32_t newest = 0;
+        for (uint8_t i = 0; i < Count; i++) {
+            const int32_t delta = test(mask, i) ? static_cast<int32_t>(LastUpdate[i] - reference) : 0;
+            oldest = std::min(oldest, delta);
+            newest = std::max(newest, delta);
+        }
+        return newest - oldest;
+    }
+
+    static uint8_t count(const Mask_t mask) { return __builtin_popcount(mask); }
+};
+
+// Interval (ms) of the refresh without an event. The totals are refreshed right after
+// new data or a changed configuration, this only covers inverters which became unreachable.
+#ifndef DATASTORE_REFRESH_INTERVAL
+#define DATASTORE_REFRESH_INTERVAL 5000
+#endif
+
+// Longest time (ms) between two responses of an inverter which is integrated to energy.
+// A longer gap (unreachable, disabled at night) is skipped instead of being bridged.
+#ifndef DATASTORE_ENERGY_MAX_GAP
+#define DATASTORE_ENERGY_MAX_GAP 300000
+#endif
+
 class DatastoreClass {
 public:
     DatastoreClass();
@@ -30,6 +159,14 @@ public:
     // Percentage (1-100) of total irradiation
     float getTotalDcIrradiation();
 
+    // AC and DC energy (Wh) of all inverters since boot, integrated from the power of
+    // consecutive responses. Unlike the yield counters they never decrease.
+    double getTotalAcEnergy();
+    double getTotalDcEnergy();
+
+    // Same as above for a single inverter, false if it has no responses yet
+    bool getInverterEnergy(const uint64_t serial, double& acEnergy, double& dcEnergy);
+
     // Amount of relevant digits for yield total
     uint32_t getTotalAcYieldTotalDigits();
 
@@ -57,13 +194,68 @@ public:
     // True if all enabled inverters are reachable
     bool getIsAllEnabledReachable();
 
+    // Time (ms) between the oldest and the newest response of the reachable inverters
+    uint32_t getTotalSkew();
+
+    // Totals of the inverters assigned to group (1 - INV_MAX_GROUP_COUNT), false for an invalid group
+    bool getGroupTotals(const uint8_t group, DatastoreGroupTotals_t& totals);
+
+    // Splits the limit across the members of the group which accept commands. Absolute limits
+    // are shared in proportion to the max power, relative limits are sent as is to every member.
+    // Returns the number of inverters which got the command.
+    uint8_t sendGroupLimit(const uint8_t group, const float limit, const PowerLimitControlType type);
+
+    // Copy of the latest decoded values of all inverters
+    void getFleetTable(FleetTable_t& table);
+
 private:
     void loop();
 
+    // Decodes the values of the inverter into row i of the table, false if the inverter
+    // was updated while reading. The row is left untouched in that case.
+    bool readInverter(InverterAbstract& inv, const bool cfgPollEnabled, const uint8_t group, const uint8_t i);
+    void clearRow(const uint8_t i);
+    void updateTotals();
+
+    // Trapezoidal integration of the power between the last two responses
+    struct InverterEnergy_t {
+        uint64_t Serial;
+        uint32_t LastUpdate;
+        float AcPower;
+        float DcPower;
+        double AcEnergy;
+        double DcEnergy;
+    };
+    void integrateEnergy(InverterEnergy_t& energy, const uint8_t i);
+
+    // Same sums as the DTU totals, built from the table as well
+    struct GroupTotals_t {
+        float AcYieldTotal;
+        float AcYieldDay;
+        float AcPower;
+        float DcPower;
+        double AcEnergy;
+        double DcEnergy;
+        uint8_t AcYieldTotalDigits;
+        uint8_t AcYieldDayDigits;
+        uint8_t AcPowerDigits;
+        uint8_t DcPowerDigits;
+        uint8_t MemberCount;
+        bool IsAllEnabledReachable;
+        uint32_t Skew;
+    };
+
     Task _loopTask;
 
     std::mutex _mutex;
 
+    FleetTable_t _table = {};
+    std::array<uint32_t, INV_MAX_COUNT> _generation = {};
+
+    std::array<InverterEnergy_t, INV_MAX_COUNT> _energy = {};
+    double _totalAcEnergy = 0;
+    double _totalDcEnergy = 0;
+
     float _totalAcYieldTotalEnabled = 0;
     float _totalAcYieldDayEnabled = 0;
     float _totalAcPowerEnabled = 0;
@@ -75,11 +267,14 @@ private:
     uint32_t _totalAcYieldDayDigits = 0;
     uint32_t _totalAcPowerDigits = 0;
     uint32_t _totalDcPowerDigits = 0;
+    uint32_t _totalSkew = 0;
     bool _isAtLeastOneReachable = false;
     bool _isAtLeastOneProducing = false;
     bool _isAllEnabledProducing = false;
     bool _isAllEnabledReachable = false;
     bool _isAtLeastOnePollEnabled = false;
+
+    std::array<GroupTotals_t, INV_MAX_GROUP_COUNT> _groups = {};
 };
 
 extern DatastoreClass Datastore;
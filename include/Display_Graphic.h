@@ -5,6 +5,7 @@
 #include "defaults.h"
 #include <TaskSchedulerDeclarations.h>
 #include <U8g2lib.h>
+#include <vector>
 
 #define CHART_HEIGHT 20 // chart area hight in pixels
 #define CHART_WIDTH 47 // chart area width in pixels
@@ -55,12 +56,16 @@ private:
     void calcLineHeights();
     void setFont(const uint8_t line);
     bool isValidDisplay();
+    void sendChangedTiles();
 
     Task _loopTask;
 
     U8G2* _display;
     DisplayGraphicDiagramClass _diagram;
 
+    // Copy of the buffer content which was last sent to the display
+    std::vector<uint8_t> _sentBuffer;
+
     bool _displayTurnedOn;
 
     DisplayType_t _display_type = DisplayType_t::None;
@@ -22,13 +22,32 @@ private:
 
     uint32_t getSecondsPerDot();
 
+    float getGraphValue(const uint8_t index) const;
+    void addGraphValue(const float value);
+    float getGraphMax() const;
+    void updateScaledValues(const uint8_t height, const float maxWatts);
+
     Task _averageTask;
     Task _dataPointTask;
 
     U8G2* _display = nullptr;
+
+    // Ring buffer, index 0 is the oldest value
     std::array<float, MAX_DATAPOINTS> _graphValues = {};
+    uint8_t _graphValuesStart = 0;
     uint8_t _graphValuesCount = 0;
 
+    // Slots of _graphValues with decreasing values, the first one holds the maximum
+    std::array<uint8_t, MAX_DATAPOINTS> _graphMaxQueue = {};
+    uint8_t _graphMaxQueueStart = 0;
+    uint8_t _graphMaxQueueCount = 0;
+
+    // Values scaled to the chart height, only updated if a value or the scale changed
+    std::array<int16_t, MAX_DATAPOINTS> _graphScaled = {};
+    bool _graphScaledValid = false;
+    uint8_t _graphScaledHeight = 0;
+    float _graphScaledMax = 0;
+
     uint8_t _chartWidth = MAX_DATAPOINTS;
 
     float _iRunningAverage = 0;
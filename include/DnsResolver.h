@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <IPAddress.h>
+#include <array>
+#include <mutex>
+
+// Number of host names which are resolved in the background
+#define DNS_RESOLVER_MAX_HOSTS 4
+
+#define DNS_RESOLVER_MAX_HOST_LEN 128
+
+// Minimum time (s) between two lookups of the same host. lwip keeps the answers
+// for their TTL, so a lookup within the TTL does not send a query.
+#ifndef DNS_RESOLVER_REFRESH_INTERVAL
+#define DNS_RESOLVER_REFRESH_INTERVAL 60
+#endif
+
+// Resolves host names without blocking the caller. The lookup is passed to the lwip
+// thread, which answers from its TTL respecting cache or sends the query and reports
+// the result in a callback. The last successful address of a host is kept and
+// returned also if a later lookup fails, so a slow or unreachable DNS server does not
+// prevent a reconnect to a known broker.
+class DnsResolverClass {
+public:
+    // Returns true and the address if it is known. IP address literals are parsed
+    // directly. Otherwise a lookup is started in the background if none is running and
+    // the last one is older than DNS_RESOLVER_REFRESH_INTERVAL. Never blocks.
+    bool resolve(const char* host, IPAddress& ip);
+
+private:
+    struct Entry_t {
+        char Host[DNS_RESOLVER_MAX_HOST_LEN];
+        IPAddress Ip;
+        bool Valid = false;
+        bool Pending = false;
+        uint32_t LastLookup = 0;
+        uint32_t LastUse = 0;
+    };
+
+    Entry_t& getEntry(const char* host);
+    void startLookup(Entry_t& entry);
+    void finishLookup(Entry_t& entry, const IPAddress* ip);
+
+    static void lookupTcpip(void* arg);
+    static void onFound(const char* name, const void* addr, void* arg);
+
+    std::array<Entry_t, DNS_RESOLVER_MAX_HOSTS> _entries;
+    std::mutex _mutex;
+};
+
+extern DnsResolverClass DnsResolver;
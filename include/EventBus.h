@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <TaskSchedulerDeclarations.h>
+#include <array>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <functional>
+#include <vector>
+
+// Number of events which can wait for the main loop. If it is full new events
+// are dropped, the consumers still run on their fallback interval then.
+#ifndef EVENT_BUS_QUEUE_SIZE
+#define EVENT_BUS_QUEUE_SIZE 32
+#endif
+
+enum class Event_t : uint8_t {
+    StatisticsUpdated,
+    DevInfoUpdated,
+    LimitChanged, // limit or power state set or read back
+    AlarmAdded,
+    GridProfileUpdated,
+    NetworkChanged,
+    ConfigChanged,
+    TotalsUpdated, // Datastore read new values
+    Count
+};
+
+struct EventData_t {
+    Event_t Type;
+    uint64_t Serial; // 0 if the event does not belong to an inverter
+    uint32_t Generation; // of the parser which was updated
+};
+
+typedef std::function<void(const EventData_t& event)> EventHandler_t;
+
+struct EventBusStats_t {
+    uint32_t Published;
+    uint32_t Dropped;
+    uint32_t Dispatched;
+};
+
+// Notifies the consumers of new data instead of letting each of them poll for it.
+// Events can be published from any task (e.g. the radio task through the data
+// callback of the Hoymiles lib), the handlers always run in the main loop.
+class EventBusClass {
+public:
+    // Has to be called before the radios are started
+    void init();
+
+    // Thread safe, wakes up the main loop
+    void publish(const Event_t type, const uint64_t serial = 0, const uint32_t generation = 0);
+
+    // Handlers are called in the order they subscribed. Only during setup.
+    void subscribe(const Event_t type, EventHandler_t handler);
+
+    // Runs the task as soon as possible after the event
+    void subscribe(const Event_t type, Task& task);
+
+    // Called by the main loop, runs the handlers of all waiting events
+    void dispatch();
+
+    EventBusStats_t getStats() const;
+
+private:
+    QueueHandle_t _queue = nullptr;
+    std::array<std::vector<EventHandler_t>, static_cast<size_t>(Event_t::Count)> _handlers;
+
+    std::atomic<uint32_t> _published { 0 };
+    std::atomic<uint32_t> _dropped { 0 };
+    std::atomic<uint32_t> _dispatched { 0 };
+};
+
+extern EventBusClass EventBus;
@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Hoymiles.h>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+enum class FieldMetric_t : uint8_t {
+    Gauge,
+    Counter,
+};
+
+struct ExportedField_t {
+    FieldId_t Field;
+    FieldMetric_t Metric;
+};
+
+// The statistic fields exported by MQTT, Prometheus and Influx. Name, unit and
+// digits are taken from the byte assignment of the inverter model.
+static constexpr std::array<ExportedField_t, 14> ExportedFields = { {
+    { FLD_UDC, FieldMetric_t::Gauge },
+    { FLD_IDC, FieldMetric_t::Gauge },
+    { FLD_PDC, FieldMetric_t::Gauge },
+    { FLD_YD, FieldMetric_t::Counter },
+    { FLD_YT, FieldMetric_t::Counter },
+    { FLD_UAC, FieldMetric_t::Gauge },
+    { FLD_IAC, FieldMetric_t::Gauge },
+    { FLD_PAC, FieldMetric_t::Gauge },
+    { FLD_F, FieldMetric_t::Gauge },
+    { FLD_T, FieldMetric_t::Gauge },
+    { FLD_PF, FieldMetric_t::Gauge },
+    { FLD_EFF, FieldMetric_t::Gauge },
+    { FLD_IRR, FieldMetric_t::Gauge },
+    { FLD_Q, FieldMetric_t::Gauge },
+} };
+
+struct FieldRecordEntry_t {
+    ChannelType_t Type;
+    ChannelNum_t Channel;
+    FieldId_t Field;
+    FieldMetric_t Metric;
+    UnitId_t Unit;
+    const char* Name;
+    float Value;
+    uint8_t Length;
+    char Formatted[FORMAT_FIXED_BUFFER_SIZE];
+};
+
+// All exported fields of one response, ordered by channel type, channel and ExportedFields
+struct FieldRecord_t {
+    uint64_t Serial;
+    uint32_t Generation; // of the statistics parser the record was rendered from
+    std::vector<FieldRecordEntry_t> Entries;
+};
+
+// Renders the exported fields of an inverter once per response, so every sink
+// uses the same consistent values instead of walking and formatting the fields
+// on its own. Thread safe, the records are immutable once returned.
+class FieldRecordClass {
+public:
+    std::shared_ptr<const FieldRecord_t> get(InverterAbstract& inv);
+
+private:
+    static std::shared_ptr<const FieldRecord_t> render(InverterAbstract& inv);
+
+    std::mutex _mutex;
+    std::vector<std::shared_ptr<const FieldRecord_t>> _records;
+};
+
+extern FieldRecordClass FieldRecord;
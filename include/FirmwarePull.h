@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "TaskCores.h"
+#include <Arduino.h>
+#include <atomic>
+#include <mutex>
+
+// Settings of the task which downloads and writes the firmware
+#ifndef FIRMWARE_PULL_TASK_CORE
+#define FIRMWARE_PULL_TASK_CORE OPENDTU_NETWORK_CORE
+#endif
+#ifndef FIRMWARE_PULL_TASK_PRIORITY
+#define FIRMWARE_PULL_TASK_PRIORITY 1
+#endif
+#ifndef FIRMWARE_PULL_TASK_STACK_SIZE
+#define FIRMWARE_PULL_TASK_STACK_SIZE 8192
+#endif
+
+// Maximum time without any received data (ms)
+#ifndef FIRMWARE_PULL_TIMEOUT
+#define FIRMWARE_PULL_TIMEOUT 15000
+#endif
+
+#define FIRMWARE_PULL_BLOCK_SIZE 4096
+
+class WiFiClient;
+
+#define FIRMWARE_DELTA_MAGIC 0x4c44444f // "ODDL"
+#define FIRMWARE_DELTA_VERSION 1
+
+// A delta image starts with this header, followed by a list of operations which
+// build the new firmware from the running one (see pio-scripts/firmware_delta.py).
+// All values are little endian.
+struct __attribute__((packed)) FirmwareDeltaHeader_t {
+    uint32_t Magic;
+    uint16_t Version;
+    uint16_t Reserved;
+    uint32_t SourceSize; // size of the firmware the delta was created against
+    uint32_t TargetSize;
+    uint8_t SourceMd5[16];
+    uint8_t TargetMd5[16];
+};
+
+enum class FirmwareDeltaOp_t : uint8_t {
+    End = 0,
+    Copy = 1, // uint32_t offset and length in the running firmware
+    Insert = 2, // uint32_t length followed by the data
+};
+
+enum class FirmwarePullState_t {
+    Idle,
+    Running,
+    Done,
+    Failed,
+};
+
+// Downloads a full image or a delta image from a HTTPS url and writes it directly
+// into the OTA partition. The server certificate is checked against the root CA of
+// the CertStore. The device restarts after a successful update.
+class FirmwarePullClass {
+public:
+    // The md5 of the resulting firmware is mandatory, the written image is checked
+    // against it. The md5 in the header of a delta image has to match it as well.
+    bool start(const String& url, const String& md5);
+    bool isRunning() const;
+
+    static bool isValidMd5(const String& md5);
+
+    FirmwarePullState_t getState() const;
+    bool isDelta() const;
+    size_t getDownloaded() const;
+    size_t getWritten() const;
+    size_t getTotal() const;
+    String getError();
+
+private:
+    static void taskProc(void* param);
+    void run();
+
+    bool fail(const char* format, ...);
+    bool readExact(uint8_t* buffer, const size_t len);
+    bool writeTarget(const uint8_t* data, const size_t len);
+
+    bool applyFull(const uint8_t* head, const size_t headLen, const int contentLength);
+    bool applyDelta();
+    bool verifySource(const FirmwareDeltaHeader_t& header);
+
+    String _url;
+    String _md5;
+
+    WiFiClient* _stream = nullptr;
+    uint8_t* _buffer = nullptr;
+
+    TaskHandle_t _taskHandle = nullptr;
+    std::atomic<FirmwarePullState_t> _state { FirmwarePullState_t::Idle };
+    std::atomic<bool> _delta { false };
+    std::atomic<size_t> _downloaded { 0 };
+    std::atomic<size_t> _written { 0 };
+    std::atomic<size_t> _total { 0 };
+
+    std::mutex _errorLock;
+    char _error[64] = "";
+};
+
+extern FirmwarePullClass FirmwarePull;
@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <TaskSchedulerDeclarations.h>
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#define FLASH_WEAR_FILENAME "/flashwear.bin"
+
+// Erase unit of the flash, LittleFS uses it as block size
+#define FLASH_WEAR_BLOCK_SIZE 4096
+
+// Interval (s) in which the totals are saved, the writes since the last save are lost on a reset
+#ifndef FLASH_WEAR_SAVE_INTERVAL
+#define FLASH_WEAR_SAVE_INTERVAL (6 * 3600)
+#endif
+
+// Time (ms) after which a write held back by the budget is tried again
+#ifndef FLASH_WEAR_RETRY_DELAY
+#define FLASH_WEAR_RETRY_DELAY 60000
+#endif
+
+// Budgets (erased blocks per day) of the writers which can be held back, the burst is a quarter of it.
+// The defaults are about twice of what the writers need with the default intervals.
+#ifndef FLASH_WEAR_BUDGET_HISTORY
+#define FLASH_WEAR_BUDGET_HISTORY 1200
+#endif
+#ifndef FLASH_WEAR_BUDGET_LINK_HISTORY
+#define FLASH_WEAR_BUDGET_LINK_HISTORY 100
+#endif
+#ifndef FLASH_WEAR_BUDGET_SNAPSHOT
+#define FLASH_WEAR_BUDGET_SNAPSHOT 400
+#endif
+#ifndef FLASH_WEAR_BUDGET_INVERTER_CACHE
+#define FLASH_WEAR_BUDGET_INVERTER_CACHE 200
+#endif
+#ifndef FLASH_WEAR_BUDGET_HASS
+#define FLASH_WEAR_BUDGET_HASS 50
+#endif
+
+enum class FlashWriter_t : uint8_t {
+    Config, // critical, never held back
+    Upload,
+    MqttJournal,
+    Time,
+    System, // pin mapping cache, language index, accounting
+    History, // the following ones have a budget
+    LinkHistory,
+    Snapshot,
+    InverterCache,
+    Hass,
+    Count,
+};
+
+struct FlashWriterStats_t {
+    const char* Name;
+    uint32_t Budget; // erased blocks per day, 0 if unlimited
+    uint64_t Bytes; // written by the writer
+    uint32_t Erases; // estimated erased blocks
+    uint32_t Writes;
+    uint32_t Deferred; // writes held back by the budget
+    float Available; // blocks left of the budget
+};
+
+struct FlashWearStats_t {
+    uint32_t Blocks; // of the file system
+    uint32_t Since; // unix time the accounting started, 0 if unknown
+    float AverageErases; // per block since the accounting started
+    std::vector<FlashWriterStats_t> Writers;
+};
+
+// Accounts the bytes written to LittleFS by each writer and estimates the erased
+// blocks: Every write of a file rewrites the touched blocks and commits its metadata,
+// so it costs at least one more block than its size. Writers which only keep data
+// for convenience ask allow() before a write and are held back once their daily
+// budget is used up, their data stays in RAM or in the queue of FsWorker meanwhile.
+// The totals are kept across restarts.
+class FlashWearClass {
+public:
+    FlashWearClass();
+    void init(Scheduler& scheduler);
+
+    void record(const FlashWriter_t writer, const size_t bytes);
+
+    // False if the budget of the writer is used up. The write has to be tried again later.
+    bool allow(const FlashWriter_t writer);
+
+    // Queues the save of changed totals right away, before a planned restart
+    void flush();
+
+    FlashWearStats_t getStats();
+
+    static const char* getWriterName(const FlashWriter_t writer);
+    static uint32_t getBudget(const FlashWriter_t writer);
+
+private:
+    void loop();
+    void load();
+    void save();
+    void refill(const uint32_t now);
+
+    Task _loopTask;
+
+    struct Writer_t {
+        uint64_t Bytes = 0;
+        uint32_t Erases = 0;
+        uint32_t Writes = 0;
+        uint32_t Deferred = 0;
+        float Tokens = 0;
+    };
+
+    std::mutex _mutex;
+    std::array<Writer_t, static_cast<size_t>(FlashWriter_t::Count)> _writers;
+    uint32_t _lastRefill = 0;
+    uint32_t _since = 0;
+    uint32_t _lastSave = 0;
+    bool _dirty = false;
+};
+
+extern FlashWearClass FlashWear;
@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "FlashWear.h"
+#include "TaskCores.h"
+#include <Arduino.h>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Settings of the task which does the flash accesses. A flash erase blocks it for
+// tens of ms, the callers only queue their requests.
+#ifndef FS_WORKER_TASK_CORE
+#define FS_WORKER_TASK_CORE OPENDTU_NETWORK_CORE
+#endif
+#ifndef FS_WORKER_TASK_PRIORITY
+#define FS_WORKER_TASK_PRIORITY 1
+#endif
+#ifndef FS_WORKER_TASK_STACK_SIZE
+#define FS_WORKER_TASK_STACK_SIZE 4096
+#endif
+
+// Time (ms) a write is delayed. Further writes of the same file within it replace its
+// data, the writes which are due together are done in one go.
+#ifndef FS_WORKER_WRITE_DELAY
+#define FS_WORKER_WRITE_DELAY 1000
+#endif
+
+struct FsEntry_t {
+    String Name;
+    size_t Size;
+    bool IsDirectory;
+};
+
+struct FsWorkerStats_t {
+    uint32_t Writes; // files written to flash
+    uint32_t Coalesced; // writes replaced by a later one of the same file
+    uint32_t Failed;
+    uint32_t Deferred; // writes held back by the flash wear budget
+    uint32_t Jobs; // reads, renames, removes, lists and other jobs
+};
+
+using FsCallback = std::function<void(const bool ok)>;
+using FsReadCallback = std::function<void(const bool ok, std::vector<uint8_t>& data)>;
+using FsListCallback = std::function<void(const bool ok, std::vector<FsEntry_t>& entries)>;
+
+// Does the LittleFS accesses of the modules which run periodically, so slow flash
+// operations do not delay the scheduler or the network tasks. The requests are done
+// in the order they were queued. A pending write of a file is done before a request
+// which accesses that file, so a read always returns the latest written data.
+//
+// The callbacks are called from the worker task. They must not call flush().
+class FsWorkerClass {
+public:
+    void init();
+
+    // Replaces the file by the data. It is written to a temporary file first, a
+    // reset while writing keeps the old content. The write is accounted to the writer
+    // and held back while its budget is used up (see FlashWear).
+    void write(const String& path, std::vector<uint8_t> data, const FlashWriter_t writer, FsCallback done = nullptr);
+
+    // Drops a queued write of the file, e.g. if it was replaced by an upload
+    void discard(const String& path);
+    // Drops all queued writes, e.g. before the files are removed. Their callbacks get false.
+    void discardAll();
+
+    void read(const String& path, FsReadCallback done);
+    void rename(const String& from, const String& to, FsCallback done = nullptr);
+    void remove(const String& path, FsCallback done = nullptr);
+    void list(const String& dir, FsListCallback done);
+
+    // Runs a job with other file accesses, e.g. partial updates of a file. The files of
+    // the job must not be written by write(), their pending writes are not done first.
+    void run(std::function<void()> job);
+
+    // Waits until all queued requests are done, before a restart
+    void flush();
+
+    FsWorkerStats_t getStats();
+
+    // The synchronous write used by the worker, for callers before the scheduler runs
+    static bool writeFile(const String& path, const std::vector<uint8_t>& data);
+
+private:
+    struct PendingWrite_t {
+        String Path;
+        std::vector<uint8_t> Data;
+        uint32_t Due; // millis()
+        FlashWriter_t Writer;
+        std::vector<FsCallback> Done;
+    };
+
+    struct Job_t {
+        std::function<void()> Run;
+        std::vector<String> Paths; // files whose pending writes are done before the job
+        bool AllWrites; // all pending writes are done before the job
+    };
+
+    static void taskProc(void* param);
+    void process();
+    void writePending(const bool all);
+    void writePaths(const std::vector<String>& paths);
+    void writeOne(PendingWrite_t& w);
+    void queueJob(std::vector<String> paths, std::function<void()> job, const bool allWrites = false);
+    uint32_t getWaitTime();
+
+    TaskHandle_t _taskHandle = nullptr;
+
+    std::mutex _mutex;
+    std::deque<Job_t> _jobs;
+    std::vector<PendingWrite_t> _writes;
+    FsWorkerStats_t _stats = {};
+};
+
+extern FsWorkerClass FsWorker;
@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <ArduinoJson.h>
+#include <array>
+#include <atomic>
+#include <vector>
+
+enum class HeapTag_t : uint8_t {
+    WebApi = 0, // documents of the web api handlers
+    WebSocket, // documents of the live data websocket
+    Mqtt, // documents of the mqtt handlers
+    MqttQueue, // topics and payloads waiting in the publish queue
+    Config, // configuration, pin mapping and language files
+    Count,
+};
+
+struct HeapTagStats_t {
+    const char* Name;
+    uint32_t Allocs;
+    uint32_t Frees;
+    uint32_t Bytes; // currently allocated
+    uint32_t PeakBytes;
+};
+
+struct HeapRegionStats_t {
+    const char* Name;
+    size_t TotalFree;
+    size_t TotalAllocated;
+    size_t LargestFreeBlock;
+    size_t MinimumFree;
+    size_t AllocatedBlocks;
+    size_t FreeBlocks;
+};
+
+// Counts the allocations of the subsystems which build json documents and strings
+// at runtime. The counters are atomics as they are updated from several tasks.
+class HeapTelemetryClass {
+public:
+    HeapTelemetryClass();
+
+    void onAlloc(const HeapTag_t tag, const size_t size);
+    void onFree(const HeapTag_t tag, const size_t size);
+
+    // Allocator for a JsonDocument which accounts the memory to the given tag
+    ArduinoJson::Allocator* getJsonAllocator(const HeapTag_t tag);
+
+    std::vector<HeapTagStats_t> getTagStats() const;
+
+    // Internal ram and psram (if available)
+    static std::vector<HeapRegionStats_t> getRegionStats();
+
+private:
+    class JsonAllocator : public ArduinoJson::Allocator {
+    public:
+        JsonAllocator(HeapTelemetryClass* telemetry, const HeapTag_t tag);
+
+        void* allocate(size_t size) override;
+        void deallocate(void* ptr) override;
+        void* reallocate(void* ptr, size_t newSize) override;
+
+    private:
+        HeapTelemetryClass* _telemetry;
+        HeapTag_t _tag;
+    };
+
+    struct Counter_t {
+        std::atomic<uint32_t> Allocs { 0 };
+        std::atomic<uint32_t> Frees { 0 };
+        std::atomic<uint32_t> Bytes { 0 };
+        std::atomic<uint32_t> PeakBytes { 0 };
+    };
+
+    std::array<Counter_t, static_cast<size_t>(HeapTag_t::Count)> _counters;
+    std::vector<JsonAllocator> _jsonAllocators;
+};
+
+extern HeapTelemetryClass HeapTelemetry;
@@ -0,0 +1,165 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <LittleFS.h>
+#include <TaskSchedulerDeclarations.h>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define HISTORY_MAGIC 0x54534948 // "HIST"
+#define HISTORY_VERSION 1
+
+// Interval in seconds in which the values are sampled
+#ifndef HISTORY_SAMPLE_INTERVAL
+#define HISTORY_SAMPLE_INTERVAL 60
+#endif
+
+// Finished records are collected in RAM and written to flash in this interval (s)
+#ifndef HISTORY_FLUSH_INTERVAL
+#define HISTORY_FLUSH_INTERVAL 900
+#endif
+
+// Number of records (24 bytes each) kept per resolution. One record is stored per
+// period for the total and for each inverter. The spiffs partition is only 192 kB.
+#ifndef HISTORY_1MIN_CAPACITY
+#define HISTORY_1MIN_CAPACITY 1024
+#endif
+#ifndef HISTORY_15MIN_CAPACITY
+#define HISTORY_15MIN_CAPACITY 1024
+#endif
+#ifndef HISTORY_1DAY_CAPACITY
+#define HISTORY_1DAY_CAPACITY 512
+#endif
+
+enum class HistoryResolution_t : uint8_t {
+    Min1 = 0,
+    Min15,
+    Day1,
+    Count,
+};
+
+struct HistoryRecord_t {
+    uint64_t Serial; // 0 for the sum of all inverters
+    uint32_t Timestamp; // start of the period
+    float Power; // average AC power in W
+    float YieldDay; // Wh at the end of the period
+    float YieldTotal; // kWh at the end of the period
+};
+
+struct HistoryFileHeader_t {
+    uint32_t Magic;
+    uint16_t Version;
+    uint16_t RecordSize;
+    uint32_t Capacity;
+    uint32_t Head; // ring position of the next record
+    uint32_t Count;
+};
+
+// Reads the records of a ring file (HistoryFileHeader_t followed by the records)
+// from the oldest to the newest
+template <typename Record>
+class RecordFileReader {
+public:
+    RecordFileReader(File file, const uint32_t first, const uint32_t count, const uint32_t capacity, std::vector<Record> pending)
+        : _file(file)
+        , _first(first)
+        , _count(count)
+        , _capacity(capacity)
+        , _pending(std::move(pending))
+    {
+    }
+
+    ~RecordFileReader()
+    {
+        if (_file) {
+            _file.close();
+        }
+    }
+
+    size_t getCount() const
+    {
+        return _count + _pending.size();
+    }
+
+    bool read(const size_t index, Record& record)
+    {
+        if (index >= _count) {
+            if (index - _count >= _pending.size()) {
+                return false;
+            }
+            record = _pending[index - _count];
+            return true;
+        }
+
+        if (!_file) {
+            return false;
+        }
+
+        const uint32_t pos = (_first + index) % _capacity;
+        if (!_file.seek(sizeof(HistoryFileHeader_t) + pos * sizeof(Record))) {
+            return false;
+        }
+
+        return _file.read(reinterpret_cast<uint8_t*>(&record), sizeof(record)) == sizeof(record);
+    }
+
+private:
+    File _file;
+    uint32_t _first; // ring position of the oldest record
+    uint32_t _count;
+    uint32_t _capacity;
+    std::vector<Record> _pending; // records not written to flash yet
+};
+
+// Reads the records of one resolution
+using HistoryReader = RecordFileReader<HistoryRecord_t>;
+
+class HistoryClass {
+public:
+    HistoryClass();
+    void init(Scheduler& scheduler);
+
+    // Writes all finished records which are still held in RAM
+    void flush();
+
+    std::unique_ptr<HistoryReader> getReader(const HistoryResolution_t resolution);
+
+    static uint32_t getPeriod(const HistoryResolution_t resolution);
+
+private:
+    struct Accumulator_t {
+        uint64_t Serial;
+        uint32_t PeriodStart;
+        float PowerSum;
+        uint32_t Samples;
+        float YieldDay;
+        float YieldTotal;
+    };
+
+    struct Store_t {
+        const char* Filename;
+        uint32_t Capacity;
+        HistoryFileHeader_t Header;
+        bool Valid;
+        std::vector<Accumulator_t> Accumulators;
+        std::vector<HistoryRecord_t> Pending;
+    };
+
+    void loop();
+    void addSample(const uint32_t now, const uint64_t serial, const float power, const float yieldDay, const float yieldTotal);
+    uint32_t getPeriodStart(const HistoryResolution_t resolution, const uint32_t timestamp) const;
+
+    bool openStore(Store_t& store);
+    bool writePending(Store_t& store);
+
+    Task _loopTask;
+
+    std::array<Store_t, static_cast<size_t>(HistoryResolution_t::Count)> _stores;
+    uint32_t _lastFlush = 0;
+
+    std::mutex _mutex;
+};
+
+extern HistoryClass History;
@@ -4,6 +4,17 @@
 #include <TaskSchedulerDeclarations.h>
 #include <WString.h>
 #include <list>
+#include <vector>
+
+// Binary cache of the meta and display data of all language packs
+#define LANG_INDEX_FILENAME "/lang.idx"
+#define LANG_INDEX_MAGIC 0x58444C4F // "OLDX"
+#define LANG_INDEX_VERSION 1
+
+#define LANG_INDEX_FILENAME_STRLEN 32
+#define LANG_INDEX_CODE_STRLEN 8
+#define LANG_INDEX_NAME_STRLEN 32
+#define LANG_INDEX_DISPLAY_STRLEN 48
 
 struct LanguageInfo_t {
     String code;
@@ -26,8 +37,47 @@ public:
         String& yield_total_kwh, String& yield_total_mwh);
 
 private:
+    enum DisplayString_t {
+        DATE_FORMAT = 0,
+        OFFLINE,
+        POWER_W,
+        POWER_KW,
+        YIELD_TODAY_WH,
+        YIELD_TODAY_KWH,
+        YIELD_TOTAL_KWH,
+        YIELD_TOTAL_MWH,
+        DISPLAY_STRING_COUNT,
+    };
+    static const char* const _displayKeys[DISPLAY_STRING_COUNT];
+
+    struct LangIndexHeader_t {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t count;
+    };
+
+    // One fixed size record per language pack, empty strings are missing in the pack
+    struct LangIndexRecord_t {
+        char filename[LANG_INDEX_FILENAME_STRLEN + 1];
+        uint32_t size;
+        uint32_t lastWrite;
+        char code[LANG_INDEX_CODE_STRLEN + 1];
+        char name[LANG_INDEX_NAME_STRLEN + 1];
+        char display[DISPLAY_STRING_COUNT][LANG_INDEX_DISPLAY_STRLEN + 1];
+    };
+
+    struct LangFile_t {
+        String filename;
+        uint32_t size;
+        uint32_t lastWrite;
+    };
+
     void readLangPacks();
-    void readConfig(String file);
+    static std::vector<LangFile_t> listLangPacks();
+    bool readIndex(const std::vector<LangFile_t>& files);
+    void buildIndex(const std::vector<LangFile_t>& files);
+    static bool readConfig(const LangFile_t& file, LangIndexRecord_t& record);
+    bool readIndexRecord(const String& locale, LangIndexRecord_t& record) const;
 
     std::list<LanguageInfo_t> _availLanguages;
 };
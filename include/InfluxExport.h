@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "TaskCores.h"
+#include <Arduino.h>
+#include <Hoymiles.h>
+#include <TaskSchedulerDeclarations.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// Settings of the task which sends the batches, the network calls block for up to INFLUX_TIMEOUT
+#ifndef INFLUX_TASK_CORE
+#define INFLUX_TASK_CORE OPENDTU_NETWORK_CORE
+#endif
+#ifndef INFLUX_TASK_PRIORITY
+#define INFLUX_TASK_PRIORITY 1
+#endif
+#ifndef INFLUX_TASK_STACK_SIZE
+#define INFLUX_TASK_STACK_SIZE 6144
+#endif
+
+// Size (bytes) of a batch. Lines which do not fit while the previous batch is
+// still being sent are dropped.
+#ifndef INFLUX_BATCH_SIZE
+#define INFLUX_BATCH_SIZE 4096
+#endif
+
+// Maximum size of one UDP datagram, a batch is split at line boundaries
+#ifndef INFLUX_UDP_PACKET_SIZE
+#define INFLUX_UDP_PACKET_SIZE 1400
+#endif
+
+// Timeout (ms) of a HTTP request
+#ifndef INFLUX_TIMEOUT
+#define INFLUX_TIMEOUT 2000
+#endif
+
+#define INFLUX_MEASUREMENT "opendtu"
+
+struct InfluxExportStats_t {
+    uint32_t Batches;
+    uint32_t LinesSent;
+    uint32_t BytesSent;
+    uint32_t LinesDropped; // batch full while the previous one was sent
+    uint32_t LinesFailed; // batch could not be sent
+    int16_t LastHttpCode; // 0 for UDP or before the first request
+};
+
+class WiFiClient;
+class HTTPClient;
+
+// Pushes the inverter statistics as InfluxDB line protocol, one line per channel.
+// Lines are added whenever an inverter has new data and sent by a separate task
+// after Influx.FlushInterval seconds (0 = right away) or if half of the batch is used.
+// The destination is an UDP listener (udp://host:port) or the HTTP write endpoint
+// (v1 /write?db=... or v2 /api/v2/write?org=...&bucket=...), the connection is kept alive.
+class InfluxExportClass {
+public:
+    InfluxExportClass();
+    void init(Scheduler& scheduler);
+
+    // Has to be called after the destination was changed
+    void reconfigure();
+
+    InfluxExportStats_t getStats();
+
+private:
+    void loop();
+    void appendInverter(InverterAbstract& inv);
+
+    static void taskProc(void* param);
+    void run();
+    bool sendUdp(const std::vector<char>& batch);
+    bool sendHttp(const std::vector<char>& batch);
+
+    Task _loopTask;
+
+    // Filled by the loop and swapped with _sending when a batch is handed to the task
+    std::vector<char> _pending;
+    uint32_t _pendingLines = 0;
+    uint32_t _lastFlush = 0;
+    std::vector<uint32_t> _lastStats; // last published Statistics update of each inverter
+
+    std::vector<char> _sending;
+    uint32_t _sendingLines = 0;
+    std::atomic<bool> _busy { false }; // _sending belongs to the task
+
+    std::atomic<bool> _reconfigure { false };
+    WiFiClient* _client = nullptr;
+    HTTPClient* _http = nullptr;
+    String _rootCa; // used by _client
+
+    TaskHandle_t _taskHandle = nullptr;
+
+    std::mutex _statsMutex;
+    InfluxExportStats_t _stats = {};
+};
+
+extern InfluxExportClass InfluxExport;
@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Hoymiles.h>
+#include <TaskSchedulerDeclarations.h>
+#include <vector>
+
+#define INVERTER_CACHE_MAGIC 0x43564E49 // "INVC"
+#define INVERTER_CACHE_VERSION 1
+
+// Interval (ms) in which new device infos and grid profiles are written to flash
+#define INVERTER_CACHE_CHECK_INTERVAL 5000
+
+struct InverterCacheFile_t {
+    uint32_t Magic;
+    uint16_t Version;
+    uint16_t GridProfileFwBuild; // firmware build of the inverter when the profile was received
+    uint64_t Serial;
+    DevInfoRawData_t DevInfo;
+    uint8_t GridProfileLength;
+    uint8_t GridProfile[GRID_PROFILE_SIZE];
+};
+
+// Keeps the device info and the grid profile of every inverter on flash. Both are
+// static, restoring them after a reboot saves their requests. The device info is
+// confirmed by the inverter some minutes later, if the firmware build has changed
+// the grid profile is requested again.
+class InverterCacheClass {
+public:
+    InverterCacheClass();
+    void init(Scheduler& scheduler);
+
+    // Fills the parsers of a newly added inverter
+    void restore(InverterAbstract& inv);
+    void remove(const uint64_t serial);
+
+private:
+    void loop();
+
+    static String getFilename(const uint64_t serial);
+    static bool read(const uint64_t serial, InverterCacheFile_t& file);
+    static void write(const InverterCacheFile_t& file);
+
+    Task _loopTask;
+
+    struct CacheState_t {
+        uint64_t Serial = 0;
+        uint32_t LastDevInfo = 0;
+        uint32_t LastGridProfile = 0;
+        InverterCacheFile_t File = {};
+    };
+    std::vector<CacheState_t> _state;
+};
+
+extern InverterCacheClass InverterCache;
@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <InverterEmulator.h>
+#include <TaskSchedulerDeclarations.h>
+#include <memory>
+#include <vector>
+
+// Probability (%) that a fragment of an answer is lost
+#ifndef INVERTER_EMULATOR_LOSS
+#define INVERTER_EMULATOR_LOSS 0
+#endif
+
+// Time (ms) from the request until the answer is sent
+#ifndef INVERTER_EMULATOR_LATENCY
+#define INVERTER_EMULATOR_LATENCY 2
+#endif
+
+// The emulated NRF inverters listen and answer on a single channel, the DTU
+// settles on it by its tx channel selection
+#ifndef INVERTER_EMULATOR_NRF_CHANNEL
+#define INVERTER_EMULATOR_NRF_CHANNEL 23
+#endif
+
+// The NRF24 filters by address, only pipe 0 and 1 can have independent ones
+#define INVERTER_EMULATOR_NRF_MAX_INVERTERS 2
+
+// Interval (ms) of the statistics on the console
+#define INVERTER_EMULATOR_LOG_INTERVAL (60 * 1000)
+
+class RF24;
+class SPIClass;
+class CMT2300A;
+
+// Firmware mode of the *_inverter_emulator envs for load tests of another DTU. Instead
+// of polling them, it answers the requests for the inverters of the configuration
+// with the radio of their type. The CMT2300A listens on the configured work frequency.
+class InverterEmulatorModeClass {
+public:
+    InverterEmulatorModeClass();
+    void init(Scheduler& scheduler);
+
+private:
+    enum class Radio_t : uint8_t {
+        Nrf,
+        Cmt,
+    };
+
+    struct Pending_t {
+        Radio_t Radio;
+        uint32_t Due; // millis()
+        std::vector<EmulatorPacket_t> Packets;
+    };
+
+    void loop();
+    void initNrf(const std::vector<uint64_t>& serials);
+    void initCmt();
+
+    void receive(const Radio_t radio, const uint8_t packet[], const uint8_t len);
+    void send(const Pending_t& pending);
+
+    Task _loopTask;
+
+    InverterEmulator _emulator;
+    std::shared_ptr<SPIClass> _spi;
+    std::unique_ptr<RF24> _nrf;
+    std::unique_ptr<CMT2300A> _cmt;
+
+    std::vector<Pending_t> _pending;
+    uint32_t _lastLog = 0;
+};
+
+extern InverterEmulatorModeClass InverterEmulatorMode;
@@ -6,17 +6,47 @@
 
 #define INVERTER_UPDATE_SETTINGS_INTERVAL 60000l
 
+// Interval (ms) of the Hoymiles loop while the radios are in standby
+#ifndef INVERTER_STANDBY_LOOP_INTERVAL
+#define INVERTER_STANDBY_LOOP_INTERVAL 100
+#endif
+
+// Interval (ms) of the Hoymiles loop while no radio exchanges data. Polls and
+// queued commands are started with at most this delay.
+#ifndef INVERTER_IDLE_LOOP_INTERVAL
+#define INVERTER_IDLE_LOOP_INTERVAL 20
+#endif
+
+class InverterAbstract;
+struct INVERTER_CONFIG_T;
+
 class InverterSettingsClass {
 public:
     InverterSettingsClass();
     void init(Scheduler& scheduler);
 
+    static void applyPollPlan(InverterAbstract& inv, const INVERTER_CONFIG_T& config);
+    static void applyInverterConfig(InverterAbstract& inv, const INVERTER_CONFIG_T& config);
+
+    // Applies the difference between the inverters of Hoymiles and the configuration,
+    // the inverters which stay configured are not interrupted
+    void applyInverterList();
+
+    // True while the radios are in the night standby
+    bool isStandby() const;
+
+    // Applies the poll and command settings with the next loop
+    void forceUpdate();
+
 private:
     void settingsLoop();
     void hoyLoop();
+    void updateStandby(const bool standby);
 
     Task _settingsTask;
     Task _hoyTask;
+
+    bool _standby = false;
 };
 
 extern InverterSettingsClass InverterSettings;
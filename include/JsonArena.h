@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <ArduinoJson.h>
+#include <array>
+
+// Maximum number of chunks one arena uses. A document which needs more overflows.
+#ifndef JSON_ARENA_MAX_CHUNKS
+#define JSON_ARENA_MAX_CHUNKS 8
+#endif
+
+// Number of free chunks kept per size class for the next request
+#ifndef JSON_ARENA_CHUNK_CACHE
+#define JSON_ARENA_CHUNK_CACHE 2
+#endif
+
+// Bump allocator for a JsonDocument which only lives during one request. Memory is
+// taken from chunks of a few size classes (in psram if available), which are returned
+// to a shared cache when the arena is destroyed or reset. Freed blocks are only
+// reused if they are the last block of a chunk, which covers the growing strings of
+// the parser. The arena has to be declared before and therefore outlive the document.
+class JsonArena : public ArduinoJson::Allocator {
+public:
+    JsonArena() = default;
+    JsonArena(const JsonArena&) = delete;
+    JsonArena& operator=(const JsonArena&) = delete;
+    ~JsonArena();
+
+    void* allocate(size_t size) override;
+    void deallocate(void* ptr) override;
+    void* reallocate(void* ptr, size_t newSize) override;
+
+    // Drops all allocations but keeps the chunks for the next document
+    void reset();
+
+private:
+    struct Chunk_t {
+        uint8_t* Data;
+        uint32_t Size;
+        uint32_t Used;
+    };
+
+    Chunk_t* findChunk(const uint8_t* block);
+    bool isLastBlock(const Chunk_t& chunk, const uint8_t* block) const;
+
+    std::array<Chunk_t, JSON_ARENA_MAX_CHUNKS> _chunks;
+    uint8_t _chunkCount = 0;
+};
@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Arduino.h>
+#include <Hoymiles.h>
+#include <TaskSchedulerDeclarations.h>
+
+// Delay (s) after the boot, every inverter should have answered its first polls
+#ifndef KERNEL_BENCHMARK_DELAY
+#define KERNEL_BENCHMARK_DELAY 120
+#endif
+
+// Calls of each kernel
+#ifndef KERNEL_BENCHMARK_ITERATIONS
+#define KERNEL_BENCHMARK_ITERATIONS 500
+#endif
+
+// Benchmark builds (env *_kernel_bench) time the hot formatters and parsers once after the
+// boot on the data of the configured inverters: the statistics fields, the alarm log, the
+// grid profile, the channel document of the live websocket and the prometheus field lines.
+// Each kernel prints "PERF opendtu_bench_ns_per_op{...}" and the bytes allocated with
+// malloc per call as "PERF opendtu_bench_heap_bytes_per_op{...}". test/bench has the same
+// kernels of lib/Hoymiles on fixed payloads, native and on the board.
+class KernelBenchmarkClass {
+public:
+    KernelBenchmarkClass();
+    void init(Scheduler& scheduler);
+
+private:
+    void run();
+    void runInverter(InverterAbstract& inv, const uint8_t idx);
+
+    template <typename F>
+    void measure(const char* kernel, const char* payload, F&& f);
+
+    Task _loopTask;
+};
+
+extern KernelBenchmarkClass KernelBenchmark;
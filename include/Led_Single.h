@@ -3,10 +3,14 @@
 
 #include "PinMapping.h"
 #include <TaskSchedulerDeclarations.h>
-#include <TimeoutHelper.h>
+#include <Ticker.h>
+#include <mutex>
 
 #define LEDSINGLE_UPDATE_INTERVAL 2000
 
+// Time (ms) a blinking LED stays on or off
+#define LEDSINGLE_BLINK_INTERVAL 500
+
 class LedSingleClass {
 public:
     LedSingleClass();
@@ -16,24 +20,29 @@ public:
     void turnAllOn();
 
 private:
+    enum class LedState_t {
+        On,
+        Off,
+        Blink,
+    };
+
     void setLoop();
-    void outputLoop();
+    void applyModes(const LedState_t (&modes)[PINMAPPING_LED_COUNT]);
+    void blink();
 
     void setLed(const uint8_t ledNo, const bool ledState);
 
     Task _setTask;
-    Task _outputTask;
 
-    enum class LedState_t {
-        On,
-        Off,
-        Blink,
-    };
+    // The blinking is driven by a timer, the outputs are only written on changes
+    Ticker _blinkTimer;
+    bool _blinkTimerRunning = false;
+    bool _blinkState = false;
+    std::mutex _mutex;
 
     LedState_t _ledMode[PINMAPPING_LED_COUNT];
     LedState_t _allMode;
     bool _ledStateCurrent[PINMAPPING_LED_COUNT];
-    TimeoutHelper _blinkTimeout;
 };
 
 extern LedSingleClass LedSingle;
\ No newline at end of file
@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "History.h"
+#include <TaskSchedulerDeclarations.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define LINK_HISTORY_MAGIC 0x4b4e494c // "LINK"
+#define LINK_HISTORY_VERSION 1
+#define LINK_HISTORY_FILENAME "/history_link.bin"
+
+// Length of a bucket in seconds
+#define LINK_HISTORY_PERIOD 3600
+
+// Interval in seconds in which the counters of the inverters are read
+#ifndef LINK_HISTORY_SAMPLE_INTERVAL
+#define LINK_HISTORY_SAMPLE_INTERVAL 60
+#endif
+
+// Number of buckets (24 bytes each) kept, one per inverter and hour. 1024 cover
+// about three weeks of two inverters.
+#ifndef LINK_HISTORY_CAPACITY
+#define LINK_HISTORY_CAPACITY 1024
+#endif
+
+struct LinkHistoryRecord_t {
+    uint64_t Serial;
+    uint32_t Timestamp; // start of the hour
+    uint16_t Requests; // data requests sent
+    uint16_t Success;
+    uint16_t Partial; // answers with missing fragments after all retransmits
+    uint16_t Retransmits; // fragments requested again
+    uint16_t Fragments; // received fragments, the rssi values are of them
+    int8_t RssiMean; // dBm, 0 without fragments
+    int8_t RssiMin;
+};
+
+static_assert(sizeof(LinkHistoryRecord_t) == 24, "The records are stored as they are");
+
+using LinkHistoryReader = RecordFileReader<LinkHistoryRecord_t>;
+
+// Hourly link quality of each inverter. The radio statistics of the inverters are
+// reset at midnight and on a reboot, so their differences are collected in buckets
+// which are kept in a ring file. A finished bucket is written at the start of the
+// next hour, the current one is lost on a reboot.
+class LinkHistoryClass {
+public:
+    LinkHistoryClass();
+    void init(Scheduler& scheduler);
+
+    // Writes all finished buckets which are still held in RAM
+    void flush();
+
+    std::unique_ptr<LinkHistoryReader> getReader();
+
+private:
+    struct Accumulator_t {
+        uint64_t Serial;
+        uint32_t PeriodStart;
+
+        // Counters of the inverter at the previous sample
+        uint32_t TxRequestData;
+        uint32_t RxSuccess;
+        uint32_t RxFailPartialAnswer;
+        uint32_t TxReRequestFragment;
+        uint32_t RssiSum;
+        uint32_t RssiCount;
+
+        // Of the current period
+        uint32_t Requests;
+        uint32_t Success;
+        uint32_t Partial;
+        uint32_t Retransmits;
+        int32_t PeriodRssiSum;
+        uint32_t PeriodRssiCount;
+        int8_t RssiMin;
+    };
+
+    void loop();
+    void finishPeriod(Accumulator_t& acc);
+
+    bool openStore();
+    bool writePending();
+
+    Task _loopTask;
+
+    HistoryFileHeader_t _header = {};
+    bool _valid = false;
+    std::vector<Accumulator_t> _accumulators;
+    std::vector<LinkHistoryRecord_t> _pending;
+
+    std::mutex _mutex;
+};
+
+extern LinkHistoryClass LinkHistory;
@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Arduino.h>
+#include <Histogram.h>
+#include <array>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Longest time (ms) one pass of the scheduler may take and the Hoymiles loop may
+// run later than its interval. Longer ones are counted and logged as violation.
+#ifndef LOOP_MONITOR_BUDGET
+#define LOOP_MONITOR_BUDGET 20
+#endif
+
+// Number of recent violations which are kept
+#ifndef LOOP_MONITOR_HISTORY
+#define LOOP_MONITOR_HISTORY 8
+#endif
+
+// At most one violation per interval (ms) is written to the console
+#ifndef LOOP_MONITOR_LOG_INTERVAL
+#define LOOP_MONITOR_LOG_INTERVAL 1000
+#endif
+
+#define LOOP_MONITOR_NAME_LEN 32
+
+enum class LoopActivity_t : uint8_t {
+    WebApi, // handler of the web server task
+    Mqtt, // callback of the mqtt client task
+    Count,
+};
+
+enum class LoopViolation_t : uint8_t {
+    HoymilesGap, // between two runs of Hoymiles.loop(), beyond its interval
+    SchedulerPass, // one call of scheduler.execute()
+};
+
+struct LoopViolationRecord_t {
+    LoopViolation_t Type;
+    uint32_t Time; // millis() when it was detected
+    uint32_t Duration; // ms
+
+    // Longest scheduler task within the gap or pass
+    char Task[LOOP_MONITOR_NAME_LEN];
+    uint32_t TaskTime; // ms
+
+    // Activities of the other tasks which ran during the gap, empty if none
+    char WebApi[LOOP_MONITOR_NAME_LEN];
+    char Mqtt[LOOP_MONITOR_NAME_LEN];
+};
+
+// Latencies of the paths a client sees, all in ms
+struct LoopLatency_t {
+    // From the start of a handler until its response was handed to the web server
+    // or the mqtt callback returned
+    std::array<Histogram<8>, static_cast<size_t>(LoopActivity_t::Count)> Activity {
+        Histogram<8> { { 5, 10, 20, 50, 100, 200, 500, 1000 } },
+        Histogram<8> { { 5, 10, 20, 50, 100, 200, 500, 1000 } },
+    };
+
+    // From the update of the statistics until the live data frame was queued
+    Histogram<8> WsFrameLag { { 10, 20, 50, 100, 200, 500, 1000, 2000 } };
+
+    // Between two statistics updates of the same inverter, the polling cycle time
+    Histogram<8> StatsInterval { { 2000, 5000, 10000, 15000, 20000, 30000, 60000, 120000 } };
+};
+
+struct LoopMonitorStats_t {
+    uint32_t HoymilesGapViolations;
+    uint32_t HoymilesGapMax; // ms
+    uint32_t SchedulerPassViolations;
+    uint32_t SchedulerPassMax; // ms
+};
+
+// Measures the latency of the main loop. The scheduler tasks report their run times
+// through the TaskProfiler, the web api and the mqtt client mark their handlers, so
+// a violation of the budget names what was running meanwhile.
+class LoopMonitorClass {
+public:
+    // Has to be called after the event bus was initialized
+    void init();
+
+    // Called on each run of the Hoymiles loop with the interval it was scheduled with
+    void markHoymilesLoop(const uint32_t interval);
+
+    // Wrap one call of scheduler.execute()
+    void beginPass();
+    void endPass();
+
+    // Called by the TaskProfiler after each task run
+    void taskFinished(const char* name, const uint32_t runTime);
+
+    // Marks the start and end of a handler in another task. A handler which is not
+    // ended is taken as running until the next one starts.
+    void beginActivity(const LoopActivity_t activity, const char* name);
+    void endActivity(const LoopActivity_t activity);
+
+    // Called by the live data websocket for each frame with new statistics
+    void markWsFrame(const uint32_t lag);
+
+    LoopMonitorStats_t getStats();
+    LoopLatency_t getLatency();
+
+    // The oldest first
+    std::vector<LoopViolationRecord_t> getViolations();
+
+private:
+    struct Longest_t {
+        const char* Name = nullptr;
+        uint32_t Time = 0; // us
+    };
+
+    struct Activity_t {
+        char Name[LOOP_MONITOR_NAME_LEN] = "";
+        uint32_t Start = 0;
+        uint32_t End = 0;
+        bool Running = false;
+    };
+
+    void statisticsUpdated(const uint64_t serial);
+    void addViolation(const LoopViolation_t type, const uint32_t duration, const Longest_t& longest);
+    void copyActivity(const LoopActivity_t activity, const uint32_t since, char* name);
+
+    uint32_t _lastHoymilesLoop = 0;
+    uint32_t _passStart = 0;
+    Longest_t _longestInGap;
+    Longest_t _longestInPass;
+    uint32_t _lastLog = 0;
+
+    std::array<Activity_t, static_cast<size_t>(LoopActivity_t::Count)> _activities;
+
+    // Serial and time of the last statistics update of each inverter
+    std::vector<std::pair<uint64_t, uint32_t>> _lastStats;
+
+    LoopMonitorStats_t _stats = {};
+    LoopLatency_t _latency;
+    std::array<LoopViolationRecord_t, LOOP_MONITOR_HISTORY> _violations = {};
+    size_t _head = 0;
+    size_t _count = 0;
+
+    std::mutex _mutex;
+};
+
+extern LoopMonitorClass LoopMonitor;
@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <TaskSchedulerDeclarations.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Upper limit (ms) of one idle wait. Tasks enabled from other threads (web server,
+// MQTT client) are started at the latest after this time.
+#ifndef LOOP_WAKEUP_MAX_SLEEP
+#define LOOP_WAKEUP_MAX_SLEEP 20
+#endif
+
+// Lets the main loop block until the next task is due instead of calling the
+// scheduler continuously. The wait ends early if another thread calls notify().
+class LoopWakeupClass {
+public:
+    // Has to be called from the task which runs loop()
+    void init();
+
+    // Blocks until the next task of the scheduler is due or notify() is called
+    void sleep(Scheduler& scheduler);
+
+    void notify();
+
+private:
+    TaskHandle_t _loopTaskHandle = nullptr;
+};
+
+extern LoopWakeupClass LoopWakeup;
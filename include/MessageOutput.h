@@ -1,34 +1,246 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 #pragma once
 
+#include "TaskCores.h"
 #include <AsyncWebSocket.h>
+#include <GzipStream.h>
 #include <HardwareSerial.h>
 #include <Stream.h>
 #include <TaskSchedulerDeclarations.h>
+#include <array>
+#include <atomic>
+#include <memory>
 #include <mutex>
+#include <vector>
 
-#define BUFFER_SIZE 500
+// Size of the log ring in bytes (power of two). The larger size is used if psram is available.
+#ifndef MESSAGEOUTPUT_RING_SIZE
+#define MESSAGEOUTPUT_RING_SIZE 4096
+#endif
+#ifndef MESSAGEOUTPUT_RING_SIZE_PSRAM
+#define MESSAGEOUTPUT_RING_SIZE_PSRAM 65536
+#endif
 
+// Unfinished lines are collected per task, so lines of different tasks do not mix
+#ifndef MESSAGEOUTPUT_LINE_BUFFERS
+#define MESSAGEOUTPUT_LINE_BUFFERS 6
+#endif
+#ifndef MESSAGEOUTPUT_LINE_SIZE
+#define MESSAGEOUTPUT_LINE_SIZE 192
+#endif
+
+// Maximum number of bytes sent to a websocket client at once
+#ifndef MESSAGEOUTPUT_WS_CHUNK_SIZE
+#define MESSAGEOUTPUT_WS_CHUNK_SIZE 1024
+#endif
+
+// Settings of the task which writes the ring to the serial port
+#ifndef MESSAGEOUTPUT_SERIAL_TASK_CORE
+#define MESSAGEOUTPUT_SERIAL_TASK_CORE OPENDTU_NETWORK_CORE
+#endif
+#ifndef MESSAGEOUTPUT_SERIAL_TASK_PRIORITY
+#define MESSAGEOUTPUT_SERIAL_TASK_PRIORITY 1
+#endif
+#ifndef MESSAGEOUTPUT_SERIAL_TASK_STACK_SIZE
+#define MESSAGEOUTPUT_SERIAL_TASK_STACK_SIZE 2048
+#endif
+
+// Size of the copy of the output which survives a reset (power of two). It is kept in
+// rtc memory, which is not cleared by a software reset, watchdog or panic.
+#ifndef MESSAGEOUTPUT_CRASHLOG_SIZE
+#define MESSAGEOUTPUT_CRASHLOG_SIZE 2048
+#endif
+
+// Highest level (see MessageLevel_t) which is written to the serial port and sent to
+// a new console client until it sets its own filter
+#ifndef MESSAGEOUTPUT_SERIAL_LEVEL
+#define MESSAGEOUTPUT_SERIAL_LEVEL 3
+#endif
+#ifndef MESSAGEOUTPUT_WS_DEFAULT_LEVEL
+#define MESSAGEOUTPUT_WS_DEFAULT_LEVEL 3
+#endif
+
+static_assert((MESSAGEOUTPUT_RING_SIZE & (MESSAGEOUTPUT_RING_SIZE - 1)) == 0, "MESSAGEOUTPUT_RING_SIZE has to be a power of two");
+static_assert((MESSAGEOUTPUT_RING_SIZE_PSRAM & (MESSAGEOUTPUT_RING_SIZE_PSRAM - 1)) == 0, "MESSAGEOUTPUT_RING_SIZE_PSRAM has to be a power of two");
+static_assert((MESSAGEOUTPUT_CRASHLOG_SIZE & (MESSAGEOUTPUT_CRASHLOG_SIZE - 1)) == 0, "MESSAGEOUTPUT_CRASHLOG_SIZE has to be a power of two");
+
+// Same values as the HOY_LOG_LEVEL_* of the Hoymiles library
+enum class MessageLevel_t : uint8_t {
+    None = 0,
+    Error,
+    Warn,
+    Info,
+    Debug, // every request, response and packet dump of the radios
+    Verbose,
+};
+
+enum class MessageSubsystem_t : uint8_t {
+    System, // everything written with print() and printf()
+    Radio, // the Hoymiles library
+    Count,
+};
+
+// Highest level a reader receives of each subsystem. With Meta each line is prefixed
+// with the uptime, level and subsystem of its record.
+struct MessageFilter_t {
+    std::array<MessageLevel_t, static_cast<size_t>(MessageSubsystem_t::Count)> Levels;
+    bool Meta;
+};
+
+// Record as returned to a reader outside of MessageOutputClass
+struct MessageRecord_t {
+    uint32_t Time; // millis() when the line was started
+    MessageLevel_t Level;
+    MessageSubsystem_t Subsystem;
+    bool Continued; // not the start of a line
+    uint16_t Len;
+};
+
+class MessageOutputClass;
+
+// Print interface which writes the records of one subsystem and level. Nothing is
+// stored if no reader wants them.
+class MessageChannel : public Print {
+public:
+    MessageChannel(MessageOutputClass& output, const MessageSubsystem_t subsystem, const MessageLevel_t level);
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+
+private:
+    MessageOutputClass& _output;
+    MessageSubsystem_t _subsystem;
+    MessageLevel_t _level;
+};
+
+// Writers reserve space in the ring with a compare and swap of the write position
+// and never wait for each other or for the readers. Every reader (the serial task
+// and each console websocket client) keeps its own position. A reader which falls
+// behind by more than the ring size continues at the newest line.
+// Each record keeps the uptime, level and subsystem of its line. The readers filter
+// them while reading and only format the prefix if they asked for it.
 class MessageOutputClass : public Print {
 public:
     MessageOutputClass();
     void init(Scheduler& scheduler);
     size_t write(uint8_t c) override;
     size_t write(const uint8_t* buffer, size_t size) override;
+    size_t write(const MessageSubsystem_t subsystem, const MessageLevel_t level, const uint8_t* buffer, size_t size);
     void register_ws_output(AsyncWebSocket* output);
 
+    // True if at least one reader receives messages of this subsystem and level, so
+    // expensive ones like the packet dumps are not even formatted otherwise
+    bool isEnabled(const MessageSubsystem_t subsystem, const MessageLevel_t level) const
+    {
+        return level <= getMaxLevel(subsystem);
+    }
+    MessageLevel_t getMaxLevel(const MessageSubsystem_t subsystem) const
+    {
+        return static_cast<MessageLevel_t>(_maxLevels[static_cast<size_t>(subsystem)].load(std::memory_order_relaxed));
+    }
+
+    static const char* getLevelName(const MessageLevel_t level);
+    static const char* getSubsystemName(const MessageSubsystem_t subsystem);
+    // Returns false if the name is unknown
+    static bool parseLevel(const char* name, MessageLevel_t& level);
+    static bool parseSubsystem(const char* name, MessageSubsystem_t& subsystem);
+
+    // Called by the console websocket if a client connects or disconnects
+    void addWsClient(const uint32_t id);
+    void removeWsClient(const uint32_t id);
+
+    // The client receives each chunk as gzip compressed binary frame
+    void setWsClientGzip(const uint32_t id);
+    void setWsClientFilter(const uint32_t id, const MessageFilter_t& filter);
+    MessageFilter_t getWsClientFilter(const uint32_t id);
+
+    // For readers outside of this class like the remote syslog. Their cursor starts at
+    // getWritePos(). readRecord() copies the next wanted record to data, which has to
+    // hold MESSAGEOUTPUT_LINE_SIZE bytes, and returns false if there is none yet.
+    uint32_t getWritePos() const { return _writePos.load(); }
+    bool readRecord(uint32_t& cursor, MessageRecord_t& record, char* data, bool& skipped, const MessageFilter_t& filter);
+    // Levels of the remote log, counted by isEnabled() like those of the other readers
+    void setRemoteFilter(const MessageFilter_t& filter);
+
+    // Last output before the previous reset, empty after a power on
+    const String& getLastBootLog() const;
+
 private:
+    struct RecordHeader_t {
+        uint32_t Pos; // position of the record, written last when the record is complete
+        uint32_t Time; // millis() when the line was started
+        uint16_t Len;
+        uint16_t Flags;
+        MessageLevel_t Level;
+        MessageSubsystem_t Subsystem;
+    };
+
+    // Tag of the records of a line
+    struct RecordTag_t {
+        uint32_t Time;
+        MessageLevel_t Level;
+        MessageSubsystem_t Subsystem;
+        bool Continued; // not the start of a line, no prefix
+    };
+
+    struct LineBuffer_t {
+        std::atomic<TaskHandle_t> Owner { nullptr };
+        uint16_t Len = 0;
+        RecordTag_t Tag;
+        char Data[MESSAGEOUTPUT_LINE_SIZE];
+    };
+
+    struct WsClient_t {
+        uint32_t Id;
+        uint32_t Cursor;
+        bool Gzip;
+        MessageFilter_t Filter;
+    };
+
     void loop();
 
+    static void serialTaskProc(void* param);
+
+    void restoreCrashLog();
+    void addCrashLog(const char* data, const size_t len);
+
+    LineBuffer_t* getLineBuffer();
+    void addRecord(const char* data, size_t len, RecordTag_t tag);
+    // Positions the cursor at the next wanted record and copies it, the cursor is moved
+    // past it by recordSize once it was used
+    bool peekRecord(uint32_t& cursor, RecordHeader_t& header, char* data, uint32_t& recordSize, bool& skipped, const MessageFilter_t& filter);
+    size_t readRecords(uint32_t& cursor, char* buffer, const size_t maxLen, bool& skipped, const MessageFilter_t& filter);
+    static size_t formatPrefix(const RecordHeader_t& header, char* buffer, const size_t maxLen);
+
+    static MessageFilter_t getDefaultFilter(const MessageLevel_t level);
+    // Has to be called with the client lock held
+    void updateMaxLevels();
+
     Task _loopTask;
 
     AsyncWebSocket* _ws = nullptr;
-    char _buffer[BUFFER_SIZE];
-    uint16_t _buff_pos = 0;
-    uint32_t _lastSend = 0;
-    bool _forceSend = false;
 
-    std::mutex _msgLock;
+    uint8_t* _ring = nullptr;
+    uint32_t _ringSize = 0;
+    std::atomic<uint32_t> _writePos { 0 };
+
+    std::array<LineBuffer_t, MESSAGEOUTPUT_LINE_BUFFERS> _lineBuffers;
+
+    std::atomic<uint32_t> _crashLogPos { 0 };
+    String _lastBootLog;
+
+    TaskHandle_t _serialTaskHandle = nullptr;
+    uint32_t _serialCursor = 0;
+    MessageFilter_t _serialFilter;
+    MessageFilter_t _remoteFilter;
+
+    // Highest level of all readers by subsystem
+    std::array<std::atomic<uint8_t>, static_cast<size_t>(MessageSubsystem_t::Count)> _maxLevels;
+
+    std::vector<WsClient_t> _wsClients;
+    std::mutex _wsClientsLock;
+
+    // Only used by the loop, allocated with the first gzip client
+    std::unique_ptr<GzipStream> _gzip;
 };
 
 extern MessageOutputClass MessageOutput;
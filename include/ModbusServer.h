@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Arduino.h>
+#include <TaskSchedulerDeclarations.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+class AsyncClient;
+class AsyncServer;
+class InverterAbstract;
+
+#ifndef MODBUS_MAX_CLIENTS
+#define MODBUS_MAX_CLIENTS 4
+#endif
+
+// Clients which send nothing for this time (ms) are disconnected
+#ifndef MODBUS_CLIENT_TIMEOUT
+#define MODBUS_CLIENT_TIMEOUT 60000
+#endif
+
+// Start of the SunSpec map ("SunS" marker), models follow without gaps
+#define MODBUS_SUNSPEC_BASE 40000
+
+// Fixed register offsets (from MODBUS_SUNSPEC_BASE) of the controls model 123.
+// Model 1 (68 registers) and 101/103 (52 registers) always come first.
+#define MODBUS_SUNSPEC_CONTROLS 122
+#define MODBUS_SUNSPEC_CONN (MODBUS_SUNSPEC_CONTROLS + 2 + 2)
+#define MODBUS_SUNSPEC_WMAXLIMPCT (MODBUS_SUNSPEC_CONTROLS + 2 + 3)
+#define MODBUS_SUNSPEC_WMAXLIM_ENA (MODBUS_SUNSPEC_CONTROLS + 2 + 7)
+
+struct ModbusServerStats_t {
+    uint8_t Clients;
+    uint32_t Requests;
+    uint32_t Exceptions;
+    uint32_t Writes; // limit and power commands queued
+};
+
+// Modbus TCP server with a SunSpec map per inverter. The unit id selects the
+// inverter by its position (1 = first inverter).
+//
+// The registers of each inverter are kept as a preformatted image (models 1,
+// 101 or 103, 123 and 160) which is rebuilt by the loop whenever the inverter
+// got new data, so requests are served by a copy of the image. Writes to the
+// limit or connect registers of model 123 queue the matching inverter command,
+// if Modbus.AllowWrite is set and commands are enabled for the inverter.
+class ModbusServerClass {
+public:
+    ModbusServerClass();
+    void init(Scheduler& scheduler);
+
+    // Restarts the server with the current configuration
+    void reconfigure();
+
+    ModbusServerStats_t getStats();
+
+private:
+    struct Image_t {
+        uint64_t Serial;
+        uint32_t State; // hash of the data the image was built from
+        std::vector<uint16_t> Registers;
+    };
+
+    struct Connection_t {
+        std::vector<uint8_t> Rx;
+    };
+
+    void loop();
+    void start();
+    void stop();
+
+    static uint32_t getImageState(InverterAbstract& inv);
+    static void buildImage(InverterAbstract& inv, const uint8_t unitId, std::vector<uint16_t>& registers);
+
+    void onConnect(AsyncClient* client);
+    void onData(AsyncClient* client, Connection_t* connection, const uint8_t* data, const size_t len);
+    size_t handleRequest(const uint8_t unitId, const uint8_t* pdu, const size_t len, uint8_t* response);
+    size_t readRegisters(const uint8_t unitId, const uint16_t address, const uint16_t count, uint8_t* response);
+    uint8_t writeRegister(const uint8_t unitId, const uint16_t address, const uint16_t value);
+
+    Task _loopTask;
+
+    AsyncServer* _server = nullptr;
+    uint16_t _port = 0;
+    std::atomic<bool> _reconfigure { false };
+
+    std::vector<Image_t> _images; // by the position of the inverter
+    std::mutex _imageMutex;
+
+    std::atomic<uint8_t> _clients { 0 };
+    std::atomic<uint32_t> _requests { 0 };
+    std::atomic<uint32_t> _exceptions { 0 };
+    std::atomic<uint32_t> _writes { 0 };
+};
+
+extern ModbusServerClass ModbusServer;
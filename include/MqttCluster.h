@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <TaskSchedulerDeclarations.h>
+#include <atomic>
+#include <espMqttClient.h>
+#include <mutex>
+#include <vector>
+
+// Interval (s) in which every DTU publishes the link quality of its inverters
+#ifndef MQTT_CLUSTER_REPORT_INTERVAL
+#define MQTT_CLUSTER_REPORT_INTERVAL 30
+#endif
+
+// A DTU is considered offline if no report arrived for this many report intervals
+#ifndef MQTT_CLUSTER_NODE_TIMEOUT
+#define MQTT_CLUSTER_NODE_TIMEOUT 3
+#endif
+
+// Interval (s) in which a DTU sends one request to each inverter it does not own.
+// Without it the link quality of the other DTUs would never be known.
+#ifndef MQTT_CLUSTER_PROBE_INTERVAL
+#define MQTT_CLUSTER_PROBE_INTERVAL 300
+#endif
+
+// Link scores are success rates (0..1). An inverter is only handed over to another
+// DTU if its score is higher by this margin.
+#ifndef MQTT_CLUSTER_HANDOVER_MARGIN
+#define MQTT_CLUSTER_HANDOVER_MARGIN 0.15f
+#endif
+
+// Subtracted from the score of a DTU for every inverter assigned to it already,
+// this spreads inverters with similar links over the DTUs
+#ifndef MQTT_CLUSTER_LOAD_PENALTY
+#define MQTT_CLUSTER_LOAD_PENALTY 0.02f
+#endif
+
+struct MqttClusterStatus_t {
+    bool Enabled;
+    String NodeId;
+    String LeaderId;
+    uint8_t NodeCount; // DTUs online, including this one
+    uint8_t OwnedInverters;
+    uint8_t AssignedInverters; // all inverters of the assignment
+    uint32_t Handovers; // assignments published while being the leader which moved an inverter
+};
+
+// Coordinates several DTUs over MQTT (topic Mqtt.Cluster.Topic) so each inverter is
+// polled by the DTU with the best link only.
+//
+// Every DTU publishes the success rate and rssi of its inverters to [topic]node/[id].
+// The DTU with the lowest id of those online is the leader. It assigns every inverter
+// to the DTU with the best score and publishes the assignment retained to
+// [topic]assignment. A DTU which goes offline loses its inverters after
+// MQTT_CLUSTER_NODE_TIMEOUT missed reports. Inverters without an assignment are polled.
+class MqttClusterClass {
+public:
+    MqttClusterClass();
+    void init(Scheduler& scheduler);
+
+    void subscribeTopics();
+    void unsubscribeTopics();
+
+    // Whether this DTU polls the inverter
+    bool isOwner(const uint64_t serial);
+
+    MqttClusterStatus_t getStatus();
+
+private:
+    struct Link_t {
+        uint64_t Serial;
+        float Score;
+        int8_t Rssi;
+        uint32_t Time; // millis() of the report
+    };
+
+    struct Node_t {
+        String Id;
+        uint32_t LastSeen;
+        std::vector<Link_t> Links;
+    };
+
+    struct Owner_t {
+        uint64_t Serial;
+        String NodeId;
+    };
+
+    // Radio statistics at the last report, the score is taken from the difference
+    struct Counters_t {
+        uint64_t Serial;
+        uint32_t TxRequestData;
+        uint32_t RxSuccess;
+    };
+
+    void loop();
+    void reset();
+    void publishReport(const uint32_t now);
+    void updateAssignment(const uint32_t now);
+    void probeInverters();
+
+    void onReport(const espMqttClientTypes::MessageProperties& properties, const char* topic, const uint8_t* payload, const size_t len, const size_t index, const size_t total);
+    void onAssignment(const espMqttClientTypes::MessageProperties& properties, const char* topic, const uint8_t* payload, const size_t len, const size_t index, const size_t total);
+
+    // Have to be called while holding _mutex
+    Node_t& getNode(const String& id);
+    bool isAlive(const Node_t& node, const uint32_t now) const;
+    void storeLinks(Node_t& node, const JsonArrayConst links, const uint32_t now);
+
+    Task _loopTask;
+
+    String _nodeId;
+    String _subscribedTopic;
+
+    std::vector<Node_t> _nodes;
+    std::vector<Owner_t> _owners;
+    std::vector<Counters_t> _counters;
+    String _leaderId;
+    uint32_t _handovers = 0;
+
+    uint32_t _joinTime = 0; // millis() of the first report
+    uint32_t _lastReport = 0;
+    uint32_t _lastProbe = 0;
+
+    // Set by the MQTT task when a new assignment arrived, applied by the loop
+    std::atomic<bool> _assignmentChanged { false };
+
+    std::mutex _mutex;
+};
+
+extern MqttClusterClass MqttCluster;
@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Arduino.h>
+#include <TaskSchedulerDeclarations.h>
+#include <atomic>
+#include <espMqttClient.h>
+#include <mutex>
+#include <vector>
+
+// A DTU is considered offline if no snapshot arrived for this many of its publish intervals
+#ifndef MQTT_FLEET_PEER_TIMEOUT
+#define MQTT_FLEET_PEER_TIMEOUT 3
+#endif
+
+// DTUs which are offline longer than this (s) are no longer part of the fleet
+#ifndef MQTT_FLEET_PEER_FORGET
+#define MQTT_FLEET_PEER_FORGET 86400
+#endif
+
+#ifndef MQTT_FLEET_MAX_PEERS
+#define MQTT_FLEET_MAX_PEERS 16
+#endif
+
+struct MqttFleetTotal_t {
+    float AcPower; // W
+    float AcYieldDay; // Wh
+    float AcYieldTotal; // kWh
+    float DcPower; // W
+    uint8_t AcPowerDigits;
+    uint8_t AcYieldDayDigits;
+    uint8_t AcYieldTotalDigits;
+    uint8_t DcPowerDigits;
+    uint8_t DtuCount; // DTUs known, including this one
+    uint8_t DtusOnline;
+    bool IsValid; // all DTUs online and all their enabled inverters reachable
+};
+
+// Combines the totals of several DTUs of one site (topic Mqtt.Fleet.Topic).
+//
+// Every DTU with Mqtt.Fleet.Publish sends a compact snapshot of its Datastore totals
+// to [topic]dtu/[id] with its publish interval. An aggregator (Mqtt.Fleet.Aggregate)
+// sums its own totals and those of all DTUs online and publishes them to
+// [topic]total/... The totals are also part of the livedata and Prometheus output.
+// Values of DTUs which are offline are left out and the total is marked as not valid.
+class MqttFleetClass {
+public:
+    MqttFleetClass();
+    void init(Scheduler& scheduler);
+
+    void subscribeTopics();
+    void unsubscribeTopics();
+
+    bool isAggregator() const;
+    MqttFleetTotal_t getTotal();
+
+    // Incremented with every snapshot received, for change detection of the livedata
+    uint32_t getGeneration() const;
+
+private:
+    struct Peer_t {
+        String Id;
+        uint32_t LastSeen; // millis() of the snapshot
+        uint32_t Interval; // publish interval (s) of the DTU
+        float AcPower;
+        float AcYieldDay;
+        float AcYieldTotal;
+        float DcPower;
+        bool IsValid;
+    };
+
+    void loop();
+    void publishSnapshot();
+    void publishTotal();
+
+    void onSnapshot(const espMqttClientTypes::MessageProperties& properties, const char* topic, const uint8_t* payload, const size_t len, const size_t index, const size_t total);
+
+    Task _loopTask;
+
+    String _nodeId;
+    String _subscribedTopic;
+
+    std::vector<Peer_t> _peers;
+    std::atomic<uint32_t> _generation { 0 };
+
+    uint32_t _lastPublish = 0;
+
+    std::mutex _mutex;
+};
+
+extern MqttFleetClass MqttFleet;
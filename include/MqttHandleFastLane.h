@@ -0,0 +1,22 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "EventBus.h"
+#include <Hoymiles.h>
+#include <TaskSchedulerDeclarations.h>
+
+// Publishes the fast lane values (see Mqtt.FastLane) as soon as a response was decoded,
+// without waiting for the publish interval, the idle window of the radios or the slot of
+// the inverter. They are queued ahead of the bulk values, so control loops like a zero
+// export regulation get them with the latency of the radio only. The values are still
+// published by the regular handlers as well.
+class MqttHandleFastLaneClass {
+public:
+    void init(Scheduler& scheduler);
+
+private:
+    void onStatisticsUpdated(const EventData_t& event);
+    void onTotalsUpdated(const EventData_t& event);
+};
+
+extern MqttHandleFastLaneClass MqttHandleFastLane;
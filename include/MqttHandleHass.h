@@ -4,6 +4,22 @@
 #include <ArduinoJson.h>
 #include <Hoymiles.h>
 #include <TaskSchedulerDeclarations.h>
+#include <unordered_map>
+
+// Number of discovery configs published per loop iteration
+#ifndef HASS_CONFIGS_PER_TICK
+#define HASS_CONFIGS_PER_TICK 4
+#endif
+
+// Interval (ms) in which the connection state is checked while no discovery is running
+#ifndef HASS_IDLE_INTERVAL
+#define HASS_IDLE_INTERVAL 500
+#endif
+
+#define HASS_HASH_FILENAME "/hass_hashes.bin"
+
+// Hash which marks a config topic as cleared
+#define HASS_CLEARED_HASH 0
 
 // mqtt discovery device classes
 enum DeviceClassType {
@@ -65,29 +81,47 @@ class MqttHandleHassClass {
 public:
     MqttHandleHassClass();
     void init(Scheduler& scheduler);
+    // Starts publishing all discovery configs. Configs are sent step by step in loop().
     void publishConfig();
     void forceUpdate();
 
 private:
     void loop();
-    static void publish(const String& subtopic, const String& payload);
-    static void publish(const String& subtopic, const JsonDocument& doc);
+    void processDiscovery();
+    void publish(const String& subtopic, const String& payload);
+    void publish(const String& subtopic, const JsonDocument& doc);
+    // Removes a retained config which was published before
+    void clearConfig(const String& subtopic);
+
+    // Publishes the entity config, or adds it to the device config with device based discovery
+    void publishComponent(const char* platform, const String& configTopic, JsonDocument& doc);
+    // Publishes the components collected since the last device, device contains its "dev" object
+    void publishDevice(const String& objectId, JsonDocument& device);
+
+    bool publishNextConfig();
+    bool publishDtuConfig(const uint16_t item);
+    bool publishInverterConfig(std::shared_ptr<InverterAbstract> inv, const uint16_t item);
+
+    // Hash of the settings which decide where and how long the broker keeps the retained configs
+    static uint32_t getRetainedContext();
+    void loadHashes();
+    void saveHashes();
 
     static void addCommonMetadata(JsonDocument& doc, const String& unit_of_measure, const String& icon, const DeviceClassType device_class, const StateClassType state_class, const CategoryType category);
 
     // Binary Sensor
-    static void publishBinarySensor(JsonDocument& doc, const String& root_device, const String& unique_id_prefix, const String& name, const String& state_topic, const String& payload_on, const String& payload_off, const DeviceClassType device_class, const StateClassType state_class, const CategoryType category);
-    static void publishDtuBinarySensor(const String& name, const String& state_topic, const String& payload_on, const String& payload_off, const DeviceClassType device_class, const StateClassType state_class, const CategoryType category);
-    static void publishInverterBinarySensor(std::shared_ptr<InverterAbstract> inv, const String& name, const String& state_topic, const String& payload_on, const String& payload_off, const DeviceClassType device_class, const StateClassType state_class, const CategoryType category);
+    void publishBinarySensor(JsonDocument& doc, const String& root_device, const String& unique_id_prefix, const String& name, const String& state_topic, const String& payload_on, const String& payload_off, const DeviceClassType device_class, const StateClassType state_class, const CategoryType category);
+    void publishDtuBinarySensor(const String& name, const String& state_topic, const String& payload_on, const String& payload_off, const DeviceClassType device_class, const StateClassType state_class, const CategoryType category);
+    void publishInverterBinarySensor(std::shared_ptr<InverterAbstract> inv, const String& name, const String& state_topic, const String& payload_on, const String& payload_off, const DeviceClassType device_class, const StateClassType state_class, const CategoryType category);
 
     // Sensor
-    static void publishSensor(JsonDocument& doc, const String& root_device, const String& unique_id_prefix, const String& name, const String& state_topic, const String& unit_of_measure, const String& icon, const DeviceClassType device_class, const StateClassType state_class, const CategoryType category);
-    static void publishDtuSensor(const String& name, const String& state_topic, const String& unit_of_measure, const String& icon, const DeviceClassType device_class, const StateClassType state_class, const CategoryType category);
-    static void publishInverterSensor(std::shared_ptr<InverterAbstract> inv, const String& name, const String& state_topic, const String& unit_of_measure, const String& icon, const DeviceClassType device_class, const StateClassType state_class, const CategoryType category);
+    void publishSensor(JsonDocument& doc, const String& root_device, const String& unique_id_prefix, const String& name, const String& state_topic, const String& unit_of_measure, const String& icon, const DeviceClassType device_class, const StateClassType state_class, const CategoryType category);
+    void publishDtuSensor(const String& name, const String& state_topic, const String& unit_of_measure, const String& icon, const DeviceClassType device_class, const StateClassType state_class, const CategoryType category);
+    void publishInverterSensor(std::shared_ptr<InverterAbstract> inv, const String& name, const String& state_topic, const String& unit_of_measure, const String& icon, const DeviceClassType device_class, const StateClassType state_class, const CategoryType category);
 
-    static void publishInverterField(std::shared_ptr<InverterAbstract> inv, const ChannelType_t type, const ChannelNum_t channel, const byteAssign_fieldDeviceClass_t fieldType, const bool clear = false);
-    static void publishInverterButton(std::shared_ptr<InverterAbstract> inv, const String& name, const String& state_topic, const String& payload, const String& icon, const DeviceClassType device_class, const StateClassType state_class, const CategoryType category);
-    static void publishInverterNumber(std::shared_ptr<InverterAbstract> inv, const String& name, const String& state_topic, const String& command_topic, const int16_t min, const int16_t max, float step, const String& unit_of_measure, const String& icon, const StateClassType state_class, const CategoryType category);
+    void publishInverterField(std::shared_ptr<InverterAbstract> inv, const ChannelType_t type, const ChannelNum_t channel, const byteAssign_fieldDeviceClass_t fieldType, const bool clear = false);
+    void publishInverterButton(std::shared_ptr<InverterAbstract> inv, const String& name, const String& state_topic, const String& payload, const String& icon, const DeviceClassType device_class, const StateClassType state_class, const CategoryType category);
+    void publishInverterNumber(std::shared_ptr<InverterAbstract> inv, const String& name, const String& state_topic, const String& command_topic, const int16_t min, const int16_t max, float step, const String& unit_of_measure, const String& icon, const StateClassType state_class, const CategoryType category);
 
     static void createInverterInfo(JsonDocument& doc, std::shared_ptr<InverterAbstract> inv);
     static void createDtuInfo(JsonDocument& doc);
@@ -101,6 +135,24 @@ private:
 
     bool _wasConnected = false;
     bool _updateForced = false;
+
+    // Position of the discovery state machine. Inverter -1 are the DTU configs.
+    bool _discoveryRunning = false;
+    int16_t _discoveryInverter = -1;
+    uint16_t _discoveryItem = 0;
+
+    // Device based discovery: the components of the current device are serialized one
+    // after the other into _devicePayload, without the device info of each entity
+    bool _deviceDiscovery = false;
+    String _devicePayload;
+    uint16_t _deviceComponents = 0;
+
+    // Hash of the last published payload per config topic, persisted in HASS_HASH_FILENAME.
+    // They stay valid as long as the retained context does not change.
+    std::unordered_map<uint32_t, uint32_t> _publishedHashes;
+    uint32_t _hashContext = 0;
+    bool _hashesLoaded = false;
+    bool _hashesChanged = false;
 };
 
 extern MqttHandleHassClass MqttHandleHass;
@@ -2,47 +2,97 @@
 #pragma once
 
 #include "Configuration.h"
+#include "FieldRecord.h"
+#include <ArduinoJson.h>
 #include <Hoymiles.h>
 #include <TaskSchedulerDeclarations.h>
 #include <espMqttClient.h>
-#include <frozen/map.h>
 #include <frozen/string.h>
+#include <frozen/unordered_map.h>
+#include <vector>
+
+// Deadbands used if only changed values are published
+#ifndef MQTT_DEADBAND_VOLTAGE
+#define MQTT_DEADBAND_VOLTAGE 0.1f
+#endif
+#ifndef MQTT_DEADBAND_CURRENT
+#define MQTT_DEADBAND_CURRENT 0.01f
+#endif
+#ifndef MQTT_DEADBAND_POWER
+#define MQTT_DEADBAND_POWER 1.0f
+#endif
+#ifndef MQTT_DEADBAND_ENERGY_WH
+#define MQTT_DEADBAND_ENERGY_WH 1.0f
+#endif
+#ifndef MQTT_DEADBAND_ENERGY_KWH
+#define MQTT_DEADBAND_ENERGY_KWH 0.001f
+#endif
+#ifndef MQTT_DEADBAND_FREQUENCY
+#define MQTT_DEADBAND_FREQUENCY 0.01f
+#endif
+#ifndef MQTT_DEADBAND_TEMPERATURE
+#define MQTT_DEADBAND_TEMPERATURE 0.1f
+#endif
+#ifndef MQTT_DEADBAND_PERCENT
+#define MQTT_DEADBAND_PERCENT 0.1f
+#endif
+#ifndef MQTT_DEADBAND_REACTIVE_POWER
+#define MQTT_DEADBAND_REACTIVE_POWER 1.0f
+#endif
 
 class MqttHandleInverterClass {
 public:
     MqttHandleInverterClass();
     void init(Scheduler& scheduler);
 
-    static String getTopic(std::shared_ptr<InverterAbstract> inv, const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId);
+    static String getTopic(InverterAbstract& inv, const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId);
 
     void subscribeTopics();
     void unsubscribeTopics();
 
 private:
     void loop();
-    void publishField(std::shared_ptr<InverterAbstract> inv, const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId);
+    void publishInverter(InverterAbstract& inv, const uint8_t i, const bool publishOnChange, const String& prefix);
+    void publishField(const char* topic, const FieldRecordEntry_t& field);
+
+    static float getDeadband(const UnitId_t unit);
+    static String getFieldName(InverterAbstract& inv, const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId);
+    static String getChannelNumber(const ChannelType_t type, const ChannelNum_t channel);
 
     Task _loopTask;
 
-    uint32_t _lastPublishStats[INV_MAX_COUNT] = { 0 };
-
-    FieldId_t _publishFields[14] = {
-        FLD_UDC,
-        FLD_IDC,
-        FLD_PDC,
-        FLD_YD,
-        FLD_YT,
-        FLD_UAC,
-        FLD_IAC,
-        FLD_PAC,
-        FLD_F,
-        FLD_T,
-        FLD_PF,
-        FLD_EFF,
-        FLD_IRR,
-        FLD_Q
+    // Position within the current publish round, see loop()
+    uint32_t _roundStart = 0;
+    bool _roundStarted = false;
+    uint16_t _nextInverter = 0;
+
+    struct PublishState_t {
+        uint64_t Serial = 0;
+        uint32_t LastPublishStats = 0;
+        uint32_t LastPublishDevInfo = 0;
+        uint32_t LastPublishSystemConfigPara = 0;
+        uint32_t LastEventSequence = 0;
+        uint32_t FieldStatisticsDay = 0;
+        uint32_t LastFullPublish = 0;
+        bool FullPublishDone = false;
+        bool Reachable = false;
+        bool Producing = false;
+
+        // Last published value of each field in the order of publishing
+        std::vector<float> Values;
+
+        // Full topic of each field in the order of publishing. All topics are
+        // stored in one buffer to avoid many small allocations.
+        String TopicPrefix;
+        std::vector<char> Topics;
+        std::vector<uint16_t> TopicOffsets;
     };
 
+    void publishEvents(const String& subtopic, InverterAbstract& inv, PublishState_t& state);
+    void publishFieldStatistics(const String& subtopic, InverterAbstract& inv, const bool previousDay);
+    const char* getFieldTopic(PublishState_t& state, const size_t slot, InverterAbstract& inv, const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId);
+    std::vector<PublishState_t> _publishState;
+
     enum class Topic : unsigned {
         LimitPersistentRelative,
         LimitPersistentAbsolute,
@@ -53,8 +103,10 @@ private:
         ResetRfStats,
     };
 
+    // One subscription <prefix>+/cmd/# for all inverters and commands, the command is
+    // looked up by the last topic level
     static constexpr frozen::string _cmdtopic = "+/cmd/";
-    static constexpr frozen::map<frozen::string, Topic, 7> _subscriptions = {
+    static constexpr frozen::unordered_map<frozen::string, Topic, 7> _commandTopics = {
         { "limit_persistent_relative", Topic::LimitPersistentRelative },
         { "limit_persistent_absolute", Topic::LimitPersistentAbsolute },
         { "limit_nonpersistent_relative", Topic::LimitNonPersistentRelative },
@@ -64,7 +116,8 @@ private:
         { "reset_rf_stats", Topic::ResetRfStats },
     };
 
-    void onMqttMessage(Topic t, const espMqttClientTypes::MessageProperties& properties, const char* topic, const uint8_t* payload, const size_t len, const size_t index, const size_t total);
+    void onMqttMessage(const espMqttClientTypes::MessageProperties& properties, const char* topic, const uint8_t* payload, const size_t len, const size_t index, const size_t total);
+    void onGroupMessage(const espMqttClientTypes::MessageProperties& properties, const char* topic, const uint8_t group, const Topic t, const uint8_t* payload, const size_t len);
 };
 
 extern MqttHandleInverterClass MqttHandleInverter;
@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <TaskSchedulerDeclarations.h>
+#include <mutex>
+#include <vector>
+
+#define MQTT_JOURNAL_MAGIC 0x4E524A4D // "MJRN"
+#define MQTT_JOURNAL_VERSION 1
+#define MQTT_JOURNAL_FILENAME "/mqtt_journal.bin"
+
+// Number of records (32 bytes each) kept on flash. If the journal is full the
+// oldest record is overwritten.
+#ifndef MQTT_JOURNAL_CAPACITY
+#define MQTT_JOURNAL_CAPACITY 1024
+#endif
+
+// Records are collected in RAM and written to flash when this number is reached
+// or the oldest one is older than MQTT_JOURNAL_FLUSH_INTERVAL (s)
+#ifndef MQTT_JOURNAL_FLUSH_COUNT
+#define MQTT_JOURNAL_FLUSH_COUNT 32
+#endif
+#ifndef MQTT_JOURNAL_FLUSH_INTERVAL
+#define MQTT_JOURNAL_FLUSH_INTERVAL 300
+#endif
+
+struct MqttJournalRecord_t {
+    uint64_t Serial;
+    uint32_t Timestamp;
+    float Power; // AC power in W
+    float YieldDay; // Wh
+    float YieldTotal; // kWh
+    float DcPower; // W
+    float Temperature; // °C
+};
+
+struct MqttJournalFileHeader_t {
+    uint32_t Magic;
+    uint16_t Version;
+    uint16_t RecordSize;
+    uint32_t Capacity;
+    uint32_t Head; // ring position of the next record
+    uint32_t Count;
+};
+
+struct MqttJournalStats_t {
+    uint32_t Count; // records waiting for the replay
+    uint32_t Recorded;
+    uint32_t Replayed;
+    uint32_t Evicted;
+};
+
+// Stores timestamped inverter snapshots while the MQTT broker is not reachable
+// and publishes them to [serial]/journal after the connection is back, with at
+// most Mqtt.Journal.ReplayRate records per second.
+class MqttJournalClass {
+public:
+    MqttJournalClass();
+    void init(Scheduler& scheduler);
+
+    // Writes the records which are still held in RAM
+    void flush();
+
+    MqttJournalStats_t getStats();
+
+private:
+    void loop();
+    void record(const uint32_t now);
+    void replay(const uint16_t maxRecords);
+
+    bool openStore();
+    bool writePending();
+    void publishRecord(const MqttJournalRecord_t& record);
+
+    Task _loopTask;
+
+    MqttJournalFileHeader_t _header = {};
+    bool _valid = false;
+    std::vector<MqttJournalRecord_t> _pending;
+    uint32_t _firstPending = 0;
+    uint32_t _lastRecord = 0;
+    MqttJournalStats_t _stats = {};
+
+    std::mutex _mutex;
+};
+
+extern MqttJournalClass MqttJournal;
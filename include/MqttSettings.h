@@ -1,12 +1,53 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 #pragma once
 
+#include "MqttTlsTransport.h"
 #include "NetworkSettings.h"
+#include "TaskCores.h"
 #include <MqttSubscribeParser.h>
 #include <Ticker.h>
+#include <atomic>
+#include <deque>
 #include <espMqttClient.h>
 #include <mutex>
 
+// Settings of the optional publish task (enabled by MQTT_PUBLISH_TASK)
+#ifndef MQTT_PUBLISH_TASK_CORE
+#define MQTT_PUBLISH_TASK_CORE OPENDTU_NETWORK_CORE
+#endif
+#ifndef MQTT_PUBLISH_TASK_PRIORITY
+#define MQTT_PUBLISH_TASK_PRIORITY 1
+#endif
+#ifndef MQTT_PUBLISH_TASK_STACK_SIZE
+#define MQTT_PUBLISH_TASK_STACK_SIZE 4096
+#endif
+
+// Maximum number of queued messages. If the queue is full the oldest message is dropped.
+#ifndef MQTT_PUBLISH_QUEUE_SIZE
+#define MQTT_PUBLISH_QUEUE_SIZE 64
+#endif
+
+// If set, a queued message is replaced by a newer message of the same topic
+#ifndef MQTT_PUBLISH_QUEUE_REPLACE
+#define MQTT_PUBLISH_QUEUE_REPLACE 1
+#endif
+
+// Time (ms) after which a publish is retried if the broker is not connected
+#ifndef MQTT_PUBLISH_RETRY_INTERVAL
+#define MQTT_PUBLISH_RETRY_INTERVAL 50
+#endif
+
+struct MqttPublishQueueStats_t {
+    uint32_t Depth;
+    uint32_t MaxDepth;
+    uint32_t Sent;
+    uint32_t Dropped;
+    uint32_t Replaced;
+    uint32_t LatencyTotal; // ms from enqueue to send
+    uint32_t LatencyMax; // ms
+    uint32_t Bytes; // topics and payloads handed to the client, also the direct publishes
+};
+
 class MqttSettingsClass {
 public:
     MqttSettingsClass();
@@ -14,7 +55,12 @@ public:
     void performReconnect();
     bool getConnected();
     void publish(const String& subtopic, const String& payload);
+    // Queued ahead of all other values, only for the few values which drive control loops
+    void publishPriority(const String& subtopic, const String& payload);
     void publishGeneric(const String& topic, const String& payload, const bool retain, const uint8_t qos = 0);
+    void publishGeneric(const char* topic, const char* payload, const bool retain, const uint8_t qos = 0);
+    // Binary payloads bypass the publish task, the client copies them into its outbox
+    void publishBinary(const char* topic, const uint8_t* payload, const size_t len, const bool retain, const uint8_t qos = 0);
 
     void subscribe(const String& topic, const uint8_t qos, const espMqttClientTypes::OnMessageCallback& cb);
     void unsubscribe(const String& topic);
@@ -22,6 +68,10 @@ public:
     String getPrefix() const;
     String getClientId() const;
 
+    bool hasPublishTask() const;
+    MqttPublishQueueStats_t getPublishQueueStats();
+    MqttTlsStats_t getTlsStats() const;
+
 private:
     void NetworkEvent(network_event event);
 
@@ -34,7 +84,29 @@ private:
 
     void createMqttClientObject();
 
+    void startPublishTask();
+    static void publishTaskProc(void* param);
+    void processPublishQueue();
+    void enqueuePublish(const char* topic, const char* payload, const bool retain, const uint8_t qos, const bool priority = false);
+    void publishDirect(const char* topic, const char* payload, const bool retain, const uint8_t qos);
+
+    struct PublishItem_t {
+        String Topic;
+        String Payload;
+        bool Retain;
+        uint8_t Qos;
+        uint32_t QueuedTime;
+    };
+
+    TaskHandle_t _publishTaskHandle = nullptr;
+    std::deque<PublishItem_t> _publishQueue;
+    std::mutex _publishQueueLock;
+    MqttPublishQueueStats_t _publishQueueStats = {};
+    std::atomic<uint32_t> _bytesPublished { 0 };
+
     MqttClient* _mqttClient = nullptr;
+    // Kept when the client is recreated, so the parsed certificates and the session survive
+    MqttTlsTransport _tlsTransport;
     Ticker _mqttReconnectTimer;
     MqttSubscribeParser _mqttSubscribeParser;
     std::mutex _clientLock;
@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Arduino.h>
+#include <MqttClientSetup.h>
+#include <Transport/Transport.h>
+#include <WiFiClient.h>
+#include <atomic>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/x509_crt.h>
+
+// Timeout (ms) of the TCP connect and of the TLS handshake
+#ifndef MQTT_TLS_TIMEOUT
+#define MQTT_TLS_TIMEOUT 10000
+#endif
+
+struct MqttTlsStats_t {
+    uint32_t Handshakes;
+    uint32_t Resumed; // abbreviated handshakes by a session id or ticket
+    uint32_t Failed;
+    uint32_t LastHandshakeTime; // ms
+    uint32_t CertParses; // the certificates are only parsed again if they changed
+};
+
+// TLS transport of espMqttClient which outlives the client object. The parsed root CA,
+// client certificate and key and the mbedTLS configuration are kept across reconnects,
+// and the session of the last connection is offered to the broker on the next handshake,
+// so a reconnect after a short network outage is resumed without a full key exchange.
+class MqttTlsTransport : public espMqttClientInternals::Transport {
+public:
+    MqttTlsTransport();
+    ~MqttTlsTransport();
+
+    // Parses the PEM strings if they differ from the last call. clientCert and clientKey may be nullptr.
+    // Returns false if they could not be parsed. Must not be called while connected.
+    bool configure(const char* rootCa, const char* clientCert, const char* clientKey);
+
+    MqttTlsStats_t getStats() const;
+
+    bool connect(IPAddress ip, uint16_t port) override;
+    bool connect(const char* host, uint16_t port) override;
+    size_t write(const uint8_t* buf, size_t size) override;
+    int read(uint8_t* buf, size_t size) override;
+    void stop() override;
+    bool connected() override;
+    bool disconnected() override;
+
+private:
+    void freeCertificates();
+    bool handshake(const char* host);
+
+    static int sendCallback(void* ctx, const unsigned char* buf, size_t len);
+    static int recvCallback(void* ctx, unsigned char* buf, size_t len);
+
+    WiFiClient _tcp;
+
+    mbedtls_entropy_context _entropy;
+    mbedtls_ctr_drbg_context _drbg;
+    mbedtls_ssl_config _conf;
+    mbedtls_x509_crt _rootCa;
+    mbedtls_x509_crt _clientCert;
+    mbedtls_pk_context _clientKey;
+    bool _seeded = false;
+    bool _configured = false;
+    uint32_t _configHash = 0;
+
+    mbedtls_ssl_context _ssl;
+    bool _sslActive = false;
+
+    mbedtls_ssl_session _session;
+    bool _sessionValid = false;
+
+    std::atomic<uint32_t> _handshakes { 0 };
+    std::atomic<uint32_t> _resumed { 0 };
+    std::atomic<uint32_t> _failed { 0 };
+    std::atomic<uint32_t> _lastHandshakeTime { 0 };
+    std::atomic<uint32_t> _certParses { 0 };
+};
+
+// espMqttClient using an external MqttTlsTransport
+class espMqttClientTls : public MqttClientSetup<espMqttClientTls> {
+public:
+    espMqttClientTls(MqttTlsTransport& transport, const uint8_t priority, const uint8_t core)
+        : MqttClientSetup(espMqttClientTypes::UseInternalTask::YES, priority, core)
+    {
+        _transport = &transport;
+    }
+};
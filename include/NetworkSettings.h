@@ -4,9 +4,15 @@
 #include "W5500.h"
 #include <DNSServer.h>
 #include <TaskSchedulerDeclarations.h>
+#include <TimerWheel.h>
 #include <WiFi.h>
 #include <vector>
 
+// Interval (ms) of the network loop, it also answers the DNS requests of the admin AP
+#ifndef NETWORK_LOOP_INTERVAL
+#define NETWORK_LOOP_INTERVAL 10
+#endif
+
 enum class network_mode {
     WiFi,
     Ethernet,
@@ -54,34 +60,47 @@ public:
     bool isConnected() const;
     network_mode NetworkMode() const;
 
+    // Maximum modem sleep of the station, not applied while the admin AP is active
+    void setPowerSave(const bool enabled);
+
     bool onEvent(DtuNetworkEventCb cbEvent, const network_event event = network_event::NETWORK_EVENT_MAX);
     void raiseEvent(const network_event event);
 
 private:
     void loop();
+    void secondTick();
     void setHostname();
     void setStaticIp();
     void handleMDNS();
     void setupMode();
+    void applyPowerSave();
     void NetworkEvent(const WiFiEvent_t event, WiFiEventInfo_t info);
+    void reconnectWiFi();
 
     Task _loopTask;
 
     static constexpr byte DNS_PORT = 53;
 
     bool _adminEnabled = true;
+    bool _powerSave = false;
     bool _forceDisconnection = false;
     uint32_t _adminTimeoutCounter = 0;
     uint32_t _adminTimeoutCounterMax = 0;
     uint32_t _connectTimeoutTimer = 0;
     uint32_t _connectRedoTimer = 0;
-    uint32_t _lastTimerCall = 0;
+    WheelTimer _secondTimer;
     IPAddress _apIp;
     IPAddress _apNetmask;
     std::unique_ptr<DNSServer> _dnsServer;
     bool _dnsServerStatus = false;
     network_mode _networkMode = network_mode::Undefined;
     bool _ethConnected = false;
+
+    // Access point of the last connection. The first reconnect attempt after a
+    // connection loss uses it to skip the scan of all channels.
+    uint8_t _lastBssid[6] = {};
+    int32_t _lastChannel = 0;
+    bool _bssidPinned = false;
     std::vector<DtuNetworkEventCbList_t> _cbEventList;
     bool _lastMdnsEnabled = false;
     std::unique_ptr<W5500> _w5500;
@@ -1,13 +1,69 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 #pragma once
 
+#include <TaskSchedulerDeclarations.h>
+#include <atomic>
+#include <ctime>
+#include <mutex>
+
+#define TIME_PERSIST_MAGIC 0x454D4954 // "TIME"
+#define TIME_PERSIST_FILENAME "/time.bin"
+
+// Interval (s) in which the current time is written to flash
+#ifndef TIME_PERSIST_INTERVAL
+#define TIME_PERSIST_INTERVAL 3600
+#endif
+
+// Sources of the system time, ordered from the best to the worst
+enum class TimeSource_t {
+    None,
+    Ntp,
+    Manual, // set by the web API
+    Rtc, // kept by the RTC over a software restart
+    Persisted, // last persisted time plus uptime, late by the time the DTU was off
+};
+
 class NtpSettingsClass {
 public:
     NtpSettingsClass();
-    void init();
+    void init(Scheduler& scheduler);
 
     void setServer();
     void setTimezone();
+
+    void setManualTime(const time_t t);
+
+    TimeSource_t getTimeSource() const;
+    static const char* getTimeSourceName(const TimeSource_t source);
+
+    // False if the time is only an estimate which polling can start with
+    bool isTimeConfident() const;
+
+    // True once the system time was set by any source, does not block like
+    // ::getLocalTime() which waits for the time to become valid. This includes the
+    // persisted estimate, timestamps which are stored or exported need isTimeConfident().
+    bool isTimeSynced() const;
+
+    // Local time of the current second, only converted once per second. The result
+    // is filled even if the time is not synced, it is near 1970 then.
+    bool getLocalTime(struct tm* info);
+
+private:
+    void loop();
+    void restoreTime();
+    void persistTime();
+
+    static void onTimeSync(struct timeval* tv);
+
+    Task _loopTask;
+
+    std::atomic<TimeSource_t> _timeSource = { TimeSource_t::None };
+    std::atomic<bool> _persistPending = { false };
+    uint32_t _lastPersist = 0;
+
+    std::mutex _localTimeMutex;
+    time_t _localTimeSecond = 0; // second _localTime was converted from, 0 if outdated
+    struct tm _localTime = {};
 };
 
-extern NtpSettingsClass NtpSettings;
\ No newline at end of file
+extern NtpSettingsClass NtpSettings;
@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "LoopMonitor.h"
+#include <Arduino.h>
+#include <Hoymiles.h>
+#include <TaskSchedulerDeclarations.h>
+#include <array>
+#include <freertos/FreeRTOS.h>
+#include <vector>
+
+// Delay (s) after the boot so the network, mqtt and the first polls have settled
+#ifndef PERF_BENCHMARK_DELAY
+#define PERF_BENCHMARK_DELAY 120
+#endif
+
+// Duration (s) of the measured run
+#ifndef PERF_BENCHMARK_DURATION
+#define PERF_BENCHMARK_DURATION 600
+#endif
+
+// Limits per second posted to the first inverter during the run, 0 disables the storm
+#ifndef PERF_BENCHMARK_LIMIT_RATE
+#define PERF_BENCHMARK_LIMIT_RATE 2
+#endif
+
+// Interval (ms) of the probe in the main loop, its largest gap is the loop latency
+#define PERF_BENCHMARK_PROBE_INTERVAL 10
+
+// Interval (ms) in which the heap and the cpu load are sampled
+#define PERF_BENCHMARK_SAMPLE_INTERVAL 1000
+
+// Interval (ms) between two result lines, so the serial port keeps up with the log ring
+#define PERF_BENCHMARK_REPORT_INTERVAL 50
+
+// Benchmark builds (env *_perf_bench) measure a fixed scenario once after the boot:
+// the polling of the configured inverters, a limit storm to the first one and the
+// load a host generates meanwhile. The counters of the run are printed as
+// "PERF <metric>{<labels>} <value>" lines, pio-scripts/perf_compare.py puts the
+// results of two builds side by side.
+class PerfBenchmarkClass {
+public:
+    PerfBenchmarkClass();
+    void init(Scheduler& scheduler);
+
+private:
+    void loop();
+    void begin(const uint32_t now);
+    void sample();
+    void postLimit();
+    void finish();
+
+    struct SinkBytes_t {
+        uint32_t Mqtt;
+        uint32_t WsLive;
+        uint32_t Influx;
+    };
+    static SinkBytes_t getSinkBytes();
+
+    template <size_t N>
+    void addQuantiles(const char* metric, const char* labels, const Histogram<N>& end, const Histogram<N>& start);
+    void addLine(const char* format, ...);
+
+    enum class State_t {
+        Waiting,
+        Running,
+        Reporting,
+        Done,
+    };
+
+    struct CommandStart_t {
+        const char* Radio;
+        CommandRadioStats_t Stats;
+    };
+
+    struct TaskLoad_t {
+        char Name[configMAX_TASK_NAME_LEN];
+        int8_t Core;
+        float LoadSum;
+        uint32_t Samples;
+    };
+
+    Task _loopTask;
+    State_t _state = State_t::Waiting;
+
+    uint32_t _runStart = 0;
+    uint32_t _lastProbe = 0;
+    uint32_t _lastSample = 0;
+    uint32_t _lastLimit = 0;
+    uint32_t _lastReport = 0;
+    uint64_t _limitSerial = 0; // inverter which gets the limit storm
+    bool _limitHigh = false;
+
+    uint32_t _loopGapMax = 0;
+    uint32_t _freeHeapMin = UINT32_MAX;
+    uint32_t _largestBlockMin = UINT32_MAX;
+    std::array<float, portNUM_PROCESSORS> _coreLoadSum = {};
+    uint32_t _cpuSamples = 0;
+    std::vector<TaskLoad_t> _taskLoads;
+
+    // Counters at the begin of the run, the report covers only the difference
+    LoopLatency_t _latencyStart;
+    std::vector<CommandStart_t> _commandsStart;
+    LimitCommandStats_t _limitStart = {};
+    SinkBytes_t _bytesStart = {};
+
+    std::vector<String> _report;
+    size_t _reportPos = 0;
+};
+
+extern PerfBenchmarkClass PerfBenchmark;
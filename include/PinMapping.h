@@ -3,11 +3,20 @@
 
 #include <Arduino.h>
 #include <ETH.h>
+#include <FS.h>
 #include <stdint.h>
 
 #define PINMAPPING_FILENAME "/pin_mapping.json"
+
+// The selected mapping is cached to skip parsing PINMAPPING_FILENAME at boot
+#define PINMAPPING_CACHE_FILENAME "/pin_mapping.bin"
+#define PINMAPPING_CACHE_MAGIC 0x50414D50 // "PMAP"
+#define PINMAPPING_CACHE_VERSION 1
 #define PINMAPPING_LED_COUNT 2
 
+// Number of nrf24 modules in addition to the first one. They share its SPI bus.
+#define PINMAPPING_NRF24_EXTRA_COUNT 1
+
 #define MAPPING_NAME_STRLEN 31
 
 struct PinMapping_t {
@@ -20,6 +29,10 @@ struct PinMapping_t {
     gpio_num_t nrf24_en;
     gpio_num_t nrf24_cs;
 
+    gpio_num_t nrf24_extra_irq[PINMAPPING_NRF24_EXTRA_COUNT];
+    gpio_num_t nrf24_extra_en[PINMAPPING_NRF24_EXTRA_COUNT];
+    gpio_num_t nrf24_extra_cs[PINMAPPING_NRF24_EXTRA_COUNT];
+
     gpio_num_t cmt_clk;
     gpio_num_t cmt_cs;
     gpio_num_t cmt_fcs;
@@ -62,6 +75,7 @@ public:
     bool isMappingSelected() const { return _mappingSelected; }
 
     bool isValidNrf24Config() const;
+    bool isValidNrf24ExtraConfig(const uint8_t idx) const;
     bool isValidCmt2300Config() const;
     bool isValidW5500Config() const;
 #if CONFIG_ETH_USE_ESP32_EMAC
@@ -69,6 +83,26 @@ public:
 #endif
 
 private:
+    struct CacheKey_t {
+        uint32_t SourceSize;
+        uint32_t SourceCrc;
+        uint32_t SelectionCrc;
+        uint8_t FirmwareSha[8]; // the defaults are build flags
+    };
+
+    struct CacheFile_t {
+        uint32_t Magic;
+        uint16_t Version;
+        uint16_t Size; // sizeof(PinMapping_t), the layout depends on the build
+        CacheKey_t Key;
+        bool MappingSelected;
+        PinMapping_t PinMapping;
+    };
+
+    static CacheKey_t getCacheKey(File& source, const String& deviceMapping);
+    bool readCache(const CacheKey_t& key);
+    void writeCache(const CacheKey_t& key);
+
     PinMapping_t _pinMapping;
 
     bool _mappingSelected = false;
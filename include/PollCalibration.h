@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Hoymiles.h>
+#include <TaskSchedulerDeclarations.h>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Interval (ms) in which the poll statistics of the inverters are sampled
+#ifndef POLLCAL_SAMPLE_INTERVAL
+#define POLLCAL_SAMPLE_INTERVAL 5000
+#endif
+
+// Samples after which the poll interval is evaluated again
+#ifndef POLLCAL_EVALUATE_SAMPLES
+#define POLLCAL_EVALUATE_SAMPLES 12
+#endif
+
+// Polls of a radio which have to be observed before its result is used
+#ifndef POLLCAL_MIN_POLLS
+#define POLLCAL_MIN_POLLS 8
+#endif
+
+// Percentage added to the measured busy time of a poll
+#ifndef POLLCAL_HEADROOM
+#define POLLCAL_HEADROOM 25
+#endif
+
+// Bounds (s) of the calibrated poll interval
+#ifndef POLLCAL_MIN_INTERVAL
+#define POLLCAL_MIN_INTERVAL 1
+#endif
+#ifndef POLLCAL_MAX_INTERVAL
+#define POLLCAL_MAX_INTERVAL 60
+#endif
+
+// Number of radios, all nrf modules and the cmt module
+#define POLLCAL_RADIO_COUNT (HOY_NRF_RADIO_COUNT + 1)
+
+struct PollCalibrationRadio_t {
+    const char* Name;
+    uint8_t Inverters; // polled and reachable inverters of the radio
+    uint32_t Polls; // observed since the start, the average decays
+    uint32_t Duration; // ms, average time of a poll
+    float SuccessRate; // 0..1, average of the completed polls
+    uint32_t QueueSize; // at the last evaluation
+    uint32_t MinInterval; // ms, below the radio cannot keep up, 0 if not measured yet
+    uint32_t CycleTime; // ms, until all inverters of the radio were polled once with the applied interval
+};
+
+struct PollCalibrationStats_t {
+    bool Enabled;
+    uint32_t Interval; // s, recommended interval including the headroom, 0 if not measured yet
+    uint32_t Applied; // s, interval the radios currently use
+    uint32_t Changes; // of the applied interval
+    std::vector<PollCalibrationRadio_t> Radios;
+};
+
+// Measures how long the polls of each radio take and how many of them succeed, and
+// derives the shortest poll interval the radios sustain without filling their command
+// queues. If the calibration is enabled, the result plus a headroom is used instead
+// of the configured poll interval and re-evaluated as inverters wake up, go to sleep
+// or their links change. The configured interval is used until enough polls were seen.
+class PollCalibrationClass {
+public:
+    PollCalibrationClass();
+    void init(Scheduler& scheduler);
+
+    // Interval (s) which has to be passed to Hoymiles.setPollInterval()
+    uint32_t getPollInterval() const;
+
+    PollCalibrationStats_t getStats() const;
+
+private:
+    void loop();
+    void sample();
+    void evaluate();
+
+    Task _loopTask;
+
+    struct InverterSample_t {
+        uint64_t Serial = 0;
+        uint32_t Runs = 0;
+        uint32_t Completed = 0;
+        uint32_t Aborted = 0;
+    };
+    std::vector<InverterSample_t> _samples;
+
+    struct RadioState_t {
+        uint8_t Inverters = 0;
+        uint32_t Polls = 0;
+        float Duration = 0; // ms, moving average
+        float SuccessRate = 1;
+        uint32_t QueueSize = 0;
+        uint32_t MinInterval = 0;
+    };
+    std::array<RadioState_t, POLLCAL_RADIO_COUNT> _radios;
+
+    uint8_t _sampleCount = 0;
+    uint32_t _interval = 0;
+    uint32_t _applied = 0;
+    uint32_t _changes = 0;
+};
+
+extern PollCalibrationClass PollCalibration;
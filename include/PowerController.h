@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "Configuration.h"
+#include <TaskSchedulerDeclarations.h>
+#include <array>
+#include <espMqttClient.h>
+#include <mutex>
+
+// Interval (ms) in which the controller checks for a new meter value
+#ifndef POWERCTRL_LOOP_INTERVAL
+#define POWERCTRL_LOOP_INTERVAL 20
+#endif
+
+// Minimum time (ms) between two limit commands to the same inverter
+#ifndef POWERCTRL_MIN_COMMAND_INTERVAL
+#define POWERCTRL_MIN_COMMAND_INTERVAL 500
+#endif
+
+// Limit changes below this value (W) are not sent to the inverter
+#ifndef POWERCTRL_HYSTERESIS
+#define POWERCTRL_HYSTERESIS 5.0f
+#endif
+
+// An inverter which produces less than its limit (limited by the sun) can only be
+// raised by this amount (percent of its max power) above the current production
+#ifndef POWERCTRL_HEADROOM
+#define POWERCTRL_HEADROOM 10.0f
+#endif
+
+// Upper limit of the time (s) between two meter values used by the integral part
+#define POWERCTRL_MAX_DT 5.0f
+
+struct PowerControllerStatus_t {
+    bool Enabled;
+    bool Active; // false if there is no recent meter value or no controllable inverter
+    float GridPower;
+    uint32_t GridPowerAge; // ms
+    float Output; // total limit of all controlled inverters (W)
+    uint8_t InverterCount;
+    uint32_t CommandCount;
+};
+
+// Keeps the power at the grid connection at the configured target by adjusting
+// the non persistent limit of all inverters which accept commands. The grid power
+// is pushed by MQTT or the web API, every new value runs one step of a PI loop.
+class PowerControllerClass {
+public:
+    PowerControllerClass();
+    void init(Scheduler& scheduler);
+
+    // Grid power in W, positive values mean drawing power from the grid
+    void setGridPower(const float power);
+
+    void subscribeTopics();
+    void unsubscribeTopics();
+
+    PowerControllerStatus_t getStatus();
+
+private:
+    struct InverterState_t {
+        uint64_t Serial;
+        float Limit; // last sent limit (W)
+        uint32_t LastCommand; // millis
+    };
+
+    void loop();
+    void control(const float gridPower, const float dt);
+    void reset();
+
+    void onMqttMessage(const espMqttClientTypes::MessageProperties& properties, const char* topic, const uint8_t* payload, const size_t len, const size_t index, const size_t total);
+
+    Task _loopTask;
+
+    std::mutex _mutex;
+    float _gridPower = 0;
+    uint32_t _gridPowerTime = 0;
+    bool _gridPowerPending = false;
+
+    String _subscribedTopic;
+
+    bool _active = false;
+    float _output = 0;
+    float _lastError = 0;
+    uint32_t _lastStep = 0;
+    uint8_t _inverterCount = 0;
+    uint32_t _commandCount = 0;
+
+    std::array<InverterState_t, INV_MAX_COUNT> _inverters = {};
+};
+
+extern PowerControllerClass PowerController;
@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <esp_pm.h>
+
+// Lowest cpu frequency (MHz) while no lock is held, 0 keeps the frequency fixed.
+// Below 80 MHz the APB clock and with it the SPI and UART clocks would change.
+#ifndef POWER_MANAGEMENT_MIN_FREQ_MHZ
+#define POWER_MANAGEMENT_MIN_FREQ_MHZ 80
+#endif
+
+struct PowerManagementStats_t {
+    bool Enabled; // dynamic frequency scaling is configured
+    uint32_t MinFreq; // MHz
+    uint32_t MaxFreq;
+    uint32_t WebRequests; // handled while holding the web lock
+};
+
+// Lets the cpu run at a low frequency while the tasks are idle. The radios hold their
+// own lock while commands are queued or a response is awaited (see HoymilesRadio),
+// web requests are handled at full speed through a middleware of WebApi. WiFi and
+// ethernet request the clocks they need from the driver. Requires CONFIG_PM_ENABLE
+// in the sdkconfig, otherwise the frequency stays fixed and the locks do nothing.
+class PowerManagementClass {
+public:
+    // Has to be called before the radios and the web server are started
+    void init();
+
+    void beginWebRequest();
+    void endWebRequest();
+
+    PowerManagementStats_t getStats() const;
+
+private:
+    esp_pm_lock_handle_t _webLock = nullptr;
+    bool _enabled = false;
+    uint32_t _minFreq = 0;
+    uint32_t _maxFreq = 0;
+    std::atomic<uint32_t> _webRequests { 0 };
+};
+
+extern PowerManagementClass PowerManagement;
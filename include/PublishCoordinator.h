@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Arduino.h>
+
+// Time (ms) a publisher may spend in one scheduler slice before it yields to the
+// scheduler, so the next radio command is not delayed by a large publish.
+#ifndef PUBLISH_SLICE_BUDGET
+#define PUBLISH_SLICE_BUDGET 5
+#endif
+
+// Shortest idle window (ms) of the radios in which a slice is granted, the budget
+// of a slice is shortened to the window
+#ifndef PUBLISH_SLICE_MIN_BUDGET
+#define PUBLISH_SLICE_MIN_BUDGET 2
+#endif
+
+// Minimum time (ms) between the start of two slices, the loop runs in between
+#ifndef PUBLISH_SLICE_GAP
+#define PUBLISH_SLICE_GAP 10
+#endif
+
+// Maximum random delay (ms) which is added to a retry
+#ifndef PUBLISH_RETRY_JITTER
+#define PUBLISH_RETRY_JITTER 50
+#endif
+
+// Shares the scheduler time between the MQTT and websocket publishers. The publishers
+// used to wait for Hoymiles.isAllRadioIdle() and then all ran right after the radio
+// transaction in one burst. Now each of them has to begin a slice, only one slice is
+// granted per PUBLISH_SLICE_GAP and every slice has a budget of PUBLISH_SLICE_BUDGET.
+// Slices are only granted within the idle window of the radios (the time until the
+// next poll is due) and end before it closes. A denied publisher sleeps until the
+// next window is expected instead of asking again every few milliseconds. While an
+// inverter is focused (Hoymiles.setFocus) the slices only keep their gap.
+//
+// All methods are called from the loop task.
+class PublishCoordinatorClass {
+public:
+    // Returns false while a radio is active, its next poll is due within
+    // PUBLISH_SLICE_MIN_BUDGET ms or another slice began less than PUBLISH_SLICE_GAP
+    // ms ago. The caller retries after getWaitDelay().
+    bool beginSlice();
+
+    // Delay (ms) until a denied slice is expected to be granted, including a random
+    // jitter so the waiting publishers do not wake up at once
+    uint32_t getWaitDelay() const;
+
+    // True while the current slice has time left
+    bool hasBudget() const;
+
+    // Delay (ms) of a retry, base plus a random jitter so waiting publishers spread out
+    static uint32_t getRetryDelay(const uint32_t base);
+
+    // Offset (ms) of item index of count within interval, used to spread the items
+    // (e.g. the inverters) of one publisher evenly over its interval
+    static uint32_t getSlot(const uint32_t interval, const uint16_t index, const uint16_t count);
+
+    uint32_t getDeniedCount() const;
+    uint32_t getOverrunCount() const;
+
+    // Has to be called by the publisher at the end of each slice to count overruns
+    void endSlice();
+
+private:
+    uint32_t _sliceStart = 0;
+    uint32_t _sliceBudget = PUBLISH_SLICE_BUDGET;
+    bool _sliceStarted = false;
+
+    uint32_t _denied = 0;
+    uint32_t _overruns = 0;
+};
+
+extern PublishCoordinatorClass PublishCoordinator;
@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <cstdint>
+
+// Items transferred per queue and run
+#ifndef QUEUE_BENCHMARK_ITEMS
+#define QUEUE_BENCHMARK_ITEMS 100000
+#endif
+
+// Delay after the boot so the benchmark does not compete with the initialization
+#ifndef QUEUE_BENCHMARK_DELAY
+#define QUEUE_BENCHMARK_DELAY 10000
+#endif
+
+#define QUEUE_BENCHMARK_TASK_STACK_SIZE 4096
+
+// Benchmark builds (env *_queue_bench) compare the queues of lib/ThreadSafeQueue once
+// after the boot. The producers run on the network core, the consumer on the radio
+// core, so the items cross the cores like the rx fragments and log lines do. The
+// results are printed to the console.
+class QueueBenchmarkClass {
+public:
+    void start();
+
+private:
+    static void taskProc(void* param);
+    void run();
+};
+
+extern QueueBenchmarkClass QueueBenchmark;
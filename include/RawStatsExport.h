@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Arduino.h>
+#include <Hoymiles.h>
+#include <TaskSchedulerDeclarations.h>
+#include <WiFiUdp.h>
+#include <atomic>
+#include <vector>
+
+// Interval (ms) in which the inverters are checked for new responses. New statistics
+// are also exported right after the StatisticsUpdated event, this is only a fallback.
+#ifndef RAWSTATS_CHECK_INTERVAL
+#define RAWSTATS_CHECK_INTERVAL 1000
+#endif
+
+#define RAWSTATS_FORMAT_VERSION 1
+
+// Header of a frame, all values big endian, followed by Length bytes of payload
+// as received from the inverter (without the fragment headers and crc).
+//  0  version (RAWSTATS_FORMAT_VERSION)
+//  1  length of the payload
+//  2  serial of the inverter (8 bytes), its upper 16 bits select the byte assignment
+// 10  unix time (s) of the response, 0 without NTP
+#define RAWSTATS_HEADER_SIZE 14
+
+struct RawStatsExportStats_t {
+    uint32_t FramesMqtt;
+    uint32_t FramesUdp;
+    uint32_t FramesFailed;
+};
+
+// Publishes the undecoded statistics payload of every response for decoding on
+// a server, so no values have to be formatted and no topics built on the device.
+class RawStatsExportClass {
+public:
+    RawStatsExportClass();
+    void init(Scheduler& scheduler);
+
+    RawStatsExportStats_t getStats() const;
+
+private:
+    void loop();
+    void sendFrame(InverterAbstract& inv);
+
+    Task _loopTask;
+
+    std::vector<uint32_t> _lastUpdate; // by the position of the inverter
+    WiFiUDP _udp;
+
+    std::atomic<uint32_t> _framesMqtt { 0 };
+    std::atomic<uint32_t> _framesUdp { 0 };
+    std::atomic<uint32_t> _framesFailed { 0 };
+};
+
+extern RawStatsExportClass RawStatsExport;
@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <TaskSchedulerDeclarations.h>
+#include <atomic>
+#include <cstdint>
+
+// Interval (ms) in which the pressure is checked
+#ifndef RESOURCE_GOVERNOR_INTERVAL
+#define RESOURCE_GOVERNOR_INTERVAL 2000
+#endif
+
+// Below these sizes (bytes) of the internal ram the memory is under pressure
+#ifndef RESOURCE_GOVERNOR_MIN_FREE_HEAP
+#define RESOURCE_GOVERNOR_MIN_FREE_HEAP 30000
+#endif
+#ifndef RESOURCE_GOVERNOR_MIN_FREE_BLOCK
+#define RESOURCE_GOVERNOR_MIN_FREE_BLOCK 12000
+#endif
+
+// Violations of the loop budget (see LoopMonitor) per interval which count as cpu pressure
+#ifndef RESOURCE_GOVERNOR_MAX_VIOLATIONS
+#define RESOURCE_GOVERNOR_MAX_VIOLATIONS 3
+#endif
+
+// Intervals without pressure and with a margin of 25 % to the thresholds until one step is restored
+#ifndef RESOURCE_GOVERNOR_RECOVERY_INTERVALS
+#define RESOURCE_GOVERNOR_RECOVERY_INTERVALS 5
+#endif
+
+// Factors by which the shed tasks run less often
+#ifndef RESOURCE_GOVERNOR_DISPLAY_FACTOR
+#define RESOURCE_GOVERNOR_DISPLAY_FACTOR 5
+#endif
+#ifndef RESOURCE_GOVERNOR_MQTT_FACTOR
+#define RESOURCE_GOVERNOR_MQTT_FACTOR 4
+#endif
+
+// In the order the load is shed, the last one is restored first
+enum class ShedStep_t : uint8_t {
+    HassDiscovery, // the discovery pauses and continues afterwards
+    WsDetail, // the live data websocket clients only get the totals, delta clients are kept
+    Display, // the display is updated less often
+    MqttInterval, // the values are published less often
+    Count,
+};
+
+struct ResourceGovernorStats_t {
+    uint8_t Level; // number of shed steps
+    uint32_t FreeHeap; // of the last check
+    uint32_t LargestFreeBlock;
+    uint32_t Violations; // of the loop budget in the last interval
+    uint32_t Escalations;
+};
+
+// Sheds optional load step by step while the heap runs low or the loop misses its
+// budget, and restores it once the pressure cleared for some time. The radio
+// polling and the control commands are never affected.
+class ResourceGovernorClass {
+public:
+    ResourceGovernorClass();
+    void init(Scheduler& scheduler);
+
+    bool isShedding(const ShedStep_t step) const
+    {
+        return _level.load() > static_cast<uint8_t>(step);
+    }
+
+    // Publish interval (s) of the mqtt handlers
+    uint32_t getMqttPublishInterval() const;
+
+    ResourceGovernorStats_t getStats() const;
+
+    static const char* getStepName(const ShedStep_t step);
+
+private:
+    void loop();
+    void setLevel(const uint8_t level);
+
+    Task _loopTask;
+
+    std::atomic<uint8_t> _level { 0 };
+    uint32_t _lastViolations = 0;
+    uint8_t _calmIntervals = 0;
+
+    uint32_t _freeHeap = 0;
+    uint32_t _largestFreeBlock = 0;
+    uint32_t _violations = 0;
+    uint32_t _escalations = 0;
+};
+
+extern ResourceGovernorClass ResourceGovernor;
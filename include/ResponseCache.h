@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <ESPAsyncWebServer.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Total size (bytes) of all cached response bodies
+#ifndef RESPONSE_CACHE_SIZE
+#define RESPONSE_CACHE_SIZE 16384
+#endif
+
+// Larger responses are not cached, they would displace everything else
+#define RESPONSE_CACHE_MAX_ENTRY (RESPONSE_CACHE_SIZE / 2)
+
+struct ResponseCacheEntry_t {
+    String Key;
+    String ETag;
+    const char* ContentType;
+    std::vector<uint8_t> Body;
+};
+
+struct ResponseCacheStats_t {
+    uint32_t Entries;
+    uint32_t Size;
+    uint32_t Hits;
+    uint32_t Misses;
+    uint32_t Evictions;
+};
+
+// Keeps the serialized bodies of the last generated responses. An entry is only
+// valid for the ETag it was generated with, which already changes with the
+// configuration and the parser data. So entries do not have to be invalidated,
+// outdated ones are replaced or displaced by newer ones (least recently used first).
+class ResponseCacheClass {
+public:
+    // Sends the cached body if it was generated for this request and ETag
+    bool send(AsyncWebServerRequest* request, const String& etag);
+
+    void put(const String& key, const String& etag, const char* contentType, std::vector<uint8_t>&& body);
+
+    ResponseCacheStats_t getStats();
+
+    // Url and query parameters
+    static String getKey(AsyncWebServerRequest* request);
+
+private:
+    static void sendEntry(AsyncWebServerRequest* request, const std::shared_ptr<const ResponseCacheEntry_t>& entry);
+
+    std::mutex _mutex;
+    std::list<std::shared_ptr<const ResponseCacheEntry_t>> _entries; // most recently used first
+    size_t _size = 0;
+
+    uint32_t _hits = 0;
+    uint32_t _misses = 0;
+    uint32_t _evictions = 0;
+};
+
+extern ResponseCacheClass ResponseCache;
@@ -9,10 +9,15 @@ public:
     void init(Scheduler& scheduler);
     void triggerRestart();
 
+    // Removes all files except the pin mapping right before the restart, so no
+    // module can write its data back after the removal
+    void triggerFactoryReset();
+
 private:
     void loop();
 
     Task _rebootTask;
+    bool _factoryReset = false;
 };
 
 extern RestartHelperClass RestartHelper;
@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <ESPAsyncWebServer.h>
+#include <array>
+#include <cstdint>
+#include <mutex>
+
+// Lifetime of a session token in seconds
+#ifndef SESSION_TOKEN_LIFETIME
+#define SESSION_TOKEN_LIFETIME 3600
+#endif
+
+#define SESSION_TOKEN_COOKIE "opendtu_session"
+
+// Tokens revoked by a logout are kept until they expire. If more of them are
+// revoked within their lifetime, a new key invalidates all tokens instead.
+#ifndef SESSION_TOKEN_REVOKED_COUNT
+#define SESSION_TOKEN_REVOKED_COUNT 8
+#endif
+
+#define SESSION_TOKEN_KEY_SIZE 32
+#define SESSION_TOKEN_MAC_SIZE 16
+
+// Hex encoded expiry (uptime in seconds) followed by the hex encoded, truncated
+// HMAC-SHA256 of the expiry. Tokens are not stored, a new key invalidates all of them.
+#define SESSION_TOKEN_LENGTH (8 + 2 * SESSION_TOKEN_MAC_SIZE)
+
+class SessionTokenClass {
+public:
+    // Creates a new key, which invalidates all issued tokens
+    void reset();
+
+    String create() const;
+
+    // Checks the "Authorization: Bearer" header and the session cookie
+    bool isAuthenticated(AsyncWebServerRequest* request) const;
+    bool validate(const char* token, const size_t len) const;
+
+    // Invalidates the token the request was authenticated with (logout)
+    void revoke(AsyncWebServerRequest* request);
+
+private:
+    struct Revoked_t {
+        uint32_t Expiry;
+        uint8_t Mac[SESSION_TOKEN_MAC_SIZE];
+    };
+
+    static uint32_t getUptime();
+    static bool findToken(AsyncWebServerRequest* request, const char*& token, size_t& len);
+    static bool decode(const char* token, const size_t len, uint32_t& expiry, uint8_t mac[SESSION_TOKEN_MAC_SIZE]);
+    void computeMac(const uint32_t expiry, uint8_t mac[SESSION_TOKEN_MAC_SIZE]) const;
+
+    uint8_t _key[SESSION_TOKEN_KEY_SIZE] = {};
+    bool _valid = false;
+
+    mutable std::mutex _mutex;
+    std::array<Revoked_t, SESSION_TOKEN_REVOKED_COUNT> _revoked = {};
+};
+
+extern SessionTokenClass SessionToken;
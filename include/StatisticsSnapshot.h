@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "Configuration.h"
+#include <Hoymiles.h>
+#include <TaskSchedulerDeclarations.h>
+#include <TimerWheel.h>
+#include <vector>
+
+#define STATS_SNAPSHOT_MAGIC 0x54535453 // "STST"
+#define STATS_SNAPSHOT_VERSION 1
+#define STATS_SNAPSHOT_FILENAME "/stats_snapshot.bin"
+
+// Interval (s) in which the snapshot is written to RTC memory (kept over a
+// software restart) and to flash (kept over a power loss)
+#ifndef STATS_SNAPSHOT_RTC_INTERVAL
+#define STATS_SNAPSHOT_RTC_INTERVAL 10
+#endif
+#ifndef STATS_SNAPSHOT_FLASH_INTERVAL
+#define STATS_SNAPSHOT_FLASH_INTERVAL 900
+#endif
+
+// RTC memory is small, further inverters are only restored from flash
+#ifndef STATS_SNAPSHOT_RTC_COUNT
+#define STATS_SNAPSHOT_RTC_COUNT 6
+#endif
+
+struct StatsSnapshotEntry_t {
+    uint64_t Serial;
+    int64_t Timestamp; // unix time of the last response
+    StatisticsSnapshot_t Statistics;
+};
+
+struct StatsSnapshotHeader_t {
+    uint32_t Magic;
+    uint16_t Version;
+    uint16_t Count;
+    uint32_t Crc; // of all entries
+};
+
+// Restores the last statistics of every inverter at boot, so the display, the
+// web interface and MQTT show them until the inverter answers. With only the
+// persisted time estimate the restore waits until NTP (or a manual time) confirms
+// it, inverters which answered meanwhile are skipped.
+class StatisticsSnapshotClass {
+public:
+    StatisticsSnapshotClass();
+
+    // Has to be called after the inverters were added
+    void init(Scheduler& scheduler);
+
+private:
+    void loop();
+    void restore();
+    bool update();
+    void writeRtc();
+    void writeFlash();
+
+    static bool readFlash(std::vector<StatsSnapshotEntry_t>& entries);
+    static void restoreEntry(InverterAbstract& inv, const StatsSnapshotEntry_t& entry, const time_t now);
+
+    Task _loopTask;
+
+    std::vector<StatsSnapshotEntry_t> _entries;
+    std::vector<uint32_t> _lastUpdate;
+    WheelTimer _flashTimer; // armed while a write to the flash is pending
+    uint32_t _lastFlashWrite = 0;
+    bool _restoreDone = false;
+};
+
+extern StatisticsSnapshotClass StatisticsSnapshot;
@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "MessageOutput.h"
+#include "TaskCores.h"
+#include <TaskSchedulerDeclarations.h>
+#include <WiFiUdp.h>
+#include <atomic>
+
+// Settings of the task which sends the datagrams. It runs below the other network
+// tasks, the records wait in the ring of MessageOutput meanwhile.
+#ifndef SYSLOG_TASK_CORE
+#define SYSLOG_TASK_CORE OPENDTU_NETWORK_CORE
+#endif
+#ifndef SYSLOG_TASK_PRIORITY
+#define SYSLOG_TASK_PRIORITY 1
+#endif
+#ifndef SYSLOG_TASK_STACK_SIZE
+#define SYSLOG_TASK_STACK_SIZE 4096
+#endif
+
+// Maximum size of a datagram, the records of a cycle are joined up to it
+#ifndef SYSLOG_DATAGRAM_SIZE
+#define SYSLOG_DATAGRAM_SIZE 1024
+#endif
+
+// Time (ms) in which the records are collected before they are sent
+#ifndef SYSLOG_FLUSH_INTERVAL
+#define SYSLOG_FLUSH_INTERVAL 500
+#endif
+
+// Facility of the RFC 5424 messages (16 = local0)
+#ifndef SYSLOG_FACILITY
+#define SYSLOG_FACILITY 16
+#endif
+
+enum class SyslogFormat_t : uint8_t {
+    Rfc5424 = 0,
+    Lines, // "<hostname> <uptime> <level> <subsystem>: <text>" per line
+    Count,
+};
+
+struct SyslogExportStats_t {
+    uint32_t Datagrams;
+    uint32_t Records;
+    uint32_t RecordsFailed; // datagram could not be sent
+    uint32_t Overruns; // records overwritten in the ring before they were sent
+};
+
+// Ships the console records to a remote syslog server or UDP line receiver. The task
+// is one more reader of the MessageOutput ring with its own cursor, so the writers
+// never wait for the network and the only buffer is one datagram. Records which are
+// overwritten in the ring while the network is slow or down are counted as overruns.
+// An RFC 5424 message carries the consecutive lines of the same level and subsystem,
+// the subsystem is its MSGID. In the line format every datagram holds as many lines
+// as fit.
+class SyslogExportClass {
+public:
+    SyslogExportClass();
+    void init(Scheduler& scheduler);
+
+    SyslogExportStats_t getStats() const;
+
+private:
+    void loop();
+
+    static void taskProc(void* param);
+    void run();
+    void drain(const SyslogFormat_t format, const IPAddress& ip, const uint16_t port);
+    size_t formatHeader(const SyslogFormat_t format, const MessageRecord_t& record, char* buffer, const size_t maxLen) const;
+    void send(const SyslogFormat_t format, const IPAddress& ip, const uint16_t port, const char* data, size_t len, const uint32_t records);
+
+    Task _loopTask;
+
+    TaskHandle_t _taskHandle = nullptr;
+    std::atomic<uint8_t> _level { static_cast<uint8_t>(MessageLevel_t::None) };
+
+    // Only used by the task
+    uint32_t _cursor = 0;
+    String _hostname;
+    WiFiUDP _udp;
+
+    std::atomic<uint32_t> _datagrams { 0 };
+    std::atomic<uint32_t> _records { 0 };
+    std::atomic<uint32_t> _recordsFailed { 0 };
+    std::atomic<uint32_t> _overruns { 0 };
+};
+
+extern SyslogExportClass SyslogExport;
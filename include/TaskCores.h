@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Arduino.h>
+
+// Threading model
+//
+// Radio core: the Arduino loop task, which runs the scheduler and with it all calls
+// into the Hoymiles library, and the optional rx tasks of the radios
+// (HOY_RADIO_TASK, HOY_RADIO_TASK_CORE) at a higher priority than the loop.
+//
+// Network core: lwip and the wifi/ethernet driver (core 0 by the IDF), AsyncTCP with
+// the web server and the websockets (CONFIG_ASYNC_TCP_RUNNING_CORE), the espMqttClient
+// task, the MQTT publish task and the tasks of the log output and the firmware update.
+//
+// Ownership: the inverters and their parsers are written by the loop task only. Web
+// and MQTT callbacks read them with Parser::readConsistent() and change them by
+// enqueuing commands, which the loop sends. Locks taken from both cores (Hoymiles._mutex,
+// the parser and cache mutexes) are only held for short copies. All std::mutex are
+// FreeRTOS mutexes, which have priority inheritance, so a web handler holding one is
+// raised to the priority of a waiting radio task.
+//
+// On single core chips everything runs on core 0 and only the priorities apply.
+#ifndef OPENDTU_RADIO_CORE
+#define OPENDTU_RADIO_CORE ARDUINO_RUNNING_CORE
+#endif
+
+#ifndef OPENDTU_NETWORK_CORE
+#if CONFIG_FREERTOS_UNICORE
+#define OPENDTU_NETWORK_CORE 0
+#else
+#define OPENDTU_NETWORK_CORE (1 - ARDUINO_RUNNING_CORE)
+#endif
+#endif
+
+// Settings of the task of espMqttClient
+#ifndef MQTT_CLIENT_TASK_PRIORITY
+#define MQTT_CLIENT_TASK_PRIORITY 1
+#endif
+#ifndef MQTT_CLIENT_TASK_CORE
+#define MQTT_CLIENT_TASK_CORE OPENDTU_NETWORK_CORE
+#endif
@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <TaskSchedulerDeclarations.h>
+#include <list>
+#include <mutex>
+#include <vector>
+
+// Interval in seconds in which the task statistics are written to the console, 0 disables it
+#ifndef TASK_PROFILER_REPORT_INTERVAL
+#define TASK_PROFILER_REPORT_INTERVAL 300
+#endif
+
+struct TaskProfileStats_t {
+    const char* Name;
+    uint32_t RunCount;
+    uint64_t RunTimeTotal; // us
+    uint32_t RunTimeMax; // us
+    uint32_t Overruns; // runs which took longer than the task interval
+    uint64_t LatenessTotal; // ms the start was delayed against the schedule
+    uint32_t LatenessMax; // ms
+};
+
+class TaskProfilerClass {
+public:
+    TaskProfilerClass();
+    void init(Scheduler& scheduler);
+
+    // Sets the callback of the task and records the statistics of each run under the given name
+    void setCallback(Task& task, const char* name, TaskCallback callback);
+
+    std::vector<TaskProfileStats_t> getStats();
+
+    // Time (ms) until the next enabled task is due, at most maxTime
+    long getTimeUntilNextRun(Scheduler& scheduler, const long maxTime);
+
+private:
+    struct TaskProfile_t {
+        Task* task;
+        TaskCallback callback;
+        TaskProfileStats_t stats;
+    };
+
+    void run(TaskProfile_t& profile);
+    void loop();
+
+    Task _loopTask;
+
+    std::list<TaskProfile_t> _profiles;
+    std::mutex _mutex;
+};
+
+extern TaskProfilerClass TaskProfiler;
@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <TaskSchedulerDeclarations.h>
+#include <TimerWheel.h>
+
+// Upper limit (ms) between two runs of the service, also if no timer is armed
+#ifndef TIMER_SERVICE_MAX_DELAY
+#define TIMER_SERVICE_MAX_DELAY (60 * 1000)
+#endif
+
+// Central deadlines of the firmware. Components arm a WheelTimer instead of checking
+// the elapsed time in every run of their loop. The wheel is driven by millis() from a
+// single task of the scheduler, which is delayed until the next slot with a timer, so
+// LoopWakeup can sleep in between. The callbacks run in the loop task.
+//
+// Has to be used from the loop task only, like the scheduler itself.
+class TimerServiceClass {
+public:
+    TimerServiceClass();
+    void init(Scheduler& scheduler);
+
+    // Expires the timer after delay ms, and after that every period ms if period > 0
+    void arm(WheelTimer& timer, const uint32_t delay, const uint32_t period = 0);
+
+    size_t getArmedCount() const;
+
+private:
+    void loop();
+
+    Task _loopTask;
+    TimerWheel _wheel;
+};
+
+extern TimerServiceClass TimerService;
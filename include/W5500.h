@@ -8,6 +8,23 @@
 
 #include <memory>
 
+// SPI clock of the W5500, 20 MHz is stable with the OpenDTU Fusion shield.
+// The chip supports up to 80 MHz with short wiring.
+#ifndef W5500_SPI_CLOCK_SPEED
+#define W5500_SPI_CLOCK_SPEED 20000000
+#endif
+
+// Number of queued SPI transactions of the MAC driver
+#ifndef W5500_SPI_QUEUE_SIZE
+#define W5500_SPI_QUEUE_SIZE 20
+#endif
+
+// Settings of the driver task which reads the received frames after an interrupt
+#ifndef W5500_RX_TASK_STACK_SIZE
+#define W5500_RX_TASK_STACK_SIZE 4096
+#endif
+// W5500_RX_TASK_PRIORITY can be defined to override the priority of the driver default
+
 class W5500 {
 private:
     explicit W5500(spi_device_handle_t spi, gpio_num_t pin_int);
@@ -1,6 +1,8 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 #pragma once
 
+#include "WebApi_bulk.h"
+#include "WebApi_capture.h"
 #include "WebApi_device.h"
 #include "WebApi_devinfo.h"
 #include "WebApi_dtu.h"
@@ -9,23 +11,63 @@
 #include "WebApi_file.h"
 #include "WebApi_firmware.h"
 #include "WebApi_gridprofile.h"
+#include "WebApi_history.h"
 #include "WebApi_i18n.h"
+#include "WebApi_influx.h"
 #include "WebApi_inverter.h"
 #include "WebApi_limit.h"
 #include "WebApi_maintenance.h"
+#include "WebApi_modbus.h"
 #include "WebApi_mqtt.h"
 #include "WebApi_network.h"
 #include "WebApi_ntp.h"
 #include "WebApi_power.h"
+#include "WebApi_powercontrol.h"
 #include "WebApi_prometheus.h"
+#include "WebApi_rawstats.h"
 #include "WebApi_security.h"
+#include "WebApi_syslog.h"
 #include "WebApi_sysstatus.h"
 #include "WebApi_webapp.h"
 #include "WebApi_ws_console.h"
 #include "WebApi_ws_live.h"
 #include <AsyncJson.h>
 #include <ESPAsyncWebServer.h>
+#include <Hoymiles.h>
 #include <TaskSchedulerDeclarations.h>
+#include <array>
+#include <functional>
+#include <vector>
+
+// Maximum size (bytes) of an application/json request body, the MQTT settings with
+// all certificates are the largest one
+#ifndef WEBAPI_MAX_BODY_SIZE
+#define WEBAPI_MAX_BODY_SIZE 10240
+#endif
+
+// Streamed and text responses are gzip compressed if the client accepts it
+#ifndef WEBAPI_GZIP_RESPONSES
+#define WEBAPI_GZIP_RESPONSES 1
+#endif
+
+// Fills the array element with the given index. Returns false if there are no more elements,
+// an element left empty is skipped.
+using JsonStreamElementCallback = std::function<bool(size_t index, JsonDocument& element)>;
+using JsonStreamMembersCallback = std::function<void(JsonDocument& members)>;
+
+// Inverters and fields requested by ?inv=<serial>,...&fields=<name>,...&channels=ac,dc,inv.
+// Field names are the ones of the live data (Power, YieldDay, ...), case and spaces are ignored.
+struct WebApiFieldFilter_t {
+    std::vector<uint64_t> Serials; // empty for all
+    std::array<uint32_t, TYPE_CNT> FieldMask; // bit per FieldId_t of each channel type
+
+    // True if fields or channels restrict the output
+    bool Projected = false;
+
+    bool includesInverter(const uint64_t serial) const;
+    bool includesChannelType(const ChannelType_t type) const { return FieldMask[type] != 0; }
+    bool includesField(const ChannelType_t type, const FieldId_t fieldId) const { return FieldMask[type] & (1UL << fieldId); }
+};
 
 class WebApiClass {
 public:
@@ -34,19 +76,49 @@ public:
     void reload();
 
     static bool checkCredentials(AsyncWebServerRequest* request);
+    // Only the password (basic auth), a session token is not accepted
+    static bool checkPassword(AsyncWebServerRequest* request);
     static bool checkCredentialsReadonly(AsyncWebServerRequest* request);
 
-    static void sendTooManyRequests(AsyncWebServerRequest* request);
+    static void sendUnauthorized(AsyncWebServerRequest* request);
+    static void sendTooManyRequests(AsyncWebServerRequest* request, const uint32_t retryAfter = 60);
 
     static void writeConfig(JsonVariant& retMsg, const WebApiError code = WebApiError::GenericSuccess, const String& message = "Settings saved!");
 
+    // Parses an application/json body from the request buffer, otherwise the form parameter "data"
     static bool parseRequestData(AsyncWebServerRequest* request, AsyncJsonResponse* response, JsonDocument& json_document);
+    // Body handler of the POST handlers which use parseRequestData
+    static void onRequestBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total);
     static uint64_t parseSerialFromRequest(AsyncWebServerRequest* request, String param_name = "inv");
-    static bool sendJsonResponse(AsyncWebServerRequest* request, AsyncJsonResponse* response, const char* function, const uint16_t line);
+    static WebApiFieldFilter_t parseFieldFilter(AsyncWebServerRequest* request);
+    static bool requestsMsgPack(AsyncWebServerRequest* request);
+    static bool acceptsGzip(AsyncWebServerRequest* request);
+    // Response stream which is compressed while it is written if the client accepts gzip
+    static AsyncResponseStream* beginResponseStream(AsyncWebServerRequest* request, const char* contentType, const size_t bufferSize);
+    static AsyncJsonResponse* createJsonResponse(AsyncWebServerRequest* request);
+    // With cache the serialized response is kept in the ResponseCache for its ETag
+    static bool sendJsonResponse(AsyncWebServerRequest* request, AsyncJsonResponse* response, const char* function, const uint16_t line, const String& etag = String(), const bool cache = false);
+    static void sendJsonArrayStream(AsyncWebServerRequest* request, const char* arrayName, const JsonStreamElementCallback& elementCb, const JsonStreamMembersCallback& membersCb = nullptr, const String& etag = String(), const bool cache = false);
+
+    // Weak ETag of the values a response is generated from. The boot, the configuration
+    // and the requested format are part of it.
+    static String generateETag(AsyncWebServerRequest* request, const std::vector<uint32_t>& state);
+    // Answers with 304 if the client already has the response with this ETag
+    static bool sendNotModified(AsyncWebServerRequest* request, const String& etag);
+    // Same as sendNotModified, otherwise answers with the cached response for this ETag.
+    // Only for responses which are completely defined by their ETag.
+    static bool sendCached(AsyncWebServerRequest* request, const String& etag);
+
+    WsLiveStats_t getWsLiveStats() const { return _webApiWsLive.getStats(); }
 
 private:
+    static void cacheJsonResponse(AsyncWebServerRequest* request, AsyncJsonResponse* response, const String& etag);
+
     AsyncWebServer _server;
+    AsyncMiddlewareFunction _admission; // rejects requests over the budget of the client before the handler runs
 
+    WebApiBulkClass _webApiBulk;
+    WebApiCaptureClass _webApiCapture;
     WebApiDeviceClass _webApiDevice;
     WebApiDevInfoClass _webApiDevInfo;
     WebApiDtuClass _webApiDtu;
@@ -54,16 +126,22 @@ private:
     WebApiFileClass _webApiFile;
     WebApiFirmwareClass _webApiFirmware;
     WebApiGridProfileClass _webApiGridprofile;
+    WebApiHistoryClass _webApiHistory;
     WebApiI18nClass _webApiI18n;
+    WebApiInfluxClass _webApiInflux;
     WebApiInverterClass _webApiInverter;
     WebApiLimitClass _webApiLimit;
     WebApiMaintenanceClass _webApiMaintenance;
+    WebApiModbusClass _webApiModbus;
     WebApiMqttClass _webApiMqtt;
     WebApiNetworkClass _webApiNetwork;
     WebApiNtpClass _webApiNtp;
     WebApiPowerClass _webApiPower;
+    WebApiPowerControlClass _webApiPowerControl;
     WebApiPrometheusClass _webApiPrometheus;
+    WebApiRawStatsClass _webApiRawStats;
     WebApiSecurityClass _webApiSecurity;
+    WebApiSyslogClass _webApiSyslog;
     WebApiSysstatusClass _webApiSysstatus;
     WebApiWebappClass _webApiWebapp;
     WebApiWsConsoleClass _webApiWsConsole;
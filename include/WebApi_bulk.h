@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "Configuration.h"
+#include "WebApi_errors.h"
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+#include <Hoymiles.h>
+#include <TaskSchedulerDeclarations.h>
+#include <memory>
+
+// Maximum number of commands in one request
+#ifndef BULK_MAX_COMMANDS
+#define BULK_MAX_COMMANDS (2 * INV_MAX_COUNT)
+#endif
+
+class WebApiBulkClass {
+public:
+    void init(AsyncWebServer& server, Scheduler& scheduler);
+
+private:
+    enum class CommandType_t {
+        Limit,
+        Power,
+        Restart,
+    };
+
+    struct Command_t {
+        std::shared_ptr<InverterAbstract> Inverter;
+        CommandType_t Type;
+        float LimitValue;
+        PowerLimitControlType LimitType;
+        bool PowerOn;
+    };
+
+    void onBulkPost(AsyncWebServerRequest* request);
+
+    static WebApiError parseCommand(const JsonVariantConst& cmd, Command_t& command);
+    static bool sendCommand(const Command_t& command);
+};
@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <ESPAsyncWebServer.h>
+#include <TaskSchedulerDeclarations.h>
+
+// Link type of the pcap file, the records are not a standard protocol
+#define CAPTURE_PCAP_LINKTYPE 147 // LINKTYPE_USER0
+
+class WebApiCaptureClass {
+public:
+    void init(AsyncWebServer& server, Scheduler& scheduler);
+
+private:
+    void onCaptureGet(AsyncWebServerRequest* request);
+    void onCaptureStatus(AsyncWebServerRequest* request);
+    void onCapturePost(AsyncWebServerRequest* request);
+};
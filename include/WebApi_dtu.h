@@ -1,8 +1,12 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 #pragma once
 
+#include <ArduinoJson.h>
 #include <ESPAsyncWebServer.h>
 #include <TaskSchedulerDeclarations.h>
+#include <vector>
+
+struct CommandTrace_t;
 
 class WebApiDtuClass {
 public:
@@ -12,6 +16,11 @@ public:
 private:
     void onDtuAdminGet(AsyncWebServerRequest* request);
     void onDtuAdminPost(AsyncWebServerRequest* request);
+    void onTracesGet(AsyncWebServerRequest* request);
+    void onQueueGet(AsyncWebServerRequest* request);
+
+    static void addTracesJson(JsonObject root, const std::vector<CommandTrace_t>& traces);
+    static void addTracesOtel(JsonObject root, const std::vector<CommandTrace_t>& traces);
 
     Task _applyDataTask;
     void applyDataTaskCb();
@@ -5,7 +5,7 @@ enum WebApiError {
     GenericBase = 1000,
     GenericSuccess,
     GenericNoValueFound,
-    GenericDataTooLarge, // not used anymore
+    GenericDataTooLarge,
     GenericParseError,
     GenericValueMissing,
     GenericWriteFailed,
@@ -17,6 +17,7 @@ enum WebApiError {
     DtuInvalidPowerLevel,
     DtuInvalidCmtFrequency,
     DtuInvalidCmtCountry,
+    DtuInvalidLimitHysteresis,
 
     FileBase = 3000,
     FileNotDeleted,
@@ -34,12 +35,16 @@ enum WebApiError {
     InverterDeleted,
     InverterOrdered,
     InverterStatsResetted,
+    InverterFocusStarted,
+    InverterFocusStopped,
+    InverterFocusInvalid,
 
     LimitBase = 5000,
     LimitSerialZero,
     LimitInvalidLimit,
     LimitInvalidType,
     LimitInvalidInverter,
+    LimitInvalidGroup,
 
     MaintenanceBase = 6000,
     MaintenanceRebootTriggered,
@@ -63,6 +68,13 @@ enum WebApiError {
     MqttHassTopicCharacter,
     MqttLwtQos,
     MqttClientIdLength,
+    MqttJournalReplayRate,
+    MqttClusterTopicLength,
+    MqttClusterTopicCharacter,
+    MqttClusterTopicTrailingSlash,
+    MqttFleetTopicLength,
+    MqttFleetTopicCharacter,
+    MqttFleetTopicTrailingSlash,
 
     NetworkBase = 8000,
     NetworkIpInvalid,
@@ -87,6 +99,7 @@ enum WebApiError {
     SecurityBase = 10000,
     SecurityPasswordLength,
     SecurityAuthSuccess,
+    SecurityLoginSuccess,
 
     PowerBase = 11000,
     PowerSerialZero,
@@ -94,4 +107,43 @@ enum WebApiError {
 
     HardwareBase = 12000,
     HardwarePinMappingLength,
+
+    FirmwareBase = 13000,
+    FirmwareUrlInvalid,
+    FirmwareUpdateRunning,
+    FirmwarePullStarted,
+    FirmwareMd5Invalid,
+    FirmwareRootCaMissing,
+
+    BulkBase = 14000,
+    BulkTooManyCommands,
+    BulkInvalidCommand,
+    BulkCommandsDisabled,
+    BulkCommandFailed,
+
+    PowerControlBase = 15000,
+    PowerControlTopicLength,
+    PowerControlGainInvalid,
+    PowerControlMinLimitInvalid,
+    PowerControlTimeoutZero,
+    PowerControlMeterReceived,
+
+    InfluxBase = 16000,
+    InfluxUrlInvalid,
+    InfluxTokenLength,
+    InfluxFlushInterval,
+    InfluxRootCaMissing,
+
+    ModbusBase = 17000,
+    ModbusPortInvalid,
+
+    RawStatsBase = 18000,
+    RawStatsHostLength,
+    RawStatsPortInvalid,
+
+    SyslogBase = 19000,
+    SyslogHostLength,
+    SyslogPortInvalid,
+    SyslogFormatInvalid,
+    SyslogLevelInvalid,
 };
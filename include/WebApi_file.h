@@ -15,4 +15,8 @@ private:
     void onFileListGet(AsyncWebServerRequest* request);
     void onFileUploadFinish(AsyncWebServerRequest* request);
     void onFileUpload(AsyncWebServerRequest* request, String filename, size_t index, uint8_t* data, size_t len, bool final);
+    void onConfigRestore(AsyncWebServerRequest* request);
+
+    static bool parseRange(const String& range, const size_t size, size_t& start, size_t& end);
+    static const char* getContentType(const String& filename);
 };
@@ -1,14 +1,96 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 #pragma once
 
+#include "TaskCores.h"
 #include <ESPAsyncWebServer.h>
 #include <TaskSchedulerDeclarations.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/stream_buffer.h>
+#include <mutex>
 
+// Size of the buffer between the upload and the flash writes
+#ifndef FIRMWARE_RING_SIZE
+#define FIRMWARE_RING_SIZE 16384
+#endif
+
+// Data is written to flash in blocks of one sector
+#define FIRMWARE_BLOCK_SIZE 4096
+
+// Settings of the task which writes the received data to flash
+#ifndef FIRMWARE_TASK_CORE
+#define FIRMWARE_TASK_CORE OPENDTU_NETWORK_CORE
+#endif
+#ifndef FIRMWARE_TASK_PRIORITY
+#define FIRMWARE_TASK_PRIORITY 2
+#endif
+#ifndef FIRMWARE_TASK_STACK_SIZE
+#define FIRMWARE_TASK_STACK_SIZE 4096
+#endif
+
+// An interrupted upload can be resumed within this time (s)
+#ifndef FIRMWARE_RESUME_TIMEOUT
+#define FIRMWARE_RESUME_TIMEOUT 300
+#endif
+
+// Maximum time the upload waits for the writer task to finish the last flash write (ms)
+#ifndef FIRMWARE_WRITE_TIMEOUT
+#define FIRMWARE_WRITE_TIMEOUT 10000
+#endif
+
+// Maximum time a received chunk waits for free space in the ring (ms). The upload handler
+// runs in the network task, so a longer stall is answered with 503 and the range received
+// so far, the client resumes from there.
+#ifndef FIRMWARE_QUEUE_TIMEOUT
+#define FIRMWARE_QUEUE_TIMEOUT 1000
+#endif
+
+// Received data is queued in a ring and written to flash by a separate task, so
+// the network keeps receiving while a sector is erased and written. An upload
+// which was interrupted continues at the received position if the next request
+// contains a "Content-Range: bytes <start>-<end>/<total>" header.
 class WebApiFirmwareClass {
 public:
     void init(AsyncWebServer& server, Scheduler& scheduler);
 
 private:
+    enum class SessionState_t {
+        Idle,
+        Receiving,
+        Finishing,
+        Done,
+        Failed,
+    };
+
     void onFirmwareUpdateFinish(AsyncWebServerRequest* request);
     void onFirmwareUpdateUpload(AsyncWebServerRequest* request, String filename, size_t index, uint8_t* data, size_t len, bool final);
+    void onFirmwareStatus(AsyncWebServerRequest* request);
+    void onFirmwarePullPost(AsyncWebServerRequest* request);
+
+    bool beginSession(AsyncWebServerRequest* request, const size_t total);
+    void abortSession();
+    bool queueData(const uint8_t* data, size_t len);
+    bool finishSession();
+
+    static bool parseContentRange(AsyncWebServerRequest* request, size_t& start, size_t& total);
+    void addRangeHeader(AsyncWebServerResponse* response);
+
+    static void writerTaskProc(void* param);
+    void writerLoop();
+
+    StreamBufferHandle_t _ring = nullptr;
+    uint8_t* _block = nullptr;
+    TaskHandle_t _writerTaskHandle = nullptr;
+    SemaphoreHandle_t _writerDone = nullptr;
+
+    std::mutex _mutex;
+    std::atomic<SessionState_t> _state { SessionState_t::Idle };
+    std::atomic<bool> _abort { false };
+    size_t _received = 0; // bytes of the firmware queued so far
+    size_t _total = 0; // size of the firmware, 0 if unknown
+    uint32_t _lastActivity = 0;
+
+    // Request which currently uploads and the firmware position of its first byte
+    AsyncWebServerRequest* _uploadRequest = nullptr;
+    size_t _uploadStart = 0;
 };
@@ -0,0 +1,15 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <ESPAsyncWebServer.h>
+#include <TaskSchedulerDeclarations.h>
+
+class WebApiInfluxClass {
+public:
+    void init(AsyncWebServer& server, Scheduler& scheduler);
+
+private:
+    void onInfluxStatus(AsyncWebServerRequest* request);
+    void onInfluxAdminGet(AsyncWebServerRequest* request);
+    void onInfluxAdminPost(AsyncWebServerRequest* request);
+};
@@ -15,4 +15,6 @@ private:
     void onInverterDelete(AsyncWebServerRequest* request);
     void onInverterOrder(AsyncWebServerRequest* request);
     void onInverterStatReset(AsyncWebServerRequest* request);
+    void onInverterFocusGet(AsyncWebServerRequest* request);
+    void onInverterFocusPost(AsyncWebServerRequest* request);
 };
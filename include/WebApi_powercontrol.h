@@ -0,0 +1,16 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <ESPAsyncWebServer.h>
+#include <TaskSchedulerDeclarations.h>
+
+class WebApiPowerControlClass {
+public:
+    void init(AsyncWebServer& server, Scheduler& scheduler);
+
+private:
+    void onPowerControlStatus(AsyncWebServerRequest* request);
+    void onPowerControlAdminGet(AsyncWebServerRequest* request);
+    void onPowerControlAdminPost(AsyncWebServerRequest* request);
+    void onPowerControlMeterPost(AsyncWebServerRequest* request);
+};
@@ -2,47 +2,124 @@
 #pragma once
 
 #include <ESPAsyncWebServer.h>
+#include <GzipStream.h>
 #include <Hoymiles.h>
 #include <TaskSchedulerDeclarations.h>
+#include <array>
 #include <map>
+#include <memory>
+#include <vector>
+
+struct WebApiFieldFilter_t;
+
+// Upper bound of the number of characters a metric value takes in the output
+#define PROMETHEUS_VALUE_WIDTH 16
+
+// Number of rendered scrapes kept, plain and gzip or different query parameters
+#ifndef PROMETHEUS_CACHE_ENTRIES
+#define PROMETHEUS_CACHE_ENTRIES 2
+#endif
 
 class WebApiPrometheusClass {
 public:
     void init(AsyncWebServer& server, Scheduler& scheduler);
 
 private:
+    // Times the metric formatting in the benchmark builds
+    friend class KernelBenchmarkClass;
+
     void onPrometheusMetricsGet(AsyncWebServerRequest* request);
 
-    void addField(AsyncResponseStream* stream, const String& serial, const uint8_t idx, std::shared_ptr<InverterAbstract> inv, const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId, const char* metricName, const char* channelName = nullptr);
+    // Collects the rendered text, compressed while it is written if requested
+    class ScrapeBuffer : public Print {
+    public:
+        ScrapeBuffer(const bool gzip, const size_t reserve);
+        size_t write(const uint8_t* data, size_t len) override;
+        size_t write(uint8_t data) override;
+        std::vector<uint8_t> finish();
+        size_t getInputSize() const { return _inputSize; }
 
-    void addPanelInfo(AsyncResponseStream* stream, const String& serial, const uint8_t idx, std::shared_ptr<InverterAbstract> inv, const ChannelType_t type, const ChannelNum_t channel);
+    private:
+        void moveOutput();
 
-    enum MetricType_t {
-        NONE = 0,
-        GAUGE,
-        COUNTER,
+        std::unique_ptr<GzipStream> _gzip;
+        std::vector<uint8_t> _data;
+        size_t _inputSize = 0;
     };
-    const char* _metricTypes[3] = { 0, "gauge", "counter" };
 
-    struct publish_type_t {
+    // A rendered scrape is reused for the configured time or until new statistics arrive,
+    // so several servers scraping the same DTU get the same body
+    struct ScrapeCache_t {
+        String Key;
+        bool Gzip = false;
+        uint32_t Created = 0;
+        uint32_t Generation = 0;
+        std::shared_ptr<const std::vector<uint8_t>> Body;
+    };
+    std::array<ScrapeCache_t, PROMETHEUS_CACHE_ENTRIES> _scrapeCache;
+    uint32_t _scrapeCacheHits = 0;
+    uint32_t _scrapeCacheMisses = 0;
+
+    static uint32_t getStatisticsGeneration();
+    static void sendBody(AsyncWebServerRequest* request, const std::shared_ptr<const std::vector<uint8_t>>& body, const bool gzip);
+    void addScrapeCache(Print* stream);
+    void render(ScrapeBuffer& buffer, AsyncWebServerRequest* request);
+
+    struct FieldLine_t {
+        ChannelType_t type;
+        ChannelNum_t channel;
         FieldId_t field;
-        MetricType_t type;
+        String prefix; // optional HELP/TYPE lines, metric name and labels
     };
 
-    const publish_type_t _publishFields[14] = {
-        { FLD_PAC, MetricType_t::GAUGE },
-        { FLD_UAC, MetricType_t::GAUGE },
-        { FLD_IAC, MetricType_t::GAUGE },
-        { FLD_PDC, MetricType_t::GAUGE },
-        { FLD_UDC, MetricType_t::GAUGE },
-        { FLD_IDC, MetricType_t::GAUGE },
-        { FLD_YD, MetricType_t::COUNTER },
-        { FLD_YT, MetricType_t::COUNTER },
-        { FLD_F, MetricType_t::GAUGE },
-        { FLD_T, MetricType_t::GAUGE },
-        { FLD_PF, MetricType_t::GAUGE },
-        { FLD_Q, MetricType_t::GAUGE },
-        { FLD_EFF, MetricType_t::GAUGE },
-        { FLD_IRR, MetricType_t::GAUGE },
+    // Text which only changes if an inverter is added, removed or renamed
+    struct InverterCache_t {
+        uint64_t Serial = 0;
+        String Name;
+        String Labels; // serial, unit and name label
+        std::vector<FieldLine_t> Fields;
+        size_t EstimatedSize = 0;
     };
+
+    const InverterCache_t& getInverterCache(const uint8_t idx, InverterAbstract& inv);
+    void buildInverterCache(InverterCache_t& cache, const uint8_t idx, InverterAbstract& inv);
+    size_t estimateResponseSize();
+
+    void addFields(Print* stream, const InverterCache_t& cache, const uint8_t idx, InverterAbstract& inv, const WebApiFieldFilter_t* filter = nullptr);
+
+    void addPanelInfo(Print* stream, const InverterCache_t& cache, const uint8_t idx, InverterAbstract& inv, const ChannelNum_t channel);
+
+    void addRadioQueueWait(Print* stream);
+    void addRadioQueue(Print* stream);
+    void addRadioCommandPool(Print* stream);
+    void addRadioCommandStats(Print* stream);
+    void addLockStats(Print* stream);
+    template <size_t N>
+    void addHistogram(Print* stream, const char* metric, const char* labels, const Histogram<N>& histogram);
+    void addMqttPublishQueue(Print* stream);
+    void addMqttTls(Print* stream);
+    void addMqttCluster(Print* stream);
+    void addMqttFleet(Print* stream);
+    void addInfluxExport(Print* stream);
+    void addModbusServer(Print* stream);
+    void addRawStatsExport(Print* stream);
+    void addSyslogExport(Print* stream);
+    void addPublishCoordinator(Print* stream);
+    void addEventBus(Print* stream);
+    void addWsLiveQueue(Print* stream);
+    void addResponseCache(Print* stream);
+    void addAdmissionControl(Print* stream);
+    void addHeapTelemetry(Print* stream);
+    void addCpuLoad(Print* stream);
+    void addPowerManagement(Print* stream);
+    void addResourceGovernor(Print* stream);
+    void addFlashWear(Print* stream);
+    void addPollCalibration(Print* stream);
+    void addTaskProfile(Print* stream);
+    void addLoopMonitor(Print* stream);
+
+    std::vector<InverterCache_t> _inverterCache;
+
+    // Size of the output which does not belong to an inverter, taken from the last response
+    size_t _staticSize = 2048;
 };
@@ -0,0 +1,15 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <ESPAsyncWebServer.h>
+#include <TaskSchedulerDeclarations.h>
+
+class WebApiRawStatsClass {
+public:
+    void init(AsyncWebServer& server, Scheduler& scheduler);
+
+private:
+    void onRawStatsStatus(AsyncWebServerRequest* request);
+    void onRawStatsAdminGet(AsyncWebServerRequest* request);
+    void onRawStatsAdminPost(AsyncWebServerRequest* request);
+};
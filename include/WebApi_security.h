@@ -13,4 +13,6 @@ private:
     void onSecurityPost(AsyncWebServerRequest* request);
 
     void onAuthenticateGet(AsyncWebServerRequest* request);
+    void onLoginPost(AsyncWebServerRequest* request);
+    void onLogoutPost(AsyncWebServerRequest* request);
 };
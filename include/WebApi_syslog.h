@@ -0,0 +1,15 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <ESPAsyncWebServer.h>
+#include <TaskSchedulerDeclarations.h>
+
+class WebApiSyslogClass {
+public:
+    void init(AsyncWebServer& server, Scheduler& scheduler);
+
+private:
+    void onSyslogStatus(AsyncWebServerRequest* request);
+    void onSyslogAdminGet(AsyncWebServerRequest* request);
+    void onSyslogAdminPost(AsyncWebServerRequest* request);
+};
@@ -9,5 +9,6 @@ public:
     void init(AsyncWebServer& server, Scheduler& scheduler);
 
 private:
-    void responseBinaryDataWithETagCache(AsyncWebServerRequest* request, const String& contentType, const String& contentEncoding, const uint8_t* content, size_t len);
+    void responseBinaryDataWithETagCache(AsyncWebServerRequest* request, const String& contentType, const String& contentEncoding, const uint8_t* content, size_t len, const char* etag);
+    void responseImmutable(AsyncWebServerRequest* request, const String& contentType, const uint8_t* content, size_t len);
 };
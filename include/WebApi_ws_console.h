@@ -4,6 +4,16 @@
 #include <ESPAsyncWebServer.h>
 #include <TaskSchedulerDeclarations.h>
 
+// Text message a console client sends to receive the output as gzip compressed binary frames
+#define WS_CONSOLE_GZIP_REQUEST "gzip"
+
+// A client chooses the records it receives with a JSON text message:
+//   {"filter": {"levels": {"system": "info", "radio": "debug"}, "meta": true}}
+// Levels are "none", "error", "warn", "info", "debug" and "verbose", subsystems which
+// are not given keep their level. With meta each line starts with the uptime, the
+// level and the subsystem.
+#define WS_CONSOLE_FILTER_KEY "filter"
+
 class WebApiWsConsoleClass {
 public:
     WebApiWsConsoleClass();
@@ -11,8 +21,12 @@ public:
     void reload();
 
 private:
+    void onWebsocketEvent(AsyncWebSocket* server, AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t len);
+    static void handleFilter(AsyncWebSocketClient* client, const uint8_t* data, const size_t len);
+
     AsyncWebSocket _ws;
     AsyncAuthenticationMiddleware _simpleDigestAuth;
+    AsyncMiddlewareFunction _sessionAuth; // accepts a session token before asking for the password
 
     Task _wsCleanupTask;
     void wsCleanupTaskCb();
@@ -4,8 +4,73 @@
 #include "Configuration.h"
 #include <ArduinoJson.h>
 #include <ESPAsyncWebServer.h>
+#include <GzipStream.h>
 #include <Hoymiles.h>
 #include <TaskSchedulerDeclarations.h>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+struct WebApiFieldFilter_t;
+
+// Text message a websocket client sends to switch to the delta protocol
+#define WS_LIVE_DELTA_REQUEST "delta"
+
+// Text message a websocket client sends to receive the documents as gzip compressed
+// binary frames. The library has no permessage-deflate, each frame is a complete gzip
+// stream which is compressed once for all clients that asked for it.
+#define WS_LIVE_GZIP_REQUEST "gzip"
+
+// A client limits the data it receives with a JSON text message:
+//   {"subscribe": {"inverters": ["<serial>", ...], "detail": "full" | "summary" | "totals"}}
+// Without inverters all are sent. "summary" omits the channel data, "totals" sends
+// only the totals and hints. Delta clients always receive all fields.
+#define WS_LIVE_SUBSCRIBE_KEY "subscribe"
+
+// Server-Sent Events stream of the full live data documents
+#define WS_LIVE_EVENTS_URL "/api/livedata/events"
+#define WS_LIVE_EVENT_NAME "livedata"
+
+// Number of sent events kept for clients which resume with Last-Event-ID
+#ifndef WS_LIVE_EVENT_HISTORY
+#define WS_LIVE_EVENT_HISTORY 8
+#endif
+
+// Position of the totals only frame in the frames waiting for a client
+#define WS_LIVE_TOTALS_FRAME INV_MAX_COUNT
+
+// Number of inverters a client can subscribe to
+#define WS_LIVE_MAX_SUBSCRIPTIONS INV_MAX_COUNT
+
+// Number of serialized live data buffers kept for reuse
+#ifndef WS_LIVE_BUFFER_POOL_SIZE
+#define WS_LIVE_BUFFER_POOL_SIZE 3
+#endif
+
+// Frames a client may have queued before newer frames wait outside of its queue
+#ifndef WS_LIVE_MAX_QUEUED_FRAMES
+#define WS_LIVE_MAX_QUEUED_FRAMES 4
+#endif
+
+// Interval (ms) in which waiting frames are moved into the client queues
+#ifndef WS_LIVE_FLUSH_INTERVAL
+#define WS_LIVE_FLUSH_INTERVAL 100
+#endif
+
+struct WsLiveStats_t {
+    uint32_t Clients;
+    uint32_t QueueDepth; // frames in the queues of all clients
+    uint32_t MaxQueueDepth; // frames in the queue of the slowest client
+    uint32_t Waiting; // frames waiting for a slow client
+    uint32_t Sent;
+    uint32_t SentBytes;
+    uint32_t Replaced; // waiting frames replaced by a newer one of the same inverter
+    uint32_t Resyncs; // delta frames dropped, the client gets a new snapshot instead
+    uint32_t GzipInput; // bytes of the documents compressed for gzip clients
+    uint32_t GzipOutput;
+};
 
 class WebApiWsLiveClass {
 public:
@@ -13,21 +78,110 @@ public:
     void init(AsyncWebServer& server, Scheduler& scheduler);
     void reload();
 
+    WsLiveStats_t getStats() const;
+
 private:
-    static void generateInverterCommonJsonResponse(JsonObject& root, std::shared_ptr<InverterAbstract> inv);
-    static void generateInverterChannelJsonResponse(JsonObject& root, std::shared_ptr<InverterAbstract> inv);
+    // Times the document generation in the benchmark builds
+    friend class KernelBenchmarkClass;
+
+    // Values last sent to the delta clients for one inverter
+    struct DeltaState_t {
+        uint64_t Serial = 0;
+        String Name;
+        std::array<double, 14> Common = {};
+        std::vector<float> Values; // in the order of forEachChannelField
+        bool Valid = false;
+    };
+
+    enum class Detail_t {
+        Full,
+        Summary,
+        Totals,
+    };
+
+    // State of a client which sent a request. Clients without one receive
+    // full documents of all inverters.
+    struct ClientState_t {
+        uint32_t Id;
+        bool Delta = false;
+        bool SnapshotPending = false;
+        bool Gzip = false;
+        Detail_t Detail = Detail_t::Full;
+        std::vector<uint64_t> Serials; // subscribed inverters, empty for all
+
+        bool isSubscribed(const uint64_t serial) const;
+    };
+
+    // The data age is only part of the websocket messages, /api/livedata/status has last_update instead
+    static void generateInverterCommonJsonResponse(JsonObject& root, InverterAbstract& inv, const bool withDataAge = true);
+    static void generateInverterChannelJsonResponse(JsonObject& root, InverterAbstract& inv, const bool addFieldIds = false, const WebApiFieldFilter_t* filter = nullptr);
+    // Inverter of /api/livedata/status, with channel data if inverters or fields were requested
+    static void generateInverterStatusJsonResponse(JsonObject& root, InverterAbstract& inv, const WebApiFieldFilter_t& filter);
     static void generateCommonJsonResponse(JsonVariant& root);
+    static uint8_t getHints();
+    static std::vector<uint32_t> getStatusState();
+    static uint32_t getLastUpdateTime(InverterAbstract& inv);
+    void generateDeltaJsonResponse(JsonVariant& root, InverterAbstract& inv, DeltaState_t& state);
 
-    static void addField(JsonObject& root, std::shared_ptr<InverterAbstract> inv, const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId, String topic = "");
+    static void forEachChannelField(InverterAbstract& inv, const std::function<void(ChannelType_t, ChannelNum_t, FieldId_t)>& cb, const WebApiFieldFilter_t* filter = nullptr);
+    static std::array<double, 14> getCommonValues(InverterAbstract& inv);
+    static uint16_t getFieldId(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId);
+
+    static void addField(JsonObject& root, InverterAbstract& inv, const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId, String topic = "", const bool addFieldId = false);
     static void addTotalField(JsonObject& root, const String& name, const float value, const String& unit, const uint8_t digits);
 
     void onLivedataStatus(AsyncWebServerRequest* request);
     void onWebsocketEvent(AsyncWebSocket* server, AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t len);
 
     AsyncWebSocket _ws;
+    AsyncEventSource _events;
     AsyncAuthenticationMiddleware _simpleDigestAuth;
+    AsyncMiddlewareFunction _sessionAuth; // accepts a session token before asking for the password
+
+    std::vector<uint32_t> _lastPublishStats;
+
+    std::vector<ClientState_t> _clientStates;
+    std::mutex _clientStatesMutex;
+    std::atomic<bool> _forcePublish = false; // a client needs all inverters with the next run
+    std::vector<DeltaState_t> _deltaState;
+    std::array<float, 3> _deltaTotal = {};
+    uint8_t _deltaHints = 0;
+    std::array<float, 5> _deltaFleet = {};
+    bool _deltaCommonValid = false;
 
-    uint32_t _lastPublishStats[INV_MAX_COUNT] = { 0 };
+    // Buffers are shared by all client queues and reused once no queue references them anymore
+    std::array<AsyncWebSocketSharedBuffer, WS_LIVE_BUFFER_POOL_SIZE> _bufferPool;
+
+    // Latest frame per inverter which did not fit into the queue of a slow client.
+    // Only used by the scheduler tasks, entries of closed clients are removed by the flush.
+    struct WaitingFrames_t {
+        uint32_t Id;
+        bool Binary; // gzip compressed frames
+        std::vector<AsyncWebSocketSharedBuffer> Frames; // by inverter position, the totals use WS_LIVE_TOTALS_FRAME
+    };
+    std::vector<WaitingFrames_t> _waitingFrames;
+
+    uint32_t _framesSent = 0;
+    uint32_t _bytesSent = 0;
+    uint32_t _framesReplaced = 0;
+    uint32_t _resyncs = 0;
+    uint32_t _queueDepth = 0;
+    uint32_t _maxQueueDepth = 0;
+    uint32_t _framesWaiting = 0;
+    uint32_t _clientCount = 0;
+    uint32_t _gzipInput = 0;
+    uint32_t _gzipOutput = 0;
+
+    // Only used by the scheduler tasks, the compressor is allocated with the first gzip client
+    std::unique_ptr<GzipStream> _gzip;
+    std::vector<uint32_t> _gzipClients; // of the current run
+
+    AsyncWebSocketSharedBuffer serializeToBuffer(const JsonDocument& root);
+    void sendToClients(const AsyncWebSocketSharedBuffer& buffer, const std::vector<uint32_t>& ids, const uint8_t framePos, const bool delta);
+    void sendToClient(AsyncWebSocketClient* client, const AsyncWebSocketSharedBuffer& buffer, const uint8_t framePos, const bool delta, const bool binary);
+    AsyncWebSocketSharedBuffer compressBuffer(const AsyncWebSocketSharedBuffer& buffer);
+    void requestSnapshot(const uint32_t clientId);
+    void handleSubscription(AsyncWebSocketClient* client, const uint8_t* data, const size_t len);
 
     std::mutex _mutex;
 
@@ -36,4 +190,19 @@ private:
 
     Task _sendDataTask;
     void sendDataTaskCb();
+
+    Task _flushTask;
+    void flushTaskCb();
+
+    // The events share the buffers of the websocket frames
+    struct Event_t {
+        uint32_t Id;
+        AsyncWebSocketSharedBuffer Buffer;
+    };
+    std::array<Event_t, WS_LIVE_EVENT_HISTORY> _eventHistory = {};
+    uint32_t _lastEventId = 0;
+    std::mutex _eventMutex;
+
+    void sendEvent(const AsyncWebSocketSharedBuffer& buffer);
+    void onEventsConnect(AsyncEventSourceClient* client);
 };
@@ -0,0 +1,25 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The referenced table is generated by pio-scripts/webapp_chunks.py
+// and contains the gzipped, content hashed chunks of the webapp.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    const char* path;
+    const uint8_t* data;
+    size_t len;
+} WebappChunk_t;
+
+// Terminated by an entry with path NULL
+extern const WebappChunk_t __WEBAPP_CHUNKS__[];
+
+#ifdef __cplusplus
+}
+#endif
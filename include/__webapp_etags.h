@@ -0,0 +1,13 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+// The referenced values are generated by pio-scripts/webapp_etags.py
+// and contain the quoted MD5 hash of the embedded file.
+
+extern const char* __ETAG_WEBAPP_DIST_INDEX_HTML_GZ__;
+extern const char* __ETAG_WEBAPP_DIST_ZONES_JSON_GZ__;
+extern const char* __ETAG_WEBAPP_DIST_FAVICON_ICO__;
+extern const char* __ETAG_WEBAPP_DIST_FAVICON_PNG__;
+extern const char* __ETAG_WEBAPP_DIST_JS_APP_JS_GZ__;
+extern const char* __ETAG_WEBAPP_DIST_SITE_WEBMANIFEST__;
+extern const char* __ETAG_WEBAPP_DIST_SW_JS_GZ__;
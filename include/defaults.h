@@ -79,9 +79,33 @@
 #define MQTT_LWT_QOS 2U
 #define MQTT_PUBLISH_INTERVAL 5U
 #define MQTT_CLEAN_SESSION true
+#define MQTT_PUBLISH_ON_CHANGE false
+#define MQTT_JSON_PAYLOAD false
+#define MQTT_JOURNAL_ENABLED false
+#define MQTT_JOURNAL_REPLAY_RATE 10U
+#define MQTT_CLUSTER_ENABLED false
+#define MQTT_CLUSTER_TOPIC "opendtu-cluster/"
+
+#define MQTT_FAST_LANE_TOTAL_AC_POWER false
+#define MQTT_FAST_LANE_TOTAL_DC_POWER false
+#define MQTT_FAST_LANE_AC_POWER false
+#define MQTT_FAST_LANE_DC_POWER false
+
+#define MQTT_FLEET_PUBLISH false
+#define MQTT_FLEET_AGGREGATE false
+#define MQTT_FLEET_TOPIC "opendtu-fleet/"
 
 #define DTU_SERIAL 0x99978563412U
 #define DTU_POLL_INTERVAL 5U
+#define DTU_ADAPTIVE_POLLING false
+#define DTU_POLL_CALIBRATION false
+#define DTU_SNAPSHOT_POLLING false
+#define DTU_FRESHNESS_SLO_INTERVAL 60U
+#define DTU_FRESHNESS_SLO_AGE 3600U
+#define DTU_LIMIT_MIN_INTERVAL 0U
+#define DTU_LIMIT_HYSTERESIS 0.0f
+#define DTU_NIGHT_STANDBY false
+#define DTU_TX_POWER_CONTROL false
 #define DTU_NRF_PA_LEVEL 0U
 #define DTU_CMT_PA_LEVEL 0
 #define DTU_CMT_FREQUENCY 865000000U
@@ -92,6 +116,7 @@
 #define MQTT_HASS_RETAIN true
 #define MQTT_HASS_TOPIC "homeassistant/"
 #define MQTT_HASS_INDIVIDUALPANELS false
+#define MQTT_HASS_DEVICE_DISCOVERY false
 
 #define DEV_PINMAPPING ""
 
@@ -105,8 +130,46 @@
 
 #define REACHABLE_THRESHOLD 2U
 
+#define INVERTER_STATS_INTERVAL 0U
+#define INVERTER_ALARM_INTERVAL 0U
+#define INVERTER_LIMIT_INTERVAL 1800U
+
 #define LED_BRIGHTNESS 100U
 
 #define MAX_INVERTER_LIMIT 2250
 
+#define POWERCTRL_ENABLED false
+#define POWERCTRL_METER_TOPIC ""
+#define POWERCTRL_TARGET_POWER 0
+#define POWERCTRL_KP 0.5f
+#define POWERCTRL_KI 0.5f
+#define POWERCTRL_METER_TIMEOUT 10U
+#define POWERCTRL_MIN_LIMIT 2U
+
+#define INFLUX_ENABLED false
+#define INFLUX_URL ""
+#define INFLUX_TOKEN ""
+#define INFLUX_ROOT_CA ""
+#define INFLUX_FLUSH_INTERVAL 10U
+
+#define MODBUS_ENABLED false
+#define MODBUS_PORT 502U
+#define MODBUS_ALLOW_WRITE false
+
+#define RAWSTATS_MQTT false
+#define RAWSTATS_UDP false
+#define RAWSTATS_UDP_HOST ""
+#define RAWSTATS_UDP_PORT 8093U
+#define RAWSTATS_SKIP_FIELDS false
+
+#define SYSLOG_ENABLED false
+#define SYSLOG_HOST ""
+#define SYSLOG_PORT 514U
+#define SYSLOG_FORMAT 0U
+#define SYSLOG_LEVEL 3U
+
+#define PROMETHEUS_CACHE_TTL 5000U
+
+#define FIRMWARE_PULL_ROOT_CA ""
+
 #define LANG_PACK_SUFFIX ".lang.json"
@@ -104,11 +104,12 @@ bool CMT2300A::write(const uint8_t* buf, const uint8_t len)
 void CMT2300A::setChannel(const uint8_t channel)
 {
     CMT2300A_SetFrequencyChannel(channel);
+    _channel = channel;
 }
 
 uint8_t CMT2300A::getChannel(void)
 {
-    return CMT2300A_ReadReg(CMT2300A_CUS_FREQ_CHNL);
+    return _channel;
 }
 
 uint8_t CMT2300A::getDynamicPayloadSize(void)
@@ -243,6 +244,11 @@ bool CMT2300A::rxFifoAvailable()
         ) & CMT2300A_ReadReg(CMT2300A_CUS_INT_FLAG);
 }
 
+void CMT2300A::setPacketInterruptOnGpio2(const bool enabled)
+{
+    _packetInterruptOnGpio2 = enabled;
+}
+
 uint32_t CMT2300A::getBaseFrequency() const
 {
     return getBaseFrequency(_frequencyBand);
@@ -304,7 +310,7 @@ bool CMT2300A::_init_radio()
 
     /* Config GPIOs */
     CMT2300A_ConfigGpio(
-        CMT2300A_GPIO2_SEL_INT1 | CMT2300A_GPIO3_SEL_INT2);
+        (_packetInterruptOnGpio2 ? CMT2300A_GPIO2_SEL_INT2 : CMT2300A_GPIO2_SEL_INT1) | CMT2300A_GPIO3_SEL_INT2);
 
     /* Config interrupt */
     CMT2300A_ConfigInterrupt(
@@ -321,6 +327,8 @@ bool CMT2300A::_init_radio()
     /* Use a single 64-byte FIFO for either Tx or Rx */
     CMT2300A_EnableFifoMerge(true);
 
+    _channel = CMT2300A_ReadReg(CMT2300A_CUS_FREQ_CHNL);
+
     /* Go to sleep for configuration to take effect */
     if (!CMT2300A_GoSleep()) {
         return false; // CMT2300A not switched to sleep mode!
@@ -94,6 +94,12 @@ public:
 
     bool rxFifoAvailable();
 
+    /**
+     * Outputs the packet interrupt (INT2) on GPIO2 instead of the tx done interrupt (INT1),
+     * for boards which only wired GPIO2. Has to be called before begin().
+     */
+    void setPacketInterruptOnGpio2(const bool enabled);
+
     uint32_t getBaseFrequency() const;
     static constexpr uint32_t getBaseFrequency(FrequencyBand_t band)
     {
@@ -135,4 +141,8 @@ private:
     uint32_t _spi_speed;
 
     FrequencyBand_t _frequencyBand = FrequencyBand_t::BAND_860;
+    bool _packetInterruptOnGpio2 = false;
+
+    // Last written frequency channel, saves a register read for every received fragment
+    uint8_t _channel = 0;
 };
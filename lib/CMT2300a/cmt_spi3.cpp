@@ -19,6 +19,13 @@ static void IRAM_ATTR post_cb(spi_transaction_t* trans)
     gpio_set_level(*reinterpret_cast<gpio_num_t*>(trans->user), 1);
 }
 
+// Same option as in the Hoymiles library, see types.h there
+#ifdef HOY_RX_IRAM
+#define CMT_RX_ATTR IRAM_ATTR
+#else
+#define CMT_RX_ATTR
+#endif
+
 spi_device_handle_t spi;
 gpio_num_t cs_reg, cs_fifo;
 
@@ -63,17 +70,21 @@ void cmt_spi3_init(const int8_t pin_sdio, const int8_t pin_clk, const int8_t pin
     ESP_ERROR_CHECK(gpio_set_direction(cs_fifo, GPIO_MODE_OUTPUT));
 }
 
+// All transfers are at most one byte long and use the tx_data/rx_data fields of the
+// transaction. A buffer pointer would make the driver allocate a DMA capable bounce
+// buffer for every single byte as the buffers are neither word aligned nor word sized.
+
 void cmt_spi3_write(const uint8_t addr, const uint8_t data)
 {
     spi_transaction_ext_t trans {
         .base {
-            .flags = SPI_TRANS_VARIABLE_CMD | SPI_TRANS_VARIABLE_ADDR,
+            .flags = SPI_TRANS_VARIABLE_CMD | SPI_TRANS_VARIABLE_ADDR | SPI_TRANS_USE_TXDATA,
             .cmd = 0,
             .addr = addr,
             .length = 8,
             .rxlength = 0,
             .user = &cs_reg, // CS for register access
-            .tx_buffer = &data,
+            .tx_data = { data },
             .rx_buffer = nullptr,
         },
         .command_bits = 1,
@@ -87,17 +98,16 @@ void cmt_spi3_write(const uint8_t addr, const uint8_t data)
 
 uint8_t cmt_spi3_read(const uint8_t addr)
 {
-    uint8_t data;
     spi_transaction_ext_t trans {
         .base {
-            .flags = SPI_TRANS_VARIABLE_CMD | SPI_TRANS_VARIABLE_ADDR,
+            .flags = SPI_TRANS_VARIABLE_CMD | SPI_TRANS_VARIABLE_ADDR | SPI_TRANS_USE_RXDATA,
             .cmd = 1,
             .addr = addr,
             .length = 0,
             .rxlength = 8,
             .user = &cs_reg, // CS for register access
             .tx_buffer = nullptr,
-            .rx_buffer = &data,
+            .rx_data = {},
         },
         .command_bits = 1,
         .address_bits = 7,
@@ -106,50 +116,52 @@ uint8_t cmt_spi3_read(const uint8_t addr)
     SPI_PARAM_LOCK();
     ESP_ERROR_CHECK(spi_device_polling_transmit(spi, reinterpret_cast<spi_transaction_t*>(&trans)));
     SPI_PARAM_UNLOCK();
-    return data;
+    return trans.base.rx_data[0];
 }
 
+// The FIFO CS has to be released after every byte, so each byte is a transaction of its own.
+// They are sent back to back while the bus is acquired.
 void cmt_spi3_write_fifo(const uint8_t* buf, const uint16_t len)
 {
     spi_transaction_t trans {
-        .flags = 0,
+        .flags = SPI_TRANS_USE_TXDATA,
         .cmd = 0,
         .addr = 0,
         .length = 8,
         .rxlength = 0,
         .user = &cs_fifo, // CS for FIFO access
-        .tx_buffer = nullptr,
+        .tx_data = {},
         .rx_buffer = nullptr,
     };
 
     SPI_PARAM_LOCK();
     spi_device_acquire_bus(spi, portMAX_DELAY);
-    for (uint8_t i = 0; i < len; i++) {
-        trans.tx_buffer = buf + i;
+    for (uint16_t i = 0; i < len; i++) {
+        trans.tx_data[0] = buf[i];
         ESP_ERROR_CHECK(spi_device_polling_transmit(spi, &trans));
     }
     spi_device_release_bus(spi);
     SPI_PARAM_UNLOCK();
 }
 
-void cmt_spi3_read_fifo(uint8_t* buf, const uint16_t len)
+void CMT_RX_ATTR cmt_spi3_read_fifo(uint8_t* buf, const uint16_t len)
 {
     spi_transaction_t trans {
-        .flags = 0,
+        .flags = SPI_TRANS_USE_RXDATA,
         .cmd = 0,
         .addr = 0,
         .length = 0,
         .rxlength = 8,
         .user = &cs_fifo, // CS for FIFO access
         .tx_buffer = nullptr,
-        .rx_buffer = nullptr,
+        .rx_data = {},
     };
 
     SPI_PARAM_LOCK();
     spi_device_acquire_bus(spi, portMAX_DELAY);
-    for (uint8_t i = 0; i < len; i++) {
-        trans.rx_buffer = buf + i;
+    for (uint16_t i = 0; i < len; i++) {
         ESP_ERROR_CHECK(spi_device_polling_transmit(spi, &trans));
+        buf[i] = trans.rx_data[0];
     }
     spi_device_release_bus(spi);
     SPI_PARAM_UNLOCK();
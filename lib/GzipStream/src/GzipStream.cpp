@@ -0,0 +1,298 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "GzipStream.h"
+#include <algorithm>
+#include <cstring>
+
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+
+static_assert(GZIP_STREAM_WINDOW_SIZE >= 2 * DEFLATE_MAX_MATCH && GZIP_STREAM_WINDOW_SIZE <= 32768,
+    "GZIP_STREAM_WINDOW_BITS out of range");
+
+// Base values and extra bits of the length codes 257 - 285 and the distance codes (RFC 1951, 3.2.5)
+static const uint16_t lengthBase[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t lengthExtra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t distBase[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t distExtra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+    };
+
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ table[crc & 0x0f];
+        crc = (crc >> 4) ^ table[crc & 0x0f];
+    }
+    return ~crc;
+}
+
+GzipStream::GzipStream()
+{
+    reset();
+}
+
+void GzipStream::reset()
+{
+    _pos = 0;
+    _end = 0;
+    _bitBuffer = 0;
+    _bitCount = 0;
+    _output.clear();
+    _outputPos = 0;
+    _crc = 0;
+    _inputSize = 0;
+    _outputSize = 0;
+    _finished = false;
+
+    memset(_head, 0, sizeof(_head));
+    memset(_prev, 0, sizeof(_prev));
+
+    // No file name and time, unknown OS
+    static const uint8_t header[] = { 0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff };
+    for (const uint8_t b : header) {
+        putByte(b);
+    }
+
+    // The block is not the last one, finish() appends an empty final block
+    putBits(0x02, 3);
+}
+
+void GzipStream::write(const uint8_t* data, size_t len)
+{
+    if (_finished) {
+        return;
+    }
+
+    _crc = crc32Update(_crc, data, len);
+    _inputSize += len;
+
+    while (len > 0) {
+        if (_end == sizeof(_window)) {
+            compress(false);
+            slide();
+        }
+
+        const size_t n = std::min(len, sizeof(_window) - _end);
+        memcpy(_window + _end, data, n);
+        _end += n;
+        data += n;
+        len -= n;
+    }
+
+    compress(false);
+}
+
+void GzipStream::finish()
+{
+    if (_finished) {
+        return;
+    }
+
+    compress(true);
+    putSymbol(256);
+
+    // Empty final block
+    putBits(0x03, 3);
+    putSymbol(256);
+    if (_bitCount > 0) {
+        putBits(0, 8 - _bitCount);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        putByte(_crc >> (8 * i));
+    }
+    for (int i = 0; i < 4; i++) {
+        putByte(_inputSize >> (8 * i));
+    }
+    _finished = true;
+}
+
+bool GzipStream::isFinished() const
+{
+    return _finished;
+}
+
+size_t GzipStream::available() const
+{
+    return _output.size() - _outputPos;
+}
+
+size_t GzipStream::read(uint8_t* buffer, size_t maxLen)
+{
+    const size_t len = std::min(maxLen, available());
+    memcpy(buffer, _output.data() + _outputPos, len);
+    _outputPos += len;
+
+    if (_outputPos == _output.size()) {
+        _output.clear();
+        _outputPos = 0;
+    }
+    return len;
+}
+
+uint32_t GzipStream::getInputSize() const
+{
+    return _inputSize;
+}
+
+uint32_t GzipStream::getOutputSize() const
+{
+    return _outputSize;
+}
+
+uint32_t GzipStream::hash(const size_t pos) const
+{
+    const uint32_t v = _window[pos] | _window[pos + 1] << 8 | _window[pos + 2] << 16;
+    return static_cast<uint32_t>(v * 2654435761U) >> (32 - GZIP_STREAM_HASH_BITS);
+}
+
+void GzipStream::insert(const size_t pos)
+{
+    const uint32_t h = hash(pos);
+    _prev[pos & (GZIP_STREAM_WINDOW_SIZE - 1)] = _head[h];
+    _head[h] = pos + 1;
+}
+
+// Greedy matching. Without flush a match may not reach the end of the input yet, so
+// DEFLATE_MAX_MATCH bytes are kept back.
+void GzipStream::compress(const bool flush)
+{
+    while (_pos < _end && (flush || _end - _pos >= DEFLATE_MAX_MATCH)) {
+        const size_t avail = _end - _pos;
+        size_t bestLen = 0;
+        size_t bestDist = 0;
+
+        if (avail >= DEFLATE_MIN_MATCH) {
+            const size_t maxLen = std::min<size_t>(avail, DEFLATE_MAX_MATCH);
+            const size_t limit = _pos > GZIP_STREAM_WINDOW_SIZE ? _pos - GZIP_STREAM_WINDOW_SIZE : 0;
+
+            uint16_t candidate = _head[hash(_pos)];
+            for (int chain = GZIP_STREAM_MAX_CHAIN; candidate != 0 && chain > 0; chain--) {
+                const size_t c = candidate - 1;
+                if (c < limit || c >= _pos) {
+                    break;
+                }
+
+                if (_window[c + bestLen] == _window[_pos + bestLen]) {
+                    size_t len = 0;
+                    while (len < maxLen && _window[c + len] == _window[_pos + len]) {
+                        len++;
+                    }
+                    if (len > bestLen) {
+                        bestLen = len;
+                        bestDist = _pos - c;
+                        if (len == maxLen) {
+                            break;
+                        }
+                    }
+                }
+
+                // Older entries of this slot may already belong to a newer position
+                const uint16_t next = _prev[c & (GZIP_STREAM_WINDOW_SIZE - 1)];
+                if (next >= candidate) {
+                    break;
+                }
+                candidate = next;
+            }
+            insert(_pos);
+        }
+
+        if (bestLen >= DEFLATE_MIN_MATCH) {
+            putMatch(bestLen, bestDist);
+            for (size_t i = 1; i < bestLen; i++) {
+                if (_pos + i + DEFLATE_MIN_MATCH <= _end) {
+                    insert(_pos + i);
+                }
+            }
+            _pos += bestLen;
+        } else {
+            putSymbol(_window[_pos]);
+            _pos++;
+        }
+    }
+}
+
+// Moves the upper half of the window down, the lookahead is kept
+void GzipStream::slide()
+{
+    memmove(_window, _window + GZIP_STREAM_WINDOW_SIZE, GZIP_STREAM_WINDOW_SIZE);
+    _pos -= GZIP_STREAM_WINDOW_SIZE;
+    _end -= GZIP_STREAM_WINDOW_SIZE;
+
+    for (auto& h : _head) {
+        h = h > GZIP_STREAM_WINDOW_SIZE ? h - GZIP_STREAM_WINDOW_SIZE : 0;
+    }
+    for (auto& p : _prev) {
+        p = p > GZIP_STREAM_WINDOW_SIZE ? p - GZIP_STREAM_WINDOW_SIZE : 0;
+    }
+}
+
+void GzipStream::putByte(const uint8_t value)
+{
+    _output.push_back(value);
+    _outputSize++;
+}
+
+void GzipStream::putBits(const uint32_t bits, const uint8_t count)
+{
+    _bitBuffer |= bits << _bitCount;
+    _bitCount += count;
+    while (_bitCount >= 8) {
+        putByte(_bitBuffer & 0xff);
+        _bitBuffer >>= 8;
+        _bitCount -= 8;
+    }
+}
+
+// Huffman codes are stored starting with their most significant bit
+void GzipStream::putCode(const uint16_t code, const uint8_t len)
+{
+    uint16_t reversed = 0;
+    for (uint8_t i = 0; i < len; i++) {
+        reversed |= ((code >> i) & 1) << (len - 1 - i);
+    }
+    putBits(reversed, len);
+}
+
+// Fixed literal/length code (RFC 1951, 3.2.6)
+void GzipStream::putSymbol(const uint16_t symbol)
+{
+    if (symbol < 144) {
+        putCode(0x30 + symbol, 8);
+    } else if (symbol < 256) {
+        putCode(0x190 + symbol - 144, 9);
+    } else if (symbol < 280) {
+        putCode(symbol - 256, 7);
+    } else {
+        putCode(0xc0 + symbol - 280, 8);
+    }
+}
+
+void GzipStream::putMatch(const uint16_t len, const uint16_t dist)
+{
+    uint8_t l = sizeof(lengthBase) / sizeof(lengthBase[0]) - 1;
+    while (lengthBase[l] > len) {
+        l--;
+    }
+    putSymbol(257 + l);
+    putBits(len - lengthBase[l], lengthExtra[l]);
+
+    uint8_t d = sizeof(distBase) / sizeof(distBase[0]) - 1;
+    while (distBase[d] > dist) {
+        d--;
+    }
+    putCode(d, 5);
+    putBits(dist - distBase[d], distExtra[d]);
+}
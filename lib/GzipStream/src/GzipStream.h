@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Size (bytes) of the LZ77 window, the maximum distance of a match. A power of two
+// between 512 and 32768.
+#ifndef GZIP_STREAM_WINDOW_BITS
+#define GZIP_STREAM_WINDOW_BITS 10
+#endif
+#define GZIP_STREAM_WINDOW_SIZE (1U << GZIP_STREAM_WINDOW_BITS)
+
+#define GZIP_STREAM_HASH_BITS 10
+#define GZIP_STREAM_HASH_SIZE (1U << GZIP_STREAM_HASH_BITS)
+
+// Number of earlier positions compared per byte, more find longer matches but cost time
+#ifndef GZIP_STREAM_MAX_CHAIN
+#define GZIP_STREAM_MAX_CHAIN 16
+#endif
+
+// Compresses a stream into the gzip format (RFC 1952) with a single deflate block
+// of the fixed Huffman codes. The data is written in pieces as it is generated and
+// the compressed bytes are read whenever needed, only the window and the unread
+// output are kept. Not thread safe.
+class GzipStream {
+public:
+    GzipStream();
+
+    // Starts a new stream, the buffers are kept for reuse
+    void reset();
+
+    void write(const uint8_t* data, size_t len);
+
+    // Compresses the rest of the input and appends the trailer. No more writes afterwards.
+    void finish();
+    bool isFinished() const;
+
+    // Compressed bytes which have not been read yet
+    size_t available() const;
+    size_t read(uint8_t* buffer, size_t maxLen);
+
+    uint32_t getInputSize() const;
+    uint32_t getOutputSize() const;
+
+private:
+    void compress(const bool flush);
+    void slide();
+    uint32_t hash(const size_t pos) const;
+    void insert(const size_t pos);
+
+    void putBits(const uint32_t bits, const uint8_t count);
+    void putCode(const uint16_t code, const uint8_t len);
+    void putSymbol(const uint16_t symbol);
+    void putMatch(const uint16_t len, const uint16_t dist);
+    void putByte(const uint8_t value);
+
+    uint8_t _window[2 * GZIP_STREAM_WINDOW_SIZE];
+
+    // Positions + 1 in _window, 0 marks an empty entry
+    uint16_t _head[GZIP_STREAM_HASH_SIZE];
+    uint16_t _prev[GZIP_STREAM_WINDOW_SIZE];
+
+    size_t _pos = 0; // next byte to compress
+    size_t _end = 0; // end of the input in _window
+
+    uint32_t _bitBuffer = 0;
+    uint8_t _bitCount = 0;
+
+    std::vector<uint8_t> _output;
+    size_t _outputPos = 0;
+
+    uint32_t _crc = 0;
+    uint32_t _inputSize = 0;
+    uint32_t _outputSize = 0;
+    bool _finished = false;
+};
@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+// Time (ms) after the last answer on the work frequency during which the inverter
+// is assumed to still be on it. The inverter itself falls back to the boot frequency
+// after 15 minutes without connection.
+#ifndef HOY_CMT_CHANNEL_HOLD
+#define HOY_CMT_CHANNEL_HOLD (5 * 60 * 1000)
+#endif
+
+// Delay (ms) between the channel change requests of an unreachable inverter,
+// doubled on each request up to the maximum
+#ifndef HOY_CMT_CHANNEL_CHANGE_BACKOFF_MIN
+#define HOY_CMT_CHANNEL_CHANGE_BACKOFF_MIN 5000
+#endif
+#ifndef HOY_CMT_CHANNEL_CHANGE_BACKOFF_MAX
+#define HOY_CMT_CHANNEL_CHANGE_BACKOFF_MAX 60000
+#endif
+
+// Remembers on which frequency a CMT inverter answered last, to decide whether
+// the channel change handshake is required before the next request
+class CmtChannelTracker {
+public:
+    // A fragment of the inverter was received on the given frequency
+    void markReceived(const uint32_t frequency, const uint32_t now)
+    {
+        _frequency = frequency;
+        _lastRx = now;
+        _attempts = 0;
+    }
+
+    // Frequency of the last answer, 0 if the inverter did not answer since boot
+    uint32_t getFrequency() const
+    {
+        return _frequency;
+    }
+
+    uint32_t getLastRx() const
+    {
+        return _lastRx;
+    }
+
+    // Channel change requests since the last answer
+    uint8_t getAttempts() const
+    {
+        return _attempts;
+    }
+
+    uint32_t getBackoff() const
+    {
+        if (_attempts == 0) {
+            return 0;
+        }
+        const uint8_t shift = std::min<uint8_t>(_attempts - 1, 16);
+        return std::min<uint32_t>(static_cast<uint32_t>(HOY_CMT_CHANNEL_CHANGE_BACKOFF_MIN) << shift,
+            HOY_CMT_CHANNEL_CHANGE_BACKOFF_MAX);
+    }
+
+    // Returns false if the inverter recently answered on the target frequency
+    // or the backoff of the last request has not passed yet
+    bool isChangeDue(const uint32_t targetFrequency, const uint32_t now) const
+    {
+        if (_frequency == targetFrequency && now - _lastRx < HOY_CMT_CHANNEL_HOLD) {
+            return false;
+        }
+        return _attempts == 0 || now - _lastAttempt >= getBackoff();
+    }
+
+    void markChangeSent(const uint32_t now)
+    {
+        _lastAttempt = now;
+        if (_attempts < UINT8_MAX) {
+            _attempts++;
+        }
+    }
+
+private:
+    uint32_t _frequency = 0;
+    uint32_t _lastRx = 0;
+    uint32_t _lastAttempt = 0;
+    uint8_t _attempts = 0;
+};
@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "CommandTrace.h"
+
+void CommandTraceRing::add(const CommandTrace_t& trace)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _traces[_head] = trace;
+    _head = (_head + 1) % _traces.size();
+    if (_count < _traces.size()) {
+        _count++;
+    }
+    _total++;
+}
+
+void CommandTraceRing::markNotified(const uint64_t serial, const uint32_t time)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t i = 1; i <= _count; i++) {
+        CommandTrace_t& trace = _traces[(_head + _traces.size() - i) % _traces.size()];
+        if (trace.Serial != serial || trace.Result != CommandTraceResult_t::Success) {
+            continue;
+        }
+        // Older traces were either notified already or had nothing to notify
+        if (trace.Notified == 0) {
+            trace.Notified = time;
+        }
+        return;
+    }
+}
+
+std::vector<CommandTrace_t> CommandTraceRing::getTraces()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    std::vector<CommandTrace_t> traces;
+    traces.reserve(_count);
+    for (size_t i = 0; i < _count; i++) {
+        traces.push_back(_traces[(_head + _traces.size() - _count + i) % _traces.size()]);
+    }
+    return traces;
+}
+
+uint32_t CommandTraceRing::getTotal()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _total;
+}
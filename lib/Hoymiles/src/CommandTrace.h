@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "commands/CommandAbstract.h"
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Number of finished commands kept in the trace ring
+#ifndef HOY_COMMAND_TRACE_COUNT
+#define HOY_COMMAND_TRACE_COUNT 64
+#endif
+
+#define HOY_COMMAND_TRACE_NAME_LEN 24
+
+enum class CommandTraceResult_t : uint8_t {
+    Success,
+    NoAnswer,
+    PartialAnswer,
+    CorruptData,
+};
+
+// Life of one command. All times are millis(), 0 if the step was not reached.
+struct CommandTrace_t {
+    uint32_t Id;
+    uint64_t Serial;
+    char CommandName[HOY_COMMAND_TRACE_NAME_LEN];
+    CommandPriority Priority;
+    CommandTraceResult_t Result;
+
+    uint8_t Resends; // whole request sent again because nothing was received
+    uint8_t Retransmits; // missing fragments requested
+    uint8_t Fragments; // of a complete response
+
+    uint32_t Enqueued;
+    uint32_t FirstTx;
+    uint32_t LastTx;
+    uint32_t Rx; // last fragment of the response
+    uint32_t ParseDone;
+    uint32_t Notified; // first consumer which was notified about the new data
+};
+
+// Ring of the recently finished commands. Filled by the radios, the consumer
+// notification is added afterwards by the application (markNotified).
+class CommandTraceRing {
+public:
+    void add(const CommandTrace_t& trace);
+
+    // Sets the notification time of the latest successful trace of the inverter
+    // which has none yet
+    void markNotified(const uint64_t serial, const uint32_t time);
+
+    // Copy of all traces, the oldest first
+    std::vector<CommandTrace_t> getTraces();
+
+    // Number of traces added since the start
+    uint32_t getTotal();
+
+private:
+    std::array<CommandTrace_t, HOY_COMMAND_TRACE_COUNT> _traces = {};
+    size_t _head = 0;
+    size_t _count = 0;
+    uint32_t _total = 0;
+
+    std::mutex _mutex;
+};
@@ -0,0 +1,245 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "FragmentAssembler.h"
+#include "Hoymiles.h"
+#include "crc.h"
+#include "inverters/InverterAbstract.h"
+#include <cmath>
+#include <cstring>
+
+void FragmentAssembler::reset()
+{
+    // Only the received flags have to be cleared, the data is overwritten on receive
+    for (uint8_t i = 0; i < _lastPacketId; i++) {
+        _fragments[i].wasReceived = false;
+    }
+    _maxPacketId = 0;
+    _lastPacketId = 0;
+    _retransmitCnt = 0;
+    _requestedFragment = 0;
+    _receivedBefore = 0;
+    _crc = 0xffff;
+    _crcFragments = 0;
+    _crcTailLen = 0;
+}
+
+void HOY_RX_ATTR FragmentAssembler::addFragment(const uint8_t fragment[], const uint8_t len)
+{
+    if (len < 11) {
+        HOY_LOGE("FATAL: (%s, %d) fragment too short\r\n", __FILE__, __LINE__);
+        return;
+    }
+
+    if (len - 11 > MAX_RF_PAYLOAD_SIZE) {
+        HOY_LOGE("FATAL: (%s, %d) fragment too large\r\n", __FILE__, __LINE__);
+        return;
+    }
+
+    const uint8_t fragmentCount = fragment[9];
+
+    // Packets with 0x81 will be seen as 1
+    const uint8_t fragmentId = fragmentCount & 0b01111111; // fragmentId is 1 based
+
+    if (fragmentId == 0) {
+        HOY_LOGE("ERROR: fragment id zero received and ignored\r\n");
+        return;
+    }
+
+    if (fragmentId >= MAX_RF_FRAGMENT_COUNT) {
+        HOY_LOGE("ERROR: fragment id %" PRId8 " is too large for buffer and ignored\r\n", fragmentId);
+        return;
+    }
+
+    memcpy(_fragments[fragmentId - 1].fragment, &fragment[10], len - 11);
+    _fragments[fragmentId - 1].len = len - 11;
+    _fragments[fragmentId - 1].mainCmd = fragment[0];
+    _fragments[fragmentId - 1].wasReceived = true;
+
+    if (fragmentId > _lastPacketId) {
+        _lastPacketId = fragmentId;
+    }
+
+    // 0b10000000 == 0x80
+    if ((fragmentCount & 0b10000000) == 0b10000000) {
+        _maxPacketId = fragmentId;
+    }
+
+    updateCrc();
+}
+
+void HOY_RX_ATTR FragmentAssembler::updateCrc()
+{
+    while (_crcFragments < MAX_RF_FRAGMENT_COUNT && _fragments[_crcFragments].wasReceived) {
+        foldCrc(_fragments[_crcFragments].fragment, _fragments[_crcFragments].len);
+        _crcFragments++;
+    }
+}
+
+void HOY_RX_ATTR FragmentAssembler::foldCrc(const uint8_t data[], const uint8_t len)
+{
+    if (len >= 2) {
+        _crc = crc16(_crcTail, _crcTailLen, _crc);
+        _crc = crc16(data, len - 2, _crc);
+        _crcTail[0] = data[len - 2];
+        _crcTail[1] = data[len - 1];
+        _crcTailLen = 2;
+        return;
+    }
+
+    for (uint8_t i = 0; i < len; i++) {
+        if (_crcTailLen == 2) {
+            _crc = crc16(_crcTail, 1, _crc);
+            _crcTail[0] = _crcTail[1];
+            _crcTailLen = 1;
+        }
+        _crcTail[_crcTailLen++] = data[i];
+    }
+}
+
+uint8_t FragmentAssembler::getFragmentCount() const
+{
+    return _maxPacketId;
+}
+
+bool FragmentAssembler::isComplete() const
+{
+    if (_maxPacketId == 0) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < _maxPacketId - 1; i++) {
+        if (!_fragments[i].wasReceived) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+uint8_t FragmentAssembler::countReceived() const
+{
+    uint8_t received = 0;
+    for (uint8_t i = 0; i < _lastPacketId; i++) {
+        received += _fragments[i].wasReceived ? 1 : 0;
+    }
+    return received;
+}
+
+void FragmentAssembler::observeDelivery(InverterAbstract& inv)
+{
+    const uint8_t received = countReceived();
+
+    if (_requestedFragment > 0) {
+        inv.getFragmentDelivery().observe(1, _fragments[_requestedFragment - 1].wasReceived ? 1 : 0);
+    } else {
+        // The size of the response is only known once its last fragment arrived, until
+        // then at least one more than the highest received fragment is expected
+        const uint8_t total = _maxPacketId > 0 ? _maxPacketId : _lastPacketId + 1;
+        if (total > _receivedBefore) {
+            inv.getFragmentDelivery().observe(total - _receivedBefore, received - _receivedBefore);
+        }
+    }
+    _receivedBefore = received;
+}
+
+bool FragmentAssembler::isResendCheaper(CommandAbstract& cmd, InverterAbstract& inv, const uint8_t missing)
+{
+    if (missing < 2 || cmd.getSendCount() > cmd.getMaxResendCount()) {
+        return false;
+    }
+
+    CommandAbstract* requestCmd = cmd.getRequestFrameCommand(1);
+    if (requestCmd == nullptr) {
+        return true;
+    }
+
+    // Requesting the fragments one by one takes a round trip per fragment, each arrives
+    // with probability p: missing / p round trips. A resend takes one round trip which
+    // delivers each missing fragment with probability p as well, the rest is requested
+    // one by one afterwards. The difference of both is the cost of the resend compared
+    // to missing round trips of a single fragment. The rx period of the resend only
+    // ends early if all missing fragments arrive.
+    const float p = inv.getFragmentDelivery().getProbability();
+    const float resendPeriod = FragmentDelivery::getExpectedPeriod(
+        inv.getRxTimeEstimator(cmd.getCommandName()), cmd.getTimeout(), std::pow(p, missing));
+    const float framePeriod = FragmentDelivery::getExpectedPeriod(
+        inv.getRxTimeEstimator(requestCmd->getCommandName()), requestCmd->getTimeout(), p);
+
+    return resendPeriod < missing * framePeriod;
+}
+
+uint8_t FragmentAssembler::verify(CommandAbstract& cmd, InverterAbstract& inv)
+{
+    observeDelivery(inv);
+
+    // All missing
+    if (_lastPacketId == 0) {
+        HOY_LOGD("All missing\r\n");
+        if (cmd.getSendCount() <= cmd.getMaxResendCount()) {
+            _requestedFragment = 0;
+            return FRAGMENT_ALL_MISSING_RESEND;
+        } else {
+            cmd.gotTimeout();
+            return FRAGMENT_ALL_MISSING_TIMEOUT;
+        }
+    }
+
+    // The gaps and, if it is still unknown, the last fragment (the one with 0x80)
+    uint8_t missing = _maxPacketId == 0 ? 1 : 0;
+    uint8_t firstMissing = 0;
+    const uint8_t known = _maxPacketId > 0 ? _maxPacketId - 1 : _lastPacketId;
+    for (uint8_t i = 0; i < known; i++) {
+        if (!_fragments[i].wasReceived) {
+            missing++;
+            if (firstMissing == 0) {
+                firstMissing = i + 1;
+            }
+        }
+    }
+    if (firstMissing == 0 && _maxPacketId == 0) {
+        firstMissing = _lastPacketId + 1;
+    }
+
+    if (missing > 0) {
+        HOY_LOGD("%" PRIu8 " missing, first %" PRIu8 "\r\n", missing, firstMissing);
+
+        if (isResendCheaper(cmd, inv, missing)) {
+            HOY_LOGD("Resend is cheaper than %" PRIu8 " retransmits\r\n", missing);
+            _requestedFragment = 0;
+            return FRAGMENT_PARTIAL_RESEND;
+        }
+
+        if (_retransmitCnt++ < cmd.getMaxRetransmitCount()) {
+            _requestedFragment = firstMissing;
+            return firstMissing;
+        } else {
+            cmd.gotTimeout();
+            return FRAGMENT_RETRANSMIT_TIMEOUT;
+        }
+    }
+
+    // Fragments after the last one (stray answers) were folded as well, start over
+    if (_crcFragments != _maxPacketId) {
+        _crc = 0xffff;
+        _crcTailLen = 0;
+        for (uint8_t i = 0; i < _maxPacketId; i++) {
+            foldCrc(_fragments[i].fragment, _fragments[i].len);
+        }
+        _crcFragments = _maxPacketId;
+    }
+
+    uint8_t size = 0;
+    for (uint8_t i = 0; i < _maxPacketId; i++) {
+        size += _fragments[i].len;
+    }
+    const bool crcValid = _crcTailLen == 2 && _crc == ((_crcTail[0] << 8) | _crcTail[1]);
+
+    if (!cmd.handleResponse(FragmentPayload(_fragments, _maxPacketId, size, crcValid))) {
+        cmd.gotTimeout();
+        return FRAGMENT_HANDLE_ERROR;
+    }
+
+    return FRAGMENT_OK;
+}
@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "FragmentPayload.h"
+#include "commands/CommandAbstract.h"
+#include "types.h"
+#include <cstdint>
+
+class InverterAbstract;
+
+enum {
+    FRAGMENT_ALL_MISSING_RESEND = 255,
+    FRAGMENT_ALL_MISSING_TIMEOUT = 254,
+    FRAGMENT_RETRANSMIT_TIMEOUT = 253,
+    FRAGMENT_HANDLE_ERROR = 252,
+    FRAGMENT_PARTIAL_RESEND = 251, // more missing than a resend of the whole request costs
+    FRAGMENT_OK = 0
+};
+
+#define MAX_RF_FRAGMENT_COUNT 13
+
+// Reassembles the response to the command at the head of a radio queue. Only one
+// command per radio is in flight, so one buffer per radio serves all its inverters.
+class FragmentAssembler {
+public:
+    // Prepares the buffer for the response to the next command
+    void reset();
+
+    void addFragment(const uint8_t fragment[], const uint8_t len);
+
+    // Returns zero on success or the fragment id for retransmit or error code. If several
+    // fragments are missing, the expected airtime of requesting them one by one is compared
+    // with a resend of the whole request, based on the learned fragment delivery and
+    // response times of the inverter.
+    uint8_t verify(CommandAbstract& cmd, InverterAbstract& inv);
+
+    // True once the last fragment (0x80) and all fragments before it were received
+    bool isComplete() const;
+
+    // Number of fragments of the last complete response
+    uint8_t getFragmentCount() const;
+
+    static constexpr size_t getBufferSize()
+    {
+        return sizeof(_fragments);
+    }
+
+private:
+    // Folds the received fragments following the ones already in the crc
+    void updateCrc();
+
+    uint8_t countReceived() const;
+    // Counts the fragments of the rx period which just ended to the delivery of the inverter
+    void observeDelivery(InverterAbstract& inv);
+    bool isResendCheaper(CommandAbstract& cmd, InverterAbstract& inv, const uint8_t missing);
+    void foldCrc(const uint8_t data[], const uint8_t len);
+
+    fragment_t _fragments[MAX_RF_FRAGMENT_COUNT] = {};
+    uint8_t _maxPacketId = 0;
+    uint8_t _lastPacketId = 0;
+    uint8_t _retransmitCnt = 0;
+
+    // Request of the current rx period: 0 for the whole request, otherwise the fragment id
+    uint8_t _requestedFragment = 0;
+    // Fragments received before the current rx period
+    uint8_t _receivedBefore = 0;
+
+    // Running crc16 over the leading fragments without gaps (_crcFragments). The
+    // last two bytes are held back, at the end of the response they are the crc.
+    uint16_t _crc = 0xffff;
+    uint8_t _crcFragments = 0;
+    uint8_t _crcTail[2];
+    uint8_t _crcTailLen = 0;
+};
@@ -0,0 +1,62 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "RxTimeEstimator.h"
+#include <cstdint>
+
+// Fragments which have to be observed before the learned delivery probability is used
+#ifndef HOY_FRAGMENT_DELIVERY_MIN_SAMPLES
+#define HOY_FRAGMENT_DELIVERY_MIN_SAMPLES 16
+#endif
+
+// Probability assumed until enough fragments were observed
+#ifndef HOY_FRAGMENT_DELIVERY_DEFAULT
+#define HOY_FRAGMENT_DELIVERY_DEFAULT 0.8f
+#endif
+
+// Learns the probability that a fragment the inverter sends arrives at the dtu. Every
+// rx period counts the fragments which were expected (the missing ones of the request)
+// and the ones which arrived. The average decays with about 64 fragments.
+class FragmentDelivery {
+public:
+    void observe(const uint8_t expected, const uint8_t received)
+    {
+        if (expected == 0) {
+            return;
+        }
+
+        const float weight = std::min(1.0f, expected / 64.0f);
+        const float ratio = static_cast<float>(std::min(received, expected)) / expected;
+        _probability = _count == 0 ? ratio : _probability + (ratio - _probability) * weight;
+        _count += expected;
+    }
+
+    float getProbability() const
+    {
+        if (_count < HOY_FRAGMENT_DELIVERY_MIN_SAMPLES) {
+            return HOY_FRAGMENT_DELIVERY_DEFAULT;
+        }
+        // Never zero, the expected costs divide by it
+        return std::max(_probability, 0.05f);
+    }
+
+    uint32_t getCount() const
+    {
+        return _count;
+    }
+
+    // Expected duration (ms) of an rx period which ends early once its fragments arrived
+    // with the given probability and runs into the timeout otherwise
+    static float getExpectedPeriod(const RxTimeEstimator& estimator, const uint32_t limit, const float probability)
+    {
+        const uint32_t timeout = estimator.getTimeout(limit);
+        if (estimator.getCount() == 0) {
+            return timeout;
+        }
+        return probability * std::min<float>(estimator.getMean(), timeout) + (1 - probability) * timeout;
+    }
+
+private:
+    float _probability = HOY_FRAGMENT_DELIVERY_DEFAULT;
+    uint32_t _count = 0;
+};
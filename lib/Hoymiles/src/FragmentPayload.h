@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "types.h"
+#include <cstdint>
+
+// Read only view of a reassembled response. The payload stays scattered over the
+// fragments in the buffer of the radio, the crc was computed while they arrived.
+class FragmentPayload {
+public:
+    FragmentPayload(const fragment_t fragments[], const uint8_t count, const uint8_t size, const bool crcValid)
+        : _fragments(fragments)
+        , _count(count)
+        , _size(size)
+        , _crcValid(crcValid)
+    {
+    }
+
+    uint8_t getFragmentCount() const
+    {
+        return _count;
+    }
+
+    const fragment_t& operator[](const uint8_t idx) const
+    {
+        return _fragments[idx];
+    }
+
+    // Number of payload bytes including the trailing crc
+    uint8_t size() const
+    {
+        return _size;
+    }
+
+    // Whether the crc16 at the end of the last fragment matches the bytes before it
+    bool isCrcValid() const
+    {
+        return _crcValid;
+    }
+
+    // Calls cb(offset, data, len) for the piece of every fragment in order
+    template <typename Callback>
+    void forEachChunk(Callback&& cb) const
+    {
+        uint8_t offs = 0;
+        for (uint8_t i = 0; i < _count; i++) {
+            cb(offs, _fragments[i].fragment, _fragments[i].len);
+            offs += _fragments[i].len;
+        }
+    }
+
+private:
+    const fragment_t* _fragments;
+    uint8_t _count;
+    uint8_t _size;
+    bool _crcValid;
+};
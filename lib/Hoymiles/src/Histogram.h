@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Histogram with fixed upper bucket bounds. Observations above the last bound are counted in an
+// additional overflow bucket.
+template <size_t N>
+class Histogram {
+public:
+    explicit Histogram(const std::array<uint32_t, N>& bounds)
+        : _bounds(bounds)
+    {
+    }
+
+    void observe(const uint32_t value)
+    {
+        size_t i = 0;
+        while (i < N && value > _bounds[i]) {
+            i++;
+        }
+        _buckets[i]++;
+        _count++;
+        _sum += value;
+    }
+
+    void reset()
+    {
+        _buckets = {};
+        _count = 0;
+        _sum = 0;
+    }
+
+    static constexpr size_t getBoundCount()
+    {
+        return N;
+    }
+
+    uint32_t getBound(const size_t idx) const
+    {
+        return _bounds[idx];
+    }
+
+    // Number of observations less or equal than the bound with the given index
+    uint32_t getCumulativeCount(const size_t idx) const
+    {
+        uint32_t count = 0;
+        for (size_t i = 0; i <= idx && i <= N; i++) {
+            count += _buckets[i];
+        }
+        return count;
+    }
+
+    uint32_t getCount() const
+    {
+        return _count;
+    }
+
+    uint64_t getSum() const
+    {
+        return _sum;
+    }
+
+private:
+    std::array<uint32_t, N> _bounds = {};
+    std::array<uint32_t, N + 1> _buckets = {};
+    uint32_t _count = 0;
+    uint64_t _sum = 0;
+};
@@ -17,119 +17,209 @@
 #include "inverters/HM_2CH.h"
 #include "inverters/HM_4CH.h"
 #include <Arduino.h>
+#include <algorithm>
 
 HoymilesClass Hoymiles;
 
+static const char* const nrfRadioNames[] = { "nrf", "nrf1", "nrf2", "nrf3" };
+static_assert(HOY_NRF_RADIO_COUNT <= sizeof(nrfRadioNames) / sizeof(nrfRadioNames[0]), "Not enough nrf radio names");
+
 void HoymilesClass::init()
 {
     _pollInterval = 0;
-    _radioNrf.reset(new HoymilesRadio_NRF());
+    for (auto& radio : _radioNrf) {
+        radio.reset(new HoymilesRadio_NRF());
+    }
+    _radioNrfInitCount = 0;
     _radioCmt.reset(new HoymilesRadio_CMT());
+
+    buildPollTransaction();
 }
 
-void HoymilesClass::initNRF(SPIClass* initialisedSpiBus, const uint8_t pinCE, const uint8_t pinIRQ)
+static bool isLimitPollDue(InverterAbstract& iv)
 {
-    _radioNrf->init(initialisedSpiBus, pinCE, pinIRQ);
+    auto systemConfigPara = iv.SystemConfigPara();
+    return (millis() - systemConfigPara->getLastUpdateRequest() > iv.getPollPlan().LimitInterval
+               || (iv.isReachable() && systemConfigPara->isReadbackRequired()))
+        && millis() - systemConfigPara->getLastUpdateCommand() > HOY_SYSTEM_CONFIG_PARA_POLL_MIN_DURATION;
 }
 
-void HoymilesClass::initCMT(const int8_t pin_sdio, const int8_t pin_clk, const int8_t pin_cs, const int8_t pin_fcs, const int8_t pin_gpio2, const int8_t pin_gpio3)
+static bool isGridProfilePollDue(InverterAbstract& iv)
 {
-    _radioCmt->init(pin_sdio, pin_clk, pin_cs, pin_fcs, pin_gpio2, pin_gpio3);
+    return !iv.getPollPlan().GridProfileOnDemand && iv.Statistics()->getLastUpdate() > 0
+        && (iv.GridProfile()->getLastUpdate() == 0 || !iv.GridProfile()->containsValidData());
 }
 
-void HoymilesClass::loop()
+static bool isDevInfoInvalid(InverterAbstract& iv)
 {
-    std::lock_guard<std::mutex> lock(_mutex);
-    _radioNrf->loop();
-    _radioCmt->loop();
+    return !iv.DevInfo()->containsValidData()
+        && iv.DevInfo()->getLastUpdateAll() > 0
+        && iv.DevInfo()->getLastUpdateSimple() > 0;
+}
 
-    if (getNumInverters() == 0 || millis() - _lastPoll <= (_pollInterval * 1000)) {
-        return;
+static bool isDevInfoPollDue(InverterAbstract& iv)
+{
+    if (iv.Statistics()->getLastUpdate() == 0) {
+        return false;
     }
 
-    static uint8_t inverterPos = 0;
+    // Restored data saves the requests at boot, a firmware update is noticed later
+    const bool confirmRestored = iv.DevInfo()->isRestored()
+        && millis() - iv.DevInfo()->getLastUpdateAll() > HOY_RESTORED_DEV_INFO_CONFIRM_DELAY;
 
-    std::shared_ptr<InverterAbstract> iv = getInverterByPos(inverterPos);
-    if ((iv == nullptr) || ((iv != nullptr) && (!iv->getRadio()->isInitialized()))) {
-        if (++inverterPos >= getNumInverters()) {
-            inverterPos = 0;
-        }
+    return iv.DevInfo()->getLastUpdateAll() == 0
+        || iv.DevInfo()->getLastUpdateSimple() == 0
+        || isDevInfoInvalid(iv) || confirmRestored;
+}
+
+static bool startChannelChangeStep(InverterAbstract& iv)
+{
+    return !iv.isReachable() && iv.sendChangeChannelRequest();
+}
+
+static bool startStatsStep(InverterAbstract& iv)
+{
+    if (!Utils::getTimeAvailable() || !iv.isStatsPollDue()) {
+        return false;
     }
+    iv.sendStatsRequest();
+    iv.markStatsPolled();
+    return true;
+}
 
-    if (iv != nullptr && iv->getRadio()->isInitialized()) {
+static bool startAlarmLogStep(InverterAbstract& iv)
+{
+    if (!Utils::getTimeAvailable() || iv.getPollPlan().AlarmOnDemand || !iv.isAlarmPollDue()) {
+        return false;
+    }
+    const bool force = iv.EventLog()->getLastAlarmRequestSuccess() == CMD_NOK;
+    iv.sendAlarmLogRequest(force);
+    iv.markAlarmPolled();
+    return true;
+}
 
-        if (iv->getZeroValuesIfUnreachable() && !iv->isReachable()) {
-            iv->Statistics()->zeroRuntimeData();
-        }
+static bool startSystemConfigParaStep(InverterAbstract& iv)
+{
+    if (!Utils::getTimeAvailable() || !isLimitPollDue(iv)) {
+        return false;
+    }
+    HOY_LOGD("Request SystemConfigPara\r\n");
+    return iv.sendSystemConfigParaRequest();
+}
 
-        if (iv->getEnablePolling() || iv->getEnableCommands()) {
-            _messageOutput->print("Fetch inverter: ");
-            _messageOutput->println(iv->serial(), HEX);
+static bool startGridProfileStep(InverterAbstract& iv)
+{
+    return isGridProfilePollDue(iv) && iv.sendGridOnProFileParaRequest();
+}
 
-            if (!iv->isReachable()) {
-                iv->sendChangeChannelRequest();
-            }
+static bool startDevInfoStep(InverterAbstract& iv)
+{
+    if (!isDevInfoPollDue(iv)) {
+        return false;
+    }
+    if (isDevInfoInvalid(iv)) {
+        HOY_LOGD("DevInfo: No Valid Data\r\n");
+    }
+    HOY_LOGD("Request device info\r\n");
+    return iv.sendDevInfoRequest();
+}
 
-            if (Utils::getTimeAvailable()) {
-                // Fetch statistics
-                iv->sendStatsRequest();
-
-                // Fetch event log
-                const bool force = iv->EventLog()->getLastAlarmRequestSuccess() == CMD_NOK;
-                iv->sendAlarmLogRequest(force);
-
-                // Fetch limit
-                if (((millis() - iv->SystemConfigPara()->getLastUpdateRequest() > HOY_SYSTEM_CONFIG_PARA_POLL_INTERVAL)
-                        && (millis() - iv->SystemConfigPara()->getLastUpdateCommand() > HOY_SYSTEM_CONFIG_PARA_POLL_MIN_DURATION))) {
-                    _messageOutput->println("Request SystemConfigPara");
-                    iv->sendSystemConfigParaRequest();
-                }
-
-                // Fetch grid profile
-                if (iv->Statistics()->getLastUpdate() > 0 && (iv->GridProfile()->getLastUpdate() == 0 || !iv->GridProfile()->containsValidData())) {
-                    iv->sendGridOnProFileParaRequest();
-                }
-
-                // Fetch dev info (but first fetch stats)
-                if (iv->Statistics()->getLastUpdate() > 0) {
-                    const bool invalidDevInfo = !iv->DevInfo()->containsValidData()
-                        && iv->DevInfo()->getLastUpdateAll() > 0
-                        && iv->DevInfo()->getLastUpdateSimple() > 0;
-
-                    if (invalidDevInfo) {
-                        _messageOutput->println("DevInfo: No Valid Data");
-                    }
-
-                    if ((iv->DevInfo()->getLastUpdateAll() == 0)
-                        || (iv->DevInfo()->getLastUpdateSimple() == 0)
-                        || invalidDevInfo) {
-                        _messageOutput->println("Request device info");
-                        iv->sendDevInfoRequest();
-                    }
-                }
-            }
+// The conditions are evaluated when the step is started, so they see the answers of
+// the previous steps. An answered stats request makes a readback of the limit due
+// in the same poll, and the device info is requested right after the first stats.
+// The snapshot mode splits the poll: the stats of all inverters are requested in one
+// go, the other requests follow in the background transaction.
+void HoymilesClass::buildPollTransaction()
+{
+    if (!_pollTransaction.getSteps().empty()) {
+        return;
+    }
 
-            // Set limit if required
-            if (iv->SystemConfigPara()->getLastLimitCommandSuccess() == CMD_NOK) {
-                _messageOutput->println("Resend ActivePowerControl");
-                iv->resendActivePowerControlRequest();
+    _pollTransaction
+        .then("ChannelChange", startChannelChangeStep)
+        .then("Stats", startStatsStep, true)
+        .then("AlarmLog", startAlarmLogStep)
+        .then("SystemConfigPara", startSystemConfigParaStep)
+        .thenAfter(1, "GridProfile", startGridProfileStep)
+        .thenAfter(1, "DevInfo", startDevInfoStep);
+
+    _snapshotTransaction
+        .then("ChannelChange", startChannelChangeStep)
+        .then("Stats", startStatsStep, true);
+
+    _backgroundTransaction
+        .then("AlarmLog", startAlarmLogStep)
+        .then("SystemConfigPara", startSystemConfigParaStep)
+        .then("GridProfile", startGridProfileStep)
+        .then("DevInfo", startDevInfoStep);
+
+    _focusTransaction
+        .then("Stats", [](InverterAbstract& iv) {
+            if (!Utils::getTimeAvailable()) {
+                return false;
             }
+            iv.sendStatsRequest();
+            iv.markStatsPolled();
+            return true;
+        });
+}
 
-            // Set power status if required
-            if (iv->PowerCommand()->getLastPowerCommandSuccess() == CMD_NOK) {
-                _messageOutput->println("Resend PowerCommand");
-                iv->resendPowerControlRequest();
-            }
+void HoymilesClass::initNRF(std::shared_ptr<SPIClass> initialisedSpiBus, const uint8_t pinCS, const uint8_t pinCE, const uint8_t pinIRQ)
+{
+    if (_radioNrfInitCount >= HOY_NRF_RADIO_COUNT) {
+        HOY_LOGE("NRF: Too many modules configured\r\n");
+        return;
+    }
+    _radioNrf[_radioNrfInitCount++]->init(initialisedSpiBus, pinCS, pinCE, pinIRQ);
+}
 
-            _messageOutput->printf("Queue size - NRF: %" PRId32 " CMT: %" PRId32 "\r\n", _radioNrf->getQueueSize(), _radioCmt->getQueueSize());
-            _lastPoll = millis();
-        }
+void HoymilesClass::initCMT(const int8_t pin_sdio, const int8_t pin_clk, const int8_t pin_cs, const int8_t pin_fcs, const int8_t pin_gpio2, const int8_t pin_gpio3)
+{
+    _radioCmt->init(pin_sdio, pin_clk, pin_cs, pin_fcs, pin_gpio2, pin_gpio3);
+}
+
+void HoymilesClass::loop()
+{
+    // The radios lock their own queues, the inverter list is not needed for that
+    for (auto& radio : _radioNrf) {
+        radio->loop();
+    }
+    _radioCmt->loop();
+
+    if (HOY_LOG_ENABLED(HOY_LOG_LEVEL_DEBUG) && millis() - _lastQueueLog >= HOY_QUEUE_LOG_INTERVAL) {
+        _lastQueueLog = millis();
+        printQueues();
+    }
+
+    TimedLock<ReaderPreferringMutex, true> lock(_inverterMutex, _pollLockStats);
 
-        if (++inverterPos >= getNumInverters()) {
-            inverterPos = 0;
+    if (isFocusActive()) {
+        pollFocus();
+    } else if (_snapshotPolling) {
+        pollSnapshot();
+    }
+
+    // All radios are independent hardware. Each of them
+    // walks through its own inverters with its own poll timer.
+    // A running snapshot or a focus has the radios for itself.
+    if (!_snapshot.running && !isFocusActive()) {
+        for (uint8_t i = 0; i < HOY_NRF_RADIO_COUNT; i++) {
+            pollRadio(_radioNrf[i].get(), _pollStateNrf[i]);
         }
+        pollRadio(_radioCmt.get(), _pollStateCmt);
+    }
+
+    // Limits held back by the rate shaping are sent as soon as they are allowed
+    for (auto& inv : _inverters) {
+        inv->processActivePowerControlRequest();
+        inv->getTransactionRunner().run(*inv);
     }
 
+    for (uint8_t i = 0; i < HOY_NRF_RADIO_COUNT; i++) {
+        updateActivity(_radioNrf[i].get(), _pollStateNrf[i]);
+    }
+    updateActivity(_radioCmt.get(), _pollStateCmt);
+
     // Perform housekeeping of all inverters on day change
     const int8_t currentWeekDay = Utils::getWeekDay();
     static int8_t lastWeekDay = -1;
@@ -147,47 +237,365 @@ void HoymilesClass::loop()
     }
 }
 
-std::shared_ptr<InverterAbstract> HoymilesClass::addInverter(const char* name, const uint64_t serial)
+void HoymilesClass::pollRadio(HoymilesRadio* radio, RadioPollState_t& state)
+{
+    if (!radio->isInitialized() || getNumInverters() == 0 || millis() - state.lastPoll <= (_pollInterval * 1000)) {
+        return;
+    }
+
+    if (!_adaptivePolling) {
+        std::shared_ptr<InverterAbstract> iv = getNextInverterByRadio(radio, state.inverterPos);
+        if (iv != nullptr && pollInverter(iv)) {
+            state.lastPoll = millis();
+            state.slotUnused = false;
+        } else {
+            state.slotUnused = true;
+        }
+        return;
+    }
+
+    // Adaptive mode: The radio still sends at most one poll per interval
+    // but it is given to the inverter which is overdue for the longest time.
+    // Idle and unreachable inverters are backed off and leave their airtime
+    // to the producing ones. If no inverter is due, nothing is sent at all.
+    std::shared_ptr<InverterAbstract> iv = getMostOverdueInverterByRadio(radio);
+    if (iv == nullptr) {
+        state.slotUnused = true;
+        return;
+    }
+
+    state.slotUnused = !pollInverter(iv);
+    if (!state.slotUnused) {
+        state.lastPoll = millis();
+    }
+    iv->markAdaptivePolled();
+}
+
+uint32_t HoymilesClass::getCycleTime() const
 {
-    std::shared_ptr<InverterAbstract> i = nullptr;
-    if (HMT_4CH::isValidSerial(serial)) {
-        i = std::make_shared<HMT_4CH>(_radioCmt.get(), serial);
-    } else if (HMT_6CH::isValidSerial(serial)) {
-        i = std::make_shared<HMT_6CH>(_radioCmt.get(), serial);
-    } else if (HMS_4CH::isValidSerial(serial)) {
-        i = std::make_shared<HMS_4CH>(_radioCmt.get(), serial);
-    } else if (HMS_2CH::isValidSerial(serial)) {
-        i = std::make_shared<HMS_2CH>(_radioCmt.get(), serial);
-    } else if (HMS_1CH::isValidSerial(serial)) {
-        i = std::make_shared<HMS_1CH>(_radioCmt.get(), serial);
-    } else if (HMS_1CHv2::isValidSerial(serial)) {
-        i = std::make_shared<HMS_1CHv2>(_radioCmt.get(), serial);
-    } else if (HM_4CH::isValidSerial(serial)) {
-        i = std::make_shared<HM_4CH>(_radioNrf.get(), serial);
-    } else if (HM_2CH::isValidSerial(serial)) {
-        i = std::make_shared<HM_2CH>(_radioNrf.get(), serial);
-    } else if (HM_1CH::isValidSerial(serial)) {
-        i = std::make_shared<HM_1CH>(_radioNrf.get(), serial);
-    } else if (HERF_1CH::isValidSerial(serial)) {
-        i = std::make_shared<HERF_1CH>(_radioNrf.get(), serial);
-    } else if (HERF_2CH::isValidSerial(serial)) {
-        i = std::make_shared<HERF_2CH>(_radioNrf.get(), serial);
-    } else if (HERF_4CH::isValidSerial(serial)) {
-        i = std::make_shared<HERF_4CH>(_radioNrf.get(), serial);
+    std::array<uint8_t, HOY_NRF_RADIO_COUNT + 1> counts = {};
+    for (auto& inv : _inverters) {
+        if (inv->getRadio() != nullptr && inv->getEnablePolling()) {
+            counts[getRadioIndex(inv->getRadio())]++;
+        }
+    }
+    return _pollInterval * 1000 * *std::max_element(counts.begin(), counts.end());
+}
+
+void HoymilesClass::pollSnapshot()
+{
+    const uint32_t now = millis();
+
+    if (_snapshot.running) {
+        // Inverters which still ran a background transaction are started as soon as it ends
+        if (!_snapshot.pending.empty()) {
+            auto& pending = _snapshot.pending;
+            pending.erase(std::remove_if(pending.begin(), pending.end(), [this](const uint64_t serial) {
+                auto inv = std::find_if(_inverters.begin(), _inverters.end(), [serial](const auto& i) { return i->serial() == serial; });
+                // Removed inverters and the ones which are not polled anymore are not waited for
+                return inv == _inverters.end() || !(*inv)->getEnablePolling()
+                    || (*inv)->getTransactionRunner().begin(_snapshotTransaction, **inv);
+            }),
+                pending.end());
+            return;
+        }
+
+        const bool active = _pollStateCmt.active
+            || std::any_of(_pollStateNrf.begin(), _pollStateNrf.end(), [](const auto& state) { return state.active; });
+        if (!active) {
+            _snapshot.running = false;
+            _snapshot.duration = now - _snapshot.start;
+            _snapshot.count++;
+        }
+        return;
     }
 
+    const uint32_t cycle = getCycleTime();
+    if (cycle == 0 || (_snapshot.started && now - _snapshot.start < cycle)) {
+        return;
+    }
+
+    _snapshot.start = now;
+    _snapshot.cycle = cycle;
+    _snapshot.started = true;
+    _snapshot.running = true;
+    _snapshot.pending.clear();
+
+    for (auto& inv : _inverters) {
+        if (!inv->getEnablePolling() || inv->getRadio() == nullptr || !inv->getRadio()->isInitialized()) {
+            continue;
+        }
+        if (inv->getZeroValuesIfUnreachable() && !inv->isReachable()) {
+            inv->Statistics()->zeroRuntimeData();
+        }
+        if (!inv->getTransactionRunner().begin(_snapshotTransaction, *inv)) {
+            _snapshot.pending.push_back(inv->serial());
+        }
+    }
+}
+
+void HoymilesClass::pollFocus()
+{
+    std::lock_guard<std::mutex> lock(_focusMutex);
+
+    if (millis() - _focus.start >= _focus.duration) {
+        HOY_LOGI("Focus on inverter %0" PRIx32 "%08" PRIx32 " ended after %" PRIu32 " requests\r\n",
+            static_cast<uint32_t>(_focus.serial >> 32), static_cast<uint32_t>(_focus.serial), _focus.requests);
+        _focus = {};
+        return;
+    }
+
+    auto inv = std::find_if(_inverters.begin(), _inverters.end(), [this](const auto& i) { return i->serial() == _focus.serial; });
+    if (inv == _inverters.end()) {
+        // The inverter was removed
+        _focus = {};
+        return;
+    }
+
+    // A transaction which was running when the focus began is finished first
+    if ((*inv)->getTransactionRunner().begin(_focusTransaction, **inv)) {
+        _focus.requests++;
+    }
+}
+
+void HoymilesClass::updateActivity(HoymilesRadio* radio, RadioPollState_t& state)
+{
+    bool active = radio->isInitialized() && (!radio->isIdle() || !radio->isQueueEmpty());
+
+    // The queue is empty for a moment between two steps of a transaction
+    if (!active && radio->isInitialized()) {
+        active = std::any_of(_inverters.begin(), _inverters.end(), [radio](const auto& inv) {
+            return inv->getRadio() == radio && inv->getTransactionRunner().isRunning();
+        });
+    }
+
+    const uint32_t now = millis();
+    if (active && !state.active) {
+        state.activeSince = now;
+    } else if (!active && state.active) {
+        state.lastActiveDuration = now - state.activeSince;
+    }
+    state.active = active;
+}
+
+std::shared_ptr<InverterAbstract> HoymilesClass::getNextInverterByRadio(const HoymilesRadio* radio, uint8_t& pos)
+{
+    for (size_t i = 0; i < _inverters.size(); i++) {
+        if (pos >= _inverters.size()) {
+            pos = 0;
+        }
+
+        std::shared_ptr<InverterAbstract> iv = _inverters[pos++];
+        if (iv->getRadio() == radio) {
+            return iv;
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<InverterAbstract> HoymilesClass::getMostOverdueInverterByRadio(const HoymilesRadio* radio)
+{
+    const uint32_t now = millis();
+    std::shared_ptr<InverterAbstract> result = nullptr;
+    uint32_t maxOverdue = 0;
+
+    for (auto& inv : _inverters) {
+        if (inv->getRadio() != radio || (!inv->getEnablePolling() && !inv->getEnableCommands())) {
+            continue;
+        }
+
+        const uint32_t elapsed = now - inv->getLastAdaptivePoll();
+        const uint32_t delay = inv->getAdaptivePollDelay(_pollInterval * 1000);
+        if (elapsed < delay) {
+            continue;
+        }
+
+        const uint32_t overdue = elapsed - delay;
+        if (result == nullptr || overdue > maxOverdue) {
+            result = inv;
+            maxOverdue = overdue;
+        }
+    }
+    return result;
+}
+
+bool HoymilesClass::pollInverter(std::shared_ptr<InverterAbstract> iv)
+{
+    if (iv->getZeroValuesIfUnreachable() && !iv->isReachable()) {
+        iv->Statistics()->zeroRuntimeData();
+    }
+
+    if (!iv->getEnablePolling() && !iv->getEnableCommands()) {
+        return false;
+    }
+
+    const InverterPollPlan_t& plan = iv->getPollPlan();
+    // In snapshot mode the stats are requested by the snapshot, the slot serves the other requests
+    const bool statsDue = !_snapshotPolling && iv->isStatsPollDue();
+    const bool alarmDue = !plan.AlarmOnDemand && iv->isAlarmPollDue();
+    const bool infoDue = _snapshotPolling && (isGridProfilePollDue(*iv) || isDevInfoPollDue(*iv));
+
+    // An inverter which was unreachable has probably restarted and lost its limit
+    if (!iv->isReachable()) {
+        iv->SystemConfigPara()->requestReadback();
+    }
+    const bool limitDue = isLimitPollDue(*iv);
+
+    // Nothing of the poll plan is due, the slot is left to the next inverter
+    if (!statsDue && !alarmDue && !limitDue && !infoDue) {
+        return false;
+    }
+
+    // The previous poll is still waiting for answers
+    if (!iv->getTransactionRunner().begin(_snapshotPolling ? _backgroundTransaction : _pollTransaction, *iv)) {
+        return false;
+    }
+
+    HOY_LOGD("Fetch inverter: %0" PRIx32 "%08" PRIx32 "\r\n",
+        static_cast<uint32_t>(iv->serial() >> 32), static_cast<uint32_t>(iv->serial()));
+
+    // Set limit if required
+    if (iv->SystemConfigPara()->getLastLimitCommandSuccess() == CMD_NOK) {
+        HOY_LOGI("Resend ActivePowerControl\r\n");
+        iv->resendActivePowerControlRequest();
+    }
+
+    // Set power status if required
+    if (iv->PowerCommand()->getLastPowerCommandSuccess() == CMD_NOK) {
+        HOY_LOGI("Resend PowerCommand\r\n");
+        iv->resendPowerControlRequest();
+    }
+
+    if (HOY_LOG_ENABLED(HOY_LOG_LEVEL_DEBUG)) {
+        uint32_t nrfQueueSize = 0;
+        for (auto& radio : _radioNrf) {
+            nrfQueueSize += radio->getQueueSize();
+        }
+        HOY_LOGD("Queue size - NRF: %" PRIu32 " CMT: %" PRIu32 "\r\n", nrfQueueSize, _radioCmt->getQueueSize());
+    }
+
+    return true;
+}
+
+// Checked in this order, the first model whose serial check matches is used. The
+// HM checks also accept older serial formats, so the exact prefixes come first.
+static const InverterModel_t* const inverterModels[] = {
+    &HMT_4CH::Model,
+    &HMT_6CH::Model,
+    &HMS_4CH::Model,
+    &HMS_2CH::Model,
+    &HMS_1CH::Model,
+    &HMS_1CHv2::Model,
+    &HM_4CH::Model,
+    &HM_2CH::Model,
+    &HM_1CH::Model,
+    &HERF_1CH::Model,
+    &HERF_2CH::Model,
+    &HERF_4CH::Model,
+};
+
+const InverterModel_t* HoymilesClass::findModel(const uint64_t serial)
+{
+    for (const auto model : inverterModels) {
+        if (model->IsValidSerial(serial)) {
+            return model;
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<InverterAbstract> HoymilesClass::createInverter(const uint64_t serial, HoymilesRadio* radioNrf, HoymilesRadio* radioCmt)
+{
+    const InverterModel_t* model = findModel(serial);
+    if (model == nullptr) {
+        return nullptr;
+    }
+    return model->Create(model->Radio == InverterRadioType_t::Cmt ? radioCmt : radioNrf, serial);
+}
+
+std::shared_ptr<InverterAbstract> HoymilesClass::addInverter(const char* name, const uint64_t serial)
+{
+    return addInverter(name, serial, nullptr);
+}
+
+std::shared_ptr<InverterAbstract> HoymilesClass::addInverter(const char* name, const uint64_t serial, HoymilesRadio* radio)
+{
+    std::shared_ptr<InverterAbstract> i = radio != nullptr
+        ? createInverter(serial, radio, radio)
+        : createInverter(serial, getLeastLoadedRadioNrf(), _radioCmt.get());
+
     if (i) {
         i->setName(name);
         i->init();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            i->setLimitShaping(_limitMinInterval, _limitHysteresis);
+        }
+
+        TimedLock<ReaderPreferringMutex> listLock(_inverterMutex, _listLockStats);
+
+        const HoymilesRadio* radio = i->getRadio();
+        const size_t radioInverterCount = std::count_if(_inverters.begin(), _inverters.end(),
+            [radio](const auto& inv) { return inv->getRadio() == radio; });
+        i->getRadio()->reserveCommandPool(radioInverterCount + 1);
+
         _inverters.push_back(std::move(i));
+        rebuildInverterIndex();
         return _inverters.back();
     }
 
     return nullptr;
 }
 
+std::shared_ptr<InverterAbstract> HoymilesClass::replaceInverter(const uint64_t oldSerial, const char* name, const uint64_t serial)
+{
+    std::shared_ptr<InverterAbstract> old = getInverterBySerial(oldSerial);
+    if (old == nullptr) {
+        return addInverter(name, serial);
+    }
+
+    // A nrf inverter stays on its radio, the load of the radios does not change
+    HoymilesRadio* radioNrf = isRadioNrf(old->getRadio()) ? old->getRadio() : getLeastLoadedRadioNrf();
+    std::shared_ptr<InverterAbstract> i = createInverter(serial, radioNrf, _radioCmt.get());
+    if (!i) {
+        return nullptr;
+    }
+
+    i->setName(name);
+    i->init();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        i->setLimitShaping(_limitMinInterval, _limitHysteresis);
+    }
+
+    {
+        TimedLock<ReaderPreferringMutex> listLock(_inverterMutex, _listLockStats);
+        auto it = std::find(_inverters.begin(), _inverters.end(), old);
+        if (it == _inverters.end()) {
+            // Removed meanwhile
+            _inverters.push_back(i);
+        } else {
+            // Same position, the other inverters keep theirs
+            *it = i;
+        }
+
+        if (i->getRadio() != old->getRadio()) {
+            const HoymilesRadio* radio = i->getRadio();
+            const size_t radioInverterCount = std::count_if(_inverters.begin(), _inverters.end(),
+                [radio](const auto& inv) { return inv->getRadio() == radio; });
+            i->getRadio()->reserveCommandPool(radioInverterCount);
+        }
+        rebuildInverterIndex();
+    }
+
+    // Only the commands of the replaced inverter are dropped
+    old->getRadio()->removeCommands(old.get());
+    return i;
+}
+
 std::shared_ptr<InverterAbstract> HoymilesClass::getInverterByPos(const uint8_t pos)
 {
+    std::shared_lock<ReaderPreferringMutex> lock(_inverterMutex);
     if (pos >= _inverters.size()) {
         return nullptr;
     } else {
@@ -197,6 +605,13 @@ std::shared_ptr<InverterAbstract> HoymilesClass::getInverterByPos(const uint8_t
 
 std::shared_ptr<InverterAbstract> HoymilesClass::getInverterBySerial(const uint64_t serial)
 {
+    std::shared_lock<ReaderPreferringMutex> lock(_inverterMutex);
+    auto it = _inverterIndex.find(getRadioId(serial));
+    if (it != _inverterIndex.end() && it->second->serial() == serial) {
+        return it->second;
+    }
+
+    // Fallback in the unlikely case that two inverters share the same radio id
     for (auto& inv : _inverters) {
         if (inv->serial() == serial) {
             return inv;
@@ -205,37 +620,58 @@ std::shared_ptr<InverterAbstract> HoymilesClass::getInverterBySerial(const uint6
     return nullptr;
 }
 
-std::shared_ptr<InverterAbstract> HoymilesClass::getInverterByFragment(const fragment_t& fragment)
+std::shared_ptr<InverterAbstract> HOY_RX_ATTR HoymilesClass::getInverterByFragment(const fragment_t& fragment)
 {
     if (fragment.len <= 4) {
         return nullptr;
     }
 
-    for (auto& inv : _inverters) {
-        serial_u p;
-        p.u64 = inv->serial();
-
-        if ((p.b[3] == fragment.fragment[1])
-            && (p.b[2] == fragment.fragment[2])
-            && (p.b[1] == fragment.fragment[3])
-            && (p.b[0] == fragment.fragment[4])) {
+    const uint32_t radioId = (static_cast<uint32_t>(fragment.fragment[1]) << 24)
+        | (static_cast<uint32_t>(fragment.fragment[2]) << 16)
+        | (static_cast<uint32_t>(fragment.fragment[3]) << 8)
+        | static_cast<uint32_t>(fragment.fragment[4]);
 
-            return inv;
-        }
+    std::shared_lock<ReaderPreferringMutex> lock(_inverterMutex);
+    auto it = _inverterIndex.find(radioId);
+    if (it != _inverterIndex.end()) {
+        return it->second;
     }
     return nullptr;
 }
 
 void HoymilesClass::removeInverterBySerial(const uint64_t serial)
 {
-    for (uint8_t i = 0; i < _inverters.size(); i++) {
-        if (_inverters[i]->serial() == serial) {
-            std::lock_guard<std::mutex> lock(_mutex);
-            _inverters[i]->getRadio()->removeCommands(_inverters[i].get());
-            _inverters.erase(_inverters.begin() + i);
+    std::shared_ptr<InverterAbstract> removed;
+    {
+        TimedLock<ReaderPreferringMutex> listLock(_inverterMutex, _listLockStats);
+        auto it = std::find_if(_inverters.begin(), _inverters.end(),
+            [serial](const auto& inv) { return inv->serial() == serial; });
+        if (it == _inverters.end()) {
             return;
         }
+        removed = std::move(*it);
+        _inverters.erase(it);
+        rebuildInverterIndex();
     }
+
+    // Outside of the list lock: the radio loop holds its queue lock while it looks up
+    // inverters. Commands it still sends meanwhile find no inverter and are dropped.
+    removed->getRadio()->removeCommands(removed.get());
+}
+
+void HoymilesClass::rebuildInverterIndex()
+{
+    _inverterIndex.clear();
+    _inverterIndex.reserve(_inverters.size());
+    for (auto& inv : _inverters) {
+        // If two inverters share the same radio id the first one wins (same as a linear scan)
+        _inverterIndex.emplace(getRadioId(inv->serial()), inv);
+    }
+}
+
+uint32_t HoymilesClass::getRadioId(const uint64_t serial)
+{
+    return static_cast<uint32_t>(serial & 0xFFFFFFFF);
 }
 
 size_t HoymilesClass::getNumInverters() const
@@ -243,9 +679,81 @@ size_t HoymilesClass::getNumInverters() const
     return _inverters.size();
 }
 
-HoymilesRadio_NRF* HoymilesClass::getRadioNrf()
+HoymilesRadio_NRF* HoymilesClass::getRadioNrf(const uint8_t idx)
+{
+    if (idx >= HOY_NRF_RADIO_COUNT) {
+        return nullptr;
+    }
+    return _radioNrf[idx].get();
+}
+
+bool HoymilesClass::isRadioNrf(const HoymilesRadio* radio) const
+{
+    return std::any_of(_radioNrf.begin(), _radioNrf.end(),
+        [radio](const auto& r) { return r.get() == radio; });
+}
+
+std::vector<RadioInfo_t> HoymilesClass::getRadios()
+{
+    std::vector<RadioInfo_t> radios;
+    radios.reserve(HOY_NRF_RADIO_COUNT + 1);
+    for (uint8_t i = 0; i < HOY_NRF_RADIO_COUNT; i++) {
+        radios.push_back({ nrfRadioNames[i], _radioNrf[i].get() });
+    }
+    radios.push_back({ "cmt", _radioCmt.get() });
+    return radios;
+}
+
+uint8_t HoymilesClass::getRadioIndex(const HoymilesRadio* radio) const
+{
+    for (uint8_t i = 0; i < HOY_NRF_RADIO_COUNT; i++) {
+        if (_radioNrf[i].get() == radio) {
+            return i;
+        }
+    }
+    return HOY_NRF_RADIO_COUNT;
+}
+
+RadioCapture& HoymilesClass::getRadioCapture()
+{
+    return _radioCapture;
+}
+
+void HoymilesClass::printQueues()
 {
-    return _radioNrf.get();
+    for (auto& r : getRadios()) {
+        if (r.radio != nullptr && r.radio->isInitialized()) {
+            r.radio->printQueue(_messageOutput, r.name);
+        }
+    }
+}
+
+CommandTraceRing& HoymilesClass::getCommandTraces()
+{
+    return _commandTraces;
+}
+
+// New nrf inverters are given to the module which serves the fewest inverters
+HoymilesRadio_NRF* HoymilesClass::getLeastLoadedRadioNrf()
+{
+    std::shared_lock<ReaderPreferringMutex> lock(_inverterMutex);
+
+    HoymilesRadio_NRF* result = _radioNrf[0].get();
+    size_t minCount = SIZE_MAX;
+
+    for (auto& radio : _radioNrf) {
+        if (!radio->isInitialized()) {
+            continue;
+        }
+
+        const size_t count = std::count_if(_inverters.begin(), _inverters.end(),
+            [&radio](const auto& inv) { return inv->getRadio() == radio.get(); });
+        if (count < minCount) {
+            result = radio.get();
+            minCount = count;
+        }
+    }
+    return result;
 }
 
 HoymilesRadio_CMT* HoymilesClass::getRadioCmt()
@@ -255,7 +763,79 @@ HoymilesRadio_CMT* HoymilesClass::getRadioCmt()
 
 bool HoymilesClass::isAllRadioIdle() const
 {
-    return _radioNrf.get()->isIdle() && _radioCmt.get()->isIdle();
+    return std::all_of(_radioNrf.begin(), _radioNrf.end(), [](const auto& r) { return r->isIdle(); })
+        && _radioCmt->isIdle();
+}
+
+uint32_t HoymilesClass::getTimeToPoll(const HoymilesRadio* radio, const RadioPollState_t& state, const uint32_t now) const
+{
+    if (!radio->isInitialized() || getNumInverters() == 0) {
+        return UINT32_MAX;
+    }
+
+    const uint32_t interval = _pollInterval * 1000;
+    const uint32_t elapsed = now - state.lastPoll;
+    if (elapsed <= interval) {
+        return interval - elapsed;
+    }
+
+    // A slot which sent nothing (no inverter due, polling disabled) is tried again by
+    // every loop. A poll only starts once an inverter becomes due, which is not predictable.
+    return state.slotUnused ? UINT32_MAX : 0;
+}
+
+uint32_t HoymilesClass::getIdleWindow() const
+{
+    const uint32_t now = millis();
+    uint32_t window = UINT32_MAX;
+
+    for (uint8_t i = 0; i < HOY_NRF_RADIO_COUNT; i++) {
+        if (_pollStateNrf[i].active) {
+            return 0;
+        }
+        window = std::min(window, getTimeToPoll(_radioNrf[i].get(), _pollStateNrf[i], now));
+    }
+    if (_pollStateCmt.active) {
+        return 0;
+    }
+    window = std::min(window, getTimeToPoll(_radioCmt.get(), _pollStateCmt, now));
+
+    if (_snapshotPolling && _snapshot.started) {
+        const uint32_t elapsed = now - _snapshot.start;
+        window = std::min(window, _snapshot.running || elapsed >= _snapshot.cycle ? 0 : _snapshot.cycle - elapsed);
+    }
+    return window;
+}
+
+uint32_t HoymilesClass::getTimeToIdleWindow(const uint32_t minWindow) const
+{
+    const uint32_t now = millis();
+    uint32_t wait = 0;
+
+    auto check = [&](const HoymilesRadio* radio, const RadioPollState_t& state) {
+        if (!radio->isInitialized()) {
+            return;
+        }
+
+        if (state.active) {
+            // The current activity is expected to take as long as the last one
+            const uint32_t elapsed = now - state.activeSince;
+            wait = std::max(wait, state.lastActiveDuration > elapsed ? state.lastActiveDuration - elapsed : HOY_IDLE_WINDOW_RECHECK);
+            return;
+        }
+
+        // The poll which is due soon is waited for, plus the activity it causes
+        const uint32_t toPoll = getTimeToPoll(radio, state, now);
+        if (toPoll < minWindow) {
+            wait = std::max(wait, toPoll + std::max<uint32_t>(state.lastActiveDuration, HOY_IDLE_WINDOW_RECHECK));
+        }
+    };
+
+    for (uint8_t i = 0; i < HOY_NRF_RADIO_COUNT; i++) {
+        check(_radioNrf[i].get(), _pollStateNrf[i]);
+    }
+    check(_radioCmt.get(), _pollStateCmt);
+    return wait;
 }
 
 uint32_t HoymilesClass::PollInterval() const
@@ -268,6 +848,131 @@ void HoymilesClass::setPollInterval(const uint32_t interval)
     _pollInterval = interval;
 }
 
+bool HoymilesClass::setStandby(const bool standby)
+{
+    bool ret = true;
+    for (auto& radio : getRadios()) {
+        if (radio.radio != nullptr) {
+            ret &= radio.radio->setStandby(standby);
+        }
+    }
+    return ret;
+}
+
+bool HoymilesClass::getAdaptivePolling() const
+{
+    return _adaptivePolling;
+}
+
+void HoymilesClass::setAdaptivePolling(const bool enabled)
+{
+    _adaptivePolling = enabled;
+}
+
+bool HoymilesClass::getSnapshotPolling() const
+{
+    return _snapshotPolling;
+}
+
+void HoymilesClass::setSnapshotPolling(const bool enabled)
+{
+    if (enabled == _snapshotPolling) {
+        return;
+    }
+    _snapshotPolling = enabled;
+
+    // The first snapshot starts right away, a running one is finished by the transactions
+    _snapshot.started = false;
+    _snapshot.running = false;
+    _snapshot.pending.clear();
+}
+
+bool HoymilesClass::setFocus(const uint64_t serial, const uint32_t duration)
+{
+    auto inv = getInverterBySerial(serial);
+    if (inv == nullptr || inv->getRadio() == nullptr || !inv->getRadio()->isInitialized()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_focusMutex);
+    if (_focus.serial != serial) {
+        _focus.requests = 0;
+    }
+    _focus.serial = serial;
+    _focus.start = millis();
+    _focus.duration = std::min<uint32_t>(duration, HOY_FOCUS_MAX_DURATION);
+    return true;
+}
+
+void HoymilesClass::clearFocus()
+{
+    std::lock_guard<std::mutex> lock(_focusMutex);
+    _focus = {};
+}
+
+bool HoymilesClass::isFocusActive() const
+{
+    std::lock_guard<std::mutex> lock(_focusMutex);
+    return _focus.serial != 0;
+}
+
+FocusState_t HoymilesClass::getFocus() const
+{
+    std::lock_guard<std::mutex> lock(_focusMutex);
+    return _focus;
+}
+
+uint32_t HoymilesClass::getSnapshotDuration() const
+{
+    return _snapshot.duration;
+}
+
+uint32_t HoymilesClass::getSnapshotCount() const
+{
+    return _snapshot.count;
+}
+
+void HoymilesClass::setTxPowerControl(const bool enabled)
+{
+    for (auto& radio : getRadios()) {
+        if (radio.radio != nullptr) {
+            radio.radio->setTxPowerControl(enabled);
+        }
+    }
+}
+
+void HoymilesClass::setLimitShaping(const uint32_t minInterval, const float hysteresis)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _limitMinInterval = minInterval;
+    _limitHysteresis = hysteresis;
+    forEachInverter([minInterval, hysteresis](InverterAbstract& inv, const uint8_t) {
+        inv.setLimitShaping(minInterval, hysteresis);
+    });
+}
+
+const LockStats_t& HoymilesClass::getListLockStats() const
+{
+    return _listLockStats;
+}
+
+const LockStats_t& HoymilesClass::getPollLockStats() const
+{
+    return _pollLockStats;
+}
+
+void HoymilesClass::setDataCallback(std::function<void(InverterAbstract& inv, const InverterData_t data)> callback)
+{
+    _dataCallback = callback;
+}
+
+void HoymilesClass::notifyData(InverterAbstract& inv, const InverterData_t data)
+{
+    if (_dataCallback) {
+        _dataCallback(inv, data);
+    }
+}
+
 void HoymilesClass::setMessageOutput(Print* output)
 {
     _messageOutput = output;
@@ -277,3 +982,28 @@ Print* HoymilesClass::getMessageOutput()
 {
     return _messageOutput;
 }
+
+void HoymilesClass::setMessageOutput(const uint8_t level, Print* output)
+{
+    if (level < _levelOutputs.size()) {
+        _levelOutputs[level] = output;
+    }
+}
+
+Print* HoymilesClass::getMessageOutput(const uint8_t level)
+{
+    if (level < _levelOutputs.size() && _levelOutputs[level] != nullptr) {
+        return _levelOutputs[level];
+    }
+    return _messageOutput;
+}
+
+void HoymilesClass::setLogLevel(const uint8_t level)
+{
+    _logLevel = level;
+}
+
+uint8_t HoymilesClass::getLogLevel() const
+{
+    return _logLevel;
+}
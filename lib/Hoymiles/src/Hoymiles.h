@@ -1,54 +1,274 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 #pragma once
 
+#include "CommandTrace.h"
+#include "HoymilesLog.h"
 #include "HoymilesRadio_CMT.h"
 #include "HoymilesRadio_NRF.h"
+#include "LockStats.h"
+#include "RadioCapture.h"
+#include "ReaderPreferringMutex.h"
 #include "inverters/InverterAbstract.h"
 #include "types.h"
 #include <Print.h>
 #include <SPI.h>
+#include <array>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
 #include <vector>
 
-#define HOY_SYSTEM_CONFIG_PARA_POLL_INTERVAL (2 * 60 * 1000) // 2 minutes
 #define HOY_SYSTEM_CONFIG_PARA_POLL_MIN_DURATION (4 * 60 * 1000) // at least 4 minutes between sending limit command and read request. Otherwise eventlog entry
 
+// Device info restored after a reboot is confirmed by the inverter after this time (ms)
+#ifndef HOY_RESTORED_DEV_INFO_CONFIRM_DELAY
+#define HOY_RESTORED_DEV_INFO_CONFIRM_DELAY (10 * 60 * 1000)
+#endif
+
+// Maximum number of nrf modules. Each of them has its own command queue and poll timer.
+#ifndef HOY_NRF_RADIO_COUNT
+#define HOY_NRF_RADIO_COUNT 2
+#endif
+
+// Interval (ms) of the queue dump to the console on the debug log level
+#ifndef HOY_QUEUE_LOG_INTERVAL
+#define HOY_QUEUE_LOG_INTERVAL 10000
+#endif
+
+// Time (ms) after which a radio which is active for longer than its last activity is checked again
+#ifndef HOY_IDLE_WINDOW_RECHECK
+#define HOY_IDLE_WINDOW_RECHECK 20
+#endif
+
+struct RadioPollState_t {
+    uint8_t inverterPos = 0;
+    uint32_t lastPoll = 0;
+    bool slotUnused = false; // the last due poll slot sent nothing
+
+    // Activity: the radio is busy, has queued commands or a transaction of its inverters is running
+    bool active = false;
+    uint32_t activeSince = 0;
+    uint32_t lastActiveDuration = 0; // ms, 0 if not seen yet
+};
+
+// Longest time (ms) a focus on a single inverter lasts before the polling returns to normal
+#ifndef HOY_FOCUS_MAX_DURATION
+#define HOY_FOCUS_MAX_DURATION (15 * 60 * 1000)
+#endif
+
+struct FocusState_t {
+    uint64_t serial = 0; // 0 while no inverter is focused
+    uint32_t start = 0;
+    uint32_t duration = 0; // ms
+    uint32_t requests = 0; // stats requests sent during the focus
+};
+
+// Snapshot polling: the stats requests of all polled inverters at the start of a cycle
+struct SnapshotState_t {
+    bool started = false;
+    bool running = false; // until the radios finished all requests of the snapshot
+    uint32_t start = 0;
+    uint32_t cycle = 0; // ms, when it started
+    uint32_t duration = 0; // ms, of the last finished snapshot
+    uint32_t count = 0; // finished snapshots
+    std::vector<uint64_t> pending; // inverters which still ran another transaction
+};
+
+struct RadioInfo_t {
+    const char* name;
+    HoymilesRadio* radio;
+};
+
 class HoymilesClass {
 public:
     void init();
-    void initNRF(SPIClass* initialisedSpiBus, const uint8_t pinCE, const uint8_t pinIRQ);
+    // Initializes the next nrf module. Several modules can share one SPI bus with different CS pins.
+    void initNRF(std::shared_ptr<SPIClass> initialisedSpiBus, const uint8_t pinCS, const uint8_t pinCE, const uint8_t pinIRQ);
     void initCMT(const int8_t pin_sdio, const int8_t pin_clk, const int8_t pin_cs, const int8_t pin_fcs, const int8_t pin_gpio2, const int8_t pin_gpio3);
     void loop();
 
     void setMessageOutput(Print* output);
     Print* getMessageOutput();
+    // Output of the messages of one level, the general output is used if none is set
+    void setMessageOutput(const uint8_t level, Print* output);
+    Print* getMessageOutput(const uint8_t level);
+
+    // Messages above this level are not written, see HoymilesLog.h
+    void setLogLevel(const uint8_t level);
+    uint8_t getLogLevel() const;
+
+    // The callback is called by the radio task after a response updated data of an
+    // inverter. It has to be short and thread safe, e.g. hand the notification over
+    // to another task. Polling the last update of the parsers still works as before.
+    void setDataCallback(std::function<void(InverterAbstract& inv, const InverterData_t data)> callback);
+    void notifyData(InverterAbstract& inv, const InverterData_t data);
 
     std::shared_ptr<InverterAbstract> addInverter(const char* name, const uint64_t serial);
+    // Adds the inverter on the given radio instead of the one of its type, e.g. the
+    // simulated radio of the host tests. The loop does not poll it.
+    std::shared_ptr<InverterAbstract> addInverter(const char* name, const uint64_t serial, HoymilesRadio* radio);
+    // Swaps the inverter of oldSerial for a new one at the same position within a single
+    // change of the list, so the index never lacks both. Adds it if oldSerial is unknown.
+    std::shared_ptr<InverterAbstract> replaceInverter(const uint64_t oldSerial, const char* name, const uint64_t serial);
+    // Model of the serial from the inverter registry, nullptr if the type is unknown
+    static const InverterModel_t* findModel(const uint64_t serial);
+    // Instance of the inverter type of the serial, nullptr if the type is unknown. Not initialized yet.
+    static std::shared_ptr<InverterAbstract> createInverter(const uint64_t serial, HoymilesRadio* radioNrf, HoymilesRadio* radioCmt);
+    // Lower 4 bytes of the serial, the address of the inverter within the packets
+    static uint32_t getRadioId(const uint64_t serial);
     std::shared_ptr<InverterAbstract> getInverterByPos(const uint8_t pos);
     std::shared_ptr<InverterAbstract> getInverterBySerial(const uint64_t serial);
     std::shared_ptr<InverterAbstract> getInverterByFragment(const fragment_t& fragment);
     void removeInverterBySerial(const uint64_t serial);
     size_t getNumInverters() const;
 
-    HoymilesRadio_NRF* getRadioNrf();
+    // Calls cb(InverterAbstract& inv, const uint8_t pos) for all inverters. The list is
+    // read locked meanwhile, so the references stay valid without copying a shared_ptr
+    // per inverter. The callback must not add or remove inverters, long callbacks
+    // delay a pending change of the inverter list.
+    template <typename Callback>
+    void forEachInverter(Callback&& cb)
+    {
+        std::shared_lock<ReaderPreferringMutex> lock(_inverterMutex);
+        for (size_t i = 0; i < _inverters.size(); i++) {
+            cb(*_inverters[i], static_cast<uint8_t>(i));
+        }
+    }
+
+    HoymilesRadio_NRF* getRadioNrf(const uint8_t idx = 0);
     HoymilesRadio_CMT* getRadioCmt();
+    bool isRadioNrf(const HoymilesRadio* radio) const;
+
+    // All radios, initialized or not, with the name used in the statistics
+    std::vector<RadioInfo_t> getRadios();
+    // Position of the radio in getRadios()
+    uint8_t getRadioIndex(const HoymilesRadio* radio) const;
+
+    RadioCapture& getRadioCapture();
+
+    // Prints the commands of all initialized radios to the message output
+    void printQueues();
+
+    // Recently finished commands with the time of each step
+    CommandTraceRing& getCommandTraces();
 
     uint32_t PollInterval() const;
     void setPollInterval(const uint32_t interval);
 
+    bool getAdaptivePolling() const;
+    void setAdaptivePolling(const bool enabled);
+
+    // Requests the stats of all polled inverters back to back at the start of each cycle
+    // instead of one inverter per poll interval, so the totals combine values of about
+    // the same time. The cycle keeps its length (poll interval times the inverters of the
+    // radio with the most of them), the other requests use the poll slots of the rest of it.
+    bool getSnapshotPolling() const;
+    void setSnapshotPolling(const bool enabled);
+    // Time (ms) from the start of the last finished snapshot until the radios were done
+    uint32_t getSnapshotDuration() const;
+    uint32_t getSnapshotCount() const;
+
+    // Focus mode: the stats of one inverter are requested as fast as its radio answers,
+    // each request right after the previous one finished. All other polls and the other
+    // requests of the focused inverter pause, commands sent by the user are still served.
+    // The focus ends after duration ms (at most HOY_FOCUS_MAX_DURATION) or by clearFocus().
+    // Returns false if the inverter is unknown or its radio is not initialized.
+    bool setFocus(const uint64_t serial, const uint32_t duration);
+    void clearFocus();
+    bool isFocusActive() const;
+    FocusState_t getFocus() const;
+
+    // Applies HoymilesRadio::setTxPowerControl to all radios
+    void setTxPowerControl(const bool enabled);
+
+    // Applies InverterAbstract::setLimitShaping to all current and future inverters
+    void setLimitShaping(const uint32_t minInterval, const float hysteresis);
+
+    // Puts all radios into standby or wakes them up. Returns false if a radio is still busy.
+    bool setStandby(const bool standby);
+
     bool isAllRadioIdle() const;
 
+    // Idle window: the time (ms) until the next poll of any radio is due, 0 while a radio
+    // is active. Background work which fits into it does not delay a radio exchange.
+    // Commands like a limit change can still start at any time. UINT32_MAX if no poll is scheduled.
+    uint32_t getIdleWindow() const;
+
+    // Time (ms) until an idle window of at least minWindow ms is expected to begin, 0 if
+    // it is open now. Estimated from the last activity of each radio.
+    uint32_t getTimeToIdleWindow(const uint32_t minWindow) const;
+
+    // Writers of the inverter list (adding and removing inverters)
+    const LockStats_t& getListLockStats() const;
+    // Read lock of the inverter list taken by the loop to dispatch the polls
+    const LockStats_t& getPollLockStats() const;
+
 private:
+    void buildPollTransaction();
+    void pollRadio(HoymilesRadio* radio, RadioPollState_t& state);
+    void pollSnapshot();
+    void pollFocus();
+    uint32_t getCycleTime() const;
+    void updateActivity(HoymilesRadio* radio, RadioPollState_t& state);
+    // Time (ms) until the next poll of the radio is due, UINT32_MAX if none is expected
+    uint32_t getTimeToPoll(const HoymilesRadio* radio, const RadioPollState_t& state, const uint32_t now) const;
+    std::shared_ptr<InverterAbstract> getNextInverterByRadio(const HoymilesRadio* radio, uint8_t& pos);
+    std::shared_ptr<InverterAbstract> getMostOverdueInverterByRadio(const HoymilesRadio* radio);
+    bool pollInverter(std::shared_ptr<InverterAbstract> iv);
+    HoymilesRadio_NRF* getLeastLoadedRadioNrf();
+
+    void rebuildInverterIndex();
+
     std::vector<std::shared_ptr<InverterAbstract>> _inverters;
-    std::unique_ptr<HoymilesRadio_NRF> _radioNrf;
+
+    // Maps the lower 4 bytes of the serial (which are used as radio address) to the inverter
+    std::unordered_map<uint32_t, std::shared_ptr<InverterAbstract>> _inverterIndex;
+    std::array<std::unique_ptr<HoymilesRadio_NRF>, HOY_NRF_RADIO_COUNT> _radioNrf;
+    uint8_t _radioNrfInitCount = 0;
     std::unique_ptr<HoymilesRadio_CMT> _radioCmt;
 
+    // Guards the limit shaping settings
     std::mutex _mutex;
 
+    // Guards _inverters and _inverterIndex against adding and removing inverters while
+    // they are read. The loop only holds it to dispatch the polls, not while running
+    // the radios. Per inverter data is guarded by the parsers (Parser::readConsistent).
+    ReaderPreferringMutex _inverterMutex;
+    LockStats_t _listLockStats;
+    LockStats_t _pollLockStats;
+
     uint32_t _pollInterval = 0;
-    uint32_t _lastPoll = 0;
+    bool _adaptivePolling = false;
+    bool _snapshotPolling = false;
+    SnapshotState_t _snapshot;
+
+    // Set by the web server, read by the loop
+    FocusState_t _focus;
+    mutable std::mutex _focusMutex;
+    uint32_t _limitMinInterval = 0;
+    float _limitHysteresis = 0;
+    std::array<RadioPollState_t, HOY_NRF_RADIO_COUNT> _pollStateNrf;
+    RadioPollState_t _pollStateCmt;
+
+    // Requests of a poll, each step is started once the previous one is answered
+    InverterTransaction _pollTransaction { "Poll" };
+    // Snapshot mode: the stats only, and the other requests in the rest of the cycle
+    InverterTransaction _snapshotTransaction { "Snapshot" };
+    InverterTransaction _backgroundTransaction { "Background" };
+    // Focus mode: the stats regardless of the poll plan
+    InverterTransaction _focusTransaction { "Focus" };
+
+    RadioCapture _radioCapture;
+    CommandTraceRing _commandTraces;
 
     Print* _messageOutput = &Serial;
+    std::array<Print*, HOY_LOG_LEVEL_VERBOSE + 1> _levelOutputs = {};
+    uint8_t _logLevel = HOY_LOG_LEVEL_DEFAULT;
+    uint32_t _lastQueueLog = 0;
+
+    std::function<void(InverterAbstract& inv, const InverterData_t data)> _dataCallback;
 };
 
 extern HoymilesClass Hoymiles;
\ No newline at end of file
@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#define HOY_LOG_LEVEL_NONE 0
+#define HOY_LOG_LEVEL_ERROR 1
+#define HOY_LOG_LEVEL_WARN 2
+#define HOY_LOG_LEVEL_INFO 3
+#define HOY_LOG_LEVEL_DEBUG 4 // every request, response and packet dump
+#define HOY_LOG_LEVEL_VERBOSE 5
+
+// Highest level which is compiled in. Messages above it are removed by the
+// compiler together with the evaluation of their arguments.
+#ifndef HOY_LOG_LEVEL
+#define HOY_LOG_LEVEL HOY_LOG_LEVEL_VERBOSE
+#endif
+
+// Level used until Hoymiles.setLogLevel() is called
+#ifndef HOY_LOG_LEVEL_DEFAULT
+#define HOY_LOG_LEVEL_DEFAULT HOY_LOG_LEVEL
+#endif
+
+// The macros require Hoymiles.h at the place of use. The arguments are only
+// evaluated if the level is enabled at compile time and at runtime.
+#define HOY_LOG_ENABLED(level) ((level) <= HOY_LOG_LEVEL && (level) <= Hoymiles.getLogLevel())
+
+#define HOY_LOG(level, ...)                                        \
+    do {                                                           \
+        if (HOY_LOG_ENABLED(level)) {                              \
+            Hoymiles.getMessageOutput(level)->printf(__VA_ARGS__); \
+        }                                                          \
+    } while (0)
+
+#define HOY_LOGE(...) HOY_LOG(HOY_LOG_LEVEL_ERROR, __VA_ARGS__)
+#define HOY_LOGW(...) HOY_LOG(HOY_LOG_LEVEL_WARN, __VA_ARGS__)
+#define HOY_LOGI(...) HOY_LOG(HOY_LOG_LEVEL_INFO, __VA_ARGS__)
+#define HOY_LOGD(...) HOY_LOG(HOY_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define HOY_LOGV(...) HOY_LOG(HOY_LOG_LEVEL_VERBOSE, __VA_ARGS__)
@@ -5,6 +5,17 @@
 #include "HoymilesRadio.h"
 #include "Hoymiles.h"
 #include "crc.h"
+#include <algorithm>
+#include <cstring>
+#include <esp_timer.h>
+
+CommandRadioStats_t::CommandRadioStats_t(const char* name)
+    : CommandName(name)
+    , RoundTrip({ 100, 200, 300, 500, 750, 1000, 1500, 2000, 3000, 5000 })
+    , Fragments({ 1, 2, 3, 4, 5, 6, 7, 8 })
+    , Retransmits({ 0, 1, 2, 3, 5, 10 })
+{
+}
 
 serial_u HoymilesRadio::DtuSerial() const
 {
@@ -28,12 +39,93 @@ serial_u HoymilesRadio::convertSerialToRadioId(const serial_u serial)
     return radioId;
 }
 
-bool HoymilesRadio::checkFragmentCrc(const fragment_t& fragment) const
+bool HOY_RX_ATTR HoymilesRadio::checkFragmentCrc(const fragment_t& fragment) const
 {
     const uint8_t crc = crc8(fragment.fragment, fragment.len - 1);
     return (crc == fragment.fragment[fragment.len - 1]);
 }
 
+void HoymilesRadio::countRxBufferLevel(const size_t level)
+{
+    // Only the producer writes the peak, a plain compare is sufficient
+    if (level > _rxBufferPeak.load(std::memory_order_relaxed)) {
+        _rxBufferPeak.store(level, std::memory_order_relaxed);
+    }
+}
+
+void HoymilesRadio::countRxBufferOverflow()
+{
+    _rxBufferOverflows.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint32_t HoymilesRadio::getRxBufferPeak() const
+{
+    return _rxBufferPeak;
+}
+
+uint32_t HoymilesRadio::getRxBufferOverflows() const
+{
+    return _rxBufferOverflows;
+}
+
+const Histogram<8>& HoymilesRadio::getRxLatency() const
+{
+    return _rxLatency;
+}
+
+const Histogram<8>& HoymilesRadio::getRxFragmentGap() const
+{
+    return _rxFragmentGap;
+}
+
+const Histogram<8>& HoymilesRadio::getRxHandlingTime() const
+{
+    return _rxHandlingTime;
+}
+
+uint32_t HoymilesRadio::getRxHandlingTimeMax() const
+{
+    return _rxHandlingTimeMax;
+}
+
+const LockStats_t& HoymilesRadio::getQueueLockStats() const
+{
+    return _queueLockStats;
+}
+
+void HoymilesRadio::countRxHandlingTime(const uint32_t duration)
+{
+    _rxHandlingTime.observe(duration);
+    _rxHandlingTimeMax = std::max(_rxHandlingTimeMax, duration);
+}
+
+void ARDUINO_ISR_ATTR HoymilesRadio::captureRxTimestamp()
+{
+    const uint8_t head = _rxTimestampHead.load(std::memory_order_relaxed);
+    const uint8_t next = (head + 1) % HOY_RX_TIMESTAMP_COUNT;
+    if (next == _rxTimestampTail.load(std::memory_order_acquire)) {
+        return; // full
+    }
+    _rxTimestamps[head] = esp_timer_get_time();
+    _rxTimestampHead.store(next, std::memory_order_release);
+}
+
+uint32_t HoymilesRadio::takeRxTimestamp()
+{
+    const uint8_t tail = _rxTimestampTail.load(std::memory_order_relaxed);
+    if (tail == _rxTimestampHead.load(std::memory_order_acquire)) {
+        return esp_timer_get_time();
+    }
+    const uint32_t timestamp = _rxTimestamps[tail];
+    _rxTimestampTail.store((tail + 1) % HOY_RX_TIMESTAMP_COUNT, std::memory_order_release);
+    return timestamp;
+}
+
+void HoymilesRadio::discardRxTimestamps()
+{
+    _rxTimestampTail.store(_rxTimestampHead.load(std::memory_order_acquire), std::memory_order_release);
+}
+
 void HoymilesRadio::sendRetransmitPacket(const uint8_t fragment_id)
 {
     CommandAbstract* cmd = _commandQueue.front().get();
@@ -41,6 +133,9 @@ void HoymilesRadio::sendRetransmitPacket(const uint8_t fragment_id)
     CommandAbstract* requestCmd = cmd->getRequestFrameCommand(fragment_id);
 
     if (requestCmd != nullptr) {
+        _commandRetransmits++;
+        _trace.Retransmits++;
+        _trace.LastTx = millis();
         sendEsbPacket(*requestCmd);
     }
 }
@@ -48,56 +143,166 @@ void HoymilesRadio::sendRetransmitPacket(const uint8_t fragment_id)
 void HoymilesRadio::sendLastPacketAgain()
 {
     CommandAbstract* cmd = _commandQueue.front().get();
+    _commandRetransmits++;
+    _trace.Resends++;
+    _trace.LastTx = millis();
     sendEsbPacket(*cmd);
 }
 
+void HoymilesRadio::storeRxFragment(InverterAbstract& inv, const fragment_t& fragment)
+{
+    inv.setLastRssi(fragment.rssi);
+
+    _rxLatency.observe(static_cast<uint32_t>(esp_timer_get_time()) - fragment.rxTime);
+
+    // Late answers to earlier commands are not reassembled, the buffer
+    // belongs to the command at the head of the queue
+    if (_busyFlag && !isQueueEmpty()
+        && _commandQueue.front().get()->getTargetAddress() == inv.serial()) {
+        _rxFragments.addFragment(fragment.fragment, fragment.len);
+
+        if (_rxFragmentSeen) {
+            _rxFragmentGap.observe(fragment.rxTime - _rxLastFragmentTime);
+        }
+        _rxLastFragmentTime = fragment.rxTime;
+        _rxFragmentSeen = true;
+        _trace.Rx = millis();
+
+        if (_rxFragments.isComplete()) {
+            _rxComplete = true;
+        }
+    }
+}
+
+void HoymilesRadio::startRxPeriod(const CommandAbstract& cmd)
+{
+    uint32_t timeout = cmd.getTimeout();
+    _rxCommandName = cmd.getCommandName();
+
+    auto inv = Hoymiles.getInverterBySerial(cmd.getTargetAddress());
+    if (nullptr != inv) {
+        timeout = inv->getRxTimeEstimator(_rxCommandName).getTimeout(timeout);
+    }
+    _rxWindowAdapted = timeout < cmd.getTimeout();
+
+    _rxStartTime = esp_timer_get_time();
+    _rxFragmentSeen = false;
+    _busyFlag = true;
+    _rxTimeout.set(timeout);
+}
+
+void HoymilesRadio::restartRxPeriod()
+{
+    _rxStartTime = esp_timer_get_time();
+    _rxTimeout.reset();
+}
+
+void HoymilesRadio::updatePowerLock()
+{
+    const bool needed = _busyFlag || !isQueueEmpty();
+    if (needed == _powerLockHeld) {
+        return;
+    }
+
+    if (!_powerLockCreated) {
+        _powerLockCreated = true;
+        if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "hoy_radio", &_powerLock) != ESP_OK) {
+            _powerLock = nullptr;
+        }
+    }
+    if (_powerLock == nullptr) {
+        return;
+    }
+
+    if (needed) {
+        esp_pm_lock_acquire(_powerLock);
+    } else {
+        esp_pm_lock_release(_powerLock);
+    }
+    _powerLockHeld = needed;
+}
+
 void HoymilesRadio::handleReceivedPackage()
 {
-    if (_busyFlag && _rxTimeout.occured()) {
-        Hoymiles.getMessageOutput()->println("RX Period End");
+    updatePowerLock();
+
+    if (_busyFlag && (_rxComplete || _rxTimeout.occured())) {
+        const bool rxComplete = _rxComplete;
+        _rxComplete = false;
+        HOY_LOGD("%s\r\n", rxComplete ? "RX Complete" : "RX Period End");
         std::shared_ptr<InverterAbstract> inv = Hoymiles.getInverterBySerial(_commandQueue.front().get()->getTargetAddress());
 
         if (nullptr != inv) {
+            // Only complete responses tell the response time. A shortened window
+            // which ended without one falls back to the static timeout once.
+            RxTimeEstimator& estimator = inv->getRxTimeEstimator(_rxCommandName);
+            if (rxComplete) {
+                // Measured up to the interrupt, the delay of the loop is not part of it
+                estimator.observe((_rxLastFragmentTime - _rxStartTime) / 1000);
+            } else if (_rxWindowAdapted) {
+                estimator.markMissed();
+            }
+
             CommandAbstract* cmd = _commandQueue.front().get();
-            uint8_t verifyResult = inv->verifyAllFragments(*cmd);
+            uint8_t verifyResult = _rxFragments.verify(*cmd, *inv);
             if (verifyResult == FRAGMENT_ALL_MISSING_RESEND) {
-                Hoymiles.getMessageOutput()->println("Nothing received, resend whole request");
+                HOY_LOGD("Nothing received, resend whole request\r\n");
+                sendLastPacketAgain();
+
+            } else if (verifyResult == FRAGMENT_PARTIAL_RESEND) {
+                HOY_LOGD("Many fragments missing, resend whole request\r\n");
                 sendLastPacketAgain();
 
             } else if (verifyResult == FRAGMENT_ALL_MISSING_TIMEOUT) {
-                Hoymiles.getMessageOutput()->println("Nothing received, resend count exeeded");
+                HOY_LOGW("Nothing received, resend count exeeded\r\n");
                 // Statistics: Count RX Fail No Answer
                 if (inv->RadioStats.TxRequestData > 0) {
                     inv->RadioStats.RxFailNoAnswer++;
                 }
 
+                // The other requests of this poll would run into the same timeouts
+                if (cmd->expectsResponse() && cmd->getPriority() == CommandPriority::Telemetry) {
+                    const uint8_t deferred = _commandQueue.deferTelemetry(inv->serial());
+                    if (deferred > 0) {
+                        HOY_LOGI("Deferred %" PRIu8 " requests until the next poll\r\n", deferred);
+                    }
+                }
+
+                finishCommandRadioStats(*cmd, 0);
+                finishTrace(CommandTraceResult_t::NoAnswer);
+                observeTxPower(*cmd, *inv, false);
                 _commandQueue.pop();
                 _busyFlag = false;
 
             } else if (verifyResult == FRAGMENT_RETRANSMIT_TIMEOUT) {
-                Hoymiles.getMessageOutput()->println("Retransmit timeout");
+                HOY_LOGW("Retransmit timeout\r\n");
                 // Statistics: Count RX Fail Partial Answer
                 if (inv->RadioStats.TxRequestData > 0) {
                     inv->RadioStats.RxFailPartialAnswer++;
                 }
 
+                finishCommandRadioStats(*cmd, 0);
+                finishTrace(CommandTraceResult_t::PartialAnswer);
+                observeTxPower(*cmd, *inv, true);
                 _commandQueue.pop();
                 _busyFlag = false;
 
             } else if (verifyResult == FRAGMENT_HANDLE_ERROR) {
-                Hoymiles.getMessageOutput()->println("Packet handling error");
+                HOY_LOGW("Packet handling error\r\n");
                 // Statistics: Count RX Fail Corrupt Data
                 if (inv->RadioStats.TxRequestData > 0) {
                     inv->RadioStats.RxFailCorruptData++;
                 }
 
+                finishCommandRadioStats(*cmd, 0);
+                finishTrace(CommandTraceResult_t::CorruptData);
+                observeTxPower(*cmd, *inv, true);
                 _commandQueue.pop();
                 _busyFlag = false;
 
             } else if (verifyResult > 0) {
                 // Perform Retransmit
-                Hoymiles.getMessageOutput()->print("Request retransmit: ");
-                Hoymiles.getMessageOutput()->println(verifyResult);
+                HOY_LOGD("Request retransmit: %" PRIu8 "\r\n", verifyResult);
                 // Statistics: Count TX Re-Request Fragment
                 inv->RadioStats.TxReRequestFragment++;
 
@@ -105,18 +310,24 @@ void HoymilesRadio::handleReceivedPackage()
 
             } else {
                 // Successful received all packages
-                Hoymiles.getMessageOutput()->println("Success");
+                HOY_LOGD("Success\r\n");
                 // Statistics: Count RX Success
                 if (inv->RadioStats.TxRequestData > 0) {
                     inv->RadioStats.RxSuccess++;
                 }
 
+                finishCommandRadioStats(*cmd, _rxFragments.getFragmentCount());
+                // The response was parsed by verify()
+                _trace.ParseDone = millis();
+                _trace.Fragments = _rxFragments.getFragmentCount();
+                finishTrace(CommandTraceResult_t::Success);
+                observeTxPower(*cmd, *inv, true);
                 _commandQueue.pop();
                 _busyFlag = false;
             }
         } else {
             // If inverter was not found, assume the command is invalid
-            Hoymiles.getMessageOutput()->println("RX: Invalid inverter found");
+            HOY_LOGW("RX: Invalid inverter found\r\n");
             // Statistics: Count RX Fail Unknown Data
             _commandQueue.pop();
             _busyFlag = false;
@@ -128,29 +339,65 @@ void HoymilesRadio::handleReceivedPackage()
 
             auto inv = Hoymiles.getInverterBySerial(cmd->getTargetAddress());
             if (nullptr != inv) {
-                inv->clearRxFragmentBuffer();
+                _rxFragments.reset();
                 // Statistics: TX Requests
                 inv->RadioStats.TxRequestData++;
 
+                // Statistics: Queue wait time
+                const uint32_t wait = millis() - cmd->getQueuedTime();
+                QueueWaitStats_t& stats = _queueWaitStats[static_cast<uint8_t>(cmd->getPriority())];
+                stats.Count++;
+                stats.Total += wait;
+                stats.Max = std::max(stats.Max, wait);
+                stats.Last = wait;
+
+                _commandStartTime = millis();
+                _commandRetransmits = 0;
+                _rxComplete = false;
+                cmd->prepareTransmit();
+                startTrace(*cmd);
+
                 sendEsbPacket(*cmd);
             } else {
-                Hoymiles.getMessageOutput()->println("TX: Invalid inverter found");
+                HOY_LOGW("TX: Invalid inverter found\r\n");
                 _commandQueue.pop();
             }
         }
     }
+
+    updatePowerLock();
 }
 
 void HoymilesRadio::dumpBuf(const uint8_t buf[], const uint8_t len, const bool appendNewline)
 {
-    for (uint8_t i = 0; i < len; i++) {
-        Hoymiles.getMessageOutput()->printf("%02X ", buf[i]);
+    // Formatted into one buffer, a printf per byte is expensive on the rx path
+    static constexpr char hex[] = "0123456789ABCDEF";
+    char line[MAX_RF_PAYLOAD_SIZE * 3 + 1];
+    const uint8_t n = std::min<uint8_t>(len, MAX_RF_PAYLOAD_SIZE);
+    for (uint8_t i = 0; i < n; i++) {
+        line[i * 3] = hex[buf[i] >> 4];
+        line[i * 3 + 1] = hex[buf[i] & 0x0f];
+        line[i * 3 + 2] = ' ';
     }
+    line[n * 3] = '\0';
+
+    // Only used for the packet dumps
     if (appendNewline) {
-        Hoymiles.getMessageOutput()->println("");
+        Hoymiles.getMessageOutput(HOY_LOG_LEVEL_DEBUG)->println(line);
+    } else {
+        Hoymiles.getMessageOutput(HOY_LOG_LEVEL_DEBUG)->print(line);
     }
 }
 
+void HoymilesRadio::captureFragment(const CaptureDirection_t direction, const uint8_t channel, const int8_t rssi, const uint8_t data[], const uint8_t len)
+{
+    RadioCapture& capture = Hoymiles.getRadioCapture();
+    if (!capture.isEnabled()) {
+        return;
+    }
+    capture.add(Hoymiles.getRadioIndex(this), direction, channel, rssi, data, len);
+}
+
 bool HoymilesRadio::isInitialized() const
 {
     return _isInitialized;
@@ -158,6 +405,7 @@ bool HoymilesRadio::isInitialized() const
 
 void HoymilesRadio::removeCommands(InverterAbstract* inv)
 {
+    TimedLock<std::mutex> lock(_queueMutex, _queueLockStats);
     _commandQueue.removeAllEntriesForInverter(inv);
 }
 
@@ -166,6 +414,111 @@ uint8_t HoymilesRadio::countSimilarCommands(std::shared_ptr<CommandAbstract> cmd
     return _commandQueue.countSimilarCommands(cmd);
 }
 
+bool HoymilesRadio::hasCommands(const uint64_t target, const uint32_t firstTraceId, const uint32_t lastTraceId) const
+{
+    return _commandQueue.hasCommands(target, firstTraceId, lastTraceId);
+}
+
+const QueueWaitStats_t& HoymilesRadio::getQueueWaitStats(const CommandPriority priority) const
+{
+    return _queueWaitStats[static_cast<uint8_t>(priority)];
+}
+
+void HoymilesRadio::resetQueueWaitStats()
+{
+    memset(_queueWaitStats, 0, sizeof(_queueWaitStats));
+}
+
+std::vector<CommandRadioStats_t> HoymilesRadio::getCommandRadioStats() const
+{
+    std::lock_guard<std::mutex> lock(_commandRadioStatsMutex);
+    return _commandRadioStats;
+}
+
+void HoymilesRadio::resetCommandRadioStats()
+{
+    std::lock_guard<std::mutex> lock(_commandRadioStatsMutex);
+    _commandRadioStats.clear();
+}
+
+// fragments is 0 if the command did not receive a complete response
+void HoymilesRadio::finishCommandRadioStats(const CommandAbstract& cmd, const uint8_t fragments)
+{
+    const char* name = cmd.getCommandName();
+
+    std::lock_guard<std::mutex> lock(_commandRadioStatsMutex);
+    auto it = std::find_if(_commandRadioStats.begin(), _commandRadioStats.end(),
+        [name](const CommandRadioStats_t& s) { return strcmp(s.CommandName, name) == 0; });
+    if (it == _commandRadioStats.end()) {
+        _commandRadioStats.emplace_back(name);
+        it = _commandRadioStats.end() - 1;
+    }
+
+    it->RoundTrip.observe(millis() - _commandStartTime);
+    it->Retransmits.observe(_commandRetransmits);
+    if (fragments > 0) {
+        it->Fragments.observe(fragments);
+    }
+}
+
+void HoymilesRadio::startTrace(const CommandAbstract& cmd)
+{
+    _trace = {};
+    _trace.Id = cmd.getTraceId();
+    _trace.Serial = cmd.getTargetAddress();
+    snprintf(_trace.CommandName, sizeof(_trace.CommandName), "%s", cmd.getCommandName());
+    _trace.Priority = cmd.getPriority();
+    _trace.Enqueued = cmd.getQueuedTime();
+    _trace.FirstTx = millis();
+    _trace.LastTx = _trace.FirstTx;
+}
+
+void HoymilesRadio::finishTrace(const CommandTraceResult_t result)
+{
+    _trace.Result = result;
+    Hoymiles.getCommandTraces().add(_trace);
+
+    // Commands which are never answered cannot fail
+    const bool success = result == CommandTraceResult_t::Success || !_commandQueue.front()->expectsResponse();
+    auto inv = Hoymiles.getInverterBySerial(_trace.Serial);
+    if (inv != nullptr) {
+        inv->getTransactionRunner().commandFinished(_trace.Id, success);
+    }
+}
+
+void HoymilesRadio::setTxPowerControl(const bool enabled)
+{
+    _txPowerControl = enabled;
+}
+
+bool HoymilesRadio::getTxPowerControl() const
+{
+    return _txPowerControl;
+}
+
+// Partial and corrupt answers count as answered but not clean, the link works
+// but the power may be too low
+void HoymilesRadio::observeTxPower(const CommandAbstract& cmd, InverterAbstract& inv, const bool answered)
+{
+    if (!_txPowerControl || !cmd.expectsResponse()) {
+        return;
+    }
+
+    const bool clean = answered && _trace.Result == CommandTraceResult_t::Success
+        && _trace.Resends == 0 && _trace.Retransmits == 0;
+    inv.getTxPowerControl().observe(answered, clean, inv.getLastRssi(), getMaxTxPowerReduction());
+}
+
+void HoymilesRadio::reserveCommandPool(const size_t inverterCount)
+{
+    _commandPool.reserve(inverterCount * HOY_COMMAND_POOL_BLOCKS_PER_INVERTER);
+}
+
+const CommandPool& HoymilesRadio::getCommandPool() const
+{
+    return _commandPool;
+}
+
 bool HoymilesRadio::isIdle() const
 {
     return !_busyFlag;
@@ -180,3 +533,107 @@ uint32_t HoymilesRadio::getQueueSize() const
 {
     return _commandQueue.size();
 }
+
+std::vector<QueuedCommandInfo_t> HoymilesRadio::getQueueSnapshot() const
+{
+    auto snapshot = _commandQueue.getSnapshot();
+    if (!snapshot.empty() && snapshot.front().Current && _busyFlag) {
+        snapshot.front().Timeout = _rxTimeout.remaining();
+    }
+    return snapshot;
+}
+
+void HoymilesRadio::printQueue(Print* output, const char* name) const
+{
+    const auto snapshot = getQueueSnapshot();
+    output->printf("Queue %s: %u commands\r\n", name, static_cast<unsigned>(snapshot.size()));
+    for (const auto& cmd : snapshot) {
+        output->printf("  %c %-20s %0" PRIx32 "%08" PRIx32 " sent %" PRIu8 " age %" PRIu32 " ms timeout %" PRIu32 " ms\r\n",
+            cmd.Current ? '*' : ' ', cmd.CommandName,
+            static_cast<uint32_t>((cmd.Target >> 32) & 0xFFFFFFFF),
+            static_cast<uint32_t>(cmd.Target & 0xFFFFFFFF),
+            cmd.SendCount, cmd.Age, cmd.Timeout);
+    }
+}
+
+bool HoymilesRadio::setStandby(const bool standby)
+{
+    if (!_isInitialized || standby == _standby) {
+        return true;
+    }
+
+    if (standby && (_busyFlag || !isQueueEmpty())) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_radioMutex);
+        if (standby) {
+            enterStandby();
+        } else {
+            leaveStandby();
+        }
+        _standby = standby;
+    }
+
+    // The rx task waits for a different event in standby
+    notifyRxTask();
+
+    HOY_LOGI("%s standby\r\n", standby ? "Entering" : "Leaving");
+    return true;
+}
+
+bool HoymilesRadio::isStandby() const
+{
+    return _standby;
+}
+
+void HoymilesRadio::startRxTask(const char* name)
+{
+    if (_rxTaskHandle != nullptr) {
+        return;
+    }
+
+    if (xTaskCreatePinnedToCore(rxTaskProc, name, HOY_RADIO_TASK_STACK_SIZE, this,
+            HOY_RADIO_TASK_PRIORITY, &_rxTaskHandle, HOY_RADIO_TASK_CORE)
+        != pdPASS) {
+        _rxTaskHandle = nullptr;
+        HOY_LOGE("%s: Could not create rx task\r\n", name);
+        return;
+    }
+
+    HOY_LOGI("%s: rx task started on core %d\r\n", name, HOY_RADIO_TASK_CORE);
+}
+
+void ARDUINO_ISR_ATTR HoymilesRadio::notifyRxTaskFromIsr()
+{
+    if (_rxTaskHandle == nullptr) {
+        return;
+    }
+
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(_rxTaskHandle, &higherPriorityTaskWoken);
+    if (higherPriorityTaskWoken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+void HoymilesRadio::notifyRxTask()
+{
+    if (_rxTaskHandle != nullptr) {
+        xTaskNotifyGive(_rxTaskHandle);
+    }
+}
+
+bool HoymilesRadio::hasRxTask() const
+{
+    return _rxTaskHandle != nullptr;
+}
+
+void HoymilesRadio::rxTaskProc(void* param)
+{
+    HoymilesRadio* radio = static_cast<HoymilesRadio*>(param);
+    for (;;) {
+        radio->rxTaskLoop();
+    }
+}
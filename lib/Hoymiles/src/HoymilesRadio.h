@@ -2,10 +2,20 @@
 #pragma once
 
 #include "Arduino.h"
+#include "CommandTrace.h"
+#include "FragmentAssembler.h"
+#include "Histogram.h"
+#include "LockStats.h"
+#include "RadioCapture.h"
 #include "commands/CommandAbstract.h"
+#include "queue/CommandPool.h"
 #include "queue/CommandQueue.h"
 #include "types.h"
 #include <TimeoutHelper.h>
+#include <atomic>
+#include <esp_pm.h>
+#include <mutex>
+#include <vector>
 
 #ifdef HOY_DEBUG_QUEUE
 #define DEBUG_PRINT(fmt, args...) Serial.printf(fmt, ##args)
@@ -13,6 +23,58 @@
 #define DEBUG_PRINT(fmt, args...) /* Don't do anything in release builds */
 #endif
 
+// Settings of the optional dedicated rx task (enabled by HOY_RADIO_TASK)
+#ifndef HOY_RADIO_TASK_CORE
+// Same core as the loop task, which feeds the radios
+#define HOY_RADIO_TASK_CORE ARDUINO_RUNNING_CORE
+#endif
+
+#ifndef HOY_RADIO_TASK_PRIORITY
+#define HOY_RADIO_TASK_PRIORITY 5
+#endif
+
+#ifndef HOY_RADIO_TASK_STACK_SIZE
+#define HOY_RADIO_TASK_STACK_SIZE 3072
+#endif
+
+// Maximum number of received fragments parsed per loop call
+#ifndef HOY_RX_BATCH_SIZE
+#define HOY_RX_BATCH_SIZE 8
+#endif
+
+// Number of interrupt times kept until the chip fifo is read
+#define HOY_RX_TIMESTAMP_COUNT 8
+
+struct QueueWaitStats_t {
+    // Number of dispatched commands
+    uint32_t Count;
+
+    // Sum of all wait times in ms
+    uint32_t Total;
+
+    // Longest wait time in ms
+    uint32_t Max;
+
+    // Wait time of the last dispatched command in ms
+    uint32_t Last;
+};
+
+// Timing and retry statistics of all commands with the same name
+struct CommandRadioStats_t {
+    explicit CommandRadioStats_t(const char* name);
+
+    const char* CommandName; // static, see CommandAbstract::getCommandName()
+
+    // Time from the first transmission until the command is finished in ms
+    Histogram<10> RoundTrip;
+
+    // Number of fragments of successfully received responses
+    Histogram<8> Fragments;
+
+    // Number of resends and fragment re-requests per command
+    Histogram<6> Retransmits;
+};
+
 class HoymilesRadio {
 public:
     serial_u DtuSerial() const;
@@ -20,70 +82,209 @@ public:
 
     bool isIdle() const;
     bool isQueueEmpty() const;
+
+    // Powers the radio chip down while no inverter is served. A queued command
+    // wakes it up again. Entering the standby is refused while a command is pending.
+    bool setStandby(const bool standby);
+    bool isStandby() const;
     uint32_t getQueueSize() const;
     bool isInitialized() const;
 
+    // Command in transmission (first) and all pending commands. The timeout of the
+    // current command is what is left of its rx period.
+    std::vector<QueuedCommandInfo_t> getQueueSnapshot() const;
+    void printQueue(Print* output, const char* name) const;
+
     void removeCommands(InverterAbstract* inv);
     uint8_t countSimilarCommands(std::shared_ptr<CommandAbstract> cmd);
+    bool hasCommands(const uint64_t target, const uint32_t firstTraceId, const uint32_t lastTraceId) const;
+
+    // Selects the transmit power per inverter from its answers, the configured PA level
+    // is the highest one used. Disabled, every request is sent with the configured level.
+    void setTxPowerControl(const bool enabled);
+    bool getTxPowerControl() const;
+
+    // Time between enqueuing and the first transmission of a command
+    const QueueWaitStats_t& getQueueWaitStats(const CommandPriority priority) const;
+    void resetQueueWaitStats();
+
+    // Round trip, fragment and retransmit histograms per command name, copied as the
+    // radio loop adds the entries of new commands
+    std::vector<CommandRadioStats_t> getCommandRadioStats() const;
+    void resetCommandRadioStats();
 
     void enqueCommand(std::shared_ptr<CommandAbstract> cmd)
     {
         DEBUG_PRINT("Queue size before: %ld\r\n", _commandQueue.size());
-        DEBUG_PRINT("Handling command %s with type %d\r\n", cmd.get()->getCommandName().c_str(), static_cast<uint8_t>(cmd.get()->getQueueInsertType()));
-        switch (cmd.get()->getQueueInsertType()) {
-        case QueueInsertType::RemoveOldest:
-            _commandQueue.removeDuplicatedEntries(cmd);
-            break;
-        case QueueInsertType::ReplaceExistent:
-            // Checks if the queue already contains a command like the new one
-            // and replaces the existing one with the new one.
-            // (The new one will not be pushed at the end of the queue)
-            if (_commandQueue.countSimilarCommands(cmd) > 0) {
-                DEBUG_PRINT("    ... existing entry will be replaced\r\n");
-                _commandQueue.replaceEntries(cmd);
-                return;
-            }
+        DEBUG_PRINT("Handling command %s with type %d\r\n", cmd.get()->getCommandName(), static_cast<uint8_t>(cmd.get()->getQueueInsertType()));
+
+        // RemoveOldest drops similar queued commands, ReplaceExistent replaces them in place
+        // and RemoveNewest drops the new one if a similar command is already queued
+        switch (_commandQueue.enqueue(cmd)) {
+        case EnqueueResult::Replaced:
+            DEBUG_PRINT("    ... existing entry will be replaced\r\n");
             break;
-        case QueueInsertType::RemoveNewest:
-            // Checks if the queue already contains a command like the new one
-            // and drops the new one. The new one will not be inserted.
-            if (_commandQueue.countSimilarCommands(cmd) > 0) {
-                DEBUG_PRINT("    ... new entry will be dropped\r\n");
-                return;
-            }
+        case EnqueueResult::Dropped:
+            DEBUG_PRINT("    ... new entry will be dropped\r\n");
             break;
-        case QueueInsertType::AllowMultiple:
-            // Dont do anything, just fall through and insert the command.
+        case EnqueueResult::Appended:
+            DEBUG_PRINT("    ... new entry will be appended\r\n");
             break;
         }
 
-        // Push the command into the queue if we reach this position of the code
-        DEBUG_PRINT("    ... new entry will be appended\r\n");
-        _commandQueue.push(cmd);
-
         DEBUG_PRINT("Queue size after: %ld\r\n", _commandQueue.size());
     }
 
     template <typename T>
     std::shared_ptr<T> prepareCommand(InverterAbstract* inv)
     {
-        return std::make_shared<T>(inv);
+        // 16 bytes are required for the shared_ptr control block
+        static_assert(sizeof(T) + 16 <= HOY_COMMAND_POOL_BLOCK_SIZE, "Command does not fit into a command pool block");
+        return std::allocate_shared<T>(CommandPoolAllocator<T>(&_commandPool), inv);
     }
 
+    // Makes sure the command pool can hold the commands of the given amount of inverters
+    void reserveCommandPool(const size_t inverterCount);
+    const CommandPool& getCommandPool() const;
+
+    // Highest number of received fragments waiting to be parsed at once
+    uint32_t getRxBufferPeak() const;
+    // Number of times the received fragments were dropped because the rx buffer was full
+    uint32_t getRxBufferOverflows() const;
+
+    // Time from the interrupt of a fragment until it is parsed by the loop in us
+    const Histogram<8>& getRxLatency() const;
+    // Time between two interrupts of fragments of the same response in us
+    const Histogram<8>& getRxFragmentGap() const;
+    // Time to parse one received fragment (crc, inverter lookup, storing) in us
+    const Histogram<8>& getRxHandlingTime() const;
+    uint32_t getRxHandlingTimeMax() const;
+
+    // Wait and hold times of the queue lock, held by the loop while it works on the queue front
+    const LockStats_t& getQueueLockStats() const;
+
 protected:
     static serial_u convertSerialToRadioId(const serial_u serial);
     static void dumpBuf(const uint8_t buf[], const uint8_t len, const bool appendNewline = true);
 
+    // Adds the fragment to the capture ring if capturing is enabled
+    void captureFragment(const CaptureDirection_t direction, const uint8_t channel, const int8_t rssi, const uint8_t data[], const uint8_t len);
+
     bool checkFragmentCrc(const fragment_t& fragment) const;
+
+    // Called by the producer of the rx buffer after each push or dropped fragment
+    void countRxBufferLevel(const size_t level);
+    void countRxBufferOverflow();
+    void countRxHandlingTime(const uint32_t duration);
+
+    // Keeps the time of a packet interrupt, called from the interrupt handler
+    void ARDUINO_ISR_ATTR captureRxTimestamp();
+    // Interrupt time of the next packet read from the chip. Packets without interrupt
+    // (polled or several in the fifo) get the current time.
+    uint32_t takeRxTimestamp();
+    // Drops the times which are left after the chip fifo was read completely
+    void discardRxTimestamps();
+
     virtual void sendEsbPacket(CommandAbstract& cmd) = 0;
     void sendRetransmitPacket(const uint8_t fragment_id);
     void sendLastPacketAgain();
     void handleReceivedPackage();
+    // Keeps the cpu at its full frequency (dynamic frequency scaling) while commands are
+    // queued or a response is awaited, so the rx windows and SPI transfers are not slowed down
+    void updatePowerLock();
+    void storeRxFragment(InverterAbstract& inv, const fragment_t& fragment);
+
+    // Starts the rx period after the command was transmitted. The window is learned from the
+    // previous response times of the inverter and bounded by the timeout of the command.
+    void startRxPeriod(const CommandAbstract& cmd);
+    // Restarts the window of startRxPeriod, if the radio starts listening after
+    // a non-blocking transmission
+    void restartRxPeriod();
+
+    void startRxTask(const char* name);
+    void ARDUINO_ISR_ATTR notifyRxTaskFromIsr();
+    bool hasRxTask() const;
+
+    // Called repeatedly from the rx task. Has to block until the next event (interrupt or timeout)
+    virtual void rxTaskLoop() { }
+    void notifyRxTask();
+
+    // Switch the chip between power down and listening, called while holding _radioMutex
+    virtual void enterStandby() = 0;
+    virtual void leaveStandby() = 0;
 
     serial_u _dtuSerial;
+    CommandPool _commandPool;
     CommandQueue _commandQueue;
     bool _isInitialized = false;
-    bool _busyFlag = false;
+    std::atomic<bool> _busyFlag { false }; // read by the rx task to select the poll rate
+    std::atomic<bool> _standby { false };
+
+    esp_pm_lock_handle_t _powerLock = nullptr;
+    bool _powerLockCreated = false;
+    bool _powerLockHeld = false;
 
     TimeoutHelper _rxTimeout;
+
+    // Response to the command at the head of the queue
+    FragmentAssembler _rxFragments;
+
+    // Set once the response to the current command is complete, ends the rx period early
+    bool _rxComplete = false;
+
+    // Command name and start of the current rx period (us) to learn the response time
+    const char* _rxCommandName = "";
+    uint32_t _rxStartTime = 0;
+    bool _rxWindowAdapted = false;
+
+    // Interrupt time of the last fragment of the current response (us)
+    uint32_t _rxLastFragmentTime = 0;
+    bool _rxFragmentSeen = false;
+
+    QueueWaitStats_t _queueWaitStats[COMMAND_PRIORITY_COUNT] = {};
+
+    std::vector<CommandRadioStats_t> _commandRadioStats;
+    mutable std::mutex _commandRadioStatsMutex;
+    uint32_t _commandStartTime = 0;
+    uint8_t _commandRetransmits = 0;
+
+    // Number of steps the radio can go below its configured PA level
+    virtual uint8_t getMaxTxPowerReduction() const = 0;
+
+    std::atomic<bool> _txPowerControl { false };
+
+    // Trace of the command at the head of the queue, added to the ring when it is finished
+    CommandTrace_t _trace = {};
+
+    std::atomic<uint32_t> _rxBufferPeak { 0 };
+    std::atomic<uint32_t> _rxBufferOverflows { 0 };
+
+    Histogram<8> _rxLatency { { 100, 250, 500, 1000, 2500, 5000, 10000, 25000 } };
+    Histogram<8> _rxFragmentGap { { 500, 1000, 2000, 3000, 5000, 10000, 20000, 50000 } };
+    Histogram<8> _rxHandlingTime { { 20, 50, 100, 200, 500, 1000, 2000, 5000 } };
+    uint32_t _rxHandlingTimeMax = 0;
+
+    // Guards all SPI access to the radio chip against the rx task
+    mutable std::mutex _radioMutex;
+
+    // Held by the loop from parsing the received fragments until the command at the
+    // queue front is finished, so removeCommands() does not free it in between.
+    // Enqueuing commands only takes the lock of the queue itself.
+    std::mutex _queueMutex;
+    LockStats_t _queueLockStats;
+
+private:
+    static void rxTaskProc(void* param);
+
+    void finishCommandRadioStats(const CommandAbstract& cmd, const uint8_t fragments);
+    void startTrace(const CommandAbstract& cmd);
+    void observeTxPower(const CommandAbstract& cmd, InverterAbstract& inv, const bool answered);
+    void finishTrace(const CommandTraceResult_t result);
+
+    TaskHandle_t _rxTaskHandle = nullptr;
+
+    // Single producer (interrupt) single consumer (reader of the chip fifo) ring
+    uint32_t _rxTimestamps[HOY_RX_TIMESTAMP_COUNT] = {};
+    std::atomic<uint8_t> _rxTimestampHead { 0 };
+    std::atomic<uint8_t> _rxTimestampTail { 0 };
 };
@@ -6,6 +6,8 @@
 #include "Hoymiles.h"
 #include "crc.h"
 #include <FunctionalInterrupt.h>
+#include <algorithm>
+#include <esp_timer.h>
 #include <frozen/map.h>
 
 constexpr CountryFrequencyDefinition_t make_value(FrequencyBand_t Band, uint32_t Freq_Legal_Min, uint32_t Freq_Legal_Max, uint32_t Freq_Default, uint32_t Freq_StartUp)
@@ -34,16 +36,16 @@ uint32_t HoymilesRadio_CMT::getFrequencyFromChannel(const uint8_t channel) const
 uint8_t HoymilesRadio_CMT::getChannelFromFrequency(const uint32_t frequency) const
 {
     if ((frequency % getChannelWidth()) != 0) {
-        Hoymiles.getMessageOutput()->printf("%.3f MHz is not divisible by %" PRId32 " kHz!\r\n", frequency / 1000000.0, getChannelWidth());
+        HOY_LOGW("%.3f MHz is not divisible by %" PRId32 " kHz!\r\n", frequency / 1000000.0, getChannelWidth());
         return 0xFF; // ERROR
     }
     if (frequency < getMinFrequency() || frequency > getMaxFrequency()) {
-        Hoymiles.getMessageOutput()->printf("%.2f MHz is out of Hoymiles/CMT range! (%.2f MHz - %.2f MHz)\r\n",
+        HOY_LOGW("%.2f MHz is out of Hoymiles/CMT range! (%.2f MHz - %.2f MHz)\r\n",
             frequency / 1000000.0, getMinFrequency() / 1000000.0, getMaxFrequency() / 1000000.0);
         return 0xFF; // ERROR
     }
     if (frequency < countryDefinition.at(_countryMode).Freq_Legal_Min || frequency > countryDefinition.at(_countryMode).Freq_Legal_Max) {
-        Hoymiles.getMessageOutput()->printf("!!! caution: %.2f MHz is out of region legal range! (%" PRId32 " - %" PRId32 " MHz)\r\n",
+        HOY_LOGW("!!! caution: %.2f MHz is out of region legal range! (%" PRId32 " - %" PRId32 " MHz)\r\n",
             frequency / 1000000.0,
             static_cast<uint32_t>(countryDefinition.at(_countryMode).Freq_Legal_Min / 1e6),
             static_cast<uint32_t>(countryDefinition.at(_countryMode).Freq_Legal_Max / 1e6));
@@ -89,28 +91,45 @@ void HoymilesRadio_CMT::init(const int8_t pin_sdio, const int8_t pin_clk, const
 
     _radio.reset(new CMT2300A(pin_sdio, pin_clk, pin_cs, pin_fcs));
 
+    // Without GPIO3 the packet interrupt is moved to GPIO2, the tx done interrupt
+    // is not required as the transmission is finished by polling the chip
+    _radio->setPacketInterruptOnGpio2(pin_gpio3 < 0 && pin_gpio2 >= 0);
     _radio->begin();
 
     setCountryMode(CountryModeId_t::MODE_EU);
     cmtSwitchDtuFreq(_inverterTargetFrequency); // start dtu at work freqency, for fast Rx if inverter is already on and frequency switched
 
     if (!_radio->isChipConnected()) {
-        Hoymiles.getMessageOutput()->println("CMT: Connection error!!");
+        HOY_LOGE("CMT: Connection error!!\r\n");
         return;
     }
-    Hoymiles.getMessageOutput()->println("CMT: Connection successful");
+    HOY_LOGI("CMT: Connection successful\r\n");
+
+    if (pin_gpio3 >= 0) {
+        attachInterrupt(digitalPinToInterrupt(pin_gpio3), std::bind(&HoymilesRadio_CMT::handleInt2, this), RISING);
+        _gpio3_configured = true;
+        _rxInterruptPin = 3;
+    }
 
     if (pin_gpio2 >= 0) {
-        attachInterrupt(digitalPinToInterrupt(pin_gpio2), std::bind(&HoymilesRadio_CMT::handleInt1, this), RISING);
+        if (_gpio3_configured) {
+            attachInterrupt(digitalPinToInterrupt(pin_gpio2), std::bind(&HoymilesRadio_CMT::handleInt1, this), RISING);
+        } else {
+            attachInterrupt(digitalPinToInterrupt(pin_gpio2), std::bind(&HoymilesRadio_CMT::handleInt2, this), RISING);
+            _rxInterruptPin = 2;
+        }
         _gpio2_configured = true;
     }
 
-    if (pin_gpio3 >= 0) {
-        attachInterrupt(digitalPinToInterrupt(pin_gpio3), std::bind(&HoymilesRadio_CMT::handleInt2, this), RISING);
-        _gpio3_configured = true;
+    if (_rxInterruptPin == 0) {
+        HOY_LOGW("CMT: No interrupt pin, the packet flag is polled\r\n");
     }
 
     _isInitialized = true;
+
+#ifdef HOY_RADIO_TASK
+    startRxTask("HOY_CMT_RX");
+#endif
 }
 
 void HoymilesRadio_CMT::loop()
@@ -119,70 +138,168 @@ void HoymilesRadio_CMT::loop()
         return;
     }
 
-    if (!_gpio3_configured) {
-        if (_radio->rxFifoAvailable()) { // read INT2, PKT_OK flag
-            _packetReceived = true;
+    if (_standby) {
+        if (isQueueEmpty()) {
+            return;
         }
+        setStandby(false);
     }
 
-    if (_packetReceived) {
-        Hoymiles.getMessageOutput()->println("Interrupt received");
-        while (_radio->available()) {
-            if (_rxBuffer.size() > FRAGMENT_BUFFER_SIZE) {
-                Hoymiles.getMessageOutput()->println("CMT: Buffer full");
-                _radio->flush_rx();
-                continue;
-            }
-
-            fragment_t f;
-            memset(f.fragment, 0xcc, MAX_RF_PAYLOAD_SIZE);
-            f.len = std::min<uint8_t>(_radio->getDynamicPayloadSize(), MAX_RF_PAYLOAD_SIZE);
-            f.channel = _radio->getChannel();
-            f.rssi = _radio->getRssiDBm();
-            f.wasReceived = false;
-            f.mainCmd = 0x00;
-            _radio->read(f.fragment, f.len);
-            _rxBuffer.push(f);
+    if (!hasRxTask()) {
+        std::lock_guard<std::mutex> lock(_radioMutex);
+
+        if (_rxInterruptPin == 0) {
+            pollRxFifo();
+        }
+
+        if (_packetReceived) {
+            readRxFifo();
+        }
+    }
+
+    TimedLock<std::mutex> queueLock(_queueMutex, _queueLockStats);
+
+    // Parse everything received so far, bounded to keep the loop responsive.
+    // Without rx task a new packet ends the batch so that the chip is read first.
+    const serial_u dtuId = convertSerialToRadioId(_dtuSerial);
+    for (uint8_t i = 0; i < HOY_RX_BATCH_SIZE && !_rxBuffer.empty(); i++) {
+        if (!hasRxTask() && _packetReceived) {
+            break;
+        }
+
+        const uint32_t start = esp_timer_get_time();
+        processRxFragment(_rxBuffer.front(), dtuId);
+        countRxHandlingTime(esp_timer_get_time() - start);
+
+        // Remove paket from buffer even it was corrupted
+        _rxBuffer.pop();
+    }
+
+    handleReceivedPackage();
+}
+
+void HOY_RX_ATTR HoymilesRadio_CMT::processRxFragment(const fragment_t& f, const serial_u& dtuId)
+{
+    if (!checkFragmentCrc(f)) {
+        HOY_LOGW("Frame kaputt\r\n"); // ;-)
+        return;
+    }
+
+    // The CMT RF module does not filter foreign packages by itself.
+    // Has to be done manually here.
+    if (memcmp(&f.fragment[5], &dtuId.b[1], 4) != 0) {
+        return;
+    }
+
+    std::shared_ptr<InverterAbstract> inv = Hoymiles.getInverterByFragment(f);
+
+    if (nullptr != inv) {
+        if (HOY_LOG_ENABLED(HOY_LOG_LEVEL_DEBUG)) {
+            Hoymiles.getMessageOutput(HOY_LOG_LEVEL_DEBUG)->printf("RX %.2f MHz --> ", getFrequencyFromChannel(f.channel) / 1000000.0);
+            dumpBuf(f.fragment, f.len, false);
+            Hoymiles.getMessageOutput(HOY_LOG_LEVEL_DEBUG)->printf("| %" PRId8 " dBm\r\n", f.rssi);
         }
-        _radio->flush_rx();
-        _packetReceived = false;
 
+        // Save packet in inverter rx buffer
+
+        storeRxFragment(*inv, f);
+        inv->getCmtChannelTracker().markReceived(getFrequencyFromChannel(f.channel), millis());
     } else {
-        // Perform package parsing only if no packages are received
-        if (!_rxBuffer.empty()) {
-            fragment_t f = _rxBuffer.back();
-            if (checkFragmentCrc(f)) {
+        HOY_LOGW("Inverter Not found!\r\n");
+    }
+}
+
+void HoymilesRadio_CMT::rxTaskLoop()
+{
+    // Without interrupt the PKT_OK flag has to be polled, fast only while a response is expected
+    TickType_t timeout = portMAX_DELAY;
+    if (_rxInterruptPin == 0 && !_standby) {
+        timeout = pdMS_TO_TICKS(_busyFlag ? 1 : HOY_CMT_IDLE_POLL_INTERVAL);
+    }
+    ulTaskNotifyTake(pdTRUE, timeout);
 
-                const serial_u dtuId = convertSerialToRadioId(_dtuSerial);
+    std::lock_guard<std::mutex> lock(_radioMutex);
 
-                // The CMT RF module does not filter foreign packages by itself.
-                // Has to be done manually here.
-                if (memcmp(&f.fragment[5], &dtuId.b[1], 4) == 0) {
+    if (_standby) {
+        return;
+    }
 
-                    std::shared_ptr<InverterAbstract> inv = Hoymiles.getInverterByFragment(f);
+    if (_rxInterruptPin == 0) {
+        pollRxFifo();
+    }
 
-                    if (nullptr != inv) {
-                        // Save packet in inverter rx buffer
-                        Hoymiles.getMessageOutput()->printf("RX %.2f MHz --> ", getFrequencyFromChannel(f.channel) / 1000000.0);
-                        dumpBuf(f.fragment, f.len, false);
-                        Hoymiles.getMessageOutput()->printf("| %" PRId8 " dBm\r\n", f.rssi);
+    if (_packetReceived) {
+        readRxFifo();
+    }
+}
 
-                        inv->addRxFragment(f.fragment, f.len, f.rssi);
-                    } else {
-                        Hoymiles.getMessageOutput()->println("Inverter Not found!");
-                    }
-                }
+void HoymilesRadio_CMT::enterStandby()
+{
+    // The sleep state keeps the configuration registers
+    _radio->stopListening();
+}
 
-            } else {
-                Hoymiles.getMessageOutput()->println("Frame kaputt"); // ;-)
-            }
+void HoymilesRadio_CMT::leaveStandby()
+{
+    _radio->startListening();
+}
 
-            // Remove paket from buffer even it was corrupted
-            _rxBuffer.pop();
+void HoymilesRadio_CMT::readRxFifo()
+{
+    // Reset the flag first so that an interrupt during reading is not lost
+    _packetReceived = false;
+
+    HOY_LOGV("Interrupt received\r\n");
+    while (_radio->available()) {
+        if (_rxBuffer.full()) {
+            HOY_LOGW("CMT: Buffer full\r\n");
+            _radio->flush_rx();
+            countRxBufferOverflow();
+            continue;
         }
+
+        fragment_t f;
+        memset(f.fragment, 0xcc, MAX_RF_PAYLOAD_SIZE);
+        f.len = std::min<uint8_t>(_radio->getDynamicPayloadSize(), MAX_RF_PAYLOAD_SIZE);
+        f.channel = _radio->getChannel();
+        f.rssi = _radio->getRssiDBm();
+        f.wasReceived = false;
+        f.mainCmd = 0x00;
+        f.rxTime = takeRxTimestamp();
+        _radio->read(f.fragment, f.len);
+        captureFragment(CaptureDirection_t::Rx, f.channel, f.rssi, f.fragment, f.len);
+        _rxBuffer.push(f);
+        countRxBufferLevel(_rxBuffer.size());
+    }
+    _radio->flush_rx();
+    discardRxTimestamps();
+}
+
+// Reads the PKT_OK flag (INT2) over SPI, every millisecond inside an rx window
+// and every HOY_CMT_IDLE_POLL_INTERVAL outside. Has to be called with the radio mutex held.
+bool HoymilesRadio_CMT::pollRxFifo()
+{
+    const uint32_t now = millis();
+    if (!_busyFlag && now - _lastRxFifoPoll < HOY_CMT_IDLE_POLL_INTERVAL) {
+        return false;
     }
+    _lastRxFifoPoll = now;
+    _rxFifoPolls++;
 
-    handleReceivedPackage();
+    if (_radio->rxFifoAvailable()) {
+        _packetReceived = true;
+    }
+    return _packetReceived;
+}
+
+uint8_t HoymilesRadio_CMT::getRxInterruptPin() const
+{
+    return _rxInterruptPin;
+}
+
+uint32_t HoymilesRadio_CMT::getRxFifoPolls() const
+{
+    return _rxFifoPolls;
 }
 
 void HoymilesRadio_CMT::setPALevel(const int8_t paLevel)
@@ -191,10 +308,31 @@ void HoymilesRadio_CMT::setPALevel(const int8_t paLevel)
         return;
     }
 
+    std::lock_guard<std::mutex> lock(_radioMutex);
     if (_radio->setPALevel(paLevel)) {
-        Hoymiles.getMessageOutput()->printf("CMT TX power set to %" PRId8 " dBm\r\n", paLevel);
+        _paLevel = paLevel;
+        _appliedPaLevel = paLevel;
+        HOY_LOGI("CMT TX power set to %" PRId8 " dBm\r\n", paLevel);
     } else {
-        Hoymiles.getMessageOutput()->printf("CMT TX power %" PRId8 " dBm is not defined! (min: -10 dBm, max: 20 dBm)\r\n", paLevel);
+        HOY_LOGE("CMT TX power %" PRId8 " dBm is not defined! (min: -10 dBm, max: 20 dBm)\r\n", paLevel);
+    }
+}
+
+uint8_t HoymilesRadio_CMT::getMaxTxPowerReduction() const
+{
+    return (_paLevel - HOY_CMT_TX_POWER_MIN + HOY_CMT_TX_POWER_STEP - 1) / HOY_CMT_TX_POWER_STEP;
+}
+
+// Has to be called with the radio mutex held
+void HoymilesRadio_CMT::applyTxPower(InverterAbstract* inv)
+{
+    int8_t level = _paLevel;
+    if (_txPowerControl && inv != nullptr) {
+        level = std::max<int>(_paLevel - inv->getTxPowerControl().getReduction() * HOY_CMT_TX_POWER_STEP, HOY_CMT_TX_POWER_MIN);
+    }
+
+    if (level != _appliedPaLevel && _radio->setPALevel(level)) {
+        _appliedPaLevel = level;
     }
 }
 
@@ -204,6 +342,7 @@ void HoymilesRadio_CMT::setInverterTargetFrequency(const uint32_t frequency)
     if (!_isInitialized) {
         return;
     }
+    std::lock_guard<std::mutex> lock(_radioMutex);
     cmtSwitchDtuFreq(_inverterTargetFrequency);
 }
 
@@ -217,6 +356,7 @@ bool HoymilesRadio_CMT::isConnected() const
     if (!_isInitialized) {
         return false;
     }
+    std::lock_guard<std::mutex> lock(_radioMutex);
     return _radio->isChipConnected();
 }
 
@@ -241,6 +381,7 @@ void HoymilesRadio_CMT::setCountryMode(const CountryModeId_t mode)
     if (!_isInitialized) {
         return;
     }
+    std::lock_guard<std::mutex> lock(_radioMutex);
     _radio->setFrequencyBand(countryDefinition.at(mode).Band);
 }
 
@@ -257,7 +398,9 @@ void ARDUINO_ISR_ATTR HoymilesRadio_CMT::handleInt1()
 
 void ARDUINO_ISR_ATTR HoymilesRadio_CMT::handleInt2()
 {
+    captureRxTimestamp();
     _packetReceived = true;
+    notifyRxTaskFromIsr();
 }
 
 void HoymilesRadio_CMT::sendEsbPacket(CommandAbstract& cmd)
@@ -266,21 +409,31 @@ void HoymilesRadio_CMT::sendEsbPacket(CommandAbstract& cmd)
 
     cmd.setRouterAddress(DtuSerial().u64);
 
+    std::lock_guard<std::mutex> lock(_radioMutex);
+
     _radio->stopListening();
+    applyTxPower(Hoymiles.getInverterBySerial(cmd.getTargetAddress()).get());
 
     if (cmd.getDataPayload()[0] == 0x56) { // @todo(tbnobody) Bad hack to identify ChannelChange Command
         cmtSwitchDtuFreq(getInvBootFrequency());
     }
 
-    Hoymiles.getMessageOutput()->printf("TX %s %.2f MHz --> ",
-        cmd.getCommandName().c_str(), getFrequencyFromChannel(_radio->getChannel()) / 1000000.0);
-    cmd.dumpDataPayload(Hoymiles.getMessageOutput());
+    if (HOY_LOG_ENABLED(HOY_LOG_LEVEL_DEBUG)) {
+        Hoymiles.getMessageOutput(HOY_LOG_LEVEL_DEBUG)->printf("TX %s %.2f MHz --> ",
+            cmd.getCommandName(), getFrequencyFromChannel(_radio->getChannel()) / 1000000.0);
+        cmd.dumpDataPayload(Hoymiles.getMessageOutput(HOY_LOG_LEVEL_DEBUG));
+    }
 
     if (!_radio->write(cmd.getDataPayload(), cmd.getDataSize())) {
-        Hoymiles.getMessageOutput()->println("TX SPI Timeout");
+        HOY_LOGE("TX SPI Timeout\r\n");
     }
+    captureFragment(CaptureDirection_t::Tx, _radio->getChannel(), 0, cmd.getDataPayload(), cmd.getDataSize());
     cmtSwitchDtuFreq(_inverterTargetFrequency);
     _radio->startListening();
-    _busyFlag = true;
-    _rxTimeout.set(cmd.getTimeout());
+    startRxPeriod(cmd);
+
+    // The rx task may sleep for the idle poll interval, it has to poll fast from now on
+    if (_rxInterruptPin == 0) {
+        notifyRxTask();
+    }
 }
@@ -5,9 +5,9 @@
 #include "commands/CommandAbstract.h"
 #include "types.h"
 #include <Arduino.h>
+#include <SpscRingBuffer.h>
 #include <cmt2300wrapper.h>
 #include <memory>
-#include <queue>
 #include <vector>
 
 // number of fragments hold in buffer
@@ -17,6 +17,18 @@
 #define HOYMILES_CMT_WORK_FREQ 865000000
 #endif
 
+// Interval (ms) of the SPI poll of the packet flag without rx interrupt while
+// no rx window is open. Inside a window the chip is polled every millisecond.
+#ifndef HOY_CMT_IDLE_POLL_INTERVAL
+#define HOY_CMT_IDLE_POLL_INTERVAL 20
+#endif
+
+// Lowest level (dBm) and dBm per step of the transmit power control
+#define HOY_CMT_TX_POWER_MIN -10
+#ifndef HOY_CMT_TX_POWER_STEP
+#define HOY_CMT_TX_POWER_STEP 3
+#endif
+
 enum CountryModeId_t {
     MODE_EU,
     MODE_US,
@@ -49,6 +61,11 @@ public:
 
     bool isConnected() const;
 
+    // Interrupt of received packets: 3 = GPIO3, 2 = GPIO2, 0 = the chip is polled
+    uint8_t getRxInterruptPin() const;
+    // Number of SPI reads of the packet flag, only used without rx interrupt
+    uint32_t getRxFifoPolls() const;
+
     uint32_t getMinFrequency() const;
     uint32_t getMaxFrequency() const;
     static constexpr uint32_t getChannelWidth()
@@ -69,6 +86,14 @@ public:
 private:
     void ARDUINO_ISR_ATTR handleInt1();
     void ARDUINO_ISR_ATTR handleInt2();
+    void rxTaskLoop() override;
+    void enterStandby() override;
+    void leaveStandby() override;
+    void readRxFifo();
+    bool pollRxFifo();
+    void processRxFragment(const fragment_t& f, const serial_u& dtuId);
+    void applyTxPower(InverterAbstract* inv);
+    uint8_t getMaxTxPowerReduction() const override;
 
     void sendEsbPacket(CommandAbstract& cmd);
 
@@ -79,12 +104,20 @@ private:
 
     bool _gpio2_configured = false;
     bool _gpio3_configured = false;
+    uint8_t _rxInterruptPin = 0;
+
+    std::atomic<uint32_t> _rxFifoPolls { 0 };
+    uint32_t _lastRxFifoPoll = 0;
 
-    std::queue<fragment_t> _rxBuffer;
+    SpscRingBuffer<fragment_t, FRAGMENT_BUFFER_SIZE> _rxBuffer;
     TimeoutHelper _txTimeout;
 
     uint32_t _inverterTargetFrequency = HOYMILES_CMT_WORK_FREQ;
 
+    // Configured PA level (dBm), the highest level used by the transmit power control
+    int8_t _paLevel = 0;
+    int8_t _appliedPaLevel = 0;
+
     bool cmtSwitchDtuFreq(const uint32_t to_frequency);
 
     CountryModeId_t _countryMode;
@@ -5,15 +5,18 @@
 #include "HoymilesRadio_NRF.h"
 #include "Hoymiles.h"
 #include "commands/RequestFrameCommand.h"
-#include <Every.h>
 #include <FunctionalInterrupt.h>
+#include <algorithm>
+#include <esp_timer.h>
 
-void HoymilesRadio_NRF::init(SPIClass* initialisedSpiBus, const uint8_t pinCE, const uint8_t pinIRQ)
+static_assert(HOY_NRF_RX_HOP_SLOTS >= NRF_CHANNEL_COUNT, "Every channel needs at least one rx slot");
+
+void HoymilesRadio_NRF::init(std::shared_ptr<SPIClass> initialisedSpiBus, const uint8_t pinCS, const uint8_t pinCE, const uint8_t pinIRQ)
 {
     _dtuSerial.u64 = 0;
 
-    _spiPtr.reset(initialisedSpiBus);
-    _radio.reset(new RF24(pinCE, initialisedSpiBus->pinSS()));
+    _spiPtr = initialisedSpiBus;
+    _radio.reset(new RF24(pinCE, pinCS));
 
     _radio->begin(_spiPtr.get());
 
@@ -21,19 +24,27 @@ void HoymilesRadio_NRF::init(SPIClass* initialisedSpiBus, const uint8_t pinCE, c
     _radio->enableDynamicPayloads();
     _radio->setCRCLength(RF24_CRC_16);
     _radio->setAddressWidth(5);
-    _radio->setRetries(0, 0);
-    _radio->maskIRQ(true, true, false); // enable only receiving interrupts
+    // Only used while transmitting, so it can stay set during rx
+    _radio->setRetries(3, 15);
+    _radio->maskIRQ(false, false, false); // tx done, tx failed and received packets
     if (!_radio->isChipConnected()) {
-        Hoymiles.getMessageOutput()->println("NRF: Connection error!!");
+        HOY_LOGE("NRF: Connection error!!\r\n");
         return;
     }
-    Hoymiles.getMessageOutput()->println("NRF: Connection successful");
+    HOY_LOGI("NRF: Connection successful\r\n");
 
     attachInterrupt(digitalPinToInterrupt(pinIRQ), std::bind(&HoymilesRadio_NRF::handleIntr, this), FALLING);
 
+    buildRxHopList(nullptr);
+    _radioChannel = _radio->getChannel();
+    _writingPipe = 0;
     openReadingPipe();
     _radio->startListening();
     _isInitialized = true;
+
+#ifdef HOY_RADIO_TASK
+    startRxTask("HOY_NRF_RX");
+#endif
 }
 
 void HoymilesRadio_NRF::loop()
@@ -42,58 +53,162 @@ void HoymilesRadio_NRF::loop()
         return;
     }
 
-    EVERY_N_MILLIS(4)
-    {
-        switchRxCh();
+    if (_standby) {
+        if (isQueueEmpty()) {
+            return;
+        }
+        setStandby(false);
     }
 
-    if (_packetReceived) {
-        Hoymiles.getMessageOutput()->println("Interrupt received");
-        while (_radio->available()) {
-            if (_rxBuffer.size() > FRAGMENT_BUFFER_SIZE) {
-                Hoymiles.getMessageOutput()->println("NRF: Buffer full");
-                _radio->flush_rx();
-                continue;
-            }
+    if (!hasRxTask()) {
+        std::lock_guard<std::mutex> lock(_radioMutex);
+        handleIrq();
+    }
+
+    TimedLock<std::mutex> queueLock(_queueMutex, _queueLockStats);
 
-            fragment_t f;
-            memset(f.fragment, 0xcc, MAX_RF_PAYLOAD_SIZE);
-            f.len = std::min<uint8_t>(_radio->getDynamicPayloadSize(), MAX_RF_PAYLOAD_SIZE);
-            f.channel = _radio->getChannel();
-            f.rssi = _radio->testRPD() ? -30 : -80;
-            _radio->read(f.fragment, f.len);
-            _rxBuffer.push(f);
+    // Parse everything received so far, bounded to keep the loop responsive. Without
+    // rx task a new interrupt ends the batch, the chip fifo only holds three packets.
+    for (uint8_t i = 0; i < HOY_RX_BATCH_SIZE && !_rxBuffer.empty(); i++) {
+        if (!hasRxTask() && _packetReceived) {
+            break;
         }
-        _packetReceived = false;
 
-    } else {
-        // Perform package parsing only if no packages are received
-        if (!_rxBuffer.empty()) {
-            fragment_t f = _rxBuffer.back();
-            if (checkFragmentCrc(f)) {
-                std::shared_ptr<InverterAbstract> inv = Hoymiles.getInverterByFragment(f);
-
-                if (nullptr != inv) {
-                    // Save packet in inverter rx buffer
-                    Hoymiles.getMessageOutput()->printf("RX Channel: %" PRId8 " --> ", f.channel);
-                    dumpBuf(f.fragment, f.len, false);
-                    Hoymiles.getMessageOutput()->printf("| %" PRId8 " dBm\r\n", f.rssi);
-
-                    inv->addRxFragment(f.fragment, f.len, f.rssi);
-                } else {
-                    Hoymiles.getMessageOutput()->println("Inverter Not found!");
-                }
-
-            } else {
-                Hoymiles.getMessageOutput()->println("Frame kaputt");
-            }
+        const uint32_t start = esp_timer_get_time();
+        processRxFragment(_rxBuffer.front());
+        countRxHandlingTime(esp_timer_get_time() - start);
+
+        // Remove paket from buffer even it was corrupted
+        _rxBuffer.pop();
+    }
+
+    // The rx window starts once the transmission is finished
+    if (!_txPending) {
+        handleReceivedPackage();
+    }
+}
+
+void HOY_RX_ATTR HoymilesRadio_NRF::processRxFragment(const fragment_t& f)
+{
+    if (!checkFragmentCrc(f)) {
+        HOY_LOGW("Frame kaputt\r\n");
+        return;
+    }
+
+    std::shared_ptr<InverterAbstract> inv = Hoymiles.getInverterByFragment(f);
+
+    // All nrf modules listen on the dtu address, so they also receive
+    // the responses to the requests of the other modules. Those are dropped.
+    if (nullptr != inv && inv->getRadio() == this) {
+        if (HOY_LOG_ENABLED(HOY_LOG_LEVEL_DEBUG)) {
+            Hoymiles.getMessageOutput(HOY_LOG_LEVEL_DEBUG)->printf("RX Channel: %" PRId8 " --> ", f.channel);
+            dumpBuf(f.fragment, f.len, false);
+            Hoymiles.getMessageOutput(HOY_LOG_LEVEL_DEBUG)->printf("| %" PRId8 " dBm\r\n", f.rssi);
+        }
+
+        // Save packet in inverter rx buffer
+
+        storeRxFragment(*inv, f);
+        countRxFragment(*inv, f);
+    } else if (nullptr == inv) {
+        HOY_LOGW("Inverter Not found!\r\n");
+    }
+}
+
+void HoymilesRadio_NRF::rxTaskLoop()
+{
+    // Wake up on the IRQ or at the latest when the next rx channel is due
+    ulTaskNotifyTake(pdTRUE, _standby ? portMAX_DELAY : pdMS_TO_TICKS(4));
+
+    std::lock_guard<std::mutex> lock(_radioMutex);
+
+    if (_standby) {
+        return;
+    }
 
-            // Remove paket from buffer even it was corrupted
-            _rxBuffer.pop();
+    handleIrq();
+}
+
+// Has to be called with the radio mutex held
+void HoymilesRadio_NRF::handleIrq()
+{
+    if (_txPending) {
+        if (_packetReceived || esp_timer_get_time() - _txStartTime > HOY_NRF_TX_TIMEOUT) {
+            finishTx();
         }
+        return;
     }
 
-    handleReceivedPackage();
+    if (_rxChSwitchTimer.ready()) {
+        switchRxCh();
+    }
+
+    if (_packetReceived) {
+        readRxFifo();
+    }
+}
+
+// Switches to rx right after the transmission, the rx window starts now
+void HoymilesRadio_NRF::finishTx()
+{
+    _packetReceived = false;
+
+    bool txOk, txFail, rxReady;
+    _radio->whatHappened(txOk, txFail, rxReady);
+    if (!txOk) {
+        // Not acknowledged (or the interrupt got lost), the payload is still in the fifo
+        _radio->flush_tx();
+    }
+    _txPending = false;
+
+    // Nothing can have been received while transmitting
+    discardRxTimestamps();
+
+    setChannel(_rxHopLst[_rxHopIdx]);
+    _radio->startListening();
+    _rxChSwitchTimer.reset();
+    restartRxPeriod();
+}
+
+void HoymilesRadio_NRF::enterStandby()
+{
+    _radio->stopListening();
+    _radio->powerDown();
+}
+
+void HoymilesRadio_NRF::leaveStandby()
+{
+    _radio->powerUp();
+    _radio->startListening();
+    _rxChSwitchTimer.reset();
+}
+
+void HoymilesRadio_NRF::readRxFifo()
+{
+    // Reset the flag first so that an interrupt during reading is not lost
+    _packetReceived = false;
+
+    HOY_LOGV("Interrupt received\r\n");
+    while (_radio->available()) {
+        if (_rxBuffer.full()) {
+            HOY_LOGW("NRF: Buffer full\r\n");
+            _radio->flush_rx();
+            countRxBufferOverflow();
+            continue;
+        }
+
+        fragment_t f;
+        memset(f.fragment, 0xcc, MAX_RF_PAYLOAD_SIZE);
+        f.len = std::min<uint8_t>(_radio->getDynamicPayloadSize(), MAX_RF_PAYLOAD_SIZE);
+        f.channel = _radioChannel;
+        f.rssi = _radio->testRPD() ? -30 : -80;
+        f.rxTime = takeRxTimestamp();
+        _radio->read(f.fragment, f.len);
+        captureFragment(CaptureDirection_t::Rx, f.channel, f.rssi, f.fragment, f.len);
+        _rxBuffer.push(f);
+        countRxBufferLevel(_rxBuffer.size());
+    }
+    discardRxTimestamps();
 }
 
 void HoymilesRadio_NRF::setPALevel(const rf24_pa_dbm_e paLevel)
@@ -101,7 +216,29 @@ void HoymilesRadio_NRF::setPALevel(const rf24_pa_dbm_e paLevel)
     if (!_isInitialized) {
         return;
     }
+    std::lock_guard<std::mutex> lock(_radioMutex);
     _radio->setPALevel(paLevel);
+    _paLevel = paLevel;
+    _appliedPaLevel = paLevel;
+}
+
+uint8_t HoymilesRadio_NRF::getMaxTxPowerReduction() const
+{
+    return _paLevel - RF24_PA_MIN;
+}
+
+// Has to be called with the radio mutex held
+void HoymilesRadio_NRF::applyTxPower(InverterAbstract* inv)
+{
+    uint8_t level = _paLevel;
+    if (_txPowerControl && inv != nullptr) {
+        level -= std::min<uint8_t>(inv->getTxPowerControl().getReduction(), getMaxTxPowerReduction());
+    }
+
+    if (level != _appliedPaLevel) {
+        _radio->setPALevel(level);
+        _appliedPaLevel = level;
+    }
 }
 
 void HoymilesRadio_NRF::setDtuSerial(const uint64_t serial)
@@ -111,6 +248,7 @@ void HoymilesRadio_NRF::setDtuSerial(const uint64_t serial)
     if (!_isInitialized) {
         return;
     }
+    std::lock_guard<std::mutex> lock(_radioMutex);
     openReadingPipe();
 }
 
@@ -119,6 +257,7 @@ bool HoymilesRadio_NRF::isConnected() const
     if (!_isInitialized) {
         return false;
     }
+    std::lock_guard<std::mutex> lock(_radioMutex);
     return _radio->isChipConnected();
 }
 
@@ -127,9 +266,16 @@ bool HoymilesRadio_NRF::isPVariant() const
     if (!_isInitialized) {
         return false;
     }
+    std::lock_guard<std::mutex> lock(_radioMutex);
     return _radio->isPVariant();
 }
 
+uint8_t HoymilesRadio_NRF::getChannel(const uint8_t idx) const
+{
+    // rx and tx use the same channels
+    return _rxChLst[idx];
+}
+
 void HoymilesRadio_NRF::openReadingPipe()
 {
     const serial_u s = convertSerialToRadioId(_dtuSerial);
@@ -138,33 +284,163 @@ void HoymilesRadio_NRF::openReadingPipe()
 
 void HoymilesRadio_NRF::openWritingPipe(const serial_u serial)
 {
+    // The address is kept in the chip during rx, so it only has to be written
+    // if the transmission goes to another inverter than the last one
     const serial_u s = convertSerialToRadioId(serial);
+    if (s.u64 == _writingPipe) {
+        return;
+    }
     _radio->openWritingPipe(s.u64);
+    _writingPipe = s.u64;
+}
+
+void HoymilesRadio_NRF::setChannel(const uint8_t channel)
+{
+    if (channel == _radioChannel) {
+        return;
+    }
+    _radio->setChannel(channel);
+    _radioChannel = channel;
 }
 
 void ARDUINO_ISR_ATTR HoymilesRadio_NRF::handleIntr()
 {
+    captureRxTimestamp();
     _packetReceived = true;
+    notifyRxTaskFromIsr();
 }
 
 uint8_t HoymilesRadio_NRF::getRxNxtChannel()
 {
-    if (++_rxChIdx >= sizeof(_rxChLst))
-        _rxChIdx = 0;
-    return _rxChLst[_rxChIdx];
+    if (++_rxHopIdx >= sizeof(_rxHopLst))
+        _rxHopIdx = 0;
+    return _rxHopLst[_rxHopIdx];
 }
 
-uint8_t HoymilesRadio_NRF::getTxNxtChannel()
+// Uses the tx channel with the best answer ratio of the inverter. If the last
+// transmission to the inverter was not answered, the next channel is tried instead.
+uint8_t HoymilesRadio_NRF::selectTxChannel(InverterAbstract* inv, const uint64_t target)
 {
-    if (++_txChIdx >= sizeof(_txChLst))
-        _txChIdx = 0;
+    const bool lastUnanswered = target == _txTarget && !_txAnswered;
+
+    if (inv == nullptr || lastUnanswered) {
+        if (++_txChIdx >= sizeof(_txChLst))
+            _txChIdx = 0;
+    } else {
+        const NrfChannelStats_t& stats = inv->NrfChannelStats;
+        uint8_t best = 0;
+        for (uint8_t i = 1; i < NRF_CHANNEL_COUNT; i++) {
+            // Compares (answered + 1) / (requests + 2) without division
+            if ((stats.TxAnsweredRecent[i] + 1) * (stats.TxRequestsRecent[best] + 2)
+                > (stats.TxAnsweredRecent[best] + 1) * (stats.TxRequestsRecent[i] + 2)) {
+                best = i;
+            }
+        }
+        _txChIdx = best;
+    }
+
+    _txTarget = target;
+    _txAnswered = false;
+
+    if (inv != nullptr) {
+        NrfChannelStats_t& stats = inv->NrfChannelStats;
+        stats.TxRequests[_txChIdx]++;
+        stats.TxRequestsRecent[_txChIdx]++;
+
+        uint32_t sum = 0;
+        for (uint8_t i = 0; i < NRF_CHANNEL_COUNT; i++) {
+            sum += stats.TxRequestsRecent[i];
+        }
+        if (sum >= HOY_NRF_TX_RECENT_WINDOW) {
+            for (uint8_t i = 0; i < NRF_CHANNEL_COUNT; i++) {
+                stats.TxRequestsRecent[i] /= 2;
+                stats.TxAnsweredRecent[i] /= 2;
+            }
+        }
+    }
+
     return _txChLst[_txChIdx];
 }
 
+// Every channel is visited at least once per cycle. The remaining slots are given
+// to the channels with the most recent fragments and the best channel comes first.
+void HoymilesRadio_NRF::buildRxHopList(const NrfChannelStats_t* stats)
+{
+    uint8_t slots[NRF_CHANNEL_COUNT];
+    uint16_t weight[NRF_CHANNEL_COUNT];
+    for (uint8_t i = 0; i < NRF_CHANNEL_COUNT; i++) {
+        slots[i] = 1;
+        weight[i] = stats != nullptr ? stats->RxFragmentsRecent[i] : 0;
+    }
+
+    for (uint8_t extra = NRF_CHANNEL_COUNT; extra < HOY_NRF_RX_HOP_SLOTS; extra++) {
+        // Channel with the highest weight per assigned slot, evenly if nothing was received yet
+        uint8_t best = extra % NRF_CHANNEL_COUNT;
+        for (uint8_t i = 0; i < NRF_CHANNEL_COUNT; i++) {
+            if (weight[i] * slots[best] > weight[best] * slots[i]) {
+                best = i;
+            }
+        }
+        slots[best]++;
+    }
+
+    uint8_t order[NRF_CHANNEL_COUNT];
+    for (uint8_t i = 0; i < NRF_CHANNEL_COUNT; i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order, order + NRF_CHANNEL_COUNT, [&weight](const uint8_t a, const uint8_t b) {
+        return weight[a] > weight[b];
+    });
+
+    // Interleave the slots so that a channel is not visited several times in a row
+    uint8_t pos = 0;
+    for (uint8_t round = 0; pos < HOY_NRF_RX_HOP_SLOTS; round++) {
+        for (uint8_t i = 0; i < NRF_CHANNEL_COUNT && pos < HOY_NRF_RX_HOP_SLOTS; i++) {
+            if (slots[order[i]] > round) {
+                _rxHopLst[pos++] = _rxChLst[order[i]];
+            }
+        }
+    }
+    _rxHopIdx = 0;
+}
+
+void HoymilesRadio_NRF::countRxFragment(InverterAbstract& inv, const fragment_t& fragment)
+{
+    NrfChannelStats_t& stats = inv.NrfChannelStats;
+
+    const uint8_t* ch = std::find(_rxChLst, _rxChLst + NRF_CHANNEL_COUNT, fragment.channel);
+    if (ch != _rxChLst + NRF_CHANNEL_COUNT) {
+        const uint8_t idx = ch - _rxChLst;
+        stats.RxFragments[idx]++;
+        stats.RxFragmentsRecent[idx]++;
+
+        uint32_t sum = 0;
+        for (uint8_t i = 0; i < NRF_CHANNEL_COUNT; i++) {
+            sum += stats.RxFragmentsRecent[i];
+        }
+        if (sum >= HOY_NRF_RX_RECENT_WINDOW) {
+            for (uint8_t i = 0; i < NRF_CHANNEL_COUNT; i++) {
+                stats.RxFragmentsRecent[i] /= 2;
+            }
+        }
+    }
+
+    if (inv.serial() == _txTarget && !_txAnswered) {
+        _txAnswered = true;
+        stats.TxAnswered[_txChIdx]++;
+        stats.TxAnsweredRecent[_txChIdx]++;
+    }
+}
+
 void HoymilesRadio_NRF::switchRxCh()
 {
+    const uint8_t channel = getRxNxtChannel();
+    if (channel == _radioChannel) {
+        return;
+    }
+
     _radio->stopListening();
-    _radio->setChannel(getRxNxtChannel());
+    setChannel(channel);
     _radio->startListening();
 }
 
@@ -174,23 +450,38 @@ void HoymilesRadio_NRF::sendEsbPacket(CommandAbstract& cmd)
 
     cmd.setRouterAddress(DtuSerial().u64);
 
-    _radio->stopListening();
-    _radio->setChannel(getTxNxtChannel());
+    std::lock_guard<std::mutex> lock(_radioMutex);
+
+    auto inv = Hoymiles.getInverterBySerial(cmd.getTargetAddress());
 
     serial_u s;
     s.u64 = cmd.getTargetAddress();
-    openWritingPipe(s);
-    _radio->setRetries(3, 15);
+    const uint8_t txChannel = selectTxChannel(inv.get(), cmd.getTargetAddress());
+    buildRxHopList(inv != nullptr ? &inv->NrfChannelStats : nullptr);
 
-    Hoymiles.getMessageOutput()->printf("TX %s Channel: %" PRId8 " --> ",
-        cmd.getCommandName().c_str(), _radio->getChannel());
-    cmd.dumpDataPayload(Hoymiles.getMessageOutput());
-    _radio->write(cmd.getDataPayload(), cmd.getDataSize());
+    if (HOY_LOG_ENABLED(HOY_LOG_LEVEL_DEBUG)) {
+        Hoymiles.getMessageOutput(HOY_LOG_LEVEL_DEBUG)->printf("TX %s Channel: %" PRId8 " --> ",
+            cmd.getCommandName(), txChannel);
+        cmd.dumpDataPayload(Hoymiles.getMessageOutput(HOY_LOG_LEVEL_DEBUG));
+    }
 
-    _radio->setRetries(0, 0);
-    openReadingPipe();
-    _radio->setChannel(getRxNxtChannel());
-    _radio->startListening();
-    _busyFlag = true;
-    _rxTimeout.set(cmd.getTimeout());
+    // Only the registers which change are written to keep the gap between
+    // the transmission and the rx start short. The reading pipe of the dtu
+    // and the retry setting are not touched by the transmission.
+    _radio->stopListening();
+    setChannel(txChannel);
+    openWritingPipe(s);
+    applyTxPower(inv.get());
+
+    // Returns right away, the retries of a missing ack are done by the chip
+    // and finishTx is called by the TX_DS or MAX_RT interrupt
+    _packetReceived = false;
+    _txPending = true;
+    _txStartTime = esp_timer_get_time();
+    _radio->startWrite(cmd.getDataPayload(), cmd.getDataSize(), false);
+    captureFragment(CaptureDirection_t::Tx, txChannel, 0, cmd.getDataPayload(), cmd.getDataSize());
+
+    // Marks the radio busy, the window is restarted by finishTx
+    startRxPeriod(cmd);
+    notifyRxTask();
 }
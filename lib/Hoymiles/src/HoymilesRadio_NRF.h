@@ -3,17 +3,39 @@
 
 #include "HoymilesRadio.h"
 #include "commands/CommandAbstract.h"
+#include "inverters/InverterAbstract.h"
+#include <Every.h>
 #include <RF24.h>
+#include <SpscRingBuffer.h>
 #include <memory>
 #include <nRF24L01.h>
-#include <queue>
 
 // number of fragments hold in buffer
 #define FRAGMENT_BUFFER_SIZE 30
 
+// Number of 4 ms rx slots per hop cycle. Each channel gets one slot, the remaining
+// slots are given to the channels which delivered the most fragments of the inverter.
+#ifndef HOY_NRF_RX_HOP_SLOTS
+#define HOY_NRF_RX_HOP_SLOTS 10
+#endif
+
+// The recent channel statistics of an inverter are halved once the sum reaches this value
+#ifndef HOY_NRF_RX_RECENT_WINDOW
+#define HOY_NRF_RX_RECENT_WINDOW 256
+#endif
+#ifndef HOY_NRF_TX_RECENT_WINDOW
+#define HOY_NRF_TX_RECENT_WINDOW 64
+#endif
+
+// Transmissions are finished by the TX_DS or MAX_RT interrupt, this timeout (us) only
+// applies if the interrupt got lost. 15 retries of 1 ms take about 17 ms.
+#ifndef HOY_NRF_TX_TIMEOUT
+#define HOY_NRF_TX_TIMEOUT 25000
+#endif
+
 class HoymilesRadio_NRF : public HoymilesRadio {
 public:
-    void init(SPIClass* initialisedSpiBus, const uint8_t pinCE, const uint8_t pinIRQ);
+    void init(std::shared_ptr<SPIClass> initialisedSpiBus, const uint8_t pinCS, const uint8_t pinCE, const uint8_t pinIRQ);
     void loop();
     void setPALevel(const rf24_pa_dbm_e paLevel);
 
@@ -22,25 +44,64 @@ public:
     bool isConnected() const;
     bool isPVariant() const;
 
+    // Channel number of the given index of the NrfChannelStats_t arrays
+    uint8_t getChannel(const uint8_t idx) const;
+
 private:
     void ARDUINO_ISR_ATTR handleIntr();
+    void rxTaskLoop() override;
+    void enterStandby() override;
+    void leaveStandby() override;
+    void readRxFifo();
+    void handleIrq();
+    void finishTx();
+    void processRxFragment(const fragment_t& f);
     uint8_t getRxNxtChannel();
-    uint8_t getTxNxtChannel();
+    uint8_t selectTxChannel(InverterAbstract* inv, const uint64_t target);
+    void buildRxHopList(const NrfChannelStats_t* stats);
+    void countRxFragment(InverterAbstract& inv, const fragment_t& fragment);
     void switchRxCh();
     void openReadingPipe();
     void openWritingPipe(const serial_u serial);
+    void setChannel(const uint8_t channel);
+    void applyTxPower(InverterAbstract* inv);
+    uint8_t getMaxTxPowerReduction() const override;
 
     void sendEsbPacket(CommandAbstract& cmd);
 
-    std::unique_ptr<SPIClass> _spiPtr;
+    // May be shared with other nrf modules
+    std::shared_ptr<SPIClass> _spiPtr;
     std::unique_ptr<RF24> _radio;
-    uint8_t _rxChLst[5] = { 3, 23, 40, 61, 75 };
-    uint8_t _rxChIdx = 0;
 
-    uint8_t _txChLst[5] = { 3, 23, 40, 61, 75 };
+    // Register values last written to the chip, used to skip redundant SPI transfers
+    uint8_t _radioChannel = 0;
+    uint64_t _writingPipe = 0;
+    uint8_t _appliedPaLevel = RF24_PA_MAX;
+    uint8_t _rxChLst[NRF_CHANNEL_COUNT] = { 3, 23, 40, 61, 75 };
+
+    // Configured PA level, the highest level used by the transmit power control
+    rf24_pa_dbm_e _paLevel = RF24_PA_MAX;
+
+    // Order in which the rx channels are visited, rebuilt for each transmission
+    uint8_t _rxHopLst[HOY_NRF_RX_HOP_SLOTS] = {};
+    uint8_t _rxHopIdx = 0;
+
+    // Per module timer, the static one of EVERY_N_MILLIS would be shared by all modules
+    CEveryNMillis _rxChSwitchTimer { 4 };
+
+    uint8_t _txChLst[NRF_CHANNEL_COUNT] = { 3, 23, 40, 61, 75 };
     uint8_t _txChIdx = 0;
 
+    // Target of the last transmission and whether it was answered
+    uint64_t _txTarget = 0;
+    bool _txAnswered = false;
+
+    // Set by the IRQ, which signals received packets and the end of a transmission
     volatile bool _packetReceived = false;
 
-    std::queue<fragment_t> _rxBuffer;
+    // A transmission was started and rx is switched on once it is finished
+    bool _txPending = false;
+    uint32_t _txStartTime = 0; // us
+
+    SpscRingBuffer<fragment_t, FRAGMENT_BUFFER_SIZE> _rxBuffer;
 };
\ No newline at end of file
@@ -0,0 +1,370 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "InverterEmulator.h"
+#include "Hoymiles.h"
+#include "crc.h"
+#include <Arduino.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <esp_random.h>
+
+// Period (ms) of the synthetic power curve, short enough that each poll sees new values
+#ifndef HOY_EMULATOR_CYCLE
+#define HOY_EMULATOR_CYCLE (10 * 60 * 1000)
+#endif
+
+#define EMULATOR_DC_VOLTAGE 32.0f
+#define EMULATOR_AC_VOLTAGE 230.0f
+#define EMULATOR_AC_VOLTAGE_LINE 400.0f
+#define EMULATOR_EFFICIENCY 0.965f
+
+// Hardware part numbers which the DevInfoParser knows, the first match of the
+// type name prefix and the number of dc channels is used
+static const struct {
+    const char* Prefix;
+    uint8_t Channels;
+    uint8_t HwPart[4];
+    uint16_t MaxPower;
+} emulatedParts[] = {
+    { "HMT", 6, { 0x10, 0x33, 0x31, 0x01 }, 2250 },
+    { "HMT", 4, { 0x10, 0x32, 0x71, 0x01 }, 2000 },
+    { "HMS", 4, { 0x10, 0x22, 0x71, 0x01 }, 2000 },
+    { "HMS", 2, { 0x10, 0x21, 0x71, 0x01 }, 1000 },
+    { "HMS", 1, { 0x10, 0x20, 0x71, 0x01 }, 500 },
+    { "HERF", 0, { 0xF1, 0x01, 0x10, 0x01 }, 600 },
+    { "HM", 4, { 0x10, 0x12, 0x30, 0x01 }, 1500 },
+    { "HM", 2, { 0x10, 0x11, 0x40, 0x01 }, 800 },
+    { "HM", 1, { 0x10, 0x10, 0x40, 0x01 }, 400 },
+};
+
+bool InverterEmulator::addInverter(const uint64_t serial)
+{
+    const InverterModel_t* model = HoymilesClass::findModel(serial);
+    if (model == nullptr) {
+        return false;
+    }
+
+    Emulated_t e;
+    e.Serial = serial;
+    e.RadioId = HoymilesClass::getRadioId(serial);
+    e.Assignment = model->ByteAssignment;
+    e.AssignmentSize = model->ByteAssignmentSize;
+    e.ChannelCount = model->ChannelCount;
+    e.StatisticSize = 0;
+    for (uint8_t i = 0; i < e.AssignmentSize; i++) {
+        const byteAssign_t& a = e.Assignment[i];
+        if (a.div != CMD_CALC) {
+            e.StatisticSize = std::max<uint8_t>(e.StatisticSize, a.start + a.num);
+        }
+    }
+
+    memset(e.HwPart, 0, sizeof(e.HwPart));
+    e.MaxPower = 400 * std::max<uint8_t>(e.ChannelCount, 1);
+    for (const auto& part : emulatedParts) {
+        if (strncmp(model->TypeName, part.Prefix, strlen(part.Prefix)) == 0 && (part.Channels == 0 || part.Channels == e.ChannelCount)) {
+            memcpy(e.HwPart, part.HwPart, sizeof(e.HwPart));
+            e.MaxPower = part.MaxPower;
+            break;
+        }
+    }
+
+    _inverters.push_back(std::move(e));
+    return true;
+}
+
+size_t InverterEmulator::getInverterCount() const
+{
+    return _inverters.size();
+}
+
+uint64_t InverterEmulator::getInverterSerial(const size_t idx) const
+{
+    return idx < _inverters.size() ? _inverters[idx].Serial : 0;
+}
+
+void InverterEmulator::setLoss(const uint8_t percent)
+{
+    _loss = std::min<uint8_t>(percent, 100);
+}
+
+EmulatorStats_t InverterEmulator::getStats() const
+{
+    return _stats;
+}
+
+InverterEmulator::Emulated_t* InverterEmulator::findInverter(const uint8_t packet[])
+{
+    const uint32_t radioId = (static_cast<uint32_t>(packet[1]) << 24)
+        | (static_cast<uint32_t>(packet[2]) << 16)
+        | (static_cast<uint32_t>(packet[3]) << 8)
+        | static_cast<uint32_t>(packet[4]);
+
+    auto it = std::find_if(_inverters.begin(), _inverters.end(),
+        [radioId](const Emulated_t& e) { return e.RadioId == radioId; });
+    return it != _inverters.end() ? &*it : nullptr;
+}
+
+bool InverterEmulator::handlePacket(const uint8_t packet[], const uint8_t len, std::vector<EmulatorPacket_t>& answer)
+{
+    if (len < 11 || len > MAX_RF_PAYLOAD_SIZE) {
+        return false;
+    }
+
+    Emulated_t* inv = findInverter(packet);
+    if (inv == nullptr) {
+        return false;
+    }
+    _stats.Requests++;
+
+    if (crc8(packet, len - 1) != packet[len - 1]) {
+        _stats.CrcErrors++;
+        return false;
+    }
+
+    std::vector<uint8_t> data;
+
+    switch (packet[0]) {
+    case 0x15:
+        // Retransmit of a single fragment of the last answer
+        if (packet[9] != 0x80) {
+            const uint8_t frame = packet[9] & 0x7f;
+            if (frame == 0 || frame > inv->LastAnswer.size()) {
+                return false;
+            }
+            sendFragment(inv->LastAnswer[frame - 1], answer);
+            return true;
+        }
+
+        if (len < 27 || crc16(&packet[10], 14) != ((packet[24] << 8) | packet[25])) {
+            _stats.CrcErrors++;
+            return false;
+        }
+
+        switch (packet[10]) {
+        case 0x0b: // RealTimeRunData
+            buildStatistic(*inv, data);
+            break;
+        case 0x11: // AlarmData, the event log is always empty
+            data.assign(2, 0);
+            break;
+        case 0x01: // DevInfoAll
+            buildDevInfoAll(data);
+            break;
+        case 0x00: // DevInfoSimple
+            buildDevInfoSimple(*inv, data);
+            break;
+        case 0x05: // SystemConfigPara
+            buildSystemConfigPara(*inv, data);
+            break;
+        default:
+            _stats.Unknown++;
+            return false;
+        }
+        break;
+
+    case 0x51: // DevControl, the answer is only checked for its id
+        handleDevControl(*inv, packet, len);
+        data.assign(&packet[10], &packet[12]);
+        break;
+
+    case 0x56: // ChannelChange, never answered by the real inverters either
+        return false;
+
+    default:
+        _stats.Unknown++;
+        return false;
+    }
+
+    buildAnswer(*inv, packet, data);
+    for (const auto& fragment : inv->LastAnswer) {
+        sendFragment(fragment, answer);
+    }
+    return true;
+}
+
+float InverterEmulator::getDcPower(const Emulated_t& inv, const uint8_t channel, const uint32_t now) const
+{
+    if (!inv.On) {
+        return 0;
+    }
+
+    // Each channel and inverter has its own phase, so the totals do not move in lockstep
+    const uint32_t t = (now + channel * 7919 + inv.RadioId) % HOY_EMULATOR_CYCLE;
+    const float phase = 2.0f * static_cast<float>(M_PI) * t / HOY_EMULATOR_CYCLE;
+    const float maxChannel = static_cast<float>(inv.MaxPower) / std::max<uint8_t>(inv.ChannelCount, 1);
+
+    return std::min(maxChannel * (0.55f + 0.35f * sinf(phase)), maxChannel * inv.Limit / 1000.0f);
+}
+
+void InverterEmulator::buildStatistic(Emulated_t& inv, std::vector<uint8_t>& data)
+{
+    const uint32_t now = millis();
+
+    float dcPower[CH_CNT] = {};
+    float acPower = 0;
+    for (uint8_t c = 0; c < inv.ChannelCount && c < CH_CNT; c++) {
+        dcPower[c] = getDcPower(inv, c, now);
+        acPower += dcPower[c] * EMULATOR_EFFICIENCY;
+
+        if (inv.LastStatistic != 0) {
+            const float energy = dcPower[c] * (now - inv.LastStatistic) / 3600000.0f; // Wh
+            inv.YieldDay[c] += energy;
+            inv.YieldTotal[c] += energy / 1000.0f;
+        }
+    }
+    inv.LastStatistic = now;
+
+    data.assign(inv.StatisticSize, 0);
+
+    for (uint8_t i = 0; i < inv.AssignmentSize; i++) {
+        const byteAssign_t& a = inv.Assignment[i];
+        if (a.div == CMD_CALC) {
+            continue;
+        }
+
+        float value = 0;
+        switch (a.fieldId) {
+        case FLD_UDC:
+            value = EMULATOR_DC_VOLTAGE;
+            break;
+        case FLD_IDC:
+            value = dcPower[a.ch] / EMULATOR_DC_VOLTAGE;
+            break;
+        case FLD_PDC:
+            value = dcPower[a.ch];
+            break;
+        case FLD_YD:
+            value = inv.YieldDay[a.ch];
+            break;
+        case FLD_YT:
+            value = inv.YieldTotal[a.ch];
+            break;
+        case FLD_UAC:
+        case FLD_UAC_1N:
+        case FLD_UAC_2N:
+        case FLD_UAC_3N:
+            value = EMULATOR_AC_VOLTAGE;
+            break;
+        case FLD_UAC_12:
+        case FLD_UAC_23:
+        case FLD_UAC_31:
+            value = EMULATOR_AC_VOLTAGE_LINE;
+            break;
+        case FLD_IAC:
+            value = acPower / EMULATOR_AC_VOLTAGE;
+            break;
+        case FLD_IAC_1:
+        case FLD_IAC_2:
+        case FLD_IAC_3:
+            value = acPower / 3 / EMULATOR_AC_VOLTAGE;
+            break;
+        case FLD_PAC:
+            value = acPower;
+            break;
+        case FLD_F:
+            value = 50.0f;
+            break;
+        case FLD_T:
+            value = 35.0f + acPower / inv.MaxPower * 10.0f;
+            break;
+        case FLD_PF:
+            value = 1.0f;
+            break;
+        default:
+            break;
+        }
+
+        const int32_t raw = lroundf(value * a.div);
+        for (uint8_t b = 0; b < a.num; b++) {
+            data[a.start + a.num - 1 - b] = static_cast<uint8_t>(raw >> (8 * b));
+        }
+    }
+}
+
+void InverterEmulator::buildDevInfoAll(std::vector<uint8_t>& data) const
+{
+    // Firmware 1.0.22 built at 2024-03-19 12:00, bootloader 1.0.1
+    data = { 0x27, 0x16, 0x07, 0xe8, 0x01, 0x3f, 0x04, 0xb0, 0x00, 0x65, 0x00, 0x00, 0x00, 0x00 };
+}
+
+void InverterEmulator::buildDevInfoSimple(const Emulated_t& inv, std::vector<uint8_t>& data) const
+{
+    data = { 0x27, 0x16, inv.HwPart[0], inv.HwPart[1], inv.HwPart[2], inv.HwPart[3],
+        0x01, 0x00, 0x0a, 0x00, 0x20, 0x01, 0x00, 0x00 };
+}
+
+void InverterEmulator::buildSystemConfigPara(const Emulated_t& inv, std::vector<uint8_t>& data) const
+{
+    data.assign(14, 0);
+    data[1] = 0x01;
+    data[2] = static_cast<uint8_t>(inv.Limit >> 8);
+    data[3] = static_cast<uint8_t>(inv.Limit);
+    data[6] = 0x03;
+    data[7] = 0xe8;
+}
+
+void InverterEmulator::handleDevControl(Emulated_t& inv, const uint8_t packet[], const uint8_t len)
+{
+    switch (packet[10]) {
+    case 0x00: // TurnOn
+        inv.On = true;
+        break;
+    case 0x01: // TurnOff
+        inv.On = false;
+        break;
+    case 0x02: // Restart drops the non persistent limit
+        inv.On = true;
+        inv.Limit = 1000;
+        break;
+    case 0x0b: { // ActivePowerControl
+        if (len < 17) {
+            return;
+        }
+        const uint16_t limit = (packet[12] << 8) | packet[13];
+        const uint16_t type = (packet[14] << 8) | packet[15];
+        // Relative limits are sent in % * 10, absolute ones in W * 10
+        const uint32_t percent = (type & 0x0001) ? limit : static_cast<uint32_t>(limit) * 100 / inv.MaxPower;
+        inv.Limit = std::min<uint32_t>(percent, 1000);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void InverterEmulator::buildAnswer(Emulated_t& inv, const uint8_t packet[], std::vector<uint8_t>& data)
+{
+    const uint16_t crc = crc16(data.data(), data.size());
+    data.push_back(static_cast<uint8_t>(crc >> 8));
+    data.push_back(static_cast<uint8_t>(crc));
+
+    inv.LastAnswer.clear();
+    const uint8_t count = (data.size() + HOY_EMULATOR_FRAGMENT_DATA - 1) / HOY_EMULATOR_FRAGMENT_DATA;
+    for (uint8_t i = 0; i < count; i++) {
+        const size_t offset = i * HOY_EMULATOR_FRAGMENT_DATA;
+        const uint8_t len = std::min<size_t>(HOY_EMULATOR_FRAGMENT_DATA, data.size() - offset);
+
+        EmulatorPacket_t fragment;
+        fragment.Data[0] = packet[0] | 0x80;
+        memcpy(&fragment.Data[1], &packet[1], 8); // inverter and dtu address of the request
+        fragment.Data[9] = (i + 1) | (i + 1 == count ? 0x80 : 0x00);
+        memcpy(&fragment.Data[10], &data[offset], len);
+        fragment.Data[10 + len] = crc8(fragment.Data, 10 + len);
+        fragment.Len = 11 + len;
+
+        inv.LastAnswer.push_back(fragment);
+    }
+}
+
+void InverterEmulator::sendFragment(const EmulatorPacket_t& fragment, std::vector<EmulatorPacket_t>& answer)
+{
+    if (_loss > 0 && esp_random() % 100 < _loss) {
+        _stats.FragmentsDropped++;
+        return;
+    }
+    _stats.FragmentsSent++;
+    answer.push_back(fragment);
+}
@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "parser/StatisticsParser.h"
+#include "types.h"
+#include <cstdint>
+#include <vector>
+
+// Data bytes per fragment of an answer, like the real inverters
+#define HOY_EMULATOR_FRAGMENT_DATA 16
+
+struct EmulatorPacket_t {
+    uint8_t Data[MAX_RF_PAYLOAD_SIZE];
+    uint8_t Len;
+};
+
+struct EmulatorStats_t {
+    uint32_t Requests; // addressed to an emulated inverter
+    uint32_t CrcErrors;
+    uint32_t Unknown; // commands which are not emulated
+    uint32_t FragmentsSent;
+    uint32_t FragmentsDropped; // by the configured loss
+};
+
+// Answers the requests of a DTU in place of the inverters with the given serials.
+// Only the protocol is emulated, the received packets are passed in and the answer
+// is returned as list of packets, so it works with both radio types. The values are
+// synthetic but use the byte assignment of the real inverter types.
+class InverterEmulator {
+public:
+    // Returns false if the serial does not belong to a known inverter type
+    bool addInverter(const uint64_t serial);
+    size_t getInverterCount() const;
+    uint64_t getInverterSerial(const size_t idx) const;
+
+    // Probability (0 - 100 %) that a fragment of an answer is not sent
+    void setLoss(const uint8_t percent);
+
+    // Appends the fragments of the answer to answer. Returns false if the packet was
+    // not addressed to an emulated inverter or is not answered.
+    bool handlePacket(const uint8_t packet[], const uint8_t len, std::vector<EmulatorPacket_t>& answer);
+
+    EmulatorStats_t getStats() const;
+
+private:
+    struct Emulated_t {
+        uint64_t Serial;
+        uint32_t RadioId;
+        const byteAssign_t* Assignment;
+        uint8_t AssignmentSize;
+        uint8_t StatisticSize;
+        uint8_t HwPart[4];
+        uint16_t MaxPower; // W
+        uint8_t ChannelCount;
+
+        uint16_t Limit = 1000; // % * 10
+        bool On = true;
+        float YieldDay[CH_CNT] = {}; // Wh
+        float YieldTotal[CH_CNT] = {}; // kWh
+        uint32_t LastStatistic = 0;
+
+        // Kept for the retransmit of single fragments
+        std::vector<EmulatorPacket_t> LastAnswer;
+    };
+
+    Emulated_t* findInverter(const uint8_t packet[]);
+
+    void buildStatistic(Emulated_t& inv, std::vector<uint8_t>& data);
+    void buildDevInfoAll(std::vector<uint8_t>& data) const;
+    void buildDevInfoSimple(const Emulated_t& inv, std::vector<uint8_t>& data) const;
+    void buildSystemConfigPara(const Emulated_t& inv, std::vector<uint8_t>& data) const;
+    void handleDevControl(Emulated_t& inv, const uint8_t packet[], const uint8_t len);
+
+    // Splits the data with its crc16 into fragments
+    void buildAnswer(Emulated_t& inv, const uint8_t packet[], std::vector<uint8_t>& data);
+    void sendFragment(const EmulatorPacket_t& fragment, std::vector<EmulatorPacket_t>& answer);
+
+    float getDcPower(const Emulated_t& inv, const uint8_t channel, const uint32_t now) const;
+
+    std::vector<Emulated_t> _inverters;
+    uint8_t _loss = 0;
+    EmulatorStats_t _stats = {};
+};
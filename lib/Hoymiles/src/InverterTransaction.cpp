@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "InverterTransaction.h"
+#include "inverters/InverterAbstract.h"
+#include <Arduino.h>
+#include <algorithm>
+
+InverterTransaction::InverterTransaction(const char* name)
+    : _name(name)
+{
+}
+
+InverterTransaction& InverterTransaction::then(const char* name, TransactionStepFunc start, const bool required)
+{
+    if (_steps.size() < TRANSACTION_MAX_STEPS) {
+        _steps.push_back({ name, std::move(start), required, TRANSACTION_NO_DEPENDENCY });
+    }
+    return *this;
+}
+
+InverterTransaction& InverterTransaction::thenAfter(const uint8_t after, const char* name, TransactionStepFunc start)
+{
+    if (_steps.size() < TRANSACTION_MAX_STEPS) {
+        _steps.push_back({ name, std::move(start), false, after });
+    }
+    return *this;
+}
+
+const char* InverterTransaction::getName() const
+{
+    return _name;
+}
+
+const std::vector<TransactionStep_t>& InverterTransaction::getSteps() const
+{
+    return _steps;
+}
+
+bool TransactionRunner::begin(const InverterTransaction& transaction, InverterAbstract& inv)
+{
+    if (isRunning()) {
+        return false;
+    }
+
+    _transaction = &transaction;
+    _step = 0;
+    _succeeded = 0;
+    _start = millis();
+    _stats.Runs++;
+
+    startNextStep(inv);
+    return true;
+}
+
+bool TransactionRunner::isRunning() const
+{
+    return _transaction != nullptr;
+}
+
+void TransactionRunner::run(InverterAbstract& inv)
+{
+    if (!isRunning()) {
+        return;
+    }
+
+    // Also waits for the resends and retransmits of the current command
+    if (inv.getRadio()->hasCommands(inv.serial(), _firstTraceId, _lastTraceId)) {
+        return;
+    }
+
+    const TransactionStep_t& step = _transaction->getSteps()[_step];
+    if (_stepFailed && step.Required) {
+        _stats.StepsSkipped += _transaction->getSteps().size() - _step - 1;
+        finish(true);
+        return;
+    }
+    if (!_stepFailed) {
+        _succeeded |= 1UL << _step;
+    }
+
+    _step++;
+    startNextStep(inv);
+}
+
+void TransactionRunner::commandFinished(const uint32_t traceId, const bool success)
+{
+    if (isRunning() && !success && traceId >= _firstTraceId && traceId <= _lastTraceId) {
+        _stepFailed = true;
+        _stats.CommandsFailed++;
+    }
+}
+
+const TransactionStats_t& TransactionRunner::getStats() const
+{
+    return _stats;
+}
+
+void TransactionRunner::startNextStep(InverterAbstract& inv)
+{
+    const auto& steps = _transaction->getSteps();
+
+    for (; _step < steps.size(); _step++) {
+        const TransactionStep_t& step = steps[_step];
+        if (step.DependsOn != TRANSACTION_NO_DEPENDENCY && !(_succeeded & (1UL << step.DependsOn))) {
+            _stats.StepsSkipped++;
+            continue;
+        }
+
+        _firstTraceId = CommandAbstract::getNextTraceId();
+        if (!step.Start(inv)) {
+            _stats.StepsSkipped++;
+            continue;
+        }
+        _lastTraceId = CommandAbstract::getNextTraceId() - 1;
+        _stepFailed = false;
+
+        // The step did not create a command, there is nothing to wait for
+        if (_lastTraceId < _firstTraceId) {
+            _succeeded |= 1UL << _step;
+            continue;
+        }
+        return;
+    }
+
+    finish(false);
+}
+
+void TransactionRunner::finish(const bool aborted)
+{
+    const uint32_t duration = millis() - _start;
+    _stats.LastDuration = duration;
+    _stats.MaxDuration = std::max(_stats.MaxDuration, duration);
+    if (aborted) {
+        _stats.Aborted++;
+    } else {
+        _stats.Completed++;
+    }
+    _transaction = nullptr;
+}
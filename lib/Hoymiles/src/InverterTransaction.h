@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class InverterAbstract;
+
+// Enqueues the commands of a step. Returns false if the step is not due.
+using TransactionStepFunc = std::function<bool(InverterAbstract&)>;
+
+#define TRANSACTION_NO_DEPENDENCY 0xff
+
+// Steps are tracked in a bit mask
+#define TRANSACTION_MAX_STEPS 32
+
+struct TransactionStep_t {
+    const char* Name;
+    TransactionStepFunc Start;
+    bool Required; // a failed command of the step skips all following steps
+    uint8_t DependsOn; // step which has to be finished successfully first
+};
+
+// Sequence of steps with commands to an inverter. Defined once and shared by all
+// inverters, the state of a run is kept by the TransactionRunner of each inverter.
+class InverterTransaction {
+public:
+    explicit InverterTransaction(const char* name);
+
+    // Appends a step, the index of the steps starts with 0
+    InverterTransaction& then(const char* name, TransactionStepFunc start, const bool required = false);
+    // The step is skipped unless the given previous step succeeded
+    InverterTransaction& thenAfter(const uint8_t after, const char* name, TransactionStepFunc start);
+
+    const char* getName() const;
+    const std::vector<TransactionStep_t>& getSteps() const;
+
+private:
+    const char* _name;
+    std::vector<TransactionStep_t> _steps;
+};
+
+struct TransactionStats_t {
+    uint32_t Runs;
+    uint32_t Completed; // all due steps were run
+    uint32_t Aborted; // a required step failed
+    uint32_t StepsSkipped; // by a failed dependency or because they were not due
+    uint32_t CommandsFailed;
+    uint32_t LastDuration; // ms from the start until the last command finished
+    uint32_t MaxDuration; // ms
+};
+
+// Runs one transaction of an inverter at a time. Each step enqueues its commands and
+// the next step is started by the loop once all of them left the queue, so the
+// conditions of a step are evaluated with the results of the previous ones.
+class TransactionRunner {
+public:
+    // Starts the first due step. Returns false if a transaction is still running.
+    bool begin(const InverterTransaction& transaction, InverterAbstract& inv);
+    bool isRunning() const;
+
+    // Called by the loop, starts the next step once the current one is finished
+    void run(InverterAbstract& inv);
+
+    // Called by the radio for each finished command of the inverter
+    void commandFinished(const uint32_t traceId, const bool success);
+
+    const TransactionStats_t& getStats() const;
+
+private:
+    void startNextStep(InverterAbstract& inv);
+    void finish(const bool aborted);
+
+    const InverterTransaction* _transaction = nullptr;
+    uint8_t _step = 0;
+    uint32_t _succeeded = 0; // bit mask of the steps
+    bool _stepFailed = false;
+
+    // Trace ids of the commands created by the current step
+    uint32_t _firstTraceId = 0;
+    uint32_t _lastTraceId = 0;
+
+    uint32_t _start = 0;
+    TransactionStats_t _stats = {};
+};
@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "commands/ActivePowerControlCommand.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+// Newest requested limit of an inverter. MQTT, the web api, modbus and the power
+// controller write it from their tasks without a lock. The loop takes it once the
+// next limit command may be sent, and a queued limit command takes a newer one right
+// before it is transmitted. A burst of requests therefore only overwrites this word.
+// The limit is kept in tenths like in the command, so everything fits into one word.
+class LimitMailbox {
+public:
+    // Returns true if a limit which was not taken yet was replaced
+    bool post(const float limit, const PowerLimitControlType type)
+    {
+        return _word.exchange(pack(limit, type) | PENDING) & PENDING;
+    }
+
+    // Marks the last posted limit as pending again
+    void repost()
+    {
+        _word.fetch_or(PENDING);
+    }
+
+    // Takes the pending limit, false if there is none
+    bool take(float& limit, PowerLimitControlType& type)
+    {
+        const uint32_t word = _word.fetch_and(~PENDING);
+        if (!(word & PENDING)) {
+            return false;
+        }
+
+        limit = (word & 0xffff) / 10.0f;
+        type = static_cast<PowerLimitControlType>(((word >> 16) & 0x01) | (((word >> 17) & 0x01) << 8));
+        return true;
+    }
+
+    bool isPending() const
+    {
+        return _word.load() & PENDING;
+    }
+
+private:
+    static constexpr uint32_t PENDING = 0x80000000;
+
+    static uint32_t pack(const float limit, const PowerLimitControlType type)
+    {
+        const uint16_t tenths = std::clamp(limit, 0.0f, 6553.5f) * 10;
+        return tenths | ((type & 0x01) << 16) | (((type >> 8) & 0x01) << 17);
+    }
+
+    std::atomic<uint32_t> _word { 0 };
+};
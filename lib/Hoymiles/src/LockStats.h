@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "Histogram.h"
+#include <algorithm>
+#include <esp_timer.h>
+
+// Wait and hold times (us) of a lock. Only updated while the lock is held,
+// so the statistics need no protection of their own.
+struct LockStats_t {
+    // Named, a braced temporary in the member initializers triggers -Wuninitialized
+    static constexpr std::array<uint32_t, 8> TimeBounds = { 10, 50, 100, 500, 1000, 5000, 10000, 50000 };
+
+    Histogram<8> WaitTime { TimeBounds };
+    Histogram<8> HoldTime { TimeBounds };
+    uint32_t MaxHoldTime = 0;
+
+    void observe(const uint32_t wait, const uint32_t hold)
+    {
+        WaitTime.observe(wait);
+        HoldTime.observe(hold);
+        MaxHoldTime = std::max(MaxHoldTime, hold);
+    }
+};
+
+// Scoped lock which records its wait and hold time. A shared lock must only
+// be timed by a single task, several readers would update the stats at once.
+template <typename Mutex, bool Shared = false>
+class TimedLock {
+public:
+    TimedLock(Mutex& mutex, LockStats_t& stats)
+        : _mutex(mutex)
+        , _stats(stats)
+    {
+        const uint32_t start = esp_timer_get_time();
+        if constexpr (Shared) {
+            _mutex.lock_shared();
+        } else {
+            _mutex.lock();
+        }
+        _acquired = esp_timer_get_time();
+        _wait = _acquired - start;
+    }
+
+    ~TimedLock()
+    {
+        _stats.observe(_wait, esp_timer_get_time() - _acquired);
+        if constexpr (Shared) {
+            _mutex.unlock_shared();
+        } else {
+            _mutex.unlock();
+        }
+    }
+
+    TimedLock(const TimedLock&) = delete;
+    TimedLock& operator=(const TimedLock&) = delete;
+
+private:
+    Mutex& _mutex;
+    LockStats_t& _stats;
+    uint32_t _acquired = 0;
+    uint32_t _wait = 0;
+};
@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "NumberFormat.h"
+#include <cmath>
+#include <cstring>
+
+static const uint32_t powersOf10[FORMAT_FIXED_MAX_DIGITS + 1] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+
+static size_t copyString(char* buffer, const size_t size, const char* str)
+{
+    const size_t len = strlen(str);
+    if (len >= size) {
+        return 0;
+    }
+    memcpy(buffer, str, len + 1);
+    return len;
+}
+
+size_t formatFixed(char* buffer, const size_t size, const float value, uint8_t digits)
+{
+    if (std::isnan(value)) {
+        return copyString(buffer, size, "nan");
+    }
+    if (digits > FORMAT_FIXED_MAX_DIGITS) {
+        digits = FORMAT_FIXED_MAX_DIGITS;
+    }
+
+    // The scaled value has to fit into 64 bits, larger values are no valid readings
+    const double scaled = std::round(std::fabs(static_cast<double>(value)) * powersOf10[digits]);
+    if (!(scaled < 1e18)) {
+        return copyString(buffer, size, value < 0 ? "-inf" : "inf");
+    }
+    uint64_t raw = static_cast<uint64_t>(scaled);
+
+    // Digits are written from the end, the fraction first
+    char tmp[FORMAT_FIXED_BUFFER_SIZE];
+    char* pos = tmp + sizeof(tmp);
+    for (uint8_t i = 0; i < digits; i++) {
+        *--pos = '0' + raw % 10;
+        raw /= 10;
+    }
+    if (digits > 0) {
+        *--pos = '.';
+    }
+    do {
+        *--pos = '0' + raw % 10;
+        raw /= 10;
+    } while (raw > 0);
+
+    // Like printf, values which round to zero keep their sign
+    if (std::signbit(value)) {
+        *--pos = '-';
+    }
+
+    const size_t len = tmp + sizeof(tmp) - pos;
+    if (len >= size) {
+        return 0;
+    }
+    memcpy(buffer, pos, len);
+    buffer[len] = '\0';
+    return len;
+}
@@ -0,0 +1,15 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Enough for any float formatted with up to FORMAT_FIXED_MAX_DIGITS digits
+#define FORMAT_FIXED_BUFFER_SIZE 24
+
+#define FORMAT_FIXED_MAX_DIGITS 6
+
+// Formats value with the given digits after the decimal point like "%.*f" but in
+// integer arithmetic, without the float support of printf. Returns the length
+// without the terminating zero or 0 if the buffer is too small.
+size_t formatFixed(char* buffer, const size_t size, const float value, uint8_t digits);
@@ -0,0 +1,96 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "RadioCapture.h"
+#include <algorithm>
+#include <cstring>
+#include <sys/time.h>
+
+void RadioCapture::setEnabled(const bool enabled)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (enabled == _enabled) {
+        return;
+    }
+
+    if (enabled) {
+        _records.resize(HOY_CAPTURE_SIZE);
+    } else {
+        _records.clear();
+        _records.shrink_to_fit();
+    }
+    _head = 0;
+    _count = 0;
+    _overwritten = 0;
+    _enabled = enabled;
+}
+
+bool RadioCapture::isEnabled() const
+{
+    return _enabled;
+}
+
+void RadioCapture::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _head = 0;
+    _count = 0;
+    _overwritten = 0;
+}
+
+void RadioCapture::add(const uint8_t radio, const CaptureDirection_t direction, const uint8_t channel, const int8_t rssi, const uint8_t data[], const uint8_t len)
+{
+    if (!_enabled) {
+        return;
+    }
+
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_records.empty()) {
+        return;
+    }
+
+    RadioCaptureRecord_t& record = _records[_head];
+    record.TimestampSec = tv.tv_sec;
+    record.TimestampUsec = tv.tv_usec;
+    record.Radio = radio;
+    record.Direction = direction;
+    record.Channel = channel;
+    record.Rssi = rssi;
+    record.Len = std::min<uint8_t>(len, MAX_RF_PAYLOAD_SIZE);
+    memcpy(record.Data, data, record.Len);
+
+    _head = (_head + 1) % _records.size();
+    if (_count < _records.size()) {
+        _count++;
+    } else {
+        _overwritten++;
+    }
+}
+
+std::vector<RadioCaptureRecord_t> RadioCapture::getRecords()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    std::vector<RadioCaptureRecord_t> records;
+    records.reserve(_count);
+    for (size_t i = 0; i < _count; i++) {
+        records.push_back(_records[(_head + _records.size() - _count + i) % _records.size()]);
+    }
+    return records;
+}
+
+size_t RadioCapture::getCount()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _count;
+}
+
+uint32_t RadioCapture::getOverwritten()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _overwritten;
+}
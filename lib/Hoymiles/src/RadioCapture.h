@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "types.h"
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Number of fragments kept in the capture ring while capturing is enabled
+#ifndef HOY_CAPTURE_SIZE
+#define HOY_CAPTURE_SIZE 128
+#endif
+
+enum class CaptureDirection_t : uint8_t {
+    Rx = 0,
+    Tx = 1,
+};
+
+struct RadioCaptureRecord_t {
+    uint32_t TimestampSec;
+    uint32_t TimestampUsec;
+    uint8_t Radio; // position in Hoymiles.getRadios()
+    CaptureDirection_t Direction;
+    uint8_t Channel; // nrf channel or cmt channel number
+    int8_t Rssi; // 0 for tx
+    uint8_t Len;
+    uint8_t Data[MAX_RF_PAYLOAD_SIZE];
+};
+
+// Binary ring of the sent and received raw fragments. The buffer is only allocated while
+// capturing is enabled, so a disabled capture costs one flag check per fragment.
+class RadioCapture {
+public:
+    void setEnabled(const bool enabled);
+    bool isEnabled() const;
+
+    void clear();
+    void add(const uint8_t radio, const CaptureDirection_t direction, const uint8_t channel, const int8_t rssi, const uint8_t data[], const uint8_t len);
+
+    // Copy of all records, the oldest first
+    std::vector<RadioCaptureRecord_t> getRecords();
+
+    size_t getCount();
+    uint32_t getOverwritten();
+
+private:
+    volatile bool _enabled = false;
+
+    std::vector<RadioCaptureRecord_t> _records;
+    size_t _head = 0;
+    size_t _count = 0;
+    uint32_t _overwritten = 0;
+
+    std::mutex _mutex;
+};
@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// Shared mutex (usable with std::shared_lock and std::unique_lock) which lets readers
+// in as long as no writer is active, even if one is waiting. So a task can take the
+// read lock again while already holding it, and readers which also hold other locks
+// do not deadlock against a waiting writer. Writers are rare (adding and removing
+// inverters) and wait until all readers are done.
+class ReaderPreferringMutex {
+public:
+    void lock_shared()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [this] { return !_writing; });
+        _readers++;
+    }
+
+    void unlock_shared()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (--_readers == 0) {
+            _cv.notify_all();
+        }
+    }
+
+    void lock()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [this] { return !_writing && _readers == 0; });
+        _writing = true;
+    }
+
+    void unlock()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _writing = false;
+        _cv.notify_all();
+    }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    uint16_t _readers = 0;
+    bool _writing = false;
+};
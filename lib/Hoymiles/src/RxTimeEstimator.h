@@ -0,0 +1,93 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Number of responses which have to be observed before the rx window is adapted
+#ifndef HOY_RX_TIMEOUT_MIN_SAMPLES
+#define HOY_RX_TIMEOUT_MIN_SAMPLES 8
+#endif
+
+// Lower bound of an adapted rx window in ms
+#ifndef HOY_RX_TIMEOUT_MIN
+#define HOY_RX_TIMEOUT_MIN 50
+#endif
+
+// Added to every adapted rx window in ms to cover the loop latency
+#ifndef HOY_RX_TIMEOUT_MARGIN
+#define HOY_RX_TIMEOUT_MARGIN 20
+#endif
+
+// Learns the response time of one command type of an inverter. The mean and the mean
+// deviation are smoothed like the TCP round trip time (RFC 6298). The rx window is set
+// to mean + 4 * deviation which covers more than 99% of the responses.
+class RxTimeEstimator {
+public:
+    // commandName has to be static, like the result of getCommandName()
+    explicit RxTimeEstimator(const char* commandName)
+        : _commandName(commandName)
+    {
+    }
+
+    const char* getCommandName() const
+    {
+        return _commandName;
+    }
+
+    // Time from the transmission until the response was complete in ms
+    void observe(const uint32_t time)
+    {
+        if (_count == 0) {
+            _mean = time;
+            _deviation = time / 2.0f;
+        } else {
+            const float error = time - _mean;
+            _mean += error / 8;
+            _deviation += (std::abs(error) - _deviation) / 4;
+        }
+        _count++;
+        _missed = false;
+    }
+
+    // An adapted rx window ended without a complete response. The next window uses the
+    // static timeout again, so a late response is observed and raises the estimation.
+    void markMissed()
+    {
+        _missed = true;
+    }
+
+    // Returns the rx window in ms which is never larger than the static timeout of the command
+    uint32_t getTimeout(const uint32_t limit) const
+    {
+        if (_count < HOY_RX_TIMEOUT_MIN_SAMPLES || _missed) {
+            return limit;
+        }
+
+        const uint32_t timeout = static_cast<uint32_t>(_mean + 4 * _deviation) + HOY_RX_TIMEOUT_MARGIN;
+        return std::min(std::max<uint32_t>(timeout, HOY_RX_TIMEOUT_MIN), limit);
+    }
+
+    uint32_t getCount() const
+    {
+        return _count;
+    }
+
+    float getMean() const
+    {
+        return _mean;
+    }
+
+    float getDeviation() const
+    {
+        return _deviation;
+    }
+
+private:
+    const char* _commandName;
+    float _mean = 0;
+    float _deviation = 0;
+    uint32_t _count = 0;
+    bool _missed = false;
+};
@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+// Number of answered requests over which the success rate is evaluated
+#ifndef HOY_TX_POWER_WINDOW
+#define HOY_TX_POWER_WINDOW 16
+#endif
+
+// Percentage of requests which have to be answered without resends or
+// re-requested fragments to keep or lower the transmit power
+#ifndef HOY_TX_POWER_TARGET
+#define HOY_TX_POWER_TARGET 90
+#endif
+
+// The power is only lowered while the inverter is received at least this strong (dBm)
+#ifndef HOY_TX_POWER_MIN_RSSI
+#define HOY_TX_POWER_MIN_RSSI -75
+#endif
+
+// Windows to wait before lowering the power again after a step up, doubled on
+// each failed attempt so the power does not oscillate around the limit
+#define HOY_TX_POWER_HOLD_MIN 2
+#define HOY_TX_POWER_HOLD_MAX 64
+
+// Closed loop transmit power of one inverter. It works with a reduction in steps
+// below the configured PA level, the radio maps the steps to its own levels.
+// Unanswered requests return to the configured level immediately.
+class TxPowerControl {
+public:
+    uint8_t getReduction() const
+    {
+        return _reduction;
+    }
+
+    uint32_t getChanges() const
+    {
+        return _changes;
+    }
+
+    // Result of a request which expects an answer. clean: answered without resends
+    // and re-requested fragments. maxReduction: lowest level of the radio.
+    void observe(const bool answered, const bool clean, const int8_t rssi, const uint8_t maxReduction)
+    {
+        if (!answered) {
+            if (_reduction > 0) {
+                setReduction(0);
+                _hold = _holdWindows;
+                _holdWindows = std::min<uint8_t>(_holdWindows * 2, HOY_TX_POWER_HOLD_MAX);
+            }
+            resetWindow();
+            return;
+        }
+
+        _requests++;
+        _clean += clean;
+        _rssiSum += rssi;
+        if (_requests < HOY_TX_POWER_WINDOW) {
+            return;
+        }
+
+        const uint8_t rate = _clean * 100 / _requests;
+        const int8_t rssiAvg = _rssiSum / _requests;
+        resetWindow();
+
+        if (rate < HOY_TX_POWER_TARGET) {
+            if (_reduction > 0) {
+                setReduction(_reduction - 1);
+                _hold = _holdWindows;
+                _holdWindows = std::min<uint8_t>(_holdWindows * 2, HOY_TX_POWER_HOLD_MAX);
+            }
+        } else if (_hold > 0) {
+            _hold--;
+        } else if (rssiAvg >= HOY_TX_POWER_MIN_RSSI && _reduction < maxReduction) {
+            setReduction(_reduction + 1);
+        }
+    }
+
+    void reset()
+    {
+        setReduction(0);
+        _hold = 0;
+        _holdWindows = HOY_TX_POWER_HOLD_MIN;
+        resetWindow();
+    }
+
+private:
+    void setReduction(const uint8_t reduction)
+    {
+        if (reduction != _reduction) {
+            _reduction = reduction;
+            _changes++;
+        }
+    }
+
+    void resetWindow()
+    {
+        _requests = 0;
+        _clean = 0;
+        _rssiSum = 0;
+    }
+
+    uint8_t _reduction = 0;
+    uint32_t _changes = 0;
+
+    uint8_t _requests = 0;
+    uint8_t _clean = 0;
+    int16_t _rssiSum = 0;
+
+    uint8_t _hold = 0;
+    uint8_t _holdWindows = HOY_TX_POWER_HOLD_MIN;
+};
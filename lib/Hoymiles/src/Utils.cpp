@@ -16,6 +16,7 @@ uint8_t Utils::getWeekDay()
 
 bool Utils::getTimeAvailable()
 {
-    struct tm timeinfo;
-    return getLocalTime(&timeinfo, 5);
+    // Same condition as getLocalTime() without waiting up to some
+    // milliseconds for the time to become valid
+    return time(nullptr) >= TIME_VALID_SINCE;
 }
@@ -3,6 +3,9 @@
 
 #include <cstdint>
 
+// Times before 2017-01-01 are the uninitialized clock counting from 1970
+#define TIME_VALID_SINCE 1483228800
+
 class Utils {
 public:
     static uint8_t getWeekDay();
@@ -21,6 +21,7 @@ Type: absolute / relative and persistant/non-persistant
 ID   Target Addr   Source Addr   Cmd  SCmd ?    Limit   Type    CRC16   CRC8
 */
 #include "ActivePowerControlCommand.h"
+#include "Hoymiles.h"
 #include "inverters/InverterAbstract.h"
 
 #define CRC_SIZE 6
@@ -42,11 +43,21 @@ ActivePowerControlCommand::ActivePowerControlCommand(InverterAbstract* inv, cons
     setTimeout(2000);
 }
 
-String ActivePowerControlCommand::getCommandName() const
+const char* ActivePowerControlCommand::getCommandName() const
 {
-    char buffer[30];
-    snprintf(buffer, sizeof(buffer), "ActivePowerControl (%02X)", getType());
-    return buffer;
+    // The statistics keep the pointer, so the name has to be static
+    switch (getType()) {
+    case AbsolutNonPersistent:
+        return "ActivePowerControl (00)";
+    case RelativNonPersistent:
+        return "ActivePowerControl (01)";
+    case AbsolutPersistent:
+        return "ActivePowerControl (100)";
+    case RelativPersistent:
+        return "ActivePowerControl (101)";
+    default:
+        return "ActivePowerControl";
+    }
 }
 
 bool ActivePowerControlCommand::areSameParameter(CommandAbstract* other)
@@ -70,9 +81,15 @@ void ActivePowerControlCommand::setActivePowerLimit(const float limit, const Pow
     udpateCRC(CRC_SIZE);
 }
 
-bool ActivePowerControlCommand::handleResponse(const fragment_t fragment[], const uint8_t max_fragment_id)
+void ActivePowerControlCommand::prepareTransmit()
+{
+    // A limit requested while this command waited in the queue replaces its limit
+    _inv->refreshActivePowerControlCommand(*this);
+}
+
+bool ActivePowerControlCommand::handleResponse(const FragmentPayload& payload)
 {
-    if (!DevControlCommand::handleResponse(fragment, max_fragment_id)) {
+    if (!DevControlCommand::handleResponse(payload)) {
         return false;
     }
 
@@ -87,10 +104,12 @@ bool ActivePowerControlCommand::handleResponse(const fragment_t fragment[], cons
         }
     }
     _inv->SystemConfigPara()->setLastUpdateCommand(millis());
+    _inv->SystemConfigPara()->requestReadback();
     std::shared_ptr<ActivePowerControlCommand> cmd(std::shared_ptr<ActivePowerControlCommand>(), this);
     if (_inv->getRadio()->countSimilarCommands(cmd) == 1) {
         _inv->SystemConfigPara()->setLastLimitCommandSuccess(CMD_OK);
     }
+    Hoymiles.notifyData(*_inv, InverterData_t::SystemConfigPara);
     return true;
 }
 
@@ -21,6 +21,7 @@ Command structure:
 ID   Target Addr   Source Addr   Idx  DT   ?    Time          Gap     AlarmId Password      CRC16   CRC8
 */
 #include "AlarmDataCommand.h"
+#include "Hoymiles.h"
 #include "inverters/InverterAbstract.h"
 
 AlarmDataCommand::AlarmDataCommand(InverterAbstract* inv, const uint64_t router_address, const time_t time)
@@ -31,29 +32,29 @@ AlarmDataCommand::AlarmDataCommand(InverterAbstract* inv, const uint64_t router_
     setTimeout(750);
 }
 
-String AlarmDataCommand::getCommandName() const
+const char* AlarmDataCommand::getCommandName() const
 {
     return "AlarmData";
 }
 
-bool AlarmDataCommand::handleResponse(const fragment_t fragment[], const uint8_t max_fragment_id)
+bool AlarmDataCommand::handleResponse(const FragmentPayload& payload)
 {
     // Check CRC of whole payload
-    if (!MultiDataCommand::handleResponse(fragment, max_fragment_id)) {
+    if (!MultiDataCommand::handleResponse(payload)) {
         return false;
     }
 
     // Move all fragments into target buffer
-    uint8_t offs = 0;
     _inv->EventLog()->beginAppendFragment();
     _inv->EventLog()->clearBuffer();
-    for (uint8_t i = 0; i < max_fragment_id; i++) {
-        _inv->EventLog()->appendFragment(offs, fragment[i].fragment, fragment[i].len);
-        offs += (fragment[i].len);
-    }
+    payload.forEachChunk([this](const uint8_t offs, const uint8_t* data, const uint8_t len) {
+        _inv->EventLog()->appendFragment(offs, data, len);
+    });
+    _inv->EventLog()->updateSequence();
     _inv->EventLog()->endAppendFragment();
     _inv->EventLog()->setLastAlarmRequestSuccess(CMD_OK);
     _inv->EventLog()->setLastUpdate(millis());
+    Hoymiles.notifyData(*_inv, InverterData_t::EventLog);
     return true;
 }
 
@@ -31,7 +31,7 @@ ChannelChangeCommand::ChannelChangeCommand(InverterAbstract* inv, const uint64_t
     setTimeout(10);
 }
 
-String ChannelChangeCommand::getCommandName() const
+const char* ChannelChangeCommand::getCommandName() const
 {
     return "ChannelChangeCommand";
 }
@@ -67,7 +67,7 @@ void ChannelChangeCommand::setCountryMode(const CountryModeId_t mode)
     }
 }
 
-bool ChannelChangeCommand::handleResponse(const fragment_t fragment[], const uint8_t max_fragment_id)
+bool ChannelChangeCommand::handleResponse(const FragmentPayload& payload)
 {
     return true;
 }
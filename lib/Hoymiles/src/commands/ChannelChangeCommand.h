@@ -8,14 +8,16 @@ class ChannelChangeCommand : public CommandAbstract {
 public:
     explicit ChannelChangeCommand(InverterAbstract* inv, const uint64_t router_address = 0, const uint8_t channel = 0);
 
-    virtual String getCommandName() const;
+    virtual const char* getCommandName() const;
 
     void setChannel(const uint8_t channel);
     uint8_t getChannel() const;
 
     void setCountryMode(const CountryModeId_t mode);
 
-    virtual bool handleResponse(const fragment_t fragment[], const uint8_t max_fragment_id);
+    virtual bool handleResponse(const FragmentPayload& payload);
 
     virtual uint8_t getMaxResendCount();
+
+    virtual bool expectsResponse() const { return false; }
 };
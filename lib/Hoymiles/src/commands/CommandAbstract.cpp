@@ -29,8 +29,12 @@ Source Address: 80 12 23 04
 #include "CommandAbstract.h"
 #include "../inverters/InverterAbstract.h"
 #include "crc.h"
+#include <algorithm>
+#include <atomic>
 #include <string.h>
 
+static std::atomic<uint32_t> nextTraceId { 1 };
+
 CommandAbstract::CommandAbstract(InverterAbstract* inv, const uint64_t router_address)
 {
     memset(_payload, 0, RF_LEN);
@@ -42,6 +46,8 @@ CommandAbstract::CommandAbstract(InverterAbstract* inv, const uint64_t router_ad
     setRouterAddress(router_address);
     setSendCount(0);
     setTimeout(0);
+
+    _traceId = nextTraceId.fetch_add(1, std::memory_order_relaxed);
 }
 
 const uint8_t* CommandAbstract::getDataPayload()
@@ -52,11 +58,17 @@ const uint8_t* CommandAbstract::getDataPayload()
 
 void CommandAbstract::dumpDataPayload(Print* stream)
 {
+    static constexpr char hex[] = "0123456789ABCDEF";
+    char line[RF_LEN * 3 + 1];
     const uint8_t* payload = getDataPayload();
-    for (uint8_t i = 0; i < getDataSize(); i++) {
-        stream->printf("%02X ", payload[i]);
+    const uint8_t len = std::min<uint8_t>(getDataSize(), RF_LEN);
+    for (uint8_t i = 0; i < len; i++) {
+        line[i * 3] = hex[payload[i] >> 4];
+        line[i * 3 + 1] = hex[payload[i] & 0x0f];
+        line[i * 3 + 2] = ' ';
     }
-    stream->println("");
+    line[len * 3] = '\0';
+    stream->println(line);
 }
 
 uint8_t CommandAbstract::getDataSize() const
@@ -69,6 +81,26 @@ void CommandAbstract::setTargetAddress(const uint64_t address)
     convertSerialToPacketId(&_payload[1], address);
     _targetAddress = address;
 }
+void CommandAbstract::setQueuedTime(const uint32_t time)
+{
+    _queuedTime = time;
+}
+
+uint32_t CommandAbstract::getQueuedTime() const
+{
+    return _queuedTime;
+}
+
+uint32_t CommandAbstract::getTraceId() const
+{
+    return _traceId;
+}
+
+uint32_t CommandAbstract::getNextTraceId()
+{
+    return nextTraceId.load(std::memory_order_relaxed);
+}
+
 uint64_t CommandAbstract::getTargetAddress() const
 {
     return _targetAddress;
@@ -139,8 +171,21 @@ uint8_t CommandAbstract::getMaxRetransmitCount() const
     return MAX_RETRANSMIT_COUNT;
 }
 
+uint32_t CommandAbstract::getCommandKey() const
+{
+    if (_commandKey == 0) {
+        // FNV-1a, the name does not change during the life time of the command
+        uint32_t hash = 2166136261u;
+        for (const char* c = getCommandName(); *c != '\0'; c++) {
+            hash = (hash ^ static_cast<uint8_t>(*c)) * 16777619u;
+        }
+        _commandKey = hash != 0 ? hash : 1;
+    }
+    return _commandKey;
+}
+
 bool CommandAbstract::areSameParameter(CommandAbstract* other)
 {
-    return this->getCommandName() == other->getCommandName()
+    return this->getCommandKey() == other->getCommandKey()
         && this->_targetAddress == other->getTargetAddress();
 }
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 #pragma once
 
+#include "FragmentPayload.h"
 #include "types.h"
 #include <Stream.h>
 #include <cstdint>
@@ -23,6 +24,15 @@ enum class QueueInsertType {
     ReplaceExistent,
 };
 
+// Commands of a higher priority class are dispatched first.
+// The order within a class is kept (FIFO).
+enum class CommandPriority : uint8_t {
+    Control,
+    Telemetry,
+};
+
+#define COMMAND_PRIORITY_COUNT 2
+
 class CommandAbstract {
 public:
     explicit CommandAbstract(InverterAbstract* inv, const uint64_t router_address = 0);
@@ -41,7 +51,10 @@ public:
     void setTimeout(const uint32_t timeout);
     uint32_t getTimeout() const;
 
-    virtual String getCommandName() const = 0;
+    virtual const char* getCommandName() const = 0;
+
+    // Hash of the command name, calculated once. Commands with the same key and target are similar.
+    uint32_t getCommandKey() const;
 
     void setSendCount(const uint8_t count);
     uint8_t getSendCount() const;
@@ -49,7 +62,10 @@ public:
 
     virtual CommandAbstract* getRequestFrameCommand(const uint8_t frame_no);
 
-    virtual bool handleResponse(const fragment_t fragment[], const uint8_t max_fragment_id) = 0;
+    // Called once right before the first packet of the command is transmitted
+    virtual void prepareTransmit() { }
+
+    virtual bool handleResponse(const FragmentPayload& payload) = 0;
     virtual void gotTimeout();
 
     // Sets the amount how often the specific command is resent if all fragments where missing
@@ -62,11 +78,25 @@ public:
     virtual QueueInsertType getQueueInsertType() const { return QueueInsertType::RemoveNewest; }
     virtual bool areSameParameter(CommandAbstract* other);
 
+    virtual CommandPriority getPriority() const { return CommandPriority::Telemetry; }
+
+    // Commands which are never answered do not tell whether the inverter is reachable
+    virtual bool expectsResponse() const { return true; }
+
+    void setQueuedTime(const uint32_t time);
+    uint32_t getQueuedTime() const;
+
+    // Unique number of the command, identifies it in the command traces
+    uint32_t getTraceId() const;
+    // Trace id the next created command will get
+    static uint32_t getNextTraceId();
+
 protected:
     uint8_t _payload[RF_LEN];
     uint8_t _payload_size;
     uint32_t _timeout;
     uint8_t _sendCount;
+    uint32_t _queuedTime = 0;
 
     uint64_t _targetAddress;
     uint64_t _routerAddress;
@@ -74,6 +104,9 @@ protected:
     InverterAbstract* _inv;
 
 private:
+    mutable uint32_t _commandKey = 0;
+    uint32_t _traceId;
+
     void setTargetAddress(const uint64_t address);
     static void convertSerialToPacketId(uint8_t buffer[], const uint64_t serial);
 };
@@ -7,7 +7,9 @@ class DevControlCommand : public CommandAbstract {
 public:
     explicit DevControlCommand(InverterAbstract* inv, const uint64_t router_address = 0);
 
-    virtual bool handleResponse(const fragment_t fragment[], const uint8_t max_fragment_id);
+    virtual bool handleResponse(const FragmentPayload& payload);
+
+    virtual CommandPriority getPriority() const { return CommandPriority::Control; }
 
 protected:
     void udpateCRC(const uint8_t len);
@@ -19,6 +19,7 @@ Command structure:
 ID   Target Addr   Source Addr   Idx  DT   ?    Time          Gap             Password      CRC16   CRC8
 */
 #include "DevInfoAllCommand.h"
+#include "Hoymiles.h"
 #include "inverters/InverterAbstract.h"
 
 DevInfoAllCommand::DevInfoAllCommand(InverterAbstract* inv, const uint64_t router_address, const time_t time)
@@ -29,27 +30,26 @@ DevInfoAllCommand::DevInfoAllCommand(InverterAbstract* inv, const uint64_t route
     setTimeout(200);
 }
 
-String DevInfoAllCommand::getCommandName() const
+const char* DevInfoAllCommand::getCommandName() const
 {
     return "DevInfoAll";
 }
 
-bool DevInfoAllCommand::handleResponse(const fragment_t fragment[], const uint8_t max_fragment_id)
+bool DevInfoAllCommand::handleResponse(const FragmentPayload& payload)
 {
     // Check CRC of whole payload
-    if (!MultiDataCommand::handleResponse(fragment, max_fragment_id)) {
+    if (!MultiDataCommand::handleResponse(payload)) {
         return false;
     }
 
     // Move all fragments into target buffer
-    uint8_t offs = 0;
     _inv->DevInfo()->beginAppendFragment();
     _inv->DevInfo()->clearBufferAll();
-    for (uint8_t i = 0; i < max_fragment_id; i++) {
-        _inv->DevInfo()->appendFragmentAll(offs, fragment[i].fragment, fragment[i].len);
-        offs += (fragment[i].len);
-    }
+    payload.forEachChunk([this](const uint8_t offs, const uint8_t* data, const uint8_t len) {
+        _inv->DevInfo()->appendFragmentAll(offs, data, len);
+    });
     _inv->DevInfo()->endAppendFragment();
     _inv->DevInfo()->setLastUpdateAll(millis());
+    Hoymiles.notifyData(*_inv, InverterData_t::DevInfo);
     return true;
 }
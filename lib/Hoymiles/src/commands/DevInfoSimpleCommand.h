@@ -7,7 +7,7 @@ class DevInfoSimpleCommand : public MultiDataCommand {
 public:
     explicit DevInfoSimpleCommand(InverterAbstract* inv, const uint64_t router_address = 0, const time_t time = 0);
 
-    virtual String getCommandName() const;
+    virtual const char* getCommandName() const;
 
-    virtual bool handleResponse(const fragment_t fragment[], const uint8_t max_fragment_id);
+    virtual bool handleResponse(const FragmentPayload& payload);
 };
@@ -30,27 +30,26 @@ GridOnProFilePara::GridOnProFilePara(InverterAbstract* inv, const uint64_t route
     setTimeout(500);
 }
 
-String GridOnProFilePara::getCommandName() const
+const char* GridOnProFilePara::getCommandName() const
 {
     return "GridOnProFilePara";
 }
 
-bool GridOnProFilePara::handleResponse(const fragment_t fragment[], const uint8_t max_fragment_id)
+bool GridOnProFilePara::handleResponse(const FragmentPayload& payload)
 {
     // Check CRC of whole payload
-    if (!MultiDataCommand::handleResponse(fragment, max_fragment_id)) {
+    if (!MultiDataCommand::handleResponse(payload)) {
         return false;
     }
 
     // Move all fragments into target buffer
-    uint8_t offs = 0;
     _inv->GridProfile()->beginAppendFragment();
     _inv->GridProfile()->clearBuffer();
-    for (uint8_t i = 0; i < max_fragment_id; i++) {
-        _inv->GridProfile()->appendFragment(offs, fragment[i].fragment, fragment[i].len);
-        offs += (fragment[i].len);
-    }
+    payload.forEachChunk([this](const uint8_t offs, const uint8_t* data, const uint8_t len) {
+        _inv->GridProfile()->appendFragment(offs, data, len);
+    });
     _inv->GridProfile()->endAppendFragment();
     _inv->GridProfile()->setLastUpdate(millis());
+    Hoymiles.notifyData(*_inv, InverterData_t::GridProfile);
     return true;
 }
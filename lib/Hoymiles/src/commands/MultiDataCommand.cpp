@@ -85,28 +85,17 @@ CommandAbstract* MultiDataCommand::getRequestFrameCommand(const uint8_t frame_no
     return &_cmdRequestFrame;
 }
 
-bool MultiDataCommand::handleResponse(const fragment_t fragment[], const uint8_t max_fragment_id)
+bool MultiDataCommand::handleResponse(const FragmentPayload& payload)
 {
-    // All fragments are available --> Check CRC
-    uint16_t crc = 0xffff, crcRcv = 0;
-
-    for (uint8_t i = 0; i < max_fragment_id; i++) {
+    for (uint8_t i = 0; i < payload.getFragmentCount(); i++) {
         // Doublecheck if correct answer package
-        if (fragment[i].mainCmd != (_payload[0] | 0x80)) {
+        if (payload[i].mainCmd != (_payload[0] | 0x80)) {
             return false;
         }
-
-        if (i == max_fragment_id - 1) {
-            // Last packet
-            crc = crc16(fragment[i].fragment, fragment[i].len - 2, crc);
-            crcRcv = (fragment[i].fragment[fragment[i].len - 2] << 8)
-                | (fragment[i].fragment[fragment[i].len - 1]);
-        } else {
-            crc = crc16(fragment[i].fragment, fragment[i].len, crc);
-        }
     }
 
-    return crc == crcRcv;
+    // All fragments are available --> Check CRC of whole payload
+    return payload.isCrcValid();
 }
 
 void MultiDataCommand::udpateCRC()
@@ -115,12 +104,3 @@ void MultiDataCommand::udpateCRC()
     _payload[24] = static_cast<uint8_t>(crc >> 8);
     _payload[25] = static_cast<uint8_t>(crc);
 }
-
-uint8_t MultiDataCommand::getTotalFragmentSize(const fragment_t fragment[], const uint8_t max_fragment_id)
-{
-    uint8_t fragmentSize = 0;
-    for (uint8_t i = 0; i < max_fragment_id; i++) {
-        fragmentSize += fragment[i].len;
-    }
-    return fragmentSize;
-}
@@ -14,13 +14,12 @@ public:
 
     CommandAbstract* getRequestFrameCommand(const uint8_t frame_no);
 
-    virtual bool handleResponse(const fragment_t fragment[], const uint8_t max_fragment_id);
+    virtual bool handleResponse(const FragmentPayload& payload);
 
 protected:
     void setDataType(const uint8_t data_type);
     uint8_t getDataType() const;
     void udpateCRC();
-    static uint8_t getTotalFragmentSize(const fragment_t fragment[], const uint8_t max_fragment_id);
 
     RequestFrameCommand _cmdRequestFrame;
 };
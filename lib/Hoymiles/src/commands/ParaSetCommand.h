@@ -6,4 +6,6 @@
 class ParaSetCommand : public CommandAbstract {
 public:
     explicit ParaSetCommand(InverterAbstract* inv, const uint64_t router_address = 0);
+
+    virtual CommandPriority getPriority() const { return CommandPriority::Control; }
 };
@@ -22,6 +22,7 @@ SCmd: Sub-Command ID
 ID   Target Addr   Source Addr   Cmd  SCmd ?    CRC16   CRC8
 */
 #include "PowerControlCommand.h"
+#include "Hoymiles.h"
 #include "inverters/InverterAbstract.h"
 
 #define CRC_SIZE 2
@@ -39,19 +40,24 @@ PowerControlCommand::PowerControlCommand(InverterAbstract* inv, const uint64_t r
     setTimeout(2000);
 }
 
-String PowerControlCommand::getCommandName() const
+const char* PowerControlCommand::getCommandName() const
 {
     return "PowerControl";
 }
 
-bool PowerControlCommand::handleResponse(const fragment_t fragment[], const uint8_t max_fragment_id)
+bool PowerControlCommand::handleResponse(const FragmentPayload& payload)
 {
-    if (!DevControlCommand::handleResponse(fragment, max_fragment_id)) {
+    if (!DevControlCommand::handleResponse(payload)) {
         return false;
     }
 
     _inv->PowerCommand()->setLastUpdateCommand(millis());
     _inv->PowerCommand()->setLastPowerCommandSuccess(CMD_OK);
+    if (_payload[10] == 0x02) {
+        // A restart drops the non persistent limit
+        _inv->SystemConfigPara()->requestReadback();
+    }
+    Hoymiles.notifyData(*_inv, InverterData_t::PowerCommand);
     return true;
 }
 
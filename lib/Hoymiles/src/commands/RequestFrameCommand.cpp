@@ -32,7 +32,7 @@ RequestFrameCommand::RequestFrameCommand(InverterAbstract* inv, const uint64_t r
     _payload_size = 10;
 }
 
-String RequestFrameCommand::getCommandName() const
+const char* RequestFrameCommand::getCommandName() const
 {
     return "RequestFrame";
 }
@@ -47,7 +47,7 @@ uint8_t RequestFrameCommand::getFrameNo() const
     return _payload[9] & (~0x80);
 }
 
-bool RequestFrameCommand::handleResponse(const fragment_t fragment[], const uint8_t max_fragment_id)
+bool RequestFrameCommand::handleResponse(const FragmentPayload& payload)
 {
     return true;
 }
@@ -30,40 +30,39 @@ SystemConfigParaCommand::SystemConfigParaCommand(InverterAbstract* inv, const ui
     setTimeout(200);
 }
 
-String SystemConfigParaCommand::getCommandName() const
+const char* SystemConfigParaCommand::getCommandName() const
 {
     return "SystemConfigPara";
 }
 
-bool SystemConfigParaCommand::handleResponse(const fragment_t fragment[], const uint8_t max_fragment_id)
+bool SystemConfigParaCommand::handleResponse(const FragmentPayload& payload)
 {
     // Check CRC of whole payload
-    if (!MultiDataCommand::handleResponse(fragment, max_fragment_id)) {
+    if (!MultiDataCommand::handleResponse(payload)) {
         return false;
     }
 
     // Check if at least all required bytes are received
     // In case of low power in the inverter it occours that some incomplete fragments
     // with a valid CRC are received.
-    const uint8_t fragmentsSize = getTotalFragmentSize(fragment, max_fragment_id);
+    const uint8_t fragmentsSize = payload.size();
     const uint8_t expectedSize = _inv->SystemConfigPara()->getExpectedByteCount();
     if (fragmentsSize < expectedSize) {
-        Hoymiles.getMessageOutput()->printf("ERROR in %s: Received fragment size: %" PRId8 ", min expected size: %" PRId8 "\r\n",
-            getCommandName().c_str(), fragmentsSize, expectedSize);
+        HOY_LOGE("ERROR in %s: Received fragment size: %" PRId8 ", min expected size: %" PRId8 "\r\n",
+            getCommandName(), fragmentsSize, expectedSize);
 
         return false;
     }
 
     // Move all fragments into target buffer
-    uint8_t offs = 0;
     _inv->SystemConfigPara()->beginAppendFragment();
     _inv->SystemConfigPara()->clearBuffer();
-    for (uint8_t i = 0; i < max_fragment_id; i++) {
-        _inv->SystemConfigPara()->appendFragment(offs, fragment[i].fragment, fragment[i].len);
-        offs += (fragment[i].len);
-    }
+    payload.forEachChunk([this](const uint8_t offs, const uint8_t* data, const uint8_t len) {
+        _inv->SystemConfigPara()->appendFragment(offs, data, len);
+    });
     _inv->SystemConfigPara()->endAppendFragment();
     _inv->SystemConfigPara()->setLastUpdateRequest(millis());
+    Hoymiles.notifyData(*_inv, InverterData_t::SystemConfigPara);
     _inv->SystemConfigPara()->setLastLimitRequestSuccess(CMD_OK);
     return true;
 }
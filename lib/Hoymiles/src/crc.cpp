@@ -1,39 +1,112 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 /*
- * Copyright (C) 2022 Thomas Basler and others
+ * Copyright (C) 2022 - 2025 Thomas Basler and others
  */
 #include "crc.h"
+#include "types.h"
+#include <array>
 
-uint8_t crc8(const uint8_t buf[], const uint8_t len)
+#if HOY_CRC_TABLE != HOY_CRC_BITWISE
+
+// The lookup tables are generated at compile time and end up in flash
+#if HOY_CRC_TABLE == HOY_CRC_NIBBLE
+#define CRC_TABLE_BITS 4
+#else
+#define CRC_TABLE_BITS 8
+#endif
+#define CRC_TABLE_SIZE (1 << CRC_TABLE_BITS)
+
+template <typename T>
+using crcTable_t = std::array<T, CRC_TABLE_SIZE>;
+
+static constexpr crcTable_t<uint8_t> createCrc8Table()
+{
+    crcTable_t<uint8_t> table {};
+    for (uint16_t i = 0; i < CRC_TABLE_SIZE; i++) {
+        uint8_t crc = i << (8 - CRC_TABLE_BITS);
+        for (uint8_t b = 0; b < CRC_TABLE_BITS; b++) {
+            crc = (crc << 1) ^ ((crc & 0x80) ? CRC8_POLY : 0x00);
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+static constexpr crcTable_t<uint16_t> createCrc16Table()
+{
+    crcTable_t<uint16_t> table {};
+    for (uint16_t i = 0; i < CRC_TABLE_SIZE; i++) {
+        uint16_t crc = i;
+        for (uint8_t b = 0; b < CRC_TABLE_BITS; b++) {
+            crc = (crc & 0x0001) ? ((crc >> 1) ^ CRC16_MODBUS_POLYNOM) : (crc >> 1);
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+static constexpr crcTable_t<uint16_t> createCrc16Nrf24Table()
+{
+    crcTable_t<uint16_t> table {};
+    for (uint16_t i = 0; i < CRC_TABLE_SIZE; i++) {
+        uint16_t crc = i << (16 - CRC_TABLE_BITS);
+        for (uint8_t b = 0; b < CRC_TABLE_BITS; b++) {
+            crc = (crc & 0x8000) ? ((crc << 1) ^ CRC16_NRF24_POLYNOM) : (crc << 1);
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+static constexpr crcTable_t<uint8_t> HOY_RX_DATA_ATTR crc8Table = createCrc8Table();
+static constexpr crcTable_t<uint16_t> HOY_RX_DATA_ATTR crc16Table = createCrc16Table();
+static constexpr crcTable_t<uint16_t> crc16Nrf24Table = createCrc16Nrf24Table();
+
+#endif
+
+uint8_t HOY_RX_ATTR crc8(const uint8_t buf[], const uint8_t len)
 {
     uint8_t crc = CRC8_INIT;
     for (uint8_t i = 0; i < len; i++) {
+#if HOY_CRC_TABLE == HOY_CRC_BYTE
+        crc = crc8Table[crc ^ buf[i]];
+#elif HOY_CRC_TABLE == HOY_CRC_NIBBLE
+        crc = (crc << 4) ^ crc8Table[(crc >> 4) ^ (buf[i] >> 4)];
+        crc = (crc << 4) ^ crc8Table[(crc >> 4) ^ (buf[i] & 0x0f)];
+#else
         crc ^= buf[i];
         for (uint8_t b = 0; b < 8; b++) {
             crc = (crc << 1) ^ ((crc & 0x80) ? CRC8_POLY : 0x00);
         }
+#endif
     }
     return crc;
 }
 
-uint16_t crc16(const uint8_t buf[], const uint8_t len, const uint16_t start)
+uint16_t HOY_RX_ATTR crc16(const uint8_t buf[], const uint8_t len, const uint16_t start)
 {
     uint16_t crc = start;
-    uint8_t shift = 0;
 
     for (uint8_t i = 0; i < len; i++) {
+#if HOY_CRC_TABLE == HOY_CRC_BYTE
+        crc = (crc >> 8) ^ crc16Table[(crc ^ buf[i]) & 0xff];
+#elif HOY_CRC_TABLE == HOY_CRC_NIBBLE
+        crc = (crc >> 4) ^ crc16Table[(crc ^ buf[i]) & 0x0f];
+        crc = (crc >> 4) ^ crc16Table[(crc ^ (buf[i] >> 4)) & 0x0f];
+#else
         crc = crc ^ buf[i];
         for (uint8_t bit = 0; bit < 8; bit++) {
-            shift = (crc & 0x0001);
+            const uint8_t shift = (crc & 0x0001);
             crc = crc >> 1;
             if (shift != 0)
-                crc = crc ^ 0xA001;
+                crc = crc ^ CRC16_MODBUS_POLYNOM;
         }
+#endif
     }
     return crc;
 }
 
-uint16_t crc16nrf24(const uint8_t buf[], const uint16_t lenBits, const uint16_t startBit, const uint16_t crcIn)
+static uint16_t crc16nrf24Bitwise(const uint8_t buf[], const uint16_t lenBits, const uint16_t startBit, const uint16_t crcIn)
 {
     uint16_t crc = crcIn;
     uint8_t idx, val = buf[(startBit >> 3)];
@@ -47,4 +120,43 @@ uint16_t crc16nrf24(const uint8_t buf[], const uint16_t lenBits, const uint16_t
     }
 
     return crc;
-}
\ No newline at end of file
+}
+
+uint16_t crc16nrf24(const uint8_t buf[], const uint16_t lenBits, const uint16_t startBit, const uint16_t crcIn)
+{
+#if HOY_CRC_TABLE == HOY_CRC_BITWISE
+    return crc16nrf24Bitwise(buf, lenBits, startBit, crcIn);
+#else
+    if (startBit >= lenBits) {
+        return crcIn;
+    }
+
+    // Process the leading bits until the start is byte aligned
+    uint16_t bit = startBit;
+    const uint16_t alignedStart = (startBit + 7) & ~0x07;
+    uint16_t crc = crcIn;
+    if (alignedStart != startBit) {
+        bit = alignedStart < lenBits ? alignedStart : lenBits;
+        crc = crc16nrf24Bitwise(buf, bit, startBit, crc);
+    }
+
+    // Process all complete bytes using the table
+    const uint16_t endByte = lenBits >> 3;
+    for (uint16_t i = bit >> 3; i < endByte; i++) {
+#if HOY_CRC_TABLE == HOY_CRC_BYTE
+        crc = (crc << 8) ^ crc16Nrf24Table[(crc >> 8) ^ buf[i]];
+#else
+        crc = (crc << 4) ^ crc16Nrf24Table[(crc >> 12) ^ (buf[i] >> 4)];
+        crc = (crc << 4) ^ crc16Nrf24Table[(crc >> 12) ^ (buf[i] & 0x0f)];
+#endif
+        bit = (i + 1) << 3;
+    }
+
+    // Process the remaining bits
+    if (bit < lenBits) {
+        crc = crc16nrf24Bitwise(buf, lenBits, bit, crc);
+    }
+
+    return crc;
+#endif
+}
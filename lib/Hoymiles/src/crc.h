@@ -9,6 +9,16 @@
 #define CRC16_MODBUS_POLYNOM 0xA001
 #define CRC16_NRF24_POLYNOM 0x1021
 
+// Implementation of the crc kernels, trades flash for speed
+// 0: bitwise (no tables), 1: nibble tables (80 bytes), 2: byte tables (1280 bytes)
+#define HOY_CRC_BITWISE 0
+#define HOY_CRC_NIBBLE 1
+#define HOY_CRC_BYTE 2
+
+#ifndef HOY_CRC_TABLE
+#define HOY_CRC_TABLE HOY_CRC_BYTE
+#endif
+
 uint8_t crc8(const uint8_t buf[], const uint8_t len);
 uint16_t crc16(const uint8_t buf[], const uint8_t len, const uint16_t start = 0xffff);
 uint16_t crc16nrf24(const uint8_t buf[], const uint16_t lenBits, const uint16_t startBit = 0, const uint16_t crcIn = 0xffff);
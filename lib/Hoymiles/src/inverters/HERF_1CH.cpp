@@ -4,8 +4,9 @@
  * Copyright (C) 2022-2024 Thomas Basler and others
  */
 #include "HERF_1CH.h"
+#include "../parser/StatisticsDecoder.h"
 
-static const byteAssign_t byteAssignment[] = {
+static constexpr byteAssign_t byteAssignment[] = {
     { TYPE_DC, CH0, FLD_UDC, UNIT_V, 2, 2, 10, false, 1 },
     { TYPE_DC, CH0, FLD_IDC, UNIT_A, 6, 2, 100, false, 2 },
     { TYPE_DC, CH0, FLD_PDC, UNIT_W, 10, 2, 10, false, 1 },
@@ -29,6 +30,17 @@ static const byteAssign_t byteAssignment[] = {
     { TYPE_INV, CH0, FLD_EFF, UNIT_PCT, CALC_TOTAL_EFF, 0, CMD_CALC, false, 3 }
 };
 
+const InverterModel_t HERF_1CH::Model = {
+    "HERF-300-1T",
+    InverterRadioType_t::Nrf,
+    HERF_1CH::isValidSerial,
+    createInverterModel<HERF_1CH>,
+    byteAssignment,
+    sizeof(byteAssignment) / sizeof(byteAssignment[0]),
+    decodeStatisticFields<byteAssignment>,
+    getDcChannelCount(byteAssignment),
+};
+
 HERF_1CH::HERF_1CH(HoymilesRadio* radio, const uint64_t serial)
     : HM_Abstract(radio, serial)
 {
@@ -41,17 +53,22 @@ bool HERF_1CH::isValidSerial(const uint64_t serial)
     return preSerial == 0x2841;
 }
 
-String HERF_1CH::typeName() const
+const char* HERF_1CH::typeName() const
 {
-    return "HERF-300-1T";
+    return Model.TypeName;
 }
 
 const byteAssign_t* HERF_1CH::getByteAssignment() const
 {
-    return byteAssignment;
+    return Model.ByteAssignment;
 }
 
 uint8_t HERF_1CH::getByteAssignmentSize() const
 {
-    return sizeof(byteAssignment) / sizeof(byteAssignment[0]);
+    return Model.ByteAssignmentSize;
+}
+
+fieldDecoder_t HERF_1CH::getFieldDecoder() const
+{
+    return Model.FieldDecoder;
 }
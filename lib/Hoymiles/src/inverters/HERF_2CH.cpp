@@ -4,8 +4,9 @@
  * Copyright (C) 2022-2024 Thomas Basler and others
  */
 #include "HERF_2CH.h"
+#include "../parser/StatisticsDecoder.h"
 
-static const byteAssign_t byteAssignment[] = {
+static constexpr byteAssign_t byteAssignment[] = {
     { TYPE_DC, CH0, FLD_UDC, UNIT_V, 2, 2, 10, false, 1 },
     { TYPE_DC, CH0, FLD_IDC, UNIT_A, 6, 2, 100, false, 2 },
     { TYPE_DC, CH0, FLD_PDC, UNIT_W, 10, 2, 10, false, 1 },
@@ -36,6 +37,17 @@ static const byteAssign_t byteAssignment[] = {
     { TYPE_INV, CH0, FLD_EFF, UNIT_PCT, CALC_TOTAL_EFF, 0, CMD_CALC, false, 3 }
 };
 
+const InverterModel_t HERF_2CH::Model = {
+    "HERF-600/800-2T",
+    InverterRadioType_t::Nrf,
+    HERF_2CH::isValidSerial,
+    createInverterModel<HERF_2CH>,
+    byteAssignment,
+    sizeof(byteAssignment) / sizeof(byteAssignment[0]),
+    decodeStatisticFields<byteAssignment>,
+    getDcChannelCount(byteAssignment),
+};
+
 HERF_2CH::HERF_2CH(HoymilesRadio* radio, const uint64_t serial)
     : HM_Abstract(radio, serial)
 {
@@ -48,17 +60,22 @@ bool HERF_2CH::isValidSerial(const uint64_t serial)
     return preSerial == 0x2821;
 }
 
-String HERF_2CH::typeName() const
+const char* HERF_2CH::typeName() const
 {
-    return "HERF-600/800-2T";
+    return Model.TypeName;
 }
 
 const byteAssign_t* HERF_2CH::getByteAssignment() const
 {
-    return byteAssignment;
+    return Model.ByteAssignment;
 }
 
 uint8_t HERF_2CH::getByteAssignmentSize() const
 {
-    return sizeof(byteAssignment) / sizeof(byteAssignment[0]);
+    return Model.ByteAssignmentSize;
+}
+
+fieldDecoder_t HERF_2CH::getFieldDecoder() const
+{
+    return Model.FieldDecoder;
 }
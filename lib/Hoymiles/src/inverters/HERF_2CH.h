@@ -7,7 +7,9 @@ class HERF_2CH : public HM_Abstract {
 public:
     explicit HERF_2CH(HoymilesRadio* radio, const uint64_t serial);
     static bool isValidSerial(const uint64_t serial);
-    String typeName() const;
+    static const InverterModel_t Model;
+    const char* typeName() const;
     const byteAssign_t* getByteAssignment() const;
     uint8_t getByteAssignmentSize() const;
+    fieldDecoder_t getFieldDecoder() const;
 };
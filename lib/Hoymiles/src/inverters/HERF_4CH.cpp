@@ -4,6 +4,19 @@
  */
 #include "HERF_4CH.h"
 
+// Shares the byte assignment of HM_4CH. That model is constant initialized, so it is
+// complete before this one is set up during the dynamic initialization.
+const InverterModel_t HERF_4CH::Model = {
+    "HERF-1600/1800-4T",
+    InverterRadioType_t::Nrf,
+    HERF_4CH::isValidSerial,
+    createInverterModel<HERF_4CH>,
+    HM_4CH::Model.ByteAssignment,
+    HM_4CH::Model.ByteAssignmentSize,
+    HM_4CH::Model.FieldDecoder,
+    HM_4CH::Model.ChannelCount,
+};
+
 HERF_4CH::HERF_4CH(HoymilesRadio* radio, const uint64_t serial)
     : HM_4CH(radio, serial)
 {
@@ -16,7 +29,7 @@ bool HERF_4CH::isValidSerial(const uint64_t serial)
     return preSerial == 0x2801;
 }
 
-String HERF_4CH::typeName() const
+const char* HERF_4CH::typeName() const
 {
-    return "HERF-1600/1800-4T";
+    return Model.TypeName;
 }
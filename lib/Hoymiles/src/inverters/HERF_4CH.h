@@ -7,5 +7,6 @@ class HERF_4CH : public HM_4CH {
 public:
     explicit HERF_4CH(HoymilesRadio* radio, const uint64_t serial);
     static bool isValidSerial(const uint64_t serial);
-    String typeName() const;
+    static const InverterModel_t Model;
+    const char* typeName() const;
 };
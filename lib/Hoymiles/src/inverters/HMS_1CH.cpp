@@ -3,8 +3,9 @@
  * Copyright (C) 2023-2024 Thomas Basler and others
  */
 #include "HMS_1CH.h"
+#include "../parser/StatisticsDecoder.h"
 
-static const byteAssign_t byteAssignment[] = {
+static constexpr byteAssign_t byteAssignment[] = {
     { TYPE_DC, CH0, FLD_UDC, UNIT_V, 2, 2, 10, false, 1 },
     { TYPE_DC, CH0, FLD_IDC, UNIT_A, 4, 2, 100, false, 2 },
     { TYPE_DC, CH0, FLD_PDC, UNIT_W, 6, 2, 10, false, 1 },
@@ -28,6 +29,17 @@ static const byteAssign_t byteAssignment[] = {
     { TYPE_INV, CH0, FLD_EFF, UNIT_PCT, CALC_TOTAL_EFF, 0, CMD_CALC, false, 3 }
 };
 
+const InverterModel_t HMS_1CH::Model = {
+    "HMS-300/350/400/450/500-1T",
+    InverterRadioType_t::Cmt,
+    HMS_1CH::isValidSerial,
+    createInverterModel<HMS_1CH>,
+    byteAssignment,
+    sizeof(byteAssignment) / sizeof(byteAssignment[0]),
+    decodeStatisticFields<byteAssignment>,
+    getDcChannelCount(byteAssignment),
+};
+
 HMS_1CH::HMS_1CH(HoymilesRadio* radio, const uint64_t serial)
     : HMS_Abstract(radio, serial)
 {
@@ -40,17 +52,22 @@ bool HMS_1CH::isValidSerial(const uint64_t serial)
     return preSerial == 0x1124;
 }
 
-String HMS_1CH::typeName() const
+const char* HMS_1CH::typeName() const
 {
-    return "HMS-300/350/400/450/500-1T";
+    return Model.TypeName;
 }
 
 const byteAssign_t* HMS_1CH::getByteAssignment() const
 {
-    return byteAssignment;
+    return Model.ByteAssignment;
 }
 
 uint8_t HMS_1CH::getByteAssignmentSize() const
 {
-    return sizeof(byteAssignment) / sizeof(byteAssignment[0]);
+    return Model.ByteAssignmentSize;
+}
+
+fieldDecoder_t HMS_1CH::getFieldDecoder() const
+{
+    return Model.FieldDecoder;
 }
@@ -8,7 +8,9 @@ class HMS_1CH : public HMS_Abstract {
 public:
     explicit HMS_1CH(HoymilesRadio* radio, const uint64_t serial);
     static bool isValidSerial(const uint64_t serial);
-    String typeName() const;
+    static const InverterModel_t Model;
+    const char* typeName() const;
     const byteAssign_t* getByteAssignment() const;
     uint8_t getByteAssignmentSize() const;
+    fieldDecoder_t getFieldDecoder() const;
 };
\ No newline at end of file
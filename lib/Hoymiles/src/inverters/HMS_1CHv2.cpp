@@ -3,8 +3,9 @@
  * Copyright (C) 2023-2024 Thomas Basler and others
  */
 #include "HMS_1CHv2.h"
+#include "../parser/StatisticsDecoder.h"
 
-static const byteAssign_t byteAssignment[] = {
+static constexpr byteAssign_t byteAssignment[] = {
     { TYPE_DC, CH0, FLD_UDC, UNIT_V, 2, 2, 10, false, 1 },
     { TYPE_DC, CH0, FLD_IDC, UNIT_A, 6, 2, 100, false, 2 },
     { TYPE_DC, CH0, FLD_PDC, UNIT_W, 10, 2, 10, false, 1 },
@@ -28,6 +29,17 @@ static const byteAssign_t byteAssignment[] = {
     { TYPE_INV, CH0, FLD_EFF, UNIT_PCT, CALC_TOTAL_EFF, 0, CMD_CALC, false, 3 }
 };
 
+const InverterModel_t HMS_1CHv2::Model = {
+    "HMS-450/500-1T v2",
+    InverterRadioType_t::Cmt,
+    HMS_1CHv2::isValidSerial,
+    createInverterModel<HMS_1CHv2>,
+    byteAssignment,
+    sizeof(byteAssignment) / sizeof(byteAssignment[0]),
+    decodeStatisticFields<byteAssignment>,
+    getDcChannelCount(byteAssignment),
+};
+
 HMS_1CHv2::HMS_1CHv2(HoymilesRadio* radio, const uint64_t serial)
     : HMS_Abstract(radio, serial)
 {
@@ -40,17 +52,22 @@ bool HMS_1CHv2::isValidSerial(const uint64_t serial)
     return preSerial == 0x1125 || preSerial == 0x1400;
 }
 
-String HMS_1CHv2::typeName() const
+const char* HMS_1CHv2::typeName() const
 {
-    return "HMS-450/500-1T v2";
+    return Model.TypeName;
 }
 
 const byteAssign_t* HMS_1CHv2::getByteAssignment() const
 {
-    return byteAssignment;
+    return Model.ByteAssignment;
 }
 
 uint8_t HMS_1CHv2::getByteAssignmentSize() const
 {
-    return sizeof(byteAssignment) / sizeof(byteAssignment[0]);
+    return Model.ByteAssignmentSize;
+}
+
+fieldDecoder_t HMS_1CHv2::getFieldDecoder() const
+{
+    return Model.FieldDecoder;
 }
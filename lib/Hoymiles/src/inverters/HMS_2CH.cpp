@@ -3,8 +3,9 @@
  * Copyright (C) 2023-2024 Thomas Basler and others
  */
 #include "HMS_2CH.h"
+#include "../parser/StatisticsDecoder.h"
 
-static const byteAssign_t byteAssignment[] = {
+static constexpr byteAssign_t byteAssignment[] = {
     { TYPE_DC, CH0, FLD_UDC, UNIT_V, 2, 2, 10, false, 1 },
     { TYPE_DC, CH0, FLD_IDC, UNIT_A, 6, 2, 100, false, 2 },
     { TYPE_DC, CH0, FLD_PDC, UNIT_W, 10, 2, 10, false, 1 },
@@ -35,6 +36,17 @@ static const byteAssign_t byteAssignment[] = {
     { TYPE_INV, CH0, FLD_EFF, UNIT_PCT, CALC_TOTAL_EFF, 0, CMD_CALC, false, 3 }
 };
 
+const InverterModel_t HMS_2CH::Model = {
+    "HMS-600/700/800/900/1000-2T",
+    InverterRadioType_t::Cmt,
+    HMS_2CH::isValidSerial,
+    createInverterModel<HMS_2CH>,
+    byteAssignment,
+    sizeof(byteAssignment) / sizeof(byteAssignment[0]),
+    decodeStatisticFields<byteAssignment>,
+    getDcChannelCount(byteAssignment),
+};
+
 HMS_2CH::HMS_2CH(HoymilesRadio* radio, const uint64_t serial)
     : HMS_Abstract(radio, serial)
 {
@@ -47,17 +59,22 @@ bool HMS_2CH::isValidSerial(const uint64_t serial)
     return preSerial == 0x1144 || preSerial == 0x1143 || preSerial == 0x1410;
 }
 
-String HMS_2CH::typeName() const
+const char* HMS_2CH::typeName() const
 {
-    return "HMS-600/700/800/900/1000-2T";
+    return Model.TypeName;
 }
 
 const byteAssign_t* HMS_2CH::getByteAssignment() const
 {
-    return byteAssignment;
+    return Model.ByteAssignment;
 }
 
 uint8_t HMS_2CH::getByteAssignmentSize() const
 {
-    return sizeof(byteAssignment) / sizeof(byteAssignment[0]);
+    return Model.ByteAssignmentSize;
+}
+
+fieldDecoder_t HMS_2CH::getFieldDecoder() const
+{
+    return Model.FieldDecoder;
 }
@@ -3,8 +3,9 @@
  * Copyright (C) 2023-2024 Thomas Basler and others
  */
 #include "HMS_4CH.h"
+#include "../parser/StatisticsDecoder.h"
 
-static const byteAssign_t byteAssignment[] = {
+static constexpr byteAssign_t byteAssignment[] = {
     { TYPE_DC, CH0, FLD_UDC, UNIT_V, 2, 2, 10, false, 1 },
     { TYPE_DC, CH0, FLD_IDC, UNIT_A, 6, 2, 100, false, 2 },
     { TYPE_DC, CH0, FLD_PDC, UNIT_W, 10, 2, 10, false, 1 },
@@ -49,6 +50,17 @@ static const byteAssign_t byteAssignment[] = {
     { TYPE_INV, CH0, FLD_EFF, UNIT_PCT, CALC_TOTAL_EFF, 0, CMD_CALC, false, 3 }
 };
 
+const InverterModel_t HMS_4CH::Model = {
+    "HMS-1600/1800/2000-4T",
+    InverterRadioType_t::Cmt,
+    HMS_4CH::isValidSerial,
+    createInverterModel<HMS_4CH>,
+    byteAssignment,
+    sizeof(byteAssignment) / sizeof(byteAssignment[0]),
+    decodeStatisticFields<byteAssignment>,
+    getDcChannelCount(byteAssignment),
+};
+
 HMS_4CH::HMS_4CH(HoymilesRadio* radio, const uint64_t serial)
     : HMS_Abstract(radio, serial)
 {
@@ -61,19 +73,19 @@ bool HMS_4CH::isValidSerial(const uint64_t serial)
     return preSerial == 0x1164 || preSerial == 0x1420;
 }
 
-String HMS_4CH::typeName() const
+const char* HMS_4CH::typeName() const
 {
-    return "HMS-1600/1800/2000-4T";
+    return Model.TypeName;
 }
 
 const byteAssign_t* HMS_4CH::getByteAssignment() const
 {
-    return byteAssignment;
+    return Model.ByteAssignment;
 }
 
 uint8_t HMS_4CH::getByteAssignmentSize() const
 {
-    return sizeof(byteAssignment) / sizeof(byteAssignment[0]);
+    return Model.ByteAssignmentSize;
 }
 
 bool HMS_4CH::supportsPowerDistributionLogic()
@@ -82,3 +94,8 @@ bool HMS_4CH::supportsPowerDistributionLogic()
     // will limit the AC output instead of limiting the DC inputs.
     return DevInfo()->getFwBuildVersion() >= 10112U;
 }
+
+fieldDecoder_t HMS_4CH::getFieldDecoder() const
+{
+    return Model.FieldDecoder;
+}
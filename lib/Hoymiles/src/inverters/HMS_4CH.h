@@ -7,8 +7,10 @@ class HMS_4CH : public HMS_Abstract {
 public:
     explicit HMS_4CH(HoymilesRadio* radio, const uint64_t serial);
     static bool isValidSerial(const uint64_t serial);
-    String typeName() const;
+    static const InverterModel_t Model;
+    const char* typeName() const;
     const byteAssign_t* getByteAssignment() const;
     uint8_t getByteAssignmentSize() const;
+    fieldDecoder_t getFieldDecoder() const;
     bool supportsPowerDistributionLogic() final;
 };
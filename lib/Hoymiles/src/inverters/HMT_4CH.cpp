@@ -3,8 +3,9 @@
  * Copyright (C) 2023-2024 Thomas Basler and others
  */
 #include "HMT_4CH.h"
+#include "../parser/StatisticsDecoder.h"
 
-static const byteAssign_t byteAssignment[] = {
+static constexpr byteAssign_t byteAssignment[] = {
     { TYPE_DC, CH0, FLD_UDC, UNIT_V, 2, 2, 10, false, 1 },
     { TYPE_DC, CH0, FLD_IDC, UNIT_A, 4, 2, 100, false, 2 },
     { TYPE_DC, CH0, FLD_PDC, UNIT_W, 8, 2, 10, false, 1 },
@@ -58,6 +59,17 @@ static const byteAssign_t byteAssignment[] = {
     { TYPE_INV, CH0, FLD_EFF, UNIT_PCT, CALC_TOTAL_EFF, 0, CMD_CALC, false, 3 }
 };
 
+const InverterModel_t HMT_4CH::Model = {
+    "HMT-1600/1800/2000-4T",
+    InverterRadioType_t::Cmt,
+    HMT_4CH::isValidSerial,
+    createInverterModel<HMT_4CH>,
+    byteAssignment,
+    sizeof(byteAssignment) / sizeof(byteAssignment[0]),
+    decodeStatisticFields<byteAssignment>,
+    getDcChannelCount(byteAssignment),
+};
+
 HMT_4CH::HMT_4CH(HoymilesRadio* radio, const uint64_t serial)
     : HMT_Abstract(radio, serial)
 {
@@ -70,17 +82,22 @@ bool HMT_4CH::isValidSerial(const uint64_t serial)
     return preSerial == 0x1361;
 }
 
-String HMT_4CH::typeName() const
+const char* HMT_4CH::typeName() const
 {
-    return "HMT-1600/1800/2000-4T";
+    return Model.TypeName;
 }
 
 const byteAssign_t* HMT_4CH::getByteAssignment() const
 {
-    return byteAssignment;
+    return Model.ByteAssignment;
 }
 
 uint8_t HMT_4CH::getByteAssignmentSize() const
 {
-    return sizeof(byteAssignment) / sizeof(byteAssignment[0]);
+    return Model.ByteAssignmentSize;
+}
+
+fieldDecoder_t HMT_4CH::getFieldDecoder() const
+{
+    return Model.FieldDecoder;
 }
@@ -20,9 +20,17 @@ bool HMT_Abstract::sendChangeChannelRequest()
         return false;
     }
 
+    // Not required while the inverter is known to be on the work frequency
+    const uint32_t targetFrequency = Hoymiles.getRadioCmt()->getInverterTargetFrequency();
+    CmtChannelTracker& tracker = getCmtChannelTracker();
+    if (!tracker.isChangeDue(targetFrequency, millis())) {
+        return false;
+    }
+    tracker.markChangeSent(millis());
+
     auto cmdChannel = _radio->prepareCommand<ChannelChangeCommand>(this);
     cmdChannel->setCountryMode(Hoymiles.getRadioCmt()->getCountryMode());
-    cmdChannel->setChannel(Hoymiles.getRadioCmt()->getChannelFromFrequency(Hoymiles.getRadioCmt()->getInverterTargetFrequency()));
+    cmdChannel->setChannel(Hoymiles.getRadioCmt()->getChannelFromFrequency(targetFrequency));
     _radio->enqueCommand(cmdChannel);
 
     return true;
@@ -3,8 +3,9 @@
  * Copyright (C) 2022-2024 Thomas Basler and others
  */
 #include "HM_1CH.h"
+#include "../parser/StatisticsDecoder.h"
 
-static const byteAssign_t byteAssignment[] = {
+static constexpr byteAssign_t byteAssignment[] = {
     { TYPE_DC, CH0, FLD_UDC, UNIT_V, 2, 2, 10, false, 1 },
     { TYPE_DC, CH0, FLD_IDC, UNIT_A, 4, 2, 100, false, 2 },
     { TYPE_DC, CH0, FLD_PDC, UNIT_W, 6, 2, 10, false, 1 },
@@ -28,6 +29,17 @@ static const byteAssign_t byteAssignment[] = {
     { TYPE_INV, CH0, FLD_EFF, UNIT_PCT, CALC_TOTAL_EFF, 0, CMD_CALC, false, 3 }
 };
 
+const InverterModel_t HM_1CH::Model = {
+    "HM-300/350/400-1T",
+    InverterRadioType_t::Nrf,
+    HM_1CH::isValidSerial,
+    createInverterModel<HM_1CH>,
+    byteAssignment,
+    sizeof(byteAssignment) / sizeof(byteAssignment[0]),
+    decodeStatisticFields<byteAssignment>,
+    getDcChannelCount(byteAssignment),
+};
+
 HM_1CH::HM_1CH(HoymilesRadio* radio, const uint64_t serial)
     : HM_Abstract(radio, serial)
 {
@@ -53,17 +65,22 @@ bool HM_1CH::isValidSerial(const uint64_t serial)
     return false;
 }
 
-String HM_1CH::typeName() const
+const char* HM_1CH::typeName() const
 {
-    return "HM-300/350/400-1T";
+    return Model.TypeName;
 }
 
 const byteAssign_t* HM_1CH::getByteAssignment() const
 {
-    return byteAssignment;
+    return Model.ByteAssignment;
 }
 
 uint8_t HM_1CH::getByteAssignmentSize() const
 {
-    return sizeof(byteAssignment) / sizeof(byteAssignment[0]);
+    return Model.ByteAssignmentSize;
+}
+
+fieldDecoder_t HM_1CH::getFieldDecoder() const
+{
+    return Model.FieldDecoder;
 }
@@ -3,8 +3,9 @@
  * Copyright (C) 2022-2024 Thomas Basler and others
  */
 #include "HM_4CH.h"
+#include "../parser/StatisticsDecoder.h"
 
-static const byteAssign_t byteAssignment[] = {
+static constexpr byteAssign_t byteAssignment[] = {
     { TYPE_DC, CH0, FLD_UDC, UNIT_V, 2, 2, 10, false, 1 },
     { TYPE_DC, CH0, FLD_IDC, UNIT_A, 4, 2, 100, false, 2 },
     { TYPE_DC, CH0, FLD_PDC, UNIT_W, 8, 2, 10, false, 1 },
@@ -49,6 +50,17 @@ static const byteAssign_t byteAssignment[] = {
     { TYPE_INV, CH0, FLD_EFF, UNIT_PCT, CALC_TOTAL_EFF, 0, CMD_CALC, false, 3 }
 };
 
+const InverterModel_t HM_4CH::Model = {
+    "HM-1000/1200/1500-4T",
+    InverterRadioType_t::Nrf,
+    HM_4CH::isValidSerial,
+    createInverterModel<HM_4CH>,
+    byteAssignment,
+    sizeof(byteAssignment) / sizeof(byteAssignment[0]),
+    decodeStatisticFields<byteAssignment>,
+    getDcChannelCount(byteAssignment),
+};
+
 HM_4CH::HM_4CH(HoymilesRadio* radio, const uint64_t serial)
     : HM_Abstract(radio, serial)
 {
@@ -74,17 +86,22 @@ bool HM_4CH::isValidSerial(const uint64_t serial)
     return false;
 }
 
-String HM_4CH::typeName() const
+const char* HM_4CH::typeName() const
 {
-    return "HM-1000/1200/1500-4T";
+    return Model.TypeName;
 }
 
 const byteAssign_t* HM_4CH::getByteAssignment() const
 {
-    return byteAssignment;
+    return Model.ByteAssignment;
 }
 
 uint8_t HM_4CH::getByteAssignmentSize() const
 {
-    return sizeof(byteAssignment) / sizeof(byteAssignment[0]);
+    return Model.ByteAssignmentSize;
+}
+
+fieldDecoder_t HM_4CH::getFieldDecoder() const
+{
+    return Model.FieldDecoder;
 }
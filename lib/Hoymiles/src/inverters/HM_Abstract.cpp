@@ -18,9 +18,9 @@ HM_Abstract::HM_Abstract(HoymilesRadio* radio, const uint64_t serial)
 {
 }
 
-bool HM_Abstract::sendStatsRequest()
+bool HM_Abstract::sendStatsRequest(const bool force)
 {
-    if (!getEnablePolling()) {
+    if (!force && !getEnablePolling()) {
         return false;
     }
 
@@ -108,20 +108,110 @@ bool HM_Abstract::sendActivePowerControlRequest(float limit, const PowerLimitCon
         limit = min<float>(100, limit);
     }
 
-    _activePowerControlLimit = limit;
-    _activePowerControlType = type;
+    _limitCommandStats.Requested++;
+
+    // Only the newest request matters, the loop picks it up
+    if (_limitMailbox.post(limit, type)) {
+        _limitCommandStats.Coalesced++;
+    }
+
+    return true;
+}
+
+bool HM_Abstract::resendActivePowerControlRequest()
+{
+    if (!getEnableCommands()) {
+        return false;
+    }
+
+    _limitMailbox.repost();
+    processActivePowerControlRequest();
+
+    return true;
+}
+
+void HM_Abstract::processActivePowerControlRequest()
+{
+    if (!_limitMailbox.isPending() || !getEnableCommands()) {
+        return;
+    }
+
+    const uint32_t elapsed = millis() - _sentPowerControlTime;
+    if (_sentPowerControl) {
+        // Only one limit at a time, the inverter would just process them one after another
+        if (SystemConfigPara()->getLastLimitCommandSuccess() == CMD_PENDING && elapsed < HOY_LIMIT_PENDING_TIMEOUT) {
+            return;
+        }
+        if (elapsed < _limitMinInterval) {
+            return;
+        }
+    }
+
+    float limit;
+    PowerLimitControlType type;
+    if (!_limitMailbox.take(limit, type)) {
+        return;
+    }
+    if (isWithinLimitHysteresis(limit, type)) {
+        _limitCommandStats.Suppressed++;
+        return;
+    }
 
     auto cmd = _radio->prepareCommand<ActivePowerControlCommand>(this);
     cmd->setActivePowerLimit(limit, type);
     SystemConfigPara()->setLastLimitCommandSuccess(CMD_PENDING);
     _radio->enqueCommand(cmd);
 
-    return true;
+    _sentPowerControlLimit = limit;
+    _sentPowerControlType = type;
+    _sentPowerControl = true;
+    _sentPowerControlTime = millis();
+    _limitCommandStats.Sent++;
 }
 
-bool HM_Abstract::resendActivePowerControlRequest()
+void HM_Abstract::refreshActivePowerControlCommand(ActivePowerControlCommand& cmd)
 {
-    return sendActivePowerControlRequest(_activePowerControlLimit, _activePowerControlType);
+    float limit;
+    PowerLimitControlType type;
+    if (!getEnableCommands() || !_limitMailbox.take(limit, type)) {
+        return;
+    }
+
+    // The queued limit was not transmitted yet, the newer one takes its place
+    cmd.setActivePowerLimit(limit, type);
+    _sentPowerControlLimit = limit;
+    _sentPowerControlType = type;
+    _limitCommandStats.Coalesced++;
+}
+
+bool HM_Abstract::isWithinLimitHysteresis(const float limit, const PowerLimitControlType type)
+{
+    // A failed or unanswered limit has to be sent again in any case
+    if (!_sentPowerControl || type != _sentPowerControlType
+        || SystemConfigPara()->getLastLimitCommandSuccess() != CMD_OK) {
+        return false;
+    }
+
+    const bool relative = type == PowerLimitControlType::RelativNonPersistent || type == PowerLimitControlType::RelativPersistent;
+    const uint16_t maxPower = DevInfo()->getMaxPower();
+    float threshold = _limitHysteresis;
+    if (!relative) {
+        threshold = maxPower > 0 ? maxPower * _limitHysteresis / 100.0f : 0;
+    }
+    if (fabsf(limit - _sentPowerControlLimit) > threshold) {
+        return false;
+    }
+
+    // The inverter loses a non persistent limit on restart. Only drop the request if
+    // the limit reported by the inverter still matches the one which was sent.
+    float sentPercent = _sentPowerControlLimit;
+    if (!relative) {
+        if (maxPower == 0) {
+            return false;
+        }
+        sentPercent = _sentPowerControlLimit / maxPower * 100.0f;
+    }
+    return fabsf(SystemConfigPara()->getLimitPercent() - sentPercent) <= max(_limitHysteresis, 1.0f);
 }
 
 bool HM_Abstract::sendPowerControlRequest(const bool turnOn)
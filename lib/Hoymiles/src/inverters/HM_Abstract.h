@@ -6,12 +6,14 @@
 class HM_Abstract : public InverterAbstract {
 public:
     explicit HM_Abstract(HoymilesRadio* radio, const uint64_t serial);
-    bool sendStatsRequest();
+    bool sendStatsRequest(const bool force = false);
     bool sendAlarmLogRequest(const bool force = false);
     bool sendDevInfoRequest();
     bool sendSystemConfigParaRequest();
     bool sendActivePowerControlRequest(float limit, const PowerLimitControlType type);
     bool resendActivePowerControlRequest();
+    void processActivePowerControlRequest();
+    void refreshActivePowerControlCommand(ActivePowerControlCommand& cmd);
     bool sendPowerControlRequest(const bool turnOn);
     bool sendRestartControlRequest();
     bool resendPowerControlRequest();
@@ -20,8 +22,16 @@ public:
 
 private:
     uint8_t _lastAlarmLogCnt = 0;
-    float _activePowerControlLimit = 0;
-    PowerLimitControlType _activePowerControlType = PowerLimitControlType::AbsolutNonPersistent;
+    bool isWithinLimitHysteresis(const float limit, const PowerLimitControlType type);
+
+    // Newest requested limit, it is sent by processActivePowerControlRequest
+    LimitMailbox _limitMailbox;
+
+    // Limit of the last command put into the queue, owned by the loop
+    float _sentPowerControlLimit = 0;
+    PowerLimitControlType _sentPowerControlType = PowerLimitControlType::AbsolutNonPersistent;
+    bool _sentPowerControl = false;
+    uint32_t _sentPowerControlTime = 0;
 
     uint8_t _powerState = 1;
 };
@@ -5,6 +5,7 @@
 #include "InverterAbstract.h"
 #include "../Hoymiles.h"
 #include "crc.h"
+#include <algorithm>
 #include <cstring>
 
 InverterAbstract::InverterAbstract(HoymilesRadio* radio, const uint64_t serial)
@@ -12,11 +13,9 @@ InverterAbstract::InverterAbstract(HoymilesRadio* radio, const uint64_t serial)
     _serial.u64 = serial;
     _radio = radio;
 
-    char serial_buff[sizeof(uint64_t) * 8 + 1];
-    snprintf(serial_buff, sizeof(serial_buff), "%0x%08x",
+    snprintf(_serialString, sizeof(_serialString), "%0x%08x",
         static_cast<uint32_t>((serial >> 32) & 0xFFFFFFFF),
         static_cast<uint32_t>(serial & 0xFFFFFFFF));
-    _serialString = serial_buff;
 
     _alarmLogParser.reset(new AlarmLogParser());
     _devInfoParser.reset(new DevInfoParser());
@@ -30,9 +29,9 @@ void InverterAbstract::init()
 {
     // This has to be done here because:
     // Not possible in constructor --> virtual function
-    // Not possible in verifyAllFragments --> Because no data if nothing is ever received
+    // Not possible in FragmentAssembler::verify --> Because no data if nothing is ever received
     // It has to be executed because otherwise the getChannelCount method in stats always returns 0
-    _statisticsParser.get()->setByteAssignment(getByteAssignment(), getByteAssignmentSize());
+    _statisticsParser.get()->setByteAssignment(getByteAssignment(), getByteAssignmentSize(), getFieldDecoder());
 }
 
 uint64_t InverterAbstract::serial() const
@@ -40,7 +39,7 @@ uint64_t InverterAbstract::serial() const
     return _serial.u64;
 }
 
-const String& InverterAbstract::serialString() const
+const char* InverterAbstract::serialString() const
 {
     return _serialString;
 }
@@ -142,6 +141,107 @@ int8_t InverterAbstract::getLastRssi() const
     return _lastRssi;
 }
 
+uint32_t InverterAbstract::getRssiSum() const
+{
+    return _rssiSum.load(std::memory_order_relaxed);
+}
+
+uint32_t InverterAbstract::getRssiCount() const
+{
+    return _rssiCount.load(std::memory_order_relaxed);
+}
+
+int8_t InverterAbstract::takeRssiMin()
+{
+    return _rssiMin.exchange(0, std::memory_order_relaxed);
+}
+
+void InverterAbstract::setLimitShaping(const uint32_t minInterval, const float hysteresis)
+{
+    _limitMinInterval = minInterval;
+    _limitHysteresis = hysteresis;
+}
+
+const LimitCommandStats_t& InverterAbstract::getLimitCommandStats() const
+{
+    return _limitCommandStats;
+}
+
+InverterMemoryUsage_t InverterAbstract::getMemoryUsage() const
+{
+    InverterMemoryUsage_t usage;
+    usage.Object = sizeof(InverterAbstract)
+        + _rxTimeEstimators.capacity() * sizeof(RxTimeEstimator);
+
+    usage.Parsers = sizeof(AlarmLogParser) + sizeof(DevInfoParser) + sizeof(GridProfileParser)
+        + sizeof(PowerCommandParser) + sizeof(StatisticsParser) + sizeof(SystemConfigParaParser)
+        + 6 * sizeof(StaticSemaphore_t);
+
+    usage.Buffers = _alarmLogParser->getAllocatedSize()
+        + _gridProfileParser->getAllocatedSize()
+        + _statisticsParser->getAllocatedSize();
+    return usage;
+}
+
+void InverterAbstract::setPollPlan(const InverterPollPlan_t& plan)
+{
+    _pollPlan = plan;
+}
+
+const InverterPollPlan_t& InverterAbstract::getPollPlan() const
+{
+    return _pollPlan;
+}
+
+bool InverterAbstract::isStatsPollDue() const
+{
+    return _lastStatsPoll == 0 || millis() - _lastStatsPoll >= _pollPlan.StatsInterval;
+}
+
+bool InverterAbstract::isAlarmPollDue() const
+{
+    return _lastAlarmPoll == 0 || millis() - _lastAlarmPoll >= _pollPlan.AlarmInterval;
+}
+
+void InverterAbstract::markStatsPolled()
+{
+    _lastStatsPoll = millis();
+}
+
+void InverterAbstract::markAlarmPolled()
+{
+    _lastAlarmPoll = millis();
+}
+
+uint32_t InverterAbstract::getAdaptivePollDelay(const uint32_t interval)
+{
+    if (!isReachable()) {
+        return interval << _adaptivePollBackoff;
+    }
+
+    if (!isProducing()) {
+        return interval * HOY_ADAPTIVE_POLL_IDLE_FACTOR;
+    }
+
+    return 0;
+}
+
+uint32_t InverterAbstract::getLastAdaptivePoll() const
+{
+    return _lastAdaptivePoll;
+}
+
+void InverterAbstract::markAdaptivePolled()
+{
+    _lastAdaptivePoll = millis();
+
+    if (isReachable()) {
+        _adaptivePollBackoff = 0;
+    } else if (_adaptivePollBackoff < HOY_ADAPTIVE_POLL_MAX_BACKOFF) {
+        _adaptivePollBackoff++;
+    }
+}
+
 bool InverterAbstract::sendChangeChannelRequest()
 {
     return false;
@@ -182,102 +282,51 @@ SystemConfigParaParser* InverterAbstract::SystemConfigPara()
     return _systemConfigParaParser.get();
 }
 
-void InverterAbstract::clearRxFragmentBuffer()
-{
-    memset(_rxFragmentBuffer, 0, MAX_RF_FRAGMENT_COUNT * sizeof(fragment_t));
-    _rxFragmentMaxPacketId = 0;
-    _rxFragmentLastPacketId = 0;
-    _rxFragmentRetransmitCnt = 0;
-}
-
-void InverterAbstract::addRxFragment(const uint8_t fragment[], const uint8_t len, const int8_t rssi)
+void HOY_RX_ATTR InverterAbstract::setLastRssi(const int8_t rssi)
 {
     _lastRssi = rssi;
+    _rssiSum.fetch_add(static_cast<uint32_t>(static_cast<int32_t>(rssi)), std::memory_order_relaxed);
+    _rssiCount.fetch_add(1, std::memory_order_relaxed);
 
-    if (len < 11) {
-        Hoymiles.getMessageOutput()->printf("FATAL: (%s, %d) fragment too short\r\n", __FILE__, __LINE__);
-        return;
-    }
-
-    if (len - 11 > MAX_RF_PAYLOAD_SIZE) {
-        Hoymiles.getMessageOutput()->printf("FATAL: (%s, %d) fragment too large\r\n", __FILE__, __LINE__);
-        return;
-    }
-
-    const uint8_t fragmentCount = fragment[9];
-
-    // Packets with 0x81 will be seen as 1
-    const uint8_t fragmentId = fragmentCount & 0b01111111; // fragmentId is 1 based
-
-    if (fragmentId == 0) {
-        Hoymiles.getMessageOutput()->println("ERROR: fragment id zero received and ignored");
-        return;
-    }
-
-    if (fragmentId >= MAX_RF_FRAGMENT_COUNT) {
-        Hoymiles.getMessageOutput()->printf("ERROR: fragment id %" PRId8 " is too large for buffer and ignored\r\n", fragmentId);
-        return;
-    }
-
-    memcpy(_rxFragmentBuffer[fragmentId - 1].fragment, &fragment[10], len - 11);
-    _rxFragmentBuffer[fragmentId - 1].len = len - 11;
-    _rxFragmentBuffer[fragmentId - 1].mainCmd = fragment[0];
-    _rxFragmentBuffer[fragmentId - 1].wasReceived = true;
-
-    if (fragmentId > _rxFragmentLastPacketId) {
-        _rxFragmentLastPacketId = fragmentId;
+    int8_t min = _rssiMin.load(std::memory_order_relaxed);
+    while ((min == 0 || rssi < min) && !_rssiMin.compare_exchange_weak(min, rssi, std::memory_order_relaxed)) {
     }
+}
 
-    // 0b10000000 == 0x80
-    if ((fragmentCount & 0b10000000) == 0b10000000) {
-        _rxFragmentMaxPacketId = fragmentId;
+RxTimeEstimator& InverterAbstract::getRxTimeEstimator(const char* commandName)
+{
+    auto it = std::find_if(_rxTimeEstimators.begin(), _rxTimeEstimators.end(),
+        [commandName](const RxTimeEstimator& e) { return strcmp(e.getCommandName(), commandName) == 0; });
+    if (it == _rxTimeEstimators.end()) {
+        _rxTimeEstimators.emplace_back(commandName);
+        it = _rxTimeEstimators.end() - 1;
     }
+    return *it;
 }
 
-// Returns Zero on Success or the Fragment ID for retransmit or error code
-uint8_t InverterAbstract::verifyAllFragments(CommandAbstract& cmd)
+const std::vector<RxTimeEstimator>& InverterAbstract::getRxTimeEstimators() const
 {
-    // All missing
-    if (_rxFragmentLastPacketId == 0) {
-        Hoymiles.getMessageOutput()->println("All missing");
-        if (cmd.getSendCount() <= cmd.getMaxResendCount()) {
-            return FRAGMENT_ALL_MISSING_RESEND;
-        } else {
-            cmd.gotTimeout();
-            return FRAGMENT_ALL_MISSING_TIMEOUT;
-        }
-    }
+    return _rxTimeEstimators;
+}
 
-    // Last fragment is missing (the one with 0x80)
-    if (_rxFragmentMaxPacketId == 0) {
-        Hoymiles.getMessageOutput()->println("Last missing");
-        if (_rxFragmentRetransmitCnt++ < cmd.getMaxRetransmitCount()) {
-            return _rxFragmentLastPacketId + 1;
-        } else {
-            cmd.gotTimeout();
-            return FRAGMENT_RETRANSMIT_TIMEOUT;
-        }
-    }
+FragmentDelivery& InverterAbstract::getFragmentDelivery()
+{
+    return _fragmentDelivery;
+}
 
-    // Middle fragment is missing
-    for (uint8_t i = 0; i < _rxFragmentMaxPacketId - 1; i++) {
-        if (!_rxFragmentBuffer[i].wasReceived) {
-            Hoymiles.getMessageOutput()->println("Middle missing");
-            if (_rxFragmentRetransmitCnt++ < cmd.getMaxRetransmitCount()) {
-                return i + 1;
-            } else {
-                cmd.gotTimeout();
-                return FRAGMENT_RETRANSMIT_TIMEOUT;
-            }
-        }
-    }
+TxPowerControl& InverterAbstract::getTxPowerControl()
+{
+    return _txPowerControl;
+}
 
-    if (!cmd.handleResponse(_rxFragmentBuffer, _rxFragmentMaxPacketId)) {
-        cmd.gotTimeout();
-        return FRAGMENT_HANDLE_ERROR;
-    }
+CmtChannelTracker& InverterAbstract::getCmtChannelTracker()
+{
+    return _cmtChannelTracker;
+}
 
-    return FRAGMENT_OK;
+TransactionRunner& InverterAbstract::getTransactionRunner()
+{
+    return _transactionRunner;
 }
 
 void InverterAbstract::performDailyTask()
@@ -285,6 +334,7 @@ void InverterAbstract::performDailyTask()
     // Have to reset the offets first, otherwise it will
     // Substract the offset from zero which leads to a high value
     Statistics()->resetYieldDayCorrection();
+    Statistics()->resetFieldStatistics();
     if (getZeroYieldDayOnMidnight()) {
         Statistics()->zeroDailyData();
     }
@@ -297,4 +347,5 @@ void InverterAbstract::performDailyTask()
 void InverterAbstract::resetRadioStats()
 {
     RadioStats = {};
+    NrfChannelStats = {};
 }
@@ -8,23 +8,79 @@
 #include "../parser/PowerCommandParser.h"
 #include "../parser/StatisticsParser.h"
 #include "../parser/SystemConfigParaParser.h"
+#include "CmtChannelTracker.h"
+#include "FragmentDelivery.h"
 #include "HoymilesRadio.h"
+#include "InverterModel.h"
+#include "InverterTransaction.h"
+#include "LimitMailbox.h"
+#include "RxTimeEstimator.h"
+#include "TxPowerControl.h"
 #include "types.h"
 #include <Arduino.h>
+#include <atomic>
 #include <cstdint>
 #include <list>
+#include <vector>
 
 #define MAX_NAME_LENGTH 32
 
-enum {
-    FRAGMENT_ALL_MISSING_RESEND = 255,
-    FRAGMENT_ALL_MISSING_TIMEOUT = 254,
-    FRAGMENT_RETRANSMIT_TIMEOUT = 253,
-    FRAGMENT_HANDLE_ERROR = 252,
-    FRAGMENT_OK = 0
+// 16 hex digits of the serial and the termination
+#define INV_SERIAL_STRING_SIZE 17
+
+// Adaptive polling: reachable but not producing inverters are polled less often by this factor
+#define HOY_ADAPTIVE_POLL_IDLE_FACTOR 4
+// Adaptive polling: poll interval of unreachable inverters is doubled up to 2^x times
+#define HOY_ADAPTIVE_POLL_MAX_BACKOFF 6
+
+// Number of channels the nrf radio hops through
+#define NRF_CHANNEL_COUNT 5
+
+// Per channel statistics of the nrf radio, the index is the position in the channel list
+struct NrfChannelStats_t {
+    // Fragments received on the rx channel
+    uint32_t RxFragments[NRF_CHANNEL_COUNT];
+
+    // Requests sent on the tx channel and how many of them got at least one fragment back
+    uint32_t TxRequests[NRF_CHANNEL_COUNT];
+    uint32_t TxAnswered[NRF_CHANNEL_COUNT];
+
+    // Same as above but halved regularly so that the channel selection follows changes
+    uint16_t RxFragmentsRecent[NRF_CHANNEL_COUNT];
+    uint16_t TxRequestsRecent[NRF_CHANNEL_COUNT];
+    uint16_t TxAnsweredRecent[NRF_CHANNEL_COUNT];
+};
+
+// A limit command which got no answer within this time (ms) does not block newer limits
+#define HOY_LIMIT_PENDING_TIMEOUT 30000
+
+// RAM used by an inverter in bytes
+struct InverterMemoryUsage_t {
+    uint32_t Object; // InverterAbstract and its rx time estimators
+    uint32_t Parsers; // parser objects and their semaphores
+    uint32_t Buffers; // lazily allocated payloads and decoded data of the parsers
+};
+
+struct LimitCommandStats_t {
+    uint32_t Requested; // calls of sendActivePowerControlRequest
+    uint32_t Sent; // commands put into the queue
+    uint32_t Coalesced; // requests replaced by a newer one before they were transmitted
+    uint32_t Suppressed; // requests within the hysteresis of the current limit
 };
 
-#define MAX_RF_FRAGMENT_COUNT 13
+// Default interval (ms) in which the limit is read back without a reason. It is also
+// read back after a limit command, a restart and when the inverter is reachable again.
+#define HOY_SYSTEM_CONFIG_PARA_POLL_INTERVAL (30 * 60 * 1000) // 30 minutes
+
+// Cadence of the requests of an inverter. Intervals are in ms, 0 means on every poll.
+// Data classes on demand are only requested if somebody asks for them.
+struct InverterPollPlan_t {
+    uint32_t StatsInterval = 0;
+    uint32_t AlarmInterval = 0;
+    uint32_t LimitInterval = HOY_SYSTEM_CONFIG_PARA_POLL_INTERVAL;
+    bool AlarmOnDemand = false;
+    bool GridProfileOnDemand = false;
+};
 
 class CommandAbstract;
 
@@ -33,12 +89,13 @@ public:
     explicit InverterAbstract(HoymilesRadio* radio, const uint64_t serial);
     void init();
     uint64_t serial() const;
-    const String& serialString() const;
+    const char* serialString() const;
     void setName(const char* name);
     const char* name() const;
-    virtual String typeName() const = 0;
+    virtual const char* typeName() const = 0;
     virtual const byteAssign_t* getByteAssignment() const = 0;
     virtual uint8_t getByteAssignmentSize() const = 0;
+    virtual fieldDecoder_t getFieldDecoder() const = 0;
 
     bool isProducing();
     bool isReachable();
@@ -63,9 +120,54 @@ public:
 
     int8_t getLastRssi() const;
 
-    void clearRxFragmentBuffer();
-    void addRxFragment(const uint8_t fragment[], const uint8_t len, const int8_t rssi);
-    uint8_t verifyAllFragments(CommandAbstract& cmd);
+    // Rssi of all fragments received since the start, not reset by performDailyTask().
+    // The average of a period is the difference of two readings, the sum wraps around.
+    uint32_t getRssiSum() const;
+    uint32_t getRssiCount() const;
+    // Lowest rssi since the previous call, 0 if no fragment was received. Only for
+    // one caller.
+    int8_t takeRssiMin();
+
+    // Limits requested while another limit is on its way, or earlier than the minimum
+    // interval (ms) after it, are held in one slot and only the newest one is sent.
+    // Requests which differ less than the hysteresis (percent of the max power) from
+    // the current limit are dropped.
+    void setLimitShaping(const uint32_t minInterval, const float hysteresis);
+    const LimitCommandStats_t& getLimitCommandStats() const;
+
+    void setPollPlan(const InverterPollPlan_t& plan);
+    const InverterPollPlan_t& getPollPlan() const;
+
+    // Whether the interval of the poll plan elapsed since the request was sent last
+    bool isStatsPollDue() const;
+    bool isAlarmPollDue() const;
+    void markStatsPolled();
+    void markAlarmPolled();
+
+    // Time which has to pass since the last adaptive poll before the inverter is due again
+    uint32_t getAdaptivePollDelay(const uint32_t interval);
+    uint32_t getLastAdaptivePoll() const;
+    void markAdaptivePolled();
+
+    // Called for every fragment received from the inverter, the fragments
+    // themselves are reassembled by the radio
+    void setLastRssi(const int8_t rssi);
+
+    // Learned response time of the given command type, created on first use
+    RxTimeEstimator& getRxTimeEstimator(const char* commandName);
+    const std::vector<RxTimeEstimator>& getRxTimeEstimators() const;
+
+    // Learned share of the fragments of the inverter which arrive
+    FragmentDelivery& getFragmentDelivery();
+
+    // Transmit power selected for this inverter, used if the radio controls the power
+    TxPowerControl& getTxPowerControl();
+
+    // Frequency of the last answer of a CMT inverter and the channel change backoff
+    CmtChannelTracker& getCmtChannelTracker();
+
+    // Runs the multi step transactions (e.g. a poll) of the inverter
+    TransactionRunner& getTransactionRunner();
 
     void performDailyTask();
 
@@ -91,12 +193,19 @@ public:
         uint32_t RxFailCorruptData;
     } RadioStats = {};
 
-    virtual bool sendStatsRequest() = 0;
+    NrfChannelStats_t NrfChannelStats = {};
+
+    // force: also if polling is disabled, used to probe the link
+    virtual bool sendStatsRequest(const bool force = false) = 0;
     virtual bool sendAlarmLogRequest(const bool force = false) = 0;
     virtual bool sendDevInfoRequest() = 0;
     virtual bool sendSystemConfigParaRequest() = 0;
     virtual bool sendActivePowerControlRequest(float limit, const PowerLimitControlType type) = 0;
     virtual bool resendActivePowerControlRequest() = 0;
+    // Sends the limit held in the slot once this is allowed, called from the loop
+    virtual void processActivePowerControlRequest() = 0;
+    // Puts a limit requested after cmd was queued into cmd, called right before it is transmitted
+    virtual void refreshActivePowerControlCommand(ActivePowerControlCommand& cmd) = 0;
     virtual bool sendPowerControlRequest(const bool turnOn) = 0;
     virtual bool sendRestartControlRequest() = 0;
     virtual bool resendPowerControlRequest() = 0;
@@ -115,17 +224,25 @@ public:
     StatisticsParser* Statistics();
     SystemConfigParaParser* SystemConfigPara();
 
+    InverterMemoryUsage_t getMemoryUsage() const;
+
 protected:
     HoymilesRadio* _radio;
 
+    uint32_t _limitMinInterval = 0;
+    float _limitHysteresis = 0;
+    LimitCommandStats_t _limitCommandStats = {};
+
 private:
     serial_u _serial;
-    String _serialString;
+    char _serialString[INV_SERIAL_STRING_SIZE];
     char _name[MAX_NAME_LENGTH] = "";
-    fragment_t _rxFragmentBuffer[MAX_RF_FRAGMENT_COUNT];
-    uint8_t _rxFragmentMaxPacketId = 0;
-    uint8_t _rxFragmentLastPacketId = 0;
-    uint8_t _rxFragmentRetransmitCnt = 0;
+
+    std::vector<RxTimeEstimator> _rxTimeEstimators;
+    FragmentDelivery _fragmentDelivery;
+    TxPowerControl _txPowerControl;
+    CmtChannelTracker _cmtChannelTracker;
+    TransactionRunner _transactionRunner;
 
     bool _enablePolling = true;
     bool _enableCommands = true;
@@ -137,6 +254,16 @@ private:
     bool _clearEventlogOnMidnight = false;
 
     int8_t _lastRssi = -127;
+    std::atomic<uint32_t> _rssiSum { 0 };
+    std::atomic<uint32_t> _rssiCount { 0 };
+    std::atomic<int8_t> _rssiMin { 0 };
+
+    uint32_t _lastAdaptivePoll = 0;
+    uint8_t _adaptivePollBackoff = 0;
+
+    InverterPollPlan_t _pollPlan;
+    uint32_t _lastStatsPoll = 0;
+    uint32_t _lastAlarmPoll = 0;
 
     std::unique_ptr<AlarmLogParser> _alarmLogParser;
     std::unique_ptr<DevInfoParser> _devInfoParser;
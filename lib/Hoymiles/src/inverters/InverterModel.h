@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "../parser/StatisticsParser.h"
+#include <cstdint>
+#include <memory>
+
+class HoymilesRadio;
+class InverterAbstract;
+
+enum class InverterRadioType_t {
+    Nrf,
+    Cmt,
+};
+
+// Constant description of an inverter model, defined next to its byte assignment.
+// The registry in Hoymiles.cpp resolves a serial to its model once when the inverter
+// is added, the instance then only forwards to these tables.
+struct InverterModel_t {
+    const char* TypeName;
+    InverterRadioType_t Radio;
+    bool (*IsValidSerial)(const uint64_t serial);
+    std::shared_ptr<InverterAbstract> (*Create)(HoymilesRadio* radio, const uint64_t serial);
+    const byteAssign_t* ByteAssignment;
+    uint8_t ByteAssignmentSize;
+    fieldDecoder_t FieldDecoder;
+    uint8_t ChannelCount; // dc inputs
+};
+
+template <class T>
+std::shared_ptr<InverterAbstract> createInverterModel(HoymilesRadio* radio, const uint64_t serial)
+{
+    return std::make_shared<T>(radio, serial);
+}
+
+template <size_t N>
+constexpr uint8_t getDcChannelCount(const byteAssign_t (&table)[N])
+{
+    uint8_t count = 0;
+    for (size_t i = 0; i < N; i++) {
+        if (table[i].type == TYPE_DC && table[i].ch + 1 > count) {
+            count = table[i].ch + 1;
+        }
+    }
+    return count;
+}
@@ -25,8 +25,10 @@ ID   Source Addr   Target Addr   Idx  ?       wcode   ?       Start   End     ?
 #include "AlarmLogParser.h"
 #include "../Hoymiles.h"
 #include <cstring>
+#include <frozen/map.h>
+#include <utility>
 
-const std::array<const AlarmMessage_t, ALARM_MSG_COUNT> AlarmLogParser::_alarmMessages = { {
+static constexpr std::array<AlarmMessage_t, ALARM_MSG_COUNT> alarmMessages = { {
     { AlarmMessageType_t::ALL, 1, "Inverter start", "Wechselrichter gestartet", "L'onduleur a démarré" },
     { AlarmMessageType_t::ALL, 2, "Time calibration", "Zeitabgleich", "" },
     { AlarmMessageType_t::ALL, 3, "EEPROM reading and writing error during operation", "", "" },
@@ -190,6 +192,23 @@ const std::array<const AlarmMessage_t, ALARM_MSG_COUNT> AlarmLogParser::_alarmMe
     { AlarmMessageType_t::ALL, 9000, "Microinverter is suspected of being stolen", "", "" },
 } };
 
+static constexpr uint32_t alarmMessageKey(const AlarmMessageType_t type, const uint16_t messageId)
+{
+    return static_cast<uint32_t>(type) << 16 | messageId;
+}
+
+template <size_t... I>
+static constexpr auto makeAlarmMessageIndex(std::index_sequence<I...>)
+{
+    return frozen::make_map(std::array<std::pair<uint32_t, uint8_t>, sizeof...(I)> { {
+        { alarmMessageKey(alarmMessages[I].InverterType, alarmMessages[I].MessageId), static_cast<uint8_t>(I) }... } });
+}
+
+static_assert(ALARM_MSG_COUNT <= UINT8_MAX, "The message index only holds 8 bit positions");
+
+// Position in alarmMessages by inverter type and message id
+static constexpr auto alarmMessageIndex = makeAlarmMessageIndex(std::make_index_sequence<ALARM_MSG_COUNT>());
+
 AlarmLogParser::AlarmLogParser()
     : Parser()
 {
@@ -198,17 +217,20 @@ AlarmLogParser::AlarmLogParser()
 
 void AlarmLogParser::clearBuffer()
 {
-    memset(_payloadAlarmLog, 0, ALARM_LOG_PAYLOAD_SIZE);
+    _payloadAlarmLog.clear();
     _alarmLogLength = 0;
 }
 
 void AlarmLogParser::appendFragment(const uint8_t offset, const uint8_t* payload, const uint8_t len)
 {
     if (offset + len > ALARM_LOG_PAYLOAD_SIZE) {
-        Hoymiles.getMessageOutput()->printf("FATAL: (%s, %d) stats packet too large for buffer (%d > %d)\r\n", __FILE__, __LINE__, offset + len, ALARM_LOG_PAYLOAD_SIZE);
+        HOY_LOGE("FATAL: (%s, %d) stats packet too large for buffer (%d > %d)\r\n", __FILE__, __LINE__, offset + len, ALARM_LOG_PAYLOAD_SIZE);
+        return;
+    }
+    if (!_payloadAlarmLog.write(offset, payload, len)) {
+        HOY_LOGE("Alarm log: out of memory\r\n");
         return;
     }
-    memcpy(&_payloadAlarmLog[offset], payload, len);
     _alarmLogLength += len;
 }
 
@@ -220,6 +242,42 @@ uint8_t AlarmLogParser::getEntryCount() const
     return (_alarmLogLength - 2) / ALARM_LOG_ENTRY_SIZE;
 }
 
+void AlarmLogParser::updateSequence()
+{
+    std::array<uint32_t, ALARM_LOG_ENTRY_COUNT> keys;
+    std::array<uint32_t, ALARM_LOG_ENTRY_COUNT> sequence;
+
+    const uint8_t count = getEntryCount();
+    for (uint8_t i = 0; i < count; i++) {
+        // Message id and start time identify an entry, the end time is set later
+        const uint8_t offset = 2 + i * ALARM_LOG_ENTRY_SIZE;
+        keys[i] = static_cast<uint32_t>(_payloadAlarmLog[offset]) << 24
+            | static_cast<uint32_t>(_payloadAlarmLog[offset + 1]) << 16
+            | static_cast<uint32_t>(_payloadAlarmLog[offset + 4]) << 8
+            | _payloadAlarmLog[offset + 5];
+
+        sequence[i] = 0;
+        for (uint8_t j = 0; j < _entryKeyCount; j++) {
+            if (_entryKey[j] == keys[i]) {
+                sequence[i] = _entrySequence[j];
+                break;
+            }
+        }
+        if (sequence[i] == 0) {
+            sequence[i] = ++_sequence;
+        }
+    }
+
+    _entryKey = keys;
+    _entrySequence = sequence;
+    _entryKeyCount = count;
+}
+
+uint32_t AlarmLogParser::getSequence() const
+{
+    return _sequence;
+}
+
 void AlarmLogParser::setLastAlarmRequestSuccess(const LastCommandSuccess status)
 {
     _lastAlarmRequestSuccess = status;
@@ -235,6 +293,16 @@ void AlarmLogParser::setMessageType(const AlarmMessageType_t type)
     _messageType = type;
 }
 
+size_t AlarmLogParser::getAllocatedSize() const
+{
+    return _payloadAlarmLog.getAllocatedSize();
+}
+
+uint32_t AlarmLogParser::getEntrySequence(const uint8_t entryId) const
+{
+    return entryId < _entryKeyCount ? _entrySequence[entryId] : 0;
+}
+
 void AlarmLogParser::getLogEntry(const uint8_t entryId, AlarmLogEntry_t& entry, const AlarmMessageLocale_t locale)
 {
     const uint8_t entryStartOffset = 2 + entryId * ALARM_LOG_ENTRY_SIZE;
@@ -257,6 +325,7 @@ void AlarmLogParser::getLogEntry(const uint8_t entryId, AlarmLogEntry_t& entry,
     entry.MessageId = _payloadAlarmLog[entryStartOffset + 1];
     entry.StartTime = ((static_cast<uint16_t>(_payloadAlarmLog[entryStartOffset + 4]) << 8) | static_cast<uint16_t>(_payloadAlarmLog[entryStartOffset + 5])) + startTimeOffset + timezoneOffset;
     entry.EndTime = (static_cast<uint16_t>(_payloadAlarmLog[entryStartOffset + 6]) << 8) | static_cast<uint16_t>(_payloadAlarmLog[entryStartOffset + 7]);
+    entry.Sequence = entryId < _entryKeyCount ? _entrySequence[entryId] : 0;
 
     HOY_SEMAPHORE_GIVE();
 
@@ -264,6 +333,12 @@ void AlarmLogParser::getLogEntry(const uint8_t entryId, AlarmLogEntry_t& entry,
         entry.EndTime += (endTimeOffset + timezoneOffset);
     }
 
+    const AlarmMessage_t* msg = findMessage(_messageType, entry.MessageId);
+    if (msg != nullptr) {
+        entry.Message = getLocaleMessage(msg, locale);
+        return;
+    }
+
     switch (locale) {
     case AlarmMessageLocale_t::DE:
         entry.Message = "Unbekannt";
@@ -274,20 +349,20 @@ void AlarmLogParser::getLogEntry(const uint8_t entryId, AlarmLogEntry_t& entry,
     default:
         entry.Message = "Unknown";
     }
+}
 
-    for (auto& msg : _alarmMessages) {
-        if (msg.MessageId == entry.MessageId) {
-            if (msg.InverterType == _messageType) {
-                entry.Message = getLocaleMessage(&msg, locale);
-                break;
-            } else if (msg.InverterType == AlarmMessageType_t::ALL) {
-                entry.Message = getLocaleMessage(&msg, locale);
-            }
-        }
+const AlarmMessage_t* AlarmLogParser::findMessage(const AlarmMessageType_t type, const uint16_t messageId)
+{
+    // A message of the inverter type is preferred over the one for all inverters
+    auto it = alarmMessageIndex.find(alarmMessageKey(type, messageId));
+    if (it == alarmMessageIndex.end() && type != AlarmMessageType_t::ALL) {
+        it = alarmMessageIndex.find(alarmMessageKey(AlarmMessageType_t::ALL, messageId));
     }
+
+    return it != alarmMessageIndex.end() ? &alarmMessages[it->second] : nullptr;
 }
 
-String AlarmLogParser::getLocaleMessage(const AlarmMessage_t* msg, const AlarmMessageLocale_t locale) const
+const char* AlarmLogParser::getLocaleMessage(const AlarmMessage_t* msg, const AlarmMessageLocale_t locale)
 {
     if (locale == AlarmMessageLocale_t::DE) {
         return msg->Message_de[0] != '\0' ? msg->Message_de : msg->Message_en;
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 #pragma once
 #include "Parser.h"
+#include "ParserBuffer.h"
 #include <array>
 #include <cstdint>
 
@@ -12,9 +13,10 @@
 
 struct AlarmLogEntry_t {
     uint16_t MessageId;
-    String Message;
+    const char* Message; // points into the static message table
     time_t StartTime;
     time_t EndTime;
+    uint32_t Sequence;
 };
 
 enum class AlarmMessageType_t {
@@ -45,21 +47,36 @@ public:
     uint8_t getEntryCount() const;
     void getLogEntry(const uint8_t entryId, AlarmLogEntry_t& entry, const AlarmMessageLocale_t locale = AlarmMessageLocale_t::EN);
 
+    // Sequence of the entry without decoding it, to select entries before getLogEntry()
+    uint32_t getEntrySequence(const uint8_t entryId) const;
+
+    // Every entry gets a sequence number when it is received for the first time.
+    // Consumers remember the last sequence they have seen and only handle entries
+    // with a higher number. Has to be called after the log was received.
+    void updateSequence();
+    uint32_t getSequence() const;
+
     void setLastAlarmRequestSuccess(const LastCommandSuccess status);
     LastCommandSuccess getLastAlarmRequestSuccess() const;
 
     void setMessageType(const AlarmMessageType_t type);
 
+    size_t getAllocatedSize() const;
+
 private:
     static int getTimezoneOffset();
-    String getLocaleMessage(const AlarmMessage_t* msg, const AlarmMessageLocale_t locale) const;
+    static const AlarmMessage_t* findMessage(const AlarmMessageType_t type, const uint16_t messageId);
+    static const char* getLocaleMessage(const AlarmMessage_t* msg, const AlarmMessageLocale_t locale);
 
-    uint8_t _payloadAlarmLog[ALARM_LOG_PAYLOAD_SIZE];
+    ParserBuffer<ALARM_LOG_PAYLOAD_SIZE> _payloadAlarmLog;
     uint8_t _alarmLogLength = 0;
 
+    uint32_t _sequence = 0;
+    std::array<uint32_t, ALARM_LOG_ENTRY_COUNT> _entrySequence = {};
+    std::array<uint32_t, ALARM_LOG_ENTRY_COUNT> _entryKey = {};
+    uint8_t _entryKeyCount = 0;
+
     LastCommandSuccess _lastAlarmRequestSuccess = CMD_NOK; // Set to NOK to fetch at startup
 
     AlarmMessageType_t _messageType = AlarmMessageType_t::ALL;
-
-    static const std::array<const AlarmMessage_t, ALARM_MSG_COUNT> _alarmMessages;
 };
@@ -29,7 +29,9 @@ ID   Source Addr   Target Addr   Idx  FW Version  HW Part No.   HW Version   ?
 */
 #include "DevInfoParser.h"
 #include "../Hoymiles.h"
+#include <algorithm>
 #include <cstring>
+#include <ctime>
 
 #define ALL 0xff
 
@@ -103,7 +105,7 @@ void DevInfoParser::clearBufferAll()
 void DevInfoParser::appendFragmentAll(const uint8_t offset, const uint8_t* payload, const uint8_t len)
 {
     if (offset + len > DEV_INFO_SIZE) {
-        Hoymiles.getMessageOutput()->printf("FATAL: (%s, %d) dev info all packet too large for buffer\r\n", __FILE__, __LINE__);
+        HOY_LOGE("FATAL: (%s, %d) dev info all packet too large for buffer\r\n", __FILE__, __LINE__);
         return;
     }
     memcpy(&_payloadDevInfoAll[offset], payload, len);
@@ -119,7 +121,7 @@ void DevInfoParser::clearBufferSimple()
 void DevInfoParser::appendFragmentSimple(const uint8_t offset, const uint8_t* payload, const uint8_t len)
 {
     if (offset + len > DEV_INFO_SIZE) {
-        Hoymiles.getMessageOutput()->printf("FATAL: (%s, %d) dev info Simple packet too large for buffer\r\n", __FILE__, __LINE__);
+        HOY_LOGE("FATAL: (%s, %d) dev info Simple packet too large for buffer\r\n", __FILE__, __LINE__);
         return;
     }
     memcpy(&_payloadDevInfoSimple[offset], payload, len);
@@ -134,6 +136,7 @@ uint32_t DevInfoParser::getLastUpdateAll() const
 void DevInfoParser::setLastUpdateAll(const uint32_t lastUpdate)
 {
     _lastUpdateAll = lastUpdate;
+    _restored = false;
     setLastUpdate(lastUpdate);
 }
 
@@ -145,9 +148,43 @@ uint32_t DevInfoParser::getLastUpdateSimple() const
 void DevInfoParser::setLastUpdateSimple(const uint32_t lastUpdate)
 {
     _lastUpdateSimple = lastUpdate;
+    _restored = false;
     setLastUpdate(lastUpdate);
 }
 
+DevInfoRawData_t DevInfoParser::getRawData() const
+{
+    DevInfoRawData_t data;
+    HOY_SEMAPHORE_TAKE();
+    memcpy(data.All, _payloadDevInfoAll, DEV_INFO_SIZE);
+    data.AllLength = _devInfoAllLength;
+    memcpy(data.Simple, _payloadDevInfoSimple, DEV_INFO_SIZE);
+    data.SimpleLength = _devInfoSimpleLength;
+    HOY_SEMAPHORE_GIVE();
+    return data;
+}
+
+void DevInfoParser::restoreRawData(const DevInfoRawData_t& data)
+{
+    beginAppendFragment();
+    memcpy(_payloadDevInfoAll, data.All, DEV_INFO_SIZE);
+    _devInfoAllLength = min<uint8_t>(data.AllLength, DEV_INFO_SIZE);
+    memcpy(_payloadDevInfoSimple, data.Simple, DEV_INFO_SIZE);
+    _devInfoSimpleLength = min<uint8_t>(data.SimpleLength, DEV_INFO_SIZE);
+    endAppendFragment();
+
+    // 0 means not received, the restore may happen right at boot
+    const uint32_t now = max<uint32_t>(millis(), 1);
+    setLastUpdateAll(now);
+    setLastUpdateSimple(now);
+    _restored = true;
+}
+
+bool DevInfoParser::isRestored() const
+{
+    return _restored;
+}
+
 uint16_t DevInfoParser::getFwBuildVersion() const
 {
     HOY_SEMAPHORE_TAKE();
@@ -172,12 +209,12 @@ time_t DevInfoParser::getFwBuildDateTime() const
     return timegm(&timeinfo);
 }
 
-String DevInfoParser::getFwBuildDateTimeStr() const
+size_t DevInfoParser::getFwBuildDateTimeStr(char* buffer, const size_t size) const
 {
-    char timebuffer[32];
     const time_t t = getFwBuildDateTime();
-    std::strftime(timebuffer, sizeof(timebuffer), "%Y-%m-%d %H:%M:%S", gmtime(&t));
-    return timebuffer;
+    struct tm timeinfo;
+    gmtime_r(&t, &timeinfo);
+    return std::strftime(buffer, size, "%Y-%m-%d %H:%M:%S", &timeinfo);
 }
 
 uint16_t DevInfoParser::getFwBootloaderVersion() const
@@ -198,13 +235,12 @@ uint32_t DevInfoParser::getHwPartNumber() const
     return (static_cast<uint32_t>(hwpn_h) << 16) | static_cast<uint32_t>(hwpn_l);
 }
 
-String DevInfoParser::getHwVersion() const
+size_t DevInfoParser::getHwVersion(char* buffer, const size_t size) const
 {
-    char buf[8];
     HOY_SEMAPHORE_TAKE();
-    snprintf(buf, sizeof(buf), "%02d.%02d", _payloadDevInfoSimple[6], _payloadDevInfoSimple[7]);
+    const int len = snprintf(buffer, size, "%02d.%02d", _payloadDevInfoSimple[6], _payloadDevInfoSimple[7]);
     HOY_SEMAPHORE_GIVE();
-    return buf;
+    return std::min<size_t>(std::max(len, 0), size > 0 ? size - 1 : 0);
 }
 
 uint16_t DevInfoParser::getMaxPower() const
@@ -216,7 +252,7 @@ uint16_t DevInfoParser::getMaxPower() const
     return devInfo[idx].maxPower;
 }
 
-String DevInfoParser::getHwModelName() const
+const char* DevInfoParser::getHwModelName() const
 {
     const uint8_t idx = getDevIdx();
     if (idx == 0xff) {
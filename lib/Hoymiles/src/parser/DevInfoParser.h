@@ -3,6 +3,16 @@
 #include "Parser.h"
 
 #define DEV_INFO_SIZE 20
+#define DEV_INFO_DATETIME_SIZE 20
+#define DEV_INFO_HW_VERSION_SIZE 8
+
+// Both responses as they were received, used to restore them after a reboot
+struct DevInfoRawData_t {
+    uint8_t All[DEV_INFO_SIZE];
+    uint8_t AllLength;
+    uint8_t Simple[DEV_INFO_SIZE];
+    uint8_t SimpleLength;
+};
 
 class DevInfoParser : public Parser {
 public:
@@ -21,17 +31,25 @@ public:
 
     uint16_t getFwBuildVersion() const;
     time_t getFwBuildDateTime() const;
-    String getFwBuildDateTimeStr() const;
+    // Writes "YYYY-MM-DD hh:mm:ss" into buffer, returns the length
+    size_t getFwBuildDateTimeStr(char* buffer, const size_t size) const;
     uint16_t getFwBootloaderVersion() const;
 
     uint32_t getHwPartNumber() const;
-    String getHwVersion() const;
+    // Writes "xx.yy" into buffer, returns the length
+    size_t getHwVersion(char* buffer, const size_t size) const;
 
     uint16_t getMaxPower() const;
-    String getHwModelName() const;
+    const char* getHwModelName() const;
 
     bool containsValidData() const;
 
+    DevInfoRawData_t getRawData() const;
+
+    // Restored data counts as received until it is confirmed by the inverter
+    void restoreRawData(const DevInfoRawData_t& data);
+    bool isRestored() const;
+
 private:
     static time_t timegm(const struct tm* tm);
     uint8_t getDevIdx() const;
@@ -44,4 +62,6 @@ private:
 
     uint8_t _payloadDevInfoSimple[DEV_INFO_SIZE] = {};
     uint8_t _devInfoSimpleLength = 0;
+
+    bool _restored = false;
 };
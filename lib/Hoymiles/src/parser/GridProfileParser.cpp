@@ -21,6 +21,7 @@ The number of values depends on the respective section and its version. After th
 */
 #include "GridProfileParser.h"
 #include "../Hoymiles.h"
+#include <algorithm>
 #include <cstring>
 #include <frozen/map.h>
 #include <frozen/string.h>
@@ -38,7 +39,7 @@ const std::array<const ProfileType_t, PROFILE_TYPE_COUNT> GridProfileParser::_pr
     { 0x37, 0x00, "CH - CH_NA EEA-NE7-CH2020" },
 } };
 
-constexpr frozen::map<uint8_t, frozen::string, 12> profileSection = {
+constexpr frozen::map<uint8_t, frozen::string, PROFILE_SECTION_COUNT> profileSection = {
     { 0x00, "Voltage (H/LVRT)" },
     { 0x10, "Frequency (H/LFRT)" },
     { 0x20, "Island Detection (ID)" },
@@ -370,21 +371,24 @@ GridProfileParser::GridProfileParser()
 
 void GridProfileParser::clearBuffer()
 {
-    memset(_payloadGridProfile, 0, GRID_PROFILE_SIZE);
+    _payloadGridProfile.clear();
     _gridProfileLength = 0;
 }
 
 void GridProfileParser::appendFragment(const uint8_t offset, const uint8_t* payload, const uint8_t len)
 {
     if (offset + len > GRID_PROFILE_SIZE) {
-        Hoymiles.getMessageOutput()->printf("FATAL: (%s, %d) grid profile packet too large for buffer\r\n", __FILE__, __LINE__);
+        HOY_LOGE("FATAL: (%s, %d) grid profile packet too large for buffer\r\n", __FILE__, __LINE__);
+        return;
+    }
+    if (!_payloadGridProfile.write(offset, payload, len)) {
+        HOY_LOGE("Grid profile: out of memory\r\n");
         return;
     }
-    memcpy(&_payloadGridProfile[offset], payload, len);
     _gridProfileLength += len;
 }
 
-String GridProfileParser::getProfileName() const
+const char* GridProfileParser::getProfileName() const
 {
     for (auto& ptype : _profileTypes) {
         if (ptype.lIdx == _payloadGridProfile[0] && ptype.hIdx == _payloadGridProfile[1]) {
@@ -394,13 +398,12 @@ String GridProfileParser::getProfileName() const
     return "Unknown";
 }
 
-String GridProfileParser::getProfileVersion() const
+size_t GridProfileParser::getProfileVersion(char* buffer, const size_t size) const
 {
-    char buffer[10];
     HOY_SEMAPHORE_TAKE();
-    snprintf(buffer, sizeof(buffer), "%d.%d.%d", (_payloadGridProfile[2] >> 4) & 0x0f, _payloadGridProfile[2] & 0x0f, _payloadGridProfile[3]);
+    const int len = snprintf(buffer, size, "%d.%d.%d", (_payloadGridProfile[2] >> 4) & 0x0f, _payloadGridProfile[2] & 0x0f, _payloadGridProfile[3]);
     HOY_SEMAPHORE_GIVE();
-    return buffer;
+    return std::min<size_t>(std::max(len, 0), size > 0 ? size - 1 : 0);
 }
 
 std::vector<uint8_t> GridProfileParser::getRawData() const
@@ -414,53 +417,94 @@ std::vector<uint8_t> GridProfileParser::getRawData() const
     return ret;
 }
 
-std::list<GridProfileSection_t> GridProfileParser::getProfile() const
+std::shared_ptr<const GridProfileDecoded_t> GridProfileParser::getProfile() const
 {
-    std::list<GridProfileSection_t> l;
-
-    if (_gridProfileLength > 4) {
-        uint16_t pos = 4;
-        do {
-            const uint8_t section_id = _payloadGridProfile[pos];
-            const uint8_t section_version = _payloadGridProfile[pos + 1];
-            const int16_t section_start = getSectionStart(section_id, section_version);
-            const uint8_t section_size = getSectionSize(section_id, section_version);
-            pos += 2;
+    HOY_SEMAPHORE_TAKE();
+    if (_decodedProfile == nullptr && containsValidData()) {
+        _decodedProfile = decodeProfile();
+    }
+    auto profile = _decodedProfile;
+    HOY_SEMAPHORE_GIVE();
+    return profile;
+}
 
-            GridProfileSection_t section;
-            try {
-                section.SectionName = profileSection.at(section_id).data();
-            } catch (const std::out_of_range&) {
-                section.SectionName = "Unknown";
-                break;
-            }
+size_t GridProfileParser::getAllocatedSize() const
+{
+    HOY_SEMAPHORE_TAKE();
+    const size_t size = _payloadGridProfile.getAllocatedSize() + (_decodedProfile != nullptr ? sizeof(GridProfileDecoded_t) : 0);
+    HOY_SEMAPHORE_GIVE();
+    return size;
+}
 
-            if (section_start == -1) {
-                section.SectionName = "Unknown";
-                break;
-            }
+void GridProfileParser::setLastUpdate(const uint32_t lastUpdate)
+{
+    // Decoded again when it is requested the next time
+    HOY_SEMAPHORE_TAKE();
+    _decodedProfile = nullptr;
+    HOY_SEMAPHORE_GIVE();
+    _restored = false;
+    Parser::setLastUpdate(lastUpdate);
+}
 
-            for (uint8_t val_id = 0; val_id < section_size; val_id++) {
-                auto itemDefinition = itemDefinitions.at(_profileValues[section_start + val_id].ItemDefinition);
+void GridProfileParser::restoreRawData(const uint8_t* data, const uint8_t len)
+{
+    beginAppendFragment();
+    clearBuffer();
+    appendFragment(0, data, min<uint8_t>(len, GRID_PROFILE_SIZE));
+    endAppendFragment();
 
-                float value = static_cast<int16_t>((_payloadGridProfile[pos] << 8) | _payloadGridProfile[pos + 1]);
-                value /= itemDefinition.Divider;
+    setLastUpdate(max<uint32_t>(millis(), 1));
+    _restored = true;
+}
+
+bool GridProfileParser::isRestored() const
+{
+    return _restored;
+}
+
+std::shared_ptr<const GridProfileDecoded_t> GridProfileParser::decodeProfile() const
+{
+    auto profile = std::make_shared<GridProfileDecoded_t>();
+
+    uint16_t pos = 4;
+    while (pos + 1 < _gridProfileLength && profile->SectionCount < profile->Sections.size()) {
+        const uint8_t section_id = _payloadGridProfile[pos];
+        const uint8_t section_version = _payloadGridProfile[pos + 1];
+        const int16_t section_start = getSectionStart(section_id, section_version);
+        const uint8_t section_size = getSectionSize(section_id, section_version);
+        pos += 2;
+
+        // The length of an unknown section is unknown as well, so nothing behind it can be decoded
+        auto sectionName = profileSection.find(section_id);
+        if (sectionName == profileSection.end() || section_start == -1) {
+            break;
+        }
 
-                GridProfileItem_t v;
-                v.Name = itemDefinition.Name.data();
-                v.Unit = itemDefinition.Unit.data();
-                v.Value = value;
-                section.items.push_back(v);
+        GridProfileSection_t& section = profile->Sections[profile->SectionCount++];
+        section.SectionName = sectionName->second.data();
+        section.ItemStart = profile->ItemCount;
+        section.ItemCount = 0;
 
-                pos += 2;
+        for (uint8_t val_id = 0; val_id < section_size && pos + 1 < _gridProfileLength; val_id++) {
+            auto itemDefinition = itemDefinitions.find(_profileValues[section_start + val_id].ItemDefinition);
+            if (itemDefinition == itemDefinitions.end() || profile->ItemCount >= profile->Items.size()) {
+                break;
             }
 
-            l.push_back(section);
+            float value = static_cast<int16_t>((_payloadGridProfile[pos] << 8) | _payloadGridProfile[pos + 1]);
+            value /= itemDefinition->second.Divider;
+
+            GridProfileItem_t& item = profile->Items[profile->ItemCount++];
+            item.Name = itemDefinition->second.Name.data();
+            item.Unit = itemDefinition->second.Unit.data();
+            item.Value = value;
+            section.ItemCount++;
 
-        } while (pos < _gridProfileLength);
+            pos += 2;
+        }
     }
 
-    return l;
+    return profile;
 }
 
 bool GridProfileParser::containsValidData() const
@@ -481,12 +525,10 @@ uint8_t GridProfileParser::getSectionSize(const uint8_t section_id, const uint8_
 
 int16_t GridProfileParser::getSectionStart(const uint8_t section_id, const uint8_t section_version)
 {
-    int16_t count = -1;
-    for (auto& values : _profileValues) {
-        count++;
-        if (values.Section == section_id && values.Version == section_version) {
-            break;
+    for (size_t i = 0; i < _profileValues.size(); i++) {
+        if (_profileValues[i].Section == section_id && _profileValues[i].Version == section_version) {
+            return i;
         }
     }
-    return count;
+    return -1;
 }
@@ -1,12 +1,20 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 #pragma once
 #include "Parser.h"
-#include <list>
+#include "ParserBuffer.h"
+#include <array>
+#include <memory>
+#include <vector>
 
 #define GRID_PROFILE_SIZE 141
+#define GRID_PROFILE_VERSION_SIZE 10
 #define PROFILE_TYPE_COUNT 10
+#define PROFILE_SECTION_COUNT 12
 #define SECTION_VALUE_COUNT 158
 
+// Every value takes two bytes behind the four bytes of the profile id and version
+#define GRID_PROFILE_MAX_ITEMS ((GRID_PROFILE_SIZE - 4) / 2)
+
 typedef struct {
     uint8_t lIdx;
     uint8_t hIdx;
@@ -19,15 +27,25 @@ struct GridProfileValue_t {
     uint8_t ItemDefinition;
 };
 
+// Name and Unit point into the static definition tables
 struct GridProfileItem_t {
-    String Name;
-    String Unit;
+    const char* Name;
+    const char* Unit;
     float Value;
 };
 
 struct GridProfileSection_t {
-    String SectionName;
-    std::list<GridProfileItem_t> items;
+    const char* SectionName;
+    uint8_t ItemStart; // index of the first item in GridProfileDecoded_t::Items
+    uint8_t ItemCount;
+};
+
+// Profile as it was decoded once after it was received
+struct GridProfileDecoded_t {
+    uint8_t SectionCount = 0;
+    std::array<GridProfileSection_t, PROFILE_SECTION_COUNT> Sections;
+    uint8_t ItemCount = 0;
+    std::array<GridProfileItem_t, GRID_PROFILE_MAX_ITEMS> Items;
 };
 
 class GridProfileParser : public Parser {
@@ -36,22 +54,41 @@ public:
     void clearBuffer();
     void appendFragment(const uint8_t offset, const uint8_t* payload, const uint8_t len);
 
-    String getProfileName() const;
-    String getProfileVersion() const;
+    const char* getProfileName() const;
+    // Writes "x.y.z" into buffer, returns the length
+    size_t getProfileVersion(char* buffer, const size_t size) const;
 
     std::vector<uint8_t> getRawData() const;
 
-    std::list<GridProfileSection_t> getProfile() const;
+    // The returned profile is not modified anymore, a new one replaces it with the next response.
+    // It is decoded with the first call after a response and kept until the next one.
+    std::shared_ptr<const GridProfileDecoded_t> getProfile() const;
 
     bool containsValidData() const;
 
+    void setLastUpdate(const uint32_t lastUpdate);
+
+    // Restored data counts as received until the profile is requested again
+    void restoreRawData(const uint8_t* data, const uint8_t len);
+    bool isRestored() const;
+
+    // Raw payload and decoded profile, if allocated
+    size_t getAllocatedSize() const;
+
 private:
+    // Has to be called while holding the semaphore
+    std::shared_ptr<const GridProfileDecoded_t> decodeProfile() const;
+
     static uint8_t getSectionSize(const uint8_t section_id, const uint8_t section_version);
     static int16_t getSectionStart(const uint8_t section_id, const uint8_t section_version);
 
-    uint8_t _payloadGridProfile[GRID_PROFILE_SIZE] = {};
+    ParserBuffer<GRID_PROFILE_SIZE> _payloadGridProfile;
     uint8_t _gridProfileLength = 0;
 
+    mutable std::shared_ptr<const GridProfileDecoded_t> _decodedProfile;
+
+    bool _restored = false;
+
     static const std::array<const ProfileType_t, PROFILE_TYPE_COUNT> _profileTypes;
     static const std::array<const GridProfileValue_t, SECTION_VALUE_COUNT> _profileValues;
 };
@@ -23,9 +23,16 @@ void Parser::setLastUpdate(const uint32_t lastUpdate)
 void Parser::beginAppendFragment()
 {
     HOY_SEMAPHORE_TAKE();
+    _generation.fetch_add(1, std::memory_order_acq_rel);
 }
 
 void Parser::endAppendFragment()
 {
+    _generation.fetch_add(1, std::memory_order_acq_rel);
     HOY_SEMAPHORE_GIVE();
-}
\ No newline at end of file
+}
+
+uint32_t Parser::getGeneration() const
+{
+    return _generation.load(std::memory_order_acquire);
+}
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 #pragma once
 #include <Arduino.h>
+#include <atomic>
 #include <cstdint>
 
 #define HOY_SEMAPHORE_TAKE() \
@@ -8,6 +9,11 @@
     } while (xSemaphoreTake(_xSemaphore, portMAX_DELAY) != pdPASS)
 #define HOY_SEMAPHORE_GIVE() xSemaphoreGive(_xSemaphore)
 
+// Number of optimistic reads before a reader falls back to the semaphore
+#ifndef HOY_PARSER_READ_RETRIES
+#define HOY_PARSER_READ_RETRIES 8
+#endif
+
 typedef enum {
     CMD_OK,
     CMD_NOK,
@@ -23,9 +29,38 @@ public:
     void beginAppendFragment();
     void endAppendFragment();
 
+    // Incremented whenever the data changes. An odd value means an update is in progress.
+    uint32_t getGeneration() const;
+
+    // Runs reader until it completed without a concurrent update, so several values
+    // read within it belong to the same response. Readers do not block the radio
+    // task, only after HOY_PARSER_READ_RETRIES collisions the semaphore is taken.
+    // The reader may run more than once and must not call into the writing methods.
+    template <typename Func>
+    void readConsistent(Func&& reader) const
+    {
+        for (uint8_t retry = 0; retry < HOY_PARSER_READ_RETRIES; retry++) {
+            const uint32_t generation = getGeneration();
+            if ((generation & 1) == 0) {
+                reader();
+                if (getGeneration() == generation) {
+                    return;
+                }
+            }
+            taskYIELD();
+        }
+
+        HOY_SEMAPHORE_TAKE();
+        reader();
+        HOY_SEMAPHORE_GIVE();
+    }
+
 protected:
     SemaphoreHandle_t _xSemaphore;
 
+    // Writers increment it once before and once after changing the data
+    std::atomic<uint32_t> _generation { 0 };
+
 private:
     uint32_t _lastUpdate = 0;
 };
\ No newline at end of file
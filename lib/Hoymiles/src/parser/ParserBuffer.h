@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+#include <Arduino.h>
+#include <cstdint>
+#include <cstring>
+#include <esp_heap_caps.h>
+
+// Put the lazily allocated parser buffers into PSRAM (if found). They are only
+// touched when a response is received or read, never in the rx interrupt.
+#ifndef HOY_PARSER_BUFFER_PSRAM
+#define HOY_PARSER_BUFFER_PSRAM 0
+#endif
+
+// Payload buffer of rarely received responses. It is allocated with the first
+// fragment, inverters which never answer such a request do not pay for it.
+// Reading an unallocated buffer returns zeros.
+template <size_t Size>
+class ParserBuffer {
+public:
+    ParserBuffer() = default;
+    ParserBuffer(const ParserBuffer&) = delete;
+    ParserBuffer& operator=(const ParserBuffer&) = delete;
+
+    ~ParserBuffer()
+    {
+        heap_caps_free(_data);
+    }
+
+    // Returns false if the buffer could not be allocated
+    bool write(const size_t offset, const uint8_t* data, const size_t len)
+    {
+        if (offset + len > Size || !allocate()) {
+            return false;
+        }
+        memcpy(&_data[offset], data, len);
+        return true;
+    }
+
+    uint8_t operator[](const size_t idx) const
+    {
+        return _data != nullptr && idx < Size ? _data[idx] : 0;
+    }
+
+    void clear()
+    {
+        if (_data != nullptr) {
+            memset(_data, 0, Size);
+        }
+    }
+
+    static constexpr size_t size()
+    {
+        return Size;
+    }
+
+    size_t getAllocatedSize() const
+    {
+        return _data != nullptr ? Size : 0;
+    }
+
+private:
+    bool allocate()
+    {
+        if (_data != nullptr) {
+            return true;
+        }
+        if (HOY_PARSER_BUFFER_PSRAM && psramFound()) {
+            _data = static_cast<uint8_t*>(heap_caps_calloc(1, Size, MALLOC_CAP_SPIRAM));
+        }
+        if (_data == nullptr) {
+            _data = static_cast<uint8_t*>(heap_caps_calloc(1, Size, MALLOC_CAP_8BIT));
+        }
+        return _data != nullptr;
+    }
+
+    uint8_t* _data = nullptr;
+};
@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+#include "StatisticsParser.h"
+#include <cstddef>
+#include <iterator>
+#include <utility>
+
+// Decoders generated at compile time from the constexpr byte assignment of an
+// inverter model. Position, length, sign and divisor of every field are constants,
+// so all fields are unpacked in one straight pass without branches on the table.
+//
+// Usage: return decodeStatisticFields<byteAssignment>; in getFieldDecoder()
+namespace StatisticsDecoder {
+
+template <uint8_t Start, uint8_t Num>
+inline uint32_t readRaw(const uint8_t* payload)
+{
+    static_assert(Num >= 1 && Num <= 4, "fields have 1 to 4 bytes");
+    static_assert(Start + Num <= STATISTIC_PACKET_SIZE, "field exceeds the statistic packet");
+
+    uint32_t val = 0;
+    for (uint8_t i = 0; i < Num; i++) {
+        val = (val << 8) | payload[Start + i];
+    }
+    return val;
+}
+
+template <const auto& Table, size_t Index>
+inline void decodeField(const uint8_t* payload, float* values)
+{
+    constexpr byteAssign_t field = Table[Index];
+    if constexpr (field.div != CMD_CALC) {
+        const uint32_t val = readRaw<field.start, field.num>(payload);
+
+        float result;
+        if constexpr (field.isSigned && field.num == 2) {
+            result = static_cast<float>(static_cast<int16_t>(val));
+        } else if constexpr (field.isSigned && field.num == 4) {
+            result = static_cast<float>(static_cast<int32_t>(val));
+        } else {
+            result = static_cast<float>(val);
+        }
+
+        if constexpr (field.div != 1) {
+            result /= static_cast<float>(field.div);
+        }
+        values[Index] = result;
+    }
+}
+
+template <const auto& Table, size_t... Index>
+inline void decodeFields(const uint8_t* payload, float* values, std::index_sequence<Index...>)
+{
+    (decodeField<Table, Index>(payload, values), ...);
+}
+
+} // namespace StatisticsDecoder
+
+template <const auto& Table>
+void decodeStatisticFields(const uint8_t* payload, float* values)
+{
+    StatisticsDecoder::decodeFields<Table>(payload, values, std::make_index_sequence<std::size(Table)>());
+}
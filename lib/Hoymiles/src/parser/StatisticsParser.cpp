@@ -4,6 +4,7 @@
  */
 #include "StatisticsParser.h"
 #include "../Hoymiles.h"
+#include <algorithm>
 
 static float calcTotalYieldTotal(StatisticsParser* iv, uint8_t arg0);
 static float calcTotalYieldDay(StatisticsParser* iv, uint8_t arg0);
@@ -56,23 +57,66 @@ const FieldId_t dailyProductionFields[] = {
     FLD_YD,
 };
 
+// Counters which only increase during the day, their minimum and maximum are known anyway
+static bool isCounterField(const FieldId_t fieldId)
+{
+    return fieldId == FLD_YD || fieldId == FLD_YT || fieldId == FLD_EVT_LOG;
+}
+
 StatisticsParser::StatisticsParser()
     : Parser()
 {
     clearBuffer();
 }
 
-void StatisticsParser::setByteAssignment(const byteAssign_t* byteAssignment, const uint8_t size)
+void StatisticsParser::setByteAssignment(const byteAssign_t* byteAssignment, const uint8_t size, const fieldDecoder_t decoder)
 {
     _byteAssignment = byteAssignment;
     _byteAssignmentSize = size;
+    _fieldDecoder = decoder;
+
+    memset(_fieldIndex, FIELD_INDEX_NONE, sizeof(_fieldIndex));
+    _fieldOffset.assign(_byteAssignmentSize, 0.0f);
+    _fieldValue.assign(_byteAssignmentSize, 0.0f);
+    _fieldStatistics.assign(_byteAssignmentSize, FieldStatistics_t());
+    _previousFieldStatistics.assign(_byteAssignmentSize, FieldStatistics_t());
 
     for (uint8_t i = 0; i < _byteAssignmentSize; i++) {
-        if (_byteAssignment[i].div == CMD_CALC) {
+        const byteAssign_t& assign = _byteAssignment[i];
+
+        // Keep the first match like the previous linear search did
+        uint8_t& index = _fieldIndex[assign.type][assign.ch][assign.fieldId];
+        if (index == FIELD_INDEX_NONE) {
+            index = i;
+        }
+
+        if (assign.div == CMD_CALC) {
             continue;
         }
-        _expectedByteCount = max<uint8_t>(_expectedByteCount, _byteAssignment[i].start + _byteAssignment[i].num);
+        _expectedByteCount = max<uint8_t>(_expectedByteCount, assign.start + assign.num);
+    }
+
+    for (uint8_t t = 0; t < TYPE_CNT; t++) {
+        _channels[t].Count = 0;
+        for (uint8_t ch = 0; ch < CH_CNT; ch++) {
+            const uint8_t* indices = _fieldIndex[t][ch];
+            if (std::any_of(indices, indices + FLD_CNT, [](const uint8_t i) { return i != FIELD_INDEX_NONE; })) {
+                _channels[t].Channels[_channels[t].Count++] = static_cast<ChannelNum_t>(ch);
+            }
+        }
     }
+
+    updateCalculatedFields();
+
+    _generation.fetch_add(2, std::memory_order_acq_rel);
+}
+
+uint8_t StatisticsParser::getFieldIndex(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId) const
+{
+    if (type >= TYPE_CNT || channel >= CH_CNT || fieldId >= FLD_CNT || _byteAssignment == nullptr) {
+        return FIELD_INDEX_NONE;
+    }
+    return _fieldIndex[type][channel][fieldId];
 }
 
 uint8_t StatisticsParser::getExpectedByteCount()
@@ -86,10 +130,10 @@ void StatisticsParser::clearBuffer()
     _statisticLength = 0;
 }
 
-void StatisticsParser::appendFragment(const uint8_t offset, const uint8_t* payload, const uint8_t len)
+void HOY_RX_ATTR StatisticsParser::appendFragment(const uint8_t offset, const uint8_t* payload, const uint8_t len)
 {
     if (offset + len > STATISTIC_PACKET_SIZE) {
-        Hoymiles.getMessageOutput()->printf("FATAL: (%s, %d) stats packet too large for buffer\r\n", __FILE__, __LINE__);
+        HOY_LOGE("FATAL: (%s, %d) stats packet too large for buffer\r\n", __FILE__, __LINE__);
         return;
     }
     memcpy(&_payloadStatistic[offset], payload, len);
@@ -98,6 +142,9 @@ void StatisticsParser::appendFragment(const uint8_t offset, const uint8_t* paylo
 
 void StatisticsParser::endAppendFragment()
 {
+    decodeAllFields();
+    updateFieldStatistics();
+
     Parser::endAppendFragment();
 
     if (!_enableYieldDayCorrection) {
@@ -109,7 +156,7 @@ void StatisticsParser::endAppendFragment()
         // check if current yield day is smaller then last cached yield day
         if (getChannelFieldValue(TYPE_DC, c, FLD_YD) < _lastYieldDay[static_cast<uint8_t>(c)]) {
             // currently all values are zero --> Add last known values to offset
-            Hoymiles.getMessageOutput()->printf("Yield Day reset detected!\r\n");
+            HOY_LOGI("Yield Day reset detected!\r\n");
 
             setChannelFieldOffset(TYPE_DC, c, FLD_YD, _lastYieldDay[static_cast<uint8_t>(c)]);
 
@@ -122,75 +169,139 @@ void StatisticsParser::endAppendFragment()
 
 const byteAssign_t* StatisticsParser::getAssignmentByChannelField(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId) const
 {
-    for (uint8_t i = 0; i < _byteAssignmentSize; i++) {
-        if (_byteAssignment[i].type == type && _byteAssignment[i].ch == channel && _byteAssignment[i].fieldId == fieldId) {
-            return &_byteAssignment[i];
-        }
+    const uint8_t index = getFieldIndex(type, channel, fieldId);
+    if (index == FIELD_INDEX_NONE) {
+        return nullptr;
     }
-    return nullptr;
+    return &_byteAssignment[index];
 }
 
-fieldSettings_t* StatisticsParser::getSettingByChannelField(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId)
+float StatisticsParser::getChannelFieldValue(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId)
 {
-    for (auto& i : _fieldSettings) {
-        if (i.type == type && i.ch == channel && i.fieldId == fieldId) {
-            return &i;
-        }
+    const uint8_t index = getFieldIndex(type, channel, fieldId);
+    if (index == FIELD_INDEX_NONE) {
+        return 0;
     }
-    return nullptr;
+    // Static values are decoded and calculated values evaluated once per update
+    return _fieldValue[index];
 }
 
-float StatisticsParser::getChannelFieldValue(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId)
+void StatisticsParser::decodeField(const uint8_t index)
 {
-    const byteAssign_t* pos = getAssignmentByChannelField(type, channel, fieldId);
-    if (pos == nullptr) {
-        return 0;
+    const byteAssign_t* pos = &_byteAssignment[index];
+    if (CMD_CALC == pos->div) {
+        return;
     }
 
     uint8_t ptr = pos->start;
     const uint8_t end = ptr + pos->num;
-    const uint16_t div = pos->div;
 
-    if (CMD_CALC != div) {
-        // Value is a static value
-        uint32_t val = 0;
-        HOY_SEMAPHORE_TAKE();
-        do {
-            val <<= 8;
-            val |= _payloadStatistic[ptr];
-        } while (++ptr != end);
-        HOY_SEMAPHORE_GIVE();
+    uint32_t val = 0;
+    do {
+        val <<= 8;
+        val |= _payloadStatistic[ptr];
+    } while (++ptr != end);
 
-        float result;
-        if (pos->isSigned && pos->num == 2) {
-            result = static_cast<float>(static_cast<int16_t>(val));
-        } else if (pos->isSigned && pos->num == 4) {
-            result = static_cast<float>(static_cast<int32_t>(val));
-        } else {
-            result = static_cast<float>(val);
-        }
+    float result;
+    if (pos->isSigned && pos->num == 2) {
+        result = static_cast<float>(static_cast<int16_t>(val));
+    } else if (pos->isSigned && pos->num == 4) {
+        result = static_cast<float>(static_cast<int32_t>(val));
+    } else {
+        result = static_cast<float>(val);
+    }
+
+    result /= static_cast<float>(pos->div);
 
-        result /= static_cast<float>(div);
+    if (_statisticLength > 0) {
+        result += _fieldOffset[index];
+    }
+
+    _fieldValue[index] = result;
+}
 
-        const fieldSettings_t* setting = getSettingByChannelField(type, channel, fieldId);
-        if (setting != nullptr && _statisticLength > 0) {
-            result += setting->offset;
+void StatisticsParser::decodeAllFields()
+{
+    // The generation is already odd, beginAppendFragment() incremented it
+    if (_fieldDecoder == nullptr) {
+        for (uint8_t i = 0; i < _byteAssignmentSize; i++) {
+            decodeField(i);
         }
-        return result;
     } else {
-        // Value has to be calculated
-        return calcFunctions[pos->start].func(this, pos->num);
+        _fieldDecoder(_payloadStatistic, _fieldValue.data());
+        if (_statisticLength > 0) {
+            for (uint8_t i = 0; i < _byteAssignmentSize; i++) {
+                _fieldValue[i] += _fieldOffset[i];
+            }
+        }
     }
+    updateCalculatedFields();
+}
 
-    return 0;
+void StatisticsParser::updateCalculatedFields()
+{
+    // The calculation functions only read decoded fields, so the order does not matter
+    for (uint8_t i = 0; i < _byteAssignmentSize; i++) {
+        const byteAssign_t& assign = _byteAssignment[i];
+        if (assign.div == CMD_CALC) {
+            _fieldValue[i] = calcFunctions[assign.start].func(this, assign.num);
+        }
+    }
+}
+
+void StatisticsParser::updateFieldStatistics()
+{
+    // Still within the update, readers see an odd generation
+    if (_statisticLength == 0) {
+        return;
+    }
+    const uint32_t now = millis();
+    for (uint8_t i = 0; i < _byteAssignmentSize; i++) {
+        if (!isCounterField(_byteAssignment[i].fieldId)) {
+            _fieldStatistics[i].add(_fieldValue[i], now);
+        }
+    }
+}
+
+bool StatisticsParser::getChannelFieldStatistics(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId, FieldStatistics_t& statistics, const bool previousDay) const
+{
+    const uint8_t index = getFieldIndex(type, channel, fieldId);
+    if (index == FIELD_INDEX_NONE) {
+        return false;
+    }
+
+    bool found = false;
+    readConsistent([&]() {
+        statistics = previousDay ? _previousFieldStatistics[index] : _fieldStatistics[index];
+        found = statistics.Count > 0;
+    });
+    return found;
+}
+
+void StatisticsParser::resetFieldStatistics()
+{
+    HOY_SEMAPHORE_TAKE();
+    _generation.fetch_add(1, std::memory_order_acq_rel);
+    // Copied instead of swapped, readers never see the vectors reallocated
+    std::copy(_fieldStatistics.begin(), _fieldStatistics.end(), _previousFieldStatistics.begin());
+    std::fill(_fieldStatistics.begin(), _fieldStatistics.end(), FieldStatistics_t());
+    _fieldStatisticsDay++;
+    _generation.fetch_add(1, std::memory_order_acq_rel);
+    HOY_SEMAPHORE_GIVE();
+}
+
+uint32_t StatisticsParser::getFieldStatisticsDay() const
+{
+    return _fieldStatisticsDay;
 }
 
 bool StatisticsParser::setChannelFieldValue(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId, float value)
 {
-    const byteAssign_t* pos = getAssignmentByChannelField(type, channel, fieldId);
-    if (pos == nullptr) {
+    const uint8_t index = getFieldIndex(type, channel, fieldId);
+    if (index == FIELD_INDEX_NONE) {
         return false;
     }
+    const byteAssign_t* pos = &_byteAssignment[index];
 
     uint8_t ptr = pos->start + pos->num - 1;
     const uint8_t end = pos->start;
@@ -200,10 +311,7 @@ bool StatisticsParser::setChannelFieldValue(const ChannelType_t type, const Chan
         return false;
     }
 
-    const fieldSettings_t* setting = getSettingByChannelField(type, channel, fieldId);
-    if (setting != nullptr) {
-        value -= setting->offset;
-    }
+    value -= _fieldOffset[index];
     value *= static_cast<float>(div);
 
     uint32_t val = 0;
@@ -220,22 +328,26 @@ bool StatisticsParser::setChannelFieldValue(const ChannelType_t type, const Chan
         _payloadStatistic[ptr] = val;
         val >>= 8;
     } while (--ptr >= end);
+
+    _generation.fetch_add(1, std::memory_order_acq_rel);
+    decodeField(index);
+    updateCalculatedFields();
+    _generation.fetch_add(1, std::memory_order_acq_rel);
     HOY_SEMAPHORE_GIVE();
 
     return true;
 }
 
-String StatisticsParser::getChannelFieldValueString(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId)
+size_t StatisticsParser::getChannelFieldValueString(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId, char* buffer, const size_t size)
 {
-    return String(
+    return formatFixed(buffer, size,
         getChannelFieldValue(type, channel, fieldId),
-        static_cast<unsigned int>(getChannelFieldDigits(type, channel, fieldId)));
+        getChannelFieldDigits(type, channel, fieldId));
 }
 
 bool StatisticsParser::hasChannelFieldValue(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId) const
 {
-    const byteAssign_t* pos = getAssignmentByChannelField(type, channel, fieldId);
-    return pos != nullptr;
+    return getFieldIndex(type, channel, fieldId) != FIELD_INDEX_NONE;
 }
 
 const char* StatisticsParser::getChannelFieldUnit(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId) const
@@ -258,30 +370,39 @@ uint8_t StatisticsParser::getChannelFieldDigits(const ChannelType_t type, const
 
 float StatisticsParser::getChannelFieldOffset(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId)
 {
-    const fieldSettings_t* setting = getSettingByChannelField(type, channel, fieldId);
-    if (setting != nullptr) {
-        return setting->offset;
+    const uint8_t index = getFieldIndex(type, channel, fieldId);
+    if (index == FIELD_INDEX_NONE) {
+        return 0;
     }
-    return 0;
+    return _fieldOffset[index];
 }
 
 void StatisticsParser::setChannelFieldOffset(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId, const float offset)
 {
-    fieldSettings_t* setting = getSettingByChannelField(type, channel, fieldId);
-    if (setting != nullptr) {
-        setting->offset = offset;
-    } else {
-        _fieldSettings.push_back({ type, channel, fieldId, offset });
+    // Offsets of fields which are not provided by the inverter are never applied
+    const uint8_t index = getFieldIndex(type, channel, fieldId);
+    if (index == FIELD_INDEX_NONE) {
+        return;
     }
+
+    HOY_SEMAPHORE_TAKE();
+    _fieldOffset[index] = offset;
+
+    _generation.fetch_add(1, std::memory_order_acq_rel);
+    decodeField(index);
+    updateCalculatedFields();
+    _generation.fetch_add(1, std::memory_order_acq_rel);
+    HOY_SEMAPHORE_GIVE();
 }
 
-std::list<ChannelType_t> StatisticsParser::getChannelTypes() const
+const std::array<ChannelType_t, TYPE_CNT>& StatisticsParser::getChannelTypes() const
 {
-    return {
+    static constexpr std::array<ChannelType_t, TYPE_CNT> types = {
         TYPE_AC,
         TYPE_DC,
         TYPE_INV
     };
+    return types;
 }
 
 const char* StatisticsParser::getChannelTypeName(const ChannelType_t type) const
@@ -289,16 +410,13 @@ const char* StatisticsParser::getChannelTypeName(const ChannelType_t type) const
     return channelsTypes[type];
 }
 
-std::list<ChannelNum_t> StatisticsParser::getChannelsByType(const ChannelType_t type) const
+const ChannelList_t& StatisticsParser::getChannelsByType(const ChannelType_t type) const
 {
-    std::list<ChannelNum_t> l;
-    for (uint8_t i = 0; i < _byteAssignmentSize; i++) {
-        if (_byteAssignment[i].type == type) {
-            l.push_back(_byteAssignment[i].ch);
-        }
+    static const ChannelList_t none = {};
+    if (type >= TYPE_CNT) {
+        return none;
     }
-    l.unique();
-    return l;
+    return _channels[type];
 }
 
 uint16_t StatisticsParser::getStringMaxPower(const uint8_t channel) const
@@ -309,7 +427,13 @@ uint16_t StatisticsParser::getStringMaxPower(const uint8_t channel) const
 void StatisticsParser::setStringMaxPower(const uint8_t channel, const uint16_t power)
 {
     if (channel < sizeof(_stringMaxPower) / sizeof(_stringMaxPower[0])) {
+        // The irradiation depends on the string power
+        HOY_SEMAPHORE_TAKE();
+        _generation.fetch_add(1, std::memory_order_acq_rel);
         _stringMaxPower[channel] = power;
+        updateCalculatedFields();
+        _generation.fetch_add(1, std::memory_order_acq_rel);
+        HOY_SEMAPHORE_GIVE();
     }
 }
 
@@ -340,6 +464,7 @@ void StatisticsParser::zeroDailyData()
 
 void StatisticsParser::setLastUpdate(const uint32_t lastUpdate)
 {
+    _restored = false;
     Parser::setLastUpdate(lastUpdate);
     setLastUpdateFromInternal(lastUpdate);
 }
@@ -364,6 +489,82 @@ void StatisticsParser::setYieldDayCorrection(const bool enabled)
     _enableYieldDayCorrection = enabled;
 }
 
+size_t StatisticsParser::getAllocatedSize() const
+{
+    return (_fieldOffset.capacity() + _fieldValue.capacity()) * sizeof(float)
+        + (_fieldStatistics.capacity() + _previousFieldStatistics.capacity()) * sizeof(FieldStatistics_t);
+}
+
+StatisticsSnapshot_t StatisticsParser::getSnapshot()
+{
+    StatisticsSnapshot_t snapshot = {};
+
+    HOY_SEMAPHORE_TAKE();
+    memcpy(snapshot.Payload, _payloadStatistic, STATISTIC_PACKET_SIZE);
+    snapshot.Length = _statisticLength;
+    memcpy(snapshot.LastYieldDay, _lastYieldDay, sizeof(_lastYieldDay));
+    HOY_SEMAPHORE_GIVE();
+
+    for (auto& c : getChannelsByType(TYPE_DC)) {
+        snapshot.YieldDayOffset[static_cast<uint8_t>(c)] = getChannelFieldOffset(TYPE_DC, c, FLD_YD);
+    }
+    return snapshot;
+}
+
+uint8_t StatisticsParser::getRawPayload(uint8_t* buffer) const
+{
+    uint8_t length = 0;
+    readConsistent([&]() {
+        length = min<uint8_t>(_statisticLength, STATISTIC_PACKET_SIZE);
+        memcpy(buffer, _payloadStatistic, length);
+    });
+    return length;
+}
+
+void StatisticsParser::restoreSnapshot(const StatisticsSnapshot_t& snapshot, const uint32_t age)
+{
+    if (snapshot.Length < _expectedByteCount || snapshot.Length > STATISTIC_PACKET_SIZE) {
+        // Snapshot of another inverter model
+        return;
+    }
+
+    // The offsets are applied while the payload is decoded
+    for (auto& c : getChannelsByType(TYPE_DC)) {
+        setChannelFieldOffset(TYPE_DC, c, FLD_YD, snapshot.YieldDayOffset[static_cast<uint8_t>(c)]);
+    }
+
+    beginAppendFragment();
+    clearBuffer();
+    appendFragment(0, snapshot.Payload, snapshot.Length);
+    endAppendFragment();
+
+    memcpy(_lastYieldDay, snapshot.LastYieldDay, sizeof(_lastYieldDay));
+
+    // The restored values are no new samples of the day
+    HOY_SEMAPHORE_TAKE();
+    _generation.fetch_add(1, std::memory_order_acq_rel);
+    std::fill(_fieldStatistics.begin(), _fieldStatistics.end(), FieldStatistics_t());
+    _generation.fetch_add(1, std::memory_order_acq_rel);
+    HOY_SEMAPHORE_GIVE();
+
+    // 0 means not received, the restore happens right at boot
+    const uint32_t now = max<uint32_t>(millis(), 1);
+    Parser::setLastUpdate(now);
+    setLastUpdateFromInternal(now);
+    _restored = true;
+    _restoredAge = age;
+}
+
+bool StatisticsParser::isRestored() const
+{
+    return _restored;
+}
+
+uint32_t StatisticsParser::getDataAge() const
+{
+    return millis() - getLastUpdate() + (_restored ? _restoredAge : 0);
+}
+
 void StatisticsParser::zeroFields(const FieldId_t* fields)
 {
     // Loop all channels
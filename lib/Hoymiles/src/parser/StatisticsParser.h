@@ -1,8 +1,10 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 #pragma once
+#include "../NumberFormat.h"
 #include "Parser.h"
+#include <array>
 #include <cstdint>
-#include <list>
+#include <vector>
 
 #define STATISTIC_PACKET_SIZE (7 * 16)
 
@@ -47,7 +49,8 @@ enum FieldId_t {
     FLD_UAC_31,
     FLD_IAC_1,
     FLD_IAC_2,
-    FLD_IAC_3
+    FLD_IAC_3,
+    FLD_CNT
 };
 const char* const fields[] = { "Voltage", "Current", "Power", "YieldDay", "YieldTotal",
     "Voltage", "Current", "Power", "Frequency", "Temperature", "PowerFactor", "Efficiency", "Irradiation", "ReactivePower", "EventLogCount",
@@ -79,10 +82,23 @@ enum ChannelNum_t {
 enum ChannelType_t {
     TYPE_AC = 0,
     TYPE_DC,
-    TYPE_INV
+    TYPE_INV,
+    TYPE_CNT
 };
 const char* const channelsTypes[] = { "AC", "DC", "INV" };
 
+// Channels of one type in ascending order, built once per byte assignment so
+// iterating them does not allocate
+struct ChannelList_t {
+    std::array<ChannelNum_t, CH_CNT> Channels;
+    uint8_t Count = 0;
+
+    const ChannelNum_t* begin() const { return Channels.data(); }
+    const ChannelNum_t* end() const { return Channels.data() + Count; }
+    size_t size() const { return Count; }
+    bool empty() const { return Count == 0; }
+};
+
 typedef struct {
     ChannelType_t type;
     ChannelNum_t ch; // channel 0 - 5
@@ -95,12 +111,53 @@ typedef struct {
     uint8_t digits; // number of valid digits after the decimal point
 } byteAssign_t;
 
-typedef struct {
-    ChannelType_t type;
-    ChannelNum_t ch; // channel 0 - 5
-    FieldId_t fieldId; // field id
-    float offset; // offset (positive/negative) to be applied on the fetched value
-} fieldSettings_t;
+// Decodes all non calculated fields of a byte assignment from the payload into values
+// (without offset), generated per inverter model by decodeStatisticFields<>()
+typedef void (*fieldDecoder_t)(const uint8_t* payload, float* values);
+
+// Marks a field which is not available in the byte assignment
+#define FIELD_INDEX_NONE 0xff
+
+// Online statistics of one field, updated with every response. The mean and the
+// variance are maintained with Welford's algorithm, no samples are stored.
+struct FieldStatistics_t {
+    uint32_t Count;
+    float Min;
+    float Max;
+    uint32_t MinTime; // millis of the response
+    uint32_t MaxTime;
+    float Mean;
+    float M2; // sum of the squared deviations from the mean
+
+    void add(const float value, const uint32_t time)
+    {
+        if (Count == 0 || value < Min) {
+            Min = value;
+            MinTime = time;
+        }
+        if (Count == 0 || value > Max) {
+            Max = value;
+            MaxTime = time;
+        }
+        Count++;
+        const float delta = value - Mean;
+        Mean += delta / Count;
+        M2 += delta * (value - Mean);
+    }
+
+    float getVariance() const
+    {
+        return Count > 1 ? M2 / (Count - 1) : 0;
+    }
+};
+
+// Compact state of the parser, restored after a reboot to show the last values
+struct StatisticsSnapshot_t {
+    uint8_t Payload[STATISTIC_PACKET_SIZE];
+    uint8_t Length;
+    float YieldDayOffset[CH_CNT];
+    float LastYieldDay[CH_CNT];
+};
 
 class StatisticsParser : public Parser {
 public:
@@ -109,16 +166,16 @@ public:
     void appendFragment(const uint8_t offset, const uint8_t* payload, const uint8_t len);
     void endAppendFragment();
 
-    void setByteAssignment(const byteAssign_t* byteAssignment, const uint8_t size);
+    void setByteAssignment(const byteAssign_t* byteAssignment, const uint8_t size, const fieldDecoder_t decoder = nullptr);
 
     // Returns 1 based amount of expected bytes of statistic data
     uint8_t getExpectedByteCount();
 
     const byteAssign_t* getAssignmentByChannelField(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId) const;
-    fieldSettings_t* getSettingByChannelField(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId);
 
     float getChannelFieldValue(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId);
-    String getChannelFieldValueString(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId);
+    // Writes the value with its digits into buffer (see FORMAT_FIXED_BUFFER_SIZE), returns the length
+    size_t getChannelFieldValueString(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId, char* buffer, const size_t size);
     bool hasChannelFieldValue(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId) const;
     const char* getChannelFieldUnit(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId) const;
     const char* getChannelFieldName(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId) const;
@@ -129,9 +186,9 @@ public:
     float getChannelFieldOffset(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId);
     void setChannelFieldOffset(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId, const float offset);
 
-    std::list<ChannelType_t> getChannelTypes() const;
+    const std::array<ChannelType_t, TYPE_CNT>& getChannelTypes() const;
     const char* getChannelTypeName(const ChannelType_t type) const;
-    std::list<ChannelNum_t> getChannelsByType(const ChannelType_t type) const;
+    const ChannelList_t& getChannelsByType(const ChannelType_t type) const;
 
     uint16_t getStringMaxPower(const uint8_t channel) const;
     void setStringMaxPower(const uint8_t channel, const uint16_t power);
@@ -154,21 +211,74 @@ public:
     bool getYieldDayCorrection() const;
     void setYieldDayCorrection(const bool enabled);
 
+    StatisticsSnapshot_t getSnapshot();
+
+    // Statistics of the field since the last daily reset, or of the whole previous day.
+    // False if the field is not available or has no samples.
+    bool getChannelFieldStatistics(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId, FieldStatistics_t& statistics, const bool previousDay = false) const;
+
+    // Ends the day, the current statistics become the ones of the previous day
+    void resetFieldStatistics();
+
+    // Incremented by every resetFieldStatistics()
+    uint32_t getFieldStatisticsDay() const;
+
+    // Copies the undecoded payload of the last response (STATISTIC_PACKET_SIZE bytes), returns its length
+    uint8_t getRawPayload(uint8_t* buffer) const;
+
+    // Field tables which depend on the byte assignment
+    size_t getAllocatedSize() const;
+
+    // Restored data counts as received until the first response of the inverter.
+    // age (ms) is the age of the snapshot at the time of the restore.
+    void restoreSnapshot(const StatisticsSnapshot_t& snapshot, const uint32_t age);
+    bool isRestored() const;
+
+    // Time (ms) since the data was received, including the age of restored data
+    uint32_t getDataAge() const;
+
 private:
     void zeroFields(const FieldId_t* fields);
+    uint8_t getFieldIndex(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId) const;
+
+    // Must be called while holding the semaphore
+    void decodeField(const uint8_t index);
+    void decodeAllFields();
+    void updateCalculatedFields();
+    void updateFieldStatistics();
 
     uint8_t _payloadStatistic[STATISTIC_PACKET_SIZE] = {};
     uint8_t _statisticLength = 0;
     uint16_t _stringMaxPower[CH_CNT];
 
-    const byteAssign_t* _byteAssignment;
-    uint8_t _byteAssignmentSize;
+    const byteAssign_t* _byteAssignment = nullptr;
+    fieldDecoder_t _fieldDecoder = nullptr;
+    uint8_t _byteAssignmentSize = 0;
     uint8_t _expectedByteCount = 0;
-    std::list<fieldSettings_t> _fieldSettings;
+
+    // Position of each field within _byteAssignment, built once in setByteAssignment()
+    uint8_t _fieldIndex[TYPE_CNT][CH_CNT][FLD_CNT];
+    std::array<ChannelList_t, TYPE_CNT> _channels;
+
+    // Offset of each field, indexed by the position within _byteAssignment
+    std::vector<float> _fieldOffset;
+
+    // Decoded value (including offset) of each field, indexed by the position within _byteAssignment.
+    // Calculated fields are evaluated by updateCalculatedFields() whenever the decoded values change.
+    std::vector<float> _fieldValue;
+
+    // Statistics of each field, indexed by the position within _byteAssignment.
+    // Sized with the byte assignment, counters are not accumulated.
+    std::vector<FieldStatistics_t> _fieldStatistics;
+    std::vector<FieldStatistics_t> _previousFieldStatistics;
+    uint32_t _fieldStatisticsDay = 0;
 
     uint32_t _rxFailureCount = 0;
     uint32_t _lastUpdateFromInternal = 0;
 
     bool _enableYieldDayCorrection = false;
     float _lastYieldDay[CH_CNT] = {};
+
+    bool _restored = false;
+    uint32_t _restoredAge = 0;
 };
@@ -35,7 +35,7 @@ void SystemConfigParaParser::clearBuffer()
 void SystemConfigParaParser::appendFragment(const uint8_t offset, const uint8_t* payload, const uint8_t len)
 {
     if (offset + len > (SYSTEM_CONFIG_PARA_SIZE)) {
-        Hoymiles.getMessageOutput()->printf("FATAL: (%s, %d) stats packet too large for buffer\r\n", __FILE__, __LINE__);
+        HOY_LOGE("FATAL: (%s, %d) stats packet too large for buffer\r\n", __FILE__, __LINE__);
         return;
     }
     memcpy(&_payload[offset], payload, len);
@@ -44,9 +44,9 @@ void SystemConfigParaParser::appendFragment(const uint8_t offset, const uint8_t*
 
 float SystemConfigParaParser::getLimitPercent() const
 {
-    HOY_SEMAPHORE_TAKE();
-    const float ret = ((static_cast<uint16_t>(_payload[2]) << 8) | _payload[3]) / 10.0;
-    HOY_SEMAPHORE_GIVE();
+    uint16_t raw;
+    readConsistent([&] { raw = (static_cast<uint16_t>(_payload[2]) << 8) | _payload[3]; });
+    const float ret = raw / 10.0;
 
     // don't pretend the inverter could produce more than its rated power,
     // even though it does process, accept, and even save limit values beyond
@@ -57,10 +57,10 @@ float SystemConfigParaParser::getLimitPercent() const
 void SystemConfigParaParser::setLimitPercent(const float value)
 {
     const uint16_t val = static_cast<uint16_t>(value * 10);
-    HOY_SEMAPHORE_TAKE();
+    beginAppendFragment();
     _payload[2] = val >> 8;
     _payload[3] = val & 0xFF;
-    HOY_SEMAPHORE_GIVE();
+    endAppendFragment();
 }
 
 void SystemConfigParaParser::setLastLimitCommandSuccess(const LastCommandSuccess status)
@@ -102,9 +102,20 @@ uint32_t SystemConfigParaParser::getLastUpdateRequest() const
 void SystemConfigParaParser::setLastUpdateRequest(const uint32_t lastUpdate)
 {
     _lastUpdateRequest = lastUpdate;
+    _readbackRequired = false;
     setLastUpdate(lastUpdate);
 }
 
+void SystemConfigParaParser::requestReadback()
+{
+    _readbackRequired = true;
+}
+
+bool SystemConfigParaParser::isReadbackRequired() const
+{
+    return _readbackRequired || _lastLimitRequestSuccess == CMD_NOK;
+}
+
 uint8_t SystemConfigParaParser::getExpectedByteCount() const
 {
     return SYSTEM_CONFIG_PARA_SIZE;
@@ -23,6 +23,10 @@ public:
     uint32_t getLastUpdateRequest() const;
     void setLastUpdateRequest(const uint32_t lastUpdate);
 
+    // The limit of the inverter may have changed, read it back on the next poll
+    void requestReadback();
+    bool isReadbackRequired() const;
+
     // Returns 1 based amount of expected bytes of data
     uint8_t getExpectedByteCount() const;
 
@@ -35,4 +39,6 @@ private:
 
     uint32_t _lastUpdateCommand = 0;
     uint32_t _lastUpdateRequest = 0;
+
+    bool _readbackRequired = true; // Fetch at startup
 };
\ No newline at end of file
@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "CommandPool.h"
+#include <new>
+
+void CommandPool::reserve(const size_t count)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    while (_blockCount < count) {
+        Block_t* block = new Block_t;
+        block->next = _freeList;
+        _freeList = block;
+        _blockCount++;
+        _freeCount++;
+    }
+}
+
+void* CommandPool::allocate(const size_t size)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (size > sizeof(Block_t)) {
+        _heapFallbackCount++;
+        return ::operator new(size);
+    }
+
+    if (_freeList == nullptr) {
+        // Pool exhausted, grow by one block
+        _blockCount++;
+        return new Block_t;
+    }
+
+    Block_t* block = _freeList;
+    _freeList = block->next;
+    _freeCount--;
+    return block;
+}
+
+void CommandPool::deallocate(void* ptr, const size_t size)
+{
+    if (ptr == nullptr) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (size > sizeof(Block_t)) {
+        ::operator delete(ptr);
+        return;
+    }
+
+    Block_t* block = static_cast<Block_t*>(ptr);
+    block->next = _freeList;
+    _freeList = block;
+    _freeCount++;
+}
+
+size_t CommandPool::getBlockCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _blockCount;
+}
+
+size_t CommandPool::getFreeCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _freeCount;
+}
+
+uint32_t CommandPool::getHeapFallbackCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _heapFallbackCount;
+}
@@ -0,0 +1,96 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+// Size of one pool block. Has to hold the largest command including the shared_ptr control block
+#define HOY_COMMAND_POOL_BLOCK_SIZE 192
+
+// Number of blocks which are reserved for each inverter assigned to a radio
+#define HOY_COMMAND_POOL_BLOCKS_PER_INVERTER 8
+
+// Free list of equally sized memory blocks used for the command objects.
+// Blocks are taken from the heap only if the pool is exhausted and
+// are never returned to it. Therefore the steady state polling does
+// not allocate heap memory anymore.
+class CommandPool {
+public:
+    CommandPool() = default;
+    CommandPool(const CommandPool&) = delete;
+    CommandPool& operator=(const CommandPool&) = delete;
+
+    void reserve(const size_t count);
+
+    void* allocate(const size_t size);
+    void deallocate(void* ptr, const size_t size);
+
+    size_t getBlockCount() const;
+    size_t getFreeCount() const;
+    uint32_t getHeapFallbackCount() const;
+
+private:
+    union Block_t {
+        Block_t* next;
+        alignas(alignof(std::max_align_t)) uint8_t data[HOY_COMMAND_POOL_BLOCK_SIZE];
+    };
+
+    Block_t* _freeList = nullptr;
+    size_t _blockCount = 0;
+    size_t _freeCount = 0;
+
+    // Number of allocations which did not fit into a block
+    uint32_t _heapFallbackCount = 0;
+
+    mutable std::mutex _mutex;
+};
+
+// Allocator to be used with std::allocate_shared. The command and the
+// reference counter are placed together in one pool block.
+template <typename T>
+class CommandPoolAllocator {
+public:
+    using value_type = T;
+
+    explicit CommandPoolAllocator(CommandPool* pool)
+        : _pool(pool)
+    {
+    }
+
+    template <typename U>
+    CommandPoolAllocator(const CommandPoolAllocator<U>& other)
+        : _pool(other.getPool())
+    {
+    }
+
+    T* allocate(const size_t n)
+    {
+        return static_cast<T*>(_pool->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, const size_t n)
+    {
+        _pool->deallocate(ptr, n * sizeof(T));
+    }
+
+    CommandPool* getPool() const
+    {
+        return _pool;
+    }
+
+    template <typename U>
+    bool operator==(const CommandPoolAllocator<U>& other) const
+    {
+        return _pool == other.getPool();
+    }
+
+    template <typename U>
+    bool operator!=(const CommandPoolAllocator<U>& other) const
+    {
+        return _pool != other.getPool();
+    }
+
+private:
+    CommandPool* _pool;
+};
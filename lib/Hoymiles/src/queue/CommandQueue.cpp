@@ -4,48 +4,341 @@
  */
 #include "CommandQueue.h"
 #include "../inverters/InverterAbstract.h"
+#include <Arduino.h>
 #include <algorithm>
 
+CommandQueue::OccupancyKey_t CommandQueue::getKey(const CommandAbstract& cmd)
+{
+    return { cmd.getTargetAddress(), cmd.getCommandKey() };
+}
+
+EnqueueResult CommandQueue::enqueue(const std::shared_ptr<CommandAbstract>& cmd)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    const OccupancyKey_t key = getKey(*cmd);
+    InverterQueue_t& queue = getInverterQueue(key.Target);
+
+    switch (cmd->getQueueInsertType()) {
+    case QueueInsertType::RemoveOldest:
+        if (getOccupancy(key) > 0) {
+            removeSimilar(queue, key);
+        }
+        break;
+    case QueueInsertType::ReplaceExistent:
+        // The command in transmission is kept
+        if (getOccupancy(key) > 0) {
+            // The replacement keeps the place and the age of the old command
+            for (auto& v : queue.Commands) {
+                if (getKey(*v) == key) {
+                    cmd->setQueuedTime(v->getQueuedTime());
+                    v = cmd;
+                }
+            }
+            return EnqueueResult::Replaced;
+        }
+        break;
+    case QueueInsertType::RemoveNewest:
+        if (getOccupancy(key) > 0) {
+            return EnqueueResult::Dropped;
+        }
+        break;
+    case QueueInsertType::AllowMultiple:
+        break;
+    }
+
+    cmd->setQueuedTime(millis());
+    insert(cmd);
+    return EnqueueResult::Appended;
+}
+
+std::shared_ptr<CommandAbstract> CommandQueue::front()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_current == nullptr) {
+        selectNext();
+    }
+    return _current;
+}
+
+std::optional<std::shared_ptr<CommandAbstract>> CommandQueue::pop()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_current == nullptr && !selectNext()) {
+        return {};
+    }
+
+    std::shared_ptr<CommandAbstract> cmd = std::move(_current);
+    _current = nullptr;
+    _size--;
+    release(*cmd);
+
+    // Charge the airtime, the inverter waits until the others had theirs
+    auto it = std::find_if(_inverterQueues.begin(), _inverterQueues.end(),
+        [&](const auto& q) { return q.Target == _currentTarget; });
+    if (it != _inverterQueues.end()) {
+        const int32_t airtime = std::min<uint32_t>(millis() - _currentStart, HOY_QUEUE_DRR_MAX_DEBT);
+        it->Deficit = std::max<int32_t>(it->Deficit - airtime, -HOY_QUEUE_DRR_MAX_DEBT);
+        if (it->Commands.empty()) {
+            // Credit is not saved up while there is nothing to send
+            it->Deficit = std::min<int32_t>(it->Deficit, 0);
+        }
+    }
+
+    return cmd;
+}
+
+unsigned long CommandQueue::size() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _size;
+}
+
 void CommandQueue::removeAllEntriesForInverter(InverterAbstract* inv)
 {
     std::lock_guard<std::mutex> lock(_mutex);
 
-    auto it = std::remove_if(_queue.begin(), _queue.end(),
-        [&](const auto& v) { return v->getTargetAddress() == inv->serial(); });
-    _queue.erase(it, _queue.end());
+    const uint64_t target = inv->serial();
+
+    auto it = std::find_if(_inverterQueues.begin(), _inverterQueues.end(),
+        [&](const auto& q) { return q.Target == target; });
+    if (it != _inverterQueues.end()) {
+        _size -= it->Commands.size();
+        _inverterQueues.erase(it);
+        if (_roundRobinPos >= _inverterQueues.size()) {
+            _roundRobinPos = 0;
+        }
+    }
+
+    if (_current != nullptr && _currentTarget == target) {
+        _current = nullptr;
+        _size--;
+    }
+
+    for (auto entry = _occupancy.begin(); entry != _occupancy.end();) {
+        if (entry->first.Target == target) {
+            entry = _occupancy.erase(entry);
+        } else {
+            ++entry;
+        }
+    }
 }
 
-void CommandQueue::removeDuplicatedEntries(std::shared_ptr<CommandAbstract> cmd)
+uint8_t CommandQueue::deferTelemetry(const uint64_t target)
 {
     std::lock_guard<std::mutex> lock(_mutex);
 
-    auto it = std::remove_if(_queue.begin() + 1, _queue.end(),
+    InverterQueue_t& queue = getInverterQueue(target);
+    auto it = std::remove_if(queue.Commands.begin(), queue.Commands.end(),
         [&](const auto& v) {
-            return cmd->areSameParameter(v.get())
-                && cmd.get()->getQueueInsertType() == QueueInsertType::RemoveOldest;
+            return v->getPriority() == CommandPriority::Telemetry && v->expectsResponse();
         });
-    _queue.erase(it, _queue.end());
+
+    const uint8_t deferred = std::distance(it, queue.Commands.end());
+    for (auto deferredIt = it; deferredIt != queue.Commands.end(); ++deferredIt) {
+        release(**deferredIt);
+    }
+    queue.Commands.erase(it, queue.Commands.end());
+    _size -= deferred;
+
+    return deferred;
 }
 
-void CommandQueue::replaceEntries(std::shared_ptr<CommandAbstract> cmd)
+uint8_t CommandQueue::countSimilarCommands(std::shared_ptr<CommandAbstract> cmd)
 {
     std::lock_guard<std::mutex> lock(_mutex);
+    return getOccupancy(getKey(*cmd));
+}
 
-    std::replace_if(_queue.begin() + 1, _queue.end(),
-        [&](const auto& v) {
-            return cmd.get()->getQueueInsertType() == QueueInsertType::ReplaceExistent
-                && cmd->areSameParameter(v.get());
-            },
-        cmd
-    );
+bool CommandQueue::hasCommands(const uint64_t target, const uint32_t firstTraceId, const uint32_t lastTraceId) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto inRange = [&](const CommandAbstract& cmd) {
+        return cmd.getTraceId() >= firstTraceId && cmd.getTraceId() <= lastTraceId;
+    };
+
+    if (_current != nullptr && _currentTarget == target && inRange(*_current)) {
+        return true;
+    }
+    for (const auto& queue : _inverterQueues) {
+        if (queue.Target != target) {
+            continue;
+        }
+        return std::any_of(queue.Commands.begin(), queue.Commands.end(),
+            [&](const auto& cmd) { return inRange(*cmd); });
+    }
+    return false;
 }
 
-uint8_t CommandQueue::countSimilarCommands(std::shared_ptr<CommandAbstract> cmd)
+std::vector<QueuedCommandInfo_t> CommandQueue::getSnapshot() const
 {
     std::lock_guard<std::mutex> lock(_mutex);
+    const uint32_t now = millis();
+
+    std::vector<QueuedCommandInfo_t> snapshot;
+    snapshot.reserve(_size);
+
+    auto add = [&](const CommandAbstract& cmd, const bool current) {
+        QueuedCommandInfo_t info;
+        info.TraceId = cmd.getTraceId();
+        info.Target = cmd.getTargetAddress();
+        snprintf(info.CommandName, sizeof(info.CommandName), "%s", cmd.getCommandName());
+        info.Priority = cmd.getPriority();
+        info.SendCount = cmd.getSendCount();
+        info.Age = now - cmd.getQueuedTime();
+        info.Timeout = cmd.getTimeout();
+        info.Current = current;
+        snapshot.push_back(info);
+    };
+
+    if (_current != nullptr) {
+        add(*_current, true);
+    }
+    for (const auto& queue : _inverterQueues) {
+        for (const auto& cmd : queue.Commands) {
+            add(*cmd, false);
+        }
+    }
+    return snapshot;
+}
 
-    return std::count_if(_queue.begin(), _queue.end(),
+CommandQueue::InverterQueue_t& CommandQueue::getInverterQueue(const uint64_t target)
+{
+    auto it = std::find_if(_inverterQueues.begin(), _inverterQueues.end(),
+        [&](const auto& q) { return q.Target == target; });
+    if (it != _inverterQueues.end()) {
+        return *it;
+    }
+
+    _inverterQueues.push_back({ target, {}, 0 });
+    return _inverterQueues.back();
+}
+
+void CommandQueue::insert(const std::shared_ptr<CommandAbstract>& cmd)
+{
+    _occupancy[getKey(*cmd)]++;
+    _size++;
+
+    auto& commands = getInverterQueue(cmd->getTargetAddress()).Commands;
+    if (cmd->getPriority() == CommandPriority::Telemetry) {
+        commands.push_back(cmd);
+        return;
+    }
+
+    auto it = std::find_if(commands.begin(), commands.end(),
         [&](const auto& v) {
-            return cmd->areSameParameter(v.get());
+            return v->getPriority() > cmd->getPriority();
         });
+    commands.insert(it, cmd);
+}
+
+void CommandQueue::removeSimilar(InverterQueue_t& queue, const OccupancyKey_t& key)
+{
+    // The command in transmission is kept
+    auto it = std::remove_if(queue.Commands.begin(), queue.Commands.end(),
+        [&](const auto& v) { return getKey(*v) == key; });
+
+    const size_t removed = std::distance(it, queue.Commands.end());
+    queue.Commands.erase(it, queue.Commands.end());
+    _size -= removed;
+
+    auto entry = _occupancy.find(key);
+    if (entry->second > removed) {
+        entry->second -= removed;
+    } else {
+        _occupancy.erase(entry);
+    }
+}
+
+void CommandQueue::release(const CommandAbstract& cmd)
+{
+    auto entry = _occupancy.find(getKey(cmd));
+    if (entry == _occupancy.end()) {
+        return;
+    }
+    if (--entry->second == 0) {
+        _occupancy.erase(entry);
+    }
+}
+
+uint8_t CommandQueue::getOccupancy(const OccupancyKey_t& key) const
+{
+    auto entry = _occupancy.find(key);
+    return entry != _occupancy.end() ? entry->second : 0;
+}
+
+bool CommandQueue::selectNext()
+{
+    InverterQueue_t* queue = selectControl();
+    if (queue == nullptr) {
+        queue = selectTelemetry();
+    }
+    if (queue == nullptr) {
+        return false;
+    }
+
+    _current = queue->Commands.front();
+    queue->Commands.pop_front();
+    _currentTarget = queue->Target;
+    _currentStart = millis();
+    return true;
+}
+
+CommandQueue::InverterQueue_t* CommandQueue::selectControl()
+{
+    // Control commands of all inverters in the order they were queued
+    const uint32_t now = millis();
+    InverterQueue_t* result = nullptr;
+    uint32_t maxWait = 0;
+
+    for (auto& queue : _inverterQueues) {
+        if (queue.Commands.empty() || queue.Commands.front()->getPriority() != CommandPriority::Control) {
+            continue;
+        }
+        const uint32_t wait = now - queue.Commands.front()->getQueuedTime();
+        if (result == nullptr || wait > maxWait) {
+            result = &queue;
+            maxWait = wait;
+        }
+    }
+    return result;
+}
+
+CommandQueue::InverterQueue_t* CommandQueue::selectTelemetry()
+{
+    const size_t count = _inverterQueues.size();
+
+    for (uint8_t round = 0; round < 2; round++) {
+        // An inverter keeps the radio as long as it has airtime left
+        for (size_t i = 0; i < count; i++) {
+            const size_t pos = (_roundRobinPos + i) % count;
+            InverterQueue_t& queue = _inverterQueues[pos];
+            if (!queue.Commands.empty() && queue.Deficit >= 0) {
+                _roundRobinPos = pos;
+                return &queue;
+            }
+        }
+
+        // All inverters with queued commands used up their airtime. Grant as many
+        // rounds at once as it takes until the first one may send again.
+        int32_t minDebt = INT32_MAX;
+        for (auto& queue : _inverterQueues) {
+            if (!queue.Commands.empty()) {
+                minDebt = std::min<int32_t>(minDebt, -queue.Deficit);
+            }
+        }
+        if (minDebt == INT32_MAX) {
+            return nullptr;
+        }
+
+        const int32_t grant = (minDebt + HOY_QUEUE_DRR_QUANTUM - 1) / HOY_QUEUE_DRR_QUANTUM * HOY_QUEUE_DRR_QUANTUM;
+        for (auto& queue : _inverterQueues) {
+            if (!queue.Commands.empty()) {
+                queue.Deficit += grant;
+            }
+        }
+        _roundRobinPos = (_roundRobinPos + 1) % count;
+    }
+    return nullptr;
 }
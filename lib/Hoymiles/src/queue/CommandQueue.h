@@ -2,16 +2,127 @@
 #pragma once
 
 #include "../commands/CommandAbstract.h"
-#include <ThreadSafeQueue.h>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+// Airtime (ms) each inverter with queued commands is granted per round
+#ifndef HOY_QUEUE_DRR_QUANTUM
+#define HOY_QUEUE_DRR_QUANTUM 500
+#endif
+
+// Maximum airtime debt (ms) an inverter can build up
+#define HOY_QUEUE_DRR_MAX_DEBT (4 * HOY_QUEUE_DRR_QUANTUM)
+
+// Length of the command names in the queue snapshot
+#define HOY_QUEUE_NAME_LEN 24
 
 class InverterAbstract;
 
-class CommandQueue : public ThreadSafeQueue<std::shared_ptr<CommandAbstract>> {
+struct QueuedCommandInfo_t {
+    uint32_t TraceId;
+    uint64_t Target;
+    char CommandName[HOY_QUEUE_NAME_LEN];
+    CommandPriority Priority;
+    uint8_t SendCount;
+    uint32_t Age; // ms since the command was queued
+    uint32_t Timeout; // ms, what is left of it for the command in transmission
+    bool Current; // in transmission
+};
+
+enum class EnqueueResult {
+    Appended,
+    Replaced, // an existing entry was replaced by the new command
+    Dropped, // a similar command is already queued
+};
+
+// Commands are queued per inverter. Control commands are dispatched first in the
+// order they were queued. Telemetry is shared by deficit round robin: each
+// dispatched command is charged with the airtime it used, so an unreachable
+// inverter which burns resends and timeouts waits while the others are served.
+class CommandQueue {
 public:
+    CommandQueue() = default;
+    CommandQueue(const CommandQueue&) = delete;
+    CommandQueue& operator=(const CommandQueue&) = delete;
+
+    // Handles the QueueInsertType of the command and inserts it, all within one lock.
+    // Whether a similar command is queued is looked up in constant time.
+    EnqueueResult enqueue(const std::shared_ptr<CommandAbstract>& cmd);
+
+    // Returns the command in transmission. If there is none, the next one is selected.
+    // Must not be called if the queue is empty.
+    std::shared_ptr<CommandAbstract> front();
+
+    // Removes the command in transmission and charges its airtime to the inverter
+    std::optional<std::shared_ptr<CommandAbstract>> pop();
+
+    unsigned long size() const;
+
     void removeAllEntriesForInverter(InverterAbstract* inv);
-    void removeDuplicatedEntries(std::shared_ptr<CommandAbstract> cmd);
-    void replaceEntries(std::shared_ptr<CommandAbstract> cmd);
+
+    // Drops the queued telemetry of an inverter which did not answer. The next poll
+    // requests it again, until then the airtime is left to the other inverters.
+    uint8_t deferTelemetry(const uint64_t target);
 
     uint8_t countSimilarCommands(std::shared_ptr<CommandAbstract> cmd);
+
+    // Whether a command of the inverter within the range of trace ids is queued or in transmission
+    bool hasCommands(const uint64_t target, const uint32_t firstTraceId, const uint32_t lastTraceId) const;
+
+    // Copy of the command in transmission (first) and all pending commands
+    std::vector<QueuedCommandInfo_t> getSnapshot() const;
+
+private:
+    struct OccupancyKey_t {
+        uint64_t Target;
+        uint32_t Command;
+
+        bool operator==(const OccupancyKey_t& other) const
+        {
+            return Target == other.Target && Command == other.Command;
+        }
+    };
+
+    struct OccupancyHash_t {
+        size_t operator()(const OccupancyKey_t& key) const
+        {
+            return static_cast<size_t>(key.Target ^ (key.Target >> 32)) ^ (key.Command * 0x9e3779b9);
+        }
+    };
+
+    struct InverterQueue_t {
+        uint64_t Target;
+        std::deque<std::shared_ptr<CommandAbstract>> Commands; // control commands first
+        int32_t Deficit;
+    };
+
+    static OccupancyKey_t getKey(const CommandAbstract& cmd);
+
+    // Must be called while holding the mutex
+    InverterQueue_t& getInverterQueue(const uint64_t target);
+    void insert(const std::shared_ptr<CommandAbstract>& cmd);
+    void removeSimilar(InverterQueue_t& queue, const OccupancyKey_t& key);
+    void release(const CommandAbstract& cmd);
+    uint8_t getOccupancy(const OccupancyKey_t& key) const;
+    bool selectNext();
+    InverterQueue_t* selectControl();
+    InverterQueue_t* selectTelemetry();
+
+    std::vector<InverterQueue_t> _inverterQueues;
+    size_t _roundRobinPos = 0;
+    size_t _size = 0;
+
+    // Command in transmission, it is not part of the inverter queues anymore
+    std::shared_ptr<CommandAbstract> _current;
+    uint64_t _currentTarget = 0;
+    uint32_t _currentStart = 0;
+
+    // Number of queued commands per inverter and command, including the current one
+    std::unordered_map<OccupancyKey_t, uint8_t, OccupancyHash_t> _occupancy;
+
+    mutable std::mutex _mutex;
 };
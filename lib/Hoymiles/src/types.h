@@ -2,6 +2,29 @@
 #pragma once
 
 #include <cstdint>
+#include <esp_attr.h>
+
+// With HOY_RX_IRAM the receive and decode path of the fragments is placed in IRAM
+// (less than 1 kB) and the crc tables in DRAM. It does not wait for the flash cache then,
+// which is evicted or refilled after flash writes and by other code. While a flash
+// write is running the loop is halted anyway, only IRAM interrupts continue.
+#ifdef HOY_RX_IRAM
+#define HOY_RX_ATTR IRAM_ATTR
+#define HOY_RX_DATA_ATTR DRAM_ATTR
+#else
+#define HOY_RX_ATTR
+#define HOY_RX_DATA_ATTR
+#endif
+
+// Data of an inverter which was updated by a response, see HoymilesClass::setDataCallback()
+enum class InverterData_t : uint8_t {
+    Statistics,
+    DevInfo,
+    SystemConfigPara, // limit read back or set
+    PowerCommand,
+    EventLog,
+    GridProfile,
+};
 
 union serial_u {
     uint64_t u64;
@@ -18,4 +41,5 @@ typedef struct {
     uint8_t channel;
     int8_t rssi;
     bool wasReceived;
+    uint32_t rxTime; // interrupt time in us (lower 32 bits of esp_timer_get_time())
 } fragment_t;
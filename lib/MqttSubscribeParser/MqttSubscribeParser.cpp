@@ -3,6 +3,7 @@
  * Copyright (C) 2022 Thomas Basler and others
  */
 #include "MqttSubscribeParser.h"
+#include <cstring>
 
 void MqttSubscribeParser::register_callback(const std::string& topic, uint8_t qos, const espMqttClientTypes::OnMessageCallback& cb)
 {
@@ -11,6 +12,8 @@ void MqttSubscribeParser::register_callback(const std::string& topic, uint8_t qo
     cbf.qos = qos;
     cbf.cb = cb;
     _callbacks.push_back(cbf);
+
+    insert_into_trie(topic, _callbacks.size() - 1);
 }
 
 void MqttSubscribeParser::unregister_callback(const std::string& topic)
@@ -22,18 +25,23 @@ void MqttSubscribeParser::unregister_callback(const std::string& topic)
             ++it;
         }
     }
+
+    // Indices of the remaining callbacks have changed
+    rebuild_trie();
 }
 
 void MqttSubscribeParser::handle_message(const espMqttClientTypes::MessageProperties& properties, const char* topic, const uint8_t* payload, size_t len, size_t index, size_t total)
 {
-    bool result = false;
-    for (const auto& cb : _callbacks) {
-        if (mosquitto_topic_matches_sub(cb.topic.c_str(), topic, &result) == MOSQ_ERR_SUCCESS) {
-            if (result) {
-                cb.cb(properties, topic, payload, len, index, total);
-            }
-        }
+    if (topic == nullptr || topic[0] == 0) {
+        return;
+    }
+
+    // Wildcards are not allowed within published topics
+    if (strpbrk(topic, "+#") != nullptr) {
+        return;
     }
+
+    match_node(_root, topic, true, properties, topic, payload, len, index, total);
 }
 
 std::vector<cb_filter_t> MqttSubscribeParser::get_callbacks()
@@ -41,131 +49,113 @@ std::vector<cb_filter_t> MqttSubscribeParser::get_callbacks()
     return _callbacks;
 }
 
-/* Does a topic match a subscription? */
-int MqttSubscribeParser::mosquitto_topic_matches_sub(const char* sub, const char* topic, bool* result)
+bool MqttSubscribeParser::is_valid_sub(const std::string& sub)
 {
-    size_t spos;
+    if (sub.empty()) {
+        return false;
+    }
 
-    if (!result)
-        return MOSQ_ERR_INVAL;
-    *result = false;
+    for (size_t i = 0; i < sub.length(); i++) {
+        if (sub[i] != '+' && sub[i] != '#') {
+            continue;
+        }
 
-    if (!sub || !topic || sub[0] == 0 || topic[0] == 0) {
-        return MOSQ_ERR_INVAL;
+        // Wildcards have to occupy a complete level
+        if (i > 0 && sub[i - 1] != '/') {
+            return false;
+        }
+        if (i + 1 < sub.length() && sub[i + 1] != '/') {
+            return false;
+        }
+
+        // Multi level wildcard has to be the last level
+        if (sub[i] == '#' && i + 1 != sub.length()) {
+            return false;
+        }
     }
 
-    if ((sub[0] == '$' && topic[0] != '$')
-        || (topic[0] == '$' && sub[0] != '$')) {
+    return true;
+}
 
-        return MOSQ_ERR_SUCCESS;
+void MqttSubscribeParser::rebuild_trie()
+{
+    _root = trie_node_t();
+    for (size_t i = 0; i < _callbacks.size(); i++) {
+        insert_into_trie(_callbacks[i].topic, i);
+    }
+}
+
+void MqttSubscribeParser::insert_into_trie(const std::string& sub, const size_t idx)
+{
+    if (!is_valid_sub(sub)) {
+        return;
     }
 
-    spos = 0;
+    trie_node_t* node = &_root;
+    size_t start = 0;
 
-    while (sub[0] != 0) {
-        if (topic[0] == '+' || topic[0] == '#') {
-            return MOSQ_ERR_INVAL;
+    for (;;) {
+        const size_t end = sub.find('/', start);
+        const std::string level = sub.substr(start, end == std::string::npos ? std::string::npos : end - start);
+
+        if (level == "#") {
+            node->multi_level.push_back(idx);
+            return;
         }
-        if (sub[0] != topic[0] || topic[0] == 0) { /* Check for wildcard matches */
-            if (sub[0] == '+') {
-                /* Check for bad "+foo" or "a/+foo" subscription */
-                if (spos > 0 && sub[-1] != '/') {
-                    return MOSQ_ERR_INVAL;
-                }
-                /* Check for bad "foo+" or "foo+/a" subscription */
-                if (sub[1] != 0 && sub[1] != '/') {
-                    return MOSQ_ERR_INVAL;
-                }
-                spos++;
-                sub++;
-                while (topic[0] != 0 && topic[0] != '/') {
-                    if (topic[0] == '+' || topic[0] == '#') {
-                        return MOSQ_ERR_INVAL;
-                    }
-                    topic++;
-                }
-                if (topic[0] == 0 && sub[0] == 0) {
-                    *result = true;
-                    return MOSQ_ERR_SUCCESS;
-                }
-            } else if (sub[0] == '#') {
-                /* Check for bad "foo#" subscription */
-                if (spos > 0 && sub[-1] != '/') {
-                    return MOSQ_ERR_INVAL;
-                }
-                /* Check for # not the final character of the sub, e.g. "#foo" */
-                if (sub[1] != 0) {
-                    return MOSQ_ERR_INVAL;
-                } else {
-                    while (topic[0] != 0) {
-                        if (topic[0] == '+' || topic[0] == '#') {
-                            return MOSQ_ERR_INVAL;
-                        }
-                        topic++;
-                    }
-                    *result = true;
-                    return MOSQ_ERR_SUCCESS;
-                }
-            } else {
-                /* Check for e.g. foo/bar matching foo/+/# */
-                if (topic[0] == 0
-                    && spos > 0
-                    && sub[-1] == '+'
-                    && sub[0] == '/'
-                    && sub[1] == '#') {
-                    *result = true;
-                    return MOSQ_ERR_SUCCESS;
-                }
-
-                /* There is no match at this point, but is the sub invalid? */
-                while (sub[0] != 0) {
-                    if (sub[0] == '#' && sub[1] != 0) {
-                        return MOSQ_ERR_INVAL;
-                    }
-                    spos++;
-                    sub++;
-                }
-
-                /* Valid input, but no match */
-                return MOSQ_ERR_SUCCESS;
-            }
-        } else {
-            /* sub[spos] == topic[tpos] */
-            if (topic[1] == 0) {
-                /* Check for e.g. foo matching foo/# */
-                if (sub[1] == '/'
-                    && sub[2] == '#'
-                    && sub[3] == 0) {
-                    *result = true;
-                    return MOSQ_ERR_SUCCESS;
-                }
-            }
-            spos++;
-            sub++;
-            topic++;
-            if (sub[0] == 0 && topic[0] == 0) {
-                *result = true;
-                return MOSQ_ERR_SUCCESS;
-            } else if (topic[0] == 0 && sub[0] == '+' && sub[1] == 0) {
-                if (spos > 0 && sub[-1] != '/') {
-                    return MOSQ_ERR_INVAL;
-                }
-                spos++;
-                sub++;
-                *result = true;
-                return MOSQ_ERR_SUCCESS;
+
+        trie_node_t* child = nullptr;
+        for (auto& c : node->children) {
+            if (c.level == level) {
+                child = &c;
+                break;
             }
         }
+        if (child == nullptr) {
+            node->children.emplace_back();
+            child = &node->children.back();
+            child->level = level;
+        }
+        node = child;
+
+        if (end == std::string::npos) {
+            node->callbacks.push_back(idx);
+            return;
+        }
+        start = end + 1;
     }
-    if ((topic[0] != 0 || sub[0] != 0)) {
-        *result = false;
+}
+
+// topic points to the remaining levels or is nullptr if all levels were consumed
+void MqttSubscribeParser::match_node(const trie_node_t& node, const char* topic, const bool first_level, const espMqttClientTypes::MessageProperties& properties, const char* full_topic, const uint8_t* payload, size_t len, size_t index, size_t total) const
+{
+    // Wildcards at the first level do not match topics starting with $
+    const bool system_topic = first_level && full_topic[0] == '$';
+
+    // "#" also matches the parent level, e.g. foo/# matches foo
+    if (!system_topic) {
+        for (const size_t idx : node.multi_level) {
+            _callbacks[idx].cb(properties, full_topic, payload, len, index, total);
+        }
     }
-    while (topic[0] != 0) {
-        if (topic[0] == '+' || topic[0] == '#') {
-            return MOSQ_ERR_INVAL;
+
+    if (topic == nullptr) {
+        for (const size_t idx : node.callbacks) {
+            _callbacks[idx].cb(properties, full_topic, payload, len, index, total);
         }
-        topic++;
+        return;
     }
 
-    return MOSQ_ERR_SUCCESS;
+    const char* level_end = strchr(topic, '/');
+    const size_t level_len = level_end != nullptr ? level_end - topic : strlen(topic);
+    const char* next = level_end != nullptr ? level_end + 1 : nullptr;
+
+    for (const auto& child : node.children) {
+        if (child.level == "+") {
+            if (!system_topic) {
+                match_node(child, next, false, properties, full_topic, payload, len, index, total);
+            }
+        } else if (child.level.length() == level_len && memcmp(child.level.data(), topic, level_len) == 0) {
+            match_node(child, next, false, properties, full_topic, payload, len, index, total);
+        }
+    }
 }
@@ -20,12 +20,19 @@ public:
     std::vector<cb_filter_t> get_callbacks();
 
 private:
-    int mosquitto_topic_matches_sub(const char* sub, const char* topic, bool* result);
+    // One node per topic level of all registered filters
+    struct trie_node_t {
+        std::string level;
+        std::vector<trie_node_t> children;
+        std::vector<size_t> callbacks; // filters ending at this level
+        std::vector<size_t> multi_level; // filters ending with "#" after this level
+    };
 
-    std::vector<cb_filter_t> _callbacks;
+    static bool is_valid_sub(const std::string& sub);
+    void rebuild_trie();
+    void insert_into_trie(const std::string& sub, const size_t idx);
+    void match_node(const trie_node_t& node, const char* topic, const bool first_level, const espMqttClientTypes::MessageProperties& properties, const char* full_topic, const uint8_t* payload, size_t len, size_t index, size_t total) const;
 
-    enum mosq_err_t {
-        MOSQ_ERR_SUCCESS = 0,
-        MOSQ_ERR_INVAL = 3,
-    };
-};
\ No newline at end of file
+    std::vector<cb_filter_t> _callbacks;
+    trie_node_t _root;
+};
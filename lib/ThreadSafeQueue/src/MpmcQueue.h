@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Bounded lock free queue for any number of producers and consumers (D. Vyukov).
+// Every slot has a sequence number which tells whether it can be written or read in
+// the current round, so producers and consumers only contend on their own index.
+// N has to be a power of two. No allocation after construction, push() and pop()
+// never block and may be called from an ISR.
+template <typename T, size_t N>
+class MpmcQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "N has to be a power of two");
+
+public:
+    MpmcQueue()
+    {
+        for (size_t i = 0; i < N; i++) {
+            _slots[i].Sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    MpmcQueue(const MpmcQueue<T, N>&) = delete;
+    MpmcQueue& operator=(const MpmcQueue<T, N>&) = delete;
+
+    // Returns false if the queue is full
+    bool push(const T& item)
+    {
+        size_t pos = _head.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = _slots[pos & MASK];
+            const size_t seq = slot.Sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.Item = item;
+                    slot.Sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = _head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false if the queue is empty
+    bool pop(T& item)
+    {
+        size_t pos = _tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = _slots[pos & MASK];
+            const size_t seq = slot.Sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    item = slot.Item;
+                    slot.Sequence.store(pos + N, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // empty
+            } else {
+                pos = _tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Only a snapshot while other tasks push or pop
+    size_t size() const
+    {
+        const size_t head = _head.load(std::memory_order_acquire);
+        const size_t tail = _tail.load(std::memory_order_acquire);
+        return head - tail <= N ? head - tail : 0;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    static constexpr size_t capacity()
+    {
+        return N;
+    }
+
+private:
+    static constexpr size_t MASK = N - 1;
+
+    struct Slot {
+        std::atomic<size_t> Sequence;
+        T Item;
+    };
+
+    std::array<Slot, N> _slots;
+    std::atomic<size_t> _head { 0 };
+    std::atomic<size_t> _tail { 0 };
+};
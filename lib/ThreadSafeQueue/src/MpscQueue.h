@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Bounded lock free queue for any number of producers and exactly one consumer, e.g.
+// log or event producers in several tasks and one task which handles them. Works like
+// MpmcQueue but the consumer owns the read index, so pop() needs no compare and swap.
+// N has to be a power of two. No allocation after construction, push() never blocks
+// and may be called from an ISR. Only pop()/front() must be called from the consumer.
+template <typename T, size_t N>
+class MpscQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "N has to be a power of two");
+
+public:
+    MpscQueue()
+    {
+        for (size_t i = 0; i < N; i++) {
+            _slots[i].Sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    MpscQueue(const MpscQueue<T, N>&) = delete;
+    MpscQueue& operator=(const MpscQueue<T, N>&) = delete;
+
+    // Returns false if the queue is full
+    bool push(const T& item)
+    {
+        size_t pos = _head.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = _slots[pos & MASK];
+            const size_t seq = slot.Sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.Item = item;
+                    slot.Sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = _head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns a pointer to the oldest element or nullptr if there is none. An element
+    // whose producer has not finished writing it counts as not yet there.
+    const T* front() const
+    {
+        const Slot& slot = _slots[_tail & MASK];
+        if (slot.Sequence.load(std::memory_order_acquire) != _tail + 1) {
+            return nullptr;
+        }
+        return &slot.Item;
+    }
+
+    // Returns false if the queue is empty
+    bool pop(T& item)
+    {
+        const T* next = front();
+        if (next == nullptr) {
+            return false;
+        }
+        item = *next;
+        pop();
+        return true;
+    }
+
+    // Removes the element returned by front()
+    void pop()
+    {
+        Slot& slot = _slots[_tail & MASK];
+        if (slot.Sequence.load(std::memory_order_acquire) != _tail + 1) {
+            return;
+        }
+        slot.Sequence.store(_tail + N, std::memory_order_release);
+        _tail++;
+    }
+
+    // Only valid in the consumer
+    bool empty() const
+    {
+        return front() == nullptr;
+    }
+
+    static constexpr size_t capacity()
+    {
+        return N;
+    }
+
+private:
+    static constexpr size_t MASK = N - 1;
+
+    struct Slot {
+        std::atomic<size_t> Sequence;
+        T Item;
+    };
+
+    std::array<Slot, N> _slots;
+    std::atomic<size_t> _head { 0 };
+    size_t _tail = 0; // only used by the consumer
+};
@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Lock free ring buffer for exactly one producer and one consumer.
+// The producer may run in a different task (or core) than the consumer, or in an ISR
+// as push() never blocks. Only push() must be called from the producer, only
+// front()/pop() from the consumer.
+template <typename T, size_t N>
+class SpscRingBuffer {
+public:
+    SpscRingBuffer() = default;
+    SpscRingBuffer(const SpscRingBuffer<T, N>&) = delete;
+    SpscRingBuffer& operator=(const SpscRingBuffer<T, N>&) = delete;
+
+    bool push(const T& item)
+    {
+        const size_t head = _head.load(std::memory_order_relaxed);
+        const size_t next = increment(head);
+        if (next == _tail.load(std::memory_order_acquire)) {
+            return false; // full
+        }
+        _buffer[head] = item;
+        _head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Returns a reference to the oldest element. Must not be called on an empty buffer.
+    const T& front() const
+    {
+        return _buffer[_tail.load(std::memory_order_relaxed)];
+    }
+
+    // Copies and removes the oldest element, returns false if the buffer is empty
+    bool pop(T& item)
+    {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = _buffer[tail];
+        _tail.store(increment(tail), std::memory_order_release);
+        return true;
+    }
+
+    void pop()
+    {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) {
+            return;
+        }
+        _tail.store(increment(tail), std::memory_order_release);
+    }
+
+    bool empty() const
+    {
+        return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+    }
+
+    bool full() const
+    {
+        return increment(_head.load(std::memory_order_acquire)) == _tail.load(std::memory_order_acquire);
+    }
+
+    size_t size() const
+    {
+        const size_t head = _head.load(std::memory_order_acquire);
+        const size_t tail = _tail.load(std::memory_order_acquire);
+        return (head >= tail) ? head - tail : head + SLOTS - tail;
+    }
+
+    static constexpr size_t capacity()
+    {
+        return N;
+    }
+
+private:
+    // One slot is always kept free to distinguish between full and empty
+    static constexpr size_t SLOTS = N + 1;
+
+    static constexpr size_t increment(const size_t idx)
+    {
+        return (idx + 1) % SLOTS;
+    }
+
+    std::array<T, SLOTS> _buffer;
+    std::atomic<size_t> _head { 0 };
+    std::atomic<size_t> _tail { 0 };
+};
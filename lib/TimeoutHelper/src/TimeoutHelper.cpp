@@ -30,4 +30,9 @@ void TimeoutHelper::reset()
 bool TimeoutHelper::occured() const
 {
     return millis() > (startMillis + timeout);
-}
\ No newline at end of file
+}
+uint32_t TimeoutHelper::remaining() const
+{
+    const uint32_t elapsed = millis() - startMillis;
+    return elapsed < timeout ? timeout - elapsed : 0;
+}
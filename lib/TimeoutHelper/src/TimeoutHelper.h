@@ -10,6 +10,7 @@ public:
     void extend(const uint32_t ms);
     void reset();
     bool occured() const;
+    uint32_t remaining() const; // ms, 0 once occured
 
 private:
     uint32_t startMillis;
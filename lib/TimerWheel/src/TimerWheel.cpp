@@ -0,0 +1,229 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "TimerWheel.h"
+#include <algorithm>
+
+#define TIMER_WHEEL_SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+static constexpr uint8_t levelShift(const uint8_t level)
+{
+    return level * TIMER_WHEEL_SLOT_BITS;
+}
+
+WheelTimer::WheelTimer(Callback callback)
+    : _callback(std::move(callback))
+{
+}
+
+WheelTimer::~WheelTimer()
+{
+    cancel();
+}
+
+void WheelTimer::setCallback(Callback callback)
+{
+    _callback = std::move(callback);
+}
+
+bool WheelTimer::isArmed() const
+{
+    return _wheel != nullptr;
+}
+
+void WheelTimer::cancel()
+{
+    if (_wheel != nullptr) {
+        _wheel->remove(this);
+    }
+}
+
+uint32_t WheelTimer::getDeadline() const
+{
+    return _deadline;
+}
+
+TimerWheel::TimerWheel(const uint32_t now)
+    : _now(now)
+{
+}
+
+TimerWheel::~TimerWheel()
+{
+    for (auto& level : _slots) {
+        for (auto& head : level) {
+            while (head.Next != &head) {
+                WheelTimer* timer = static_cast<WheelTimer*>(head.Next);
+                unlink(timer);
+                timer->_wheel = nullptr;
+            }
+        }
+    }
+}
+
+void TimerWheel::unlink(TimerNode* node)
+{
+    node->Prev->Next = node->Next;
+    node->Next->Prev = node->Prev;
+    node->Prev = node;
+    node->Next = node;
+}
+
+void TimerWheel::append(TimerNode& head, TimerNode* node)
+{
+    node->Prev = head.Prev;
+    node->Next = &head;
+    head.Prev->Next = node;
+    head.Prev = node;
+}
+
+void TimerWheel::arm(WheelTimer& timer, const uint32_t delay, const uint32_t period)
+{
+    timer.cancel();
+    timer._deadline = _now + std::max<uint32_t>(delay, 1);
+    timer._period = period;
+    insert(&timer);
+}
+
+void TimerWheel::insert(WheelTimer* timer)
+{
+    const uint32_t delta = timer->_deadline - _now;
+
+    uint8_t level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1UL << levelShift(level + 1))) {
+        level++;
+    }
+
+    // Too far in the future, placed at the end of the wheel and re-placed when it is reached
+    const uint32_t position = delta <= TIMER_WHEEL_MAX_DELAY ? timer->_deadline : _now + TIMER_WHEEL_MAX_DELAY;
+    const uint8_t slot = (position >> levelShift(level)) & TIMER_WHEEL_SLOT_MASK;
+
+    append(_slots[level][slot], timer);
+    _occupied[level] |= 1ULL << slot;
+    timer->_wheel = this;
+    timer->_level = level;
+    timer->_slot = slot;
+    _armed++;
+}
+
+void TimerWheel::remove(WheelTimer* timer)
+{
+    TimerNode& head = _slots[timer->_level][timer->_slot];
+    unlink(timer);
+    if (head.Next == &head) {
+        _occupied[timer->_level] &= ~(1ULL << timer->_slot);
+    }
+    timer->_wheel = nullptr;
+    _armed--;
+}
+
+// Moves the timers of the slot of the level which has become current one level down
+void TimerWheel::cascade(const uint8_t level)
+{
+    const uint8_t slot = (_now >> levelShift(level)) & TIMER_WHEEL_SLOT_MASK;
+    TimerNode& head = _slots[level][slot];
+    while (head.Next != &head) {
+        WheelTimer* timer = static_cast<WheelTimer*>(head.Next);
+        remove(timer);
+        insert(timer);
+    }
+}
+
+void TimerWheel::expire()
+{
+    const uint8_t slot = _now & TIMER_WHEEL_SLOT_MASK;
+    if (!(_occupied[0] & (1ULL << slot))) {
+        return;
+    }
+
+    // The callbacks may change the slot, so the timers are taken out first
+    TimerNode pending;
+    TimerNode& head = _slots[0][slot];
+    pending.Next = head.Next;
+    pending.Prev = head.Prev;
+    pending.Next->Prev = &pending;
+    pending.Prev->Next = &pending;
+    head.Next = &head;
+    head.Prev = &head;
+    _occupied[0] &= ~(1ULL << slot);
+
+    while (pending.Next != &pending) {
+        WheelTimer* timer = static_cast<WheelTimer*>(pending.Next);
+        unlink(timer);
+        timer->_wheel = nullptr;
+        _armed--;
+
+        if (timer->_deadline != _now) {
+            insert(timer); // placed at the end of the wheel, not yet due
+            continue;
+        }
+
+        if (timer->_period > 0) {
+            timer->_deadline += timer->_period;
+            insert(timer);
+        }
+        // Last access, the callback may re-arm or cancel the timer
+        if (timer->_callback) {
+            timer->_callback();
+        }
+    }
+}
+
+void TimerWheel::advance(const uint32_t now)
+{
+    while (_now != now) {
+        // Nothing expires in level 0, skip to the end of the current round
+        if (_occupied[0] == 0) {
+            const uint32_t roundEnd = _now | TIMER_WHEEL_SLOT_MASK;
+            _now = (now - _now) < (roundEnd - _now) ? now : roundEnd;
+            if (_now == now) {
+                break;
+            }
+        }
+
+        _now++;
+        for (uint8_t level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+            if ((_now & ((1UL << levelShift(level)) - 1)) != 0) {
+                break;
+            }
+            cascade(level);
+        }
+        expire();
+    }
+}
+
+uint32_t TimerWheel::getTime() const
+{
+    return _now;
+}
+
+uint32_t TimerWheel::getNextWakeup() const
+{
+    uint32_t wakeup = UINT32_MAX;
+    for (uint8_t level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        if (_occupied[level] == 0) {
+            continue;
+        }
+        const uint8_t shift = levelShift(level);
+        const uint8_t current = (_now >> shift) & TIMER_WHEEL_SLOT_MASK;
+
+        // Distance to the next occupied slot. The current slot of an upper level
+        // was already moved down, a timer in it is one round ahead.
+        const uint8_t first = (current + 1) & TIMER_WHEEL_SLOT_MASK;
+        const uint64_t rotated = first == 0
+            ? _occupied[level]
+            : (_occupied[level] >> first) | (_occupied[level] << (TIMER_WHEEL_SLOTS - first));
+        const uint32_t distance = 1 + __builtin_ctzll(rotated);
+
+        // Start of the slot, relative to now
+        const uint32_t start = (((_now >> shift) + distance) << shift) - _now;
+        wakeup = std::min(wakeup, start);
+    }
+    return wakeup;
+}
+
+size_t TimerWheel::getArmedCount() const
+{
+    return _armed;
+}
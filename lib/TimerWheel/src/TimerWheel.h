@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+
+// Longest delay (ticks) which is placed directly, longer ones are re-placed on the way
+#define TIMER_WHEEL_MAX_DELAY ((1UL << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOT_BITS)) - 1)
+
+class TimerWheel;
+
+struct TimerNode {
+    TimerNode* Prev = this;
+    TimerNode* Next = this;
+};
+
+// A deadline which is registered at a TimerWheel. The timer does not allocate, it is
+// linked into the slot of its deadline. Destroying an armed timer cancels it.
+class WheelTimer : private TimerNode {
+public:
+    using Callback = std::function<void()>;
+
+    WheelTimer() = default;
+    explicit WheelTimer(Callback callback);
+    WheelTimer(const WheelTimer&) = delete;
+    WheelTimer& operator=(const WheelTimer&) = delete;
+    ~WheelTimer();
+
+    void setCallback(Callback callback);
+
+    bool isArmed() const;
+    void cancel();
+
+    // Time of the wheel at which the timer expires, only valid while armed
+    uint32_t getDeadline() const;
+
+private:
+    friend class TimerWheel;
+
+    TimerWheel* _wheel = nullptr;
+    uint32_t _deadline = 0;
+    uint32_t _period = 0; // 0 for one shot timers
+    uint8_t _level = 0;
+    uint8_t _slot = 0;
+    Callback _callback;
+};
+
+// Hashed hierarchical timer wheel (Varghese & Lauck). Level 0 has one slot per tick,
+// every further level has slots of TIMER_WHEEL_SLOTS times the width of the level
+// below. A timer is placed by its deadline and moves one level down whenever the
+// slot of its level becomes current, so arm and cancel are O(1) and every tick only
+// touches the timers which expire in it.
+//
+// The wheel has no time source, the owner calls advance() with the current time.
+// Not thread safe, all calls have to be made from the same task.
+class TimerWheel {
+public:
+    explicit TimerWheel(const uint32_t now = 0);
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+    ~TimerWheel();
+
+    // Expires the timer after delay ticks (at least one), and after that every period
+    // ticks if period > 0. An armed timer is moved to the new deadline.
+    void arm(WheelTimer& timer, const uint32_t delay, const uint32_t period = 0);
+
+    // Runs the callbacks of all timers which expire up to now. The callbacks may arm
+    // and cancel timers, including their own.
+    void advance(const uint32_t now);
+
+    uint32_t getTime() const;
+
+    // Ticks until the next slot with a timer becomes current, UINT32_MAX if no timer is
+    // armed. Timers of the upper levels are not expired then but moved down, it is the
+    // latest time advance() has to be called.
+    uint32_t getNextWakeup() const;
+
+    size_t getArmedCount() const;
+
+private:
+    friend class WheelTimer;
+
+    static void unlink(TimerNode* node);
+    static void append(TimerNode& head, TimerNode* node);
+
+    void insert(WheelTimer* timer);
+    void remove(WheelTimer* timer);
+    void cascade(const uint8_t level);
+    void expire();
+
+    uint32_t _now;
+    size_t _armed = 0;
+    std::array<std::array<TimerNode, TIMER_WHEEL_SLOTS>, TIMER_WHEEL_LEVELS> _slots;
+    std::array<uint64_t, TIMER_WHEEL_LEVELS> _occupied = {}; // bit per non empty slot
+};
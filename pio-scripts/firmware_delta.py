@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# Copyright (C) 2025 Thomas Basler and others
+#
+# Creates a delta image which builds a new firmware from the firmware running on
+# the device. The result can be downloaded by the DTU using /api/firmware/pull.
+#
+# Usage: firmware_delta.py <running firmware.bin> <new firmware.bin> <output.delta>
+#
+# Format (little endian, see include/FirmwarePull.h):
+#   header: magic "ODDL", u16 version, u16 reserved, u32 source size,
+#           u32 target size, 16 byte source md5, 16 byte target md5
+#   ops:    0x01 u32 offset u32 length   copy from the running firmware
+#           0x02 u32 length <data>       insert the following data
+#           0x00                         end
+
+import hashlib
+import struct
+import sys
+
+MAGIC = 0x4C44444F
+VERSION = 1
+
+OP_END = 0
+OP_COPY = 1
+OP_INSERT = 2
+
+# Length of the blocks used to find matching data. Code moves by multiples of
+# four bytes in most cases, so only aligned positions of the source are indexed.
+BLOCK = 32
+STEP = 4
+
+# A copy has to be longer than its operation to save anything
+MIN_COPY = BLOCK
+
+
+def create_delta(source, target):
+    index = {}
+    for pos in range(0, len(source) - BLOCK + 1, STEP):
+        index.setdefault(source[pos:pos + BLOCK], pos)
+
+    ops = []
+    literal = bytearray()
+    pos = 0
+    last_copy_end = 0
+
+    def flush_literal():
+        if literal:
+            ops.append(struct.pack("<BI", OP_INSERT, len(literal)) + bytes(literal))
+            literal.clear()
+
+    while pos < len(target):
+        # Continuing behind the previous copy is the most likely match
+        candidates = []
+        if last_copy_end + BLOCK <= len(source) and source[last_copy_end:last_copy_end + BLOCK] == target[pos:pos + BLOCK]:
+            candidates.append(last_copy_end)
+        match = index.get(target[pos:pos + BLOCK])
+        if match is not None:
+            candidates.append(match)
+
+        best_offset, best_len = 0, 0
+        for offset in candidates:
+            length = BLOCK
+            while pos + length < len(target) and offset + length < len(source) and source[offset + length] == target[pos + length]:
+                length += 1
+            if length > best_len:
+                best_offset, best_len = offset, length
+
+        if best_len >= MIN_COPY:
+            flush_literal()
+            ops.append(struct.pack("<BII", OP_COPY, best_offset, best_len))
+            pos += best_len
+            last_copy_end = best_offset + best_len
+        else:
+            literal.append(target[pos])
+            pos += 1
+
+    flush_literal()
+    ops.append(struct.pack("<B", OP_END))
+
+    header = struct.pack("<IHHII16s16s", MAGIC, VERSION, 0, len(source), len(target),
+                         hashlib.md5(source).digest(), hashlib.md5(target).digest())
+    return header + b"".join(ops)
+
+
+def main():
+    if len(sys.argv) != 4:
+        print("Usage: %s <running firmware.bin> <new firmware.bin> <output.delta>" % sys.argv[0])
+        return 1
+
+    with open(sys.argv[1], "rb") as f:
+        source = f.read()
+    with open(sys.argv[2], "rb") as f:
+        target = f.read()
+
+    delta = create_delta(source, target)
+    with open(sys.argv[3], "wb") as f:
+        f.write(delta)
+
+    print("Delta: %d bytes (%.1f%% of %d bytes)" % (len(delta), 100.0 * len(delta) / len(target), len(target)))
+    # The DTU needs this md5 in the "md5" field of /api/firmware/pull
+    print("Target md5: %s" % hashlib.md5(target).hexdigest())
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
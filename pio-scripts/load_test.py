@@ -0,0 +1,305 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# Copyright (C) 2025 Thomas Basler and others
+#
+# Generates load on a running DTU and reports the latencies measured by the device.
+# The test first runs idle for the baseline time, then with the configured load for
+# the duration. The histograms of /api/prometheus/metrics are read before and after
+# each phase, so only the observations of a phase are compared:
+#   opendtu_handler_duration_ms   web api and mqtt handlers
+#   opendtu_ws_live_frame_lag_ms  statistics update until the live frame was queued
+#   opendtu_stats_interval_ms     polling cycle time of the inverters
+#
+# Usage: load_test.py <host> [options], see --help
+#
+# The websocket load requires the websocket-client package, the mqtt load paho-mqtt.
+# The mqtt load only publishes to the given topic, choose one without side effects
+# unless the command handling itself should be tested.
+#
+# Returns 1 if one of the thresholds is exceeded.
+
+import argparse
+import base64
+import re
+import sys
+import threading
+import time
+import urllib.request
+
+METRICS_PATH = "/api/prometheus/metrics"
+
+LINE_RE = re.compile(r'^(\w+)_(bucket|sum|count)\{([^}]*)\} (\S+)$')
+
+
+def fetch(args, path, timeout=10):
+    request = urllib.request.Request("http://%s%s" % (args.host, path))
+    if args.password:
+        token = base64.b64encode(("admin:%s" % args.password).encode()).decode()
+        request.add_header("Authorization", "Basic " + token)
+    with urllib.request.urlopen(request, timeout=timeout) as response:
+        return response.read()
+
+
+def read_histograms(args):
+    """Returns {(metric, labels): {"buckets": [(le, count)], "sum": x, "count": n}}"""
+    histograms = {}
+    for line in fetch(args, METRICS_PATH).decode().splitlines():
+        match = LINE_RE.match(line)
+        if match is None:
+            continue
+        metric, kind, labels, value = match.groups()
+        le = None
+        parts = []
+        for label in labels.split(","):
+            if label.startswith("le="):
+                le = label[4:-1]
+            else:
+                parts.append(label)
+        h = histograms.setdefault((metric, ",".join(parts)), {"buckets": [], "sum": 0, "count": 0})
+        if kind == "bucket":
+            h["buckets"].append((float("inf") if le == "+Inf" else float(le), float(value)))
+        else:
+            h[kind] = float(value)
+    return histograms
+
+
+def diff(before, after):
+    result = {}
+    for key, a in after.items():
+        b = before.get(key, {"buckets": [(le, 0) for le, _ in a["buckets"]], "sum": 0, "count": 0})
+        result[key] = {
+            "buckets": [(le, count - b_count) for (le, count), (_, b_count) in zip(a["buckets"], b["buckets"])],
+            "sum": a["sum"] - b["sum"],
+            "count": a["count"] - b["count"],
+        }
+    return result
+
+
+def quantile(h, q):
+    """Upper bound of the bucket which contains the quantile"""
+    if h["count"] <= 0:
+        return None
+    for le, count in h["buckets"]:
+        if count >= q * h["count"]:
+            return le
+    return float("inf")
+
+
+def mean(h):
+    return h["sum"] / h["count"] if h["count"] > 0 else None
+
+
+class Counter:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.ok = 0
+        self.failed = 0
+        self.times = []
+
+    def add(self, ok, duration=None):
+        with self.lock:
+            if ok:
+                self.ok += 1
+            else:
+                self.failed += 1
+            if duration is not None:
+                self.times.append(duration)
+
+
+def run_at_rate(rate, stop, fn):
+    if rate <= 0:
+        return
+    interval = 1.0 / rate
+    next_run = time.monotonic()
+    while not stop.is_set():
+        fn()
+        next_run += interval
+        delay = next_run - time.monotonic()
+        if delay > 0:
+            stop.wait(delay)
+        else:
+            next_run = time.monotonic()
+
+
+def http_load(args, path, rate, counter, stop):
+    def request():
+        start = time.monotonic()
+        try:
+            fetch(args, path)
+            counter.add(True, (time.monotonic() - start) * 1000)
+        except Exception:
+            counter.add(False)
+
+    run_at_rate(rate, stop, request)
+
+
+def ws_load(args, counter, stop):
+    import websocket
+
+    def on_message(ws, message):
+        counter.add(True)
+
+    clients = []
+    for _ in range(args.ws_clients):
+        header = []
+        if args.password:
+            token = base64.b64encode(("admin:%s" % args.password).encode()).decode()
+            header.append("Authorization: Basic " + token)
+        ws = websocket.WebSocketApp("ws://%s/livedata" % args.host, header=header, on_message=on_message,
+                                    on_error=lambda ws, error: counter.add(False))
+        thread = threading.Thread(target=ws.run_forever, daemon=True)
+        thread.start()
+        clients.append(ws)
+
+    stop.wait()
+    for ws in clients:
+        ws.close()
+
+
+def mqtt_load(args, counter, stop):
+    import paho.mqtt.client as mqtt
+
+    # paho-mqtt 2.x requires the version of the callback api
+    if hasattr(mqtt, "CallbackAPIVersion"):
+        client = mqtt.Client(mqtt.CallbackAPIVersion.VERSION2)
+    else:
+        client = mqtt.Client()
+    if args.mqtt_user:
+        client.username_pw_set(args.mqtt_user, args.mqtt_password)
+    client.connect(args.mqtt_broker, args.mqtt_port)
+    client.loop_start()
+
+    def publish():
+        counter.add(client.publish(args.mqtt_topic, args.mqtt_payload).rc == mqtt.MQTT_ERR_SUCCESS)
+
+    run_at_rate(args.mqtt_rate, stop, publish)
+    client.loop_stop()
+    client.disconnect()
+
+
+def run_phase(args, duration, load):
+    counters = {}
+    stop = threading.Event()
+    threads = []
+
+    if load:
+        for name, path, rate in (("livedata", "/api/livedata/status", args.livedata_rate),
+                                 ("prometheus", METRICS_PATH, args.prometheus_rate)):
+            if rate > 0:
+                counters[name] = Counter()
+                threads.append(threading.Thread(target=http_load, args=(args, path, rate, counters[name], stop)))
+        if args.ws_clients > 0:
+            counters["websocket"] = Counter()
+            threads.append(threading.Thread(target=ws_load, args=(args, counters["websocket"], stop)))
+        if args.mqtt_topic and args.mqtt_rate > 0:
+            counters["mqtt"] = Counter()
+            threads.append(threading.Thread(target=mqtt_load, args=(args, counters["mqtt"], stop)))
+
+    before = read_histograms(args)
+    for thread in threads:
+        thread.start()
+    time.sleep(duration)
+    stop.set()
+    for thread in threads:
+        thread.join()
+    after = read_histograms(args)
+
+    return diff(before, after), counters
+
+
+def format_ms(value):
+    if value is None:
+        return "-"
+    if value == float("inf"):
+        return "inf"
+    return "%.0f" % value
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Load generator and latency report for a running DTU")
+    parser.add_argument("host", help="address of the DTU")
+    parser.add_argument("--password", default="", help="admin password if read only access is disabled")
+    parser.add_argument("--baseline", type=float, default=120, help="duration of the idle phase in s")
+    parser.add_argument("--duration", type=float, default=300, help="duration of the load phase in s")
+    parser.add_argument("--livedata-rate", type=float, default=5, help="requests/s to /api/livedata/status")
+    parser.add_argument("--prometheus-rate", type=float, default=1, help="requests/s to the prometheus metrics")
+    parser.add_argument("--ws-clients", type=int, default=2, help="number of /livedata websocket clients")
+    parser.add_argument("--mqtt-broker", default="", help="broker the DTU is connected to")
+    parser.add_argument("--mqtt-port", type=int, default=1883)
+    parser.add_argument("--mqtt-user", default="")
+    parser.add_argument("--mqtt-password", default="")
+    parser.add_argument("--mqtt-topic", default="", help="command topic which is published to")
+    parser.add_argument("--mqtt-payload", default="")
+    parser.add_argument("--mqtt-rate", type=float, default=1, help="messages/s to the command topic")
+    parser.add_argument("--max-handler-p95", type=float, default=200, help="threshold of the handler duration in ms")
+    parser.add_argument("--max-frame-lag-p95", type=float, default=500, help="threshold of the live frame lag in ms")
+    parser.add_argument("--max-cycle-increase", type=float, default=20,
+                        help="allowed increase of the mean polling cycle time under load in percent")
+    args = parser.parse_args()
+
+    if args.mqtt_topic and not args.mqtt_broker:
+        parser.error("--mqtt-topic requires --mqtt-broker")
+
+    print("Baseline for %.0f s..." % args.baseline)
+    baseline, _ = run_phase(args, args.baseline, False)
+    print("Load for %.0f s..." % args.duration)
+    loaded, counters = run_phase(args, args.duration, True)
+
+    print()
+    print("%-12s %8s %8s %10s" % ("client", "ok", "failed", "mean ms"))
+    for name, counter in counters.items():
+        times = counter.times
+        print("%-12s %8d %8d %10s" % (name, counter.ok, counter.failed,
+                                      format_ms(sum(times) / len(times) if times else None)))
+
+    print()
+    print("%-30s %-22s %8s %8s %8s %8s" % ("metric", "labels", "phase", "count", "mean", "p95"))
+    for key in sorted(loaded):
+        for phase, histograms in (("idle", baseline), ("load", loaded)):
+            h = histograms.get(key)
+            if h is None:
+                continue
+            print("%-30s %-22s %8s %8d %8s %8s" % (key[0], key[1], phase, h["count"],
+                                                   format_ms(mean(h)), format_ms(quantile(h, 0.95))))
+
+    failures = []
+
+    for key, h in loaded.items():
+        p95 = quantile(h, 0.95)
+        if p95 is None:
+            continue
+        if key[0] == "opendtu_handler_duration_ms" and p95 > args.max_handler_p95:
+            failures.append("%s{%s} p95 %s ms > %.0f ms" % (key[0], key[1], format_ms(p95), args.max_handler_p95))
+        if key[0] == "opendtu_ws_live_frame_lag_ms" and p95 > args.max_frame_lag_p95:
+            failures.append("%s p95 %s ms > %.0f ms" % (key[0], format_ms(p95), args.max_frame_lag_p95))
+
+    for key, h in loaded.items():
+        if key[0] != "opendtu_stats_interval_ms":
+            continue
+        idle = mean(baseline.get(key, {"sum": 0, "count": 0}))
+        load = mean(h)
+        if idle is None or load is None:
+            failures.append("no statistics updates for the polling cycle comparison")
+            continue
+        increase = (load - idle) * 100 / idle
+        print()
+        print("Polling cycle: %.0f ms idle, %.0f ms under load (%+.1f %%)" % (idle, load, increase))
+        if increase > args.max_cycle_increase:
+            failures.append("polling cycle increased by %.1f %% > %.0f %%" % (increase, args.max_cycle_increase))
+
+    for counter_name, counter in counters.items():
+        if counter.failed > 0:
+            failures.append("%d failed %s requests" % (counter.failed, counter_name))
+
+    print()
+    if failures:
+        for failure in failures:
+            print("FAIL: " + failure)
+        return 1
+    print("PASS")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# Copyright (C) 2025 Thomas Basler and others
+#
+# Puts the results of two runs of env:*_perf_bench side by side. The inputs are the
+# console logs of the runs (e.g. "pio device monitor | tee a.log"), only the lines
+# "PERF <metric>{<labels>} <value>" are read. The last run in a log is used.
+#
+# Usage: perf_compare.py <baseline.log> <candidate.log> [--threshold <percent>]
+#
+# Lower is better for all latencies, loads and bytes, higher for the heap metrics.
+# Returns 1 if a metric got worse by more than the threshold.
+
+import argparse
+import re
+import sys
+
+LINE_RE = re.compile(r'PERF (\w+(?:\{[^}]*\})?) (\S+)\s*$')
+
+HIGHER_IS_BETTER = ("opendtu_perf_heap_",)
+
+# Describe the run, they are not compared
+INFO = ("opendtu_perf_info", "opendtu_perf_duration_s", "opendtu_perf_done")
+
+
+def read_results(filename):
+    results = {}
+    with open(filename, errors="replace") as f:
+        for line in f:
+            match = LINE_RE.search(line)
+            if match is None:
+                continue
+            key, value = match.groups()
+            if key.startswith("opendtu_perf_info"):
+                # A new run starts, an earlier one in the same log is dropped
+                results = {}
+            results[key] = float("inf") if value == "+Inf" else float(value)
+    return results
+
+
+def build_of(results):
+    for key in results:
+        if key.startswith("opendtu_perf_info"):
+            match = re.search(r'build="([^"]*)"', key)
+            return match.group(1) if match else "?"
+    return "?"
+
+
+def format_value(value):
+    if value is None:
+        return "-"
+    if value == float("inf"):
+        return "+Inf"
+    if value == int(value):
+        return "%d" % value
+    return "%.1f" % value
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compares the results of two perf benchmark runs")
+    parser.add_argument("baseline", help="console log of the baseline build")
+    parser.add_argument("candidate", help="console log of the build to check")
+    parser.add_argument("--threshold", type=float, default=10, help="allowed regression in percent")
+    args = parser.parse_args()
+
+    baseline = read_results(args.baseline)
+    candidate = read_results(args.candidate)
+    for name, results in ((args.baseline, baseline), (args.candidate, candidate)):
+        if "opendtu_perf_done" not in results:
+            print("%s: no complete run found" % name)
+            return 2
+
+    print("baseline %s, candidate %s" % (build_of(baseline), build_of(candidate)))
+    print()
+    print("%-90s %12s %12s %9s" % ("metric", "baseline", "candidate", "change"))
+
+    regressions = []
+    for key in sorted(set(baseline) | set(candidate)):
+        if key.startswith(INFO):
+            continue
+        a = baseline.get(key)
+        b = candidate.get(key)
+
+        change = ""
+        if a is not None and b is not None and a not in (0, float("inf")) and b != float("inf"):
+            percent = (b - a) * 100 / a
+            change = "%+.1f %%" % percent
+            worse = -percent if key.startswith(HIGHER_IS_BETTER) else percent
+            # Counts only describe the amount of work done in the run
+            if worse > args.threshold and not key.split("{")[0].endswith("_count"):
+                regressions.append("%s %s -> %s (%s)" % (key, format_value(a), format_value(b), change))
+        elif a is not None and b is not None and b == float("inf") and a != float("inf"):
+            change = "worse"
+            regressions.append("%s %s -> +Inf" % (key, format_value(a)))
+
+        print("%-90s %12s %12s %9s" % (key, format_value(a), format_value(b), change))
+
+    print()
+    if regressions:
+        for regression in regressions:
+            print("WORSE: " + regression)
+        return 1
+    print("No regression above %.0f %%" % args.threshold)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,59 @@
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# Copyright (C) 2025 Thomas Basler and others
+#
+import glob
+import os
+
+Import("env")
+
+
+def updateFileIfChanged(filename, content):
+    mustUpdate = True
+    try:
+        with open(filename, "rb") as fp:
+            if fp.read() == content:
+                mustUpdate = False
+    except:
+        pass
+    if mustUpdate:
+        with open(filename, "wb") as fp:
+            fp.write(content)
+    return mustUpdate
+
+
+def do_main():
+    # The code split views of the webapp are named by their content hash, so they can not be
+    # listed in board_build.embed_files. They are compiled into a table instead.
+    project_dir = env.subst("$PROJECT_DIR")
+    chunks = sorted(glob.glob(os.path.join(project_dir, "webapp_dist", "js", "*.js.gz")))
+    chunks = [c for c in chunks if os.path.basename(c) != "app.js.gz"]
+
+    targetfile = os.path.join(env.subst("$BUILD_DIR"), "__webapp_chunks.c")
+    lines = ""
+    lines += "/* Generated file within build process - Do NOT edit */\n"
+    lines += "#include <stddef.h>\n"
+    lines += "#include <stdint.h>\n"
+    lines += '#include "__webapp_chunks.h"\n\n'
+
+    for i, filename in enumerate(chunks):
+        with open(filename, "rb") as fp:
+            data = fp.read()
+        lines += "static const uint8_t chunk_%d[] = {\n" % i
+        for pos in range(0, len(data), 16):
+            lines += "    " + ", ".join("0x%02x" % b for b in data[pos : pos + 16]) + ",\n"
+        lines += "};\n\n"
+
+    lines += "const WebappChunk_t __WEBAPP_CHUNKS__[] = {\n"
+    for i, filename in enumerate(chunks):
+        # Served without the .gz extension, the content is always gzip encoded
+        path = "/js/" + os.path.basename(filename)[:-3]
+        lines += '    { "%s", chunk_%d, sizeof(chunk_%d) },\n' % (path, i, i)
+    lines += "    { NULL, NULL, 0 },\n"
+    lines += "};\n"
+
+    updateFileIfChanged(targetfile, bytes(lines, "utf-8"))
+
+    env.AppendUnique(PIOBUILDFILES=[targetfile])
+
+do_main()
@@ -0,0 +1,48 @@
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# Copyright (C) 2025 Thomas Basler and others
+#
+import hashlib
+import os
+import re
+
+Import("env")
+
+
+def updateFileIfChanged(filename, content):
+    mustUpdate = True
+    try:
+        with open(filename, "rb") as fp:
+            if fp.read() == content:
+                mustUpdate = False
+    except:
+        pass
+    if mustUpdate:
+        with open(filename, "wb") as fp:
+            fp.write(content)
+    return mustUpdate
+
+
+def get_etag_name(filename):
+    # Same naming as the _binary_<path>_start symbols created for board_build.embed_files
+    return "__ETAG_" + re.sub(r"[^A-Za-z0-9]", "_", filename).upper() + "__"
+
+
+def do_main():
+    embed_files = env.GetProjectOption("board_build.embed_files", "").split()
+
+    targetfile = os.path.join(env.subst("$BUILD_DIR"), "__webapp_etags.c")
+    lines = ""
+    lines += "/* Generated file within build process - Do NOT edit */\n"
+
+    for filename in embed_files:
+        with open(os.path.join(env.subst("$PROJECT_DIR"), filename), "rb") as fp:
+            md5 = hashlib.md5(fp.read()).hexdigest()
+        lines += 'const char *%s = "\\"%s\\"";\n' % (get_etag_name(filename), md5)
+
+    updateFileIfChanged(targetfile, bytes(lines, "utf-8"))
+
+    # Add the created file to the buildfiles - platformio knows how to handle *.c files
+    env.AppendUnique(PIOBUILDFILES=[targetfile])
+
+do_main()
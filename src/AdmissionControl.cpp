@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "AdmissionControl.h"
+#include <Arduino.h>
+#include <algorithm>
+
+#define TOKEN_UNIT 1000
+
+AdmissionControlClass AdmissionControl;
+
+// By AdmissionClass_t
+const AdmissionControlClass::Limit_t AdmissionControlClass::ClientLimits[] = {
+    { ADMISSION_CONTROL_RATE, ADMISSION_CONTROL_BURST },
+    { ADMISSION_READ_RATE, ADMISSION_READ_BURST },
+    { ADMISSION_WRITE_RATE, ADMISSION_WRITE_BURST },
+};
+const AdmissionControlClass::Limit_t AdmissionControlClass::TotalLimits[] = {
+    { ADMISSION_CONTROL_TOTAL_RATE, ADMISSION_CONTROL_TOTAL_BURST },
+    { ADMISSION_READ_TOTAL_RATE, ADMISSION_READ_TOTAL_BURST },
+    { ADMISSION_WRITE_TOTAL_RATE, ADMISSION_WRITE_TOTAL_BURST },
+};
+
+AdmissionControlClass::AdmissionControlClass()
+{
+    fill(_total, TotalLimits, 0);
+}
+
+const char* AdmissionControlClass::getClassName(const AdmissionClass_t cls)
+{
+    switch (cls) {
+    case AdmissionClass_t::Control:
+        return "control";
+    case AdmissionClass_t::Read:
+        return "read";
+    default:
+        return "write";
+    }
+}
+
+bool AdmissionControlClass::classify(AsyncWebServerRequest* request, AdmissionClass_t& cls)
+{
+    const String& url = request->url();
+    if (!url.startsWith("/api/")) {
+        return false;
+    }
+
+    if (url.startsWith("/api/limit/") || url.startsWith("/api/power/")) {
+        cls = AdmissionClass_t::Control;
+    } else if (request->method() == HTTP_GET || request->method() == HTTP_HEAD) {
+        cls = AdmissionClass_t::Read;
+    } else {
+        cls = AdmissionClass_t::Write;
+    }
+    return true;
+}
+
+void AdmissionControlClass::fill(Buckets_t& buckets, const Limit_t limits[], const uint32_t now)
+{
+    for (size_t i = 0; i < buckets.size(); i++) {
+        buckets[i] = { static_cast<uint32_t>(limits[i].Burst) * TOKEN_UNIT, now };
+    }
+}
+
+void AdmissionControlClass::refill(Bucket_t& bucket, const Limit_t& limit, const uint32_t now)
+{
+    // A rate of r requests/s adds r tokens of 1/1000 request per ms
+    const uint64_t tokens = bucket.Tokens + static_cast<uint64_t>(now - bucket.LastRefill) * limit.Rate;
+    bucket.Tokens = std::min<uint64_t>(tokens, static_cast<uint64_t>(limit.Burst) * TOKEN_UNIT);
+    bucket.LastRefill = now;
+}
+
+uint32_t AdmissionControlClass::getRetryAfter(const Bucket_t& bucket, const Limit_t& limit)
+{
+    if (bucket.Tokens >= TOKEN_UNIT || limit.Rate == 0) {
+        return 1;
+    }
+    const uint32_t ms = (TOKEN_UNIT - bucket.Tokens) / limit.Rate;
+    return std::max<uint32_t>(1, (ms + 999) / 1000);
+}
+
+AdmissionControlClass::Client_t& AdmissionControlClass::getClient(const uint32_t address, const uint32_t now)
+{
+    Client_t* oldest = &_clients[0];
+    for (auto& client : _clients) {
+        if (client.LastSeen != 0 && client.Address == address) {
+            client.LastSeen = now | 1;
+            return client;
+        }
+        if (client.LastSeen == 0 || static_cast<int32_t>(client.LastSeen - oldest->LastSeen) < 0) {
+            oldest = &client;
+            if (client.LastSeen == 0) {
+                break;
+            }
+        }
+    }
+
+    // A new client starts with the full burst, the total budget still applies
+    oldest->Address = address;
+    oldest->LastSeen = now | 1; // 0 marks an unused entry
+    fill(oldest->Buckets, ClientLimits, now);
+    return *oldest;
+}
+
+uint32_t AdmissionControlClass::check(AsyncWebServerRequest* request)
+{
+    AdmissionClass_t cls;
+    if (!classify(request, cls)) {
+        return 0;
+    }
+    const size_t idx = static_cast<size_t>(cls);
+    const uint32_t now = millis();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    Bucket_t& total = _total[idx];
+    refill(total, TotalLimits[idx], now);
+
+    Bucket_t& own = getClient(request->client()->getRemoteAddress(), now).Buckets[idx];
+    refill(own, ClientLimits[idx], now);
+
+    // Both budgets have to allow the request, otherwise no token is used
+    if (own.Tokens < TOKEN_UNIT) {
+        _stats[idx].Rejected++;
+        return getRetryAfter(own, ClientLimits[idx]);
+    }
+    if (total.Tokens < TOKEN_UNIT) {
+        _stats[idx].Rejected++;
+        return getRetryAfter(total, TotalLimits[idx]);
+    }
+
+    own.Tokens -= TOKEN_UNIT;
+    total.Tokens -= TOKEN_UNIT;
+    _stats[idx].Admitted++;
+    return 0;
+}
+
+AdmissionStats_t AdmissionControlClass::getStats()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    AdmissionStats_t stats;
+    stats.Clients = std::count_if(_clients.begin(), _clients.end(), [](const Client_t& c) { return c.LastSeen != 0; });
+    stats.Classes = _stats;
+    return stats;
+}
@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "BootTiming.h"
+#include <Arduino.h>
+
+BootTimingClass BootTiming;
+
+void BootTimingClass::beginPhase(const char* name)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    const uint32_t now = millis();
+
+    if (_running) {
+        _phases.back().Duration = now - _phases.back().Start;
+    }
+
+    _phases.push_back({ name, now, 0 });
+    _running = true;
+}
+
+void BootTimingClass::endPhase()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_running) {
+        return;
+    }
+
+    _phases.back().Duration = millis() - _phases.back().Start;
+    _running = false;
+}
+
+std::vector<BootPhase_t> BootTimingClass::getPhases()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _phases;
+}
@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "CertStore.h"
+#include "FlashWear.h"
+#include "FsWorker.h"
+#include "defaults.h"
+#include <LittleFS.h>
+#include <esp_rom_crc.h>
+
+CertStoreClass CertStore;
+
+const char* CertStoreClass::getFilename(const Cert_t cert)
+{
+    switch (cert) {
+    case Cert_t::MqttRootCa:
+        return "/mqtt_root_ca.pem";
+    case Cert_t::MqttClientCert:
+        return "/mqtt_client_cert.pem";
+    case Cert_t::FirmwareRootCa:
+        return "/firmware_root_ca.pem";
+    case Cert_t::InfluxRootCa:
+        return "/influx_root_ca.pem";
+    default:
+        return "/mqtt_client_key.pem";
+    }
+}
+
+const char* CertStoreClass::getDefault(const Cert_t cert)
+{
+    switch (cert) {
+    case Cert_t::MqttRootCa:
+        return MQTT_ROOT_CA_CERT;
+    case Cert_t::MqttClientCert:
+        return MQTT_TLSCLIENTCERT;
+    case Cert_t::FirmwareRootCa:
+        return FIRMWARE_PULL_ROOT_CA;
+    case Cert_t::InfluxRootCa:
+        return INFLUX_ROOT_CA;
+    default:
+        return MQTT_TLSCLIENTKEY;
+    }
+}
+
+uint32_t CertStoreClass::calcHandle(const char* pem, const size_t len)
+{
+    return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(pem), len);
+}
+
+String CertStoreClass::readLocked(const Cert_t cert)
+{
+    File f = LittleFS.open(getFilename(cert), "r", false);
+    if (!f) {
+        return getDefault(cert);
+    }
+
+    String pem;
+    pem.reserve(f.size());
+    while (f.available()) {
+        char buffer[128];
+        const size_t len = f.readBytes(buffer, sizeof(buffer));
+        pem.concat(buffer, len);
+    }
+    f.close();
+    return pem;
+}
+
+String CertStoreClass::read(const Cert_t cert)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return readLocked(cert);
+}
+
+uint32_t CertStoreClass::getHandle(const Cert_t cert)
+{
+    const String pem = read(cert);
+    return calcHandle(pem.c_str(), pem.length());
+}
+
+uint32_t CertStoreClass::write(const Cert_t cert, const char* pem)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    const size_t len = strlen(pem);
+    const String current = readLocked(cert);
+    if (current == pem) {
+        return calcHandle(pem, len);
+    }
+
+    // Written to a temporary file first, a reset while writing keeps the old content
+    const std::vector<uint8_t> data(pem, pem + len);
+    if (!FsWorkerClass::writeFile(getFilename(cert), data)) {
+        return calcHandle(current.c_str(), current.length());
+    }
+    FlashWear.record(FlashWriter_t::Config, len);
+    return calcHandle(pem, len);
+}
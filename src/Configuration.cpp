@@ -3,189 +3,606 @@
  * Copyright (C) 2022-2025 Thomas Basler and others
  */
 #include "Configuration.h"
+#include "CertStore.h"
+#include "EventBus.h"
+#include "FsWorker.h"
+#include "HeapTelemetry.h"
 #include "MessageOutput.h"
 #include "NetworkSettings.h"
+#include "TaskProfiler.h"
 #include "Utils.h"
 #include "defaults.h"
 #include <ArduinoJson.h>
 #include <LittleFS.h>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <esp_rom_crc.h>
+#include <memory>
 #include <nvs_flash.h>
+#include <type_traits>
+#include <utility>
+
+static_assert((INV_INDEX_SIZE & (INV_INDEX_SIZE - 1)) == 0 && INV_INDEX_SIZE > INV_MAX_COUNT, "INV_INDEX_SIZE has to be a power of two larger than INV_MAX_COUNT");
 
 CONFIG_T config;
 
 static std::condition_variable sWriterCv;
 static std::mutex sWriterMutex;
 static unsigned sWriterCount = 0;
+static ReaderPreferringMutex sInverterMutex;
+static std::atomic<uint32_t> sChangeCount = 0;
+
+// Every field of the binary image is stored as record of id, length and data.
+// Ids are never reused: a field which changes its meaning or type gets a new id,
+// a removed field leaves a gap. Missing fields keep their default value, longer
+// or unknown ones are cut or skipped, so the image survives changes of CONFIG_T.
+struct ConfigImageHeader_t {
+    uint32_t Magic;
+    uint16_t Version;
+    uint16_t Reserved;
+    uint32_t Length; // bytes following the header
+    uint32_t Crc; // crc32 of these bytes
+};
+
+struct ConfigRecord_t {
+    uint16_t Id;
+    uint16_t Length;
+};
+
+struct ConfigField_t {
+    uint16_t Id;
+    void* Data;
+    uint16_t Size;
+    bool IsString; // stored without the unused part of the buffer
+};
+
+// Fields of INVERTER_CONFIG_T and CHANNEL_CONFIG_T, relative to the start of the struct
+struct ConfigMember_t {
+    uint16_t Id;
+    uint16_t Offset;
+    uint16_t Size;
+    bool IsString;
+};
+
+#define CONFIG_FIELD(id, member) \
+    { id, &config.member, sizeof(config.member), std::is_same_v<std::remove_extent_t<decltype(config.member)>, char> }
+
+#define CONFIG_MEMBER(type, id, member)                                                          \
+    { id, offsetof(type, member), sizeof(std::declval<type&>().member),                          \
+        std::is_same_v<std::remove_extent_t<std::remove_reference_t<decltype(std::declval<type&>().member)>>, char> }
+
+// Starts a new inverter, the following inverter and channel records belong to it
+#define CONFIG_ID_INVERTER 0x0100
+// Channel c uses the ids CONFIG_ID_CHANNEL + c * CONFIG_ID_CHANNEL_STRIDE + member id
+#define CONFIG_ID_CHANNEL 0x0200
+#define CONFIG_ID_CHANNEL_STRIDE 0x10
+
+static_assert(INV_MAX_CHAN_COUNT * CONFIG_ID_CHANNEL_STRIDE <= 0x100, "channel ids exceed their range");
+
+static const ConfigField_t configFields[] = {
+    CONFIG_FIELD(0x0001, Cfg.Version),
+    CONFIG_FIELD(0x0002, Cfg.SaveCount),
+
+    CONFIG_FIELD(0x0010, WiFi.Ssid),
+    CONFIG_FIELD(0x0011, WiFi.Password),
+    CONFIG_FIELD(0x0012, WiFi.Ip),
+    CONFIG_FIELD(0x0013, WiFi.Netmask),
+    CONFIG_FIELD(0x0014, WiFi.Gateway),
+    CONFIG_FIELD(0x0015, WiFi.Dns1),
+    CONFIG_FIELD(0x0016, WiFi.Dns2),
+    CONFIG_FIELD(0x0017, WiFi.Dhcp),
+    CONFIG_FIELD(0x0018, WiFi.Hostname),
+    CONFIG_FIELD(0x0019, WiFi.ApTimeout),
+
+    CONFIG_FIELD(0x0020, Mdns.Enabled),
+
+    CONFIG_FIELD(0x0030, Ntp.Server),
+    CONFIG_FIELD(0x0031, Ntp.Timezone),
+    CONFIG_FIELD(0x0032, Ntp.TimezoneDescr),
+    CONFIG_FIELD(0x0033, Ntp.Longitude),
+    CONFIG_FIELD(0x0034, Ntp.Latitude),
+    CONFIG_FIELD(0x0035, Ntp.SunsetType),
+
+    CONFIG_FIELD(0x0040, Mqtt.Enabled),
+    CONFIG_FIELD(0x0041, Mqtt.Hostname),
+    CONFIG_FIELD(0x0042, Mqtt.Port),
+    CONFIG_FIELD(0x0043, Mqtt.ClientId),
+    CONFIG_FIELD(0x0044, Mqtt.Username),
+    CONFIG_FIELD(0x0045, Mqtt.Password),
+    CONFIG_FIELD(0x0046, Mqtt.Topic),
+    CONFIG_FIELD(0x0047, Mqtt.Retain),
+    CONFIG_FIELD(0x0048, Mqtt.PublishInterval),
+    CONFIG_FIELD(0x0049, Mqtt.CleanSession),
+    CONFIG_FIELD(0x004a, Mqtt.PublishOnChange),
+    CONFIG_FIELD(0x004b, Mqtt.JsonPayload),
+    CONFIG_FIELD(0x004c, Mqtt.FastLane.TotalAcPower),
+    CONFIG_FIELD(0x004d, Mqtt.FastLane.TotalDcPower),
+    CONFIG_FIELD(0x004e, Mqtt.FastLane.AcPower),
+    CONFIG_FIELD(0x004f, Mqtt.FastLane.DcPower),
+
+    CONFIG_FIELD(0x0050, Mqtt.Journal.Enabled),
+    CONFIG_FIELD(0x0051, Mqtt.Journal.ReplayRate),
+
+    CONFIG_FIELD(0x0054, Mqtt.Cluster.Enabled),
+    CONFIG_FIELD(0x0055, Mqtt.Cluster.Topic),
+
+    CONFIG_FIELD(0x0058, Mqtt.Lwt.Topic),
+    CONFIG_FIELD(0x0059, Mqtt.Lwt.Value_Online),
+    CONFIG_FIELD(0x005a, Mqtt.Lwt.Value_Offline),
+    CONFIG_FIELD(0x005b, Mqtt.Lwt.Qos),
+
+    CONFIG_FIELD(0x005c, Mqtt.Fleet.Publish),
+    CONFIG_FIELD(0x005d, Mqtt.Fleet.Aggregate),
+    CONFIG_FIELD(0x005e, Mqtt.Fleet.Topic),
+
+    CONFIG_FIELD(0x0060, Mqtt.Hass.Enabled),
+    CONFIG_FIELD(0x0061, Mqtt.Hass.Retain),
+    CONFIG_FIELD(0x0062, Mqtt.Hass.Topic),
+    CONFIG_FIELD(0x0063, Mqtt.Hass.IndividualPanels),
+    CONFIG_FIELD(0x0064, Mqtt.Hass.Expire),
+    CONFIG_FIELD(0x0065, Mqtt.Hass.DeviceDiscovery),
+
+    CONFIG_FIELD(0x0068, Mqtt.Tls.Enabled),
+    CONFIG_FIELD(0x006a, Mqtt.Tls.CertLogin),
+
+    CONFIG_FIELD(0x0070, Dtu.Serial),
+    CONFIG_FIELD(0x0071, Dtu.PollInterval),
+    CONFIG_FIELD(0x0072, Dtu.AdaptivePolling),
+    CONFIG_FIELD(0x0073, Dtu.LimitMinInterval),
+    CONFIG_FIELD(0x0074, Dtu.LimitHysteresis),
+    CONFIG_FIELD(0x0075, Dtu.NightStandby),
+    CONFIG_FIELD(0x0076, Dtu.Nrf.PaLevel),
+    CONFIG_FIELD(0x0077, Dtu.Cmt.PaLevel),
+    CONFIG_FIELD(0x0078, Dtu.Cmt.Frequency),
+    CONFIG_FIELD(0x0079, Dtu.Cmt.CountryMode),
+    CONFIG_FIELD(0x007a, Dtu.TxPowerControl),
+    CONFIG_FIELD(0x007b, Dtu.PollCalibration),
+    CONFIG_FIELD(0x007c, Dtu.SnapshotPolling),
+    CONFIG_FIELD(0x007d, Dtu.FreshnessSloInterval),
+    CONFIG_FIELD(0x007e, Dtu.FreshnessSloAge),
+
+    CONFIG_FIELD(0x0080, Security.Password),
+    CONFIG_FIELD(0x0081, Security.AllowReadonly),
+
+    CONFIG_FIELD(0x0090, Display.PowerSafe),
+    CONFIG_FIELD(0x0091, Display.ScreenSaver),
+    CONFIG_FIELD(0x0092, Display.Rotation),
+    CONFIG_FIELD(0x0093, Display.Contrast),
+    CONFIG_FIELD(0x0094, Display.Locale),
+    CONFIG_FIELD(0x0095, Display.Diagram.Duration),
+    CONFIG_FIELD(0x0096, Display.Diagram.Mode),
+
+    CONFIG_FIELD(0x00a0, Led_Single),
+
+    CONFIG_FIELD(0x00b0, PowerControl.Enabled),
+    CONFIG_FIELD(0x00b1, PowerControl.MeterTopic),
+    CONFIG_FIELD(0x00b2, PowerControl.TargetPower),
+    CONFIG_FIELD(0x00b3, PowerControl.Kp),
+    CONFIG_FIELD(0x00b4, PowerControl.Ki),
+    CONFIG_FIELD(0x00b5, PowerControl.MeterTimeout),
+    CONFIG_FIELD(0x00b6, PowerControl.MinLimit),
+
+    CONFIG_FIELD(0x00b8, Influx.Enabled),
+    CONFIG_FIELD(0x00b9, Influx.Url),
+    CONFIG_FIELD(0x00ba, Influx.Token),
+    CONFIG_FIELD(0x00bb, Influx.FlushInterval),
+
+    CONFIG_FIELD(0x00bc, Modbus.Enabled),
+    CONFIG_FIELD(0x00bd, Modbus.Port),
+    CONFIG_FIELD(0x00be, Modbus.AllowWrite),
+
+    CONFIG_FIELD(0x00c0, Dev_PinMapping),
+
+    CONFIG_FIELD(0x00d0, RawStats.Mqtt),
+    CONFIG_FIELD(0x00d1, RawStats.Udp),
+    CONFIG_FIELD(0x00d2, RawStats.UdpHost),
+    CONFIG_FIELD(0x00d3, RawStats.UdpPort),
+    CONFIG_FIELD(0x00d4, RawStats.SkipFields),
+
+    CONFIG_FIELD(0x00e0, Syslog.Enabled),
+    CONFIG_FIELD(0x00e1, Syslog.Host),
+    CONFIG_FIELD(0x00e2, Syslog.Port),
+    CONFIG_FIELD(0x00e3, Syslog.Format),
+    CONFIG_FIELD(0x00e4, Syslog.Level),
+
+    CONFIG_FIELD(0x00e8, Prometheus.CacheTtl),
+};
+
+// The certificates were part of the image until they got files of their own (see CertStore)
+struct LegacyCertField_t {
+    uint16_t Id;
+    Cert_t Cert;
+};
+
+static const LegacyCertField_t legacyCertFields[] = {
+    { 0x0069, Cert_t::MqttRootCa },
+    { 0x006b, Cert_t::MqttClientCert },
+    { 0x006c, Cert_t::MqttClientKey },
+};
+
+static const ConfigMember_t inverterMembers[] = {
+    CONFIG_MEMBER(INVERTER_CONFIG_T, 0x0110, Serial),
+    CONFIG_MEMBER(INVERTER_CONFIG_T, 0x0111, Name),
+    CONFIG_MEMBER(INVERTER_CONFIG_T, 0x0112, Order),
+    CONFIG_MEMBER(INVERTER_CONFIG_T, 0x0113, Poll_Enable),
+    CONFIG_MEMBER(INVERTER_CONFIG_T, 0x0114, Poll_Enable_Night),
+    CONFIG_MEMBER(INVERTER_CONFIG_T, 0x0115, Command_Enable),
+    CONFIG_MEMBER(INVERTER_CONFIG_T, 0x0116, Command_Enable_Night),
+    CONFIG_MEMBER(INVERTER_CONFIG_T, 0x0117, ReachableThreshold),
+    CONFIG_MEMBER(INVERTER_CONFIG_T, 0x0118, ZeroRuntimeDataIfUnrechable),
+    CONFIG_MEMBER(INVERTER_CONFIG_T, 0x0119, ZeroYieldDayOnMidnight),
+    CONFIG_MEMBER(INVERTER_CONFIG_T, 0x011a, ClearEventlogOnMidnight),
+    CONFIG_MEMBER(INVERTER_CONFIG_T, 0x011b, YieldDayCorrection),
+    CONFIG_MEMBER(INVERTER_CONFIG_T, 0x011c, Group),
+
+    CONFIG_MEMBER(INVERTER_CONFIG_T, 0x0120, PollPlan.StatsInterval),
+    CONFIG_MEMBER(INVERTER_CONFIG_T, 0x0121, PollPlan.AlarmInterval),
+    CONFIG_MEMBER(INVERTER_CONFIG_T, 0x0122, PollPlan.LimitInterval),
+    CONFIG_MEMBER(INVERTER_CONFIG_T, 0x0123, PollPlan.AlarmOnDemand),
+    CONFIG_MEMBER(INVERTER_CONFIG_T, 0x0124, PollPlan.GridProfileOnDemand),
+};
+
+static const ConfigMember_t channelMembers[] = {
+    CONFIG_MEMBER(CHANNEL_CONFIG_T, 0x00, MaxChannelPower),
+    CONFIG_MEMBER(CHANNEL_CONFIG_T, 0x01, Name),
+    CONFIG_MEMBER(CHANNEL_CONFIG_T, 0x02, YieldTotalOffset),
+};
 
 void ConfigurationClass::init(Scheduler& scheduler)
 {
     scheduler.addTask(_loopTask);
-    _loopTask.setCallback(std::bind(&ConfigurationClass::loop, this));
+    TaskProfiler.setCallback(_loopTask, "Configuration.loop", std::bind(&ConfigurationClass::loop, this));
     _loopTask.setIterations(TASK_FOREVER);
     _loopTask.enable();
 
-    memset(&config, 0x0, sizeof(config));
+    // config is a global object and therefore already zero initialized.
+    // Only the inverter list has to be cleared.
+    config.Inverter.clear();
+    rebuildInverterIndex();
 }
 
-bool ConfigurationClass::write()
+void ConfigurationClass::serialize(std::vector<uint8_t>& image)
 {
-    File f = LittleFS.open(CONFIG_FILENAME, "w");
-    if (!f) {
-        return false;
+    {
+        // Changes requested from now on need another write
+        std::lock_guard<std::mutex> lock(_writeRequestMutex);
+        _writePending = false;
     }
+
     config.Cfg.SaveCount++;
 
-    JsonDocument doc;
+    image.clear();
+    image.resize(sizeof(ConfigImageHeader_t));
+    ConfigImageHeader_t header = {};
+    header.Magic = CONFIG_IMAGE_MAGIC;
+    header.Version = CONFIG_IMAGE_VERSION;
 
-    JsonObject cfg = doc["cfg"].to<JsonObject>();
-    cfg["version"] = config.Cfg.Version;
-    cfg["save_count"] = config.Cfg.SaveCount;
+    auto writeRecord = [&](const uint16_t id, const void* data, size_t size, const bool isString) {
+        if (isString) {
+            size = strnlen(static_cast<const char*>(data), size);
+        }
+        const ConfigRecord_t record = { id, static_cast<uint16_t>(size) };
+        const uint8_t* recordBytes = reinterpret_cast<const uint8_t*>(&record);
+        image.insert(image.end(), recordBytes, recordBytes + sizeof(record));
+        if (size > 0) {
+            image.insert(image.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+        }
 
-    JsonObject wifi = doc["wifi"].to<JsonObject>();
-    wifi["ssid"] = config.WiFi.Ssid;
-    wifi["password"] = config.WiFi.Password;
-    wifi["ip"] = IPAddress(config.WiFi.Ip).toString();
-    wifi["netmask"] = IPAddress(config.WiFi.Netmask).toString();
-    wifi["gateway"] = IPAddress(config.WiFi.Gateway).toString();
-    wifi["dns1"] = IPAddress(config.WiFi.Dns1).toString();
-    wifi["dns2"] = IPAddress(config.WiFi.Dns2).toString();
-    wifi["dhcp"] = config.WiFi.Dhcp;
-    wifi["hostname"] = config.WiFi.Hostname;
-    wifi["aptimeout"] = config.WiFi.ApTimeout;
+        header.Crc = esp_rom_crc32_le(header.Crc, recordBytes, sizeof(record));
+        if (size > 0) {
+            header.Crc = esp_rom_crc32_le(header.Crc, static_cast<const uint8_t*>(data), size);
+        }
+        header.Length += sizeof(record) + size;
+    };
 
-    JsonObject mdns = doc["mdns"].to<JsonObject>();
-    mdns["enabled"] = config.Mdns.Enabled;
+    for (const auto& field : configFields) {
+        writeRecord(field.Id, field.Data, field.Size, field.IsString);
+    }
 
-    JsonObject ntp = doc["ntp"].to<JsonObject>();
-    ntp["server"] = config.Ntp.Server;
-    ntp["timezone"] = config.Ntp.Timezone;
-    ntp["timezone_descr"] = config.Ntp.TimezoneDescr;
-    ntp["latitude"] = config.Ntp.Latitude;
-    ntp["longitude"] = config.Ntp.Longitude;
-    ntp["sunsettype"] = config.Ntp.SunsetType;
+    for (const auto& inv_cfg : config.Inverter) {
+        writeRecord(CONFIG_ID_INVERTER, nullptr, 0, false);
 
-    JsonObject mqtt = doc["mqtt"].to<JsonObject>();
-    mqtt["enabled"] = config.Mqtt.Enabled;
-    mqtt["hostname"] = config.Mqtt.Hostname;
-    mqtt["port"] = config.Mqtt.Port;
-    mqtt["clientid"] = config.Mqtt.ClientId;
-    mqtt["username"] = config.Mqtt.Username;
-    mqtt["password"] = config.Mqtt.Password;
-    mqtt["topic"] = config.Mqtt.Topic;
-    mqtt["retain"] = config.Mqtt.Retain;
-    mqtt["publish_interval"] = config.Mqtt.PublishInterval;
-    mqtt["clean_session"] = config.Mqtt.CleanSession;
+        const uint8_t* inv = reinterpret_cast<const uint8_t*>(&inv_cfg);
+        for (const auto& member : inverterMembers) {
+            writeRecord(member.Id, inv + member.Offset, member.Size, member.IsString);
+        }
 
-    JsonObject mqtt_lwt = mqtt["lwt"].to<JsonObject>();
-    mqtt_lwt["topic"] = config.Mqtt.Lwt.Topic;
-    mqtt_lwt["value_online"] = config.Mqtt.Lwt.Value_Online;
-    mqtt_lwt["value_offline"] = config.Mqtt.Lwt.Value_Offline;
-    mqtt_lwt["qos"] = config.Mqtt.Lwt.Qos;
+        for (uint8_t c = 0; c < INV_MAX_CHAN_COUNT; c++) {
+            const uint8_t* channel = reinterpret_cast<const uint8_t*>(&inv_cfg.channel[c]);
+            for (const auto& member : channelMembers) {
+                writeRecord(CONFIG_ID_CHANNEL + c * CONFIG_ID_CHANNEL_STRIDE + member.Id,
+                    channel + member.Offset, member.Size, member.IsString);
+            }
+        }
+    }
 
-    JsonObject mqtt_tls = mqtt["tls"].to<JsonObject>();
-    mqtt_tls["enabled"] = config.Mqtt.Tls.Enabled;
-    mqtt_tls["root_ca_cert"] = config.Mqtt.Tls.RootCaCert;
-    mqtt_tls["certlogin"] = config.Mqtt.Tls.CertLogin;
-    mqtt_tls["client_cert"] = config.Mqtt.Tls.ClientCert;
-    mqtt_tls["client_key"] = config.Mqtt.Tls.ClientKey;
+    memcpy(image.data(), &header, sizeof(header));
+}
 
-    JsonObject mqtt_hass = mqtt["hass"].to<JsonObject>();
-    mqtt_hass["enabled"] = config.Mqtt.Hass.Enabled;
-    mqtt_hass["retain"] = config.Mqtt.Hass.Retain;
-    mqtt_hass["topic"] = config.Mqtt.Hass.Topic;
-    mqtt_hass["individual_panels"] = config.Mqtt.Hass.IndividualPanels;
-    mqtt_hass["expire"] = config.Mqtt.Hass.Expire;
+bool ConfigurationClass::write()
+{
+    // A queued write has older data
+    FsWorker.discard(CONFIG_IMAGE_FILENAME);
 
-    JsonObject dtu = doc["dtu"].to<JsonObject>();
-    dtu["serial"] = config.Dtu.Serial;
-    dtu["poll_interval"] = config.Dtu.PollInterval;
-    dtu["nrf_pa_level"] = config.Dtu.Nrf.PaLevel;
-    dtu["cmt_pa_level"] = config.Dtu.Cmt.PaLevel;
-    dtu["cmt_frequency"] = config.Dtu.Cmt.Frequency;
-    dtu["cmt_country_mode"] = config.Dtu.Cmt.CountryMode;
+    std::vector<uint8_t> image;
+    serialize(image);
 
-    JsonObject security = doc["security"].to<JsonObject>();
-    security["password"] = config.Security.Password;
-    security["allow_readonly"] = config.Security.AllowReadonly;
+    // Written to a temporary file first so a reset while writing keeps the old configuration
+    if (!FsWorkerClass::writeFile(CONFIG_IMAGE_FILENAME, image)) {
+        MessageOutput.println("Failed to write file");
+        _writeFailed = true;
+        return false;
+    }
+    FlashWear.record(FlashWriter_t::Config, image.size());
+    _writeFailed = false;
+    return true;
+}
 
-    JsonObject device = doc["device"].to<JsonObject>();
-    device["pinmapping"] = config.Dev_PinMapping;
+void ConfigurationClass::requestWrite()
+{
+    std::lock_guard<std::mutex> lock(_writeRequestMutex);
+    _writeLastRequest = millis();
+    if (!_writePending) {
+        _writeFirstRequest = _writeLastRequest;
+        _writePending = true;
+    }
+}
 
-    JsonObject display = device["display"].to<JsonObject>();
-    display["powersafe"] = config.Display.PowerSafe;
-    display["screensaver"] = config.Display.ScreenSaver;
-    display["rotation"] = config.Display.Rotation;
-    display["contrast"] = config.Display.Contrast;
-    display["locale"] = config.Display.Locale;
-    display["diagram_duration"] = config.Display.Diagram.Duration;
-    display["diagram_mode"] = config.Display.Diagram.Mode;
+bool ConfigurationClass::hasWriteFailed() const
+{
+    return _writeFailed;
+}
 
-    JsonArray leds = device["led"].to<JsonArray>();
-    for (uint8_t i = 0; i < PINMAPPING_LED_COUNT; i++) {
-        JsonObject led = leds.add<JsonObject>();
-        led["brightness"] = config.Led_Single[i].Brightness;
+bool ConfigurationClass::isWritePending()
+{
+    std::lock_guard<std::mutex> lock(_writeRequestMutex);
+    return _writePending;
+}
+
+void ConfigurationClass::flushPendingWrite()
+{
+    if (isWritePending()) {
+        write();
     }
+}
 
-    JsonArray inverters = doc["inverters"].to<JsonArray>();
-    for (uint8_t i = 0; i < INV_MAX_COUNT; i++) {
-        JsonObject inv = inverters.add<JsonObject>();
-        inv["serial"] = config.Inverter[i].Serial;
-        inv["name"] = config.Inverter[i].Name;
-        inv["order"] = config.Inverter[i].Order;
-        inv["poll_enable"] = config.Inverter[i].Poll_Enable;
-        inv["poll_enable_night"] = config.Inverter[i].Poll_Enable_Night;
-        inv["command_enable"] = config.Inverter[i].Command_Enable;
-        inv["command_enable_night"] = config.Inverter[i].Command_Enable_Night;
-        inv["reachable_threshold"] = config.Inverter[i].ReachableThreshold;
-        inv["zero_runtime"] = config.Inverter[i].ZeroRuntimeDataIfUnrechable;
-        inv["zero_day"] = config.Inverter[i].ZeroYieldDayOnMidnight;
-        inv["clear_eventlog"] = config.Inverter[i].ClearEventlogOnMidnight;
-        inv["yieldday_correction"] = config.Inverter[i].YieldDayCorrection;
+void ConfigurationClass::discardPendingWrite()
+{
+    FsWorker.discard(CONFIG_IMAGE_FILENAME);
 
-        JsonArray channel = inv["channel"].to<JsonArray>();
-        for (uint8_t c = 0; c < INV_MAX_CHAN_COUNT; c++) {
-            JsonObject chanData = channel.add<JsonObject>();
-            chanData["name"] = config.Inverter[i].channel[c].Name;
-            chanData["max_power"] = config.Inverter[i].channel[c].MaxChannelPower;
-            chanData["yield_total_offset"] = config.Inverter[i].channel[c].YieldTotalOffset;
+    std::lock_guard<std::mutex> lock(_writeRequestMutex);
+    _writePending = false;
+}
+
+bool ConfigurationClass::read()
+{
+    // A JSON file is an older configuration or a restored backup
+    bool valid = LittleFS.exists(CONFIG_FILENAME) && importJson();
+
+    if (!valid) {
+        loadDefaults();
+        valid = readImage();
+        if (!valid) {
+            MessageOutput.print("no valid configuration, using defaults... ");
+            loadDefaults();
         }
     }
+    rebuildInverterIndex();
 
-    if (!Utils::checkJsonAlloc(doc, __FUNCTION__, __LINE__)) {
+    config.Mqtt.Tls.RootCaCert = CertStore.getHandle(Cert_t::MqttRootCa);
+    config.Mqtt.Tls.ClientCert = CertStore.getHandle(Cert_t::MqttClientCert);
+    config.Mqtt.Tls.ClientKey = CertStore.getHandle(Cert_t::MqttClientKey);
+    config.Influx.RootCaCert = CertStore.getHandle(Cert_t::InfluxRootCa);
+
+    // Check for default DTU serial
+    MessageOutput.print("Check for default DTU serial... ");
+    if (config.Dtu.Serial == DTU_SERIAL) {
+        MessageOutput.print("generate serial based on ESP chip id: ");
+        const uint64_t dtuId = Utils::generateDtuSerial();
+        MessageOutput.printf("%0" PRIx32 "%08" PRIx32 "... ",
+            static_cast<uint32_t>((dtuId >> 32) & 0xFFFFFFFF),
+            static_cast<uint32_t>(dtuId & 0xFFFFFFFF));
+        config.Dtu.Serial = dtuId;
+        write();
+    }
+    MessageOutput.println("done");
+
+    return valid;
+}
+
+void ConfigurationClass::loadDefaults()
+{
+    // Every value missing in the document is set to its default
+    JsonDocument doc;
+    fromJson(doc);
+}
+
+// Applies the records of the image to the current (default) configuration
+bool ConfigurationClass::readImage()
+{
+    File f = LittleFS.open(CONFIG_IMAGE_FILENAME, "r", false);
+    if (!f) {
         return false;
     }
 
-    // Serialize JSON to file
-    if (serializeJson(doc, f) == 0) {
-        MessageOutput.println("Failed to write file");
+    ConfigImageHeader_t header;
+    if (f.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header)
+        || header.Magic != CONFIG_IMAGE_MAGIC
+        || header.Version != CONFIG_IMAGE_VERSION
+        || header.Length != f.size() - sizeof(header)) {
+        MessageOutput.print("invalid configuration file... ");
         return false;
     }
 
-    f.close();
+    uint32_t crc = 0;
+    size_t remaining = header.Length;
+    auto readData = [&](void* data, const size_t len) {
+        if (len > remaining || f.read(static_cast<uint8_t*>(data), len) != len) {
+            return false;
+        }
+        crc = esp_rom_crc32_le(crc, static_cast<const uint8_t*>(data), len);
+        remaining -= len;
+        return true;
+    };
+
+    // Copies the part of the record which fits into the field and skips the rest
+    auto readField = [&](void* data, const size_t size, const bool isString, size_t len) {
+        const size_t copy = min(len, isString ? size - 1 : size);
+        if (copy > 0 && !readData(data, copy)) {
+            return false;
+        }
+        if (isString) {
+            static_cast<char*>(data)[copy] = '\0';
+        }
+        len -= copy;
+
+        uint8_t skip[32];
+        while (len > 0) {
+            const size_t chunk = min(len, sizeof(skip));
+            if (!readData(skip, chunk)) {
+                return false;
+            }
+            len -= chunk;
+        }
+        return true;
+    };
+
+    INVERTER_CONFIG_T* inv_cfg = nullptr;
+    bool tooManyInverters = false;
+    std::vector<std::pair<Cert_t, std::vector<char>>> legacyCerts;
+    while (remaining > 0) {
+        ConfigRecord_t record;
+        if (!readData(&record, sizeof(record)) || record.Length > remaining) {
+            MessageOutput.print("truncated configuration file... ");
+            return false;
+        }
+
+        void* data = nullptr;
+        size_t size = 0;
+        bool isString = false;
+
+        if (record.Id == CONFIG_ID_INVERTER) {
+            inv_cfg = nullptr;
+            if (config.Inverter.size() < INV_MAX_COUNT) {
+                inv_cfg = &config.Inverter.emplace_back();
+                initInverterConfig(*inv_cfg);
+            } else {
+                tooManyInverters = true;
+            }
+        } else if (record.Id >= CONFIG_ID_CHANNEL && record.Id < CONFIG_ID_CHANNEL + 0x100) {
+            const uint8_t c = (record.Id - CONFIG_ID_CHANNEL) / CONFIG_ID_CHANNEL_STRIDE;
+            const uint16_t id = (record.Id - CONFIG_ID_CHANNEL) % CONFIG_ID_CHANNEL_STRIDE;
+            for (const auto& member : channelMembers) {
+                if (member.Id == id && inv_cfg != nullptr && c < INV_MAX_CHAN_COUNT) {
+                    data = reinterpret_cast<uint8_t*>(&inv_cfg->channel[c]) + member.Offset;
+                    size = member.Size;
+                    isString = member.IsString;
+                    break;
+                }
+            }
+        } else if (record.Id > CONFIG_ID_INVERTER) {
+            for (const auto& member : inverterMembers) {
+                if (member.Id == record.Id && inv_cfg != nullptr) {
+                    data = reinterpret_cast<uint8_t*>(inv_cfg) + member.Offset;
+                    size = member.Size;
+                    isString = member.IsString;
+                    break;
+                }
+            }
+        } else {
+            for (const auto& field : configFields) {
+                if (field.Id == record.Id) {
+                    data = field.Data;
+                    size = field.Size;
+                    isString = field.IsString;
+                    break;
+                }
+            }
+            for (const auto& legacy : legacyCertFields) {
+                if (legacy.Id == record.Id) {
+                    auto& cert = legacyCerts.emplace_back(legacy.Cert, std::vector<char>(record.Length + 1));
+                    data = cert.second.data();
+                    size = cert.second.size();
+                    isString = true;
+                    break;
+                }
+            }
+        }
+
+        // Records of unknown fields are only part of the checksum
+        if (!readField(data, size, isString, record.Length)) {
+            MessageOutput.print("truncated configuration file... ");
+            return false;
+        }
+    }
+
+    if (crc != header.Crc) {
+        MessageOutput.print("configuration checksum mismatch... ");
+        return false;
+    }
+
+    // Moved to their files, the next write of the image drops them
+    for (const auto& cert : legacyCerts) {
+        CertStore.write(cert.first, cert.second.data());
+    }
+    if (!legacyCerts.empty()) {
+        requestWrite();
+    }
+
+    if (tooManyInverters) {
+        MessageOutput.println("Too many inverters configured, ignoring the rest");
+    }
+
+    // A slot without serial would never be polled and cannot be edited
+    config.Inverter.erase(std::remove_if(config.Inverter.begin(), config.Inverter.end(),
+                              [](const INVERTER_CONFIG_T& inv) { return inv.Serial == 0; }),
+        config.Inverter.end());
+
     return true;
 }
 
-bool ConfigurationClass::read()
+// Reads CONFIG_FILENAME into the configuration and replaces the image by it
+bool ConfigurationClass::importJson()
 {
     File f = LittleFS.open(CONFIG_FILENAME, "r", false);
     Utils::skipBom(f);
 
-    JsonDocument doc;
+    JsonDocument doc(HeapTelemetry.getJsonAllocator(HeapTag_t::Config));
 
     // Deserialize the JSON document
     const DeserializationError error = deserializeJson(doc, f);
+    f.close();
     if (error) {
-        MessageOutput.println("Failed to read file, using default configuration");
+        MessageOutput.printf("failed to import %s: %s... ", CONFIG_FILENAME, error.c_str());
+        LittleFS.remove(CONFIG_FILENAME);
+        return false;
     }
 
     if (!Utils::checkJsonAlloc(doc, __FUNCTION__, __LINE__)) {
         return false;
     }
 
+    fromJson(doc);
+    migrateJson(doc);
+
+    MessageOutput.print("imported JSON... ");
+    if (write()) {
+        LittleFS.remove(CONFIG_FILENAME);
+    }
+    return true;
+}
+
+static void cfgFromJson(JsonVariant doc, CONFIG_T& config)
+{
     JsonObject cfg = doc["cfg"];
     config.Cfg.Version = cfg["version"] | CONFIG_VERSION;
     config.Cfg.SaveCount = cfg["save_count"] | 0;
+}
 
+static void wifiFromJson(JsonVariant doc, CONFIG_T& config)
+{
     JsonObject wifi = doc["wifi"];
     strlcpy(config.WiFi.Ssid, wifi["ssid"] | WIFI_SSID, sizeof(config.WiFi.Ssid));
     strlcpy(config.WiFi.Password, wifi["password"] | WIFI_PASSWORD, sizeof(config.WiFi.Password));
@@ -228,10 +645,16 @@ bool ConfigurationClass::read()
 
     config.WiFi.Dhcp = wifi["dhcp"] | WIFI_DHCP;
     config.WiFi.ApTimeout = wifi["aptimeout"] | ACCESS_POINT_TIMEOUT;
+}
 
+static void mdnsFromJson(JsonVariant doc, CONFIG_T& config)
+{
     JsonObject mdns = doc["mdns"];
     config.Mdns.Enabled = mdns["enabled"] | MDNS_ENABLED;
+}
 
+static void ntpFromJson(JsonVariant doc, CONFIG_T& config)
+{
     JsonObject ntp = doc["ntp"];
     strlcpy(config.Ntp.Server, ntp["server"] | NTP_SERVER, sizeof(config.Ntp.Server));
     strlcpy(config.Ntp.Timezone, ntp["timezone"] | NTP_TIMEZONE, sizeof(config.Ntp.Timezone));
@@ -239,7 +662,10 @@ bool ConfigurationClass::read()
     config.Ntp.Latitude = ntp["latitude"] | NTP_LATITUDE;
     config.Ntp.Longitude = ntp["longitude"] | NTP_LONGITUDE;
     config.Ntp.SunsetType = ntp["sunsettype"] | NTP_SUNSETTYPE;
+}
 
+static void mqttFromJson(JsonVariant doc, CONFIG_T& config)
+{
     JsonObject mqtt = doc["mqtt"];
     config.Mqtt.Enabled = mqtt["enabled"] | MQTT_ENABLED;
     strlcpy(config.Mqtt.Hostname, mqtt["hostname"] | MQTT_HOST, sizeof(config.Mqtt.Hostname));
@@ -251,6 +677,27 @@ bool ConfigurationClass::read()
     config.Mqtt.Retain = mqtt["retain"] | MQTT_RETAIN;
     config.Mqtt.PublishInterval = mqtt["publish_interval"] | MQTT_PUBLISH_INTERVAL;
     config.Mqtt.CleanSession = mqtt["clean_session"] | MQTT_CLEAN_SESSION;
+    config.Mqtt.PublishOnChange = mqtt["publish_on_change"] | MQTT_PUBLISH_ON_CHANGE;
+    config.Mqtt.JsonPayload = mqtt["json_payload"] | MQTT_JSON_PAYLOAD;
+
+    JsonObject mqtt_journal = mqtt["journal"];
+    config.Mqtt.Journal.Enabled = mqtt_journal["enabled"] | MQTT_JOURNAL_ENABLED;
+    config.Mqtt.Journal.ReplayRate = mqtt_journal["replay_rate"] | MQTT_JOURNAL_REPLAY_RATE;
+
+    JsonObject mqtt_cluster = mqtt["cluster"];
+    config.Mqtt.Cluster.Enabled = mqtt_cluster["enabled"] | MQTT_CLUSTER_ENABLED;
+    strlcpy(config.Mqtt.Cluster.Topic, mqtt_cluster["topic"] | MQTT_CLUSTER_TOPIC, sizeof(config.Mqtt.Cluster.Topic));
+
+    JsonObject mqtt_fast_lane = mqtt["fast_lane"];
+    config.Mqtt.FastLane.TotalAcPower = mqtt_fast_lane["total_ac_power"] | MQTT_FAST_LANE_TOTAL_AC_POWER;
+    config.Mqtt.FastLane.TotalDcPower = mqtt_fast_lane["total_dc_power"] | MQTT_FAST_LANE_TOTAL_DC_POWER;
+    config.Mqtt.FastLane.AcPower = mqtt_fast_lane["ac_power"] | MQTT_FAST_LANE_AC_POWER;
+    config.Mqtt.FastLane.DcPower = mqtt_fast_lane["dc_power"] | MQTT_FAST_LANE_DC_POWER;
+
+    JsonObject mqtt_fleet = mqtt["fleet"];
+    config.Mqtt.Fleet.Publish = mqtt_fleet["publish"] | MQTT_FLEET_PUBLISH;
+    config.Mqtt.Fleet.Aggregate = mqtt_fleet["aggregate"] | MQTT_FLEET_AGGREGATE;
+    strlcpy(config.Mqtt.Fleet.Topic, mqtt_fleet["topic"] | MQTT_FLEET_TOPIC, sizeof(config.Mqtt.Fleet.Topic));
 
     JsonObject mqtt_lwt = mqtt["lwt"];
     strlcpy(config.Mqtt.Lwt.Topic, mqtt_lwt["topic"] | MQTT_LWT_TOPIC, sizeof(config.Mqtt.Lwt.Topic));
@@ -260,30 +707,46 @@ bool ConfigurationClass::read()
 
     JsonObject mqtt_tls = mqtt["tls"];
     config.Mqtt.Tls.Enabled = mqtt_tls["enabled"] | MQTT_TLS;
-    strlcpy(config.Mqtt.Tls.RootCaCert, mqtt_tls["root_ca_cert"] | MQTT_ROOT_CA_CERT, sizeof(config.Mqtt.Tls.RootCaCert));
     config.Mqtt.Tls.CertLogin = mqtt_tls["certlogin"] | MQTT_TLSCERTLOGIN;
-    strlcpy(config.Mqtt.Tls.ClientCert, mqtt_tls["client_cert"] | MQTT_TLSCLIENTCERT, sizeof(config.Mqtt.Tls.ClientCert));
-    strlcpy(config.Mqtt.Tls.ClientKey, mqtt_tls["client_key"] | MQTT_TLSCLIENTKEY, sizeof(config.Mqtt.Tls.ClientKey));
 
     JsonObject mqtt_hass = mqtt["hass"];
     config.Mqtt.Hass.Enabled = mqtt_hass["enabled"] | MQTT_HASS_ENABLED;
     config.Mqtt.Hass.Retain = mqtt_hass["retain"] | MQTT_HASS_RETAIN;
     config.Mqtt.Hass.Expire = mqtt_hass["expire"] | MQTT_HASS_EXPIRE;
     config.Mqtt.Hass.IndividualPanels = mqtt_hass["individual_panels"] | MQTT_HASS_INDIVIDUALPANELS;
+    config.Mqtt.Hass.DeviceDiscovery = mqtt_hass["device_discovery"] | MQTT_HASS_DEVICE_DISCOVERY;
     strlcpy(config.Mqtt.Hass.Topic, mqtt_hass["topic"] | MQTT_HASS_TOPIC, sizeof(config.Mqtt.Hass.Topic));
+}
 
+static void dtuFromJson(JsonVariant doc, CONFIG_T& config)
+{
     JsonObject dtu = doc["dtu"];
     config.Dtu.Serial = dtu["serial"] | DTU_SERIAL;
     config.Dtu.PollInterval = dtu["poll_interval"] | DTU_POLL_INTERVAL;
+    config.Dtu.AdaptivePolling = dtu["adaptive_polling"] | DTU_ADAPTIVE_POLLING;
+    config.Dtu.PollCalibration = dtu["poll_calibration"] | DTU_POLL_CALIBRATION;
+    config.Dtu.SnapshotPolling = dtu["snapshot_polling"] | DTU_SNAPSHOT_POLLING;
+    config.Dtu.FreshnessSloInterval = dtu["freshness_slo_interval"] | DTU_FRESHNESS_SLO_INTERVAL;
+    config.Dtu.FreshnessSloAge = dtu["freshness_slo_age"] | DTU_FRESHNESS_SLO_AGE;
+    config.Dtu.LimitMinInterval = dtu["limit_min_interval"] | DTU_LIMIT_MIN_INTERVAL;
+    config.Dtu.LimitHysteresis = dtu["limit_hysteresis"] | DTU_LIMIT_HYSTERESIS;
+    config.Dtu.NightStandby = dtu["night_standby"] | DTU_NIGHT_STANDBY;
+    config.Dtu.TxPowerControl = dtu["tx_power_control"] | DTU_TX_POWER_CONTROL;
     config.Dtu.Nrf.PaLevel = dtu["nrf_pa_level"] | DTU_NRF_PA_LEVEL;
     config.Dtu.Cmt.PaLevel = dtu["cmt_pa_level"] | DTU_CMT_PA_LEVEL;
     config.Dtu.Cmt.Frequency = dtu["cmt_frequency"] | DTU_CMT_FREQUENCY;
     config.Dtu.Cmt.CountryMode = dtu["cmt_country_mode"] | DTU_CMT_COUNTRY_MODE;
+}
 
+static void securityFromJson(JsonVariant doc, CONFIG_T& config)
+{
     JsonObject security = doc["security"];
     strlcpy(config.Security.Password, security["password"] | ACCESS_POINT_PASSWORD, sizeof(config.Security.Password));
     config.Security.AllowReadonly = security["allow_readonly"] | SECURITY_ALLOW_READONLY;
+}
 
+static void deviceFromJson(JsonVariant doc, CONFIG_T& config)
+{
     JsonObject device = doc["device"];
     strlcpy(config.Dev_PinMapping, device["pinmapping"] | DEV_PINMAPPING, sizeof(config.Dev_PinMapping));
 
@@ -301,81 +764,540 @@ bool ConfigurationClass::read()
         JsonObject led = leds[i].as<JsonObject>();
         config.Led_Single[i].Brightness = led["brightness"] | LED_BRIGHTNESS;
     }
+}
+
+static void powerControlFromJson(JsonVariant doc, CONFIG_T& config)
+{
+    JsonObject powercontrol = doc["powercontrol"];
+    config.PowerControl.Enabled = powercontrol["enabled"] | POWERCTRL_ENABLED;
+    strlcpy(config.PowerControl.MeterTopic, powercontrol["meter_topic"] | POWERCTRL_METER_TOPIC, sizeof(config.PowerControl.MeterTopic));
+    config.PowerControl.TargetPower = powercontrol["target_power"] | POWERCTRL_TARGET_POWER;
+    config.PowerControl.Kp = powercontrol["kp"] | POWERCTRL_KP;
+    config.PowerControl.Ki = powercontrol["ki"] | POWERCTRL_KI;
+    config.PowerControl.MeterTimeout = powercontrol["meter_timeout"] | POWERCTRL_METER_TIMEOUT;
+    config.PowerControl.MinLimit = powercontrol["min_limit"] | POWERCTRL_MIN_LIMIT;
+}
+
+static void influxFromJson(JsonVariant doc, CONFIG_T& config)
+{
+    JsonObject influx = doc["influx"];
+    config.Influx.Enabled = influx["enabled"] | INFLUX_ENABLED;
+    strlcpy(config.Influx.Url, influx["url"] | INFLUX_URL, sizeof(config.Influx.Url));
+    strlcpy(config.Influx.Token, influx["token"] | INFLUX_TOKEN, sizeof(config.Influx.Token));
+    config.Influx.FlushInterval = influx["flush_interval"] | INFLUX_FLUSH_INTERVAL;
+}
+
+static void modbusFromJson(JsonVariant doc, CONFIG_T& config)
+{
+    JsonObject modbus = doc["modbus"];
+    config.Modbus.Enabled = modbus["enabled"] | MODBUS_ENABLED;
+    config.Modbus.Port = modbus["port"] | MODBUS_PORT;
+    config.Modbus.AllowWrite = modbus["allow_write"] | MODBUS_ALLOW_WRITE;
+}
+
+static void rawStatsFromJson(JsonVariant doc, CONFIG_T& config)
+{
+    JsonObject rawstats = doc["rawstats"];
+    config.RawStats.Mqtt = rawstats["mqtt"] | RAWSTATS_MQTT;
+    config.RawStats.Udp = rawstats["udp"] | RAWSTATS_UDP;
+    strlcpy(config.RawStats.UdpHost, rawstats["udp_host"] | RAWSTATS_UDP_HOST, sizeof(config.RawStats.UdpHost));
+    config.RawStats.UdpPort = rawstats["udp_port"] | RAWSTATS_UDP_PORT;
+    config.RawStats.SkipFields = rawstats["skip_fields"] | RAWSTATS_SKIP_FIELDS;
+}
+
+static void syslogFromJson(JsonVariant doc, CONFIG_T& config)
+{
+    JsonObject syslog = doc["syslog"];
+    config.Syslog.Enabled = syslog["enabled"] | SYSLOG_ENABLED;
+    strlcpy(config.Syslog.Host, syslog["host"] | SYSLOG_HOST, sizeof(config.Syslog.Host));
+    config.Syslog.Port = syslog["port"] | SYSLOG_PORT;
+    config.Syslog.Format = syslog["format"] | SYSLOG_FORMAT;
+    config.Syslog.Level = syslog["level"] | SYSLOG_LEVEL;
+}
 
+static void prometheusFromJson(JsonVariant doc, CONFIG_T& config)
+{
+    JsonObject prometheus = doc["prometheus"];
+    config.Prometheus.CacheTtl = prometheus["cache_ttl"] | PROMETHEUS_CACHE_TTL;
+}
+
+static void invertersFromJson(JsonVariant doc, CONFIG_T& config)
+{
     JsonArray inverters = doc["inverters"];
-    for (uint8_t i = 0; i < INV_MAX_COUNT; i++) {
-        JsonObject inv = inverters[i].as<JsonObject>();
-        config.Inverter[i].Serial = inv["serial"] | 0ULL;
-        strlcpy(config.Inverter[i].Name, inv["name"] | "", sizeof(config.Inverter[i].Name));
-        config.Inverter[i].Order = inv["order"] | 0;
-
-        config.Inverter[i].Poll_Enable = inv["poll_enable"] | true;
-        config.Inverter[i].Poll_Enable_Night = inv["poll_enable_night"] | true;
-        config.Inverter[i].Command_Enable = inv["command_enable"] | true;
-        config.Inverter[i].Command_Enable_Night = inv["command_enable_night"] | true;
-        config.Inverter[i].ReachableThreshold = inv["reachable_threshold"] | REACHABLE_THRESHOLD;
-        config.Inverter[i].ZeroRuntimeDataIfUnrechable = inv["zero_runtime"] | false;
-        config.Inverter[i].ZeroYieldDayOnMidnight = inv["zero_day"] | false;
-        config.Inverter[i].ClearEventlogOnMidnight = inv["clear_eventlog"] | false;
-        config.Inverter[i].YieldDayCorrection = inv["yieldday_correction"] | false;
+    config.Inverter.clear();
+    for (JsonObject inv : inverters) {
+        // Older configurations contain empty slots
+        const uint64_t serial = inv["serial"] | 0ULL;
+        if (serial == 0) {
+            continue;
+        }
+
+        if (config.Inverter.size() >= INV_MAX_COUNT) {
+            MessageOutput.println("Too many inverters configured, ignoring the rest");
+            break;
+        }
+
+        INVERTER_CONFIG_T& inv_cfg = config.Inverter.emplace_back();
+        inv_cfg.Serial = serial;
+        strlcpy(inv_cfg.Name, inv["name"] | "", sizeof(inv_cfg.Name));
+        inv_cfg.Order = inv["order"] | 0;
+
+        inv_cfg.Poll_Enable = inv["poll_enable"] | true;
+        inv_cfg.Poll_Enable_Night = inv["poll_enable_night"] | true;
+        inv_cfg.Command_Enable = inv["command_enable"] | true;
+        inv_cfg.Command_Enable_Night = inv["command_enable_night"] | true;
+        inv_cfg.ReachableThreshold = inv["reachable_threshold"] | REACHABLE_THRESHOLD;
+        inv_cfg.ZeroRuntimeDataIfUnrechable = inv["zero_runtime"] | false;
+        inv_cfg.ZeroYieldDayOnMidnight = inv["zero_day"] | false;
+        inv_cfg.ClearEventlogOnMidnight = inv["clear_eventlog"] | false;
+        inv_cfg.YieldDayCorrection = inv["yieldday_correction"] | false;
+        inv_cfg.Group = std::min<uint8_t>(inv["group"] | 0, INV_MAX_GROUP_COUNT);
+
+        JsonObject pollPlan = inv["poll_plan"];
+        inv_cfg.PollPlan.StatsInterval = pollPlan["stats_interval"] | INVERTER_STATS_INTERVAL;
+        inv_cfg.PollPlan.AlarmInterval = pollPlan["alarm_interval"] | INVERTER_ALARM_INTERVAL;
+        inv_cfg.PollPlan.LimitInterval = pollPlan["limit_interval"] | INVERTER_LIMIT_INTERVAL;
+        inv_cfg.PollPlan.AlarmOnDemand = pollPlan["alarm_on_demand"] | false;
+        inv_cfg.PollPlan.GridProfileOnDemand = pollPlan["gridprofile_on_demand"] | false;
 
         JsonArray channel = inv["channel"];
         for (uint8_t c = 0; c < INV_MAX_CHAN_COUNT; c++) {
-            config.Inverter[i].channel[c].MaxChannelPower = channel[c]["max_power"] | 0;
-            config.Inverter[i].channel[c].YieldTotalOffset = channel[c]["yield_total_offset"] | 0.0f;
-            strlcpy(config.Inverter[i].channel[c].Name, channel[c]["name"] | "", sizeof(config.Inverter[i].channel[c].Name));
+            inv_cfg.channel[c].MaxChannelPower = channel[c]["max_power"] | 0;
+            inv_cfg.channel[c].YieldTotalOffset = channel[c]["yield_total_offset"] | 0.0f;
+            strlcpy(inv_cfg.channel[c].Name, channel[c]["name"] | "", sizeof(inv_cfg.channel[c].Name));
         }
     }
+}
 
-    f.close();
+// Written to their files right away, so a restore only reads them once the rest of the file is valid
+static void certsFromJson(JsonVariant doc, CONFIG_T& config)
+{
+    JsonObject mqtt_tls = doc["mqtt"]["tls"];
 
-    // Check for default DTU serial
-    MessageOutput.print("Check for default DTU serial... ");
-    if (config.Dtu.Serial == DTU_SERIAL) {
-        MessageOutput.print("generate serial based on ESP chip id: ");
-        const uint64_t dtuId = Utils::generateDtuSerial();
-        MessageOutput.printf("%0" PRIx32 "%08" PRIx32 "... ",
-            static_cast<uint32_t>((dtuId >> 32) & 0xFFFFFFFF),
-            static_cast<uint32_t>(dtuId & 0xFFFFFFFF));
-        config.Dtu.Serial = dtuId;
-        write();
+    // Only part of older files and backups, the defaults are used if the files do not exist
+    if (mqtt_tls["root_ca_cert"].is<const char*>()) {
+        config.Mqtt.Tls.RootCaCert = CertStore.write(Cert_t::MqttRootCa, mqtt_tls["root_ca_cert"].as<const char*>());
+    }
+    if (mqtt_tls["client_cert"].is<const char*>()) {
+        config.Mqtt.Tls.ClientCert = CertStore.write(Cert_t::MqttClientCert, mqtt_tls["client_cert"].as<const char*>());
+    }
+    if (mqtt_tls["client_key"].is<const char*>()) {
+        config.Mqtt.Tls.ClientKey = CertStore.write(Cert_t::MqttClientKey, mqtt_tls["client_key"].as<const char*>());
     }
-    MessageOutput.println("done");
 
-    return true;
+    JsonObject influx = doc["influx"];
+    if (influx["root_ca_cert"].is<const char*>()) {
+        config.Influx.RootCaCert = CertStore.write(Cert_t::InfluxRootCa, influx["root_ca_cert"].as<const char*>());
+    }
 }
 
-void ConfigurationClass::migrate()
+// Top level members of CONFIG_FILENAME. Each function only reads its member and sets
+// the defaults of the values which are missing, so the sections can be read one at a time.
+static const struct {
+    const char* Key;
+    void (*FromJson)(JsonVariant doc, CONFIG_T& config);
+} configSections[] = {
+    { "cfg", cfgFromJson },
+    { "wifi", wifiFromJson },
+    { "mdns", mdnsFromJson },
+    { "ntp", ntpFromJson },
+    { "mqtt", mqttFromJson },
+    { "dtu", dtuFromJson },
+    { "security", securityFromJson },
+    { "device", deviceFromJson },
+    { "powercontrol", powerControlFromJson },
+    { "influx", influxFromJson },
+    { "modbus", modbusFromJson },
+    { "rawstats", rawStatsFromJson },
+    { "syslog", syslogFromJson },
+    { "prometheus", prometheusFromJson },
+    { "inverters", invertersFromJson },
+};
+
+void ConfigurationClass::fromJson(JsonDocument& doc)
 {
-    File f = LittleFS.open(CONFIG_FILENAME, "r", false);
-    if (!f) {
-        MessageOutput.println("Failed to open file, cancel migration");
-        return;
+    for (const auto& section : configSections) {
+        section.FromJson(doc.as<JsonVariant>(), config);
     }
+    certsFromJson(doc.as<JsonVariant>(), config);
+}
 
+// Reads the members of the file which are part of the filter, the others are skipped by the parser
+static DeserializationError readFiltered(File& f, JsonDocument& doc, const JsonDocument& filter)
+{
+    f.seek(0);
     Utils::skipBom(f);
+    return deserializeJson(doc, f, DeserializationOption::Filter(filter),
+        DeserializationOption::NestingLimit(CONFIG_RESTORE_NESTING_LIMIT));
+}
 
-    JsonDocument doc;
+// Limits which fromJson does not enforce itself, the web api checks them when the values are entered
+static bool validate(const CONFIG_T& staging, String& error)
+{
+    if (staging.Dtu.Serial == 0) {
+        error = "DTU serial cannot be zero";
+    } else if (staging.Dtu.PollInterval == 0) {
+        error = "Poll interval must be greater zero";
+    } else if (staging.Dtu.Nrf.PaLevel > 3 || staging.Dtu.Cmt.PaLevel < -10 || staging.Dtu.Cmt.PaLevel > 20) {
+        error = "Invalid power level setting";
+    } else if (staging.Mqtt.Enabled && (staging.Mqtt.Port == 0 || staging.Mqtt.Hostname[0] == '\0')) {
+        error = "Invalid MqTT server";
+    } else {
+        for (size_t i = 0; i < staging.Inverter.size(); i++) {
+            for (size_t j = i + 1; j < staging.Inverter.size(); j++) {
+                if (staging.Inverter[i].Serial == staging.Inverter[j].Serial) {
+                    error = "Inverter serial is used twice";
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+    return false;
+}
 
-    // Deserialize the JSON document
-    const DeserializationError error = deserializeJson(doc, f);
-    if (error) {
-        MessageOutput.printf("Failed to read file, cancel migration: %s\r\n", error.c_str());
-        return;
+// Settings which are only applied at boot, all others are applied by onConfigRestore the
+// same way as by their own web API handler. The structures are compared bytewise,
+// different unused bytes behind a string only cause an unneeded restart.
+static bool needsRestart(const CONFIG_T& a, const CONFIG_T& b)
+{
+    return memcmp(&a.WiFi, &b.WiFi, sizeof(a.WiFi)) != 0
+        || memcmp(&a.Mdns, &b.Mdns, sizeof(a.Mdns)) != 0
+        || memcmp(&a.Dtu, &b.Dtu, sizeof(a.Dtu)) != 0
+        || memcmp(&a.Display, &b.Display, sizeof(a.Display)) != 0
+        || memcmp(&a.Led_Single, &b.Led_Single, sizeof(a.Led_Single)) != 0
+        || memcmp(&a.Influx, &b.Influx, sizeof(a.Influx)) != 0
+        || memcmp(&a.Modbus, &b.Modbus, sizeof(a.Modbus)) != 0
+        || memcmp(&a.RawStats, &b.RawStats, sizeof(a.RawStats)) != 0
+        || strcmp(a.Dev_PinMapping, b.Dev_PinMapping) != 0;
+}
+
+ConfigRestoreResult_t ConfigurationClass::restoreJson(const char* filename, String& error)
+{
+    File f = LittleFS.open(filename, "r", false);
+    if (!f) {
+        error = "File not found";
+        return ConfigRestoreResult_t::Invalid;
+    }
+    if (f.size() > CONFIG_RESTORE_MAX_SIZE) {
+        error = "File too large";
+        return ConfigRestoreResult_t::Invalid;
     }
 
+    // Zero initialized like the global configuration, needsRestart compares the bytes
+    auto staging = std::make_unique<CONFIG_T>();
+    JsonDocument empty;
+    for (const auto& section : configSections) {
+        section.FromJson(empty.as<JsonVariant>(), *staging);
+    }
+
+    // Only a single member is in RAM at a time instead of the whole document
+    for (const auto& section : configSections) {
+        JsonDocument filter;
+        filter[section.Key] = true;
+        JsonDocument doc(HeapTelemetry.getJsonAllocator(HeapTag_t::Config));
+
+        const DeserializationError result = readFiltered(f, doc, filter);
+        if (result) {
+            error = String("Invalid JSON: ") + result.c_str();
+            return ConfigRestoreResult_t::Invalid;
+        }
+        if (!Utils::checkJsonAlloc(doc, __FUNCTION__, __LINE__)) {
+            error = String("Out of memory in ") + section.Key;
+            return ConfigRestoreResult_t::Invalid;
+        }
+        if (!doc.is<JsonObject>()) {
+            error = "Not a configuration file";
+            return ConfigRestoreResult_t::Invalid;
+        }
+
+        JsonVariant value = doc[section.Key];
+        const bool isArray = strcmp(section.Key, "inverters") == 0;
+        if (!value.isNull() && (isArray ? !value.is<JsonArray>() : !value.is<JsonObject>())) {
+            error = String("Invalid type of ") + section.Key;
+            return ConfigRestoreResult_t::Invalid;
+        }
+        if (isArray && value.size() > INV_MAX_COUNT) {
+            error = "Too many inverters";
+            return ConfigRestoreResult_t::Invalid;
+        }
+
+        section.FromJson(doc.as<JsonVariant>(), *staging);
+    }
+
+    if (!validate(*staging, error)) {
+        return ConfigRestoreResult_t::Invalid;
+    }
+
+    // Older versions need migrateJson, which works on the whole document
+    if (staging->Cfg.Version < CONFIG_VERSION) {
+        f.close();
+        discardPendingWrite();
+        LittleFS.remove(CONFIG_FILENAME);
+        LittleFS.rename(filename, CONFIG_FILENAME);
+        return ConfigRestoreResult_t::RestartRequired;
+    }
+
+    staging->Mqtt.Tls.RootCaCert = CertStore.getHandle(Cert_t::MqttRootCa);
+    staging->Mqtt.Tls.ClientCert = CertStore.getHandle(Cert_t::MqttClientCert);
+    staging->Mqtt.Tls.ClientKey = CertStore.getHandle(Cert_t::MqttClientKey);
+    staging->Influx.RootCaCert = CertStore.getHandle(Cert_t::InfluxRootCa);
+    {
+        JsonDocument filter;
+        filter["mqtt"]["tls"] = true;
+        filter["influx"]["root_ca_cert"] = true;
+        JsonDocument doc(HeapTelemetry.getJsonAllocator(HeapTag_t::Config));
+        if (!readFiltered(f, doc, filter) && Utils::checkJsonAlloc(doc, __FUNCTION__, __LINE__)) {
+            certsFromJson(doc.as<JsonVariant>(), *staging);
+        }
+    }
+    f.close();
+
+    bool restart;
+    {
+        auto guard = getWriteGuard();
+        auto& current = guard.getConfig();
+
+        // A backup without serial keeps the one generated for this board
+        if (staging->Dtu.Serial == DTU_SERIAL) {
+            staging->Dtu.Serial = current.Dtu.Serial;
+        }
+        staging->Cfg.Version = CONFIG_VERSION;
+        staging->Cfg.SaveCount = current.Cfg.SaveCount;
+
+        restart = needsRestart(*staging, current);
+        current = std::move(*staging);
+    }
+
+    // Written right away, a restart must not lose the restored configuration
+    if (!write()) {
+        requestWrite();
+    }
+
+    return restart ? ConfigRestoreResult_t::RestartRequired : ConfigRestoreResult_t::Applied;
+}
+
+void ConfigurationClass::toJson(JsonDocument& doc)
+{
+    JsonObject cfg = doc["cfg"].to<JsonObject>();
+    cfg["version"] = config.Cfg.Version;
+    cfg["save_count"] = config.Cfg.SaveCount;
+
+    JsonObject wifi = doc["wifi"].to<JsonObject>();
+    wifi["ssid"] = config.WiFi.Ssid;
+    wifi["password"] = config.WiFi.Password;
+    wifi["ip"] = IPAddress(config.WiFi.Ip).toString();
+    wifi["netmask"] = IPAddress(config.WiFi.Netmask).toString();
+    wifi["gateway"] = IPAddress(config.WiFi.Gateway).toString();
+    wifi["dns1"] = IPAddress(config.WiFi.Dns1).toString();
+    wifi["dns2"] = IPAddress(config.WiFi.Dns2).toString();
+    wifi["dhcp"] = config.WiFi.Dhcp;
+    wifi["hostname"] = config.WiFi.Hostname;
+    wifi["aptimeout"] = config.WiFi.ApTimeout;
+
+    JsonObject mdns = doc["mdns"].to<JsonObject>();
+    mdns["enabled"] = config.Mdns.Enabled;
+
+    JsonObject ntp = doc["ntp"].to<JsonObject>();
+    ntp["server"] = config.Ntp.Server;
+    ntp["timezone"] = config.Ntp.Timezone;
+    ntp["timezone_descr"] = config.Ntp.TimezoneDescr;
+    ntp["latitude"] = config.Ntp.Latitude;
+    ntp["longitude"] = config.Ntp.Longitude;
+    ntp["sunsettype"] = config.Ntp.SunsetType;
+
+    JsonObject mqtt = doc["mqtt"].to<JsonObject>();
+    mqtt["enabled"] = config.Mqtt.Enabled;
+    mqtt["hostname"] = config.Mqtt.Hostname;
+    mqtt["port"] = config.Mqtt.Port;
+    mqtt["clientid"] = config.Mqtt.ClientId;
+    mqtt["username"] = config.Mqtt.Username;
+    mqtt["password"] = config.Mqtt.Password;
+    mqtt["topic"] = config.Mqtt.Topic;
+    mqtt["retain"] = config.Mqtt.Retain;
+    mqtt["publish_interval"] = config.Mqtt.PublishInterval;
+    mqtt["clean_session"] = config.Mqtt.CleanSession;
+    mqtt["publish_on_change"] = config.Mqtt.PublishOnChange;
+    mqtt["json_payload"] = config.Mqtt.JsonPayload;
+
+    JsonObject mqtt_journal = mqtt["journal"].to<JsonObject>();
+    mqtt_journal["enabled"] = config.Mqtt.Journal.Enabled;
+    mqtt_journal["replay_rate"] = config.Mqtt.Journal.ReplayRate;
+
+    JsonObject mqtt_cluster = mqtt["cluster"].to<JsonObject>();
+    mqtt_cluster["enabled"] = config.Mqtt.Cluster.Enabled;
+    mqtt_cluster["topic"] = config.Mqtt.Cluster.Topic;
+
+    JsonObject mqtt_fast_lane = mqtt["fast_lane"].to<JsonObject>();
+    mqtt_fast_lane["total_ac_power"] = config.Mqtt.FastLane.TotalAcPower;
+    mqtt_fast_lane["total_dc_power"] = config.Mqtt.FastLane.TotalDcPower;
+    mqtt_fast_lane["ac_power"] = config.Mqtt.FastLane.AcPower;
+    mqtt_fast_lane["dc_power"] = config.Mqtt.FastLane.DcPower;
+
+    JsonObject mqtt_fleet = mqtt["fleet"].to<JsonObject>();
+    mqtt_fleet["publish"] = config.Mqtt.Fleet.Publish;
+    mqtt_fleet["aggregate"] = config.Mqtt.Fleet.Aggregate;
+    mqtt_fleet["topic"] = config.Mqtt.Fleet.Topic;
+
+    JsonObject mqtt_lwt = mqtt["lwt"].to<JsonObject>();
+    mqtt_lwt["topic"] = config.Mqtt.Lwt.Topic;
+    mqtt_lwt["value_online"] = config.Mqtt.Lwt.Value_Online;
+    mqtt_lwt["value_offline"] = config.Mqtt.Lwt.Value_Offline;
+    mqtt_lwt["qos"] = config.Mqtt.Lwt.Qos;
+
+    JsonObject mqtt_tls = mqtt["tls"].to<JsonObject>();
+    mqtt_tls["enabled"] = config.Mqtt.Tls.Enabled;
+    mqtt_tls["certlogin"] = config.Mqtt.Tls.CertLogin;
+    // The backup contains the certificates, they are written to their files on the import
+    mqtt_tls["root_ca_cert"] = CertStore.read(Cert_t::MqttRootCa);
+    mqtt_tls["client_cert"] = CertStore.read(Cert_t::MqttClientCert);
+    mqtt_tls["client_key"] = CertStore.read(Cert_t::MqttClientKey);
+
+    JsonObject mqtt_hass = mqtt["hass"].to<JsonObject>();
+    mqtt_hass["enabled"] = config.Mqtt.Hass.Enabled;
+    mqtt_hass["retain"] = config.Mqtt.Hass.Retain;
+    mqtt_hass["topic"] = config.Mqtt.Hass.Topic;
+    mqtt_hass["individual_panels"] = config.Mqtt.Hass.IndividualPanels;
+    mqtt_hass["expire"] = config.Mqtt.Hass.Expire;
+    mqtt_hass["device_discovery"] = config.Mqtt.Hass.DeviceDiscovery;
+
+    JsonObject dtu = doc["dtu"].to<JsonObject>();
+    dtu["serial"] = config.Dtu.Serial;
+    dtu["poll_interval"] = config.Dtu.PollInterval;
+    dtu["adaptive_polling"] = config.Dtu.AdaptivePolling;
+    dtu["poll_calibration"] = config.Dtu.PollCalibration;
+    dtu["snapshot_polling"] = config.Dtu.SnapshotPolling;
+    dtu["freshness_slo_interval"] = config.Dtu.FreshnessSloInterval;
+    dtu["freshness_slo_age"] = config.Dtu.FreshnessSloAge;
+    dtu["limit_min_interval"] = config.Dtu.LimitMinInterval;
+    dtu["limit_hysteresis"] = config.Dtu.LimitHysteresis;
+    dtu["night_standby"] = config.Dtu.NightStandby;
+    dtu["tx_power_control"] = config.Dtu.TxPowerControl;
+    dtu["nrf_pa_level"] = config.Dtu.Nrf.PaLevel;
+    dtu["cmt_pa_level"] = config.Dtu.Cmt.PaLevel;
+    dtu["cmt_frequency"] = config.Dtu.Cmt.Frequency;
+    dtu["cmt_country_mode"] = config.Dtu.Cmt.CountryMode;
+
+    JsonObject security = doc["security"].to<JsonObject>();
+    security["password"] = config.Security.Password;
+    security["allow_readonly"] = config.Security.AllowReadonly;
+
+    JsonObject device = doc["device"].to<JsonObject>();
+    device["pinmapping"] = config.Dev_PinMapping;
+
+    JsonObject display = device["display"].to<JsonObject>();
+    display["powersafe"] = config.Display.PowerSafe;
+    display["screensaver"] = config.Display.ScreenSaver;
+    display["rotation"] = config.Display.Rotation;
+    display["contrast"] = config.Display.Contrast;
+    display["locale"] = config.Display.Locale;
+    display["diagram_duration"] = config.Display.Diagram.Duration;
+    display["diagram_mode"] = config.Display.Diagram.Mode;
+
+    JsonArray leds = device["led"].to<JsonArray>();
+    for (uint8_t i = 0; i < PINMAPPING_LED_COUNT; i++) {
+        JsonObject led = leds.add<JsonObject>();
+        led["brightness"] = config.Led_Single[i].Brightness;
+    }
+
+    JsonObject powercontrol = doc["powercontrol"].to<JsonObject>();
+    powercontrol["enabled"] = config.PowerControl.Enabled;
+    powercontrol["meter_topic"] = config.PowerControl.MeterTopic;
+    powercontrol["target_power"] = config.PowerControl.TargetPower;
+    powercontrol["kp"] = config.PowerControl.Kp;
+    powercontrol["ki"] = config.PowerControl.Ki;
+    powercontrol["meter_timeout"] = config.PowerControl.MeterTimeout;
+    powercontrol["min_limit"] = config.PowerControl.MinLimit;
+
+    JsonObject influx = doc["influx"].to<JsonObject>();
+    influx["enabled"] = config.Influx.Enabled;
+    influx["url"] = config.Influx.Url;
+    influx["token"] = config.Influx.Token;
+    influx["flush_interval"] = config.Influx.FlushInterval;
+    influx["root_ca_cert"] = CertStore.read(Cert_t::InfluxRootCa);
+
+    JsonObject modbus = doc["modbus"].to<JsonObject>();
+    modbus["enabled"] = config.Modbus.Enabled;
+    modbus["port"] = config.Modbus.Port;
+    modbus["allow_write"] = config.Modbus.AllowWrite;
+
+    JsonObject rawstats = doc["rawstats"].to<JsonObject>();
+    rawstats["mqtt"] = config.RawStats.Mqtt;
+    rawstats["udp"] = config.RawStats.Udp;
+    rawstats["udp_host"] = config.RawStats.UdpHost;
+    rawstats["udp_port"] = config.RawStats.UdpPort;
+    rawstats["skip_fields"] = config.RawStats.SkipFields;
+
+    JsonObject syslog = doc["syslog"].to<JsonObject>();
+    syslog["enabled"] = config.Syslog.Enabled;
+    syslog["host"] = config.Syslog.Host;
+    syslog["port"] = config.Syslog.Port;
+    syslog["format"] = config.Syslog.Format;
+    syslog["level"] = config.Syslog.Level;
+
+    JsonObject prometheus = doc["prometheus"].to<JsonObject>();
+    prometheus["cache_ttl"] = config.Prometheus.CacheTtl;
+
+    JsonArray inverters = doc["inverters"].to<JsonArray>();
+    for (const auto& inv_cfg : config.Inverter) {
+        JsonObject inv = inverters.add<JsonObject>();
+        inv["serial"] = inv_cfg.Serial;
+        inv["name"] = inv_cfg.Name;
+        inv["order"] = inv_cfg.Order;
+        inv["poll_enable"] = inv_cfg.Poll_Enable;
+        inv["poll_enable_night"] = inv_cfg.Poll_Enable_Night;
+        inv["command_enable"] = inv_cfg.Command_Enable;
+        inv["command_enable_night"] = inv_cfg.Command_Enable_Night;
+        inv["reachable_threshold"] = inv_cfg.ReachableThreshold;
+        inv["zero_runtime"] = inv_cfg.ZeroRuntimeDataIfUnrechable;
+        inv["zero_day"] = inv_cfg.ZeroYieldDayOnMidnight;
+        inv["clear_eventlog"] = inv_cfg.ClearEventlogOnMidnight;
+        inv["yieldday_correction"] = inv_cfg.YieldDayCorrection;
+        inv["group"] = inv_cfg.Group;
+
+        JsonObject pollPlan = inv["poll_plan"].to<JsonObject>();
+        pollPlan["stats_interval"] = inv_cfg.PollPlan.StatsInterval;
+        pollPlan["alarm_interval"] = inv_cfg.PollPlan.AlarmInterval;
+        pollPlan["limit_interval"] = inv_cfg.PollPlan.LimitInterval;
+        pollPlan["alarm_on_demand"] = inv_cfg.PollPlan.AlarmOnDemand;
+        pollPlan["gridprofile_on_demand"] = inv_cfg.PollPlan.GridProfileOnDemand;
+
+        JsonArray channel = inv["channel"].to<JsonArray>();
+        for (uint8_t c = 0; c < INV_MAX_CHAN_COUNT; c++) {
+            JsonObject chanData = channel.add<JsonObject>();
+            chanData["name"] = inv_cfg.channel[c].Name;
+            chanData["max_power"] = inv_cfg.channel[c].MaxChannelPower;
+            chanData["yield_total_offset"] = inv_cfg.channel[c].YieldTotalOffset;
+        }
+    }
+}
+
+bool ConfigurationClass::exportJson(Print& output)
+{
+    JsonDocument doc(HeapTelemetry.getJsonAllocator(HeapTag_t::Config));
+    toJson(doc);
+
     if (!Utils::checkJsonAlloc(doc, __FUNCTION__, __LINE__)) {
-        return;
+        return false;
     }
 
+    return serializeJson(doc, output) > 0;
+}
+
+// Steps which need values of older versions that only exist in the JSON format
+void ConfigurationClass::migrateJson(JsonDocument& doc)
+{
     if (config.Cfg.Version < 0x00011700) {
         JsonArray inverters = doc["inverters"];
-        for (uint8_t i = 0; i < INV_MAX_COUNT; i++) {
-            JsonObject inv = inverters[i].as<JsonObject>();
+        for (JsonObject inv : inverters) {
+            INVERTER_CONFIG_T* inv_cfg = getInverterConfig(inv["serial"] | 0ULL);
+            if (inv_cfg == nullptr) {
+                continue;
+            }
             JsonArray channels = inv["channels"];
             for (uint8_t c = 0; c < INV_MAX_CHAN_COUNT; c++) {
-                config.Inverter[i].channel[c].MaxChannelPower = channels[c];
-                strlcpy(config.Inverter[i].channel[c].Name, "", sizeof(config.Inverter[i].channel[c].Name));
+                inv_cfg->channel[c].MaxChannelPower = channels[c];
+                strlcpy(inv_cfg->channel[c].Name, "", sizeof(inv_cfg->channel[c].Name));
             }
         }
     }
@@ -390,6 +1312,25 @@ void ConfigurationClass::migrate()
         config.Dtu.Nrf.PaLevel = dtu["pa_level"];
     }
 
+    if (config.Cfg.Version < 0x00011d00) {
+        JsonObject device = doc["device"];
+        JsonObject display = device["display"];
+        switch (display["language"] | 0U) {
+        case 0U:
+            strlcpy(config.Display.Locale, "en", sizeof(config.Display.Locale));
+            break;
+        case 1U:
+            strlcpy(config.Display.Locale, "de", sizeof(config.Display.Locale));
+            break;
+        case 2U:
+            strlcpy(config.Display.Locale, "fr", sizeof(config.Display.Locale));
+            break;
+        }
+    }
+}
+
+void ConfigurationClass::migrate()
+{
     if (config.Cfg.Version < 0x00011a00) {
         // This migration fixes this issue: https://github.com/espressif/arduino-esp32/issues/8828
         // It occours when migrating from Core 2.0.9 to 2.0.14
@@ -409,27 +1350,8 @@ void ConfigurationClass::migrate()
         }
     }
 
-    if (config.Cfg.Version < 0x00011d00) {
-        JsonObject device = doc["device"];
-        JsonObject display = device["display"];
-        switch (display["language"] | 0U) {
-        case 0U:
-            strlcpy(config.Display.Locale, "en", sizeof(config.Display.Locale));
-            break;
-        case 1U:
-            strlcpy(config.Display.Locale, "de", sizeof(config.Display.Locale));
-            break;
-        case 2U:
-            strlcpy(config.Display.Locale, "fr", sizeof(config.Display.Locale));
-            break;
-        }
-    }
-
-    f.close();
-
     config.Cfg.Version = CONFIG_VERSION;
     write();
-    read();
 }
 
 CONFIG_T const& ConfigurationClass::get()
@@ -437,27 +1359,54 @@ CONFIG_T const& ConfigurationClass::get()
     return config;
 }
 
+uint32_t ConfigurationClass::getChangeCount() const
+{
+    return sChangeCount;
+}
+
 ConfigurationClass::WriteGuard ConfigurationClass::getWriteGuard()
 {
     return WriteGuard();
 }
 
+ConfigurationClass::ReadGuard ConfigurationClass::getReadGuard()
+{
+    return ReadGuard();
+}
+
 INVERTER_CONFIG_T* ConfigurationClass::getFreeInverterSlot()
 {
-    for (uint8_t i = 0; i < INV_MAX_COUNT; i++) {
-        if (config.Inverter[i].Serial == 0) {
-            return &config.Inverter[i];
-        }
+    if (config.Inverter.size() >= INV_MAX_COUNT) {
+        return nullptr;
     }
 
-    return nullptr;
+    INVERTER_CONFIG_T& inverter = config.Inverter.emplace_back();
+    initInverterConfig(inverter);
+    return &inverter;
 }
 
 INVERTER_CONFIG_T* ConfigurationClass::getInverterConfig(const uint64_t serial)
 {
-    for (uint8_t i = 0; i < INV_MAX_COUNT; i++) {
-        if (config.Inverter[i].Serial == serial) {
-            return &config.Inverter[i];
+    if (serial == 0) {
+        return nullptr;
+    }
+
+    const uint8_t start = getInverterIndexSlot(serial);
+    for (uint8_t i = 0; i < INV_INDEX_SIZE; i++) {
+        const uint8_t entry = _inverterIndex[(start + i) & (INV_INDEX_SIZE - 1)];
+        if (entry == 0) {
+            break;
+        }
+        if (entry <= config.Inverter.size() && config.Inverter[entry - 1].Serial == serial) {
+            return &config.Inverter[entry - 1];
+        }
+    }
+
+    // The index is only a shortcut. Fall back to the list in case it was
+    // changed without rebuilding the index.
+    for (auto& inverter : config.Inverter) {
+        if (inverter.Serial == serial) {
+            return &inverter;
         }
     }
 
@@ -466,35 +1415,98 @@ INVERTER_CONFIG_T* ConfigurationClass::getInverterConfig(const uint64_t serial)
 
 void ConfigurationClass::deleteInverterById(const uint8_t id)
 {
-    config.Inverter[id].Serial = 0ULL;
-    strlcpy(config.Inverter[id].Name, "", sizeof(config.Inverter[id].Name));
-    config.Inverter[id].Order = 0;
+    if (id >= config.Inverter.size()) {
+        return;
+    }
+
+    config.Inverter.erase(config.Inverter.begin() + id);
+    rebuildInverterIndex();
+}
+
+uint8_t ConfigurationClass::getInverterIndexSlot(const uint64_t serial)
+{
+    // Multiplicative hashing, serials often only differ in a few digits
+    return static_cast<uint8_t>(((serial * 0x9E3779B97F4A7C15ULL) >> 32) & (INV_INDEX_SIZE - 1));
+}
+
+void ConfigurationClass::rebuildInverterIndex()
+{
+    std::array<uint8_t, INV_INDEX_SIZE> index = {};
+
+    for (uint8_t i = 0; i < config.Inverter.size(); i++) {
+        if (config.Inverter[i].Serial == 0) {
+            continue;
+        }
+
+        uint8_t slot = getInverterIndexSlot(config.Inverter[i].Serial);
+        while (index[slot] != 0) {
+            slot = (slot + 1) & (INV_INDEX_SIZE - 1);
+        }
+        index[slot] = i + 1;
+    }
+
+    _inverterIndex = index;
+}
 
-    config.Inverter[id].Poll_Enable = true;
-    config.Inverter[id].Poll_Enable_Night = true;
-    config.Inverter[id].Command_Enable = true;
-    config.Inverter[id].Command_Enable_Night = true;
-    config.Inverter[id].ReachableThreshold = REACHABLE_THRESHOLD;
-    config.Inverter[id].ZeroRuntimeDataIfUnrechable = false;
-    config.Inverter[id].ZeroYieldDayOnMidnight = false;
-    config.Inverter[id].YieldDayCorrection = false;
+void ConfigurationClass::initInverterConfig(INVERTER_CONFIG_T& inverter)
+{
+    inverter.Serial = 0ULL;
+    strlcpy(inverter.Name, "", sizeof(inverter.Name));
+    inverter.Order = 0;
+
+    inverter.Poll_Enable = true;
+    inverter.Poll_Enable_Night = true;
+    inverter.Command_Enable = true;
+    inverter.Command_Enable_Night = true;
+    inverter.ReachableThreshold = REACHABLE_THRESHOLD;
+    inverter.ZeroRuntimeDataIfUnrechable = false;
+    inverter.ZeroYieldDayOnMidnight = false;
+    inverter.ClearEventlogOnMidnight = false;
+    inverter.YieldDayCorrection = false;
+    inverter.Group = 0;
+
+    inverter.PollPlan.StatsInterval = INVERTER_STATS_INTERVAL;
+    inverter.PollPlan.AlarmInterval = INVERTER_ALARM_INTERVAL;
+    inverter.PollPlan.LimitInterval = INVERTER_LIMIT_INTERVAL;
+    inverter.PollPlan.AlarmOnDemand = false;
+    inverter.PollPlan.GridProfileOnDemand = false;
 
     for (uint8_t c = 0; c < INV_MAX_CHAN_COUNT; c++) {
-        config.Inverter[id].channel[c].MaxChannelPower = 0;
-        config.Inverter[id].channel[c].YieldTotalOffset = 0.0f;
-        strlcpy(config.Inverter[id].channel[c].Name, "", sizeof(config.Inverter[id].channel[c].Name));
+        inverter.channel[c].MaxChannelPower = 0;
+        inverter.channel[c].YieldTotalOffset = 0.0f;
+        strlcpy(inverter.channel[c].Name, "", sizeof(inverter.channel[c].Name));
     }
 }
 
 void ConfigurationClass::loop()
 {
-    std::unique_lock<std::mutex> lock(sWriterMutex);
-    if (sWriterCount == 0) {
+    {
+        std::unique_lock<std::mutex> lock(sWriterMutex);
+        if (sWriterCount > 0) {
+            sWriterCv.notify_all();
+            sWriterCv.wait(lock, [] { return sWriterCount == 0; });
+        }
+    }
+
+    // Write guards only get the config while this task is waiting above,
+    // so the config can't change while it is serialized here.
+    bool writeDue;
+    {
+        std::lock_guard<std::mutex> lock(_writeRequestMutex);
+        const uint32_t now = millis();
+        writeDue = _writePending
+            && (now - _writeLastRequest >= CONFIG_WRITE_DELAY
+                || now - _writeFirstRequest >= CONFIG_WRITE_MAX_DELAY);
+    }
+
+    if (!writeDue) {
         return;
     }
 
-    sWriterCv.notify_all();
-    sWriterCv.wait(lock, [] { return sWriterCount == 0; });
+    // Only the serialization needs the config, the flash write is done by the worker
+    std::vector<uint8_t> image;
+    serialize(image);
+    FsWorker.write(CONFIG_IMAGE_FILENAME, std::move(image), FlashWriter_t::Config, [this](const bool ok) { _writeFailed = !ok; });
 }
 
 CONFIG_T& ConfigurationClass::WriteGuard::getConfig()
@@ -507,14 +1519,27 @@ ConfigurationClass::WriteGuard::WriteGuard()
 {
     sWriterCount++;
     sWriterCv.wait(_lock);
+    _inverterLock = std::unique_lock<ReaderPreferringMutex>(sInverterMutex);
 }
 
 ConfigurationClass::WriteGuard::~WriteGuard()
 {
+    // Inverters could have been added, removed or got a new serial
+    Configuration.rebuildInverterIndex();
+    _inverterLock.unlock();
+    sChangeCount++;
+
     sWriterCount--;
     if (sWriterCount == 0) {
         sWriterCv.notify_all();
     }
+
+    EventBus.publish(Event_t::ConfigChanged);
+}
+
+ConfigurationClass::ReadGuard::ReadGuard()
+    : _lock(sInverterMutex)
+{
 }
 
 ConfigurationClass Configuration;
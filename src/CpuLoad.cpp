@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "CpuLoad.h"
+#include "TaskProfiler.h"
+#include <algorithm>
+#include <esp_freertos_hooks.h>
+#include <esp_timer.h>
+
+CpuLoadClass CpuLoad;
+
+#if !configGENERATE_RUN_TIME_STATS
+struct TickSample_t {
+    volatile TaskHandle_t Task;
+    volatile uint32_t Count;
+};
+
+// Written by the tick interrupt of each core only, so no lock is needed
+static DRAM_ATTR TickSample_t tickSamples[portNUM_PROCESSORS][CPU_LOAD_MAX_TASKS];
+static DRAM_ATTR volatile uint32_t tickCount[portNUM_PROCESSORS];
+
+static void IRAM_ATTR sampleTick()
+{
+    const BaseType_t core = xPortGetCoreID();
+    const TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    tickCount[core]++;
+
+    // Ticks of tasks which do not fit anymore only count for the core
+    TickSample_t* samples = tickSamples[core];
+    for (uint8_t i = 0; i < CPU_LOAD_MAX_TASKS; i++) {
+        if (samples[i].Task == task) {
+            samples[i].Count++;
+            return;
+        }
+        if (samples[i].Task == nullptr) {
+            samples[i].Count = 1;
+            samples[i].Task = task;
+            return;
+        }
+    }
+}
+#endif
+
+CpuLoadClass::CpuLoadClass()
+    : _loopTask(CPU_LOAD_INTERVAL * TASK_MILLISECOND, TASK_FOREVER)
+{
+}
+
+void CpuLoadClass::init(Scheduler& scheduler)
+{
+#if !configGENERATE_RUN_TIME_STATS
+    for (UBaseType_t core = 0; core < portNUM_PROCESSORS; core++) {
+        esp_register_freertos_tick_hook_for_cpu(sampleTick, core);
+    }
+#endif
+
+    scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "CpuLoad.loop", std::bind(&CpuLoadClass::loop, this));
+    _loopTask.enable();
+}
+
+CpuLoadStats_t CpuLoadClass::getStats()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
+
+// Run time in us or number of ticks the task was running
+uint32_t CpuLoadClass::getCounter(const TaskStatus_t& status)
+{
+#if configGENERATE_RUN_TIME_STATS
+    return status.ulRunTimeCounter;
+#else
+    uint32_t count = 0;
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+        for (uint8_t i = 0; i < CPU_LOAD_MAX_TASKS; i++) {
+            if (tickSamples[core][i].Task == status.xHandle) {
+                count += tickSamples[core][i].Count;
+                break;
+            }
+        }
+    }
+    return count;
+#endif
+}
+
+void CpuLoadClass::loop()
+{
+    // Some room for tasks which are created meanwhile
+    _status.resize(uxTaskGetNumberOfTasks() + 4);
+    const UBaseType_t count = uxTaskGetSystemState(_status.data(), _status.size(), nullptr);
+
+    // Time which passed on each core in the unit of the counters
+    std::array<uint32_t, portNUM_PROCESSORS> elapsed;
+#if configGENERATE_RUN_TIME_STATS
+    const uint64_t now = esp_timer_get_time();
+    elapsed.fill(now - _lastTime);
+    _lastTime = now;
+#else
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+        const uint32_t ticks = tickCount[core];
+        elapsed[core] = ticks - _lastTicks[core];
+        _lastTicks[core] = ticks;
+    }
+#endif
+    const bool first = _lastCounters.empty();
+
+    uint32_t elapsedAvg = 0;
+    for (auto e : elapsed) {
+        elapsedAvg += e / portNUM_PROCESSORS;
+    }
+
+    std::vector<Counter_t> counters;
+    counters.reserve(count);
+
+    CpuLoadStats_t stats = {};
+    stats.Exact = configGENERATE_RUN_TIME_STATS;
+    stats.CoreLoad.fill(0);
+    stats.Tasks.reserve(count);
+
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t& status = _status[i];
+        const uint32_t value = getCounter(status);
+        counters.push_back({ status.xHandle, value });
+
+        // New tasks are counted since their start
+        uint32_t last = 0;
+        for (const auto& c : _lastCounters) {
+            if (c.Task == status.xHandle) {
+                last = c.Value;
+                break;
+            }
+        }
+
+        const BaseType_t affinity = xTaskGetAffinity(status.xHandle);
+        const int8_t core = affinity == tskNO_AFFINITY ? -1 : affinity;
+        const uint32_t total = core < 0 ? elapsedAvg : elapsed[core];
+
+        CpuTaskLoad_t task;
+        strlcpy(task.Name, status.pcTaskName, sizeof(task.Name));
+        task.Core = core;
+        task.Priority = status.uxCurrentPriority;
+        task.Load = total > 0 ? 100.0f * (value - last) / total : 0;
+        task.StackHighWater = status.usStackHighWaterMark;
+        stats.Tasks.push_back(task);
+
+        for (uint8_t c = 0; c < portNUM_PROCESSORS; c++) {
+            if (status.xHandle == xTaskGetIdleTaskHandleForCPU(c)) {
+                stats.CoreLoad[c] = std::clamp(100.0f - task.Load, 0.0f, 100.0f);
+            }
+        }
+    }
+    _lastCounters.swap(counters);
+
+    // The first interval has no reference yet
+    if (first) {
+        return;
+    }
+
+    std::sort(stats.Tasks.begin(), stats.Tasks.end(),
+        [](const CpuTaskLoad_t& a, const CpuTaskLoad_t& b) { return a.Load > b.Load; });
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats = std::move(stats);
+}
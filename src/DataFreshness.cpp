@@ -0,0 +1,162 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "DataFreshness.h"
+#include "Configuration.h"
+#include "MessageOutput.h"
+#include "TaskProfiler.h"
+#include <algorithm>
+
+DataFreshnessClass DataFreshness;
+
+DataFreshnessClass::DataFreshnessClass()
+    : _loopTask(DATA_FRESHNESS_CHECK_INTERVAL * TASK_SECOND, TASK_FOREVER)
+{
+}
+
+void DataFreshnessClass::init(Scheduler& scheduler)
+{
+    EventBus.subscribe(Event_t::StatisticsUpdated, std::bind(&DataFreshnessClass::onStatisticsUpdated, this, std::placeholders::_1));
+
+    scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "DataFreshness.loop", std::bind(&DataFreshnessClass::loop, this));
+    _loopTask.enable();
+}
+
+DataFreshnessClass::Inverter_t* DataFreshnessClass::findInverter(const uint64_t serial)
+{
+    auto it = std::find_if(_inverters.begin(), _inverters.end(),
+        [serial](const Inverter_t& entry) { return entry.Serial == serial; });
+    return it != _inverters.end() ? &*it : nullptr;
+}
+
+void DataFreshnessClass::onStatisticsUpdated(const EventData_t& event)
+{
+    auto inv = Hoymiles.getInverterBySerial(event.Serial);
+    if (inv == nullptr) {
+        return;
+    }
+    const uint32_t lastUpdate = inv->Statistics()->getLastUpdate();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    Inverter_t* entry = findInverter(event.Serial);
+    if (entry == nullptr) {
+        _inverters.emplace_back();
+        entry = &_inverters.back();
+        entry->Serial = event.Serial;
+    }
+
+    // The first update after the boot or a pause only sets the reference
+    if (entry->LastUpdate != 0 && lastUpdate != entry->LastUpdate) {
+        entry->Intervals[entry->Next] = lastUpdate - entry->LastUpdate;
+        entry->Next = (entry->Next + 1) % entry->Intervals.size();
+        entry->Count = std::min<size_t>(entry->Count + 1, entry->Intervals.size());
+    }
+    entry->LastUpdate = lastUpdate;
+}
+
+static uint32_t getAge(const uint32_t lastUpdate, const uint32_t now)
+{
+    return lastUpdate > 0 ? now - lastUpdate : DATA_FRESHNESS_NEVER;
+}
+
+void DataFreshnessClass::calculate(const Inverter_t& entry, DataFreshnessStats_t& stats) const
+{
+    stats.Samples = entry.Count;
+    stats.Violated = entry.Violated;
+    stats.Violations = entry.Violations;
+    stats.P50 = 0;
+    stats.P95 = 0;
+    stats.Max = 0;
+    if (entry.Count == 0) {
+        return;
+    }
+
+    std::array<uint32_t, DATA_FRESHNESS_WINDOW> sorted;
+    std::copy_n(entry.Intervals.begin(), entry.Count, sorted.begin());
+    auto end = sorted.begin() + entry.Count;
+
+    // Nearest rank, the window is small enough to not interpolate
+    auto p50 = sorted.begin() + (entry.Count - 1) / 2;
+    std::nth_element(sorted.begin(), p50, end);
+    stats.P50 = *p50;
+    auto p95 = sorted.begin() + (entry.Count * 95 + 99) / 100 - 1;
+    std::nth_element(sorted.begin(), p95, end);
+    stats.P95 = *p95;
+    stats.Max = *std::max_element(sorted.begin(), end);
+}
+
+void DataFreshnessClass::getStats(InverterAbstract& inv, DataFreshnessStats_t& stats)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const Inverter_t* entry = findInverter(inv.serial());
+        if (entry != nullptr) {
+            calculate(*entry, stats);
+        } else {
+            calculate(Inverter_t(), stats);
+        }
+    }
+
+    const uint32_t now = millis();
+    stats.StatsAge = inv.Statistics()->getLastUpdate() > 0 ? inv.Statistics()->getDataAge() : DATA_FRESHNESS_NEVER;
+    stats.DevInfoAge = getAge(std::max(inv.DevInfo()->getLastUpdateAll(), inv.DevInfo()->getLastUpdateSimple()), now);
+    stats.LimitAge = getAge(inv.SystemConfigPara()->getLastUpdateRequest(), now);
+    stats.AlarmAge = getAge(inv.EventLog()->getLastUpdate(), now);
+}
+
+uint8_t DataFreshnessClass::getViolatedCount()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return std::count_if(_inverters.begin(), _inverters.end(),
+        [](const Inverter_t& entry) { return entry.Violated; });
+}
+
+void DataFreshnessClass::loop()
+{
+    auto const& dtu = Configuration.get().Dtu;
+    const uint32_t intervalSlo = dtu.FreshnessSloInterval * 1000U;
+    const uint32_t ageSlo = dtu.FreshnessSloAge * 1000U;
+
+    // Drop the inverters which were removed
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _inverters.erase(std::remove_if(_inverters.begin(), _inverters.end(),
+                             [](const Inverter_t& entry) { return Hoymiles.getInverterBySerial(entry.Serial) == nullptr; }),
+            _inverters.end());
+    }
+
+    Hoymiles.forEachInverter([&](InverterAbstract& inv, const uint8_t) {
+        DataFreshnessStats_t stats;
+        getStats(inv, stats);
+
+        bool violated = false;
+        if (inv.getEnablePolling()) {
+            // Devinfo does not change, it is only requested once and not part of the SLO
+            violated = (intervalSlo > 0 && (stats.P95 > intervalSlo || (stats.StatsAge != DATA_FRESHNESS_NEVER && stats.StatsAge > intervalSlo)))
+                || (ageSlo > 0 && stats.LimitAge != DATA_FRESHNESS_NEVER && stats.LimitAge > ageSlo)
+                || (ageSlo > 0 && stats.AlarmAge != DATA_FRESHNESS_NEVER && stats.AlarmAge > ageSlo);
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        Inverter_t* entry = findInverter(inv.serial());
+        if (entry == nullptr) {
+            return;
+        }
+
+        if (!inv.getEnablePolling()) {
+            // The pause must not end up as an interval
+            entry->LastUpdate = 0;
+        }
+
+        if (violated) {
+            if (!entry->Violated) {
+                MessageOutput.printf("Data freshness: %s misses its SLO (p95 %" PRIu32 " ms, limit age %" PRIu32 " ms, alarm age %" PRIu32 " ms)\r\n",
+                    inv.serialString(), stats.P95, stats.LimitAge, stats.AlarmAge);
+            }
+            entry->Violations++;
+        }
+        entry->Violated = violated;
+    });
+}
@@ -1,121 +1,272 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 /*
- * Copyright (C) 2023-2024 Thomas Basler and others
+ * Copyright (C) 2023-2025 Thomas Basler and others
  */
 #include "Datastore.h"
 #include "Configuration.h"
+#include "EventBus.h"
+#include "TaskProfiler.h"
 #include <Hoymiles.h>
 
 DatastoreClass Datastore;
 
 DatastoreClass::DatastoreClass()
-    : _loopTask(1 * TASK_SECOND, TASK_FOREVER, std::bind(&DatastoreClass::loop, this))
+    : _loopTask(DATASTORE_REFRESH_INTERVAL * TASK_MILLISECOND, TASK_FOREVER)
 {
 }
 
 void DatastoreClass::init(Scheduler& scheduler)
 {
     scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "Datastore.loop", std::bind(&DatastoreClass::loop, this));
     _loopTask.enable();
+
+    EventBus.subscribe(Event_t::StatisticsUpdated, _loopTask);
+    EventBus.subscribe(Event_t::LimitChanged, _loopTask);
+    EventBus.subscribe(Event_t::ConfigChanged, _loopTask);
 }
 
 void DatastoreClass::loop()
 {
-    if (!Hoymiles.isAllRadioIdle()) {
-        _loopTask.forceNextIteration();
-        return;
-    }
-
-    uint8_t isProducing = 0;
-    uint8_t isReachable = 0;
-    uint8_t pollEnabledCount = 0;
-
     std::lock_guard<std::mutex> lock(_mutex);
 
-    _totalAcYieldTotalEnabled = 0;
-    _totalAcYieldTotalDigits = 0;
-
-    _totalAcYieldDayEnabled = 0;
-    _totalAcYieldDayDigits = 0;
+    uint8_t count = 0;
+    bool changed = false;
 
-    _totalAcPowerEnabled = 0;
-    _totalAcPowerDigits = 0;
-
-    _totalDcPowerEnabled = 0;
-    _totalDcPowerDigits = 0;
-
-    _totalDcPowerIrradiation = 0;
-    _totalDcIrradiationInstalled = 0;
-
-    _isAllEnabledProducing = true;
-    _isAllEnabledReachable = true;
-
-    for (uint8_t i = 0; i < Hoymiles.getNumInverters(); i++) {
-        auto inv = Hoymiles.getInverterByPos(i);
-        if (inv == nullptr) {
-            continue;
+    Hoymiles.forEachInverter([&](InverterAbstract& inv, const uint8_t i) {
+        if (i >= INV_MAX_COUNT) {
+            return;
         }
+        count = i + 1;
 
-        auto cfg = Configuration.getInverterConfig(inv->serial());
+        auto cfg = Configuration.getInverterConfig(inv.serial());
         if (cfg == nullptr) {
-            continue;
+            clearRow(i);
+            return;
         }
 
-        if (inv->getEnablePolling()) {
-            pollEnabledCount++;
-        }
+        const bool pollEnabled = inv.getEnablePolling();
+        const uint8_t group = cfg->Group <= INV_MAX_GROUP_COUNT ? cfg->Group : 0;
 
-        if (inv->isProducing()) {
-            isProducing++;
-        } else {
-            if (inv->getEnablePolling()) {
-                _isAllEnabledProducing = false;
-            }
-        }
+        if (!FleetTable_t::test(_table.Valid, i)
+            || _table.Serial[i] != inv.serial()
+            || _generation[i] != inv.Statistics()->getGeneration()
+            || FleetTable_t::test(_table.PollEnabled, i) != pollEnabled
+            || FleetTable_t::test(_table.CfgPollEnabled, i) != cfg->Poll_Enable
+            || _table.Group[i] != group) {
 
-        if (inv->isReachable()) {
-            isReachable++;
-        } else {
-            if (inv->getEnablePolling()) {
-                _isAllEnabledReachable = false;
+            if (readInverter(inv, cfg->Poll_Enable, group, i)) {
+                integrateEnergy(_energy[i], i);
+                changed = true;
             }
+            // Otherwise the inverter was updated while reading, the previous values are kept until the next run
         }
 
-        for (auto& c : inv->Statistics()->getChannelsByType(TYPE_INV)) {
-            if (cfg->Poll_Enable) {
-                _totalAcYieldTotalEnabled += inv->Statistics()->getChannelFieldValue(TYPE_INV, c, FLD_YT);
-                _totalAcYieldDayEnabled += inv->Statistics()->getChannelFieldValue(TYPE_INV, c, FLD_YD);
+        FleetTable_t::set(_table.Reachable, i, inv.isReachable());
+    });
 
-                _totalAcYieldTotalDigits = max<unsigned int>(_totalAcYieldTotalDigits, inv->Statistics()->getChannelFieldDigits(TYPE_INV, c, FLD_YT));
-                _totalAcYieldDayDigits = max<unsigned int>(_totalAcYieldDayDigits, inv->Statistics()->getChannelFieldDigits(TYPE_INV, c, FLD_YD));
-            }
+    // Inverters which were removed do not contribute anymore
+    for (uint8_t i = count; i < _table.Count; i++) {
+        clearRow(i);
+    }
+    _table.Count = count;
+
+    updateTotals();
+
+    if (changed) {
+        EventBus.publish(Event_t::TotalsUpdated);
+    }
+}
+
+bool DatastoreClass::readInverter(InverterAbstract& inv, const bool cfgPollEnabled, const uint8_t group, const uint8_t i)
+{
+    auto stats = inv.Statistics();
+
+    // An odd generation means the parser is just decoding new data
+    const uint32_t generation = stats->getGeneration();
+    if (generation & 1) {
+        return false;
+    }
+
+    const bool pollEnabled = inv.getEnablePolling();
+    float acYieldTotal = 0;
+    float acYieldDay = 0;
+    float acPower = 0;
+    float dcPower = 0;
+    float dcPowerIrradiation = 0;
+    float dcIrradiationInstalled = 0;
+    uint8_t acYieldTotalDigits = 0;
+    uint8_t acYieldDayDigits = 0;
+    uint8_t acPowerDigits = 0;
+    uint8_t dcPowerDigits = 0;
+
+    if (cfgPollEnabled) {
+        for (auto& c : stats->getChannelsByType(TYPE_INV)) {
+            acYieldTotal += stats->getChannelFieldValue(TYPE_INV, c, FLD_YT);
+            acYieldDay += stats->getChannelFieldValue(TYPE_INV, c, FLD_YD);
+
+            acYieldTotalDigits = max<uint8_t>(acYieldTotalDigits, stats->getChannelFieldDigits(TYPE_INV, c, FLD_YT));
+            acYieldDayDigits = max<uint8_t>(acYieldDayDigits, stats->getChannelFieldDigits(TYPE_INV, c, FLD_YD));
         }
+    }
 
-        for (auto& c : inv->Statistics()->getChannelsByType(TYPE_AC)) {
-            if (inv->getEnablePolling()) {
-                _totalAcPowerEnabled += inv->Statistics()->getChannelFieldValue(TYPE_AC, c, FLD_PAC);
-                _totalAcPowerDigits = max<unsigned int>(_totalAcPowerDigits, inv->Statistics()->getChannelFieldDigits(TYPE_AC, c, FLD_PAC));
-            }
+    if (pollEnabled) {
+        for (auto& c : stats->getChannelsByType(TYPE_AC)) {
+            acPower += stats->getChannelFieldValue(TYPE_AC, c, FLD_PAC);
+            acPowerDigits = max<uint8_t>(acPowerDigits, stats->getChannelFieldDigits(TYPE_AC, c, FLD_PAC));
         }
 
-        for (auto& c : inv->Statistics()->getChannelsByType(TYPE_DC)) {
-            if (inv->getEnablePolling()) {
-                _totalDcPowerEnabled += inv->Statistics()->getChannelFieldValue(TYPE_DC, c, FLD_PDC);
-                _totalDcPowerDigits = max<unsigned int>(_totalDcPowerDigits, inv->Statistics()->getChannelFieldDigits(TYPE_DC, c, FLD_PDC));
+        for (auto& c : stats->getChannelsByType(TYPE_DC)) {
+            const float power = stats->getChannelFieldValue(TYPE_DC, c, FLD_PDC);
+            dcPower += power;
+            dcPowerDigits = max<uint8_t>(dcPowerDigits, stats->getChannelFieldDigits(TYPE_DC, c, FLD_PDC));
 
-                if (inv->Statistics()->getStringMaxPower(c) > 0) {
-                    _totalDcPowerIrradiation += inv->Statistics()->getChannelFieldValue(TYPE_DC, c, FLD_PDC);
-                    _totalDcIrradiationInstalled += inv->Statistics()->getStringMaxPower(c);
-                }
+            const uint16_t maxPower = stats->getStringMaxPower(c);
+            if (maxPower > 0) {
+                dcPowerIrradiation += power;
+                dcIrradiationInstalled += maxPower;
             }
         }
     }
 
-    _isAtLeastOneProducing = isProducing > 0;
-    _isAtLeastOneReachable = isReachable > 0;
-    _isAtLeastOnePollEnabled = pollEnabledCount > 0;
+    const uint32_t lastUpdate = stats->getLastUpdate();
+    const bool restored = stats->isRestored();
+    if (stats->getGeneration() != generation) {
+        return false;
+    }
 
+    _generation[i] = generation;
+    _table.Serial[i] = inv.serial();
+    _table.LastUpdate[i] = lastUpdate;
+    _table.Group[i] = group;
+    _table.AcYieldTotal[i] = acYieldTotal;
+    _table.AcYieldDay[i] = acYieldDay;
+    _table.AcPower[i] = acPower;
+    _table.DcPower[i] = dcPower;
+    _table.DcPowerIrradiation[i] = dcPowerIrradiation;
+    _table.DcIrradiationInstalled[i] = dcIrradiationInstalled;
+    _table.AcYieldTotalDigits[i] = acYieldTotalDigits;
+    _table.AcYieldDayDigits[i] = acYieldDayDigits;
+    _table.AcPowerDigits[i] = acPowerDigits;
+    _table.DcPowerDigits[i] = dcPowerDigits;
+    FleetTable_t::set(_table.Valid, i, true);
+    FleetTable_t::set(_table.Restored, i, restored);
+    FleetTable_t::set(_table.PollEnabled, i, pollEnabled);
+    FleetTable_t::set(_table.CfgPollEnabled, i, cfgPollEnabled);
+    return true;
+}
+
+void DatastoreClass::clearRow(const uint8_t i)
+{
+    _generation[i] = 0;
+    _table.Serial[i] = 0;
+    _table.LastUpdate[i] = 0;
+    _table.Group[i] = 0;
+    _table.AcYieldTotal[i] = 0;
+    _table.AcYieldDay[i] = 0;
+    _table.AcPower[i] = 0;
+    _table.DcPower[i] = 0;
+    _table.DcPowerIrradiation[i] = 0;
+    _table.DcIrradiationInstalled[i] = 0;
+    _table.AcYieldTotalDigits[i] = 0;
+    _table.AcYieldDayDigits[i] = 0;
+    _table.AcPowerDigits[i] = 0;
+    _table.DcPowerDigits[i] = 0;
+    FleetTable_t::set(_table.Valid, i, false);
+    FleetTable_t::set(_table.Restored, i, false);
+    FleetTable_t::set(_table.PollEnabled, i, false);
+    FleetTable_t::set(_table.CfgPollEnabled, i, false);
+    FleetTable_t::set(_table.Reachable, i, false);
+}
+
+void DatastoreClass::updateTotals()
+{
+    // Rows which are not valid hold zeros, the sums do not need to mask them
+    const FleetTable_t::Mask_t all = ~static_cast<FleetTable_t::Mask_t>(0);
+    const FleetTable_t::Mask_t valid = _table.Valid;
+    const FleetTable_t::Mask_t pollEnabled = valid & _table.PollEnabled;
+    const FleetTable_t::Mask_t reachable = valid & _table.Reachable;
+    const FleetTable_t::Mask_t producing = pollEnabled & _table.positiveMask(_table.AcPower);
+    // Responses of this run, restored values have no reliable time
+    const FleetTable_t::Mask_t responses = reachable & _table.PollEnabled & ~_table.Restored & _table.positiveMask(_table.LastUpdate);
+
+    _totalAcYieldTotalEnabled = _table.sum(_table.AcYieldTotal, all);
+    _totalAcYieldDayEnabled = _table.sum(_table.AcYieldDay, all);
+    _totalAcPowerEnabled = _table.sum(_table.AcPower, all);
+    _totalDcPowerEnabled = _table.sum(_table.DcPower, all);
+    _totalDcPowerIrradiation = _table.sum(_table.DcPowerIrradiation, all);
+    _totalDcIrradiationInstalled = _table.sum(_table.DcIrradiationInstalled, all);
     _totalDcIrradiation = _totalDcIrradiationInstalled > 0 ? _totalDcPowerIrradiation / _totalDcIrradiationInstalled * 100.0f : 0;
+
+    _totalAcYieldTotalDigits = _table.max(_table.AcYieldTotalDigits, all);
+    _totalAcYieldDayDigits = _table.max(_table.AcYieldDayDigits, all);
+    _totalAcPowerDigits = _table.max(_table.AcPowerDigits, all);
+    _totalDcPowerDigits = _table.max(_table.DcPowerDigits, all);
+
+    _isAtLeastOneProducing = producing != 0;
+    _isAtLeastOneReachable = reachable != 0;
+    _isAtLeastOnePollEnabled = pollEnabled != 0;
+    _isAllEnabledProducing = (pollEnabled & ~producing) == 0;
+    _isAllEnabledReachable = (pollEnabled & ~reachable) == 0;
+    _totalSkew = _table.span(responses);
+
+    for (uint8_t g = 0; g < _groups.size(); g++) {
+        GroupTotals_t& group = _groups[g];
+        const FleetTable_t::Mask_t members = valid & _table.groupMask(g + 1);
+
+        group.MemberCount = FleetTable_t::count(members);
+        group.AcYieldTotal = _table.sum(_table.AcYieldTotal, members);
+        group.AcYieldDay = _table.sum(_table.AcYieldDay, members);
+        group.AcPower = _table.sum(_table.AcPower, members);
+        group.DcPower = _table.sum(_table.DcPower, members);
+        group.AcYieldTotalDigits = _table.max(_table.AcYieldTotalDigits, members);
+        group.AcYieldDayDigits = _table.max(_table.AcYieldDayDigits, members);
+        group.AcPowerDigits = _table.max(_table.AcPowerDigits, members);
+        group.DcPowerDigits = _table.max(_table.DcPowerDigits, members);
+        group.IsAllEnabledReachable = (members & pollEnabled & ~reachable) == 0;
+        group.Skew = _table.span(members & responses);
+    }
+}
+
+void DatastoreClass::integrateEnergy(InverterEnergy_t& energy, const uint8_t i)
+{
+    const uint64_t serial = _table.Serial[i];
+    const uint32_t lastUpdate = _table.LastUpdate[i];
+    const float acPower = _table.AcPower[i];
+    const float dcPower = _table.DcPower[i];
+    const uint8_t group = _table.Group[i];
+
+    if (energy.Serial != serial) {
+        energy = {};
+        energy.Serial = serial;
+    }
+
+    // Only new responses are samples, restored data has no reliable time
+    if (FleetTable_t::test(_table.Restored, i) || lastUpdate == 0 || lastUpdate == energy.LastUpdate) {
+        return;
+    }
+
+    const uint32_t dt = lastUpdate - energy.LastUpdate;
+    if (energy.LastUpdate != 0 && dt <= DATASTORE_ENERGY_MAX_GAP) {
+        const double hours = dt / 3600000.0;
+        const double ac = (energy.AcPower + acPower) / 2.0 * hours;
+        const double dc = (energy.DcPower + dcPower) / 2.0 * hours;
+
+        energy.AcEnergy += ac;
+        energy.DcEnergy += dc;
+        _totalAcEnergy += ac;
+        _totalDcEnergy += dc;
+
+        // Only added, a group counter keeps the energy of inverters which left the group
+        if (group > 0) {
+            _groups[group - 1].AcEnergy += ac;
+            _groups[group - 1].DcEnergy += dc;
+        }
+    }
+
+    energy.LastUpdate = lastUpdate;
+    energy.AcPower = acPower;
+    energy.DcPower = dcPower;
 }
 
 float DatastoreClass::getTotalAcYieldTotalEnabled()
@@ -160,6 +311,31 @@ float DatastoreClass::getTotalDcIrradiation()
     return _totalDcIrradiation;
 }
 
+double DatastoreClass::getTotalAcEnergy()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _totalAcEnergy;
+}
+
+double DatastoreClass::getTotalDcEnergy()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _totalDcEnergy;
+}
+
+bool DatastoreClass::getInverterEnergy(const uint64_t serial, double& acEnergy, double& dcEnergy)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& energy : _energy) {
+        if (energy.Serial == serial && energy.LastUpdate != 0) {
+            acEnergy = energy.AcEnergy;
+            dcEnergy = energy.DcEnergy;
+            return true;
+        }
+    }
+    return false;
+}
+
 uint32_t DatastoreClass::getTotalAcYieldTotalDigits()
 {
     std::lock_guard<std::mutex> lock(_mutex);
@@ -208,8 +384,94 @@ bool DatastoreClass::getIsAllEnabledReachable()
     return _isAllEnabledReachable;
 }
 
+uint32_t DatastoreClass::getTotalSkew()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _totalSkew;
+}
+
 bool DatastoreClass::getIsAtLeastOnePollEnabled()
 {
     std::lock_guard<std::mutex> lock(_mutex);
     return _isAtLeastOnePollEnabled;
 }
+
+void DatastoreClass::getFleetTable(FleetTable_t& table)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    table = _table;
+}
+
+bool DatastoreClass::getGroupTotals(const uint8_t group, DatastoreGroupTotals_t& totals)
+{
+    if (group == 0 || group > INV_MAX_GROUP_COUNT) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    const GroupTotals_t& g = _groups[group - 1];
+    totals.MemberCount = g.MemberCount;
+    totals.AcYieldTotal = g.AcYieldTotal;
+    totals.AcYieldDay = g.AcYieldDay;
+    totals.AcPower = g.AcPower;
+    totals.DcPower = g.DcPower;
+    totals.AcEnergy = g.AcEnergy;
+    totals.DcEnergy = g.DcEnergy;
+    totals.AcYieldTotalDigits = g.AcYieldTotalDigits;
+    totals.AcYieldDayDigits = g.AcYieldDayDigits;
+    totals.AcPowerDigits = g.AcPowerDigits;
+    totals.DcPowerDigits = g.DcPowerDigits;
+    totals.IsAllEnabledReachable = g.IsAllEnabledReachable;
+    totals.Skew = g.Skew;
+    return true;
+}
+
+uint8_t DatastoreClass::sendGroupLimit(const uint8_t group, const float limit, const PowerLimitControlType type)
+{
+    if (group == 0 || group > INV_MAX_GROUP_COUNT) {
+        return 0;
+    }
+
+    // Only the serials are kept, the inverter list can change once it is unlocked
+    struct Member_t {
+        uint64_t Serial;
+        float MaxPower;
+    };
+    std::array<Member_t, INV_MAX_COUNT> members;
+    uint8_t count = 0;
+    float totalMaxPower = 0;
+
+    {
+        // Called by the MQTT and web handlers, the configs are locked before the inverter list
+        auto configGuard = Configuration.getReadGuard();
+        Hoymiles.forEachInverter([&](InverterAbstract& inv, const uint8_t) {
+            auto cfg = Configuration.getInverterConfig(inv.serial());
+            if (cfg == nullptr || cfg->Group != group || !inv.getEnableCommands() || count >= members.size()) {
+                return;
+            }
+            const float maxPower = inv.DevInfo()->getMaxPower();
+            members[count++] = { inv.serial(), maxPower };
+            totalMaxPower += maxPower;
+        });
+    }
+
+    const bool absolute = type == PowerLimitControlType::AbsolutNonPersistent
+        || type == PowerLimitControlType::AbsolutPersistent;
+
+    uint8_t sent = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        float share = limit;
+        if (absolute) {
+            // Without a known max power of every member the limit is split evenly
+            const float maxPower = members[i].MaxPower;
+            share = totalMaxPower > 0 && maxPower > 0 ? limit * maxPower / totalMaxPower : limit / count;
+        }
+
+        // Removed meanwhile by a change of the inverter list
+        auto inv = Hoymiles.getInverterBySerial(members[i].Serial);
+        if (inv != nullptr && inv->sendActivePowerControlRequest(share, type)) {
+            sent++;
+        }
+    }
+    return sent;
+}
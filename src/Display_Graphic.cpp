@@ -7,6 +7,8 @@
 #include "Datastore.h"
 #include "I18n.h"
 #include "PinMapping.h"
+#include "ResourceGovernor.h"
+#include "TaskProfiler.h"
 #include <NetworkSettings.h>
 #include <map>
 #include <time.h>
@@ -38,7 +40,7 @@ static const char* const i18n_yield_total_mwh[] = { "total: %.0f kWh", "Ges.: %.
 static const char* const i18n_date_format[] = { "%m/%d/%Y %H:%M", "%d.%m.%Y %H:%M", "%d/%m/%Y %H:%M" };
 
 DisplayGraphicClass::DisplayGraphicClass()
-    : _loopTask(TASK_IMMEDIATE, TASK_FOREVER, std::bind(&DisplayGraphicClass::loop, this))
+    : _loopTask(TASK_IMMEDIATE, TASK_FOREVER)
 {
 }
 
@@ -71,6 +73,7 @@ void DisplayGraphicClass::init(Scheduler& scheduler)
     _diagram.init(scheduler, _display);
 
     scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "DisplayGraphic.loop", std::bind(&DisplayGraphicClass::loop, this));
     _loopTask.setInterval(_period);
     _loopTask.enable();
 
@@ -225,6 +228,41 @@ void DisplayGraphicClass::setStartupDisplay()
     _display->clearBuffer();
     printText("OpenDTU!", 0);
     _display->sendBuffer();
+
+    const size_t size = _display->getBufferTileWidth() * _display->getBufferTileHeight() * 8;
+    const uint8_t* buffer = _display->getBufferPtr();
+    _sentBuffer.assign(buffer, buffer + size);
+}
+
+void DisplayGraphicClass::sendChangedTiles()
+{
+    // The buffer is organized in rows of 8x8 pixel tiles with 8 bytes each, in the
+    // orientation of the controller. Only the changed range of each row is sent.
+    const uint8_t tileWidth = _display->getBufferTileWidth();
+    const uint8_t tileHeight = _display->getBufferTileHeight();
+    const uint8_t* buffer = _display->getBufferPtr();
+
+    for (uint8_t ty = 0; ty < tileHeight; ty++) {
+        const size_t rowOffset = ty * tileWidth * 8;
+        int16_t first = -1;
+        int16_t last = -1;
+        for (uint8_t tx = 0; tx < tileWidth; tx++) {
+            const size_t offset = rowOffset + tx * 8;
+            if (memcmp(&buffer[offset], &_sentBuffer[offset], 8) != 0) {
+                if (first < 0) {
+                    first = tx;
+                }
+                last = tx;
+            }
+        }
+
+        if (first < 0) {
+            continue;
+        }
+
+        _display->updateDisplayArea(first, ty, last - first + 1, 1);
+        memcpy(&_sentBuffer[rowOffset + first * 8], &buffer[rowOffset + first * 8], (last - first + 1) * 8);
+    }
 }
 
 DisplayGraphicDiagramClass& DisplayGraphicClass::Diagram()
@@ -234,7 +272,7 @@ DisplayGraphicDiagramClass& DisplayGraphicClass::Diagram()
 
 void DisplayGraphicClass::loop()
 {
-    _loopTask.setInterval(_period);
+    _loopTask.setInterval(ResourceGovernor.isShedding(ShedStep_t::Display) ? _period * RESOURCE_GOVERNOR_DISPLAY_FACTOR : _period);
 
     _display->clearBuffer();
     bool displayPowerSave = false;
@@ -311,7 +349,7 @@ void DisplayGraphicClass::loop()
         }
     }
 
-    _display->sendBuffer();
+    sendChangedTiles();
 
     _mExtra++;
 
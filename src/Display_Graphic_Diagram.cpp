@@ -5,11 +5,12 @@
 #include "Display_Graphic_Diagram.h"
 #include "Configuration.h"
 #include "Datastore.h"
+#include "TaskProfiler.h"
 #include <algorithm>
 
 DisplayGraphicDiagramClass::DisplayGraphicDiagramClass()
-    : _averageTask(1 * TASK_SECOND, TASK_FOREVER, std::bind(&DisplayGraphicDiagramClass::averageLoop, this))
-    , _dataPointTask(TASK_IMMEDIATE, TASK_FOREVER, std::bind(&DisplayGraphicDiagramClass::dataPointLoop, this))
+    : _averageTask(1 * TASK_SECOND, TASK_FOREVER)
+    , _dataPointTask(TASK_IMMEDIATE, TASK_FOREVER)
 {
 }
 
@@ -18,9 +19,11 @@ void DisplayGraphicDiagramClass::init(Scheduler& scheduler, U8G2* display)
     _display = display;
 
     scheduler.addTask(_averageTask);
+    TaskProfiler.setCallback(_averageTask, "DisplayGraphicDiagram.averageLoop", std::bind(&DisplayGraphicDiagramClass::averageLoop, this));
     _averageTask.enable();
 
     scheduler.addTask(_dataPointTask);
+    TaskProfiler.setCallback(_dataPointTask, "DisplayGraphicDiagram.dataPointLoop", std::bind(&DisplayGraphicDiagramClass::dataPointLoop, this));
     updatePeriod();
     _dataPointTask.enable();
 }
@@ -34,19 +37,71 @@ void DisplayGraphicDiagramClass::averageLoop()
 
 void DisplayGraphicDiagramClass::dataPointLoop()
 {
-    if (_graphValuesCount >= std::size(_graphValues)) {
-        for (uint8_t i = 0; i < std::size(_graphValues) - 1; i++) {
-            _graphValues[i] = _graphValues[i + 1];
-        }
-        _graphValuesCount = std::size(_graphValues) - 1;
-    }
     if (_iRunningAverageCnt != 0) {
-        _graphValues[_graphValuesCount++] = _iRunningAverage / _iRunningAverageCnt;
+        addGraphValue(_iRunningAverage / _iRunningAverageCnt);
         _iRunningAverage = 0;
         _iRunningAverageCnt = 0;
     }
 }
 
+float DisplayGraphicDiagramClass::getGraphValue(const uint8_t index) const
+{
+    return _graphValues[(_graphValuesStart + index) % MAX_DATAPOINTS];
+}
+
+void DisplayGraphicDiagramClass::addGraphValue(const float value)
+{
+    if (_graphValuesCount == MAX_DATAPOINTS) {
+        // Drop the oldest value
+        if (_graphMaxQueueCount > 0 && _graphMaxQueue[_graphMaxQueueStart] == _graphValuesStart) {
+            _graphMaxQueueStart = (_graphMaxQueueStart + 1) % MAX_DATAPOINTS;
+            _graphMaxQueueCount--;
+        }
+
+        _graphValuesStart = (_graphValuesStart + 1) % MAX_DATAPOINTS;
+        _graphValuesCount--;
+    }
+
+    // Values smaller than the new one can never become the maximum again
+    while (_graphMaxQueueCount > 0
+        && _graphValues[_graphMaxQueue[(_graphMaxQueueStart + _graphMaxQueueCount - 1) % MAX_DATAPOINTS]] <= value) {
+        _graphMaxQueueCount--;
+    }
+
+    const uint8_t slot = (_graphValuesStart + _graphValuesCount) % MAX_DATAPOINTS;
+    _graphValues[slot] = value;
+    _graphValuesCount++;
+
+    _graphMaxQueue[(_graphMaxQueueStart + _graphMaxQueueCount) % MAX_DATAPOINTS] = slot;
+    _graphMaxQueueCount++;
+
+    _graphScaledValid = false;
+}
+
+float DisplayGraphicDiagramClass::getGraphMax() const
+{
+    if (_graphMaxQueueCount == 0) {
+        return 0;
+    }
+    return std::max(0.0f, _graphValues[_graphMaxQueue[_graphMaxQueueStart]]);
+}
+
+void DisplayGraphicDiagramClass::updateScaledValues(const uint8_t height, const float maxWatts)
+{
+    if (_graphScaledValid && _graphScaledHeight == height && _graphScaledMax == maxWatts) {
+        return;
+    }
+
+    const float scaleFactorY = maxWatts / static_cast<float>(height);
+    for (uint8_t i = 0; i < _graphValuesCount; i++) {
+        _graphScaled[i] = scaleFactorY == 0 ? 0 : std::max<int16_t>(0, getGraphValue(i) / scaleFactorY - 0.5);
+    }
+
+    _graphScaledValid = true;
+    _graphScaledHeight = height;
+    _graphScaledMax = maxWatts;
+}
+
 uint32_t DisplayGraphicDiagramClass::getSecondsPerDot()
 {
     return Configuration.get().Display.Diagram.Duration / _chartWidth;
@@ -83,7 +138,7 @@ void DisplayGraphicDiagramClass::redraw(uint8_t screenSaverOffsetX, uint8_t xPos
 
     // draw AC value
     char fmtText[7];
-    const float maxWatts = *std::max_element(_graphValues.begin(), _graphValues.end());
+    const float maxWatts = getGraphMax();
     if (maxWatts > 999) {
         snprintf(fmtText, sizeof(fmtText), "%2.1fkW", maxWatts / 1000);
     } else {
@@ -117,10 +172,13 @@ void DisplayGraphicDiagramClass::redraw(uint8_t screenSaverOffsetX, uint8_t xPos
         }
     }
 
+    updateScaledValues(height, maxWatts);
+
+    const uint32_t secondsPerDot = getSecondsPerDot();
     uint8_t xAxisTicks = 1;
     for (uint8_t i = 1; i < _graphValuesCount; i++) {
         // draw one tick per hour to the x-axis
-        if (i * getSecondsPerDot() > (3600u * xAxisTicks)) {
+        if (i * secondsPerDot > (3600u * xAxisTicks)) {
             _display->drawPixel((graphPosX + 1 + i) * scaleFactorX, graphPosY + height);
             xAxisTicks++;
         }
@@ -130,7 +188,7 @@ void DisplayGraphicDiagramClass::redraw(uint8_t screenSaverOffsetX, uint8_t xPos
         }
 
         _display->drawLine(
-            graphPosX + (i - 1) / scaleFactorX, horizontal_line_y - std::max<int16_t>(0, _graphValues[i - 1] / scaleFactorY - 0.5),
-            graphPosX + i / scaleFactorX, horizontal_line_y - std::max<int16_t>(0, _graphValues[i] / scaleFactorY - 0.5));
+            graphPosX + (i - 1) / scaleFactorX, horizontal_line_y - _graphScaled[i - 1],
+            graphPosX + i / scaleFactorX, horizontal_line_y - _graphScaled[i]);
     }
 }
@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "DnsResolver.h"
+#include "MessageOutput.h"
+#include <Arduino.h>
+#include <algorithm>
+#include <cstring>
+#include <lwip/dns.h>
+#include <lwip/tcpip.h>
+
+DnsResolverClass DnsResolver;
+
+bool DnsResolverClass::resolve(const char* host, IPAddress& ip)
+{
+    if (host == nullptr || host[0] == '\0') {
+        return false;
+    }
+    if (ip.fromString(host)) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    Entry_t& entry = getEntry(host);
+    entry.LastUse = millis();
+
+    if (!entry.Pending && (!entry.Valid || millis() - entry.LastLookup >= DNS_RESOLVER_REFRESH_INTERVAL * 1000)) {
+        startLookup(entry);
+    }
+
+    if (!entry.Valid) {
+        return false;
+    }
+    ip = entry.Ip;
+    return true;
+}
+
+// Must be called with the mutex held. Replaces the least recently used entry if the
+// host is not known.
+DnsResolverClass::Entry_t& DnsResolverClass::getEntry(const char* host)
+{
+    for (auto& entry : _entries) {
+        if (strcmp(entry.Host, host) == 0) {
+            return entry;
+        }
+    }
+
+    // A pending lookup still reports into its entry, so it is not replaced
+    Entry_t* oldest = nullptr;
+    for (auto& entry : _entries) {
+        if (!entry.Pending && (oldest == nullptr || entry.LastUse < oldest->LastUse)) {
+            oldest = &entry;
+        }
+    }
+    if (oldest == nullptr) {
+        oldest = &_entries[0];
+    }
+
+    strlcpy(oldest->Host, host, sizeof(oldest->Host));
+    oldest->Valid = false;
+    oldest->Pending = false;
+    oldest->LastLookup = 0;
+    return *oldest;
+}
+
+void DnsResolverClass::startLookup(Entry_t& entry)
+{
+    entry.Pending = true;
+    entry.LastLookup = millis();
+
+    // Only queued, the lwip thread runs the lookup
+    if (tcpip_callback(&DnsResolverClass::lookupTcpip, &entry) != ERR_OK) {
+        entry.Pending = false;
+    }
+}
+
+void DnsResolverClass::lookupTcpip(void* arg)
+{
+    Entry_t* entry = static_cast<Entry_t*>(arg);
+
+    char host[DNS_RESOLVER_MAX_HOST_LEN];
+    {
+        std::lock_guard<std::mutex> lock(DnsResolver._mutex);
+        strlcpy(host, entry->Host, sizeof(host));
+    }
+
+    ip_addr_t addr;
+    const err_t err = dns_gethostbyname(host, &addr,
+        [](const char* name, const ip_addr_t* ipaddr, void* callbackArg) {
+            onFound(name, ipaddr, callbackArg);
+        },
+        entry);
+
+    if (err == ERR_OK) {
+        onFound(host, &addr, entry); // answered from the cache
+    } else if (err != ERR_INPROGRESS) {
+        onFound(host, nullptr, entry);
+    }
+}
+
+void DnsResolverClass::onFound(const char* name, const void* addr, void* arg)
+{
+    Entry_t* entry = static_cast<Entry_t*>(arg);
+    const ip_addr_t* ipaddr = static_cast<const ip_addr_t*>(addr);
+
+    std::lock_guard<std::mutex> lock(DnsResolver._mutex);
+    entry->Pending = false;
+
+    // The entry may have been assigned to another host in the meantime
+    if (strcmp(entry->Host, name) != 0) {
+        return;
+    }
+
+    if (ipaddr == nullptr || IP_GET_TYPE(ipaddr) != IPADDR_TYPE_V4) {
+        // The last good address stays valid
+        MessageOutput.printf("DNS lookup of %s failed%s\r\n", name, entry->Valid ? ", using the last address" : "");
+        return;
+    }
+
+    entry->Ip = IPAddress(ip4_addr_get_u32(ip_2_ip4(ipaddr)));
+    entry->Valid = true;
+}
@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "EventBus.h"
+#include "LoopWakeup.h"
+#include <Hoymiles.h>
+
+EventBusClass EventBus;
+
+void EventBusClass::init()
+{
+    _queue = xQueueCreate(EVENT_BUS_QUEUE_SIZE, sizeof(EventData_t));
+
+    Hoymiles.setDataCallback([this](InverterAbstract& inv, const InverterData_t data) {
+        switch (data) {
+        case InverterData_t::Statistics:
+            publish(Event_t::StatisticsUpdated, inv.serial(), inv.Statistics()->getGeneration());
+            break;
+        case InverterData_t::DevInfo:
+            publish(Event_t::DevInfoUpdated, inv.serial(), inv.DevInfo()->getGeneration());
+            break;
+        case InverterData_t::SystemConfigPara:
+        case InverterData_t::PowerCommand:
+            publish(Event_t::LimitChanged, inv.serial(), inv.SystemConfigPara()->getGeneration());
+            break;
+        case InverterData_t::EventLog:
+            publish(Event_t::AlarmAdded, inv.serial(), inv.EventLog()->getGeneration());
+            break;
+        case InverterData_t::GridProfile:
+            publish(Event_t::GridProfileUpdated, inv.serial(), inv.GridProfile()->getGeneration());
+            break;
+        }
+    });
+}
+
+void EventBusClass::publish(const Event_t type, const uint64_t serial, const uint32_t generation)
+{
+    if (_queue == nullptr) {
+        return;
+    }
+
+    const EventData_t event = { type, serial, generation };
+    if (xQueueSend(_queue, &event, 0) != pdTRUE) {
+        _dropped++;
+        return;
+    }
+    _published++;
+
+    LoopWakeup.notify();
+}
+
+void EventBusClass::subscribe(const Event_t type, EventHandler_t handler)
+{
+    _handlers[static_cast<size_t>(type)].push_back(handler);
+}
+
+void EventBusClass::subscribe(const Event_t type, Task& task)
+{
+    subscribe(type, [&task](const EventData_t&) {
+        if (task.isEnabled()) {
+            task.forceNextIteration();
+        }
+    });
+}
+
+void EventBusClass::dispatch()
+{
+    if (_queue == nullptr) {
+        return;
+    }
+
+    EventData_t event;
+    while (xQueueReceive(_queue, &event, 0) == pdTRUE) {
+        for (auto& handler : _handlers[static_cast<size_t>(event.Type)]) {
+            handler(event);
+        }
+        _dispatched++;
+
+        // Completes the trace of the command which delivered the data
+        if (event.Serial != 0) {
+            Hoymiles.getCommandTraces().markNotified(event.Serial, millis());
+        }
+    }
+}
+
+EventBusStats_t EventBusClass::getStats() const
+{
+    EventBusStats_t stats;
+    stats.Published = _published;
+    stats.Dropped = _dropped;
+    stats.Dispatched = _dispatched;
+    return stats;
+}
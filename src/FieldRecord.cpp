@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "FieldRecord.h"
+#include "Configuration.h"
+#include <algorithm>
+
+FieldRecordClass FieldRecord;
+
+std::shared_ptr<const FieldRecord_t> FieldRecordClass::get(InverterAbstract& inv)
+{
+    const uint64_t serial = inv.serial();
+    const uint32_t generation = inv.Statistics()->getGeneration();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto it = std::find_if(_records.begin(), _records.end(),
+        [serial](const std::shared_ptr<const FieldRecord_t>& r) { return r->Serial == serial; });
+    if (it != _records.end() && (*it)->Generation == generation) {
+        return *it;
+    }
+
+    auto record = render(inv);
+    if (it != _records.end()) {
+        *it = record;
+    } else {
+        // Records of removed inverters are dropped at some point
+        if (_records.size() >= INV_MAX_COUNT) {
+            _records.clear();
+        }
+        _records.push_back(record);
+    }
+    return record;
+}
+
+std::shared_ptr<const FieldRecord_t> FieldRecordClass::render(InverterAbstract& inv)
+{
+    auto record = std::make_shared<FieldRecord_t>();
+    record->Serial = inv.serial();
+
+    StatisticsParser* stats = inv.Statistics();
+    stats->readConsistent([&]() {
+        record->Generation = stats->getGeneration();
+        record->Entries.clear();
+
+        for (auto& t : stats->getChannelTypes()) {
+            for (auto& c : stats->getChannelsByType(t)) {
+                for (const auto& exported : ExportedFields) {
+                    const byteAssign_t* assign = stats->getAssignmentByChannelField(t, c, exported.Field);
+                    if (assign == nullptr) {
+                        continue;
+                    }
+
+                    FieldRecordEntry_t entry;
+                    entry.Type = t;
+                    entry.Channel = c;
+                    entry.Field = exported.Field;
+                    entry.Metric = exported.Metric;
+                    entry.Unit = assign->unitId;
+                    entry.Name = stats->getChannelFieldName(t, c, exported.Field);
+                    entry.Value = stats->getChannelFieldValue(t, c, exported.Field);
+                    entry.Length = stats->getChannelFieldValueString(t, c, exported.Field, entry.Formatted, sizeof(entry.Formatted));
+                    record->Entries.push_back(entry);
+                }
+            }
+        }
+    });
+
+    return record;
+}
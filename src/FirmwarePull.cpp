@@ -0,0 +1,380 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "FirmwarePull.h"
+#include "CertStore.h"
+#include "MessageOutput.h"
+#include "RestartHelper.h"
+#include <HTTPClient.h>
+#include <MD5Builder.h>
+#include <Update.h>
+#include <WiFiClientSecure.h>
+#include <algorithm>
+#include <cstdarg>
+#include <esp_ota_ops.h>
+#include <memory>
+
+static_assert(sizeof(FirmwareDeltaHeader_t) == 48, "The delta header has to match pio-scripts/firmware_delta.py");
+
+FirmwarePullClass FirmwarePull;
+
+bool FirmwarePullClass::start(const String& url, const String& md5)
+{
+    if (_taskHandle != nullptr || Update.isRunning()) {
+        return false;
+    }
+    if (!url.startsWith("https://") || !isValidMd5(md5)) {
+        return false;
+    }
+
+    _url = url;
+    _md5 = md5;
+    _delta = false;
+    _downloaded = 0;
+    _written = 0;
+    _total = 0;
+    {
+        std::lock_guard<std::mutex> lock(_errorLock);
+        _error[0] = '\0';
+    }
+    _state = FirmwarePullState_t::Running;
+
+    if (xTaskCreatePinnedToCore(taskProc, "OTA_PULL", FIRMWARE_PULL_TASK_STACK_SIZE, this,
+            FIRMWARE_PULL_TASK_PRIORITY, &_taskHandle, FIRMWARE_PULL_TASK_CORE)
+        != pdPASS) {
+        _taskHandle = nullptr;
+        fail("Could not create task");
+        return false;
+    }
+
+    return true;
+}
+
+bool FirmwarePullClass::isValidMd5(const String& md5)
+{
+    if (md5.length() != 32) {
+        return false;
+    }
+    for (size_t i = 0; i < md5.length(); i++) {
+        if (!isxdigit(static_cast<unsigned char>(md5[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FirmwarePullClass::isRunning() const
+{
+    return _state == FirmwarePullState_t::Running;
+}
+
+FirmwarePullState_t FirmwarePullClass::getState() const
+{
+    return _state;
+}
+
+bool FirmwarePullClass::isDelta() const
+{
+    return _delta;
+}
+
+size_t FirmwarePullClass::getDownloaded() const
+{
+    return _downloaded;
+}
+
+size_t FirmwarePullClass::getWritten() const
+{
+    return _written;
+}
+
+size_t FirmwarePullClass::getTotal() const
+{
+    return _total;
+}
+
+String FirmwarePullClass::getError()
+{
+    std::lock_guard<std::mutex> lock(_errorLock);
+    return _error;
+}
+
+bool FirmwarePullClass::fail(const char* format, ...)
+{
+    {
+        std::lock_guard<std::mutex> lock(_errorLock);
+        va_list args;
+        va_start(args, format);
+        vsnprintf(_error, sizeof(_error), format, args);
+        va_end(args);
+    }
+
+    MessageOutput.printf("Firmware pull failed: %s\r\n", _error);
+    _state = FirmwarePullState_t::Failed;
+    return false;
+}
+
+void FirmwarePullClass::taskProc(void* param)
+{
+    FirmwarePullClass* pull = static_cast<FirmwarePullClass*>(param);
+    pull->run();
+
+    pull->_taskHandle = nullptr;
+    vTaskDelete(nullptr);
+}
+
+void FirmwarePullClass::run()
+{
+    MessageOutput.printf("Firmware pull from %s\r\n", _url.c_str());
+
+    // The client only keeps a pointer to the certificate, it has to outlive the connection
+    const String rootCa = CertStore.read(Cert_t::FirmwareRootCa);
+    if (rootCa.isEmpty()) {
+        fail("Root certificate missing");
+        return;
+    }
+    auto client = std::make_unique<WiFiClientSecure>();
+    client->setCACert(rootCa.c_str());
+
+    std::unique_ptr<uint8_t[]> buffer(new (std::nothrow) uint8_t[FIRMWARE_PULL_BLOCK_SIZE]);
+    if (buffer == nullptr) {
+        fail("Out of memory");
+        return;
+    }
+    _buffer = buffer.get();
+
+    HTTPClient http;
+    http.setTimeout(FIRMWARE_PULL_TIMEOUT);
+    http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
+    if (!http.begin(*client, _url)) {
+        fail("Invalid url");
+        return;
+    }
+
+    const int code = http.GET();
+    if (code != HTTP_CODE_OK) {
+        http.end();
+        fail("HTTP status %d", code);
+        return;
+    }
+
+    _stream = http.getStreamPtr();
+    const int contentLength = http.getSize();
+
+    // Delta images are recognized by their magic, everything else is written as it is
+    uint32_t magic = 0;
+    bool ok = readExact(reinterpret_cast<uint8_t*>(&magic), sizeof(magic));
+    if (ok) {
+        _delta = magic == FIRMWARE_DELTA_MAGIC;
+        ok = _delta ? applyDelta() : applyFull(reinterpret_cast<const uint8_t*>(&magic), sizeof(magic), contentLength);
+    }
+
+    http.end();
+    _stream = nullptr;
+    _buffer = nullptr;
+
+    if (!ok) {
+        if (Update.isRunning()) {
+            Update.abort();
+        }
+        if (_state == FirmwarePullState_t::Running) {
+            fail("Download incomplete");
+        }
+        return;
+    }
+
+    if (!Update.end(true)) {
+        fail("Could not end OTA: %s", Update.errorString());
+        return;
+    }
+
+    MessageOutput.printf("Firmware pull finished, %u bytes downloaded, %u bytes written\r\n", _downloaded.load(), _written.load());
+    _state = FirmwarePullState_t::Done;
+    RestartHelper.triggerRestart();
+}
+
+bool FirmwarePullClass::readExact(uint8_t* buffer, const size_t len)
+{
+    size_t pos = 0;
+    uint32_t lastData = millis();
+
+    while (pos < len) {
+        const int available = _stream->available();
+        if (available <= 0) {
+            if (!_stream->connected() || millis() - lastData > FIRMWARE_PULL_TIMEOUT) {
+                return false;
+            }
+            vTaskDelay(pdMS_TO_TICKS(1));
+            continue;
+        }
+
+        const int n = _stream->read(buffer + pos, std::min<size_t>(len - pos, available));
+        if (n > 0) {
+            pos += n;
+            _downloaded += n;
+            lastData = millis();
+        }
+    }
+
+    return true;
+}
+
+bool FirmwarePullClass::writeTarget(const uint8_t* data, const size_t len)
+{
+    if (Update.write(const_cast<uint8_t*>(data), len) != len) {
+        return fail("Could not write OTA: %s", Update.errorString());
+    }
+    _written += len;
+    return true;
+}
+
+bool FirmwarePullClass::applyFull(const uint8_t* head, const size_t headLen, const int contentLength)
+{
+    if (!Update.begin(contentLength > 0 ? contentLength : UPDATE_SIZE_UNKNOWN, U_FLASH)) {
+        return fail("Could not begin OTA: %s", Update.errorString());
+    }
+    if (!Update.setMD5(_md5.c_str())) {
+        return fail("MD5 parameter invalid");
+    }
+    _total = contentLength > 0 ? contentLength : 0;
+
+    if (!writeTarget(head, headLen)) {
+        return false;
+    }
+
+    size_t remaining = contentLength > 0 ? contentLength - headLen : SIZE_MAX;
+    while (remaining > 0) {
+        // Waits for at least one byte if nothing is available yet
+        const size_t available = std::max(_stream->available(), 1);
+        const size_t len = std::min({ remaining, available, static_cast<size_t>(FIRMWARE_PULL_BLOCK_SIZE) });
+
+        if (!readExact(_buffer, len)) {
+            // Without a content length the end of the connection is the end of the image
+            return contentLength <= 0 && !_stream->connected() && _stream->available() <= 0;
+        }
+
+        if (!writeTarget(_buffer, len)) {
+            return false;
+        }
+        remaining -= len;
+    }
+
+    return true;
+}
+
+bool FirmwarePullClass::applyDelta()
+{
+    FirmwareDeltaHeader_t header;
+    header.Magic = FIRMWARE_DELTA_MAGIC;
+    if (!readExact(reinterpret_cast<uint8_t*>(&header) + sizeof(header.Magic), sizeof(header) - sizeof(header.Magic))) {
+        return false;
+    }
+
+    if (header.Version != FIRMWARE_DELTA_VERSION) {
+        return fail("Delta version %d not supported", header.Version);
+    }
+
+    if (!verifySource(header)) {
+        return false;
+    }
+
+    // The header is part of the download, only the md5 of the caller is trusted
+    char md5[33];
+    for (uint8_t i = 0; i < sizeof(header.TargetMd5); i++) {
+        snprintf(&md5[i * 2], 3, "%02x", header.TargetMd5[i]);
+    }
+    if (!_md5.equalsIgnoreCase(md5)) {
+        return fail("Delta does not match the md5");
+    }
+
+    if (!Update.begin(header.TargetSize, U_FLASH)) {
+        return fail("Could not begin OTA: %s", Update.errorString());
+    }
+    if (!Update.setMD5(_md5.c_str())) {
+        return fail("MD5 parameter invalid");
+    }
+    _total = header.TargetSize;
+
+    const esp_partition_t* source = esp_ota_get_running_partition();
+
+    for (;;) {
+        FirmwareDeltaOp_t op;
+        if (!readExact(reinterpret_cast<uint8_t*>(&op), sizeof(op))) {
+            return false;
+        }
+
+        if (op == FirmwareDeltaOp_t::End) {
+            return true;
+        }
+
+        uint32_t offset = 0;
+        uint32_t len = 0;
+        if (op == FirmwareDeltaOp_t::Copy && !readExact(reinterpret_cast<uint8_t*>(&offset), sizeof(offset))) {
+            return false;
+        }
+        if (!readExact(reinterpret_cast<uint8_t*>(&len), sizeof(len))) {
+            return false;
+        }
+
+        switch (op) {
+        case FirmwareDeltaOp_t::Copy:
+            if (offset + len > header.SourceSize || offset + len < offset) {
+                return fail("Delta copy out of range");
+            }
+            while (len > 0) {
+                const uint32_t n = std::min<uint32_t>(len, FIRMWARE_PULL_BLOCK_SIZE);
+                if (esp_partition_read(source, offset, _buffer, n) != ESP_OK) {
+                    return fail("Could not read running firmware");
+                }
+                if (!writeTarget(_buffer, n)) {
+                    return false;
+                }
+                offset += n;
+                len -= n;
+            }
+            break;
+
+        case FirmwareDeltaOp_t::Insert:
+            while (len > 0) {
+                const uint32_t n = std::min<uint32_t>(len, FIRMWARE_PULL_BLOCK_SIZE);
+                if (!readExact(_buffer, n) || !writeTarget(_buffer, n)) {
+                    return false;
+                }
+                len -= n;
+            }
+            break;
+
+        default:
+            return fail("Invalid delta operation %d", static_cast<uint8_t>(op));
+        }
+    }
+}
+
+bool FirmwarePullClass::verifySource(const FirmwareDeltaHeader_t& header)
+{
+    // A delta only fits the exact image it was created against
+    const esp_partition_t* source = esp_ota_get_running_partition();
+    if (source == nullptr || header.SourceSize > source->size) {
+        return fail("Delta does not match the running firmware");
+    }
+
+    MD5Builder md5;
+    md5.begin();
+    for (uint32_t offset = 0; offset < header.SourceSize; offset += FIRMWARE_PULL_BLOCK_SIZE) {
+        const uint32_t n = std::min<uint32_t>(header.SourceSize - offset, FIRMWARE_PULL_BLOCK_SIZE);
+        if (esp_partition_read(source, offset, _buffer, n) != ESP_OK) {
+            return fail("Could not read running firmware");
+        }
+        md5.add(_buffer, n);
+    }
+    md5.calculate();
+
+    uint8_t digest[16];
+    md5.getBytes(digest);
+    if (memcmp(digest, header.SourceMd5, sizeof(digest)) != 0) {
+        return fail("Delta does not match the running firmware");
+    }
+
+    return true;
+}
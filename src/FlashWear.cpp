@@ -0,0 +1,251 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "FlashWear.h"
+#include "FsWorker.h"
+#include "MessageOutput.h"
+#include "NtpSettings.h"
+#include "TaskProfiler.h"
+#include <LittleFS.h>
+#include <algorithm>
+#include <cstring>
+
+#define FLASH_WEAR_MAGIC 0x52414557 // "WEAR"
+#define FLASH_WEAR_VERSION 1
+
+struct FlashWearFileHeader_t {
+    uint32_t Magic;
+    uint16_t Version;
+    uint16_t Writers;
+    uint32_t Since;
+};
+
+struct FlashWearFileWriter_t {
+    uint64_t Bytes;
+    uint32_t Erases;
+    uint32_t Writes;
+    uint32_t Deferred;
+};
+
+FlashWearClass FlashWear;
+
+FlashWearClass::FlashWearClass()
+    : _loopTask(60 * TASK_SECOND, TASK_FOREVER)
+{
+}
+
+void FlashWearClass::init(Scheduler& scheduler)
+{
+    load();
+
+    _lastRefill = millis();
+    _lastSave = millis();
+    for (uint8_t i = 0; i < _writers.size(); i++) {
+        _writers[i].Tokens = getBudget(static_cast<FlashWriter_t>(i)) / 4.0f;
+    }
+
+    scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "FlashWear.loop", std::bind(&FlashWearClass::loop, this));
+    _loopTask.enable();
+}
+
+const char* FlashWearClass::getWriterName(const FlashWriter_t writer)
+{
+    switch (writer) {
+    case FlashWriter_t::Config:
+        return "config";
+    case FlashWriter_t::Upload:
+        return "upload";
+    case FlashWriter_t::MqttJournal:
+        return "mqtt_journal";
+    case FlashWriter_t::Time:
+        return "time";
+    case FlashWriter_t::System:
+        return "system";
+    case FlashWriter_t::History:
+        return "history";
+    case FlashWriter_t::LinkHistory:
+        return "link_history";
+    case FlashWriter_t::Snapshot:
+        return "snapshot";
+    case FlashWriter_t::InverterCache:
+        return "inverter_cache";
+    case FlashWriter_t::Hass:
+        return "hass";
+    default:
+        return "unknown";
+    }
+}
+
+uint32_t FlashWearClass::getBudget(const FlashWriter_t writer)
+{
+    switch (writer) {
+    case FlashWriter_t::History:
+        return FLASH_WEAR_BUDGET_HISTORY;
+    case FlashWriter_t::LinkHistory:
+        return FLASH_WEAR_BUDGET_LINK_HISTORY;
+    case FlashWriter_t::Snapshot:
+        return FLASH_WEAR_BUDGET_SNAPSHOT;
+    case FlashWriter_t::InverterCache:
+        return FLASH_WEAR_BUDGET_INVERTER_CACHE;
+    case FlashWriter_t::Hass:
+        return FLASH_WEAR_BUDGET_HASS;
+    default:
+        return 0;
+    }
+}
+
+void FlashWearClass::refill(const uint32_t now)
+{
+    const float days = (now - _lastRefill) / (24 * 3600 * 1000.0f);
+    _lastRefill = now;
+
+    for (uint8_t i = 0; i < _writers.size(); i++) {
+        const uint32_t budget = getBudget(static_cast<FlashWriter_t>(i));
+        if (budget > 0) {
+            _writers[i].Tokens = std::min(_writers[i].Tokens + budget * days, budget / 4.0f);
+        }
+    }
+}
+
+void FlashWearClass::record(const FlashWriter_t writer, const size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    refill(millis());
+
+    // The data blocks and at least one block of the metadata
+    const uint32_t erases = (bytes + FLASH_WEAR_BLOCK_SIZE - 1) / FLASH_WEAR_BLOCK_SIZE + 1;
+
+    Writer_t& w = _writers[static_cast<size_t>(writer)];
+    w.Bytes += bytes;
+    w.Erases += erases;
+    w.Writes++;
+    if (getBudget(writer) > 0) {
+        w.Tokens -= erases;
+    }
+    _dirty = true;
+}
+
+bool FlashWearClass::allow(const FlashWriter_t writer)
+{
+    if (getBudget(writer) == 0) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    refill(millis());
+
+    Writer_t& w = _writers[static_cast<size_t>(writer)];
+    if (w.Tokens >= 1) {
+        return true;
+    }
+    if (w.Deferred++ == 0) {
+        MessageOutput.printf("Flash wear: budget of %s used up, writes are held back\r\n", getWriterName(writer));
+    }
+    return false;
+}
+
+void FlashWearClass::loop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (_since == 0 && NtpSettings.isTimeConfident()) {
+            _since = time(nullptr);
+            _dirty = true;
+        }
+
+        if (!_dirty || millis() - _lastSave < FLASH_WEAR_SAVE_INTERVAL * 1000U) {
+            return;
+        }
+        _lastSave = millis();
+        _dirty = false;
+    }
+
+    // The write is recorded as well, which needs the lock
+    save();
+}
+
+void FlashWearClass::flush()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_dirty) {
+            return;
+        }
+        _lastSave = millis();
+        _dirty = false;
+    }
+
+    save();
+}
+
+void FlashWearClass::load()
+{
+    File f = LittleFS.open(FLASH_WEAR_FILENAME, "r", false);
+    if (!f) {
+        return;
+    }
+
+    FlashWearFileHeader_t header;
+    if (f.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header)
+        || header.Magic != FLASH_WEAR_MAGIC
+        || header.Version != FLASH_WEAR_VERSION) {
+        f.close();
+        return;
+    }
+
+    // Writers added later start at zero
+    std::lock_guard<std::mutex> lock(_mutex);
+    _since = header.Since;
+    for (uint16_t i = 0; i < header.Writers && i < _writers.size(); i++) {
+        FlashWearFileWriter_t entry;
+        if (f.read(reinterpret_cast<uint8_t*>(&entry), sizeof(entry)) != sizeof(entry)) {
+            break;
+        }
+        _writers[i].Bytes = entry.Bytes;
+        _writers[i].Erases = entry.Erases;
+        _writers[i].Writes = entry.Writes;
+        _writers[i].Deferred = entry.Deferred;
+    }
+    f.close();
+}
+
+void FlashWearClass::save()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    FlashWearFileHeader_t header = { FLASH_WEAR_MAGIC, FLASH_WEAR_VERSION, static_cast<uint16_t>(_writers.size()), _since };
+
+    std::vector<uint8_t> data(sizeof(header) + _writers.size() * sizeof(FlashWearFileWriter_t));
+    memcpy(data.data(), &header, sizeof(header));
+    for (size_t i = 0; i < _writers.size(); i++) {
+        const FlashWearFileWriter_t entry = { _writers[i].Bytes, _writers[i].Erases, _writers[i].Writes, _writers[i].Deferred };
+        memcpy(data.data() + sizeof(header) + i * sizeof(entry), &entry, sizeof(entry));
+    }
+
+    lock.unlock();
+
+    FsWorker.write(FLASH_WEAR_FILENAME, std::move(data), FlashWriter_t::System);
+}
+
+FlashWearStats_t FlashWearClass::getStats()
+{
+    FlashWearStats_t stats;
+    stats.Blocks = LittleFS.totalBytes() / FLASH_WEAR_BLOCK_SIZE;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    refill(millis());
+
+    stats.Since = _since;
+    uint64_t erases = 0;
+    for (uint8_t i = 0; i < _writers.size(); i++) {
+        const FlashWriter_t writer = static_cast<FlashWriter_t>(i);
+        const Writer_t& w = _writers[i];
+        stats.Writers.push_back({ getWriterName(writer), getBudget(writer), w.Bytes, w.Erases, w.Writes, w.Deferred,
+            getBudget(writer) > 0 ? std::max(w.Tokens, 0.0f) : 0 });
+        erases += w.Erases;
+    }
+    stats.AverageErases = stats.Blocks > 0 ? static_cast<float>(erases) / stats.Blocks : 0;
+    return stats;
+}
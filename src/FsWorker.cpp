@@ -0,0 +1,338 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "FsWorker.h"
+#include "MessageOutput.h"
+#include <LittleFS.h>
+#include <algorithm>
+#include <iterator>
+
+FsWorkerClass FsWorker;
+
+void FsWorkerClass::init()
+{
+    if (xTaskCreatePinnedToCore(taskProc, "FS_WORKER", FS_WORKER_TASK_STACK_SIZE, this,
+            FS_WORKER_TASK_PRIORITY, &_taskHandle, FS_WORKER_TASK_CORE)
+        != pdPASS) {
+        // All requests are done by the callers then
+        _taskHandle = nullptr;
+        MessageOutput.println("FS: Could not create worker task");
+    }
+}
+
+bool FsWorkerClass::writeFile(const String& path, const std::vector<uint8_t>& data)
+{
+    const String temp = path + ".tmp";
+    File f = LittleFS.open(temp, "w");
+    if (!f) {
+        return false;
+    }
+
+    const bool ok = data.empty() || f.write(data.data(), data.size()) == data.size();
+    f.close();
+
+    if (!ok) {
+        LittleFS.remove(temp);
+        return false;
+    }
+    return LittleFS.rename(temp, path);
+}
+
+void FsWorkerClass::write(const String& path, std::vector<uint8_t> data, const FlashWriter_t writer, FsCallback done)
+{
+    if (_taskHandle == nullptr) {
+        const bool ok = writeFile(path, data);
+        if (ok) {
+            FlashWear.record(writer, data.size());
+        }
+        if (done) {
+            done(ok);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = std::find_if(_writes.begin(), _writes.end(), [&](const PendingWrite_t& w) { return w.Path == path; });
+        if (it != _writes.end()) {
+            // Keeps the due time, so a file which changes continuously is still written
+            it->Data = std::move(data);
+            if (done) {
+                it->Done.push_back(std::move(done));
+            }
+            _stats.Coalesced++;
+        } else {
+            PendingWrite_t pending = { path, std::move(data), millis() + FS_WORKER_WRITE_DELAY, writer, {} };
+            if (done) {
+                pending.Done.push_back(std::move(done));
+            }
+            _writes.push_back(std::move(pending));
+        }
+    }
+    xTaskNotifyGive(_taskHandle);
+}
+
+void FsWorkerClass::discard(const String& path)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _writes.erase(std::remove_if(_writes.begin(), _writes.end(), [&](const PendingWrite_t& w) { return w.Path == path; }), _writes.end());
+}
+
+void FsWorkerClass::discardAll()
+{
+    std::vector<PendingWrite_t> writes;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        writes.swap(_writes);
+    }
+
+    for (auto& w : writes) {
+        for (auto& done : w.Done) {
+            done(false);
+        }
+    }
+}
+
+void FsWorkerClass::read(const String& path, FsReadCallback done)
+{
+    queueJob({ path }, [path, done]() {
+        std::vector<uint8_t> data;
+        File f = LittleFS.open(path, "r", false);
+        if (!f) {
+            done(false, data);
+            return;
+        }
+
+        data.resize(f.size());
+        const bool ok = data.empty() || f.read(data.data(), data.size()) == data.size();
+        f.close();
+        done(ok, data);
+    });
+}
+
+void FsWorkerClass::rename(const String& from, const String& to, FsCallback done)
+{
+    queueJob({ from, to }, [from, to, done]() {
+        const bool ok = LittleFS.rename(from, to);
+        if (done) {
+            done(ok);
+        }
+    });
+}
+
+void FsWorkerClass::remove(const String& path, FsCallback done)
+{
+    queueJob({ path }, [path, done]() {
+        const bool ok = !LittleFS.exists(path) || LittleFS.remove(path);
+        if (done) {
+            done(ok);
+        }
+    });
+}
+
+void FsWorkerClass::list(const String& dir, FsListCallback done)
+{
+    // The pending writes of the directory are done first, so new files are part of the list
+    std::vector<String> paths;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (const auto& w : _writes) {
+            if (w.Path.startsWith(dir)) {
+                paths.push_back(w.Path);
+            }
+        }
+    }
+
+    queueJob(std::move(paths), [dir, done]() {
+        std::vector<FsEntry_t> entries;
+        File root = LittleFS.open(dir);
+        if (!root || !root.isDirectory()) {
+            done(false, entries);
+            return;
+        }
+
+        File file = root.openNextFile();
+        while (file) {
+            entries.push_back({ file.name(), file.size(), file.isDirectory() });
+            file.close();
+            file = root.openNextFile();
+        }
+        root.close();
+        done(true, entries);
+    });
+}
+
+void FsWorkerClass::run(std::function<void()> job)
+{
+    queueJob({}, std::move(job));
+}
+
+void FsWorkerClass::queueJob(std::vector<String> paths, std::function<void()> job, const bool allWrites)
+{
+    if (_taskHandle == nullptr) {
+        job();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _jobs.push_back({ std::move(job), std::move(paths), allWrites });
+    }
+    xTaskNotifyGive(_taskHandle);
+}
+
+void FsWorkerClass::flush()
+{
+    if (_taskHandle == nullptr) {
+        return;
+    }
+    if (xTaskGetCurrentTaskHandle() == _taskHandle) {
+        writePending(true);
+        return;
+    }
+
+    // All pending writes are done before the job
+    StaticSemaphore_t buffer;
+    SemaphoreHandle_t done = xSemaphoreCreateBinaryStatic(&buffer);
+    queueJob({}, [done]() { xSemaphoreGive(done); }, true);
+    xSemaphoreTake(done, portMAX_DELAY);
+    vSemaphoreDelete(done);
+}
+
+FsWorkerStats_t FsWorkerClass::getStats()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
+
+void FsWorkerClass::taskProc(void* param)
+{
+    FsWorkerClass* worker = static_cast<FsWorkerClass*>(param);
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, worker->getWaitTime());
+        worker->process();
+    }
+}
+
+uint32_t FsWorkerClass::getWaitTime()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_writes.empty()) {
+        return portMAX_DELAY;
+    }
+
+    const uint32_t now = millis();
+    int32_t wait = INT32_MAX;
+    for (const auto& w : _writes) {
+        wait = std::min(wait, static_cast<int32_t>(w.Due - now));
+    }
+    return wait > 0 ? pdMS_TO_TICKS(wait) : 0;
+}
+
+void FsWorkerClass::process()
+{
+    for (;;) {
+        Job_t job;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_jobs.empty()) {
+                break;
+            }
+            job = std::move(_jobs.front());
+            _jobs.pop_front();
+            _stats.Jobs++;
+        }
+
+        // Only the files the job accesses, the other writes keep their delay and wear budget
+        if (job.AllWrites) {
+            writePending(true);
+        } else {
+            writePaths(job.Paths);
+        }
+        job.Run();
+    }
+
+    writePending(false);
+}
+
+void FsWorkerClass::writePending(const bool all)
+{
+    std::vector<PendingWrite_t> writes;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const uint32_t now = millis();
+        const bool due = std::any_of(_writes.begin(), _writes.end(),
+            [now](const PendingWrite_t& w) { return static_cast<int32_t>(now - w.Due) >= 0; });
+        if (!all && !due) {
+            return;
+        }
+
+        // Once one is due the others are written as well, the flash is busy anyway
+        writes.swap(_writes);
+    }
+
+    for (auto& w : writes) {
+        // Kept in the queue, further writes of the file replace its data meanwhile. Before
+        // a request of the file and a restart it is written, so reads get the latest data.
+        if (!all && !FlashWear.allow(w.Writer)) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stats.Deferred++;
+            auto newer = std::find_if(_writes.begin(), _writes.end(), [&](const PendingWrite_t& p) { return p.Path == w.Path; });
+            if (newer != _writes.end()) {
+                // Queued meanwhile, its data replaces the held back one
+                newer->Due = millis() + FLASH_WEAR_RETRY_DELAY;
+                newer->Done.insert(newer->Done.begin(), std::make_move_iterator(w.Done.begin()), std::make_move_iterator(w.Done.end()));
+                continue;
+            }
+            w.Due = millis() + FLASH_WEAR_RETRY_DELAY;
+            _writes.push_back(std::move(w));
+            continue;
+        }
+
+        writeOne(w);
+    }
+}
+
+void FsWorkerClass::writePaths(const std::vector<String>& paths)
+{
+    if (paths.empty()) {
+        return;
+    }
+
+    std::vector<PendingWrite_t> writes;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = std::stable_partition(_writes.begin(), _writes.end(), [&paths](const PendingWrite_t& w) {
+            return std::find(paths.begin(), paths.end(), w.Path) == paths.end();
+        });
+        writes.assign(std::make_move_iterator(it), std::make_move_iterator(_writes.end()));
+        _writes.erase(it, _writes.end());
+    }
+
+    for (auto& w : writes) {
+        writeOne(w);
+    }
+}
+
+void FsWorkerClass::writeOne(PendingWrite_t& w)
+{
+    const bool ok = writeFile(w.Path, w.Data);
+    if (ok) {
+        FlashWear.record(w.Writer, w.Data.size());
+    } else {
+        MessageOutput.printf("FS: Failed to write %s\r\n", w.Path.c_str());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stats.Writes++;
+        if (!ok) {
+            _stats.Failed++;
+        }
+    }
+
+    for (auto& done : w.Done) {
+        done(ok);
+    }
+}
@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "HeapTelemetry.h"
+#include <esp_heap_caps.h>
+
+// The size of each json allocation is stored in front of it, as deallocate() does not pass it
+#define HEAP_TELEMETRY_HEADER_SIZE 8
+
+HeapTelemetryClass HeapTelemetry;
+
+static const char* const tagNames[] = { "webapi", "websocket", "mqtt", "mqtt_queue", "config" };
+static_assert(sizeof(tagNames) / sizeof(tagNames[0]) == static_cast<size_t>(HeapTag_t::Count), "Missing heap tag name");
+
+HeapTelemetryClass::HeapTelemetryClass()
+{
+    _jsonAllocators.reserve(static_cast<size_t>(HeapTag_t::Count));
+    for (size_t i = 0; i < static_cast<size_t>(HeapTag_t::Count); i++) {
+        _jsonAllocators.emplace_back(this, static_cast<HeapTag_t>(i));
+    }
+}
+
+void HeapTelemetryClass::onAlloc(const HeapTag_t tag, const size_t size)
+{
+    Counter_t& counter = _counters[static_cast<size_t>(tag)];
+    counter.Allocs.fetch_add(1, std::memory_order_relaxed);
+    const uint32_t bytes = counter.Bytes.fetch_add(size, std::memory_order_relaxed) + size;
+
+    uint32_t peak = counter.PeakBytes.load(std::memory_order_relaxed);
+    while (bytes > peak && !counter.PeakBytes.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) { }
+}
+
+void HeapTelemetryClass::onFree(const HeapTag_t tag, const size_t size)
+{
+    Counter_t& counter = _counters[static_cast<size_t>(tag)];
+    counter.Frees.fetch_add(1, std::memory_order_relaxed);
+    counter.Bytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+ArduinoJson::Allocator* HeapTelemetryClass::getJsonAllocator(const HeapTag_t tag)
+{
+    return &_jsonAllocators[static_cast<size_t>(tag)];
+}
+
+std::vector<HeapTagStats_t> HeapTelemetryClass::getTagStats() const
+{
+    std::vector<HeapTagStats_t> stats;
+    stats.reserve(_counters.size());
+    for (size_t i = 0; i < _counters.size(); i++) {
+        const Counter_t& counter = _counters[i];
+        stats.push_back({ tagNames[i],
+            counter.Allocs.load(std::memory_order_relaxed),
+            counter.Frees.load(std::memory_order_relaxed),
+            counter.Bytes.load(std::memory_order_relaxed),
+            counter.PeakBytes.load(std::memory_order_relaxed) });
+    }
+    return stats;
+}
+
+std::vector<HeapRegionStats_t> HeapTelemetryClass::getRegionStats()
+{
+    std::vector<HeapRegionStats_t> stats;
+
+    const std::array<std::pair<const char*, uint32_t>, 2> regions = { {
+        { "internal", MALLOC_CAP_INTERNAL },
+        { "psram", MALLOC_CAP_SPIRAM },
+    } };
+
+    for (const auto& region : regions) {
+        if (heap_caps_get_total_size(region.second) == 0) {
+            continue;
+        }
+
+        multi_heap_info_t info;
+        heap_caps_get_info(&info, region.second);
+        stats.push_back({ region.first,
+            info.total_free_bytes,
+            info.total_allocated_bytes,
+            info.largest_free_block,
+            info.minimum_free_bytes,
+            info.allocated_blocks,
+            info.free_blocks });
+    }
+
+    return stats;
+}
+
+HeapTelemetryClass::JsonAllocator::JsonAllocator(HeapTelemetryClass* telemetry, const HeapTag_t tag)
+    : _telemetry(telemetry)
+    , _tag(tag)
+{
+}
+
+void* HeapTelemetryClass::JsonAllocator::allocate(size_t size)
+{
+    uint8_t* block = static_cast<uint8_t*>(malloc(size + HEAP_TELEMETRY_HEADER_SIZE));
+    if (block == nullptr) {
+        return nullptr;
+    }
+
+    *reinterpret_cast<size_t*>(block) = size;
+    _telemetry->onAlloc(_tag, size);
+    return block + HEAP_TELEMETRY_HEADER_SIZE;
+}
+
+void HeapTelemetryClass::JsonAllocator::deallocate(void* ptr)
+{
+    if (ptr == nullptr) {
+        return;
+    }
+
+    uint8_t* block = static_cast<uint8_t*>(ptr) - HEAP_TELEMETRY_HEADER_SIZE;
+    _telemetry->onFree(_tag, *reinterpret_cast<size_t*>(block));
+    free(block);
+}
+
+void* HeapTelemetryClass::JsonAllocator::reallocate(void* ptr, size_t newSize)
+{
+    if (ptr == nullptr) {
+        return allocate(newSize);
+    }
+
+    uint8_t* block = static_cast<uint8_t*>(ptr) - HEAP_TELEMETRY_HEADER_SIZE;
+    const size_t oldSize = *reinterpret_cast<size_t*>(block);
+
+    block = static_cast<uint8_t*>(realloc(block, newSize + HEAP_TELEMETRY_HEADER_SIZE));
+    if (block == nullptr) {
+        return nullptr;
+    }
+
+    // Counted as a free of the old and an allocation of the new block
+    *reinterpret_cast<size_t*>(block) = newSize;
+    _telemetry->onFree(_tag, oldSize);
+    _telemetry->onAlloc(_tag, newSize);
+    return block + HEAP_TELEMETRY_HEADER_SIZE;
+}
@@ -0,0 +1,243 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "History.h"
+#include "Datastore.h"
+#include "FlashWear.h"
+#include "FsWorker.h"
+#include "MessageOutput.h"
+#include "NtpSettings.h"
+#include "TaskProfiler.h"
+#include "Utils.h"
+#include <Hoymiles.h>
+#include <algorithm>
+#include <ctime>
+
+HistoryClass History;
+
+HistoryClass::HistoryClass()
+    : _loopTask(HISTORY_SAMPLE_INTERVAL * TASK_SECOND, TASK_FOREVER)
+{
+    _stores[static_cast<size_t>(HistoryResolution_t::Min1)] = { "/history_1m.bin", HISTORY_1MIN_CAPACITY, {}, false, {}, {} };
+    _stores[static_cast<size_t>(HistoryResolution_t::Min15)] = { "/history_15m.bin", HISTORY_15MIN_CAPACITY, {}, false, {}, {} };
+    _stores[static_cast<size_t>(HistoryResolution_t::Day1)] = { "/history_1d.bin", HISTORY_1DAY_CAPACITY, {}, false, {}, {} };
+}
+
+void HistoryClass::init(Scheduler& scheduler)
+{
+    scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "History.loop", std::bind(&HistoryClass::loop, this));
+    _loopTask.enable();
+}
+
+uint32_t HistoryClass::getPeriod(const HistoryResolution_t resolution)
+{
+    switch (resolution) {
+    case HistoryResolution_t::Min1:
+        return 60;
+    case HistoryResolution_t::Min15:
+        return 15 * 60;
+    default:
+        return 24 * 60 * 60;
+    }
+}
+
+uint32_t HistoryClass::getPeriodStart(const HistoryResolution_t resolution, const uint32_t timestamp) const
+{
+    // Periods are aligned to the local time, so a day starts at midnight
+    const uint32_t period = getPeriod(resolution);
+    const int64_t local = static_cast<int64_t>(timestamp) + Utils::getTimezoneOffset();
+    return timestamp - static_cast<uint32_t>(((local % period) + period) % period);
+}
+
+void HistoryClass::loop()
+{
+    if (!NtpSettings.isTimeConfident() || Hoymiles.getNumInverters() == 0) {
+        return;
+    }
+
+    const uint32_t now = time(nullptr);
+
+    addSample(now, 0,
+        Datastore.getTotalAcPowerEnabled(),
+        Datastore.getTotalAcYieldDayEnabled(),
+        Datastore.getTotalAcYieldTotalEnabled());
+
+    Hoymiles.forEachInverter([&](InverterAbstract& inv, const uint8_t) {
+        if (!inv.isReachable()) {
+            return;
+        }
+
+        addSample(now, inv.serial(),
+            inv.Statistics()->getChannelFieldValue(TYPE_AC, CH0, FLD_PAC),
+            inv.Statistics()->getChannelFieldValue(TYPE_INV, CH0, FLD_YD),
+            inv.Statistics()->getChannelFieldValue(TYPE_INV, CH0, FLD_YT));
+    });
+
+    if (_lastFlush == 0) {
+        _lastFlush = now;
+    } else if (now - _lastFlush >= HISTORY_FLUSH_INTERVAL) {
+        // The flash write is done by the worker, the samples are kept in RAM until then
+        _lastFlush = now;
+        FsWorker.run([this]() { flush(); });
+    }
+}
+
+void HistoryClass::addSample(const uint32_t now, const uint64_t serial, const float power, const float yieldDay, const float yieldTotal)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    for (size_t r = 0; r < _stores.size(); r++) {
+        Store_t& store = _stores[r];
+        const uint32_t periodStart = getPeriodStart(static_cast<HistoryResolution_t>(r), now);
+
+        auto acc = std::find_if(store.Accumulators.begin(), store.Accumulators.end(), [serial](const Accumulator_t& a) {
+            return a.Serial == serial;
+        });
+        if (acc == store.Accumulators.end()) {
+            acc = store.Accumulators.insert(store.Accumulators.end(), { serial, periodStart, 0, 0, 0, 0 });
+        }
+
+        // The first sample of a new period finishes the previous one
+        if (acc->Samples > 0 && acc->PeriodStart != periodStart) {
+            if (store.Pending.size() >= store.Capacity) {
+                store.Pending.erase(store.Pending.begin());
+            }
+            store.Pending.push_back({ serial, acc->PeriodStart, acc->PowerSum / acc->Samples, acc->YieldDay, acc->YieldTotal });
+
+            acc->PowerSum = 0;
+            acc->Samples = 0;
+        }
+
+        acc->PeriodStart = periodStart;
+        acc->PowerSum += power;
+        acc->Samples++;
+        acc->YieldDay = yieldDay;
+        acc->YieldTotal = yieldTotal;
+    }
+}
+
+void HistoryClass::flush()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // The records stay in RAM until the next flush, the oldest ones are dropped once the buffer is full
+    if (!FlashWear.allow(FlashWriter_t::History)) {
+        return;
+    }
+
+    for (auto& store : _stores) {
+        if (!writePending(store)) {
+            MessageOutput.printf("Failed to write history file %s\r\n", store.Filename);
+        }
+    }
+
+    _lastFlush = time(nullptr);
+}
+
+bool HistoryClass::openStore(Store_t& store)
+{
+    if (store.Valid) {
+        return true;
+    }
+
+    File f = LittleFS.open(store.Filename, "r", false);
+    if (f) {
+        HistoryFileHeader_t header;
+        const bool ok = f.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) == sizeof(header)
+            && header.Magic == HISTORY_MAGIC
+            && header.Version == HISTORY_VERSION
+            && header.RecordSize == sizeof(HistoryRecord_t)
+            && header.Capacity == store.Capacity
+            && header.Head < header.Capacity
+            && header.Count <= header.Capacity;
+        f.close();
+
+        if (ok) {
+            store.Header = header;
+            store.Valid = true;
+            return true;
+        }
+    }
+
+    // Missing or incompatible, start a new file
+    f = LittleFS.open(store.Filename, "w");
+    if (!f) {
+        return false;
+    }
+
+    store.Header = { HISTORY_MAGIC, HISTORY_VERSION, sizeof(HistoryRecord_t), store.Capacity, 0, 0 };
+    store.Valid = f.write(reinterpret_cast<const uint8_t*>(&store.Header), sizeof(store.Header)) == sizeof(store.Header);
+    f.close();
+    return store.Valid;
+}
+
+bool HistoryClass::writePending(Store_t& store)
+{
+    if (store.Pending.empty()) {
+        return true;
+    }
+
+    if (!openStore(store)) {
+        return false;
+    }
+
+    File f = LittleFS.open(store.Filename, "r+", false);
+    if (!f) {
+        store.Valid = false;
+        return false;
+    }
+
+    // The ring is only written at the head, so records are appended until the
+    // capacity is reached and the oldest ones are overwritten afterwards.
+    HistoryFileHeader_t header = store.Header;
+    bool ok = f.seek(sizeof(HistoryFileHeader_t) + header.Head * sizeof(HistoryRecord_t));
+    for (const auto& record : store.Pending) {
+        if (!ok) {
+            break;
+        }
+        ok = f.write(reinterpret_cast<const uint8_t*>(&record), sizeof(record)) == sizeof(record);
+
+        header.Head++;
+        header.Count = std::min(header.Count + 1, header.Capacity);
+        if (header.Head == header.Capacity) {
+            header.Head = 0;
+            ok = ok && f.seek(sizeof(HistoryFileHeader_t));
+        }
+    }
+
+    ok = ok && f.seek(0) && f.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header)) == sizeof(header);
+    f.close();
+
+    if (!ok) {
+        // Start over with a new file on the next attempt
+        store.Valid = false;
+        LittleFS.remove(store.Filename);
+        return false;
+    }
+
+    FlashWear.record(FlashWriter_t::History, store.Pending.size() * sizeof(HistoryRecord_t) + sizeof(header));
+    store.Header = header;
+    store.Pending.clear();
+    return true;
+}
+
+std::unique_ptr<HistoryReader> HistoryClass::getReader(const HistoryResolution_t resolution)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    Store_t& store = _stores[static_cast<size_t>(resolution)];
+
+    File f;
+    uint32_t first = 0;
+    uint32_t count = 0;
+    if (openStore(store)) {
+        f = LittleFS.open(store.Filename, "r", false);
+        if (f) {
+            first = (store.Header.Head + store.Header.Capacity - store.Header.Count) % store.Header.Capacity;
+            count = store.Header.Count;
+        }
+    }
+
+    return std::make_unique<HistoryReader>(f, first, count, store.Capacity, store.Pending);
+}
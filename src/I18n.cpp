@@ -3,14 +3,29 @@
  * Copyright (C) 2024 Thomas Basler and others
  */
 #include "I18n.h"
+#include "FlashWear.h"
+#include "HeapTelemetry.h"
 #include "MessageOutput.h"
 #include "Utils.h"
 #include "defaults.h"
 #include <ArduinoJson.h>
 #include <LittleFS.h>
+#include <algorithm>
+#include <memory>
 
 I18nClass I18n;
 
+const char* const I18nClass::_displayKeys[DISPLAY_STRING_COUNT] = {
+    "date_format",
+    "offline",
+    "power_w",
+    "power_kw",
+    "yield_today_wh",
+    "yield_today_kwh",
+    "yield_total_kwh",
+    "yield_total_mwh",
+};
+
 I18nClass::I18nClass()
 {
 }
@@ -46,113 +61,201 @@ void I18nClass::readDisplayStrings(
     String& yield_today_wh, String& yield_today_kwh,
     String& yield_total_kwh, String& yield_total_mwh)
 {
-    auto filename = getFilenameByLocale(locale);
-    if (filename == "") {
-        return;
+    auto record = std::make_unique<LangIndexRecord_t>();
+    if (!readIndexRecord(locale, *record)) {
+        // Index not available, parse the language pack itself
+        auto filename = getFilenameByLocale(locale);
+        if (filename == "" || !readConfig({ filename, 0, 0 }, *record)) {
+            return;
+        }
     }
 
-    JsonDocument filter;
-    filter["display"] = true;
+    String* const strings[DISPLAY_STRING_COUNT] = {
+        &date_format, &offline, &power_w, &power_kw,
+        &yield_today_wh, &yield_today_kwh, &yield_total_kwh, &yield_total_mwh
+    };
 
-    File f = LittleFS.open(filename, "r", false);
+    for (uint8_t i = 0; i < DISPLAY_STRING_COUNT; i++) {
+        if (record->display[i][0] != '\0') {
+            *strings[i] = record->display[i];
+        }
+    }
+}
 
-    JsonDocument doc;
+void I18nClass::readLangPacks()
+{
+    const auto files = listLangPacks();
 
-    // Deserialize the JSON document
-    const DeserializationError error = deserializeJson(doc, f, DeserializationOption::Filter(filter));
-    if (error) {
-        MessageOutput.printf("Failed to read file %s\r\n", filename.c_str());
-        f.close();
+    if (readIndex(files)) {
         return;
     }
 
-    if (!Utils::checkJsonAlloc(doc, __FUNCTION__, __LINE__)) {
-        return;
-    }
+    buildIndex(files);
+}
 
-    auto displayData = doc["display"];
+std::vector<I18nClass::LangFile_t> I18nClass::listLangPacks()
+{
+    std::vector<LangFile_t> files;
 
-    if (displayData["date_format"].as<String>() != "null") {
-        date_format = displayData["date_format"].as<String>();
+    auto root = LittleFS.open("/");
+    auto file = root.openNextFile();
+    while (file) {
+        const String path = file.path();
+        if (!file.isDirectory() && path.endsWith(LANG_PACK_SUFFIX)) {
+            files.push_back({ path, static_cast<uint32_t>(file.size()), static_cast<uint32_t>(file.getLastWrite()) });
+        }
+        file.close();
+        file = root.openNextFile();
     }
+    root.close();
 
-    if (displayData["offline"].as<String>() != "null") {
-        offline = displayData["offline"].as<String>();
-    }
+    return files;
+}
 
-    if (displayData["power_w"].as<String>() != "null") {
-        power_w = displayData["power_w"].as<String>();
+bool I18nClass::readIndex(const std::vector<LangFile_t>& files)
+{
+    File f = LittleFS.open(LANG_INDEX_FILENAME, "r", false);
+    if (!f) {
+        return false;
     }
 
-    if (displayData["power_kw"].as<String>() != "null") {
-        power_kw = displayData["power_kw"].as<String>();
+    LangIndexHeader_t header;
+    if (f.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header)
+        || header.magic != LANG_INDEX_MAGIC
+        || header.version != LANG_INDEX_VERSION
+        || header.count != files.size()) {
+        f.close();
+        return false;
     }
 
-    if (displayData["yield_today_wh"].as<String>() != "null") {
-        yield_today_wh = displayData["yield_today_wh"].as<String>();
-    }
+    std::list<LanguageInfo_t> languages;
+    auto record = std::make_unique<LangIndexRecord_t>();
 
-    if (displayData["yield_today_kwh"].as<String>() != "null") {
-        yield_today_kwh = displayData["yield_today_kwh"].as<String>();
-    }
+    for (uint16_t i = 0; i < header.count; i++) {
+        if (f.read(reinterpret_cast<uint8_t*>(record.get()), sizeof(LangIndexRecord_t)) != sizeof(LangIndexRecord_t)) {
+            f.close();
+            return false;
+        }
 
-    if (displayData["yield_total_kwh"].as<String>() != "null") {
-        yield_total_kwh = displayData["yield_total_kwh"].as<String>();
-    }
+        // Any added, removed or changed language pack invalidates the index
+        auto it = std::find_if(files.begin(), files.end(), [&record](const LangFile_t& file) {
+            return file.filename == record->filename;
+        });
+        if (it == files.end() || it->size != record->size || it->lastWrite != record->lastWrite) {
+            f.close();
+            return false;
+        }
 
-    if (displayData["yield_total_mwh"].as<String>() != "null") {
-        yield_total_mwh = displayData["yield_total_mwh"].as<String>();
+        if (record->code[0] != '\0' && record->name[0] != '\0') {
+            languages.push_back({ record->code, record->name, record->filename });
+        }
     }
 
     f.close();
+    _availLanguages = std::move(languages);
+    return true;
 }
 
-void I18nClass::readLangPacks()
+void I18nClass::buildIndex(const std::vector<LangFile_t>& files)
 {
-    auto root = LittleFS.open("/");
-    auto file = root.getNextFileName();
+    MessageOutput.println("Building language pack index");
+
+    File f = LittleFS.open(LANG_INDEX_FILENAME, "w");
+    if (f) {
+        const LangIndexHeader_t header = { LANG_INDEX_MAGIC, LANG_INDEX_VERSION, static_cast<uint16_t>(files.size()) };
+        f.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+    }
+
+    _availLanguages.clear();
+    auto record = std::make_unique<LangIndexRecord_t>();
+
+    for (const auto& file : files) {
+        MessageOutput.printf("Read File %s\r\n", file.filename.c_str());
 
-    while (file != "") {
-        if (file.endsWith(LANG_PACK_SUFFIX)) {
-            MessageOutput.printf("Read File %s\r\n", file.c_str());
-            readConfig(file);
+        // Invalid packs are kept in the index as well, so they are not parsed again on each boot
+        if (readConfig(file, *record)) {
+            _availLanguages.push_back({ record->code, record->name, file.filename });
+        }
+
+        if (f) {
+            f.write(reinterpret_cast<const uint8_t*>(record.get()), sizeof(LangIndexRecord_t));
         }
-        file = root.getNextFileName();
     }
-    root.close();
+
+    if (f) {
+        FlashWear.record(FlashWriter_t::System, f.size());
+        f.close();
+    }
 }
 
-void I18nClass::readConfig(String file)
+bool I18nClass::readConfig(const LangFile_t& file, LangIndexRecord_t& record)
 {
-    JsonDocument filter;
+    memset(&record, 0, sizeof(record));
+    strlcpy(record.filename, file.filename.c_str(), sizeof(record.filename));
+    record.size = file.size;
+    record.lastWrite = file.lastWrite;
+
+    JsonDocument filter(HeapTelemetry.getJsonAllocator(HeapTag_t::Config));
     filter["meta"] = true;
+    filter["display"] = true;
 
-    File f = LittleFS.open(file, "r", false);
+    File f = LittleFS.open(file.filename, "r", false);
 
-    JsonDocument doc;
+    JsonDocument doc(HeapTelemetry.getJsonAllocator(HeapTag_t::Config));
 
     // Deserialize the JSON document
     const DeserializationError error = deserializeJson(doc, f, DeserializationOption::Filter(filter));
+    f.close();
     if (error) {
-        MessageOutput.printf("Failed to read file %s\r\n", file.c_str());
-        f.close();
-        return;
+        MessageOutput.printf("Failed to read file %s\r\n", file.filename.c_str());
+        return false;
     }
 
     if (!Utils::checkJsonAlloc(doc, __FUNCTION__, __LINE__)) {
-        return;
+        return false;
     }
 
-    LanguageInfo_t lang;
-    lang.code = String(doc["meta"]["code"] | "");
-    lang.name = String(doc["meta"]["name"] | "");
-    lang.filename = file;
+    strlcpy(record.code, doc["meta"]["code"] | "", sizeof(record.code));
+    strlcpy(record.name, doc["meta"]["name"] | "", sizeof(record.name));
 
-    if (lang.code != "" && lang.name != "") {
-        _availLanguages.push_back(lang);
-    } else {
+    auto displayData = doc["display"];
+    for (uint8_t i = 0; i < DISPLAY_STRING_COUNT; i++) {
+        strlcpy(record.display[i], displayData[_displayKeys[i]] | "", sizeof(record.display[i]));
+    }
+
+    if (record.code[0] == '\0' || record.name[0] == '\0') {
         MessageOutput.printf("Invalid meta data\r\n");
+        return false;
+    }
+
+    return true;
+}
+
+bool I18nClass::readIndexRecord(const String& locale, LangIndexRecord_t& record) const
+{
+    File f = LittleFS.open(LANG_INDEX_FILENAME, "r", false);
+    if (!f) {
+        return false;
+    }
+
+    LangIndexHeader_t header;
+    if (f.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header)
+        || header.magic != LANG_INDEX_MAGIC
+        || header.version != LANG_INDEX_VERSION) {
+        f.close();
+        return false;
+    }
+
+    for (uint16_t i = 0; i < header.count; i++) {
+        if (f.read(reinterpret_cast<uint8_t*>(&record), sizeof(record)) != sizeof(record)) {
+            break;
+        }
+        if (locale == record.code) {
+            f.close();
+            return true;
+        }
     }
 
     f.close();
+    return false;
 }
@@ -0,0 +1,306 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "InfluxExport.h"
+#include "CertStore.h"
+#include "Configuration.h"
+#include "EventBus.h"
+#include "FieldRecord.h"
+#include "MessageOutput.h"
+#include "NtpSettings.h"
+#include "TaskProfiler.h"
+#include <HTTPClient.h>
+#include <WiFiClientSecure.h>
+#include <WiFiUdp.h>
+#include <algorithm>
+#include <ctime>
+
+InfluxExportClass InfluxExport;
+
+static void appendString(std::vector<char>& buffer, const char* str)
+{
+    buffer.insert(buffer.end(), str, str + strlen(str));
+}
+
+// Commas, spaces and equal signs have to be escaped in tag values
+static void appendTag(std::vector<char>& buffer, const char* key, const char* value)
+{
+    buffer.push_back(',');
+    appendString(buffer, key);
+    buffer.push_back('=');
+    for (const char* c = value; *c != '\0'; c++) {
+        if (*c == ',' || *c == ' ' || *c == '=') {
+            buffer.push_back('\\');
+        }
+        buffer.push_back(*c);
+    }
+}
+
+InfluxExportClass::InfluxExportClass()
+    : _loopTask(TASK_SECOND, TASK_FOREVER)
+{
+}
+
+void InfluxExportClass::init(Scheduler& scheduler)
+{
+    scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "InfluxExport.loop", std::bind(&InfluxExportClass::loop, this));
+    _loopTask.enable();
+
+    EventBus.subscribe(Event_t::StatisticsUpdated, _loopTask);
+}
+
+void InfluxExportClass::reconfigure()
+{
+    _reconfigure = true;
+}
+
+InfluxExportStats_t InfluxExportClass::getStats()
+{
+    std::lock_guard<std::mutex> lock(_statsMutex);
+    return _stats;
+}
+
+void InfluxExportClass::loop()
+{
+    const CONFIG_T& config = Configuration.get();
+    if (!config.Influx.Enabled || config.Influx.Url[0] == '\0') {
+        _pending.clear();
+        _pendingLines = 0;
+        return;
+    }
+
+    if (_taskHandle == nullptr) {
+        if (xTaskCreatePinnedToCore(taskProc, "INFLUX", INFLUX_TASK_STACK_SIZE, this,
+                INFLUX_TASK_PRIORITY, &_taskHandle, INFLUX_TASK_CORE)
+            != pdPASS) {
+            _taskHandle = nullptr;
+            MessageOutput.println("Influx: Could not create task");
+            return;
+        }
+        _pending.reserve(INFLUX_BATCH_SIZE);
+    }
+
+    Hoymiles.forEachInverter([this](InverterAbstract& inv, const uint8_t i) {
+        if (i >= _lastStats.size()) {
+            _lastStats.resize(i + 1, 0);
+        }
+
+        const uint32_t lastUpdate = inv.Statistics()->getLastUpdateFromInternal();
+        if (inv.Statistics()->getLastUpdate() == 0 || lastUpdate == _lastStats[i]) {
+            return;
+        }
+        _lastStats[i] = lastUpdate;
+
+        appendInverter(inv);
+    });
+
+    const uint32_t now = millis();
+    if (_pendingLines == 0 || _busy) {
+        return;
+    }
+    if (now - _lastFlush < config.Influx.FlushInterval * 1000 && _pending.size() < INFLUX_BATCH_SIZE / 2) {
+        return;
+    }
+
+    _sending.swap(_pending);
+    _sendingLines = _pendingLines;
+    _pending.clear();
+    _pendingLines = 0;
+    _lastFlush = now;
+
+    _busy = true;
+    xTaskNotifyGive(_taskHandle);
+}
+
+void InfluxExportClass::appendInverter(InverterAbstract& inv)
+{
+    StatisticsParser* stats = inv.Statistics();
+
+    // Nanoseconds of the response, without a valid time the server sets its own
+    char timestamp[24] = "";
+    if (NtpSettings.isTimeConfident()) {
+        snprintf(timestamp, sizeof(timestamp), " %lld000000000",
+            static_cast<long long>(std::time(nullptr) - stats->getDataAge() / 1000));
+    }
+
+    const auto record = FieldRecord.get(inv);
+    uint32_t lines = 0;
+    uint32_t dropped = 0;
+    size_t lineStart = 0;
+
+    // One line per channel, the entries of a channel follow each other
+    for (size_t pos = 0; pos < record->Entries.size(); pos++) {
+        const FieldRecordEntry_t& entry = record->Entries[pos];
+        const bool first = pos == 0 || entry.Type != record->Entries[pos - 1].Type || entry.Channel != record->Entries[pos - 1].Channel;
+        const bool last = pos + 1 == record->Entries.size() || entry.Type != record->Entries[pos + 1].Type || entry.Channel != record->Entries[pos + 1].Channel;
+
+        if (first) {
+            lineStart = _pending.size();
+            char channel[4];
+            snprintf(channel, sizeof(channel), "%d", static_cast<int>(entry.Channel));
+
+            appendString(_pending, INFLUX_MEASUREMENT);
+            appendTag(_pending, "serial", inv.serialString());
+            appendTag(_pending, "name", inv.name());
+            appendTag(_pending, "type", stats->getChannelTypeName(entry.Type));
+            appendTag(_pending, "channel", channel);
+        }
+
+        _pending.push_back(first ? ' ' : ',');
+        appendString(_pending, entry.Name);
+        _pending.push_back('=');
+        _pending.insert(_pending.end(), entry.Formatted, entry.Formatted + entry.Length);
+
+        if (!last) {
+            continue;
+        }
+
+        appendString(_pending, timestamp);
+        _pending.push_back('\n');
+
+        if (_pending.size() > INFLUX_BATCH_SIZE) {
+            _pending.resize(lineStart);
+            dropped++;
+        } else {
+            lines++;
+        }
+    }
+
+    _pendingLines += lines;
+    if (dropped > 0) {
+        std::lock_guard<std::mutex> lock(_statsMutex);
+        _stats.LinesDropped += dropped;
+    }
+}
+
+void InfluxExportClass::taskProc(void* param)
+{
+    InfluxExportClass* exporter = static_cast<InfluxExportClass*>(param);
+    exporter->run();
+}
+
+void InfluxExportClass::run()
+{
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // A kept alive connection belongs to the old destination
+        if (_reconfigure.exchange(false)) {
+            delete _http;
+            delete _client;
+            _http = nullptr;
+            _client = nullptr;
+            _rootCa = String();
+        }
+
+        const bool udp = strncmp(Configuration.get().Influx.Url, "udp://", 6) == 0;
+        const bool ok = udp ? sendUdp(_sending) : sendHttp(_sending);
+
+        {
+            std::lock_guard<std::mutex> lock(_statsMutex);
+            _stats.Batches++;
+            if (ok) {
+                _stats.LinesSent += _sendingLines;
+                _stats.BytesSent += _sending.size();
+            } else {
+                _stats.LinesFailed += _sendingLines;
+            }
+        }
+
+        _sending.clear();
+        _busy = false;
+    }
+}
+
+bool InfluxExportClass::sendUdp(const std::vector<char>& batch)
+{
+    const String url = Configuration.get().Influx.Url;
+    const int portPos = url.lastIndexOf(':');
+    if (portPos <= 5) {
+        return false;
+    }
+    const String host = url.substring(6, portPos);
+    const uint16_t port = url.substring(portPos + 1).toInt();
+
+    WiFiUDP client;
+    bool ok = true;
+    size_t pos = 0;
+
+    while (pos < batch.size()) {
+        // Split at the last line end which fits into the datagram, a longer line is sent alone
+        size_t end = std::min(pos + INFLUX_UDP_PACKET_SIZE, batch.size());
+        if (end < batch.size()) {
+            size_t split = end;
+            while (split > pos && batch[split - 1] != '\n') {
+                split--;
+            }
+            if (split > pos) {
+                end = split;
+            } else {
+                const auto lineEnd = std::find(batch.begin() + pos, batch.end(), '\n');
+                end = std::min<size_t>(lineEnd - batch.begin() + 1, batch.size());
+            }
+        }
+
+        ok &= client.beginPacket(host.c_str(), port) == 1
+            && client.write(reinterpret_cast<const uint8_t*>(&batch[pos]), end - pos) == end - pos
+            && client.endPacket() == 1;
+        pos = end;
+    }
+
+    return ok;
+}
+
+bool InfluxExportClass::sendHttp(const std::vector<char>& batch)
+{
+    const CONFIG_T& config = Configuration.get();
+    const String url = config.Influx.Url;
+
+    if (_http == nullptr) {
+        if (url.startsWith("https://")) {
+            // The token must only reach the configured server, the client keeps a
+            // pointer to the certificate as long as it exists
+            _rootCa = CertStore.read(Cert_t::InfluxRootCa);
+            if (_rootCa.isEmpty()) {
+                return false;
+            }
+            auto secure = new WiFiClientSecure();
+            secure->setCACert(_rootCa.c_str());
+            _client = secure;
+        } else {
+            _client = new WiFiClient();
+        }
+
+        _http = new HTTPClient();
+        _http->setReuse(true);
+        _http->setTimeout(INFLUX_TIMEOUT);
+        _http->setConnectTimeout(INFLUX_TIMEOUT);
+    }
+
+    if (!_http->begin(*_client, url)) {
+        return false;
+    }
+
+    _http->addHeader("Content-Type", "text/plain; charset=utf-8");
+    if (config.Influx.Token[0] != '\0') {
+        _http->addHeader("Authorization", String("Token ") + config.Influx.Token);
+    }
+
+    const int code = _http->POST(reinterpret_cast<uint8_t*>(const_cast<char*>(batch.data())), batch.size());
+    _http->end();
+
+    const bool ok = code == HTTP_CODE_NO_CONTENT || code == HTTP_CODE_OK;
+
+    {
+        std::lock_guard<std::mutex> lock(_statsMutex);
+        // Only log changes, a server which is down would fill the console otherwise
+        if (!ok && code != _stats.LastHttpCode) {
+            MessageOutput.printf("Influx: write failed with %d\r\n", code);
+        }
+        _stats.LastHttpCode = code;
+    }
+
+    return ok;
+}
@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "InverterCache.h"
+#include "FsWorker.h"
+#include "MessageOutput.h"
+#include "TaskProfiler.h"
+#include <LittleFS.h>
+
+InverterCacheClass InverterCache;
+
+InverterCacheClass::InverterCacheClass()
+    : _loopTask(INVERTER_CACHE_CHECK_INTERVAL * TASK_MILLISECOND, TASK_FOREVER)
+{
+}
+
+void InverterCacheClass::init(Scheduler& scheduler)
+{
+    scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "InverterCache.loop", std::bind(&InverterCacheClass::loop, this));
+    _loopTask.enable();
+}
+
+String InverterCacheClass::getFilename(const uint64_t serial)
+{
+    char filename[32];
+    snprintf(filename, sizeof(filename), "/inv_%0" PRIx32 "%08" PRIx32 ".bin",
+        static_cast<uint32_t>((serial >> 32) & 0xFFFFFFFF),
+        static_cast<uint32_t>(serial & 0xFFFFFFFF));
+    return filename;
+}
+
+bool InverterCacheClass::read(const uint64_t serial, InverterCacheFile_t& file)
+{
+    File f = LittleFS.open(getFilename(serial), "r", false);
+    if (!f) {
+        return false;
+    }
+
+    const bool ok = f.read(reinterpret_cast<uint8_t*>(&file), sizeof(file)) == sizeof(file)
+        && file.Magic == INVERTER_CACHE_MAGIC
+        && file.Version == INVERTER_CACHE_VERSION
+        && file.Serial == serial
+        && file.GridProfileLength <= GRID_PROFILE_SIZE;
+    f.close();
+    return ok;
+}
+
+void InverterCacheClass::write(const InverterCacheFile_t& file)
+{
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(&file);
+    FsWorker.write(getFilename(file.Serial), std::vector<uint8_t>(data, data + sizeof(file)), FlashWriter_t::InverterCache);
+}
+
+void InverterCacheClass::restore(InverterAbstract& inv)
+{
+    InverterCacheFile_t file;
+    if (!read(inv.serial(), file)) {
+        return;
+    }
+
+    if (file.DevInfo.AllLength > 0 && file.DevInfo.SimpleLength > 0) {
+        inv.DevInfo()->restoreRawData(file.DevInfo);
+    }
+    if (file.GridProfileLength > 0) {
+        inv.GridProfile()->restoreRawData(file.GridProfile, file.GridProfileLength);
+    }
+    MessageOutput.printf("Inverter %s: restored device info and grid profile\r\n", inv.serialString());
+}
+
+void InverterCacheClass::remove(const uint64_t serial)
+{
+    const String filename = getFilename(serial);
+    FsWorker.discard(filename);
+    FsWorker.remove(filename);
+}
+
+void InverterCacheClass::loop()
+{
+    _state.resize(Hoymiles.getNumInverters());
+
+    Hoymiles.forEachInverter([&](InverterAbstract& inv, const uint8_t i) {
+        if (i >= _state.size()) {
+            _state.resize(i + 1);
+        }
+
+        CacheState_t& state = _state[i];
+        if (state.Serial != inv.serial()) {
+            state = CacheState_t();
+            state.Serial = inv.serial();
+            if (!read(state.Serial, state.File)) {
+                state.File = {};
+                state.File.Magic = INVERTER_CACHE_MAGIC;
+                state.File.Version = INVERTER_CACHE_VERSION;
+                state.File.Serial = state.Serial;
+            }
+        }
+
+        bool changed = false;
+
+        // Restored data is already on flash, only answers of the inverter are stored
+        auto devInfo = inv.DevInfo();
+        if (!devInfo->isRestored() && devInfo->containsValidData()
+            && devInfo->getLastUpdateAll() != state.LastDevInfo) {
+            state.LastDevInfo = devInfo->getLastUpdateAll();
+
+            const DevInfoRawData_t raw = devInfo->getRawData();
+            if (memcmp(&raw, &state.File.DevInfo, sizeof(raw)) != 0) {
+                state.File.DevInfo = raw;
+                changed = true;
+            }
+
+            if (inv.GridProfile()->isRestored() && state.File.GridProfileFwBuild != devInfo->getFwBuildVersion()) {
+                MessageOutput.printf("Inverter %s: firmware has changed, request grid profile\r\n", inv.serialString());
+                inv.sendGridOnProFileParaRequest();
+            }
+        }
+
+        auto gridProfile = inv.GridProfile();
+        if (!gridProfile->isRestored() && gridProfile->containsValidData()
+            && gridProfile->getLastUpdate() != state.LastGridProfile) {
+            state.LastGridProfile = gridProfile->getLastUpdate();
+
+            const std::vector<uint8_t> raw = gridProfile->getRawData();
+            const uint16_t fwBuild = devInfo->containsValidData() ? devInfo->getFwBuildVersion() : 0;
+            if (raw.size() <= GRID_PROFILE_SIZE
+                && (raw.size() != state.File.GridProfileLength
+                    || memcmp(raw.data(), state.File.GridProfile, raw.size()) != 0
+                    || fwBuild != state.File.GridProfileFwBuild)) {
+                memset(state.File.GridProfile, 0, sizeof(state.File.GridProfile));
+                memcpy(state.File.GridProfile, raw.data(), raw.size());
+                state.File.GridProfileLength = raw.size();
+                state.File.GridProfileFwBuild = fwBuild;
+                changed = true;
+            }
+        }
+
+        if (changed) {
+            write(state.File);
+        }
+    });
+}
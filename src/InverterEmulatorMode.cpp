@@ -0,0 +1,204 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "InverterEmulatorMode.h"
+#include "Configuration.h"
+#include "MessageOutput.h"
+#include "PinMapping.h"
+#include "TaskProfiler.h"
+#include <Hoymiles.h>
+#include <RF24.h>
+#include <SpiManager.h>
+#include <cmt2300wrapper.h>
+
+#ifdef INVERTER_EMULATOR
+
+InverterEmulatorModeClass InverterEmulatorMode;
+
+// Radio address of the 4 byte id as within the packets
+static uint64_t getRadioAddress(const uint8_t id[])
+{
+    return 0x01ULL
+        | static_cast<uint64_t>(id[0]) << 8
+        | static_cast<uint64_t>(id[1]) << 16
+        | static_cast<uint64_t>(id[2]) << 24
+        | static_cast<uint64_t>(id[3]) << 32;
+}
+
+InverterEmulatorModeClass::InverterEmulatorModeClass()
+    : _loopTask(TASK_MILLISECOND, TASK_FOREVER)
+{
+}
+
+void InverterEmulatorModeClass::init(Scheduler& scheduler)
+{
+    MessageOutput.print("Initialize inverter emulator... ");
+
+    // The other modules expect the radio objects, they are never initialized
+    Hoymiles.setMessageOutput(&MessageOutput);
+    Hoymiles.init();
+
+    std::vector<uint64_t> nrfSerials;
+    const CONFIG_T& config = Configuration.get();
+    for (const auto& inv : config.Inverter) {
+        if (inv.Serial == 0) {
+            continue;
+        }
+        if (!_emulator.addInverter(inv.Serial)) {
+            MessageOutput.printf("  Unknown inverter type of %0" PRIx32 "%08" PRIx32 "\r\n",
+                static_cast<uint32_t>(inv.Serial >> 32), static_cast<uint32_t>(inv.Serial));
+            continue;
+        }
+
+        if (HoymilesClass::findModel(inv.Serial)->Radio == InverterRadioType_t::Nrf) {
+            nrfSerials.push_back(inv.Serial);
+        }
+    }
+    _emulator.setLoss(INVERTER_EMULATOR_LOSS);
+
+    if (!nrfSerials.empty() && PinMapping.isValidNrf24Config()) {
+        initNrf(nrfSerials);
+    }
+    if (nrfSerials.size() < _emulator.getInverterCount() && PinMapping.isValidCmt2300Config()) {
+        initCmt();
+    }
+
+    MessageOutput.printf("%u inverters, loss %d %%, latency %d ms\r\n",
+        _emulator.getInverterCount(), INVERTER_EMULATOR_LOSS, INVERTER_EMULATOR_LATENCY);
+
+    scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "InverterEmulatorMode.loop", std::bind(&InverterEmulatorModeClass::loop, this));
+    _loopTask.enable();
+}
+
+void InverterEmulatorModeClass::initNrf(const std::vector<uint64_t>& serials)
+{
+    const PinMapping_t& pin = PinMapping.get();
+
+    auto spi_bus = SpiManagerInst.claim_bus_arduino();
+    ESP_ERROR_CHECK(spi_bus ? ESP_OK : ESP_FAIL);
+
+    _spi = std::make_shared<SPIClass>(*spi_bus);
+    _spi->begin(pin.nrf24_clk, pin.nrf24_miso, pin.nrf24_mosi, pin.nrf24_cs);
+
+    // Same settings as the DTU, the acknowledge is sent by the chip
+    _nrf.reset(new RF24(pin.nrf24_en, pin.nrf24_cs));
+    _nrf->begin(_spi.get());
+    _nrf->setDataRate(RF24_250KBPS);
+    _nrf->enableDynamicPayloads();
+    _nrf->setCRCLength(RF24_CRC_16);
+    _nrf->setAddressWidth(5);
+    _nrf->setRetries(3, 15);
+    _nrf->setPALevel(static_cast<rf24_pa_dbm_e>(Configuration.get().Dtu.Nrf.PaLevel));
+    _nrf->setChannel(INVERTER_EMULATOR_NRF_CHANNEL);
+
+    if (!_nrf->isChipConnected()) {
+        MessageOutput.println("  NRF: Connection error");
+        _nrf.reset();
+        return;
+    }
+
+    for (size_t i = 0; i < serials.size(); i++) {
+        if (i >= INVERTER_EMULATOR_NRF_MAX_INVERTERS) {
+            MessageOutput.printf("  NRF: Only %d inverters can be emulated\r\n", INVERTER_EMULATOR_NRF_MAX_INVERTERS);
+            break;
+        }
+        uint8_t id[4];
+        CommandAbstract::convertSerialToPacketId(id, serials[i]);
+        _nrf->openReadingPipe(i, getRadioAddress(id));
+    }
+    _nrf->startListening();
+}
+
+void InverterEmulatorModeClass::initCmt()
+{
+    const PinMapping_t& pin = PinMapping.get();
+    const CONFIG_T& config = Configuration.get();
+
+    _cmt.reset(new CMT2300A(pin.cmt_sdio, pin.cmt_clk, pin.cmt_cs, pin.cmt_fcs));
+    _cmt->begin();
+    if (!_cmt->isChipConnected()) {
+        MessageOutput.println("  CMT: Connection error");
+        _cmt.reset();
+        return;
+    }
+
+    for (const auto& country : Hoymiles.getRadioCmt()->getCountryFrequencyList()) {
+        if (country.mode == config.Dtu.Cmt.CountryMode) {
+            _cmt->setFrequencyBand(country.definition.Band);
+        }
+    }
+    _cmt->setChannel((config.Dtu.Cmt.Frequency - _cmt->getBaseFrequency()) / HoymilesRadio_CMT::getChannelWidth());
+    _cmt->setPALevel(config.Dtu.Cmt.PaLevel);
+    _cmt->startListening();
+}
+
+void InverterEmulatorModeClass::loop()
+{
+    uint8_t packet[MAX_RF_PAYLOAD_SIZE];
+
+    if (_nrf != nullptr && _nrf->available()) {
+        const uint8_t len = std::min<uint8_t>(_nrf->getDynamicPayloadSize(), sizeof(packet));
+        _nrf->read(packet, len);
+        receive(Radio_t::Nrf, packet, len);
+    }
+
+    if (_cmt != nullptr && _cmt->available()) {
+        const uint8_t len = std::min<uint8_t>(_cmt->getDynamicPayloadSize(), sizeof(packet));
+        _cmt->read(packet, len);
+        _cmt->flush_rx();
+        receive(Radio_t::Cmt, packet, len);
+    }
+
+    const uint32_t now = millis();
+    for (auto it = _pending.begin(); it != _pending.end();) {
+        if (static_cast<int32_t>(now - it->Due) < 0) {
+            ++it;
+            continue;
+        }
+        send(*it);
+        it = _pending.erase(it);
+    }
+
+    if (now - _lastLog >= INVERTER_EMULATOR_LOG_INTERVAL) {
+        _lastLog = now;
+        const EmulatorStats_t stats = _emulator.getStats();
+        MessageOutput.printf("Emulator: %" PRIu32 " requests, %" PRIu32 " crc errors, %" PRIu32 " unknown, "
+                             "%" PRIu32 " fragments sent, %" PRIu32 " dropped\r\n",
+            stats.Requests, stats.CrcErrors, stats.Unknown, stats.FragmentsSent, stats.FragmentsDropped);
+    }
+}
+
+void InverterEmulatorModeClass::receive(const Radio_t radio, const uint8_t packet[], const uint8_t len)
+{
+    Pending_t pending;
+    if (!_emulator.handlePacket(packet, len, pending.Packets) || pending.Packets.empty()) {
+        return;
+    }
+    pending.Radio = radio;
+    pending.Due = millis() + INVERTER_EMULATOR_LATENCY;
+    _pending.push_back(std::move(pending));
+}
+
+void InverterEmulatorModeClass::send(const Pending_t& pending)
+{
+    if (pending.Radio == Radio_t::Nrf) {
+        _nrf->stopListening();
+        _nrf->openWritingPipe(getRadioAddress(&pending.Packets.front().Data[5]));
+        for (const auto& p : pending.Packets) {
+            _nrf->write(p.Data, p.Len);
+        }
+        // Restores the reading address of pipe 0
+        _nrf->startListening();
+        return;
+    }
+
+    _cmt->stopListening();
+    for (const auto& p : pending.Packets) {
+        _cmt->write(p.Data, p.Len);
+    }
+    _cmt->startListening();
+}
+
+#endif
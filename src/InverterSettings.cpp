@@ -4,17 +4,34 @@
  */
 #include "InverterSettings.h"
 #include "Configuration.h"
+#include "InverterCache.h"
+#include "LoopMonitor.h"
 #include "MessageOutput.h"
+#include "MqttCluster.h"
+#include "NetworkSettings.h"
 #include "PinMapping.h"
+#include "PollCalibration.h"
 #include "SunPosition.h"
+#include "TaskProfiler.h"
 #include <Hoymiles.h>
 #include <SpiManager.h>
+#include <vector>
 
 InverterSettingsClass InverterSettings;
 
+// The messages of the library are tagged with their level, by HOY_LOG_LEVEL_*
+static MessageChannel radioOutputs[] = {
+    { MessageOutput, MessageSubsystem_t::Radio, MessageLevel_t::None },
+    { MessageOutput, MessageSubsystem_t::Radio, MessageLevel_t::Error },
+    { MessageOutput, MessageSubsystem_t::Radio, MessageLevel_t::Warn },
+    { MessageOutput, MessageSubsystem_t::Radio, MessageLevel_t::Info },
+    { MessageOutput, MessageSubsystem_t::Radio, MessageLevel_t::Debug },
+    { MessageOutput, MessageSubsystem_t::Radio, MessageLevel_t::Verbose },
+};
+
 InverterSettingsClass::InverterSettingsClass()
-    : _settingsTask(INVERTER_UPDATE_SETTINGS_INTERVAL, TASK_FOREVER, std::bind(&InverterSettingsClass::settingsLoop, this))
-    , _hoyTask(TASK_IMMEDIATE, TASK_FOREVER, std::bind(&InverterSettingsClass::hoyLoop, this))
+    : _settingsTask(INVERTER_UPDATE_SETTINGS_INTERVAL, TASK_FOREVER)
+    , _hoyTask(TASK_IMMEDIATE, TASK_FOREVER)
 {
 }
 
@@ -26,7 +43,11 @@ void InverterSettingsClass::init(Scheduler& scheduler)
     // Initialize inverter communication
     MessageOutput.print("Initialize Hoymiles interface... ");
 
-    Hoymiles.setMessageOutput(&MessageOutput);
+    Hoymiles.setMessageOutput(&radioOutputs[HOY_LOG_LEVEL_INFO]);
+    for (uint8_t level = HOY_LOG_LEVEL_ERROR; level <= HOY_LOG_LEVEL_VERBOSE; level++) {
+        Hoymiles.setMessageOutput(level, &radioOutputs[level]);
+    }
+    Hoymiles.setLogLevel(static_cast<uint8_t>(MessageOutput.getMaxLevel(MessageSubsystem_t::Radio)));
     Hoymiles.init();
 
     if (PinMapping.isValidNrf24Config() || PinMapping.isValidCmt2300Config()) {
@@ -34,9 +55,16 @@ void InverterSettingsClass::init(Scheduler& scheduler)
             auto spi_bus = SpiManagerInst.claim_bus_arduino();
             ESP_ERROR_CHECK(spi_bus ? ESP_OK : ESP_FAIL);
 
-            SPIClass* spiClass = new SPIClass(*spi_bus);
+            auto spiClass = std::make_shared<SPIClass>(*spi_bus);
             spiClass->begin(pin.nrf24_clk, pin.nrf24_miso, pin.nrf24_mosi, pin.nrf24_cs);
-            Hoymiles.initNRF(spiClass, pin.nrf24_en, pin.nrf24_irq);
+            Hoymiles.initNRF(spiClass, pin.nrf24_cs, pin.nrf24_en, pin.nrf24_irq);
+
+            // Additional modules only have their own CS, CE and IRQ pins
+            for (uint8_t i = 0; i < PINMAPPING_NRF24_EXTRA_COUNT; i++) {
+                if (PinMapping.isValidNrf24ExtraConfig(i)) {
+                    Hoymiles.initNRF(spiClass, pin.nrf24_extra_cs[i], pin.nrf24_extra_en[i], pin.nrf24_extra_irq[i]);
+                }
+            }
         }
 
         if (PinMapping.isValidCmt2300Config()) {
@@ -48,17 +76,25 @@ void InverterSettingsClass::init(Scheduler& scheduler)
         }
 
         MessageOutput.println("  Setting radio PA level... ");
-        Hoymiles.getRadioNrf()->setPALevel((rf24_pa_dbm_e)config.Dtu.Nrf.PaLevel);
+        for (uint8_t i = 0; i < HOY_NRF_RADIO_COUNT; i++) {
+            Hoymiles.getRadioNrf(i)->setPALevel((rf24_pa_dbm_e)config.Dtu.Nrf.PaLevel);
+        }
         Hoymiles.getRadioCmt()->setPALevel(config.Dtu.Cmt.PaLevel);
 
         MessageOutput.println("  Setting DTU serial... ");
-        Hoymiles.getRadioNrf()->setDtuSerial(config.Dtu.Serial);
+        for (uint8_t i = 0; i < HOY_NRF_RADIO_COUNT; i++) {
+            Hoymiles.getRadioNrf(i)->setDtuSerial(config.Dtu.Serial);
+        }
         Hoymiles.getRadioCmt()->setDtuSerial(config.Dtu.Serial);
 
         MessageOutput.println("  Setting poll interval... ");
-        Hoymiles.setPollInterval(config.Dtu.PollInterval);
+        Hoymiles.setPollInterval(PollCalibration.getPollInterval());
+        Hoymiles.setAdaptivePolling(config.Dtu.AdaptivePolling);
+        Hoymiles.setSnapshotPolling(config.Dtu.SnapshotPolling);
+        Hoymiles.setTxPowerControl(config.Dtu.TxPowerControl);
+        Hoymiles.setLimitShaping(config.Dtu.LimitMinInterval, config.Dtu.LimitHysteresis);
 
-        for (uint8_t i = 0; i < INV_MAX_COUNT; i++) {
+        for (uint8_t i = 0; i < config.Inverter.size(); i++) {
             if (config.Inverter[i].Serial > 0) {
                 MessageOutput.printf("  Adding inverter: %0" PRIx32 "%08" PRIx32 " - %s",
                     static_cast<uint32_t>((config.Inverter[i].Serial >> 32) & 0xFFFFFFFF),
@@ -69,15 +105,8 @@ void InverterSettingsClass::init(Scheduler& scheduler)
                     config.Inverter[i].Serial);
 
                 if (inv != nullptr) {
-                    inv->setReachableThreshold(config.Inverter[i].ReachableThreshold);
-                    inv->setZeroValuesIfUnreachable(config.Inverter[i].ZeroRuntimeDataIfUnrechable);
-                    inv->setZeroYieldDayOnMidnight(config.Inverter[i].ZeroYieldDayOnMidnight);
-                    inv->setClearEventlogOnMidnight(config.Inverter[i].ClearEventlogOnMidnight);
-                    inv->Statistics()->setYieldDayCorrection(config.Inverter[i].YieldDayCorrection);
-                    for (uint8_t c = 0; c < INV_MAX_CHAN_COUNT; c++) {
-                        inv->Statistics()->setStringMaxPower(c, config.Inverter[i].channel[c].MaxChannelPower);
-                        inv->Statistics()->setChannelFieldOffset(TYPE_DC, static_cast<ChannelNum_t>(c), FLD_YT, config.Inverter[i].channel[c].YieldTotalOffset);
-                    }
+                    applyInverterConfig(*inv, config.Inverter[i]);
+                    InverterCache.restore(*inv);
                 }
                 MessageOutput.println(" done");
             }
@@ -88,19 +117,103 @@ void InverterSettingsClass::init(Scheduler& scheduler)
     }
 
     scheduler.addTask(_hoyTask);
+    TaskProfiler.setCallback(_hoyTask, "InverterSettings.hoyLoop", std::bind(&InverterSettingsClass::hoyLoop, this));
     _hoyTask.enable();
 
     scheduler.addTask(_settingsTask);
+    TaskProfiler.setCallback(_settingsTask, "InverterSettings.settingsLoop", std::bind(&InverterSettingsClass::settingsLoop, this));
     _settingsTask.enable();
 }
 
+void InverterSettingsClass::applyPollPlan(InverterAbstract& inv, const INVERTER_CONFIG_T& config)
+{
+    InverterPollPlan_t plan;
+    plan.StatsInterval = config.PollPlan.StatsInterval * 1000;
+    plan.AlarmInterval = config.PollPlan.AlarmInterval * 1000;
+    plan.LimitInterval = config.PollPlan.LimitInterval * 1000;
+    plan.AlarmOnDemand = config.PollPlan.AlarmOnDemand;
+    plan.GridProfileOnDemand = config.PollPlan.GridProfileOnDemand;
+    inv.setPollPlan(plan);
+}
+
+void InverterSettingsClass::applyInverterConfig(InverterAbstract& inv, const INVERTER_CONFIG_T& config)
+{
+    inv.setReachableThreshold(config.ReachableThreshold);
+    inv.setZeroValuesIfUnreachable(config.ZeroRuntimeDataIfUnrechable);
+    inv.setZeroYieldDayOnMidnight(config.ZeroYieldDayOnMidnight);
+    inv.setClearEventlogOnMidnight(config.ClearEventlogOnMidnight);
+    inv.Statistics()->setYieldDayCorrection(config.YieldDayCorrection);
+    applyPollPlan(inv, config);
+    for (uint8_t c = 0; c < INV_MAX_CHAN_COUNT; c++) {
+        inv.Statistics()->setStringMaxPower(c, config.channel[c].MaxChannelPower);
+        inv.Statistics()->setChannelFieldOffset(TYPE_DC, static_cast<ChannelNum_t>(c), FLD_YT, config.channel[c].YieldTotalOffset);
+    }
+}
+
+void InverterSettingsClass::applyInverterList()
+{
+    // Called by the web server, the configs are used while the inverter list is changed
+    auto configGuard = Configuration.getReadGuard();
+    const CONFIG_T& config = Configuration.get();
+
+    // Inverters which are not configured anymore
+    std::vector<uint64_t> removed;
+    Hoymiles.forEachInverter([&](InverterAbstract& inv, const uint8_t) {
+        if (Configuration.getInverterConfig(inv.serial()) == nullptr) {
+            removed.push_back(inv.serial());
+        }
+    });
+
+    // Unchanged serials keep their object with its parser state and queued commands.
+    // A new serial takes the position of a removed one (an edited serial), so the
+    // position based caches of the other inverters stay valid.
+    auto next = removed.begin();
+    for (const auto& inv_cfg : config.Inverter) {
+        auto inv = Hoymiles.getInverterBySerial(inv_cfg.Serial);
+        if (inv != nullptr) {
+            inv->setName(inv_cfg.Name);
+            applyInverterConfig(*inv, inv_cfg);
+            continue;
+        }
+
+        if (next != removed.end()) {
+            const uint64_t oldSerial = *next++;
+            InverterCache.remove(oldSerial);
+            inv = Hoymiles.replaceInverter(oldSerial, inv_cfg.Name, inv_cfg.Serial);
+            if (inv == nullptr) {
+                // Unknown type of the new serial
+                Hoymiles.removeInverterBySerial(oldSerial);
+            }
+        } else {
+            inv = Hoymiles.addInverter(inv_cfg.Name, inv_cfg.Serial);
+        }
+        if (inv != nullptr) {
+            applyInverterConfig(*inv, inv_cfg);
+            InverterCache.restore(*inv);
+        }
+    }
+
+    for (; next != removed.end(); ++next) {
+        Hoymiles.removeInverterBySerial(*next);
+        InverterCache.remove(*next);
+    }
+
+    // Polling and commands follow the day period and the cluster ownership
+    forceUpdate();
+}
+
+void InverterSettingsClass::forceUpdate()
+{
+    _settingsTask.forceNextIteration();
+}
+
 void InverterSettingsClass::settingsLoop()
 {
     const CONFIG_T& config = Configuration.get();
     const bool isDayPeriod = SunPosition.isDayPeriod();
+    bool radioRequired = false;
 
-    for (uint8_t i = 0; i < INV_MAX_COUNT; i++) {
-        auto const& inv_cfg = config.Inverter[i];
+    for (auto const& inv_cfg : config.Inverter) {
         if (inv_cfg.Serial == 0) {
             continue;
         }
@@ -109,12 +222,52 @@ void InverterSettingsClass::settingsLoop()
             continue;
         }
 
-        inv->setEnablePolling(inv_cfg.Poll_Enable && (isDayPeriod || inv_cfg.Poll_Enable_Night));
+        // In cluster mode an inverter is only polled by the DTU which owns it
+        inv->setEnablePolling(inv_cfg.Poll_Enable && (isDayPeriod || inv_cfg.Poll_Enable_Night)
+            && MqttCluster.isOwner(inv_cfg.Serial));
         inv->setEnableCommands(inv_cfg.Command_Enable && (isDayPeriod || inv_cfg.Command_Enable_Night));
+        radioRequired |= inv->getEnablePolling() || inv->getEnableCommands();
     }
+
+    // The sunrise enables polling again and thereby ends the standby
+    updateStandby(config.Dtu.NightStandby && !isDayPeriod && !radioRequired);
+}
+
+void InverterSettingsClass::updateStandby(const bool standby)
+{
+    // A radio which was still busy is retried with the next settings loop
+    const bool radioStandby = Hoymiles.setStandby(standby);
+
+    if (standby == _standby || (standby && !radioStandby)) {
+        return;
+    }
+    _standby = standby;
+
+    NetworkSettings.setPowerSave(standby);
+
+    MessageOutput.printf("Night standby %s\r\n", standby ? "entered" : "left");
+}
+
+bool InverterSettingsClass::isStandby() const
+{
+    return _standby;
 }
 
 void InverterSettingsClass::hoyLoop()
 {
+    LoopMonitor.markHoymilesLoop(_hoyTask.getInterval());
+
+    // The packet dumps are only formatted while a console client subscribed to them
+    Hoymiles.setLogLevel(static_cast<uint8_t>(MessageOutput.getMaxLevel(MessageSubsystem_t::Radio)));
     Hoymiles.loop();
+
+    // A running exchange has to be served continuously, otherwise the loop only
+    // has to start the next poll or command
+    if (_standby) {
+        _hoyTask.setInterval(INVERTER_STANDBY_LOOP_INTERVAL * TASK_MILLISECOND);
+    } else if (Hoymiles.isAllRadioIdle()) {
+        _hoyTask.setInterval(INVERTER_IDLE_LOOP_INTERVAL * TASK_MILLISECOND);
+    } else {
+        _hoyTask.setInterval(TASK_IMMEDIATE);
+    }
 }
@@ -0,0 +1,203 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "JsonArena.h"
+#include "HeapTelemetry.h"
+#include <Arduino.h>
+#include <algorithm>
+#include <esp_heap_caps.h>
+#include <mutex>
+
+// Each block starts with its size, aligned for the variant slots of ArduinoJson
+#define JSON_ARENA_ALIGN 8
+#define JSON_ARENA_HEADER_SIZE 8
+
+namespace {
+constexpr std::array<uint32_t, 4> sizeClasses = { 1024, 4096, 16384, 65536 };
+
+constexpr uint32_t alignSize(const size_t size)
+{
+    return (size + JSON_ARENA_ALIGN - 1) & ~(JSON_ARENA_ALIGN - 1);
+}
+
+// Free chunks shared by all arenas, one stack per size class
+class ChunkCache {
+public:
+    uint8_t* take(const uint32_t size)
+    {
+        const int8_t cls = getClass(size);
+        if (cls >= 0) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto& stack = _free[cls];
+            if (_count[cls] > 0) {
+                return stack[--_count[cls]];
+            }
+        }
+
+        uint8_t* data = nullptr;
+        if (psramFound()) {
+            data = static_cast<uint8_t*>(heap_caps_malloc(size, MALLOC_CAP_SPIRAM));
+        }
+        if (data == nullptr) {
+            data = static_cast<uint8_t*>(heap_caps_malloc(size, MALLOC_CAP_8BIT));
+        }
+        if (data != nullptr) {
+            HeapTelemetry.onAlloc(HeapTag_t::WebApi, size);
+        }
+        return data;
+    }
+
+    void give(uint8_t* data, const uint32_t size)
+    {
+        const int8_t cls = getClass(size);
+        if (cls >= 0) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_count[cls] < JSON_ARENA_CHUNK_CACHE) {
+                _free[cls][_count[cls]++] = data;
+                return;
+            }
+        }
+
+        HeapTelemetry.onFree(HeapTag_t::WebApi, size);
+        heap_caps_free(data);
+    }
+
+private:
+    static int8_t getClass(const uint32_t size)
+    {
+        for (uint8_t i = 0; i < sizeClasses.size(); i++) {
+            if (sizeClasses[i] == size) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    std::array<std::array<uint8_t*, JSON_ARENA_CHUNK_CACHE>, sizeClasses.size()> _free = {};
+    std::array<uint8_t, sizeClasses.size()> _count = {};
+    std::mutex _mutex;
+};
+
+ChunkCache chunkCache;
+}
+
+JsonArena::~JsonArena()
+{
+    for (uint8_t i = 0; i < _chunkCount; i++) {
+        chunkCache.give(_chunks[i].Data, _chunks[i].Size);
+    }
+}
+
+void JsonArena::reset()
+{
+    for (uint8_t i = 0; i < _chunkCount; i++) {
+        _chunks[i].Used = 0;
+    }
+}
+
+void* JsonArena::allocate(size_t size)
+{
+    const uint32_t need = JSON_ARENA_HEADER_SIZE + alignSize(size);
+
+    Chunk_t* chunk = nullptr;
+    for (uint8_t i = 0; i < _chunkCount; i++) {
+        if (_chunks[i].Size - _chunks[i].Used >= need) {
+            chunk = &_chunks[i];
+            break;
+        }
+    }
+
+    if (chunk == nullptr) {
+        if (_chunkCount == _chunks.size()) {
+            return nullptr;
+        }
+
+        // Each new chunk is at least one size class larger than the previous one
+        const uint32_t minSize = _chunkCount > 0 ? _chunks[_chunkCount - 1].Size + 1 : 0;
+        uint32_t chunkSize = need;
+        for (const auto s : sizeClasses) {
+            if (s >= need && s >= minSize) {
+                chunkSize = s;
+                break;
+            }
+        }
+
+        uint8_t* data = chunkCache.take(chunkSize);
+        if (data == nullptr) {
+            return nullptr;
+        }
+
+        chunk = &_chunks[_chunkCount++];
+        *chunk = { data, chunkSize, 0 };
+    }
+
+    uint8_t* block = &chunk->Data[chunk->Used];
+    *reinterpret_cast<uint32_t*>(block) = size;
+    chunk->Used += need;
+    return block + JSON_ARENA_HEADER_SIZE;
+}
+
+void JsonArena::deallocate(void* ptr)
+{
+    if (ptr == nullptr) {
+        return;
+    }
+
+    uint8_t* block = static_cast<uint8_t*>(ptr) - JSON_ARENA_HEADER_SIZE;
+    Chunk_t* chunk = findChunk(block);
+    if (chunk != nullptr && isLastBlock(*chunk, block)) {
+        chunk->Used = block - chunk->Data;
+    }
+}
+
+void* JsonArena::reallocate(void* ptr, size_t newSize)
+{
+    if (ptr == nullptr) {
+        return allocate(newSize);
+    }
+
+    uint8_t* block = static_cast<uint8_t*>(ptr) - JSON_ARENA_HEADER_SIZE;
+    const uint32_t oldSize = *reinterpret_cast<uint32_t*>(block);
+
+    // The last block of a chunk grows and shrinks in place
+    Chunk_t* chunk = findChunk(block);
+    if (chunk != nullptr && isLastBlock(*chunk, block)) {
+        const uint32_t offset = block - chunk->Data;
+        const uint32_t need = JSON_ARENA_HEADER_SIZE + alignSize(newSize);
+        if (chunk->Size - offset >= need) {
+            *reinterpret_cast<uint32_t*>(block) = newSize;
+            chunk->Used = offset + need;
+            return ptr;
+        }
+    }
+
+    if (newSize <= oldSize) {
+        *reinterpret_cast<uint32_t*>(block) = newSize;
+        return ptr;
+    }
+
+    void* moved = allocate(newSize);
+    if (moved == nullptr) {
+        return nullptr;
+    }
+    memcpy(moved, ptr, oldSize);
+    deallocate(ptr);
+    return moved;
+}
+
+JsonArena::Chunk_t* JsonArena::findChunk(const uint8_t* block)
+{
+    for (uint8_t i = 0; i < _chunkCount; i++) {
+        if (block >= _chunks[i].Data && block < _chunks[i].Data + _chunks[i].Size) {
+            return &_chunks[i];
+        }
+    }
+    return nullptr;
+}
+
+bool JsonArena::isLastBlock(const Chunk_t& chunk, const uint8_t* block) const
+{
+    const uint32_t size = *reinterpret_cast<const uint32_t*>(block);
+    return block + JSON_ARENA_HEADER_SIZE + alignSize(size) == chunk.Data + chunk.Used;
+}
@@ -0,0 +1,185 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "KernelBenchmark.h"
+#include "MessageOutput.h"
+#include "TaskProfiler.h"
+#include "WebApi_prometheus.h"
+#include "WebApi_ws_live.h"
+#include <ArduinoJson.h>
+#include <atomic>
+#include <vector>
+
+#ifdef KERNEL_BENCHMARK
+
+KernelBenchmarkClass KernelBenchmark;
+
+namespace {
+
+// Only the allocations of the task which runs the benchmark are counted
+std::atomic<TaskHandle_t> countTask { nullptr };
+uint64_t heapBytes = 0;
+volatile uint32_t sink = 0;
+
+struct StatsField_t {
+    ChannelType_t Type;
+    ChannelNum_t Channel;
+    FieldId_t Field;
+};
+
+inline void countAlloc(const size_t size)
+{
+    const TaskHandle_t task = countTask.load(std::memory_order_relaxed);
+    if (task != nullptr && task == xTaskGetCurrentTaskHandle()) {
+        heapBytes += size;
+    }
+}
+
+} // namespace
+
+// env *_kernel_bench links with --wrap for these
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+    countAlloc(size);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+    countAlloc(count * size);
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    countAlloc(size);
+    return __real_realloc(ptr, size);
+}
+}
+
+KernelBenchmarkClass::KernelBenchmarkClass()
+    : _loopTask(KERNEL_BENCHMARK_DELAY * TASK_SECOND, TASK_ONCE)
+{
+}
+
+void KernelBenchmarkClass::init(Scheduler& scheduler)
+{
+    MessageOutput.printf("Kernel benchmark enabled, run starts in %d s\r\n", KERNEL_BENCHMARK_DELAY);
+
+    scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "KernelBenchmark.run", std::bind(&KernelBenchmarkClass::run, this));
+    _loopTask.enableDelayed();
+}
+
+template <typename F>
+void KernelBenchmarkClass::measure(const char* kernel, const char* payload, F&& f)
+{
+    // Warm up, caches and buffers which are allocated once are not counted
+    sink = sink + static_cast<uint32_t>(f());
+
+    heapBytes = 0;
+    countTask.store(xTaskGetCurrentTaskHandle(), std::memory_order_relaxed);
+    uint64_t cycles = 0;
+    for (uint32_t i = 0; i < KERNEL_BENCHMARK_ITERATIONS; i++) {
+        // Per call, the 32 bit cycle counter wraps after a few seconds
+        const uint32_t start = ESP.getCycleCount();
+        sink = sink + static_cast<uint32_t>(f());
+        cycles += ESP.getCycleCount() - start;
+    }
+    countTask.store(nullptr, std::memory_order_relaxed);
+
+    MessageOutput.printf("PERF opendtu_bench_ns_per_op{kernel=\"%s\",payload=\"%s\"} %.1f\r\n",
+        kernel, payload, cycles * 1000.0 / getCpuFrequencyMhz() / KERNEL_BENCHMARK_ITERATIONS);
+    MessageOutput.printf("PERF opendtu_bench_heap_bytes_per_op{kernel=\"%s\",payload=\"%s\"} %.1f\r\n",
+        kernel, payload, static_cast<double>(heapBytes) / KERNEL_BENCHMARK_ITERATIONS);
+}
+
+void KernelBenchmarkClass::run()
+{
+    MessageOutput.println("Kernel benchmark: run started");
+    MessageOutput.printf("PERF opendtu_perf_info{build=\"%s\",env=\"%s\"} 1\r\n", __COMPILED_GIT_HASH__, PIOENV);
+
+    Hoymiles.forEachInverter([this](InverterAbstract& inv, const uint8_t idx) {
+        if (inv.Statistics()->getLastUpdate() == 0) {
+            MessageOutput.printf("Kernel benchmark: %s has no data, skipped\r\n", inv.serialString());
+            return;
+        }
+        runInverter(inv, idx);
+    });
+
+    MessageOutput.println("PERF opendtu_perf_done 1");
+    MessageOutput.println("Kernel benchmark: run finished");
+}
+
+void KernelBenchmarkClass::runInverter(InverterAbstract& inv, const uint8_t idx)
+{
+    const char* payload = inv.typeName();
+
+    StatisticsParser* stats = inv.Statistics();
+    std::vector<StatsField_t> fields;
+    for (auto& t : stats->getChannelTypes()) {
+        for (auto& c : stats->getChannelsByType(t)) {
+            for (uint8_t f = 0; f < FLD_CNT; f++) {
+                if (stats->hasChannelFieldValue(t, c, static_cast<FieldId_t>(f))) {
+                    fields.push_back({ t, c, static_cast<FieldId_t>(f) });
+                }
+            }
+        }
+    }
+    if (!fields.empty()) {
+        size_t i = 0;
+        measure("StatisticsParser::getChannelFieldValue", payload, [&]() {
+            const StatsField_t& f = fields[i];
+            i = (i + 1) % fields.size();
+            return stats->getChannelFieldValue(f.Type, f.Channel, f.Field);
+        });
+    }
+
+    AlarmLogParser* eventLog = inv.EventLog();
+    const uint8_t entryCount = eventLog->getEntryCount();
+    if (entryCount > 0) {
+        uint8_t i = 0;
+        AlarmLogEntry_t entry;
+        measure("AlarmLogParser::getLogEntry", payload, [&]() {
+            eventLog->getLogEntry(i, entry);
+            i = (i + 1) % entryCount;
+            return entry.MessageId;
+        });
+    }
+
+    // Decoded once per response, a copy of the received profile is decoded again and again
+    const std::vector<uint8_t> rawProfile = inv.GridProfile()->getRawData();
+    if (!rawProfile.empty()) {
+        GridProfileParser parser;
+        measure("GridProfileParser::getProfile", payload, [&]() {
+            parser.restoreRawData(rawProfile.data(), rawProfile.size());
+            auto profile = parser.getProfile();
+            return profile != nullptr ? profile->ItemCount : 0;
+        });
+    }
+
+    measure("WebApiWsLive::generateInverterChannelJsonResponse", payload, [&]() {
+        JsonDocument doc;
+        JsonObject root = doc.to<JsonObject>();
+        WebApiWsLiveClass::generateInverterChannelJsonResponse(root, inv);
+        return measureJson(doc);
+    });
+
+    // Own instance, the cache of the scrapes stays untouched
+    WebApiPrometheusClass prometheus;
+    prometheus._inverterCache.resize(idx + 1);
+    const auto& cache = prometheus.getInverterCache(idx, inv);
+    measure("WebApiPrometheus::addFields", payload, [&]() {
+        WebApiPrometheusClass::ScrapeBuffer buffer(false, cache.EstimatedSize);
+        prometheus.addFields(&buffer, cache, idx, inv);
+        return buffer.getInputSize();
+    });
+}
+
+#endif
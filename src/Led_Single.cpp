@@ -7,7 +7,9 @@
 #include "Datastore.h"
 #include "MqttSettings.h"
 #include "NetworkSettings.h"
+#include "NtpSettings.h"
 #include "PinMapping.h"
+#include "TaskProfiler.h"
 #include <Hoymiles.h>
 
 LedSingleClass LedSingle;
@@ -38,8 +40,7 @@ const uint8_t pwmTable[] = {
 #define LED_OFF 0
 
 LedSingleClass::LedSingleClass()
-    : _setTask(LEDSINGLE_UPDATE_INTERVAL * TASK_MILLISECOND, TASK_FOREVER, std::bind(&LedSingleClass::setLoop, this))
-    , _outputTask(TASK_IMMEDIATE, TASK_FOREVER, std::bind(&LedSingleClass::outputLoop, this))
+    : _setTask(LEDSINGLE_UPDATE_INTERVAL * TASK_MILLISECOND, TASK_FOREVER)
 {
 }
 
@@ -47,7 +48,6 @@ void LedSingleClass::init(Scheduler& scheduler)
 {
     bool ledActive = false;
 
-    _blinkTimeout.set(500);
     turnAllOn();
 
     const auto& pin = PinMapping.get();
@@ -63,53 +63,53 @@ void LedSingleClass::init(Scheduler& scheduler)
     }
 
     if (ledActive) {
-        scheduler.addTask(_outputTask);
-        _outputTask.enable();
-
         scheduler.addTask(_setTask);
+        TaskProfiler.setCallback(_setTask, "LedSingle.setLoop", std::bind(&LedSingleClass::setLoop, this));
         _setTask.enable();
     }
 }
 
 void LedSingleClass::setLoop()
 {
+    LedState_t modes[PINMAPPING_LED_COUNT];
+    modes[0] = LedState_t::Off;
+    modes[1] = LedState_t::Off;
+
     if (_allMode == LedState_t::On) {
         const CONFIG_T& config = Configuration.get();
 
         // Update network status
-        _ledMode[0] = LedState_t::Off;
-
         if (NetworkSettings.isConnected()) {
-            _ledMode[0] = LedState_t::Blink;
+            modes[0] = LedState_t::Blink;
         }
 
-        struct tm timeinfo;
-        if (getLocalTime(&timeinfo, 5) && (!config.Mqtt.Enabled || (config.Mqtt.Enabled && MqttSettings.getConnected()))) {
-            _ledMode[0] = LedState_t::On;
+        if (NtpSettings.isTimeConfident() && (!config.Mqtt.Enabled || (config.Mqtt.Enabled && MqttSettings.getConnected()))) {
+            modes[0] = LedState_t::On;
         }
 
         // Update inverter status
-        _ledMode[1] = LedState_t::Off;
         if (Hoymiles.getNumInverters() && Datastore.getIsAtLeastOnePollEnabled()) {
             // set LED status
             if (Datastore.getIsAllEnabledReachable() && Datastore.getIsAllEnabledProducing()) {
-                _ledMode[1] = LedState_t::On;
+                modes[1] = LedState_t::On;
             }
             if (Datastore.getIsAllEnabledReachable() && !Datastore.getIsAllEnabledProducing()) {
-                _ledMode[1] = LedState_t::Blink;
+                modes[1] = LedState_t::Blink;
             }
         }
-
-    } else if (_allMode == LedState_t::Off) {
-        _ledMode[0] = LedState_t::Off;
-        _ledMode[1] = LedState_t::Off;
     }
+
+    applyModes(modes);
 }
 
-void LedSingleClass::outputLoop()
+void LedSingleClass::applyModes(const LedState_t (&modes)[PINMAPPING_LED_COUNT])
 {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    bool blinking = false;
     for (uint8_t i = 0; i < PINMAPPING_LED_COUNT; i++) {
-        switch (_ledMode[i]) {
+        _ledMode[i] = modes[i];
+        switch (modes[i]) {
         case LedState_t::Off:
             setLed(i, false);
             break;
@@ -117,13 +117,34 @@ void LedSingleClass::outputLoop()
             setLed(i, true);
             break;
         case LedState_t::Blink:
-            if (_blinkTimeout.occured()) {
-                setLed(i, !_ledStateCurrent[i]);
-                _blinkTimeout.reset();
-            }
+            // Keep the phase of an LED which is already blinking
+            setLed(i, _blinkState);
+            blinking = true;
             break;
         }
     }
+
+    if (blinking && !_blinkTimerRunning) {
+        _blinkTimer.attach_ms(
+            LEDSINGLE_BLINK_INTERVAL, +[](LedSingleClass* instance) { instance->blink(); }, this);
+        _blinkTimerRunning = true;
+    } else if (!blinking && _blinkTimerRunning) {
+        _blinkTimer.detach();
+        _blinkTimerRunning = false;
+    }
+}
+
+void LedSingleClass::blink()
+{
+    // Runs in the timer task
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _blinkState = !_blinkState;
+    for (uint8_t i = 0; i < PINMAPPING_LED_COUNT; i++) {
+        if (_ledMode[i] == LedState_t::Blink) {
+            setLed(i, _blinkState);
+        }
+    }
 }
 
 void LedSingleClass::setLed(const uint8_t ledNo, const bool ledState)
@@ -0,0 +1,251 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "LinkHistory.h"
+#include "FlashWear.h"
+#include "FsWorker.h"
+#include "MessageOutput.h"
+#include "NtpSettings.h"
+#include "TaskProfiler.h"
+#include <Hoymiles.h>
+#include <algorithm>
+#include <ctime>
+
+LinkHistoryClass LinkHistory;
+
+// Difference to the previous reading, the radio statistics start from zero again after a reset
+static uint32_t takeDelta(const uint32_t current, uint32_t& previous)
+{
+    const uint32_t delta = current >= previous ? current - previous : current;
+    previous = current;
+    return delta;
+}
+
+LinkHistoryClass::LinkHistoryClass()
+    : _loopTask(LINK_HISTORY_SAMPLE_INTERVAL * TASK_SECOND, TASK_FOREVER)
+{
+}
+
+void LinkHistoryClass::init(Scheduler& scheduler)
+{
+    scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "LinkHistory.loop", std::bind(&LinkHistoryClass::loop, this));
+    _loopTask.enable();
+}
+
+void LinkHistoryClass::loop()
+{
+    if (!NtpSettings.isTimeConfident() || Hoymiles.getNumInverters() == 0) {
+        return;
+    }
+
+    const uint32_t now = time(nullptr);
+    const uint32_t periodStart = now - now % LINK_HISTORY_PERIOD;
+    bool finished = false;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        Hoymiles.forEachInverter([&](InverterAbstract& inv, const uint8_t) {
+            const uint64_t serial = inv.serial();
+            auto acc = std::find_if(_accumulators.begin(), _accumulators.end(), [serial](const Accumulator_t& a) {
+                return a.Serial == serial;
+            });
+
+            if (acc == _accumulators.end()) {
+                // The counters up to the first sample are not assigned to a period
+                Accumulator_t a = {};
+                a.Serial = serial;
+                a.PeriodStart = periodStart;
+                a.TxRequestData = inv.RadioStats.TxRequestData;
+                a.RxSuccess = inv.RadioStats.RxSuccess;
+                a.RxFailPartialAnswer = inv.RadioStats.RxFailPartialAnswer;
+                a.TxReRequestFragment = inv.RadioStats.TxReRequestFragment;
+                a.RssiSum = inv.getRssiSum();
+                a.RssiCount = inv.getRssiCount();
+                inv.takeRssiMin();
+                _accumulators.push_back(a);
+                return;
+            }
+
+            acc->Requests += takeDelta(inv.RadioStats.TxRequestData, acc->TxRequestData);
+            acc->Success += takeDelta(inv.RadioStats.RxSuccess, acc->RxSuccess);
+            acc->Partial += takeDelta(inv.RadioStats.RxFailPartialAnswer, acc->RxFailPartialAnswer);
+            acc->Retransmits += takeDelta(inv.RadioStats.TxReRequestFragment, acc->TxReRequestFragment);
+
+            // The rssi counters are never reset and wrap around
+            const uint32_t rssiSum = inv.getRssiSum();
+            const uint32_t rssiCount = inv.getRssiCount();
+            acc->PeriodRssiSum += static_cast<int32_t>(rssiSum - acc->RssiSum);
+            acc->PeriodRssiCount += rssiCount - acc->RssiCount;
+            acc->RssiSum = rssiSum;
+            acc->RssiCount = rssiCount;
+
+            const int8_t rssiMin = inv.takeRssiMin();
+            if (rssiMin != 0 && (acc->RssiMin == 0 || rssiMin < acc->RssiMin)) {
+                acc->RssiMin = rssiMin;
+            }
+
+            // The sample after the end of a period still belongs to it
+            if (acc->PeriodStart != periodStart) {
+                finishPeriod(*acc);
+                acc->PeriodStart = periodStart;
+                finished = true;
+            }
+        });
+    }
+
+    if (finished) {
+        // The flash write is done by the worker
+        FsWorker.run([this]() { flush(); });
+    }
+}
+
+void LinkHistoryClass::finishPeriod(Accumulator_t& acc)
+{
+    // Nothing is stored for the hours without polls, e.g. at night
+    if (acc.Requests > 0 || acc.PeriodRssiCount > 0) {
+        LinkHistoryRecord_t record;
+        record.Serial = acc.Serial;
+        record.Timestamp = acc.PeriodStart;
+        record.Requests = std::min<uint32_t>(acc.Requests, UINT16_MAX);
+        record.Success = std::min<uint32_t>(acc.Success, UINT16_MAX);
+        record.Partial = std::min<uint32_t>(acc.Partial, UINT16_MAX);
+        record.Retransmits = std::min<uint32_t>(acc.Retransmits, UINT16_MAX);
+        record.Fragments = std::min<uint32_t>(acc.PeriodRssiCount, UINT16_MAX);
+        record.RssiMean = acc.PeriodRssiCount > 0 ? acc.PeriodRssiSum / static_cast<int32_t>(acc.PeriodRssiCount) : 0;
+        record.RssiMin = acc.RssiMin;
+
+        if (_pending.size() >= LINK_HISTORY_CAPACITY) {
+            _pending.erase(_pending.begin());
+        }
+        _pending.push_back(record);
+    }
+
+    acc.Requests = 0;
+    acc.Success = 0;
+    acc.Partial = 0;
+    acc.Retransmits = 0;
+    acc.PeriodRssiSum = 0;
+    acc.PeriodRssiCount = 0;
+    acc.RssiMin = 0;
+}
+
+void LinkHistoryClass::flush()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // Kept in RAM until the next finished period
+    if (!FlashWear.allow(FlashWriter_t::LinkHistory)) {
+        return;
+    }
+
+    if (!writePending()) {
+        MessageOutput.printf("Failed to write history file %s\r\n", LINK_HISTORY_FILENAME);
+    }
+}
+
+bool LinkHistoryClass::openStore()
+{
+    if (_valid) {
+        return true;
+    }
+
+    File f = LittleFS.open(LINK_HISTORY_FILENAME, "r", false);
+    if (f) {
+        HistoryFileHeader_t header;
+        const bool ok = f.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) == sizeof(header)
+            && header.Magic == LINK_HISTORY_MAGIC
+            && header.Version == LINK_HISTORY_VERSION
+            && header.RecordSize == sizeof(LinkHistoryRecord_t)
+            && header.Capacity == LINK_HISTORY_CAPACITY
+            && header.Head < header.Capacity
+            && header.Count <= header.Capacity;
+        f.close();
+
+        if (ok) {
+            _header = header;
+            _valid = true;
+            return true;
+        }
+    }
+
+    // Missing or incompatible, start a new file
+    f = LittleFS.open(LINK_HISTORY_FILENAME, "w");
+    if (!f) {
+        return false;
+    }
+
+    _header = { LINK_HISTORY_MAGIC, LINK_HISTORY_VERSION, sizeof(LinkHistoryRecord_t), LINK_HISTORY_CAPACITY, 0, 0 };
+    _valid = f.write(reinterpret_cast<const uint8_t*>(&_header), sizeof(_header)) == sizeof(_header);
+    f.close();
+    return _valid;
+}
+
+bool LinkHistoryClass::writePending()
+{
+    if (_pending.empty()) {
+        return true;
+    }
+
+    if (!openStore()) {
+        return false;
+    }
+
+    File f = LittleFS.open(LINK_HISTORY_FILENAME, "r+", false);
+    if (!f) {
+        _valid = false;
+        return false;
+    }
+
+    // Same ring layout as the files of History
+    HistoryFileHeader_t header = _header;
+    bool ok = f.seek(sizeof(HistoryFileHeader_t) + header.Head * sizeof(LinkHistoryRecord_t));
+    for (const auto& record : _pending) {
+        if (!ok) {
+            break;
+        }
+        ok = f.write(reinterpret_cast<const uint8_t*>(&record), sizeof(record)) == sizeof(record);
+
+        header.Head++;
+        header.Count = std::min(header.Count + 1, header.Capacity);
+        if (header.Head == header.Capacity) {
+            header.Head = 0;
+            ok = ok && f.seek(sizeof(HistoryFileHeader_t));
+        }
+    }
+
+    ok = ok && f.seek(0) && f.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header)) == sizeof(header);
+    f.close();
+
+    if (!ok) {
+        // Start over with a new file on the next attempt
+        _valid = false;
+        LittleFS.remove(LINK_HISTORY_FILENAME);
+        return false;
+    }
+
+    FlashWear.record(FlashWriter_t::LinkHistory, _pending.size() * sizeof(LinkHistoryRecord_t) + sizeof(header));
+    _header = header;
+    _pending.clear();
+    return true;
+}
+
+std::unique_ptr<LinkHistoryReader> LinkHistoryClass::getReader()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    File f;
+    uint32_t first = 0;
+    uint32_t count = 0;
+    if (openStore()) {
+        f = LittleFS.open(LINK_HISTORY_FILENAME, "r", false);
+        if (f) {
+            first = (_header.Head + _header.Capacity - _header.Count) % _header.Capacity;
+            count = _header.Count;
+        }
+    }
+
+    return std::make_unique<LinkHistoryReader>(f, first, count, LINK_HISTORY_CAPACITY, _pending);
+}
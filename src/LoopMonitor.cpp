@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "LoopMonitor.h"
+#include "EventBus.h"
+#include "MessageOutput.h"
+#include <algorithm>
+
+LoopMonitorClass LoopMonitor;
+
+void LoopMonitorClass::init()
+{
+    EventBus.subscribe(Event_t::StatisticsUpdated, [this](const EventData_t& event) {
+        statisticsUpdated(event.Serial);
+    });
+}
+
+// Runs in the main loop
+void LoopMonitorClass::statisticsUpdated(const uint64_t serial)
+{
+    const uint32_t now = millis();
+    auto last = std::find_if(_lastStats.begin(), _lastStats.end(),
+        [serial](const std::pair<uint64_t, uint32_t>& s) { return s.first == serial; });
+    if (last == _lastStats.end()) {
+        _lastStats.emplace_back(serial, now);
+        return;
+    }
+
+    const uint32_t interval = now - last->second;
+    last->second = now;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _latency.StatsInterval.observe(interval);
+}
+
+void LoopMonitorClass::markHoymilesLoop(const uint32_t interval)
+{
+    const uint32_t now = millis();
+    const uint32_t gap = now - _lastHoymilesLoop;
+    const bool first = _lastHoymilesLoop == 0;
+    _lastHoymilesLoop = now;
+
+    if (!first && gap > interval + LOOP_MONITOR_BUDGET) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stats.HoymilesGapViolations++;
+        _stats.HoymilesGapMax = std::max(_stats.HoymilesGapMax, gap);
+        addViolation(LoopViolation_t::HoymilesGap, gap, _longestInGap);
+    }
+    _longestInGap = {};
+}
+
+void LoopMonitorClass::beginPass()
+{
+    _passStart = millis();
+    _longestInPass = {};
+}
+
+void LoopMonitorClass::endPass()
+{
+    const uint32_t duration = millis() - _passStart;
+    if (duration <= LOOP_MONITOR_BUDGET) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.SchedulerPassViolations++;
+    _stats.SchedulerPassMax = std::max(_stats.SchedulerPassMax, duration);
+    addViolation(LoopViolation_t::SchedulerPass, duration, _longestInPass);
+}
+
+void LoopMonitorClass::taskFinished(const char* name, const uint32_t runTime)
+{
+    if (runTime > _longestInGap.Time) {
+        _longestInGap = { name, runTime };
+    }
+    if (runTime > _longestInPass.Time) {
+        _longestInPass = { name, runTime };
+    }
+}
+
+void LoopMonitorClass::beginActivity(const LoopActivity_t activity, const char* name)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    Activity_t& a = _activities[static_cast<size_t>(activity)];
+    strlcpy(a.Name, name, sizeof(a.Name));
+    a.Start = millis();
+    a.Running = true;
+}
+
+void LoopMonitorClass::endActivity(const LoopActivity_t activity)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    Activity_t& a = _activities[static_cast<size_t>(activity)];
+    a.End = millis();
+    if (a.Running) {
+        _latency.Activity[static_cast<size_t>(activity)].observe(a.End - a.Start);
+    }
+    a.Running = false;
+}
+
+void LoopMonitorClass::markWsFrame(const uint32_t lag)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _latency.WsFrameLag.observe(lag);
+}
+
+// Must be called while holding the mutex
+void LoopMonitorClass::copyActivity(const LoopActivity_t activity, const uint32_t since, char* name)
+{
+    const Activity_t& a = _activities[static_cast<size_t>(activity)];
+    const uint32_t now = millis();
+    if (a.Start != 0 && (a.Running || now - a.End <= now - since)) {
+        strlcpy(name, a.Name, LOOP_MONITOR_NAME_LEN);
+    } else {
+        name[0] = '\0';
+    }
+}
+
+// Must be called while holding the mutex
+void LoopMonitorClass::addViolation(const LoopViolation_t type, const uint32_t duration, const Longest_t& longest)
+{
+    const uint32_t now = millis();
+
+    LoopViolationRecord_t& record = _violations[_head];
+    record.Type = type;
+    record.Time = now;
+    record.Duration = duration;
+    strlcpy(record.Task, longest.Name != nullptr ? longest.Name : "", sizeof(record.Task));
+    record.TaskTime = longest.Time / 1000;
+    copyActivity(LoopActivity_t::WebApi, now - duration, record.WebApi);
+    copyActivity(LoopActivity_t::Mqtt, now - duration, record.Mqtt);
+
+    _head = (_head + 1) % _violations.size();
+    _count = std::min(_count + 1, _violations.size());
+
+    if (now - _lastLog < LOOP_MONITOR_LOG_INTERVAL) {
+        return;
+    }
+    _lastLog = now;
+
+    MessageOutput.printf("Loop: %s took %" PRIu32 " ms (budget %d ms), task %s (%" PRIu32 " ms), web %s, mqtt %s\r\n",
+        type == LoopViolation_t::HoymilesGap ? "Hoymiles gap" : "scheduler pass",
+        duration, LOOP_MONITOR_BUDGET,
+        record.Task[0] != '\0' ? record.Task : "-", record.TaskTime,
+        record.WebApi[0] != '\0' ? record.WebApi : "-",
+        record.Mqtt[0] != '\0' ? record.Mqtt : "-");
+}
+
+LoopMonitorStats_t LoopMonitorClass::getStats()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
+
+LoopLatency_t LoopMonitorClass::getLatency()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _latency;
+}
+
+std::vector<LoopViolationRecord_t> LoopMonitorClass::getViolations()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    std::vector<LoopViolationRecord_t> violations;
+    violations.reserve(_count);
+    for (size_t i = 0; i < _count; i++) {
+        violations.push_back(_violations[(_head + _violations.size() - _count + i) % _violations.size()]);
+    }
+    return violations;
+}
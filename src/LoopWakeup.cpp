@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "LoopWakeup.h"
+#include "TaskProfiler.h"
+
+LoopWakeupClass LoopWakeup;
+
+void LoopWakeupClass::init()
+{
+    _loopTaskHandle = xTaskGetCurrentTaskHandle();
+}
+
+void LoopWakeupClass::sleep(Scheduler& scheduler)
+{
+    const long timeout = TaskProfiler.getTimeUntilNextRun(scheduler, LOOP_WAKEUP_MAX_SLEEP);
+    if (timeout <= 0) {
+        return;
+    }
+
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeout));
+}
+
+void LoopWakeupClass::notify()
+{
+    if (_loopTaskHandle != nullptr) {
+        xTaskNotifyGive(_loopTaskHandle);
+    }
+}
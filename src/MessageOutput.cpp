@@ -1,22 +1,199 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 /*
- * Copyright (C) 2022-2024 Thomas Basler and others
+ * Copyright (C) 2022-2025 Thomas Basler and others
  */
 #include "MessageOutput.h"
+#include "TaskProfiler.h"
 
 #include <Arduino.h>
+#include <algorithm>
+#include <cctype>
+#include <esp_attr.h>
+#include <esp_heap_caps.h>
+#include <esp_system.h>
+
+#define RECORD_FLAG_PAD 0x0001
+#define RECORD_FLAG_CONTINUED 0x0002 // rest of a line which did not fit into one record
+#define RECORD_ALIGN 8
+
+#define CRASHLOG_MAGIC 0x474f4c43 // "CLOG"
+
+struct CrashLog_t {
+    uint32_t Magic;
+    uint32_t Pos; // total number of bytes written since the magic was set
+    char Data[MESSAGEOUTPUT_CRASHLOG_SIZE];
+};
+
+static RTC_NOINIT_ATTR CrashLog_t crashLog;
+
+// "<uptime s>.<ms> <level> <subsystem>: "
+#define RECORD_PREFIX_SIZE 32
+
+static_assert(MESSAGEOUTPUT_WS_CHUNK_SIZE >= MESSAGEOUTPUT_LINE_SIZE + RECORD_PREFIX_SIZE, "A websocket chunk has to hold at least one line");
+static_assert(MESSAGEOUTPUT_CRASHLOG_SIZE >= MESSAGEOUTPUT_LINE_SIZE, "The crash log has to hold at least one line");
+
 
 MessageOutputClass MessageOutput;
 
+static const char* const levelNames[] = { "none", "error", "warn", "info", "debug", "verbose" };
+static const char* const subsystemNames[] = { "system", "radio" };
+
+static_assert(sizeof(subsystemNames) / sizeof(subsystemNames[0]) == static_cast<size_t>(MessageSubsystem_t::Count),
+    "Name of a subsystem missing");
+
+MessageChannel::MessageChannel(MessageOutputClass& output, const MessageSubsystem_t subsystem, const MessageLevel_t level)
+    : _output(output)
+    , _subsystem(subsystem)
+    , _level(level)
+{
+}
+
+size_t MessageChannel::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t MessageChannel::write(const uint8_t* buffer, size_t size)
+{
+    return _output.write(_subsystem, _level, buffer, size);
+}
+
 MessageOutputClass::MessageOutputClass()
-    : _loopTask(TASK_IMMEDIATE, TASK_FOREVER, std::bind(&MessageOutputClass::loop, this))
+    : _loopTask(50 * TASK_MILLISECOND, TASK_FOREVER)
+    , _serialFilter(getDefaultFilter(static_cast<MessageLevel_t>(MESSAGEOUTPUT_SERIAL_LEVEL)))
+    , _remoteFilter(getDefaultFilter(MessageLevel_t::None))
 {
+    // No client yet, so no lock is needed
+    updateMaxLevels();
+}
+
+const char* MessageOutputClass::getLevelName(const MessageLevel_t level)
+{
+    return levelNames[std::min<size_t>(static_cast<size_t>(level), static_cast<size_t>(MessageLevel_t::Verbose))];
+}
+
+const char* MessageOutputClass::getSubsystemName(const MessageSubsystem_t subsystem)
+{
+    return subsystemNames[std::min<size_t>(static_cast<size_t>(subsystem), static_cast<size_t>(MessageSubsystem_t::Count) - 1)];
+}
+
+bool MessageOutputClass::parseLevel(const char* name, MessageLevel_t& level)
+{
+    for (size_t i = 0; i < sizeof(levelNames) / sizeof(levelNames[0]); i++) {
+        if (strcmp(name, levelNames[i]) == 0) {
+            level = static_cast<MessageLevel_t>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MessageOutputClass::parseSubsystem(const char* name, MessageSubsystem_t& subsystem)
+{
+    for (size_t i = 0; i < sizeof(subsystemNames) / sizeof(subsystemNames[0]); i++) {
+        if (strcmp(name, subsystemNames[i]) == 0) {
+            subsystem = static_cast<MessageSubsystem_t>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+MessageFilter_t MessageOutputClass::getDefaultFilter(const MessageLevel_t level)
+{
+    MessageFilter_t filter;
+    filter.Levels.fill(level);
+    filter.Meta = false;
+    return filter;
+}
+
+void MessageOutputClass::updateMaxLevels()
+{
+    for (size_t i = 0; i < _maxLevels.size(); i++) {
+        MessageLevel_t level = std::max(_serialFilter.Levels[i], _remoteFilter.Levels[i]);
+        for (const auto& c : _wsClients) {
+            level = std::max(level, c.Filter.Levels[i]);
+        }
+        _maxLevels[i].store(static_cast<uint8_t>(level), std::memory_order_relaxed);
+    }
 }
 
 void MessageOutputClass::init(Scheduler& scheduler)
 {
     scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "MessageOutput.loop", std::bind(&MessageOutputClass::loop, this));
     _loopTask.enable();
+
+    restoreCrashLog();
+
+    uint32_t size = MESSAGEOUTPUT_RING_SIZE;
+    uint8_t* ring = nullptr;
+    if (psramFound()) {
+        size = MESSAGEOUTPUT_RING_SIZE_PSRAM;
+        ring = static_cast<uint8_t*>(heap_caps_malloc(size, MALLOC_CAP_SPIRAM));
+    }
+    if (ring == nullptr) {
+        size = MESSAGEOUTPUT_RING_SIZE;
+        ring = static_cast<uint8_t*>(heap_caps_malloc(size, MALLOC_CAP_8BIT));
+    }
+    if (ring == nullptr) {
+        // Output keeps going directly to the serial port
+        return;
+    }
+
+    // No record position matches the initial content
+    memset(ring, 0xff, size);
+    _ringSize = size;
+    _ring = ring;
+
+    if (xTaskCreatePinnedToCore(serialTaskProc, "MSG_OUT", MESSAGEOUTPUT_SERIAL_TASK_STACK_SIZE, this,
+            MESSAGEOUTPUT_SERIAL_TASK_PRIORITY, &_serialTaskHandle, MESSAGEOUTPUT_SERIAL_TASK_CORE)
+        != pdPASS) {
+        _serialTaskHandle = nullptr;
+        _ring = nullptr;
+        heap_caps_free(ring);
+    }
+
+    if (!_lastBootLog.isEmpty()) {
+        println("--- Output before the last reset ---");
+        print(_lastBootLog);
+        println("--- End of output before the last reset ---");
+    }
+}
+
+void MessageOutputClass::restoreCrashLog()
+{
+    // The rtc memory holds random content after a power on
+    if (esp_reset_reason() != ESP_RST_POWERON && crashLog.Magic == CRASHLOG_MAGIC) {
+        const uint32_t len = std::min<uint32_t>(crashLog.Pos, MESSAGEOUTPUT_CRASHLOG_SIZE);
+        const uint32_t start = (crashLog.Pos - len) & (MESSAGEOUTPUT_CRASHLOG_SIZE - 1);
+        const uint32_t first = std::min<uint32_t>(len, MESSAGEOUTPUT_CRASHLOG_SIZE - start);
+
+        _lastBootLog.reserve(len);
+        _lastBootLog.concat(&crashLog.Data[start], first);
+        _lastBootLog.concat(&crashLog.Data[0], len - first);
+    }
+
+    crashLog.Magic = CRASHLOG_MAGIC;
+    crashLog.Pos = 0;
+    _crashLogPos = 0;
+}
+
+const String& MessageOutputClass::getLastBootLog() const
+{
+    return _lastBootLog;
+}
+
+void MessageOutputClass::addCrashLog(const char* data, const size_t len)
+{
+    // Plain copy of the bytes, writers only share the atomic position
+    const uint32_t pos = _crashLogPos.fetch_add(len, std::memory_order_relaxed);
+    const uint32_t offset = pos & (MESSAGEOUTPUT_CRASHLOG_SIZE - 1);
+    const uint32_t first = std::min<uint32_t>(len, MESSAGEOUTPUT_CRASHLOG_SIZE - offset);
+
+    memcpy(&crashLog.Data[offset], data, first);
+    memcpy(&crashLog.Data[0], data + first, len - first);
+    crashLog.Pos = pos + len;
 }
 
 void MessageOutputClass::register_ws_output(AsyncWebSocket* output)
@@ -24,43 +201,360 @@ void MessageOutputClass::register_ws_output(AsyncWebSocket* output)
     _ws = output;
 }
 
-size_t MessageOutputClass::write(uint8_t c)
+void MessageOutputClass::addWsClient(const uint32_t id)
 {
-    if (_buff_pos < BUFFER_SIZE) {
-        std::lock_guard<std::mutex> lock(_msgLock);
-        _buffer[_buff_pos] = c;
-        _buff_pos++;
-    } else {
-        _forceSend = true;
+    std::lock_guard<std::mutex> lock(_wsClientsLock);
+    _wsClients.push_back({ id, _writePos.load(), false, getDefaultFilter(static_cast<MessageLevel_t>(MESSAGEOUTPUT_WS_DEFAULT_LEVEL)) });
+    updateMaxLevels();
+}
+
+void MessageOutputClass::removeWsClient(const uint32_t id)
+{
+    std::lock_guard<std::mutex> lock(_wsClientsLock);
+    _wsClients.erase(std::remove_if(_wsClients.begin(), _wsClients.end(),
+                         [id](const WsClient_t& c) { return c.Id == id; }),
+        _wsClients.end());
+    updateMaxLevels();
+}
+
+void MessageOutputClass::setWsClientGzip(const uint32_t id)
+{
+    std::lock_guard<std::mutex> lock(_wsClientsLock);
+    for (auto& c : _wsClients) {
+        if (c.Id == id) {
+            c.Gzip = true;
+        }
+    }
+}
+
+void MessageOutputClass::setWsClientFilter(const uint32_t id, const MessageFilter_t& filter)
+{
+    std::lock_guard<std::mutex> lock(_wsClientsLock);
+    for (auto& c : _wsClients) {
+        if (c.Id == id) {
+            c.Filter = filter;
+        }
+    }
+    updateMaxLevels();
+}
+
+void MessageOutputClass::setRemoteFilter(const MessageFilter_t& filter)
+{
+    std::lock_guard<std::mutex> lock(_wsClientsLock);
+    _remoteFilter = filter;
+    updateMaxLevels();
+}
+
+MessageFilter_t MessageOutputClass::getWsClientFilter(const uint32_t id)
+{
+    std::lock_guard<std::mutex> lock(_wsClientsLock);
+    for (const auto& c : _wsClients) {
+        if (c.Id == id) {
+            return c.Filter;
+        }
     }
+    return getDefaultFilter(static_cast<MessageLevel_t>(MESSAGEOUTPUT_WS_DEFAULT_LEVEL));
+}
 
-    return Serial.write(c);
+size_t MessageOutputClass::write(uint8_t c)
+{
+    return write(&c, 1);
 }
 
 size_t MessageOutputClass::write(const uint8_t* buffer, size_t size)
 {
-    std::lock_guard<std::mutex> lock(_msgLock);
-    if (_buff_pos + size < BUFFER_SIZE) {
-        memcpy(&_buffer[_buff_pos], buffer, size);
-        _buff_pos += size;
+    return write(MessageSubsystem_t::System, MessageLevel_t::Info, buffer, size);
+}
+
+size_t MessageOutputClass::write(const MessageSubsystem_t subsystem, const MessageLevel_t level, const uint8_t* buffer, size_t size)
+{
+    if (!isEnabled(subsystem, level)) {
+        return size;
+    }
+
+    if (_ring == nullptr) {
+        return Serial.write(buffer, size);
+    }
+
+    LineBuffer_t* line = xPortInIsrContext() ? nullptr : getLineBuffer();
+    if (line == nullptr) {
+        // No line buffer left, the text is stored as it is
+        addRecord(reinterpret_cast<const char*>(buffer), size, { millis(), level, subsystem, false });
+        return size;
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        // The tag of the first write of a line applies to all of it
+        if (line->Len == 0 && !line->Tag.Continued) {
+            line->Tag = { millis(), level, subsystem, false };
+        }
+        line->Data[line->Len++] = buffer[i];
+        if (buffer[i] == '\n' || line->Len == MESSAGEOUTPUT_LINE_SIZE) {
+            addRecord(line->Data, line->Len, line->Tag);
+            line->Tag.Continued = buffer[i] != '\n';
+            line->Len = 0;
+        }
+    }
+
+    // Only tasks with an unfinished line keep their buffer
+    if (line->Len == 0 && !line->Tag.Continued) {
+        line->Owner.store(nullptr, std::memory_order_release);
+    }
+
+    return size;
+}
+
+MessageOutputClass::LineBuffer_t* MessageOutputClass::getLineBuffer()
+{
+    const TaskHandle_t self = xTaskGetCurrentTaskHandle();
+
+    for (auto& line : _lineBuffers) {
+        if (line.Owner.load(std::memory_order_acquire) == self) {
+            return &line;
+        }
+    }
+
+    for (auto& line : _lineBuffers) {
+        TaskHandle_t expected = nullptr;
+        if (line.Owner.compare_exchange_strong(expected, self, std::memory_order_acq_rel)) {
+            return &line;
+        }
+    }
+
+    return nullptr;
+}
+
+void MessageOutputClass::addRecord(const char* data, size_t len, RecordTag_t tag)
+{
+    while (len > 0) {
+        const uint16_t chunk = std::min<size_t>(len, MESSAGEOUTPUT_LINE_SIZE);
+        const uint32_t need = (sizeof(RecordHeader_t) + chunk + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+
+        // A record never wraps around, the rest of the ring is filled with a padding record instead
+        uint32_t pos = _writePos.load(std::memory_order_relaxed);
+        uint32_t pad;
+        do {
+            const uint32_t offset = pos & (_ringSize - 1);
+            pad = (_ringSize - offset < need) ? _ringSize - offset : 0;
+        } while (!_writePos.compare_exchange_weak(pos, pos + pad + need, std::memory_order_acq_rel, std::memory_order_relaxed));
+        std::atomic_thread_fence(std::memory_order_release);
+
+        if (pad > 0) {
+            RecordHeader_t* header = reinterpret_cast<RecordHeader_t*>(&_ring[pos & (_ringSize - 1)]);
+            header->Len = 0;
+            header->Flags = RECORD_FLAG_PAD;
+            __atomic_store_n(&header->Pos, pos, __ATOMIC_RELEASE);
+            pos += pad;
+        }
+
+        RecordHeader_t* header = reinterpret_cast<RecordHeader_t*>(&_ring[pos & (_ringSize - 1)]);
+        header->Time = tag.Time;
+        header->Len = chunk;
+        header->Flags = tag.Continued ? RECORD_FLAG_CONTINUED : 0;
+        header->Level = tag.Level;
+        header->Subsystem = tag.Subsystem;
+        memcpy(header + 1, data, chunk);
+        __atomic_store_n(&header->Pos, pos, __ATOMIC_RELEASE);
+
+        addCrashLog(data, chunk);
+
+        data += chunk;
+        len -= chunk;
+        tag.Continued = true;
+    }
+
+    if (_serialTaskHandle != nullptr) {
+        if (xPortInIsrContext()) {
+            vTaskNotifyGiveFromISR(_serialTaskHandle, nullptr);
+        } else {
+            xTaskNotifyGive(_serialTaskHandle);
+        }
+    }
+}
+
+size_t MessageOutputClass::formatPrefix(const RecordHeader_t& header, char* buffer, const size_t maxLen)
+{
+    const int len = snprintf(buffer, maxLen, "%" PRIu32 ".%03" PRIu32 " %c %s: ",
+        header.Time / 1000, header.Time % 1000, toupper(getLevelName(header.Level)[0]), getSubsystemName(header.Subsystem));
+    return len > 0 ? std::min<size_t>(len, maxLen - 1) : 0;
+}
+
+bool MessageOutputClass::peekRecord(uint32_t& cursor, RecordHeader_t& header, char* data, uint32_t& recordSize, bool& skipped, const MessageFilter_t& filter)
+{
+    for (;;) {
+        const uint32_t writePos = _writePos.load(std::memory_order_acquire);
+        if (writePos - cursor > _ringSize) {
+            // Overwritten before it was read, the next record starts at the write position
+            cursor = writePos;
+            skipped = true;
+        }
+        if (cursor == writePos) {
+            return false;
+        }
+
+        const uint32_t offset = cursor & (_ringSize - 1);
+        const RecordHeader_t* stored = reinterpret_cast<const RecordHeader_t*>(&_ring[offset]);
+        if (__atomic_load_n(&stored->Pos, __ATOMIC_ACQUIRE) != cursor) {
+            // Reserved but not complete yet
+            return false;
+        }
+
+        header = *stored;
+        const uint16_t len = header.Len;
+        const bool pad = header.Flags & RECORD_FLAG_PAD;
+        recordSize = pad
+            ? _ringSize - offset
+            : (sizeof(RecordHeader_t) + len + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+
+        // Filtered records are only skipped, their text is never copied
+        const bool wanted = !pad
+            && static_cast<size_t>(header.Subsystem) < filter.Levels.size()
+            && header.Level <= filter.Levels[static_cast<size_t>(header.Subsystem)];
+
+        if (!pad && (len > MESSAGEOUTPUT_LINE_SIZE || offset + recordSize > _ringSize)) {
+            // Header changed while it was read
+            cursor = _writePos.load();
+            skipped = true;
+            return false;
+        }
+
+        if (wanted) {
+            memcpy(data, stored + 1, len);
+        }
+
+        // The copy is only valid if no writer reserved the record in the meantime
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_writePos.load(std::memory_order_relaxed) - cursor > _ringSize) {
+            cursor = _writePos.load();
+            skipped = true;
+            return false;
+        }
+
+        if (wanted) {
+            // The cursor is moved by the caller once the record was used
+            return true;
+        }
+        cursor += recordSize;
+    }
+}
+
+size_t MessageOutputClass::readRecords(uint32_t& cursor, char* buffer, const size_t maxLen, bool& skipped, const MessageFilter_t& filter)
+{
+    size_t written = 0;
+    skipped = false;
+
+    RecordHeader_t header;
+    uint32_t recordSize;
+    char data[MESSAGEOUTPUT_LINE_SIZE];
+    while (peekRecord(cursor, header, data, recordSize, skipped, filter)) {
+        char prefix[RECORD_PREFIX_SIZE];
+        size_t prefixLen = 0;
+        if (filter.Meta && !(header.Flags & RECORD_FLAG_CONTINUED)) {
+            prefixLen = formatPrefix(header, prefix, sizeof(prefix));
+        }
+        if (written + prefixLen + header.Len > maxLen) {
+            break;
+        }
+        memcpy(&buffer[written], prefix, prefixLen);
+        memcpy(&buffer[written + prefixLen], data, header.Len);
+        written += prefixLen + header.Len;
+        cursor += recordSize;
     }
-    _forceSend = true;
 
-    return Serial.write(buffer, size);
+    return written;
+}
+
+bool MessageOutputClass::readRecord(uint32_t& cursor, MessageRecord_t& record, char* data, bool& skipped, const MessageFilter_t& filter)
+{
+    skipped = false;
+    if (_ring == nullptr) {
+        return false;
+    }
+
+    RecordHeader_t header;
+    uint32_t recordSize;
+    if (!peekRecord(cursor, header, data, recordSize, skipped, filter)) {
+        return false;
+    }
+    cursor += recordSize;
+
+    record.Time = header.Time;
+    record.Level = header.Level;
+    record.Subsystem = header.Subsystem;
+    record.Continued = header.Flags & RECORD_FLAG_CONTINUED;
+    record.Len = header.Len;
+    return true;
+}
+
+void MessageOutputClass::serialTaskProc(void* param)
+{
+    MessageOutputClass* output = static_cast<MessageOutputClass*>(param);
+    char buffer[MESSAGEOUTPUT_LINE_SIZE * 2];
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        bool skipped;
+        size_t len;
+        while ((len = output->readRecords(output->_serialCursor, buffer, sizeof(buffer), skipped, output->_serialFilter)) > 0 || skipped) {
+            if (skipped) {
+                Serial.print("\r\n*** Console output skipped ***\r\n");
+            }
+            Serial.write(buffer, len);
+        }
+    }
 }
 
 void MessageOutputClass::loop()
 {
-    // Send data via websocket if either time is over or buffer is full
-    if (_forceSend || (millis() - _lastSend > 1000)) {
-        std::lock_guard<std::mutex> lock(_msgLock);
-        if (_ws && _buff_pos > 0) {
-            _ws->textAll(_buffer, _buff_pos);
-            _buff_pos = 0;
+    if (_ws == nullptr || _ring == nullptr) {
+        return;
+    }
+
+    std::vector<WsClient_t> clients;
+    {
+        std::lock_guard<std::mutex> lock(_wsClientsLock);
+        clients = _wsClients;
+    }
+
+    // Sending happens outside of the lock as a full client queue may raise a disconnect event
+    char buffer[MESSAGEOUTPUT_WS_CHUNK_SIZE];
+    for (auto& c : clients) {
+        AsyncWebSocketClient* client = _ws->client(c.Id);
+        if (client == nullptr || !client->canSend()) {
+            // The cursor stays until the client has room in its queue again
+            continue;
+        }
+
+        bool skipped;
+        const size_t len = readRecords(c.Cursor, buffer, sizeof(buffer), skipped, c.Filter);
+        if (len == 0) {
+            continue;
+        }
+        if (!c.Gzip) {
+            client->text(buffer, len);
+            continue;
         }
-        if (_forceSend) {
-            _buff_pos = 0;
+
+        if (_gzip == nullptr) {
+            _gzip.reset(new GzipStream());
+        } else {
+            _gzip->reset();
+        }
+        _gzip->write(reinterpret_cast<const uint8_t*>(buffer), len);
+        _gzip->finish();
+
+        // The compressed chunk is never larger than the buffer plus the gzip overhead
+        uint8_t compressed[MESSAGEOUTPUT_WS_CHUNK_SIZE + MESSAGEOUTPUT_WS_CHUNK_SIZE / 8 + 32];
+        const size_t compressedLen = _gzip->read(compressed, sizeof(compressed));
+        client->binary(compressed, compressedLen);
+    }
+
+    std::lock_guard<std::mutex> lock(_wsClientsLock);
+    for (auto& stored : _wsClients) {
+        auto it = std::find_if(clients.begin(), clients.end(), [&stored](const WsClient_t& c) { return c.Id == stored.Id; });
+        if (it != clients.end()) {
+            stored.Cursor = it->Cursor;
         }
-        _forceSend = false;
     }
 }
@@ -0,0 +1,559 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "ModbusServer.h"
+#include "Configuration.h"
+#include "EventBus.h"
+#include "MessageOutput.h"
+#include "TaskProfiler.h"
+#include <AsyncTCP.h>
+#include <Hoymiles.h>
+#include <algorithm>
+#include <cmath>
+
+ModbusServerClass ModbusServer;
+
+#define MODBUS_MBAP_SIZE 7
+#define MODBUS_MAX_PDU_SIZE 253
+#define MODBUS_MAX_READ_COUNT 125
+#define MODBUS_MAX_WRITE_COUNT 123
+
+#define MODBUS_FC_READ_HOLDING 0x03
+#define MODBUS_FC_READ_INPUT 0x04
+#define MODBUS_FC_WRITE_SINGLE 0x06
+#define MODBUS_FC_WRITE_MULTIPLE 0x10
+
+#define MODBUS_EX_ILLEGAL_FUNCTION 0x01
+#define MODBUS_EX_ILLEGAL_ADDRESS 0x02
+#define MODBUS_EX_ILLEGAL_VALUE 0x03
+#define MODBUS_EX_DEVICE_FAILURE 0x04
+#define MODBUS_EX_TARGET_FAILED 0x0b
+
+// SunSpec values of registers without data
+#define SUNSPEC_NA_UINT16 0xffff
+#define SUNSPEC_NA_INT16 0x8000
+#define SUNSPEC_NA_SF 0x8000
+
+// Inverter operating states of model 101/103
+enum class SunSpecState_t : uint16_t {
+    Off = 1,
+    Mppt = 4,
+    Throttled = 5,
+    Standby = 8,
+};
+
+// Appends the registers of the SunSpec models to an image
+class SunSpecWriter {
+public:
+    explicit SunSpecWriter(std::vector<uint16_t>& registers)
+        : _registers(registers)
+    {
+    }
+
+    void model(const uint16_t id, const uint16_t length)
+    {
+        u16(id);
+        u16(length);
+    }
+
+    void u16(const uint16_t value)
+    {
+        _registers.push_back(value);
+    }
+
+    // Scaled by 10^-sf, values out of range are not implemented
+    void u16(const float value, const int8_t sf)
+    {
+        const float scaled = std::round(value * std::pow(10.0f, -sf));
+        u16(std::isfinite(scaled) && scaled >= 0 && scaled < SUNSPEC_NA_UINT16 ? static_cast<uint16_t>(scaled) : SUNSPEC_NA_UINT16);
+    }
+
+    void s16(const float value, const int8_t sf)
+    {
+        const float scaled = std::round(value * std::pow(10.0f, -sf));
+        u16(std::isfinite(scaled) && scaled > INT16_MIN && scaled <= INT16_MAX ? static_cast<uint16_t>(static_cast<int16_t>(scaled)) : SUNSPEC_NA_INT16);
+    }
+
+    void sf(const int8_t value)
+    {
+        u16(static_cast<uint16_t>(static_cast<int16_t>(value)));
+    }
+
+    void u32(const uint32_t value)
+    {
+        u16(static_cast<uint16_t>(value >> 16));
+        u16(static_cast<uint16_t>(value & 0xffff));
+    }
+
+    void fill(const uint16_t value, const size_t count)
+    {
+        _registers.insert(_registers.end(), count, value);
+    }
+
+    // Two characters per register, padded with zeros
+    void str(const char* value, const size_t registers)
+    {
+        const size_t len = strlen(value);
+        for (size_t i = 0; i < registers; i++) {
+            const uint8_t hi = 2 * i < len ? value[2 * i] : 0;
+            const uint8_t lo = 2 * i + 1 < len ? value[2 * i + 1] : 0;
+            u16(static_cast<uint16_t>(hi << 8 | lo));
+        }
+    }
+
+    size_t size() const
+    {
+        return _registers.size();
+    }
+
+private:
+    std::vector<uint16_t>& _registers;
+};
+
+ModbusServerClass::ModbusServerClass()
+    : _loopTask(TASK_SECOND, TASK_FOREVER)
+{
+}
+
+void ModbusServerClass::init(Scheduler& scheduler)
+{
+    scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "ModbusServer.loop", std::bind(&ModbusServerClass::loop, this));
+    _loopTask.enable();
+
+    // The images are rebuilt right after new data instead of up to a second later
+    EventBus.subscribe(Event_t::StatisticsUpdated, _loopTask);
+    EventBus.subscribe(Event_t::LimitChanged, _loopTask);
+
+    start();
+}
+
+void ModbusServerClass::reconfigure()
+{
+    _reconfigure = true;
+}
+
+ModbusServerStats_t ModbusServerClass::getStats()
+{
+    ModbusServerStats_t stats;
+    stats.Clients = _clients;
+    stats.Requests = _requests;
+    stats.Exceptions = _exceptions;
+    stats.Writes = _writes;
+    return stats;
+}
+
+void ModbusServerClass::start()
+{
+    const CONFIG_T& config = Configuration.get();
+    if (!config.Modbus.Enabled) {
+        return;
+    }
+
+    _port = config.Modbus.Port;
+    _server = new AsyncServer(_port);
+    _server->onClient([](void* arg, AsyncClient* client) {
+        static_cast<ModbusServerClass*>(arg)->onConnect(client);
+    },
+        this);
+    _server->setNoDelay(true);
+    _server->begin();
+
+    MessageOutput.printf("Modbus: server listening on port %u\r\n", _port);
+}
+
+void ModbusServerClass::stop()
+{
+    if (_server == nullptr) {
+        return;
+    }
+
+    _server->end();
+    delete _server;
+    _server = nullptr;
+
+    std::lock_guard<std::mutex> lock(_imageMutex);
+    _images.clear();
+}
+
+void ModbusServerClass::loop()
+{
+    if (_reconfigure.exchange(false)) {
+        stop();
+        start();
+    }
+
+    if (_server == nullptr) {
+        return;
+    }
+
+    std::vector<uint16_t> registers;
+    const size_t count = Hoymiles.getNumInverters();
+
+    Hoymiles.forEachInverter([&](InverterAbstract& inv, const uint8_t i) {
+        const uint32_t state = getImageState(inv);
+        {
+            std::lock_guard<std::mutex> lock(_imageMutex);
+            if (i < _images.size() && _images[i].Serial == inv.serial() && _images[i].State == state) {
+                return;
+            }
+        }
+
+        // Built without the lock, requests are served from the old image meanwhile
+        registers.clear();
+        buildImage(inv, i + 1, registers);
+
+        std::lock_guard<std::mutex> lock(_imageMutex);
+        if (i >= _images.size()) {
+            _images.resize(i + 1);
+        }
+        _images[i].Serial = inv.serial();
+        _images[i].State = state;
+        _images[i].Registers.swap(registers);
+    });
+
+    std::lock_guard<std::mutex> lock(_imageMutex);
+    if (_images.size() > count) {
+        _images.resize(count);
+    }
+}
+
+uint32_t ModbusServerClass::getImageState(InverterAbstract& inv)
+{
+    uint32_t state = inv.Statistics()->getGeneration();
+    state = state * 31 + inv.DevInfo()->getLastUpdateAll();
+    state = state * 31 + inv.SystemConfigPara()->getLastUpdate();
+    state = state * 31 + (inv.isReachable() << 0 | inv.isProducing() << 1);
+    return state;
+}
+
+void ModbusServerClass::buildImage(InverterAbstract& inv, const uint8_t unitId, std::vector<uint16_t>& registers)
+{
+    StatisticsParser* stats = inv.Statistics();
+    SunSpecWriter w(registers);
+
+    w.u16(0x5375); // "SunS"
+    w.u16(0x6e53);
+
+    // Model 1: common
+    char buffer[33];
+    w.model(1, 66);
+    w.str("Hoymiles", 16); // Mn
+    w.str(inv.DevInfo()->getHwModelName(), 16); // Md
+    w.str(inv.name(), 8); // Opt
+    const uint16_t fw = inv.DevInfo()->getFwBuildVersion();
+    snprintf(buffer, sizeof(buffer), "%u.%u.%u", fw / 10000, (fw / 100) % 100, fw % 100);
+    w.str(buffer, 8); // Vr
+    w.str(inv.serialString(), 16); // SN
+    w.u16(unitId); // DA
+    w.u16(0); // Pad
+
+    auto value = [stats](const ChannelType_t type, const ChannelNum_t channel, const FieldId_t field) {
+        return stats->hasChannelFieldValue(type, channel, field) ? stats->getChannelFieldValue(type, channel, field) : NAN;
+    };
+
+    ChannelList_t dcChannels;
+    uint8_t limit = 100;
+
+    stats->readConsistent([&]() {
+        registers.resize(2 + 68);
+        dcChannels = stats->getChannelsByType(TYPE_DC);
+
+        // Model 101 (single phase) or 103 (three phase) inverter
+        const bool threePhase = stats->hasChannelFieldValue(TYPE_AC, CH0, FLD_UAC_1N);
+        w.model(threePhase ? 103 : 101, 50);
+        w.u16(value(TYPE_AC, CH0, FLD_IAC), -2); // A
+        if (threePhase) {
+            w.u16(value(TYPE_AC, CH0, FLD_IAC_1), -2);
+            w.u16(value(TYPE_AC, CH0, FLD_IAC_2), -2);
+            w.u16(value(TYPE_AC, CH0, FLD_IAC_3), -2);
+        } else {
+            w.u16(value(TYPE_AC, CH0, FLD_IAC), -2);
+            w.fill(SUNSPEC_NA_UINT16, 2);
+        }
+        w.sf(-2); // A_SF
+        if (threePhase) {
+            w.u16(value(TYPE_AC, CH0, FLD_UAC_12), -1);
+            w.u16(value(TYPE_AC, CH0, FLD_UAC_23), -1);
+            w.u16(value(TYPE_AC, CH0, FLD_UAC_31), -1);
+            w.u16(value(TYPE_AC, CH0, FLD_UAC_1N), -1);
+            w.u16(value(TYPE_AC, CH0, FLD_UAC_2N), -1);
+            w.u16(value(TYPE_AC, CH0, FLD_UAC_3N), -1);
+        } else {
+            w.fill(SUNSPEC_NA_UINT16, 3);
+            w.u16(value(TYPE_AC, CH0, FLD_UAC), -1);
+            w.fill(SUNSPEC_NA_UINT16, 2);
+        }
+        w.sf(-1); // V_SF
+        w.s16(value(TYPE_AC, CH0, FLD_PAC), -1); // W
+        w.sf(-1);
+        w.u16(value(TYPE_AC, CH0, FLD_F), -2); // Hz
+        w.sf(-2);
+        w.u16(SUNSPEC_NA_INT16); // VA
+        w.u16(SUNSPEC_NA_SF);
+        w.s16(value(TYPE_AC, CH0, FLD_Q), -1); // VAr
+        w.sf(-1);
+        w.s16(value(TYPE_AC, CH0, FLD_PF), -3); // PF
+        w.sf(-3);
+        const float yieldTotal = value(TYPE_INV, CH0, FLD_YT);
+        w.u32(std::isfinite(yieldTotal) ? static_cast<uint32_t>(yieldTotal * 1000) : 0); // WH
+        w.sf(0);
+        w.u16(SUNSPEC_NA_UINT16); // DCA
+        w.u16(SUNSPEC_NA_SF);
+        w.u16(SUNSPEC_NA_UINT16); // DCV
+        w.u16(SUNSPEC_NA_SF);
+        w.s16(value(TYPE_INV, CH0, FLD_PDC), -1); // DCW
+        w.sf(-1);
+        w.s16(value(TYPE_INV, CH0, FLD_T), -1); // TmpCab
+        w.fill(SUNSPEC_NA_INT16, 3); // TmpSnk, TmpTrns, TmpOt
+        w.sf(-1);
+
+        limit = std::min<float>(100, std::max<float>(0, inv.SystemConfigPara()->getLimitPercent()));
+        SunSpecState_t state = SunSpecState_t::Off;
+        if (inv.isProducing()) {
+            state = limit < 100 ? SunSpecState_t::Throttled : SunSpecState_t::Mppt;
+        } else if (inv.isReachable()) {
+            state = SunSpecState_t::Standby;
+        }
+        w.u16(static_cast<uint16_t>(state)); // St
+        w.u16(SUNSPEC_NA_UINT16); // StVnd
+        w.fill(0, 12); // Evt1, Evt2, EvtVnd1..4
+
+        // Model 123: immediate controls, only the limit and connect registers are writable
+        w.model(123, 24);
+        w.fill(0, 2); // Conn_WinTms, Conn_RvrtTms
+        w.u16(inv.isProducing() ? 1 : 0); // Conn
+        w.u16(limit); // WMaxLimPct
+        w.fill(0, 3); // WMaxLimPct_WinTms, _RvrtTms, _RmpTms
+        w.u16(limit < 100 ? 1 : 0); // WMaxLim_Ena
+        w.u16(SUNSPEC_NA_INT16); // OutPFSet
+        w.fill(0, 3);
+        w.u16(0); // OutPFSet_Ena
+        w.fill(SUNSPEC_NA_INT16, 3); // VArWMaxPct, VArMaxPct, VArAvalPct
+        w.fill(0, 3);
+        w.u16(SUNSPEC_NA_UINT16); // VArPct_Mod
+        w.u16(0); // VArPct_Ena
+        w.sf(0); // WMaxLimPct_SF
+        w.u16(SUNSPEC_NA_SF); // OutPFSet_SF
+        w.u16(SUNSPEC_NA_SF); // VArPct_SF
+
+        // Model 160: one module per MPPT input
+        w.model(160, 8 + 20 * dcChannels.size());
+        w.sf(-2); // DCA_SF
+        w.sf(-1); // DCV_SF
+        w.sf(-1); // DCW_SF
+        w.sf(0); // DCWH_SF
+        w.u32(0); // Evt
+        w.u16(dcChannels.size()); // N
+        w.u16(SUNSPEC_NA_UINT16); // TmsPer
+        for (const auto& c : dcChannels) {
+            char id[17];
+            snprintf(id, sizeof(id), "Input %d", static_cast<int>(c) + 1);
+            w.u16(static_cast<uint16_t>(c) + 1); // ID
+            w.str(id, 8); // IDStr
+            w.u16(value(TYPE_DC, c, FLD_IDC), -2);
+            w.u16(value(TYPE_DC, c, FLD_UDC), -1);
+            w.u16(value(TYPE_DC, c, FLD_PDC), -1);
+            const float dcYield = value(TYPE_DC, c, FLD_YT);
+            w.u32(std::isfinite(dcYield) ? static_cast<uint32_t>(dcYield * 1000) : 0); // DCWH
+            w.u32(0); // Tms
+            w.u16(SUNSPEC_NA_INT16); // Tmp
+            w.u16(SUNSPEC_NA_UINT16); // DCSt
+            w.u32(0); // DCEvt
+        }
+
+        w.u16(0xffff); // end model
+        w.u16(0);
+    });
+}
+
+void ModbusServerClass::onConnect(AsyncClient* client)
+{
+    if (_clients >= MODBUS_MAX_CLIENTS) {
+        client->close(true);
+        delete client;
+        return;
+    }
+    _clients++;
+
+    Connection_t* connection = new Connection_t();
+    client->setRxTimeout(MODBUS_CLIENT_TIMEOUT / 1000);
+    client->setNoDelay(true);
+
+    client->onData([](void* arg, AsyncClient* c, void* data, size_t len) {
+        ModbusServer.onData(c, static_cast<Connection_t*>(arg), static_cast<const uint8_t*>(data), len);
+    },
+        connection);
+    client->onTimeout([](void*, AsyncClient* c, uint32_t) {
+        c->close(true);
+    },
+        nullptr);
+    client->onDisconnect([](void* arg, AsyncClient* c) {
+        delete static_cast<Connection_t*>(arg);
+        ModbusServer._clients--;
+        delete c;
+    },
+        connection);
+}
+
+void ModbusServerClass::onData(AsyncClient* client, Connection_t* connection, const uint8_t* data, const size_t len)
+{
+    // Requests may be split or several of them may arrive at once
+    connection->Rx.insert(connection->Rx.end(), data, data + len);
+
+    while (connection->Rx.size() >= MODBUS_MBAP_SIZE) {
+        const uint8_t* frame = connection->Rx.data();
+        const uint16_t protocol = frame[2] << 8 | frame[3];
+        const uint16_t length = frame[4] << 8 | frame[5];
+        if (protocol != 0 || length < 2 || length > MODBUS_MAX_PDU_SIZE + 1) {
+            client->close(true);
+            return;
+        }
+        if (connection->Rx.size() < 6u + length) {
+            return;
+        }
+
+        uint8_t response[MODBUS_MBAP_SIZE + MODBUS_MAX_PDU_SIZE];
+        const uint8_t unitId = frame[6];
+        const size_t pduLen = handleRequest(unitId, &frame[MODBUS_MBAP_SIZE], length - 1, &response[MODBUS_MBAP_SIZE]);
+
+        memcpy(response, frame, 4); // Transaction and protocol id
+        response[4] = (pduLen + 1) >> 8;
+        response[5] = (pduLen + 1) & 0xff;
+        response[6] = unitId;
+        client->write(reinterpret_cast<const char*>(response), MODBUS_MBAP_SIZE + pduLen);
+
+        connection->Rx.erase(connection->Rx.begin(), connection->Rx.begin() + 6 + length);
+    }
+}
+
+size_t ModbusServerClass::handleRequest(const uint8_t unitId, const uint8_t* pdu, const size_t len, uint8_t* response)
+{
+    _requests++;
+
+    const uint8_t function = pdu[0];
+    uint8_t exception = 0;
+    size_t responseLen = 0;
+
+    response[0] = function;
+
+    if (function == MODBUS_FC_READ_HOLDING || function == MODBUS_FC_READ_INPUT) {
+        const uint16_t address = pdu[1] << 8 | pdu[2];
+        const uint16_t count = pdu[3] << 8 | pdu[4];
+        if (len != 5 || count == 0 || count > MODBUS_MAX_READ_COUNT) {
+            exception = MODBUS_EX_ILLEGAL_VALUE;
+        } else {
+            responseLen = readRegisters(unitId, address, count, response);
+            if (responseLen == 0) {
+                exception = response[1];
+            }
+        }
+    } else if (function == MODBUS_FC_WRITE_SINGLE) {
+        if (len != 5) {
+            exception = MODBUS_EX_ILLEGAL_VALUE;
+        } else {
+            exception = writeRegister(unitId, pdu[1] << 8 | pdu[2], pdu[3] << 8 | pdu[4]);
+            if (exception == 0) {
+                memcpy(response, pdu, 5); // Echo of the request
+                responseLen = 5;
+            }
+        }
+    } else if (function == MODBUS_FC_WRITE_MULTIPLE) {
+        const uint16_t address = pdu[1] << 8 | pdu[2];
+        const uint16_t count = pdu[3] << 8 | pdu[4];
+        if (len < 6 || count == 0 || count > MODBUS_MAX_WRITE_COUNT || pdu[5] != 2 * count || len != 6u + 2 * count) {
+            exception = MODBUS_EX_ILLEGAL_VALUE;
+        } else {
+            for (uint16_t i = 0; i < count && exception == 0; i++) {
+                exception = writeRegister(unitId, address + i, pdu[6 + 2 * i] << 8 | pdu[7 + 2 * i]);
+            }
+            if (exception == 0) {
+                memcpy(response, pdu, 5); // Function, address and count
+                responseLen = 5;
+            }
+        }
+    } else {
+        exception = MODBUS_EX_ILLEGAL_FUNCTION;
+    }
+
+    if (exception != 0) {
+        _exceptions++;
+        response[0] = function | 0x80;
+        response[1] = exception;
+        return 2;
+    }
+    return responseLen;
+}
+
+// Returns the length of the response, 0 with the exception code in response[1]
+size_t ModbusServerClass::readRegisters(const uint8_t unitId, const uint16_t address, const uint16_t count, uint8_t* response)
+{
+    std::lock_guard<std::mutex> lock(_imageMutex);
+
+    if (unitId == 0 || unitId > _images.size() || _images[unitId - 1].Registers.empty()) {
+        response[1] = MODBUS_EX_TARGET_FAILED;
+        return 0;
+    }
+
+    const std::vector<uint16_t>& registers = _images[unitId - 1].Registers;
+    if (address < MODBUS_SUNSPEC_BASE || address - MODBUS_SUNSPEC_BASE + count > registers.size()) {
+        response[1] = MODBUS_EX_ILLEGAL_ADDRESS;
+        return 0;
+    }
+
+    response[1] = 2 * count;
+    const uint16_t* src = &registers[address - MODBUS_SUNSPEC_BASE];
+    for (uint16_t i = 0; i < count; i++) {
+        response[2 + 2 * i] = src[i] >> 8;
+        response[3 + 2 * i] = src[i] & 0xff;
+    }
+    return 2 + 2 * count;
+}
+
+uint8_t ModbusServerClass::writeRegister(const uint8_t unitId, const uint16_t address, const uint16_t value)
+{
+    if (!Configuration.get().Modbus.AllowWrite) {
+        return MODBUS_EX_ILLEGAL_FUNCTION;
+    }
+
+    std::shared_ptr<InverterAbstract> inv = unitId > 0 ? Hoymiles.getInverterByPos(unitId - 1) : nullptr;
+    if (inv == nullptr) {
+        return MODBUS_EX_TARGET_FAILED;
+    }
+
+    const uint16_t offset = address - MODBUS_SUNSPEC_BASE;
+    bool queued = false;
+
+    switch (offset) {
+    case MODBUS_SUNSPEC_WMAXLIMPCT:
+        if (value > 100) {
+            return MODBUS_EX_ILLEGAL_VALUE;
+        }
+        queued = inv->sendActivePowerControlRequest(value, PowerLimitControlType::RelativNonPersistent);
+        break;
+    case MODBUS_SUNSPEC_WMAXLIM_ENA:
+        if (value > 1) {
+            return MODBUS_EX_ILLEGAL_VALUE;
+        }
+        // Disabling the limit releases the inverter to its full power, enabling it keeps the current limit
+        queued = value == 1 || inv->sendActivePowerControlRequest(100, PowerLimitControlType::RelativNonPersistent);
+        break;
+    case MODBUS_SUNSPEC_CONN:
+        if (value > 1) {
+            return MODBUS_EX_ILLEGAL_VALUE;
+        }
+        queued = inv->sendPowerControlRequest(value == 1);
+        break;
+    default:
+        return MODBUS_EX_ILLEGAL_ADDRESS;
+    }
+
+    // Commands disabled for the inverter or the queue is full
+    if (!queued) {
+        return MODBUS_EX_DEVICE_FAILURE;
+    }
+
+    _writes++;
+    return 0;
+}
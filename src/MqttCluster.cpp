@@ -0,0 +1,458 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "MqttCluster.h"
+#include "Configuration.h"
+#include "InverterSettings.h"
+#include "MessageOutput.h"
+#include "MqttSettings.h"
+#include "NetworkSettings.h"
+#include "SunPosition.h"
+#include "TaskProfiler.h"
+#include "Utils.h"
+#include <Hoymiles.h>
+#include <algorithm>
+#include <cmath>
+
+MqttClusterClass MqttCluster;
+
+static String serialToString(const uint64_t serial)
+{
+    char buffer[sizeof(uint64_t) * 8 + 1];
+    snprintf(buffer, sizeof(buffer), "%0" PRIx32 "%08" PRIx32,
+        static_cast<uint32_t>((serial >> 32) & 0xFFFFFFFF),
+        static_cast<uint32_t>(serial & 0xFFFFFFFF));
+    return buffer;
+}
+
+MqttClusterClass::MqttClusterClass()
+    : _loopTask(TASK_SECOND, TASK_FOREVER)
+{
+}
+
+void MqttClusterClass::init(Scheduler& scheduler)
+{
+    // Fixed width, so the lowest id can be compared as string
+    char nodeId[9];
+    snprintf(nodeId, sizeof(nodeId), "%06" PRIx32, Utils::getChipId());
+    _nodeId = nodeId;
+
+    scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "MqttCluster.loop", std::bind(&MqttClusterClass::loop, this));
+    _loopTask.enable();
+
+    subscribeTopics();
+}
+
+void MqttClusterClass::subscribeTopics()
+{
+    const CONFIG_T& config = Configuration.get();
+    if (!config.Mqtt.Cluster.Enabled || config.Mqtt.Cluster.Topic[0] == '\0') {
+        return;
+    }
+
+    using std::placeholders::_1;
+    using std::placeholders::_2;
+    using std::placeholders::_3;
+    using std::placeholders::_4;
+    using std::placeholders::_5;
+    using std::placeholders::_6;
+
+    _subscribedTopic = config.Mqtt.Cluster.Topic;
+    MqttSettings.subscribe(_subscribedTopic + "node/+", 0, std::bind(&MqttClusterClass::onReport, this, _1, _2, _3, _4, _5, _6));
+    MqttSettings.subscribe(_subscribedTopic + "assignment", 1, std::bind(&MqttClusterClass::onAssignment, this, _1, _2, _3, _4, _5, _6));
+}
+
+void MqttClusterClass::unsubscribeTopics()
+{
+    if (_subscribedTopic.isEmpty()) {
+        return;
+    }
+
+    MqttSettings.unsubscribe(_subscribedTopic + "node/+");
+    MqttSettings.unsubscribe(_subscribedTopic + "assignment");
+    _subscribedTopic.clear();
+
+    // The state of the old cluster does not apply any longer
+    reset();
+}
+
+bool MqttClusterClass::isOwner(const uint64_t serial)
+{
+    if (!Configuration.get().Mqtt.Cluster.Enabled) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = std::find_if(_owners.begin(), _owners.end(), [serial](const Owner_t& o) { return o.Serial == serial; });
+    return it == _owners.end() || it->NodeId == _nodeId;
+}
+
+MqttClusterStatus_t MqttClusterClass::getStatus()
+{
+    const uint32_t now = millis();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    MqttClusterStatus_t status;
+    status.Enabled = Configuration.get().Mqtt.Cluster.Enabled;
+    status.NodeId = _nodeId;
+    status.LeaderId = _leaderId;
+    status.NodeCount = std::count_if(_nodes.begin(), _nodes.end(), [this, now](const Node_t& n) { return isAlive(n, now); });
+    status.OwnedInverters = std::count_if(_owners.begin(), _owners.end(), [this](const Owner_t& o) { return o.NodeId == _nodeId; });
+    status.AssignedInverters = _owners.size();
+    status.Handovers = _handovers;
+    return status;
+}
+
+void MqttClusterClass::reset()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _nodes.clear();
+        _owners.clear();
+        _leaderId.clear();
+    }
+    _assignmentChanged = true;
+}
+
+void MqttClusterClass::loop()
+{
+    const CONFIG_T& config = Configuration.get();
+
+    // Polling follows a new assignment within a second, not only with the next settings loop
+    if (_assignmentChanged.exchange(false)) {
+        InverterSettings.forceUpdate();
+    }
+
+    if (!config.Mqtt.Enabled || !config.Mqtt.Cluster.Enabled || _subscribedTopic.isEmpty() || !MqttSettings.getConnected()) {
+        return;
+    }
+
+    const uint32_t now = millis();
+    if (_lastReport != 0 && now - _lastReport < MQTT_CLUSTER_REPORT_INTERVAL * 1000) {
+        return;
+    }
+    _lastReport = now;
+    if (_joinTime == 0) {
+        _joinTime = now;
+    }
+
+    publishReport(now);
+    updateAssignment(now);
+    probeInverters();
+}
+
+void MqttClusterClass::publishReport(const uint32_t now)
+{
+    JsonDocument doc;
+    doc["hostname"] = NetworkSettings.getHostname();
+    JsonArray links = doc["inverters"].to<JsonArray>();
+
+    Hoymiles.forEachInverter([&](InverterAbstract& inv, const uint8_t) {
+        const uint32_t txTotal = inv.RadioStats.TxRequestData;
+        const uint32_t rxTotal = inv.RadioStats.RxSuccess;
+
+        auto it = std::find_if(_counters.begin(), _counters.end(), [&inv](const Counters_t& c) { return c.Serial == inv.serial(); });
+        if (it == _counters.end()) {
+            // The first report only takes the base of the difference
+            _counters.push_back({ inv.serial(), txTotal, rxTotal });
+            return;
+        }
+
+        uint32_t tx = txTotal - it->TxRequestData;
+        uint32_t rx = rxTotal - it->RxSuccess;
+        if (txTotal < it->TxRequestData || rxTotal < it->RxSuccess) {
+            // Statistics were reset at midnight
+            tx = txTotal;
+            rx = rxTotal;
+        }
+        it->TxRequestData = txTotal;
+        it->RxSuccess = rxTotal;
+
+        // Nothing was sent to the inverter, the other DTUs keep the last score
+        if (tx == 0) {
+            return;
+        }
+
+        JsonObject link = links.add<JsonObject>();
+        link["serial"] = inv.serialString();
+        link["score"] = std::min(1.0f, static_cast<float>(rx) / tx);
+        link["rssi"] = inv.getLastRssi();
+    });
+
+    if (!Utils::checkJsonAlloc(doc, __FUNCTION__, __LINE__)) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        storeLinks(getNode(_nodeId), doc["inverters"].as<JsonArrayConst>(), now);
+    }
+
+    String payload;
+    serializeJson(doc, payload);
+    MqttSettings.publishGeneric(_subscribedTopic + "node/" + _nodeId, payload, false, 0);
+}
+
+void MqttClusterClass::updateAssignment(const uint32_t now)
+{
+    String payload;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        // Forget DTUs which are offline since a long time
+        _nodes.erase(std::remove_if(_nodes.begin(), _nodes.end(), [now](const Node_t& n) {
+            return now - n.LastSeen > 10 * MQTT_CLUSTER_NODE_TIMEOUT * MQTT_CLUSTER_REPORT_INTERVAL * 1000;
+        }),
+            _nodes.end());
+
+        // Until the reports of all DTUs online have been seen, nobody is elected
+        if (now - _joinTime < MQTT_CLUSTER_NODE_TIMEOUT * MQTT_CLUSTER_REPORT_INTERVAL * 1000) {
+            return;
+        }
+
+        String leader;
+        for (const auto& node : _nodes) {
+            if (isAlive(node, now) && (leader.isEmpty() || node.Id < leader)) {
+                leader = node.Id;
+            }
+        }
+
+        const bool becameLeader = leader == _nodeId && _leaderId != _nodeId;
+        if (leader != _leaderId) {
+            MessageOutput.printf("Cluster: leader is %s\r\n", leader.c_str());
+        }
+        _leaderId = leader;
+        if (leader != _nodeId) {
+            return;
+        }
+
+        // Non owners only measure with their probes, their scores have to live that long
+        const uint32_t maxLinkAge = 3 * MQTT_CLUSTER_PROBE_INTERVAL * 1000;
+
+        std::vector<uint64_t> serials;
+        for (const auto& owner : _owners) {
+            serials.push_back(owner.Serial);
+        }
+        for (const auto& node : _nodes) {
+            for (const auto& link : node.Links) {
+                serials.push_back(link.Serial);
+            }
+        }
+        std::sort(serials.begin(), serials.end());
+        serials.erase(std::unique(serials.begin(), serials.end()), serials.end());
+
+        std::vector<uint8_t> load(_nodes.size(), 0);
+        std::vector<Owner_t> owners;
+        uint32_t moved = 0;
+
+        for (const uint64_t serial : serials) {
+            // Score of the node reduced by the inverters it got already, NAN without current link
+            auto score = [&](const size_t n, int8_t* rssi) -> float {
+                if (!isAlive(_nodes[n], now)) {
+                    return NAN;
+                }
+                auto link = std::find_if(_nodes[n].Links.begin(), _nodes[n].Links.end(), [serial](const Link_t& l) { return l.Serial == serial; });
+                if (link == _nodes[n].Links.end() || now - link->Time > maxLinkAge) {
+                    return NAN;
+                }
+                if (rssi != nullptr) {
+                    *rssi = link->Rssi;
+                }
+                return link->Score - MQTT_CLUSTER_LOAD_PENALTY * load[n];
+            };
+
+            auto previous = std::find_if(_owners.begin(), _owners.end(), [serial](const Owner_t& o) { return o.Serial == serial; });
+            int current = -1;
+            if (previous != _owners.end()) {
+                for (size_t n = 0; n < _nodes.size(); n++) {
+                    if (_nodes[n].Id == previous->NodeId && isAlive(_nodes[n], now)) {
+                        current = n;
+                    }
+                }
+            }
+
+            int best = -1;
+            float bestScore = 0;
+            int8_t bestRssi = 0;
+            for (size_t n = 0; n < _nodes.size(); n++) {
+                int8_t rssi = 0;
+                const float s = score(n, &rssi);
+                if (std::isnan(s)) {
+                    continue;
+                }
+                if (best < 0 || s > bestScore || (s == bestScore && rssi > bestRssi)) {
+                    best = n;
+                    bestScore = s;
+                    bestRssi = rssi;
+                }
+            }
+
+            int chosen = current;
+            if (best >= 0 && best != current) {
+                const float currentScore = current >= 0 ? score(current, nullptr) : NAN;
+                if (std::isnan(currentScore) || bestScore > currentScore + MQTT_CLUSTER_HANDOVER_MARGIN) {
+                    chosen = best;
+                }
+            }
+
+            // Neither the old owner nor any other DTU online knows the inverter, so all DTUs poll it
+            if (chosen < 0) {
+                continue;
+            }
+
+            if (previous == _owners.end() || previous->NodeId != _nodes[chosen].Id) {
+                moved++;
+            }
+            owners.push_back({ serial, _nodes[chosen].Id });
+            load[chosen]++;
+        }
+
+        // The removal of an owner is a change as well
+        const bool changed = moved > 0 || owners.size() != _owners.size();
+        if (!changed && !becameLeader) {
+            return;
+        }
+        if (moved > 0) {
+            _handovers++;
+        }
+        _owners = owners;
+
+        JsonDocument doc;
+        doc["leader"] = _nodeId;
+        JsonArray list = doc["owners"].to<JsonArray>();
+        for (const auto& owner : _owners) {
+            JsonObject obj = list.add<JsonObject>();
+            obj["serial"] = serialToString(owner.Serial);
+            obj["node"] = owner.NodeId;
+        }
+        if (!Utils::checkJsonAlloc(doc, __FUNCTION__, __LINE__)) {
+            return;
+        }
+        serializeJson(doc, payload);
+    }
+
+    _assignmentChanged = true;
+
+    // Retained, so DTUs which start later get the assignment right away
+    MqttSettings.publishGeneric(_subscribedTopic + "assignment", payload, true, 1);
+}
+
+void MqttClusterClass::probeInverters()
+{
+    const uint32_t now = millis();
+    if (_lastProbe != 0 && now - _lastProbe < MQTT_CLUSTER_PROBE_INTERVAL * 1000) {
+        return;
+    }
+    _lastProbe = now;
+
+    const bool isDayPeriod = SunPosition.isDayPeriod();
+
+    for (auto const& inv_cfg : Configuration.get().Inverter) {
+        if (inv_cfg.Serial == 0 || isOwner(inv_cfg.Serial)) {
+            continue;
+        }
+        if (!inv_cfg.Poll_Enable || !(isDayPeriod || inv_cfg.Poll_Enable_Night)) {
+            continue;
+        }
+
+        auto inv = Hoymiles.getInverterBySerial(inv_cfg.Serial);
+        if (inv != nullptr) {
+            inv->sendStatsRequest(true);
+        }
+    }
+}
+
+void MqttClusterClass::onReport(const espMqttClientTypes::MessageProperties& properties, const char* topic, const uint8_t* payload, const size_t len, const size_t index, const size_t total)
+{
+    // Reports are small, fragmented or retained ones are not current
+    if (index != 0 || len != total || properties.retain) {
+        return;
+    }
+
+    const char* id = strrchr(topic, '/');
+    if (id == nullptr || id[1] == '\0' || _nodeId == id + 1) {
+        return;
+    }
+
+    JsonDocument doc;
+    if (deserializeJson(doc, payload, len) || !doc["inverters"].is<JsonArrayConst>()) {
+        MessageOutput.printf("Cluster: invalid report on topic '%s'\r\n", topic);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    storeLinks(getNode(id + 1), doc["inverters"].as<JsonArrayConst>(), millis());
+}
+
+void MqttClusterClass::onAssignment(const espMqttClientTypes::MessageProperties& properties, const char* topic, const uint8_t* payload, const size_t len, const size_t index, const size_t total)
+{
+    if (index != 0 || len != total) {
+        return;
+    }
+
+    std::vector<Owner_t> owners;
+
+    // An empty message removes the assignment, all DTUs poll all their inverters then
+    if (len > 0) {
+        JsonDocument doc;
+        if (deserializeJson(doc, payload, len) || !doc["owners"].is<JsonArrayConst>()) {
+            MessageOutput.printf("Cluster: invalid assignment on topic '%s'\r\n", topic);
+            return;
+        }
+
+        for (JsonObjectConst owner : doc["owners"].as<JsonArrayConst>()) {
+            const uint64_t serial = strtoull(owner["serial"] | "0", nullptr, 16);
+            const char* node = owner["node"] | "";
+            if (serial != 0 && node[0] != '\0') {
+                owners.push_back({ serial, node });
+            }
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _owners = std::move(owners);
+    }
+    _assignmentChanged = true;
+}
+
+MqttClusterClass::Node_t& MqttClusterClass::getNode(const String& id)
+{
+    auto it = std::find_if(_nodes.begin(), _nodes.end(), [&id](const Node_t& n) { return n.Id == id; });
+    if (it != _nodes.end()) {
+        return *it;
+    }
+
+    MessageOutput.printf("Cluster: DTU %s joined\r\n", id.c_str());
+    _nodes.push_back({ id, 0, {} });
+    return _nodes.back();
+}
+
+bool MqttClusterClass::isAlive(const Node_t& node, const uint32_t now) const
+{
+    return now - node.LastSeen <= MQTT_CLUSTER_NODE_TIMEOUT * MQTT_CLUSTER_REPORT_INTERVAL * 1000;
+}
+
+void MqttClusterClass::storeLinks(Node_t& node, const JsonArrayConst links, const uint32_t now)
+{
+    node.LastSeen = now;
+
+    for (JsonObjectConst obj : links) {
+        const uint64_t serial = strtoull(obj["serial"] | "0", nullptr, 16);
+        if (serial == 0) {
+            continue;
+        }
+
+        auto link = std::find_if(node.Links.begin(), node.Links.end(), [serial](const Link_t& l) { return l.Serial == serial; });
+        if (link == node.Links.end()) {
+            node.Links.push_back({ serial, 0, 0, 0 });
+            link = node.Links.end() - 1;
+        }
+        link->Score = obj["score"] | 0.0f;
+        link->Rssi = obj["rssi"] | -127;
+        link->Time = now;
+    }
+}
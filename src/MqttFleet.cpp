@@ -0,0 +1,225 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "MqttFleet.h"
+#include "Configuration.h"
+#include "Datastore.h"
+#include "MessageOutput.h"
+#include "MqttSettings.h"
+#include "NetworkSettings.h"
+#include "TaskProfiler.h"
+#include "Utils.h"
+#include <ArduinoJson.h>
+#include <algorithm>
+
+MqttFleetClass MqttFleet;
+
+MqttFleetClass::MqttFleetClass()
+    : _loopTask(TASK_SECOND, TASK_FOREVER)
+{
+}
+
+void MqttFleetClass::init(Scheduler& scheduler)
+{
+    char nodeId[9];
+    snprintf(nodeId, sizeof(nodeId), "%06" PRIx32, Utils::getChipId());
+    _nodeId = nodeId;
+
+    scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "MqttFleet.loop", std::bind(&MqttFleetClass::loop, this));
+    _loopTask.enable();
+
+    subscribeTopics();
+}
+
+void MqttFleetClass::subscribeTopics()
+{
+    const CONFIG_T& config = Configuration.get();
+    if (!config.Mqtt.Fleet.Aggregate || config.Mqtt.Fleet.Topic[0] == '\0') {
+        return;
+    }
+
+    using std::placeholders::_1;
+    using std::placeholders::_2;
+    using std::placeholders::_3;
+    using std::placeholders::_4;
+    using std::placeholders::_5;
+    using std::placeholders::_6;
+
+    _subscribedTopic = config.Mqtt.Fleet.Topic;
+    MqttSettings.subscribe(_subscribedTopic + "dtu/+", 0, std::bind(&MqttFleetClass::onSnapshot, this, _1, _2, _3, _4, _5, _6));
+}
+
+void MqttFleetClass::unsubscribeTopics()
+{
+    if (_subscribedTopic.isEmpty()) {
+        return;
+    }
+
+    MqttSettings.unsubscribe(_subscribedTopic + "dtu/+");
+    _subscribedTopic.clear();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _peers.clear();
+    _generation++;
+}
+
+bool MqttFleetClass::isAggregator() const
+{
+    return Configuration.get().Mqtt.Fleet.Aggregate;
+}
+
+uint32_t MqttFleetClass::getGeneration() const
+{
+    return _generation;
+}
+
+MqttFleetTotal_t MqttFleetClass::getTotal()
+{
+    MqttFleetTotal_t total;
+    total.AcPower = Datastore.getTotalAcPowerEnabled();
+    total.AcYieldDay = Datastore.getTotalAcYieldDayEnabled();
+    total.AcYieldTotal = Datastore.getTotalAcYieldTotalEnabled();
+    total.DcPower = Datastore.getTotalDcPowerEnabled();
+    total.AcPowerDigits = Datastore.getTotalAcPowerDigits();
+    total.AcYieldDayDigits = Datastore.getTotalAcYieldDayDigits();
+    total.AcYieldTotalDigits = Datastore.getTotalAcYieldTotalDigits();
+    total.DcPowerDigits = Datastore.getTotalDcPowerDigits();
+    total.DtuCount = 1;
+    total.DtusOnline = 1;
+    total.IsValid = Datastore.getIsAllEnabledReachable();
+
+    const uint32_t now = millis();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const auto& peer : _peers) {
+        total.DtuCount++;
+        if (now - peer.LastSeen > MQTT_FLEET_PEER_TIMEOUT * peer.Interval * 1000) {
+            total.IsValid = false;
+            continue;
+        }
+
+        total.DtusOnline++;
+        total.AcPower += peer.AcPower;
+        total.AcYieldDay += peer.AcYieldDay;
+        total.AcYieldTotal += peer.AcYieldTotal;
+        total.DcPower += peer.DcPower;
+        total.IsValid &= peer.IsValid;
+    }
+
+    return total;
+}
+
+void MqttFleetClass::loop()
+{
+    const CONFIG_T& config = Configuration.get();
+
+    if (!config.Mqtt.Enabled || !(config.Mqtt.Fleet.Publish || config.Mqtt.Fleet.Aggregate)
+        || config.Mqtt.Fleet.Topic[0] == '\0' || !MqttSettings.getConnected()) {
+        return;
+    }
+
+    const uint32_t now = millis();
+    if (_lastPublish != 0 && now - _lastPublish < config.Mqtt.PublishInterval * 1000) {
+        return;
+    }
+    _lastPublish = now;
+
+    {
+        // Forget DTUs which were removed from the site
+        std::lock_guard<std::mutex> lock(_mutex);
+        _peers.erase(std::remove_if(_peers.begin(), _peers.end(), [now](const Peer_t& p) {
+            return now - p.LastSeen > MQTT_FLEET_PEER_FORGET * 1000UL;
+        }),
+            _peers.end());
+    }
+
+    if (config.Mqtt.Fleet.Publish) {
+        publishSnapshot();
+    }
+    if (config.Mqtt.Fleet.Aggregate) {
+        publishTotal();
+    }
+}
+
+void MqttFleetClass::publishSnapshot()
+{
+    const CONFIG_T& config = Configuration.get();
+
+    JsonDocument doc;
+    doc["hostname"] = NetworkSettings.getHostname();
+    doc["interval"] = config.Mqtt.PublishInterval;
+    doc["ac_power"] = Datastore.getTotalAcPowerEnabled();
+    doc["ac_yieldday"] = Datastore.getTotalAcYieldDayEnabled();
+    doc["ac_yieldtotal"] = Datastore.getTotalAcYieldTotalEnabled();
+    doc["dc_power"] = Datastore.getTotalDcPowerEnabled();
+    doc["is_valid"] = Datastore.getIsAllEnabledReachable();
+
+    if (!Utils::checkJsonAlloc(doc, __FUNCTION__, __LINE__)) {
+        return;
+    }
+
+    String payload;
+    serializeJson(doc, payload);
+
+    // Not retained, the aggregator must not count a DTU which is gone
+    MqttSettings.publishGeneric(String(config.Mqtt.Fleet.Topic) + "dtu/" + _nodeId, payload, false, 0);
+}
+
+void MqttFleetClass::publishTotal()
+{
+    const CONFIG_T& config = Configuration.get();
+    const MqttFleetTotal_t total = getTotal();
+    const String topic = String(config.Mqtt.Fleet.Topic) + "total/";
+
+    MqttSettings.publishGeneric(topic + "ac/power", String(total.AcPower, total.AcPowerDigits), config.Mqtt.Retain);
+    MqttSettings.publishGeneric(topic + "ac/yieldtotal", String(total.AcYieldTotal, total.AcYieldTotalDigits), config.Mqtt.Retain);
+    MqttSettings.publishGeneric(topic + "ac/yieldday", String(total.AcYieldDay, total.AcYieldDayDigits), config.Mqtt.Retain);
+    MqttSettings.publishGeneric(topic + "dc/power", String(total.DcPower, total.DcPowerDigits), config.Mqtt.Retain);
+    MqttSettings.publishGeneric(topic + "dtus", String(total.DtuCount), config.Mqtt.Retain);
+    MqttSettings.publishGeneric(topic + "dtus_online", String(total.DtusOnline), config.Mqtt.Retain);
+    MqttSettings.publishGeneric(topic + "is_valid", String(total.IsValid), config.Mqtt.Retain);
+}
+
+void MqttFleetClass::onSnapshot(const espMqttClientTypes::MessageProperties& properties, const char* topic, const uint8_t* payload, const size_t len, const size_t index, const size_t total)
+{
+    // Snapshots are small, retained ones are not current
+    if (index != 0 || len != total || properties.retain) {
+        return;
+    }
+
+    const char* id = strrchr(topic, '/');
+    if (id == nullptr || id[1] == '\0' || _nodeId == id + 1) {
+        return;
+    }
+
+    JsonDocument doc;
+    if (deserializeJson(doc, payload, len) || !doc["ac_power"].is<float>()) {
+        MessageOutput.printf("Fleet: invalid snapshot on topic '%s'\r\n", topic);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto peer = std::find_if(_peers.begin(), _peers.end(), [id](const Peer_t& p) { return p.Id == id + 1; });
+    if (peer == _peers.end()) {
+        if (_peers.size() >= MQTT_FLEET_MAX_PEERS) {
+            return;
+        }
+        MessageOutput.printf("Fleet: DTU %s joined\r\n", id + 1);
+        _peers.push_back({});
+        peer = _peers.end() - 1;
+        peer->Id = id + 1;
+    }
+
+    peer->LastSeen = millis();
+    peer->Interval = std::max<uint32_t>(doc["interval"] | MQTT_PUBLISH_INTERVAL, 1);
+    peer->AcPower = doc["ac_power"] | 0.0f;
+    peer->AcYieldDay = doc["ac_yieldday"] | 0.0f;
+    peer->AcYieldTotal = doc["ac_yieldtotal"] | 0.0f;
+    peer->DcPower = doc["dc_power"] | 0.0f;
+    peer->IsValid = doc["is_valid"] | false;
+
+    _generation++;
+}
@@ -4,31 +4,39 @@
  */
 #include "MqttHandleDtu.h"
 #include "Configuration.h"
+#include "CpuLoad.h"
 #include "MqttSettings.h"
 #include "NetworkSettings.h"
+#include "PublishCoordinator.h"
+#include "ResourceGovernor.h"
+#include "TaskProfiler.h"
 #include <CpuTemperature.h>
-#include <Hoymiles.h>
 
 MqttHandleDtuClass MqttHandleDtu;
 
 MqttHandleDtuClass::MqttHandleDtuClass()
-    : _loopTask(TASK_IMMEDIATE, TASK_FOREVER, std::bind(&MqttHandleDtuClass::loop, this))
+    : _loopTask(TASK_IMMEDIATE, TASK_FOREVER)
 {
 }
 
 void MqttHandleDtuClass::init(Scheduler& scheduler)
 {
     scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "MqttHandleDtu.loop", std::bind(&MqttHandleDtuClass::loop, this));
     _loopTask.setInterval(Configuration.get().Mqtt.PublishInterval * TASK_SECOND);
     _loopTask.enable();
 }
 
 void MqttHandleDtuClass::loop()
 {
-    _loopTask.setInterval(Configuration.get().Mqtt.PublishInterval * TASK_SECOND);
+    _loopTask.setInterval(ResourceGovernor.getMqttPublishInterval() * TASK_SECOND);
 
-    if (!MqttSettings.getConnected() || !Hoymiles.isAllRadioIdle()) {
-        _loopTask.forceNextIteration();
+    if (!MqttSettings.getConnected()) {
+        _loopTask.delay(PublishCoordinator.getRetryDelay(MQTT_PUBLISH_RETRY_INTERVAL) * TASK_MILLISECOND);
+        return;
+    }
+    if (!PublishCoordinator.beginSlice()) {
+        _loopTask.delay(PublishCoordinator.getWaitDelay() * TASK_MILLISECOND);
         return;
     }
 
@@ -44,8 +52,20 @@ void MqttHandleDtuClass::loop()
         MqttSettings.publish("dtu/bssid", WiFi.BSSIDstr());
     }
 
+    const CpuLoadStats_t cpuLoad = CpuLoad.getStats();
+    for (uint8_t i = 0; i < ESP.getChipCores() && i < cpuLoad.CoreLoad.size(); i++) {
+        MqttSettings.publish("dtu/cpu/core" + String(i), String(cpuLoad.CoreLoad[i]));
+    }
+    for (const auto& task : cpuLoad.Tasks) {
+        String name = task.Name;
+        name.replace(' ', '_');
+        MqttSettings.publish("dtu/cpu/task/" + name, String(task.Load));
+    }
+
     float temperature = CpuTemperature.read();
     if (!std::isnan(temperature)) {
         MqttSettings.publish("dtu/temperature", String(temperature));
     }
+
+    PublishCoordinator.endSlice();
 }
@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "MqttHandleFastLane.h"
+#include "Configuration.h"
+#include "Datastore.h"
+#include "MqttSettings.h"
+
+MqttHandleFastLaneClass MqttHandleFastLane;
+
+void MqttHandleFastLaneClass::init(Scheduler& scheduler)
+{
+    EventBus.subscribe(Event_t::StatisticsUpdated, std::bind(&MqttHandleFastLaneClass::onStatisticsUpdated, this, std::placeholders::_1));
+    EventBus.subscribe(Event_t::TotalsUpdated, std::bind(&MqttHandleFastLaneClass::onTotalsUpdated, this, std::placeholders::_1));
+}
+
+void MqttHandleFastLaneClass::onStatisticsUpdated(const EventData_t& event)
+{
+    auto const& fastLane = Configuration.get().Mqtt.FastLane;
+    if ((!fastLane.AcPower && !fastLane.DcPower) || !MqttSettings.getConnected()) {
+        return;
+    }
+
+    auto inv = Hoymiles.getInverterBySerial(event.Serial);
+    if (inv == nullptr || !inv->getEnablePolling()) {
+        return;
+    }
+
+    auto stats = inv->Statistics();
+    char acPower[FORMAT_FIXED_BUFFER_SIZE] = {};
+    char dcPower[FORMAT_FIXED_BUFFER_SIZE] = {};
+    stats->readConsistent([&]() {
+        if (fastLane.AcPower && stats->hasChannelFieldValue(TYPE_AC, CH0, FLD_PAC)) {
+            stats->getChannelFieldValueString(TYPE_AC, CH0, FLD_PAC, acPower, sizeof(acPower));
+        }
+        if (fastLane.DcPower && stats->hasChannelFieldValue(TYPE_INV, CH0, FLD_PDC)) {
+            stats->getChannelFieldValueString(TYPE_INV, CH0, FLD_PDC, dcPower, sizeof(dcPower));
+        }
+    });
+
+    // Same topics as MqttHandleInverter
+    const String subtopic = String(inv->serialString()) + "/0/";
+    if (acPower[0] != '\0') {
+        MqttSettings.publishPriority(subtopic + "power", acPower);
+    }
+    if (dcPower[0] != '\0') {
+        MqttSettings.publishPriority(subtopic + "powerdc", dcPower);
+    }
+}
+
+void MqttHandleFastLaneClass::onTotalsUpdated(const EventData_t& event)
+{
+    auto const& fastLane = Configuration.get().Mqtt.FastLane;
+    if ((!fastLane.TotalAcPower && !fastLane.TotalDcPower) || !MqttSettings.getConnected()) {
+        return;
+    }
+
+    // Same topics as MqttHandleInverterTotal
+    if (fastLane.TotalAcPower) {
+        MqttSettings.publishPriority("ac/power", String(Datastore.getTotalAcPowerEnabled(), Datastore.getTotalAcPowerDigits()));
+    }
+    if (fastLane.TotalDcPower) {
+        MqttSettings.publishPriority("dc/power", String(Datastore.getTotalDcPowerEnabled(), Datastore.getTotalDcPowerDigits()));
+    }
+}
@@ -3,27 +3,42 @@
  * Copyright (C) 2022-2025 Thomas Basler and others
  */
 #include "MqttHandleHass.h"
+#include "FsWorker.h"
+#include "HeapTelemetry.h"
+#include "MessageOutput.h"
 #include "MqttHandleInverter.h"
 #include "MqttSettings.h"
 #include "NetworkSettings.h"
+#include "ResourceGovernor.h"
+#include "TaskProfiler.h"
 #include "Utils.h"
 #include "__compiled_constants.h"
 #include "defaults.h"
+#include <LittleFS.h>
 
 MqttHandleHassClass MqttHandleHass;
 
 MqttHandleHassClass::MqttHandleHassClass()
-    : _loopTask(TASK_IMMEDIATE, TASK_FOREVER, std::bind(&MqttHandleHassClass::loop, this))
+    : _loopTask(TASK_IMMEDIATE, TASK_FOREVER)
 {
 }
 
 void MqttHandleHassClass::init(Scheduler& scheduler)
 {
     scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "MqttHandleHass.loop", std::bind(&MqttHandleHassClass::loop, this));
     _loopTask.enable();
 }
 
 void MqttHandleHassClass::loop()
+{
+    processDiscovery();
+
+    const bool paused = ResourceGovernor.isShedding(ShedStep_t::HassDiscovery);
+    _loopTask.setInterval(_discoveryRunning && !paused ? TASK_IMMEDIATE : HASS_IDLE_INTERVAL * TASK_MILLISECOND);
+}
+
+void MqttHandleHassClass::processDiscovery()
 {
     if (_updateForced) {
         publishConfig();
@@ -38,6 +53,28 @@ void MqttHandleHassClass::loop()
         // Connection lost
         _wasConnected = false;
     }
+
+    if (!_discoveryRunning) {
+        return;
+    }
+
+    if (!Configuration.get().Mqtt.Hass.Enabled) {
+        _discoveryRunning = false;
+        return;
+    }
+
+    // Continue after the connection was established again or the memory pressure cleared
+    if (!MqttSettings.getConnected() || ResourceGovernor.isShedding(ShedStep_t::HassDiscovery)) {
+        return;
+    }
+
+    for (uint8_t i = 0; i < HASS_CONFIGS_PER_TICK && _discoveryRunning; i++) {
+        _discoveryRunning = publishNextConfig();
+    }
+
+    if (!_discoveryRunning && _hashesChanged) {
+        saveHashes();
+    }
 }
 
 void MqttHandleHassClass::forceUpdate()
@@ -55,64 +92,192 @@ void MqttHandleHassClass::publishConfig()
         return;
     }
 
-    const CONFIG_T& config = Configuration.get();
+    if (!_hashesLoaded) {
+        loadHashes();
+        _hashesLoaded = true;
+    }
+
+    // The broker does not have the retained configs of another broker, topic or retain setting
+    const uint32_t context = getRetainedContext();
+    if (context != _hashContext) {
+        _publishedHashes.clear();
+        _hashContext = context;
+        _hashesChanged = true;
+    }
+
+    // (Re)start from the beginning
+    _discoveryRunning = true;
+    _discoveryInverter = -1;
+    _discoveryItem = 0;
+
+    _deviceDiscovery = Configuration.get().Mqtt.Hass.DeviceDiscovery;
+    _devicePayload = String();
+    _deviceComponents = 0;
+}
+
+bool MqttHandleHassClass::publishNextConfig()
+{
+    if (_discoveryInverter < 0) {
+        if (publishDtuConfig(_discoveryItem)) {
+            _discoveryItem++;
+            return true;
+        }
+
+        JsonDocument device(HeapTelemetry.getJsonAllocator(HeapTag_t::Mqtt));
+        createDtuInfo(device);
+        publishDevice(getDtuUniqueId(), device);
+
+        _discoveryInverter = 0;
+        _discoveryItem = 0;
+    }
+
+    while (_discoveryInverter < Hoymiles.getNumInverters()) {
+        auto inv = Hoymiles.getInverterByPos(_discoveryInverter);
+        if (inv != nullptr && publishInverterConfig(inv, _discoveryItem)) {
+            _discoveryItem++;
+            return true;
+        }
+        if (inv != nullptr) {
+            JsonDocument device(HeapTelemetry.getJsonAllocator(HeapTag_t::Mqtt));
+            createInverterInfo(device, inv);
+            publishDevice(String("dtu_") + inv->serialString(), device);
+        }
+        _discoveryInverter++;
+        _discoveryItem = 0;
+    }
 
-    // publish DTU sensors
-    publishDtuSensor("IP", "dtu/ip", "", "mdi:network-outline", DEVICE_CLS_NONE, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
-    publishDtuSensor("WiFi Signal", "dtu/rssi", "dBm", "", DEVICE_CLS_SIGNAL_STRENGTH, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
-    publishDtuSensor("Uptime", "dtu/uptime", "s", "", DEVICE_CLS_DURATION, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
-    publishDtuSensor("Temperature", "dtu/temperature", "°C", "", DEVICE_CLS_TEMPERATURE, STATE_CLS_MEASUREMENT, CATEGORY_DIAGNOSTIC);
-    publishDtuSensor("Heap Size", "dtu/heap/size", "Bytes", "mdi:memory", DEVICE_CLS_NONE, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
-    publishDtuSensor("Heap Free", "dtu/heap/free", "Bytes", "mdi:memory", DEVICE_CLS_NONE, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
-    publishDtuSensor("Largest Free Heap Block", "dtu/heap/maxalloc", "Bytes", "mdi:memory", DEVICE_CLS_NONE, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
-    publishDtuSensor("Lifetime Minimum Free Heap", "dtu/heap/minfree", "Bytes", "mdi:memory", DEVICE_CLS_NONE, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
+    return false;
+}
 
-    publishDtuSensor("Yield Total", "ac/yieldtotal", "kWh", "", DEVICE_CLS_ENERGY, STATE_CLS_TOTAL_INCREASING, CATEGORY_NONE);
-    publishDtuSensor("Yield Day", "ac/yieldday", "Wh", "", DEVICE_CLS_ENERGY, STATE_CLS_TOTAL_INCREASING, CATEGORY_NONE);
-    publishDtuSensor("AC Power", "ac/power", "W", "", DEVICE_CLS_PWR, STATE_CLS_MEASUREMENT, CATEGORY_NONE);
-    publishDtuSensor("DC Power", "dc/power", "W", "", DEVICE_CLS_PWR, STATE_CLS_MEASUREMENT, CATEGORY_NONE);
+bool MqttHandleHassClass::publishDtuConfig(const uint16_t item)
+{
+    const CONFIG_T& config = Configuration.get();
 
-    publishDtuBinarySensor("Status", config.Mqtt.Lwt.Topic, config.Mqtt.Lwt.Value_Online, config.Mqtt.Lwt.Value_Offline, DEVICE_CLS_CONNECTIVITY, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
+    switch (item) {
+    case 0:
+        publishDtuSensor("IP", "dtu/ip", "", "mdi:network-outline", DEVICE_CLS_NONE, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
+        break;
+    case 1:
+        publishDtuSensor("WiFi Signal", "dtu/rssi", "dBm", "", DEVICE_CLS_SIGNAL_STRENGTH, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
+        break;
+    case 2:
+        publishDtuSensor("Uptime", "dtu/uptime", "s", "", DEVICE_CLS_DURATION, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
+        break;
+    case 3:
+        publishDtuSensor("Temperature", "dtu/temperature", "°C", "", DEVICE_CLS_TEMPERATURE, STATE_CLS_MEASUREMENT, CATEGORY_DIAGNOSTIC);
+        break;
+    case 4:
+        publishDtuSensor("Heap Size", "dtu/heap/size", "Bytes", "mdi:memory", DEVICE_CLS_NONE, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
+        break;
+    case 5:
+        publishDtuSensor("Heap Free", "dtu/heap/free", "Bytes", "mdi:memory", DEVICE_CLS_NONE, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
+        break;
+    case 6:
+        publishDtuSensor("Largest Free Heap Block", "dtu/heap/maxalloc", "Bytes", "mdi:memory", DEVICE_CLS_NONE, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
+        break;
+    case 7:
+        publishDtuSensor("Lifetime Minimum Free Heap", "dtu/heap/minfree", "Bytes", "mdi:memory", DEVICE_CLS_NONE, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
+        break;
+    case 8:
+        publishDtuSensor("Yield Total", "ac/yieldtotal", "kWh", "", DEVICE_CLS_ENERGY, STATE_CLS_TOTAL_INCREASING, CATEGORY_NONE);
+        break;
+    case 9:
+        publishDtuSensor("Yield Day", "ac/yieldday", "Wh", "", DEVICE_CLS_ENERGY, STATE_CLS_TOTAL_INCREASING, CATEGORY_NONE);
+        break;
+    case 10:
+        publishDtuSensor("AC Power", "ac/power", "W", "", DEVICE_CLS_PWR, STATE_CLS_MEASUREMENT, CATEGORY_NONE);
+        break;
+    case 11:
+        publishDtuSensor("DC Power", "dc/power", "W", "", DEVICE_CLS_PWR, STATE_CLS_MEASUREMENT, CATEGORY_NONE);
+        break;
+    case 12:
+        publishDtuBinarySensor("Status", config.Mqtt.Lwt.Topic, config.Mqtt.Lwt.Value_Online, config.Mqtt.Lwt.Value_Offline, DEVICE_CLS_CONNECTIVITY, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
+        break;
+    default:
+        return false;
+    }
 
-    // Loop all inverters
-    for (uint8_t i = 0; i < Hoymiles.getNumInverters(); i++) {
-        auto inv = Hoymiles.getInverterByPos(i);
+    return true;
+}
 
+bool MqttHandleHassClass::publishInverterConfig(std::shared_ptr<InverterAbstract> inv, const uint16_t item)
+{
+    switch (item) {
+    case 0:
         publishInverterButton(inv, "Turn Inverter Off", "cmd/power", "0", "mdi:power-plug-off", DEVICE_CLS_NONE, STATE_CLS_NONE, CATEGORY_CONFIG);
+        return true;
+    case 1:
         publishInverterButton(inv, "Turn Inverter On", "cmd/power", "1", "mdi:power-plug", DEVICE_CLS_NONE, STATE_CLS_NONE, CATEGORY_CONFIG);
+        return true;
+    case 2:
         publishInverterButton(inv, "Restart Inverter", "cmd/restart", "1", "", DEVICE_CLS_RESTART, STATE_CLS_NONE, CATEGORY_CONFIG);
+        return true;
+    case 3:
         publishInverterButton(inv, "Reset Radio Statistics", "cmd/reset_rf_stats", "1", "", DEVICE_CLS_NONE, STATE_CLS_NONE, CATEGORY_CONFIG);
-
+        return true;
+    case 4:
         publishInverterNumber(inv, "Limit NonPersistent Relative", "status/limit_relative", "cmd/limit_nonpersistent_relative", 0, 100, 0.1, "%", "mdi:speedometer", STATE_CLS_NONE, CATEGORY_CONFIG);
+        return true;
+    case 5:
         publishInverterNumber(inv, "Limit Persistent Relative", "status/limit_relative", "cmd/limit_persistent_relative", 0, 100, 0.1, "%", "mdi:speedometer", STATE_CLS_NONE, CATEGORY_CONFIG);
-
+        return true;
+    case 6:
         publishInverterNumber(inv, "Limit NonPersistent Absolute", "status/limit_absolute", "cmd/limit_nonpersistent_absolute", 0, MAX_INVERTER_LIMIT, 1, "W", "mdi:speedometer", STATE_CLS_NONE, CATEGORY_CONFIG);
+        return true;
+    case 7:
         publishInverterNumber(inv, "Limit Persistent Absolute", "status/limit_absolute", "cmd/limit_persistent_absolute", 0, MAX_INVERTER_LIMIT, 1, "W", "mdi:speedometer", STATE_CLS_NONE, CATEGORY_CONFIG);
-
+        return true;
+    case 8:
         publishInverterBinarySensor(inv, "Reachable", "status/reachable", "1", "0", DEVICE_CLS_CONNECTIVITY, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
+        return true;
+    case 9:
         publishInverterBinarySensor(inv, "Producing", "status/producing", "1", "0", DEVICE_CLS_NONE, STATE_CLS_NONE, CATEGORY_NONE);
-
+        return true;
+    case 10:
         publishInverterSensor(inv, "TX Requests", "radio/tx_request", "", "", DEVICE_CLS_NONE, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
+        return true;
+    case 11:
         publishInverterSensor(inv, "RX Success", "radio/rx_success", "", "", DEVICE_CLS_NONE, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
+        return true;
+    case 12:
         publishInverterSensor(inv, "RX Fail Receive Nothing", "radio/rx_fail_nothing", "", "", DEVICE_CLS_NONE, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
+        return true;
+    case 13:
         publishInverterSensor(inv, "RX Fail Receive Partial", "radio/rx_fail_partial", "", "", DEVICE_CLS_NONE, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
+        return true;
+    case 14:
         publishInverterSensor(inv, "RX Fail Receive Corrupt", "radio/rx_fail_corrupt", "", "", DEVICE_CLS_NONE, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
+        return true;
+    case 15:
         publishInverterSensor(inv, "TX Re-Request Fragment", "radio/tx_re_request", "", "", DEVICE_CLS_NONE, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
+        return true;
+    case 16:
         publishInverterSensor(inv, "RSSI", "radio/rssi", "dBm", "", DEVICE_CLS_SIGNAL_STRENGTH, STATE_CLS_NONE, CATEGORY_DIAGNOSTIC);
+        return true;
+    default:
+        break;
+    }
 
-        // Loop all channels
-        for (auto& t : inv->Statistics()->getChannelTypes()) {
-            for (auto& c : inv->Statistics()->getChannelsByType(t)) {
-                for (uint8_t f = 0; f < DEVICE_CLS_ASSIGN_LIST_LEN; f++) {
-                    bool clear = false;
-                    if (t == TYPE_DC && !config.Mqtt.Hass.IndividualPanels) {
-                        clear = true;
-                    }
-                    publishInverterField(inv, t, c, deviceFieldAssignment[f], clear);
+    // All further items are the fields of all channels
+    uint16_t fieldItem = item - 17;
+    for (auto& t : inv->Statistics()->getChannelTypes()) {
+        for (auto& c : inv->Statistics()->getChannelsByType(t)) {
+            for (uint8_t f = 0; f < DEVICE_CLS_ASSIGN_LIST_LEN; f++) {
+                if (!inv->Statistics()->hasChannelFieldValue(t, c, deviceFieldAssignment[f].fieldId)) {
+                    continue;
                 }
+                if (fieldItem-- > 0) {
+                    continue;
+                }
+
+                const bool clear = (t == TYPE_DC && !Configuration.get().Mqtt.Hass.IndividualPanels);
+                publishInverterField(inv, t, c, deviceFieldAssignment[f], clear);
+                return true;
             }
         }
     }
+
+    return false;
 }
 
 void MqttHandleHassClass::publishInverterField(std::shared_ptr<InverterAbstract> inv, const ChannelType_t type, const ChannelNum_t channel, const byteAssign_fieldDeviceClass_t fieldType, const bool clear)
@@ -143,7 +308,7 @@ void MqttHandleHassClass::publishInverterField(std::shared_ptr<InverterAbstract>
         + "/config";
 
     if (!clear) {
-        const String stateTopic = MqttSettings.getPrefix() + MqttHandleInverter.getTopic(inv, type, channel, fieldType.fieldId);
+        const String stateTopic = MqttSettings.getPrefix() + MqttHandleInverter.getTopic(*inv, type, channel, fieldType.fieldId);
 
         String name;
         if (type != TYPE_DC) {
@@ -154,8 +319,10 @@ void MqttHandleHassClass::publishInverterField(std::shared_ptr<InverterAbstract>
 
         String unit_of_measure = inv->Statistics()->getChannelFieldUnit(type, channel, fieldType.fieldId);
 
-        JsonDocument root;
-        createInverterInfo(root, inv);
+        JsonDocument root(HeapTelemetry.getJsonAllocator(HeapTag_t::Mqtt));
+        if (!_deviceDiscovery) {
+            createInverterInfo(root, inv);
+        }
         addCommonMetadata(root, unit_of_measure, "", fieldType.deviceClsId, fieldType.stateClsId, CATEGORY_NONE);
 
         root["name"] = name;
@@ -166,7 +333,9 @@ void MqttHandleHassClass::publishInverterField(std::shared_ptr<InverterAbstract>
             root["exp_aft"] = Hoymiles.getNumInverters() * max<uint32_t>(Hoymiles.PollInterval(), Configuration.get().Mqtt.PublishInterval) * inv->getReachableThreshold();
         }
 
-        publish(configTopic, root);
+        publishComponent("sensor", configTopic, root);
+    } else if (_deviceDiscovery) {
+        clearConfig(configTopic);
     } else {
         publish(configTopic, "");
     }
@@ -189,8 +358,10 @@ void MqttHandleHassClass::publishInverterButton(
 
     const String cmdTopic = MqttSettings.getPrefix() + serial + "/" + state_topic;
 
-    JsonDocument root;
-    createInverterInfo(root, inv);
+    JsonDocument root(HeapTelemetry.getJsonAllocator(HeapTag_t::Mqtt));
+    if (!_deviceDiscovery) {
+        createInverterInfo(root, inv);
+    }
     addCommonMetadata(root, "", icon, device_class, state_class, category);
 
     root["name"] = name;
@@ -198,7 +369,7 @@ void MqttHandleHassClass::publishInverterButton(
     root["cmd_t"] = cmdTopic;
     root["payload_press"] = payload;
 
-    publish(configTopic, root);
+    publishComponent("button", configTopic, root);
 }
 
 void MqttHandleHassClass::publishInverterNumber(
@@ -221,8 +392,10 @@ void MqttHandleHassClass::publishInverterNumber(
     const String cmdTopic = MqttSettings.getPrefix() + serial + "/" + command_topic;
     const String statTopic = MqttSettings.getPrefix() + serial + "/" + stateTopic;
 
-    JsonDocument root;
-    createInverterInfo(root, inv);
+    JsonDocument root(HeapTelemetry.getJsonAllocator(HeapTag_t::Mqtt));
+    if (!_deviceDiscovery) {
+        createInverterInfo(root, inv);
+    }
     addCommonMetadata(root, unit_of_measure, icon, DEVICE_CLS_NONE, state_class, category);
 
     root["name"] = name;
@@ -233,7 +406,7 @@ void MqttHandleHassClass::publishInverterNumber(
     root["max"] = max;
     root["step"] = step;
 
-    publish(configTopic, root);
+    publishComponent("number", configTopic, root);
 }
 
 void MqttHandleHassClass::createInverterInfo(JsonDocument& root, std::shared_ptr<InverterAbstract> inv)
@@ -291,14 +464,90 @@ String MqttHandleHassClass::getDtuUrl()
     return String("http://") + NetworkSettings.localIP().toString();
 }
 
+static uint32_t fnv1a(const char* data, const size_t len, uint32_t hash = 2166136261UL)
+{
+    for (size_t i = 0; i < len; i++) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
 void MqttHandleHassClass::publish(const String& subtopic, const String& payload)
 {
-    String topic = Configuration.get().Mqtt.Hass.Topic;
+    const CONFIG_T& config = Configuration.get();
+
+    String topic = config.Mqtt.Hass.Topic;
     topic += subtopic;
-    MqttSettings.publishGeneric(topic, payload, Configuration.get().Mqtt.Hass.Retain);
+
+    // Retained configs which did not change since the last publish are still known by the
+    // broker, also after a reconnect, a forced update or a reboot
+    if (config.Mqtt.Hass.Retain) {
+        const uint32_t key = fnv1a(topic.c_str(), topic.length());
+        const uint32_t hash = fnv1a(payload.c_str(), payload.length());
+
+        auto it = _publishedHashes.find(key);
+        if (it != _publishedHashes.end() && it->second == hash) {
+            return;
+        }
+        _publishedHashes[key] = hash;
+        _hashesChanged = true;
+    }
+
+    MqttSettings.publishGeneric(topic, payload, config.Mqtt.Hass.Retain);
     yield();
 }
 
+uint32_t MqttHandleHassClass::getRetainedContext()
+{
+    const CONFIG_T& config = Configuration.get();
+
+    uint32_t hash = fnv1a(config.Mqtt.Hostname, strlen(config.Mqtt.Hostname));
+    hash = fnv1a(reinterpret_cast<const char*>(&config.Mqtt.Port), sizeof(config.Mqtt.Port), hash);
+    hash = fnv1a(config.Mqtt.Hass.Topic, strlen(config.Mqtt.Hass.Topic), hash);
+
+    const uint8_t flags = (config.Mqtt.Hass.Retain ? 0x01 : 0) | (config.Mqtt.Hass.Expire ? 0x02 : 0);
+    return fnv1a(reinterpret_cast<const char*>(&flags), sizeof(flags), hash);
+}
+
+void MqttHandleHassClass::loadHashes()
+{
+    _publishedHashes.clear();
+    _hashContext = 0;
+
+    File f = LittleFS.open(HASS_HASH_FILENAME, "r", false);
+    if (!f) {
+        return;
+    }
+
+    // The context comes first, the topic and payload hashes follow
+    uint32_t entry[2];
+    if (f.read(reinterpret_cast<uint8_t*>(&_hashContext), sizeof(_hashContext)) == sizeof(_hashContext)) {
+        while (f.read(reinterpret_cast<uint8_t*>(entry), sizeof(entry)) == sizeof(entry)) {
+            _publishedHashes[entry[0]] = entry[1];
+        }
+    }
+    f.close();
+}
+
+void MqttHandleHassClass::saveHashes()
+{
+    std::vector<uint8_t> data;
+    data.reserve(sizeof(_hashContext) + _publishedHashes.size() * 2 * sizeof(uint32_t));
+
+    const uint8_t* context = reinterpret_cast<const uint8_t*>(&_hashContext);
+    data.insert(data.end(), context, context + sizeof(_hashContext));
+    for (auto& h : _publishedHashes) {
+        const uint32_t entry[2] = { h.first, h.second };
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(entry);
+        data.insert(data.end(), bytes, bytes + sizeof(entry));
+    }
+    // Held back while the budget of the writer is used up, the hashes stay in memory meanwhile
+    FsWorker.write(HASS_HASH_FILENAME, std::move(data), FlashWriter_t::Hass);
+
+    _hashesChanged = false;
+}
+
 void MqttHandleHassClass::publish(const String& subtopic, const JsonDocument& doc)
 {
     if (!Utils::checkJsonAlloc(doc, __FUNCTION__, __LINE__)) {
@@ -309,6 +558,82 @@ void MqttHandleHassClass::publish(const String& subtopic, const JsonDocument& do
     publish(subtopic, buffer);
 }
 
+void MqttHandleHassClass::clearConfig(const String& subtopic)
+{
+    const CONFIG_T& config = Configuration.get();
+
+    String topic = config.Mqtt.Hass.Topic;
+    topic += subtopic;
+
+    // Cleared once, until the retained context changes
+    const uint32_t key = fnv1a(topic.c_str(), topic.length());
+    auto it = _publishedHashes.find(key);
+    if (it != _publishedHashes.end() && it->second == HASS_CLEARED_HASH) {
+        return;
+    }
+    _publishedHashes[key] = HASS_CLEARED_HASH;
+    _hashesChanged = true;
+
+    MqttSettings.publishGeneric(topic, "", true);
+    yield();
+}
+
+void MqttHandleHassClass::publishComponent(const char* platform, const String& configTopic, JsonDocument& doc)
+{
+    if (!_deviceDiscovery) {
+        publish(configTopic, doc);
+        return;
+    }
+
+    // A retained entity config of the same unique id would be a duplicate of the component
+    clearConfig(configTopic);
+
+    doc["p"] = platform;
+    if (!Utils::checkJsonAlloc(doc, __FUNCTION__, __LINE__)) {
+        return;
+    }
+
+    if (_deviceComponents++ > 0) {
+        _devicePayload += ',';
+    }
+    serializeJson(doc["uniq_id"], _devicePayload);
+    _devicePayload += ':';
+    serializeJson(doc, _devicePayload);
+}
+
+void MqttHandleHassClass::publishDevice(const String& objectId, JsonDocument& device)
+{
+    const String configTopic = "device/" + objectId + "/config";
+
+    if (!_deviceDiscovery || _deviceComponents == 0) {
+        clearConfig(configTopic);
+        return;
+    }
+
+    auto origin = device["o"].to<JsonObject>();
+    origin["name"] = "OpenDTU";
+    origin["sw"] = __COMPILED_GIT_HASH__;
+    origin["url"] = "https://github.com/tbnobody/OpenDTU";
+
+    if (!Utils::checkJsonAlloc(device, __FUNCTION__, __LINE__)) {
+        return;
+    }
+
+    // {"dev":{...},"o":{...},"cmps":{<components>}}
+    String payload;
+    payload.reserve(measureJson(device) + _devicePayload.length() + 12);
+    serializeJson(device, payload);
+    payload.remove(payload.length() - 1);
+    payload += ",\"cmps\":{";
+    payload += _devicePayload;
+    payload += "}}";
+
+    _devicePayload = String();
+    _deviceComponents = 0;
+
+    publish(configTopic, payload);
+}
+
 void MqttHandleHassClass::addCommonMetadata(
     JsonDocument& doc,
     const String& unit_of_measure, const String& icon,
@@ -349,7 +674,7 @@ void MqttHandleHassClass::publishBinarySensor(
     addCommonMetadata(doc, "", "", device_class, state_class, category);
 
     const String configTopic = "binary_sensor/" + root_device + "/" + sensor_id + "/config";
-    publish(configTopic, doc);
+    publishComponent("binary_sensor", configTopic, doc);
 }
 
 void MqttHandleHassClass::publishDtuBinarySensor(
@@ -358,8 +683,10 @@ void MqttHandleHassClass::publishDtuBinarySensor(
 {
     const String dtuId = getDtuUniqueId();
 
-    JsonDocument root;
-    createDtuInfo(root);
+    JsonDocument root(HeapTelemetry.getJsonAllocator(HeapTag_t::Mqtt));
+    if (!_deviceDiscovery) {
+        createDtuInfo(root);
+    }
     publishBinarySensor(root, dtuId, dtuId, name, state_topic, payload_on, payload_off, device_class, state_class, category);
 }
 
@@ -369,8 +696,10 @@ void MqttHandleHassClass::publishInverterBinarySensor(
 {
     const String serial = inv->serialString();
 
-    JsonDocument root;
-    createInverterInfo(root, inv);
+    JsonDocument root(HeapTelemetry.getJsonAllocator(HeapTag_t::Mqtt));
+    if (!_deviceDiscovery) {
+        createInverterInfo(root, inv);
+    }
     publishBinarySensor(root, "dtu_" + serial, serial, name, serial + "/" + state_topic, payload_on, payload_off, device_class, state_class, category);
 }
 
@@ -396,7 +725,7 @@ void MqttHandleHassClass::publishSensor(
     doc["pl_not_avail"] = config.Mqtt.Lwt.Value_Offline;
 
     const String configTopic = "sensor/" + root_device + "/" + sensor_id + "/config";
-    publish(configTopic, doc);
+    publishComponent("sensor", configTopic, doc);
 }
 
 void MqttHandleHassClass::publishDtuSensor(
@@ -406,8 +735,10 @@ void MqttHandleHassClass::publishDtuSensor(
 {
     const String dtuId = getDtuUniqueId();
 
-    JsonDocument root;
-    createDtuInfo(root);
+    JsonDocument root(HeapTelemetry.getJsonAllocator(HeapTag_t::Mqtt));
+    if (!_deviceDiscovery) {
+        createDtuInfo(root);
+    }
     publishSensor(root, dtuId, dtuId, name, state_topic, unit_of_measure, icon, device_class, state_class, category);
 }
 
@@ -418,7 +749,9 @@ void MqttHandleHassClass::publishInverterSensor(
 {
     const String serial = inv->serialString();
 
-    JsonDocument root;
-    createInverterInfo(root, inv);
+    JsonDocument root(HeapTelemetry.getJsonAllocator(HeapTag_t::Mqtt));
+    if (!_deviceDiscovery) {
+        createInverterInfo(root, inv);
+    }
     publishSensor(root, "dtu_" + serial, serial, name, serial + "/" + state_topic, unit_of_measure, icon, device_class, state_class, category);
 }
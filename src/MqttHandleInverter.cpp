@@ -3,8 +3,14 @@
  * Copyright (C) 2022-2024 Thomas Basler and others
  */
 #include "MqttHandleInverter.h"
+#include "Datastore.h"
+#include "HeapTelemetry.h"
 #include "MessageOutput.h"
 #include "MqttSettings.h"
+#include "PublishCoordinator.h"
+#include "ResourceGovernor.h"
+#include "TaskProfiler.h"
+#include <cmath>
 #include <ctime>
 
 #define PUBLISH_MAX_INTERVAL 60000
@@ -12,7 +18,7 @@
 MqttHandleInverterClass MqttHandleInverter;
 
 MqttHandleInverterClass::MqttHandleInverterClass()
-    : _loopTask(TASK_IMMEDIATE, TASK_FOREVER, std::bind(&MqttHandleInverterClass::loop, this))
+    : _loopTask(TASK_IMMEDIATE, TASK_FOREVER)
 {
 }
 
@@ -21,122 +27,372 @@ void MqttHandleInverterClass::init(Scheduler& scheduler)
     subscribeTopics();
 
     scheduler.addTask(_loopTask);
-    _loopTask.setInterval(Configuration.get().Mqtt.PublishInterval * TASK_SECOND);
+    TaskProfiler.setCallback(_loopTask, "MqttHandleInverter.loop", std::bind(&MqttHandleInverterClass::loop, this));
     _loopTask.enable();
 }
 
 void MqttHandleInverterClass::loop()
 {
-    _loopTask.setInterval(Configuration.get().Mqtt.PublishInterval * TASK_SECOND);
+    const uint32_t interval = ResourceGovernor.getMqttPublishInterval() * 1000;
+    const uint16_t count = Hoymiles.getNumInverters();
+    const uint32_t now = millis();
+
+    if (_nextInverter >= count) {
+        // The next round starts one interval after the start of the last one
+        if (_roundStarted && now - _roundStart < interval) {
+            _loopTask.delay((interval - (now - _roundStart)) * TASK_MILLISECOND);
+            return;
+        }
+        _roundStart = now;
+        _roundStarted = true;
+        _nextInverter = 0;
+
+        if (count == 0) {
+            _loopTask.delay(interval * TASK_MILLISECOND);
+            return;
+        }
+    }
 
-    if (!MqttSettings.getConnected() || !Hoymiles.isAllRadioIdle()) {
-        _loopTask.forceNextIteration();
+    // The inverters are spread evenly over the interval instead of being published in one burst
+    const uint32_t slot = PublishCoordinator.getSlot(interval, _nextInverter, count);
+    if (now - _roundStart < slot) {
+        _loopTask.delay((slot - (now - _roundStart)) * TASK_MILLISECOND);
         return;
     }
 
-    // Loop all inverters
-    for (uint8_t i = 0; i < Hoymiles.getNumInverters(); i++) {
-        auto inv = Hoymiles.getInverterByPos(i);
+    if (!MqttSettings.getConnected()) {
+        _loopTask.delay(PublishCoordinator.getRetryDelay(MQTT_PUBLISH_RETRY_INTERVAL) * TASK_MILLISECOND);
+        return;
+    }
+    if (!PublishCoordinator.beginSlice()) {
+        _loopTask.delay(PublishCoordinator.getWaitDelay() * TASK_MILLISECOND);
+        return;
+    }
+
+    const bool publishOnChange = Configuration.get().Mqtt.PublishOnChange;
+    const String prefix = MqttSettings.getPrefix();
+
+    _publishState.resize(count);
+
+    // Inverters which became due while the radio was busy are caught up within the budget of the slice
+    do {
+        auto inv = Hoymiles.getInverterByPos(_nextInverter);
+        if (inv != nullptr) {
+            publishInverter(*inv, _nextInverter, publishOnChange, prefix);
+        }
+        _nextInverter++;
+    } while (_nextInverter < count
+        && millis() - _roundStart >= PublishCoordinator.getSlot(interval, _nextInverter, count)
+        && PublishCoordinator.hasBudget());
+
+    PublishCoordinator.endSlice();
+    _loopTask.delay(PUBLISH_SLICE_GAP * TASK_MILLISECOND);
+}
+
+void MqttHandleInverterClass::publishInverter(InverterAbstract& inv, const uint8_t i, const bool publishOnChange, const String& prefix)
+{
+    if (i >= _publishState.size()) {
+        _publishState.resize(i + 1);
+    }
+
+    const String subtopic = inv.serialString();
+
+    PublishState_t& state = _publishState[i];
+    if (state.Serial != inv.serial()) {
+        state = PublishState_t();
+        state.Serial = inv.serial();
+        state.FieldStatisticsDay = inv.Statistics()->getFieldStatisticsDay();
+    }
+
+    if (state.TopicPrefix != prefix) {
+        state.TopicPrefix = prefix;
+        state.Topics.clear();
+        state.TopicOffsets.clear();
+    }
 
-        const String subtopic = inv->serialString();
+    // If only changed values are published, everything is still published once per PUBLISH_MAX_INTERVAL
+    const bool fullPublish = !publishOnChange || !state.FullPublishDone || (millis() - state.LastFullPublish >= PUBLISH_MAX_INTERVAL);
+    if (fullPublish) {
+        state.LastFullPublish = millis();
+        state.FullPublishDone = true;
+    }
 
+    if (fullPublish) {
         // Name
-        MqttSettings.publish(subtopic + "/name", inv->name());
+        MqttSettings.publish(subtopic + "/name", inv.name());
 
         // Radio Statistics
-        MqttSettings.publish(subtopic + "/radio/tx_request", String(inv->RadioStats.TxRequestData));
-        MqttSettings.publish(subtopic + "/radio/tx_re_request", String(inv->RadioStats.TxReRequestFragment));
-        MqttSettings.publish(subtopic + "/radio/rx_success", String(inv->RadioStats.RxSuccess));
-        MqttSettings.publish(subtopic + "/radio/rx_fail_nothing", String(inv->RadioStats.RxFailNoAnswer));
-        MqttSettings.publish(subtopic + "/radio/rx_fail_partial", String(inv->RadioStats.RxFailPartialAnswer));
-        MqttSettings.publish(subtopic + "/radio/rx_fail_corrupt", String(inv->RadioStats.RxFailCorruptData));
-        MqttSettings.publish(subtopic + "/radio/rssi", String(inv->getLastRssi()));
+        MqttSettings.publish(subtopic + "/radio/tx_request", String(inv.RadioStats.TxRequestData));
+        MqttSettings.publish(subtopic + "/radio/tx_re_request", String(inv.RadioStats.TxReRequestFragment));
+        MqttSettings.publish(subtopic + "/radio/rx_success", String(inv.RadioStats.RxSuccess));
+        MqttSettings.publish(subtopic + "/radio/rx_fail_nothing", String(inv.RadioStats.RxFailNoAnswer));
+        MqttSettings.publish(subtopic + "/radio/rx_fail_partial", String(inv.RadioStats.RxFailPartialAnswer));
+        MqttSettings.publish(subtopic + "/radio/rx_fail_corrupt", String(inv.RadioStats.RxFailCorruptData));
+        MqttSettings.publish(subtopic + "/radio/rssi", String(inv.getLastRssi()));
+    }
 
-        if (inv->DevInfo()->getLastUpdate() > 0) {
-            // Bootloader Version
-            MqttSettings.publish(subtopic + "/device/bootloaderversion", String(inv->DevInfo()->getFwBootloaderVersion()));
+    if (inv.DevInfo()->getLastUpdate() > 0
+        && (fullPublish || inv.DevInfo()->getLastUpdate() != state.LastPublishDevInfo)) {
+        state.LastPublishDevInfo = inv.DevInfo()->getLastUpdate();
 
-            // Firmware Version
-            MqttSettings.publish(subtopic + "/device/fwbuildversion", String(inv->DevInfo()->getFwBuildVersion()));
+        // Bootloader Version
+        MqttSettings.publish(subtopic + "/device/bootloaderversion", String(inv.DevInfo()->getFwBootloaderVersion()));
 
-            // Firmware Build DateTime
-            MqttSettings.publish(subtopic + "/device/fwbuilddatetime", inv->DevInfo()->getFwBuildDateTimeStr());
+        // Firmware Version
+        MqttSettings.publish(subtopic + "/device/fwbuildversion", String(inv.DevInfo()->getFwBuildVersion()));
 
-            // Hardware part number
-            MqttSettings.publish(subtopic + "/device/hwpartnumber", String(inv->DevInfo()->getHwPartNumber()));
+        // Firmware Build DateTime
+        char buffer[DEV_INFO_DATETIME_SIZE];
+        inv.DevInfo()->getFwBuildDateTimeStr(buffer, sizeof(buffer));
+        MqttSettings.publish(subtopic + "/device/fwbuilddatetime", buffer);
 
-            // Hardware version
-            MqttSettings.publish(subtopic + "/device/hwversion", inv->DevInfo()->getHwVersion());
-        }
+        // Hardware part number
+        MqttSettings.publish(subtopic + "/device/hwpartnumber", String(inv.DevInfo()->getHwPartNumber()));
 
-        if (inv->SystemConfigPara()->getLastUpdate() > 0) {
-            // Limit
-            MqttSettings.publish(subtopic + "/status/limit_relative", String(inv->SystemConfigPara()->getLimitPercent()));
+        // Hardware version
+        inv.DevInfo()->getHwVersion(buffer, sizeof(buffer));
+        MqttSettings.publish(subtopic + "/device/hwversion", buffer);
+    }
 
-            uint16_t maxpower = inv->DevInfo()->getMaxPower();
-            if (maxpower > 0) {
-                MqttSettings.publish(subtopic + "/status/limit_absolute", String(inv->SystemConfigPara()->getLimitPercent() * maxpower / 100));
-            }
+    if (inv.SystemConfigPara()->getLastUpdate() > 0
+        && (fullPublish || inv.SystemConfigPara()->getLastUpdate() != state.LastPublishSystemConfigPara)) {
+        state.LastPublishSystemConfigPara = inv.SystemConfigPara()->getLastUpdate();
+
+        // Limit
+        MqttSettings.publish(subtopic + "/status/limit_relative", String(inv.SystemConfigPara()->getLimitPercent()));
+
+        uint16_t maxpower = inv.DevInfo()->getMaxPower();
+        if (maxpower > 0) {
+            MqttSettings.publish(subtopic + "/status/limit_absolute", String(inv.SystemConfigPara()->getLimitPercent() * maxpower / 100));
         }
+    }
 
-        MqttSettings.publish(subtopic + "/status/reachable", String(inv->isReachable()));
-        MqttSettings.publish(subtopic + "/status/producing", String(inv->isProducing()));
+    if (inv.EventLog()->getSequence() != state.LastEventSequence) {
+        publishEvents(subtopic, inv, state);
+    }
+
+    const bool reachable = inv.isReachable();
+    const bool producing = inv.isProducing();
+    if (fullPublish || reachable != state.Reachable || producing != state.Producing) {
+        state.Reachable = reachable;
+        state.Producing = producing;
+        MqttSettings.publish(subtopic + "/status/reachable", String(reachable));
+        MqttSettings.publish(subtopic + "/status/producing", String(producing));
+    }
+
+    const uint32_t lastUpdateInternal = inv.Statistics()->getLastUpdateFromInternal();
+    const bool statsChanged = lastUpdateInternal != state.LastPublishStats;
 
-        if (inv->Statistics()->getLastUpdate() > 0) {
-            MqttSettings.publish(subtopic + "/status/last_update", String(std::time(0) - (millis() - inv->Statistics()->getLastUpdate()) / 1000));
+    if (fullPublish || statsChanged) {
+        if (inv.Statistics()->getLastUpdate() > 0) {
+            MqttSettings.publish(subtopic + "/status/last_update", String(std::time(0) - inv.Statistics()->getDataAge() / 1000));
         } else {
             MqttSettings.publish(subtopic + "/status/last_update", String(0));
         }
 
-        const uint32_t lastUpdateInternal = inv->Statistics()->getLastUpdateFromInternal();
-        if (inv->Statistics()->getLastUpdate() > 0 && (lastUpdateInternal != _lastPublishStats[i])) {
-            _lastPublishStats[i] = lastUpdateInternal;
-
-            // Loop all channels
-            for (auto& t : inv->Statistics()->getChannelTypes()) {
-                for (auto& c : inv->Statistics()->getChannelsByType(t)) {
-                    if (t == TYPE_DC) {
-                        INVERTER_CONFIG_T* inv_cfg = Configuration.getInverterConfig(inv->serial());
-                        if (inv_cfg != nullptr) {
-                            // TODO(tbnobody)
-                            MqttSettings.publish(inv->serialString() + "/" + String(static_cast<uint8_t>(c) + 1) + "/name", inv_cfg->channel[c].Name);
-                        }
+        // Energy (Wh) integrated by the DTU since boot, finer than the yield counters
+        double acEnergy;
+        double dcEnergy;
+        if (Datastore.getInverterEnergy(inv.serial(), acEnergy, dcEnergy)) {
+            MqttSettings.publish(subtopic + "/energy/ac", String(acEnergy, 3));
+            MqttSettings.publish(subtopic + "/energy/dc", String(dcEnergy, 3));
+        }
+    }
+
+    // Daily statistics instead of every sample, the final ones once the day ended
+    if (fullPublish) {
+        publishFieldStatistics(subtopic, inv, false);
+    }
+    if (inv.Statistics()->getFieldStatisticsDay() != state.FieldStatisticsDay) {
+        state.FieldStatisticsDay = inv.Statistics()->getFieldStatisticsDay();
+        publishFieldStatistics(subtopic, inv, true);
+    }
+
+    // The values are decoded from the raw payload on the server (see RawStatsExport)
+    if (Configuration.get().RawStats.SkipFields) {
+        state.LastPublishStats = lastUpdateInternal;
+    } else if (inv.Statistics()->getLastUpdate() > 0 && (statsChanged || (publishOnChange && fullPublish))) {
+        state.LastPublishStats = lastUpdateInternal;
+
+        const bool jsonPayload = Configuration.get().Mqtt.JsonPayload;
+        JsonDocument doc(HeapTelemetry.getJsonAllocator(HeapTag_t::Mqtt));
+        std::vector<float> jsonValues;
+        bool jsonChanged = fullPublish;
+
+        size_t slot = 0;
+        const auto record = FieldRecord.get(inv);
+        size_t entry = 0;
+
+        // Loop all channels
+        for (auto& t : inv.Statistics()->getChannelTypes()) {
+            for (auto& c : inv.Statistics()->getChannelsByType(t)) {
+                INVERTER_CONFIG_T* inv_cfg = nullptr;
+                if (t == TYPE_DC && (fullPublish || jsonPayload)) {
+                    inv_cfg = Configuration.getInverterConfig(inv.serial());
+                }
+
+                if (jsonPayload) {
+                    JsonObject chanObj = doc[inv.Statistics()->getChannelTypeName(t)][getChannelNumber(t, c)].to<JsonObject>();
+                    if (inv_cfg != nullptr) {
+                        chanObj["name"] = inv_cfg->channel[c].Name;
+                    }
+                } else if (inv_cfg != nullptr) {
+                    // TODO(tbnobody)
+                    MqttSettings.publish(String(inv.serialString()) + "/" + String(static_cast<uint8_t>(c) + 1) + "/name", inv_cfg->channel[c].Name);
+                }
+
+                // The entries of the record are in the same channel order
+                for (; entry < record->Entries.size() && record->Entries[entry].Type == t && record->Entries[entry].Channel == c; entry++) {
+                    const FieldRecordEntry_t& field = record->Entries[entry];
+
+                    if (slot >= state.Values.size()) {
+                        state.Values.push_back(NAN);
+                    }
+                    const size_t fieldSlot = slot++;
+                    float& lastValue = state.Values[fieldSlot];
+                    const float value = field.Value;
+
+                    const bool changed = fullPublish || std::isnan(lastValue)
+                        || std::fabs(value - lastValue) > getDeadband(field.Unit);
+
+                    if (jsonPayload) {
+                        // The document always contains all fields, it is published if any of them changed
+                        doc[inv.Statistics()->getChannelTypeName(t)][getChannelNumber(t, c)][getFieldName(inv, t, c, field.Field)] = serialized(field.Formatted, field.Length);
+                        jsonValues.push_back(value);
+                        jsonChanged |= changed;
+                        continue;
                     }
-                    for (uint8_t f = 0; f < sizeof(_publishFields) / sizeof(FieldId_t); f++) {
-                        publishField(inv, t, c, _publishFields[f]);
+
+                    if (!changed) {
+                        continue;
                     }
+                    lastValue = value;
+
+                    publishField(getFieldTopic(state, fieldSlot, inv, t, c, field.Field), field);
                 }
             }
         }
 
-        yield();
+        if (jsonPayload && jsonChanged) {
+            String buffer;
+            serializeJson(doc, buffer);
+            MqttSettings.publish(subtopic + "/json", buffer);
+            state.Values = std::move(jsonValues);
+        }
     }
+
 }
 
-void MqttHandleInverterClass::publishField(std::shared_ptr<InverterAbstract> inv, const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId)
+void MqttHandleInverterClass::publishEvents(const String& subtopic, InverterAbstract& inv, PublishState_t& state)
 {
-    const String topic = getTopic(inv, type, channel, fieldId);
-    if (topic == "") {
+    // Only entries which were not published before, the full log is available by the web API
+    const uint8_t count = inv.EventLog()->getEntryCount();
+    for (uint8_t i = 0; i < count; i++) {
+        AlarmLogEntry_t entry;
+        inv.EventLog()->getLogEntry(i, entry);
+        if (entry.Sequence <= state.LastEventSequence) {
+            continue;
+        }
+
+        JsonDocument root(HeapTelemetry.getJsonAllocator(HeapTag_t::Mqtt));
+        root["message_id"] = entry.MessageId;
+        root["message"] = JsonString(entry.Message, true);
+        root["start_time"] = entry.StartTime;
+        root["end_time"] = entry.EndTime;
+        root["sequence"] = entry.Sequence;
+
+        String buffer;
+        serializeJson(root, buffer);
+        MqttSettings.publish(subtopic + "/event", buffer);
+    }
+    state.LastEventSequence = inv.EventLog()->getSequence();
+}
+
+void MqttHandleInverterClass::publishFieldStatistics(const String& subtopic, InverterAbstract& inv, const bool previousDay)
+{
+    auto stats = inv.Statistics();
+    JsonDocument doc(HeapTelemetry.getJsonAllocator(HeapTag_t::Mqtt));
+    bool hasSamples = false;
+
+    // The times are millis of the responses
+    const time_t now = std::time(0);
+    const uint32_t nowMillis = millis();
+
+    for (auto& t : stats->getChannelTypes()) {
+        for (auto& c : stats->getChannelsByType(t)) {
+            for (uint8_t f = 0; f < FLD_CNT; f++) {
+                const FieldId_t field = static_cast<FieldId_t>(f);
+                FieldStatistics_t fieldStats;
+                if (!stats->getChannelFieldStatistics(t, c, field, fieldStats, previousDay)) {
+                    continue;
+                }
+                hasSamples = true;
+
+                JsonObject obj = doc[stats->getChannelTypeName(t)][getChannelNumber(t, c)][getFieldName(inv, t, c, field)].to<JsonObject>();
+                obj["min"] = fieldStats.Min;
+                obj["min_time"] = now - (nowMillis - fieldStats.MinTime) / 1000;
+                obj["max"] = fieldStats.Max;
+                obj["max_time"] = now - (nowMillis - fieldStats.MaxTime) / 1000;
+                obj["mean"] = fieldStats.Mean;
+                obj["stddev"] = std::sqrt(fieldStats.getVariance());
+                obj["count"] = fieldStats.Count;
+            }
+        }
+    }
+
+    if (!hasSamples) {
         return;
     }
 
-    MqttSettings.publish(topic, inv->Statistics()->getChannelFieldValueString(type, channel, fieldId));
+    String buffer;
+    serializeJson(doc, buffer);
+    MqttSettings.publish(subtopic + (previousDay ? "/daily/previous" : "/daily/current"), buffer);
+}
+
+void MqttHandleInverterClass::publishField(const char* topic, const FieldRecordEntry_t& field)
+{
+    MqttSettings.publishGeneric(topic, field.Formatted, Configuration.get().Mqtt.Retain);
 }
 
-String MqttHandleInverterClass::getTopic(std::shared_ptr<InverterAbstract> inv, const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId)
+const char* MqttHandleInverterClass::getFieldTopic(PublishState_t& state, const size_t slot, InverterAbstract& inv, const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId)
 {
-    if (!inv->Statistics()->hasChannelFieldValue(type, channel, fieldId)) {
+    // Topics are created on first use and kept until the prefix or the inverter changes
+    while (state.TopicOffsets.size() <= slot) {
+        state.TopicOffsets.push_back(UINT16_MAX);
+    }
+
+    if (state.TopicOffsets[slot] == UINT16_MAX) {
+        const String topic = state.TopicPrefix + getTopic(inv, type, channel, fieldId);
+        state.TopicOffsets[slot] = state.Topics.size();
+        state.Topics.insert(state.Topics.end(), topic.c_str(), topic.c_str() + topic.length() + 1);
+    }
+
+    return &state.Topics[state.TopicOffsets[slot]];
+}
+
+String MqttHandleInverterClass::getTopic(InverterAbstract& inv, const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId)
+{
+    if (!inv.Statistics()->hasChannelFieldValue(type, channel, fieldId)) {
         return "";
     }
 
+    return String(inv.serialString()) + "/" + getChannelNumber(type, channel) + "/" + getFieldName(inv, type, channel, fieldId);
+}
+
+String MqttHandleInverterClass::getFieldName(InverterAbstract& inv, const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId)
+{
     String chanName;
     if (type == TYPE_INV && fieldId == FLD_PDC) {
         chanName = "powerdc";
     } else {
-        chanName = inv->Statistics()->getChannelFieldName(type, channel, fieldId);
+        chanName = inv.Statistics()->getChannelFieldName(type, channel, fieldId);
         chanName.toLowerCase();
     }
+    return chanName;
+}
 
+String MqttHandleInverterClass::getChannelNumber(const ChannelType_t type, const ChannelNum_t channel)
+{
     String chanNum;
     if (type == TYPE_DC) {
         // TODO(tbnobody)
@@ -144,23 +400,61 @@ String MqttHandleInverterClass::getTopic(std::shared_ptr<InverterAbstract> inv,
     } else {
         chanNum = channel;
     }
+    return chanNum;
+}
 
-    return inv->serialString() + "/" + chanNum + "/" + chanName;
+float MqttHandleInverterClass::getDeadband(const UnitId_t unit)
+{
+    switch (unit) {
+    case UNIT_V:
+        return MQTT_DEADBAND_VOLTAGE;
+    case UNIT_A:
+        return MQTT_DEADBAND_CURRENT;
+    case UNIT_W:
+        return MQTT_DEADBAND_POWER;
+    case UNIT_WH:
+        return MQTT_DEADBAND_ENERGY_WH;
+    case UNIT_KWH:
+        return MQTT_DEADBAND_ENERGY_KWH;
+    case UNIT_HZ:
+        return MQTT_DEADBAND_FREQUENCY;
+    case UNIT_C:
+        return MQTT_DEADBAND_TEMPERATURE;
+    case UNIT_PCT:
+        return MQTT_DEADBAND_PERCENT;
+    case UNIT_VAR:
+        return MQTT_DEADBAND_REACTIVE_POWER;
+    default:
+        return 0;
+    }
 }
 
-void MqttHandleInverterClass::onMqttMessage(Topic t, const espMqttClientTypes::MessageProperties& properties, const char* topic, const uint8_t* payload, const size_t len, const size_t index, const size_t total)
+void MqttHandleInverterClass::onMqttMessage(const espMqttClientTypes::MessageProperties& properties, const char* topic, const uint8_t* payload, const size_t len, const size_t index, const size_t total)
 {
     const CONFIG_T& config = Configuration.get();
 
-    char token_topic[MQTT_MAX_TOPIC_STRLEN + 40]; // respect all subtopics
-    strncpy(token_topic, topic, MQTT_MAX_TOPIC_STRLEN + 40); // convert const char* to char*
-
-    char* serial_str;
-    char* rest = &token_topic[strlen(config.Mqtt.Topic)];
+    // <prefix><serial>/cmd/<command>
+    const size_t prefixLen = strlen(config.Mqtt.Topic);
+    if (strncmp(topic, config.Mqtt.Topic, prefixLen) != 0) {
+        return;
+    }
+    const char* serial_str = topic + prefixLen;
+    const char* cmd = strstr(serial_str, "/cmd/");
+    if (cmd == nullptr || cmd == serial_str) {
+        return;
+    }
+    const char* command = cmd + strlen("/cmd/");
 
-    serial_str = strtok_r(rest, "/", &rest);
+    auto it = _commandTopics.find(frozen::string(command, strlen(command)));
+    if (it == _commandTopics.end()) {
+        return;
+    }
+    const Topic t = it->second;
 
-    if (serial_str == NULL) {
+    // <prefix>group_<n>/cmd/<command> splits a limit across the members of the group
+    if (strncmp(serial_str, "group_", strlen("group_")) == 0) {
+        const unsigned long group = strtoul(serial_str + strlen("group_"), 0, 10);
+        onGroupMessage(properties, topic, group <= INV_MAX_GROUP_COUNT ? group : 0, t, payload, len);
         return;
     }
 
@@ -243,28 +537,61 @@ void MqttHandleInverterClass::onMqttMessage(Topic t, const espMqttClientTypes::M
     }
 }
 
-void MqttHandleInverterClass::subscribeTopics()
+void MqttHandleInverterClass::onGroupMessage(const espMqttClientTypes::MessageProperties& properties, const char* topic, const uint8_t group, const Topic t, const uint8_t* payload, const size_t len)
 {
-    String const& prefix = MqttSettings.getPrefix();
+    if (group == 0 || group > INV_MAX_GROUP_COUNT) {
+        MessageOutput.println("Group not found");
+        return;
+    }
 
-    auto subscribe = [&prefix, this](char const* subTopic, Topic t) {
-        String fullTopic(prefix + _cmdtopic.data() + subTopic);
-        MqttSettings.subscribe(fullTopic.c_str(), 0,
-            std::bind(&MqttHandleInverterClass::onMqttMessage, this, t,
-                std::placeholders::_1, std::placeholders::_2,
-                std::placeholders::_3, std::placeholders::_4,
-                std::placeholders::_5, std::placeholders::_6));
-    };
+    std::string strValue(reinterpret_cast<const char*>(payload), len);
+    float payload_val = -1;
+    try {
+        payload_val = std::stof(strValue);
+    } catch (std::invalid_argument const& e) {
+        MessageOutput.printf("MQTT handler: cannot parse payload of topic '%s' as float: %s\r\n",
+            topic, strValue.c_str());
+        return;
+    }
 
-    for (auto const& s : _subscriptions) {
-        subscribe(s.first.data(), s.second);
+    PowerLimitControlType type;
+    switch (t) {
+    case Topic::LimitPersistentRelative:
+        type = PowerLimitControlType::RelativPersistent;
+        break;
+    case Topic::LimitPersistentAbsolute:
+        type = PowerLimitControlType::AbsolutPersistent;
+        break;
+    case Topic::LimitNonPersistentRelative:
+        type = PowerLimitControlType::RelativNonPersistent;
+        break;
+    case Topic::LimitNonPersistentAbsolute:
+        type = PowerLimitControlType::AbsolutNonPersistent;
+        break;
+    default:
+        MessageOutput.println("Command not supported for groups");
+        return;
+    }
+
+    if (properties.retain && (type == PowerLimitControlType::RelativNonPersistent || type == PowerLimitControlType::AbsolutNonPersistent)) {
+        MessageOutput.println("Ignored because retained");
+        return;
     }
+
+    const uint8_t sent = Datastore.sendGroupLimit(group, payload_val, type);
+    MessageOutput.printf("Group %" PRIu8 " limit: %.1f sent to %" PRIu8 " inverters\r\n", group, payload_val, sent);
+}
+
+void MqttHandleInverterClass::subscribeTopics()
+{
+    MqttSettings.subscribe(MqttSettings.getPrefix() + _cmdtopic.data() + "#", 0,
+        std::bind(&MqttHandleInverterClass::onMqttMessage, this,
+            std::placeholders::_1, std::placeholders::_2,
+            std::placeholders::_3, std::placeholders::_4,
+            std::placeholders::_5, std::placeholders::_6));
 }
 
 void MqttHandleInverterClass::unsubscribeTopics()
 {
-    String const& prefix = MqttSettings.getPrefix() + _cmdtopic.data();
-    for (auto const& s : _subscriptions) {
-        MqttSettings.unsubscribe(prefix + s.first.data());
-    }
+    MqttSettings.unsubscribe(MqttSettings.getPrefix() + _cmdtopic.data() + "#");
 }
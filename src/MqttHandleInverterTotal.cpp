@@ -6,18 +6,21 @@
 #include "Configuration.h"
 #include "Datastore.h"
 #include "MqttSettings.h"
-#include <Hoymiles.h>
+#include "PublishCoordinator.h"
+#include "ResourceGovernor.h"
+#include "TaskProfiler.h"
 
 MqttHandleInverterTotalClass MqttHandleInverterTotal;
 
 MqttHandleInverterTotalClass::MqttHandleInverterTotalClass()
-    : _loopTask(TASK_IMMEDIATE, TASK_FOREVER, std::bind(&MqttHandleInverterTotalClass::loop, this))
+    : _loopTask(TASK_IMMEDIATE, TASK_FOREVER)
 {
 }
 
 void MqttHandleInverterTotalClass::init(Scheduler& scheduler)
 {
     scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "MqttHandleInverterTotal.loop", std::bind(&MqttHandleInverterTotalClass::loop, this));
     _loopTask.setInterval(Configuration.get().Mqtt.PublishInterval * TASK_SECOND);
     _loopTask.enable();
 }
@@ -25,18 +28,47 @@ void MqttHandleInverterTotalClass::init(Scheduler& scheduler)
 void MqttHandleInverterTotalClass::loop()
 {
     // Update interval from config
-    _loopTask.setInterval(Configuration.get().Mqtt.PublishInterval * TASK_SECOND);
+    _loopTask.setInterval(ResourceGovernor.getMqttPublishInterval() * TASK_SECOND);
 
-    if (!MqttSettings.getConnected() || !Hoymiles.isAllRadioIdle()) {
-        _loopTask.forceNextIteration();
+    if (!MqttSettings.getConnected()) {
+        _loopTask.delay(PublishCoordinator.getRetryDelay(MQTT_PUBLISH_RETRY_INTERVAL) * TASK_MILLISECOND);
+        return;
+    }
+    if (!PublishCoordinator.beginSlice()) {
+        _loopTask.delay(PublishCoordinator.getWaitDelay() * TASK_MILLISECOND);
         return;
     }
 
     MqttSettings.publish("ac/power", String(Datastore.getTotalAcPowerEnabled(), Datastore.getTotalAcPowerDigits()));
     MqttSettings.publish("ac/yieldtotal", String(Datastore.getTotalAcYieldTotalEnabled(), Datastore.getTotalAcYieldTotalDigits()));
     MqttSettings.publish("ac/yieldday", String(Datastore.getTotalAcYieldDayEnabled(), Datastore.getTotalAcYieldDayDigits()));
+    MqttSettings.publish("ac/energy", String(Datastore.getTotalAcEnergy(), 3));
     MqttSettings.publish("ac/is_valid", String(Datastore.getIsAllEnabledReachable()));
     MqttSettings.publish("dc/power", String(Datastore.getTotalDcPowerEnabled(), Datastore.getTotalDcPowerDigits()));
+    MqttSettings.publish("dc/energy", String(Datastore.getTotalDcEnergy(), 3));
     MqttSettings.publish("dc/irradiation", String(Datastore.getTotalDcIrradiation(), 3));
     MqttSettings.publish("dc/is_valid", String(Datastore.getIsAllEnabledReachable()));
+    MqttSettings.publish("skew", String(Datastore.getTotalSkew()));
+
+    // One set of totals per group which has members, <prefix>group_<n>/...
+    for (uint8_t group = 1; group <= INV_MAX_GROUP_COUNT; group++) {
+        DatastoreGroupTotals_t totals;
+        if (!Datastore.getGroupTotals(group, totals) || totals.MemberCount == 0) {
+            continue;
+        }
+
+        const String subtopic = "group_" + String(group) + "/";
+        MqttSettings.publish(subtopic + "ac/power", String(totals.AcPower, totals.AcPowerDigits));
+        MqttSettings.publish(subtopic + "ac/yieldtotal", String(totals.AcYieldTotal, totals.AcYieldTotalDigits));
+        MqttSettings.publish(subtopic + "ac/yieldday", String(totals.AcYieldDay, totals.AcYieldDayDigits));
+        MqttSettings.publish(subtopic + "ac/energy", String(totals.AcEnergy, 3));
+        MqttSettings.publish(subtopic + "ac/is_valid", String(totals.IsAllEnabledReachable));
+        MqttSettings.publish(subtopic + "dc/power", String(totals.DcPower, totals.DcPowerDigits));
+        MqttSettings.publish(subtopic + "dc/energy", String(totals.DcEnergy, 3));
+        MqttSettings.publish(subtopic + "dc/is_valid", String(totals.IsAllEnabledReachable));
+        MqttSettings.publish(subtopic + "members", String(totals.MemberCount));
+        MqttSettings.publish(subtopic + "skew", String(totals.Skew));
+    }
+
+    PublishCoordinator.endSlice();
 }
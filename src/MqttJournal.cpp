@@ -0,0 +1,257 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "MqttJournal.h"
+#include "Configuration.h"
+#include "FlashWear.h"
+#include "MessageOutput.h"
+#include "MqttSettings.h"
+#include "NtpSettings.h"
+#include "TaskProfiler.h"
+#include <Hoymiles.h>
+#include <LittleFS.h>
+
+MqttJournalClass MqttJournal;
+
+MqttJournalClass::MqttJournalClass()
+    : _loopTask(TASK_SECOND, TASK_FOREVER)
+{
+}
+
+void MqttJournalClass::init(Scheduler& scheduler)
+{
+    scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "MqttJournal.loop", std::bind(&MqttJournalClass::loop, this));
+    _loopTask.enable();
+}
+
+void MqttJournalClass::loop()
+{
+    const CONFIG_T& config = Configuration.get();
+    if (!config.Mqtt.Enabled || !config.Mqtt.Journal.Enabled) {
+        return;
+    }
+
+    if (MqttSettings.getConnected()) {
+        // Records from RAM are replayed from flash as well, this keeps the order
+        flush();
+        replay(config.Mqtt.Journal.ReplayRate);
+        return;
+    }
+
+    if (!NtpSettings.isTimeConfident()) {
+        return;
+    }
+
+    const uint32_t now = time(nullptr);
+    if (now - _lastRecord >= config.Mqtt.PublishInterval) {
+        record(now);
+        _lastRecord = now;
+    }
+
+    bool flushDue;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        flushDue = _pending.size() >= MQTT_JOURNAL_FLUSH_COUNT
+            || (!_pending.empty() && now - _firstPending >= MQTT_JOURNAL_FLUSH_INTERVAL);
+    }
+    if (flushDue) {
+        flush();
+    }
+}
+
+void MqttJournalClass::record(const uint32_t now)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    Hoymiles.forEachInverter([&](InverterAbstract& inv, const uint8_t) {
+        if (!inv.isReachable()) {
+            return;
+        }
+
+        if (_pending.empty()) {
+            _firstPending = now;
+        }
+
+        auto stats = inv.Statistics();
+        MqttJournalRecord_t record = { inv.serial(), now };
+        stats->readConsistent([&] {
+            record.Power = stats->getChannelFieldValue(TYPE_AC, CH0, FLD_PAC);
+            record.YieldDay = stats->getChannelFieldValue(TYPE_INV, CH0, FLD_YD);
+            record.YieldTotal = stats->getChannelFieldValue(TYPE_INV, CH0, FLD_YT);
+            record.DcPower = stats->getChannelFieldValue(TYPE_INV, CH0, FLD_PDC);
+            record.Temperature = stats->getChannelFieldValue(TYPE_INV, CH0, FLD_T);
+        });
+        _pending.push_back(record);
+        _stats.Recorded++;
+    });
+}
+
+void MqttJournalClass::flush()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!writePending()) {
+        MessageOutput.println("Failed to write MQTT journal");
+    }
+}
+
+MqttJournalStats_t MqttJournalClass::getStats()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    MqttJournalStats_t stats = _stats;
+    stats.Count = (_valid ? _header.Count : 0) + _pending.size();
+    return stats;
+}
+
+bool MqttJournalClass::openStore()
+{
+    if (_valid) {
+        return true;
+    }
+
+    File f = LittleFS.open(MQTT_JOURNAL_FILENAME, "r", false);
+    if (f) {
+        MqttJournalFileHeader_t header;
+        const bool ok = f.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) == sizeof(header)
+            && header.Magic == MQTT_JOURNAL_MAGIC
+            && header.Version == MQTT_JOURNAL_VERSION
+            && header.RecordSize == sizeof(MqttJournalRecord_t)
+            && header.Capacity == MQTT_JOURNAL_CAPACITY
+            && header.Head < header.Capacity
+            && header.Count <= header.Capacity;
+        f.close();
+
+        if (ok) {
+            _header = header;
+            _valid = true;
+            return true;
+        }
+    }
+
+    // Missing or incompatible, start a new file
+    f = LittleFS.open(MQTT_JOURNAL_FILENAME, "w");
+    if (!f) {
+        return false;
+    }
+
+    _header = { MQTT_JOURNAL_MAGIC, MQTT_JOURNAL_VERSION, sizeof(MqttJournalRecord_t), MQTT_JOURNAL_CAPACITY, 0, 0 };
+    _valid = f.write(reinterpret_cast<const uint8_t*>(&_header), sizeof(_header)) == sizeof(_header);
+    f.close();
+    return _valid;
+}
+
+bool MqttJournalClass::writePending()
+{
+    if (_pending.empty()) {
+        return true;
+    }
+
+    if (!openStore()) {
+        return false;
+    }
+
+    File f = LittleFS.open(MQTT_JOURNAL_FILENAME, "r+", false);
+    if (!f) {
+        _valid = false;
+        return false;
+    }
+
+    // Records are appended at the head, a full ring overwrites the oldest ones
+    MqttJournalFileHeader_t header = _header;
+    bool ok = f.seek(sizeof(MqttJournalFileHeader_t) + header.Head * sizeof(MqttJournalRecord_t));
+    for (const auto& record : _pending) {
+        if (!ok) {
+            break;
+        }
+        ok = f.write(reinterpret_cast<const uint8_t*>(&record), sizeof(record)) == sizeof(record);
+
+        if (header.Count == header.Capacity) {
+            _stats.Evicted++;
+        }
+        header.Head++;
+        header.Count = std::min(header.Count + 1, header.Capacity);
+        if (header.Head == header.Capacity) {
+            header.Head = 0;
+            ok = ok && f.seek(sizeof(MqttJournalFileHeader_t));
+        }
+    }
+
+    ok = ok && f.seek(0) && f.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header)) == sizeof(header);
+    f.close();
+
+    if (!ok) {
+        // Start over with a new file on the next attempt
+        _valid = false;
+        LittleFS.remove(MQTT_JOURNAL_FILENAME);
+        return false;
+    }
+
+    FlashWear.record(FlashWriter_t::MqttJournal, _pending.size() * sizeof(MqttJournalRecord_t) + sizeof(header));
+    _header = header;
+    _pending.clear();
+    return true;
+}
+
+void MqttJournalClass::replay(const uint16_t maxRecords)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (!openStore() || _header.Count == 0 || maxRecords == 0) {
+        return;
+    }
+
+    File f = LittleFS.open(MQTT_JOURNAL_FILENAME, "r+", false);
+    if (!f) {
+        _valid = false;
+        return;
+    }
+
+    // Oldest records first, the next call continues where this one stopped
+    MqttJournalFileHeader_t header = _header;
+    const uint32_t first = (header.Head + header.Capacity - header.Count) % header.Capacity;
+    const uint32_t count = std::min<uint32_t>(header.Count, maxRecords);
+
+    uint32_t replayed = 0;
+    for (; replayed < count && MqttSettings.getConnected(); replayed++) {
+        MqttJournalRecord_t record;
+        const uint32_t pos = (first + replayed) % header.Capacity;
+        if (!f.seek(sizeof(MqttJournalFileHeader_t) + pos * sizeof(MqttJournalRecord_t))
+            || f.read(reinterpret_cast<uint8_t*>(&record), sizeof(record)) != sizeof(record)) {
+            break;
+        }
+        publishRecord(record);
+    }
+
+    header.Count -= replayed;
+    if (header.Count == 0) {
+        header.Head = 0;
+    }
+    const bool ok = f.seek(0) && f.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header)) == sizeof(header);
+    f.close();
+
+    if (!ok) {
+        _valid = false;
+        LittleFS.remove(MQTT_JOURNAL_FILENAME);
+        return;
+    }
+
+    _header = header;
+    _stats.Replayed += replayed;
+}
+
+void MqttJournalClass::publishRecord(const MqttJournalRecord_t& record)
+{
+    char serial[sizeof(uint64_t) * 8 + 1];
+    snprintf(serial, sizeof(serial), "%0" PRIx32 "%08" PRIx32,
+        static_cast<uint32_t>((record.Serial >> 32) & 0xFFFFFFFF),
+        static_cast<uint32_t>(record.Serial & 0xFFFFFFFF));
+
+    char payload[160];
+    snprintf(payload, sizeof(payload),
+        "{\"ts\":%" PRIu32 ",\"power\":%.1f,\"yieldday\":%.0f,\"yieldtotal\":%.3f,\"dc_power\":%.1f,\"temperature\":%.1f}",
+        record.Timestamp, record.Power, record.YieldDay, record.YieldTotal, record.DcPower, record.Temperature);
+
+    // Not retained, the replayed values are older than the current state
+    MqttSettings.publishGeneric(MqttSettings.getPrefix() + serial + "/journal", payload, false, 1);
+}
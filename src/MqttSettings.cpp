@@ -3,7 +3,11 @@
  * Copyright (C) 2022 Thomas Basler and others
  */
 #include "MqttSettings.h"
+#include "CertStore.h"
 #include "Configuration.h"
+#include "DnsResolver.h"
+#include "HeapTelemetry.h"
+#include "LoopMonitor.h"
 #include "MessageOutput.h"
 
 MqttSettingsClass::MqttSettingsClass()
@@ -93,7 +97,9 @@ void MqttSettingsClass::onMqttMessage(const espMqttClientTypes::MessagePropertie
 {
     MessageOutput.printf("Received MQTT message on topic: %s\r\n", topic);
 
+    LoopMonitor.beginActivity(LoopActivity_t::Mqtt, topic);
     _mqttSubscribeParser.handle_message(properties, topic, payload, len, index, total);
+    LoopMonitor.endActivity(LoopActivity_t::Mqtt);
 }
 
 void MqttSettingsClass::performConnect()
@@ -111,27 +117,43 @@ void MqttSettingsClass::performConnect()
             return;
         }
 
-        MessageOutput.println("Connecting to MQTT...");
         const CONFIG_T& config = Configuration.get();
+
+        // The client would resolve the host name blocking within its task. Until the
+        // first lookup finished, the connect is retried.
+        IPAddress brokerIp;
+        if (!DnsResolver.resolve(config.Mqtt.Hostname, brokerIp)) {
+            MessageOutput.printf("Resolving MQTT broker %s...\r\n", config.Mqtt.Hostname);
+            _mqttReconnectTimer.once(
+                1, +[](MqttSettingsClass* instance) { instance->performConnect(); }, this);
+            return;
+        }
+
+        MessageOutput.println("Connecting to MQTT...");
         const String willTopic = getPrefix() + config.Mqtt.Lwt.Topic;
         String clientId = getClientId();
         if (config.Mqtt.Tls.Enabled) {
-            static_cast<espMqttClientSecure*>(_mqttClient)->setCACert(config.Mqtt.Tls.RootCaCert);
-            static_cast<espMqttClientSecure*>(_mqttClient)->setServer(config.Mqtt.Hostname, config.Mqtt.Port);
+            // Only parsed again if the certificates changed. The PEM text is only
+            // in RAM while connecting, the transport keeps the parsed certificates.
+            const String rootCa = CertStore.read(Cert_t::MqttRootCa);
             if (config.Mqtt.Tls.CertLogin) {
-                static_cast<espMqttClientSecure*>(_mqttClient)->setCertificate(config.Mqtt.Tls.ClientCert);
-                static_cast<espMqttClientSecure*>(_mqttClient)->setPrivateKey(config.Mqtt.Tls.ClientKey);
+                const String clientCert = CertStore.read(Cert_t::MqttClientCert);
+                const String clientKey = CertStore.read(Cert_t::MqttClientKey);
+                _tlsTransport.configure(rootCa.c_str(), clientCert.c_str(), clientKey.c_str());
             } else {
-                static_cast<espMqttClientSecure*>(_mqttClient)->setCredentials(config.Mqtt.Username, config.Mqtt.Password);
+                _tlsTransport.configure(rootCa.c_str(), nullptr, nullptr);
+                static_cast<espMqttClientTls*>(_mqttClient)->setCredentials(config.Mqtt.Username, config.Mqtt.Password);
             }
-            static_cast<espMqttClientSecure*>(_mqttClient)->setWill(willTopic.c_str(), config.Mqtt.Lwt.Qos, config.Mqtt.Retain, config.Mqtt.Lwt.Value_Offline);
-            static_cast<espMqttClientSecure*>(_mqttClient)->setClientId(clientId.c_str());
-            static_cast<espMqttClientSecure*>(_mqttClient)->setCleanSession(config.Mqtt.CleanSession);
-            static_cast<espMqttClientSecure*>(_mqttClient)->onConnect(std::bind(&MqttSettingsClass::onMqttConnect, this, _1));
-            static_cast<espMqttClientSecure*>(_mqttClient)->onDisconnect(std::bind(&MqttSettingsClass::onMqttDisconnect, this, _1));
-            static_cast<espMqttClientSecure*>(_mqttClient)->onMessage(std::bind(&MqttSettingsClass::onMqttMessage, this, _1, _2, _3, _4, _5, _6));
+            // The host name is required for the certificate check, the transport uses the cached address
+            static_cast<espMqttClientTls*>(_mqttClient)->setServer(config.Mqtt.Hostname, config.Mqtt.Port);
+            static_cast<espMqttClientTls*>(_mqttClient)->setWill(willTopic.c_str(), config.Mqtt.Lwt.Qos, config.Mqtt.Retain, config.Mqtt.Lwt.Value_Offline);
+            static_cast<espMqttClientTls*>(_mqttClient)->setClientId(clientId.c_str());
+            static_cast<espMqttClientTls*>(_mqttClient)->setCleanSession(config.Mqtt.CleanSession);
+            static_cast<espMqttClientTls*>(_mqttClient)->onConnect(std::bind(&MqttSettingsClass::onMqttConnect, this, _1));
+            static_cast<espMqttClientTls*>(_mqttClient)->onDisconnect(std::bind(&MqttSettingsClass::onMqttDisconnect, this, _1));
+            static_cast<espMqttClientTls*>(_mqttClient)->onMessage(std::bind(&MqttSettingsClass::onMqttMessage, this, _1, _2, _3, _4, _5, _6));
         } else {
-            static_cast<espMqttClient*>(_mqttClient)->setServer(config.Mqtt.Hostname, config.Mqtt.Port);
+            static_cast<espMqttClient*>(_mqttClient)->setServer(brokerIp, config.Mqtt.Port);
             static_cast<espMqttClient*>(_mqttClient)->setCredentials(config.Mqtt.Username, config.Mqtt.Password);
             static_cast<espMqttClient*>(_mqttClient)->setWill(willTopic.c_str(), config.Mqtt.Lwt.Qos, config.Mqtt.Retain, config.Mqtt.Lwt.Value_Offline);
             static_cast<espMqttClient*>(_mqttClient)->setClientId(clientId.c_str());
@@ -199,13 +221,188 @@ void MqttSettingsClass::publish(const String& subtopic, const String& payload)
     publishGeneric(topic, value, Configuration.get().Mqtt.Retain, 0);
 }
 
+void MqttSettingsClass::publishPriority(const String& subtopic, const String& payload)
+{
+    String topic = getPrefix();
+    topic += subtopic;
+
+    if (_publishTaskHandle != nullptr) {
+        enqueuePublish(topic.c_str(), payload.c_str(), Configuration.get().Mqtt.Retain, 0, true);
+        return;
+    }
+    publishDirect(topic.c_str(), payload.c_str(), Configuration.get().Mqtt.Retain, 0);
+}
+
 void MqttSettingsClass::publishGeneric(const String& topic, const String& payload, const bool retain, const uint8_t qos)
+{
+    publishGeneric(topic.c_str(), payload.c_str(), retain, qos);
+}
+
+void MqttSettingsClass::publishGeneric(const char* topic, const char* payload, const bool retain, const uint8_t qos)
+{
+    if (_publishTaskHandle != nullptr) {
+        enqueuePublish(topic, payload, retain, qos);
+        return;
+    }
+    publishDirect(topic, payload, retain, qos);
+}
+
+void MqttSettingsClass::publishDirect(const char* topic, const char* payload, const bool retain, const uint8_t qos)
+{
+    std::lock_guard<std::mutex> lock(_clientLock);
+    if (_mqttClient == nullptr) {
+        return;
+    }
+    _mqttClient->publish(topic, qos, retain, payload);
+    _bytesPublished += strlen(topic) + strlen(payload);
+}
+
+void MqttSettingsClass::publishBinary(const char* topic, const uint8_t* payload, const size_t len, const bool retain, const uint8_t qos)
 {
     std::lock_guard<std::mutex> lock(_clientLock);
     if (_mqttClient == nullptr) {
         return;
     }
-    _mqttClient->publish(topic.c_str(), qos, retain, payload.c_str());
+    _mqttClient->publish(topic, qos, retain, payload, len);
+    _bytesPublished += strlen(topic) + len;
+}
+
+void MqttSettingsClass::enqueuePublish(const char* topic, const char* payload, const bool retain, const uint8_t qos, const bool priority)
+{
+    {
+        std::lock_guard<std::mutex> lock(_publishQueueLock);
+
+        if (priority) {
+            // A queued value of the same topic is obsolete, the new one goes to the front
+            for (auto it = _publishQueue.begin(); it != _publishQueue.end(); ++it) {
+                if (it->Topic == topic) {
+                    HeapTelemetry.onFree(HeapTag_t::MqttQueue, it->Topic.length() + it->Payload.length());
+                    _publishQueue.erase(it);
+                    _publishQueueStats.Replaced++;
+                    break;
+                }
+            }
+            if (_publishQueue.size() >= MQTT_PUBLISH_QUEUE_SIZE) {
+                // The newest bulk value is dropped instead of an older priority value
+                const PublishItem_t& dropped = _publishQueue.back();
+                HeapTelemetry.onFree(HeapTag_t::MqttQueue, dropped.Topic.length() + dropped.Payload.length());
+                _publishQueue.pop_back();
+                _publishQueueStats.Dropped++;
+            }
+            _publishQueue.push_front({ topic, payload, retain, qos, millis() });
+            HeapTelemetry.onAlloc(HeapTag_t::MqttQueue, _publishQueue.front().Topic.length() + _publishQueue.front().Payload.length());
+        } else {
+#if MQTT_PUBLISH_QUEUE_REPLACE
+            // A newer value makes a queued value of the same topic obsolete. The old
+            // queue position is kept, but the latency is measured from the newer value.
+            bool replaced = false;
+            for (auto& item : _publishQueue) {
+                if (item.Topic == topic) {
+                    HeapTelemetry.onFree(HeapTag_t::MqttQueue, item.Payload.length());
+                    item.Payload = payload;
+                    HeapTelemetry.onAlloc(HeapTag_t::MqttQueue, item.Payload.length());
+                    item.Retain = retain;
+                    item.Qos = qos;
+                    item.QueuedTime = millis();
+                    _publishQueueStats.Replaced++;
+                    replaced = true;
+                    break;
+                }
+            }
+            if (!replaced)
+#endif
+            {
+                if (_publishQueue.size() >= MQTT_PUBLISH_QUEUE_SIZE) {
+                    const PublishItem_t& dropped = _publishQueue.front();
+                    HeapTelemetry.onFree(HeapTag_t::MqttQueue, dropped.Topic.length() + dropped.Payload.length());
+                    _publishQueue.pop_front();
+                    _publishQueueStats.Dropped++;
+                }
+                _publishQueue.push_back({ topic, payload, retain, qos, millis() });
+                HeapTelemetry.onAlloc(HeapTag_t::MqttQueue, _publishQueue.back().Topic.length() + _publishQueue.back().Payload.length());
+            }
+        }
+
+        _publishQueueStats.Depth = _publishQueue.size();
+        if (_publishQueueStats.Depth > _publishQueueStats.MaxDepth) {
+            _publishQueueStats.MaxDepth = _publishQueueStats.Depth;
+        }
+    }
+
+    xTaskNotifyGive(_publishTaskHandle);
+}
+
+void MqttSettingsClass::processPublishQueue()
+{
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    for (;;) {
+        PublishItem_t item;
+        {
+            std::lock_guard<std::mutex> lock(_publishQueueLock);
+            if (_publishQueue.empty()) {
+                return;
+            }
+            item = std::move(_publishQueue.front());
+            _publishQueue.pop_front();
+            HeapTelemetry.onFree(HeapTag_t::MqttQueue, item.Topic.length() + item.Payload.length());
+            _publishQueueStats.Depth = _publishQueue.size();
+        }
+
+        publishDirect(item.Topic.c_str(), item.Payload.c_str(), item.Retain, item.Qos);
+
+        const uint32_t latency = millis() - item.QueuedTime;
+
+        std::lock_guard<std::mutex> lock(_publishQueueLock);
+        _publishQueueStats.Sent++;
+        _publishQueueStats.LatencyTotal += latency;
+        if (latency > _publishQueueStats.LatencyMax) {
+            _publishQueueStats.LatencyMax = latency;
+        }
+    }
+}
+
+void MqttSettingsClass::publishTaskProc(void* param)
+{
+    MqttSettingsClass* settings = static_cast<MqttSettingsClass*>(param);
+    for (;;) {
+        settings->processPublishQueue();
+    }
+}
+
+void MqttSettingsClass::startPublishTask()
+{
+    if (_publishTaskHandle != nullptr) {
+        return;
+    }
+
+    if (xTaskCreatePinnedToCore(publishTaskProc, "MQTT_PUB", MQTT_PUBLISH_TASK_STACK_SIZE, this,
+            MQTT_PUBLISH_TASK_PRIORITY, &_publishTaskHandle, MQTT_PUBLISH_TASK_CORE)
+        != pdPASS) {
+        _publishTaskHandle = nullptr;
+        MessageOutput.println("MQTT: Could not create publish task");
+        return;
+    }
+
+    MessageOutput.printf("MQTT: publish task started on core %d\r\n", MQTT_PUBLISH_TASK_CORE);
+}
+
+bool MqttSettingsClass::hasPublishTask() const
+{
+    return _publishTaskHandle != nullptr;
+}
+
+MqttTlsStats_t MqttSettingsClass::getTlsStats() const
+{
+    return _tlsTransport.getStats();
+}
+
+MqttPublishQueueStats_t MqttSettingsClass::getPublishQueueStats()
+{
+    std::lock_guard<std::mutex> lock(_publishQueueLock);
+    MqttPublishQueueStats_t stats = _publishQueueStats;
+    stats.Bytes = _bytesPublished;
+    return stats;
 }
 
 void MqttSettingsClass::init()
@@ -214,6 +411,10 @@ void MqttSettingsClass::init()
     NetworkSettings.onEvent(std::bind(&MqttSettingsClass::NetworkEvent, this, _1));
 
     createMqttClientObject();
+
+#ifdef MQTT_PUBLISH_TASK
+    startPublishTask();
+#endif
 }
 
 void MqttSettingsClass::createMqttClientObject()
@@ -225,9 +426,9 @@ void MqttSettingsClass::createMqttClientObject()
     }
     const CONFIG_T& config = Configuration.get();
     if (config.Mqtt.Tls.Enabled) {
-        _mqttClient = static_cast<MqttClient*>(new espMqttClientSecure);
+        _mqttClient = static_cast<MqttClient*>(new espMqttClientTls(_tlsTransport, MQTT_CLIENT_TASK_PRIORITY, MQTT_CLIENT_TASK_CORE));
     } else {
-        _mqttClient = static_cast<MqttClient*>(new espMqttClient);
+        _mqttClient = static_cast<MqttClient*>(new espMqttClient(MQTT_CLIENT_TASK_PRIORITY, MQTT_CLIENT_TASK_CORE));
     }
 }
 
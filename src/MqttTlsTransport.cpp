@@ -0,0 +1,308 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "MqttTlsTransport.h"
+#include "DnsResolver.h"
+#include "MessageOutput.h"
+#include <mbedtls/error.h>
+#include <mbedtls/net_sockets.h>
+
+static uint32_t fnv1a(const char* data, uint32_t hash = 2166136261UL)
+{
+    for (const char* c = data; c != nullptr && *c != '\0'; c++) {
+        hash ^= static_cast<uint8_t>(*c);
+        hash *= 16777619UL;
+    }
+    // Separates the strings, "ab" + "" and "a" + "b" must not collide
+    return (hash ^ 0xff) * 16777619UL;
+}
+
+static void logError(const char* what, const int ret)
+{
+    char buffer[100];
+    mbedtls_strerror(ret, buffer, sizeof(buffer));
+    MessageOutput.printf("MQTT TLS: %s failed (-0x%04x, %s)\r\n", what, -ret, buffer);
+}
+
+MqttTlsTransport::MqttTlsTransport()
+{
+    mbedtls_entropy_init(&_entropy);
+    mbedtls_ctr_drbg_init(&_drbg);
+    mbedtls_ssl_config_init(&_conf);
+    mbedtls_x509_crt_init(&_rootCa);
+    mbedtls_x509_crt_init(&_clientCert);
+    mbedtls_pk_init(&_clientKey);
+    mbedtls_ssl_init(&_ssl);
+    mbedtls_ssl_session_init(&_session);
+}
+
+MqttTlsTransport::~MqttTlsTransport()
+{
+    stop();
+    freeCertificates();
+    mbedtls_ssl_session_free(&_session);
+    mbedtls_ssl_config_free(&_conf);
+    mbedtls_ctr_drbg_free(&_drbg);
+    mbedtls_entropy_free(&_entropy);
+}
+
+void MqttTlsTransport::freeCertificates()
+{
+    mbedtls_x509_crt_free(&_rootCa);
+    mbedtls_x509_crt_free(&_clientCert);
+    mbedtls_pk_free(&_clientKey);
+    mbedtls_x509_crt_init(&_rootCa);
+    mbedtls_x509_crt_init(&_clientCert);
+    mbedtls_pk_init(&_clientKey);
+    _configured = false;
+}
+
+bool MqttTlsTransport::configure(const char* rootCa, const char* clientCert, const char* clientKey)
+{
+    const uint32_t hash = fnv1a(clientKey, fnv1a(clientCert, fnv1a(rootCa)));
+    if (_sslActive || (_configured && hash == _configHash)) {
+        return _configured;
+    }
+
+    freeCertificates();
+    mbedtls_ssl_config_free(&_conf);
+    mbedtls_ssl_config_init(&_conf);
+
+    // A session of other certificates must not be resumed
+    mbedtls_ssl_session_free(&_session);
+    mbedtls_ssl_session_init(&_session);
+    _sessionValid = false;
+
+    _configHash = hash;
+    _certParses++;
+
+    int ret;
+    if (!_seeded) {
+        static const char personalization[] = "opendtu-mqtt";
+        ret = mbedtls_ctr_drbg_seed(&_drbg, mbedtls_entropy_func, &_entropy,
+            reinterpret_cast<const unsigned char*>(personalization), sizeof(personalization) - 1);
+        if (ret != 0) {
+            logError("seeding the random generator", ret);
+            return false;
+        }
+        _seeded = true;
+    }
+
+    ret = mbedtls_ssl_config_defaults(&_conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    if (ret != 0) {
+        logError("setting up the configuration", ret);
+        return false;
+    }
+    mbedtls_ssl_conf_rng(&_conf, mbedtls_ctr_drbg_random, &_drbg);
+#ifdef MBEDTLS_SSL_SESSION_TICKETS
+    mbedtls_ssl_conf_session_tickets(&_conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+
+    // The length includes the terminating zero for PEM
+    ret = mbedtls_x509_crt_parse(&_rootCa, reinterpret_cast<const unsigned char*>(rootCa), strlen(rootCa) + 1);
+    if (ret != 0) {
+        logError("parsing the root CA", ret);
+        return false;
+    }
+    mbedtls_ssl_conf_ca_chain(&_conf, &_rootCa, nullptr);
+    mbedtls_ssl_conf_authmode(&_conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+
+    if (clientCert != nullptr && clientKey != nullptr) {
+        ret = mbedtls_x509_crt_parse(&_clientCert, reinterpret_cast<const unsigned char*>(clientCert), strlen(clientCert) + 1);
+        if (ret != 0) {
+            logError("parsing the client certificate", ret);
+            return false;
+        }
+        ret = mbedtls_pk_parse_key(&_clientKey, reinterpret_cast<const unsigned char*>(clientKey), strlen(clientKey) + 1, nullptr, 0);
+        if (ret != 0) {
+            logError("parsing the client key", ret);
+            return false;
+        }
+        ret = mbedtls_ssl_conf_own_cert(&_conf, &_clientCert, &_clientKey);
+        if (ret != 0) {
+            logError("setting the client certificate", ret);
+            return false;
+        }
+    }
+
+    _configured = true;
+    return true;
+}
+
+MqttTlsStats_t MqttTlsTransport::getStats() const
+{
+    MqttTlsStats_t stats;
+    stats.Handshakes = _handshakes;
+    stats.Resumed = _resumed;
+    stats.Failed = _failed;
+    stats.LastHandshakeTime = _lastHandshakeTime;
+    stats.CertParses = _certParses;
+    return stats;
+}
+
+bool MqttTlsTransport::connect(IPAddress ip, uint16_t port)
+{
+    const String host = ip.toString();
+    return connect(host.c_str(), port);
+}
+
+bool MqttTlsTransport::connect(const char* host, uint16_t port)
+{
+    stop();
+
+    if (!_configured) {
+        return false;
+    }
+
+    // Connects to the cached address, a lookup by the client would block
+    IPAddress ip;
+    if (!DnsResolver.resolve(host, ip)) {
+        return false;
+    }
+    if (!_tcp.connect(ip, port, MQTT_TLS_TIMEOUT)) {
+        return false;
+    }
+    _tcp.setNoDelay(true);
+
+    if (!handshake(host)) {
+        _failed++;
+        stop();
+        return false;
+    }
+    return true;
+}
+
+bool MqttTlsTransport::handshake(const char* host)
+{
+    mbedtls_ssl_init(&_ssl);
+    _sslActive = true;
+
+    int ret = mbedtls_ssl_setup(&_ssl, &_conf);
+    if (ret != 0) {
+        logError("setup", ret);
+        return false;
+    }
+    mbedtls_ssl_set_hostname(&_ssl, host);
+    mbedtls_ssl_set_bio(&_ssl, this, sendCallback, recvCallback, nullptr);
+
+    if (_sessionValid) {
+        mbedtls_ssl_set_session(&_ssl, &_session);
+    }
+
+    const uint32_t start = millis();
+    while ((ret = mbedtls_ssl_handshake(&_ssl)) != 0) {
+        if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            logError("handshake", ret);
+
+            // The broker may have rejected the session, the next attempt starts a new one
+            _sessionValid = false;
+            return false;
+        }
+        if (millis() - start > MQTT_TLS_TIMEOUT) {
+            MessageOutput.println("MQTT TLS: handshake timed out");
+            return false;
+        }
+        delay(1);
+    }
+
+    _handshakes++;
+    _lastHandshakeTime = millis() - start;
+
+    // The broker resumed the session if it kept the offered session id
+    const mbedtls_ssl_session* current = _ssl.session;
+    if (_sessionValid && current != nullptr && current->id_len > 0
+        && current->id_len == _session.id_len && memcmp(current->id, _session.id, current->id_len) == 0) {
+        _resumed++;
+    }
+
+    mbedtls_ssl_session_free(&_session);
+    mbedtls_ssl_session_init(&_session);
+    _sessionValid = mbedtls_ssl_get_session(&_ssl, &_session) == 0;
+
+    return true;
+}
+
+size_t MqttTlsTransport::write(const uint8_t* buf, size_t size)
+{
+    if (!_sslActive) {
+        return 0;
+    }
+
+    size_t written = 0;
+    while (written < size) {
+        const int ret = mbedtls_ssl_write(&_ssl, buf + written, size - written);
+        if (ret > 0) {
+            written += ret;
+        } else if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            delay(1);
+        } else {
+            stop();
+            break;
+        }
+    }
+    return written;
+}
+
+int MqttTlsTransport::read(uint8_t* buf, size_t size)
+{
+    if (!_sslActive) {
+        return -1;
+    }
+
+    const int ret = mbedtls_ssl_read(&_ssl, buf, size);
+    if (ret > 0) {
+        return ret;
+    }
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        return -1;
+    }
+
+    // Closed by the broker or broken connection
+    stop();
+    return -1;
+}
+
+void MqttTlsTransport::stop()
+{
+    if (_sslActive) {
+        if (_tcp.connected()) {
+            mbedtls_ssl_close_notify(&_ssl);
+        }
+        mbedtls_ssl_free(&_ssl);
+        _sslActive = false;
+    }
+    _tcp.stop();
+}
+
+bool MqttTlsTransport::connected()
+{
+    return _sslActive && _tcp.connected();
+}
+
+bool MqttTlsTransport::disconnected()
+{
+    return !connected();
+}
+
+int MqttTlsTransport::sendCallback(void* ctx, const unsigned char* buf, size_t len)
+{
+    MqttTlsTransport* transport = static_cast<MqttTlsTransport*>(ctx);
+    if (!transport->_tcp.connected()) {
+        return MBEDTLS_ERR_NET_CONN_RESET;
+    }
+
+    const size_t written = transport->_tcp.write(buf, len);
+    return written > 0 ? static_cast<int>(written) : MBEDTLS_ERR_SSL_WANT_WRITE;
+}
+
+int MqttTlsTransport::recvCallback(void* ctx, unsigned char* buf, size_t len)
+{
+    MqttTlsTransport* transport = static_cast<MqttTlsTransport*>(ctx);
+    if (transport->_tcp.available() <= 0) {
+        return transport->_tcp.connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_CONN_RESET;
+    }
+
+    const int ret = transport->_tcp.read(buf, len);
+    return ret > 0 ? ret : MBEDTLS_ERR_SSL_WANT_READ;
+}
@@ -4,16 +4,21 @@
  */
 #include "NetworkSettings.h"
 #include "Configuration.h"
+#include "EventBus.h"
+#include "LoopWakeup.h"
 #include "MessageOutput.h"
 #include "PinMapping.h"
+#include "TaskProfiler.h"
+#include "TimerService.h"
 #include "Utils.h"
 #include "__compiled_constants.h"
 #include "defaults.h"
 #include <ESPmDNS.h>
 #include <ETH.h>
+#include <esp_wifi.h>
 
 NetworkSettingsClass::NetworkSettingsClass()
-    : _loopTask(TASK_IMMEDIATE, TASK_FOREVER, std::bind(&NetworkSettingsClass::loop, this))
+    : _loopTask(NETWORK_LOOP_INTERVAL * TASK_MILLISECOND, TASK_FOREVER)
     , _apIp(192, 168, 4, 1)
     , _apNetmask(255, 255, 255, 0)
     , _dnsServer(std::make_unique<DNSServer>())
@@ -53,7 +58,11 @@ void NetworkSettingsClass::init(Scheduler& scheduler)
 
     setupMode();
 
+    _secondTimer.setCallback(std::bind(&NetworkSettingsClass::secondTick, this));
+    TimerService.arm(_secondTimer, 1000, 1000);
+
     scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "NetworkSettings.loop", std::bind(&NetworkSettingsClass::loop, this));
     _loopTask.enable();
 }
 
@@ -100,14 +109,16 @@ void NetworkSettingsClass::NetworkEvent(const WiFiEvent_t event, WiFiEventInfo_t
         // Reason codes can be found here: https://github.com/espressif/esp-idf/blob/5454d37d496a8c58542eb450467471404c606501/components/esp_wifi/include/esp_wifi_types_generic.h#L79-L141
         MessageOutput.printf("WiFi disconnected: %" PRIu8 "\r\n", info.wifi_sta_disconnected.reason);
         if (_networkMode == network_mode::WiFi) {
-            MessageOutput.println("Try reconnecting");
-            WiFi.disconnect(true, false);
-            WiFi.begin();
+            reconnectWiFi();
             raiseEvent(network_event::NETWORK_DISCONNECTED);
         }
         break;
     case ARDUINO_EVENT_WIFI_STA_GOT_IP:
         MessageOutput.printf("WiFi got ip: %s\r\n", WiFi.localIP().toString().c_str());
+        if (WiFi.BSSID() != nullptr) {
+            memcpy(_lastBssid, WiFi.BSSID(), sizeof(_lastBssid));
+            _lastChannel = WiFi.channel();
+        }
         if (_networkMode == network_mode::WiFi) {
             raiseEvent(network_event::NETWORK_GOT_IP);
         }
@@ -117,6 +128,30 @@ void NetworkSettingsClass::NetworkEvent(const WiFiEvent_t event, WiFiEventInfo_t
     }
 }
 
+void NetworkSettingsClass::reconnectWiFi()
+{
+    // Runs in the WiFi event task, WiFi.begin() only starts the connection
+    const CONFIG_T& config = Configuration.get();
+    WiFi.disconnect(true, false);
+
+    if (_lastChannel > 0) {
+        // Only the first attempt is bound to the last access point. If it fails,
+        // the next one scans again and may roam to another access point.
+        MessageOutput.printf("Try reconnecting to %02X:%02X:%02X:%02X:%02X:%02X on channel %" PRId32 "\r\n",
+            _lastBssid[0], _lastBssid[1], _lastBssid[2], _lastBssid[3], _lastBssid[4], _lastBssid[5], _lastChannel);
+        WiFi.begin(config.WiFi.Ssid, config.WiFi.Password, _lastChannel, _lastBssid);
+        _lastChannel = 0;
+        _bssidPinned = true;
+    } else if (_bssidPinned) {
+        MessageOutput.println("Try reconnecting");
+        WiFi.begin(config.WiFi.Ssid, config.WiFi.Password);
+        _bssidPinned = false;
+    } else {
+        MessageOutput.println("Try reconnecting");
+        WiFi.begin();
+    }
+}
+
 bool NetworkSettingsClass::onEvent(DtuNetworkEventCb cbEvent, const network_event event)
 {
     if (!cbEvent) {
@@ -138,6 +173,9 @@ void NetworkSettingsClass::raiseEvent(const network_event event)
             }
         }
     }
+
+    // The callbacks run in the event task, let the main loop handle their results
+    EventBus.publish(Event_t::NetworkChanged);
 }
 
 void NetworkSettingsClass::handleMDNS()
@@ -188,6 +226,21 @@ void NetworkSettingsClass::setupMode()
             WiFi.mode(WIFI_MODE_NULL);
         }
     }
+    applyPowerSave();
+}
+
+void NetworkSettingsClass::setPowerSave(const bool enabled)
+{
+    _powerSave = enabled;
+    applyPowerSave();
+}
+
+void NetworkSettingsClass::applyPowerSave()
+{
+    if (WiFi.getMode() == WIFI_MODE_NULL) {
+        return;
+    }
+    WiFi.setSleep(_powerSave && !_adminEnabled ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM);
 }
 
 void NetworkSettingsClass::enableAdminMode()
@@ -203,6 +256,19 @@ String NetworkSettingsClass::getApName() const
     return String(ACCESS_POINT_NAME + String(Utils::getChipId()));
 }
 
+// Counts the seconds of the admin and connect timeouts
+void NetworkSettingsClass::secondTick()
+{
+    if (_adminEnabled && _adminTimeoutCounterMax > 0) {
+        _adminTimeoutCounter++;
+        if (_adminTimeoutCounter % 10 == 0) {
+            MessageOutput.printf("Admin AP remaining seconds: %" PRId32 " / %" PRId32 "\r\n", _adminTimeoutCounter, _adminTimeoutCounterMax);
+        }
+    }
+    _connectTimeoutTimer++;
+    _connectRedoTimer++;
+}
+
 void NetworkSettingsClass::loop()
 {
     if (_ethConnected) {
@@ -222,17 +288,6 @@ void NetworkSettingsClass::loop()
         applyConfig();
     }
 
-    if (millis() - _lastTimerCall > 1000) {
-        if (_adminEnabled && _adminTimeoutCounterMax > 0) {
-            _adminTimeoutCounter++;
-            if (_adminTimeoutCounter % 10 == 0) {
-                MessageOutput.printf("Admin AP remaining seconds: %" PRId32 " / %" PRId32 "\r\n", _adminTimeoutCounter, _adminTimeoutCounterMax);
-            }
-        }
-        _connectTimeoutTimer++;
-        _connectRedoTimer++;
-        _lastTimerCall = millis();
-    }
     if (_adminEnabled) {
         // Don't disable the admin mode when network is not available
         if (!isConnected()) {
@@ -283,7 +338,13 @@ void NetworkSettingsClass::applyConfig()
         return;
     }
     MessageOutput.print("Configuring WiFi STA using ");
-    if (strcmp(WiFi.SSID().c_str(), Configuration.get().WiFi.Ssid) || strcmp(WiFi.psk().c_str(), Configuration.get().WiFi.Password)) {
+
+    // A fast reconnect stores the access point in the WiFi configuration, it must
+    // not restrict the connection after a restart
+    wifi_config_t wifiConfig;
+    const bool bssidStored = esp_wifi_get_config(WIFI_IF_STA, &wifiConfig) == ESP_OK && wifiConfig.sta.bssid_set;
+
+    if (strcmp(WiFi.SSID().c_str(), Configuration.get().WiFi.Ssid) || strcmp(WiFi.psk().c_str(), Configuration.get().WiFi.Password) || bssidStored) {
         MessageOutput.print("new credentials... ");
         WiFi.begin(
             Configuration.get().WiFi.Ssid,
@@ -4,17 +4,36 @@
  */
 #include "NtpSettings.h"
 #include "Configuration.h"
+#include "FlashWear.h"
+#include "MessageOutput.h"
+#include "TaskProfiler.h"
 #include <Arduino.h>
+#include <LittleFS.h>
+#include <esp_sntp.h>
 #include <time.h>
 
+struct TimePersistFile_t {
+    uint32_t Magic;
+    uint32_t Reserved;
+    int64_t Time;
+};
+
 NtpSettingsClass::NtpSettingsClass()
+    : _loopTask(10 * TASK_SECOND, TASK_FOREVER)
 {
 }
 
-void NtpSettingsClass::init()
+void NtpSettingsClass::init(Scheduler& scheduler)
 {
+    restoreTime();
+
+    sntp_set_time_sync_notification_cb(&NtpSettingsClass::onTimeSync);
     setServer();
     setTimezone();
+
+    scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "NtpSettings.loop", std::bind(&NtpSettingsClass::loop, this));
+    _loopTask.enable();
 }
 
 void NtpSettingsClass::setServer()
@@ -24,8 +43,128 @@ void NtpSettingsClass::setServer()
 
 void NtpSettingsClass::setTimezone()
 {
+    std::lock_guard<std::mutex> lock(_localTimeMutex);
     setenv("TZ", Configuration.get().Ntp.Timezone, 1);
     tzset();
+    _localTimeSecond = 0;
+}
+
+void NtpSettingsClass::setManualTime(const time_t t)
+{
+    struct timeval now = { .tv_sec = t, .tv_usec = 0 };
+    settimeofday(&now, NULL);
+    _timeSource = TimeSource_t::Manual;
+    _persistPending = true;
+
+    std::lock_guard<std::mutex> lock(_localTimeMutex);
+    _localTimeSecond = 0;
+}
+
+TimeSource_t NtpSettingsClass::getTimeSource() const
+{
+    return _timeSource;
+}
+
+const char* NtpSettingsClass::getTimeSourceName(const TimeSource_t source)
+{
+    switch (source) {
+    case TimeSource_t::Ntp:
+        return "ntp";
+    case TimeSource_t::Manual:
+        return "manual";
+    case TimeSource_t::Rtc:
+        return "rtc";
+    case TimeSource_t::Persisted:
+        return "persisted";
+    default:
+        return "none";
+    }
+}
+
+bool NtpSettingsClass::isTimeConfident() const
+{
+    const TimeSource_t source = _timeSource;
+    return source == TimeSource_t::Ntp || source == TimeSource_t::Manual || source == TimeSource_t::Rtc;
+}
+
+bool NtpSettingsClass::isTimeSynced() const
+{
+    return _timeSource != TimeSource_t::None;
+}
+
+bool NtpSettingsClass::getLocalTime(struct tm* info)
+{
+    const time_t now = time(nullptr);
+
+    std::lock_guard<std::mutex> lock(_localTimeMutex);
+    if (now != _localTimeSecond) {
+        localtime_r(&now, &_localTime);
+        _localTimeSecond = now;
+    }
+    *info = _localTime;
+
+    return isTimeSynced();
+}
+
+void NtpSettingsClass::onTimeSync(struct timeval* tv)
+{
+    // Runs in the context of the lwip task
+    NtpSettings._timeSource = TimeSource_t::Ntp;
+    NtpSettings._persistPending = true;
+}
+
+void NtpSettingsClass::restoreTime()
+{
+    struct tm timeinfo;
+    if (::getLocalTime(&timeinfo, 0)) {
+        _timeSource = TimeSource_t::Rtc;
+        return;
+    }
+
+    File f = LittleFS.open(TIME_PERSIST_FILENAME, "r", false);
+    if (!f) {
+        return;
+    }
+
+    TimePersistFile_t file;
+    const bool ok = f.read(reinterpret_cast<uint8_t*>(&file), sizeof(file)) == sizeof(file)
+        && file.Magic == TIME_PERSIST_MAGIC;
+    f.close();
+    if (!ok) {
+        return;
+    }
+
+    // The time the DTU was switched off is unknown, the estimate is late by it
+    struct timeval now = { .tv_sec = static_cast<time_t>(file.Time + millis() / 1000), .tv_usec = 0 };
+    settimeofday(&now, NULL);
+    _timeSource = TimeSource_t::Persisted;
+    MessageOutput.println("Time restored from flash, waiting for NTP");
+}
+
+void NtpSettingsClass::persistTime()
+{
+    File f = LittleFS.open(TIME_PERSIST_FILENAME, "w");
+    if (!f) {
+        return;
+    }
+
+    TimePersistFile_t file = { TIME_PERSIST_MAGIC, 0, static_cast<int64_t>(time(nullptr)) };
+    f.write(reinterpret_cast<const uint8_t*>(&file), sizeof(file));
+    f.close();
+    FlashWear.record(FlashWriter_t::Time, sizeof(file));
+}
+
+void NtpSettingsClass::loop()
+{
+    if (_timeSource == TimeSource_t::None) {
+        return;
+    }
+
+    if (_persistPending || millis() - _lastPersist >= TIME_PERSIST_INTERVAL * 1000) {
+        _persistPending = false;
+        _lastPersist = millis();
+        persistTime();
+    }
 }
 
-NtpSettingsClass NtpSettings;
\ No newline at end of file
+NtpSettingsClass NtpSettings;
@@ -0,0 +1,259 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "PerfBenchmark.h"
+#include "CpuLoad.h"
+#include "InfluxExport.h"
+#include "MessageOutput.h"
+#include "MqttSettings.h"
+#include "TaskProfiler.h"
+#include "WebApi.h"
+#include <algorithm>
+#include <cstdarg>
+#include <cstring>
+#include <esp_heap_caps.h>
+
+#ifdef PERF_BENCHMARK
+
+PerfBenchmarkClass PerfBenchmark;
+
+PerfBenchmarkClass::PerfBenchmarkClass()
+    : _loopTask(PERF_BENCHMARK_PROBE_INTERVAL * TASK_MILLISECOND, TASK_FOREVER)
+{
+}
+
+void PerfBenchmarkClass::init(Scheduler& scheduler)
+{
+    MessageOutput.printf("Perf benchmark enabled, %d s run starts in %d s\r\n",
+        PERF_BENCHMARK_DURATION, PERF_BENCHMARK_DELAY);
+
+    scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "PerfBenchmark.loop", std::bind(&PerfBenchmarkClass::loop, this));
+    _loopTask.enable();
+}
+
+PerfBenchmarkClass::SinkBytes_t PerfBenchmarkClass::getSinkBytes()
+{
+    SinkBytes_t bytes;
+    bytes.Mqtt = MqttSettings.getPublishQueueStats().Bytes;
+    bytes.WsLive = WebApi.getWsLiveStats().SentBytes;
+    bytes.Influx = InfluxExport.getStats().BytesSent;
+    return bytes;
+}
+
+void PerfBenchmarkClass::loop()
+{
+    const uint32_t now = millis();
+
+    switch (_state) {
+    case State_t::Waiting:
+        if (now >= PERF_BENCHMARK_DELAY * 1000U) {
+            begin(now);
+        }
+        break;
+
+    case State_t::Running:
+        _loopGapMax = std::max(_loopGapMax, now - _lastProbe);
+        _lastProbe = now;
+
+        if (now - _lastSample >= PERF_BENCHMARK_SAMPLE_INTERVAL) {
+            _lastSample = now;
+            sample();
+        }
+        if (PERF_BENCHMARK_LIMIT_RATE > 0 && now - _lastLimit >= 1000U / PERF_BENCHMARK_LIMIT_RATE) {
+            _lastLimit = now;
+            postLimit();
+        }
+        if (now - _runStart >= PERF_BENCHMARK_DURATION * 1000U) {
+            finish();
+        }
+        break;
+
+    case State_t::Reporting:
+        if (now - _lastReport < PERF_BENCHMARK_REPORT_INTERVAL) {
+            break;
+        }
+        _lastReport = now;
+        MessageOutput.printf("PERF %s\r\n", _report[_reportPos].c_str());
+        if (++_reportPos >= _report.size()) {
+            _report.clear();
+            _report.shrink_to_fit();
+            _state = State_t::Done;
+            _loopTask.disable();
+        }
+        break;
+
+    case State_t::Done:
+        break;
+    }
+}
+
+void PerfBenchmarkClass::begin(const uint32_t now)
+{
+    MessageOutput.println("Perf benchmark: run started");
+
+    _latencyStart = LoopMonitor.getLatency();
+    _commandsStart.clear();
+    for (const auto& r : Hoymiles.getRadios()) {
+        if (!r.radio->isInitialized()) {
+            continue;
+        }
+        for (const auto& stats : r.radio->getCommandRadioStats()) {
+            _commandsStart.push_back({ r.name, stats });
+        }
+    }
+
+    auto inv = Hoymiles.getInverterByPos(0);
+    _limitSerial = inv != nullptr ? inv->serial() : 0;
+    if (inv != nullptr) {
+        _limitStart = inv->getLimitCommandStats();
+    }
+    _bytesStart = getSinkBytes();
+
+    _runStart = now;
+    _lastProbe = now;
+    _lastSample = now;
+    _lastLimit = now;
+    _state = State_t::Running;
+}
+
+void PerfBenchmarkClass::sample()
+{
+    _freeHeapMin = std::min(_freeHeapMin, ESP.getFreeHeap());
+    _largestBlockMin = std::min<uint32_t>(_largestBlockMin, heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+
+    const CpuLoadStats_t cpu = CpuLoad.getStats();
+    for (size_t i = 0; i < cpu.CoreLoad.size(); i++) {
+        _coreLoadSum[i] += cpu.CoreLoad[i];
+    }
+    _cpuSamples++;
+
+    for (const auto& task : cpu.Tasks) {
+        auto it = std::find_if(_taskLoads.begin(), _taskLoads.end(),
+            [&task](const TaskLoad_t& t) { return strcmp(t.Name, task.Name) == 0; });
+        if (it == _taskLoads.end()) {
+            TaskLoad_t t = {};
+            strlcpy(t.Name, task.Name, sizeof(t.Name));
+            t.Core = task.Core;
+            _taskLoads.push_back(t);
+            it = _taskLoads.end() - 1;
+        }
+        it->LoadSum += task.Load;
+        it->Samples++;
+    }
+}
+
+void PerfBenchmarkClass::postLimit()
+{
+    auto inv = Hoymiles.getInverterBySerial(_limitSerial);
+    if (inv == nullptr) {
+        return;
+    }
+
+    // Alternates, so the hysteresis does not swallow the requests
+    _limitHigh = !_limitHigh;
+    inv->sendActivePowerControlRequest(_limitHigh ? 100 : 50, PowerLimitControlType::RelativNonPersistent);
+}
+
+void PerfBenchmarkClass::addLine(const char* format, ...)
+{
+    char buffer[160];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    _report.emplace_back(buffer);
+}
+
+template <size_t N>
+void PerfBenchmarkClass::addQuantiles(const char* metric, const char* labels, const Histogram<N>& end, const Histogram<N>& start)
+{
+    const uint32_t count = end.getCount() - start.getCount();
+    const char* separator = labels[0] != '\0' ? "," : "";
+
+    addLine("%s_count{%s} %" PRIu32, metric, labels, count);
+    if (count == 0) {
+        return;
+    }
+    addLine("%s_mean{%s} %" PRIu32, metric, labels, static_cast<uint32_t>((end.getSum() - start.getSum()) / count));
+
+    // Upper bound of the bucket which contains the quantile
+    for (const float q : { 0.5f, 0.95f, 0.99f }) {
+        size_t i = 0;
+        while (i < N && end.getCumulativeCount(i) - start.getCumulativeCount(i) < q * count) {
+            i++;
+        }
+        if (i < N) {
+            addLine("%s{%s%squantile=\"%.2f\"} %" PRIu32, metric, labels, separator, q, end.getBound(i));
+        } else {
+            addLine("%s{%s%squantile=\"%.2f\"} +Inf", metric, labels, separator, q);
+        }
+    }
+}
+
+void PerfBenchmarkClass::finish()
+{
+    MessageOutput.println("Perf benchmark: run finished");
+
+    addLine("opendtu_perf_info{build=\"%s\",env=\"%s\"} 1", __COMPILED_GIT_HASH__, PIOENV);
+    addLine("opendtu_perf_duration_s %d", PERF_BENCHMARK_DURATION);
+
+    const LoopLatency_t latency = LoopMonitor.getLatency();
+    addQuantiles("opendtu_perf_poll_cycle_ms", "", latency.StatsInterval, _latencyStart.StatsInterval);
+    addQuantiles("opendtu_perf_ws_frame_lag_ms", "", latency.WsFrameLag, _latencyStart.WsFrameLag);
+
+    char labels[96];
+    for (const auto& r : Hoymiles.getRadios()) {
+        if (!r.radio->isInitialized()) {
+            continue;
+        }
+        for (const auto& stats : r.radio->getCommandRadioStats()) {
+            auto start = std::find_if(_commandsStart.begin(), _commandsStart.end(), [&](const CommandStart_t& c) {
+                return strcmp(c.Radio, r.name) == 0 && strcmp(c.Stats.CommandName, stats.CommandName) == 0;
+            });
+            const CommandRadioStats_t empty(stats.CommandName);
+            snprintf(labels, sizeof(labels), "radio=\"%s\",command=\"%s\"", r.name, stats.CommandName);
+            addQuantiles("opendtu_perf_command_round_trip_ms", labels, stats.RoundTrip,
+                start != _commandsStart.end() ? start->Stats.RoundTrip : empty.RoundTrip);
+        }
+    }
+    _commandsStart.clear();
+
+    addLine("opendtu_perf_loop_gap_max_ms %" PRIu32, _loopGapMax);
+    addLine("opendtu_perf_heap_free_min %" PRIu32, _freeHeapMin);
+    addLine("opendtu_perf_heap_min_free_since_boot %" PRIu32, ESP.getMinFreeHeap());
+    addLine("opendtu_perf_heap_largest_block_min %" PRIu32, _largestBlockMin);
+
+    if (_cpuSamples > 0) {
+        for (size_t i = 0; i < _coreLoadSum.size(); i++) {
+            addLine("opendtu_perf_core_load{core=\"%u\"} %.1f", static_cast<unsigned>(i), _coreLoadSum[i] / _cpuSamples);
+        }
+    }
+    for (const auto& task : _taskLoads) {
+        addLine("opendtu_perf_task_load{task=\"%s\",core=\"%d\"} %.1f", task.Name, task.Core, task.LoadSum / task.Samples);
+    }
+    _taskLoads.clear();
+
+    const SinkBytes_t bytes = getSinkBytes();
+    addLine("opendtu_perf_sink_bytes{sink=\"mqtt\"} %" PRIu32, bytes.Mqtt - _bytesStart.Mqtt);
+    addLine("opendtu_perf_sink_bytes{sink=\"ws_live\"} %" PRIu32, bytes.WsLive - _bytesStart.WsLive);
+    addLine("opendtu_perf_sink_bytes{sink=\"influx\"} %" PRIu32, bytes.Influx - _bytesStart.Influx);
+
+    auto inv = Hoymiles.getInverterBySerial(_limitSerial);
+    if (inv != nullptr) {
+        const LimitCommandStats_t& limit = inv->getLimitCommandStats();
+        addLine("opendtu_perf_limit_commands{result=\"requested\"} %" PRIu32, limit.Requested - _limitStart.Requested);
+        addLine("opendtu_perf_limit_commands{result=\"sent\"} %" PRIu32, limit.Sent - _limitStart.Sent);
+        addLine("opendtu_perf_limit_commands{result=\"coalesced\"} %" PRIu32, limit.Coalesced - _limitStart.Coalesced);
+        addLine("opendtu_perf_limit_commands{result=\"suppressed\"} %" PRIu32, limit.Suppressed - _limitStart.Suppressed);
+    }
+
+    addLine("opendtu_perf_done 1");
+
+    _reportPos = 0;
+    _lastReport = millis();
+    _state = State_t::Reporting;
+}
+
+#endif
@@ -3,11 +3,15 @@
  * Copyright (C) 2022 - 2025 Thomas Basler and others
  */
 #include "PinMapping.h"
+#include "FlashWear.h"
+#include "HeapTelemetry.h"
 #include "MessageOutput.h"
 #include "Utils.h"
 #include <ArduinoJson.h>
 #include <LittleFS.h>
 #include <SpiManager.h>
+#include <esp_ota_ops.h>
+#include <esp_rom_crc.h>
 #include <string.h>
 
 #ifndef DISPLAY_TYPE
@@ -150,6 +154,12 @@ PinMappingClass::PinMappingClass()
     _pinMapping.nrf24_miso = HOYMILES_PIN_MISO;
     _pinMapping.nrf24_mosi = HOYMILES_PIN_MOSI;
 
+    for (uint8_t i = 0; i < PINMAPPING_NRF24_EXTRA_COUNT; i++) {
+        _pinMapping.nrf24_extra_irq[i] = GPIO_NUM_NC;
+        _pinMapping.nrf24_extra_en[i] = GPIO_NUM_NC;
+        _pinMapping.nrf24_extra_cs[i] = GPIO_NUM_NC;
+    }
+
     _pinMapping.cmt_clk = CMT_CLK;
     _pinMapping.cmt_cs = CMT_CS;
     _pinMapping.cmt_fcs = CMT_FCS;
@@ -210,9 +220,15 @@ bool PinMappingClass::init(const String& deviceMapping)
         return false;
     }
 
+    const CacheKey_t key = getCacheKey(f, deviceMapping);
+    if (readCache(key)) {
+        return _mappingSelected;
+    }
+
+    f.seek(0);
     Utils::skipBom(f);
 
-    JsonDocument doc;
+    JsonDocument doc(HeapTelemetry.getJsonAllocator(HeapTag_t::Config));
     // Deserialize the JSON document
     DeserializationError error = deserializeJson(doc, f);
     if (error) {
@@ -232,6 +248,14 @@ bool PinMappingClass::init(const String& deviceMapping)
             _pinMapping.nrf24_miso = doc[i]["nrf24"]["miso"] | HOYMILES_PIN_MISO;
             _pinMapping.nrf24_mosi = doc[i]["nrf24"]["mosi"] | HOYMILES_PIN_MOSI;
 
+            // Additional modules are named nrf24_1, nrf24_2, ...
+            for (uint8_t n = 0; n < PINMAPPING_NRF24_EXTRA_COUNT; n++) {
+                const String key = "nrf24_" + String(n + 1);
+                _pinMapping.nrf24_extra_irq[n] = doc[i][key]["irq"] | GPIO_NUM_NC;
+                _pinMapping.nrf24_extra_en[n] = doc[i][key]["en"] | GPIO_NUM_NC;
+                _pinMapping.nrf24_extra_cs[n] = doc[i][key]["cs"] | GPIO_NUM_NC;
+            }
+
             _pinMapping.cmt_clk = doc[i]["cmt"]["clk"] | CMT_CLK;
             _pinMapping.cmt_cs = doc[i]["cmt"]["cs"] | CMT_CS;
             _pinMapping.cmt_fcs = doc[i]["cmt"]["fcs"] | CMT_FCS;
@@ -268,12 +292,78 @@ bool PinMappingClass::init(const String& deviceMapping)
 
             _pinMapping.led[0] = doc[i]["led"]["led0"] | LED0;
             _pinMapping.led[1] = doc[i]["led"]["led1"] | LED1;
-
-            return true;
+            break;
         }
     }
 
-    return false;
+    // A missing mapping is cached as well, the defaults are used in that case
+    writeCache(key);
+    return _mappingSelected;
+}
+
+PinMappingClass::CacheKey_t PinMappingClass::getCacheKey(File& source, const String& deviceMapping)
+{
+    CacheKey_t key = {};
+    key.SourceSize = source.size();
+
+    // Reading the file costs a fraction of parsing it and needs no heap
+    uint8_t buffer[256];
+    size_t len;
+    while ((len = source.read(buffer, sizeof(buffer))) > 0) {
+        key.SourceCrc = esp_rom_crc32_le(key.SourceCrc, buffer, len);
+    }
+
+    key.SelectionCrc = esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(deviceMapping.c_str()), deviceMapping.length());
+
+    const esp_app_desc_t* app = esp_ota_get_app_description();
+    memcpy(key.FirmwareSha, app->app_elf_sha256, sizeof(key.FirmwareSha));
+
+    return key;
+}
+
+bool PinMappingClass::readCache(const CacheKey_t& key)
+{
+    File f = LittleFS.open(PINMAPPING_CACHE_FILENAME, "r", false);
+    if (!f) {
+        return false;
+    }
+
+    CacheFile_t cache;
+
+    if (f.read(reinterpret_cast<uint8_t*>(&cache), sizeof(cache)) != sizeof(cache)
+        || cache.Magic != PINMAPPING_CACHE_MAGIC
+        || cache.Version != PINMAPPING_CACHE_VERSION
+        || cache.Size != sizeof(PinMapping_t)
+        || memcmp(&cache.Key, &key, sizeof(key)) != 0) {
+        return false;
+    }
+
+    _pinMapping = cache.PinMapping;
+    _mappingSelected = cache.MappingSelected;
+    return true;
+}
+
+void PinMappingClass::writeCache(const CacheKey_t& key)
+{
+    CacheFile_t cache = {};
+    cache.Magic = PINMAPPING_CACHE_MAGIC;
+    cache.Version = PINMAPPING_CACHE_VERSION;
+    cache.Size = sizeof(PinMapping_t);
+    cache.Key = key;
+    cache.MappingSelected = _mappingSelected;
+    cache.PinMapping = _pinMapping;
+
+    File f = LittleFS.open(PINMAPPING_CACHE_FILENAME, "w");
+    if (!f) {
+        return;
+    }
+    if (f.write(reinterpret_cast<const uint8_t*>(&cache), sizeof(cache)) != sizeof(cache)) {
+        f.close();
+        LittleFS.remove(PINMAPPING_CACHE_FILENAME);
+        return;
+    }
+    f.close();
+    FlashWear.record(FlashWriter_t::System, sizeof(cache));
 }
 
 bool PinMappingClass::isValidNrf24Config() const
@@ -286,6 +376,15 @@ bool PinMappingClass::isValidNrf24Config() const
         && _pinMapping.nrf24_mosi > GPIO_NUM_NC;
 }
 
+bool PinMappingClass::isValidNrf24ExtraConfig(const uint8_t idx) const
+{
+    return isValidNrf24Config()
+        && idx < PINMAPPING_NRF24_EXTRA_COUNT
+        && _pinMapping.nrf24_extra_irq[idx] > GPIO_NUM_NC
+        && _pinMapping.nrf24_extra_en[idx] > GPIO_NUM_NC
+        && _pinMapping.nrf24_extra_cs[idx] > GPIO_NUM_NC;
+}
+
 bool PinMappingClass::isValidCmt2300Config() const
 {
     return _pinMapping.cmt_clk > GPIO_NUM_NC
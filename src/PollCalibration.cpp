@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "PollCalibration.h"
+#include "Configuration.h"
+#include "MessageOutput.h"
+#include "TaskProfiler.h"
+#include <algorithm>
+
+PollCalibrationClass PollCalibration;
+
+PollCalibrationClass::PollCalibrationClass()
+    : _loopTask(POLLCAL_SAMPLE_INTERVAL * TASK_MILLISECOND, TASK_FOREVER)
+{
+}
+
+void PollCalibrationClass::init(Scheduler& scheduler)
+{
+    scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "PollCalibration.loop", std::bind(&PollCalibrationClass::loop, this));
+    _loopTask.enable();
+}
+
+uint32_t PollCalibrationClass::getPollInterval() const
+{
+    auto const& config = Configuration.get();
+    if (config.Dtu.PollCalibration && _applied > 0) {
+        return _applied;
+    }
+    return config.Dtu.PollInterval;
+}
+
+void PollCalibrationClass::loop()
+{
+    sample();
+
+    if (++_sampleCount < POLLCAL_EVALUATE_SAMPLES) {
+        return;
+    }
+    _sampleCount = 0;
+    evaluate();
+}
+
+void PollCalibrationClass::sample()
+{
+    for (auto& radio : _radios) {
+        radio.Inverters = 0;
+    }
+
+    std::vector<InverterSample_t> samples;
+    samples.reserve(Hoymiles.getNumInverters());
+
+    Hoymiles.forEachInverter([&](InverterAbstract& inv, const uint8_t pos) {
+        HoymilesRadio* radio = inv.getRadio();
+        if (radio == nullptr) {
+            return;
+        }
+        RadioState_t& state = _radios[Hoymiles.getRadioIndex(radio)];
+
+        // Sleeping inverters only get a probe now and then and do not count to the cycle
+        if (inv.getEnablePolling() && inv.isReachable()) {
+            state.Inverters++;
+        }
+
+        const TransactionStats_t& stats = inv.getTransactionRunner().getStats();
+        InverterSample_t current;
+        current.Serial = inv.serial();
+        current.Runs = stats.Runs;
+        current.Completed = stats.Completed;
+        current.Aborted = stats.Aborted;
+        samples.push_back(current);
+
+        auto previous = std::find_if(_samples.begin(), _samples.end(),
+            [&](const InverterSample_t& s) { return s.Serial == current.Serial; });
+        if (previous == _samples.end() || current.Runs == previous->Runs) {
+            return;
+        }
+
+        // Only the duration of the last poll is known, it stands for all polls since the last sample
+        const uint32_t polls = current.Runs - previous->Runs;
+        const uint32_t finished = (current.Completed - previous->Completed) + (current.Aborted - previous->Aborted);
+        const float weight = std::min(1.0f, polls / 8.0f);
+
+        state.Duration = state.Polls == 0 ? stats.LastDuration : state.Duration + (stats.LastDuration - state.Duration) * weight;
+        if (finished > 0) {
+            const float successRate = static_cast<float>(current.Completed - previous->Completed) / finished;
+            state.SuccessRate += (successRate - state.SuccessRate) * weight;
+        }
+        state.Polls += polls;
+    });
+
+    _samples = std::move(samples);
+}
+
+void PollCalibrationClass::evaluate()
+{
+    const auto radios = Hoymiles.getRadios();
+    const uint32_t current = Hoymiles.PollInterval();
+    uint32_t required = 0;
+
+    for (size_t i = 0; i < radios.size() && i < _radios.size(); i++) {
+        RadioState_t& state = _radios[i];
+        state.QueueSize = radios[i].radio != nullptr && radios[i].radio->isInitialized() ? radios[i].radio->getQueueSize() : 0;
+
+        if (state.Inverters == 0 || state.Polls < POLLCAL_MIN_POLLS) {
+            state.MinInterval = 0;
+            continue;
+        }
+
+        // A new poll of the radio is only useful once the previous one is answered
+        state.MinInterval = static_cast<uint32_t>(state.Duration);
+
+        // Failed polls are retransmitted in bursts, their share is added to the headroom
+        const float factor = (100 + POLLCAL_HEADROOM) / 100.0f + (1.0f - state.SuccessRate);
+        uint32_t interval = static_cast<uint32_t>(state.MinInterval * factor);
+
+        // More than one waiting command per inverter: the radio does not keep up with the current interval
+        if (state.QueueSize > state.Inverters) {
+            interval = std::max(interval, (current + 1) * 1000);
+        }
+        required = std::max(required, interval);
+    }
+
+    if (required == 0) {
+        _interval = 0;
+        return;
+    }
+    _interval = std::clamp<uint32_t>((required + 999) / 1000, POLLCAL_MIN_INTERVAL, POLLCAL_MAX_INTERVAL);
+
+    if (!Configuration.get().Dtu.PollCalibration) {
+        _applied = 0;
+        return;
+    }
+
+    // A longer interval is needed at once, a shorter one is approached step by step
+    uint32_t target = _interval;
+    if (_applied > 0 && target < _applied) {
+        target = _applied - 1;
+    }
+    if (target == _applied) {
+        return;
+    }
+
+    MessageOutput.printf("Poll calibration: interval %" PRIu32 " s (was %" PRIu32 " s)\r\n", target, current);
+    _applied = target;
+    _changes++;
+    Hoymiles.setPollInterval(_applied);
+}
+
+PollCalibrationStats_t PollCalibrationClass::getStats() const
+{
+    PollCalibrationStats_t stats;
+    stats.Enabled = Configuration.get().Dtu.PollCalibration;
+    stats.Interval = _interval;
+    stats.Applied = Hoymiles.PollInterval();
+    stats.Changes = _changes;
+
+    const auto radios = Hoymiles.getRadios();
+    for (size_t i = 0; i < radios.size() && i < _radios.size(); i++) {
+        const RadioState_t& state = _radios[i];
+        PollCalibrationRadio_t radio;
+        radio.Name = radios[i].name;
+        radio.Inverters = state.Inverters;
+        radio.Polls = state.Polls;
+        radio.Duration = static_cast<uint32_t>(state.Duration);
+        radio.SuccessRate = state.SuccessRate;
+        radio.QueueSize = state.QueueSize;
+        radio.MinInterval = state.MinInterval;
+        radio.CycleTime = stats.Applied * 1000 * state.Inverters;
+        stats.Radios.push_back(radio);
+    }
+    return stats;
+}
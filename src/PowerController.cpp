@@ -0,0 +1,281 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "PowerController.h"
+#include "MessageOutput.h"
+#include "MqttSettings.h"
+#include "TaskProfiler.h"
+#include <Hoymiles.h>
+#include <cmath>
+
+PowerControllerClass PowerController;
+
+PowerControllerClass::PowerControllerClass()
+    : _loopTask(POWERCTRL_LOOP_INTERVAL * TASK_MILLISECOND, TASK_FOREVER)
+{
+}
+
+void PowerControllerClass::init(Scheduler& scheduler)
+{
+    scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "PowerController.loop", std::bind(&PowerControllerClass::loop, this));
+    _loopTask.enable();
+
+    subscribeTopics();
+}
+
+void PowerControllerClass::setGridPower(const float power)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _gridPower = power;
+    _gridPowerTime = millis();
+    _gridPowerPending = true;
+}
+
+void PowerControllerClass::subscribeTopics()
+{
+    const CONFIG_T& config = Configuration.get();
+    if (!config.PowerControl.Enabled || config.PowerControl.MeterTopic[0] == '\0') {
+        return;
+    }
+
+    _subscribedTopic = config.PowerControl.MeterTopic;
+    MqttSettings.subscribe(_subscribedTopic, 0,
+        std::bind(&PowerControllerClass::onMqttMessage, this,
+            std::placeholders::_1, std::placeholders::_2,
+            std::placeholders::_3, std::placeholders::_4,
+            std::placeholders::_5, std::placeholders::_6));
+}
+
+void PowerControllerClass::unsubscribeTopics()
+{
+    if (_subscribedTopic.isEmpty()) {
+        return;
+    }
+
+    MqttSettings.unsubscribe(_subscribedTopic);
+    _subscribedTopic.clear();
+}
+
+void PowerControllerClass::onMqttMessage(const espMqttClientTypes::MessageProperties& properties, const char* topic, const uint8_t* payload, const size_t len, const size_t index, const size_t total)
+{
+    // A meter value is short, fragmented or retained messages are no current readings
+    if (index != 0 || len != total || properties.retain) {
+        return;
+    }
+
+    char value[32];
+    if (len == 0 || len >= sizeof(value)) {
+        return;
+    }
+    memcpy(value, payload, len);
+    value[len] = '\0';
+
+    char* end;
+    const float power = strtof(value, &end);
+    if (end == value || !std::isfinite(power)) {
+        MessageOutput.printf("Power control: cannot parse payload of topic '%s' as float: %s\r\n", topic, value);
+        return;
+    }
+
+    setGridPower(power);
+}
+
+PowerControllerStatus_t PowerControllerClass::getStatus()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    PowerControllerStatus_t status;
+    status.Enabled = Configuration.get().PowerControl.Enabled;
+    status.Active = _active;
+    status.GridPower = _gridPower;
+    status.GridPowerAge = _gridPowerTime > 0 ? millis() - _gridPowerTime : 0;
+    status.Output = _output;
+    status.InverterCount = _inverterCount;
+    status.CommandCount = _commandCount;
+    return status;
+}
+
+void PowerControllerClass::reset()
+{
+    // The inverters keep their last limit, the next start continues from their production
+    _active = false;
+    _lastStep = 0;
+    _inverterCount = 0;
+}
+
+void PowerControllerClass::loop()
+{
+    const CONFIG_T& config = Configuration.get();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (!config.PowerControl.Enabled) {
+        if (_active) {
+            reset();
+        }
+        _gridPowerPending = false;
+        return;
+    }
+
+    const uint32_t now = millis();
+
+    if (!_gridPowerPending) {
+        if (_active && now - _gridPowerTime > config.PowerControl.MeterTimeout * 1000) {
+            MessageOutput.println("Power control: no meter value received, control paused");
+            reset();
+        }
+        return;
+    }
+    _gridPowerPending = false;
+
+    const float dt = _lastStep > 0 ? min<float>((now - _lastStep) / 1000.0f, POWERCTRL_MAX_DT) : 0;
+    _lastStep = now;
+
+    control(_gridPower, dt);
+}
+
+void PowerControllerClass::control(const float gridPower, const float dt)
+{
+    const CONFIG_T& config = Configuration.get();
+
+    // The inverter is only known by its serial, the list can change once it is unlocked
+    struct Candidate_t {
+        uint64_t Serial;
+        InverterState_t* State;
+        float MaxPower;
+        float Cap;
+        float Limit;
+        bool Full;
+    };
+    std::array<Candidate_t, INV_MAX_COUNT> candidates;
+    uint8_t count = 0;
+
+    float production = 0;
+    float totalMin = 0;
+    float totalCap = 0;
+
+    Hoymiles.forEachInverter([&](InverterAbstract& inv, const uint8_t i) {
+        if (i >= _inverters.size() || !inv.getEnableCommands() || !inv.isReachable()) {
+            return;
+        }
+
+        const float maxPower = inv.DevInfo()->getMaxPower();
+        if (maxPower <= 0) {
+            // The inverter model is not known yet
+            return;
+        }
+
+        InverterState_t& state = _inverters[i];
+        if (state.Serial != inv.serial()) {
+            state = {};
+            state.Serial = inv.serial();
+            state.Limit = inv.SystemConfigPara()->getLimitPercent() * maxPower / 100.0f;
+        }
+
+        auto stats = inv.Statistics();
+        float power = 0;
+        stats->readConsistent([&] {
+            power = 0;
+            for (auto& c : stats->getChannelsByType(TYPE_AC)) {
+                power += stats->getChannelFieldValue(TYPE_AC, c, FLD_PAC);
+            }
+        });
+        production += power;
+
+        const float minPower = maxPower * config.PowerControl.MinLimit / 100.0f;
+
+        // Inverters without power distribution logic split the limit evenly across their
+        // inputs. If they already produce less than the limit, raising it does not help
+        // until the sun returns, so their share is bounded by the current production.
+        float cap = maxPower;
+        if (!inv.supportsPowerDistributionLogic() && power < state.Limit * 0.9f) {
+            cap = constrain(power + maxPower * POWERCTRL_HEADROOM / 100.0f, minPower, maxPower);
+        }
+
+        candidates[count++] = { inv.serial(), &state, maxPower, cap, minPower, false };
+        totalMin += minPower;
+        totalCap += cap;
+    });
+
+    _inverterCount = count;
+    if (count == 0) {
+        _active = false;
+        return;
+    }
+
+    // PI controller in velocity form, the output is the total limit of all inverters.
+    // Clamping the output directly prevents the integral part from winding up.
+    const float error = gridPower - config.PowerControl.TargetPower;
+    if (!_active) {
+        _output = production;
+        _lastError = error;
+        _active = true;
+    }
+    _output += config.PowerControl.Kp * (error - _lastError) + config.PowerControl.Ki * dt * error;
+    _output = constrain(_output, totalMin, totalCap);
+    _lastError = error;
+
+    // Distribute the output in proportion to the max power, inverters which reach
+    // their cap pass the remainder on to the others
+    float remaining = _output - totalMin;
+    for (uint8_t pass = 0; pass < count && remaining > 0.5f; pass++) {
+        float weight = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            if (!candidates[i].Full) {
+                weight += candidates[i].MaxPower;
+            }
+        }
+        if (weight <= 0) {
+            break;
+        }
+
+        float assigned = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            Candidate_t& c = candidates[i];
+            if (c.Full) {
+                continue;
+            }
+            const float share = remaining * c.MaxPower / weight;
+            const float room = c.Cap - c.Limit;
+            if (share >= room) {
+                c.Limit = c.Cap;
+                c.Full = true;
+                assigned += room;
+            } else {
+                c.Limit += share;
+                assigned += share;
+            }
+        }
+        remaining -= assigned;
+    }
+
+    const uint32_t now = millis();
+    for (uint8_t i = 0; i < count; i++) {
+        Candidate_t& c = candidates[i];
+        InverterState_t& state = *c.State;
+
+        if (fabsf(c.Limit - state.Limit) < POWERCTRL_HYSTERESIS
+            || now - state.LastCommand < POWERCTRL_MIN_COMMAND_INTERVAL) {
+            continue;
+        }
+
+        // Removed meanwhile by a change of the inverter list
+        auto inv = Hoymiles.getInverterBySerial(c.Serial);
+        if (inv == nullptr) {
+            continue;
+        }
+
+        // Only one limit at a time, the next one is sent once the inverter has answered
+        if (inv->SystemConfigPara()->getLastLimitCommandSuccess() == CMD_PENDING) {
+            continue;
+        }
+
+        if (inv->sendActivePowerControlRequest(c.Limit, PowerLimitControlType::AbsolutNonPersistent)) {
+            state.Limit = c.Limit;
+            state.LastCommand = now;
+            _commandCount++;
+        }
+    }
+}
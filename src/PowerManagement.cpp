@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "PowerManagement.h"
+#include "MessageOutput.h"
+#include <Arduino.h>
+#include <esp_idf_version.h>
+
+PowerManagementClass PowerManagement;
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+using PmConfig_t = esp_pm_config_t;
+#elif CONFIG_IDF_TARGET_ESP32S3
+using PmConfig_t = esp_pm_config_esp32s3_t;
+#elif CONFIG_IDF_TARGET_ESP32C3
+using PmConfig_t = esp_pm_config_esp32c3_t;
+#else
+using PmConfig_t = esp_pm_config_esp32_t;
+#endif
+
+void PowerManagementClass::init()
+{
+    _maxFreq = getCpuFrequencyMhz();
+    _minFreq = _maxFreq;
+
+#ifdef CONFIG_PM_ENABLE
+    if (POWER_MANAGEMENT_MIN_FREQ_MHZ == 0 || POWER_MANAGEMENT_MIN_FREQ_MHZ >= _maxFreq) {
+        return;
+    }
+
+    if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "web", &_webLock) != ESP_OK) {
+        _webLock = nullptr;
+    }
+
+    // Light sleep would disconnect the WiFi and delay the radio interrupts
+    PmConfig_t config = {};
+    config.max_freq_mhz = _maxFreq;
+    config.min_freq_mhz = POWER_MANAGEMENT_MIN_FREQ_MHZ;
+    config.light_sleep_enable = false;
+
+    const esp_err_t err = esp_pm_configure(&config);
+    if (err != ESP_OK) {
+        MessageOutput.printf("Power management: not available (%s)\r\n", esp_err_to_name(err));
+        return;
+    }
+
+    _enabled = true;
+    _minFreq = POWER_MANAGEMENT_MIN_FREQ_MHZ;
+    MessageOutput.printf("Power management: %" PRIu32 " to %" PRIu32 " MHz\r\n", _minFreq, _maxFreq);
+#endif
+}
+
+void PowerManagementClass::beginWebRequest()
+{
+    if (_webLock != nullptr) {
+        esp_pm_lock_acquire(_webLock);
+        _webRequests++;
+    }
+}
+
+void PowerManagementClass::endWebRequest()
+{
+    if (_webLock != nullptr) {
+        esp_pm_lock_release(_webLock);
+    }
+}
+
+PowerManagementStats_t PowerManagementClass::getStats() const
+{
+    PowerManagementStats_t stats;
+    stats.Enabled = _enabled;
+    stats.MinFreq = _minFreq;
+    stats.MaxFreq = _maxFreq;
+    stats.WebRequests = _webRequests.load();
+    return stats;
+}
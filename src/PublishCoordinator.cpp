@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "PublishCoordinator.h"
+#include <Hoymiles.h>
+#include <algorithm>
+#include <esp_random.h>
+
+PublishCoordinatorClass PublishCoordinator;
+
+bool PublishCoordinatorClass::beginSlice()
+{
+    const uint32_t now = millis();
+    // A focused inverter keeps its radio busy all the time, its data is streamed anyway
+    const uint32_t window = Hoymiles.isFocusActive() ? PUBLISH_SLICE_BUDGET : Hoymiles.getIdleWindow();
+
+    if (window < PUBLISH_SLICE_MIN_BUDGET || (_sliceStarted && now - _sliceStart < PUBLISH_SLICE_GAP)) {
+        _denied++;
+        return false;
+    }
+
+    _sliceStart = now;
+    _sliceBudget = std::min<uint32_t>(PUBLISH_SLICE_BUDGET, window);
+    _sliceStarted = true;
+    return true;
+}
+
+uint32_t PublishCoordinatorClass::getWaitDelay() const
+{
+    uint32_t wait = Hoymiles.isFocusActive() ? 0 : Hoymiles.getTimeToIdleWindow(PUBLISH_SLICE_MIN_BUDGET);
+
+    const uint32_t sinceSlice = millis() - _sliceStart;
+    if (_sliceStarted && sinceSlice < PUBLISH_SLICE_GAP) {
+        wait = std::max(wait, PUBLISH_SLICE_GAP - sinceSlice);
+    }
+    return getRetryDelay(wait);
+}
+
+bool PublishCoordinatorClass::hasBudget() const
+{
+    return millis() - _sliceStart < _sliceBudget;
+}
+
+void PublishCoordinatorClass::endSlice()
+{
+    // A single item can take longer than the budget, it is not split
+    if (millis() - _sliceStart > _sliceBudget) {
+        _overruns++;
+    }
+}
+
+uint32_t PublishCoordinatorClass::getRetryDelay(const uint32_t base)
+{
+    return base + esp_random() % (PUBLISH_RETRY_JITTER + 1);
+}
+
+uint32_t PublishCoordinatorClass::getSlot(const uint32_t interval, const uint16_t index, const uint16_t count)
+{
+    if (count == 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(interval) * index / count;
+}
+
+uint32_t PublishCoordinatorClass::getDeniedCount() const
+{
+    return _denied;
+}
+
+uint32_t PublishCoordinatorClass::getOverrunCount() const
+{
+    return _overruns;
+}
@@ -0,0 +1,139 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "QueueBenchmark.h"
+#include "MessageOutput.h"
+#include "TaskCores.h"
+#include <MpmcQueue.h>
+#include <MpscQueue.h>
+#include <SpscRingBuffer.h>
+#include <ThreadSafeQueue.h>
+#include <atomic>
+#include <esp_timer.h>
+
+#ifdef QUEUE_BENCHMARK
+
+QueueBenchmarkClass QueueBenchmark;
+
+namespace {
+
+// Gives the unbounded queue the interface of the bounded ones
+class ThreadSafeQueueAdapter {
+public:
+    bool push(const uint32_t& item)
+    {
+        _queue.push(item);
+        return true;
+    }
+
+    bool pop(uint32_t& item)
+    {
+        auto ret = _queue.pop();
+        if (!ret.has_value()) {
+            return false;
+        }
+        item = *ret;
+        return true;
+    }
+
+private:
+    ThreadSafeQueue<uint32_t> _queue;
+};
+
+template <typename Q>
+struct Run_t {
+    Q* Queue;
+    uint32_t Items; // per producer
+    std::atomic<uint32_t> Done;
+    std::atomic<uint32_t> Full; // failed push, the producer had to retry
+    uint64_t Sum;
+};
+
+template <typename Q>
+void producerProc(void* param)
+{
+    auto run = static_cast<Run_t<Q>*>(param);
+    for (uint32_t i = 1; i <= run->Items; i++) {
+        while (!run->Queue->push(i)) {
+            run->Full.fetch_add(1, std::memory_order_relaxed);
+            taskYIELD();
+        }
+    }
+    run->Done.fetch_add(1, std::memory_order_release);
+    vTaskDelete(nullptr);
+}
+
+template <typename Q>
+void runQueue(const char* name, Q& queue, const uint8_t producers)
+{
+    Run_t<Q> run = {};
+    run.Queue = &queue;
+    run.Items = QUEUE_BENCHMARK_ITEMS / producers;
+
+    const uint32_t total = run.Items * producers;
+    const uint64_t expected = static_cast<uint64_t>(run.Items) * (run.Items + 1) / 2 * producers;
+
+    const int64_t start = esp_timer_get_time();
+    for (uint8_t i = 0; i < producers; i++) {
+        xTaskCreatePinnedToCore(producerProc<Q>, "QUEUE_PROD", QUEUE_BENCHMARK_TASK_STACK_SIZE, &run,
+            uxTaskPriorityGet(nullptr), nullptr, OPENDTU_NETWORK_CORE);
+    }
+
+    uint32_t received = 0;
+    uint32_t item;
+    while (received < total) {
+        if (queue.pop(item)) {
+            run.Sum += item;
+            received++;
+        } else {
+            taskYIELD();
+        }
+    }
+    const int64_t duration = esp_timer_get_time() - start;
+
+    // The producers delete themselves after the last push
+    while (run.Done.load(std::memory_order_acquire) < producers) {
+        vTaskDelay(1);
+    }
+
+    MessageOutput.printf("%-16s %u producer(s): %" PRIu32 " items in %" PRId64 " us, %.0f ns/item, %" PRIu32 " full%s\r\n",
+        name, producers, total, duration, duration * 1000.0 / total, run.Full.load(),
+        run.Sum == expected ? "" : ", CHECKSUM ERROR");
+}
+
+} // namespace
+
+void QueueBenchmarkClass::start()
+{
+    MessageOutput.println("Queue benchmark enabled");
+    xTaskCreatePinnedToCore(taskProc, "QUEUE_BENCH", QUEUE_BENCHMARK_TASK_STACK_SIZE, this,
+        1, nullptr, OPENDTU_RADIO_CORE);
+}
+
+void QueueBenchmarkClass::taskProc(void* param)
+{
+    vTaskDelay(pdMS_TO_TICKS(QUEUE_BENCHMARK_DELAY));
+    static_cast<QueueBenchmarkClass*>(param)->run();
+    vTaskDelete(nullptr);
+}
+
+void QueueBenchmarkClass::run()
+{
+    // Static, the bounded queues hold their slots inline
+    static ThreadSafeQueueAdapter threadSafeQueue;
+    static SpscRingBuffer<uint32_t, 64> spscRing;
+    static MpscQueue<uint32_t, 64> mpscQueue;
+    static MpmcQueue<uint32_t, 64> mpmcQueue;
+
+    MessageOutput.println("Queue benchmark:");
+    runQueue("ThreadSafeQueue", threadSafeQueue, 1);
+    runQueue("ThreadSafeQueue", threadSafeQueue, 2);
+    runQueue("SpscRingBuffer", spscRing, 1);
+    runQueue("MpscQueue", mpscQueue, 1);
+    runQueue("MpscQueue", mpscQueue, 2);
+    runQueue("MpmcQueue", mpmcQueue, 1);
+    runQueue("MpmcQueue", mpmcQueue, 2);
+}
+
+#endif
@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "RawStatsExport.h"
+#include "Configuration.h"
+#include "EventBus.h"
+#include "MqttSettings.h"
+#include "NtpSettings.h"
+#include "TaskProfiler.h"
+#include <ctime>
+
+RawStatsExportClass RawStatsExport;
+
+RawStatsExportClass::RawStatsExportClass()
+    : _loopTask(RAWSTATS_CHECK_INTERVAL * TASK_MILLISECOND, TASK_FOREVER)
+{
+}
+
+void RawStatsExportClass::init(Scheduler& scheduler)
+{
+    scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "RawStatsExport.loop", std::bind(&RawStatsExportClass::loop, this));
+    _loopTask.enable();
+
+    EventBus.subscribe(Event_t::StatisticsUpdated, _loopTask);
+}
+
+RawStatsExportStats_t RawStatsExportClass::getStats() const
+{
+    RawStatsExportStats_t stats;
+    stats.FramesMqtt = _framesMqtt;
+    stats.FramesUdp = _framesUdp;
+    stats.FramesFailed = _framesFailed;
+    return stats;
+}
+
+void RawStatsExportClass::loop()
+{
+    const CONFIG_T& config = Configuration.get();
+    if (!config.RawStats.Mqtt && !config.RawStats.Udp) {
+        return;
+    }
+
+    Hoymiles.forEachInverter([this](InverterAbstract& inv, const uint8_t i) {
+        if (i >= _lastUpdate.size()) {
+            _lastUpdate.resize(i + 1, 0);
+        }
+
+        // Restored values were not received from the inverter
+        const uint32_t lastUpdate = inv.Statistics()->getLastUpdate();
+        if (lastUpdate == 0 || lastUpdate == _lastUpdate[i] || inv.Statistics()->isRestored()) {
+            return;
+        }
+        _lastUpdate[i] = lastUpdate;
+
+        sendFrame(inv);
+    });
+}
+
+void RawStatsExportClass::sendFrame(InverterAbstract& inv)
+{
+    const CONFIG_T& config = Configuration.get();
+
+    uint8_t frame[RAWSTATS_HEADER_SIZE + STATISTIC_PACKET_SIZE];
+    const uint8_t length = inv.Statistics()->getRawPayload(&frame[RAWSTATS_HEADER_SIZE]);
+
+    const uint64_t serial = inv.serial();
+    const uint32_t timestamp = NtpSettings.isTimeConfident()
+        ? std::time(nullptr) - inv.Statistics()->getDataAge() / 1000
+        : 0;
+
+    frame[0] = RAWSTATS_FORMAT_VERSION;
+    frame[1] = length;
+    for (uint8_t b = 0; b < 8; b++) {
+        frame[2 + b] = serial >> (56 - 8 * b);
+    }
+    for (uint8_t b = 0; b < 4; b++) {
+        frame[10 + b] = timestamp >> (24 - 8 * b);
+    }
+
+    const size_t size = RAWSTATS_HEADER_SIZE + length;
+
+    if (config.RawStats.Mqtt && MqttSettings.getConnected()) {
+        const String topic = MqttSettings.getPrefix() + inv.serialString() + "/raw";
+        MqttSettings.publishBinary(topic.c_str(), frame, size, false);
+        _framesMqtt++;
+    }
+
+    if (config.RawStats.Udp && config.RawStats.UdpHost[0] != '\0') {
+        if (_udp.beginPacket(config.RawStats.UdpHost, config.RawStats.UdpPort) == 1
+            && _udp.write(frame, size) == size
+            && _udp.endPacket() == 1) {
+            _framesUdp++;
+        } else {
+            _framesFailed++;
+        }
+    }
+}
@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "ResourceGovernor.h"
+#include "Configuration.h"
+#include "LoopMonitor.h"
+#include "MessageOutput.h"
+#include "TaskProfiler.h"
+#include <esp_heap_caps.h>
+
+ResourceGovernorClass ResourceGovernor;
+
+ResourceGovernorClass::ResourceGovernorClass()
+    : _loopTask(RESOURCE_GOVERNOR_INTERVAL * TASK_MILLISECOND, TASK_FOREVER)
+{
+}
+
+void ResourceGovernorClass::init(Scheduler& scheduler)
+{
+    scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "ResourceGovernor.loop", std::bind(&ResourceGovernorClass::loop, this));
+    _loopTask.enable();
+}
+
+const char* ResourceGovernorClass::getStepName(const ShedStep_t step)
+{
+    switch (step) {
+    case ShedStep_t::HassDiscovery:
+        return "hass_discovery";
+    case ShedStep_t::WsDetail:
+        return "ws_detail";
+    case ShedStep_t::Display:
+        return "display";
+    default:
+        return "mqtt_interval";
+    }
+}
+
+uint32_t ResourceGovernorClass::getMqttPublishInterval() const
+{
+    const uint32_t interval = Configuration.get().Mqtt.PublishInterval;
+    return isShedding(ShedStep_t::MqttInterval) ? interval * RESOURCE_GOVERNOR_MQTT_FACTOR : interval;
+}
+
+void ResourceGovernorClass::loop()
+{
+    _freeHeap = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    _largestFreeBlock = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+
+    const LoopMonitorStats_t loopStats = LoopMonitor.getStats();
+    const uint32_t violations = loopStats.HoymilesGapViolations + loopStats.SchedulerPassViolations;
+    _violations = violations - _lastViolations;
+    _lastViolations = violations;
+
+    const bool memoryPressure = _freeHeap < RESOURCE_GOVERNOR_MIN_FREE_HEAP
+        || _largestFreeBlock < RESOURCE_GOVERNOR_MIN_FREE_BLOCK;
+    const bool cpuPressure = _violations >= RESOURCE_GOVERNOR_MAX_VIOLATIONS;
+
+    const uint8_t level = _level.load();
+    const uint8_t maxLevel = static_cast<uint8_t>(ShedStep_t::Count);
+
+    if (memoryPressure || cpuPressure) {
+        _calmIntervals = 0;
+
+        // Close to running out all steps are shed at once, otherwise one per interval
+        const bool critical = _freeHeap < RESOURCE_GOVERNOR_MIN_FREE_HEAP / 2
+            || _largestFreeBlock < RESOURCE_GOVERNOR_MIN_FREE_BLOCK / 2;
+        if (level < maxLevel) {
+            _escalations++;
+            setLevel(critical ? maxLevel : level + 1);
+        }
+        return;
+    }
+
+    // The margin keeps the level from toggling around the thresholds
+    const bool calm = _freeHeap >= RESOURCE_GOVERNOR_MIN_FREE_HEAP * 5 / 4
+        && _largestFreeBlock >= RESOURCE_GOVERNOR_MIN_FREE_BLOCK * 5 / 4
+        && _violations == 0;
+    if (!calm || level == 0) {
+        _calmIntervals = 0;
+        return;
+    }
+
+    if (++_calmIntervals >= RESOURCE_GOVERNOR_RECOVERY_INTERVALS) {
+        _calmIntervals = 0;
+        setLevel(level - 1);
+    }
+}
+
+void ResourceGovernorClass::setLevel(const uint8_t level)
+{
+    const uint8_t previous = _level.exchange(level);
+    if (level > previous) {
+        MessageOutput.printf("Resource governor: shedding up to %s (free heap %" PRIu32 ", largest block %" PRIu32 ", %" PRIu32 " loop violations)\r\n",
+            getStepName(static_cast<ShedStep_t>(level - 1)), _freeHeap, _largestFreeBlock, _violations);
+    } else if (level < previous) {
+        MessageOutput.printf("Resource governor: restored %s\r\n", getStepName(static_cast<ShedStep_t>(previous - 1)));
+    }
+}
+
+ResourceGovernorStats_t ResourceGovernorClass::getStats() const
+{
+    ResourceGovernorStats_t stats;
+    stats.Level = _level.load();
+    stats.FreeHeap = _freeHeap;
+    stats.LargestFreeBlock = _largestFreeBlock;
+    stats.Violations = _violations;
+    stats.Escalations = _escalations;
+    return stats;
+}
@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "ResponseCache.h"
+#include <algorithm>
+
+ResponseCacheClass ResponseCache;
+
+String ResponseCacheClass::getKey(AsyncWebServerRequest* request)
+{
+    String key = request->url();
+    char separator = '?';
+    for (size_t i = 0; i < request->params(); i++) {
+        const AsyncWebParameter* param = request->getParam(i);
+        if (param->isPost() || param->isFile()) {
+            continue;
+        }
+        key += separator;
+        key += param->name();
+        key += '=';
+        key += param->value();
+        separator = '&';
+    }
+    return key;
+}
+
+bool ResponseCacheClass::send(AsyncWebServerRequest* request, const String& etag)
+{
+    const String key = getKey(request);
+
+    std::shared_ptr<const ResponseCacheEntry_t> entry;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        auto it = std::find_if(_entries.begin(), _entries.end(), [&key](const auto& e) { return e->Key == key; });
+        if (it == _entries.end() || (*it)->ETag != etag) {
+            _misses++;
+            return false;
+        }
+
+        _hits++;
+        entry = *it;
+        _entries.splice(_entries.begin(), _entries, it);
+    }
+
+    sendEntry(request, entry);
+    return true;
+}
+
+void ResponseCacheClass::put(const String& key, const String& etag, const char* contentType, std::vector<uint8_t>&& body)
+{
+    if (body.empty() || body.size() > RESPONSE_CACHE_MAX_ENTRY) {
+        return;
+    }
+
+    auto entry = std::make_shared<ResponseCacheEntry_t>();
+    entry->Key = key;
+    entry->ETag = etag;
+    entry->ContentType = contentType;
+    entry->Body = std::move(body);
+    entry->Body.shrink_to_fit();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // An older version of the same response is replaced
+    auto it = std::find_if(_entries.begin(), _entries.end(), [&entry](const auto& e) { return e->Key == entry->Key; });
+    if (it != _entries.end()) {
+        _size -= (*it)->Body.size();
+        _entries.erase(it);
+    }
+
+    while (!_entries.empty() && _size + entry->Body.size() > RESPONSE_CACHE_SIZE) {
+        _size -= _entries.back()->Body.size();
+        _entries.pop_back();
+        _evictions++;
+    }
+
+    _size += entry->Body.size();
+    _entries.push_front(std::move(entry));
+}
+
+ResponseCacheStats_t ResponseCacheClass::getStats()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    ResponseCacheStats_t stats;
+    stats.Entries = _entries.size();
+    stats.Size = _size;
+    stats.Hits = _hits;
+    stats.Misses = _misses;
+    stats.Evictions = _evictions;
+    return stats;
+}
+
+void ResponseCacheClass::sendEntry(AsyncWebServerRequest* request, const std::shared_ptr<const ResponseCacheEntry_t>& entry)
+{
+    // The response keeps the entry alive, even if it is displaced while being sent
+    AsyncWebServerResponse* response = request->beginResponse(entry->ContentType, entry->Body.size(), [entry](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+        if (index >= entry->Body.size()) {
+            return 0;
+        }
+        const size_t len = std::min(maxLen, entry->Body.size() - index);
+        memcpy(buffer, entry->Body.data() + index, len);
+        return len;
+    });
+
+    response->addHeader("Vary", "Accept");
+    response->addHeader("ETag", entry->ETag);
+    request->send(response);
+}
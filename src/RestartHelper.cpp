@@ -3,20 +3,29 @@
  * Copyright (C) 2024 Thomas Basler and others
  */
 #include "RestartHelper.h"
+#include "Configuration.h"
 #include "Display_Graphic.h"
+#include "FlashWear.h"
+#include "FsWorker.h"
+#include "History.h"
 #include "Led_Single.h"
+#include "LinkHistory.h"
+#include "MqttJournal.h"
+#include "TaskProfiler.h"
+#include "Utils.h"
 #include <Esp.h>
 
 RestartHelperClass RestartHelper;
 
 RestartHelperClass::RestartHelperClass()
-    : _rebootTask(1 * TASK_SECOND, TASK_FOREVER, std::bind(&RestartHelperClass::loop, this))
+    : _rebootTask(1 * TASK_SECOND, TASK_FOREVER)
 {
 }
 
 void RestartHelperClass::init(Scheduler& scheduler)
 {
     scheduler.addTask(_rebootTask);
+    TaskProfiler.setCallback(_rebootTask, "RestartHelper.loop", std::bind(&RestartHelperClass::loop, this));
 }
 
 void RestartHelperClass::triggerRestart()
@@ -25,12 +34,33 @@ void RestartHelperClass::triggerRestart()
     _rebootTask.restart();
 }
 
+void RestartHelperClass::triggerFactoryReset()
+{
+    _factoryReset = true;
+    triggerRestart();
+}
+
 void RestartHelperClass::loop()
 {
     if (_rebootTask.isFirstIteration()) {
         LedSingle.turnAllOff();
         Display.setStatus(false);
+    } else if (_factoryReset) {
+        // Jobs already running in the worker may still write, they are finished first
+        FsWorker.discardAll();
+        FsWorker.flush();
+        Utils::removeAllFiles();
+        ESP.restart();
     } else {
+        Configuration.flushPendingWrite();
+        History.flush();
+        LinkHistory.flush();
+        MqttJournal.flush();
+        FsWorker.flush();
+
+        // Includes the writes of the flushes above
+        FlashWear.flush();
+        FsWorker.flush();
         ESP.restart();
     }
 }
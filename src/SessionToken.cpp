@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "SessionToken.h"
+#include <cinttypes>
+#include <cstring>
+#include <esp_random.h>
+#include <esp_timer.h>
+#include <mbedtls/md.h>
+
+SessionTokenClass SessionToken;
+
+static int8_t hexValue(const char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+void SessionTokenClass::reset()
+{
+    esp_fill_random(_key, sizeof(_key));
+    _valid = true;
+
+    // Tokens of the old key are rejected anyway
+    std::lock_guard<std::mutex> lock(_mutex);
+    _revoked = {};
+}
+
+uint32_t SessionTokenClass::getUptime()
+{
+    return esp_timer_get_time() / 1000000;
+}
+
+void SessionTokenClass::computeMac(const uint32_t expiry, uint8_t mac[SESSION_TOKEN_MAC_SIZE]) const
+{
+    const uint8_t data[4] = {
+        static_cast<uint8_t>(expiry >> 24),
+        static_cast<uint8_t>(expiry >> 16),
+        static_cast<uint8_t>(expiry >> 8),
+        static_cast<uint8_t>(expiry),
+    };
+
+    uint8_t hmac[32];
+    mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), _key, sizeof(_key), data, sizeof(data), hmac);
+    memcpy(mac, hmac, SESSION_TOKEN_MAC_SIZE);
+}
+
+String SessionTokenClass::create() const
+{
+    const uint32_t expiry = getUptime() + SESSION_TOKEN_LIFETIME;
+
+    uint8_t mac[SESSION_TOKEN_MAC_SIZE];
+    computeMac(expiry, mac);
+
+    char token[SESSION_TOKEN_LENGTH + 1];
+    snprintf(token, sizeof(token), "%08" PRIx32, expiry);
+    for (uint8_t i = 0; i < SESSION_TOKEN_MAC_SIZE; i++) {
+        snprintf(&token[8 + i * 2], 3, "%02x", mac[i]);
+    }
+
+    return token;
+}
+
+bool SessionTokenClass::decode(const char* token, const size_t len, uint32_t& expiry, uint8_t mac[SESSION_TOKEN_MAC_SIZE])
+{
+    if (len != SESSION_TOKEN_LENGTH) {
+        return false;
+    }
+
+    expiry = 0;
+    for (uint8_t i = 0; i < 8; i++) {
+        const int8_t v = hexValue(token[i]);
+        if (v < 0) {
+            return false;
+        }
+        expiry = (expiry << 4) | v;
+    }
+
+    for (uint8_t i = 0; i < SESSION_TOKEN_MAC_SIZE; i++) {
+        const int8_t high = hexValue(token[8 + i * 2]);
+        const int8_t low = hexValue(token[8 + i * 2 + 1]);
+        if ((high | low) < 0) {
+            return false;
+        }
+        mac[i] = static_cast<uint8_t>((high << 4) | low);
+    }
+
+    return true;
+}
+
+bool SessionTokenClass::validate(const char* token, const size_t len) const
+{
+    uint32_t expiry;
+    uint8_t tokenMac[SESSION_TOKEN_MAC_SIZE];
+    if (!_valid || !decode(token, len, expiry, tokenMac)) {
+        return false;
+    }
+
+    if (expiry < getUptime()) {
+        return false;
+    }
+
+    uint8_t mac[SESSION_TOKEN_MAC_SIZE];
+    computeMac(expiry, mac);
+
+    // Every byte is compared, so the time does not depend on the position of a difference
+    uint8_t diff = 0;
+    for (uint8_t i = 0; i < SESSION_TOKEN_MAC_SIZE; i++) {
+        diff |= mac[i] ^ tokenMac[i];
+    }
+    if (diff != 0) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const auto& revoked : _revoked) {
+        if (revoked.Expiry == expiry && memcmp(revoked.Mac, tokenMac, sizeof(tokenMac)) == 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool SessionTokenClass::findToken(AsyncWebServerRequest* request, const char*& token, size_t& len)
+{
+    const AsyncWebHeader* auth = request->getHeader("Authorization");
+    if (auth != nullptr) {
+        const char* value = auth->value().c_str();
+        if (strncmp(value, "Bearer ", 7) == 0) {
+            token = value + 7;
+            len = auth->value().length() - 7;
+            return true;
+        }
+    }
+
+    const AsyncWebHeader* cookie = request->getHeader("Cookie");
+    if (cookie == nullptr) {
+        return false;
+    }
+
+    const char* cookies = cookie->value().c_str();
+    const size_t nameLen = strlen(SESSION_TOKEN_COOKIE);
+    for (const char* pos = strstr(cookies, SESSION_TOKEN_COOKIE "="); pos != nullptr; pos = strstr(pos + 1, SESSION_TOKEN_COOKIE "=")) {
+        // Only a full cookie name matches
+        if (pos != cookies && pos[-1] != ' ' && pos[-1] != ';') {
+            continue;
+        }
+
+        token = pos + nameLen + 1;
+        const char* end = strchr(token, ';');
+        len = end != nullptr ? end - token : strlen(token);
+        return true;
+    }
+
+    return false;
+}
+
+bool SessionTokenClass::isAuthenticated(AsyncWebServerRequest* request) const
+{
+    const char* token;
+    size_t len;
+    return findToken(request, token, len) && validate(token, len);
+}
+
+void SessionTokenClass::revoke(AsyncWebServerRequest* request)
+{
+    const char* token;
+    size_t len;
+    if (!findToken(request, token, len) || !validate(token, len)) {
+        return;
+    }
+
+    Revoked_t entry;
+    decode(token, len, entry.Expiry, entry.Mac);
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const uint32_t now = getUptime();
+        for (auto& revoked : _revoked) {
+            // Expired tokens are rejected anyway, their entry is free again
+            if (revoked.Expiry == 0 || revoked.Expiry < now) {
+                revoked = entry;
+                return;
+            }
+        }
+    }
+
+    reset();
+}
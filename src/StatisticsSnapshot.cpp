@@ -0,0 +1,218 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "StatisticsSnapshot.h"
+#include "FsWorker.h"
+#include "MessageOutput.h"
+#include "NtpSettings.h"
+#include "TaskProfiler.h"
+#include "TimerService.h"
+#include <LittleFS.h>
+#include <esp_attr.h>
+#include <esp_rom_crc.h>
+
+struct StatsSnapshotRtc_t {
+    StatsSnapshotHeader_t Header;
+    StatsSnapshotEntry_t Entries[STATS_SNAPSHOT_RTC_COUNT];
+};
+
+static RTC_NOINIT_ATTR StatsSnapshotRtc_t rtcSnapshot;
+
+StatisticsSnapshotClass StatisticsSnapshot;
+
+static uint32_t entriesCrc(const StatsSnapshotEntry_t* entries, const uint16_t count)
+{
+    return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(entries), count * sizeof(StatsSnapshotEntry_t));
+}
+
+StatisticsSnapshotClass::StatisticsSnapshotClass()
+    : _loopTask(STATS_SNAPSHOT_RTC_INTERVAL * TASK_SECOND, TASK_FOREVER)
+{
+}
+
+void StatisticsSnapshotClass::init(Scheduler& scheduler)
+{
+    _flashTimer.setCallback([this]() {
+        _lastFlashWrite = millis();
+        writeFlash();
+    });
+
+    scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "StatisticsSnapshot.loop", std::bind(&StatisticsSnapshotClass::loop, this));
+    _loopTask.enable();
+}
+
+bool StatisticsSnapshotClass::readFlash(std::vector<StatsSnapshotEntry_t>& entries)
+{
+    File f = LittleFS.open(STATS_SNAPSHOT_FILENAME, "r", false);
+    if (!f) {
+        return false;
+    }
+
+    StatsSnapshotHeader_t header;
+    bool ok = f.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) == sizeof(header)
+        && header.Magic == STATS_SNAPSHOT_MAGIC
+        && header.Version == STATS_SNAPSHOT_VERSION
+        && header.Count <= INV_MAX_COUNT;
+    if (ok) {
+        entries.resize(header.Count);
+        const size_t len = header.Count * sizeof(StatsSnapshotEntry_t);
+        ok = f.read(reinterpret_cast<uint8_t*>(entries.data()), len) == len
+            && entriesCrc(entries.data(), header.Count) == header.Crc;
+    }
+    f.close();
+    return ok;
+}
+
+void StatisticsSnapshotClass::restoreEntry(InverterAbstract& inv, const StatsSnapshotEntry_t& entry, const time_t now)
+{
+    const uint32_t age = now > entry.Timestamp ? (now - entry.Timestamp) * 1000 : 0;
+    inv.Statistics()->restoreSnapshot(entry.Statistics, age);
+
+    // The DTU was off at midnight
+    struct tm then;
+    struct tm today;
+    const time_t timestamp = entry.Timestamp;
+    localtime_r(&timestamp, &then);
+    localtime_r(&now, &today);
+    if (then.tm_yday != today.tm_yday || then.tm_year != today.tm_year) {
+        inv.performDailyTask();
+    }
+}
+
+void StatisticsSnapshotClass::restore()
+{
+    const time_t now = time(nullptr);
+
+    std::vector<StatsSnapshotEntry_t> flashEntries;
+    if (!readFlash(flashEntries)) {
+        flashEntries.clear();
+    }
+
+    const bool rtcValid = rtcSnapshot.Header.Magic == STATS_SNAPSHOT_MAGIC
+        && rtcSnapshot.Header.Version == STATS_SNAPSHOT_VERSION
+        && rtcSnapshot.Header.Count <= STATS_SNAPSHOT_RTC_COUNT
+        && entriesCrc(rtcSnapshot.Entries, rtcSnapshot.Header.Count) == rtcSnapshot.Header.Crc;
+
+    // Restored entries are kept until the inverter answers
+    const uint8_t count = min<uint8_t>(Hoymiles.getNumInverters(), INV_MAX_COUNT);
+    _entries.assign(count, {});
+    _lastUpdate.assign(count, 0);
+
+    uint8_t restored = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        auto inv = Hoymiles.getInverterByPos(i);
+        _entries[i].Serial = inv->serial();
+
+        // The inverter answered while the restore waited for the time, its data is newer
+        if (inv->Statistics()->getLastUpdate() != 0) {
+            continue;
+        }
+
+        // RTC memory is written more often, use the newest snapshot of both
+        const StatsSnapshotEntry_t* best = nullptr;
+        if (rtcValid) {
+            for (uint16_t e = 0; e < rtcSnapshot.Header.Count; e++) {
+                if (rtcSnapshot.Entries[e].Serial == inv->serial()) {
+                    best = &rtcSnapshot.Entries[e];
+                    break;
+                }
+            }
+        }
+        for (auto& entry : flashEntries) {
+            if (entry.Serial == inv->serial() && (best == nullptr || entry.Timestamp > best->Timestamp)) {
+                best = &entry;
+                break;
+            }
+        }
+
+        if (best != nullptr && best->Timestamp > 0) {
+            _entries[i] = *best;
+            restoreEntry(*inv, *best, now);
+            restored++;
+        }
+    }
+
+    if (restored > 0) {
+        MessageOutput.printf("Restored statistics of %" PRIu8 " inverters\r\n", restored);
+    }
+}
+
+bool StatisticsSnapshotClass::update()
+{
+    const uint8_t count = min<uint8_t>(Hoymiles.getNumInverters(), INV_MAX_COUNT);
+    bool changed = _entries.size() != count;
+    _entries.resize(count);
+    _lastUpdate.resize(count);
+
+    const time_t now = time(nullptr);
+    for (uint8_t i = 0; i < count; i++) {
+        auto inv = Hoymiles.getInverterByPos(i);
+        auto stats = inv->Statistics();
+
+        // Restored data is already part of the snapshot
+        if (stats->getLastUpdate() == 0 || stats->isRestored()) {
+            if (_entries[i].Serial != inv->serial()) {
+                _entries[i] = {};
+                _entries[i].Serial = inv->serial();
+                changed = true;
+            }
+            continue;
+        }
+
+        if (_entries[i].Serial == inv->serial() && _lastUpdate[i] == stats->getLastUpdate()) {
+            continue;
+        }
+
+        _lastUpdate[i] = stats->getLastUpdate();
+        _entries[i].Serial = inv->serial();
+        _entries[i].Timestamp = now - stats->getDataAge() / 1000;
+        _entries[i].Statistics = stats->getSnapshot();
+        changed = true;
+    }
+    return changed;
+}
+
+void StatisticsSnapshotClass::writeRtc()
+{
+    const uint16_t count = min<size_t>(_entries.size(), STATS_SNAPSHOT_RTC_COUNT);
+    memcpy(rtcSnapshot.Entries, _entries.data(), count * sizeof(StatsSnapshotEntry_t));
+    rtcSnapshot.Header = { STATS_SNAPSHOT_MAGIC, STATS_SNAPSHOT_VERSION, count, entriesCrc(rtcSnapshot.Entries, count) };
+}
+
+void StatisticsSnapshotClass::writeFlash()
+{
+    const uint16_t count = _entries.size();
+    const StatsSnapshotHeader_t header = { STATS_SNAPSHOT_MAGIC, STATS_SNAPSHOT_VERSION, count, entriesCrc(_entries.data(), count) };
+
+    std::vector<uint8_t> data(sizeof(header) + count * sizeof(StatsSnapshotEntry_t));
+    memcpy(data.data(), &header, sizeof(header));
+    memcpy(data.data() + sizeof(header), _entries.data(), count * sizeof(StatsSnapshotEntry_t));
+    FsWorker.write(STATS_SNAPSHOT_FILENAME, std::move(data), FlashWriter_t::Snapshot);
+}
+
+void StatisticsSnapshotClass::loop()
+{
+    // An estimated time would give a wrong age and could miss a change of the day,
+    // neither the restore nor the snapshot is done before the time is confident
+    if (!NtpSettings.isTimeConfident()) {
+        return;
+    }
+
+    if (!_restoreDone) {
+        _restoreDone = true;
+        restore();
+    }
+
+    if (update()) {
+        writeRtc();
+
+        // At most one write per interval, the pending one takes the latest values
+        if (!_flashTimer.isArmed()) {
+            const uint32_t elapsed = millis() - _lastFlashWrite;
+            const uint32_t interval = STATS_SNAPSHOT_FLASH_INTERVAL * 1000;
+            TimerService.arm(_flashTimer, elapsed < interval ? interval - elapsed : 0);
+        }
+    }
+}
@@ -4,6 +4,8 @@
  */
 #include "SunPosition.h"
 #include "Configuration.h"
+#include "NtpSettings.h"
+#include "TaskProfiler.h"
 #include "Utils.h"
 #include <Arduino.h>
 
@@ -12,13 +14,14 @@
 SunPositionClass SunPosition;
 
 SunPositionClass::SunPositionClass()
-    : _loopTask(5 * TASK_SECOND, TASK_FOREVER, std::bind(&SunPositionClass::loop, this))
+    : _loopTask(5 * TASK_SECOND, TASK_FOREVER)
 {
 }
 
 void SunPositionClass::init(Scheduler& scheduler)
 {
     scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "SunPosition.loop", std::bind(&SunPositionClass::loop, this));
     _loopTask.enable();
 }
 
@@ -64,7 +67,7 @@ bool SunPositionClass::checkRecalcDayChanged() const
 void SunPositionClass::updateSunData()
 {
     struct tm timeinfo;
-    const bool gotLocalTime = getLocalTime(&timeinfo, 5);
+    const bool gotLocalTime = NtpSettings.getLocalTime(&timeinfo);
 
     _lastSunPositionCalculatedYMD = CALC_UNIQUE_ID(timeinfo);
     setDoRecalc(false);
@@ -0,0 +1,221 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "SyslogExport.h"
+#include "Configuration.h"
+#include "DnsResolver.h"
+#include "EventBus.h"
+#include "NetworkSettings.h"
+#include "NtpSettings.h"
+#include "TaskProfiler.h"
+#include <algorithm>
+#include <ctime>
+#include <sys/time.h>
+
+// "<PRI>1 YYYY-MM-DDTHH:MM:SS.mmmZ <hostname> opendtu - <subsystem> - "
+#define SYSLOG_HEADER_SIZE 128
+
+static_assert(SYSLOG_DATAGRAM_SIZE >= SYSLOG_HEADER_SIZE + MESSAGEOUTPUT_LINE_SIZE, "A datagram has to hold at least one record");
+
+SyslogExportClass SyslogExport;
+
+// RFC 5424 severity by MessageLevel_t
+static const uint8_t severities[] = { 7, 3, 4, 6, 7, 7 };
+
+SyslogExportClass::SyslogExportClass()
+    : _loopTask(TASK_SECOND, TASK_FOREVER)
+{
+}
+
+void SyslogExportClass::init(Scheduler& scheduler)
+{
+    scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "SyslogExport.loop", std::bind(&SyslogExportClass::loop, this));
+    _loopTask.enable();
+
+    EventBus.subscribe(Event_t::ConfigChanged, _loopTask);
+}
+
+SyslogExportStats_t SyslogExportClass::getStats() const
+{
+    SyslogExportStats_t stats;
+    stats.Datagrams = _datagrams;
+    stats.Records = _records;
+    stats.RecordsFailed = _recordsFailed;
+    stats.Overruns = _overruns;
+    return stats;
+}
+
+void SyslogExportClass::loop()
+{
+    const CONFIG_T& config = Configuration.get();
+    const bool enabled = config.Syslog.Enabled && config.Syslog.Host[0] != '\0';
+    const MessageLevel_t level = enabled
+        ? std::min(static_cast<MessageLevel_t>(config.Syslog.Level), MessageLevel_t::Verbose)
+        : MessageLevel_t::None;
+
+    if (static_cast<uint8_t>(level) != _level) {
+        MessageFilter_t filter;
+        filter.Levels.fill(level);
+        filter.Meta = false;
+        MessageOutput.setRemoteFilter(filter);
+        _level = static_cast<uint8_t>(level);
+    }
+
+    if (!enabled || _taskHandle != nullptr) {
+        return;
+    }
+
+    _cursor = MessageOutput.getWritePos();
+    if (xTaskCreatePinnedToCore(taskProc, "SYSLOG", SYSLOG_TASK_STACK_SIZE, this,
+            SYSLOG_TASK_PRIORITY, &_taskHandle, SYSLOG_TASK_CORE)
+        != pdPASS) {
+        _taskHandle = nullptr;
+        MessageOutput.println("Syslog: Could not create task");
+    }
+}
+
+void SyslogExportClass::taskProc(void* param)
+{
+    static_cast<SyslogExportClass*>(param)->run();
+}
+
+void SyslogExportClass::run()
+{
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(SYSLOG_FLUSH_INTERVAL));
+
+        if (_level == static_cast<uint8_t>(MessageLevel_t::None)) {
+            // Disabled, nothing of the meantime is sent after it is enabled again
+            _cursor = MessageOutput.getWritePos();
+            continue;
+        }
+
+        // Records wait in the ring until the network and the address are available
+        const CONFIG_T& config = Configuration.get();
+        IPAddress ip;
+        if (!NetworkSettings.isConnected() || !DnsResolver.resolve(config.Syslog.Host, ip)) {
+            continue;
+        }
+
+        _hostname = NetworkSettings.getHostname();
+        const SyslogFormat_t format = config.Syslog.Format == static_cast<uint8_t>(SyslogFormat_t::Lines)
+            ? SyslogFormat_t::Lines
+            : SyslogFormat_t::Rfc5424;
+        drain(format, ip, config.Syslog.Port);
+    }
+}
+
+void SyslogExportClass::drain(const SyslogFormat_t format, const IPAddress& ip, const uint16_t port)
+{
+    MessageFilter_t filter;
+    filter.Levels.fill(static_cast<MessageLevel_t>(_level.load()));
+    filter.Meta = false;
+
+    char datagram[SYSLOG_DATAGRAM_SIZE];
+    size_t len = 0;
+    uint32_t records = 0;
+
+    // Of the message which is currently built in the RFC 5424 format
+    MessageLevel_t messageLevel = MessageLevel_t::None;
+    MessageSubsystem_t messageSubsystem = MessageSubsystem_t::System;
+
+    MessageRecord_t record;
+    char data[MESSAGEOUTPUT_LINE_SIZE];
+    bool skipped;
+    for (;;) {
+        const bool found = MessageOutput.readRecord(_cursor, record, data, skipped, filter);
+        if (skipped) {
+            _overruns++;
+        }
+        if (!found) {
+            break;
+        }
+
+        // Line ends are sent as a single \n
+        size_t textLen = 0;
+        for (size_t i = 0; i < record.Len; i++) {
+            if (data[i] != '\r') {
+                data[textLen++] = data[i];
+            }
+        }
+
+        char header[SYSLOG_HEADER_SIZE];
+        size_t headerLen = 0;
+        bool otherMessage = false;
+        if (format == SyslogFormat_t::Lines) {
+            headerLen = record.Continued ? 0 : formatHeader(format, record, header, sizeof(header));
+        } else {
+            otherMessage = !record.Continued && (record.Level != messageLevel || record.Subsystem != messageSubsystem);
+        }
+
+        if (records > 0 && (otherMessage || len + headerLen + textLen > sizeof(datagram))) {
+            send(format, ip, port, datagram, len, records);
+            len = 0;
+            records = 0;
+        }
+
+        // Every datagram is one complete RFC 5424 message
+        if (format == SyslogFormat_t::Rfc5424 && records == 0) {
+            headerLen = formatHeader(format, record, header, sizeof(header));
+            messageLevel = record.Level;
+            messageSubsystem = record.Subsystem;
+        }
+
+        memcpy(&datagram[len], header, headerLen);
+        memcpy(&datagram[len + headerLen], data, textLen);
+        len += headerLen + textLen;
+        records++;
+    }
+
+    if (records > 0) {
+        send(format, ip, port, datagram, len, records);
+    }
+}
+
+size_t SyslogExportClass::formatHeader(const SyslogFormat_t format, const MessageRecord_t& record, char* buffer, const size_t maxLen) const
+{
+    int len;
+    if (format == SyslogFormat_t::Lines) {
+        len = snprintf(buffer, maxLen, "%s %" PRIu32 ".%03" PRIu32 " %c %s: ", _hostname.c_str(),
+            record.Time / 1000, record.Time % 1000,
+            toupper(MessageOutputClass::getLevelName(record.Level)[0]), MessageOutputClass::getSubsystemName(record.Subsystem));
+    } else {
+        // The time of the record, the receiver sets its own without NTP
+        char timestamp[32] = "-";
+        if (NtpSettings.isTimeConfident()) {
+            struct timeval now;
+            gettimeofday(&now, nullptr);
+            const int64_t ms = static_cast<int64_t>(now.tv_sec) * 1000 + now.tv_usec / 1000 - (millis() - record.Time);
+            const time_t seconds = ms / 1000;
+            struct tm tm;
+            gmtime_r(&seconds, &tm);
+            snprintf(timestamp, sizeof(timestamp), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ",
+                tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, static_cast<int>(ms % 1000));
+        }
+
+        const uint8_t severity = severities[std::min<size_t>(static_cast<size_t>(record.Level), sizeof(severities) - 1)];
+        len = snprintf(buffer, maxLen, "<%d>1 %s %s opendtu - %s - ", SYSLOG_FACILITY * 8 + severity,
+            timestamp, _hostname.c_str(), MessageOutputClass::getSubsystemName(record.Subsystem));
+    }
+    return len > 0 ? std::min<size_t>(len, maxLen - 1) : 0;
+}
+
+void SyslogExportClass::send(const SyslogFormat_t format, const IPAddress& ip, const uint16_t port, const char* data, size_t len, const uint32_t records)
+{
+    // The message itself has no trailing line end
+    if (format == SyslogFormat_t::Rfc5424 && len > 0 && data[len - 1] == '\n') {
+        len--;
+    }
+
+    // Failures are only counted, a message about them would be shipped again
+    if (_udp.beginPacket(ip, port) == 1
+        && _udp.write(reinterpret_cast<const uint8_t*>(data), len) == len
+        && _udp.endPacket() == 1) {
+        _datagrams++;
+        _records += records;
+    } else {
+        _recordsFailed += records;
+    }
+}
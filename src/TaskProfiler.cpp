@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "TaskProfiler.h"
+#include "LoopMonitor.h"
+#include "MessageOutput.h"
+#include <algorithm>
+
+TaskProfilerClass TaskProfiler;
+
+TaskProfilerClass::TaskProfilerClass()
+    : _loopTask(TASK_PROFILER_REPORT_INTERVAL * TASK_SECOND, TASK_FOREVER, std::bind(&TaskProfilerClass::loop, this))
+{
+}
+
+void TaskProfilerClass::init(Scheduler& scheduler)
+{
+    if (TASK_PROFILER_REPORT_INTERVAL == 0) {
+        return;
+    }
+
+    scheduler.addTask(_loopTask);
+    _loopTask.enableDelayed();
+}
+
+void TaskProfilerClass::setCallback(Task& task, const char* name, TaskCallback callback)
+{
+    TaskProfile_t* profile;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _profiles.push_back({ &task, std::move(callback), { name, 0, 0, 0, 0, 0, 0 } });
+        profile = &_profiles.back();
+    }
+
+    task.setCallback([this, profile]() { run(*profile); });
+}
+
+void TaskProfilerClass::run(TaskProfile_t& profile)
+{
+    const uint32_t start = micros();
+    profile.callback();
+    const uint32_t runTime = micros() - start;
+    LoopMonitor.taskFinished(profile.stats.Name, runTime);
+
+#ifdef _TASK_TIMECRITICAL
+    // Delay between the scheduled and the actual start of this run
+    const uint32_t lateness = std::max<long>(profile.task->getStartDelay(), 0);
+#else
+    const uint32_t lateness = 0;
+#endif
+
+    const unsigned long interval = profile.task->getInterval();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    TaskProfileStats_t& stats = profile.stats;
+    stats.RunCount++;
+    stats.RunTimeTotal += runTime;
+    stats.RunTimeMax = std::max(stats.RunTimeMax, runTime);
+    if (interval > 0 && runTime > interval * 1000) {
+        stats.Overruns++;
+    }
+    stats.LatenessTotal += lateness;
+    stats.LatenessMax = std::max(stats.LatenessMax, lateness);
+}
+
+std::vector<TaskProfileStats_t> TaskProfilerClass::getStats()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    std::vector<TaskProfileStats_t> stats;
+    stats.reserve(_profiles.size());
+    for (const auto& profile : _profiles) {
+        stats.push_back(profile.stats);
+    }
+    return stats;
+}
+
+long TaskProfilerClass::getTimeUntilNextRun(Scheduler& scheduler, const long maxTime)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    long next = maxTime;
+    for (const auto& profile : _profiles) {
+        // Returns a negative value for disabled tasks
+        const long time = scheduler.timeUntilNextIteration(*profile.task);
+        if (time >= 0 && time < next) {
+            next = time;
+            if (next == 0) {
+                break;
+            }
+        }
+    }
+    return next;
+}
+
+void TaskProfilerClass::loop()
+{
+    auto stats = getStats();
+
+    // Most expensive task first
+    std::sort(stats.begin(), stats.end(), [](const TaskProfileStats_t& a, const TaskProfileStats_t& b) {
+        return a.RunTimeTotal > b.RunTimeTotal;
+    });
+
+    MessageOutput.printf("Task profile after %" PRIu32 " s (runs, total ms, max us, max late ms, overruns):\r\n", static_cast<uint32_t>(millis() / 1000));
+    for (const auto& s : stats) {
+        MessageOutput.printf("  %-32s %10" PRIu32 " %10" PRIu64 " %8" PRIu32 " %6" PRIu32 " %6" PRIu32 "\r\n",
+            s.Name, s.RunCount, s.RunTimeTotal / 1000, s.RunTimeMax, s.LatenessMax, s.Overruns);
+    }
+}
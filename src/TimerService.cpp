@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "TimerService.h"
+#include "TaskProfiler.h"
+#include <Arduino.h>
+#include <algorithm>
+
+TimerServiceClass TimerService;
+
+TimerServiceClass::TimerServiceClass()
+    : _loopTask(TIMER_SERVICE_MAX_DELAY * TASK_MILLISECOND, TASK_FOREVER)
+    , _wheel(millis())
+{
+}
+
+void TimerServiceClass::init(Scheduler& scheduler)
+{
+    scheduler.addTask(_loopTask);
+    TaskProfiler.setCallback(_loopTask, "TimerService.loop", std::bind(&TimerServiceClass::loop, this));
+    _loopTask.enable();
+}
+
+void TimerServiceClass::arm(WheelTimer& timer, const uint32_t delay, const uint32_t period)
+{
+    // The wheel may lag behind if the loop was busy, the deadline is relative to now
+    _wheel.arm(timer, delay + (millis() - _wheel.getTime()), period);
+
+    // Recalculates the delay of the task, the new timer may be the next one
+    _loopTask.forceNextIteration();
+}
+
+size_t TimerServiceClass::getArmedCount() const
+{
+    return _wheel.getArmedCount();
+}
+
+void TimerServiceClass::loop()
+{
+    _wheel.advance(millis());
+
+    const uint32_t wakeup = std::min<uint32_t>(_wheel.getNextWakeup(), TIMER_SERVICE_MAX_DELAY);
+    _loopTask.delay(wakeup * TASK_MILLISECOND);
+}
@@ -25,7 +25,10 @@ W5500::W5500(spi_device_handle_t spi, gpio_num_t pin_int)
     w5500_config.int_gpio_num = pin_int;
 
     eth_mac_config_t mac_config = ETH_MAC_DEFAULT_CONFIG();
-    mac_config.rx_task_stack_size = 4096;
+    mac_config.rx_task_stack_size = W5500_RX_TASK_STACK_SIZE;
+#ifdef W5500_RX_TASK_PRIORITY
+    mac_config.rx_task_prio = W5500_RX_TASK_PRIORITY;
+#endif
     esp_eth_mac_t* mac = esp_eth_mac_new_w5500(&w5500_config, &mac_config);
 
     eth_phy_config_t phy_config = ETH_PHY_DEFAULT_CONFIG();
@@ -76,16 +79,20 @@ std::unique_ptr<W5500> W5500::setup(gpio_num_t pin_mosi, gpio_num_t pin_miso, gp
         .duty_cycle_pos = 0,
         .cs_ena_pretrans = 0, // only 0 supported
         .cs_ena_posttrans = 0, // only 0 supported
-        .clock_speed_hz = 20000000, // stable with OpenDTU Fusion shield
+        .clock_speed_hz = W5500_SPI_CLOCK_SPEED,
         .input_delay_ns = 0,
         .spics_io_num = pin_cs,
         .flags = 0,
-        .queue_size = 20,
+        .queue_size = W5500_SPI_QUEUE_SIZE,
         .pre_cb = nullptr,
         .post_cb = nullptr,
     };
 
-    spi_device_handle_t spi = SpiManagerInst.alloc_device("", bus_config, device_config);
+    // Prefer a bus of its own, every transaction on a shared bus waits for the
+    // radio transfers and remaps the pins. If no bus is left, share the one of the CMT2300A.
+    spi_device_handle_t spi = SpiManagerInst.alloc_device("w5500", bus_config, device_config);
+    if (!spi)
+        spi = SpiManagerInst.alloc_device("", bus_config, device_config);
     if (!spi)
         return nullptr;
 
@@ -3,18 +3,46 @@
  * Copyright (C) 2022-2024 Thomas Basler and others
  */
 #include "WebApi.h"
+#include "AdmissionControl.h"
 #include "Configuration.h"
+#include "JsonArena.h"
+#include "LoopMonitor.h"
 #include "MessageOutput.h"
+#include "PowerManagement.h"
+#include "ResponseCache.h"
+#include "SessionToken.h"
+#include "Utils.h"
 #include "defaults.h"
 #include <AsyncJson.h>
+#include <GzipStream.h>
+#include <algorithm>
+#include <esp_rom_crc.h>
+#include <memory>
 
 WebApiClass::WebApiClass()
     : _server(HTTP_PORT)
+    , _admission([](AsyncWebServerRequest* request, ArMiddlewareNext next) {
+        const uint32_t retryAfter = AdmissionControl.check(request);
+        if (retryAfter > 0) {
+            sendTooManyRequests(request, retryAfter);
+            return;
+        }
+        // The handler runs at full speed, the response is sent afterwards by the tcp task
+        PowerManagement.beginWebRequest();
+        next();
+        PowerManagement.endWebRequest();
+    })
 {
 }
 
 void WebApiClass::init(Scheduler& scheduler)
 {
+    SessionToken.reset();
+
+    _server.addMiddleware(&_admission);
+
+    _webApiBulk.init(_server, scheduler);
+    _webApiCapture.init(_server, scheduler);
     _webApiDevice.init(_server, scheduler);
     _webApiDevInfo.init(_server, scheduler);
     _webApiDtu.init(_server, scheduler);
@@ -22,16 +50,22 @@ void WebApiClass::init(Scheduler& scheduler)
     _webApiFile.init(_server, scheduler);
     _webApiFirmware.init(_server, scheduler);
     _webApiGridprofile.init(_server, scheduler);
+    _webApiHistory.init(_server, scheduler);
     _webApiI18n.init(_server, scheduler);
+    _webApiInflux.init(_server, scheduler);
     _webApiInverter.init(_server, scheduler);
     _webApiLimit.init(_server, scheduler);
     _webApiMaintenance.init(_server, scheduler);
+    _webApiModbus.init(_server, scheduler);
     _webApiMqtt.init(_server, scheduler);
     _webApiNetwork.init(_server, scheduler);
     _webApiNtp.init(_server, scheduler);
     _webApiPower.init(_server, scheduler);
+    _webApiPowerControl.init(_server, scheduler);
     _webApiPrometheus.init(_server, scheduler);
+    _webApiRawStats.init(_server, scheduler);
     _webApiSecurity.init(_server, scheduler);
+    _webApiSyslog.init(_server, scheduler);
     _webApiSysstatus.init(_server, scheduler);
     _webApiWebapp.init(_server, scheduler);
     _webApiWsConsole.init(_server, scheduler);
@@ -48,11 +82,39 @@ void WebApiClass::reload()
 
 bool WebApiClass::checkCredentials(AsyncWebServerRequest* request)
 {
+    // Almost all handlers start here, the loop monitor reports them as culprit
+    LoopMonitor.beginActivity(LoopActivity_t::WebApi, request->url().c_str());
+
+    if (SessionToken.isAuthenticated(request)) {
+        return true;
+    }
+
     auto const& config = Configuration.get();
     if (request->authenticate(AUTH_USERNAME, config.Security.Password)) {
         return true;
     }
 
+    sendUnauthorized(request);
+    return false;
+}
+
+bool WebApiClass::checkPassword(AsyncWebServerRequest* request)
+{
+    LoopMonitor.beginActivity(LoopActivity_t::WebApi, request->url().c_str());
+
+    // A token must not renew itself, otherwise a stolen one would never expire
+    const AsyncWebHeader* auth = request->getHeader("Authorization");
+    if (auth != nullptr && !auth->value().startsWith("Bearer ")
+        && request->authenticate(AUTH_USERNAME, Configuration.get().Security.Password)) {
+        return true;
+    }
+
+    sendUnauthorized(request);
+    return false;
+}
+
+void WebApiClass::sendUnauthorized(AsyncWebServerRequest* request)
+{
     AsyncWebServerResponse* r = request->beginResponse(401);
 
     // WebAPI should set the X-Requested-With to prevent browser internal auth dialogs
@@ -60,36 +122,68 @@ bool WebApiClass::checkCredentials(AsyncWebServerRequest* request)
         r->addHeader("WWW-Authenticate", "Basic realm=\"Login Required\"");
     }
     request->send(r);
-
-    return false;
 }
 
 bool WebApiClass::checkCredentialsReadonly(AsyncWebServerRequest* request)
 {
     auto const& config = Configuration.get();
     if (config.Security.AllowReadonly) {
+        LoopMonitor.beginActivity(LoopActivity_t::WebApi, request->url().c_str());
         return true;
     } else {
         return checkCredentials(request);
     }
 }
 
-void WebApiClass::sendTooManyRequests(AsyncWebServerRequest* request)
+void WebApiClass::sendTooManyRequests(AsyncWebServerRequest* request, const uint32_t retryAfter)
 {
     auto response = request->beginResponse(429, "text/plain", "Too Many Requests");
-    response->addHeader("Retry-After", "60");
+    response->addHeader("Retry-After", String(retryAfter));
     request->send(response);
 }
 
 void WebApiClass::writeConfig(JsonVariant& retMsg, const WebApiError code, const String& message)
 {
-    if (!Configuration.write()) {
+    // The file itself is written by the configuration task to keep the request handler short
+    Configuration.requestWrite();
+
+    // This write is still pending, but if the last one failed it will most likely fail as well
+    if (Configuration.hasWriteFailed()) {
+        retMsg["type"] = "warning";
         retMsg["message"] = "Write failed!";
         retMsg["code"] = WebApiError::GenericWriteFailed;
-    } else {
-        retMsg["type"] = "success";
-        retMsg["message"] = message;
-        retMsg["code"] = code;
+        return;
+    }
+
+    retMsg["type"] = "success";
+    retMsg["message"] = message;
+    retMsg["code"] = code;
+    retMsg["pending"] = true;
+}
+
+static bool isJsonBody(AsyncWebServerRequest* request)
+{
+    return request->contentType().startsWith("application/json");
+}
+
+void WebApiClass::onRequestBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total)
+{
+    if (!isJsonBody(request)) {
+        return;
+    }
+
+    // One buffer of the announced size, freed with the request
+    if (index == 0 && request->_tempObject == nullptr && total <= WEBAPI_MAX_BODY_SIZE) {
+        request->_tempObject = malloc(total + 1);
+    }
+
+    char* body = static_cast<char*>(request->_tempObject);
+    if (body == nullptr || index + len > total) {
+        return;
+    }
+    memcpy(body + index, data, len);
+    if (index + len == total) {
+        body[total] = '\0';
     }
 }
 
@@ -98,15 +192,38 @@ bool WebApiClass::parseRequestData(AsyncWebServerRequest* request, AsyncJsonResp
     auto& retMsg = response->getRoot();
     retMsg["type"] = "warning";
 
-    if (!request->hasParam("data", true)) {
-        retMsg["message"] = "No values found!";
-        retMsg["code"] = WebApiError::GenericNoValueFound;
-        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
-        return false;
+    DeserializationError error;
+    if (isJsonBody(request)) {
+        if (request->contentLength() > WEBAPI_MAX_BODY_SIZE) {
+            retMsg["message"] = "Data too large!";
+            retMsg["code"] = WebApiError::GenericDataTooLarge;
+            WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+            return false;
+        }
+
+        char* body = static_cast<char*>(request->_tempObject);
+        if (body == nullptr || request->contentLength() == 0) {
+            retMsg["message"] = "No values found!";
+            retMsg["code"] = WebApiError::GenericNoValueFound;
+            WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+            return false;
+        }
+
+        // Parsed from the collected body without copying it into a String first. ArduinoJson 7
+        // has no zero-copy mode, the strings are still copied into the document.
+        error = deserializeJson(json_document, body, request->contentLength());
+    } else {
+        if (!request->hasParam("data", true)) {
+            retMsg["message"] = "No values found!";
+            retMsg["code"] = WebApiError::GenericNoValueFound;
+            WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+            return false;
+        }
+
+        // Form encoded, kept for existing scripts
+        error = deserializeJson(json_document, request->getParam("data", true)->value());
     }
 
-    const String json = request->getParam("data", true)->value();
-    const DeserializationError error = deserializeJson(json_document, json);
     if (error) {
         retMsg["message"] = "Failed to parse data!";
         retMsg["code"] = WebApiError::GenericParseError;
@@ -127,7 +244,249 @@ uint64_t WebApiClass::parseSerialFromRequest(AsyncWebServerRequest* request, Str
     return 0;
 }
 
-bool WebApiClass::sendJsonResponse(AsyncWebServerRequest* request, AsyncJsonResponse* response, const char* function, const uint16_t line)
+// Compares a field name with a requested one, ignoring case and spaces ("Power DC" == "powerdc")
+static bool fieldNameEquals(const char* name, const char* requested, const size_t len)
+{
+    size_t pos = 0;
+    for (; *name != '\0'; name++) {
+        if (*name == ' ') {
+            continue;
+        }
+        if (pos >= len || tolower(*name) != tolower(requested[pos])) {
+            return false;
+        }
+        pos++;
+    }
+    return pos == len;
+}
+
+WebApiFieldFilter_t WebApiClass::parseFieldFilter(AsyncWebServerRequest* request)
+{
+    WebApiFieldFilter_t filter;
+    filter.FieldMask.fill(UINT32_MAX);
+
+    if (request->hasParam("inv")) {
+        const String value = request->getParam("inv")->value();
+        for (int start = 0; start < static_cast<int>(value.length());) {
+            int end = value.indexOf(',', start);
+            if (end < 0) {
+                end = value.length();
+            }
+            const uint64_t serial = strtoull(value.substring(start, end).c_str(), nullptr, 16);
+            if (serial > 0 && filter.Serials.size() < INV_MAX_COUNT) {
+                filter.Serials.push_back(serial);
+            }
+            start = end + 1;
+        }
+    }
+
+    if (request->hasParam("channels")) {
+        const String value = request->getParam("channels")->value();
+        for (uint8_t t = 0; t < TYPE_CNT; t++) {
+            bool requested = false;
+            for (int start = 0; start < static_cast<int>(value.length()) && !requested;) {
+                int end = value.indexOf(',', start);
+                if (end < 0) {
+                    end = value.length();
+                }
+                requested = fieldNameEquals(channelsTypes[t], value.c_str() + start, end - start);
+                start = end + 1;
+            }
+            if (!requested) {
+                filter.FieldMask[t] = 0;
+            }
+        }
+        filter.Projected = true;
+    }
+
+    if (request->hasParam("fields")) {
+        const String value = request->getParam("fields")->value();
+        std::array<uint32_t, TYPE_CNT> mask = {};
+        for (int start = 0; start < static_cast<int>(value.length());) {
+            int end = value.indexOf(',', start);
+            if (end < 0) {
+                end = value.length();
+            }
+            for (uint8_t t = 0; t < TYPE_CNT; t++) {
+                for (uint8_t f = 0; f < FLD_CNT; f++) {
+                    // The total DC power of an inverter is published as "Power DC"
+                    const char* name = (t == TYPE_INV && f == FLD_PDC) ? "PowerDC" : fields[f];
+                    if (fieldNameEquals(name, value.c_str() + start, end - start)) {
+                        mask[t] |= 1UL << f;
+                    }
+                }
+            }
+            start = end + 1;
+        }
+        for (uint8_t t = 0; t < TYPE_CNT; t++) {
+            filter.FieldMask[t] &= mask[t];
+        }
+        filter.Projected = true;
+    }
+
+    return filter;
+}
+
+bool WebApiFieldFilter_t::includesInverter(const uint64_t serial) const
+{
+    return Serials.empty() || std::find(Serials.begin(), Serials.end(), serial) != Serials.end();
+}
+
+// A MessagePack response is requested by "Accept: application/msgpack" or "?format=msgpack"
+bool WebApiClass::requestsMsgPack(AsyncWebServerRequest* request)
+{
+#ifdef ASYNC_MSG_PACK_SUPPORT
+    return (request->hasParam("format") && request->getParam("format")->value() == "msgpack")
+        || (request->hasHeader("Accept") && request->header("Accept").indexOf("application/msgpack") >= 0);
+#else
+    return false;
+#endif
+}
+
+bool WebApiClass::acceptsGzip(AsyncWebServerRequest* request)
+{
+#if WEBAPI_GZIP_RESPONSES
+    return request->hasHeader("Accept-Encoding") && request->header("Accept-Encoding").indexOf("gzip") >= 0;
+#else
+    return false;
+#endif
+}
+
+namespace {
+// Compresses everything which is printed to it, only the compressed data is buffered
+class GzipResponseStream : public AsyncResponseStream {
+public:
+    GzipResponseStream(const char* contentType, const size_t bufferSize)
+        : AsyncResponseStream(contentType, bufferSize)
+    {
+        addHeader("Content-Encoding", "gzip");
+        addHeader("Vary", "Accept-Encoding");
+    }
+
+    size_t write(const uint8_t* data, size_t len) override
+    {
+        _gzip.write(data, len);
+        moveOutput();
+        return len;
+    }
+
+    size_t write(uint8_t data) override
+    {
+        return write(&data, 1);
+    }
+
+    void _respond(AsyncWebServerRequest* request) override
+    {
+        _gzip.finish();
+        moveOutput();
+        AsyncResponseStream::_respond(request);
+    }
+
+private:
+    void moveOutput()
+    {
+        uint8_t buffer[128];
+        while (_gzip.available() > 0) {
+            const size_t len = _gzip.read(buffer, sizeof(buffer));
+            AsyncResponseStream::write(buffer, len);
+        }
+    }
+
+    GzipStream _gzip;
+};
+}
+
+AsyncResponseStream* WebApiClass::beginResponseStream(AsyncWebServerRequest* request, const char* contentType, const size_t bufferSize)
+{
+    if (acceptsGzip(request)) {
+        // Text of repeating lines shrinks to a fraction
+        return new GzipResponseStream(contentType, bufferSize / 4);
+    }
+    return request->beginResponseStream(contentType, bufferSize);
+}
+
+AsyncJsonResponse* WebApiClass::createJsonResponse(AsyncWebServerRequest* request)
+{
+#ifdef ASYNC_MSG_PACK_SUPPORT
+    if (requestsMsgPack(request)) {
+        AsyncJsonResponse* response = new AsyncMessagePackResponse();
+        response->setContentType("application/msgpack");
+        response->addHeader("Vary", "Accept");
+        return response;
+    }
+#endif
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    response->addHeader("Vary", "Accept");
+    return response;
+}
+
+String WebApiClass::generateETag(AsyncWebServerRequest* request, const std::vector<uint32_t>& state)
+{
+    // The parser generations start from zero after a reboot
+    static const uint32_t bootId = esp_random();
+
+    const uint32_t header[] = { bootId, Configuration.getChangeCount(), requestsMsgPack(request) };
+    uint32_t crc = esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(header), sizeof(header));
+    crc = esp_rom_crc32_le(crc, reinterpret_cast<const uint8_t*>(state.data()), state.size() * sizeof(uint32_t));
+
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "W/\"%08" PRIx32 "\"", crc);
+    return buffer;
+}
+
+bool WebApiClass::sendNotModified(AsyncWebServerRequest* request, const String& etag)
+{
+    if (!request->hasHeader("If-None-Match") || request->header("If-None-Match") != etag) {
+        return false;
+    }
+
+    AsyncWebServerResponse* response = request->beginResponse(304);
+    response->addHeader("ETag", etag);
+    request->send(response);
+    LoopMonitor.endActivity(LoopActivity_t::WebApi);
+    return true;
+}
+
+bool WebApiClass::sendCached(AsyncWebServerRequest* request, const String& etag)
+{
+    if (sendNotModified(request, etag)) {
+        return true;
+    }
+    if (ResponseCache.send(request, etag)) {
+        LoopMonitor.endActivity(LoopActivity_t::WebApi);
+        return true;
+    }
+    return false;
+}
+
+void WebApiClass::cacheJsonResponse(AsyncWebServerRequest* request, AsyncJsonResponse* response, const String& etag)
+{
+    auto& root = response->getRoot();
+    const bool msgPack = requestsMsgPack(request);
+
+#ifdef ASYNC_MSG_PACK_SUPPORT
+    const size_t len = msgPack ? measureMsgPack(root) : measureJson(root);
+#else
+    const size_t len = measureJson(root);
+#endif
+    if (len > RESPONSE_CACHE_MAX_ENTRY) {
+        return;
+    }
+
+    std::vector<uint8_t> body(len);
+#ifdef ASYNC_MSG_PACK_SUPPORT
+    if (msgPack) {
+        serializeMsgPack(root, body.data(), body.size());
+        ResponseCache.put(ResponseCache.getKey(request), etag, "application/msgpack", std::move(body));
+        return;
+    }
+#endif
+    serializeJson(root, reinterpret_cast<char*>(body.data()), body.size());
+    ResponseCache.put(ResponseCache.getKey(request), etag, "application/json", std::move(body));
+}
+
+bool WebApiClass::sendJsonResponse(AsyncWebServerRequest* request, AsyncJsonResponse* response, const char* function, const uint16_t line, const String& etag, const bool cache)
 {
     bool ret_val = true;
     if (response->overflowed()) {
@@ -142,9 +501,215 @@ bool WebApiClass::sendJsonResponse(AsyncWebServerRequest* request, AsyncJsonResp
         ret_val = false;
     }
 
+    if (ret_val && !etag.isEmpty()) {
+        response->addHeader("ETag", etag);
+        if (cache) {
+            cacheJsonResponse(request, response, etag);
+        }
+    }
+
     response->setLength();
     request->send(response);
+    LoopMonitor.endActivity(LoopActivity_t::WebApi);
     return ret_val;
 }
 
 WebApiClass WebApi;
+
+namespace {
+// State of a chunked JSON response which is generated one array element at a time
+struct JsonStreamState_t {
+    enum class Stage {
+        Head,
+        Elements,
+        Members,
+        Done,
+    };
+
+    String ArrayName;
+    JsonStreamElementCallback ElementCb;
+    JsonStreamMembersCallback MembersCb;
+
+    Stage NextStage = Stage::Head;
+    size_t Index = 0;
+    bool FirstElement = true;
+
+    String Pending;
+    size_t PendingPos = 0;
+
+    // Copy of the whole response for the ResponseCache, dropped if it gets too large
+    bool Capture = false;
+    String CacheKey;
+    String ETag;
+    std::vector<uint8_t> Captured;
+
+    // Shared by the documents of all elements, they are built one after the other
+    JsonArena Arena;
+
+    std::unique_ptr<GzipStream> Gzip;
+
+    // Generates the next part of the document into Pending. Returns false at the end of the document.
+    bool produceNext()
+    {
+        Pending.clear();
+        PendingPos = 0;
+
+        switch (NextStage) {
+        case Stage::Head:
+            Pending = "{\"" + ArrayName + "\":[";
+            NextStage = Stage::Elements;
+            return true;
+
+        case Stage::Elements:
+            for (;;) {
+                Arena.reset();
+                JsonDocument doc(&Arena);
+                if (!ElementCb(Index++, doc)) {
+                    Pending = "]";
+                    NextStage = Stage::Members;
+                    return true;
+                }
+                if (doc.isNull() || !Utils::checkJsonAlloc(doc, __FUNCTION__, __LINE__)) {
+                    continue;
+                }
+
+                if (!FirstElement) {
+                    Pending = ",";
+                }
+                FirstElement = false;
+
+                String element;
+                serializeJson(doc, element);
+                Pending += element;
+                return true;
+            }
+
+        case Stage::Members:
+            NextStage = Stage::Done;
+            if (MembersCb != nullptr) {
+                Arena.reset();
+                JsonDocument doc(&Arena);
+                MembersCb(doc);
+
+                String members;
+                if (!doc.isNull() && Utils::checkJsonAlloc(doc, __FUNCTION__, __LINE__)) {
+                    serializeJson(doc, members);
+                }
+
+                // Strip the braces of the members object and append its content behind the array
+                if (members.length() > 2) {
+                    Pending = "," + members.substring(1, members.length() - 1);
+                }
+            }
+            Pending += "}";
+            return true;
+
+        case Stage::Done:
+        default:
+            return false;
+        }
+    }
+
+    // Copies the uncompressed document into the buffer. Returns 0 at the end.
+    size_t fill(uint8_t* buffer, size_t maxLen)
+    {
+        size_t written = 0;
+        while (written < maxLen) {
+            if (PendingPos >= Pending.length()) {
+                if (!produceNext()) {
+                    if (Capture) {
+                        ResponseCache.put(CacheKey, ETag, "application/json", std::move(Captured));
+                        Capture = false;
+                    }
+                    break;
+                }
+
+                if (Capture) {
+                    if (Captured.size() + Pending.length() > RESPONSE_CACHE_MAX_ENTRY) {
+                        Capture = false;
+                        Captured = {};
+                    } else {
+                        Captured.insert(Captured.end(), Pending.c_str(), Pending.c_str() + Pending.length());
+                    }
+                }
+                continue;
+            }
+
+            const size_t len = std::min(maxLen - written, Pending.length() - PendingPos);
+            memcpy(buffer + written, Pending.c_str() + PendingPos, len);
+            PendingPos += len;
+            written += len;
+        }
+        return written;
+    }
+
+    size_t read(uint8_t* buffer, size_t maxLen)
+    {
+        if (Gzip == nullptr) {
+            return fill(buffer, maxLen);
+        }
+
+        size_t written = 0;
+        uint8_t raw[256];
+        while (written < maxLen) {
+            if (Gzip->available() > 0) {
+                written += Gzip->read(buffer + written, maxLen - written);
+                continue;
+            }
+            if (Gzip->isFinished()) {
+                break;
+            }
+
+            const size_t len = fill(raw, sizeof(raw));
+            if (len == 0) {
+                Gzip->finish();
+            } else {
+                Gzip->write(raw, len);
+            }
+        }
+        return written;
+    }
+};
+}
+
+void WebApiClass::sendJsonArrayStream(AsyncWebServerRequest* request, const char* arrayName, const JsonStreamElementCallback& elementCb, const JsonStreamMembersCallback& membersCb, const String& etag, const bool cache)
+{
+    auto state = std::make_shared<JsonStreamState_t>();
+    state->ArrayName = arrayName;
+    state->ElementCb = elementCb;
+    state->MembersCb = membersCb;
+
+    if (cache && !etag.isEmpty()) {
+        state->Capture = true;
+        state->CacheKey = ResponseCache.getKey(request);
+        state->ETag = etag;
+    }
+
+    if (acceptsGzip(request)) {
+        state->Gzip = std::make_unique<GzipStream>();
+    }
+
+    // Only one element is kept in memory at a time, independent of the size of the whole response
+    AsyncWebServerResponse* response = request->beginChunkedResponse("application/json", [state](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+        try {
+            return state->read(buffer, maxLen);
+        } catch (const std::bad_alloc& bad_alloc) {
+            MessageOutput.printf("Streamed response temporarely out of resources. Reason: \"%s\".\r\n", bad_alloc.what());
+            state->NextStage = JsonStreamState_t::Stage::Done;
+            state->Pending.clear();
+            state->Capture = false;
+            return 0;
+        }
+    });
+
+    if (state->Gzip != nullptr) {
+        response->addHeader("Content-Encoding", "gzip");
+        response->addHeader("Vary", "Accept-Encoding");
+    }
+    response->addHeader("Vary", "Accept");
+    if (!etag.isEmpty()) {
+        response->addHeader("ETag", etag);
+    }
+    request->send(response);
+    LoopMonitor.endActivity(LoopActivity_t::WebApi);
+}
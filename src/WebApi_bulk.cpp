@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "WebApi_bulk.h"
+#include "JsonArena.h"
+#include "WebApi.h"
+#include "defaults.h"
+#include <AsyncJson.h>
+#include <vector>
+
+void WebApiBulkClass::init(AsyncWebServer& server, Scheduler& scheduler)
+{
+    using std::placeholders::_1;
+
+    server.on("/api/bulk/config", HTTP_POST, std::bind(&WebApiBulkClass::onBulkPost, this, _1), nullptr, WebApiClass::onRequestBody);
+}
+
+// Accepts {"commands": [...]} where every entry has the fields of a request to
+// /api/limit/config ("limit_value", "limit_type") or /api/power/config ("power",
+// "restart") together with the "serial". Invalid commands are rejected before any
+// command is queued. A command the inverter refuses is reported in its result.
+void WebApiBulkClass::onBulkPost(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentials(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    JsonArena arena;
+    JsonDocument root(&arena);
+    if (!WebApi.parseRequestData(request, response, root)) {
+        return;
+    }
+
+    auto& retMsg = response->getRoot();
+
+    if (!root["commands"].is<JsonArrayConst>()) {
+        retMsg["message"] = "Values are missing!";
+        retMsg["code"] = WebApiError::GenericValueMissing;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    const JsonArrayConst commands = root["commands"].as<JsonArrayConst>();
+    if (commands.size() > BULK_MAX_COMMANDS) {
+        retMsg["message"] = "Too many commands!";
+        retMsg["code"] = WebApiError::BulkTooManyCommands;
+        retMsg["param"]["max"] = BULK_MAX_COMMANDS;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    // All commands are validated before the first one is queued
+    std::vector<Command_t> parsed(commands.size());
+    auto results = retMsg["results"].to<JsonArray>();
+    bool valid = true;
+    size_t i = 0;
+    for (const auto cmd : commands) {
+        const WebApiError code = parseCommand(cmd, parsed[i++]);
+
+        auto result = results.add<JsonObject>();
+        result["serial"] = cmd["serial"];
+        result["code"] = code;
+        valid = valid && code == WebApiError::GenericSuccess;
+    }
+
+    if (!valid) {
+        retMsg["message"] = "Invalid command specified, nothing queued!";
+        retMsg["code"] = WebApiError::BulkInvalidCommand;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    // A command can still be refused while it is queued (e.g. the inverter is not reachable)
+    bool queued = true;
+    for (i = 0; i < parsed.size(); i++) {
+        if (!sendCommand(parsed[i])) {
+            results[i]["code"] = WebApiError::BulkCommandFailed;
+            queued = false;
+        }
+    }
+
+    if (!queued) {
+        retMsg["type"] = "warning";
+        retMsg["message"] = "Some commands could not be queued!";
+        retMsg["code"] = WebApiError::BulkCommandFailed;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    retMsg["type"] = "success";
+    retMsg["message"] = "Settings saved!";
+    retMsg["code"] = WebApiError::GenericSuccess;
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
+
+WebApiError WebApiBulkClass::parseCommand(const JsonVariantConst& cmd, Command_t& command)
+{
+    if (!(cmd["serial"].is<String>()
+            && ((cmd["limit_value"].is<float>() && cmd["limit_type"].is<uint16_t>())
+                || cmd["power"].is<bool>()
+                || cmd["restart"].is<bool>()))) {
+        return WebApiError::GenericValueMissing;
+    }
+
+    // Interpret the string as a hex value and convert it to uint64_t
+    const uint64_t serial = strtoll(cmd["serial"].as<const char*>(), NULL, 16);
+    if (serial == 0) {
+        return WebApiError::LimitSerialZero;
+    }
+
+    command.Inverter = Hoymiles.getInverterBySerial(serial);
+    if (command.Inverter == nullptr) {
+        return WebApiError::LimitInvalidInverter;
+    }
+
+    if (!command.Inverter->getEnableCommands()) {
+        return WebApiError::BulkCommandsDisabled;
+    }
+
+    if (cmd["limit_value"].is<float>()) {
+        command.Type = CommandType_t::Limit;
+        command.LimitValue = cmd["limit_value"].as<float>();
+        command.LimitType = cmd["limit_type"].as<PowerLimitControlType>();
+
+        if (command.LimitValue > MAX_INVERTER_LIMIT) {
+            return WebApiError::LimitInvalidLimit;
+        }
+
+        if (!((command.LimitType == PowerLimitControlType::AbsolutNonPersistent)
+                || (command.LimitType == PowerLimitControlType::AbsolutPersistent)
+                || (command.LimitType == PowerLimitControlType::RelativNonPersistent)
+                || (command.LimitType == PowerLimitControlType::RelativPersistent))) {
+            return WebApiError::LimitInvalidType;
+        }
+    } else if (cmd["power"].is<bool>()) {
+        command.Type = CommandType_t::Power;
+        command.PowerOn = cmd["power"].as<bool>();
+    } else {
+        if (!cmd["restart"].as<bool>()) {
+            return WebApiError::GenericValueMissing;
+        }
+        command.Type = CommandType_t::Restart;
+    }
+
+    return WebApiError::GenericSuccess;
+}
+
+bool WebApiBulkClass::sendCommand(const Command_t& command)
+{
+    switch (command.Type) {
+    case CommandType_t::Limit:
+        return command.Inverter->sendActivePowerControlRequest(command.LimitValue, command.LimitType);
+    case CommandType_t::Power:
+        return command.Inverter->sendPowerControlRequest(command.PowerOn);
+    default:
+        return command.Inverter->sendRestartControlRequest();
+    }
+}
@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "WebApi_capture.h"
+#include "JsonArena.h"
+#include "WebApi.h"
+#include "WebApi_errors.h"
+#include <AsyncJson.h>
+#include <Hoymiles.h>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+struct PcapFileHeader_t {
+    uint32_t Magic;
+    uint16_t VersionMajor;
+    uint16_t VersionMinor;
+    int32_t ThisZone;
+    uint32_t SigFigs;
+    uint32_t SnapLen;
+    uint32_t LinkType;
+};
+
+struct PcapRecordHeader_t {
+    uint32_t TsSec;
+    uint32_t TsUsec;
+    uint32_t InclLen;
+    uint32_t OrigLen;
+};
+
+// Each packet starts with radio, direction, channel and rssi followed by the raw fragment
+constexpr size_t PseudoHeaderSize = 4;
+
+struct PcapStreamState_t {
+    std::vector<uint8_t> Data;
+    size_t Pos = 0;
+};
+
+template <typename T>
+void append(std::vector<uint8_t>& data, const T& value)
+{
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(&value);
+    data.insert(data.end(), p, p + sizeof(T));
+}
+}
+
+void WebApiCaptureClass::init(AsyncWebServer& server, Scheduler& scheduler)
+{
+    using std::placeholders::_1;
+
+    server.on("/api/capture", HTTP_GET, std::bind(&WebApiCaptureClass::onCaptureGet, this, _1));
+    server.on("/api/capture/status", HTTP_GET, std::bind(&WebApiCaptureClass::onCaptureStatus, this, _1));
+    server.on("/api/capture/config", HTTP_POST, std::bind(&WebApiCaptureClass::onCapturePost, this, _1), nullptr, WebApiClass::onRequestBody);
+}
+
+void WebApiCaptureClass::onCaptureGet(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentials(request)) {
+        return;
+    }
+
+    // The ring is copied at once, so fragments captured during the download
+    // do not shift the records which are currently sent.
+    const auto records = Hoymiles.getRadioCapture().getRecords();
+
+    auto state = std::make_shared<PcapStreamState_t>();
+    state->Data.reserve(sizeof(PcapFileHeader_t) + records.size() * (sizeof(PcapRecordHeader_t) + PseudoHeaderSize + MAX_RF_PAYLOAD_SIZE));
+
+    append(state->Data, PcapFileHeader_t { 0xa1b2c3d4, 2, 4, 0, 0, PseudoHeaderSize + MAX_RF_PAYLOAD_SIZE, CAPTURE_PCAP_LINKTYPE });
+    for (const auto& r : records) {
+        const uint32_t len = PseudoHeaderSize + r.Len;
+        append(state->Data, PcapRecordHeader_t { r.TimestampSec, r.TimestampUsec, len, len });
+        state->Data.push_back(r.Radio);
+        state->Data.push_back(static_cast<uint8_t>(r.Direction));
+        state->Data.push_back(r.Channel);
+        state->Data.push_back(static_cast<uint8_t>(r.Rssi));
+        state->Data.insert(state->Data.end(), r.Data, r.Data + r.Len);
+    }
+
+    AsyncWebServerResponse* response = request->beginChunkedResponse("application/vnd.tcpdump.pcap", [state](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+        const size_t len = std::min(maxLen, state->Data.size() - state->Pos);
+        memcpy(buffer, state->Data.data() + state->Pos, len);
+        state->Pos += len;
+        return len;
+    });
+
+    response->addHeader("Content-Disposition", "attachment; filename=\"opendtu.pcap\"");
+    request->send(response);
+}
+
+void WebApiCaptureClass::onCaptureStatus(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentials(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    auto& root = response->getRoot();
+
+    RadioCapture& capture = Hoymiles.getRadioCapture();
+    root["enabled"] = capture.isEnabled();
+    root["count"] = capture.getCount();
+    root["capacity"] = HOY_CAPTURE_SIZE;
+    root["overwritten"] = capture.getOverwritten();
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
+
+void WebApiCaptureClass::onCapturePost(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentials(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    JsonArena arena;
+    JsonDocument root(&arena);
+    if (!WebApi.parseRequestData(request, response, root)) {
+        return;
+    }
+
+    auto& retMsg = response->getRoot();
+
+    if (!(root["enabled"].is<bool>()
+            || root["clear"].is<bool>())) {
+        retMsg["message"] = "Values are missing!";
+        retMsg["code"] = WebApiError::GenericValueMissing;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    RadioCapture& capture = Hoymiles.getRadioCapture();
+    if (root["enabled"].is<bool>()) {
+        capture.setEnabled(root["enabled"].as<bool>());
+    }
+    if (root["clear"].as<bool>()) {
+        capture.clear();
+    }
+
+    retMsg["type"] = "success";
+    retMsg["message"] = "Settings saved!";
+    retMsg["code"] = WebApiError::GenericSuccess;
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
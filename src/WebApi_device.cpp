@@ -5,6 +5,7 @@
 #include "WebApi_device.h"
 #include "Configuration.h"
 #include "Display_Graphic.h"
+#include "JsonArena.h"
 #include "PinMapping.h"
 #include "RestartHelper.h"
 #include "WebApi.h"
@@ -17,7 +18,7 @@ void WebApiDeviceClass::init(AsyncWebServer& server, Scheduler& scheduler)
     using std::placeholders::_1;
 
     server.on("/api/device/config", HTTP_GET, std::bind(&WebApiDeviceClass::onDeviceAdminGet, this, _1));
-    server.on("/api/device/config", HTTP_POST, std::bind(&WebApiDeviceClass::onDeviceAdminPost, this, _1));
+    server.on("/api/device/config", HTTP_POST, std::bind(&WebApiDeviceClass::onDeviceAdminPost, this, _1), nullptr, WebApiClass::onRequestBody);
 }
 
 void WebApiDeviceClass::onDeviceAdminGet(AsyncWebServerRequest* request)
@@ -42,6 +43,13 @@ void WebApiDeviceClass::onDeviceAdminGet(AsyncWebServerRequest* request)
     nrfPinObj["miso"] = pin.nrf24_miso;
     nrfPinObj["mosi"] = pin.nrf24_mosi;
 
+    for (uint8_t i = 0; i < PINMAPPING_NRF24_EXTRA_COUNT; i++) {
+        auto nrfExtraPinObj = curPin["nrf24_" + String(i + 1)].to<JsonObject>();
+        nrfExtraPinObj["cs"] = pin.nrf24_extra_cs[i];
+        nrfExtraPinObj["en"] = pin.nrf24_extra_en[i];
+        nrfExtraPinObj["irq"] = pin.nrf24_extra_irq[i];
+    }
+
     auto cmtPinObj = curPin["cmt"].to<JsonObject>();
     cmtPinObj["clk"] = pin.cmt_clk;
     cmtPinObj["cs"] = pin.cmt_cs;
@@ -106,7 +114,8 @@ void WebApiDeviceClass::onDeviceAdminPost(AsyncWebServerRequest* request)
     }
 
     AsyncJsonResponse* response = new AsyncJsonResponse();
-    JsonDocument root;
+    JsonArena arena;
+    JsonDocument root(&arena);
     if (!WebApi.parseRequestData(request, response, root)) {
         return;
     }
@@ -21,22 +21,35 @@ void WebApiDevInfoClass::onDevInfoStatus(AsyncWebServerRequest* request)
         return;
     }
 
-    AsyncJsonResponse* response = new AsyncJsonResponse();
-    auto& root = response->getRoot();
     auto serial = WebApi.parseSerialFromRequest(request);
     auto inv = Hoymiles.getInverterBySerial(serial);
 
+    std::vector<uint32_t> state;
+    if (inv != nullptr) {
+        state = { inv->DevInfo()->getGeneration(), inv->DevInfo()->getLastUpdate() };
+    }
+    const String etag = WebApi.generateETag(request, state);
+    if (WebApi.sendCached(request, etag)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = WebApi.createJsonResponse(request);
+    auto& root = response->getRoot();
+
     if (inv != nullptr) {
         root["valid_data"] = inv->DevInfo()->getLastUpdate() > 0;
         root["fw_bootloader_version"] = inv->DevInfo()->getFwBootloaderVersion();
         root["fw_build_version"] = inv->DevInfo()->getFwBuildVersion();
         root["hw_part_number"] = inv->DevInfo()->getHwPartNumber();
-        root["hw_version"] = inv->DevInfo()->getHwVersion();
+        char buffer[DEV_INFO_DATETIME_SIZE];
+        inv->DevInfo()->getHwVersion(buffer, sizeof(buffer));
+        root["hw_version"] = buffer;
         root["hw_model_name"] = inv->DevInfo()->getHwModelName();
         root["max_power"] = inv->DevInfo()->getMaxPower();
-        root["fw_build_datetime"] = inv->DevInfo()->getFwBuildDateTimeStr();
+        inv->DevInfo()->getFwBuildDateTimeStr(buffer, sizeof(buffer));
+        root["fw_build_datetime"] = buffer;
         root["pdl_supported"] = inv->supportsPowerDistributionLogic();
     }
 
-    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__, etag, true);
 }
@@ -4,13 +4,18 @@
  */
 #include "WebApi_dtu.h"
 #include "Configuration.h"
+#include "JsonArena.h"
+#include "PollCalibration.h"
+#include "TaskProfiler.h"
 #include "WebApi.h"
 #include "WebApi_errors.h"
 #include <AsyncJson.h>
 #include <Hoymiles.h>
+#include <algorithm>
+#include <sys/time.h>
 
 WebApiDtuClass::WebApiDtuClass()
-    : _applyDataTask(TASK_IMMEDIATE, TASK_ONCE, std::bind(&WebApiDtuClass::applyDataTaskCb, this))
+    : _applyDataTask(TASK_IMMEDIATE, TASK_ONCE)
 {
 }
 
@@ -19,22 +24,31 @@ void WebApiDtuClass::init(AsyncWebServer& server, Scheduler& scheduler)
     using std::placeholders::_1;
 
     server.on("/api/dtu/config", HTTP_GET, std::bind(&WebApiDtuClass::onDtuAdminGet, this, _1));
-    server.on("/api/dtu/config", HTTP_POST, std::bind(&WebApiDtuClass::onDtuAdminPost, this, _1));
+    server.on("/api/dtu/config", HTTP_POST, std::bind(&WebApiDtuClass::onDtuAdminPost, this, _1), nullptr, WebApiClass::onRequestBody);
+    server.on("/api/dtu/traces", HTTP_GET, std::bind(&WebApiDtuClass::onTracesGet, this, _1));
+    server.on("/api/dtu/queue", HTTP_GET, std::bind(&WebApiDtuClass::onQueueGet, this, _1));
 
     scheduler.addTask(_applyDataTask);
+    TaskProfiler.setCallback(_applyDataTask, "WebApiDtu.applyData", std::bind(&WebApiDtuClass::applyDataTaskCb, this));
 }
 
 void WebApiDtuClass::applyDataTaskCb()
 {
     // Execute stuff in main thread to avoid busy SPI bus
     auto const& config = Configuration.get();
-    Hoymiles.getRadioNrf()->setPALevel((rf24_pa_dbm_e)config.Dtu.Nrf.PaLevel);
+    for (uint8_t i = 0; i < HOY_NRF_RADIO_COUNT; i++) {
+        Hoymiles.getRadioNrf(i)->setPALevel((rf24_pa_dbm_e)config.Dtu.Nrf.PaLevel);
+        Hoymiles.getRadioNrf(i)->setDtuSerial(config.Dtu.Serial);
+    }
     Hoymiles.getRadioCmt()->setPALevel(config.Dtu.Cmt.PaLevel);
-    Hoymiles.getRadioNrf()->setDtuSerial(config.Dtu.Serial);
     Hoymiles.getRadioCmt()->setDtuSerial(config.Dtu.Serial);
     Hoymiles.getRadioCmt()->setCountryMode(static_cast<CountryModeId_t>(config.Dtu.Cmt.CountryMode));
     Hoymiles.getRadioCmt()->setInverterTargetFrequency(config.Dtu.Cmt.Frequency);
-    Hoymiles.setPollInterval(config.Dtu.PollInterval);
+    Hoymiles.setPollInterval(PollCalibration.getPollInterval());
+    Hoymiles.setAdaptivePolling(config.Dtu.AdaptivePolling);
+    Hoymiles.setSnapshotPolling(config.Dtu.SnapshotPolling);
+    Hoymiles.setTxPowerControl(config.Dtu.TxPowerControl);
+    Hoymiles.setLimitShaping(config.Dtu.LimitMinInterval, config.Dtu.LimitHysteresis);
 }
 
 void WebApiDtuClass::onDtuAdminGet(AsyncWebServerRequest* request)
@@ -54,6 +68,16 @@ void WebApiDtuClass::onDtuAdminGet(AsyncWebServerRequest* request)
         static_cast<uint32_t>(config.Dtu.Serial & 0xFFFFFFFF));
     root["serial"] = buffer;
     root["pollinterval"] = config.Dtu.PollInterval;
+    root["adaptive_polling"] = config.Dtu.AdaptivePolling;
+    root["poll_calibration"] = config.Dtu.PollCalibration;
+    root["poll_calibrated_interval"] = PollCalibration.getStats().Interval;
+    root["snapshot_polling"] = config.Dtu.SnapshotPolling;
+    root["freshness_slo_interval"] = config.Dtu.FreshnessSloInterval;
+    root["freshness_slo_age"] = config.Dtu.FreshnessSloAge;
+    root["limit_min_interval"] = config.Dtu.LimitMinInterval;
+    root["limit_hysteresis"] = config.Dtu.LimitHysteresis;
+    root["night_standby"] = config.Dtu.NightStandby;
+    root["tx_power_control"] = config.Dtu.TxPowerControl;
     root["nrf_enabled"] = Hoymiles.getRadioNrf()->isInitialized();
     root["nrf_palevel"] = config.Dtu.Nrf.PaLevel;
     root["cmt_enabled"] = Hoymiles.getRadioCmt()->isInitialized();
@@ -83,7 +107,8 @@ void WebApiDtuClass::onDtuAdminPost(AsyncWebServerRequest* request)
     }
 
     AsyncJsonResponse* response = new AsyncJsonResponse();
-    JsonDocument root;
+    JsonArena arena;
+    JsonDocument root(&arena);
     if (!WebApi.parseRequestData(request, response, root)) {
         return;
     }
@@ -92,6 +117,9 @@ void WebApiDtuClass::onDtuAdminPost(AsyncWebServerRequest* request)
 
     if (!(root["serial"].is<String>()
             && root["pollinterval"].is<uint32_t>()
+            && root["adaptive_polling"].is<bool>()
+            && root["limit_min_interval"].is<uint32_t>()
+            && root["limit_hysteresis"].is<float>()
             && root["nrf_palevel"].is<uint8_t>()
             && root["cmt_palevel"].is<int8_t>()
             && root["cmt_frequency"].is<uint32_t>()
@@ -119,6 +147,13 @@ void WebApiDtuClass::onDtuAdminPost(AsyncWebServerRequest* request)
         return;
     }
 
+    if (root["limit_hysteresis"].as<float>() < 0 || root["limit_hysteresis"].as<float>() > 100) {
+        retMsg["message"] = "Limit hysteresis must be between 0 and 100 %!";
+        retMsg["code"] = WebApiError::DtuInvalidLimitHysteresis;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
     if (root["nrf_palevel"].as<uint8_t>() > 3) {
         retMsg["message"] = "Invalid power level setting!";
         retMsg["code"] = WebApiError::DtuInvalidPowerLevel;
@@ -158,6 +193,15 @@ void WebApiDtuClass::onDtuAdminPost(AsyncWebServerRequest* request)
         auto& config = guard.getConfig();
         config.Dtu.Serial = serial;
         config.Dtu.PollInterval = root["pollinterval"].as<uint32_t>();
+        config.Dtu.AdaptivePolling = root["adaptive_polling"].as<bool>();
+        config.Dtu.PollCalibration = root["poll_calibration"] | false;
+        config.Dtu.SnapshotPolling = root["snapshot_polling"] | false;
+        config.Dtu.FreshnessSloInterval = root["freshness_slo_interval"].as<uint32_t>();
+        config.Dtu.FreshnessSloAge = root["freshness_slo_age"].as<uint32_t>();
+        config.Dtu.LimitMinInterval = root["limit_min_interval"].as<uint32_t>();
+        config.Dtu.LimitHysteresis = root["limit_hysteresis"].as<float>();
+        config.Dtu.NightStandby = root["night_standby"] | false;
+        config.Dtu.TxPowerControl = root["tx_power_control"] | false;
         config.Dtu.Nrf.PaLevel = root["nrf_palevel"].as<uint8_t>();
         config.Dtu.Cmt.PaLevel = root["cmt_palevel"].as<int8_t>();
         config.Dtu.Cmt.Frequency = root["cmt_frequency"].as<uint32_t>();
@@ -171,3 +215,256 @@ void WebApiDtuClass::onDtuAdminPost(AsyncWebServerRequest* request)
     _applyDataTask.enable();
     _applyDataTask.restart();
 }
+
+static const char* getTraceResultName(const CommandTraceResult_t result)
+{
+    switch (result) {
+    case CommandTraceResult_t::Success:
+        return "success";
+    case CommandTraceResult_t::NoAnswer:
+        return "no_answer";
+    case CommandTraceResult_t::PartialAnswer:
+        return "partial_answer";
+    case CommandTraceResult_t::CorruptData:
+        return "corrupt_data";
+    }
+    return "unknown";
+}
+
+static String getSerialString(const uint64_t serial)
+{
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%0" PRIx32 "%08" PRIx32,
+        static_cast<uint32_t>((serial >> 32) & 0xFFFFFFFF),
+        static_cast<uint32_t>(serial & 0xFFFFFFFF));
+    return buffer;
+}
+
+// End of the last step which was reached
+static uint32_t getTraceEnd(const CommandTrace_t& trace)
+{
+    if (trace.Notified != 0) {
+        return trace.Notified;
+    }
+    if (trace.ParseDone != 0) {
+        return trace.ParseDone;
+    }
+    return std::max(trace.Rx, trace.LastTx);
+}
+
+// Nearest rank of the sorted values
+static uint32_t getPercentile(const std::vector<uint32_t>& sorted, const uint8_t percent)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    const size_t rank = (sorted.size() * percent + 99) / 100;
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+static void addPercentiles(JsonObject obj, std::vector<uint32_t>& values)
+{
+    std::sort(values.begin(), values.end());
+    obj["p50"] = getPercentile(values, 50);
+    obj["p90"] = getPercentile(values, 90);
+    obj["p99"] = getPercentile(values, 99);
+    obj["max"] = values.empty() ? 0 : values.back();
+}
+
+void WebApiDtuClass::onTracesGet(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentials(request)) {
+        return;
+    }
+
+    CommandTraceRing& ring = Hoymiles.getCommandTraces();
+    const auto traces = ring.getTraces();
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    auto root = response->getRoot().as<JsonObject>();
+
+    if (request->hasParam("format") && request->getParam("format")->value() == "otel") {
+        addTracesOtel(root, traces);
+    } else {
+        root["total"] = ring.getTotal();
+        root["capacity"] = HOY_COMMAND_TRACE_COUNT;
+        root["uptime"] = millis();
+        addTracesJson(root, traces);
+    }
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
+
+// Times of the steps are relative to the enqueuing, missing steps are left out
+void WebApiDtuClass::addTracesJson(JsonObject root, const std::vector<CommandTrace_t>& traces)
+{
+    auto traceArray = root["traces"].to<JsonArray>();
+    for (const auto& trace : traces) {
+        auto obj = traceArray.add<JsonObject>();
+        obj["id"] = trace.Id;
+        obj["serial"] = getSerialString(trace.Serial);
+        obj["command"] = trace.CommandName;
+        obj["priority"] = trace.Priority == CommandPriority::Control ? "control" : "telemetry";
+        obj["result"] = getTraceResultName(trace.Result);
+        obj["resends"] = trace.Resends;
+        obj["retransmits"] = trace.Retransmits;
+        obj["fragments"] = trace.Fragments;
+        obj["enqueued"] = trace.Enqueued;
+        obj["first_tx"] = trace.FirstTx - trace.Enqueued;
+        obj["last_tx"] = trace.LastTx - trace.Enqueued;
+        if (trace.Rx != 0) {
+            obj["rx"] = trace.Rx - trace.Enqueued;
+        }
+        if (trace.ParseDone != 0) {
+            obj["parse_done"] = trace.ParseDone - trace.Enqueued;
+        }
+        if (trace.Notified != 0) {
+            obj["notified"] = trace.Notified - trace.Enqueued;
+        }
+        obj["total"] = getTraceEnd(trace) - trace.Enqueued;
+    }
+
+    // Aggregates per command name of the traces in the ring
+    std::vector<String> names;
+    for (const auto& trace : traces) {
+        if (std::find(names.begin(), names.end(), trace.CommandName) == names.end()) {
+            names.push_back(trace.CommandName);
+        }
+    }
+
+    auto commandArray = root["commands"].to<JsonArray>();
+    for (const auto& name : names) {
+        std::vector<uint32_t> queueWait;
+        std::vector<uint32_t> radio;
+        std::vector<uint32_t> total;
+        uint32_t failed = 0;
+
+        for (const auto& trace : traces) {
+            if (name != trace.CommandName) {
+                continue;
+            }
+            queueWait.push_back(trace.FirstTx - trace.Enqueued);
+            if (trace.Result != CommandTraceResult_t::Success) {
+                failed++;
+                continue;
+            }
+            radio.push_back(trace.Rx - trace.FirstTx);
+            total.push_back(getTraceEnd(trace) - trace.Enqueued);
+        }
+
+        auto obj = commandArray.add<JsonObject>();
+        obj["command"] = name;
+        obj["count"] = queueWait.size();
+        obj["failed"] = failed;
+        addPercentiles(obj["queue_wait"].to<JsonObject>(), queueWait);
+        addPercentiles(obj["radio"].to<JsonObject>(), radio);
+        addPercentiles(obj["total"].to<JsonObject>(), total);
+    }
+}
+
+// Shaped like the OTLP/JSON export of OpenTelemetry, one span per command with
+// an event per step. The times are only meaningful once the clock is synced.
+void WebApiDtuClass::addTracesOtel(JsonObject root, const std::vector<CommandTrace_t>& traces)
+{
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    const uint64_t bootMs = static_cast<uint64_t>(tv.tv_sec) * 1000 + tv.tv_usec / 1000 - millis();
+
+    auto toUnixNano = [bootMs](const uint32_t time) {
+        char buffer[24];
+        snprintf(buffer, sizeof(buffer), "%llu000000", static_cast<unsigned long long>(bootMs + time));
+        return String(buffer);
+    };
+
+    auto resourceSpan = root["resourceSpans"].to<JsonArray>().add<JsonObject>();
+    auto attribute = resourceSpan["resource"]["attributes"].to<JsonArray>().add<JsonObject>();
+    attribute["key"] = "service.name";
+    attribute["value"]["stringValue"] = "opendtu";
+
+    auto scopeSpan = resourceSpan["scopeSpans"].to<JsonArray>().add<JsonObject>();
+    scopeSpan["scope"]["name"] = "hoymiles";
+    auto spans = scopeSpan["spans"].to<JsonArray>();
+
+    for (const auto& trace : traces) {
+        char id[33];
+        snprintf(id, sizeof(id), "%032" PRIx32, trace.Id);
+
+        auto span = spans.add<JsonObject>();
+        span["traceId"] = id;
+        span["spanId"] = id + 16;
+        span["name"] = trace.CommandName;
+        span["kind"] = 3; // client
+        span["startTimeUnixNano"] = toUnixNano(trace.Enqueued);
+        span["endTimeUnixNano"] = toUnixNano(getTraceEnd(trace));
+        span["status"]["code"] = trace.Result == CommandTraceResult_t::Success ? 1 : 2;
+
+        auto attributes = span["attributes"].to<JsonArray>();
+        auto addAttribute = [&attributes](const char* key, const char* value) {
+            auto obj = attributes.add<JsonObject>();
+            obj["key"] = key;
+            obj["value"]["stringValue"] = value;
+        };
+        auto addIntAttribute = [&attributes](const char* key, const uint32_t value) {
+            auto obj = attributes.add<JsonObject>();
+            obj["key"] = key;
+            obj["value"]["intValue"] = String(value);
+        };
+        addAttribute("inverter.serial", getSerialString(trace.Serial).c_str());
+        addAttribute("command.result", getTraceResultName(trace.Result));
+        addIntAttribute("command.resends", trace.Resends);
+        addIntAttribute("command.retransmits", trace.Retransmits);
+        addIntAttribute("command.fragments", trace.Fragments);
+
+        auto events = span["events"].to<JsonArray>();
+        auto addEvent = [&events, &toUnixNano](const char* name, const uint32_t time) {
+            if (time == 0) {
+                return;
+            }
+            auto obj = events.add<JsonObject>();
+            obj["name"] = name;
+            obj["timeUnixNano"] = toUnixNano(time);
+        };
+        addEvent("first_tx", trace.FirstTx);
+        addEvent("last_tx", trace.LastTx);
+        addEvent("rx", trace.Rx);
+        addEvent("parse_done", trace.ParseDone);
+        addEvent("notified", trace.Notified);
+    }
+}
+
+void WebApiDtuClass::onQueueGet(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentials(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    auto& root = response->getRoot();
+    auto radioArray = root["radios"].to<JsonArray>();
+
+    for (auto& r : Hoymiles.getRadios()) {
+        if (r.radio == nullptr || !r.radio->isInitialized()) {
+            continue;
+        }
+
+        auto radioObj = radioArray.add<JsonObject>();
+        radioObj["name"] = r.name;
+        radioObj["idle"] = r.radio->isIdle();
+
+        auto commandArray = radioObj["commands"].to<JsonArray>();
+        for (const auto& cmd : r.radio->getQueueSnapshot()) {
+            auto obj = commandArray.add<JsonObject>();
+            obj["id"] = cmd.TraceId;
+            obj["command"] = cmd.CommandName;
+            obj["serial"] = getSerialString(cmd.Target);
+            obj["priority"] = cmd.Priority == CommandPriority::Control ? "control" : "telemetry";
+            obj["current"] = cmd.Current;
+            obj["send_count"] = cmd.SendCount;
+            obj["age"] = cmd.Age;
+            obj["timeout"] = cmd.Timeout;
+        }
+        radioObj["size"] = commandArray.size();
+    }
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
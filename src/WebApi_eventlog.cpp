@@ -6,6 +6,8 @@
 #include "WebApi.h"
 #include <AsyncJson.h>
 #include <Hoymiles.h>
+#include <algorithm>
+#include <array>
 
 void WebApiEventlogClass::init(AsyncWebServer& server, Scheduler& scheduler)
 {
@@ -20,8 +22,6 @@ void WebApiEventlogClass::onEventlogStatus(AsyncWebServerRequest* request)
         return;
     }
 
-    AsyncJsonResponse* response = new AsyncJsonResponse();
-    auto& root = response->getRoot();
     auto serial = WebApi.parseSerialFromRequest(request);
 
     AlarmMessageLocale_t locale = AlarmMessageLocale_t::EN;
@@ -37,25 +37,70 @@ void WebApiEventlogClass::onEventlogStatus(AsyncWebServerRequest* request)
     }
 
     auto inv = Hoymiles.getInverterBySerial(serial);
+    if (inv != nullptr && inv->getPollPlan().AlarmOnDemand) {
+        // Not polled, the next view shows the requested log
+        inv->sendAlarmLogRequest(true);
+    }
 
-    if (inv != nullptr) {
-        uint8_t logEntryCount = inv->EventLog()->getEntryCount();
-
-        root["count"] = logEntryCount;
-        JsonArray eventsArray = root["events"].to<JsonArray>();
+    // With "since" only entries received after the given sequence are selected, of
+    // them "offset" are skipped and at most "limit" returned
+    const uint32_t since = request->hasParam("since") ? request->getParam("since")->value().toInt() : 0;
+    const uint32_t offset = request->hasParam("offset") ? request->getParam("offset")->value().toInt() : 0;
+    uint32_t limit = ALARM_LOG_ENTRY_COUNT;
+    if (request->hasParam("limit")) {
+        limit = std::min<uint32_t>(std::max<long>(request->getParam("limit")->value().toInt(), 0), ALARM_LOG_ENTRY_COUNT);
+    }
 
-        for (uint8_t logEntry = 0; logEntry < logEntryCount; logEntry++) {
-            JsonObject eventsObject = eventsArray.add<JsonObject>();
+    const uint8_t count = inv != nullptr ? std::min<uint8_t>(inv->EventLog()->getEntryCount(), ALARM_LOG_ENTRY_COUNT) : 0;
 
-            AlarmLogEntry_t entry;
-            inv->EventLog()->getLogEntry(logEntry, entry, locale);
+    std::vector<uint32_t> state;
+    if (inv != nullptr) {
+        state = { inv->EventLog()->getGeneration(), inv->EventLog()->getLastUpdate(), inv->EventLog()->getSequence(),
+            count, since, offset, limit, static_cast<uint32_t>(locale) };
+    }
+    const String etag = WebApi.generateETag(request, state);
+    if (WebApi.sendCached(request, etag)) {
+        return;
+    }
 
-            eventsObject["message_id"] = entry.MessageId;
-            eventsObject["message"] = entry.Message;
-            eventsObject["start_time"] = entry.StartTime;
-            eventsObject["end_time"] = entry.EndTime;
+    // Only the entries of the page are decoded
+    std::array<AlarmLogEntry_t, ALARM_LOG_ENTRY_COUNT> entries;
+    uint8_t logEntryCount = 0;
+    uint8_t total = 0;
+    const uint32_t sequence = inv != nullptr ? inv->EventLog()->getSequence() : 0;
+    for (uint8_t i = 0; i < count; i++) {
+        if (inv->EventLog()->getEntrySequence(i) <= since) {
+            continue;
+        }
+        if (total++ >= offset && logEntryCount < limit) {
+            inv->EventLog()->getLogEntry(i, entries[logEntryCount++], locale);
         }
     }
 
-    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+    WebApi.sendJsonArrayStream(
+        request, "events",
+        [entries, logEntryCount](size_t index, JsonDocument& element) {
+            if (index >= logEntryCount) {
+                return false;
+            }
+
+            const AlarmLogEntry_t& entry = entries[index];
+
+            element["message_id"] = entry.MessageId;
+            // The message table is static, so the document only keeps the pointer
+            element["message"] = JsonString(entry.Message, true);
+            element["start_time"] = entry.StartTime;
+            element["end_time"] = entry.EndTime;
+            element["sequence"] = entry.Sequence;
+            return true;
+        },
+        [inv, logEntryCount, total, offset, sequence](JsonDocument& members) {
+            if (inv != nullptr) {
+                members["count"] = logEntryCount;
+                members["total"] = total;
+                members["offset"] = offset;
+                members["sequence"] = sequence;
+            }
+        },
+        etag, true);
 }
@@ -1,15 +1,30 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 /*
- * Copyright (C) 2022-2024 Thomas Basler and others
+ * Copyright (C) 2022-2025 Thomas Basler and others
  */
 #include "WebApi_file.h"
 #include "Configuration.h"
+#include "FlashWear.h"
+#include "InverterSettings.h"
+#include "JsonArena.h"
+#include "MqttCluster.h"
+#include "MqttFleet.h"
+#include "MqttHandleHass.h"
+#include "MqttHandleInverter.h"
+#include "MqttSettings.h"
+#include "NtpSettings.h"
+#include "PowerController.h"
 #include "RestartHelper.h"
+#include "SessionToken.h"
+#include "SunPosition.h"
 #include "Utils.h"
 #include "WebApi.h"
 #include "WebApi_errors.h"
 #include <AsyncJson.h>
 #include <LittleFS.h>
+#include <algorithm>
+#include <ctime>
+#include <memory>
 
 void WebApiFileClass::init(AsyncWebServer& server, Scheduler& scheduler)
 {
@@ -21,8 +36,8 @@ void WebApiFileClass::init(AsyncWebServer& server, Scheduler& scheduler)
     using std::placeholders::_6;
 
     server.on("/api/file/get", HTTP_GET, std::bind(&WebApiFileClass::onFileGet, this, _1));
-    server.on("/api/file/delete", HTTP_POST, std::bind(&WebApiFileClass::onFileDelete, this, _1));
-    server.on("/api/file/delete_all", HTTP_POST, std::bind(&WebApiFileClass::onFileDeleteAll, this, _1));
+    server.on("/api/file/delete", HTTP_POST, std::bind(&WebApiFileClass::onFileDelete, this, _1), nullptr, WebApiClass::onRequestBody);
+    server.on("/api/file/delete_all", HTTP_POST, std::bind(&WebApiFileClass::onFileDeleteAll, this, _1), nullptr, WebApiClass::onRequestBody);
     server.on("/api/file/list", HTTP_GET, std::bind(&WebApiFileClass::onFileListGet, this, _1));
     server.on("/api/file/upload", HTTP_POST,
         std::bind(&WebApiFileClass::onFileUploadFinish, this, _1),
@@ -46,7 +61,12 @@ void WebApiFileClass::onFileListGet(AsyncWebServerRequest* request)
             continue;
         }
         JsonObject obj = data.add<JsonObject>();
-        obj["name"] = String(file.name());
+        // The binary configuration is offered in its JSON backup format
+        if (String("/") + file.name() == CONFIG_IMAGE_FILENAME) {
+            obj["name"] = String(CONFIG_FILENAME).substring(1);
+        } else {
+            obj["name"] = String(file.name());
+        }
         obj["size"] = file.size();
 
         file = rootfs.openNextFile();
@@ -64,16 +84,145 @@ void WebApiFileClass::onFileGet(AsyncWebServerRequest* request)
 
     String requestFile = CONFIG_FILENAME;
     if (request->hasParam("file")) {
-        String name = "/" + request->getParam("file")->value();
-        if (LittleFS.exists(name)) {
-            requestFile = name;
-        } else {
-            request->send(404);
+        requestFile = "/" + request->getParam("file")->value();
+    }
+
+    // The backup of the configuration is generated from the binary image
+    if (requestFile == CONFIG_FILENAME && !LittleFS.exists(CONFIG_FILENAME)) {
+        AsyncResponseStream* response = request->beginResponseStream("application/json");
+        if (!Configuration.exportJson(*response)) {
+            delete response;
+            request->send(500);
             return;
         }
+        response->addHeader("Content-Disposition", "attachment; filename=\"" + requestFile.substring(1) + "\"");
+        request->send(response);
+        return;
+    }
+
+    // A precompressed variant is preferred if the client accepts it
+    bool gzip = false;
+    if (!requestFile.endsWith(".gz") && request->hasHeader("Accept-Encoding")
+        && request->header("Accept-Encoding").indexOf("gzip") >= 0 && LittleFS.exists(requestFile + ".gz")) {
+        gzip = true;
+    } else if (!LittleFS.exists(requestFile)) {
+        request->send(404);
+        return;
+    }
+
+    auto file = std::make_shared<File>(LittleFS.open(gzip ? requestFile + ".gz" : requestFile, "r"));
+    if (!*file || file->isDirectory()) {
+        request->send(404);
+        return;
+    }
+
+    const size_t size = file->size();
+    const time_t lastWrite = file->getLastWrite();
+
+    // The metadata identifies the content without reading it. Without a
+    // modification time the content itself is hashed.
+    String etag;
+    if (lastWrite > 0) {
+        char buffer[24];
+        snprintf(buffer, sizeof(buffer), "\"%x-%llx\"", static_cast<unsigned int>(size), static_cast<unsigned long long>(lastWrite));
+        etag = buffer;
+    } else {
+        etag = "\"" + Utils::generateMd5FromFile(file->path()) + "\"";
     }
 
-    request->send(LittleFS, requestFile, String(), true);
+    if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag) {
+        AsyncWebServerResponse* response = request->beginResponse(304);
+        response->addHeader("ETag", etag);
+        request->send(response);
+        return;
+    }
+
+    size_t start = 0;
+    size_t end = size > 0 ? size - 1 : 0;
+    bool partial = false;
+    if (request->hasHeader("Range") && (!request->hasHeader("If-Range") || request->header("If-Range") == etag)) {
+        if (!parseRange(request->header("Range"), size, start, end)) {
+            AsyncWebServerResponse* response = request->beginResponse(416);
+            response->addHeader("Content-Range", "bytes */" + String(size));
+            request->send(response);
+            return;
+        }
+        partial = true;
+    }
+
+    const size_t len = size > 0 ? end - start + 1 : 0;
+    if (start > 0) {
+        file->seek(start);
+    }
+
+    // The file is read straight into the send buffer, never more than fits into it
+    AsyncWebServerResponse* response = request->beginResponse(getContentType(requestFile), len,
+        [file, start](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+            if (file->position() != start + index) {
+                file->seek(start + index);
+            }
+            return file->read(buffer, maxLen);
+        });
+
+    if (partial) {
+        response->setCode(206);
+        response->addHeader("Content-Range", "bytes " + String(start) + "-" + String(end) + "/" + String(size));
+    }
+    if (gzip) {
+        response->addHeader("Content-Encoding", "gzip");
+    }
+    if (lastWrite > 0) {
+        struct tm timeinfo;
+        char buffer[32];
+        gmtime_r(&lastWrite, &timeinfo);
+        strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &timeinfo);
+        response->addHeader("Last-Modified", buffer);
+    }
+    response->addHeader("ETag", etag);
+    response->addHeader("Accept-Ranges", "bytes");
+    response->addHeader("Content-Disposition", "attachment; filename=\"" + requestFile.substring(1) + "\"");
+    request->send(response);
+}
+
+// Only a single range is supported: "bytes=<start>-<end>", "bytes=<start>-" or "bytes=-<suffix length>"
+bool WebApiFileClass::parseRange(const String& range, const size_t size, size_t& start, size_t& end)
+{
+    if (!range.startsWith("bytes=") || range.indexOf(',') >= 0 || size == 0) {
+        return false;
+    }
+
+    const int dash = range.indexOf('-');
+    if (dash < 0) {
+        return false;
+    }
+
+    const String first = range.substring(6, dash);
+    const String last = range.substring(dash + 1);
+
+    if (first.isEmpty()) {
+        const size_t suffix = last.toInt();
+        if (suffix == 0) {
+            return false;
+        }
+        start = suffix >= size ? 0 : size - suffix;
+        end = size - 1;
+        return true;
+    }
+
+    start = first.toInt();
+    end = last.isEmpty() ? size - 1 : std::min<size_t>(last.toInt(), size - 1);
+    return start <= end && start < size;
+}
+
+const char* WebApiFileClass::getContentType(const String& filename)
+{
+    if (filename.endsWith(".json")) {
+        return asyncsrv::T_application_json;
+    }
+    if (filename.endsWith(".gz")) {
+        return "application/gzip";
+    }
+    return "application/octet-stream";
 }
 
 void WebApiFileClass::onFileDelete(AsyncWebServerRequest* request)
@@ -83,7 +232,8 @@ void WebApiFileClass::onFileDelete(AsyncWebServerRequest* request)
     }
 
     AsyncJsonResponse* response = new AsyncJsonResponse();
-    JsonDocument root;
+    JsonArena arena;
+    JsonDocument root(&arena);
     if (!WebApi.parseRequestData(request, response, root)) {
         return;
     }
@@ -98,12 +248,20 @@ void WebApiFileClass::onFileDelete(AsyncWebServerRequest* request)
     }
 
     String name = "/" + root["file"].as<String>();
-    if (!LittleFS.exists(name)) {
+    const bool isConfig = name == CONFIG_FILENAME || name == CONFIG_IMAGE_FILENAME;
+    if (!LittleFS.exists(name) && !(isConfig && LittleFS.exists(CONFIG_IMAGE_FILENAME))) {
         request->send(404);
         return;
     }
 
-    LittleFS.remove(name);
+    if (isConfig) {
+        // Removes the configuration in both formats
+        Configuration.discardPendingWrite();
+        LittleFS.remove(CONFIG_FILENAME);
+        LittleFS.remove(CONFIG_IMAGE_FILENAME);
+    } else {
+        LittleFS.remove(name);
+    }
 
     retMsg["type"] = "success";
     retMsg["message"] = "File deleted";
@@ -119,7 +277,8 @@ void WebApiFileClass::onFileDeleteAll(AsyncWebServerRequest* request)
     }
 
     AsyncJsonResponse* response = new AsyncJsonResponse();
-    JsonDocument root;
+    JsonArena arena;
+    JsonDocument root(&arena);
     if (!WebApi.parseRequestData(request, response, root)) {
         return;
     }
@@ -146,8 +305,8 @@ void WebApiFileClass::onFileDeleteAll(AsyncWebServerRequest* request)
 
     WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
 
-    Utils::removeAllFiles();
-    RestartHelper.triggerRestart();
+    Configuration.discardPendingWrite();
+    RestartHelper.triggerFactoryReset();
 }
 
 void WebApiFileClass::onFileUpload(AsyncWebServerRequest* request, String filename, size_t index, uint8_t* data, size_t len, bool final)
@@ -162,18 +321,34 @@ void WebApiFileClass::onFileUpload(AsyncWebServerRequest* request, String filena
             request->send(500);
             return;
         }
-        const String name = "/" + request->getParam("file")->value();
+        String name = "/" + request->getParam("file")->value();
+        if (name == CONFIG_FILENAME) {
+            // Applied by onFileUploadFinish once it is complete and valid
+            name = CONFIG_RESTORE_FILENAME;
+        } else if (name == CONFIG_IMAGE_FILENAME) {
+            // A pending write would otherwise replace the uploaded configuration
+            Configuration.discardPendingWrite();
+        }
         request->_tempFile = LittleFS.open(name, "w");
     }
 
-    if (len) {
+    if (request->_tempFile && String(request->_tempFile.path()) == CONFIG_RESTORE_FILENAME
+        && index + len > CONFIG_RESTORE_MAX_SIZE) {
+        // The missing file tells onFileUploadFinish that the restore was too large
+        request->_tempFile.close();
+        LittleFS.remove(CONFIG_RESTORE_FILENAME);
+        return;
+    }
+
+    if (len && request->_tempFile) {
         // stream the incoming chunk to the opened file
         request->_tempFile.write(data, len);
     }
 
-    if (final) {
+    if (final && request->_tempFile) {
         // close the file handle as the upload is now done
         request->_tempFile.close();
+        FlashWear.record(FlashWriter_t::Upload, index + len);
     }
 }
 
@@ -186,9 +361,64 @@ void WebApiFileClass::onFileUploadFinish(AsyncWebServerRequest* request)
     // the request handler is triggered after the upload has finished...
     // create the response, add header, and send response
 
+    if (request->hasParam("file") && "/" + request->getParam("file")->value() == CONFIG_FILENAME) {
+        onConfigRestore(request);
+        return;
+    }
+
     AsyncWebServerResponse* response = request->beginResponse(200, "text/plain", "OK");
     response->addHeader("Connection", "close");
     response->addHeader("Access-Control-Allow-Origin", "*");
     request->send(response);
     RestartHelper.triggerRestart();
 }
+
+void WebApiFileClass::onConfigRestore(AsyncWebServerRequest* request)
+{
+    String error = "File too large";
+    ConfigRestoreResult_t result = ConfigRestoreResult_t::Invalid;
+    if (LittleFS.exists(CONFIG_RESTORE_FILENAME)) {
+        // The subscriptions of the previous topics are dropped before they change
+        MqttHandleInverter.unsubscribeTopics();
+        PowerController.unsubscribeTopics();
+        MqttCluster.unsubscribeTopics();
+        MqttFleet.unsubscribeTopics();
+        result = Configuration.restoreJson(CONFIG_RESTORE_FILENAME, error);
+        MqttHandleInverter.subscribeTopics();
+        PowerController.subscribeTopics();
+        MqttCluster.subscribeTopics();
+        MqttFleet.subscribeTopics();
+        LittleFS.remove(CONFIG_RESTORE_FILENAME);
+    }
+
+    // The restore view shows the text of an error response
+    AsyncWebServerResponse* response;
+    switch (result) {
+    case ConfigRestoreResult_t::Applied:
+        response = request->beginResponse(200, "text/plain", "applied");
+        break;
+    case ConfigRestoreResult_t::RestartRequired:
+        response = request->beginResponse(200, "text/plain", "OK");
+        break;
+    default:
+        response = request->beginResponse(500, "text/plain", error);
+        break;
+    }
+    response->addHeader("Connection", "close");
+    response->addHeader("Access-Control-Allow-Origin", "*");
+    request->send(response);
+
+    if (result == ConfigRestoreResult_t::RestartRequired) {
+        RestartHelper.triggerRestart();
+    } else if (result == ConfigRestoreResult_t::Applied) {
+        // Same as the handlers of the single sections, the others need a restart (see Configuration::restoreJson)
+        NtpSettings.setServer();
+        NtpSettings.setTimezone();
+        SunPosition.setDoRecalc(true);
+        InverterSettings.applyInverterList();
+        MqttSettings.performReconnect();
+        MqttHandleHass.forceUpdate();
+        SessionToken.reset();
+        WebApi.reload();
+    }
+}
@@ -1,14 +1,19 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 /*
- * Copyright (C) 2022-2024 Thomas Basler and others
+ * Copyright (C) 2022-2025 Thomas Basler and others
  */
 #include "WebApi_firmware.h"
+#include "CertStore.h"
 #include "Configuration.h"
+#include "FirmwarePull.h"
+#include "JsonArena.h"
+#include "MessageOutput.h"
 #include "RestartHelper.h"
 #include "WebApi.h"
 #include "helper.h"
 #include <AsyncJson.h>
 #include <Update.h>
+#include <algorithm>
 
 void WebApiFirmwareClass::init(AsyncWebServer& server, Scheduler& scheduler)
 {
@@ -22,6 +27,9 @@ void WebApiFirmwareClass::init(AsyncWebServer& server, Scheduler& scheduler)
     server.on("/api/firmware/update", HTTP_POST,
         std::bind(&WebApiFirmwareClass::onFirmwareUpdateFinish, this, _1),
         std::bind(&WebApiFirmwareClass::onFirmwareUpdateUpload, this, _1, _2, _3, _4, _5, _6));
+
+    server.on("/api/firmware/status", HTTP_GET, std::bind(&WebApiFirmwareClass::onFirmwareStatus, this, _1));
+    server.on("/api/firmware/pull", HTTP_POST, std::bind(&WebApiFirmwareClass::onFirmwarePullPost, this, _1), nullptr, WebApiClass::onRequestBody);
 }
 
 void WebApiFirmwareClass::onFirmwareUpdateFinish(AsyncWebServerRequest* request)
@@ -33,7 +41,24 @@ void WebApiFirmwareClass::onFirmwareUpdateFinish(AsyncWebServerRequest* request)
     // the request handler is triggered after the upload has finished...
     // create the response, add header, and send response
 
-    AsyncWebServerResponse* response = request->beginResponse((Update.hasError()) ? 500 : 200, "text/plain", (Update.hasError()) ? "FAIL" : "OK");
+    if (request != _uploadRequest && _state == SessionState_t::Receiving) {
+        // The upload was taken over by a newer request
+        request->send(409, "text/plain", "Upload continued by another request");
+        return;
+    }
+    _uploadRequest = nullptr;
+
+    if (_state == SessionState_t::Receiving) {
+        // Only a part of the firmware was sent, the upload continues with the next request
+        AsyncWebServerResponse* response = request->beginResponse(308, "text/plain", "INCOMPLETE");
+        addRangeHeader(response);
+        response->addHeader("Access-Control-Allow-Origin", "*");
+        request->send(response);
+        return;
+    }
+
+    const bool success = _state == SessionState_t::Done && !Update.hasError();
+    AsyncWebServerResponse* response = request->beginResponse(success ? 200 : 500, "text/plain", success ? "OK" : "FAIL");
     response->addHeader("Connection", "close");
     response->addHeader("Access-Control-Allow-Origin", "*");
     request->send(response);
@@ -48,29 +73,70 @@ void WebApiFirmwareClass::onFirmwareUpdateUpload(AsyncWebServerRequest* request,
 
     // Upload handler chunks in data
     if (!index) {
-        if (!request->hasParam("MD5", true)) {
-            return request->send(400, "text/plain", "MD5 parameter missing");
-        }
+        size_t start = 0;
+        size_t total = 0;
+        const bool ranged = parseContentRange(request, start, total);
 
-        if (!Update.setMD5(request->getParam("MD5", true)->value().c_str())) {
-            return request->send(400, "text/plain", "MD5 parameter invalid");
-        }
+        if (!ranged || start == 0) {
+            if (!beginSession(request, total)) {
+                return;
+            }
+        } else {
+            bool resumable;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                resumable = _state == SessionState_t::Receiving && start <= _received && (total == 0 || _total == 0 || total == _total);
+                if (resumable && _total == 0) {
+                    _total = total;
+                }
+            }
 
-        if (!Update.begin(UPDATE_SIZE_UNKNOWN, U_FLASH)) { // Start with max available size
-            Update.printError(Serial);
-            return request->send(400, "text/plain", "OTA could not begin");
+            if (!resumable) {
+                AsyncWebServerResponse* response = request->beginResponse(416, "text/plain", "Upload cannot be resumed");
+                addRangeHeader(response);
+                return request->send(response);
+            }
         }
+
+        _uploadRequest = request;
+        _uploadStart = start;
+    }
+
+    if (request != _uploadRequest) {
+        // Failed at the beginning or taken over by a newer request
+        return;
+    }
+
+    // Data which was already received before the upload was interrupted is skipped
+    const size_t pos = _uploadStart + index;
+    if (pos > _received) {
+        _uploadRequest = nullptr;
+        return request->send(416, "text/plain", "Upload position invalid");
     }
+    const size_t skip = std::min(len, _received - pos);
 
     // Write chunked data to the free sketch space
-    if (len) {
-        if (Update.write(data, len) != len) {
-            return request->send(400, "text/plain", "OTA could not begin");
+    if (len > skip) {
+        if (!queueData(data + skip, len - skip)) {
+            _uploadRequest = nullptr;
+            if (_state == SessionState_t::Receiving) {
+                // The flash writes fell behind, the session stays open for a resume
+                AsyncWebServerResponse* response = request->beginResponse(503, "text/plain", "OTA busy");
+                addRangeHeader(response);
+                response->addHeader("Retry-After", "1");
+                return request->send(response);
+            }
+            return request->send(400, "text/plain", "OTA could not write");
         }
     }
 
     if (final) { // if the final flag is set then this is the last frame of data
-        if (!Update.end(true)) { // true to set the size to the current progress
+        if (_total > 0 && _received < _total) {
+            // Only a part of the firmware, the finish handler reports the received range
+            return;
+        }
+
+        if (!finishSession()) {
             Update.printError(Serial);
             return request->send(400, "text/plain", "Could not end OTA");
         }
@@ -78,3 +144,305 @@ void WebApiFirmwareClass::onFirmwareUpdateUpload(AsyncWebServerRequest* request,
         return;
     }
 }
+
+void WebApiFirmwareClass::onFirmwareStatus(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentials(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    auto& root = response->getRoot();
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        root["active"] = _state == SessionState_t::Receiving;
+        root["received"] = _received;
+        root["total"] = _total;
+    }
+    root["error"] = Update.hasError() ? Update.errorString() : "";
+
+    static constexpr const char* pullStates[] = { "idle", "running", "done", "failed" };
+    auto pull = root["pull"].to<JsonObject>();
+    pull["state"] = pullStates[static_cast<int>(FirmwarePull.getState())];
+    pull["delta"] = FirmwarePull.isDelta();
+    pull["downloaded"] = FirmwarePull.getDownloaded();
+    pull["written"] = FirmwarePull.getWritten();
+    pull["total"] = FirmwarePull.getTotal();
+    pull["error"] = FirmwarePull.getError();
+
+    addRangeHeader(response);
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
+
+void WebApiFirmwareClass::onFirmwarePullPost(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentials(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    JsonArena arena;
+    JsonDocument root(&arena);
+    if (!WebApi.parseRequestData(request, response, root)) {
+        return;
+    }
+
+    auto& retMsg = response->getRoot();
+
+    if (!root["url"].is<String>()) {
+        retMsg["message"] = "Values are missing!";
+        retMsg["code"] = WebApiError::GenericValueMissing;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    const String url = root["url"].as<String>();
+    if (!url.startsWith("https://")) {
+        retMsg["message"] = "Url must start with https://!";
+        retMsg["code"] = WebApiError::FirmwareUrlInvalid;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    // The md5 comes from the caller, not from the downloaded image, so a modified
+    // image (or delta) is rejected before the new firmware gets booted
+    const String md5 = root["md5"] | "";
+    if (!FirmwarePullClass::isValidMd5(md5)) {
+        retMsg["message"] = "The md5 of the new firmware is missing or invalid!";
+        retMsg["code"] = WebApiError::FirmwareMd5Invalid;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    if (root["root_ca"].is<const char*>()) {
+        CertStore.write(Cert_t::FirmwareRootCa, root["root_ca"].as<const char*>());
+    }
+    if (CertStore.read(Cert_t::FirmwareRootCa).isEmpty()) {
+        retMsg["message"] = "The root certificate of the firmware server is missing!";
+        retMsg["code"] = WebApiError::FirmwareRootCaMissing;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    // A push upload and a pull share the single OTA partition
+    if (_writerTaskHandle != nullptr || !FirmwarePull.start(url, md5)) {
+        retMsg["message"] = "Firmware update already running!";
+        retMsg["code"] = WebApiError::FirmwareUpdateRunning;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    retMsg["type"] = "success";
+    retMsg["message"] = "Firmware download started!";
+    retMsg["code"] = WebApiError::FirmwarePullStarted;
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
+
+bool WebApiFirmwareClass::parseContentRange(AsyncWebServerRequest* request, size_t& start, size_t& total)
+{
+    if (!request->hasHeader("Content-Range")) {
+        return false;
+    }
+
+    // bytes <start>-<end>/<total>, the total may be "*" if it is unknown
+    const String value = request->header("Content-Range");
+    unsigned int first = 0;
+    unsigned int last = 0;
+    unsigned int size = 0;
+    const int fields = sscanf(value.c_str(), "bytes %u-%u/%u", &first, &last, &size);
+    if (fields < 2) {
+        return false;
+    }
+
+    start = first;
+    total = fields == 3 ? size : 0;
+    return true;
+}
+
+void WebApiFirmwareClass::addRangeHeader(AsyncWebServerResponse* response)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_state == SessionState_t::Receiving && _received > 0) {
+        response->addHeader("Range", "bytes=0-" + String(_received - 1));
+    }
+}
+
+bool WebApiFirmwareClass::beginSession(AsyncWebServerRequest* request, const size_t total)
+{
+    abortSession();
+
+    if (FirmwarePull.isRunning()) {
+        request->send(409, "text/plain", "Firmware download running");
+        return false;
+    }
+
+    if (!request->hasParam("MD5", true)) {
+        request->send(400, "text/plain", "MD5 parameter missing");
+        return false;
+    }
+
+    if (_ring == nullptr) {
+        // A blocked writer task is woken up as soon as a full block is available
+        _ring = xStreamBufferCreate(FIRMWARE_RING_SIZE, FIRMWARE_BLOCK_SIZE);
+        _block = static_cast<uint8_t*>(malloc(FIRMWARE_BLOCK_SIZE));
+        _writerDone = xSemaphoreCreateBinary();
+    }
+    if (_ring == nullptr || _block == nullptr || _writerDone == nullptr) {
+        request->send(500, "text/plain", "OTA out of memory");
+        return false;
+    }
+    xStreamBufferReset(_ring);
+    xSemaphoreTake(_writerDone, 0);
+
+    if (!Update.setMD5(request->getParam("MD5", true)->value().c_str())) {
+        request->send(400, "text/plain", "MD5 parameter invalid");
+        return false;
+    }
+
+    if (!Update.begin(total > 0 ? total : UPDATE_SIZE_UNKNOWN, U_FLASH)) { // Start with max available size
+        Update.printError(Serial);
+        request->send(400, "text/plain", "OTA could not begin");
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _received = 0;
+        _total = total;
+        _lastActivity = millis();
+        _abort = false;
+        _state = SessionState_t::Receiving;
+
+        if (xTaskCreatePinnedToCore(writerTaskProc, "OTA", FIRMWARE_TASK_STACK_SIZE, this,
+                FIRMWARE_TASK_PRIORITY, &_writerTaskHandle, FIRMWARE_TASK_CORE)
+            != pdPASS) {
+            _writerTaskHandle = nullptr;
+            _state = SessionState_t::Failed;
+        }
+    }
+
+    if (_state != SessionState_t::Receiving) {
+        Update.abort();
+        request->send(500, "text/plain", "OTA could not begin");
+        return false;
+    }
+
+    return true;
+}
+
+void WebApiFirmwareClass::abortSession()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_writerTaskHandle == nullptr) {
+            return;
+        }
+        _abort = true;
+    }
+
+    // The writer task aborts the update itself before it ends
+    xSemaphoreTake(_writerDone, pdMS_TO_TICKS(FIRMWARE_WRITE_TIMEOUT));
+}
+
+bool WebApiFirmwareClass::queueData(const uint8_t* data, size_t len)
+{
+    const uint32_t start = millis();
+
+    while (len > 0) {
+        if (_state != SessionState_t::Receiving) {
+            return false;
+        }
+
+        // Waits only while the ring is full, the writer task frees it block by block
+        const size_t sent = xStreamBufferSend(_ring, data, len, pdMS_TO_TICKS(100));
+        data += sent;
+        len -= sent;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _received += sent;
+            _lastActivity = millis();
+        }
+
+        if (len > 0 && millis() - start > FIRMWARE_QUEUE_TIMEOUT) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool WebApiFirmwareClass::finishSession()
+{
+    _state = SessionState_t::Finishing;
+
+    if (xSemaphoreTake(_writerDone, pdMS_TO_TICKS(FIRMWARE_WRITE_TIMEOUT)) != pdTRUE) {
+        return false;
+    }
+
+    return _state == SessionState_t::Done;
+}
+
+void WebApiFirmwareClass::writerTaskProc(void* param)
+{
+    static_cast<WebApiFirmwareClass*>(param)->writerLoop();
+}
+
+void WebApiFirmwareClass::writerLoop()
+{
+    // Update.write() erases and writes a sector once its internal buffer is full, so
+    // whole blocks result in exactly one flash operation per call
+    size_t fill = 0;
+    SessionState_t result = SessionState_t::Failed;
+
+    for (;;) {
+        const size_t n = xStreamBufferReceive(_ring, _block + fill, FIRMWARE_BLOCK_SIZE - fill, pdMS_TO_TICKS(100));
+        fill += n;
+
+        if (_abort) {
+            result = SessionState_t::Idle;
+            break;
+        }
+
+        if (fill == FIRMWARE_BLOCK_SIZE) {
+            if (Update.write(_block, fill) != fill) {
+                break;
+            }
+            fill = 0;
+            continue;
+        }
+
+        if (n > 0) {
+            continue;
+        }
+
+        // The state is set after the last data was queued, so an empty ring means everything was received
+        if (_state == SessionState_t::Finishing && xStreamBufferIsEmpty(_ring)) {
+            if ((fill == 0 || Update.write(_block, fill) == fill) && Update.end(true)) { // true to set the size to the current progress
+                result = SessionState_t::Done;
+            }
+            break;
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_state == SessionState_t::Receiving && millis() - _lastActivity > FIRMWARE_RESUME_TIMEOUT * 1000) {
+            MessageOutput.println("Firmware upload was not resumed in time");
+            break;
+        }
+    }
+
+    if (result != SessionState_t::Done) {
+        Update.abort();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _state = result;
+        _writerTaskHandle = nullptr;
+    }
+
+    xSemaphoreGive(_writerDone);
+    vTaskDelete(nullptr);
+}
@@ -21,35 +21,59 @@ void WebApiGridProfileClass::onGridProfileStatus(AsyncWebServerRequest* request)
         return;
     }
 
-    AsyncJsonResponse* response = new AsyncJsonResponse();
-    auto& root = response->getRoot();
     auto serial = WebApi.parseSerialFromRequest(request);
     auto inv = Hoymiles.getInverterBySerial(serial);
 
+    std::vector<uint32_t> state;
     if (inv != nullptr) {
-        root["name"] = inv->GridProfile()->getProfileName();
-        root["version"] = inv->GridProfile()->getProfileVersion();
+        if (inv->getPollPlan().GridProfileOnDemand && !inv->GridProfile()->containsValidData()) {
+            // Not polled, the next view shows the requested profile
+            inv->sendGridOnProFileParaRequest();
+        }
+        state = { inv->GridProfile()->getGeneration(), inv->GridProfile()->getLastUpdate() };
+    }
+    const String etag = WebApi.generateETag(request, state);
+    if (WebApi.sendCached(request, etag)) {
+        return;
+    }
+
+    std::shared_ptr<const GridProfileDecoded_t> profile;
+    if (inv != nullptr) {
+        profile = inv->GridProfile()->getProfile();
+    }
 
-        auto jsonSections = root["sections"].to<JsonArray>();
-        auto profSections = inv->GridProfile()->getProfile();
+    // One section with its items is serialized at a time
+    WebApi.sendJsonArrayStream(
+        request, "sections",
+        [profile](size_t index, JsonDocument& element) {
+            if (profile == nullptr || index >= profile->SectionCount) {
+                return false;
+            }
 
-        for (auto& profSection : profSections) {
-            auto jsonSection = jsonSections.add<JsonObject>();
-            jsonSection["name"] = profSection.SectionName;
+            const auto& profSection = profile->Sections[index];
+            element["name"] = JsonString(profSection.SectionName, true);
 
-            auto jsonItems = jsonSection["items"].to<JsonArray>();
+            auto jsonItems = element["items"].to<JsonArray>();
 
-            for (auto& profItem : profSection.items) {
+            for (uint8_t i = 0; i < profSection.ItemCount; i++) {
+                const auto& profItem = profile->Items[profSection.ItemStart + i];
                 auto jsonItem = jsonItems.add<JsonObject>();
 
-                jsonItem["n"] = profItem.Name;
-                jsonItem["u"] = profItem.Unit;
+                jsonItem["n"] = JsonString(profItem.Name, true);
+                jsonItem["u"] = JsonString(profItem.Unit, true);
                 jsonItem["v"] = profItem.Value;
             }
-        }
-    }
-
-    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+            return true;
+        },
+        [inv](JsonDocument& members) {
+            if (inv != nullptr) {
+                members["name"] = inv->GridProfile()->getProfileName();
+                char version[GRID_PROFILE_VERSION_SIZE];
+                inv->GridProfile()->getProfileVersion(version, sizeof(version));
+                members["version"] = version;
+            }
+        },
+        etag, true);
 }
 
 void WebApiGridProfileClass::onGridProfileRawdata(AsyncWebServerRequest* request)
@@ -58,17 +82,19 @@ void WebApiGridProfileClass::onGridProfileRawdata(AsyncWebServerRequest* request
         return;
     }
 
-    AsyncJsonResponse* response = new AsyncJsonResponse();
-    auto& root = response->getRoot();
     auto serial = WebApi.parseSerialFromRequest(request);
     auto inv = Hoymiles.getInverterBySerial(serial);
 
+    auto data = std::make_shared<std::vector<uint8_t>>();
     if (inv != nullptr) {
-        auto raw = root["raw"].to<JsonArray>();
-        auto data = inv->GridProfile()->getRawData();
-
-        copyArray(&data[0], data.size(), raw);
+        *data = inv->GridProfile()->getRawData();
     }
 
-    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+    WebApi.sendJsonArrayStream(request, "raw", [data](size_t index, JsonDocument& element) {
+        if (index >= data->size()) {
+            return false;
+        }
+        element.set((*data)[index]);
+        return true;
+    });
 }
@@ -0,0 +1,113 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "WebApi_history.h"
+#include "History.h"
+#include "LinkHistory.h"
+#include "WebApi.h"
+
+void WebApiHistoryClass::init(AsyncWebServer& server, Scheduler& scheduler)
+{
+    using std::placeholders::_1;
+
+    // Before /api/history, which also matches the urls below it
+    server.on("/api/history/link", HTTP_GET, std::bind(&WebApiHistoryClass::onLinkHistoryGet, this, _1));
+    server.on("/api/history", HTTP_GET, std::bind(&WebApiHistoryClass::onHistoryGet, this, _1));
+}
+
+// Parameters: resolution (1m, 15m or 1d), inv (serial, the total if omitted)
+// and start/end as unix timestamps
+void WebApiHistoryClass::onHistoryGet(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentialsReadonly(request)) {
+        return;
+    }
+
+    HistoryResolution_t resolution = HistoryResolution_t::Min15;
+    if (request->hasParam("resolution")) {
+        const String s = request->getParam("resolution")->value();
+        if (s == "1m") {
+            resolution = HistoryResolution_t::Min1;
+        } else if (s == "1d") {
+            resolution = HistoryResolution_t::Day1;
+        }
+    }
+
+    const uint64_t serial = WebApi.parseSerialFromRequest(request);
+    const uint32_t start = request->hasParam("start") ? strtoul(request->getParam("start")->value().c_str(), NULL, 10) : 0;
+    const uint32_t end = request->hasParam("end") ? strtoul(request->getParam("end")->value().c_str(), NULL, 10) : UINT32_MAX;
+
+    // The records are read from flash one by one while the response is sent
+    std::shared_ptr<HistoryReader> reader = History.getReader(resolution);
+    auto cursor = std::make_shared<size_t>(0);
+
+    WebApi.sendJsonArrayStream(
+        request, "records",
+        [reader, cursor, serial, start, end](size_t, JsonDocument& element) {
+            HistoryRecord_t record;
+            while (reader->read((*cursor)++, record)) {
+                if (record.Serial != serial || record.Timestamp < start || record.Timestamp > end) {
+                    continue;
+                }
+
+                element["t"] = record.Timestamp;
+                element["p"] = record.Power;
+                element["yd"] = record.YieldDay;
+                element["yt"] = record.YieldTotal;
+                return true;
+            }
+            return false;
+        },
+        [resolution](JsonDocument& members) {
+            members["period"] = History.getPeriod(resolution);
+        });
+}
+
+// Parameters: inv (serial, all inverters if omitted) and start/end as unix timestamps
+void WebApiHistoryClass::onLinkHistoryGet(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentialsReadonly(request)) {
+        return;
+    }
+
+    const uint64_t serial = WebApi.parseSerialFromRequest(request);
+    const uint32_t start = request->hasParam("start") ? strtoul(request->getParam("start")->value().c_str(), NULL, 10) : 0;
+    const uint32_t end = request->hasParam("end") ? strtoul(request->getParam("end")->value().c_str(), NULL, 10) : UINT32_MAX;
+
+    std::shared_ptr<LinkHistoryReader> reader = LinkHistory.getReader();
+    auto cursor = std::make_shared<size_t>(0);
+
+    WebApi.sendJsonArrayStream(
+        request, "records",
+        [reader, cursor, serial, start, end](size_t, JsonDocument& element) {
+            LinkHistoryRecord_t record;
+            while (reader->read((*cursor)++, record)) {
+                if ((serial != 0 && record.Serial != serial) || record.Timestamp < start || record.Timestamp > end) {
+                    continue;
+                }
+
+                char buffer[17];
+                snprintf(buffer, sizeof(buffer), "%0" PRIx32 "%08" PRIx32,
+                    static_cast<uint32_t>((record.Serial >> 32) & 0xFFFFFFFF),
+                    static_cast<uint32_t>(record.Serial & 0xFFFFFFFF));
+
+                element["t"] = record.Timestamp;
+                element["serial"] = buffer;
+                element["requests"] = record.Requests;
+                element["success"] = record.Success;
+                element["partial"] = record.Partial;
+                element["retransmits"] = record.Retransmits;
+                element["fragments"] = record.Fragments;
+                if (record.Fragments > 0) {
+                    element["rssi_mean"] = record.RssiMean;
+                    element["rssi_min"] = record.RssiMin;
+                }
+                return true;
+            }
+            return false;
+        },
+        [](JsonDocument& members) {
+            members["period"] = LINK_HISTORY_PERIOD;
+        });
+}
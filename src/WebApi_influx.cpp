@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "WebApi_influx.h"
+#include "CertStore.h"
+#include "Configuration.h"
+#include "InfluxExport.h"
+#include "JsonArena.h"
+#include "WebApi.h"
+#include "WebApi_errors.h"
+#include "helper.h"
+#include <AsyncJson.h>
+
+// Upper bound of the flush interval (s)
+#define INFLUX_MAX_FLUSH_INTERVAL 3600
+
+void WebApiInfluxClass::init(AsyncWebServer& server, Scheduler& scheduler)
+{
+    using std::placeholders::_1;
+
+    server.on("/api/influx/status", HTTP_GET, std::bind(&WebApiInfluxClass::onInfluxStatus, this, _1));
+    server.on("/api/influx/config", HTTP_GET, std::bind(&WebApiInfluxClass::onInfluxAdminGet, this, _1));
+    server.on("/api/influx/config", HTTP_POST, std::bind(&WebApiInfluxClass::onInfluxAdminPost, this, _1), nullptr, WebApiClass::onRequestBody);
+}
+
+void WebApiInfluxClass::onInfluxStatus(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentialsReadonly(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    auto& root = response->getRoot();
+
+    const InfluxExportStats_t stats = InfluxExport.getStats();
+    root["enabled"] = Configuration.get().Influx.Enabled;
+    root["batches"] = stats.Batches;
+    root["lines_sent"] = stats.LinesSent;
+    root["lines_dropped"] = stats.LinesDropped;
+    root["lines_failed"] = stats.LinesFailed;
+    root["last_http_code"] = stats.LastHttpCode;
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
+
+void WebApiInfluxClass::onInfluxAdminGet(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentials(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    auto& root = response->getRoot();
+    const CONFIG_T& config = Configuration.get();
+
+    root["enabled"] = config.Influx.Enabled;
+    root["url"] = config.Influx.Url;
+    root["token"] = config.Influx.Token;
+    root["flush_interval"] = config.Influx.FlushInterval;
+    root["root_ca_cert"] = CertStore.read(Cert_t::InfluxRootCa);
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
+
+void WebApiInfluxClass::onInfluxAdminPost(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentials(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    JsonArena arena;
+    JsonDocument root(&arena);
+    if (!WebApi.parseRequestData(request, response, root)) {
+        return;
+    }
+
+    auto& retMsg = response->getRoot();
+
+    if (!(root["enabled"].is<bool>()
+            && root["url"].is<String>()
+            && root["token"].is<String>()
+            && root["flush_interval"].is<uint32_t>())) {
+        retMsg["message"] = "Values are missing!";
+        retMsg["code"] = WebApiError::GenericValueMissing;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    const String url = root["url"].as<String>();
+    const bool validScheme = url.startsWith("udp://") || url.startsWith("http://") || url.startsWith("https://");
+    if (url.length() > INFLUX_MAX_URL_STRLEN
+        || (root["enabled"].as<bool>() && !validScheme)
+        || (url.startsWith("udp://") && url.lastIndexOf(':') <= 5)) {
+        retMsg["message"] = "Url must start with udp://, http:// or https://, an udp url needs a port!";
+        retMsg["code"] = WebApiError::InfluxUrlInvalid;
+        retMsg["param"]["max"] = INFLUX_MAX_URL_STRLEN;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    if (root["token"].as<String>().length() > INFLUX_MAX_TOKEN_STRLEN) {
+        retMsg["message"] = "Token must not be longer than " STR(INFLUX_MAX_TOKEN_STRLEN) " characters!";
+        retMsg["code"] = WebApiError::InfluxTokenLength;
+        retMsg["param"]["max"] = INFLUX_MAX_TOKEN_STRLEN;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    if (root["flush_interval"].as<uint32_t>() > INFLUX_MAX_FLUSH_INTERVAL) {
+        retMsg["message"] = "Flush interval must be between 0 and " STR(INFLUX_MAX_FLUSH_INTERVAL) " seconds!";
+        retMsg["code"] = WebApiError::InfluxFlushInterval;
+        retMsg["param"]["max"] = INFLUX_MAX_FLUSH_INTERVAL;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    // The certificate of a https server is checked, the token is not sent to anyone else
+    const String rootCa = root["root_ca_cert"].is<String>() ? root["root_ca_cert"].as<String>() : CertStore.read(Cert_t::InfluxRootCa);
+    if (root["enabled"].as<bool>() && url.startsWith("https://") && rootCa.isEmpty()) {
+        retMsg["message"] = "A https url needs the root certificate of the server!";
+        retMsg["code"] = WebApiError::InfluxRootCaMissing;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+    const uint32_t rootCaCert = CertStore.write(Cert_t::InfluxRootCa, rootCa.c_str());
+
+    {
+        auto guard = Configuration.getWriteGuard();
+        auto& config = guard.getConfig();
+
+        config.Influx.Enabled = root["enabled"].as<bool>();
+        strlcpy(config.Influx.Url, url.c_str(), sizeof(config.Influx.Url));
+        strlcpy(config.Influx.Token, root["token"].as<String>().c_str(), sizeof(config.Influx.Token));
+        config.Influx.FlushInterval = root["flush_interval"].as<uint32_t>();
+        config.Influx.RootCaCert = rootCaCert;
+    }
+
+    WebApi.writeConfig(retMsg);
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+
+    InfluxExport.reconfigure();
+}
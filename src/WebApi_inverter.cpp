@@ -4,6 +4,8 @@
  */
 #include "WebApi_inverter.h"
 #include "Configuration.h"
+#include "InverterSettings.h"
+#include "JsonArena.h"
 #include "MqttHandleHass.h"
 #include "WebApi.h"
 #include "WebApi_errors.h"
@@ -11,17 +13,21 @@
 #include "helper.h"
 #include <AsyncJson.h>
 #include <Hoymiles.h>
+#include <algorithm>
+#include <memory>
 
 void WebApiInverterClass::init(AsyncWebServer& server, Scheduler& scheduler)
 {
     using std::placeholders::_1;
 
     server.on("/api/inverter/list", HTTP_GET, std::bind(&WebApiInverterClass::onInverterList, this, _1));
-    server.on("/api/inverter/add", HTTP_POST, std::bind(&WebApiInverterClass::onInverterAdd, this, _1));
-    server.on("/api/inverter/edit", HTTP_POST, std::bind(&WebApiInverterClass::onInverterEdit, this, _1));
-    server.on("/api/inverter/del", HTTP_POST, std::bind(&WebApiInverterClass::onInverterDelete, this, _1));
-    server.on("/api/inverter/order", HTTP_POST, std::bind(&WebApiInverterClass::onInverterOrder, this, _1));
+    server.on("/api/inverter/add", HTTP_POST, std::bind(&WebApiInverterClass::onInverterAdd, this, _1), nullptr, WebApiClass::onRequestBody);
+    server.on("/api/inverter/edit", HTTP_POST, std::bind(&WebApiInverterClass::onInverterEdit, this, _1), nullptr, WebApiClass::onRequestBody);
+    server.on("/api/inverter/del", HTTP_POST, std::bind(&WebApiInverterClass::onInverterDelete, this, _1), nullptr, WebApiClass::onRequestBody);
+    server.on("/api/inverter/order", HTTP_POST, std::bind(&WebApiInverterClass::onInverterOrder, this, _1), nullptr, WebApiClass::onRequestBody);
     server.on("/api/inverter/stats_reset", HTTP_GET, std::bind(&WebApiInverterClass::onInverterStatReset, this, _1));
+    server.on("/api/inverter/focus", HTTP_GET, std::bind(&WebApiInverterClass::onInverterFocusGet, this, _1));
+    server.on("/api/inverter/focus", HTTP_POST, std::bind(&WebApiInverterClass::onInverterFocusPost, this, _1), nullptr, WebApiClass::onRequestBody);
 }
 
 void WebApiInverterClass::onInverterList(AsyncWebServerRequest* request)
@@ -30,56 +36,82 @@ void WebApiInverterClass::onInverterList(AsyncWebServerRequest* request)
         return;
     }
 
-    AsyncJsonResponse* response = new AsyncJsonResponse();
-    auto& root = response->getRoot();
-    JsonArray data = root["inverter"].to<JsonArray>();
-
-    const CONFIG_T& config = Configuration.get();
-
-    for (uint8_t i = 0; i < INV_MAX_COUNT; i++) {
-        if (config.Inverter[i].Serial > 0) {
-            JsonObject obj = data.add<JsonObject>();
-            obj["id"] = i;
-            obj["name"] = String(config.Inverter[i].Name);
-            obj["order"] = config.Inverter[i].Order;
-
-            // Inverter Serial is read as HEX
-            char buffer[sizeof(uint64_t) * 8 + 1];
-            snprintf(buffer, sizeof(buffer), "%0" PRIx32 "%08" PRIx32,
-                static_cast<uint32_t>((config.Inverter[i].Serial >> 32) & 0xFFFFFFFF),
-                static_cast<uint32_t>(config.Inverter[i].Serial & 0xFFFFFFFF));
-            obj["serial"] = buffer;
-            obj["poll_enable"] = config.Inverter[i].Poll_Enable;
-            obj["poll_enable_night"] = config.Inverter[i].Poll_Enable_Night;
-            obj["command_enable"] = config.Inverter[i].Command_Enable;
-            obj["command_enable_night"] = config.Inverter[i].Command_Enable_Night;
-            obj["reachable_threshold"] = config.Inverter[i].ReachableThreshold;
-            obj["zero_runtime"] = config.Inverter[i].ZeroRuntimeDataIfUnrechable;
-            obj["zero_day"] = config.Inverter[i].ZeroYieldDayOnMidnight;
-            obj["clear_eventlog"] = config.Inverter[i].ClearEventlogOnMidnight;
-            obj["yieldday_correction"] = config.Inverter[i].YieldDayCorrection;
-
-            auto inv = Hoymiles.getInverterBySerial(config.Inverter[i].Serial);
-            uint8_t max_channels;
-            if (inv == nullptr) {
-                obj["type"] = "Unknown";
-                max_channels = INV_MAX_CHAN_COUNT;
-            } else {
-                obj["type"] = inv->typeName();
-                max_channels = inv->Statistics()->getChannelsByType(TYPE_DC).size();
-            }
+    // The configuration is covered by the ETag itself, the type and channel count
+    // change once the device info of an inverter is known
+    std::vector<uint32_t> state;
+    Hoymiles.forEachInverter([&state](InverterAbstract& inv, const uint8_t) {
+        state.push_back(inv.DevInfo()->getGeneration());
+    });
+    const String etag = WebApi.generateETag(request, state);
+    if (WebApi.sendCached(request, etag)) {
+        return;
+    }
 
-            JsonArray channel = obj["channel"].to<JsonArray>();
-            for (uint8_t c = 0; c < max_channels; c++) {
-                JsonObject chanData = channel.add<JsonObject>();
-                chanData["name"] = config.Inverter[i].channel[c].Name;
-                chanData["max_power"] = config.Inverter[i].channel[c].MaxChannelPower;
-                chanData["yield_total_offset"] = config.Inverter[i].channel[c].YieldTotalOffset;
-            }
-        }
+    // The chunks are generated later by the web server, meanwhile inverters can be
+    // added or removed. So they are generated from a copy of the configs.
+    std::shared_ptr<const std::vector<INVERTER_CONFIG_T>> configs;
+    {
+        auto configGuard = Configuration.getReadGuard();
+        configs = std::make_shared<const std::vector<INVERTER_CONFIG_T>>(Configuration.get().Inverter);
     }
 
-    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+    WebApi.sendJsonArrayStream(request, "inverter", [configs](size_t index, JsonDocument& element) {
+        if (index >= configs->size()) {
+            return false;
+        }
+
+        const uint8_t i = index;
+        const INVERTER_CONFIG_T& inv_cfg = (*configs)[i];
+        if (inv_cfg.Serial == 0) {
+            return true;
+        }
+
+        JsonObject obj = element.to<JsonObject>();
+        obj["id"] = i;
+        obj["name"] = String(inv_cfg.Name);
+        obj["order"] = inv_cfg.Order;
+
+        // Inverter Serial is read as HEX
+        char buffer[sizeof(uint64_t) * 8 + 1];
+        snprintf(buffer, sizeof(buffer), "%0" PRIx32 "%08" PRIx32,
+            static_cast<uint32_t>((inv_cfg.Serial >> 32) & 0xFFFFFFFF),
+            static_cast<uint32_t>(inv_cfg.Serial & 0xFFFFFFFF));
+        obj["serial"] = buffer;
+        obj["poll_enable"] = inv_cfg.Poll_Enable;
+        obj["poll_enable_night"] = inv_cfg.Poll_Enable_Night;
+        obj["command_enable"] = inv_cfg.Command_Enable;
+        obj["command_enable_night"] = inv_cfg.Command_Enable_Night;
+        obj["reachable_threshold"] = inv_cfg.ReachableThreshold;
+        obj["zero_runtime"] = inv_cfg.ZeroRuntimeDataIfUnrechable;
+        obj["zero_day"] = inv_cfg.ZeroYieldDayOnMidnight;
+        obj["clear_eventlog"] = inv_cfg.ClearEventlogOnMidnight;
+        obj["yieldday_correction"] = inv_cfg.YieldDayCorrection;
+        obj["group"] = inv_cfg.Group;
+        obj["stats_interval"] = inv_cfg.PollPlan.StatsInterval;
+        obj["alarm_interval"] = inv_cfg.PollPlan.AlarmInterval;
+        obj["limit_interval"] = inv_cfg.PollPlan.LimitInterval;
+        obj["alarm_on_demand"] = inv_cfg.PollPlan.AlarmOnDemand;
+        obj["gridprofile_on_demand"] = inv_cfg.PollPlan.GridProfileOnDemand;
+
+        auto inv = Hoymiles.getInverterBySerial(inv_cfg.Serial);
+        uint8_t max_channels;
+        if (inv == nullptr) {
+            obj["type"] = "Unknown";
+            max_channels = INV_MAX_CHAN_COUNT;
+        } else {
+            obj["type"] = inv->typeName();
+            max_channels = inv->Statistics()->getChannelsByType(TYPE_DC).size();
+        }
+
+        JsonArray channel = obj["channel"].to<JsonArray>();
+        for (uint8_t c = 0; c < max_channels; c++) {
+            JsonObject chanData = channel.add<JsonObject>();
+            chanData["name"] = inv_cfg.channel[c].Name;
+            chanData["max_power"] = inv_cfg.channel[c].MaxChannelPower;
+            chanData["yield_total_offset"] = inv_cfg.channel[c].YieldTotalOffset;
+        }
+        return true;
+    }, nullptr, etag, true);
 }
 
 void WebApiInverterClass::onInverterAdd(AsyncWebServerRequest* request)
@@ -89,7 +121,8 @@ void WebApiInverterClass::onInverterAdd(AsyncWebServerRequest* request)
     }
 
     AsyncJsonResponse* response = new AsyncJsonResponse();
-    JsonDocument root;
+    JsonArena arena;
+    JsonDocument root(&arena);
     if (!WebApi.parseRequestData(request, response, root)) {
         return;
     }
@@ -122,32 +155,28 @@ void WebApiInverterClass::onInverterAdd(AsyncWebServerRequest* request)
         return;
     }
 
-    INVERTER_CONFIG_T* inverter = Configuration.getFreeInverterSlot();
+    {
+        // Adding a slot may reallocate the inverter table, so block all readers meanwhile
+        auto guard = Configuration.getWriteGuard();
+        INVERTER_CONFIG_T* slot = Configuration.getFreeInverterSlot();
+
+        if (!slot) {
+            retMsg["message"] = "Only " STR(INV_MAX_COUNT) " inverters are supported!";
+            retMsg["code"] = WebApiError::InverterCount;
+            retMsg["param"]["max"] = INV_MAX_COUNT;
+            WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+            return;
+        }
 
-    if (!inverter) {
-        retMsg["message"] = "Only " STR(INV_MAX_COUNT) " inverters are supported!";
-        retMsg["code"] = WebApiError::InverterCount;
-        retMsg["param"]["max"] = INV_MAX_COUNT;
-        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
-        return;
+        slot->Serial = serial;
+        strncpy(slot->Name, root["name"].as<String>().c_str(), INV_MAX_NAME_STRLEN);
     }
 
-    // Interpret the string as a hex value and convert it to uint64_t
-    inverter->Serial = serial;
-
-    strncpy(inverter->Name, root["name"].as<String>().c_str(), INV_MAX_NAME_STRLEN);
-
     WebApi.writeConfig(retMsg, WebApiError::InverterAdded, "Inverter created!");
 
     WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
 
-    auto inv = Hoymiles.addInverter(inverter->Name, inverter->Serial);
-
-    if (inv != nullptr) {
-        for (uint8_t c = 0; c < INV_MAX_CHAN_COUNT; c++) {
-            inv->Statistics()->setStringMaxPower(c, inverter->channel[c].MaxChannelPower);
-        }
-    }
+    InverterSettings.applyInverterList();
 
     MqttHandleHass.forceUpdate();
 }
@@ -159,7 +188,8 @@ void WebApiInverterClass::onInverterEdit(AsyncWebServerRequest* request)
     }
 
     AsyncJsonResponse* response = new AsyncJsonResponse();
-    JsonDocument root;
+    JsonArena arena;
+    JsonDocument root(&arena);
     if (!WebApi.parseRequestData(request, response, root)) {
         return;
     }
@@ -176,7 +206,7 @@ void WebApiInverterClass::onInverterEdit(AsyncWebServerRequest* request)
         return;
     }
 
-    if (root["id"].as<uint8_t>() > INV_MAX_COUNT - 1) {
+    if (root["id"].as<uint8_t>() >= Configuration.get().Inverter.size()) {
         retMsg["message"] = "Invalid ID specified!";
         retMsg["code"] = WebApiError::InverterInvalidId;
         WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
@@ -209,15 +239,12 @@ void WebApiInverterClass::onInverterEdit(AsyncWebServerRequest* request)
         return;
     }
 
-    uint64_t old_serial = 0;
-
     {
         auto guard = Configuration.getWriteGuard();
         auto& config = guard.getConfig();
 
         INVERTER_CONFIG_T& inverter = config.Inverter[root["id"].as<uint8_t>()];
 
-        old_serial = inverter.Serial;
         inverter.Serial = new_serial;
         strncpy(inverter.Name, root["name"].as<String>().c_str(), INV_MAX_NAME_STRLEN);
 
@@ -230,6 +257,12 @@ void WebApiInverterClass::onInverterEdit(AsyncWebServerRequest* request)
         inverter.ZeroYieldDayOnMidnight = root["zero_day"] | false;
         inverter.ClearEventlogOnMidnight = root["clear_eventlog"] | false;
         inverter.YieldDayCorrection = root["yieldday_correction"] | false;
+        inverter.Group = std::min<uint8_t>(root["group"] | 0, INV_MAX_GROUP_COUNT);
+        inverter.PollPlan.StatsInterval = root["stats_interval"] | INVERTER_STATS_INTERVAL;
+        inverter.PollPlan.AlarmInterval = root["alarm_interval"] | INVERTER_ALARM_INTERVAL;
+        inverter.PollPlan.LimitInterval = root["limit_interval"] | INVERTER_LIMIT_INTERVAL;
+        inverter.PollPlan.AlarmOnDemand = root["alarm_on_demand"] | false;
+        inverter.PollPlan.GridProfileOnDemand = root["gridprofile_on_demand"] | false;
 
         uint8_t arrayCount = 0;
         for (JsonVariant channel : channelArray) {
@@ -244,34 +277,8 @@ void WebApiInverterClass::onInverterEdit(AsyncWebServerRequest* request)
 
     WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
 
-    INVERTER_CONFIG_T const& inverter = Configuration.get().Inverter[root["id"].as<uint8_t>()];
-    std::shared_ptr<InverterAbstract> inv = Hoymiles.getInverterBySerial(old_serial);
-
-    if (inv != nullptr && new_serial != old_serial) {
-        // Valid inverter exists but serial changed --> remove it and insert new one
-        Hoymiles.removeInverterBySerial(old_serial);
-        inv = Hoymiles.addInverter(inverter.Name, inverter.Serial);
-    } else if (inv != nullptr && new_serial == old_serial) {
-        // Valid inverter exists and serial stays the same --> update name
-        inv->setName(inverter.Name);
-    } else if (inv == nullptr) {
-        // Valid inverter did not exist --> try to create one
-        inv = Hoymiles.addInverter(inverter.Name, inverter.Serial);
-    }
-
-    if (inv != nullptr) {
-        inv->setEnablePolling(inverter.Poll_Enable);
-        inv->setEnableCommands(inverter.Command_Enable);
-        inv->setReachableThreshold(inverter.ReachableThreshold);
-        inv->setZeroValuesIfUnreachable(inverter.ZeroRuntimeDataIfUnrechable);
-        inv->setZeroYieldDayOnMidnight(inverter.ZeroYieldDayOnMidnight);
-        inv->setClearEventlogOnMidnight(inverter.ClearEventlogOnMidnight);
-        inv->Statistics()->setYieldDayCorrection(inverter.YieldDayCorrection);
-        for (uint8_t c = 0; c < INV_MAX_CHAN_COUNT; c++) {
-            inv->Statistics()->setStringMaxPower(c, inverter.channel[c].MaxChannelPower);
-            inv->Statistics()->setChannelFieldOffset(TYPE_DC, static_cast<ChannelNum_t>(c), FLD_YT, inverter.channel[c].YieldTotalOffset);
-        }
-    }
+    // An edited serial exchanges only this inverter, the others keep polling
+    InverterSettings.applyInverterList();
 
     MqttHandleHass.forceUpdate();
 }
@@ -283,7 +290,8 @@ void WebApiInverterClass::onInverterDelete(AsyncWebServerRequest* request)
     }
 
     AsyncJsonResponse* response = new AsyncJsonResponse();
-    JsonDocument root;
+    JsonArena arena;
+    JsonDocument root(&arena);
     if (!WebApi.parseRequestData(request, response, root)) {
         return;
     }
@@ -297,7 +305,7 @@ void WebApiInverterClass::onInverterDelete(AsyncWebServerRequest* request)
         return;
     }
 
-    if (root["id"].as<uint8_t>() > INV_MAX_COUNT - 1) {
+    if (root["id"].as<uint8_t>() >= Configuration.get().Inverter.size()) {
         retMsg["message"] = "Invalid ID specified!";
         retMsg["code"] = WebApiError::InverterInvalidId;
         WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
@@ -305,16 +313,19 @@ void WebApiInverterClass::onInverterDelete(AsyncWebServerRequest* request)
     }
 
     uint8_t inverter_id = root["id"].as<uint8_t>();
-    INVERTER_CONFIG_T const& inverter = Configuration.get().Inverter[inverter_id];
 
-    Hoymiles.removeInverterBySerial(inverter.Serial);
-
-    Configuration.deleteInverterById(inverter_id);
+    {
+        auto guard = Configuration.getWriteGuard();
+        Configuration.deleteInverterById(inverter_id);
+    }
 
     WebApi.writeConfig(retMsg, WebApiError::InverterDeleted, "Inverter deleted!");
 
     WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
 
+    // Outside of the write guard, the main loop keeps running meanwhile
+    InverterSettings.applyInverterList();
+
     MqttHandleHass.forceUpdate();
 }
 
@@ -325,7 +336,8 @@ void WebApiInverterClass::onInverterOrder(AsyncWebServerRequest* request)
     }
 
     AsyncJsonResponse* response = new AsyncJsonResponse();
-    JsonDocument root;
+    JsonArena arena;
+    JsonDocument root(&arena);
     if (!WebApi.parseRequestData(request, response, root)) {
         return;
     }
@@ -348,7 +360,7 @@ void WebApiInverterClass::onInverterOrder(AsyncWebServerRequest* request)
 
         for (JsonVariant id : orderArray) {
             uint8_t inverter_id = id.as<uint8_t>();
-            if (inverter_id < INV_MAX_COUNT) {
+            if (inverter_id < config.Inverter.size()) {
                 INVERTER_CONFIG_T& inverter = config.Inverter[inverter_id];
                 inverter.Order = order;
             }
@@ -381,3 +393,79 @@ void WebApiInverterClass::onInverterStatReset(AsyncWebServerRequest* request)
 
     WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
 }
+
+void WebApiInverterClass::onInverterFocusGet(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentialsReadonly(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    auto& root = response->getRoot();
+    const FocusState_t focus = Hoymiles.getFocus();
+
+    root["active"] = focus.serial != 0;
+    if (focus.serial != 0) {
+        char buffer[sizeof(uint64_t) * 8 + 1];
+        snprintf(buffer, sizeof(buffer), "%0" PRIx32 "%08" PRIx32,
+            static_cast<uint32_t>((focus.serial >> 32) & 0xFFFFFFFF),
+            static_cast<uint32_t>(focus.serial & 0xFFFFFFFF));
+        root["serial"] = buffer;
+        const uint32_t elapsed = millis() - focus.start;
+        root["remaining"] = (focus.duration > elapsed ? focus.duration - elapsed : 0) / 1000;
+        root["requests"] = focus.requests;
+    }
+    root["max_duration"] = HOY_FOCUS_MAX_DURATION / 1000;
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
+
+void WebApiInverterClass::onInverterFocusPost(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentials(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    JsonArena arena;
+    JsonDocument root(&arena);
+    if (!WebApi.parseRequestData(request, response, root)) {
+        return;
+    }
+
+    auto& retMsg = response->getRoot();
+
+    if (!(root["serial"].is<String>() && root["duration"].is<uint32_t>())) {
+        retMsg["message"] = "Values are missing!";
+        retMsg["code"] = WebApiError::GenericValueMissing;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    // Interpret the string as a hex value and convert it to uint64_t
+    const uint64_t serial = strtoll(root["serial"].as<String>().c_str(), NULL, 16);
+    const uint32_t duration = root["duration"].as<uint32_t>();
+
+    // A duration of 0 ends the focus
+    if (duration == 0) {
+        Hoymiles.clearFocus();
+        retMsg["type"] = "success";
+        retMsg["message"] = "Focus stopped!";
+        retMsg["code"] = WebApiError::InverterFocusStopped;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    if (!Hoymiles.setFocus(serial, duration * 1000)) {
+        retMsg["message"] = "Invalid inverter specified!";
+        retMsg["code"] = WebApiError::InverterFocusInvalid;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    retMsg["type"] = "success";
+    retMsg["message"] = "Focus started!";
+    retMsg["code"] = WebApiError::InverterFocusStarted;
+    retMsg["param"]["max"] = HOY_FOCUS_MAX_DURATION / 1000;
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
@@ -3,6 +3,8 @@
  * Copyright (C) 2022-2024 Thomas Basler and others
  */
 #include "WebApi_limit.h"
+#include "Datastore.h"
+#include "JsonArena.h"
 #include "WebApi.h"
 #include "WebApi_errors.h"
 #include "defaults.h"
@@ -15,7 +17,7 @@ void WebApiLimitClass::init(AsyncWebServer& server, Scheduler& scheduler)
     using std::placeholders::_1;
 
     server.on("/api/limit/status", HTTP_GET, std::bind(&WebApiLimitClass::onLimitStatus, this, _1));
-    server.on("/api/limit/config", HTTP_POST, std::bind(&WebApiLimitClass::onLimitPost, this, _1));
+    server.on("/api/limit/config", HTTP_POST, std::bind(&WebApiLimitClass::onLimitPost, this, _1), nullptr, WebApiClass::onRequestBody);
 }
 
 void WebApiLimitClass::onLimitStatus(AsyncWebServerRequest* request)
@@ -27,15 +29,13 @@ void WebApiLimitClass::onLimitStatus(AsyncWebServerRequest* request)
     AsyncJsonResponse* response = new AsyncJsonResponse();
     auto& root = response->getRoot();
 
-    for (uint8_t i = 0; i < Hoymiles.getNumInverters(); i++) {
-        auto inv = Hoymiles.getInverterByPos(i);
+    Hoymiles.forEachInverter([&](InverterAbstract& inv, const uint8_t) {
+        const char* serial = inv.serialString();
 
-        String serial = inv->serialString();
+        root[serial]["limit_relative"] = inv.SystemConfigPara()->getLimitPercent();
+        root[serial]["max_power"] = inv.DevInfo()->getMaxPower();
 
-        root[serial]["limit_relative"] = inv->SystemConfigPara()->getLimitPercent();
-        root[serial]["max_power"] = inv->DevInfo()->getMaxPower();
-
-        LastCommandSuccess status = inv->SystemConfigPara()->getLastLimitCommandSuccess();
+        LastCommandSuccess status = inv.SystemConfigPara()->getLastLimitCommandSuccess();
         String limitStatus = "Unknown";
         if (status == LastCommandSuccess::CMD_OK) {
             limitStatus = "Ok";
@@ -45,7 +45,14 @@ void WebApiLimitClass::onLimitStatus(AsyncWebServerRequest* request)
             limitStatus = "Pending";
         }
         root[serial]["limit_set_status"] = limitStatus;
-    }
+
+        const LimitCommandStats_t& limitStats = inv.getLimitCommandStats();
+        JsonObject statsObj = root[serial]["limit_stats"].to<JsonObject>();
+        statsObj["requested"] = limitStats.Requested;
+        statsObj["sent"] = limitStats.Sent;
+        statsObj["coalesced"] = limitStats.Coalesced;
+        statsObj["suppressed"] = limitStats.Suppressed;
+    });
 
     WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
 }
@@ -57,14 +64,15 @@ void WebApiLimitClass::onLimitPost(AsyncWebServerRequest* request)
     }
 
     AsyncJsonResponse* response = new AsyncJsonResponse();
-    JsonDocument root;
+    JsonArena arena;
+    JsonDocument root(&arena);
     if (!WebApi.parseRequestData(request, response, root)) {
         return;
     }
 
     auto& retMsg = response->getRoot();
 
-    if (!(root["serial"].is<String>()
+    if (!((root["serial"].is<String>() || root["group"].is<uint8_t>())
             && root["limit_value"].is<float>()
             && root["limit_type"].is<uint16_t>())) {
         retMsg["message"] = "Values are missing!";
@@ -73,16 +81,6 @@ void WebApiLimitClass::onLimitPost(AsyncWebServerRequest* request)
         return;
     }
 
-    // Interpret the string as a hex value and convert it to uint64_t
-    const uint64_t serial = strtoll(root["serial"].as<String>().c_str(), NULL, 16);
-
-    if (serial == 0) {
-        retMsg["message"] = "Serial must be a number > 0!";
-        retMsg["code"] = WebApiError::LimitSerialZero;
-        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
-        return;
-    }
-
     if (root["limit_value"].as<float>() > MAX_INVERTER_LIMIT) {
         retMsg["message"] = "Limit must between 0 and " STR(MAX_INVERTER_LIMIT) "!";
         retMsg["code"] = WebApiError::LimitInvalidLimit;
@@ -105,6 +103,36 @@ void WebApiLimitClass::onLimitPost(AsyncWebServerRequest* request)
     float limit = root["limit_value"].as<float>();
     PowerLimitControlType type = root["limit_type"].as<PowerLimitControlType>();
 
+    // A group limit is split across all members of the group which accept commands
+    if (!root["serial"].is<String>()) {
+        const uint8_t group = root["group"].as<uint8_t>();
+        if (group == 0 || group > INV_MAX_GROUP_COUNT) {
+            retMsg["message"] = "Invalid group specified!";
+            retMsg["code"] = WebApiError::LimitInvalidGroup;
+            retMsg["param"]["max"] = INV_MAX_GROUP_COUNT;
+            WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+            return;
+        }
+
+        retMsg["inverters"] = Datastore.sendGroupLimit(group, limit, type);
+        retMsg["type"] = "success";
+        retMsg["message"] = "Settings saved!";
+        retMsg["code"] = WebApiError::GenericSuccess;
+
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    // Interpret the string as a hex value and convert it to uint64_t
+    const uint64_t serial = strtoll(root["serial"].as<String>().c_str(), NULL, 16);
+
+    if (serial == 0) {
+        retMsg["message"] = "Serial must be a number > 0!";
+        retMsg["code"] = WebApiError::LimitSerialZero;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
     auto inv = Hoymiles.getInverterBySerial(serial);
     if (inv == nullptr) {
         retMsg["message"] = "Invalid inverter specified!";
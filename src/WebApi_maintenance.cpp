@@ -4,6 +4,7 @@
  */
 
 #include "WebApi_maintenance.h"
+#include "JsonArena.h"
 #include "RestartHelper.h"
 #include "WebApi.h"
 #include "WebApi_errors.h"
@@ -13,7 +14,7 @@ void WebApiMaintenanceClass::init(AsyncWebServer& server, Scheduler& scheduler)
 {
     using std::placeholders::_1;
 
-    server.on("/api/maintenance/reboot", HTTP_POST, std::bind(&WebApiMaintenanceClass::onRebootPost, this, _1));
+    server.on("/api/maintenance/reboot", HTTP_POST, std::bind(&WebApiMaintenanceClass::onRebootPost, this, _1), nullptr, WebApiClass::onRequestBody);
 }
 
 void WebApiMaintenanceClass::onRebootPost(AsyncWebServerRequest* request)
@@ -23,7 +24,8 @@ void WebApiMaintenanceClass::onRebootPost(AsyncWebServerRequest* request)
     }
 
     AsyncJsonResponse* response = new AsyncJsonResponse();
-    JsonDocument root;
+    JsonArena arena;
+    JsonDocument root(&arena);
     if (!WebApi.parseRequestData(request, response, root)) {
         return;
     }
@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "WebApi_modbus.h"
+#include "Configuration.h"
+#include "JsonArena.h"
+#include "ModbusServer.h"
+#include "WebApi.h"
+#include "WebApi_errors.h"
+#include <AsyncJson.h>
+
+void WebApiModbusClass::init(AsyncWebServer& server, Scheduler& scheduler)
+{
+    using std::placeholders::_1;
+
+    server.on("/api/modbus/status", HTTP_GET, std::bind(&WebApiModbusClass::onModbusStatus, this, _1));
+    server.on("/api/modbus/config", HTTP_GET, std::bind(&WebApiModbusClass::onModbusAdminGet, this, _1));
+    server.on("/api/modbus/config", HTTP_POST, std::bind(&WebApiModbusClass::onModbusAdminPost, this, _1), nullptr, WebApiClass::onRequestBody);
+}
+
+void WebApiModbusClass::onModbusStatus(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentialsReadonly(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    auto& root = response->getRoot();
+    const CONFIG_T& config = Configuration.get();
+
+    const ModbusServerStats_t stats = ModbusServer.getStats();
+    root["enabled"] = config.Modbus.Enabled;
+    root["port"] = config.Modbus.Port;
+    root["allow_write"] = config.Modbus.AllowWrite;
+    root["clients"] = stats.Clients;
+    root["requests"] = stats.Requests;
+    root["exceptions"] = stats.Exceptions;
+    root["writes"] = stats.Writes;
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
+
+void WebApiModbusClass::onModbusAdminGet(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentials(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    auto& root = response->getRoot();
+    const CONFIG_T& config = Configuration.get();
+
+    root["enabled"] = config.Modbus.Enabled;
+    root["port"] = config.Modbus.Port;
+    root["allow_write"] = config.Modbus.AllowWrite;
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
+
+void WebApiModbusClass::onModbusAdminPost(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentials(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    JsonArena arena;
+    JsonDocument root(&arena);
+    if (!WebApi.parseRequestData(request, response, root)) {
+        return;
+    }
+
+    auto& retMsg = response->getRoot();
+
+    if (!(root["enabled"].is<bool>()
+            && root["port"].is<uint32_t>()
+            && root["allow_write"].is<bool>())) {
+        retMsg["message"] = "Values are missing!";
+        retMsg["code"] = WebApiError::GenericValueMissing;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    if (root["port"].as<uint32_t>() == 0 || root["port"].as<uint32_t>() > 65535) {
+        retMsg["message"] = "Port must be a number between 1 and 65535!";
+        retMsg["code"] = WebApiError::ModbusPortInvalid;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    {
+        auto guard = Configuration.getWriteGuard();
+        auto& config = guard.getConfig();
+
+        config.Modbus.Enabled = root["enabled"].as<bool>();
+        config.Modbus.Port = root["port"].as<uint32_t>();
+        config.Modbus.AllowWrite = root["allow_write"].as<bool>();
+    }
+
+    WebApi.writeConfig(retMsg);
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+
+    ModbusServer.reconfigure();
+}
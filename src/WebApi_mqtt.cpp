@@ -3,7 +3,11 @@
  * Copyright (C) 2022-2024 Thomas Basler and others
  */
 #include "WebApi_mqtt.h"
+#include "CertStore.h"
 #include "Configuration.h"
+#include "JsonArena.h"
+#include "MqttCluster.h"
+#include "MqttFleet.h"
 #include "MqttHandleHass.h"
 #include "MqttHandleInverter.h"
 #include "MqttSettings.h"
@@ -18,7 +22,7 @@ void WebApiMqttClass::init(AsyncWebServer& server, Scheduler& scheduler)
 
     server.on("/api/mqtt/status", HTTP_GET, std::bind(&WebApiMqttClass::onMqttStatus, this, _1));
     server.on("/api/mqtt/config", HTTP_GET, std::bind(&WebApiMqttClass::onMqttAdminGet, this, _1));
-    server.on("/api/mqtt/config", HTTP_POST, std::bind(&WebApiMqttClass::onMqttAdminPost, this, _1));
+    server.on("/api/mqtt/config", HTTP_POST, std::bind(&WebApiMqttClass::onMqttAdminPost, this, _1), nullptr, WebApiClass::onRequestBody);
 }
 
 void WebApiMqttClass::onMqttStatus(AsyncWebServerRequest* request)
@@ -40,9 +44,9 @@ void WebApiMqttClass::onMqttStatus(AsyncWebServerRequest* request)
     root["mqtt_connected"] = MqttSettings.getConnected();
     root["mqtt_retain"] = config.Mqtt.Retain;
     root["mqtt_tls"] = config.Mqtt.Tls.Enabled;
-    root["mqtt_root_ca_cert_info"] = getTlsCertInfo(config.Mqtt.Tls.RootCaCert);
+    root["mqtt_root_ca_cert_info"] = getTlsCertInfo(CertStore.read(Cert_t::MqttRootCa).c_str());
     root["mqtt_tls_cert_login"] = config.Mqtt.Tls.CertLogin;
-    root["mqtt_client_cert_info"] = getTlsCertInfo(config.Mqtt.Tls.ClientCert);
+    root["mqtt_client_cert_info"] = getTlsCertInfo(CertStore.read(Cert_t::MqttClientCert).c_str());
     root["mqtt_lwt_topic"] = String(config.Mqtt.Topic) + config.Mqtt.Lwt.Topic;
     root["mqtt_publish_interval"] = config.Mqtt.PublishInterval;
     root["mqtt_clean_session"] = config.Mqtt.CleanSession;
@@ -51,6 +55,25 @@ void WebApiMqttClass::onMqttStatus(AsyncWebServerRequest* request)
     root["mqtt_hass_retain"] = config.Mqtt.Hass.Retain;
     root["mqtt_hass_topic"] = config.Mqtt.Hass.Topic;
     root["mqtt_hass_individualpanels"] = config.Mqtt.Hass.IndividualPanels;
+    root["mqtt_hass_device_discovery"] = config.Mqtt.Hass.DeviceDiscovery;
+
+    const MqttClusterStatus_t cluster = MqttCluster.getStatus();
+    root["mqtt_cluster_enabled"] = cluster.Enabled;
+    root["mqtt_cluster_topic"] = config.Mqtt.Cluster.Topic;
+    root["mqtt_cluster_node"] = cluster.NodeId;
+    root["mqtt_cluster_leader"] = cluster.LeaderId;
+    root["mqtt_cluster_nodes"] = cluster.NodeCount;
+    root["mqtt_cluster_owned"] = cluster.OwnedInverters;
+    root["mqtt_cluster_assigned"] = cluster.AssignedInverters;
+
+    root["mqtt_fleet_publish"] = config.Mqtt.Fleet.Publish;
+    root["mqtt_fleet_aggregate"] = config.Mqtt.Fleet.Aggregate;
+    root["mqtt_fleet_topic"] = config.Mqtt.Fleet.Topic;
+    if (config.Mqtt.Fleet.Aggregate) {
+        const MqttFleetTotal_t fleet = MqttFleet.getTotal();
+        root["mqtt_fleet_dtus"] = fleet.DtuCount;
+        root["mqtt_fleet_dtus_online"] = fleet.DtusOnline;
+    }
 
     WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
 }
@@ -74,21 +97,35 @@ void WebApiMqttClass::onMqttAdminGet(AsyncWebServerRequest* request)
     root["mqtt_topic"] = config.Mqtt.Topic;
     root["mqtt_retain"] = config.Mqtt.Retain;
     root["mqtt_tls"] = config.Mqtt.Tls.Enabled;
-    root["mqtt_root_ca_cert"] = config.Mqtt.Tls.RootCaCert;
+    root["mqtt_root_ca_cert"] = CertStore.read(Cert_t::MqttRootCa);
     root["mqtt_tls_cert_login"] = config.Mqtt.Tls.CertLogin;
-    root["mqtt_client_cert"] = config.Mqtt.Tls.ClientCert;
-    root["mqtt_client_key"] = config.Mqtt.Tls.ClientKey;
+    root["mqtt_client_cert"] = CertStore.read(Cert_t::MqttClientCert);
+    root["mqtt_client_key"] = CertStore.read(Cert_t::MqttClientKey);
     root["mqtt_lwt_topic"] = config.Mqtt.Lwt.Topic;
     root["mqtt_lwt_online"] = config.Mqtt.Lwt.Value_Online;
     root["mqtt_lwt_offline"] = config.Mqtt.Lwt.Value_Offline;
     root["mqtt_lwt_qos"] = config.Mqtt.Lwt.Qos;
     root["mqtt_publish_interval"] = config.Mqtt.PublishInterval;
     root["mqtt_clean_session"] = config.Mqtt.CleanSession;
+    root["mqtt_publish_on_change"] = config.Mqtt.PublishOnChange;
+    root["mqtt_json_payload"] = config.Mqtt.JsonPayload;
+    root["mqtt_fast_lane_total_ac_power"] = config.Mqtt.FastLane.TotalAcPower;
+    root["mqtt_fast_lane_total_dc_power"] = config.Mqtt.FastLane.TotalDcPower;
+    root["mqtt_fast_lane_ac_power"] = config.Mqtt.FastLane.AcPower;
+    root["mqtt_fast_lane_dc_power"] = config.Mqtt.FastLane.DcPower;
+    root["mqtt_journal_enabled"] = config.Mqtt.Journal.Enabled;
+    root["mqtt_journal_replay_rate"] = config.Mqtt.Journal.ReplayRate;
+    root["mqtt_cluster_enabled"] = config.Mqtt.Cluster.Enabled;
+    root["mqtt_cluster_topic"] = config.Mqtt.Cluster.Topic;
+    root["mqtt_fleet_publish"] = config.Mqtt.Fleet.Publish;
+    root["mqtt_fleet_aggregate"] = config.Mqtt.Fleet.Aggregate;
+    root["mqtt_fleet_topic"] = config.Mqtt.Fleet.Topic;
     root["mqtt_hass_enabled"] = config.Mqtt.Hass.Enabled;
     root["mqtt_hass_expire"] = config.Mqtt.Hass.Expire;
     root["mqtt_hass_retain"] = config.Mqtt.Hass.Retain;
     root["mqtt_hass_topic"] = config.Mqtt.Hass.Topic;
     root["mqtt_hass_individualpanels"] = config.Mqtt.Hass.IndividualPanels;
+    root["mqtt_hass_device_discovery"] = config.Mqtt.Hass.DeviceDiscovery;
 
     WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
 }
@@ -100,7 +137,8 @@ void WebApiMqttClass::onMqttAdminPost(AsyncWebServerRequest* request)
     }
 
     AsyncJsonResponse* response = new AsyncJsonResponse();
-    JsonDocument root;
+    JsonArena arena;
+    JsonDocument root(&arena);
     if (!WebApi.parseRequestData(request, response, root)) {
         return;
     }
@@ -125,11 +163,25 @@ void WebApiMqttClass::onMqttAdminPost(AsyncWebServerRequest* request)
             && root["mqtt_lwt_qos"].is<uint8_t>()
             && root["mqtt_publish_interval"].is<uint32_t>()
             && root["mqtt_clean_session"].is<bool>()
+            && root["mqtt_publish_on_change"].is<bool>()
+            && root["mqtt_json_payload"].is<bool>()
+            && root["mqtt_fast_lane_total_ac_power"].is<bool>()
+            && root["mqtt_fast_lane_total_dc_power"].is<bool>()
+            && root["mqtt_fast_lane_ac_power"].is<bool>()
+            && root["mqtt_fast_lane_dc_power"].is<bool>()
+            && root["mqtt_journal_enabled"].is<bool>()
+            && root["mqtt_journal_replay_rate"].is<uint16_t>()
+            && root["mqtt_cluster_enabled"].is<bool>()
+            && root["mqtt_cluster_topic"].is<String>()
+            && root["mqtt_fleet_publish"].is<bool>()
+            && root["mqtt_fleet_aggregate"].is<bool>()
+            && root["mqtt_fleet_topic"].is<String>()
             && root["mqtt_hass_enabled"].is<bool>()
             && root["mqtt_hass_expire"].is<bool>()
             && root["mqtt_hass_retain"].is<bool>()
             && root["mqtt_hass_topic"].is<String>()
-            && root["mqtt_hass_individualpanels"].is<bool>())) {
+            && root["mqtt_hass_individualpanels"].is<bool>()
+            && root["mqtt_hass_device_discovery"].is<bool>())) {
         retMsg["message"] = "Values are missing!";
         retMsg["code"] = WebApiError::GenericValueMissing;
         WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
@@ -253,6 +305,63 @@ void WebApiMqttClass::onMqttAdminPost(AsyncWebServerRequest* request)
             return;
         }
 
+        if (root["mqtt_journal_replay_rate"].as<uint16_t>() < 1 || root["mqtt_journal_replay_rate"].as<uint16_t>() > 100) {
+            retMsg["message"] = "Journal replay rate must be a number between 1 and 100!";
+            retMsg["code"] = WebApiError::MqttJournalReplayRate;
+            retMsg["param"]["min"] = 1;
+            retMsg["param"]["max"] = 100;
+            WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+            return;
+        }
+
+        if (root["mqtt_cluster_enabled"].as<bool>()) {
+            if (root["mqtt_cluster_topic"].as<String>().length() == 0 || root["mqtt_cluster_topic"].as<String>().length() > MQTT_MAX_TOPIC_STRLEN) {
+                retMsg["message"] = "Cluster topic must be between 1 and " STR(MQTT_MAX_TOPIC_STRLEN) " characters long!";
+                retMsg["code"] = WebApiError::MqttClusterTopicLength;
+                retMsg["param"]["max"] = MQTT_MAX_TOPIC_STRLEN;
+                WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+                return;
+            }
+
+            if (root["mqtt_cluster_topic"].as<String>().indexOf(' ') != -1) {
+                retMsg["message"] = "Cluster topic must not contain space characters!";
+                retMsg["code"] = WebApiError::MqttClusterTopicCharacter;
+                WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+                return;
+            }
+
+            if (!root["mqtt_cluster_topic"].as<String>().endsWith("/")) {
+                retMsg["message"] = "Cluster topic must end with a slash (/)!";
+                retMsg["code"] = WebApiError::MqttClusterTopicTrailingSlash;
+                WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+                return;
+            }
+        }
+
+        if (root["mqtt_fleet_publish"].as<bool>() || root["mqtt_fleet_aggregate"].as<bool>()) {
+            if (root["mqtt_fleet_topic"].as<String>().length() == 0 || root["mqtt_fleet_topic"].as<String>().length() > MQTT_MAX_TOPIC_STRLEN) {
+                retMsg["message"] = "Fleet topic must be between 1 and " STR(MQTT_MAX_TOPIC_STRLEN) " characters long!";
+                retMsg["code"] = WebApiError::MqttFleetTopicLength;
+                retMsg["param"]["max"] = MQTT_MAX_TOPIC_STRLEN;
+                WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+                return;
+            }
+
+            if (root["mqtt_fleet_topic"].as<String>().indexOf(' ') != -1) {
+                retMsg["message"] = "Fleet topic must not contain space characters!";
+                retMsg["code"] = WebApiError::MqttFleetTopicCharacter;
+                WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+                return;
+            }
+
+            if (!root["mqtt_fleet_topic"].as<String>().endsWith("/")) {
+                retMsg["message"] = "Fleet topic must end with a slash (/)!";
+                retMsg["code"] = WebApiError::MqttFleetTopicTrailingSlash;
+                WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+                return;
+            }
+        }
+
         if (root["mqtt_hass_enabled"].as<bool>()) {
             if (root["mqtt_hass_topic"].as<String>().length() > MQTT_MAX_TOPIC_STRLEN) {
                 retMsg["message"] = "Hass topic must not be longer than " STR(MQTT_MAX_TOPIC_STRLEN) " characters!";
@@ -271,6 +380,11 @@ void WebApiMqttClass::onMqttAdminPost(AsyncWebServerRequest* request)
         }
     }
 
+    // Written to their files before the configuration is locked, unchanged ones are not written again
+    const uint32_t rootCaCert = CertStore.write(Cert_t::MqttRootCa, root["mqtt_root_ca_cert"].as<String>().c_str());
+    const uint32_t clientCert = CertStore.write(Cert_t::MqttClientCert, root["mqtt_client_cert"].as<String>().c_str());
+    const uint32_t clientKey = CertStore.write(Cert_t::MqttClientKey, root["mqtt_client_key"].as<String>().c_str());
+
     {
         auto guard = Configuration.getWriteGuard();
         auto& config = guard.getConfig();
@@ -278,10 +392,10 @@ void WebApiMqttClass::onMqttAdminPost(AsyncWebServerRequest* request)
         config.Mqtt.Enabled = root["mqtt_enabled"].as<bool>();
         config.Mqtt.Retain = root["mqtt_retain"].as<bool>();
         config.Mqtt.Tls.Enabled = root["mqtt_tls"].as<bool>();
-        strlcpy(config.Mqtt.Tls.RootCaCert, root["mqtt_root_ca_cert"].as<String>().c_str(), sizeof(config.Mqtt.Tls.RootCaCert));
+        config.Mqtt.Tls.RootCaCert = rootCaCert;
         config.Mqtt.Tls.CertLogin = root["mqtt_tls_cert_login"].as<bool>();
-        strlcpy(config.Mqtt.Tls.ClientCert, root["mqtt_client_cert"].as<String>().c_str(), sizeof(config.Mqtt.Tls.ClientCert));
-        strlcpy(config.Mqtt.Tls.ClientKey, root["mqtt_client_key"].as<String>().c_str(), sizeof(config.Mqtt.Tls.ClientKey));
+        config.Mqtt.Tls.ClientCert = clientCert;
+        config.Mqtt.Tls.ClientKey = clientKey;
         config.Mqtt.Port = root["mqtt_port"].as<uint>();
         strlcpy(config.Mqtt.Hostname, root["mqtt_hostname"].as<String>().c_str(), sizeof(config.Mqtt.Hostname));
         strlcpy(config.Mqtt.ClientId, root["mqtt_clientid"].as<String>().c_str(), sizeof(config.Mqtt.ClientId));
@@ -293,10 +407,38 @@ void WebApiMqttClass::onMqttAdminPost(AsyncWebServerRequest* request)
         config.Mqtt.Lwt.Qos = root["mqtt_lwt_qos"].as<uint8_t>();
         config.Mqtt.PublishInterval = root["mqtt_publish_interval"].as<uint32_t>();
         config.Mqtt.CleanSession = root["mqtt_clean_session"].as<bool>();
+        config.Mqtt.PublishOnChange = root["mqtt_publish_on_change"].as<bool>();
+        config.Mqtt.JsonPayload = root["mqtt_json_payload"].as<bool>();
+        config.Mqtt.FastLane.TotalAcPower = root["mqtt_fast_lane_total_ac_power"].as<bool>();
+        config.Mqtt.FastLane.TotalDcPower = root["mqtt_fast_lane_total_dc_power"].as<bool>();
+        config.Mqtt.FastLane.AcPower = root["mqtt_fast_lane_ac_power"].as<bool>();
+        config.Mqtt.FastLane.DcPower = root["mqtt_fast_lane_dc_power"].as<bool>();
+        config.Mqtt.Journal.Enabled = root["mqtt_journal_enabled"].as<bool>();
+        config.Mqtt.Journal.ReplayRate = root["mqtt_journal_replay_rate"].as<uint16_t>();
+
+        // Check if the cluster was switched or moved to another topic
+        if (config.Mqtt.Cluster.Enabled != root["mqtt_cluster_enabled"].as<bool>()
+            || strcmp(config.Mqtt.Cluster.Topic, root["mqtt_cluster_topic"].as<String>().c_str())) {
+            MqttCluster.unsubscribeTopics();
+            config.Mqtt.Cluster.Enabled = root["mqtt_cluster_enabled"].as<bool>();
+            strlcpy(config.Mqtt.Cluster.Topic, root["mqtt_cluster_topic"].as<String>().c_str(), sizeof(config.Mqtt.Cluster.Topic));
+            MqttCluster.subscribeTopics();
+        }
+
+        // Only the aggregator subscribes to the snapshots
+        config.Mqtt.Fleet.Publish = root["mqtt_fleet_publish"].as<bool>();
+        if (config.Mqtt.Fleet.Aggregate != root["mqtt_fleet_aggregate"].as<bool>()
+            || strcmp(config.Mqtt.Fleet.Topic, root["mqtt_fleet_topic"].as<String>().c_str())) {
+            MqttFleet.unsubscribeTopics();
+            config.Mqtt.Fleet.Aggregate = root["mqtt_fleet_aggregate"].as<bool>();
+            strlcpy(config.Mqtt.Fleet.Topic, root["mqtt_fleet_topic"].as<String>().c_str(), sizeof(config.Mqtt.Fleet.Topic));
+            MqttFleet.subscribeTopics();
+        }
         config.Mqtt.Hass.Enabled = root["mqtt_hass_enabled"].as<bool>();
         config.Mqtt.Hass.Expire = root["mqtt_hass_expire"].as<bool>();
         config.Mqtt.Hass.Retain = root["mqtt_hass_retain"].as<bool>();
         config.Mqtt.Hass.IndividualPanels = root["mqtt_hass_individualpanels"].as<bool>();
+        config.Mqtt.Hass.DeviceDiscovery = root["mqtt_hass_device_discovery"].as<bool>();
         strlcpy(config.Mqtt.Hass.Topic, root["mqtt_hass_topic"].as<String>().c_str(), sizeof(config.Mqtt.Hass.Topic));
 
         // Check if base topic was changed
@@ -4,14 +4,16 @@
  */
 #include "WebApi_network.h"
 #include "Configuration.h"
+#include "JsonArena.h"
 #include "NetworkSettings.h"
+#include "TaskProfiler.h"
 #include "WebApi.h"
 #include "WebApi_errors.h"
 #include "helper.h"
 #include <AsyncJson.h>
 
 WebApiNetworkClass::WebApiNetworkClass()
-    : _applyDataTask(500 * TASK_MILLISECOND, TASK_ONCE, std::bind(&WebApiNetworkClass::applyDataTaskCb, this))
+    : _applyDataTask(500 * TASK_MILLISECOND, TASK_ONCE)
 {
 }
 
@@ -21,9 +23,10 @@ void WebApiNetworkClass::init(AsyncWebServer& server, Scheduler& scheduler)
 
     server.on("/api/network/status", HTTP_GET, std::bind(&WebApiNetworkClass::onNetworkStatus, this, _1));
     server.on("/api/network/config", HTTP_GET, std::bind(&WebApiNetworkClass::onNetworkAdminGet, this, _1));
-    server.on("/api/network/config", HTTP_POST, std::bind(&WebApiNetworkClass::onNetworkAdminPost, this, _1));
+    server.on("/api/network/config", HTTP_POST, std::bind(&WebApiNetworkClass::onNetworkAdminPost, this, _1), nullptr, WebApiClass::onRequestBody);
 
     scheduler.addTask(_applyDataTask);
+    TaskProfiler.setCallback(_applyDataTask, "WebApiNetwork.applyData", std::bind(&WebApiNetworkClass::applyDataTaskCb, this));
 }
 
 void WebApiNetworkClass::onNetworkStatus(AsyncWebServerRequest* request)
@@ -88,7 +91,8 @@ void WebApiNetworkClass::onNetworkAdminPost(AsyncWebServerRequest* request)
     }
 
     AsyncJsonResponse* response = new AsyncJsonResponse();
-    JsonDocument root;
+    JsonArena arena;
+    JsonDocument root(&arena);
     if (!WebApi.parseRequestData(request, response, root)) {
         return;
     }
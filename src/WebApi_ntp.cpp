@@ -4,6 +4,7 @@
  */
 #include "WebApi_ntp.h"
 #include "Configuration.h"
+#include "JsonArena.h"
 #include "NtpSettings.h"
 #include "SunPosition.h"
 #include "WebApi.h"
@@ -17,9 +18,9 @@ void WebApiNtpClass::init(AsyncWebServer& server, Scheduler& scheduler)
 
     server.on("/api/ntp/status", HTTP_GET, std::bind(&WebApiNtpClass::onNtpStatus, this, _1));
     server.on("/api/ntp/config", HTTP_GET, std::bind(&WebApiNtpClass::onNtpAdminGet, this, _1));
-    server.on("/api/ntp/config", HTTP_POST, std::bind(&WebApiNtpClass::onNtpAdminPost, this, _1));
+    server.on("/api/ntp/config", HTTP_POST, std::bind(&WebApiNtpClass::onNtpAdminPost, this, _1), nullptr, WebApiClass::onRequestBody);
     server.on("/api/ntp/time", HTTP_GET, std::bind(&WebApiNtpClass::onNtpTimeGet, this, _1));
-    server.on("/api/ntp/time", HTTP_POST, std::bind(&WebApiNtpClass::onNtpTimePost, this, _1));
+    server.on("/api/ntp/time", HTTP_POST, std::bind(&WebApiNtpClass::onNtpTimePost, this, _1), nullptr, WebApiClass::onRequestBody);
 }
 
 void WebApiNtpClass::onNtpStatus(AsyncWebServerRequest* request)
@@ -36,12 +37,15 @@ void WebApiNtpClass::onNtpStatus(AsyncWebServerRequest* request)
     root["ntp_timezone"] = config.Ntp.Timezone;
     root["ntp_timezone_descr"] = config.Ntp.TimezoneDescr;
 
+    // An estimated time is used for polling but does not count as synced
     struct tm timeinfo;
-    if (!getLocalTime(&timeinfo, 5)) {
+    if (!NtpSettings.getLocalTime(&timeinfo)) {
         root["ntp_status"] = false;
     } else {
-        root["ntp_status"] = true;
+        root["ntp_status"] = NtpSettings.isTimeConfident();
     }
+    root["time_source"] = NtpSettingsClass::getTimeSourceName(NtpSettings.getTimeSource());
+    root["time_confident"] = NtpSettings.isTimeConfident();
     char timeStringBuff[50];
     strftime(timeStringBuff, sizeof(timeStringBuff), "%A, %B %d %Y %H:%M:%S", &timeinfo);
     root["ntp_localtime"] = timeStringBuff;
@@ -93,7 +97,8 @@ void WebApiNtpClass::onNtpAdminPost(AsyncWebServerRequest* request)
     }
 
     AsyncJsonResponse* response = new AsyncJsonResponse();
-    JsonDocument root;
+    JsonArena arena;
+    JsonDocument root(&arena);
     if (!WebApi.parseRequestData(request, response, root)) {
         return;
     }
@@ -167,10 +172,10 @@ void WebApiNtpClass::onNtpTimeGet(AsyncWebServerRequest* request)
     auto& root = response->getRoot();
 
     struct tm timeinfo;
-    if (!getLocalTime(&timeinfo, 5)) {
+    if (!NtpSettings.getLocalTime(&timeinfo)) {
         root["ntp_status"] = false;
     } else {
-        root["ntp_status"] = true;
+        root["ntp_status"] = NtpSettings.isTimeConfident();
     }
 
     root["year"] = timeinfo.tm_year + 1900;
@@ -190,7 +195,8 @@ void WebApiNtpClass::onNtpTimePost(AsyncWebServerRequest* request)
     }
 
     AsyncJsonResponse* response = new AsyncJsonResponse();
-    JsonDocument root;
+    JsonArena arena;
+    JsonDocument root(&arena);
     if (!WebApi.parseRequestData(request, response, root)) {
         return;
     }
@@ -272,9 +278,7 @@ void WebApiNtpClass::onNtpTimePost(AsyncWebServerRequest* request)
     local.tm_year = root["year"].as<uint>() - 1900; // years since 1900
     local.tm_isdst = -1;
 
-    time_t t = mktime(&local);
-    struct timeval now = { .tv_sec = t, .tv_usec = 0 };
-    settimeofday(&now, NULL);
+    NtpSettings.setManualTime(mktime(&local));
 
     retMsg["type"] = "success";
     retMsg["message"] = "Time updated!";
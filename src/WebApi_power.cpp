@@ -3,6 +3,7 @@
  * Copyright (C) 2022-2024 Thomas Basler and others
  */
 #include "WebApi_power.h"
+#include "JsonArena.h"
 #include "WebApi.h"
 #include "WebApi_errors.h"
 #include <AsyncJson.h>
@@ -13,7 +14,7 @@ void WebApiPowerClass::init(AsyncWebServer& server, Scheduler& scheduler)
     using std::placeholders::_1;
 
     server.on("/api/power/status", HTTP_GET, std::bind(&WebApiPowerClass::onPowerStatus, this, _1));
-    server.on("/api/power/config", HTTP_POST, std::bind(&WebApiPowerClass::onPowerPost, this, _1));
+    server.on("/api/power/config", HTTP_POST, std::bind(&WebApiPowerClass::onPowerPost, this, _1), nullptr, WebApiClass::onRequestBody);
 }
 
 void WebApiPowerClass::onPowerStatus(AsyncWebServerRequest* request)
@@ -25,10 +26,8 @@ void WebApiPowerClass::onPowerStatus(AsyncWebServerRequest* request)
     AsyncJsonResponse* response = new AsyncJsonResponse();
     auto& root = response->getRoot();
 
-    for (uint8_t i = 0; i < Hoymiles.getNumInverters(); i++) {
-        auto inv = Hoymiles.getInverterByPos(i);
-
-        LastCommandSuccess status = inv->PowerCommand()->getLastPowerCommandSuccess();
+    Hoymiles.forEachInverter([&](InverterAbstract& inv, const uint8_t) {
+        LastCommandSuccess status = inv.PowerCommand()->getLastPowerCommandSuccess();
         String limitStatus = "Unknown";
         if (status == LastCommandSuccess::CMD_OK) {
             limitStatus = "Ok";
@@ -37,8 +36,8 @@ void WebApiPowerClass::onPowerStatus(AsyncWebServerRequest* request)
         } else if (status == LastCommandSuccess::CMD_PENDING) {
             limitStatus = "Pending";
         }
-        root[inv->serialString()]["power_set_status"] = limitStatus;
-    }
+        root[inv.serialString()]["power_set_status"] = limitStatus;
+    });
 
     WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
 }
@@ -50,7 +49,8 @@ void WebApiPowerClass::onPowerPost(AsyncWebServerRequest* request)
     }
 
     AsyncJsonResponse* response = new AsyncJsonResponse();
-    JsonDocument root;
+    JsonArena arena;
+    JsonDocument root(&arena);
     if (!WebApi.parseRequestData(request, response, root)) {
         return;
     }
@@ -0,0 +1,183 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "WebApi_powercontrol.h"
+#include "Configuration.h"
+#include "JsonArena.h"
+#include "PowerController.h"
+#include "WebApi.h"
+#include "WebApi_errors.h"
+#include "helper.h"
+#include <AsyncJson.h>
+#include <cmath>
+
+// Upper bound of the controller gains, higher values only make the loop oscillate
+#define POWERCTRL_MAX_GAIN 10
+
+void WebApiPowerControlClass::init(AsyncWebServer& server, Scheduler& scheduler)
+{
+    using std::placeholders::_1;
+
+    server.on("/api/powercontrol/status", HTTP_GET, std::bind(&WebApiPowerControlClass::onPowerControlStatus, this, _1));
+    server.on("/api/powercontrol/config", HTTP_GET, std::bind(&WebApiPowerControlClass::onPowerControlAdminGet, this, _1));
+    server.on("/api/powercontrol/config", HTTP_POST, std::bind(&WebApiPowerControlClass::onPowerControlAdminPost, this, _1), nullptr, WebApiClass::onRequestBody);
+    server.on("/api/powercontrol/meter", HTTP_POST, std::bind(&WebApiPowerControlClass::onPowerControlMeterPost, this, _1), nullptr, WebApiClass::onRequestBody);
+}
+
+void WebApiPowerControlClass::onPowerControlStatus(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentialsReadonly(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    auto& root = response->getRoot();
+
+    const PowerControllerStatus_t status = PowerController.getStatus();
+    root["enabled"] = status.Enabled;
+    root["active"] = status.Active;
+    root["grid_power"] = status.GridPower;
+    root["grid_power_age"] = status.GridPowerAge;
+    root["output"] = status.Output;
+    root["inverter_count"] = status.InverterCount;
+    root["command_count"] = status.CommandCount;
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
+
+void WebApiPowerControlClass::onPowerControlAdminGet(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentials(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    auto& root = response->getRoot();
+    const CONFIG_T& config = Configuration.get();
+
+    root["enabled"] = config.PowerControl.Enabled;
+    root["meter_topic"] = config.PowerControl.MeterTopic;
+    root["target_power"] = config.PowerControl.TargetPower;
+    root["kp"] = config.PowerControl.Kp;
+    root["ki"] = config.PowerControl.Ki;
+    root["meter_timeout"] = config.PowerControl.MeterTimeout;
+    root["min_limit"] = config.PowerControl.MinLimit;
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
+
+void WebApiPowerControlClass::onPowerControlAdminPost(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentials(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    JsonArena arena;
+    JsonDocument root(&arena);
+    if (!WebApi.parseRequestData(request, response, root)) {
+        return;
+    }
+
+    auto& retMsg = response->getRoot();
+
+    if (!(root["enabled"].is<bool>()
+            && root["meter_topic"].is<String>()
+            && root["target_power"].is<int32_t>()
+            && root["kp"].is<float>()
+            && root["ki"].is<float>()
+            && root["meter_timeout"].is<uint32_t>()
+            && root["min_limit"].is<uint8_t>())) {
+        retMsg["message"] = "Values are missing!";
+        retMsg["code"] = WebApiError::GenericValueMissing;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    const String topic = root["meter_topic"].as<String>();
+    if (topic.length() > POWERCTRL_MAX_TOPIC_STRLEN
+        || (root["enabled"].as<bool>() && topic.length() == 0)) {
+        retMsg["message"] = "Meter topic must between 1 and " STR(POWERCTRL_MAX_TOPIC_STRLEN) " characters long!";
+        retMsg["code"] = WebApiError::PowerControlTopicLength;
+        retMsg["param"]["max"] = POWERCTRL_MAX_TOPIC_STRLEN;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    const float kp = root["kp"].as<float>();
+    const float ki = root["ki"].as<float>();
+    if (!(kp >= 0 && kp <= POWERCTRL_MAX_GAIN && ki >= 0 && ki <= POWERCTRL_MAX_GAIN)) {
+        retMsg["message"] = "Gains must be between 0 and " STR(POWERCTRL_MAX_GAIN) "!";
+        retMsg["code"] = WebApiError::PowerControlGainInvalid;
+        retMsg["param"]["max"] = POWERCTRL_MAX_GAIN;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    if (root["min_limit"].as<uint8_t>() > 100) {
+        retMsg["message"] = "Minimum limit must be between 0 and 100 %!";
+        retMsg["code"] = WebApiError::PowerControlMinLimitInvalid;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    if (root["meter_timeout"].as<uint32_t>() == 0) {
+        retMsg["message"] = "Meter timeout must be larger than 0!";
+        retMsg["code"] = WebApiError::PowerControlTimeoutZero;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    {
+        auto guard = Configuration.getWriteGuard();
+        auto& config = guard.getConfig();
+
+        config.PowerControl.Enabled = root["enabled"].as<bool>();
+        strlcpy(config.PowerControl.MeterTopic, topic.c_str(), sizeof(config.PowerControl.MeterTopic));
+        config.PowerControl.TargetPower = root["target_power"].as<int32_t>();
+        config.PowerControl.Kp = kp;
+        config.PowerControl.Ki = ki;
+        config.PowerControl.MeterTimeout = root["meter_timeout"].as<uint32_t>();
+        config.PowerControl.MinLimit = root["min_limit"].as<uint8_t>();
+    }
+
+    WebApi.writeConfig(retMsg);
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+
+    PowerController.unsubscribeTopics();
+    PowerController.subscribeTopics();
+}
+
+// Meter values from sources without MqTT: {"power": <W>}, positive when drawing from the grid
+void WebApiPowerControlClass::onPowerControlMeterPost(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentials(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    JsonArena arena;
+    JsonDocument root(&arena);
+    if (!WebApi.parseRequestData(request, response, root)) {
+        return;
+    }
+
+    auto& retMsg = response->getRoot();
+
+    if (!root["power"].is<float>() || !std::isfinite(root["power"].as<float>())) {
+        retMsg["message"] = "Values are missing!";
+        retMsg["code"] = WebApiError::GenericValueMissing;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    PowerController.setGridPower(root["power"].as<float>());
+
+    retMsg["type"] = "success";
+    retMsg["message"] = "Meter value received!";
+    retMsg["code"] = WebApiError::PowerControlMeterReceived;
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
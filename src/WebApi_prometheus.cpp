@@ -4,12 +4,35 @@
  * Copyright (C) 2022-2025 Thomas Basler and others
  */
 #include "WebApi_prometheus.h"
+#include "AdmissionControl.h"
 #include "Configuration.h"
+#include "CpuLoad.h"
+#include "DataFreshness.h"
+#include "Datastore.h"
+#include "EventBus.h"
+#include "FieldRecord.h"
+#include "FlashWear.h"
+#include "HeapTelemetry.h"
+#include "InfluxExport.h"
+#include "LoopMonitor.h"
 #include "MessageOutput.h"
+#include "ModbusServer.h"
+#include "MqttCluster.h"
+#include "MqttFleet.h"
+#include "MqttSettings.h"
 #include "NetworkSettings.h"
+#include "PublishCoordinator.h"
+#include "RawStatsExport.h"
+#include "PollCalibration.h"
+#include "PowerManagement.h"
+#include "ResourceGovernor.h"
+#include "ResponseCache.h"
+#include "SyslogExport.h"
+#include "TaskProfiler.h"
 #include "WebApi.h"
 #include "__compiled_constants.h"
 #include <Hoymiles.h>
+#include <algorithm>
 
 void WebApiPrometheusClass::init(AsyncWebServer& server, Scheduler& scheduler)
 {
@@ -20,146 +43,460 @@ void WebApiPrometheusClass::init(AsyncWebServer& server, Scheduler& scheduler)
 
 void WebApiPrometheusClass::onPrometheusMetricsGet(AsyncWebServerRequest* request)
 {
-    static size_t initialResponseBufferSize = 1024;
-
     if (!WebApi.checkCredentialsReadonly(request)) {
         return;
     }
 
+    const bool gzip = WebApi.acceptsGzip(request);
+    const uint32_t ttl = Configuration.get().Prometheus.CacheTtl;
+    const String key = ResponseCache.getKey(request);
+    const uint32_t generation = getStatisticsGeneration();
+    const uint32_t now = millis();
+
+    // Outdated bodies are released right away instead of waiting until they are replaced
+    for (auto& entry : _scrapeCache) {
+        if (entry.Body != nullptr && (entry.Generation != generation || now - entry.Created >= ttl)) {
+            entry.Body.reset();
+            entry.Key = String();
+        }
+    }
+
+    if (ttl > 0) {
+        for (const auto& entry : _scrapeCache) {
+            if (entry.Body != nullptr && entry.Gzip == gzip && entry.Key == key) {
+                _scrapeCacheHits++;
+                sendBody(request, entry.Body, gzip);
+                return;
+            }
+        }
+        _scrapeCacheMisses++;
+    }
+
     try {
-        auto stream = request->beginResponseStream("text/plain; charset=utf-8", initialResponseBufferSize);
+        // Text of repeating lines shrinks to a fraction
+        ScrapeBuffer buffer(gzip, gzip ? estimateResponseSize() / 4 : estimateResponseSize());
+        render(buffer, request);
+        auto body = std::make_shared<const std::vector<uint8_t>>(buffer.finish());
 
-        stream->print("# HELP opendtu_build Build info\n");
-        stream->print("# TYPE opendtu_build gauge\n");
-        stream->printf("opendtu_build{name=\"%s\",id=\"%s\",version=\"%d.%d.%d\"} 1\n",
-            NetworkSettings.getHostname().c_str(), __COMPILED_GIT_HASH__, CONFIG_VERSION >> 24 & 0xff, CONFIG_VERSION >> 16 & 0xff, CONFIG_VERSION >> 8 & 0xff);
+        if (ttl > 0) {
+            // A free entry is used first, otherwise the oldest one is replaced
+            auto oldest = std::min_element(_scrapeCache.begin(), _scrapeCache.end(), [now](const auto& a, const auto& b) {
+                if (a.Body == nullptr || b.Body == nullptr) {
+                    return a.Body == nullptr && b.Body != nullptr;
+                }
+                return now - a.Created > now - b.Created;
+            });
+            oldest->Key = key;
+            oldest->Gzip = gzip;
+            oldest->Created = now;
+            oldest->Generation = generation;
+            oldest->Body = body;
+        }
 
-        stream->print("# HELP opendtu_platform Platform info\n");
-        stream->print("# TYPE opendtu_platform gauge\n");
-        stream->printf("opendtu_platform{arch=\"%s\",mac=\"%s\"} 1\n", ESP.getChipModel(), NetworkSettings.macAddress().c_str());
+        sendBody(request, body, gzip);
 
-        stream->print("# HELP opendtu_uptime Uptime in seconds\n");
-        stream->print("# TYPE opendtu_uptime counter\n");
-        stream->printf("opendtu_uptime %lld\n", esp_timer_get_time() / 1000000);
+    } catch (std::bad_alloc& bad_alloc) {
+        MessageOutput.printf("Call to /api/prometheus/metrics temporarely out of resources. Reason: \"%s\".\r\n", bad_alloc.what());
 
-        stream->print("# HELP opendtu_heap_size System memory size\n");
-        stream->print("# TYPE opendtu_heap_size gauge\n");
-        stream->printf("opendtu_heap_size %" PRId32 "\n", ESP.getHeapSize());
+        WebApi.sendTooManyRequests(request);
+    }
+}
+
+void WebApiPrometheusClass::render(ScrapeBuffer& buffer, AsyncWebServerRequest* request)
+{
+    Print* stream = &buffer;
+
+    stream->print("# HELP opendtu_build Build info\n");
+    stream->print("# TYPE opendtu_build gauge\n");
+    stream->printf("opendtu_build{name=\"%s\",id=\"%s\",version=\"%d.%d.%d\"} 1\n",
+        NetworkSettings.getHostname().c_str(), __COMPILED_GIT_HASH__, CONFIG_VERSION >> 24 & 0xff, CONFIG_VERSION >> 16 & 0xff, CONFIG_VERSION >> 8 & 0xff);
+
+    stream->print("# HELP opendtu_platform Platform info\n");
+    stream->print("# TYPE opendtu_platform gauge\n");
+    stream->printf("opendtu_platform{arch=\"%s\",mac=\"%s\"} 1\n", ESP.getChipModel(), NetworkSettings.macAddress().c_str());
+
+    stream->print("# HELP opendtu_uptime Uptime in seconds\n");
+    stream->print("# TYPE opendtu_uptime counter\n");
+    stream->printf("opendtu_uptime %lld\n", esp_timer_get_time() / 1000000);
 
-        stream->print("# HELP opendtu_free_heap_size System free memory\n");
-        stream->print("# TYPE opendtu_free_heap_size gauge\n");
-        stream->printf("opendtu_free_heap_size %" PRId32 "\n", ESP.getFreeHeap());
+    stream->print("# HELP opendtu_heap_size System memory size\n");
+    stream->print("# TYPE opendtu_heap_size gauge\n");
+    stream->printf("opendtu_heap_size %" PRId32 "\n", ESP.getHeapSize());
 
-        stream->print("# HELP opendtu_biggest_heap_block Biggest free heap block\n");
-        stream->print("# TYPE opendtu_biggest_heap_block gauge\n");
-        stream->printf("opendtu_biggest_heap_block %" PRId32 "\n", ESP.getMaxAllocHeap());
+    stream->print("# HELP opendtu_free_heap_size System free memory\n");
+    stream->print("# TYPE opendtu_free_heap_size gauge\n");
+    stream->printf("opendtu_free_heap_size %" PRId32 "\n", ESP.getFreeHeap());
 
-        stream->print("# HELP opendtu_heap_min_free Minimum free memory since boot\n");
-        stream->print("# TYPE opendtu_heap_min_free gauge\n");
-        stream->printf("opendtu_heap_min_free %" PRId32 "\n", ESP.getMinFreeHeap());
+    stream->print("# HELP opendtu_biggest_heap_block Biggest free heap block\n");
+    stream->print("# TYPE opendtu_biggest_heap_block gauge\n");
+    stream->printf("opendtu_biggest_heap_block %" PRId32 "\n", ESP.getMaxAllocHeap());
 
-        stream->print("# HELP wifi_rssi WiFi RSSI\n");
-        stream->print("# TYPE wifi_rssi gauge\n");
-        stream->printf("wifi_rssi %" PRId8 "\n", WiFi.RSSI());
+    stream->print("# HELP opendtu_heap_min_free Minimum free memory since boot\n");
+    stream->print("# TYPE opendtu_heap_min_free gauge\n");
+    stream->printf("opendtu_heap_min_free %" PRId32 "\n", ESP.getMinFreeHeap());
 
-        stream->print("# HELP wifi_station WiFi Station info\n");
-        stream->print("# TYPE wifi_station gauge\n");
-        stream->printf("wifi_station{bssid=\"%s\"} 1\n", WiFi.BSSIDstr().c_str());
+    stream->print("# HELP wifi_rssi WiFi RSSI\n");
+    stream->print("# TYPE wifi_rssi gauge\n");
+    stream->printf("wifi_rssi %" PRId8 "\n", WiFi.RSSI());
 
-        for (uint8_t i = 0; i < Hoymiles.getNumInverters(); i++) {
-            auto inv = Hoymiles.getInverterByPos(i);
+    stream->print("# HELP wifi_station WiFi Station info\n");
+    stream->print("# TYPE wifi_station gauge\n");
+    stream->printf("wifi_station{bssid=\"%s\"} 1\n", WiFi.BSSIDstr().c_str());
+
+    addRadioQueueWait(stream);
+    addRadioQueue(stream);
+    addRadioCommandPool(stream);
+    addRadioCommandStats(stream);
+    addLockStats(stream);
+    addMqttPublishQueue(stream);
+    addMqttTls(stream);
+    addMqttCluster(stream);
+    addMqttFleet(stream);
+    addInfluxExport(stream);
+    addModbusServer(stream);
+    addRawStatsExport(stream);
+    addSyslogExport(stream);
+    addPublishCoordinator(stream);
+    addEventBus(stream);
+    addWsLiveQueue(stream);
+    addResponseCache(stream);
+    addAdmissionControl(stream);
+    addHeapTelemetry(stream);
+    addCpuLoad(stream);
+    addPowerManagement(stream);
+    addResourceGovernor(stream);
+    addFlashWear(stream);
+    addPollCalibration(stream);
+    addTaskProfile(stream);
+    addLoopMonitor(stream);
+    addScrapeCache(stream);
+
+    _staticSize = buffer.getInputSize();
+    _inverterCache.resize(Hoymiles.getNumInverters());
+
+    // Only the requested inverters and fields, see WebApiFieldFilter_t
+    const WebApiFieldFilter_t filter = WebApi.parseFieldFilter(request);
+    bool first = true;
+
+    Hoymiles.forEachInverter([&](InverterAbstract& inv, const uint8_t i) {
+        if (i >= _inverterCache.size()) {
+            _inverterCache.resize(i + 1);
+        }
+        if (!filter.includesInverter(inv.serial())) {
+            return;
+        }
+        const auto& cache = getInverterCache(i, inv);
+        const char* labels = cache.Labels.c_str();
 
-            String serial = inv->serialString();
-            const char* name = inv->name();
-            if (i == 0) {
-                stream->print("# HELP opendtu_last_update last update from inverter in s\n");
-                stream->print("# TYPE opendtu_last_update gauge\n");
+        // A projection only asks for channel fields, the inverter diagnostics are skipped
+        if (filter.Projected) {
+            if (inv.Statistics()->getLastUpdate() > 0) {
+                addFields(stream, cache, i, inv, &filter);
             }
-            stream->printf("opendtu_last_update{serial=\"%s\",unit=\"%" PRId8 "\",name=\"%s\"} %" PRId32 "\n",
-                serial.c_str(), i, name, inv->Statistics()->getLastUpdate() / 1000);
+            return;
+        }
+
+        if (first) {
+            stream->print("# HELP opendtu_last_update last update from inverter in s\n");
+            stream->print("# TYPE opendtu_last_update gauge\n");
+        }
+        stream->printf("opendtu_last_update{%s} %" PRId32 "\n",
+            labels, inv.Statistics()->getLastUpdate() / 1000);
 
-            if (i == 0) {
-                stream->print("# HELP opendtu_inverter_limit_relative current relative limit of the inverter\n");
-                stream->print("# TYPE opendtu_inverter_limit_relative gauge\n");
+        if (first) {
+            stream->print("# HELP opendtu_inverter_limit_relative current relative limit of the inverter\n");
+            stream->print("# TYPE opendtu_inverter_limit_relative gauge\n");
+        }
+        stream->printf("opendtu_inverter_limit_relative{%s} %f\n",
+            labels, inv.SystemConfigPara()->getLimitPercent() / 100.0);
+
+        if (inv.DevInfo()->getMaxPower() > 0) {
+            if (first) {
+                stream->print("# HELP opendtu_inverter_limit_absolute current relative limit of the inverter\n");
+                stream->print("# TYPE opendtu_inverter_limit_absolute gauge\n");
             }
-            stream->printf("opendtu_inverter_limit_relative{serial=\"%s\",unit=\"%" PRId8 "\",name=\"%s\"} %f\n",
-                serial.c_str(), i, name, inv->SystemConfigPara()->getLimitPercent() / 100.0);
+            stream->printf("opendtu_inverter_limit_absolute{%s} %f\n",
+                labels, inv.SystemConfigPara()->getLimitPercent() * inv.DevInfo()->getMaxPower() / 100.0);
+        }
 
-            if (inv->DevInfo()->getMaxPower() > 0) {
-                if (i == 0) {
-                    stream->print("# HELP opendtu_inverter_limit_absolute current relative limit of the inverter\n");
-                    stream->print("# TYPE opendtu_inverter_limit_absolute gauge\n");
-                }
-                stream->printf("opendtu_inverter_limit_absolute{serial=\"%s\",unit=\"%" PRId8 "\",name=\"%s\"} %f\n",
-                    serial.c_str(), i, name, inv->SystemConfigPara()->getLimitPercent() * inv->DevInfo()->getMaxPower() / 100.0);
+        const LimitCommandStats_t& limitStats = inv.getLimitCommandStats();
+        if (first) {
+            stream->print("# HELP opendtu_inverter_limit_commands limit requests by result (sent, coalesced into a newer one, suppressed by the hysteresis)\n");
+            stream->print("# TYPE opendtu_inverter_limit_commands counter\n");
+        }
+        stream->printf("opendtu_inverter_limit_commands{%s,result=\"sent\"} %" PRIu32 "\n", labels, limitStats.Sent);
+        stream->printf("opendtu_inverter_limit_commands{%s,result=\"coalesced\"} %" PRIu32 "\n", labels, limitStats.Coalesced);
+        stream->printf("opendtu_inverter_limit_commands{%s,result=\"suppressed\"} %" PRIu32 "\n", labels, limitStats.Suppressed);
+
+        if (first) {
+            stream->print("# HELP opendtu_inverter_tx_power_reduction steps below the configured PA level used for the inverter\n");
+            stream->print("# TYPE opendtu_inverter_tx_power_reduction gauge\n");
+        }
+        stream->printf("opendtu_inverter_tx_power_reduction{%s} %" PRIu8 "\n", labels, inv.getTxPowerControl().getReduction());
+
+        if (first) {
+            stream->print("# HELP opendtu_inverter_tx_power_changes changes of the transmit power of the inverter\n");
+            stream->print("# TYPE opendtu_inverter_tx_power_changes counter\n");
+        }
+        stream->printf("opendtu_inverter_tx_power_changes{%s} %" PRIu32 "\n", labels, inv.getTxPowerControl().getChanges());
+
+        const TransactionStats_t& pollStats = inv.getTransactionRunner().getStats();
+        if (first) {
+            stream->print("# HELP opendtu_inverter_polls polls by result (completed, aborted by a failed stats request)\n");
+            stream->print("# TYPE opendtu_inverter_polls counter\n");
+        }
+        stream->printf("opendtu_inverter_polls{%s,result=\"completed\"} %" PRIu32 "\n", labels, pollStats.Completed);
+        stream->printf("opendtu_inverter_polls{%s,result=\"aborted\"} %" PRIu32 "\n", labels, pollStats.Aborted);
+
+        if (first) {
+            stream->print("# HELP opendtu_inverter_poll_duration_ms time from the start of the last poll until its last answer\n");
+            stream->print("# TYPE opendtu_inverter_poll_duration_ms gauge\n");
+        }
+        stream->printf("opendtu_inverter_poll_duration_ms{%s} %" PRIu32 "\n", labels, pollStats.LastDuration);
+
+        DataFreshnessStats_t freshness;
+        DataFreshness.getStats(inv, freshness);
+        if (freshness.Samples > 0) {
+            if (first) {
+                stream->print("# HELP opendtu_inverter_stats_interval_ms time between two statistics updates over the last updates\n");
+                stream->print("# TYPE opendtu_inverter_stats_interval_ms summary\n");
             }
+            stream->printf("opendtu_inverter_stats_interval_ms{%s,quantile=\"0.5\"} %" PRIu32 "\n", labels, freshness.P50);
+            stream->printf("opendtu_inverter_stats_interval_ms{%s,quantile=\"0.95\"} %" PRIu32 "\n", labels, freshness.P95);
+            stream->printf("opendtu_inverter_stats_interval_ms{%s,quantile=\"1\"} %" PRIu32 "\n", labels, freshness.Max);
+        }
 
-            // Loop all channels if Statistics have been updated at least once since DTU boot
-            if (inv->Statistics()->getLastUpdate() > 0) {
-                for (auto& t : inv->Statistics()->getChannelTypes()) {
-                    for (auto& c : inv->Statistics()->getChannelsByType(t)) {
-                        addPanelInfo(stream, serial, i, inv, t, c);
-                        for (uint8_t f = 0; f < sizeof(_publishFields) / sizeof(_publishFields[0]); f++) {
-                            if (t == TYPE_INV && _publishFields[f].field == FLD_PDC) {
-                                addField(stream, serial, i, inv, t, c, _publishFields[f].field, _metricTypes[_publishFields[f].type], "PowerDC");
-                            } else {
-                                addField(stream, serial, i, inv, t, c, _publishFields[f].field, _metricTypes[_publishFields[f].type]);
-                            }
-                        }
-                    }
-                }
+        if (first) {
+            stream->print("# HELP opendtu_inverter_data_age_seconds age of the last answer by data class, missing if none was received\n");
+            stream->print("# TYPE opendtu_inverter_data_age_seconds gauge\n");
+        }
+        const std::array<std::pair<const char*, uint32_t>, 4> ages = { {
+            { "stats", freshness.StatsAge },
+            { "devinfo", freshness.DevInfoAge },
+            { "limit", freshness.LimitAge },
+            { "alarm", freshness.AlarmAge },
+        } };
+        for (const auto& age : ages) {
+            if (age.second != DATA_FRESHNESS_NEVER) {
+                stream->printf("opendtu_inverter_data_age_seconds{%s,class=\"%s\"} %.3f\n", labels, age.first, age.second / 1000.0);
             }
         }
-        stream->addHeader("Cache-Control", "no-cache");
-        if (stream->getContentLength() > initialResponseBufferSize) {
-            initialResponseBufferSize = stream->getContentLength();
-            MessageOutput.printf("Increased /api/prometheus/metrics initialResponseBufferSize to %u bytes\r\n", initialResponseBufferSize);
+
+        if (first) {
+            stream->print("# HELP opendtu_inverter_freshness_slo_violated 1 if the polled inverter misses a data freshness SLO\n");
+            stream->print("# TYPE opendtu_inverter_freshness_slo_violated gauge\n");
         }
-        request->send(stream);
+        stream->printf("opendtu_inverter_freshness_slo_violated{%s} %d\n", labels, freshness.Violated ? 1 : 0);
 
-    } catch (std::bad_alloc& bad_alloc) {
-        MessageOutput.printf("Call to /api/prometheus/metrics temporarely out of resources. Reason: \"%s\".\r\n", bad_alloc.what());
+        if (first) {
+            stream->print("# HELP opendtu_inverter_freshness_slo_violations checks in which the inverter missed a data freshness SLO\n");
+            stream->print("# TYPE opendtu_inverter_freshness_slo_violations counter\n");
+        }
+        stream->printf("opendtu_inverter_freshness_slo_violations{%s} %" PRIu32 "\n", labels, freshness.Violations);
 
-        WebApi.sendTooManyRequests(request);
+        const InverterMemoryUsage_t memory = inv.getMemoryUsage();
+        if (first) {
+            stream->print("# HELP opendtu_inverter_memory_bytes RAM used by the inverter (object, parsers, lazily allocated parser buffers)\n");
+            stream->print("# TYPE opendtu_inverter_memory_bytes gauge\n");
+        }
+        stream->printf("opendtu_inverter_memory_bytes{%s,part=\"object\"} %" PRIu32 "\n", labels, memory.Object);
+        stream->printf("opendtu_inverter_memory_bytes{%s,part=\"parsers\"} %" PRIu32 "\n", labels, memory.Parsers);
+        stream->printf("opendtu_inverter_memory_bytes{%s,part=\"buffers\"} %" PRIu32 "\n", labels, memory.Buffers);
+
+        // Loop all channels if Statistics have been updated at least once since DTU boot
+        if (inv.Statistics()->getLastUpdate() > 0) {
+            addFields(stream, cache, i, inv);
+        }
+        first = false;
+    });
+}
+
+uint32_t WebApiPrometheusClass::getStatisticsGeneration()
+{
+    uint32_t generation = Hoymiles.getNumInverters();
+    Hoymiles.forEachInverter([&generation](InverterAbstract& inv, const uint8_t) {
+        generation = generation * 31 + inv.Statistics()->getGeneration();
+    });
+    return generation;
+}
+
+void WebApiPrometheusClass::sendBody(AsyncWebServerRequest* request, const std::shared_ptr<const std::vector<uint8_t>>& body, const bool gzip)
+{
+    // The response keeps the body alive, even if the cache entry is replaced while being sent
+    AsyncWebServerResponse* response = request->beginResponse("text/plain; charset=utf-8", body->size(), [body](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+        if (index >= body->size()) {
+            return 0;
+        }
+        const size_t len = std::min(maxLen, body->size() - index);
+        memcpy(buffer, body->data() + index, len);
+        return len;
+    });
+
+    if (gzip) {
+        response->addHeader("Content-Encoding", "gzip");
+        response->addHeader("Vary", "Accept-Encoding");
     }
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+    LoopMonitor.endActivity(LoopActivity_t::WebApi);
 }
 
-void WebApiPrometheusClass::addField(AsyncResponseStream* stream, const String& serial, const uint8_t idx, std::shared_ptr<InverterAbstract> inv, const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId, const char* metricName, const char* channelName)
+WebApiPrometheusClass::ScrapeBuffer::ScrapeBuffer(const bool gzip, const size_t reserve)
 {
-    if (inv->Statistics()->hasChannelFieldValue(type, channel, fieldId)) {
-        const char* chanName = (channelName == nullptr) ? inv->Statistics()->getChannelFieldName(type, channel, fieldId) : channelName;
-        if (idx == 0 && type == TYPE_AC && channel == 0) {
-            stream->printf("# HELP opendtu_%s in %s\n", chanName, inv->Statistics()->getChannelFieldUnit(type, channel, fieldId));
-            stream->printf("# TYPE opendtu_%s %s\n", chanName, metricName);
+    if (gzip) {
+        _gzip = std::make_unique<GzipStream>();
+    }
+    _data.reserve(reserve);
+}
+
+size_t WebApiPrometheusClass::ScrapeBuffer::write(const uint8_t* data, size_t len)
+{
+    _inputSize += len;
+    if (_gzip == nullptr) {
+        _data.insert(_data.end(), data, data + len);
+        return len;
+    }
+
+    _gzip->write(data, len);
+    moveOutput();
+    return len;
+}
+
+size_t WebApiPrometheusClass::ScrapeBuffer::write(uint8_t data)
+{
+    return write(&data, 1);
+}
+
+std::vector<uint8_t> WebApiPrometheusClass::ScrapeBuffer::finish()
+{
+    if (_gzip != nullptr) {
+        _gzip->finish();
+        moveOutput();
+        _gzip.reset();
+    }
+    _data.shrink_to_fit();
+    return std::move(_data);
+}
+
+void WebApiPrometheusClass::ScrapeBuffer::moveOutput()
+{
+    uint8_t buffer[128];
+    while (_gzip->available() > 0) {
+        const size_t len = _gzip->read(buffer, sizeof(buffer));
+        _data.insert(_data.end(), buffer, buffer + len);
+    }
+}
+
+const WebApiPrometheusClass::InverterCache_t& WebApiPrometheusClass::getInverterCache(const uint8_t idx, InverterAbstract& inv)
+{
+    auto& cache = _inverterCache[idx];
+    if (cache.Serial != inv.serial() || cache.Name != inv.name()) {
+        buildInverterCache(cache, idx, inv);
+    }
+    return cache;
+}
+
+void WebApiPrometheusClass::buildInverterCache(InverterCache_t& cache, const uint8_t idx, InverterAbstract& inv)
+{
+    cache.Serial = inv.serial();
+    cache.Name = inv.name();
+
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "serial=\"%s\",unit=\"%" PRId8 "\",name=\"%s\"",
+        inv.serialString(), idx, inv.name());
+    cache.Labels = buffer;
+
+    cache.Fields.clear();
+    for (auto& t : inv.Statistics()->getChannelTypes()) {
+        for (auto& c : inv.Statistics()->getChannelsByType(t)) {
+            for (const auto& exported : ExportedFields) {
+                const FieldId_t fieldId = exported.Field;
+                if (!inv.Statistics()->hasChannelFieldValue(t, c, fieldId)) {
+                    continue;
+                }
+
+                const char* chanName = (t == TYPE_INV && fieldId == FLD_PDC) ? "PowerDC" : inv.Statistics()->getChannelFieldName(t, c, fieldId);
+
+                String prefix;
+                if (idx == 0 && t == TYPE_AC && c == 0) {
+                    snprintf(buffer, sizeof(buffer), "# HELP opendtu_%s in %s\n# TYPE opendtu_%s %s\n",
+                        chanName, inv.Statistics()->getChannelFieldUnit(t, c, fieldId), chanName, exported.Metric == FieldMetric_t::Counter ? "counter" : "gauge");
+                    prefix = buffer;
+                }
+                snprintf(buffer, sizeof(buffer), "opendtu_%s{%s,type=\"%s\",channel=\"%d\"} ",
+                    chanName, cache.Labels.c_str(), inv.Statistics()->getChannelTypeName(t), c);
+                prefix += buffer;
+
+                cache.Fields.push_back({ t, c, fieldId, prefix });
+            }
         }
-        stream->printf("opendtu_%s{serial=\"%s\",unit=\"%" PRId8 "\",name=\"%s\",type=\"%s\",channel=\"%d\"} %s\n",
-            chanName,
-            serial.c_str(),
-            idx,
-            inv->name(),
-            inv->Statistics()->getChannelTypeName(type),
-            channel,
-            inv->Statistics()->getChannelFieldValueString(type, channel, fieldId).c_str());
+    }
+
+    // Field lines plus everything printed with the inverter labels: last update, limits, memory and three lines per panel
+    const size_t labelLines = 6 + 3 * inv.Statistics()->getChannelsByType(TYPE_DC).size();
+    cache.EstimatedSize = labelLines * (64 + cache.Labels.length() + PROMETHEUS_VALUE_WIDTH) + (idx == 0 ? 1024 : 0);
+    for (const auto& field : cache.Fields) {
+        cache.EstimatedSize += field.prefix.length() + PROMETHEUS_VALUE_WIDTH + 1;
     }
 }
 
-void WebApiPrometheusClass::addPanelInfo(AsyncResponseStream* stream, const String& serial, const uint8_t idx, std::shared_ptr<InverterAbstract> inv, const ChannelType_t type, const ChannelNum_t channel)
+size_t WebApiPrometheusClass::estimateResponseSize()
 {
-    if (type != TYPE_DC) {
-        return;
+    size_t size = _staticSize;
+    for (uint8_t i = 0; i < Hoymiles.getNumInverters() && i < _inverterCache.size(); i++) {
+        size += _inverterCache[i].EstimatedSize;
+    }
+    return size;
+}
+
+void WebApiPrometheusClass::addFields(Print* stream, const InverterCache_t& cache, const uint8_t idx, InverterAbstract& inv, const WebApiFieldFilter_t* filter)
+{
+    // The record has the same order as the cached fields
+    const auto record = FieldRecord.get(inv);
+    size_t entry = 0;
+
+    size_t pos = 0;
+    for (auto& t : inv.Statistics()->getChannelTypes()) {
+        for (auto& c : inv.Statistics()->getChannelsByType(t)) {
+            if (t == TYPE_DC && filter == nullptr) {
+                addPanelInfo(stream, cache, idx, inv, c);
+            }
+
+            // Fields are cached in the same channel order
+            for (; pos < cache.Fields.size() && cache.Fields[pos].type == t && cache.Fields[pos].channel == c; pos++) {
+                const auto& field = cache.Fields[pos];
+                if (filter != nullptr && !filter->includesField(field.type, field.field)) {
+                    continue;
+                }
+                while (entry < record->Entries.size()
+                    && (record->Entries[entry].Type != field.type || record->Entries[entry].Channel != field.channel || record->Entries[entry].Field != field.field)) {
+                    entry++;
+                }
+                if (entry == record->Entries.size()) {
+                    continue;
+                }
+
+                stream->print(field.prefix);
+                stream->write(reinterpret_cast<const uint8_t*>(record->Entries[entry].Formatted), record->Entries[entry].Length);
+                stream->write('\n');
+            }
+        }
     }
+}
 
-    const auto& config = Configuration.getInverterConfig(inv->serial());
+void WebApiPrometheusClass::addPanelInfo(Print* stream, const InverterCache_t& cache, const uint8_t idx, InverterAbstract& inv, const ChannelNum_t channel)
+{
+    auto configGuard = Configuration.getReadGuard();
+    const auto& config = Configuration.getInverterConfig(inv.serial());
+    const char* labels = cache.Labels.c_str();
 
     const bool printHelp = (idx == 0 && channel == 0);
     if (printHelp) {
         stream->print("# HELP opendtu_PanelInfo panel information\n");
         stream->print("# TYPE opendtu_PanelInfo gauge\n");
     }
-    stream->printf("opendtu_PanelInfo{serial=\"%s\",unit=\"%" PRId8 "\",name=\"%s\",channel=\"%d\",panelname=\"%s\"} 1\n",
-        serial.c_str(),
-        idx,
-        inv->name(),
+    stream->printf("opendtu_PanelInfo{%s,channel=\"%d\",panelname=\"%s\"} 1\n",
+        labels,
         channel,
         config->channel[channel].Name);
 
@@ -167,10 +504,8 @@ void WebApiPrometheusClass::addPanelInfo(AsyncResponseStream* stream, const Stri
         stream->print("# HELP opendtu_MaxPower panel maximum output power\n");
         stream->print("# TYPE opendtu_MaxPower gauge\n");
     }
-    stream->printf("opendtu_MaxPower{serial=\"%s\",unit=\"%" PRId8 "\",name=\"%s\",channel=\"%d\"} %d\n",
-        serial.c_str(),
-        idx,
-        inv->name(),
+    stream->printf("opendtu_MaxPower{%s,channel=\"%d\"} %d\n",
+        labels,
         channel,
         config->channel[channel].MaxChannelPower);
 
@@ -178,10 +513,922 @@ void WebApiPrometheusClass::addPanelInfo(AsyncResponseStream* stream, const Stri
         stream->print("# HELP opendtu_YieldTotalOffset panel yield offset (for used inverters)\n");
         stream->print("# TYPE opendtu_YieldTotalOffset gauge\n");
     }
-    stream->printf("opendtu_YieldTotalOffset{serial=\"%s\",unit=\"%" PRId8 "\",name=\"%s\",channel=\"%" PRId16 "\"} %f\n",
-        serial.c_str(),
-        idx,
-        inv->name(),
+    stream->printf("opendtu_YieldTotalOffset{%s,channel=\"%" PRId16 "\"} %f\n",
+        labels,
         channel,
         config->channel[channel].YieldTotalOffset);
 }
+
+void WebApiPrometheusClass::addRadioQueueWait(Print* stream)
+{
+    const auto radios = Hoymiles.getRadios();
+
+    struct {
+        const char* name;
+        CommandPriority priority;
+    } const classes[] = {
+        { "control", CommandPriority::Control },
+        { "telemetry", CommandPriority::Telemetry },
+    };
+
+    stream->print("# HELP opendtu_radio_queue_wait_count Number of commands sent by the radio\n");
+    stream->print("# TYPE opendtu_radio_queue_wait_count counter\n");
+    for (auto& r : radios) {
+        if (!r.radio->isInitialized()) {
+            continue;
+        }
+        for (auto& c : classes) {
+            stream->printf("opendtu_radio_queue_wait_count{radio=\"%s\",class=\"%s\"} %" PRIu32 "\n",
+                r.name, c.name, r.radio->getQueueWaitStats(c.priority).Count);
+        }
+    }
+
+    stream->print("# HELP opendtu_radio_queue_wait_total Sum of the time between enqueuing and sending of all commands in ms\n");
+    stream->print("# TYPE opendtu_radio_queue_wait_total counter\n");
+    for (auto& r : radios) {
+        if (!r.radio->isInitialized()) {
+            continue;
+        }
+        for (auto& c : classes) {
+            stream->printf("opendtu_radio_queue_wait_total{radio=\"%s\",class=\"%s\"} %" PRIu32 "\n",
+                r.name, c.name, r.radio->getQueueWaitStats(c.priority).Total);
+        }
+    }
+
+    stream->print("# HELP opendtu_radio_queue_wait_max Longest time between enqueuing and sending of a command in ms\n");
+    stream->print("# TYPE opendtu_radio_queue_wait_max gauge\n");
+    for (auto& r : radios) {
+        if (!r.radio->isInitialized()) {
+            continue;
+        }
+        for (auto& c : classes) {
+            stream->printf("opendtu_radio_queue_wait_max{radio=\"%s\",class=\"%s\"} %" PRIu32 "\n",
+                r.name, c.name, r.radio->getQueueWaitStats(c.priority).Max);
+        }
+    }
+}
+
+void WebApiPrometheusClass::addRadioQueue(Print* stream)
+{
+    const auto radios = Hoymiles.getRadios();
+
+    stream->print("# HELP opendtu_radio_queue_depth Number of queued commands including the one in transmission\n");
+    stream->print("# TYPE opendtu_radio_queue_depth gauge\n");
+    std::vector<uint32_t> oldest;
+    for (auto& r : radios) {
+        if (!r.radio->isInitialized()) {
+            oldest.push_back(0);
+            continue;
+        }
+        const auto snapshot = r.radio->getQueueSnapshot();
+        uint32_t age = 0;
+        for (const auto& cmd : snapshot) {
+            age = std::max(age, cmd.Age);
+        }
+        oldest.push_back(age);
+        stream->printf("opendtu_radio_queue_depth{radio=\"%s\"} %u\n", r.name, static_cast<unsigned>(snapshot.size()));
+    }
+
+    stream->print("# HELP opendtu_radio_queue_oldest_age Time since the oldest queued command was enqueued in ms\n");
+    stream->print("# TYPE opendtu_radio_queue_oldest_age gauge\n");
+    for (size_t i = 0; i < radios.size(); i++) {
+        if (!radios[i].radio->isInitialized()) {
+            continue;
+        }
+        stream->printf("opendtu_radio_queue_oldest_age{radio=\"%s\"} %" PRIu32 "\n", radios[i].name, oldest[i]);
+    }
+}
+
+void WebApiPrometheusClass::addRadioCommandPool(Print* stream)
+{
+    const auto radios = Hoymiles.getRadios();
+
+    stream->print("# HELP opendtu_radio_command_pool_blocks Number of command pool blocks\n");
+    stream->print("# TYPE opendtu_radio_command_pool_blocks gauge\n");
+    for (auto& r : radios) {
+        if (r.radio->isInitialized()) {
+            stream->printf("opendtu_radio_command_pool_blocks{radio=\"%s\"} %u\n",
+                r.name, r.radio->getCommandPool().getBlockCount());
+        }
+    }
+
+    stream->print("# HELP opendtu_radio_command_pool_free Number of free command pool blocks\n");
+    stream->print("# TYPE opendtu_radio_command_pool_free gauge\n");
+    for (auto& r : radios) {
+        if (r.radio->isInitialized()) {
+            stream->printf("opendtu_radio_command_pool_free{radio=\"%s\"} %u\n",
+                r.name, r.radio->getCommandPool().getFreeCount());
+        }
+    }
+
+    stream->print("# HELP opendtu_radio_command_pool_heap_fallback Number of commands which did not fit into a pool block\n");
+    stream->print("# TYPE opendtu_radio_command_pool_heap_fallback counter\n");
+    for (auto& r : radios) {
+        if (r.radio->isInitialized()) {
+            stream->printf("opendtu_radio_command_pool_heap_fallback{radio=\"%s\"} %" PRIu32 "\n",
+                r.name, r.radio->getCommandPool().getHeapFallbackCount());
+        }
+    }
+
+    stream->print("# HELP opendtu_radio_rx_buffer_peak Highest number of received fragments waiting to be parsed\n");
+    stream->print("# TYPE opendtu_radio_rx_buffer_peak gauge\n");
+    for (auto& r : radios) {
+        if (r.radio->isInitialized()) {
+            stream->printf("opendtu_radio_rx_buffer_peak{radio=\"%s\"} %" PRIu32 "\n",
+                r.name, r.radio->getRxBufferPeak());
+        }
+    }
+
+    stream->print("# HELP opendtu_radio_rx_buffer_overflows Number of times received fragments were dropped because the rx buffer was full\n");
+    stream->print("# TYPE opendtu_radio_rx_buffer_overflows counter\n");
+    for (auto& r : radios) {
+        if (r.radio->isInitialized()) {
+            stream->printf("opendtu_radio_rx_buffer_overflows{radio=\"%s\"} %" PRIu32 "\n",
+                r.name, r.radio->getRxBufferOverflows());
+        }
+    }
+
+    auto cmt = Hoymiles.getRadioCmt();
+    if (cmt->isInitialized()) {
+        stream->print("# HELP opendtu_radio_rx_interrupt_pin GPIO of the packet interrupt (0: the packet flag is polled over SPI)\n");
+        stream->print("# TYPE opendtu_radio_rx_interrupt_pin gauge\n");
+        stream->printf("opendtu_radio_rx_interrupt_pin{radio=\"cmt\"} %" PRIu8 "\n", cmt->getRxInterruptPin());
+
+        stream->print("# HELP opendtu_radio_rx_fifo_polls Number of SPI reads of the packet flag\n");
+        stream->print("# TYPE opendtu_radio_rx_fifo_polls counter\n");
+        stream->printf("opendtu_radio_rx_fifo_polls{radio=\"cmt\"} %" PRIu32 "\n", cmt->getRxFifoPolls());
+    }
+}
+
+void WebApiPrometheusClass::addRadioCommandStats(Print* stream)
+{
+    const auto radios = Hoymiles.getRadios();
+
+    struct {
+        const char* metric;
+        const char* help;
+    } const metrics[] = {
+        { "opendtu_radio_round_trip_ms", "Time from the first transmission of a command until it is finished in ms" },
+        { "opendtu_radio_response_fragments", "Number of fragments of a successfully received response" },
+        { "opendtu_radio_retransmits", "Number of resends and fragment re-requests per command" },
+    };
+
+    // One copy per radio, so all three metrics show the same commands
+    std::vector<std::vector<CommandRadioStats_t>> radioStats;
+    for (auto& r : radios) {
+        radioStats.push_back(r.radio->isInitialized() ? r.radio->getCommandRadioStats() : std::vector<CommandRadioStats_t>());
+    }
+
+    for (uint8_t m = 0; m < sizeof(metrics) / sizeof(metrics[0]); m++) {
+        stream->printf("# HELP %s %s\n", metrics[m].metric, metrics[m].help);
+        stream->printf("# TYPE %s histogram\n", metrics[m].metric);
+
+        for (size_t i = 0; i < radios.size(); i++) {
+            const auto& r = radios[i];
+            for (const auto& stats : radioStats[i]) {
+                char labels[64];
+                snprintf(labels, sizeof(labels), "radio=\"%s\",command=\"%s\"", r.name, stats.CommandName);
+
+                if (m == 0) {
+                    addHistogram(stream, metrics[m].metric, labels, stats.RoundTrip);
+                } else if (m == 1) {
+                    addHistogram(stream, metrics[m].metric, labels, stats.Fragments);
+                } else {
+                    addHistogram(stream, metrics[m].metric, labels, stats.Retransmits);
+                }
+            }
+        }
+    }
+
+    stream->print("# HELP opendtu_radio_rx_latency_us Time from the interrupt of a fragment until it is parsed in us\n");
+    stream->print("# TYPE opendtu_radio_rx_latency_us histogram\n");
+    for (auto& r : radios) {
+        if (r.radio->isInitialized()) {
+            char labels[32];
+            snprintf(labels, sizeof(labels), "radio=\"%s\"", r.name);
+            addHistogram(stream, "opendtu_radio_rx_latency_us", labels, r.radio->getRxLatency());
+        }
+    }
+
+    stream->print("# HELP opendtu_radio_rx_fragment_gap_us Time between the fragments of a response in us\n");
+    stream->print("# TYPE opendtu_radio_rx_fragment_gap_us histogram\n");
+    for (auto& r : radios) {
+        if (r.radio->isInitialized()) {
+            char labels[32];
+            snprintf(labels, sizeof(labels), "radio=\"%s\"", r.name);
+            addHistogram(stream, "opendtu_radio_rx_fragment_gap_us", labels, r.radio->getRxFragmentGap());
+        }
+    }
+
+    stream->print("# HELP opendtu_radio_rx_handling_us Time to parse a received fragment in us\n");
+    stream->print("# TYPE opendtu_radio_rx_handling_us histogram\n");
+    for (auto& r : radios) {
+        if (r.radio->isInitialized()) {
+            char labels[32];
+            snprintf(labels, sizeof(labels), "radio=\"%s\"", r.name);
+            addHistogram(stream, "opendtu_radio_rx_handling_us", labels, r.radio->getRxHandlingTime());
+        }
+    }
+
+    stream->print("# HELP opendtu_radio_rx_handling_max_us Longest time to parse a received fragment in us\n");
+    stream->print("# TYPE opendtu_radio_rx_handling_max_us gauge\n");
+    for (auto& r : radios) {
+        if (r.radio->isInitialized()) {
+            stream->printf("opendtu_radio_rx_handling_max_us{radio=\"%s\"} %" PRIu32 "\n",
+                r.name, r.radio->getRxHandlingTimeMax());
+        }
+    }
+}
+
+void WebApiPrometheusClass::addLockStats(Print* stream)
+{
+    struct {
+        String labels;
+        const LockStats_t* stats;
+    } locks[HOY_NRF_RADIO_COUNT + 3];
+    size_t count = 0;
+
+    locks[count++] = { "lock=\"inverter_list\"", &Hoymiles.getListLockStats() };
+    locks[count++] = { "lock=\"poll\"", &Hoymiles.getPollLockStats() };
+    for (auto& r : Hoymiles.getRadios()) {
+        if (r.radio->isInitialized() && count < sizeof(locks) / sizeof(locks[0])) {
+            locks[count++] = { String("lock=\"radio_queue\",radio=\"") + r.name + "\"", &r.radio->getQueueLockStats() };
+        }
+    }
+
+    stream->print("# HELP opendtu_lock_wait_us Time to acquire the lock in us\n");
+    stream->print("# TYPE opendtu_lock_wait_us histogram\n");
+    for (size_t i = 0; i < count; i++) {
+        addHistogram(stream, "opendtu_lock_wait_us", locks[i].labels.c_str(), locks[i].stats->WaitTime);
+    }
+
+    stream->print("# HELP opendtu_lock_hold_us Time the lock was held in us\n");
+    stream->print("# TYPE opendtu_lock_hold_us histogram\n");
+    for (size_t i = 0; i < count; i++) {
+        addHistogram(stream, "opendtu_lock_hold_us", locks[i].labels.c_str(), locks[i].stats->HoldTime);
+    }
+
+    stream->print("# HELP opendtu_lock_hold_max_us Longest time the lock was held in us\n");
+    stream->print("# TYPE opendtu_lock_hold_max_us gauge\n");
+    for (size_t i = 0; i < count; i++) {
+        stream->printf("opendtu_lock_hold_max_us{%s} %" PRIu32 "\n", locks[i].labels.c_str(), locks[i].stats->MaxHoldTime);
+    }
+}
+
+template <size_t N>
+void WebApiPrometheusClass::addHistogram(Print* stream, const char* metric, const char* labels, const Histogram<N>& histogram)
+{
+    for (size_t i = 0; i < histogram.getBoundCount(); i++) {
+        stream->printf("%s_bucket{%s,le=\"%" PRIu32 "\"} %" PRIu32 "\n",
+            metric, labels, histogram.getBound(i), histogram.getCumulativeCount(i));
+    }
+    stream->printf("%s_bucket{%s,le=\"+Inf\"} %" PRIu32 "\n", metric, labels, histogram.getCount());
+    stream->printf("%s_sum{%s} %" PRIu64 "\n", metric, labels, histogram.getSum());
+    stream->printf("%s_count{%s} %" PRIu32 "\n", metric, labels, histogram.getCount());
+}
+
+void WebApiPrometheusClass::addMqttCluster(Print* stream)
+{
+    const MqttClusterStatus_t status = MqttCluster.getStatus();
+    if (!status.Enabled) {
+        return;
+    }
+
+    stream->print("# HELP opendtu_cluster_nodes Number of DTUs of the cluster which are online\n");
+    stream->print("# TYPE opendtu_cluster_nodes gauge\n");
+    stream->printf("opendtu_cluster_nodes %" PRIu8 "\n", status.NodeCount);
+
+    stream->print("# HELP opendtu_cluster_leader 1 if this DTU assigns the inverters of the cluster\n");
+    stream->print("# TYPE opendtu_cluster_leader gauge\n");
+    stream->printf("opendtu_cluster_leader %d\n", status.LeaderId == status.NodeId ? 1 : 0);
+
+    stream->print("# HELP opendtu_cluster_inverters Inverters of the cluster assignment by owner\n");
+    stream->print("# TYPE opendtu_cluster_inverters gauge\n");
+    stream->printf("opendtu_cluster_inverters{owner=\"self\"} %" PRIu8 "\n", status.OwnedInverters);
+    stream->printf("opendtu_cluster_inverters{owner=\"other\"} %" PRIu8 "\n", status.AssignedInverters - status.OwnedInverters);
+
+    stream->print("# HELP opendtu_cluster_handovers Assignments published by this DTU which moved inverters\n");
+    stream->print("# TYPE opendtu_cluster_handovers counter\n");
+    stream->printf("opendtu_cluster_handovers %" PRIu32 "\n", status.Handovers);
+}
+
+void WebApiPrometheusClass::addMqttFleet(Print* stream)
+{
+    if (!MqttFleet.isAggregator()) {
+        return;
+    }
+
+    const MqttFleetTotal_t total = MqttFleet.getTotal();
+
+    stream->print("# HELP opendtu_fleet_dtus Number of DTUs of the fleet\n");
+    stream->print("# TYPE opendtu_fleet_dtus gauge\n");
+    stream->printf("opendtu_fleet_dtus{state=\"online\"} %" PRIu8 "\n", total.DtusOnline);
+    stream->printf("opendtu_fleet_dtus{state=\"offline\"} %" PRIu8 "\n", total.DtuCount - total.DtusOnline);
+
+    stream->print("# HELP opendtu_fleet_ac_power AC power of all DTUs online in W\n");
+    stream->print("# TYPE opendtu_fleet_ac_power gauge\n");
+    stream->printf("opendtu_fleet_ac_power %f\n", total.AcPower);
+
+    stream->print("# HELP opendtu_fleet_dc_power DC power of all DTUs online in W\n");
+    stream->print("# TYPE opendtu_fleet_dc_power gauge\n");
+    stream->printf("opendtu_fleet_dc_power %f\n", total.DcPower);
+
+    stream->print("# HELP opendtu_fleet_yield_day Yield day of all DTUs online in Wh\n");
+    stream->print("# TYPE opendtu_fleet_yield_day gauge\n");
+    stream->printf("opendtu_fleet_yield_day %f\n", total.AcYieldDay);
+
+    stream->print("# HELP opendtu_fleet_yield_total Yield total of all DTUs online in kWh\n");
+    stream->print("# TYPE opendtu_fleet_yield_total gauge\n");
+    stream->printf("opendtu_fleet_yield_total %f\n", total.AcYieldTotal);
+
+    stream->print("# HELP opendtu_fleet_valid 1 if all DTUs are online and all their inverters reachable\n");
+    stream->print("# TYPE opendtu_fleet_valid gauge\n");
+    stream->printf("opendtu_fleet_valid %d\n", total.IsValid ? 1 : 0);
+}
+
+void WebApiPrometheusClass::addInfluxExport(Print* stream)
+{
+    if (!Configuration.get().Influx.Enabled) {
+        return;
+    }
+
+    const InfluxExportStats_t stats = InfluxExport.getStats();
+
+    stream->print("# HELP opendtu_influx_batches Batches sent by the Influx exporter\n");
+    stream->print("# TYPE opendtu_influx_batches counter\n");
+    stream->printf("opendtu_influx_batches %" PRIu32 "\n", stats.Batches);
+
+    stream->print("# HELP opendtu_influx_lines Lines of the Influx exporter by result\n");
+    stream->print("# TYPE opendtu_influx_lines counter\n");
+    stream->printf("opendtu_influx_lines{result=\"sent\"} %" PRIu32 "\n", stats.LinesSent);
+    stream->printf("opendtu_influx_lines{result=\"dropped\"} %" PRIu32 "\n", stats.LinesDropped);
+    stream->printf("opendtu_influx_lines{result=\"failed\"} %" PRIu32 "\n", stats.LinesFailed);
+
+    stream->print("# HELP opendtu_influx_sent_bytes Bytes of the batches sent by the Influx exporter\n");
+    stream->print("# TYPE opendtu_influx_sent_bytes counter\n");
+    stream->printf("opendtu_influx_sent_bytes %" PRIu32 "\n", stats.BytesSent);
+}
+
+void WebApiPrometheusClass::addModbusServer(Print* stream)
+{
+    if (!Configuration.get().Modbus.Enabled) {
+        return;
+    }
+
+    const ModbusServerStats_t stats = ModbusServer.getStats();
+
+    stream->print("# HELP opendtu_modbus_clients Connected Modbus TCP clients\n");
+    stream->print("# TYPE opendtu_modbus_clients gauge\n");
+    stream->printf("opendtu_modbus_clients %u\n", stats.Clients);
+
+    stream->print("# HELP opendtu_modbus_requests Modbus requests received\n");
+    stream->print("# TYPE opendtu_modbus_requests counter\n");
+    stream->printf("opendtu_modbus_requests %" PRIu32 "\n", stats.Requests);
+
+    stream->print("# HELP opendtu_modbus_exceptions Modbus requests answered with an exception\n");
+    stream->print("# TYPE opendtu_modbus_exceptions counter\n");
+    stream->printf("opendtu_modbus_exceptions %" PRIu32 "\n", stats.Exceptions);
+
+    stream->print("# HELP opendtu_modbus_writes Inverter commands queued by Modbus writes\n");
+    stream->print("# TYPE opendtu_modbus_writes counter\n");
+    stream->printf("opendtu_modbus_writes %" PRIu32 "\n", stats.Writes);
+}
+
+void WebApiPrometheusClass::addRawStatsExport(Print* stream)
+{
+    const CONFIG_T& config = Configuration.get();
+    if (!config.RawStats.Mqtt && !config.RawStats.Udp) {
+        return;
+    }
+
+    const RawStatsExportStats_t stats = RawStatsExport.getStats();
+
+    stream->print("# HELP opendtu_rawstats_frames Raw statistics frames by transport\n");
+    stream->print("# TYPE opendtu_rawstats_frames counter\n");
+    stream->printf("opendtu_rawstats_frames{transport=\"mqtt\"} %" PRIu32 "\n", stats.FramesMqtt);
+    stream->printf("opendtu_rawstats_frames{transport=\"udp\"} %" PRIu32 "\n", stats.FramesUdp);
+
+    stream->print("# HELP opendtu_rawstats_failed Raw statistics frames which could not be sent\n");
+    stream->print("# TYPE opendtu_rawstats_failed counter\n");
+    stream->printf("opendtu_rawstats_failed %" PRIu32 "\n", stats.FramesFailed);
+}
+
+void WebApiPrometheusClass::addSyslogExport(Print* stream)
+{
+    if (!Configuration.get().Syslog.Enabled) {
+        return;
+    }
+
+    const SyslogExportStats_t stats = SyslogExport.getStats();
+
+    stream->print("# HELP opendtu_syslog_datagrams Datagrams sent to the syslog server\n");
+    stream->print("# TYPE opendtu_syslog_datagrams counter\n");
+    stream->printf("opendtu_syslog_datagrams %" PRIu32 "\n", stats.Datagrams);
+
+    stream->print("# HELP opendtu_syslog_records Console records by result\n");
+    stream->print("# TYPE opendtu_syslog_records counter\n");
+    stream->printf("opendtu_syslog_records{result=\"sent\"} %" PRIu32 "\n", stats.Records);
+    stream->printf("opendtu_syslog_records{result=\"failed\"} %" PRIu32 "\n", stats.RecordsFailed);
+
+    stream->print("# HELP opendtu_syslog_overruns Times records were overwritten before they were sent\n");
+    stream->print("# TYPE opendtu_syslog_overruns counter\n");
+    stream->printf("opendtu_syslog_overruns %" PRIu32 "\n", stats.Overruns);
+}
+
+void WebApiPrometheusClass::addEventBus(Print* stream)
+{
+    const EventBusStats_t stats = EventBus.getStats();
+
+    stream->print("# HELP opendtu_events_published Events published to the internal event bus\n");
+    stream->print("# TYPE opendtu_events_published counter\n");
+    stream->printf("opendtu_events_published %" PRIu32 "\n", stats.Published);
+
+    stream->print("# HELP opendtu_events_dropped Events dropped because the event queue was full\n");
+    stream->print("# TYPE opendtu_events_dropped counter\n");
+    stream->printf("opendtu_events_dropped %" PRIu32 "\n", stats.Dropped);
+
+    stream->print("# HELP opendtu_events_dispatched Events handled by the main loop\n");
+    stream->print("# TYPE opendtu_events_dispatched counter\n");
+    stream->printf("opendtu_events_dispatched %" PRIu32 "\n", stats.Dispatched);
+}
+
+void WebApiPrometheusClass::addPublishCoordinator(Print* stream)
+{
+    stream->print("# HELP opendtu_publish_slices_denied Publish slices denied because of an active radio, a closing idle window or another slice\n");
+    stream->print("# TYPE opendtu_publish_slices_denied counter\n");
+    stream->printf("opendtu_publish_slices_denied %" PRIu32 "\n", PublishCoordinator.getDeniedCount());
+
+    stream->print("# HELP opendtu_publish_slice_overruns Publish slices which took longer than their budget\n");
+    stream->print("# TYPE opendtu_publish_slice_overruns counter\n");
+    stream->printf("opendtu_publish_slice_overruns %" PRIu32 "\n", PublishCoordinator.getOverrunCount());
+
+    // Not present while no poll is scheduled
+    const uint32_t window = Hoymiles.getIdleWindow();
+    if (window != UINT32_MAX) {
+        stream->print("# HELP opendtu_radio_idle_window_seconds Time until the next poll of a radio is due, 0 while a radio is active\n");
+        stream->print("# TYPE opendtu_radio_idle_window_seconds gauge\n");
+        stream->printf("opendtu_radio_idle_window_seconds %.3f\n", window / 1000.0f);
+    }
+}
+
+void WebApiPrometheusClass::addMqttTls(Print* stream)
+{
+    const CONFIG_T& config = Configuration.get();
+    if (!config.Mqtt.Enabled || !config.Mqtt.Tls.Enabled) {
+        return;
+    }
+
+    const MqttTlsStats_t stats = MqttSettings.getTlsStats();
+
+    stream->print("# HELP opendtu_mqtt_tls_handshakes TLS handshakes with the MQTT broker by result\n");
+    stream->print("# TYPE opendtu_mqtt_tls_handshakes counter\n");
+    stream->printf("opendtu_mqtt_tls_handshakes{result=\"full\"} %" PRIu32 "\n", stats.Handshakes - stats.Resumed);
+    stream->printf("opendtu_mqtt_tls_handshakes{result=\"resumed\"} %" PRIu32 "\n", stats.Resumed);
+    stream->printf("opendtu_mqtt_tls_handshakes{result=\"failed\"} %" PRIu32 "\n", stats.Failed);
+
+    stream->print("# HELP opendtu_mqtt_tls_last_handshake_ms Duration of the last TLS handshake in ms\n");
+    stream->print("# TYPE opendtu_mqtt_tls_last_handshake_ms gauge\n");
+    stream->printf("opendtu_mqtt_tls_last_handshake_ms %" PRIu32 "\n", stats.LastHandshakeTime);
+
+    stream->print("# HELP opendtu_mqtt_tls_cert_parses Times the MQTT certificates were parsed\n");
+    stream->print("# TYPE opendtu_mqtt_tls_cert_parses counter\n");
+    stream->printf("opendtu_mqtt_tls_cert_parses %" PRIu32 "\n", stats.CertParses);
+}
+
+void WebApiPrometheusClass::addMqttPublishQueue(Print* stream)
+{
+    if (!MqttSettings.hasPublishTask()) {
+        return;
+    }
+
+    const MqttPublishQueueStats_t stats = MqttSettings.getPublishQueueStats();
+
+    stream->print("# HELP opendtu_mqtt_queue_depth Number of messages waiting in the MQTT publish queue\n");
+    stream->print("# TYPE opendtu_mqtt_queue_depth gauge\n");
+    stream->printf("opendtu_mqtt_queue_depth %" PRIu32 "\n", stats.Depth);
+
+    stream->print("# HELP opendtu_mqtt_queue_depth_max Maximum number of messages in the MQTT publish queue\n");
+    stream->print("# TYPE opendtu_mqtt_queue_depth_max gauge\n");
+    stream->printf("opendtu_mqtt_queue_depth_max %" PRIu32 "\n", stats.MaxDepth);
+
+    stream->print("# HELP opendtu_mqtt_queue_sent Number of messages sent from the MQTT publish queue\n");
+    stream->print("# TYPE opendtu_mqtt_queue_sent counter\n");
+    stream->printf("opendtu_mqtt_queue_sent %" PRIu32 "\n", stats.Sent);
+
+    stream->print("# HELP opendtu_mqtt_queue_dropped Number of messages dropped because the MQTT publish queue was full\n");
+    stream->print("# TYPE opendtu_mqtt_queue_dropped counter\n");
+    stream->printf("opendtu_mqtt_queue_dropped %" PRIu32 "\n", stats.Dropped);
+
+    stream->print("# HELP opendtu_mqtt_queue_replaced Number of queued messages replaced by a newer value of the same topic\n");
+    stream->print("# TYPE opendtu_mqtt_queue_replaced counter\n");
+    stream->printf("opendtu_mqtt_queue_replaced %" PRIu32 "\n", stats.Replaced);
+
+    stream->print("# HELP opendtu_mqtt_queue_latency_total Sum of the time between enqueue and send in ms\n");
+    stream->print("# TYPE opendtu_mqtt_queue_latency_total counter\n");
+    stream->printf("opendtu_mqtt_queue_latency_total %" PRIu32 "\n", stats.LatencyTotal);
+
+    stream->print("# HELP opendtu_mqtt_queue_latency_max Maximum time between enqueue and send in ms\n");
+    stream->print("# TYPE opendtu_mqtt_queue_latency_max gauge\n");
+    stream->printf("opendtu_mqtt_queue_latency_max %" PRIu32 "\n", stats.LatencyMax);
+
+    stream->print("# HELP opendtu_mqtt_published_bytes Bytes of the topics and payloads handed to the MQTT client\n");
+    stream->print("# TYPE opendtu_mqtt_published_bytes counter\n");
+    stream->printf("opendtu_mqtt_published_bytes %" PRIu32 "\n", stats.Bytes);
+}
+
+void WebApiPrometheusClass::addWsLiveQueue(Print* stream)
+{
+    const WsLiveStats_t stats = WebApi.getWsLiveStats();
+
+    stream->print("# HELP opendtu_ws_live_clients Number of connected live data websocket clients\n");
+    stream->print("# TYPE opendtu_ws_live_clients gauge\n");
+    stream->printf("opendtu_ws_live_clients %" PRIu32 "\n", stats.Clients);
+
+    stream->print("# HELP opendtu_ws_live_queue_depth Number of frames in the queues of all live data clients\n");
+    stream->print("# TYPE opendtu_ws_live_queue_depth gauge\n");
+    stream->printf("opendtu_ws_live_queue_depth %" PRIu32 "\n", stats.QueueDepth);
+
+    stream->print("# HELP opendtu_ws_live_queue_depth_max Number of frames in the queue of the slowest live data client\n");
+    stream->print("# TYPE opendtu_ws_live_queue_depth_max gauge\n");
+    stream->printf("opendtu_ws_live_queue_depth_max %" PRIu32 "\n", stats.MaxQueueDepth);
+
+    stream->print("# HELP opendtu_ws_live_waiting Number of frames waiting for a slow live data client\n");
+    stream->print("# TYPE opendtu_ws_live_waiting gauge\n");
+    stream->printf("opendtu_ws_live_waiting %" PRIu32 "\n", stats.Waiting);
+
+    stream->print("# HELP opendtu_ws_live_frames Live data frames by result (sent, replaced by a newer one, delta dropped for a resync)\n");
+    stream->print("# TYPE opendtu_ws_live_frames counter\n");
+    stream->printf("opendtu_ws_live_frames{result=\"sent\"} %" PRIu32 "\n", stats.Sent);
+    stream->printf("opendtu_ws_live_frames{result=\"replaced\"} %" PRIu32 "\n", stats.Replaced);
+    stream->printf("opendtu_ws_live_frames{result=\"resync\"} %" PRIu32 "\n", stats.Resyncs);
+
+    stream->print("# HELP opendtu_ws_live_sent_bytes Bytes of the live data frames queued for the clients\n");
+    stream->print("# TYPE opendtu_ws_live_sent_bytes counter\n");
+    stream->printf("opendtu_ws_live_sent_bytes %" PRIu32 "\n", stats.SentBytes);
+
+    stream->print("# HELP opendtu_ws_live_gzip_bytes Bytes of the live data frames before and after the compression for gzip clients\n");
+    stream->print("# TYPE opendtu_ws_live_gzip_bytes counter\n");
+    stream->printf("opendtu_ws_live_gzip_bytes{stage=\"input\"} %" PRIu32 "\n", stats.GzipInput);
+    stream->printf("opendtu_ws_live_gzip_bytes{stage=\"output\"} %" PRIu32 "\n", stats.GzipOutput);
+}
+
+void WebApiPrometheusClass::addResponseCache(Print* stream)
+{
+    const ResponseCacheStats_t stats = ResponseCache.getStats();
+
+    stream->print("# HELP opendtu_response_cache_entries Number of cached web api responses\n");
+    stream->print("# TYPE opendtu_response_cache_entries gauge\n");
+    stream->printf("opendtu_response_cache_entries %" PRIu32 "\n", stats.Entries);
+
+    stream->print("# HELP opendtu_response_cache_bytes Size of all cached web api responses\n");
+    stream->print("# TYPE opendtu_response_cache_bytes gauge\n");
+    stream->printf("opendtu_response_cache_bytes %" PRIu32 "\n", stats.Size);
+
+    stream->print("# HELP opendtu_response_cache_lookups Lookups of cached web api responses by result\n");
+    stream->print("# TYPE opendtu_response_cache_lookups counter\n");
+    stream->printf("opendtu_response_cache_lookups{result=\"hit\"} %" PRIu32 "\n", stats.Hits);
+    stream->printf("opendtu_response_cache_lookups{result=\"miss\"} %" PRIu32 "\n", stats.Misses);
+
+    stream->print("# HELP opendtu_response_cache_evictions Cached web api responses displaced by newer ones\n");
+    stream->print("# TYPE opendtu_response_cache_evictions counter\n");
+    stream->printf("opendtu_response_cache_evictions %" PRIu32 "\n", stats.Evictions);
+}
+
+void WebApiPrometheusClass::addScrapeCache(Print* stream)
+{
+    size_t size = 0;
+    for (const auto& entry : _scrapeCache) {
+        if (entry.Body != nullptr) {
+            size += entry.Body->size();
+        }
+    }
+
+    stream->print("# HELP opendtu_prometheus_cache_bytes Size of the kept scrape bodies\n");
+    stream->print("# TYPE opendtu_prometheus_cache_bytes gauge\n");
+    stream->printf("opendtu_prometheus_cache_bytes %" PRIu32 "\n", static_cast<uint32_t>(size));
+
+    stream->print("# HELP opendtu_prometheus_cache_lookups Scrapes by result (served from the cache, rendered)\n");
+    stream->print("# TYPE opendtu_prometheus_cache_lookups counter\n");
+    stream->printf("opendtu_prometheus_cache_lookups{result=\"hit\"} %" PRIu32 "\n", _scrapeCacheHits);
+    stream->printf("opendtu_prometheus_cache_lookups{result=\"miss\"} %" PRIu32 "\n", _scrapeCacheMisses);
+}
+
+void WebApiPrometheusClass::addAdmissionControl(Print* stream)
+{
+    const AdmissionStats_t stats = AdmissionControl.getStats();
+
+    stream->print("# HELP opendtu_admission_clients Number of client addresses with their own request budget\n");
+    stream->print("# TYPE opendtu_admission_clients gauge\n");
+    stream->printf("opendtu_admission_clients %" PRIu32 "\n", stats.Clients);
+
+    stream->print("# HELP opendtu_admission_requests Web api requests by endpoint class and result of the admission control\n");
+    stream->print("# TYPE opendtu_admission_requests counter\n");
+    for (size_t i = 0; i < stats.Classes.size(); i++) {
+        const char* name = AdmissionControlClass::getClassName(static_cast<AdmissionClass_t>(i));
+        stream->printf("opendtu_admission_requests{class=\"%s\",result=\"admitted\"} %" PRIu32 "\n", name, stats.Classes[i].Admitted);
+        stream->printf("opendtu_admission_requests{class=\"%s\",result=\"rejected\"} %" PRIu32 "\n", name, stats.Classes[i].Rejected);
+    }
+}
+
+void WebApiPrometheusClass::addCpuLoad(Print* stream)
+{
+    const CpuLoadStats_t stats = CpuLoad.getStats();
+
+    stream->print("# HELP opendtu_cpu_core_load Load of a core over the last interval in percent\n");
+    stream->print("# TYPE opendtu_cpu_core_load gauge\n");
+    for (uint8_t i = 0; i < ESP.getChipCores() && i < stats.CoreLoad.size(); i++) {
+        stream->printf("opendtu_cpu_core_load{core=\"%" PRIu8 "\"} %f\n", i, stats.CoreLoad[i]);
+    }
+
+    stream->print("# HELP opendtu_cpu_task_load Load of a task over the last interval in percent of one core\n");
+    stream->print("# TYPE opendtu_cpu_task_load gauge\n");
+    for (const auto& t : stats.Tasks) {
+        stream->printf("opendtu_cpu_task_load{task=\"%s\"} %f\n", t.Name, t.Load);
+    }
+
+    stream->print("# HELP opendtu_task_stack_free Bytes of the stack of a task which were never used\n");
+    stream->print("# TYPE opendtu_task_stack_free gauge\n");
+    for (const auto& t : stats.Tasks) {
+        stream->printf("opendtu_task_stack_free{task=\"%s\"} %" PRIu32 "\n", t.Name, t.StackHighWater);
+    }
+}
+
+void WebApiPrometheusClass::addPowerManagement(Print* stream)
+{
+    const PowerManagementStats_t stats = PowerManagement.getStats();
+
+    stream->print("# HELP opendtu_power_management_enabled Dynamic frequency scaling of the cpu is configured\n");
+    stream->print("# TYPE opendtu_power_management_enabled gauge\n");
+    stream->printf("opendtu_power_management_enabled %d\n", stats.Enabled ? 1 : 0);
+
+    stream->print("# HELP opendtu_cpu_frequency_mhz Frequency range of the cpu\n");
+    stream->print("# TYPE opendtu_cpu_frequency_mhz gauge\n");
+    stream->printf("opendtu_cpu_frequency_mhz{bound=\"min\"} %" PRIu32 "\n", stats.MinFreq);
+    stream->printf("opendtu_cpu_frequency_mhz{bound=\"max\"} %" PRIu32 "\n", stats.MaxFreq);
+
+    stream->print("# HELP opendtu_power_management_web_requests Web requests handled at full cpu frequency\n");
+    stream->print("# TYPE opendtu_power_management_web_requests counter\n");
+    stream->printf("opendtu_power_management_web_requests %" PRIu32 "\n", stats.WebRequests);
+}
+
+void WebApiPrometheusClass::addResourceGovernor(Print* stream)
+{
+    const ResourceGovernorStats_t stats = ResourceGovernor.getStats();
+
+    stream->print("# HELP opendtu_resource_governor_level Number of load shedding steps in effect\n");
+    stream->print("# TYPE opendtu_resource_governor_level gauge\n");
+    stream->printf("opendtu_resource_governor_level %u\n", stats.Level);
+
+    stream->print("# HELP opendtu_resource_governor_shedding Load shedding step in effect\n");
+    stream->print("# TYPE opendtu_resource_governor_shedding gauge\n");
+    for (uint8_t i = 0; i < static_cast<uint8_t>(ShedStep_t::Count); i++) {
+        stream->printf("opendtu_resource_governor_shedding{step=\"%s\"} %d\n",
+            ResourceGovernorClass::getStepName(static_cast<ShedStep_t>(i)), stats.Level > i ? 1 : 0);
+    }
+
+    stream->print("# HELP opendtu_resource_governor_escalations Times more load was shed\n");
+    stream->print("# TYPE opendtu_resource_governor_escalations counter\n");
+    stream->printf("opendtu_resource_governor_escalations %" PRIu32 "\n", stats.Escalations);
+}
+
+void WebApiPrometheusClass::addFlashWear(Print* stream)
+{
+    const FlashWearStats_t stats = FlashWear.getStats();
+
+    stream->print("# HELP opendtu_flash_average_erases Estimated erase cycles per block of the file system since the accounting started\n");
+    stream->print("# TYPE opendtu_flash_average_erases gauge\n");
+    stream->printf("opendtu_flash_average_erases %.3f\n", stats.AverageErases);
+
+    stream->print("# HELP opendtu_flash_written_bytes Bytes written to the file system by the writer\n");
+    stream->print("# TYPE opendtu_flash_written_bytes counter\n");
+    for (const auto& w : stats.Writers) {
+        stream->printf("opendtu_flash_written_bytes{writer=\"%s\"} %llu\n", w.Name, static_cast<unsigned long long>(w.Bytes));
+    }
+
+    stream->print("# HELP opendtu_flash_erases Estimated erased blocks of the writer\n");
+    stream->print("# TYPE opendtu_flash_erases counter\n");
+    for (const auto& w : stats.Writers) {
+        stream->printf("opendtu_flash_erases{writer=\"%s\"} %" PRIu32 "\n", w.Name, w.Erases);
+    }
+
+    stream->print("# HELP opendtu_flash_writes Writes of the writer\n");
+    stream->print("# TYPE opendtu_flash_writes counter\n");
+    for (const auto& w : stats.Writers) {
+        stream->printf("opendtu_flash_writes{writer=\"%s\"} %" PRIu32 "\n", w.Name, w.Writes);
+    }
+
+    stream->print("# HELP opendtu_flash_deferred_writes Writes held back by the budget of the writer\n");
+    stream->print("# TYPE opendtu_flash_deferred_writes counter\n");
+    for (const auto& w : stats.Writers) {
+        stream->printf("opendtu_flash_deferred_writes{writer=\"%s\"} %" PRIu32 "\n", w.Name, w.Deferred);
+    }
+
+    stream->print("# HELP opendtu_flash_budget_available Blocks left of the daily budget of the writer\n");
+    stream->print("# TYPE opendtu_flash_budget_available gauge\n");
+    for (const auto& w : stats.Writers) {
+        if (w.Budget > 0) {
+            stream->printf("opendtu_flash_budget_available{writer=\"%s\"} %.1f\n", w.Name, w.Available);
+        }
+    }
+}
+
+void WebApiPrometheusClass::addPollCalibration(Print* stream)
+{
+    const PollCalibrationStats_t stats = PollCalibration.getStats();
+
+    stream->print("# HELP opendtu_poll_interval_seconds Poll interval the radios use\n");
+    stream->print("# TYPE opendtu_poll_interval_seconds gauge\n");
+    stream->printf("opendtu_poll_interval_seconds %" PRIu32 "\n", stats.Applied);
+
+    stream->print("# HELP opendtu_poll_calibration_interval_seconds Poll interval recommended by the calibration including the headroom, 0 if not measured yet\n");
+    stream->print("# TYPE opendtu_poll_calibration_interval_seconds gauge\n");
+    stream->printf("opendtu_poll_calibration_interval_seconds %" PRIu32 "\n", stats.Interval);
+
+    stream->print("# HELP opendtu_poll_calibration_changes Times the calibration changed the poll interval\n");
+    stream->print("# TYPE opendtu_poll_calibration_changes counter\n");
+    stream->printf("opendtu_poll_calibration_changes %" PRIu32 "\n", stats.Changes);
+
+    stream->print("# HELP opendtu_poll_calibration_duration_ms Average time of a poll of the radio\n");
+    stream->print("# TYPE opendtu_poll_calibration_duration_ms gauge\n");
+    for (const auto& r : stats.Radios) {
+        stream->printf("opendtu_poll_calibration_duration_ms{radio=\"%s\"} %" PRIu32 "\n", r.Name, r.Duration);
+    }
+
+    stream->print("# HELP opendtu_poll_calibration_success_ratio Average share of the completed polls of the radio\n");
+    stream->print("# TYPE opendtu_poll_calibration_success_ratio gauge\n");
+    for (const auto& r : stats.Radios) {
+        stream->printf("opendtu_poll_calibration_success_ratio{radio=\"%s\"} %.3f\n", r.Name, r.SuccessRate);
+    }
+
+    stream->print("# HELP opendtu_poll_calibration_min_interval_ms Shortest poll interval the radio sustains, 0 if not measured yet\n");
+    stream->print("# TYPE opendtu_poll_calibration_min_interval_ms gauge\n");
+    for (const auto& r : stats.Radios) {
+        stream->printf("opendtu_poll_calibration_min_interval_ms{radio=\"%s\"} %" PRIu32 "\n", r.Name, r.MinInterval);
+    }
+
+    stream->print("# HELP opendtu_poll_calibration_cycle_ms Time until all polled inverters of the radio were polled once\n");
+    stream->print("# TYPE opendtu_poll_calibration_cycle_ms gauge\n");
+    for (const auto& r : stats.Radios) {
+        stream->printf("opendtu_poll_calibration_cycle_ms{radio=\"%s\"} %" PRIu32 "\n", r.Name, r.CycleTime);
+    }
+
+    stream->print("# HELP opendtu_totals_skew_ms Time between the oldest and the newest response the totals are built of\n");
+    stream->print("# TYPE opendtu_totals_skew_ms gauge\n");
+    stream->printf("opendtu_totals_skew_ms %" PRIu32 "\n", Datastore.getTotalSkew());
+
+    if (Hoymiles.getSnapshotPolling()) {
+        stream->print("# HELP opendtu_poll_snapshot_duration_ms Time the last snapshot of the stats of all inverters took\n");
+        stream->print("# TYPE opendtu_poll_snapshot_duration_ms gauge\n");
+        stream->printf("opendtu_poll_snapshot_duration_ms %" PRIu32 "\n", Hoymiles.getSnapshotDuration());
+
+        stream->print("# HELP opendtu_poll_snapshots Finished snapshots of the stats of all inverters\n");
+        stream->print("# TYPE opendtu_poll_snapshots counter\n");
+        stream->printf("opendtu_poll_snapshots %" PRIu32 "\n", Hoymiles.getSnapshotCount());
+    }
+}
+
+void WebApiPrometheusClass::addHeapTelemetry(Print* stream)
+{
+    const auto tags = HeapTelemetry.getTagStats();
+
+    stream->print("# HELP opendtu_heap_tag_allocations Number of allocations of a subsystem\n");
+    stream->print("# TYPE opendtu_heap_tag_allocations counter\n");
+    for (const auto& t : tags) {
+        stream->printf("opendtu_heap_tag_allocations{tag=\"%s\"} %" PRIu32 "\n", t.Name, t.Allocs);
+    }
+
+    stream->print("# HELP opendtu_heap_tag_frees Number of freed allocations of a subsystem\n");
+    stream->print("# TYPE opendtu_heap_tag_frees counter\n");
+    for (const auto& t : tags) {
+        stream->printf("opendtu_heap_tag_frees{tag=\"%s\"} %" PRIu32 "\n", t.Name, t.Frees);
+    }
+
+    stream->print("# HELP opendtu_heap_tag_bytes Bytes currently allocated by a subsystem\n");
+    stream->print("# TYPE opendtu_heap_tag_bytes gauge\n");
+    for (const auto& t : tags) {
+        stream->printf("opendtu_heap_tag_bytes{tag=\"%s\"} %" PRIu32 "\n", t.Name, t.Bytes);
+    }
+
+    stream->print("# HELP opendtu_heap_tag_bytes_max Maximum of the bytes allocated by a subsystem at once\n");
+    stream->print("# TYPE opendtu_heap_tag_bytes_max gauge\n");
+    for (const auto& t : tags) {
+        stream->printf("opendtu_heap_tag_bytes_max{tag=\"%s\"} %" PRIu32 "\n", t.Name, t.PeakBytes);
+    }
+
+    const auto regions = HeapTelemetry.getRegionStats();
+
+    stream->print("# HELP opendtu_heap_region_free Free bytes of a memory region\n");
+    stream->print("# TYPE opendtu_heap_region_free gauge\n");
+    for (const auto& r : regions) {
+        stream->printf("opendtu_heap_region_free{region=\"%s\"} %zu\n", r.Name, r.TotalFree);
+    }
+
+    stream->print("# HELP opendtu_heap_region_allocated Allocated bytes of a memory region\n");
+    stream->print("# TYPE opendtu_heap_region_allocated gauge\n");
+    for (const auto& r : regions) {
+        stream->printf("opendtu_heap_region_allocated{region=\"%s\"} %zu\n", r.Name, r.TotalAllocated);
+    }
+
+    stream->print("# HELP opendtu_heap_region_largest_free_block Largest free block of a memory region\n");
+    stream->print("# TYPE opendtu_heap_region_largest_free_block gauge\n");
+    for (const auto& r : regions) {
+        stream->printf("opendtu_heap_region_largest_free_block{region=\"%s\"} %zu\n", r.Name, r.LargestFreeBlock);
+    }
+
+    stream->print("# HELP opendtu_heap_region_min_free Minimum free bytes of a memory region since boot\n");
+    stream->print("# TYPE opendtu_heap_region_min_free gauge\n");
+    for (const auto& r : regions) {
+        stream->printf("opendtu_heap_region_min_free{region=\"%s\"} %zu\n", r.Name, r.MinimumFree);
+    }
+
+    stream->print("# HELP opendtu_heap_region_allocated_blocks Number of allocated blocks of a memory region\n");
+    stream->print("# TYPE opendtu_heap_region_allocated_blocks gauge\n");
+    for (const auto& r : regions) {
+        stream->printf("opendtu_heap_region_allocated_blocks{region=\"%s\"} %zu\n", r.Name, r.AllocatedBlocks);
+    }
+
+    stream->print("# HELP opendtu_heap_region_free_blocks Number of free blocks of a memory region\n");
+    stream->print("# TYPE opendtu_heap_region_free_blocks gauge\n");
+    for (const auto& r : regions) {
+        stream->printf("opendtu_heap_region_free_blocks{region=\"%s\"} %zu\n", r.Name, r.FreeBlocks);
+    }
+
+    // 0 if all free memory is one block, towards 1 the more it is split up
+    stream->print("# HELP opendtu_heap_region_fragmentation Share of the free memory outside of the largest free block\n");
+    stream->print("# TYPE opendtu_heap_region_fragmentation gauge\n");
+    for (const auto& r : regions) {
+        const float fragmentation = r.TotalFree > 0 ? 1.0f - static_cast<float>(r.LargestFreeBlock) / r.TotalFree : 0;
+        stream->printf("opendtu_heap_region_fragmentation{region=\"%s\"} %.3f\n", r.Name, fragmentation);
+    }
+}
+
+void WebApiPrometheusClass::addLoopMonitor(Print* stream)
+{
+    const LoopMonitorStats_t stats = LoopMonitor.getStats();
+
+    stream->print("# HELP opendtu_loop_violations Number of times the loop latency budget was exceeded\n");
+    stream->print("# TYPE opendtu_loop_violations counter\n");
+    stream->printf("opendtu_loop_violations{type=\"hoymiles_gap\"} %" PRIu32 "\n", stats.HoymilesGapViolations);
+    stream->printf("opendtu_loop_violations{type=\"scheduler_pass\"} %" PRIu32 "\n", stats.SchedulerPassViolations);
+
+    stream->print("# HELP opendtu_loop_latency_max Longest violation of the loop latency budget in ms\n");
+    stream->print("# TYPE opendtu_loop_latency_max gauge\n");
+    stream->printf("opendtu_loop_latency_max{type=\"hoymiles_gap\"} %" PRIu32 "\n", stats.HoymilesGapMax);
+    stream->printf("opendtu_loop_latency_max{type=\"scheduler_pass\"} %" PRIu32 "\n", stats.SchedulerPassMax);
+
+    const LoopLatency_t latency = LoopMonitor.getLatency();
+
+    stream->print("# HELP opendtu_handler_duration_ms Time from the start of a web api or mqtt handler until its response\n");
+    stream->print("# TYPE opendtu_handler_duration_ms histogram\n");
+    addHistogram(stream, "opendtu_handler_duration_ms", "activity=\"webapi\"", latency.Activity[static_cast<size_t>(LoopActivity_t::WebApi)]);
+    addHistogram(stream, "opendtu_handler_duration_ms", "activity=\"mqtt\"", latency.Activity[static_cast<size_t>(LoopActivity_t::Mqtt)]);
+
+    stream->print("# HELP opendtu_ws_live_frame_lag_ms Time from a statistics update until its live data frame was queued\n");
+    stream->print("# TYPE opendtu_ws_live_frame_lag_ms histogram\n");
+    addHistogram(stream, "opendtu_ws_live_frame_lag_ms", "source=\"statistics\"", latency.WsFrameLag);
+
+    stream->print("# HELP opendtu_stats_interval_ms Time between two statistics updates of an inverter\n");
+    stream->print("# TYPE opendtu_stats_interval_ms histogram\n");
+    addHistogram(stream, "opendtu_stats_interval_ms", "source=\"statistics\"", latency.StatsInterval);
+}
+
+void WebApiPrometheusClass::addTaskProfile(Print* stream)
+{
+    const auto stats = TaskProfiler.getStats();
+
+    stream->print("# HELP opendtu_task_runs Number of runs of a scheduler task\n");
+    stream->print("# TYPE opendtu_task_runs counter\n");
+    for (const auto& s : stats) {
+        stream->printf("opendtu_task_runs{task=\"%s\"} %" PRIu32 "\n", s.Name, s.RunCount);
+    }
+
+    stream->print("# HELP opendtu_task_run_time_total Sum of the execution time of a scheduler task in us\n");
+    stream->print("# TYPE opendtu_task_run_time_total counter\n");
+    for (const auto& s : stats) {
+        stream->printf("opendtu_task_run_time_total{task=\"%s\"} %" PRIu64 "\n", s.Name, s.RunTimeTotal);
+    }
+
+    stream->print("# HELP opendtu_task_run_time_max Longest single run of a scheduler task in us\n");
+    stream->print("# TYPE opendtu_task_run_time_max gauge\n");
+    for (const auto& s : stats) {
+        stream->printf("opendtu_task_run_time_max{task=\"%s\"} %" PRIu32 "\n", s.Name, s.RunTimeMax);
+    }
+
+    stream->print("# HELP opendtu_task_overruns Number of runs which took longer than the task interval\n");
+    stream->print("# TYPE opendtu_task_overruns counter\n");
+    for (const auto& s : stats) {
+        stream->printf("opendtu_task_overruns{task=\"%s\"} %" PRIu32 "\n", s.Name, s.Overruns);
+    }
+
+    stream->print("# HELP opendtu_task_lateness_total Sum of the delays between scheduled and actual start of a task in ms\n");
+    stream->print("# TYPE opendtu_task_lateness_total counter\n");
+    for (const auto& s : stats) {
+        stream->printf("opendtu_task_lateness_total{task=\"%s\"} %" PRIu64 "\n", s.Name, s.LatenessTotal);
+    }
+
+    stream->print("# HELP opendtu_task_lateness_max Longest delay between scheduled and actual start of a task in ms\n");
+    stream->print("# TYPE opendtu_task_lateness_max gauge\n");
+    for (const auto& s : stats) {
+        stream->printf("opendtu_task_lateness_max{task=\"%s\"} %" PRIu32 "\n", s.Name, s.LatenessMax);
+    }
+}
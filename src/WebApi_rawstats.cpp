@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "WebApi_rawstats.h"
+#include "Configuration.h"
+#include "JsonArena.h"
+#include "RawStatsExport.h"
+#include "WebApi.h"
+#include "WebApi_errors.h"
+#include "helper.h"
+#include <AsyncJson.h>
+
+void WebApiRawStatsClass::init(AsyncWebServer& server, Scheduler& scheduler)
+{
+    using std::placeholders::_1;
+
+    server.on("/api/rawstats/status", HTTP_GET, std::bind(&WebApiRawStatsClass::onRawStatsStatus, this, _1));
+    server.on("/api/rawstats/config", HTTP_GET, std::bind(&WebApiRawStatsClass::onRawStatsAdminGet, this, _1));
+    server.on("/api/rawstats/config", HTTP_POST, std::bind(&WebApiRawStatsClass::onRawStatsAdminPost, this, _1), nullptr, WebApiClass::onRequestBody);
+}
+
+void WebApiRawStatsClass::onRawStatsStatus(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentialsReadonly(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    auto& root = response->getRoot();
+
+    const RawStatsExportStats_t stats = RawStatsExport.getStats();
+    root["format_version"] = RAWSTATS_FORMAT_VERSION;
+    root["frames_mqtt"] = stats.FramesMqtt;
+    root["frames_udp"] = stats.FramesUdp;
+    root["frames_failed"] = stats.FramesFailed;
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
+
+void WebApiRawStatsClass::onRawStatsAdminGet(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentials(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    auto& root = response->getRoot();
+    const CONFIG_T& config = Configuration.get();
+
+    root["mqtt"] = config.RawStats.Mqtt;
+    root["udp"] = config.RawStats.Udp;
+    root["udp_host"] = config.RawStats.UdpHost;
+    root["udp_port"] = config.RawStats.UdpPort;
+    root["skip_fields"] = config.RawStats.SkipFields;
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
+
+void WebApiRawStatsClass::onRawStatsAdminPost(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentials(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    JsonArena arena;
+    JsonDocument root(&arena);
+    if (!WebApi.parseRequestData(request, response, root)) {
+        return;
+    }
+
+    auto& retMsg = response->getRoot();
+
+    if (!(root["mqtt"].is<bool>()
+            && root["udp"].is<bool>()
+            && root["udp_host"].is<String>()
+            && root["udp_port"].is<uint32_t>()
+            && root["skip_fields"].is<bool>())) {
+        retMsg["message"] = "Values are missing!";
+        retMsg["code"] = WebApiError::GenericValueMissing;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    const String host = root["udp_host"].as<String>();
+    if (host.length() > RAWSTATS_MAX_HOST_STRLEN || (root["udp"].as<bool>() && host.length() == 0)) {
+        retMsg["message"] = "Host must be between 1 and " STR(RAWSTATS_MAX_HOST_STRLEN) " characters long!";
+        retMsg["code"] = WebApiError::RawStatsHostLength;
+        retMsg["param"]["max"] = RAWSTATS_MAX_HOST_STRLEN;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    if (root["udp_port"].as<uint32_t>() == 0 || root["udp_port"].as<uint32_t>() > 65535) {
+        retMsg["message"] = "Port must be a number between 1 and 65535!";
+        retMsg["code"] = WebApiError::RawStatsPortInvalid;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    {
+        auto guard = Configuration.getWriteGuard();
+        auto& config = guard.getConfig();
+
+        config.RawStats.Mqtt = root["mqtt"].as<bool>();
+        config.RawStats.Udp = root["udp"].as<bool>();
+        strlcpy(config.RawStats.UdpHost, host.c_str(), sizeof(config.RawStats.UdpHost));
+        config.RawStats.UdpPort = root["udp_port"].as<uint32_t>();
+        config.RawStats.SkipFields = root["skip_fields"].as<bool>();
+    }
+
+    WebApi.writeConfig(retMsg);
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
@@ -1,9 +1,11 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 /*
- * Copyright (C) 2022-2024 Thomas Basler and others
+ * Copyright (C) 2022-2025 Thomas Basler and others
  */
 #include "WebApi_security.h"
 #include "Configuration.h"
+#include "JsonArena.h"
+#include "SessionToken.h"
 #include "WebApi.h"
 #include "WebApi_errors.h"
 #include "helper.h"
@@ -14,8 +16,10 @@ void WebApiSecurityClass::init(AsyncWebServer& server, Scheduler& scheduler)
     using std::placeholders::_1;
 
     server.on("/api/security/config", HTTP_GET, std::bind(&WebApiSecurityClass::onSecurityGet, this, _1));
-    server.on("/api/security/config", HTTP_POST, std::bind(&WebApiSecurityClass::onSecurityPost, this, _1));
+    server.on("/api/security/config", HTTP_POST, std::bind(&WebApiSecurityClass::onSecurityPost, this, _1), nullptr, WebApiClass::onRequestBody);
     server.on("/api/security/authenticate", HTTP_GET, std::bind(&WebApiSecurityClass::onAuthenticateGet, this, _1));
+    server.on("/api/security/login", HTTP_POST, std::bind(&WebApiSecurityClass::onLoginPost, this, _1));
+    server.on("/api/security/logout", HTTP_POST, std::bind(&WebApiSecurityClass::onLogoutPost, this, _1));
 }
 
 void WebApiSecurityClass::onSecurityGet(AsyncWebServerRequest* request)
@@ -41,7 +45,8 @@ void WebApiSecurityClass::onSecurityPost(AsyncWebServerRequest* request)
     }
 
     AsyncJsonResponse* response = new AsyncJsonResponse();
-    JsonDocument root;
+    JsonArena arena;
+    JsonDocument root(&arena);
     if (!WebApi.parseRequestData(request, response, root)) {
         return;
     }
@@ -76,6 +81,8 @@ void WebApiSecurityClass::onSecurityPost(AsyncWebServerRequest* request)
 
     WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
 
+    // Tokens issued for the old password are not accepted anymore
+    SessionToken.reset();
     WebApi.reload();
 }
 
@@ -93,3 +100,37 @@ void WebApiSecurityClass::onAuthenticateGet(AsyncWebServerRequest* request)
 
     WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
 }
+
+// Issues a session token for the password. It is returned in the body for
+// scripting clients and as cookie, which is also sent by websockets.
+void WebApiSecurityClass::onLoginPost(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkPassword(request)) {
+        return;
+    }
+
+    const String token = SessionToken.create();
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    auto& retMsg = response->getRoot();
+    retMsg["type"] = "success";
+    retMsg["message"] = "Login successful!";
+    retMsg["code"] = WebApiError::SecurityLoginSuccess;
+    retMsg["token"] = token;
+    retMsg["expires_in"] = SESSION_TOKEN_LIFETIME;
+
+    response->addHeader("Set-Cookie", String(SESSION_TOKEN_COOKIE "=") + token + "; Max-Age=" STR(SESSION_TOKEN_LIFETIME) "; Path=/; HttpOnly; SameSite=Strict");
+    response->addHeader("Cache-Control", "no-store");
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
+
+void WebApiSecurityClass::onLogoutPost(AsyncWebServerRequest* request)
+{
+    // Deleting the cookie is not enough, a copy of the token would stay valid
+    SessionToken.revoke(request);
+
+    AsyncWebServerResponse* response = request->beginResponse(204);
+    response->addHeader("Set-Cookie", SESSION_TOKEN_COOKIE "=; Max-Age=0; Path=/; HttpOnly; SameSite=Strict");
+    request->send(response);
+}
@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+#include "WebApi_syslog.h"
+#include "Configuration.h"
+#include "JsonArena.h"
+#include "SyslogExport.h"
+#include "WebApi.h"
+#include "WebApi_errors.h"
+#include "helper.h"
+#include <AsyncJson.h>
+
+void WebApiSyslogClass::init(AsyncWebServer& server, Scheduler& scheduler)
+{
+    using std::placeholders::_1;
+
+    server.on("/api/syslog/status", HTTP_GET, std::bind(&WebApiSyslogClass::onSyslogStatus, this, _1));
+    server.on("/api/syslog/config", HTTP_GET, std::bind(&WebApiSyslogClass::onSyslogAdminGet, this, _1));
+    server.on("/api/syslog/config", HTTP_POST, std::bind(&WebApiSyslogClass::onSyslogAdminPost, this, _1), nullptr, WebApiClass::onRequestBody);
+}
+
+void WebApiSyslogClass::onSyslogStatus(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentialsReadonly(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    auto& root = response->getRoot();
+
+    const SyslogExportStats_t stats = SyslogExport.getStats();
+    root["enabled"] = Configuration.get().Syslog.Enabled;
+    root["datagrams"] = stats.Datagrams;
+    root["records"] = stats.Records;
+    root["records_failed"] = stats.RecordsFailed;
+    root["overruns"] = stats.Overruns;
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
+
+void WebApiSyslogClass::onSyslogAdminGet(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentials(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    auto& root = response->getRoot();
+    const CONFIG_T& config = Configuration.get();
+
+    root["enabled"] = config.Syslog.Enabled;
+    root["host"] = config.Syslog.Host;
+    root["port"] = config.Syslog.Port;
+    root["format"] = config.Syslog.Format;
+    root["level"] = config.Syslog.Level;
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
+
+void WebApiSyslogClass::onSyslogAdminPost(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentials(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    JsonArena arena;
+    JsonDocument root(&arena);
+    if (!WebApi.parseRequestData(request, response, root)) {
+        return;
+    }
+
+    auto& retMsg = response->getRoot();
+
+    if (!(root["enabled"].is<bool>()
+            && root["host"].is<String>()
+            && root["port"].is<uint32_t>()
+            && root["format"].is<uint32_t>()
+            && root["level"].is<uint32_t>())) {
+        retMsg["message"] = "Values are missing!";
+        retMsg["code"] = WebApiError::GenericValueMissing;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    const String host = root["host"].as<String>();
+    if (host.length() > SYSLOG_MAX_HOST_STRLEN || (root["enabled"].as<bool>() && host.length() == 0)) {
+        retMsg["message"] = "Host must be between 1 and " STR(SYSLOG_MAX_HOST_STRLEN) " characters long!";
+        retMsg["code"] = WebApiError::SyslogHostLength;
+        retMsg["param"]["max"] = SYSLOG_MAX_HOST_STRLEN;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    if (root["port"].as<uint32_t>() == 0 || root["port"].as<uint32_t>() > 65535) {
+        retMsg["message"] = "Port must be a number between 1 and 65535!";
+        retMsg["code"] = WebApiError::SyslogPortInvalid;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    if (root["format"].as<uint32_t>() >= static_cast<uint32_t>(SyslogFormat_t::Count)) {
+        retMsg["message"] = "Invalid format!";
+        retMsg["code"] = WebApiError::SyslogFormatInvalid;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    if (root["level"].as<uint32_t>() < static_cast<uint32_t>(MessageLevel_t::Error)
+        || root["level"].as<uint32_t>() > static_cast<uint32_t>(MessageLevel_t::Verbose)) {
+        retMsg["message"] = "Invalid level!";
+        retMsg["code"] = WebApiError::SyslogLevelInvalid;
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    {
+        auto guard = Configuration.getWriteGuard();
+        auto& config = guard.getConfig();
+
+        config.Syslog.Enabled = root["enabled"].as<bool>();
+        strlcpy(config.Syslog.Host, host.c_str(), sizeof(config.Syslog.Host));
+        config.Syslog.Port = root["port"].as<uint32_t>();
+        config.Syslog.Format = root["format"].as<uint32_t>();
+        config.Syslog.Level = root["level"].as<uint32_t>();
+    }
+
+    WebApi.writeConfig(retMsg);
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+}
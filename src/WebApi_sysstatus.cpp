@@ -3,9 +3,16 @@
  * Copyright (C) 2022-2025 Thomas Basler and others
  */
 #include "WebApi_sysstatus.h"
+#include "BootTiming.h"
 #include "Configuration.h"
+#include "CpuLoad.h"
+#include "DataFreshness.h"
+#include "FlashWear.h"
+#include "LoopMonitor.h"
+#include "MessageOutput.h"
 #include "NetworkSettings.h"
 #include "PinMapping.h"
+#include "TaskProfiler.h"
 #include "WebApi.h"
 #include "__compiled_constants.h"
 #include <AsyncJson.h>
@@ -19,6 +26,37 @@ void WebApiSysstatusClass::init(AsyncWebServer& server, Scheduler& scheduler)
     using std::placeholders::_1;
 
     server.on("/api/system/status", HTTP_GET, std::bind(&WebApiSysstatusClass::onSystemStatus, this, _1));
+    server.on("/api/system/flashwear", HTTP_GET, std::bind(&WebApiSysstatusClass::onFlashWear, this, _1));
+}
+
+void WebApiSysstatusClass::onFlashWear(AsyncWebServerRequest* request)
+{
+    if (!WebApi.checkCredentialsReadonly(request)) {
+        return;
+    }
+
+    AsyncJsonResponse* response = new AsyncJsonResponse();
+    auto& root = response->getRoot();
+
+    const FlashWearStats_t stats = FlashWear.getStats();
+    root["blocks"] = stats.Blocks;
+    root["block_size"] = FLASH_WEAR_BLOCK_SIZE;
+    root["since"] = stats.Since;
+    root["average_erases"] = stats.AverageErases;
+
+    auto writers = root["writers"].to<JsonArray>();
+    for (const auto& w : stats.Writers) {
+        auto obj = writers.add<JsonObject>();
+        obj["name"] = w.Name;
+        obj["budget"] = w.Budget;
+        obj["available"] = w.Available;
+        obj["bytes"] = w.Bytes;
+        obj["erases"] = w.Erases;
+        obj["writes"] = w.Writes;
+        obj["deferred"] = w.Deferred;
+    }
+
+    WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
 }
 
 void WebApiSysstatusClass::onSystemStatus(AsyncWebServerRequest* request)
@@ -52,10 +90,18 @@ void WebApiSysstatusClass::onSystemStatus(AsyncWebServerRequest* request)
     root["chipcores"] = ESP.getChipCores();
     root["flashsize"] = ESP.getFlashChipSize();
 
+    const CpuLoadStats_t cpuLoad = CpuLoad.getStats();
+    root["cpu_load_exact"] = cpuLoad.Exact;
+    JsonArray coreLoad = root["cpu_load"].to<JsonArray>();
+    for (uint8_t i = 0; i < ESP.getChipCores() && i < cpuLoad.CoreLoad.size(); i++) {
+        coreLoad.add(cpuLoad.CoreLoad[i]);
+    }
+
     JsonArray taskDetails = root["task_details"].to<JsonArray>();
-    static std::array<char const*, 12> constexpr task_names = {
+    static std::array<char const*, 18> constexpr task_names = {
         "IDLE0", "IDLE1", "wifi", "tiT", "loopTask", "async_tcp", "mqttclient",
-        "HUAWEI_CAN_0", "PM:SDM", "PM:HTTP+JSON", "PM:SML", "PM:HTTP+SML"
+        "HUAWEI_CAN_0", "PM:SDM", "PM:HTTP+JSON", "PM:SML", "PM:HTTP+SML",
+        "HOY_NRF_RX", "HOY_CMT_RX", "MQTT_PUB", "MSG_OUT", "OTA_PULL", "OTA"
     };
     for (char const* task_name : task_names) {
         TaskHandle_t const handle = xTaskGetHandle(task_name);
@@ -66,6 +112,18 @@ void WebApiSysstatusClass::onSystemStatus(AsyncWebServerRequest* request)
         task["name"] = task_name;
         task["stack_watermark"] = uxTaskGetStackHighWaterMark(handle);
         task["priority"] = uxTaskPriorityGet(handle);
+        const BaseType_t core = xTaskGetAffinity(handle);
+        if (core == tskNO_AFFINITY) {
+            task["core"] = nullptr;
+        } else {
+            task["core"] = core;
+        }
+        for (const auto& load : cpuLoad.Tasks) {
+            if (strcmp(load.Name, task_name) == 0) {
+                task["cpu_load"] = load.Load;
+                break;
+            }
+        }
     }
 
     String reason;
@@ -75,6 +133,10 @@ void WebApiSysstatusClass::onSystemStatus(AsyncWebServerRequest* request)
     reason = ResetReason::get_reset_reason_verbose(1);
     root["resetreason_1"] = reason;
 
+    if (!MessageOutput.getLastBootLog().isEmpty()) {
+        root["last_boot_log"] = MessageOutput.getLastBootLog();
+    }
+
     root["cfgsavecount"] = Configuration.get().Cfg.SaveCount;
 
     char version[16];
@@ -85,6 +147,14 @@ void WebApiSysstatusClass::onSystemStatus(AsyncWebServerRequest* request)
 
     root["uptime"] = esp_timer_get_time() / 1000000;
 
+    JsonArray bootPhases = root["boot_phases"].to<JsonArray>();
+    for (const auto& phase : BootTiming.getPhases()) {
+        JsonObject p = bootPhases.add<JsonObject>();
+        p["name"] = phase.Name;
+        p["start"] = phase.Start;
+        p["duration"] = phase.Duration;
+    }
+
     root["nrf_configured"] = PinMapping.isValidNrf24Config();
     root["nrf_connected"] = Hoymiles.getRadioNrf()->isConnected();
     root["nrf_pvariant"] = Hoymiles.getRadioNrf()->isPVariant();
@@ -92,5 +162,88 @@ void WebApiSysstatusClass::onSystemStatus(AsyncWebServerRequest* request)
     root["cmt_configured"] = PinMapping.isValidCmt2300Config();
     root["cmt_connected"] = Hoymiles.getRadioCmt()->isConnected();
 
+    const auto radios = Hoymiles.getRadios();
+
+    JsonArray radioCommands = root["radio_commands"].to<JsonArray>();
+    for (auto& r : radios) {
+        if (!r.radio->isInitialized()) {
+            continue;
+        }
+        for (const auto& stats : r.radio->getCommandRadioStats()) {
+            JsonObject command = radioCommands.add<JsonObject>();
+            command["radio"] = r.name;
+            command["name"] = stats.CommandName;
+            command["count"] = stats.RoundTrip.getCount();
+            command["round_trip_avg"] = stats.RoundTrip.getCount() > 0 ? stats.RoundTrip.getSum() / stats.RoundTrip.getCount() : 0;
+            command["fragments_avg"] = stats.Fragments.getCount() > 0 ? static_cast<float>(stats.Fragments.getSum()) / stats.Fragments.getCount() : 0;
+            command["retransmits_avg"] = stats.Retransmits.getCount() > 0 ? static_cast<float>(stats.Retransmits.getSum()) / stats.Retransmits.getCount() : 0;
+        }
+    }
+
+    JsonArray tasks = root["tasks"].to<JsonArray>();
+    for (const auto& stats : TaskProfiler.getStats()) {
+        JsonObject task = tasks.add<JsonObject>();
+        task["name"] = stats.Name;
+        task["runs"] = stats.RunCount;
+        task["run_time_total"] = stats.RunTimeTotal / 1000;
+        task["run_time_avg"] = stats.RunCount > 0 ? stats.RunTimeTotal / stats.RunCount : 0;
+        task["run_time_max"] = stats.RunTimeMax;
+        task["overruns"] = stats.Overruns;
+        task["lateness_avg"] = stats.RunCount > 0 ? static_cast<float>(stats.LatenessTotal) / stats.RunCount : 0;
+        task["lateness_max"] = stats.LatenessMax;
+    }
+
+    JsonObject dataFreshness = root["data_freshness"].to<JsonObject>();
+    dataFreshness["slo_interval"] = Configuration.get().Dtu.FreshnessSloInterval;
+    dataFreshness["slo_age"] = Configuration.get().Dtu.FreshnessSloAge;
+    dataFreshness["violated"] = DataFreshness.getViolatedCount();
+    JsonArray freshnessInverters = dataFreshness["inverters"].to<JsonArray>();
+    Hoymiles.forEachInverter([&](InverterAbstract& inv, const uint8_t) {
+        DataFreshnessStats_t stats;
+        DataFreshness.getStats(inv, stats);
+
+        JsonObject obj = freshnessInverters.add<JsonObject>();
+        obj["serial"] = inv.serialString();
+        obj["samples"] = stats.Samples;
+        obj["interval_p50"] = stats.P50;
+        obj["interval_p95"] = stats.P95;
+        obj["interval_max"] = stats.Max;
+        // null if the class was not received yet
+        JsonObject age = obj["age"].to<JsonObject>();
+        auto setAge = [&age](const char* name, const uint32_t value) {
+            if (value != DATA_FRESHNESS_NEVER) {
+                age[name] = value;
+            } else {
+                age[name] = nullptr;
+            }
+        };
+        setAge("stats", stats.StatsAge);
+        setAge("devinfo", stats.DevInfoAge);
+        setAge("limit", stats.LimitAge);
+        setAge("alarm", stats.AlarmAge);
+        obj["violated"] = stats.Violated;
+        obj["violations"] = stats.Violations;
+    });
+
+    const LoopMonitorStats_t loopStats = LoopMonitor.getStats();
+    JsonObject loopMonitor = root["loop_monitor"].to<JsonObject>();
+    loopMonitor["budget"] = LOOP_MONITOR_BUDGET;
+    loopMonitor["hoymiles_gap_violations"] = loopStats.HoymilesGapViolations;
+    loopMonitor["hoymiles_gap_max"] = loopStats.HoymilesGapMax;
+    loopMonitor["scheduler_pass_violations"] = loopStats.SchedulerPassViolations;
+    loopMonitor["scheduler_pass_max"] = loopStats.SchedulerPassMax;
+
+    JsonArray violations = loopMonitor["violations"].to<JsonArray>();
+    for (const auto& v : LoopMonitor.getViolations()) {
+        JsonObject violation = violations.add<JsonObject>();
+        violation["type"] = v.Type == LoopViolation_t::HoymilesGap ? "hoymiles_gap" : "scheduler_pass";
+        violation["time"] = v.Time;
+        violation["duration"] = v.Duration;
+        violation["task"] = v.Task;
+        violation["task_time"] = v.TaskTime;
+        violation["webapi"] = v.WebApi;
+        violation["mqtt"] = v.Mqtt;
+    }
+
     WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
 }
@@ -3,7 +3,8 @@
  * Copyright (C) 2022-2025 Thomas Basler and others
  */
 #include "WebApi_webapp.h"
-#include <MD5Builder.h>
+#include "__webapp_chunks.h"
+#include "__webapp_etags.h"
 
 extern const uint8_t file_index_html_start[] asm("_binary_webapp_dist_index_html_gz_start");
 extern const uint8_t file_favicon_ico_start[] asm("_binary_webapp_dist_favicon_ico_start");
@@ -11,6 +12,7 @@ extern const uint8_t file_favicon_png_start[] asm("_binary_webapp_dist_favicon_p
 extern const uint8_t file_zones_json_start[] asm("_binary_webapp_dist_zones_json_gz_start");
 extern const uint8_t file_app_js_start[] asm("_binary_webapp_dist_js_app_js_gz_start");
 extern const uint8_t file_site_webmanifest_start[] asm("_binary_webapp_dist_site_webmanifest_start");
+extern const uint8_t file_sw_js_start[] asm("_binary_webapp_dist_sw_js_gz_start");
 
 extern const uint8_t file_index_html_end[] asm("_binary_webapp_dist_index_html_gz_end");
 extern const uint8_t file_favicon_ico_end[] asm("_binary_webapp_dist_favicon_ico_end");
@@ -18,18 +20,12 @@ extern const uint8_t file_favicon_png_end[] asm("_binary_webapp_dist_favicon_png
 extern const uint8_t file_zones_json_end[] asm("_binary_webapp_dist_zones_json_gz_end");
 extern const uint8_t file_app_js_end[] asm("_binary_webapp_dist_js_app_js_gz_end");
 extern const uint8_t file_site_webmanifest_end[] asm("_binary_webapp_dist_site_webmanifest_end");
+extern const uint8_t file_sw_js_end[] asm("_binary_webapp_dist_sw_js_gz_end");
 
-void WebApiWebappClass::responseBinaryDataWithETagCache(AsyncWebServerRequest* request, const String& contentType, const String& contentEncoding, const uint8_t* content, size_t len)
+void WebApiWebappClass::responseBinaryDataWithETagCache(AsyncWebServerRequest* request, const String& contentType, const String& contentEncoding, const uint8_t* content, size_t len, const char* etag)
 {
-    auto md5 = MD5Builder();
-    md5.begin();
-    md5.add(const_cast<uint8_t*>(content), len);
-    md5.calculate();
-
-    String expectedEtag;
-    expectedEtag = "\"";
-    expectedEtag += md5.toString();
-    expectedEtag += "\"";
+    // The ETag is calculated at build time, see pio-scripts/webapp_etags.py
+    const String expectedEtag = etag;
 
     bool eTagMatch = false;
     if (request->hasHeader("If-None-Match")) {
@@ -55,6 +51,16 @@ void WebApiWebappClass::responseBinaryDataWithETagCache(AsyncWebServerRequest* r
     request->send(response);
 }
 
+void WebApiWebappClass::responseImmutable(AsyncWebServerRequest* request, const String& contentType, const uint8_t* content, size_t len)
+{
+    // The file name contains the hash of the content, so the browser never has to revalidate it
+    AsyncWebServerResponse* response = request->beginResponse(200, contentType, content, len);
+    response->addHeader("Content-Encoding", "gzip");
+    response->addHeader("Cache-Control", "public, max-age=31536000, immutable");
+
+    request->send(response);
+}
+
 void WebApiWebappClass::init(AsyncWebServer& server, Scheduler& scheduler)
 {
     /*
@@ -63,34 +69,46 @@ void WebApiWebappClass::init(AsyncWebServer& server, Scheduler& scheduler)
     */
 
     server.on("/", HTTP_GET, [&](AsyncWebServerRequest* request) {
-        responseBinaryDataWithETagCache(request, "text/html", "gzip", file_index_html_start, file_index_html_end - file_index_html_start);
+        responseBinaryDataWithETagCache(request, "text/html", "gzip", file_index_html_start, file_index_html_end - file_index_html_start, __ETAG_WEBAPP_DIST_INDEX_HTML_GZ__);
     });
 
     server.onNotFound([&](AsyncWebServerRequest* request) {
-        responseBinaryDataWithETagCache(request, "text/html", "gzip", file_index_html_start, file_index_html_end - file_index_html_start);
+        responseBinaryDataWithETagCache(request, "text/html", "gzip", file_index_html_start, file_index_html_end - file_index_html_start, __ETAG_WEBAPP_DIST_INDEX_HTML_GZ__);
     });
 
     server.on("/index.html", HTTP_GET, [&](AsyncWebServerRequest* request) {
-        responseBinaryDataWithETagCache(request, "text/html", "gzip", file_index_html_start, file_index_html_end - file_index_html_start);
+        responseBinaryDataWithETagCache(request, "text/html", "gzip", file_index_html_start, file_index_html_end - file_index_html_start, __ETAG_WEBAPP_DIST_INDEX_HTML_GZ__);
     });
 
     server.on("/favicon.ico", HTTP_GET, [&](AsyncWebServerRequest* request) {
-        responseBinaryDataWithETagCache(request, "image/x-icon", "", file_favicon_ico_start, file_favicon_ico_end - file_favicon_ico_start);
+        responseBinaryDataWithETagCache(request, "image/x-icon", "", file_favicon_ico_start, file_favicon_ico_end - file_favicon_ico_start, __ETAG_WEBAPP_DIST_FAVICON_ICO__);
     });
 
     server.on("/favicon.png", HTTP_GET, [&](AsyncWebServerRequest* request) {
-        responseBinaryDataWithETagCache(request, "image/png", "", file_favicon_png_start, file_favicon_png_end - file_favicon_png_start);
+        responseBinaryDataWithETagCache(request, "image/png", "", file_favicon_png_start, file_favicon_png_end - file_favicon_png_start, __ETAG_WEBAPP_DIST_FAVICON_PNG__);
     });
 
     server.on("/zones.json", HTTP_GET, [&](AsyncWebServerRequest* request) {
-        responseBinaryDataWithETagCache(request, "application/json", "gzip", file_zones_json_start, file_zones_json_end - file_zones_json_start);
+        responseBinaryDataWithETagCache(request, "application/json", "gzip", file_zones_json_start, file_zones_json_end - file_zones_json_start, __ETAG_WEBAPP_DIST_ZONES_JSON_GZ__);
     });
 
     server.on("/site.webmanifest", HTTP_GET, [&](AsyncWebServerRequest* request) {
-        responseBinaryDataWithETagCache(request, "application/json", "", file_site_webmanifest_start, file_site_webmanifest_end - file_site_webmanifest_start);
+        responseBinaryDataWithETagCache(request, "application/json", "", file_site_webmanifest_start, file_site_webmanifest_end - file_site_webmanifest_start, __ETAG_WEBAPP_DIST_SITE_WEBMANIFEST__);
     });
 
     server.on("/js/app.js", HTTP_GET, [&](AsyncWebServerRequest* request) {
-        responseBinaryDataWithETagCache(request, "text/javascript", "gzip", file_app_js_start, file_app_js_end - file_app_js_start);
+        responseBinaryDataWithETagCache(request, "text/javascript", "gzip", file_app_js_start, file_app_js_end - file_app_js_start, __ETAG_WEBAPP_DIST_JS_APP_JS_GZ__);
+    });
+
+    // The browser checks it for a new build on every navigation, everything else comes from its cache
+    server.on("/sw.js", HTTP_GET, [&](AsyncWebServerRequest* request) {
+        responseBinaryDataWithETagCache(request, "text/javascript", "gzip", file_sw_js_start, file_sw_js_end - file_sw_js_start, __ETAG_WEBAPP_DIST_SW_JS_GZ__);
     });
+
+    // Views which are loaded on demand by the router
+    for (const WebappChunk_t* chunk = __WEBAPP_CHUNKS__; chunk->path != nullptr; chunk++) {
+        server.on(chunk->path, HTTP_GET, [this, chunk](AsyncWebServerRequest* request) {
+            responseImmutable(request, "text/javascript", chunk->data, chunk->len);
+        });
+    }
 }
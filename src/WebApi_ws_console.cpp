@@ -4,22 +4,41 @@
  */
 #include "WebApi_ws_console.h"
 #include "Configuration.h"
+#include "HeapTelemetry.h"
 #include "MessageOutput.h"
+#include "SessionToken.h"
+#include "TaskProfiler.h"
 #include "WebApi.h"
 #include "defaults.h"
+#include <ArduinoJson.h>
 
 WebApiWsConsoleClass::WebApiWsConsoleClass()
     : _ws("/console")
-    , _wsCleanupTask(1 * TASK_SECOND, TASK_FOREVER, std::bind(&WebApiWsConsoleClass::wsCleanupTaskCb, this))
+    , _sessionAuth([this](AsyncWebServerRequest* request, ArMiddlewareNext next) {
+        if (SessionToken.isAuthenticated(request)) {
+            return next();
+        }
+        _simpleDigestAuth.run(request, next);
+    })
+    , _wsCleanupTask(1 * TASK_SECOND, TASK_FOREVER)
 {
 }
 
 void WebApiWsConsoleClass::init(AsyncWebServer& server, Scheduler& scheduler)
 {
+    using std::placeholders::_1;
+    using std::placeholders::_2;
+    using std::placeholders::_3;
+    using std::placeholders::_4;
+    using std::placeholders::_5;
+    using std::placeholders::_6;
+
     server.addHandler(&_ws);
+    _ws.onEvent(std::bind(&WebApiWsConsoleClass::onWebsocketEvent, this, _1, _2, _3, _4, _5, _6));
     MessageOutput.register_ws_output(&_ws);
 
     scheduler.addTask(_wsCleanupTask);
+    TaskProfiler.setCallback(_wsCleanupTask, "WebApiWsConsole.wsCleanup", std::bind(&WebApiWsConsoleClass::wsCleanupTaskCb, this));
     _wsCleanupTask.enable();
 
     _simpleDigestAuth.setUsername(AUTH_USERNAME);
@@ -30,7 +49,7 @@ void WebApiWsConsoleClass::init(AsyncWebServer& server, Scheduler& scheduler)
 
 void WebApiWsConsoleClass::reload()
 {
-    _ws.removeMiddleware(&_simpleDigestAuth);
+    _ws.removeMiddleware(&_sessionAuth);
 
     auto const& config = Configuration.get();
 
@@ -40,11 +59,54 @@ void WebApiWsConsoleClass::reload()
 
     _ws.enable(false);
     _simpleDigestAuth.setPassword(config.Security.Password);
-    _ws.addMiddleware(&_simpleDigestAuth);
+    _ws.addMiddleware(&_sessionAuth);
     _ws.closeAll();
     _ws.enable(true);
 }
 
+void WebApiWsConsoleClass::onWebsocketEvent(AsyncWebSocket* server, AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t len)
+{
+    // Each client reads the console output from its own position
+    if (type == WS_EVT_CONNECT) {
+        MessageOutput.addWsClient(client->id());
+    } else if (type == WS_EVT_DISCONNECT) {
+        MessageOutput.removeWsClient(client->id());
+    } else if (type == WS_EVT_DATA) {
+        const AwsFrameInfo* info = static_cast<AwsFrameInfo*>(arg);
+        if (!info->final || info->index != 0 || info->len != len || info->opcode != WS_TEXT) {
+            return;
+        }
+
+        if (len > 0 && data[0] == '{') {
+            handleFilter(client, data, len);
+        } else if (len == strlen(WS_CONSOLE_GZIP_REQUEST) && memcmp(data, WS_CONSOLE_GZIP_REQUEST, len) == 0) {
+            MessageOutput.setWsClientGzip(client->id());
+        }
+    }
+}
+
+void WebApiWsConsoleClass::handleFilter(AsyncWebSocketClient* client, const uint8_t* data, const size_t len)
+{
+    JsonDocument doc(HeapTelemetry.getJsonAllocator(HeapTag_t::WebApi));
+    if (deserializeJson(doc, data, len) || !doc[WS_CONSOLE_FILTER_KEY].is<JsonObject>()) {
+        return;
+    }
+    JsonObject root = doc[WS_CONSOLE_FILTER_KEY];
+
+    MessageFilter_t filter = MessageOutput.getWsClientFilter(client->id());
+    for (JsonPair pair : root["levels"].as<JsonObject>()) {
+        MessageSubsystem_t subsystem;
+        MessageLevel_t level;
+        if (MessageOutput.parseSubsystem(pair.key().c_str(), subsystem)
+            && MessageOutput.parseLevel(pair.value() | "", level)) {
+            filter.Levels[static_cast<size_t>(subsystem)] = level;
+        }
+    }
+    filter.Meta = root["meta"] | filter.Meta;
+
+    MessageOutput.setWsClientFilter(client->id(), filter);
+}
+
 void WebApiWsConsoleClass::wsCleanupTaskCb()
 {
     // see: https://github.com/me-no-dev/ESPAsyncWebServer#limiting-the-number-of-web-socket-clients
@@ -4,11 +4,22 @@
  */
 #include "WebApi_ws_live.h"
 #include "Datastore.h"
+#include "EventBus.h"
+#include "HeapTelemetry.h"
+#include "LoopMonitor.h"
 #include "MessageOutput.h"
+#include "MqttFleet.h"
+#include "NtpSettings.h"
+#include "PublishCoordinator.h"
+#include "ResourceGovernor.h"
+#include "SessionToken.h"
+#include "TaskProfiler.h"
 #include "Utils.h"
 #include "WebApi.h"
 #include "defaults.h"
 #include <AsyncJson.h>
+#include <algorithm>
+#include <sys/time.h>
 
 #ifndef PIN_MAPPING_REQUIRED
 #define PIN_MAPPING_REQUIRED 0
@@ -16,8 +27,16 @@
 
 WebApiWsLiveClass::WebApiWsLiveClass()
     : _ws("/livedata")
-    , _wsCleanupTask(1 * TASK_SECOND, TASK_FOREVER, std::bind(&WebApiWsLiveClass::wsCleanupTaskCb, this))
-    , _sendDataTask(1 * TASK_SECOND, TASK_FOREVER, std::bind(&WebApiWsLiveClass::sendDataTaskCb, this))
+    , _events(WS_LIVE_EVENTS_URL)
+    , _sessionAuth([this](AsyncWebServerRequest* request, ArMiddlewareNext next) {
+        if (SessionToken.isAuthenticated(request)) {
+            return next();
+        }
+        _simpleDigestAuth.run(request, next);
+    })
+    , _wsCleanupTask(1 * TASK_SECOND, TASK_FOREVER)
+    , _sendDataTask(1 * TASK_SECOND, TASK_FOREVER)
+    , _flushTask(WS_LIVE_FLUSH_INTERVAL * TASK_MILLISECOND, TASK_FOREVER)
 {
 }
 
@@ -35,11 +54,27 @@ void WebApiWsLiveClass::init(AsyncWebServer& server, Scheduler& scheduler)
     server.addHandler(&_ws);
     _ws.onEvent(std::bind(&WebApiWsLiveClass::onWebsocketEvent, this, _1, _2, _3, _4, _5, _6));
 
+    // Ids of a new boot do not continue the ones a resuming client knows
+    _lastEventId = esp_random();
+    server.addHandler(&_events);
+    _events.onConnect(std::bind(&WebApiWsLiveClass::onEventsConnect, this, _1));
+
     scheduler.addTask(_wsCleanupTask);
+    TaskProfiler.setCallback(_wsCleanupTask, "WebApiWsLive.wsCleanup", std::bind(&WebApiWsLiveClass::wsCleanupTaskCb, this));
     _wsCleanupTask.enable();
 
     scheduler.addTask(_sendDataTask);
+    TaskProfiler.setCallback(_sendDataTask, "WebApiWsLive.sendData", std::bind(&WebApiWsLiveClass::sendDataTaskCb, this));
     _sendDataTask.enable();
+
+    // New data is sent right away, the interval only covers the periodic refresh
+    EventBus.subscribe(Event_t::StatisticsUpdated, _sendDataTask);
+    EventBus.subscribe(Event_t::LimitChanged, _sendDataTask);
+
+    scheduler.addTask(_flushTask);
+    TaskProfiler.setCallback(_flushTask, "WebApiWsLive.flush", std::bind(&WebApiWsLiveClass::flushTaskCb, this));
+    _flushTask.enable();
+
     _simpleDigestAuth.setUsername(AUTH_USERNAME);
     _simpleDigestAuth.setRealm("live websocket");
 
@@ -48,7 +83,8 @@ void WebApiWsLiveClass::init(AsyncWebServer& server, Scheduler& scheduler)
 
 void WebApiWsLiveClass::reload()
 {
-    _ws.removeMiddleware(&_simpleDigestAuth);
+    _ws.removeMiddleware(&_sessionAuth);
+    _events.removeMiddleware(&_sessionAuth);
 
     auto const& config = Configuration.get();
 
@@ -58,9 +94,12 @@ void WebApiWsLiveClass::reload()
 
     _ws.enable(false);
     _simpleDigestAuth.setPassword(config.Security.Password);
-    _ws.addMiddleware(&_simpleDigestAuth);
+    _ws.addMiddleware(&_sessionAuth);
     _ws.closeAll();
     _ws.enable(true);
+
+    _events.addMiddleware(&_sessionAuth);
+    _events.close();
 }
 
 void WebApiWsLiveClass::wsCleanupTaskCb()
@@ -71,52 +110,453 @@ void WebApiWsLiveClass::wsCleanupTaskCb()
 
 void WebApiWsLiveClass::sendDataTaskCb()
 {
-    // do nothing if no WS client is connected
-    if (_ws.count() == 0) {
+    // do nothing if no WS or SSE client is connected
+    const bool hasEventClients = _events.count() > 0;
+    if (_ws.count() == 0 && !hasEventClients) {
         return;
     }
 
+    if (!PublishCoordinator.beginSlice()) {
+        _sendDataTask.delay(PublishCoordinator.getWaitDelay() * TASK_MILLISECOND);
+        return;
+    }
+
+    _lastPublishStats.resize(Hoymiles.getNumInverters());
+    _deltaState.resize(Hoymiles.getNumInverters());
+
+    // Copy of the client states, the frames are sent outside of the lock
+    std::vector<ClientState_t> clients;
+    {
+        std::lock_guard<std::mutex> lock(_clientStatesMutex);
+        for (auto& client : _ws.getClients()) {
+            auto state = std::find_if(_clientStates.begin(), _clientStates.end(),
+                [&client](const ClientState_t& c) { return c.Id == client.id(); });
+            if (state != _clientStates.end()) {
+                clients.push_back(*state);
+            } else {
+                clients.push_back({ client.id() });
+            }
+        }
+    }
+
+    // Under pressure the clients only get the totals, the delta clients stay as they send little
+    if (ResourceGovernor.isShedding(ShedStep_t::WsDetail)) {
+        for (auto& client : clients) {
+            client.Detail = Detail_t::Totals;
+        }
+    }
+
+    _gzipClients.clear();
+    for (const auto& client : clients) {
+        if (client.Gzip) {
+            _gzipClients.push_back(client.Id);
+        }
+    }
+
+    const bool hasDeltaClients = std::any_of(clients.begin(), clients.end(),
+        [](const ClientState_t& c) { return c.Delta && !c.SnapshotPending; });
+    std::vector<uint32_t> snapshotClients;
+    for (const auto& client : clients) {
+        if (client.Delta && client.SnapshotPending) {
+            snapshotClients.push_back(client.Id);
+        }
+    }
+    const bool hasSnapshotPending = !snapshotClients.empty();
+
+    auto selectClients = [&clients](const uint64_t serial, const std::function<bool(const ClientState_t&)>& filter) {
+        std::vector<uint32_t> ids;
+        for (const auto& client : clients) {
+            if (filter(client) && (serial == 0 || client.isSubscribed(serial))) {
+                ids.push_back(client.Id);
+            }
+        }
+        return ids;
+    };
+
+    const bool forcePublish = _forcePublish.exchange(false);
+    bool hasPublished = false;
+    bool hasDeferred = false;
+
     // Loop all inverters
-    for (uint8_t i = 0; i < Hoymiles.getNumInverters(); i++) {
-        auto inv = Hoymiles.getInverterByPos(i);
-        if (inv == nullptr) {
-            continue;
+    Hoymiles.forEachInverter([&](InverterAbstract& inv, const uint8_t i) {
+        if (i >= _lastPublishStats.size() || i >= _deltaState.size()) {
+            return;
         }
 
-        const uint32_t lastUpdateInternal = inv->Statistics()->getLastUpdateFromInternal();
-        if (!((lastUpdateInternal > 0 && lastUpdateInternal > _lastPublishStats[i]) || (millis() - _lastPublishStats[i] > (10 * 1000)))) {
-            continue;
+        const uint32_t lastUpdateInternal = inv.Statistics()->getLastUpdateFromInternal();
+        const bool publish = forcePublish || (lastUpdateInternal > 0 && lastUpdateInternal > _lastPublishStats[i]) || (millis() - _lastPublishStats[i] > (10 * 1000));
+        if (!publish && !hasSnapshotPending) {
+            return;
         }
 
-        _lastPublishStats[i] = millis();
+        // Inverters which exceed the budget of the slice are sent in the next one. Not for
+        // snapshots and forced publishes as they are only requested once.
+        if (hasPublished && !forcePublish && !hasSnapshotPending && !PublishCoordinator.hasBudget()) {
+            hasDeferred = true;
+            return;
+        }
+
+        const bool newData = lastUpdateInternal > 0 && lastUpdateInternal > _lastPublishStats[i];
+        if (publish) {
+            _lastPublishStats[i] = millis();
+            hasPublished = true;
+        }
 
         try {
             std::lock_guard<std::mutex> lock(_mutex);
-            JsonDocument root;
-            JsonVariant var = root;
 
-            auto invArray = var["inverters"].to<JsonArray>();
-            auto invObject = invArray.add<JsonObject>();
+            // The channel data is only serialized if a client shows it
+            for (const Detail_t detail : { Detail_t::Full, Detail_t::Summary }) {
+                if (!publish) {
+                    break;
+                }
 
-            generateCommonJsonResponse(var);
-            generateInverterCommonJsonResponse(invObject, inv);
-            generateInverterChannelJsonResponse(invObject, inv);
+                const auto ids = selectClients(inv.serial(),
+                    [detail](const ClientState_t& c) { return !c.Delta && c.Detail == detail; });
+                const bool toEvents = hasEventClients && detail == Detail_t::Full;
+                if (ids.empty() && !toEvents) {
+                    continue;
+                }
 
-            if (!Utils::checkJsonAlloc(root, __FUNCTION__, __LINE__)) {
-                continue;
+                JsonDocument root(HeapTelemetry.getJsonAllocator(HeapTag_t::WebSocket));
+                JsonVariant var = root;
+
+                auto invArray = var["inverters"].to<JsonArray>();
+                auto invObject = invArray.add<JsonObject>();
+
+                generateCommonJsonResponse(var);
+                generateInverterCommonJsonResponse(invObject, inv);
+                if (detail == Detail_t::Full) {
+                    generateInverterChannelJsonResponse(invObject, inv);
+                }
+
+                if (Utils::checkJsonAlloc(root, __FUNCTION__, __LINE__)) {
+                    const auto buffer = serializeToBuffer(root);
+                    sendToClients(buffer, ids, i, false);
+                    if (toEvents) {
+                        sendEvent(buffer);
+                    }
+                }
+            }
+
+            // Clients which just switched to the delta protocol get the full document once, including the field ids
+            bool snapshotSent = false;
+            if (hasSnapshotPending) {
+                const auto ids = selectClients(inv.serial(),
+                    [](const ClientState_t& c) { return c.Delta && c.SnapshotPending; });
+                if (!ids.empty()) {
+                    JsonDocument root(HeapTelemetry.getJsonAllocator(HeapTag_t::WebSocket));
+                    JsonVariant var = root;
+
+                    auto invArray = var["inverters"].to<JsonArray>();
+                    auto invObject = invArray.add<JsonObject>();
+
+                    generateCommonJsonResponse(var);
+                    generateInverterCommonJsonResponse(invObject, inv);
+                    generateInverterChannelJsonResponse(invObject, inv, true);
+
+                    if (Utils::checkJsonAlloc(root, __FUNCTION__, __LINE__)) {
+                        sendToClients(serializeToBuffer(root), ids, i, false);
+                        snapshotSent = true;
+                    }
+                }
             }
 
-            String buffer;
-            serializeJson(root, buffer);
+            // The delta state is shared by all delta clients, so it is updated even if
+            // no client subscribed to this inverter. After a snapshot it is brought to the
+            // values just sent, as the next delta of the new client builds on them.
+            if ((publish && hasDeltaClients) || snapshotSent) {
+                JsonDocument root(HeapTelemetry.getJsonAllocator(HeapTag_t::WebSocket));
+                JsonVariant var = root;
 
-            _ws.textAll(buffer);
+                generateDeltaJsonResponse(var, inv, _deltaState[i]);
+
+                const auto ids = selectClients(inv.serial(),
+                    [](const ClientState_t& c) { return c.Delta && !c.SnapshotPending; });
+                if (!ids.empty() && Utils::checkJsonAlloc(root, __FUNCTION__, __LINE__)) {
+                    sendToClients(serializeToBuffer(root), ids, i, true);
+                }
+            }
+
+            if (newData) {
+                LoopMonitor.markWsFrame(millis() - lastUpdateInternal);
+            }
 
         } catch (const std::bad_alloc& bad_alloc) {
             MessageOutput.printf("Call to /api/livedata/status temporarely out of resources. Reason: \"%s\".\r\n", bad_alloc.what());
         } catch (const std::exception& exc) {
             MessageOutput.printf("Unknown exception in /api/livedata/status. Reason: \"%s\".\r\n", exc.what());
         }
+    });
+
+    // Clients which only show the totals get them once per run with new data
+    const auto totalsClients = selectClients(0,
+        [](const ClientState_t& c) { return !c.Delta && c.Detail == Detail_t::Totals; });
+    if (hasPublished && !totalsClients.empty()) {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        JsonDocument root(HeapTelemetry.getJsonAllocator(HeapTag_t::WebSocket));
+        JsonVariant var = root;
+
+        var["inverters"].to<JsonArray>();
+        generateCommonJsonResponse(var);
+
+        if (Utils::checkJsonAlloc(root, __FUNCTION__, __LINE__)) {
+            sendToClients(serializeToBuffer(root), totalsClients, WS_LIVE_TOTALS_FRAME, false);
+        }
+    }
+
+    // Clients which requested the delta protocol during this run get their snapshot next time
+    if (hasSnapshotPending) {
+        std::lock_guard<std::mutex> lock(_clientStatesMutex);
+        for (auto& client : _clientStates) {
+            if (std::find(snapshotClients.begin(), snapshotClients.end(), client.Id) != snapshotClients.end()) {
+                client.SnapshotPending = false;
+            }
+        }
+    }
+
+    PublishCoordinator.endSlice();
+    if (hasDeferred) {
+        _sendDataTask.delay(PublishCoordinator.getRetryDelay(PUBLISH_SLICE_GAP) * TASK_MILLISECOND);
+    }
+}
+
+AsyncWebSocketSharedBuffer WebApiWsLiveClass::serializeToBuffer(const JsonDocument& root)
+{
+    const size_t len = measureJson(root);
+
+    // A use count of 1 means only the pool holds the buffer. The count is only
+    // decreased by the client queues so a stale value just skips a free buffer.
+    int8_t freeSlot = -1;
+    for (uint8_t i = 0; i < _bufferPool.size(); i++) {
+        if (_bufferPool[i] == nullptr) {
+            _bufferPool[i] = std::make_shared<std::vector<uint8_t>>();
+        }
+        if (_bufferPool[i].use_count() > 1) {
+            continue;
+        }
+        if (freeSlot < 0 || _bufferPool[i]->capacity() >= len) {
+            freeSlot = i;
+        }
+        if (_bufferPool[i]->capacity() >= len) {
+            break;
+        }
     }
+
+    AsyncWebSocketSharedBuffer buffer = freeSlot >= 0 ? _bufferPool[freeSlot] : std::make_shared<std::vector<uint8_t>>();
+    buffer->resize(len);
+    serializeJson(root, buffer->data(), len);
+
+    return buffer;
+}
+
+void WebApiWsLiveClass::sendToClients(const AsyncWebSocketSharedBuffer& buffer, const std::vector<uint32_t>& ids, const uint8_t framePos, const bool delta)
+{
+    // Compressed once for all gzip clients and only if one of them gets the frame
+    AsyncWebSocketSharedBuffer compressed;
+
+    // Sending happens outside of the client state lock as a full client queue may raise a disconnect event
+    for (const auto id : ids) {
+        AsyncWebSocketClient* client = _ws.client(id);
+        if (client == nullptr) {
+            continue;
+        }
+        if (std::find(_gzipClients.begin(), _gzipClients.end(), id) == _gzipClients.end()) {
+            sendToClient(client, buffer, framePos, delta, false);
+            continue;
+        }
+        if (compressed == nullptr) {
+            compressed = compressBuffer(buffer);
+        }
+        sendToClient(client, compressed, framePos, delta, true);
+    }
+}
+
+AsyncWebSocketSharedBuffer WebApiWsLiveClass::compressBuffer(const AsyncWebSocketSharedBuffer& buffer)
+{
+    if (_gzip == nullptr) {
+        _gzip.reset(new GzipStream());
+    } else {
+        _gzip->reset();
+    }
+    _gzip->write(buffer->data(), buffer->size());
+    _gzip->finish();
+
+    auto compressed = std::make_shared<std::vector<uint8_t>>(_gzip->available());
+    _gzip->read(compressed->data(), compressed->size());
+
+    _gzipInput += buffer->size();
+    _gzipOutput += compressed->size();
+    return compressed;
+}
+
+void WebApiWsLiveClass::sendToClient(AsyncWebSocketClient* client, const AsyncWebSocketSharedBuffer& buffer, const uint8_t framePos, const bool delta, const bool binary)
+{
+    auto waiting = std::find_if(_waitingFrames.begin(), _waitingFrames.end(),
+        [client](const WaitingFrames_t& w) { return w.Id == client->id(); });
+    const bool isWaiting = waiting != _waitingFrames.end()
+        && framePos < waiting->Frames.size() && waiting->Frames[framePos] != nullptr;
+
+    if (!isWaiting && client->queueLen() < WS_LIVE_MAX_QUEUED_FRAMES) {
+        if (binary) {
+            client->binary(buffer);
+        } else {
+            client->text(buffer);
+        }
+        _framesSent++;
+        _bytesSent += buffer->size();
+        return;
+    }
+
+    // A delta builds on all previous ones and cannot replace them. The client
+    // gets a full document of every inverter instead once it caught up.
+    if (delta) {
+        requestSnapshot(client->id());
+        _resyncs++;
+        return;
+    }
+
+    // Latest wins: only the newest frame of an inverter waits for the client
+    if (waiting == _waitingFrames.end()) {
+        waiting = _waitingFrames.insert(_waitingFrames.end(), { client->id(), binary, {} });
+    }
+    if (waiting->Binary != binary) {
+        // The client switched to gzip frames, the frames of the other format are dropped
+        waiting->Frames.clear();
+        waiting->Binary = binary;
+    }
+    if (waiting->Frames.size() <= framePos) {
+        waiting->Frames.resize(framePos + 1);
+    }
+    if (waiting->Frames[framePos] != nullptr) {
+        _framesReplaced++;
+    }
+    waiting->Frames[framePos] = buffer;
+}
+
+void WebApiWsLiveClass::sendEvent(const AsyncWebSocketSharedBuffer& buffer)
+{
+    uint32_t id;
+    {
+        std::lock_guard<std::mutex> lock(_eventMutex);
+        id = ++_lastEventId;
+        _eventHistory[id % _eventHistory.size()] = { id, buffer };
+    }
+
+    const String message(reinterpret_cast<const char*>(buffer->data()), buffer->size());
+    _events.send(message.c_str(), WS_LIVE_EVENT_NAME, id);
+}
+
+void WebApiWsLiveClass::onEventsConnect(AsyncEventSourceClient* client)
+{
+    const uint32_t lastId = client->lastId();
+
+    std::vector<Event_t> replay;
+    bool complete = false;
+    {
+        std::lock_guard<std::mutex> lock(_eventMutex);
+        const int32_t missed = static_cast<int32_t>(_lastEventId - lastId);
+        complete = lastId != 0 && missed >= 0 && missed <= static_cast<int32_t>(_eventHistory.size());
+        if (complete) {
+            for (const auto& event : _eventHistory) {
+                if (event.Buffer != nullptr && static_cast<int32_t>(event.Id - lastId) > 0) {
+                    replay.push_back(event);
+                }
+            }
+        }
+    }
+
+    // A new client or one which missed too much gets all inverters with the next run
+    if (!complete) {
+        _forcePublish = true;
+        return;
+    }
+
+    std::sort(replay.begin(), replay.end(),
+        [](const Event_t& a, const Event_t& b) { return static_cast<int32_t>(a.Id - b.Id) < 0; });
+    for (const auto& event : replay) {
+        const String message(reinterpret_cast<const char*>(event.Buffer->data()), event.Buffer->size());
+        client->send(message.c_str(), WS_LIVE_EVENT_NAME, event.Id);
+    }
+}
+
+void WebApiWsLiveClass::requestSnapshot(const uint32_t clientId)
+{
+    std::lock_guard<std::mutex> lock(_clientStatesMutex);
+    for (auto& c : _clientStates) {
+        if (c.Id == clientId) {
+            c.SnapshotPending = true;
+            return;
+        }
+    }
+}
+
+void WebApiWsLiveClass::flushTaskCb()
+{
+    uint32_t waitingCount = 0;
+    for (auto& waiting : _waitingFrames) {
+        AsyncWebSocketClient* client = _ws.client(waiting.Id);
+        if (client == nullptr) {
+            waiting.Frames.clear();
+            continue;
+        }
+
+        for (auto& frame : waiting.Frames) {
+            if (frame == nullptr) {
+                continue;
+            }
+            if (client->queueLen() >= WS_LIVE_MAX_QUEUED_FRAMES) {
+                waitingCount++;
+                continue;
+            }
+            if (waiting.Binary) {
+                client->binary(frame);
+            } else {
+                client->text(frame);
+            }
+            _framesSent++;
+            _bytesSent += frame->size();
+            frame = nullptr;
+        }
+    }
+
+    _waitingFrames.erase(std::remove_if(_waitingFrames.begin(), _waitingFrames.end(),
+                             [](const WaitingFrames_t& w) {
+                                 return std::none_of(w.Frames.begin(), w.Frames.end(),
+                                     [](const AsyncWebSocketSharedBuffer& f) { return f != nullptr; });
+                             }),
+        _waitingFrames.end());
+
+    uint32_t clientCount = 0;
+    uint32_t depth = 0;
+    uint32_t maxDepth = 0;
+    for (auto& client : _ws.getClients()) {
+        const uint32_t len = client.queueLen();
+        clientCount++;
+        depth += len;
+        maxDepth = std::max(maxDepth, len);
+    }
+    _clientCount = clientCount;
+    _queueDepth = depth;
+    _maxQueueDepth = maxDepth;
+    _framesWaiting = waitingCount;
+}
+
+WsLiveStats_t WebApiWsLiveClass::getStats() const
+{
+    WsLiveStats_t stats;
+    stats.Clients = _clientCount;
+    stats.QueueDepth = _queueDepth;
+    stats.MaxQueueDepth = _maxQueueDepth;
+    stats.Waiting = _framesWaiting;
+    stats.Sent = _framesSent;
+    stats.SentBytes = _bytesSent;
+    stats.Replaced = _framesReplaced;
+    stats.Resyncs = _resyncs;
+    stats.GzipInput = _gzipInput;
+    stats.GzipOutput = _gzipOutput;
+    return stats;
 }
 
 void WebApiWsLiveClass::generateCommonJsonResponse(JsonVariant& root)
@@ -126,104 +566,350 @@ void WebApiWsLiveClass::generateCommonJsonResponse(JsonVariant& root)
     addTotalField(totalObj, "YieldDay", Datastore.getTotalAcYieldDayEnabled(), "Wh", Datastore.getTotalAcYieldDayDigits());
     addTotalField(totalObj, "YieldTotal", Datastore.getTotalAcYieldTotalEnabled(), "kWh", Datastore.getTotalAcYieldTotalDigits());
 
+    if (MqttFleet.isAggregator()) {
+        const MqttFleetTotal_t fleet = MqttFleet.getTotal();
+        auto fleetObj = root["fleet"].to<JsonObject>();
+        addTotalField(fleetObj, "Power", fleet.AcPower, "W", fleet.AcPowerDigits);
+        addTotalField(fleetObj, "YieldDay", fleet.AcYieldDay, "Wh", fleet.AcYieldDayDigits);
+        addTotalField(fleetObj, "YieldTotal", fleet.AcYieldTotal, "kWh", fleet.AcYieldTotalDigits);
+        fleetObj["dtus"] = fleet.DtuCount;
+        fleetObj["dtus_online"] = fleet.DtusOnline;
+        fleetObj["is_valid"] = fleet.IsValid;
+    }
+
+    const uint8_t hints = getHints();
     JsonObject hintObj = root["hints"].to<JsonObject>();
-    struct tm timeinfo;
-    hintObj["time_sync"] = !getLocalTime(&timeinfo, 5);
-    hintObj["radio_problem"] = (Hoymiles.getRadioNrf()->isInitialized() && (!Hoymiles.getRadioNrf()->isConnected() || !Hoymiles.getRadioNrf()->isPVariant())) || (Hoymiles.getRadioCmt()->isInitialized() && (!Hoymiles.getRadioCmt()->isConnected()));
-    hintObj["default_password"] = strcmp(Configuration.get().Security.Password, ACCESS_POINT_PASSWORD) == 0;
+    hintObj["time_sync"] = static_cast<bool>(hints & (1 << 0));
+    hintObj["radio_problem"] = static_cast<bool>(hints & (1 << 1));
+    hintObj["default_password"] = static_cast<bool>(hints & (1 << 2));
+    hintObj["pin_mapping_issue"] = static_cast<bool>(hints & (1 << 3));
+}
+
+// Bit 0: time_sync, 1: radio_problem, 2: default_password, 3: pin_mapping_issue
+uint8_t WebApiWsLiveClass::getHints()
+{
+    uint8_t hints = 0;
 
-    hintObj["pin_mapping_issue"] = PIN_MAPPING_REQUIRED && !PinMapping.isMappingSelected();
+    hints |= !NtpSettings.isTimeConfident() << 0;
+
+    bool radioProblem = Hoymiles.getRadioCmt()->isInitialized() && !Hoymiles.getRadioCmt()->isConnected();
+    for (uint8_t i = 0; i < HOY_NRF_RADIO_COUNT; i++) {
+        auto radio = Hoymiles.getRadioNrf(i);
+        radioProblem |= radio->isInitialized() && (!radio->isConnected() || !radio->isPVariant());
+    }
+    hints |= radioProblem << 1;
+    hints |= (strcmp(Configuration.get().Security.Password, ACCESS_POINT_PASSWORD) == 0) << 2;
+    hints |= (PIN_MAPPING_REQUIRED && !PinMapping.isMappingSelected()) << 3;
+
+    return hints;
 }
 
-void WebApiWsLiveClass::generateInverterCommonJsonResponse(JsonObject& root, std::shared_ptr<InverterAbstract> inv)
+// Everything /api/livedata/status is generated from. The totals depend on all
+// inverters, so all of them are part of it even if only one is requested.
+// It contains no data age, which would change with every request.
+std::vector<uint32_t> WebApiWsLiveClass::getStatusState()
 {
-    const INVERTER_CONFIG_T* inv_cfg = Configuration.getInverterConfig(inv->serial());
+    std::vector<uint32_t> state;
+    state.push_back(getHints());
+    state.push_back(MqttFleet.getGeneration());
+
+    Hoymiles.forEachInverter([&state](InverterAbstract& inv, const uint8_t) {
+        for (const Parser* parser : std::initializer_list<const Parser*> { inv.Statistics(), inv.SystemConfigPara(), inv.DevInfo(), inv.EventLog() }) {
+            state.push_back(parser->getGeneration());
+            state.push_back(parser->getLastUpdate());
+        }
+
+        state.push_back(getLastUpdateTime(inv));
+
+        state.push_back(inv.RadioStats.TxRequestData);
+        state.push_back(inv.RadioStats.TxReRequestFragment);
+        state.push_back(inv.RadioStats.RxSuccess);
+        state.push_back(inv.RadioStats.RxFailPartialAnswer);
+        state.push_back(inv.RadioStats.RxFailNoAnswer);
+        state.push_back(inv.RadioStats.RxFailCorruptData);
+        state.push_back(inv.isReachable() << 0 | inv.isProducing() << 1 | inv.getEnablePolling() << 2);
+    });
+
+    return state;
+}
+
+// Unix time of the last answer, 0 without one or while the time is not set. It is
+// derived from the uptime of the answer, so it does not change with the request time.
+uint32_t WebApiWsLiveClass::getLastUpdateTime(InverterAbstract& inv)
+{
+    const uint32_t lastUpdate = inv.Statistics()->getLastUpdate();
+    if (lastUpdate == 0 || !NtpSettings.isTimeSynced()) {
+        return 0;
+    }
+
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    const int64_t nowMs = static_cast<int64_t>(tv.tv_sec) * 1000 + tv.tv_usec / 1000;
+    return (nowMs - (millis() - lastUpdate)) / 1000;
+}
+
+void WebApiWsLiveClass::generateInverterCommonJsonResponse(JsonObject& root, InverterAbstract& inv, const bool withDataAge)
+{
+    const INVERTER_CONFIG_T* inv_cfg = Configuration.getInverterConfig(inv.serial());
     if (inv_cfg == nullptr) {
         return;
     }
 
-    root["serial"] = inv->serialString();
-    root["name"] = inv->name();
+    root["serial"] = inv.serialString();
+    root["name"] = inv.name();
     root["order"] = inv_cfg->Order;
-    root["data_age"] = (millis() - inv->Statistics()->getLastUpdate()) / 1000;
-    root["data_age_ms"] = millis() - inv->Statistics()->getLastUpdate();
-    root["poll_enabled"] = inv->getEnablePolling();
-    root["reachable"] = inv->isReachable();
-    root["producing"] = inv->isProducing();
-    root["limit_relative"] = inv->SystemConfigPara()->getLimitPercent();
-    if (inv->DevInfo()->getMaxPower() > 0) {
-        root["limit_absolute"] = inv->SystemConfigPara()->getLimitPercent() * inv->DevInfo()->getMaxPower() / 100.0;
+    if (withDataAge) {
+        root["data_age"] = inv.Statistics()->getDataAge() / 1000;
+        root["data_age_ms"] = inv.Statistics()->getDataAge();
+    } else {
+        root["last_update"] = getLastUpdateTime(inv);
+    }
+    root["poll_enabled"] = inv.getEnablePolling();
+    root["reachable"] = inv.isReachable();
+    root["producing"] = inv.isProducing();
+    root["limit_relative"] = inv.SystemConfigPara()->getLimitPercent();
+    if (inv.DevInfo()->getMaxPower() > 0) {
+        root["limit_absolute"] = inv.SystemConfigPara()->getLimitPercent() * inv.DevInfo()->getMaxPower() / 100.0;
     } else {
         root["limit_absolute"] = -1;
     }
-    root["radio_stats"]["tx_request"] = inv->RadioStats.TxRequestData;
-    root["radio_stats"]["tx_re_request"] = inv->RadioStats.TxReRequestFragment;
-    root["radio_stats"]["rx_success"] = inv->RadioStats.RxSuccess;
-    root["radio_stats"]["rx_fail_nothing"] = inv->RadioStats.RxFailNoAnswer;
-    root["radio_stats"]["rx_fail_partial"] = inv->RadioStats.RxFailPartialAnswer;
-    root["radio_stats"]["rx_fail_corrupt"] = inv->RadioStats.RxFailCorruptData;
-    root["radio_stats"]["rssi"] = inv->getLastRssi();
+    root["radio_stats"]["tx_request"] = inv.RadioStats.TxRequestData;
+    root["radio_stats"]["tx_re_request"] = inv.RadioStats.TxReRequestFragment;
+    root["radio_stats"]["rx_success"] = inv.RadioStats.RxSuccess;
+    root["radio_stats"]["rx_fail_nothing"] = inv.RadioStats.RxFailNoAnswer;
+    root["radio_stats"]["rx_fail_partial"] = inv.RadioStats.RxFailPartialAnswer;
+    root["radio_stats"]["rx_fail_corrupt"] = inv.RadioStats.RxFailCorruptData;
+    root["radio_stats"]["rssi"] = inv.getLastRssi();
+    root["radio_stats"]["tx_power_reduction"] = inv.getTxPowerControl().getReduction();
+
+    if (Hoymiles.isRadioNrf(inv.getRadio())) {
+        auto channels = root["radio_stats"]["channels"].to<JsonArray>();
+        for (uint8_t i = 0; i < NRF_CHANNEL_COUNT; i++) {
+            auto channel = channels.add<JsonObject>();
+            channel["channel"] = Hoymiles.getRadioNrf()->getChannel(i);
+            channel["rx_fragments"] = inv.NrfChannelStats.RxFragments[i];
+            channel["tx_request"] = inv.NrfChannelStats.TxRequests[i];
+            channel["tx_answered"] = inv.NrfChannelStats.TxAnswered[i];
+        }
+    }
 }
 
-void WebApiWsLiveClass::generateInverterChannelJsonResponse(JsonObject& root, std::shared_ptr<InverterAbstract> inv)
+void WebApiWsLiveClass::generateInverterStatusJsonResponse(JsonObject& root, InverterAbstract& inv, const WebApiFieldFilter_t& filter)
 {
-    const INVERTER_CONFIG_T* inv_cfg = Configuration.getInverterConfig(inv->serial());
+    if (!filter.Projected) {
+        generateInverterCommonJsonResponse(root, inv, false);
+        if (!filter.Serials.empty()) {
+            generateInverterChannelJsonResponse(root, inv);
+        }
+        return;
+    }
+
+    // Only what identifies the inverter, the radio statistics are not generated at all
+    root["serial"] = inv.serialString();
+    root["name"] = inv.name();
+    root["last_update"] = getLastUpdateTime(inv);
+    root["reachable"] = inv.isReachable();
+    root["producing"] = inv.isProducing();
+    generateInverterChannelJsonResponse(root, inv, false, &filter);
+}
+
+void WebApiWsLiveClass::generateInverterChannelJsonResponse(JsonObject& root, InverterAbstract& inv, const bool addFieldIds, const WebApiFieldFilter_t* filter)
+{
+    const INVERTER_CONFIG_T* inv_cfg = Configuration.getInverterConfig(inv.serial());
     if (inv_cfg == nullptr) {
         return;
     }
 
-    // Loop all channels
-    for (auto& t : inv->Statistics()->getChannelTypes()) {
-        auto chanTypeObj = root[inv->Statistics()->getChannelTypeName(t)].to<JsonObject>();
-        for (auto& c : inv->Statistics()->getChannelsByType(t)) {
-            if (t == TYPE_DC) {
+    for (auto& t : inv.Statistics()->getChannelTypes()) {
+        if (filter != nullptr && !filter->includesChannelType(t)) {
+            continue;
+        }
+        auto chanTypeObj = root[inv.Statistics()->getChannelTypeName(t)].to<JsonObject>();
+        if (t == TYPE_DC && filter == nullptr) {
+            for (auto& c : inv.Statistics()->getChannelsByType(t)) {
                 chanTypeObj[String(static_cast<uint8_t>(c))]["name"]["u"] = inv_cfg->channel[c].Name;
             }
-            addField(chanTypeObj, inv, t, c, FLD_PAC);
-            addField(chanTypeObj, inv, t, c, FLD_UAC);
-            addField(chanTypeObj, inv, t, c, FLD_IAC);
-            if (t == TYPE_INV) {
-                addField(chanTypeObj, inv, t, c, FLD_PDC, "Power DC");
-            } else {
-                addField(chanTypeObj, inv, t, c, FLD_PDC);
-            }
-            addField(chanTypeObj, inv, t, c, FLD_UDC);
-            addField(chanTypeObj, inv, t, c, FLD_IDC);
-            addField(chanTypeObj, inv, t, c, FLD_YD);
-            addField(chanTypeObj, inv, t, c, FLD_YT);
-            addField(chanTypeObj, inv, t, c, FLD_F);
-            addField(chanTypeObj, inv, t, c, FLD_T);
-            addField(chanTypeObj, inv, t, c, FLD_PF);
-            addField(chanTypeObj, inv, t, c, FLD_Q);
-            addField(chanTypeObj, inv, t, c, FLD_EFF);
-            if (t == TYPE_DC && inv->Statistics()->getStringMaxPower(c) > 0) {
-                addField(chanTypeObj, inv, t, c, FLD_IRR);
-                chanTypeObj[String(c)][inv->Statistics()->getChannelFieldName(t, c, FLD_IRR)]["max"] = inv->Statistics()->getStringMaxPower(c);
-            }
         }
     }
 
-    if (inv->Statistics()->hasChannelFieldValue(TYPE_INV, CH0, FLD_EVT_LOG)) {
-        root["events"] = inv->EventLog()->getEntryCount();
+    // Loop all channels
+    forEachChannelField(inv, [&root, &inv, addFieldIds](ChannelType_t t, ChannelNum_t c, FieldId_t f) {
+        auto chanTypeObj = root[inv.Statistics()->getChannelTypeName(t)].as<JsonObject>();
+        if (t == TYPE_INV && f == FLD_PDC) {
+            addField(chanTypeObj, inv, t, c, f, "Power DC", addFieldIds);
+        } else {
+            addField(chanTypeObj, inv, t, c, f, "", addFieldIds);
+        }
+        if (f == FLD_IRR) {
+            chanTypeObj[String(c)][inv.Statistics()->getChannelFieldName(t, c, FLD_IRR)]["max"] = inv.Statistics()->getStringMaxPower(c);
+        }
+    },
+        filter);
+
+    if (filter != nullptr) {
+        return;
+    }
+
+    if (inv.Statistics()->hasChannelFieldValue(TYPE_INV, CH0, FLD_EVT_LOG)) {
+        root["events"] = inv.EventLog()->getEntryCount();
     } else {
         root["events"] = -1;
     }
 }
 
-void WebApiWsLiveClass::addField(JsonObject& root, std::shared_ptr<InverterAbstract> inv, const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId, String topic)
+void WebApiWsLiveClass::generateDeltaJsonResponse(JsonVariant& root, InverterAbstract& inv, DeltaState_t& state)
 {
-    if (inv->Statistics()->hasChannelFieldValue(type, channel, fieldId)) {
+    if (state.Serial != inv.serial()) {
+        state = DeltaState_t();
+        state.Serial = inv.serial();
+    }
+
+    auto deltaObj = root["delta"].to<JsonObject>();
+
+    // Common inverter values are only sent if one of them has changed
+    const auto common = getCommonValues(inv);
+    if (!state.Valid || common != state.Common || state.Name != inv.name()) {
+        generateInverterCommonJsonResponse(deltaObj, inv);
+        state.Common = common;
+        state.Name = inv.name();
+    } else {
+        deltaObj["serial"] = inv.serialString();
+        deltaObj["data_age"] = inv.Statistics()->getDataAge() / 1000;
+        deltaObj["data_age_ms"] = inv.Statistics()->getDataAge();
+    }
+
+    // Channel fields are sent as "id": value pairs, the ids are part of the snapshot
+    auto valueObj = deltaObj["v"].to<JsonObject>();
+    size_t pos = 0;
+    forEachChannelField(inv, [&](ChannelType_t t, ChannelNum_t c, FieldId_t f) {
+        const float value = inv.Statistics()->getChannelFieldValue(t, c, f);
+        if (pos >= state.Values.size()) {
+            state.Values.push_back(value);
+        } else if (state.Valid && state.Values[pos] == value) {
+            pos++;
+            return;
+        } else {
+            state.Values[pos] = value;
+        }
+        valueObj[String(getFieldId(t, c, f))] = value;
+        pos++;
+    });
+    state.Values.resize(pos);
+    state.Valid = true;
+
+    JsonDocument commonDoc(HeapTelemetry.getJsonAllocator(HeapTag_t::WebSocket));
+    JsonVariant commonVar = commonDoc;
+    generateCommonJsonResponse(commonVar);
+
+    const std::array<float, 3> total = {
+        commonVar["total"]["Power"]["v"].as<float>(),
+        commonVar["total"]["YieldDay"]["v"].as<float>(),
+        commonVar["total"]["YieldTotal"]["v"].as<float>(),
+    };
+    if (!_deltaCommonValid || total != _deltaTotal) {
+        root["total"] = commonVar["total"];
+        _deltaTotal = total;
+    }
+
+    uint8_t hints = 0;
+    hints |= commonVar["hints"]["time_sync"].as<bool>() << 0;
+    hints |= commonVar["hints"]["radio_problem"].as<bool>() << 1;
+    hints |= commonVar["hints"]["default_password"].as<bool>() << 2;
+    hints |= commonVar["hints"]["pin_mapping_issue"].as<bool>() << 3;
+    if (!_deltaCommonValid || hints != _deltaHints) {
+        root["hints"] = commonVar["hints"];
+        _deltaHints = hints;
+    }
+
+    if (commonVar["fleet"].is<JsonObject>()) {
+        const std::array<float, 5> fleet = {
+            commonVar["fleet"]["Power"]["v"].as<float>(),
+            commonVar["fleet"]["YieldDay"]["v"].as<float>(),
+            commonVar["fleet"]["YieldTotal"]["v"].as<float>(),
+            commonVar["fleet"]["dtus_online"].as<float>(),
+            commonVar["fleet"]["is_valid"].as<bool>() ? 1.0f : 0.0f,
+        };
+        if (!_deltaCommonValid || fleet != _deltaFleet) {
+            root["fleet"] = commonVar["fleet"];
+            _deltaFleet = fleet;
+        }
+    }
+
+    _deltaCommonValid = true;
+}
+
+void WebApiWsLiveClass::forEachChannelField(InverterAbstract& inv, const std::function<void(ChannelType_t, ChannelNum_t, FieldId_t)>& cb, const WebApiFieldFilter_t* filter)
+{
+    static constexpr FieldId_t fields[] = {
+        FLD_PAC, FLD_UAC, FLD_IAC, FLD_PDC, FLD_UDC, FLD_IDC, FLD_YD,
+        FLD_YT, FLD_F, FLD_T, FLD_PF, FLD_Q, FLD_EFF
+    };
+
+    for (auto& t : inv.Statistics()->getChannelTypes()) {
+        if (filter != nullptr && !filter->includesChannelType(t)) {
+            continue;
+        }
+        for (auto& c : inv.Statistics()->getChannelsByType(t)) {
+            for (const auto f : fields) {
+                if ((filter == nullptr || filter->includesField(t, f)) && inv.Statistics()->hasChannelFieldValue(t, c, f)) {
+                    cb(t, c, f);
+                }
+            }
+            if (t == TYPE_DC && (filter == nullptr || filter->includesField(t, FLD_IRR))
+                && inv.Statistics()->getStringMaxPower(c) > 0
+                && inv.Statistics()->hasChannelFieldValue(t, c, FLD_IRR)) {
+                cb(t, c, FLD_IRR);
+            }
+        }
+    }
+}
+
+std::array<double, 14> WebApiWsLiveClass::getCommonValues(InverterAbstract& inv)
+{
+    const INVERTER_CONFIG_T* inv_cfg = Configuration.getInverterConfig(inv.serial());
+
+    return {
+        static_cast<double>(inv_cfg != nullptr ? inv_cfg->Order : 0),
+        static_cast<double>(inv.getEnablePolling()),
+        static_cast<double>(inv.isReachable()),
+        static_cast<double>(inv.isProducing()),
+        static_cast<double>(inv.SystemConfigPara()->getLimitPercent()),
+        static_cast<double>(inv.DevInfo()->getMaxPower()),
+        static_cast<double>(inv.RadioStats.TxRequestData),
+        static_cast<double>(inv.RadioStats.TxReRequestFragment),
+        static_cast<double>(inv.RadioStats.RxSuccess),
+        static_cast<double>(inv.RadioStats.RxFailNoAnswer),
+        static_cast<double>(inv.RadioStats.RxFailPartialAnswer),
+        static_cast<double>(inv.RadioStats.RxFailCorruptData),
+        static_cast<double>(inv.getLastRssi()),
+        static_cast<double>(inv.Statistics()->hasChannelFieldValue(TYPE_INV, CH0, FLD_EVT_LOG) ? inv.EventLog()->getEntryCount() : -1),
+    };
+}
+
+uint16_t WebApiWsLiveClass::getFieldId(const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId)
+{
+    return (static_cast<uint16_t>(type) * CH_CNT + channel) * FLD_CNT + fieldId;
+}
+
+void WebApiWsLiveClass::addField(JsonObject& root, InverterAbstract& inv, const ChannelType_t type, const ChannelNum_t channel, const FieldId_t fieldId, String topic, const bool addFieldId)
+{
+    if (inv.Statistics()->hasChannelFieldValue(type, channel, fieldId)) {
         String chanName;
         if (topic == "") {
-            chanName = inv->Statistics()->getChannelFieldName(type, channel, fieldId);
+            chanName = inv.Statistics()->getChannelFieldName(type, channel, fieldId);
         } else {
             chanName = topic;
         }
         String chanNum;
         chanNum = channel;
-        root[chanNum][chanName]["v"] = inv->Statistics()->getChannelFieldValue(type, channel, fieldId);
-        root[chanNum][chanName]["u"] = inv->Statistics()->getChannelFieldUnit(type, channel, fieldId);
-        root[chanNum][chanName]["d"] = inv->Statistics()->getChannelFieldDigits(type, channel, fieldId);
+        char value[FORMAT_FIXED_BUFFER_SIZE];
+        const size_t len = inv.Statistics()->getChannelFieldValueString(type, channel, fieldId, value, sizeof(value));
+        root[chanNum][chanName]["v"] = serialized(value, len);
+        root[chanNum][chanName]["u"] = inv.Statistics()->getChannelFieldUnit(type, channel, fieldId);
+        root[chanNum][chanName]["d"] = inv.Statistics()->getChannelFieldDigits(type, channel, fieldId);
+        if (addFieldId) {
+            root[chanNum][chanName]["id"] = getFieldId(type, channel, fieldId);
+        }
     }
 }
 
@@ -238,9 +924,101 @@ void WebApiWsLiveClass::onWebsocketEvent(AsyncWebSocket* server, AsyncWebSocketC
 {
     if (type == WS_EVT_CONNECT) {
         MessageOutput.printf("Websocket: [%s][%u] connect\r\n", server->url(), client->id());
+
+        // The new client gets all inverters with the next run instead of after their next update
+        _forcePublish = true;
     } else if (type == WS_EVT_DISCONNECT) {
         MessageOutput.printf("Websocket: [%s][%u] disconnect\r\n", server->url(), client->id());
+
+        std::lock_guard<std::mutex> lock(_clientStatesMutex);
+        _clientStates.erase(std::remove_if(_clientStates.begin(), _clientStates.end(),
+                                [client](const ClientState_t& c) { return c.Id == client->id(); }),
+            _clientStates.end());
+    } else if (type == WS_EVT_DATA) {
+        const AwsFrameInfo* info = static_cast<AwsFrameInfo*>(arg);
+        if (!info->final || info->index != 0 || info->len != len || info->opcode != WS_TEXT) {
+            return;
+        }
+
+        if (len > 0 && data[0] == '{') {
+            handleSubscription(client, data, len);
+            return;
+        }
+
+        const bool isGzip = len == strlen(WS_LIVE_GZIP_REQUEST) && memcmp(data, WS_LIVE_GZIP_REQUEST, len) == 0;
+        if (!isGzip && (len != strlen(WS_LIVE_DELTA_REQUEST) || memcmp(data, WS_LIVE_DELTA_REQUEST, len) != 0)) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(_clientStatesMutex);
+        auto state = std::find_if(_clientStates.begin(), _clientStates.end(),
+            [client](const ClientState_t& c) { return c.Id == client->id(); });
+        if (state == _clientStates.end()) {
+            state = _clientStates.insert(_clientStates.end(), { client->id() });
+        }
+
+        if (isGzip) {
+            state->Gzip = true;
+            MessageOutput.printf("Websocket: [%s][%u] gzip frames\r\n", server->url(), client->id());
+            return;
+        }
+
+        if (!state->Delta) {
+            MessageOutput.printf("Websocket: [%s][%u] delta protocol\r\n", server->url(), client->id());
+        }
+        state->Delta = true;
+        state->SnapshotPending = true;
+    }
+}
+
+void WebApiWsLiveClass::handleSubscription(AsyncWebSocketClient* client, const uint8_t* data, const size_t len)
+{
+    JsonDocument doc(HeapTelemetry.getJsonAllocator(HeapTag_t::WebSocket));
+    if (deserializeJson(doc, data, len) || !doc[WS_LIVE_SUBSCRIBE_KEY].is<JsonObject>()) {
+        return;
+    }
+    JsonObject subscribe = doc[WS_LIVE_SUBSCRIBE_KEY];
+
+    Detail_t detail = Detail_t::Full;
+    const String detailName = subscribe["detail"] | "full";
+    if (detailName == "summary") {
+        detail = Detail_t::Summary;
+    } else if (detailName == "totals") {
+        detail = Detail_t::Totals;
+    }
+
+    std::vector<uint64_t> serials;
+    for (JsonVariant serial : subscribe["inverters"].as<JsonArray>()) {
+        if (serials.size() >= WS_LIVE_MAX_SUBSCRIPTIONS) {
+            break;
+        }
+        const uint64_t value = serial.is<const char*>() ? strtoull(serial.as<const char*>(), nullptr, 16) : 0;
+        if (value != 0) {
+            serials.push_back(value);
+        }
     }
+
+    std::lock_guard<std::mutex> lock(_clientStatesMutex);
+    auto state = std::find_if(_clientStates.begin(), _clientStates.end(),
+        [client](const ClientState_t& c) { return c.Id == client->id(); });
+    if (state == _clientStates.end()) {
+        state = _clientStates.insert(_clientStates.end(), { client->id() });
+    }
+    state->Detail = detail;
+    state->Serials = std::move(serials);
+
+    // A delta client needs the full document of inverters it did not receive so far
+    if (state->Delta) {
+        state->SnapshotPending = true;
+    }
+
+    // The next run sends the newly subscribed data without waiting for an update
+    _forcePublish = true;
+}
+
+bool WebApiWsLiveClass::ClientState_t::isSubscribed(const uint64_t serial) const
+{
+    return Serials.empty() || std::find(Serials.begin(), Serials.end(), serial) != Serials.end();
 }
 
 void WebApiWsLiveClass::onLivedataStatus(AsyncWebServerRequest* request)
@@ -249,36 +1027,58 @@ void WebApiWsLiveClass::onLivedataStatus(AsyncWebServerRequest* request)
         return;
     }
 
+    const String etag = WebApi.generateETag(request, getStatusState());
+    if (WebApi.sendNotModified(request, etag)) {
+        return;
+    }
+
+    // Inverters which are not requested and fields which are not projected are not generated at all
+    const WebApiFieldFilter_t filter = WebApi.parseFieldFilter(request);
+
+    if (!WebApi.requestsMsgPack(request)) {
+        // Inverters are serialized one after another so the number of inverters does not affect the peak heap usage
+        WebApi.sendJsonArrayStream(
+            request, "inverters",
+            [this, filter](size_t index, JsonDocument& element) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                auto configGuard = Configuration.getReadGuard();
+
+                if (index >= Hoymiles.getNumInverters()) {
+                    return false;
+                }
+                auto inv = Hoymiles.getInverterByPos(index);
+                if (inv != nullptr && filter.includesInverter(inv->serial())) {
+                    JsonObject invObject = element.to<JsonObject>();
+                    generateInverterStatusJsonResponse(invObject, *inv, filter);
+                }
+                return true;
+            },
+            [this](JsonDocument& members) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                JsonVariant var = members;
+                generateCommonJsonResponse(var);
+            },
+            etag);
+        return;
+    }
+
     try {
         std::lock_guard<std::mutex> lock(_mutex);
-        AsyncJsonResponse* response = new AsyncJsonResponse();
+        auto configGuard = Configuration.getReadGuard();
+        AsyncJsonResponse* response = WebApi.createJsonResponse(request);
         auto& root = response->getRoot();
         auto invArray = root["inverters"].to<JsonArray>();
-        auto serial = WebApi.parseSerialFromRequest(request);
 
-        if (serial > 0) {
-            auto inv = Hoymiles.getInverterBySerial(serial);
-            if (inv != nullptr) {
+        Hoymiles.forEachInverter([&invArray, &filter](InverterAbstract& inv, const uint8_t) {
+            if (filter.includesInverter(inv.serial())) {
                 JsonObject invObject = invArray.add<JsonObject>();
-                generateInverterCommonJsonResponse(invObject, inv);
-                generateInverterChannelJsonResponse(invObject, inv);
+                generateInverterStatusJsonResponse(invObject, inv, filter);
             }
-        } else {
-            // Loop all inverters
-            for (uint8_t i = 0; i < Hoymiles.getNumInverters(); i++) {
-                auto inv = Hoymiles.getInverterByPos(i);
-                if (inv == nullptr) {
-                    continue;
-                }
-
-                JsonObject invObject = invArray.add<JsonObject>();
-                generateInverterCommonJsonResponse(invObject, inv);
-            }
-        }
+        });
 
         generateCommonJsonResponse(root);
 
-        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__);
+        WebApi.sendJsonResponse(request, response, __FUNCTION__, __LINE__, etag);
 
     } catch (const std::bad_alloc& bad_alloc) {
         MessageOutput.printf("Call to /api/livedata/status temporarely out of resources. Reason: \"%s\".\r\n", bad_alloc.what());
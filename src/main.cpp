@@ -2,24 +2,54 @@
 /*
  * Copyright (C) 2022-2024 Thomas Basler and others
  */
+#include "BootTiming.h"
 #include "Configuration.h"
+#include "CpuLoad.h"
+#include "DataFreshness.h"
 #include "Datastore.h"
 #include "Display_Graphic.h"
+#include "EventBus.h"
+#include "FlashWear.h"
+#include "FsWorker.h"
+#include "History.h"
 #include "I18n.h"
+#include "InfluxExport.h"
+#include "InverterCache.h"
+#include "InverterEmulatorMode.h"
 #include "InverterSettings.h"
+#include "KernelBenchmark.h"
 #include "Led_Single.h"
+#include "LinkHistory.h"
+#include "LoopMonitor.h"
+#include "LoopWakeup.h"
 #include "MessageOutput.h"
+#include "ModbusServer.h"
+#include "MqttCluster.h"
+#include "MqttFleet.h"
 #include "MqttHandleDtu.h"
+#include "MqttHandleFastLane.h"
 #include "MqttHandleHass.h"
 #include "MqttHandleInverter.h"
 #include "MqttHandleInverterTotal.h"
+#include "MqttJournal.h"
 #include "MqttSettings.h"
 #include "NetworkSettings.h"
 #include "NtpSettings.h"
+#include "PerfBenchmark.h"
 #include "PinMapping.h"
+#include "PollCalibration.h"
+#include "PowerManagement.h"
+#include "PowerController.h"
+#include "QueueBenchmark.h"
+#include "RawStatsExport.h"
+#include "ResourceGovernor.h"
 #include "RestartHelper.h"
 #include "Scheduler.h"
+#include "StatisticsSnapshot.h"
 #include "SunPosition.h"
+#include "SyslogExport.h"
+#include "TaskProfiler.h"
+#include "TimerService.h"
 #include "Utils.h"
 #include "WebApi.h"
 #include "defaults.h"
@@ -28,6 +58,54 @@
 #include <TaskScheduler.h>
 #include <esp_heap_caps.h>
 
+// Time (ms) after the end of setup() until the non-critical subsystems are initialized
+#ifndef DEFERRED_INIT_DELAY
+#define DEFERRED_INIT_DELAY 100
+#endif
+
+static void deferredInit()
+{
+    // Read languate pack
+    BootTiming.beginPhase("i18n");
+    MessageOutput.print("Reading language pack... ");
+    I18n.init(scheduler);
+    MessageOutput.println("done");
+
+    // Initialize Display
+    BootTiming.beginPhase("display");
+    MessageOutput.print("Initialize Display... ");
+    Display.init(scheduler);
+    MessageOutput.println("done");
+
+    // Initialize Home Assistant auto discovery
+    BootTiming.beginPhase("hass");
+    MqttHandleHass.init(scheduler);
+    BootTiming.endPhase();
+}
+
+static Task deferredInitTask(TASK_IMMEDIATE, TASK_ONCE);
+
+#ifdef FLASH_STRESS_TEST
+// Benchmark builds (env *_rx_bench) keep the flash busy to measure the rx handling
+// time while the flash cache is disabled and refilled, see opendtu_radio_rx_handling_us
+#define FLASH_STRESS_FILENAME "/flash_stress.bin"
+#define FLASH_STRESS_SIZE 4096
+#define FLASH_STRESS_INTERVAL 50
+
+static void flashStressTask(void*)
+{
+    static uint8_t buffer[FLASH_STRESS_SIZE];
+    for (;;) {
+        File f = LittleFS.open(FLASH_STRESS_FILENAME, "w");
+        if (f) {
+            f.write(buffer, sizeof(buffer));
+            f.close();
+        }
+        vTaskDelay(pdMS_TO_TICKS(FLASH_STRESS_INTERVAL));
+    }
+}
+#endif
+
 void setup()
 {
     // Move all dynamic allocations >512byte to psram (if available)
@@ -40,11 +118,20 @@ void setup()
     while (!Serial)
         yield();
 #endif
+    LoopWakeup.init();
+    EventBus.init();
+    LoopMonitor.init();
     MessageOutput.init(scheduler);
+    TaskProfiler.init(scheduler);
+    TimerService.init(scheduler);
+    CpuLoad.init(scheduler);
+    ResourceGovernor.init(scheduler);
+    PowerManagement.init();
     MessageOutput.println();
     MessageOutput.println("Starting OpenDTU");
 
     // Initialize file system
+    BootTiming.beginPhase("fs");
     MessageOutput.print("Initialize FS... ");
     if (!LittleFS.begin(false)) { // Do not format if mount failed
         MessageOutput.print("failed... trying to format...");
@@ -56,8 +143,20 @@ void setup()
     } else {
         MessageOutput.println("done");
     }
+    FsWorker.init();
+    FlashWear.init(scheduler);
+
+#ifdef FLASH_STRESS_TEST
+    MessageOutput.println("Flash stress test enabled");
+    xTaskCreate(flashStressTask, "FLASH_STRESS", 3072, nullptr, 1, nullptr);
+#endif
+
+#ifdef QUEUE_BENCHMARK
+    QueueBenchmark.start();
+#endif
 
     // Read configuration values
+    BootTiming.beginPhase("config");
     Configuration.init(scheduler);
     MessageOutput.print("Reading configuration... ");
     if (!Configuration.read()) {
@@ -73,12 +172,8 @@ void setup()
     }
     MessageOutput.println("done");
 
-    // Read languate pack
-    MessageOutput.print("Reading language pack... ");
-    I18n.init(scheduler);
-    MessageOutput.println("done");
-
     // Load PinMapping
+    BootTiming.beginPhase("pinmapping");
     MessageOutput.print("Reading PinMapping... ");
     if (PinMapping.init(Configuration.get().Dev_PinMapping)) {
         MessageOutput.print("found valid mapping ");
@@ -87,53 +182,123 @@ void setup()
     }
     MessageOutput.println("done");
 
+    // Initialize SunPosition
+    BootTiming.beginPhase("sunposition");
+    MessageOutput.print("Initialize SunPosition... ");
+    SunPosition.init(scheduler);
+    MessageOutput.println("done");
+
+    // Bring up the radios first so polling starts as soon as the time is known
+    BootTiming.beginPhase("radio");
+#ifdef INVERTER_EMULATOR
+    MessageOutput.println("Inverter emulator enabled");
+    InverterEmulatorMode.init(scheduler);
+#else
+    InverterSettings.init(scheduler);
+#endif
+    PollCalibration.init(scheduler);
+    InverterCache.init(scheduler);
+    Datastore.init(scheduler);
+    DataFreshness.init(scheduler);
+    History.init(scheduler);
+    LinkHistory.init(scheduler);
+
     // Initialize Network
+    BootTiming.beginPhase("network");
     MessageOutput.print("Initialize Network... ");
     NetworkSettings.init(scheduler);
     MessageOutput.println("done");
     NetworkSettings.applyConfig();
 
     // Initialize NTP
+    BootTiming.beginPhase("ntp");
     MessageOutput.print("Initialize NTP... ");
-    NtpSettings.init();
+    NtpSettings.init(scheduler);
     MessageOutput.println("done");
 
-    // Initialize SunPosition
-    MessageOutput.print("Initialize SunPosition... ");
-    SunPosition.init(scheduler);
-    MessageOutput.println("done");
+    // Needs the time to know the age of the snapshot
+    StatisticsSnapshot.init(scheduler);
 
     // Initialize MqTT
+    BootTiming.beginPhase("mqtt");
     MessageOutput.print("Initialize MqTT... ");
     MqttSettings.init();
     MqttHandleDtu.init(scheduler);
     MqttHandleInverter.init(scheduler);
     MqttHandleInverterTotal.init(scheduler);
-    MqttHandleHass.init(scheduler);
+    MqttHandleFastLane.init(scheduler);
+    MqttJournal.init(scheduler);
+    MqttCluster.init(scheduler);
+    MqttFleet.init(scheduler);
+    MessageOutput.println("done");
+
+    // Initialize power control, it receives the meter values by MqTT or the WebApi
+    BootTiming.beginPhase("powercontrol");
+    MessageOutput.print("Initialize power control... ");
+    PowerController.init(scheduler);
+    MessageOutput.println("done");
+
+    // Initialize the push exporter, the batches are sent by its own task
+    BootTiming.beginPhase("influx");
+    MessageOutput.print("Initialize Influx export... ");
+    InfluxExport.init(scheduler);
+    MessageOutput.println("done");
+
+    BootTiming.beginPhase("modbus");
+    MessageOutput.print("Initialize Modbus server... ");
+    ModbusServer.init(scheduler);
+    MessageOutput.println("done");
+
+    BootTiming.beginPhase("rawstats");
+    MessageOutput.print("Initialize raw statistics export... ");
+    RawStatsExport.init(scheduler);
+    MessageOutput.println("done");
+
+    BootTiming.beginPhase("syslog");
+    MessageOutput.print("Initialize syslog export... ");
+    SyslogExport.init(scheduler);
     MessageOutput.println("done");
 
     // Initialize WebApi
+    BootTiming.beginPhase("webapi");
     MessageOutput.print("Initialize WebApi... ");
     WebApi.init(scheduler);
     MessageOutput.println("done");
 
-    // Initialize Display
-    MessageOutput.print("Initialize Display... ");
-    Display.init(scheduler);
-    MessageOutput.println("done");
+#ifdef PERF_BENCHMARK
+    PerfBenchmark.init(scheduler);
+#endif
+
+#ifdef KERNEL_BENCHMARK
+    KernelBenchmark.init(scheduler);
+#endif
 
     // Initialize Single LEDs
+    BootTiming.beginPhase("led");
     MessageOutput.print("Initialize LEDs... ");
     LedSingle.init(scheduler);
     MessageOutput.println("done");
 
-    InverterSettings.init(scheduler);
-
-    Datastore.init(scheduler);
     RestartHelper.init(scheduler);
+    BootTiming.endPhase();
+
+    // Everything which is not required to poll the inverters is set up
+    // by the scheduler after the radio and network tasks ran for a moment
+    scheduler.addTask(deferredInitTask);
+    TaskProfiler.setCallback(deferredInitTask, "main.deferredInit", deferredInit);
+    deferredInitTask.enableDelayed(DEFERRED_INIT_DELAY);
 }
 
 void loop()
 {
-    scheduler.execute();
+    // Tasks woken up by an event run in the same pass of the scheduler
+    EventBus.dispatch();
+
+    // execute() returns true if no task was due
+    LoopMonitor.beginPass();
+    const bool idle = scheduler.execute();
+    LoopMonitor.endPass();
+    if (idle) {
+        LoopWakeup.sleep(scheduler);
+    }
 }
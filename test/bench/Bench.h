@@ -0,0 +1,150 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+// Timing and heap accounting of the bench suites, run with "pio test -e native_bench" on
+// the host or "pio test -e generic_esp32_bench" on the board. Each kernel is called once
+// to warm up and then BENCH_ITERATIONS times. The results are printed as
+// "PERF opendtu_bench_ns_per_op{...}" and "PERF opendtu_bench_heap_bytes_per_op{...}"
+// lines, pio-scripts/perf_compare.py compares them between two builds.
+//
+// Include it in one file per suite, it defines the allocation hooks: operator new on the
+// host, malloc wrapped by the linker (--wrap) on the board.
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <unity.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+#ifndef BENCH_ITERATIONS
+#ifdef ARDUINO
+#define BENCH_ITERATIONS 2000
+#else
+#define BENCH_ITERATIONS 100000
+#endif
+#endif
+
+// Calls per measurement, short enough that the 32 bit cycle counter does not wrap
+#define BENCH_CHUNK 100
+
+namespace Bench {
+
+inline bool counting = false;
+inline uint64_t heapBytes = 0;
+inline volatile uint32_t sink = 0;
+
+inline void countAlloc(const size_t size)
+{
+    if (counting) {
+        heapBytes += size;
+    }
+}
+
+#ifdef ARDUINO
+// CPU cycles, converted with the current clock
+inline uint32_t ticks() { return ESP.getCycleCount(); }
+inline double ticksToNs(const uint64_t ticks) { return ticks * 1000.0 / getCpuFrequencyMhz(); }
+#else
+inline uint64_t ticks()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+inline double ticksToNs(const uint64_t ticks) { return ticks; }
+#endif
+
+// f is one operation, its result is kept so the call is not optimized away
+template <typename F>
+void run(const char* kernel, const char* payload, F&& f)
+{
+    sink = sink + static_cast<uint32_t>(f());
+
+    uint64_t elapsed = 0;
+    heapBytes = 0;
+    counting = true;
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i += BENCH_CHUNK) {
+        const uint32_t n = std::min<uint32_t>(BENCH_CHUNK, BENCH_ITERATIONS - i);
+        const auto start = ticks();
+        for (uint32_t j = 0; j < n; j++) {
+            sink = sink + static_cast<uint32_t>(f());
+        }
+        elapsed += ticks() - start;
+    }
+    counting = false;
+
+    char line[160];
+    snprintf(line, sizeof(line), "PERF opendtu_bench_ns_per_op{kernel=\"%s\",payload=\"%s\"} %.1f",
+        kernel, payload, ticksToNs(elapsed) / BENCH_ITERATIONS);
+    TEST_MESSAGE(line);
+    snprintf(line, sizeof(line), "PERF opendtu_bench_heap_bytes_per_op{kernel=\"%s\",payload=\"%s\"} %.1f",
+        kernel, payload, static_cast<double>(heapBytes) / BENCH_ITERATIONS);
+    TEST_MESSAGE(line);
+}
+
+} // namespace Bench
+
+#ifdef ARDUINO
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+    Bench::countAlloc(size);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+    Bench::countAlloc(count * size);
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    Bench::countAlloc(size);
+    return __real_realloc(ptr, size);
+}
+}
+#else
+void* operator new(size_t size)
+{
+    Bench::countAlloc(size);
+    void* ptr = malloc(size > 0 ? size : 1);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+#endif
@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <cstdint>
+
+// Responses in the byte layout of the inverters, without the fragment headers and the
+// trailing crc16. The statistics come from InverterEmulator at run time.
+
+// AlarmData (0x11) of a HM-600 with five events: start, time calibration, PV-1 without
+// input until 06:20, a grid overvoltage at 13:05 and the evening shutdown
+static const uint8_t benchAlarmLog[] = {
+    0x00, 0x01,
+    0x00, 0x01, 0x00, 0x01, 0x57, 0x58, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x02, 0x00, 0x02, 0x57, 0x59, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0xd1, 0x00, 0x03, 0x57, 0x5d, 0x59, 0x1a, 0x00, 0x00, 0x00, 0x00,
+    0x30, 0x8d, 0x00, 0x04, 0x0f, 0x47, 0x0f, 0x65, 0x00, 0x00, 0x09, 0xf6,
+    0x20, 0x04, 0x00, 0x05, 0x78, 0x7a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+// GridOnProFilePara (0x02) of the EN 50549-1:2019 profile, eight sections
+static const uint8_t benchGridProfile[] = {
+    0x0a, 0x00, 0x00, 0x10,
+    0x00, 0x0a, 0x08, 0xfc, 0x07, 0x30, 0x00, 0x1e, 0x09, 0xe2, 0x00, 0x1e, 0x04, 0x0b, 0x00, 0x1e, 0x09, 0xe2,
+    0x10, 0x03, 0x13, 0x88, 0x12, 0x8e, 0x00, 0x01, 0x14, 0x1e, 0x00, 0x01, 0x12, 0x8e, 0x00, 0x0a, 0x14, 0x50, 0x00, 0x0a,
+    0x20, 0x00, 0x00, 0x01,
+    0x30, 0x03, 0x02, 0x58, 0x09, 0xe2, 0x07, 0xa3, 0x13, 0x92, 0x13, 0x7e,
+    0x40, 0x00, 0x00, 0x10, 0x00, 0x10,
+    0x50, 0x08, 0x00, 0x01, 0x13, 0x9c, 0x01, 0x90, 0x00, 0x10, 0x01, 0xf6, 0x13, 0x74,
+    0x60, 0x04, 0x00, 0x00, 0x09, 0xe2, 0x0a, 0x55, 0x00, 0x14,
+    0x70, 0x02, 0x00, 0x01, 0x00, 0x64,
+};
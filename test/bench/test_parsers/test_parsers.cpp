@@ -0,0 +1,194 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+
+// Times the parsers and checksums of lib/Hoymiles on complete responses. The statistics
+// of each inverter class are answered by InverterEmulator, so they have the byte layout
+// and size of the real ones. The alarm log and the grid profile are in payloads.h.
+#include "Bench.h"
+#include "payloads.h"
+#include <InverterEmulator.h>
+#include <commands/RealTimeRunDataCommand.h>
+#include <crc.h>
+#include <inverters/HMS_4CH.h>
+#include <inverters/HMT_6CH.h>
+#include <inverters/HM_4CH.h>
+#include <parser/AlarmLogParser.h>
+#include <parser/GridProfileParser.h>
+#include <vector>
+
+#define BENCH_DTU_SERIAL 0x199980000001
+
+struct StatsField_t {
+    ChannelType_t Type;
+    ChannelNum_t Channel;
+    FieldId_t Field;
+};
+
+static InverterEmulator emulator;
+
+// Response fragments of the emulator to a RealTimeRunData request of the inverter
+static std::vector<EmulatorPacket_t> requestStatistics(InverterAbstract& inv)
+{
+    RealTimeRunDataCommand cmd(&inv, BENCH_DTU_SERIAL, 1735689600);
+    std::vector<EmulatorPacket_t> answer;
+    emulator.handlePacket(cmd.getDataPayload(), cmd.getDataSize(), answer);
+    return answer;
+}
+
+// Fills the statistics of the inverter like a complete response does
+static void receiveStatistics(InverterAbstract& inv)
+{
+    const auto answer = requestStatistics(inv);
+    TEST_ASSERT_FALSE(answer.empty());
+
+    std::vector<uint8_t> payload;
+    for (const auto& fragment : answer) {
+        payload.insert(payload.end(), &fragment.Data[10], &fragment.Data[fragment.Len - 1]);
+    }
+    payload.resize(payload.size() - 2); // crc16
+
+    StatisticsParser* stats = inv.Statistics();
+    stats->beginAppendFragment();
+    stats->clearBuffer();
+    stats->appendFragment(0, payload.data(), payload.size());
+    stats->endAppendFragment();
+    stats->setLastUpdate(1);
+}
+
+static void benchStatistics(const char* payload, InverterAbstract& inv)
+{
+    inv.init();
+    TEST_ASSERT_TRUE(emulator.addInverter(inv.serial()));
+    receiveStatistics(inv);
+
+    StatisticsParser* stats = inv.Statistics();
+    std::vector<StatsField_t> fields;
+    for (auto& t : stats->getChannelTypes()) {
+        for (auto& c : stats->getChannelsByType(t)) {
+            for (uint8_t f = 0; f < FLD_CNT; f++) {
+                if (stats->hasChannelFieldValue(t, c, static_cast<FieldId_t>(f))) {
+                    fields.push_back({ t, c, static_cast<FieldId_t>(f) });
+                }
+            }
+        }
+    }
+    TEST_ASSERT_TRUE(fields.size() > 0);
+    TEST_ASSERT_TRUE(stats->getChannelFieldValue(TYPE_AC, CH0, FLD_PAC) > 0);
+
+    // One field per call, in the order a live frame reads them
+    size_t i = 0;
+    Bench::run("StatisticsParser::getChannelFieldValue", payload, [&]() {
+        const StatsField_t& f = fields[i];
+        i = (i + 1) % fields.size();
+        return stats->getChannelFieldValue(f.Type, f.Channel, f.Field);
+    });
+}
+
+static void test_statistics()
+{
+    HM_4CH hm(nullptr, 0x116100000001);
+    benchStatistics("HM_4CH", hm);
+
+    HMS_4CH hms(nullptr, 0x116400000002);
+    benchStatistics("HMS_4CH", hms);
+
+    HMT_6CH hmt(nullptr, 0x138200000003);
+    benchStatistics("HMT_6CH", hmt);
+}
+
+static void test_alarm_log()
+{
+    AlarmLogParser parser;
+    parser.beginAppendFragment();
+    parser.clearBuffer();
+    parser.appendFragment(0, benchAlarmLog, sizeof(benchAlarmLog));
+    parser.endAppendFragment();
+    parser.updateSequence();
+
+    const uint8_t count = parser.getEntryCount();
+    TEST_ASSERT_EQUAL_UINT8(5, count);
+
+    AlarmLogEntry_t entry;
+    parser.getLogEntry(3, entry);
+    TEST_ASSERT_EQUAL_UINT16(141, entry.MessageId);
+    TEST_ASSERT_EQUAL_STRING("Grid: Grid overvoltage", entry.Message);
+
+    uint8_t i = 0;
+    Bench::run("AlarmLogParser::getLogEntry", "HM_2CH", [&]() {
+        parser.getLogEntry(i, entry);
+        i = (i + 1) % count;
+        return entry.MessageId;
+    });
+}
+
+// A new response is decoded once by the first getProfile()
+static void test_grid_profile()
+{
+    GridProfileParser parser;
+    parser.restoreRawData(benchGridProfile, sizeof(benchGridProfile));
+
+    TEST_ASSERT_EQUAL_STRING("XX - EN 50549-1:2019", parser.getProfileName());
+    auto profile = parser.getProfile();
+    TEST_ASSERT_NOT_NULL(profile.get());
+    TEST_ASSERT_EQUAL_UINT8(8, profile->SectionCount);
+
+    Bench::run("GridProfileParser::getProfile", "EN_50549", [&]() {
+        parser.restoreRawData(benchGridProfile, sizeof(benchGridProfile));
+        return parser.getProfile()->ItemCount;
+    });
+}
+
+// Checksums of the largest statistics fragment
+static void test_crc()
+{
+    HM_4CH inv(nullptr, 0x116100000004);
+    TEST_ASSERT_TRUE(emulator.addInverter(inv.serial()));
+    const auto answer = requestStatistics(inv);
+    TEST_ASSERT_FALSE(answer.empty());
+    const EmulatorPacket_t& fragment = answer.front();
+
+    Bench::run("crc8", "fragment", [&]() {
+        return crc8(fragment.Data, fragment.Len - 1);
+    });
+    Bench::run("crc16", "fragment", [&]() {
+        return crc16(&fragment.Data[10], fragment.Len - 11);
+    });
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static int runTests()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_statistics);
+    RUN_TEST(test_alarm_log);
+    RUN_TEST(test_grid_profile);
+    RUN_TEST(test_crc);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup()
+{
+    // The serial monitor of "pio test" connects after the reset
+    delay(2000);
+    runTests();
+}
+
+void loop()
+{
+}
+#else
+int main()
+{
+    return runTests();
+}
+#endif
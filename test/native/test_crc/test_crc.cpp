@@ -0,0 +1,155 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+
+// Compares the three kernels of HOY_CRC_TABLE against each other and against the check
+// values of the algorithms, then times them. crc.cpp is compiled once per variant, each
+// into its own namespace.
+#include "crc.h"
+#include "types.h"
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <unity.h>
+
+#define CRC_SOURCE "../../../lib/Hoymiles/src/crc.cpp"
+
+namespace bitwise {
+#undef HOY_CRC_TABLE
+#define HOY_CRC_TABLE HOY_CRC_BITWISE
+#include CRC_SOURCE
+}
+
+namespace nibble {
+#undef HOY_CRC_TABLE
+#define HOY_CRC_TABLE HOY_CRC_NIBBLE
+#include CRC_SOURCE
+#undef CRC_TABLE_BITS
+#undef CRC_TABLE_SIZE
+}
+
+namespace byte {
+#undef HOY_CRC_TABLE
+#define HOY_CRC_TABLE HOY_CRC_BYTE
+#include CRC_SOURCE
+#undef CRC_TABLE_BITS
+#undef CRC_TABLE_SIZE
+}
+
+// Frames per timed run, enough to hide the resolution of the clock
+#define CRC_BENCH_ITERATIONS 200000
+
+static const uint8_t checkInput[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static std::vector<uint8_t> randomBuffer(std::mt19937& rng, const size_t len)
+{
+    std::vector<uint8_t> buf(len);
+    for (auto& b : buf) {
+        b = rng();
+    }
+    return buf;
+}
+
+static void test_check_values()
+{
+    // CRC-16/MODBUS and CRC-16/CCITT-FALSE of "123456789"
+    TEST_ASSERT_EQUAL_HEX16(0x4B37, bitwise::crc16(checkInput, sizeof(checkInput), 0xffff));
+    TEST_ASSERT_EQUAL_HEX16(0x4B37, nibble::crc16(checkInput, sizeof(checkInput), 0xffff));
+    TEST_ASSERT_EQUAL_HEX16(0x4B37, byte::crc16(checkInput, sizeof(checkInput), 0xffff));
+
+    TEST_ASSERT_EQUAL_HEX16(0x29B1, bitwise::crc16nrf24(checkInput, sizeof(checkInput) * 8, 0, 0xffff));
+    TEST_ASSERT_EQUAL_HEX16(0x29B1, nibble::crc16nrf24(checkInput, sizeof(checkInput) * 8, 0, 0xffff));
+    TEST_ASSERT_EQUAL_HEX16(0x29B1, byte::crc16nrf24(checkInput, sizeof(checkInput) * 8, 0, 0xffff));
+}
+
+static void test_crc8_equal()
+{
+    std::mt19937 rng(1);
+    for (uint8_t len = 0; len <= MAX_RF_PAYLOAD_SIZE; len++) {
+        const auto buf = randomBuffer(rng, len);
+        const uint8_t expected = bitwise::crc8(buf.data(), len);
+        TEST_ASSERT_EQUAL_HEX8(expected, nibble::crc8(buf.data(), len));
+        TEST_ASSERT_EQUAL_HEX8(expected, byte::crc8(buf.data(), len));
+    }
+}
+
+static void test_crc16_equal()
+{
+    std::mt19937 rng(2);
+    for (uint16_t len = 0; len <= 255; len++) {
+        const auto buf = randomBuffer(rng, len);
+        const uint16_t start = rng();
+        const uint16_t expected = bitwise::crc16(buf.data(), len, start);
+        TEST_ASSERT_EQUAL_HEX16(expected, nibble::crc16(buf.data(), len, start));
+        TEST_ASSERT_EQUAL_HEX16(expected, byte::crc16(buf.data(), len, start));
+    }
+}
+
+static void test_crc16nrf24_equal()
+{
+    // Every start and end bit, the packets of the nrf radio are not byte aligned
+    std::mt19937 rng(3);
+    const auto buf = randomBuffer(rng, MAX_RF_PAYLOAD_SIZE + 8);
+    for (uint16_t startBit = 0; startBit < 24; startBit++) {
+        for (uint16_t lenBits = 0; lenBits <= buf.size() * 8; lenBits++) {
+            const uint16_t expected = bitwise::crc16nrf24(buf.data(), lenBits, startBit, 0xffff);
+            TEST_ASSERT_EQUAL_HEX16(expected, nibble::crc16nrf24(buf.data(), lenBits, startBit, 0xffff));
+            TEST_ASSERT_EQUAL_HEX16(expected, byte::crc16nrf24(buf.data(), lenBits, startBit, 0xffff));
+        }
+    }
+}
+
+template <typename F>
+static void bench(const char* kernel, const char* impl, F&& f)
+{
+    std::mt19937 rng(4);
+    const auto buf = randomBuffer(rng, MAX_RF_PAYLOAD_SIZE);
+    volatile uint32_t sink = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < CRC_BENCH_ITERATIONS; i++) {
+        sink = sink + f(buf.data());
+    }
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    char line[128];
+    snprintf(line, sizeof(line), "PERF opendtu_bench_ns_per_op{kernel=\"%s\",impl=\"%s\"} %.1f",
+        kernel, impl, static_cast<double>(ns) / CRC_BENCH_ITERATIONS);
+    TEST_MESSAGE(line);
+}
+
+// Time of a 27 byte payload (crc8, crc16) and of a 32 byte nrf packet (crc16nrf24)
+static void test_bench()
+{
+    bench("crc8", "bitwise", [](const uint8_t* b) { return bitwise::crc8(b, 27); });
+    bench("crc8", "nibble", [](const uint8_t* b) { return nibble::crc8(b, 27); });
+    bench("crc8", "byte", [](const uint8_t* b) { return byte::crc8(b, 27); });
+    bench("crc16", "bitwise", [](const uint8_t* b) { return bitwise::crc16(b, 27, 0xffff); });
+    bench("crc16", "nibble", [](const uint8_t* b) { return nibble::crc16(b, 27, 0xffff); });
+    bench("crc16", "byte", [](const uint8_t* b) { return byte::crc16(b, 27, 0xffff); });
+    bench("crc16nrf24", "bitwise", [](const uint8_t* b) { return bitwise::crc16nrf24(b, 32 * 8, 9, 0xffff); });
+    bench("crc16nrf24", "nibble", [](const uint8_t* b) { return nibble::crc16nrf24(b, 32 * 8, 9, 0xffff); });
+    bench("crc16nrf24", "byte", [](const uint8_t* b) { return byte::crc16nrf24(b, 32 * 8, 9, 0xffff); });
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_check_values);
+    RUN_TEST(test_crc8_equal);
+    RUN_TEST(test_crc16_equal);
+    RUN_TEST(test_crc16nrf24_equal);
+    RUN_TEST(test_bench);
+    return UNITY_END();
+}
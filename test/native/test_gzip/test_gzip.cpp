@@ -0,0 +1,356 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+
+// Round trips of GzipStream through a small inflater. It decodes the stored and the
+// fixed Huffman blocks of RFC 1951, the only ones GzipStream writes, and checks the
+// gzip header and trailer of RFC 1952.
+#include <GzipStream.h>
+#include <random>
+#include <string>
+#include <unity.h>
+#include <vector>
+
+// Base values and extra bits of the length and distance codes (RFC 1951, 3.2.5)
+static const uint16_t lengthBase[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t lengthExtra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t distBase[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t distExtra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+class Inflater {
+public:
+    explicit Inflater(const std::vector<uint8_t>& in)
+        : _in(in)
+    {
+    }
+
+    // Returns false if the data is not a valid gzip stream
+    bool run(std::vector<uint8_t>& out)
+    {
+        if (_in.size() < 18 || _in[0] != 0x1f || _in[1] != 0x8b || _in[2] != 0x08 || _in[3] != 0x00) {
+            return false;
+        }
+        _bytePos = 10;
+
+        bool last = false;
+        while (!last) {
+            last = bits(1);
+            const uint32_t type = bits(2);
+            if (type == 0) {
+                if (!stored(out)) {
+                    return false;
+                }
+            } else if (type == 1) {
+                if (!fixed(out)) {
+                    return false;
+                }
+            } else {
+                return false;
+            }
+            if (_bytePos > _in.size()) {
+                return false;
+            }
+        }
+
+        // The trailer starts at the next byte
+        _bitCount = 0;
+        if (_bytePos + 8 != _in.size()) {
+            return false;
+        }
+        const uint32_t crc = le32(_bytePos);
+        const uint32_t size = le32(_bytePos + 4);
+        return crc == crc32(out) && size == out.size();
+    }
+
+    static uint32_t crc32(const std::vector<uint8_t>& data)
+    {
+        uint32_t crc = 0xffffffff;
+        for (const uint8_t b : data) {
+            crc ^= b;
+            for (int i = 0; i < 8; i++) {
+                crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0);
+            }
+        }
+        return ~crc;
+    }
+
+private:
+    uint32_t bits(const uint8_t count)
+    {
+        uint32_t value = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            if (_bitCount == 0) {
+                _bitBuffer = _bytePos < _in.size() ? _in[_bytePos] : 0;
+                _bytePos++;
+                _bitCount = 8;
+            }
+            value |= (_bitBuffer & 1) << i;
+            _bitBuffer >>= 1;
+            _bitCount--;
+        }
+        return value;
+    }
+
+    // Huffman codes start with their most significant bit
+    uint32_t code(const uint8_t count)
+    {
+        uint32_t value = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            value = (value << 1) | bits(1);
+        }
+        return value;
+    }
+
+    uint32_t le32(const size_t pos) const
+    {
+        return _in[pos] | _in[pos + 1] << 8 | _in[pos + 2] << 16 | static_cast<uint32_t>(_in[pos + 3]) << 24;
+    }
+
+    bool stored(std::vector<uint8_t>& out)
+    {
+        _bitCount = 0;
+        if (_bytePos + 4 > _in.size()) {
+            return false;
+        }
+        const uint16_t len = _in[_bytePos] | _in[_bytePos + 1] << 8;
+        const uint16_t nlen = _in[_bytePos + 2] | _in[_bytePos + 3] << 8;
+        _bytePos += 4;
+        if (len != static_cast<uint16_t>(~nlen) || _bytePos + len > _in.size()) {
+            return false;
+        }
+        out.insert(out.end(), _in.begin() + _bytePos, _in.begin() + _bytePos + len);
+        _bytePos += len;
+        return true;
+    }
+
+    // Fixed literal/length code (RFC 1951, 3.2.6)
+    uint16_t symbol()
+    {
+        uint32_t c = code(7);
+        if (c <= 0x17) {
+            return 256 + c;
+        }
+        c = (c << 1) | bits(1);
+        if (c >= 0x30 && c <= 0xbf) {
+            return c - 0x30;
+        }
+        if (c >= 0xc0 && c <= 0xc7) {
+            return 280 + c - 0xc0;
+        }
+        c = (c << 1) | bits(1);
+        return 144 + c - 0x190;
+    }
+
+    bool fixed(std::vector<uint8_t>& out)
+    {
+        while (_bytePos <= _in.size()) {
+            const uint16_t s = symbol();
+            if (s < 256) {
+                out.push_back(s);
+                continue;
+            }
+            if (s == 256) {
+                return true;
+            }
+            if (s > 285) {
+                return false;
+            }
+            const uint16_t len = lengthBase[s - 257] + bits(lengthExtra[s - 257]);
+            const uint32_t d = code(5);
+            if (d >= 30) {
+                return false;
+            }
+            const uint32_t dist = distBase[d] + bits(distExtra[d]);
+            if (dist > out.size() || dist > GZIP_STREAM_WINDOW_SIZE) {
+                return false;
+            }
+            for (uint16_t i = 0; i < len; i++) {
+                out.push_back(out[out.size() - dist]);
+            }
+        }
+        return false;
+    }
+
+    const std::vector<uint8_t>& _in;
+    size_t _bytePos = 0;
+    uint32_t _bitBuffer = 0;
+    uint8_t _bitCount = 0;
+};
+
+static GzipStream gzip;
+
+void setUp()
+{
+    gzip.reset();
+}
+
+void tearDown()
+{
+}
+
+static std::vector<uint8_t> readAll(GzipStream& stream)
+{
+    std::vector<uint8_t> out;
+    uint8_t buffer[97];
+    size_t len;
+    while ((len = stream.read(buffer, sizeof(buffer))) > 0) {
+        out.insert(out.end(), buffer, buffer + len);
+    }
+    return out;
+}
+
+// Writes the input in pieces of chunk bytes and reads the output after every write
+static std::vector<uint8_t> compress(const std::vector<uint8_t>& input, const size_t chunk)
+{
+    std::vector<uint8_t> out;
+    for (size_t pos = 0; pos < input.size(); pos += chunk) {
+        gzip.write(input.data() + pos, std::min(chunk, input.size() - pos));
+        const auto part = readAll(gzip);
+        out.insert(out.end(), part.begin(), part.end());
+    }
+    gzip.finish();
+    const auto part = readAll(gzip);
+    out.insert(out.end(), part.begin(), part.end());
+    return out;
+}
+
+static void assertRoundTrip(const std::vector<uint8_t>& input, const size_t chunk)
+{
+    gzip.reset();
+    const auto compressed = compress(input, chunk);
+    TEST_ASSERT_TRUE(gzip.isFinished());
+    TEST_ASSERT_EQUAL_UINT32(input.size(), gzip.getInputSize());
+    TEST_ASSERT_EQUAL_UINT32(compressed.size(), gzip.getOutputSize());
+
+    std::vector<uint8_t> output;
+    Inflater inflater(compressed);
+    TEST_ASSERT_TRUE(inflater.run(output));
+    TEST_ASSERT_EQUAL_size_t(input.size(), output.size());
+    TEST_ASSERT_TRUE(input == output);
+}
+
+static std::vector<uint8_t> metricsText(const size_t lines)
+{
+    std::string text;
+    char line[128];
+    for (size_t i = 0; i < lines; i++) {
+        snprintf(line, sizeof(line), "opendtu_PanelPower{serial=\"1161%08u\",unit=\"%u\",channel=\"%u\"} %u.%u\n",
+            static_cast<unsigned>(i / 16), static_cast<unsigned>(i % 2), static_cast<unsigned>(i % 4),
+            static_cast<unsigned>(i * 7 % 400), static_cast<unsigned>(i % 10));
+        text += line;
+    }
+    return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+static std::vector<uint8_t> randomData(const size_t len)
+{
+    std::mt19937 rng(1);
+    std::vector<uint8_t> data(len);
+    for (auto& b : data) {
+        b = rng();
+    }
+    return data;
+}
+
+static void test_empty()
+{
+    assertRoundTrip({}, 1);
+}
+
+static void test_short()
+{
+    assertRoundTrip({ 'a' }, 1);
+    assertRoundTrip({ 'a', 'b' }, 1);
+    assertRoundTrip({ 'a', 'a', 'a', 'a' }, 1);
+}
+
+static void test_text()
+{
+    const auto input = metricsText(2000);
+    for (const size_t chunk : { 1, 7, 258, 1024, 4096, 1000000 }) {
+        assertRoundTrip(input, chunk);
+    }
+
+    // Repeating lines shrink to a fraction
+    TEST_ASSERT_LESS_THAN(input.size() / 4, gzip.getOutputSize());
+}
+
+static void test_random()
+{
+    // Does not compress, the fixed codes make it at most 1/8 larger
+    const auto input = randomData(50000);
+    assertRoundTrip(input, 333);
+    TEST_ASSERT_LESS_THAN(input.size() * 9 / 8 + 32, gzip.getOutputSize());
+}
+
+static void test_runs()
+{
+    // Longest matches and the distance of 1, across several slides of the window
+    std::vector<uint8_t> input(10 * GZIP_STREAM_WINDOW_SIZE, 'x');
+    for (size_t i = 0; i < input.size(); i += 1500) {
+        input[i] = 'y';
+    }
+    assertRoundTrip(input, 100);
+    assertRoundTrip(input, input.size());
+}
+
+static void test_window_distance()
+{
+    // The same block at the largest distance the window allows
+    const auto block = randomData(GZIP_STREAM_WINDOW_SIZE / 2);
+    std::vector<uint8_t> input;
+    for (int i = 0; i < 6; i++) {
+        input.insert(input.end(), block.begin(), block.end());
+        const auto filler = randomData(GZIP_STREAM_WINDOW_SIZE / 2 - 16 + i);
+        input.insert(input.end(), filler.begin(), filler.end());
+    }
+    assertRoundTrip(input, 61);
+}
+
+static void test_corrupt_detected()
+{
+    // Makes sure the inflater is able to fail, a flipped bit breaks the crc
+    const auto input = metricsText(100);
+    auto compressed = compress(input, input.size());
+    compressed[compressed.size() / 2] ^= 0x10;
+
+    std::vector<uint8_t> output;
+    Inflater inflater(compressed);
+    TEST_ASSERT_FALSE(inflater.run(output));
+}
+
+static void test_write_after_finish()
+{
+    const uint8_t data[] = { 1, 2, 3 };
+    gzip.write(data, sizeof(data));
+    gzip.finish();
+    const auto first = readAll(gzip);
+    gzip.write(data, sizeof(data));
+    gzip.finish();
+    TEST_ASSERT_EQUAL_size_t(0, gzip.available());
+    TEST_ASSERT_EQUAL_UINT32(sizeof(data), gzip.getInputSize());
+
+    std::vector<uint8_t> output;
+    Inflater inflater(first);
+    TEST_ASSERT_TRUE(inflater.run(output));
+    TEST_ASSERT_EQUAL_size_t(sizeof(data), output.size());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_empty);
+    RUN_TEST(test_short);
+    RUN_TEST(test_text);
+    RUN_TEST(test_random);
+    RUN_TEST(test_runs);
+    RUN_TEST(test_window_distance);
+    RUN_TEST(test_corrupt_detected);
+    RUN_TEST(test_write_after_finish);
+    return UNITY_END();
+}
@@ -0,0 +1,173 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <HostClock.h>
+#include <Hoymiles.h>
+#include <HoymilesRadio.h>
+#include <InverterEmulator.h>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+// Time (us) from a request until the first fragment of the answer arrives
+#ifndef SIM_RADIO_ANSWER_DELAY
+#define SIM_RADIO_ANSWER_DELAY 8000
+#endif
+
+// Time (us) between two fragments of an answer
+#ifndef SIM_RADIO_FRAGMENT_GAP
+#define SIM_RADIO_FRAGMENT_GAP 2500
+#endif
+
+// Step (us) of the virtual clock between two loop calls
+#define SIM_RADIO_STEP 500
+
+struct SimFragment_t {
+    uint32_t Offset; // us after the request
+    fragment_t Fragment;
+};
+
+// Radio without a chip. Each transmitted packet is passed to a responder, by default
+// nothing answers. The fragments of the answer are replayed into the receive path at
+// their virtual time. Like HoymilesRadio_NRF::loop(), loop() parses the fragments which
+// arrived so far and then lets handleReceivedPackage() finish, retry or start a command.
+class SimRadio : public HoymilesRadio {
+public:
+    // Returns the fragments of the answer to the packet
+    using Responder = std::function<std::vector<SimFragment_t>(const uint8_t packet[], const uint8_t len)>;
+    // Called for each fragment of an answer, returning false drops it
+    using Filter = std::function<bool(fragment_t& fragment)>;
+
+    SimRadio()
+    {
+        _isInitialized = true;
+    }
+
+    void setResponder(Responder responder)
+    {
+        _responder = std::move(responder);
+    }
+
+    void setFilter(Filter filter)
+    {
+        _filter = std::move(filter);
+    }
+
+    // Answers like the emulated inverters, the fragments follow each other after the delay
+    static Responder emulatorResponder(InverterEmulator& emulator)
+    {
+        return [&emulator](const uint8_t packet[], const uint8_t len) {
+            std::vector<EmulatorPacket_t> answer;
+            emulator.handlePacket(packet, len, answer);
+            std::vector<SimFragment_t> trace;
+            for (size_t i = 0; i < answer.size(); i++) {
+                trace.push_back(makeFragment(SIM_RADIO_ANSWER_DELAY + i * SIM_RADIO_FRAGMENT_GAP, answer[i].Data, answer[i].Len));
+            }
+            return trace;
+        };
+    }
+
+    // Answers every request with the same recorded fragments
+    static Responder traceResponder(const std::vector<SimFragment_t>& trace)
+    {
+        return [trace](const uint8_t[], const uint8_t) { return trace; };
+    }
+
+    static SimFragment_t makeFragment(const uint32_t offset, const uint8_t data[], const uint8_t len)
+    {
+        SimFragment_t f = {};
+        f.Offset = offset;
+        f.Fragment.mainCmd = data[0];
+        f.Fragment.len = std::min<uint8_t>(len, MAX_RF_PAYLOAD_SIZE);
+        memcpy(f.Fragment.fragment, data, f.Fragment.len);
+        f.Fragment.rssi = -60;
+        return f;
+    }
+
+    void loop()
+    {
+        TimedLock<std::mutex> queueLock(_queueMutex, _queueLockStats);
+
+        while (!_air.empty() && _air.front().first <= HostClock::now()) {
+            const fragment_t f = _air.front().second;
+            _air.erase(_air.begin());
+
+            if (!checkFragmentCrc(f)) {
+                _crcErrors++;
+                continue;
+            }
+            auto inv = Hoymiles.getInverterByFragment(f);
+            if (inv != nullptr && inv->getRadio() == this) {
+                storeRxFragment(*inv, f);
+                _rxCount++;
+            }
+        }
+
+        handleReceivedPackage();
+    }
+
+    // Runs the loop on the virtual clock until the queue is empty and no command is
+    // pending. Returns false if that takes longer than timeout ms.
+    bool runUntilIdle(const uint32_t timeout = 60000)
+    {
+        const uint64_t end = HostClock::now() + timeout * 1000ULL;
+        for (;;) {
+            loop();
+            if (isIdle() && isQueueEmpty()) {
+                return true;
+            }
+            if (HostClock::now() >= end) {
+                return false;
+            }
+            HostClock::advance(SIM_RADIO_STEP);
+        }
+    }
+
+    uint32_t getTxCount() const { return _txCount; }
+    uint32_t getRxCount() const { return _rxCount; }
+    uint32_t getCrcErrors() const { return _crcErrors; }
+    const std::vector<uint8_t>& getLastTx() const { return _lastTx; }
+
+protected:
+    void sendEsbPacket(CommandAbstract& cmd) override
+    {
+        cmd.incrementSendCount();
+        cmd.setRouterAddress(DtuSerial().u64);
+
+        _txCount++;
+        _lastTx.assign(cmd.getDataPayload(), cmd.getDataPayload() + cmd.getDataSize());
+
+        if (_responder) {
+            const uint64_t now = HostClock::now();
+            for (auto f : _responder(_lastTx.data(), _lastTx.size())) {
+                if (_filter && !_filter(f.Fragment)) {
+                    continue;
+                }
+                const uint64_t time = now + f.Offset;
+                f.Fragment.rxTime = static_cast<uint32_t>(time);
+                auto it = std::upper_bound(_air.begin(), _air.end(), time,
+                    [](const uint64_t t, const std::pair<uint64_t, fragment_t>& a) { return t < a.first; });
+                _air.insert(it, { time, f.Fragment });
+            }
+        }
+
+        startRxPeriod(cmd);
+    }
+
+    void enterStandby() override { }
+    void leaveStandby() override { }
+    uint8_t getMaxTxPowerReduction() const override { return 0; }
+
+private:
+    Responder _responder;
+    Filter _filter;
+
+    // Fragments on their way, ordered by the time they arrive
+    std::vector<std::pair<uint64_t, fragment_t>> _air;
+
+    std::vector<uint8_t> _lastTx;
+    uint32_t _txCount = 0;
+    uint32_t _rxCount = 0;
+    uint32_t _crcErrors = 0;
+};
@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2025 Thomas Basler and others
+ */
+
+// Drives the command queue and the receive path of the library against the inverter
+// emulator on a virtual clock. SimRadio replays the fragments of the answers into
+// HoymilesRadio::storeRxFragment() like the interrupt of a real radio would.
+#include "SimRadio.h"
+#include <Arduino.h>
+#include <HostClock.h>
+#include <Hoymiles.h>
+#include <InverterEmulator.h>
+#include <chrono>
+#include <cstdio>
+#include <unity.h>
+
+// Requests of the throughput benchmark per inverter class
+#define SIM_BENCH_REQUESTS 200
+
+struct SimInverter_t {
+    const char* Class;
+    uint64_t Serial;
+};
+
+static const SimInverter_t simInverters[] = {
+    { "HM_1CH", 0x112100000001 },
+    { "HM_2CH", 0x114100000002 },
+    { "HM_4CH", 0x116100000003 },
+    { "HMS_1CH", 0x112400000004 },
+    { "HMS_2CH", 0x114400000005 },
+    { "HMS_4CH", 0x116400000006 },
+    { "HMT_4CH", 0x136100000007 },
+    { "HMT_6CH", 0x138200000008 },
+    { "HERF_2CH", 0x282100000009 },
+};
+
+static SimRadio radio;
+static InverterEmulator emulator;
+
+void setUp()
+{
+    radio.setResponder(SimRadio::emulatorResponder(emulator));
+    radio.setFilter(nullptr);
+    emulator.setLoss(0);
+}
+
+void tearDown()
+{
+    radio.runUntilIdle();
+}
+
+static std::shared_ptr<InverterAbstract> getInverter(const size_t idx)
+{
+    auto inv = Hoymiles.getInverterBySerial(simInverters[idx].Serial);
+    TEST_ASSERT_NOT_NULL_MESSAGE(inv.get(), simInverters[idx].Class);
+    inv->resetRadioStats();
+    return inv;
+}
+
+static void test_stats_round_trip()
+{
+    for (size_t i = 0; i < sizeof(simInverters) / sizeof(simInverters[0]); i++) {
+        auto inv = getInverter(i);
+        const uint32_t lastUpdate = inv->Statistics()->getLastUpdate();
+
+        HostClock::advance(1000000);
+        TEST_ASSERT_TRUE_MESSAGE(inv->sendStatsRequest(true), simInverters[i].Class);
+        TEST_ASSERT_TRUE_MESSAGE(radio.runUntilIdle(), simInverters[i].Class);
+
+        TEST_ASSERT_GREATER_THAN_UINT32_MESSAGE(lastUpdate, inv->Statistics()->getLastUpdate(), simInverters[i].Class);
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(1, inv->RadioStats.RxSuccess, simInverters[i].Class);
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, inv->RadioStats.TxReRequestFragment, simInverters[i].Class);
+        TEST_ASSERT_TRUE_MESSAGE(inv->Statistics()->getChannelFieldValue(TYPE_AC, CH0, FLD_PAC) > 0, simInverters[i].Class);
+    }
+}
+
+// A lost fragment is requested again, the answer is complete afterwards
+static void test_lost_fragment_is_requested()
+{
+    auto inv = getInverter(2);
+    bool dropped = false;
+    radio.setFilter([&dropped](fragment_t& f) {
+        if (!dropped && (f.fragment[9] & 0x7f) == 2) {
+            dropped = true;
+            return false;
+        }
+        return true;
+    });
+
+    TEST_ASSERT_TRUE(inv->sendStatsRequest(true));
+    TEST_ASSERT_TRUE(radio.runUntilIdle());
+
+    TEST_ASSERT_TRUE(dropped);
+    TEST_ASSERT_EQUAL_UINT32(1, inv->RadioStats.TxReRequestFragment);
+    TEST_ASSERT_EQUAL_UINT32(1, inv->RadioStats.RxSuccess);
+}
+
+// A fragment with a wrong crc is discarded by the radio and requested like a lost one
+static void test_corrupt_fragment_is_requested()
+{
+    auto inv = getInverter(2);
+    const uint32_t crcErrors = radio.getCrcErrors();
+    bool corrupted = false;
+    radio.setFilter([&corrupted](fragment_t& f) {
+        if (!corrupted && (f.fragment[9] & 0x7f) == 1) {
+            corrupted = true;
+            f.fragment[10] ^= 0x55;
+        }
+        return true;
+    });
+
+    TEST_ASSERT_TRUE(inv->sendStatsRequest(true));
+    TEST_ASSERT_TRUE(radio.runUntilIdle());
+
+    TEST_ASSERT_EQUAL_UINT32(crcErrors + 1, radio.getCrcErrors());
+    TEST_ASSERT_EQUAL_UINT32(1, inv->RadioStats.TxReRequestFragment);
+    TEST_ASSERT_EQUAL_UINT32(1, inv->RadioStats.RxSuccess);
+}
+
+// Without answer the request is sent again until the resend count is exceeded
+static void test_no_answer()
+{
+    auto inv = getInverter(2);
+    const uint32_t txCount = radio.getTxCount();
+    const uint32_t lastUpdate = inv->Statistics()->getLastUpdate();
+    radio.setResponder(nullptr);
+
+    TEST_ASSERT_TRUE(inv->sendStatsRequest(true));
+    TEST_ASSERT_TRUE(radio.runUntilIdle());
+
+    TEST_ASSERT_EQUAL_UINT32(1, inv->RadioStats.RxFailNoAnswer);
+    TEST_ASSERT_EQUAL_UINT32(0, inv->RadioStats.RxSuccess);
+    TEST_ASSERT_EQUAL_UINT32(1 + MAX_RESEND_COUNT, radio.getTxCount() - txCount);
+    TEST_ASSERT_EQUAL_UINT32(lastUpdate, inv->Statistics()->getLastUpdate());
+}
+
+// A recorded answer is replayed with its own timing
+static void test_replay_trace()
+{
+    auto inv = getInverter(0);
+
+    // Records the answer of the emulator once
+    std::vector<SimFragment_t> trace;
+    auto record = SimRadio::emulatorResponder(emulator);
+    radio.setResponder([&](const uint8_t packet[], const uint8_t len) {
+        trace = record(packet, len);
+        return trace;
+    });
+    TEST_ASSERT_TRUE(inv->sendStatsRequest(true));
+    TEST_ASSERT_TRUE(radio.runUntilIdle());
+    TEST_ASSERT_FALSE(trace.empty());
+
+    // The fragments arrive in reverse order and late, but within the rx window
+    for (size_t i = 0; i < trace.size(); i++) {
+        trace[i].Offset = 40000 - i * 3000;
+    }
+    radio.setResponder(SimRadio::traceResponder(trace));
+    inv->resetRadioStats();
+    const uint32_t lastUpdate = inv->Statistics()->getLastUpdate();
+
+    HostClock::advance(1000000);
+    TEST_ASSERT_TRUE(inv->sendStatsRequest(true));
+    TEST_ASSERT_TRUE(radio.runUntilIdle());
+
+    TEST_ASSERT_GREATER_THAN_UINT32(lastUpdate, inv->Statistics()->getLastUpdate());
+    TEST_ASSERT_EQUAL_UINT32(1, inv->RadioStats.RxSuccess);
+}
+
+// Host time to handle one stats request and its answer, and the round trip on the
+// virtual clock with the timing of SimRadio
+static void test_bench_throughput()
+{
+    char line[160];
+    for (size_t i = 0; i < sizeof(simInverters) / sizeof(simInverters[0]); i++) {
+        auto inv = getInverter(i);
+        const uint32_t rxCount = radio.getRxCount();
+        const uint64_t virtualStart = HostClock::now();
+
+        const auto start = std::chrono::steady_clock::now();
+        for (uint32_t n = 0; n < SIM_BENCH_REQUESTS; n++) {
+            inv->sendStatsRequest(true);
+            radio.runUntilIdle();
+        }
+        const auto end = std::chrono::steady_clock::now();
+
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(SIM_BENCH_REQUESTS, inv->RadioStats.RxSuccess, simInverters[i].Class);
+
+        const double ns = std::chrono::duration<double, std::nano>(end - start).count() / SIM_BENCH_REQUESTS;
+        snprintf(line, sizeof(line), "PERF opendtu_sim_ns_per_request{class=\"%s\"} %.0f", simInverters[i].Class, ns);
+        TEST_MESSAGE(line);
+        snprintf(line, sizeof(line), "PERF opendtu_sim_round_trip_us{class=\"%s\"} %" PRIu64,
+            simInverters[i].Class, (HostClock::now() - virtualStart) / SIM_BENCH_REQUESTS);
+        TEST_MESSAGE(line);
+        snprintf(line, sizeof(line), "PERF opendtu_sim_fragments_per_request{class=\"%s\"} %.1f",
+            simInverters[i].Class, static_cast<double>(radio.getRxCount() - rxCount) / SIM_BENCH_REQUESTS);
+        TEST_MESSAGE(line);
+    }
+}
+
+int main()
+{
+    Hoymiles.init();
+    Hoymiles.setMessageOutput(&Serial);
+    Hoymiles.setLogLevel(HOY_LOG_LEVEL_NONE);
+
+    for (const auto& inv : simInverters) {
+        emulator.addInverter(inv.Serial);
+        Hoymiles.addInverter(inv.Class, inv.Serial, &radio);
+    }
+
+    UNITY_BEGIN();
+    RUN_TEST(test_stats_round_trip);
+    RUN_TEST(test_lost_fragment_is_requested);
+    RUN_TEST(test_corrupt_fragment_is_requested);
+    RUN_TEST(test_no_answer);
+    RUN_TEST(test_replay_trace);
+    RUN_TEST(test_bench_throughput);
+    return UNITY_END();
+}
@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+// Host stand-in for the parts of the Arduino core and FreeRTOS the libraries use.
+// The time is virtual (see HostClock.h) and there are no tasks, creating one fails,
+// so the users fall back to their polling in the loop.
+#include "HostClock.h"
+#include "Stream.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <sys/time.h>
+#include <thread>
+#include <unistd.h>
+
+using std::max;
+using std::min;
+
+#define ARDUINO_ISR_ATTR
+#define ARDUINO_RUNNING_CORE 1
+
+#define RISING 0x01
+#define FALLING 0x02
+#define digitalPinToInterrupt(p) (p)
+
+inline unsigned long millis()
+{
+    return HostClock::now() / 1000;
+}
+
+inline unsigned long micros()
+{
+    return HostClock::now();
+}
+
+inline void delay(const uint32_t ms)
+{
+    HostClock::advance(ms * 1000ULL);
+}
+
+inline void delayMicroseconds(const uint32_t us)
+{
+    HostClock::advance(us);
+}
+
+inline void yield()
+{
+}
+
+inline bool psramFound()
+{
+    return false;
+}
+
+inline bool getLocalTime(struct tm* info, const uint32_t = 5000)
+{
+    const time_t now = time(nullptr);
+    localtime_r(&now, info);
+    return info->tm_year > (2016 - 1900);
+}
+
+// Writes to stdout
+class HostSerial : public Print {
+public:
+    size_t write(uint8_t c) override { return fwrite(&c, 1, 1, stdout); }
+    size_t write(const uint8_t* buffer, size_t size) override { return fwrite(buffer, 1, size, stdout); }
+    using Print::write;
+};
+inline HostSerial Serial;
+
+// FreeRTOS
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+typedef void* TaskHandle_t;
+typedef std::mutex* SemaphoreHandle_t;
+typedef std::mutex StaticSemaphore_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL 0
+#define pdPASS 1
+#define portMAX_DELAY UINT32_MAX
+#define pdMS_TO_TICKS(ms) (ms)
+#define portYIELD_FROM_ISR()
+#define taskYIELD() std::this_thread::yield()
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    return new std::mutex();
+}
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t)
+{
+    semaphore->lock();
+    return pdPASS;
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    semaphore->unlock();
+    return pdPASS;
+}
+
+inline BaseType_t xTaskCreatePinnedToCore(void (*)(void*), const char*, uint32_t, void*, uint32_t, TaskHandle_t*, BaseType_t)
+{
+    return pdFAIL;
+}
+
+inline void xTaskNotifyGive(TaskHandle_t) { }
+inline void vTaskNotifyGiveFromISR(TaskHandle_t, BaseType_t*) { }
+inline uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) { return 0; }
@@ -0,0 +1,9 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+// Host stand-in, there are no pins which could raise an interrupt
+inline void attachInterrupt(uint8_t, std::function<void(void)>, int) { }
+inline void detachInterrupt(uint8_t) { }
@@ -0,0 +1,17 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <cstdint>
+
+// Virtual time of the host builds. millis(), micros() and esp_timer_get_time() read it,
+// only the tests move it forward, so a run does not depend on the speed of the host.
+class HostClock {
+public:
+    static uint64_t now() { return _us; }
+    static void advance(const uint64_t us) { _us += us; }
+    static void set(const uint64_t us) { _us = us; }
+
+private:
+    // Starts after the boot like on the target, 0 often means "never" to the callers
+    static inline uint64_t _us = 1000000;
+};
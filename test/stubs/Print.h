@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+// Host stand-in for the Print class of the Arduino core
+class Print {
+public:
+    virtual ~Print() = default;
+
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size)
+    {
+        size_t n = 0;
+        while (size-- > 0) {
+            n += write(*buffer++);
+        }
+        return n;
+    }
+
+    size_t write(const char* str) { return write(reinterpret_cast<const uint8_t*>(str), strlen(str)); }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        const int len = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        if (len <= 0) {
+            return 0;
+        }
+        return write(reinterpret_cast<const uint8_t*>(buffer), std::min<size_t>(len, sizeof(buffer) - 1));
+    }
+
+    size_t print(const char* str) { return write(str); }
+    size_t print(const char c) { return write(static_cast<uint8_t>(c)); }
+    size_t print(const int value) { return printf("%d", value); }
+    size_t print(const unsigned value) { return printf("%u", value); }
+    size_t print(const long value) { return printf("%ld", value); }
+    size_t print(const unsigned long value) { return printf("%lu", value); }
+    size_t print(const double value, const int digits = 2) { return printf("%.*f", digits, value); }
+
+    size_t println() { return write("\r\n"); }
+    template <typename T>
+    size_t println(const T value)
+    {
+        const size_t n = print(value);
+        return n + println();
+    }
+};
@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <SPI.h>
+#include <cstdint>
+
+typedef enum {
+    RF24_PA_MIN = 0,
+    RF24_PA_LOW,
+    RF24_PA_HIGH,
+    RF24_PA_MAX,
+    RF24_PA_ERROR,
+} rf24_pa_dbm_e;
+
+typedef enum {
+    RF24_1MBPS = 0,
+    RF24_2MBPS,
+    RF24_250KBPS,
+} rf24_datarate_e;
+
+typedef enum {
+    RF24_CRC_DISABLED = 0,
+    RF24_CRC_8,
+    RF24_CRC_16,
+} rf24_crclength_e;
+
+// Host stand-in for the nrf24 driver: a chip which is never connected and never
+// receives anything. Tests feed the fragments through a radio of their own.
+class RF24 {
+public:
+    RF24(uint16_t, uint16_t) { }
+    bool begin(SPIClass*) { return false; }
+    bool isChipConnected() { return false; }
+    bool isPVariant() { return false; }
+    void setDataRate(rf24_datarate_e) { }
+    void enableDynamicPayloads() { }
+    void setCRCLength(rf24_crclength_e) { }
+    void setAddressWidth(uint8_t) { }
+    void setRetries(uint8_t, uint8_t) { }
+    void maskIRQ(bool, bool, bool) { }
+    void setPALevel(uint8_t, bool = true) { }
+    void setChannel(uint8_t channel) { _channel = channel; }
+    uint8_t getChannel() { return _channel; }
+    void openReadingPipe(uint8_t, uint64_t) { }
+    void openWritingPipe(uint64_t) { }
+    void startListening() { }
+    void stopListening() { }
+    void powerDown() { }
+    void powerUp() { }
+    bool available() { return false; }
+    uint8_t getDynamicPayloadSize() { return 0; }
+    bool testRPD() { return false; }
+    void read(void*, uint8_t) { }
+    bool startWrite(const void*, uint8_t, bool) { return false; }
+    void whatHappened(bool& txOk, bool& txFail, bool& rxReady) { txOk = txFail = rxReady = false; }
+    uint8_t flush_tx() { return 0; }
+    uint8_t flush_rx() { return 0; }
+
+private:
+    uint8_t _channel = 76;
+};
@@ -0,0 +1,12 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <cstdint>
+
+// Host stand-in for the SPI bus of the Arduino core
+class SPIClass {
+public:
+    explicit SPIClass(uint8_t = 0) { }
+    void begin(int8_t = -1, int8_t = -1, int8_t = -1, int8_t = -1) { }
+    void end() { }
+};
@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <stdint.h>
+
+// Host stand-in for lib/CMT2300a: a chip which is never connected and never receives
+// anything. The constants are the ones of the real driver.
+#define CMT2300A_ONE_STEP_SIZE 2500
+#define FH_OFFSET 100
+#define CMT_SPI_SPEED 4000000
+#define CMT_BASE_FREQ_900 900000000
+#define CMT_BASE_FREQ_860 860000000
+
+enum FrequencyBand_t {
+    BAND_860,
+    BAND_900,
+    FrequencyBand_Max,
+};
+
+class CMT2300A {
+public:
+    CMT2300A(const uint8_t, const uint8_t, const uint8_t, const uint8_t, const uint32_t = CMT_SPI_SPEED) { }
+    bool begin() { return false; }
+    bool isChipConnected() { return false; }
+    bool startListening() { return true; }
+    bool stopListening() { return true; }
+    bool available() { return false; }
+    void read(void*, const uint8_t) { }
+    bool write(const uint8_t*, const uint8_t) { return false; }
+    void setChannel(const uint8_t channel) { _channel = channel; }
+    uint8_t getChannel() { return _channel; }
+    uint8_t getDynamicPayloadSize() { return 0; }
+    int getRssiDBm() { return 0; }
+    bool setPALevel(const int8_t) { return true; }
+    bool rxFifoAvailable() { return false; }
+    void setPacketInterruptOnGpio2(const bool) { }
+
+    uint32_t getBaseFrequency() const { return getBaseFrequency(_frequencyBand); }
+    static constexpr uint32_t getBaseFrequency(FrequencyBand_t band)
+    {
+        return band == FrequencyBand_t::BAND_900 ? CMT_BASE_FREQ_900 : CMT_BASE_FREQ_860;
+    }
+    FrequencyBand_t getFrequencyBand() const { return _frequencyBand; }
+    void setFrequencyBand(const FrequencyBand_t mode) { _frequencyBand = mode; }
+    void flush_rx() { }
+
+private:
+    FrequencyBand_t _frequencyBand = FrequencyBand_t::BAND_860;
+    uint8_t _channel = 0;
+};
@@ -0,0 +1,6 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+// Host stand-in for the esp-idf header, the placement in IRAM/DRAM has no meaning there
+#define IRAM_ATTR
+#define DRAM_ATTR
@@ -0,0 +1,9 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include "HostClock.h"
+
+inline int64_t esp_timer_get_time()
+{
+    return HostClock::now();
+}
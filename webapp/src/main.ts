@@ -19,3 +19,15 @@ app.use(router);
 app.use(i18n);
 
 app.mount('#app');
+
+// Browsers only allow service workers in a secure context (https or localhost)
+if ('serviceWorker' in navigator && import.meta.env.PROD) {
+    // A new firmware activates its service worker at once, the page still runs the old app
+    const updating = navigator.serviceWorker.controller !== null;
+    navigator.serviceWorker.addEventListener('controllerchange', () => {
+        if (updating) {
+            window.location.reload();
+        }
+    });
+    navigator.serviceWorker.register('/sw.js').catch((error) => console.error(error));
+}
@@ -9,6 +9,16 @@ export interface CountryDef {
 export interface DtuConfig {
     serial: number;
     pollinterval: number;
+    adaptive_polling: boolean;
+    poll_calibration: boolean;
+    snapshot_polling: boolean;
+    freshness_slo_interval: number;
+    freshness_slo_age: number;
+    poll_calibrated_interval: number;
+    limit_min_interval: number;
+    limit_hysteresis: number;
+    night_standby: boolean;
+    tx_power_control: boolean;
     nrf_enabled: boolean;
     nrf_palevel: number;
     cmt_enabled: boolean;
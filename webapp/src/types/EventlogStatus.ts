@@ -3,9 +3,13 @@ export interface EventlogItem {
     message: string;
     start_time: number;
     end_time: number;
+    sequence: number;
 }
 
 export interface EventlogItems {
     count: number;
+    total: number;
+    offset: number;
+    sequence: number;
     events: Array<EventlogItem>;
 }
@@ -19,5 +19,11 @@ export interface Inverter {
     zero_day: boolean;
     clear_eventlog: boolean;
     yieldday_correction: boolean;
+    group: number;
+    stats_interval: number;
+    alarm_interval: number;
+    limit_interval: number;
+    alarm_on_demand: boolean;
+    gridprofile_on_demand: boolean;
     channel: Array<InverterChannel>;
 }
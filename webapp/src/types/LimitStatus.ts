@@ -1,5 +1,13 @@
+export interface LimitCommandStats {
+    requested: number;
+    sent: number;
+    coalesced: number;
+    suppressed: number;
+}
+
 export interface LimitStatus {
     limit_relative: number;
     max_power: number;
     limit_set_status: string;
+    limit_stats: LimitCommandStats;
 }
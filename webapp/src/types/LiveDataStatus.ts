@@ -3,6 +3,7 @@ export interface ValueObject {
     u: string; // unit
     d: number; // digits
     max: number;
+    id?: number; // field id used by the delta protocol
 }
 
 export interface InverterStatistics {
@@ -21,6 +22,13 @@ export interface InverterStatistics {
     Irradiation?: ValueObject;
 }
 
+export interface RadioChannelStatistics {
+    channel: number;
+    rx_fragments: number;
+    tx_request: number;
+    tx_answered: number;
+}
+
 export interface RadioStatistics {
     tx_request: number;
     tx_re_request: number;
@@ -29,6 +37,8 @@ export interface RadioStatistics {
     rx_fail_partial: number;
     rx_fail_corrupt: number;
     rssi: number;
+    tx_power_reduction?: number;
+    channels?: RadioChannelStatistics[];
 }
 
 export interface Inverter {
@@ -37,6 +47,7 @@ export interface Inverter {
     order: number;
     data_age: number;
     data_age_ms: number;
+    last_update?: number; // /api/livedata/status only, unix time instead of the data age
     poll_enabled: boolean;
     reachable: boolean;
     producing: boolean;
@@ -55,6 +66,12 @@ export interface Total {
     YieldTotal: ValueObject;
 }
 
+export interface FleetTotal extends Total {
+    dtus: number;
+    dtus_online: number;
+    is_valid: boolean;
+}
+
 export interface Hints {
     time_sync: boolean;
     default_password: boolean;
@@ -65,5 +82,16 @@ export interface Hints {
 export interface LiveData {
     inverters: Inverter[];
     total: Total;
+    fleet?: FleetTotal;
     hints: Hints;
 }
+
+export interface LiveDataDelta {
+    delta: Partial<Inverter> & { serial: string; v: Record<string, number> };
+    total?: Total;
+    fleet?: FleetTotal;
+    hints?: Hints;
+}
+
+// A message of the live data websocket
+export type LiveDataMessage = LiveData | LiveDataDelta;
@@ -8,6 +8,19 @@ export interface MqttConfig {
     mqtt_topic: string;
     mqtt_publish_interval: number;
     mqtt_clean_session: boolean;
+    mqtt_publish_on_change: boolean;
+    mqtt_json_payload: boolean;
+    mqtt_fast_lane_total_ac_power: boolean;
+    mqtt_fast_lane_total_dc_power: boolean;
+    mqtt_fast_lane_ac_power: boolean;
+    mqtt_fast_lane_dc_power: boolean;
+    mqtt_journal_enabled: boolean;
+    mqtt_journal_replay_rate: number;
+    mqtt_cluster_enabled: boolean;
+    mqtt_cluster_topic: string;
+    mqtt_fleet_publish: boolean;
+    mqtt_fleet_aggregate: boolean;
+    mqtt_fleet_topic: string;
     mqtt_retain: boolean;
     mqtt_tls: boolean;
     mqtt_root_ca_cert: string;
@@ -23,4 +36,5 @@ export interface MqttConfig {
     mqtt_hass_retain: boolean;
     mqtt_hass_topic: string;
     mqtt_hass_individualpanels: boolean;
+    mqtt_hass_device_discovery: boolean;
 }
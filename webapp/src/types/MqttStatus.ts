@@ -18,4 +18,17 @@ export interface MqttStatus {
     mqtt_hass_retain: boolean;
     mqtt_hass_topic: string;
     mqtt_hass_individualpanels: boolean;
+    mqtt_hass_device_discovery: boolean;
+    mqtt_cluster_enabled: boolean;
+    mqtt_cluster_topic: string;
+    mqtt_cluster_node: string;
+    mqtt_cluster_leader: string;
+    mqtt_cluster_nodes: number;
+    mqtt_cluster_owned: number;
+    mqtt_cluster_assigned: number;
+    mqtt_fleet_publish: boolean;
+    mqtt_fleet_aggregate: boolean;
+    mqtt_fleet_topic: string;
+    mqtt_fleet_dtus?: number;
+    mqtt_fleet_dtus_online?: number;
 }
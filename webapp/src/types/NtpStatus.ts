@@ -4,6 +4,8 @@ export interface NtpStatus {
     ntp_timezone_descr: string;
     ntp_status: boolean;
     ntp_localtime: string;
+    time_source: string;
+    time_confident: boolean;
     sun_risetime: string;
     sun_settime: string;
     sun_isDayPeriod: boolean;
@@ -7,6 +7,12 @@ export interface Nrf24 {
     cs: number;
 }
 
+export interface Nrf24Extra {
+    irq: number;
+    en: number;
+    cs: number;
+}
+
 export interface Cmt2300 {
     clk: number;
     cs: number;
@@ -43,6 +49,7 @@ export interface Device {
     name: string;
     links: Array<Links>;
     nrf24: Nrf24;
+    nrf24_1?: Nrf24Extra;
     cmt: Cmt2300;
     eth: Ethernet;
     display: Display;
@@ -2,6 +2,8 @@ export interface TaskDetail {
     name: string;
     stack_watermark: number;
     priority: number;
+    core: number | null;
+    cpu_load?: number;
 }
 
 export interface SystemStatus {
@@ -11,6 +13,8 @@ export interface SystemStatus {
     chipcores: number;
     cpufreq: number;
     cputemp: number;
+    cpu_load: number[];
+    cpu_load_exact: boolean;
     flashsize: number;
     // TaskDetails
     task_details: TaskDetail[];
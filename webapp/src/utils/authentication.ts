@@ -1,40 +1,114 @@
 import type { Emitter, EventType } from 'mitt';
 import type { Router } from 'vue-router';
+import { decodeMsgPack } from './msgpack';
 
-export function authHeader(): Headers {
-    // return authorization header with basic auth credentials
-    let user = null;
+interface StoredUser {
+    authdata?: string;
+    token?: string;
+    expires?: number;
+}
+
+function getUser(): StoredUser | null {
     try {
-        user = JSON.parse(localStorage.getItem('user') || '');
+        return JSON.parse(localStorage.getItem('user') || '');
     } catch {
         // continue regardless of error
     }
+    return null;
+}
+
+function hasValidToken(user: StoredUser | null): boolean {
+    return !!(user && user.token && user.expires && Date.now() < user.expires);
+}
+
+function storeToken(user: StoredUser, data: { token?: string; expires_in?: number }) {
+    if (data && data.token && data.expires_in) {
+        user.token = data.token;
+        // renew the token a minute before the device stops accepting it
+        user.expires = Date.now() + (data.expires_in - 60) * 1000;
+    }
+}
+
+let refreshPending = false;
+
+function refreshToken(user: StoredUser) {
+    if (refreshPending || !user.authdata) {
+        return;
+    }
+    refreshPending = true;
+
+    fetch('/api/security/login', {
+        method: 'POST',
+        headers: {
+            'X-Requested-With': 'XMLHttpRequest',
+            Authorization: 'Basic ' + user.authdata,
+        },
+    })
+        .then((response) => (response.ok ? response.json() : null))
+        .then((data) => {
+            const current = getUser();
+            if (data && current) {
+                storeToken(current, data);
+                localStorage.setItem('user', JSON.stringify(current));
+            }
+        })
+        .catch(() => {
+            // the basic credentials are used until the next try
+        })
+        .finally(() => {
+            refreshPending = false;
+        });
+}
+
+export function authHeader(): Headers {
+    // return authorization header with the session token or basic auth credentials
+    const user = getUser();
 
     const headers = new Headers();
     headers.append('X-Requested-With', 'XMLHttpRequest');
-    if (user && user.authdata) {
+    if (user && hasValidToken(user)) {
+        headers.append('Authorization', 'Bearer ' + user.token);
+    } else if (user && user.authdata) {
         headers.append('Authorization', 'Basic ' + user.authdata);
+        refreshToken(user);
     }
     return new Headers(headers);
 }
 
+// for POST requests with a JSON body, the device parses it without a copy
+export function authJsonHeader(): Headers {
+    const headers = authHeader();
+    headers.append('Content-Type', 'application/json');
+    return headers;
+}
+
 export function authUrl(): string {
-    let user = null;
-    try {
-        user = JSON.parse(localStorage.getItem('user') || '');
-    } catch {
-        // continue regardless of error
-    }
+    const user = getUser();
 
-    if (user && user.authdata) {
+    // websockets authenticate by the session cookie while the token is valid
+    if (user && user.authdata && !hasValidToken(user)) {
         return encodeURIComponent(atob(user.authdata)).replace('%3A', ':') + '@';
     }
     return '';
 }
 
 export function logout() {
+    // the device revokes the token, the cookie is sent along as well
+    const user = getUser();
+    const headers = new Headers();
+    headers.append('X-Requested-With', 'XMLHttpRequest');
+    if (user && hasValidToken(user)) {
+        headers.append('Authorization', 'Bearer ' + user.token);
+    }
+
     // remove user from local storage to log user out
     localStorage.removeItem('user');
+    fetch('/api/security/logout', {
+        method: 'POST',
+        headers: headers,
+    }).catch(() => {
+        // the token expires anyway
+    });
 }
 
 export function isLoggedIn(): boolean {
@@ -43,14 +117,14 @@ export function isLoggedIn(): boolean {
 
 export function login(username: string, password: string) {
     const requestOptions = {
-        method: 'GET',
+        method: 'POST',
         headers: {
             'X-Requested-With': 'XMLHttpRequest',
             Authorization: 'Basic ' + btoa(unescape(encodeURIComponent(username + ':' + password))),
         },
     };
 
-    return fetch('/api/security/authenticate', requestOptions)
+    return fetch('/api/security/login', requestOptions)
         .then(handleAuthResponse)
         .then((retVal) => {
             // login successful if there's a user in the response
@@ -58,6 +132,7 @@ export function login(username: string, password: string) {
                 // store user details and basic auth credentials in local storage
                 // to keep user logged in between page refreshes
                 retVal.authdata = btoa(unescape(encodeURIComponent(username + ':' + password)));
+                storeToken(retVal, retVal);
                 localStorage.setItem('user', JSON.stringify(retVal));
             }
 
@@ -71,8 +146,12 @@ export function handleResponse(
     router: Router,
     ignore_error: boolean = false
 ) {
-    return response.text().then((text) => {
-        const data = text && JSON.parse(text);
+    const contentType = response.headers.get('Content-Type') || '';
+    const body = contentType.includes('application/msgpack')
+        ? response.arrayBuffer().then((buffer) => decodeMsgPack(new Uint8Array(buffer)) as ReturnType<typeof JSON.parse>)
+        : response.text().then((text) => text && JSON.parse(text));
+
+    return body.then((data) => {
         if (!response.ok) {
             if (response.status === 401) {
                 // auto logout if 401 response returned from api
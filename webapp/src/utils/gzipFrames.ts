@@ -0,0 +1,24 @@
+// The live data and console websockets send gzip compressed binary frames after the
+// client requested them with the text message 'gzip'
+export function supportsGzipFrames(): boolean {
+    return typeof DecompressionStream !== 'undefined';
+}
+
+// Returns a function which passes the text of each frame to the handler. The
+// decompression is asynchronous, the frames are handled in the order of arrival.
+export function createFrameDecoder(handler: (text: string) => void): (data: string | ArrayBuffer) => void {
+    let pending = Promise.resolve();
+
+    return (data) => {
+        pending = pending
+            .then(async () => {
+                if (typeof data === 'string') {
+                    handler(data);
+                    return;
+                }
+                const stream = new Blob([data]).stream().pipeThrough(new DecompressionStream('gzip'));
+                handler(await new Response(stream).text());
+            })
+            .catch((error) => console.error(error));
+    };
+}
@@ -0,0 +1,115 @@
+// Minimal MessagePack decoder covering the types ArduinoJson's serializeMsgPack() emits
+export function decodeMsgPack(data: Uint8Array): unknown {
+    const view = new DataView(data.buffer, data.byteOffset, data.byteLength);
+    const decoder = new TextDecoder();
+    let pos = 0;
+
+    const readString = (len: number): string => {
+        const str = decoder.decode(data.subarray(pos, pos + len));
+        pos += len;
+        return str;
+    };
+
+    const readArray = (len: number): unknown[] => {
+        const arr = [];
+        for (let i = 0; i < len; i++) {
+            arr.push(read());
+        }
+        return arr;
+    };
+
+    const readMap = (len: number): Record<string, unknown> => {
+        const obj: Record<string, unknown> = {};
+        for (let i = 0; i < len; i++) {
+            const key = String(read());
+            obj[key] = read();
+        }
+        return obj;
+    };
+
+    const read = (): unknown => {
+        const type = view.getUint8(pos++);
+        let value: unknown;
+
+        if (type <= 0x7f) return type;
+        if (type >= 0xe0) return type - 0x100;
+        if ((type & 0xf0) == 0x80) return readMap(type & 0x0f);
+        if ((type & 0xf0) == 0x90) return readArray(type & 0x0f);
+        if ((type & 0xe0) == 0xa0) return readString(type & 0x1f);
+
+        switch (type) {
+            case 0xc0:
+                return null;
+            case 0xc2:
+                return false;
+            case 0xc3:
+                return true;
+            case 0xca:
+                value = view.getFloat32(pos);
+                pos += 4;
+                return value;
+            case 0xcb:
+                value = view.getFloat64(pos);
+                pos += 8;
+                return value;
+            case 0xcc:
+                return view.getUint8(pos++);
+            case 0xcd:
+                value = view.getUint16(pos);
+                pos += 2;
+                return value;
+            case 0xce:
+                value = view.getUint32(pos);
+                pos += 4;
+                return value;
+            case 0xcf:
+                value = Number(view.getBigUint64(pos));
+                pos += 8;
+                return value;
+            case 0xd0:
+                return view.getInt8(pos++);
+            case 0xd1:
+                value = view.getInt16(pos);
+                pos += 2;
+                return value;
+            case 0xd2:
+                value = view.getInt32(pos);
+                pos += 4;
+                return value;
+            case 0xd3:
+                value = Number(view.getBigInt64(pos));
+                pos += 8;
+                return value;
+            case 0xd9:
+                return readString(view.getUint8(pos++));
+            case 0xda:
+                value = view.getUint16(pos);
+                pos += 2;
+                return readString(value as number);
+            case 0xdb:
+                value = view.getUint32(pos);
+                pos += 4;
+                return readString(value as number);
+            case 0xdc:
+                value = view.getUint16(pos);
+                pos += 2;
+                return readArray(value as number);
+            case 0xdd:
+                value = view.getUint32(pos);
+                pos += 4;
+                return readArray(value as number);
+            case 0xde:
+                value = view.getUint16(pos);
+                pos += 2;
+                return readMap(value as number);
+            case 0xdf:
+                value = view.getUint32(pos);
+                pos += 4;
+                return readMap(value as number);
+        }
+
+        throw new Error('Unsupported MessagePack type 0x' + type.toString(16));
+    };
+
+    return read();
+}
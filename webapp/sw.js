@@ -0,0 +1,93 @@
+/* global self, caches, fetch, URL */
+
+// Keeps the app shell in the browser, so opening the web UI only causes API and
+// WebSocket requests on the DTU. The build hash is inserted by vite.config.ts: A new
+// firmware changes this file, the browser installs it in the background and the
+// cache of the previous build is dropped.
+const BUILD_HASH = '__BUILD_HASH__';
+const CACHE_NAME = 'opendtu-' + BUILD_HASH;
+
+const SHELL = ['/', '/js/app.js', '/zones.json', '/site.webmanifest', '/favicon.ico', '/favicon.png'];
+
+// Served from the cache and refreshed afterwards, they only change with an uploaded language pack
+const REVALIDATE = ['/api/i18n/languages', '/api/i18n/language'];
+
+// Never cached
+const NETWORK_ONLY = ['/api/', '/livedata', '/console'];
+
+self.addEventListener('install', (event) => {
+    event.waitUntil(
+        caches
+            .open(CACHE_NAME)
+            .then((cache) => cache.addAll(SHELL))
+            .then(() => self.skipWaiting())
+    );
+});
+
+self.addEventListener('activate', (event) => {
+    event.waitUntil(
+        caches
+            .keys()
+            .then((keys) => Promise.all(keys.filter((key) => key !== CACHE_NAME).map((key) => caches.delete(key))))
+            .then(() => self.clients.claim())
+    );
+});
+
+function cacheFirst(request) {
+    return caches.match(request).then((cached) => {
+        if (cached) {
+            return cached;
+        }
+        // The views are loaded on demand, their names contain the hash of the content
+        return fetch(request).then((response) => {
+            if (response.ok) {
+                const copy = response.clone();
+                caches.open(CACHE_NAME).then((cache) => cache.put(request, copy));
+            }
+            return response;
+        });
+    });
+}
+
+function staleWhileRevalidate(event) {
+    const update = fetch(event.request).then((response) => {
+        if (response.ok) {
+            const copy = response.clone();
+            caches.open(CACHE_NAME).then((cache) => cache.put(event.request, copy));
+        }
+        return response;
+    });
+
+    return caches.match(event.request).then((cached) => {
+        if (cached) {
+            event.waitUntil(update.catch(() => undefined));
+            return cached;
+        }
+        return update;
+    });
+}
+
+self.addEventListener('fetch', (event) => {
+    const request = event.request;
+    const url = new URL(request.url);
+    if (request.method !== 'GET' || url.origin !== self.location.origin) {
+        return;
+    }
+
+    if (REVALIDATE.includes(url.pathname)) {
+        event.respondWith(staleWhileRevalidate(event));
+        return;
+    }
+
+    if (NETWORK_ONLY.some((prefix) => url.pathname.startsWith(prefix))) {
+        return;
+    }
+
+    // All routes of the single page app are answered by index.html
+    if (request.mode === 'navigate') {
+        event.respondWith(caches.match('/').then((cached) => cached || fetch(request)));
+        return;
+    }
+
+    event.respondWith(cacheFirst(request));
+});
@@ -1,6 +1,6 @@
 import { fileURLToPath, URL } from 'node:url'
 
-import { defineConfig } from 'vite'
+import { defineConfig, type Plugin } from 'vite'
 import vue from '@vitejs/plugin-vue'
 
 import viteCompression from 'vite-plugin-compression';
@@ -8,6 +8,8 @@ import cssInjectedByJsPlugin from 'vite-plugin-css-injected-by-js'
 import VueI18nPlugin from '@intlify/unplugin-vue-i18n/vite'
 
 import path from 'path'
+import fs from 'fs'
+import { createHash } from 'crypto'
 
 // example 'vite.user.ts': export const proxy_target = '192.168.16.107'
 let proxy_target;
@@ -18,10 +20,38 @@ try {
     proxy_target = '192.168.20.110';
 }
 
+// Emits sw.js with the hash of the whole build, so every new build replaces the app shell
+// cached by the service worker. The public files are part of the hash as they are cached as well.
+function serviceWorker(): Plugin {
+  const root = path.dirname(fileURLToPath(import.meta.url));
+  return {
+    name: 'opendtu-service-worker',
+    apply: 'build',
+    generateBundle(_, bundle) {
+      const hash = createHash('sha256');
+      for (const name of Object.keys(bundle).sort()) {
+        const file = bundle[name];
+        hash.update(name);
+        hash.update(file.type === 'chunk' ? file.code : file.source);
+      }
+      const publicDir = path.resolve(root, 'public');
+      for (const name of fs.readdirSync(publicDir).sort()) {
+        hash.update(name);
+        hash.update(fs.readFileSync(path.resolve(publicDir, name)));
+      }
+
+      const source = fs.readFileSync(path.resolve(root, 'sw.js'), 'utf-8')
+        .replace('__BUILD_HASH__', hash.digest('hex').substring(0, 16));
+      this.emitFile({ type: 'asset', fileName: 'sw.js', source });
+    },
+  };
+}
+
 // https://vitejs.dev/config/
 export default defineConfig(({ command }) => { return {
   plugins: [
     vue(),
+    serviceWorker(),
     viteCompression({ deleteOriginFile: true, threshold: 0 }),
     cssInjectedByJsPlugin(),
     VueI18nPlugin({
@@ -48,10 +78,11 @@ export default defineConfig(({ command }) => { return {
     chunkSizeWarningLimit: 1024,
     rollupOptions: {
       output: {
-        // Only create one js file
-        inlineDynamicImports: true,
-        // Get rid of hash on js file
+        // The entry keeps a fixed name as it is referenced by index.html and revalidated by its ETag
         entryFileNames: 'js/app.js',
+        // The views are split into chunks named by their content hash, the firmware serves them
+        // as immutable (see pio-scripts/webapp_chunks.py)
+        chunkFileNames: 'js/[name]-[hash].js',
         // Get rid of hash on css file
         assetFileNames: "assets/[name].[ext]",
       },